@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Heap allocation accounting
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <libcamera/base/private.h>
+
+namespace libcamera {
+
+struct AllocationCounters {
+	uint64_t allocations = 0;
+	uint64_t bytes = 0;
+
+	AllocationCounters operator-(const AllocationCounters &other) const
+	{
+		return { allocations - other.allocations, bytes - other.bytes };
+	}
+};
+
+class AllocationTracker
+{
+public:
+	static bool enabled();
+
+	static AllocationCounters thread();
+	static AllocationCounters process();
+};
+
+} /* namespace libcamera */
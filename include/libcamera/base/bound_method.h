@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <new>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -23,6 +25,62 @@ enum ConnectionType {
 	ConnectionTypeBlocking,
 };
 
+#ifndef __DOXYGEN__
+namespace details {
+
+void *poolAllocate(std::size_t size);
+void poolDeallocate(void *ptr, std::size_t size);
+
+/*
+ * Allocator for the shared argument packs. It allocates the pack and the
+ * shared pointer control block from the libcamera memory pool in a single
+ * block, avoiding heap allocations for queued method invocations.
+ */
+template<typename T>
+class PackAllocator
+{
+public:
+	using value_type = T;
+
+	PackAllocator() = default;
+
+	template<typename U>
+	PackAllocator([[maybe_unused]] const PackAllocator<U> &other)
+	{
+	}
+
+	T *allocate(std::size_t n)
+	{
+		if constexpr (alignof(T) > alignof(std::max_align_t))
+			return std::allocator<T>().allocate(n);
+		else
+			return static_cast<T *>(poolAllocate(n * sizeof(T)));
+	}
+
+	void deallocate(T *ptr, std::size_t n)
+	{
+		if constexpr (alignof(T) > alignof(std::max_align_t))
+			std::allocator<T>().deallocate(ptr, n);
+		else
+			poolDeallocate(ptr, n * sizeof(T));
+	}
+
+	template<typename U>
+	bool operator==([[maybe_unused]] const PackAllocator<U> &other) const
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=([[maybe_unused]] const PackAllocator<U> &other) const
+	{
+		return false;
+	}
+};
+
+} /* namespace details */
+#endif /* __DOXYGEN__ */
+
 class BoundMethodPackBase
 {
 public:
@@ -72,6 +130,32 @@ public:
 	}
 	virtual ~BoundMethodBase() = default;
 
+#ifndef __DOXYGEN__
+	/*
+	 * Bound methods are created for every Object::invokeMethod() call,
+	 * allocate them from the memory pool.
+	 */
+	static void *operator new(std::size_t size)
+	{
+		return details::poolAllocate(size);
+	}
+
+	static void *operator new(std::size_t size, std::align_val_t align)
+	{
+		return ::operator new(size, align);
+	}
+
+	static void operator delete(void *ptr, std::size_t size)
+	{
+		details::poolDeallocate(ptr, size);
+	}
+
+	static void operator delete(void *ptr, std::size_t size, std::align_val_t align)
+	{
+		::operator delete(ptr, size, align);
+	}
+#endif /* __DOXYGEN__ */
+
 	template<typename T, std::enable_if_t<!std::is_same<Object, T>::value> * = nullptr>
 	bool match(T *obj) { return obj == obj_; }
 	bool match(Object *object) { return object == object_; }
@@ -145,7 +229,8 @@ public:
 		if (!this->object_)
 			return func_(args...);
 
-		auto pack = std::make_shared<PackType>(args...);
+		auto pack = std::allocate_shared<PackType>(details::PackAllocator<PackType>(),
+							   args...);
 		bool sync = BoundMethodBase::activatePack(pack, deleteMethod);
 		return sync ? pack->returnValue() : R();
 	}
@@ -180,7 +265,8 @@ public:
 			return (obj->*func_)(args...);
 		}
 
-		auto pack = std::make_shared<PackType>(args...);
+		auto pack = std::allocate_shared<PackType>(details::PackAllocator<PackType>(),
+							   args...);
 		bool sync = BoundMethodBase::activatePack(pack, deleteMethod);
 		return sync ? pack->returnValue() : R();
 	}
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Epoll-based event dispatcher
+ */
+
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/private.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/timer_wheel.h>
+#include <libcamera/base/unique_fd.h>
+#include <libcamera/base/utils.h>
+
+struct epoll_event;
+
+namespace libcamera {
+
+class EventNotifier;
+class Timer;
+
+class EventDispatcherEpoll final : public EventDispatcher
+{
+public:
+	EventDispatcherEpoll();
+	~EventDispatcherEpoll();
+
+	void registerEventNotifier(EventNotifier *notifier);
+	void unregisterEventNotifier(EventNotifier *notifier);
+
+	void registerTimer(Timer *timer);
+	void unregisterTimer(Timer *timer);
+
+	void processEvents();
+	void interrupt();
+
+private:
+	struct EventNotifierSetEpoll {
+		uint32_t events() const;
+		EventNotifier *notifiers[3];
+	};
+
+	int updateFd(int fd, uint32_t oldEvents, uint32_t newEvents);
+	void updateTimer();
+	void processInterrupt();
+	void processTimerfd();
+	void processNotifiers(const struct epoll_event &event);
+	void processTimers();
+
+	std::map<int, EventNotifierSetEpoll> notifiers_;
+	TimerWheel timers_;
+	UniqueFD epollfd_;
+	UniqueFD eventfd_;
+	UniqueFD timerfd_;
+	utils::time_point timerDeadline_;
+	std::vector<struct epoll_event> events_;
+
+	int processingFd_;
+};
+
+} /* namespace libcamera */
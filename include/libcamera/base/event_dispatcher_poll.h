@@ -7,13 +7,13 @@
 
 #pragma once
 
-#include <list>
 #include <map>
 #include <vector>
 
 #include <libcamera/base/private.h>
 
 #include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/timer_wheel.h>
 #include <libcamera/base/unique_fd.h>
 
 struct pollfd;
@@ -50,7 +50,7 @@ private:
 	void processTimers();
 
 	std::map<int, EventNotifierSetPoll> notifiers_;
-	std::list<Timer *> timers_;
+	TimerWheel timers_;
 	UniqueFD eventfd_;
 
 	bool processingEvents_;
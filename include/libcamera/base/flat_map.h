@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Sorted associative container with inline storage
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <initializer_list>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+namespace libcamera {
+
+template<typename Key, typename T, std::size_t N, typename Compare = std::less<Key>>
+class FlatMap
+{
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<Key, T>;
+	using size_type = std::size_t;
+	using key_compare = Compare;
+	using iterator = value_type *;
+	using const_iterator = const value_type *;
+
+	FlatMap()
+		: size_(0), onHeap_(false)
+	{
+	}
+
+	FlatMap(std::initializer_list<value_type> init)
+		: FlatMap()
+	{
+		for (const value_type &value : init)
+			insert(value);
+	}
+
+	iterator begin() { return data(); }
+	const_iterator begin() const { return data(); }
+	const_iterator cbegin() const { return data(); }
+	iterator end() { return data() + size(); }
+	const_iterator end() const { return data() + size(); }
+	const_iterator cend() const { return data() + size(); }
+
+	bool empty() const { return size() == 0; }
+	size_type size() const { return onHeap_ ? heap_.size() : size_; }
+
+	void clear()
+	{
+		size_ = 0;
+		heap_.clear();
+	}
+
+	iterator find(const Key &key)
+	{
+		iterator it = lowerBound(key);
+		return it != end() && !compare_(key, it->first) ? it : end();
+	}
+
+	const_iterator find(const Key &key) const
+	{
+		return const_cast<FlatMap *>(this)->find(key);
+	}
+
+	size_type count(const Key &key) const { return find(key) != end(); }
+	bool contains(const Key &key) const { return find(key) != end(); }
+
+	T &at(const Key &key) { return find(key)->second; }
+	const T &at(const Key &key) const { return find(key)->second; }
+
+	T &operator[](const Key &key)
+	{
+		return emplace(key, T{}).first->second;
+	}
+
+	std::pair<iterator, bool> insert(const value_type &value)
+	{
+		return emplace(value.first, value.second);
+	}
+
+	std::pair<iterator, bool> emplace(const Key &key, const T &value)
+	{
+		iterator it = lowerBound(key);
+		if (it != end() && !compare_(key, it->first))
+			return { it, false };
+
+		size_type pos = it - begin();
+
+		if (!onHeap_ && size_ == N) {
+			heap_.reserve(N * 2);
+			heap_.assign(std::make_move_iterator(inline_.begin()),
+				     std::make_move_iterator(inline_.end()));
+			onHeap_ = true;
+		}
+
+		if (onHeap_) {
+			heap_.emplace(heap_.begin() + pos, key, value);
+		} else {
+			std::move_backward(inline_.begin() + pos,
+					   inline_.begin() + size_,
+					   inline_.begin() + size_ + 1);
+			inline_[pos] = { key, value };
+			size_++;
+		}
+
+		return { begin() + pos, true };
+	}
+
+	iterator erase(const_iterator pos)
+	{
+		size_type index = pos - begin();
+
+		if (onHeap_) {
+			heap_.erase(heap_.begin() + index);
+		} else {
+			std::move(inline_.begin() + index + 1,
+				  inline_.begin() + size_,
+				  inline_.begin() + index);
+			size_--;
+		}
+
+		return begin() + index;
+	}
+
+	size_type erase(const Key &key)
+	{
+		iterator it = find(key);
+		if (it == end())
+			return 0;
+
+		erase(it);
+		return 1;
+	}
+
+private:
+	value_type *data() { return onHeap_ ? heap_.data() : inline_.data(); }
+	const value_type *data() const { return onHeap_ ? heap_.data() : inline_.data(); }
+
+	iterator lowerBound(const Key &key)
+	{
+		return std::lower_bound(begin(), end(), key,
+					[this](const value_type &value, const Key &k) {
+						return compare_(value.first, k);
+					});
+	}
+
+	std::array<value_type, N> inline_;
+	std::vector<value_type> heap_;
+	size_type size_;
+	bool onHeap_;
+	Compare compare_;
+};
+
+template<typename Key, typename T, std::size_t N, typename Compare>
+bool operator==(const FlatMap<Key, T, N, Compare> &lhs,
+		const FlatMap<Key, T, N, Compare> &rhs)
+{
+	return lhs.size() == rhs.size() &&
+	       std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template<typename Key, typename T, std::size_t N, typename Compare>
+bool operator!=(const FlatMap<Key, T, N, Compare> &lhs,
+		const FlatMap<Key, T, N, Compare> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+} /* namespace libcamera */
@@ -108,10 +108,30 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
 #ifndef __DOXYGEN__
 #define _LOG_CATEGORY(name) logCategory##name
 
+/*
+ * Messages with a severity lower than LIBCAMERA_LOG_MIN_SEVERITY are removed at
+ * compile time. Other messages are filtered at runtime based on the severity of
+ * their category, before constructing the LogMessage.
+ */
+#ifndef LIBCAMERA_LOG_MIN_SEVERITY
+#define LIBCAMERA_LOG_MIN_SEVERITY 0
+#endif
+
+class LogVoidify
+{
+public:
+	void operator&([[maybe_unused]] std::ostream &stream) {}
+};
+
+#define _LOG_ENABLED(cat, sev) \
+	(Log##sev >= LIBCAMERA_LOG_MIN_SEVERITY && Log##sev >= (cat).severity())
+
 #define _LOG1(severity) \
-	_log(nullptr, Log##severity).stream()
+	!_LOG_ENABLED(LogCategory::defaultCategory(), severity) ? (void)0 : \
+	LogVoidify() & _log(nullptr, Log##severity).stream()
 #define _LOG2(category, severity) \
-	_log(&_LOG_CATEGORY(category)(), Log##severity).stream()
+	!_LOG_ENABLED(_LOG_CATEGORY(category)(), severity) ? (void)0 : \
+	LogVoidify() & _log(&_LOG_CATEGORY(category)(), Log##severity).stream()
 
 /*
  * Expand the LOG() macro to _LOG1() or _LOG2() based on the number of
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Small object memory pool
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+#include <libcamera/base/private.h>
+
+namespace libcamera {
+
+class MemoryPool
+{
+public:
+	static void *allocate(std::size_t size);
+	static void deallocate(void *ptr, std::size_t size);
+
+	static uint64_t heapAllocations();
+};
+
+} /* namespace libcamera */
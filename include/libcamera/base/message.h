@@ -8,14 +8,17 @@
 #pragma once
 
 #include <atomic>
+#include <cstddef>
 
 #include <libcamera/base/private.h>
 
 #include <libcamera/base/bound_method.h>
+#include <libcamera/base/utils.h>
 
 namespace libcamera {
 
 class BoundMethodBase;
+class MessageQueue;
 class Object;
 class Semaphore;
 class Thread;
@@ -40,10 +43,13 @@ public:
 	static Type registerMessageType();
 
 private:
+	friend class MessageQueue;
 	friend class Thread;
 
 	Type type_;
 	Object *receiver_;
+	Message *next_;
+	utils::time_point posted_;
 
 	static std::atomic_uint nextUserType_;
 };
@@ -57,6 +63,10 @@ public:
 		      bool deleteMethod = false);
 	~InvokeMessage();
 
+	static void *operator new(std::size_t size);
+	static void operator delete(void *ptr, std::size_t size);
+
+	BoundMethodBase *method() const { return method_; }
 	Semaphore *semaphore() const { return semaphore_; }
 
 	void invoke();
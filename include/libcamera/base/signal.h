@@ -7,12 +7,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <functional>
-#include <list>
 #include <type_traits>
 #include <vector>
 
 #include <libcamera/base/bound_method.h>
+#include <libcamera/base/class.h>
 
 namespace libcamera {
 
@@ -21,18 +23,40 @@ class Object;
 class SignalBase
 {
 public:
+	SignalBase();
+	~SignalBase();
+
 	void disconnect(Object *object);
 
 protected:
-	using SlotList = std::list<BoundMethodBase *>;
+	struct SlotArray {
+		SlotArray(std::size_t size)
+			: slots(size), refs(1), next(nullptr)
+		{
+		}
+
+		std::vector<std::atomic<BoundMethodBase *>> slots;
+		std::vector<BoundMethodBase *> removed;
+		std::atomic<unsigned int> refs;
+		SlotArray *next;
+	};
 
 	void connect(BoundMethodBase *slot);
-	void disconnect(std::function<bool(SlotList::iterator &)> match);
+	void disconnect(std::function<bool(BoundMethodBase *)> match);
 
-	SlotList slots();
+	SlotArray *acquireSlots();
+	static void releaseSlots(SlotArray *slots);
 
 private:
-	SlotList slots_;
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(SignalBase)
+
+	void publish(SlotArray *slots);
+	void reclaim();
+
+	std::atomic<SlotArray *> slots_;
+	std::atomic<unsigned int> emitters_;
+	std::atomic<bool> retired_;
+	std::vector<SlotArray *> retiredArrays_;
 };
 
 template<typename... Args>
@@ -97,7 +121,7 @@ public:
 
 	void disconnect()
 	{
-		SignalBase::disconnect([]([[maybe_unused]] SlotList::iterator &iter) {
+		SignalBase::disconnect([]([[maybe_unused]] BoundMethodBase *slot) {
 			return true;
 		});
 	}
@@ -105,17 +129,17 @@ public:
 	template<typename T>
 	void disconnect(T *obj)
 	{
-		SignalBase::disconnect([obj](SlotList::iterator &iter) {
-			return (*iter)->match(obj);
+		SignalBase::disconnect([obj](BoundMethodBase *slot) {
+			return slot->match(obj);
 		});
 	}
 
 	template<typename T, typename R>
 	void disconnect(T *obj, R (T::*func)(Args...))
 	{
-		SignalBase::disconnect([obj, func](SlotList::iterator &iter) {
+		SignalBase::disconnect([obj, func](BoundMethodBase *base) {
 			BoundMethodArgs<R, Args...> *slot =
-				static_cast<BoundMethodArgs<R, Args...> *>(*iter);
+				static_cast<BoundMethodArgs<R, Args...> *>(base);
 
 			if (!slot->match(obj))
 				return false;
@@ -133,9 +157,9 @@ public:
 	template<typename R>
 	void disconnect(R (*func)(Args...))
 	{
-		SignalBase::disconnect([func](SlotList::iterator &iter) {
+		SignalBase::disconnect([func](BoundMethodBase *base) {
 			BoundMethodArgs<R, Args...> *slot =
-				static_cast<BoundMethodArgs<R, Args...> *>(*iter);
+				static_cast<BoundMethodArgs<R, Args...> *>(base);
 
 			if (!slot->match(nullptr))
 				return false;
@@ -147,11 +171,22 @@ public:
 	void emit(Args... args)
 	{
 		/*
-		 * Make a copy of the slots list as the slot could call the
-		 * disconnect operation, invalidating the iterator.
+		 * The slot array is replaced, not modified, when slots are
+		 * connected, so slots can connect and disconnect while it is
+		 * iterated. The entries of disconnected slots are cleared.
 		 */
-		for (BoundMethodBase *slot : slots())
-			static_cast<BoundMethodArgs<void, Args...> *>(slot)->activate(args...);
+		SlotArray *slots = acquireSlots();
+		if (!slots)
+			return;
+
+		for (const auto &entry : slots->slots) {
+			BoundMethodBase *slot = entry.load();
+			if (slot)
+				static_cast<BoundMethodArgs<void, Args...> *>(slot)->activate(args...);
+		}
+
+		/* The signal may have been destroyed by a slot. */
+		releaseSlots(slots);
 	}
 };
 
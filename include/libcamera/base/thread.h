@@ -7,14 +7,21 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
 #include <sys/types.h>
 #include <thread>
+#include <typeinfo>
+#include <vector>
 
 #include <libcamera/base/private.h>
 
 #include <libcamera/base/message.h>
 #include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
 #include <libcamera/base/utils.h>
 
 namespace libcamera {
@@ -25,12 +32,69 @@ class Object;
 class ThreadData;
 class ThreadMain;
 
+struct ThreadStatistics {
+	static constexpr unsigned int kLatencyBuckets = 16;
+
+	struct Receiver {
+		std::string name;
+		uint64_t messages;
+		utils::duration totalTime;
+		utils::duration maxTime;
+		uint64_t allocations;
+		uint64_t allocatedBytes;
+	};
+
+	uint64_t messages = 0;
+	std::size_t maxQueueDepth = 0;
+	std::array<uint64_t, kLatencyBuckets> latency = {};
+	std::vector<Receiver> receivers;
+	utils::duration waitTime = {};
+	utils::duration busyTime = {};
+};
+
+struct ThreadProfile {
+	struct Slot {
+		std::string receiver;
+		std::string slot;
+		uint64_t samples;
+		utils::duration totalTime;
+		utils::duration maxTime;
+	};
+
+	unsigned int interval = 0;
+	uint64_t dispatches = 0;
+	std::vector<Slot> slots;
+
+	std::string toString() const;
+};
+
 class Thread
 {
 public:
-	Thread();
+	enum class SchedulingPolicy {
+		Other,
+		Fifo,
+		RoundRobin,
+	};
+
+	Thread(const std::string &name = {});
 	virtual ~Thread();
 
+	const std::string &name() const;
+
+	int setAffinity(Span<const unsigned int> cpus);
+	int setPriority(SchedulingPolicy policy, int priority = 0);
+
+	void setStatisticsEnabled(bool enable);
+	bool statisticsEnabled() const;
+	ThreadStatistics statistics() const;
+	void resetStatistics();
+
+	void setProfilingInterval(unsigned int interval);
+	unsigned int profilingInterval() const;
+	ThreadProfile profile() const;
+	void resetProfile();
+
 	void start();
 	void exit(int code = 0);
 	bool wait(utils::duration duration = utils::duration::max());
@@ -43,6 +107,7 @@ public:
 	static pid_t currentId();
 
 	EventDispatcher *eventDispatcher();
+	int setEventDispatcher(std::unique_ptr<EventDispatcher> dispatcher);
 
 	void dispatchMessages(Message::Type type = Message::Type::None);
 
@@ -54,9 +119,27 @@ private:
 	void startThread();
 	void finishThread();
 
+	bool nativeHandle(pthread_t *handle);
+
+	void accountWaitStart(utils::time_point start);
+	void accountWait(utils::time_point start, utils::time_point end);
+
+	struct ProfileSample {
+		const std::type_info *receiver;
+		const std::type_info *slot;
+		Message::Type type;
+		utils::time_point start;
+	};
+
+	bool profileEnter();
+	void profileLeave(const ProfileSample *sample);
+
 	void postMessage(std::unique_ptr<Message> msg, Object *receiver);
 	void removeMessages(Object *receiver);
 
+	friend class BoundMethodBase;
+	friend class EventDispatcherEpoll;
+	friend class EventDispatcherPoll;
 	friend class Object;
 	friend class ThreadData;
 	friend class ThreadMain;
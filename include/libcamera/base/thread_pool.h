@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Work-stealing thread pool
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/private.h>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/signal.h>
+
+namespace libcamera {
+
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+
+	ThreadPool(unsigned int size);
+	~ThreadPool();
+
+	static ThreadPool *instance();
+
+	unsigned int size() const { return workers_.size(); }
+
+	void post(Task task) LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	template<typename F,
+		 typename R = std::invoke_result_t<std::decay_t<F>>>
+	std::future<R> submit(F &&func)
+	{
+		auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+		std::future<R> future = task->get_future();
+
+		post([task]() { (*task)(); });
+
+		return future;
+	}
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(ThreadPool)
+
+	class Worker;
+
+	bool runTask(unsigned int index);
+	void work(unsigned int index) LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::atomic<unsigned int> next_;
+	std::atomic<int> pending_;
+
+	Mutex mutex_;
+	ConditionVariable cv_;
+	bool stopping_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+class TaskGroup
+{
+public:
+	TaskGroup(unsigned int maxConcurrency = 0,
+		  ThreadPool *pool = ThreadPool::instance());
+	~TaskGroup();
+
+	void run(ThreadPool::Task task);
+	void wait();
+
+	Signal<> finished;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(TaskGroup)
+
+	struct State;
+
+	static void runTasks(State *state, bool runner);
+
+	ThreadPool *pool_;
+	std::shared_ptr<State> state_;
+};
+
+} /* namespace libcamera */
@@ -18,6 +18,7 @@
 namespace libcamera {
 
 class Message;
+class TimerWheel;
 
 class Timer : public Object
 {
@@ -38,11 +39,17 @@ protected:
 	void message(Message *msg) override;
 
 private:
+	friend class TimerWheel;
+
 	void registerTimer();
 	void unregisterTimer();
 
 	bool running_;
 	std::chrono::steady_clock::time_point deadline_;
+
+	Timer *wheelNext_;
+	Timer **wheelPrev_;
+	unsigned int wheelSlot_;
 };
 
 } /* namespace libcamera */
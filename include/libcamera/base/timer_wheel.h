@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Hierarchical timer wheel
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <libcamera/base/private.h>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class Timer;
+
+class TimerWheel
+{
+public:
+	TimerWheel();
+
+	void add(Timer *timer);
+	void remove(Timer *timer);
+
+	bool empty() const { return !count_; }
+	utils::time_point nextDeadline() const;
+
+	Timer *pop(utils::time_point now);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(TimerWheel)
+
+	static constexpr unsigned int kTickShift = 16;
+	static constexpr unsigned int kSlotShift = 6;
+	static constexpr unsigned int kSlots = 1 << kSlotShift;
+	static constexpr unsigned int kLevels = 8;
+	static constexpr unsigned int kExpired = kLevels * kSlots;
+
+	static uint64_t ticks(utils::time_point time);
+
+	void insert(Timer *timer);
+	void link(Timer *timer, unsigned int slot);
+	void unlink(Timer *timer);
+
+	void advance(utils::time_point now);
+	void expireSlot(unsigned int slot, utils::time_point now);
+	void cascade(unsigned int level);
+
+	Timer *slots_[kLevels * kSlots];
+	uint64_t occupied_[kLevels];
+	Timer *expired_;
+
+	uint64_t clock_;
+	unsigned int count_;
+};
+
+} /* namespace libcamera */
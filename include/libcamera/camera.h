@@ -7,12 +7,14 @@
 
 #pragma once
 
+#include <functional>
 #include <initializer_list>
 #include <memory>
 #include <optional>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/flags.h>
@@ -21,6 +23,8 @@
 
 #include <libcamera/controls.h>
 #include <libcamera/geometry.h>
+#include <libcamera/memory_usage.h>
+#include <libcamera/metrics.h>
 #include <libcamera/orientation.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
@@ -116,6 +120,8 @@ class Camera final : public Object, public std::enable_shared_from_this<Camera>,
 	LIBCAMERA_DECLARE_PRIVATE()
 
 public:
+	using Executor = std::function<void(std::function<void()> task)>;
+
 	static std::shared_ptr<Camera> create(std::unique_ptr<Private> d,
 					      const std::string &id,
 					      const std::set<Stream *> &streams);
@@ -123,6 +129,7 @@ public:
 	const std::string &id() const;
 
 	Signal<Request *, FrameBuffer *> bufferCompleted;
+	Signal<Request *, const ControlList &> metadataAvailable;
 	Signal<Request *> requestCompleted;
 	Signal<> disconnected;
 
@@ -134,6 +141,10 @@ public:
 
 	const std::set<Stream *> &streams() const;
 
+	std::vector<Metric> metrics() const;
+	MemoryUsage memoryUsage() const;
+	unsigned int recommendedBufferCount(const Stream *stream) const;
+
 	std::unique_ptr<CameraConfiguration>
 	generateConfiguration(Span<const StreamRole> roles = {});
 
@@ -147,6 +158,9 @@ public:
 
 	std::unique_ptr<Request> createRequest(uint64_t cookie = 0);
 	int queueRequest(Request *request);
+	int queueRequests(Span<Request *const> requests);
+
+	int setCompletionExecutor(Executor executor);
 
 	int start(const ControlList *controls = nullptr);
 	int stop();
@@ -163,6 +177,7 @@ private:
 	void requestComplete(Request *request);
 
 	friend class FrameBufferAllocator;
+	friend class FrameBufferPool;
 	int exportFrameBuffers(Stream *stream,
 			       std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 };
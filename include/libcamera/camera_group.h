@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Group of cameras operated in lockstep
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+
+namespace libcamera {
+
+class Camera;
+class CameraConfiguration;
+class ControlList;
+class Request;
+
+class CameraGroup : public Extensible
+{
+	LIBCAMERA_DECLARE_PRIVATE()
+
+public:
+	CameraGroup(std::vector<std::shared_ptr<Camera>> cameras);
+	~CameraGroup();
+
+	const std::vector<std::shared_ptr<Camera>> &cameras() const;
+	bool hardwareSynchronised() const;
+
+	int configure(const std::vector<CameraConfiguration *> &configs);
+
+	int start(const ControlList *controls = nullptr);
+	int stop();
+
+	int queueRequests(const std::vector<Request *> &requests);
+
+	Signal<const std::vector<Request *> &> requestsCompleted;
+
+private:
+	LIBCAMERA_DISABLE_COPY(CameraGroup)
+};
+
+} /* namespace libcamera */
@@ -16,6 +16,8 @@
 #include <libcamera/base/object.h>
 #include <libcamera/base/signal.h>
 
+#include <libcamera/metrics.h>
+
 namespace libcamera {
 
 class Camera;
@@ -33,6 +35,8 @@ public:
 	std::vector<std::shared_ptr<Camera>> cameras() const;
 	std::shared_ptr<Camera> get(const std::string &id);
 
+	std::vector<Metric> metrics() const;
+
 	static const std::string &version() { return version_; }
 
 	Signal<std::shared_ptr<Camera>> cameraAdded;
@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/class.h>
@@ -127,6 +128,8 @@ public:
 
 	ControlValue(const ControlValue &other);
 	ControlValue &operator=(const ControlValue &other);
+	ControlValue(ControlValue &&other) noexcept;
+	ControlValue &operator=(ControlValue &&other) noexcept;
 
 	ControlType type() const { return type_; }
 	bool isNone() const { return type_ == ControlTypeNone; }
@@ -197,11 +200,13 @@ public:
 		     std::size_t numElements = 1);
 
 private:
+	static constexpr std::size_t kInlineStorageSize = 56;
+
 	ControlType type_ : 8;
 	bool isArray_;
 	std::size_t numElements_ : 32;
 	union {
-		uint64_t value_;
+		alignas(uint64_t) uint8_t value_[kInlineStorageSize];
 		void *storage_;
 	};
 
@@ -349,7 +354,7 @@ private:
 class ControlList
 {
 private:
-	using ControlListMap = std::unordered_map<unsigned int, ControlValue>;
+	using ControlListMap = std::vector<std::pair<unsigned int, ControlValue>>;
 
 public:
 	enum class MergePolicy {
@@ -373,6 +378,7 @@ public:
 	std::size_t size() const { return controls_.size(); }
 
 	void clear() { controls_.clear(); }
+	void reserve(std::size_t size) { controls_.reserve(size); }
 	void merge(const ControlList &source, MergePolicy policy = MergePolicy::KeepExisting);
 
 	bool contains(unsigned int id) const;
@@ -380,7 +386,7 @@ public:
 	template<typename T>
 	std::optional<T> get(const Control<T> &ctrl) const
 	{
-		const auto entry = controls_.find(ctrl.id());
+		const auto entry = lookup(ctrl.id());
 		if (entry == controls_.end())
 			return std::nullopt;
 
@@ -415,6 +421,7 @@ public:
 	const ControlIdMap *idMap() const { return idmap_; }
 
 private:
+	const_iterator lookup(unsigned int id) const;
 	const ControlValue *find(unsigned int id) const;
 	ControlValue *find(unsigned int id);
 
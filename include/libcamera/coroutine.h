@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Coroutine wrappers for asynchronous capture
+ */
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine) || defined(__DOXYGEN__)
+
+#include <atomic>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/class.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/request.h>
+
+namespace libcamera {
+
+using CoroutineResumer = std::function<void(std::coroutine_handle<> handle)>;
+
+template<typename T>
+class CompletionQueue
+{
+public:
+	class Awaiter
+	{
+	public:
+		Awaiter(CompletionQueue *queue)
+			: queue_(queue)
+		{
+		}
+
+		bool await_ready() const { return !queue_->empty(); }
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			return queue_->suspend(handle);
+		}
+		T await_resume() { return queue_->pop(); }
+
+	private:
+		CompletionQueue *queue_;
+	};
+
+	CompletionQueue(size_t capacity, CoroutineResumer resumer = {})
+		: slots_(capacity), resumer_(std::move(resumer)), head_(0),
+		  tail_(0), waiter_(nullptr)
+	{
+	}
+
+	size_t capacity() const { return slots_.size(); }
+	bool empty() const { return head_.load() == tail_.load(); }
+
+	bool push(T value)
+	{
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_.load(std::memory_order_acquire) == slots_.size())
+			return false;
+
+		slots_[tail % slots_.size()] = std::move(value);
+		tail_.store(tail + 1);
+
+		void *waiter = waiter_.exchange(nullptr);
+		if (waiter)
+			resume(std::coroutine_handle<>::from_address(waiter));
+
+		return true;
+	}
+
+	T pop()
+	{
+		size_t head = head_.load(std::memory_order_relaxed);
+		T value = std::move(slots_[head % slots_.size()]);
+		head_.store(head + 1, std::memory_order_release);
+
+		return value;
+	}
+
+	Awaiter next() { return Awaiter(this); }
+
+	void resume(std::coroutine_handle<> handle) const
+	{
+		if (resumer_)
+			resumer_(handle);
+		else
+			handle.resume();
+	}
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(CompletionQueue)
+
+	bool suspend(std::coroutine_handle<> handle)
+	{
+		waiter_.store(handle.address());
+		if (empty())
+			return true;
+
+		/*
+		 * A value has been pushed concurrently. Resume immediately,
+		 * unless the producer has already claimed the waiter.
+		 */
+		return waiter_.exchange(nullptr) != handle.address();
+	}
+
+	std::vector<T> slots_;
+	CoroutineResumer resumer_;
+
+	std::atomic<size_t> head_;
+	std::atomic<size_t> tail_;
+	std::atomic<void *> waiter_;
+};
+
+class AsyncCamera
+{
+public:
+	class CaptureAwaiter
+	{
+	public:
+		CaptureAwaiter(AsyncCamera *camera, Request *request)
+			: camera_(camera), request_(request), ret_(0)
+		{
+		}
+
+		bool await_ready() const { return false; }
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			int ret = camera_->queueCapture(request_, handle);
+			if (!ret)
+				return true;
+
+			ret_ = ret;
+			return false;
+		}
+		int await_resume() const { return ret_; }
+
+	private:
+		AsyncCamera *camera_;
+		Request *request_;
+		int ret_;
+	};
+
+	AsyncCamera(std::shared_ptr<Camera> camera, size_t capacity,
+		    CoroutineResumer resumer = {})
+		: camera_(std::move(camera)), completed_(capacity, std::move(resumer)),
+		  capture_(nullptr)
+	{
+		camera_->requestCompleted.connect(this, &AsyncCamera::requestCompleted);
+	}
+
+	~AsyncCamera()
+	{
+		camera_->requestCompleted.disconnect(this, &AsyncCamera::requestCompleted);
+	}
+
+	Camera *camera() const { return camera_.get(); }
+
+	int queueRequest(Request *request) { return camera_->queueRequest(request); }
+
+	CompletionQueue<Request *>::Awaiter nextCompleted() { return completed_.next(); }
+	CaptureAwaiter capture(Request *request) { return CaptureAwaiter(this, request); }
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(AsyncCamera)
+
+	int queueCapture(Request *request, std::coroutine_handle<> handle)
+	{
+		captureHandle_ = handle;
+		capture_.store(request, std::memory_order_release);
+
+		int ret = camera_->queueRequest(request);
+		if (ret < 0)
+			capture_.store(nullptr, std::memory_order_relaxed);
+
+		/*
+		 * On success the coroutine may already have been resumed, the
+		 * caller shall not touch the awaiter anymore.
+		 */
+		return ret;
+	}
+
+	void requestCompleted(Request *request)
+	{
+		if (request == capture_.load(std::memory_order_acquire)) {
+			capture_.store(nullptr, std::memory_order_relaxed);
+			completed_.resume(captureHandle_);
+			return;
+		}
+
+		completed_.push(request);
+	}
+
+	std::shared_ptr<Camera> camera_;
+	CompletionQueue<Request *> completed_;
+
+	std::atomic<Request *> capture_;
+	std::coroutine_handle<> captureHandle_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __cpp_impl_coroutine */
@@ -56,6 +56,7 @@ public:
 		SharedFD fd;
 		unsigned int offset = kInvalidOffset;
 		unsigned int length;
+		void *address = nullptr;
 	};
 
 	FrameBuffer(const std::vector<Plane> &planes, unsigned int cookie = 0);
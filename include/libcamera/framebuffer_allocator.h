@@ -38,4 +38,26 @@ private:
 	std::map<Stream *, std::vector<std::unique_ptr<FrameBuffer>>> buffers_;
 };
 
+class FrameBufferPool
+{
+public:
+	FrameBufferPool(unsigned int maxBuffers);
+	~FrameBufferPool();
+
+	int acquire(Camera *camera, Stream *stream, unsigned int count,
+		    std::vector<FrameBuffer *> *buffers);
+	void release(FrameBuffer *buffer);
+
+	unsigned int size() const { return buffers_.size(); }
+	unsigned int maxBuffers() const { return maxBuffers_; }
+
+private:
+	LIBCAMERA_DISABLE_COPY(FrameBufferPool)
+
+	struct Buffer;
+
+	std::vector<std::unique_ptr<Buffer>> buffers_;
+	unsigned int maxBuffers_;
+};
+
 } /* namespace libcamera */
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Buffer residency tracking
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <unordered_map>
+
+#include <libcamera/base/class.h>
+
+namespace libcamera {
+
+class FrameBuffer;
+class MetricHistogram;
+
+class BufferResidency
+{
+public:
+	static constexpr unsigned int kWindow = 64;
+	static constexpr unsigned int kMinSamples = 8;
+
+	BufferResidency(MetricHistogram *latency = nullptr,
+			MetricHistogram *hold = nullptr);
+
+	void bufferQueued(const FrameBuffer *buffer, int64_t time);
+	void bufferCompleted(const FrameBuffer *buffer, int64_t time);
+	void reset();
+
+	unsigned int recommendedCount() const
+	{
+		return recommended_.load(std::memory_order_relaxed);
+	}
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(BufferResidency)
+
+	struct Entry {
+		int64_t queued;
+		int64_t completed;
+		int64_t latency;
+	};
+
+	void update();
+
+	MetricHistogram *latency_;
+	MetricHistogram *hold_;
+
+	std::unordered_map<const FrameBuffer *, Entry> buffers_;
+	int64_t lastCompleted_;
+
+	std::array<int64_t, kWindow> intervals_;
+	std::array<int64_t, kWindow> busy_;
+	unsigned int numIntervals_;
+	unsigned int numBusy_;
+
+	std::atomic<unsigned int> recommended_;
+};
+
+} /* namespace libcamera */
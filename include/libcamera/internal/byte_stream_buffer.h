@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <initializer_list>
 #include <stddef.h>
 #include <stdint.h>
 #include <type_traits>
@@ -65,6 +66,15 @@ public:
 			     data.size_bytes());
 	}
 
+	int write(std::initializer_list<Span<const uint8_t>> data);
+
+	template<typename T>
+	std::remove_reference_t<T> *reserve(size_t count = 1)
+	{
+		using return_type = std::remove_reference_t<T> *;
+		return reinterpret_cast<return_type>(reserve(sizeof(T), count));
+	}
+
 private:
 	LIBCAMERA_DISABLE_COPY(ByteStreamBuffer)
 
@@ -73,6 +83,7 @@ private:
 	int read(uint8_t *data, size_t size);
 	const uint8_t *read(size_t size, size_t count);
 	int write(const uint8_t *data, size_t size);
+	uint8_t *reserve(size_t size, size_t count);
 
 	ByteStreamBuffer *parent_;
 
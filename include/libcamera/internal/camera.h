@@ -7,15 +7,25 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <list>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <libcamera/base/class.h>
 
 #include <libcamera/camera.h>
+#include <libcamera/control_ids.h>
+
+#include "libcamera/internal/buffer_residency.h"
+#include "libcamera/internal/fence_waiter.h"
+#include "libcamera/internal/frame_rate_governor.h"
+#include "libcamera/internal/memory_usage.h"
+#include "libcamera/internal/metrics.h"
 
 namespace libcamera {
 
@@ -36,11 +46,35 @@ public:
 	std::list<Request *> queuedRequests_;
 	ControlInfoMap controlInfo_;
 	ControlList properties_;
+	std::vector<const ControlId *> metadataIds_;
+
+	FenceWaiter fenceWaiter_;
 
 	uint32_t requestSequence_;
 
+	std::map<const Stream *, uint32_t> streamSequences_;
+	std::map<uint32_t, controls::FrameDropCauseEnum> frameDropCauses_;
+	bool starved_;
+	bool metadataOnlyRequests_;
+
+	MetricsRegistry metrics_;
+	std::shared_ptr<MemoryAccount> memory_;
+	std::map<const Stream *, std::unique_ptr<BufferResidency>> bufferResidency_;
+	std::unique_ptr<FrameRateGovernor> governor_;
+
 	const CameraControlValidator *validator() const { return validator_.get(); }
 
+	void bufferComplete(Request *request, FrameBuffer *buffer);
+	void metadataAvailable(Request *request, const ControlList &metadata);
+	void recordRequestMetrics(const Request *request);
+	void recordBuffersQueued(const Request *request);
+	void recordBufferCompleted(const Request *request, const FrameBuffer *buffer);
+	void resetBufferResidency();
+
+	void frameDropped(uint32_t sequence, controls::FrameDropCauseEnum cause);
+	void detectFrameDrops(Request *request);
+	void resetFrameDrops();
+
 private:
 	enum State {
 		CameraAvailable,
@@ -58,6 +92,8 @@ private:
 			    bool allowDisconnected = false,
 			    const char *from = __builtin_FUNCTION()) const;
 
+	int validateRequest(const Request *request) const;
+
 	void disconnect();
 	void setState(State state);
 
@@ -70,6 +106,17 @@ private:
 	std::atomic<State> state_;
 
 	std::unique_ptr<CameraControlValidator> validator_;
+
+	Executor executor_;
+
+	MetricCounter *requestsCompleted_;
+	MetricCounter *requestsCancelled_;
+	MetricCounter *bufferErrors_;
+	MetricCounter *framesDropped_;
+	std::array<MetricCounter *, controls::FrameDropCauseValues.size()> frameDropCauseCounters_;
+	MetricHistogram *requestLatency_;
+	MetricHistogram *bufferLatency_;
+	MetricHistogram *bufferHold_;
 };
 
 } /* namespace libcamera */
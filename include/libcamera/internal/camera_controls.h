@@ -7,11 +7,14 @@
 
 #pragma once
 
+#include <vector>
+
 #include "libcamera/internal/control_validator.h"
 
 namespace libcamera {
 
 class Camera;
+class ControlInfo;
 
 class CameraControlValidator final : public ControlValidator
 {
@@ -21,8 +24,17 @@ public:
 	const std::string &name() const override;
 	bool validate(unsigned int id) const override;
 
+	void update();
+	const ControlInfo *info(unsigned int id) const;
+
 private:
+	struct Range {
+		unsigned int first;
+		std::vector<const ControlInfo *> infos;
+	};
+
 	Camera *camera_;
+	std::vector<Range> ranges_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Camera group private data
+ */
+
+#pragma once
+
+#include <libcamera/camera_group.h>
+
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/thread_annotations.h>
+
+namespace libcamera {
+
+class Camera;
+class Request;
+
+class CameraGroup::Private : public Extensible::Private
+{
+	LIBCAMERA_DECLARE_PUBLIC(CameraGroup)
+
+public:
+	Private(std::vector<std::shared_ptr<Camera>> cameras);
+
+	void requestComplete(Request *request);
+	void retireRequests(Request *request, unsigned int count)
+		LIBCAMERA_TSA_EXCLUDES(lock_);
+	void checkSequences(const std::vector<Request *> &requests);
+	void resetSyncModes();
+
+	std::vector<std::shared_ptr<Camera>> cameras_;
+	bool configured_;
+	bool synchronised_;
+	bool running_;
+
+	struct Group {
+		std::vector<Request *> requests;
+		unsigned int pending;
+	};
+
+	Mutex lock_;
+	std::deque<Group> groups_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+	std::deque<std::vector<Request *>> completed_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+	bool dispatching_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+
+	std::vector<int64_t> sequenceOffsets_;
+};
+
+} /* namespace libcamera */
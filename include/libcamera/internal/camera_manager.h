@@ -26,6 +26,7 @@ namespace libcamera {
 
 class Camera;
 class DeviceEnumerator;
+class PipelineHandlerThread;
 
 class CameraManager::Private : public Extensible::Private, public Thread
 {
@@ -33,6 +34,7 @@ class CameraManager::Private : public Extensible::Private, public Thread
 
 public:
 	Private();
+	~Private();
 
 	int start();
 	void addCamera(std::shared_ptr<Camera> camera) LIBCAMERA_TSA_EXCLUDES(mutex_);
@@ -45,7 +47,9 @@ private:
 	int init();
 	void createPipelineHandlers();
 	void pipelineFactoryMatch(const PipelineHandlerFactoryBase *factory);
+	void createPipelineThreads();
 	void cleanup() LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void dumpMetrics();
 
 	/*
 	 * This mutex protects
@@ -62,6 +66,9 @@ private:
 
 	std::unique_ptr<DeviceEnumerator> enumerator_;
 
+	std::vector<std::unique_ptr<PipelineHandlerThread>> pipelineThreads_;
+	unsigned int nextPipelineThread_;
+
 	IPAManager ipaManager_;
 	ProcessManager processManager_;
 };
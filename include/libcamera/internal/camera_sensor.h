@@ -7,12 +7,15 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
 
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
@@ -30,11 +33,13 @@ namespace libcamera {
 
 class CameraLens;
 class MediaEntity;
+class MediaRequest;
 class SensorConfiguration;
 
 struct CameraSensorProperties;
 
 enum class Orientation;
+enum class SensorSyncMode;
 
 class CameraSensor : protected Loggable
 {
@@ -61,6 +66,7 @@ public:
 	int setFormat(V4L2SubdeviceFormat *format,
 		      Transform transform = Transform::Identity);
 	int tryFormat(V4L2SubdeviceFormat *format) const;
+	int setCrop(Rectangle *crop);
 
 	int applyConfiguration(const SensorConfiguration &config,
 			       Transform transform = Transform::Identity,
@@ -72,8 +78,9 @@ public:
 	BayerFormat::Order bayerOrder(Transform t) const;
 
 	const ControlInfoMap &controls() const;
-	ControlList getControls(const std::vector<uint32_t> &ids);
-	int setControls(ControlList *ctrls);
+	ControlList getControls(const std::vector<uint32_t> &ids,
+				const MediaRequest *request = nullptr);
+	int setControls(ControlList *ctrls, const MediaRequest *request = nullptr);
 
 	const std::vector<controls::draft::TestPatternModeEnum> &testPatternModes() const
 	{
@@ -81,17 +88,31 @@ public:
 	}
 	int setTestPatternMode(controls::draft::TestPatternModeEnum mode);
 
+	const std::vector<SensorSyncMode> &syncModes() const { return syncModes_; }
+	int setSyncMode(SensorSyncMode mode);
+
 protected:
 	std::string logPrefix() const override;
 
 private:
 	LIBCAMERA_DISABLE_COPY(CameraSensor)
 
+	struct Mode {
+		unsigned int code;
+		Size size;
+		float ratio;
+		unsigned int area;
+	};
+
+	V4L2SubdeviceFormat findFormat(const std::vector<unsigned int> &mbusCodes,
+				       const Size &size) const;
+
 	int generateId();
 	int validateSensorDriver();
 	void initVimcDefaultProperties();
 	void initStaticProperties();
 	void initTestPatternModes();
+	void initSyncModes();
 	int initProperties();
 	int discoverAncillaryDevices();
 	int applyTestPatternMode(controls::draft::TestPatternModeEnum mode);
@@ -108,8 +129,11 @@ private:
 	V4L2Subdevice::Formats formats_;
 	std::vector<unsigned int> mbusCodes_;
 	std::vector<Size> sizes_;
+	std::vector<Mode> modes_;
 	std::vector<controls::draft::TestPatternModeEnum> testPatternModes_;
 	controls::draft::TestPatternModeEnum testPatternMode_;
+	std::vector<SensorSyncMode> syncModes_;
+	SensorSyncMode syncMode_;
 
 	Size pixelArraySize_;
 	Rectangle activeArea_;
@@ -121,6 +145,11 @@ private:
 	ControlList properties_;
 
 	std::unique_ptr<CameraLens> focusLens_;
+
+	using FormatKey = std::pair<std::vector<unsigned int>, Size>;
+	mutable Mutex formatCacheMutex_;
+	mutable std::map<FormatKey, V4L2SubdeviceFormat> formatCache_
+		LIBCAMERA_TSA_GUARDED_BY(formatCacheMutex_);
 };
 
 } /* namespace libcamera */
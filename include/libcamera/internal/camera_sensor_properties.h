@@ -8,6 +8,7 @@
 #pragma once
 
 #include <map>
+#include <stdint.h>
 #include <string>
 
 #include <libcamera/control_ids.h>
@@ -15,11 +16,19 @@
 
 namespace libcamera {
 
+enum class SensorSyncMode {
+	Off,
+	Leader,
+	Follower,
+};
+
 struct CameraSensorProperties {
 	static const CameraSensorProperties *get(const std::string &sensor);
 
 	Size unitCellSize;
 	std::map<controls::draft::TestPatternModeEnum, int32_t> testPatternModes;
+	uint32_t syncModeControl = 0;
+	std::map<SensorSyncMode, int32_t> syncModes = {};
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Camera sharing between processes
+ */
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/controls.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/control_serializer.h"
+
+namespace libcamera {
+
+class Camera;
+class CameraConfiguration;
+class EventNotifier;
+class FrameBuffer;
+class FrameBufferAllocator;
+class IPCUnixSocket;
+class Request;
+
+class CameraShareServer : public Object
+{
+public:
+	CameraShareServer(std::shared_ptr<Camera> camera);
+	~CameraShareServer();
+
+	int start(const std::string &path, const CameraConfiguration *config);
+	void stop();
+
+	bool isRunning() const { return running_; }
+	unsigned int clients() const { return clients_.size(); }
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(CameraShareServer)
+
+	struct Client;
+
+	int listen(const std::string &path);
+	void newConnection();
+	int sendStreams(Client *client);
+
+	void clientMessage(Client *client);
+	void clientHangup(Client *client);
+	void removeClient(Client *client);
+
+	void requestComplete(Request *request);
+	void releaseBuffer(Client *client, unsigned int stream,
+			   unsigned int index);
+
+	std::shared_ptr<Camera> camera_;
+	bool running_;
+
+	std::string path_;
+	UniqueFD listenFd_;
+	std::unique_ptr<EventNotifier> listenNotifier_;
+
+	std::vector<Stream *> streams_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+	std::vector<std::unique_ptr<Request>> requests_;
+	std::vector<unsigned int> references_;
+
+	std::list<std::unique_ptr<Client>> clients_;
+};
+
+class CameraShareClient : public Object
+{
+public:
+	struct StreamInfo {
+		StreamConfiguration configuration;
+		std::vector<std::unique_ptr<FrameBuffer>> buffers;
+	};
+
+	CameraShareClient();
+	~CameraShareClient();
+
+	int connect(const std::string &path);
+	void disconnect();
+	bool isConnected() const { return control_.isValid(); }
+
+	const std::vector<StreamInfo> &streams() const { return streams_; }
+
+	int subscribe(const std::vector<unsigned int> &streams);
+	int release(unsigned int stream, FrameBuffer *buffer);
+
+	Signal<> streamsReady;
+	Signal<unsigned int, FrameBuffer *, const ControlList &> frameReady;
+	Signal<> disconnected;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(CameraShareClient)
+
+	void controlReady();
+	void message();
+
+	UniqueFD control_;
+	std::unique_ptr<EventNotifier> controlNotifier_;
+	std::unique_ptr<IPCUnixSocket> socket_;
+	ControlSerializer serializer_;
+
+	unsigned int numStreams_;
+	std::vector<StreamInfo> streams_;
+};
+
+} /* namespace libcamera */
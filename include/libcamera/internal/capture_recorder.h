@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Capture session recording and replay
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/file.h>
+#include <libcamera/base/span.h>
+
+namespace libcamera {
+
+class ControlList;
+
+struct CaptureChunk {
+	enum class Type : uint32_t {
+		Init = 1,
+		Configure = 2,
+		Request = 3,
+		Statistics = 4,
+		SensorControls = 5,
+	};
+
+	Type type;
+	uint32_t frame;
+	uint64_t timestamp;
+	std::vector<uint8_t> data;
+
+	static std::vector<uint8_t> encodeControls(const ControlList &controls);
+	static int decodeControls(Span<const uint8_t> data, ControlList *controls);
+};
+
+class CaptureRecorder
+{
+public:
+	CaptureRecorder(const std::string &pipe);
+
+	bool isEnabled() const { return !directory_.empty(); }
+	bool isOpen() const { return file_.isOpen(); }
+
+	int open();
+	void close();
+
+	void write(CaptureChunk::Type type, uint32_t frame, uint64_t timestamp,
+		   Span<const uint8_t> data);
+
+private:
+	LIBCAMERA_DISABLE_COPY(CaptureRecorder)
+
+	std::string pipe_;
+	std::string directory_;
+	unsigned int sessions_;
+	File file_;
+};
+
+class CaptureRecording
+{
+public:
+	CaptureRecording(const std::string &path);
+
+	int open();
+	const std::string &pipe() const { return pipe_; }
+
+	int next(CaptureChunk *chunk);
+
+private:
+	LIBCAMERA_DISABLE_COPY(CaptureRecording)
+
+	File file_;
+	std::string pipe_;
+};
+
+} /* namespace libcamera */
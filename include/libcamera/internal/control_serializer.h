@@ -9,6 +9,8 @@
 
 #include <map>
 #include <memory>
+#include <stdint.h>
+#include <utility>
 #include <vector>
 
 #include <libcamera/controls.h>
@@ -29,8 +31,10 @@ public:
 
 	void reset();
 
+	void setDeltaEncoding(unsigned int keyframeInterval);
+
 	static size_t binarySize(const ControlInfoMap &infoMap);
-	static size_t binarySize(const ControlList &list);
+	size_t binarySize(const ControlList &list) const;
 
 	int serialize(const ControlInfoMap &infoMap, ByteStreamBuffer &buffer);
 	int serialize(const ControlList &list, ByteStreamBuffer &buffer);
@@ -41,6 +45,15 @@ public:
 	bool isCached(const ControlInfoMap &infoMap);
 
 private:
+	struct DeltaStream {
+		uint16_t id;
+		uint32_t sequence;
+		unsigned int sinceKeyframe;
+		ControlList baseline;
+	};
+
+	using DeltaStreamKey = std::pair<unsigned int, unsigned int>;
+
 	static size_t binarySize(const ControlValue &value);
 	static size_t binarySize(const ControlInfo &info);
 
@@ -51,12 +64,19 @@ private:
 				      bool isArray = false, unsigned int count = 1);
 	ControlInfo loadControlInfo(ByteStreamBuffer &buffer);
 
+	bool deltaStreamKey(const ControlList &list, DeltaStreamKey *key) const;
+	const ControlList *deltaBaseline(const ControlList &list) const;
+
 	unsigned int serial_;
 	unsigned int serialSeed_;
 	std::vector<std::unique_ptr<ControlId>> controlIds_;
 	std::vector<std::unique_ptr<ControlIdMap>> controlIdMaps_;
 	std::map<unsigned int, ControlInfoMap> infoMaps_;
 	std::map<const ControlInfoMap *, unsigned int> infoMapHandles_;
+
+	unsigned int keyframeInterval_;
+	std::map<DeltaStreamKey, DeltaStream> txStreams_;
+	std::map<uint16_t, DeltaStream> rxStreams_;
 };
 
 } /* namespace libcamera */
@@ -20,6 +20,7 @@
 #include <libcamera/base/signal.h>
 
 #include <libcamera/geometry.h>
+#include <libcamera/request.h>
 
 namespace libcamera {
 
@@ -54,7 +55,7 @@ public:
 	virtual void stop() = 0;
 
 	virtual int queueBuffers(FrameBuffer *input,
-				 const std::map<const Stream *, FrameBuffer *> &outputs) = 0;
+				 const Request::BufferMap &outputs) = 0;
 
 	Signal<FrameBuffer *> inputBufferReady;
 	Signal<FrameBuffer *> outputBufferReady;
@@ -74,6 +75,7 @@ public:
 	const std::vector<std::string> &compatibles() const { return compatibles_; }
 
 	static std::unique_ptr<Converter> create(MediaDevice *media);
+	static std::unique_ptr<Converter> create(const std::string &name);
 	static std::vector<ConverterFactoryBase *> &factories();
 	static std::vector<std::string> names();
 
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * CPU-based format converter
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread_pool.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+
+#include "libcamera/internal/converter.h"
+#include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+namespace libcamera {
+
+class FrameBuffer;
+class MediaDevice;
+class Stream;
+struct StreamConfiguration;
+
+class SoftwareConverter : public Converter, public Object
+{
+public:
+	SoftwareConverter(MediaDevice *media);
+
+	int loadConfiguration([[maybe_unused]] const std::string &filename) { return 0; }
+	bool isValid() const { return dmaHeap_.isValid(); }
+
+	std::vector<PixelFormat> formats(PixelFormat input);
+	SizeRange sizes(const Size &input);
+
+	std::tuple<unsigned int, unsigned int>
+	strideAndFrameSize(const PixelFormat &pixelFormat, const Size &size);
+
+	int configure(const StreamConfiguration &inputCfg,
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs);
+	int exportBuffers(const Stream *stream, unsigned int count,
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+
+	int start();
+	void stop();
+
+	int queueBuffers(FrameBuffer *input,
+			 const Request::BufferMap &outputs);
+
+private:
+	/*
+	 * Memory layout of a supported pixel format. For RGB formats, the
+	 * offsets are the byte offsets of the red, green, blue and alpha (or
+	 * padding) components in a pixel, with -1 for formats without alpha or
+	 * padding. For packed YUV 4:2:2 formats, they are the byte offsets of
+	 * the first luma, blue chroma, second luma and red chroma components in
+	 * a pair of pixels.
+	 */
+	struct Layout {
+		PixelFormat format;
+		bool yuv;
+		unsigned int bytesPerPixel;
+		std::array<int, 4> offsets;
+	};
+
+	struct ColourMatrix {
+		int32_t coeffs[3][3];
+		std::array<int32_t, 3> inOffsets;
+		std::array<int32_t, 3> outOffsets;
+	};
+
+	struct Plane {
+		const Layout *layout;
+		Size size;
+		unsigned int stride;
+		std::vector<unsigned int> xmap;
+		std::vector<unsigned int> ymap;
+		std::optional<ColourMatrix> matrix;
+		bool copy;
+	};
+
+	struct Job {
+		uint64_t id;
+		FrameBuffer *input;
+		Request::BufferMap outputs;
+		std::optional<MappedFrameBuffer> in;
+		std::vector<std::pair<const Plane *, MappedFrameBuffer>> out;
+		std::atomic<unsigned int> remaining;
+	};
+
+	static const std::array<Layout, 10> layouts_;
+
+	static const Layout *layout(const PixelFormat &format);
+	static void unpackRow(const Layout &layout, const uint8_t *src,
+			      unsigned int width, uint8_t *row[3]);
+	static void packRow(const Plane &plane, uint8_t *const row[3],
+			    uint8_t *dst);
+
+	void processStripe(Job *job, unsigned int first, unsigned int last);
+	void jobDone(uint64_t id);
+	void completeJob(std::list<Job>::iterator job);
+
+	DmaBufAllocator dmaHeap_;
+
+	Plane input_;
+	std::map<const Stream *, Plane> outputs_;
+
+	unsigned int stripes_;
+	bool running_;
+	uint64_t nextJobId_;
+	std::list<Job> activeJobs_;
+	std::unique_ptr<TaskGroup> tasks_;
+};
+
+} /* namespace libcamera */
@@ -9,14 +9,17 @@
 #pragma once
 
 #include <functional>
+#include <list>
 #include <map>
 #include <memory>
+#include <queue>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/signal.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/pixel_format.h>
 
@@ -55,7 +58,7 @@ public:
 	void stop();
 
 	int queueBuffers(FrameBuffer *input,
-			 const std::map<const Stream *, FrameBuffer *> &outputs);
+			 const Request::BufferMap &outputs);
 
 private:
 	class V4L2M2MStream : protected Loggable
@@ -73,6 +76,8 @@ private:
 		int start();
 		void stop();
 
+		unsigned int maxQueueDepth() const;
+
 		int queueBuffers(FrameBuffer *input, FrameBuffer *output);
 
 	protected:
@@ -90,10 +95,35 @@ private:
 		unsigned int outputBufferCount_;
 	};
 
+	struct Job {
+		FrameBuffer *input;
+		Request::BufferMap outputs;
+		unsigned int inputRefs;
+		unsigned int outputsPending;
+		utils::time_point queued;
+	};
+
+	int queueJob(Job &job);
+	void cancelJob(Job &job);
+	void processJobs();
+
+	void inputDone(FrameBuffer *buffer);
+	void outputDone(FrameBuffer *buffer);
+	void completeJob(std::list<Job>::iterator job);
+
 	std::unique_ptr<V4L2M2MDevice> m2m_;
 
 	std::map<const Stream *, std::unique_ptr<V4L2M2MStream>> streams_;
-	std::map<FrameBuffer *, unsigned int> queue_;
+
+	unsigned int queueDepth_;
+	unsigned int maxQueueDepth_;
+	bool running_;
+	std::queue<Job> pendingJobs_;
+	std::list<Job> activeJobs_;
+
+	unsigned int completedJobs_;
+	utils::Duration totalLatency_;
+	utils::Duration maxLatency_;
 };
 
 } /* namespace libcamera */
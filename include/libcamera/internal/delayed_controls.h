@@ -7,8 +7,10 @@
 
 #pragma once
 
+#include <array>
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
 #include <libcamera/controls.h>
 
@@ -27,10 +29,10 @@ public:
 	DelayedControls(V4L2Device *device,
 			const std::unordered_map<uint32_t, ControlParams> &controlParams);
 
-	void reset();
+	void reset(unsigned int cookie = 0);
 
-	bool push(const ControlList &controls);
-	ControlList get(uint32_t sequence);
+	bool push(const ControlList &controls, unsigned int cookie = 0);
+	const ControlList &get(uint32_t sequence, unsigned int *cookie = nullptr);
 
 	void applyControls(uint32_t sequence);
 
@@ -53,29 +55,41 @@ private:
 
 	/* \todo Make the listSize configurable at instance creation time. */
 	static constexpr int listSize = 16;
-	class ControlRingBuffer : public std::array<Info, listSize>
+	template<typename T>
+	class RingBuffer : public std::array<T, listSize>
 	{
 	public:
-		Info &operator[](unsigned int index)
+		T &operator[](unsigned int index)
 		{
-			return std::array<Info, listSize>::operator[](index % listSize);
+			return std::array<T, listSize>::operator[](index % listSize);
 		}
 
-		const Info &operator[](unsigned int index) const
+		const T &operator[](unsigned int index) const
 		{
-			return std::array<Info, listSize>::operator[](index % listSize);
+			return std::array<T, listSize>::operator[](index % listSize);
 		}
 	};
 
+	struct Control {
+		const ControlId *id;
+		ControlParams params;
+		RingBuffer<Info> values;
+	};
+
+	Control *findControl(unsigned int id);
+
 	V4L2Device *device_;
-	/* \todo Evaluate if we should index on ControlId * or unsigned int */
-	std::unordered_map<const ControlId *, ControlParams> controlParams_;
+	std::vector<Control> controls_;
 	unsigned int maxDelay_;
 
 	uint32_t queueCount_;
 	uint32_t writeCount_;
-	/* \todo Evaluate if we should index on ControlId * or unsigned int */
-	std::unordered_map<const ControlId *, ControlRingBuffer> values_;
+	RingBuffer<unsigned int> cookies_;
+
+	std::vector<uint32_t> ids_;
+	ControlList current_;
+	ControlList pending_;
+	ControlList priority_;
 };
 
 } /* namespace libcamera */
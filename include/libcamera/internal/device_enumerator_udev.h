@@ -7,12 +7,16 @@
 
 #pragma once
 
+#include <chrono>
 #include <list>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
 #include <sys/types.h>
+#include <vector>
+
+#include <libcamera/base/timer.h>
 
 #include "libcamera/internal/device_enumerator.h"
 
@@ -55,11 +59,14 @@ private:
 	};
 
 	int addUdevDevice(struct udev_device *dev);
+	int addMediaDevice(std::unique_ptr<MediaDevice> media);
 	int populateMediaDevice(MediaDevice *media, DependencyMap *deps);
 	std::string lookupDeviceNode(dev_t devnum);
 
 	int addV4L2Device(dev_t devnum);
+	void removeMediaDevice(const std::string &deviceNode);
 	void udevNotify();
+	void processEvents();
 
 	struct udev *udev_;
 	struct udev_monitor *monitor_;
@@ -68,6 +75,12 @@ private:
 	std::set<dev_t> orphans_;
 	std::list<MediaDeviceDeps> pending_;
 	std::map<dev_t, MediaDeviceDeps *> devMap_;
+
+	/* Hotplug additions, processed in batches when the timer expires. */
+	std::vector<struct udev_device *> events_;
+	std::chrono::steady_clock::time_point batchStart_;
+	Timer timer_;
+	unsigned int added_;
 };
 
 } /* namespace libcamera */
@@ -7,11 +7,17 @@
 
 #pragma once
 
+#include <initializer_list>
+#include <memory>
 #include <stddef.h>
+#include <vector>
 
 #include <libcamera/base/flags.h>
+#include <libcamera/base/memfd.h>
 #include <libcamera/base/unique_fd.h>
 
+#include <libcamera/framebuffer.h>
+
 namespace libcamera {
 
 class DmaBufAllocator
@@ -26,15 +32,35 @@ public:
 	using DmaBufAllocatorFlags = Flags<DmaBufAllocatorFlag>;
 
 	DmaBufAllocator(DmaBufAllocatorFlags flags = DmaBufAllocatorFlag::CmaHeap);
+	DmaBufAllocator(std::initializer_list<DmaBufAllocatorFlag> preferences);
 	~DmaBufAllocator();
 	bool isValid() const { return providerHandle_.isValid(); }
+	DmaBufAllocatorFlag type() const { return type_; }
 	UniqueFD alloc(const char *name, std::size_t size);
 
+	void setPoolLimit(std::size_t bytes);
+	void setHugePages(bool enable);
+	void recycle(UniqueFD fd);
+
+	std::unique_ptr<FrameBuffer>
+	exportFrameBuffer(const char *name, std::size_t size,
+			  std::vector<FrameBuffer::Plane> planes);
+
 private:
+	class Pool;
+	class PooledFrameBuffer;
+
+	bool open(DmaBufAllocatorFlags types);
+
 	UniqueFD allocFromHeap(const char *name, std::size_t size);
 	UniqueFD allocFromUDmaBuf(const char *name, std::size_t size);
+	UniqueFD createUDmaBuf(const char *name, std::size_t size,
+			       MemFd::Options options);
 	UniqueFD providerHandle_;
 	DmaBufAllocatorFlag type_;
+	bool hugePages_;
+
+	std::shared_ptr<Pool> pool_;
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(DmaBufAllocator::DmaBufAllocatorFlag)
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Shared waiter for frame buffer fences
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/unique_fd.h>
+
+namespace libcamera {
+
+class EventNotifier;
+class FrameBuffer;
+
+class FenceWaiter
+{
+public:
+	FenceWaiter();
+	~FenceWaiter();
+
+	int add(FrameBuffer *buffer);
+	void remove(FrameBuffer *buffer);
+
+	Signal<FrameBuffer *> signalled;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(FenceWaiter)
+
+	void eventsReady();
+
+	UniqueFD epollFd_;
+	std::unique_ptr<EventNotifier> notifier_;
+};
+
+} /* namespace libcamera */
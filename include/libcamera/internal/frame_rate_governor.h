@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Frame rate adaptation to the application demand
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+namespace libcamera {
+
+class ControlInfo;
+class ControlList;
+
+class FrameRateGovernor
+{
+public:
+	static constexpr unsigned int kWindow = 30;
+	static constexpr unsigned int kProbeWindows = 3;
+
+	FrameRateGovernor(const ControlInfo &frameDurationLimits);
+
+	void start(const ControlList *controls);
+	void requestQueued(ControlList &controls);
+	void requestCompleted(const ControlList &metadata);
+
+	bool isActive() const;
+	int64_t frameDuration() const;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(FrameRateGovernor)
+
+	void update();
+
+	const int64_t minDuration_;
+	const int64_t maxDuration_;
+
+	mutable Mutex mutex_;
+	bool active_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int64_t target_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool pending_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int64_t probeFrom_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	int64_t frameDurationMeasured_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int delivered_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int starved_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int cleanWindows_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <utility>
 
@@ -14,6 +15,9 @@
 
 #include <libcamera/fence.h>
 #include <libcamera/framebuffer.h>
+#include <libcamera/memory_usage.h>
+
+#include "libcamera/internal/memory_usage.h"
 
 namespace libcamera {
 
@@ -35,6 +39,18 @@ public:
 
 	FrameMetadata &metadata() { return metadata_; }
 
+	void setRequestCompleteHandler(std::function<void()> handler)
+	{
+		requestCompleteHandler_ = std::move(handler);
+	}
+	void requestComplete();
+
+	MemoryUsage::Type memoryType() const { return memoryType_; }
+	void setMemoryType(MemoryUsage::Type type) { memoryType_ = type; }
+
+	const MemoryAccount::Charge &memoryCharge() const { return memoryCharge_; }
+	void setMemoryCharge(MemoryAccount::Charge charge) { memoryCharge_ = std::move(charge); }
+
 private:
 	std::vector<Plane> planes_;
 	FrameMetadata metadata_;
@@ -43,6 +59,11 @@ private:
 	std::unique_ptr<Fence> fence_;
 	Request *request_;
 	bool isContiguous_;
+
+	std::function<void()> requestCompleteHandler_;
+
+	MemoryUsage::Type memoryType_;
+	MemoryAccount::Charge memoryCharge_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Per-frame IPA processing time budget
+ */
+
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class FrameMetadata;
+class MetricCounter;
+class MetricHistogram;
+class MetricsRegistry;
+
+class IPABudget
+{
+public:
+	enum class Policy {
+		Report,
+		Skip,
+	};
+
+	IPABudget(const std::string &pipe, MetricsRegistry *metrics);
+
+	Policy policy() const { return policy_; }
+	utils::Duration budget() const { return budget_; }
+	unsigned int overruns() const { return overruns_; }
+
+	void reset();
+
+	bool skip(const FrameMetadata &metadata);
+	void begin(unsigned int frame);
+	utils::Duration end(unsigned int frame);
+
+private:
+	struct Processing {
+		utils::time_point start;
+		bool handled;
+	};
+
+	void updateBudget(const FrameMetadata &metadata);
+
+	std::string pipe_;
+	Policy policy_;
+
+	utils::Duration budget_;
+	uint32_t lastSequence_;
+	uint64_t lastTimestamp_;
+
+	std::map<unsigned int, Processing> processing_;
+	unsigned int overruns_;
+	bool skipNext_;
+
+	MetricCounter *overrunsCounter_;
+	MetricCounter *skippedCounter_;
+	MetricHistogram *processingTime_;
+};
+
+} /* namespace libcamera */
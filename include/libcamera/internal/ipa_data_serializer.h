@@ -88,6 +88,19 @@ public:
 
 #ifndef __DOXYGEN__
 
+/*
+ * Types whose serialized form is identical to their in-memory representation,
+ * and that can thus be serialized with a plain memory copy. This covers
+ * arithmetic types, and is specialized by the generated serializers for mojom
+ * structs made of such types only and without any padding.
+ */
+template<typename T>
+struct is_trivially_serializable : std::is_arithmetic<T> {
+};
+
+template<typename T>
+inline constexpr bool is_trivially_serializable_v = is_trivially_serializable<T>::value;
+
 /*
  * Serialization format for vector of type V:
  *
@@ -99,11 +112,20 @@ public:
  * 4 bytes - uint32_t Number of fds for the element
  * X bytes - Serialized element
  *
+ * If V is trivially serializable, the elements are instead stored contiguously
+ * without any size or number of fds:
+ *
+ * 4 bytes - uint32_t Length of vector, in number of elements
+ * X bytes - Elements, Length * sizeof(V) bytes
+ *
  * \todo Support elements that are references
  */
 template<typename V>
 class IPADataSerializer<std::vector<V>>
 {
+	static constexpr bool kTrivial = is_trivially_serializable_v<V> &&
+					 !std::is_same_v<V, bool>;
+
 public:
 	static std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
 	serialize(const std::vector<V> &data, ControlSerializer *cs = nullptr)
@@ -113,6 +135,16 @@ public:
 
 		/* Serialize the length. */
 		uint32_t vecLen = data.size();
+
+		if constexpr (kTrivial) {
+			dataVec.resize(4 + vecLen * sizeof(V));
+			memcpy(dataVec.data(), &vecLen, 4);
+			if (vecLen)
+				memcpy(dataVec.data() + 4, data.data(), vecLen * sizeof(V));
+
+			return { std::move(dataVec), {} };
+		}
+
 		appendPOD<uint32_t>(dataVec, vecLen);
 
 		/* Serialize the members. */
@@ -130,7 +162,7 @@ public:
 			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
 		}
 
-		return { dataVec, fdsVec };
+		return { std::move(dataVec), std::move(fdsVec) };
 	}
 
 	static std::vector<V> deserialize(std::vector<uint8_t> &data, ControlSerializer *cs = nullptr)
@@ -159,6 +191,23 @@ public:
 					  ControlSerializer *cs = nullptr)
 	{
 		uint32_t vecLen = readPOD<uint32_t>(dataBegin, 0, dataEnd);
+
+		if constexpr (kTrivial) {
+			size_t dataSize = std::distance(dataBegin, dataEnd) - 4;
+			if (dataSize / sizeof(V) < vecLen) {
+				LOG(IPADataSerializer, Error)
+					<< "Failed to deserialize vector: not enough data, expected "
+					<< vecLen * sizeof(V) << ", got " << dataSize;
+				return {};
+			}
+
+			std::vector<V> ret(vecLen);
+			if (vecLen)
+				memcpy(ret.data(), &*(dataBegin + 4), vecLen * sizeof(V));
+
+			return ret;
+		}
+
 		std::vector<V> ret(vecLen);
 
 		std::vector<uint8_t>::const_iterator dataIter = dataBegin + 4;
@@ -236,7 +285,7 @@ public:
 			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
 		}
 
-		return { dataVec, fdsVec };
+		return { std::move(dataVec), std::move(fdsVec) };
 	}
 
 	static std::map<K, V> deserialize(std::vector<uint8_t> &data, ControlSerializer *cs = nullptr)
@@ -314,7 +363,7 @@ public:
 		dataVec.reserve(sizeof(Flags<E>));
 		appendPOD<uint32_t>(dataVec, static_cast<typename Flags<E>::Type>(data));
 
-		return { dataVec, {} };
+		return { std::move(dataVec), {} };
 	}
 
 	static Flags<E> deserialize(std::vector<uint8_t> &data,
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <map>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #include <libcamera/base/log.h>
@@ -55,8 +57,23 @@ public:
 #endif
 
 private:
+	struct FileStamp {
+		uint64_t device;
+		uint64_t inode;
+		uint64_t size;
+		int64_t mtime;
+		int64_t ctime;
+
+		bool operator==(const FileStamp &other) const;
+		bool operator!=(const FileStamp &other) const
+		{
+			return !(*this == other);
+		}
+	};
+
 	static IPAManager *self_;
 
+	void scan();
 	void parseDir(const char *libDir, unsigned int maxDepth,
 		      std::vector<std::string> &files);
 	unsigned int addDir(const char *libDir, unsigned int maxDepth = 0);
@@ -64,10 +81,22 @@ private:
 	IPAModule *module(PipelineHandler *pipe, uint32_t minVersion,
 			  uint32_t maxVersion);
 
-	bool isSignatureValid(IPAModule *ipa) const;
+	bool isSignatureValid(IPAModule *ipa);
 
+	static bool fileStamp(const std::string &path, FileStamp *stamp);
+	void loadSignatureCache();
+	void saveSignatureCache() const;
+
+	bool scanned_;
+	std::vector<std::string> moduleFiles_;
+	std::size_t nextModule_;
 	std::vector<IPAModule *> modules_;
 
+	bool signatureCacheLoaded_;
+	std::string signatureCachePath_;
+	FileStamp libraryStamp_;
+	std::map<std::string, FileStamp> signatureCache_;
+
 #if HAVE_IPA_PUBKEY
 	static const uint8_t publicKeyData_[];
 	static const PubKey pubKey_;
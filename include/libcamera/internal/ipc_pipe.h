@@ -9,6 +9,7 @@
 
 #include <vector>
 
+#include <libcamera/base/class.h>
 #include <libcamera/base/shared_fd.h>
 #include <libcamera/base/signal.h>
 
@@ -22,6 +23,7 @@ public:
 	struct Header {
 		uint32_t cmd;
 		uint32_t cookie;
+		uint32_t channel;
 	};
 
 	IPCMessage();
@@ -30,6 +32,8 @@ public:
 	IPCMessage(IPCUnixSocket::Payload &payload);
 
 	IPCUnixSocket::Payload payload() const;
+	int send(IPCUnixSocket *socket) const;
+	int sendBatched(IPCUnixSocket *socket) const;
 
 	Header &header() { return header_; }
 	std::vector<uint8_t> &data() { return data_; }
@@ -46,6 +50,31 @@ private:
 	std::vector<SharedFD> fds_;
 };
 
+class IPCPipe;
+
+class IPCPendingCall
+{
+public:
+	IPCPendingCall();
+	IPCPendingCall(IPCPipe *pipe, uint32_t cookie);
+	IPCPendingCall(IPCPendingCall &&other);
+	~IPCPendingCall();
+
+	IPCPendingCall &operator=(IPCPendingCall &&other);
+
+	bool isValid() const { return pipe_ != nullptr; }
+	bool isComplete() const;
+	int wait(IPCMessage *out = nullptr);
+
+private:
+	LIBCAMERA_DISABLE_COPY(IPCPendingCall)
+
+	void release();
+
+	IPCPipe *pipe_;
+	uint32_t cookie_;
+};
+
 class IPCPipe
 {
 public:
@@ -59,9 +88,17 @@ public:
 
 	virtual int sendAsync(const IPCMessage &data) = 0;
 
+	virtual IPCPendingCall sendPipelined(const IPCMessage &in) = 0;
+
 	Signal<const IPCMessage &> recv;
 
 protected:
+	friend class IPCPendingCall;
+
+	virtual bool isCallComplete(uint32_t cookie) const = 0;
+	virtual int waitCall(uint32_t cookie, IPCMessage *out) = 0;
+	virtual void cancelCall(uint32_t cookie) = 0;
+
 	bool connected_;
 };
 
@@ -16,8 +16,6 @@
 
 namespace libcamera {
 
-class Process;
-
 class IPCPipeUnixSocket : public IPCPipe
 {
 public:
@@ -29,18 +27,30 @@ public:
 
 	int sendAsync(const IPCMessage &data) override;
 
+	IPCPendingCall sendPipelined(const IPCMessage &in) override;
+
+	static void releaseSpareWorkers();
+
+protected:
+	bool isCallComplete(uint32_t cookie) const override;
+	int waitCall(uint32_t cookie, IPCMessage *out) override;
+	void cancelCall(uint32_t cookie) override;
+
 private:
+	class Worker;
+
 	struct CallData {
-		IPCUnixSocket::Payload *response;
+		IPCUnixSocket::Payload response;
 		bool done;
+		bool cancelled;
 	};
 
-	void readyRead();
-	int call(const IPCUnixSocket::Payload &message,
-		 IPCUnixSocket::Payload *response, uint32_t seq);
+	int send(const IPCMessage &in, bool batched);
+	void receive(const IPCMessage::Header &header,
+		     IPCUnixSocket::Payload &payload);
 
-	std::unique_ptr<Process> proc_;
-	std::unique_ptr<IPCUnixSocket> socket_;
+	std::shared_ptr<Worker> worker_;
+	uint32_t channel_;
 	std::map<uint32_t, CallData> callData_;
 };
 
@@ -7,16 +7,20 @@
 
 #pragma once
 
+#include <deque>
+#include <initializer_list>
 #include <stdint.h>
 #include <sys/types.h>
 #include <vector>
 
 #include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
 #include <libcamera/base/unique_fd.h>
 
 namespace libcamera {
 
 class EventNotifier;
+class Timer;
 
 class IPCUnixSocket
 {
@@ -35,25 +39,66 @@ public:
 	bool isBound() const;
 
 	int send(const Payload &payload);
+	int send(std::initializer_list<Span<const uint8_t>> data,
+		 Span<const int32_t> fds);
+	int sendBatched(std::initializer_list<Span<const uint8_t>> data,
+			Span<const int32_t> fds);
+	int flush();
 	int receive(Payload *payload);
 
 	Signal<> readyRead;
 
 private:
+	static constexpr unsigned int kMaxDataBuffers = 4;
+	static constexpr std::size_t kMaxBatchSize = 64 * 1024;
+
 	struct Header {
 		uint32_t data;
 		uint8_t fds;
+		uint8_t flags;
 	};
 
-	int sendData(const void *buffer, size_t length, const int32_t *fds, unsigned int num);
+	struct BatchRecord {
+		uint32_t data;
+		uint32_t fds;
+	};
+
+	struct Ring;
+
+	int sendMessage(std::initializer_list<Span<const uint8_t>> data,
+			Span<const int32_t> fds, uint8_t flags);
+	int receiveMessage(Payload *payload);
+	int unpackBatch(const Payload &batch);
+	void dispatchPending();
+
+	int sendData(std::initializer_list<Span<const uint8_t>> data,
+		     const int32_t *fds, unsigned int num);
 	int recvData(void *buffer, size_t length, int32_t *fds, unsigned int num);
+	int recvHeader();
+
+	int mapRings(const UniqueFD &fd, bool creator);
+	void unmapRings();
+	bool writeRing(std::initializer_list<Span<const uint8_t>> data,
+		       size_t size);
+	int readRing(uint8_t *data, size_t size);
 
 	void dataNotifier();
 
 	UniqueFD fd_;
 	bool headerReceived_;
 	struct Header header_;
+	std::vector<int32_t> headerFds_;
 	EventNotifier *notifier_;
+
+	void *ringMem_;
+	Ring *txRing_;
+	Ring *rxRing_;
+
+	std::vector<uint8_t> batchData_;
+	std::vector<UniqueFD> batchFds_;
+	unsigned int batchCount_;
+	Timer *batchTimer_;
+	std::deque<Payload> pending_;
 };
 
 } /* namespace libcamera */
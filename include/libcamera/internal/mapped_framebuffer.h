@@ -50,11 +50,33 @@ public:
 		Read = 1 << 0,
 		Write = 1 << 1,
 		ReadWrite = Read | Write,
+		Populate = 1 << 2,
+		ExplicitAccess = 1 << 3,
 	};
 
 	using MapFlags = Flags<MapFlag>;
 
 	MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags);
+	~MappedFrameBuffer();
+
+	MappedFrameBuffer(MappedFrameBuffer &&other);
+	MappedFrameBuffer &operator=(MappedFrameBuffer &&other);
+
+	int beginAccess(MapFlags access) const;
+	int endAccess() const;
+	bool accessing() const { return syncFlags_ != 0; }
+
+	static void invalidate(Span<const FrameBuffer::Plane> planes);
+
+private:
+	struct Mapping;
+
+	int sync(uint64_t flags) const;
+	void release();
+
+	std::vector<Mapping *> mappings_;
+	MapFlags flags_;
+	mutable unsigned int syncFlags_;
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(MappedFrameBuffer::MapFlag)
@@ -8,8 +8,10 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <linux/media.h>
@@ -22,6 +24,8 @@
 
 namespace libcamera {
 
+class MediaRequest;
+
 class MediaDevice : protected Loggable
 {
 public:
@@ -41,6 +45,7 @@ public:
 	const std::string &driver() const { return driver_; }
 	const std::string &deviceNode() const { return deviceNode_; }
 	const std::string &model() const { return model_; }
+	const std::string &serial() const { return serial_; }
 	unsigned int version() const { return version_; }
 	unsigned int hwRevision() const { return hwRevision_; }
 
@@ -54,6 +59,9 @@ public:
 	MediaLink *link(const MediaPad *source, const MediaPad *sink);
 	int disableLinks();
 
+	int allocateRequests(unsigned int count,
+			     std::vector<std::unique_ptr<MediaRequest>> *requests);
+
 	Signal<> disconnected;
 
 protected:
@@ -67,8 +75,6 @@ private:
 	bool addObject(MediaObject *object);
 	void clear();
 
-	struct media_v2_interface *findInterface(const struct media_v2_topology &topology,
-						 unsigned int entityId);
 	bool populateEntities(const struct media_v2_topology &topology);
 	bool populatePads(const struct media_v2_topology &topology);
 	bool populateLinks(const struct media_v2_topology &topology);
@@ -80,6 +86,7 @@ private:
 	std::string driver_;
 	std::string deviceNode_;
 	std::string model_;
+	std::string serial_;
 	unsigned int version_;
 	unsigned int hwRevision_;
 
@@ -87,8 +94,10 @@ private:
 	bool valid_;
 	bool acquired_;
 
-	std::map<unsigned int, MediaObject *> objects_;
+	std::vector<MediaObject *> objects_;
+	std::unordered_map<unsigned int, MediaObject *> objectsById_;
 	std::vector<MediaEntity *> entities_;
+	std::unordered_map<std::string, MediaEntity *> entitiesByName_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Media Controller request
+ */
+
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/unique_fd.h>
+
+namespace libcamera {
+
+class EventNotifier;
+
+class MediaRequest
+{
+public:
+	enum class Status {
+		Idle,
+		Queued,
+		Complete,
+	};
+
+	explicit MediaRequest(UniqueFD fd);
+	~MediaRequest();
+
+	int fd() const { return fd_.get(); }
+	Status status() const { return status_; }
+
+	uint64_t cookie() const { return cookie_; }
+	void setCookie(uint64_t cookie) { cookie_ = cookie; }
+
+	int queue();
+	int reinit();
+
+	Signal<MediaRequest *> completed;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(MediaRequest)
+
+	void requestComplete();
+
+	UniqueFD fd_;
+	std::unique_ptr<EventNotifier> notifier_;
+	Status status_;
+	uint64_t cookie_;
+};
+
+} /* namespace libcamera */
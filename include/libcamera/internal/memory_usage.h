@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Memory footprint accounting
+ */
+
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/memory_usage.h>
+
+namespace libcamera {
+
+class FrameBuffer;
+
+class MemoryAccount : public std::enable_shared_from_this<MemoryAccount>
+{
+public:
+	class Charge
+	{
+	public:
+		Charge() = default;
+		Charge(Charge &&other);
+		~Charge();
+
+		Charge &operator=(Charge &&other);
+
+		uint64_t bytes() const { return bytes_; }
+		void release();
+
+	private:
+		LIBCAMERA_DISABLE_COPY(Charge)
+
+		friend class MemoryAccount;
+
+		Charge(std::shared_ptr<MemoryAccount> account,
+		       MemoryUsage::Type type, uint64_t bytes);
+
+		std::shared_ptr<MemoryAccount> account_;
+		MemoryUsage::Type type_ = MemoryUsage::Type::Anonymous;
+		uint64_t bytes_ = 0;
+	};
+
+	MemoryAccount() = default;
+
+	Charge charge(MemoryUsage::Type type, uint64_t bytes);
+	void charge(FrameBuffer *buffer);
+
+	MemoryUsage usage() const LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(MemoryAccount)
+
+	void add(MemoryUsage::Type type, uint64_t bytes)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void remove(MemoryUsage::Type type, uint64_t bytes)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	mutable Mutex mutex_;
+	MemoryUsage usage_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Runtime metrics registry
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/metrics.h>
+
+namespace libcamera {
+
+class MetricCounter
+{
+public:
+	MetricCounter()
+		: value_(0)
+	{
+	}
+
+	void add(uint64_t count = 1)
+	{
+		value_.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(MetricCounter)
+
+	std::atomic<uint64_t> value_;
+};
+
+class MetricHistogram
+{
+public:
+	MetricHistogram(std::vector<uint64_t> bounds);
+
+	void record(uint64_t value);
+
+	const std::vector<uint64_t> &bounds() const { return bounds_; }
+	uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+	uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+	std::vector<uint64_t> buckets() const;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(MetricHistogram)
+
+	std::vector<uint64_t> bounds_;
+	std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+	std::atomic<uint64_t> count_;
+	std::atomic<uint64_t> sum_;
+};
+
+class MetricsRegistry
+{
+public:
+	MetricsRegistry(const std::string &scope = {});
+	~MetricsRegistry();
+
+	std::string scope() const LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void setScope(const std::string &scope) LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	MetricCounter *counter(const std::string &name)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+	MetricHistogram *histogram(const std::string &name,
+				   std::vector<uint64_t> bounds)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	std::vector<Metric> metrics() const LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	static std::vector<Metric> allMetrics();
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(MetricsRegistry)
+
+	struct List;
+	static List &list();
+
+	void collect(std::vector<Metric> *metrics) const
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	mutable Mutex mutex_;
+	std::string scope_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::map<std::string, std::unique_ptr<MetricCounter>> counters_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::map<std::string, std::unique_ptr<MetricHistogram>> histograms_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
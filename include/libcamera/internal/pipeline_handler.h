@@ -7,16 +7,18 @@
 
 #pragma once
 
+#include <list>
 #include <memory>
-#include <queue>
 #include <set>
 #include <string>
 #include <sys/types.h>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/object.h>
 
+#include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
 #include <libcamera/stream.h>
 
@@ -34,6 +36,8 @@ class MediaDevice;
 class PipelineHandler;
 class Request;
 
+enum class SensorSyncMode;
+
 class PipelineHandler : public std::enable_shared_from_this<PipelineHandler>,
 			public Object
 {
@@ -55,15 +59,21 @@ public:
 	virtual int exportFrameBuffers(Camera *camera, Stream *stream,
 				       std::vector<std::unique_ptr<FrameBuffer>> *buffers) = 0;
 
+	virtual int setSyncMode(Camera *camera, SensorSyncMode mode);
+
 	virtual int start(Camera *camera, const ControlList *controls) = 0;
 	void stop(Camera *camera);
 	bool hasPendingRequests(const Camera *camera) const;
 
 	void registerRequest(Request *request);
 	void queueRequest(Request *request);
+	void queueRequests(const std::vector<Request *> &requests);
 
 	bool completeBuffer(Request *request, FrameBuffer *buffer);
+	void metadataAvailable(Request *request, const ControlList &metadata);
 	void completeRequest(Request *request);
+	void frameDropped(Camera *camera, uint32_t sequence,
+			  controls::FrameDropCauseEnum cause);
 
 	std::string configurationFile(const std::string &subdir,
 				      const std::string &name) const;
@@ -90,10 +100,18 @@ private:
 	void doQueueRequest(Request *request);
 	void doQueueRequests();
 
+	void pushRequest(std::list<Request *> &list, Request *request);
+	void popRequest(std::list<Request *> &list);
+	std::list<Request *>::iterator
+	eraseRequest(std::list<Request *> &list, std::list<Request *>::iterator pos);
+
 	std::vector<std::shared_ptr<MediaDevice>> mediaDevices_;
 	std::vector<std::weak_ptr<Camera>> cameras_;
 
-	std::queue<Request *> waitingRequests_;
+	std::list<Request *> waitingRequests_;
+	std::list<Request *> freeRequestNodes_;
+	std::vector<std::pair<const Camera *, int>> blockedCameras_;
+	bool queueingBatch_;
 
 	const char *name_;
 
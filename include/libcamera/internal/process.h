@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <list>
 #include <signal.h>
 #include <string>
 #include <vector>
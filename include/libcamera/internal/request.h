@@ -7,11 +7,13 @@
 
 #pragma once
 
+#include <array>
 #include <chrono>
-#include <map>
 #include <memory>
+#include <stdint.h>
+#include <vector>
 
-#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/allocation_tracker.h>
 #include <libcamera/base/timer.h>
 
 #include <libcamera/request.h>
@@ -28,6 +30,17 @@ class Request::Private : public Extensible::Private
 	LIBCAMERA_DECLARE_PUBLIC(Request)
 
 public:
+	enum TimelineStage {
+		StageQueued,
+		StageDeviceQueued,
+		StageSensor,
+		StageFirstBuffer,
+		StageLastBuffer,
+		StageMetadata,
+		StageCompleted,
+		StageCount,
+	};
+
 	Private(Camera *camera);
 	~Private();
 
@@ -42,23 +55,32 @@ public:
 	void prepare(std::chrono::milliseconds timeout = 0ms);
 	Signal<> prepared;
 
+	void fenceSignalled(FrameBuffer *buffer);
+
+	void recordStage(TimelineStage stage);
+	const std::array<int64_t, StageCount> &timeline() const { return timeline_; }
+
 private:
 	friend class PipelineHandler;
 	friend std::ostream &operator<<(std::ostream &out, const Request &r);
 
 	void doCancelRequest();
 	void emitPrepareCompleted();
-	void notifierActivated(FrameBuffer *buffer);
+	void cancelFences();
 	void timeout();
 
 	Camera *camera_;
 	bool cancelled_;
 	uint32_t sequence_ = 0;
 	bool prepared_ = false;
+	int priority_ = 0;
 
-	std::unordered_set<FrameBuffer *> pending_;
-	std::map<FrameBuffer *, std::unique_ptr<EventNotifier>> notifiers_;
+	std::vector<FrameBuffer *> pending_;
+	unsigned int pendingFences_ = 0;
 	std::unique_ptr<Timer> timer_;
+
+	std::array<int64_t, StageCount> timeline_ = {};
+	AllocationCounters allocations_;
 };
 
 } /* namespace libcamera */
@@ -25,4 +25,8 @@ struct DebayerParams {
 	ColorLookupTable blue;
 };
 
+static constexpr unsigned int kDebayerParamsBufferCount = 4;
+
+using DebayerParamsBuffers = std::array<DebayerParams, kDebayerParamsBufferCount>;
+
 } /* namespace libcamera */
@@ -7,34 +7,39 @@
 
 #pragma once
 
+#include <array>
 #include <functional>
 #include <initializer_list>
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/signal.h>
 #include <libcamera/base/thread.h>
 
 #include <libcamera/geometry.h>
 #include <libcamera/pixel_format.h>
+#include <libcamera/request.h>
 
 #include <libcamera/ipa/soft_ipa_interface.h>
 #include <libcamera/ipa/soft_ipa_proxy.h>
 
 #include "libcamera/internal/camera_sensor.h"
 #include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/memory_usage.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/shared_mem_object.h"
 #include "libcamera/internal/software_isp/debayer_params.h"
 
 namespace libcamera {
 
-class DebayerCpu;
+class Debayer;
 class FrameBuffer;
 class PixelFormat;
 class Stream;
@@ -52,6 +57,10 @@ public:
 
 	bool isValid() const;
 
+	void setMemoryAccount(std::shared_ptr<MemoryAccount> account);
+
+	unsigned int maxStreams() const;
+
 	std::vector<PixelFormat> formats(PixelFormat input);
 
 	SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
@@ -66,35 +75,50 @@ public:
 	int exportBuffers(const Stream *stream, unsigned int count,
 			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 
-	void processStats(const ControlList &sensorControls);
+	void processStats(uint32_t statsBufferId, const ControlList &sensorControls);
 
 	int start();
 	void stop();
 
 	int queueBuffers(FrameBuffer *input,
-			 const std::map<const Stream *, FrameBuffer *> &outputs);
+			 const Request::BufferMap &outputs);
 
-	void process(FrameBuffer *input, FrameBuffer *output);
+	void process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs);
 
 	Signal<FrameBuffer *> inputBufferReady;
 	Signal<FrameBuffer *> outputBufferReady;
-	Signal<> ispStatsReady;
+	Signal<uint32_t> ispStatsReady;
 	Signal<const ControlList &> setSensorControls;
 
 private:
-	void saveIspParams();
+	struct PendingFrame {
+		FrameBuffer *input;
+		std::vector<FrameBuffer *> outputs;
+	};
+
+	void saveIspParams(uint32_t paramsBufferId);
 	void setSensorCtrls(const ControlList &sensorControls);
-	void statsReady();
+	void statsReady(uint32_t statsBufferId);
+	void releaseStatsBuffer(uint32_t statsBufferId);
 	void inputReady(FrameBuffer *input);
 	void outputReady(FrameBuffer *output);
 
-	std::unique_ptr<DebayerCpu> debayer_;
+	std::unique_ptr<Debayer> debayer_;
 	Thread ispWorkerThread_;
-	SharedMemObject<DebayerParams> sharedParams_;
-	DebayerParams debayerParams_;
+	SharedMemObject<DebayerParamsBuffers> sharedParams_;
 	DmaBufAllocator dmaHeap_;
+	std::vector<const Stream *> streams_;
+
+	uint32_t paramsBufferIndex_;
+	Mutex pendingFramesMutex_;
+	std::array<PendingFrame, kDebayerParamsBufferCount> pendingFrames_
+		LIBCAMERA_TSA_GUARDED_BY(pendingFramesMutex_);
 
 	std::unique_ptr<ipa::soft::IPAProxySoft> ipa_;
+
+	std::shared_ptr<MemoryAccount> memoryAccount_;
+	MemoryAccount::Charge sharedMemoryCharge_;
+	MemoryAccount::Charge debayerCharge_;
 };
 
 } /* namespace libcamera */
@@ -46,4 +46,20 @@ struct SwIspStats {
 	Histogram yHistogram;
 };
 
+/**
+ * \brief Ring of statistics buffers shared between the Software ISP and IPA
+ *
+ * The Software ISP fills the buffers in turn and passes the index of the
+ * buffer holding the statistics of a frame to the IPA, which owns the buffer
+ * until it releases it. A buffer owned by the IPA is never written. When the
+ * IPA lags behind by kSwIspStatsBufferCount frames or more, no buffer is free,
+ * and the statistics of the frames are dropped until a buffer is released.
+ */
+static constexpr unsigned int kSwIspStatsBufferCount = 4;
+
+/**
+ * \brief Type of the statistics buffers ring shared with the IPA
+ */
+using SwIspStatsBuffers = std::array<SwIspStats, kSwIspStatsBufferCount>;
+
 } /* namespace libcamera */
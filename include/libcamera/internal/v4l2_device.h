@@ -17,6 +17,7 @@
 #include <libcamera/base/log.h>
 #include <libcamera/base/signal.h>
 #include <libcamera/base/span.h>
+#include <libcamera/base/timer.h>
 #include <libcamera/base/unique_fd.h>
 
 #include <libcamera/color_space.h>
@@ -27,6 +28,7 @@
 namespace libcamera {
 
 class EventNotifier;
+class MediaRequest;
 
 class V4L2Device : protected Loggable
 {
@@ -36,8 +38,11 @@ public:
 
 	const ControlInfoMap &controls() const { return controls_; }
 
-	ControlList getControls(const std::vector<uint32_t> &ids);
-	int setControls(ControlList *ctrls);
+	ControlList getControls(const std::vector<uint32_t> &ids,
+				const MediaRequest *request = nullptr);
+	int setControls(ControlList *ctrls, const MediaRequest *request = nullptr);
+	void setControlsDeferred(const ControlList &ctrls);
+	int flushControls();
 
 	const struct v4l2_query_ext_ctrl *controlInfo(uint32_t id) const;
 
@@ -60,6 +65,8 @@ protected:
 
 	int fd() const { return fd_.get(); }
 
+	void disableControlCache();
+
 	template<typename T>
 	static std::optional<ColorSpace> toColorSpace(const T &v4l2Format,
 						      PixelFormatInfo::ColourEncoding colourEncoding);
@@ -77,6 +84,11 @@ private:
 	void updateControls(ControlList *ctrls,
 			    Span<const v4l2_ext_control> v4l2Ctrls);
 
+	static bool controlCacheable(const v4l2_query_ext_ctrl &ctrl);
+	void enableControlCache();
+	void updateControlCache(unsigned int id, const ControlValue &value);
+	bool controlEventsPending();
+
 	void eventAvailable();
 
 	std::map<unsigned int, struct v4l2_query_ext_ctrl> controlInfo_;
@@ -88,6 +100,11 @@ private:
 
 	EventNotifier *fdEventNotifier_;
 	bool frameStartEnabled_;
+
+	bool controlCacheEnabled_;
+	std::map<unsigned int, ControlValue> controlCache_;
+	ControlList pendingControls_;
+	Timer flushTimer_;
 };
 
 } /* namespace libcamera */
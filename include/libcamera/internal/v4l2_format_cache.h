@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Persistent cache of enumerated V4L2 formats
+ */
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/geometry.h>
+
+namespace libcamera {
+
+class V4L2FormatCache
+{
+public:
+	using Formats = std::map<unsigned int, std::vector<SizeRange>>;
+
+	V4L2FormatCache(const std::string &directory);
+
+	static V4L2FormatCache *instance();
+	static std::string deviceId(const std::string &deviceNode);
+
+	std::optional<Formats> lookup(const std::string &device,
+				      const std::string &query)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void store(const std::string &device, const std::string &query,
+		   const Formats &formats)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(V4L2FormatCache)
+
+	using Queries = std::map<std::string, Formats>;
+
+	std::string path(const std::string &device) const;
+	Queries &queries(const std::string &device)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+	Queries load(const std::string &device) const;
+	void save(const std::string &device, const Queries &queries) const;
+
+	std::string directory_;
+	std::string kernel_;
+
+	Mutex mutex_;
+	std::map<std::string, Queries> devices_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
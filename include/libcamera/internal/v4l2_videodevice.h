@@ -15,6 +15,7 @@
 #include <queue>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -33,6 +34,7 @@
 #include <libcamera/pixel_format.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/metrics.h"
 #include "libcamera/internal/v4l2_device.h"
 #include "libcamera/internal/v4l2_pixelformat.h"
 
@@ -41,6 +43,7 @@ namespace libcamera {
 class EventNotifier;
 class MediaDevice;
 class MediaEntity;
+class MediaRequest;
 
 struct V4L2Capability final : v4l2_capability {
 	const char *driver() const
@@ -133,6 +136,13 @@ public:
 	int get(const FrameBuffer &buffer);
 	void put(unsigned int index);
 
+	void add(const FrameBuffer &buffer);
+	void remove(unsigned int count);
+	unsigned int size() const { return cache_.size(); }
+
+	uint64_t hits() const { return hits_; }
+	uint64_t misses() const { return misses_; }
+
 private:
 	class Entry
 	{
@@ -144,25 +154,34 @@ private:
 
 		bool free_;
 		uint64_t lastUsed_;
+		std::size_t key_;
 
 	private:
 		struct Plane {
 			Plane(const FrameBuffer::Plane &plane)
-				: fd(plane.fd.get()), length(plane.length)
+				: fd(plane.fd.get()), offset(plane.offset),
+				  length(plane.length), address(plane.address)
 			{
 			}
 
 			int fd;
+			unsigned int offset;
 			unsigned int length;
+			void *address;
 		};
 
 		std::vector<Plane> planes_;
 	};
 
+	static std::size_t key(const FrameBuffer &buffer);
+
+	void unindex(unsigned int index);
+
 	std::atomic<uint64_t> lastUsedCounter_;
 	std::vector<Entry> cache_;
-	/* \todo Expose the miss counter through an instrumentation API. */
-	unsigned int missCounter_;
+	std::unordered_multimap<std::size_t, unsigned int> index_;
+	uint64_t hits_;
+	uint64_t misses_;
 };
 
 class V4L2DeviceFormat
@@ -185,6 +204,21 @@ public:
 
 std::ostream &operator<<(std::ostream &out, const V4L2DeviceFormat &f);
 
+struct V4L2LatencyStatistics {
+	static constexpr unsigned int kLatencyBuckets = 16;
+
+	struct Stage {
+		uint64_t buffers = 0;
+		std::array<uint64_t, kLatencyBuckets> latency = {};
+		utils::duration totalTime = {};
+		utils::duration maxTime = {};
+	};
+
+	Stage kernel;
+	Stage dispatch;
+	Stage completion;
+};
+
 class V4L2VideoDevice : public V4L2Device
 {
 public:
@@ -215,10 +249,17 @@ public:
 			    std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 	int exportBuffers(unsigned int count,
 			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
-	int importBuffers(unsigned int count);
+	int importBuffers(unsigned int count,
+			  enum v4l2_memory memoryType = V4L2_MEMORY_DMABUF);
+	int addBuffers(unsigned int count,
+		       std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+	int removeBuffers(unsigned int count,
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 	int releaseBuffers();
 
-	int queueBuffer(FrameBuffer *buffer);
+	bool supportsRequests() const { return supportsRequests_; }
+	bool supportsRemoveBuffers() const { return supportsRemoveBuffers_; }
+	int queueBuffer(FrameBuffer *buffer, const MediaRequest *request = nullptr);
 	Signal<FrameBuffer *> bufferReady;
 
 	int streamOn();
@@ -227,6 +268,14 @@ public:
 	void setDequeueTimeout(utils::Duration timeout);
 	Signal<> dequeueTimeout;
 
+	void setBatchedDequeue(bool enable) { batchedDequeue_ = enable; }
+	Signal<> bufferBatchComplete;
+
+	void setLatencyStatisticsEnabled(bool enable);
+	bool latencyStatisticsEnabled() const { return latency_ != nullptr; }
+	V4L2LatencyStatistics latencyStatistics() const;
+	void resetLatencyStatistics();
+
 	static std::unique_ptr<V4L2VideoDevice>
 	fromEntityName(const MediaDevice *media, const std::string &entity);
 
@@ -244,6 +293,8 @@ private:
 		Stopped,
 	};
 
+	class LatencyTracker;
+
 	int initFormats();
 
 	int getFormatMeta(V4L2DeviceFormat *format);
@@ -267,7 +318,7 @@ private:
 	void bufferAvailable();
 	FrameBuffer *dequeueBuffer();
 
-	int queueToDevice(FrameBuffer *buffer);
+	int queueToDevice(FrameBuffer *buffer, const MediaRequest *request);
 
 	void watchdogExpired();
 
@@ -293,6 +344,20 @@ private:
 
 	Timer watchdog_;
 	utils::Duration watchdogDuration_;
+
+	bool batchedDequeue_;
+	bool supportsRequests_;
+	bool supportsRemoveBuffers_;
+
+	std::shared_ptr<LatencyTracker> latency_;
+	utils::time_point dequeueTime_;
+
+	MetricsRegistry metrics_;
+	MetricCounter *cacheHits_;
+	MetricCounter *cacheMisses_;
+	MetricCounter *buffersDequeued_;
+	MetricCounter *bufferErrors_;
+	MetricCounter *dequeueTimeouts_;
 };
 
 class V4L2M2MDevice
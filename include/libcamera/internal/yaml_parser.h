@@ -8,7 +8,7 @@
 #pragma once
 
 #include <iterator>
-#include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -20,22 +20,22 @@
 namespace libcamera {
 
 class File;
+class YamlParserCache;
 class YamlParserContext;
 
 class YamlObject
 {
 private:
 	struct Value {
-		Value(std::string &&k, std::unique_ptr<YamlObject> &&v)
-			: key(std::move(k)), value(std::move(v))
+		Value(const std::string *k, YamlObject *v)
+			: key(k), value(v)
 		{
 		}
-		std::string key;
-		std::unique_ptr<YamlObject> value;
+		const std::string *key;
+		YamlObject *value;
 	};
 
 	using Container = std::vector<Value>;
-	using ListContainer = std::vector<std::unique_ptr<YamlObject>>;
 
 public:
 #ifndef __DOXYGEN__
@@ -110,12 +110,12 @@ public:
 
 		value_type operator*() const
 		{
-			return *it_->value.get();
+			return *it_->value;
 		}
 
 		pointer operator->() const
 		{
-			return it_->value.get();
+			return it_->value;
 		}
 	};
 
@@ -128,7 +128,7 @@ public:
 
 		value_type operator*() const
 		{
-			return { it_->key, *it_->value.get() };
+			return { *it_->key, *it_->value };
 		}
 	};
 
@@ -205,6 +205,7 @@ private:
 
 	template<typename T>
 	friend struct Getter;
+	friend class YamlParserCache;
 	friend class YamlParserContext;
 
 	enum class Type {
@@ -213,16 +214,22 @@ private:
 		Value,
 	};
 
+	class Storage;
+
 	template<typename T>
 	struct Getter {
 		std::optional<T> get(const YamlObject &obj) const;
 	};
 
+	void indexDictionary();
+
 	Type type_;
 
 	std::string value_;
 	Container list_;
-	std::map<std::string, YamlObject *> dictionary_;
+	std::vector<uint32_t> dictionary_;
+
+	std::unique_ptr<Storage> storage_;
 };
 
 class YamlParser final
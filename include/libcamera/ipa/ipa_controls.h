@@ -17,6 +17,8 @@ extern "C" {
 
 #define IPA_CONTROLS_FORMAT_VERSION	1
 
+#define IPA_CONTROLS_FLAG_DELTA		(1 << 0)
+
 enum ipa_controls_id_map_type {
 	IPA_CONTROL_ID_MAP_CONTROLS,
 	IPA_CONTROL_ID_MAP_PROPERTIES,
@@ -30,7 +32,9 @@ struct ipa_controls_header {
 	uint32_t size;
 	uint32_t data_offset;
 	enum ipa_controls_id_map_type id_map_type;
-	uint32_t reserved[2];
+	uint16_t flags;
+	uint16_t stream;
+	uint32_t sequence;
 };
 
 struct ipa_control_value_entry {
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Memory footprint of a camera
+ */
+
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <string>
+
+namespace libcamera {
+
+struct MemoryUsage {
+	enum class Type {
+		Device,
+		DmaHeapCma,
+		DmaHeapSystem,
+		Anonymous,
+	};
+
+	static constexpr unsigned int kNumTypes = 4;
+
+	struct Entry {
+		uint64_t current = 0;
+		uint64_t peak = 0;
+	};
+
+	Entry &operator[](Type type) { return types[static_cast<unsigned int>(type)]; }
+	const Entry &operator[](Type type) const { return types[static_cast<unsigned int>(type)]; }
+
+	std::array<Entry, kNumTypes> types;
+	Entry total;
+
+	std::string toString() const;
+};
+
+} /* namespace libcamera */
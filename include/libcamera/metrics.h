@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Runtime metrics
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace libcamera {
+
+struct Metric {
+	enum class Type {
+		Counter,
+		Histogram,
+	};
+
+	std::string scope;
+	std::string name;
+	Type type;
+
+	uint64_t value;
+	uint64_t sum;
+	std::vector<uint64_t> bounds;
+	std::vector<uint64_t> buckets;
+
+	std::string toString() const;
+};
+
+} /* namespace libcamera */
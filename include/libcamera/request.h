@@ -7,7 +7,6 @@
 
 #pragma once
 
-#include <map>
 #include <memory>
 #include <ostream>
 #include <stdint.h>
@@ -15,6 +14,7 @@
 #include <unordered_set>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/flat_map.h>
 #include <libcamera/base/signal.h>
 
 #include <libcamera/controls.h>
@@ -43,7 +43,7 @@ public:
 		ReuseBuffers = (1 << 0),
 	};
 
-	using BufferMap = std::map<const Stream *, FrameBuffer *>;
+	using BufferMap = FlatMap<const Stream *, FrameBuffer *, 4>;
 
 	Request(Camera *camera, uint64_t cookie = 0);
 	~Request();
@@ -61,6 +61,9 @@ public:
 	uint64_t cookie() const { return cookie_; }
 	Status status() const { return status_; }
 
+	void setPriority(int priority);
+	int priority() const;
+
 	bool hasPendingBuffers() const;
 
 	std::string toString() const;
@@ -10,13 +10,20 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <ctype.h>
+#include <fstream>
 #include <map>
+#include <sstream>
+#include <stdio.h>
 #include <type_traits>
+#include <unistd.h>
 
 #include <hardware/camera3.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
+#include <libcamera/camera_manager.h>
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
 #include <libcamera/property_ids.h>
@@ -29,6 +36,23 @@ LOG_DECLARE_CATEGORY(HAL)
 
 namespace {
 
+/*
+ * Directory of the stream configurations cache, overridden by the
+ * LIBCAMERA_HAL_CACHE_DIR environment variable. The cache is disabled if the
+ * directory doesn't exist.
+ */
+#if defined(OS_CHROMEOS)
+constexpr const char *kCacheDir = "/var/cache/camera";
+#else
+constexpr const char *kCacheDir = "/data/vendor/camera";
+#endif
+
+/* Bump the version when the format of the cache changes. */
+/* The minimum frame rate of the constrained high speed video mode. */
+constexpr unsigned int kMinHighSpeedFps = 120;
+
+constexpr const char *kCacheHeader = "libcamera-hal-stream-configurations 2";
+
 /*
  * \var camera3Resolutions
  * \brief The list of image resolutions commonly supported by Android
@@ -361,6 +385,9 @@ CameraCapabilities::computeCapabilities()
 	if (rawStreamAvailable_)
 		capabilities.insert(ANDROID_REQUEST_AVAILABLE_CAPABILITIES_RAW);
 
+	if (highSpeedVideoAvailable())
+		capabilities.insert(ANDROID_REQUEST_AVAILABLE_CAPABILITIES_CONSTRAINED_HIGH_SPEED_VIDEO);
+
 	return capabilities;
 }
 
@@ -407,6 +434,14 @@ int CameraCapabilities::initialize(std::shared_ptr<Camera> camera,
 	rawStreamAvailable_ = false;
 	maxFrameDuration_ = 0;
 
+	/*
+	 * Probing the stream configurations validates and applies many camera
+	 * configurations, which is slow. Use the results cached by a previous
+	 * run when they are still valid.
+	 */
+	if (!loadStreamConfigurations())
+		return 0;
+
 	/* Acquire the camera and initialize available stream configurations. */
 	int ret = camera_->acquire();
 	if (ret) {
@@ -415,14 +450,37 @@ int CameraCapabilities::initialize(std::shared_ptr<Camera> camera,
 	}
 
 	ret = initializeStreamConfigurations();
-	if (ret) {
-		camera_->release();
+	camera_->release();
+	if (ret)
 		return ret;
+
+	saveStreamConfigurations();
+
+	return 0;
+}
+
+/*
+ * Retrieve the camera static metadata, constructing it on first use. The camera
+ * is temporarily acquired to construct the static metadata, this function shall
+ * thus be called before the camera is opened.
+ *
+ * Return the static metadata, or nullptr if it can't be constructed.
+ */
+CameraMetadata *CameraCapabilities::staticMetadata()
+{
+	if (staticMetadata_)
+		return staticMetadata_.get();
+
+	int ret = camera_->acquire();
+	if (ret) {
+		LOG(HAL, Error) << "Failed to temporarily acquire the camera";
+		return nullptr;
 	}
 
-	ret = initializeStaticMetadata();
+	initializeStaticMetadata();
 	camera_->release();
-	return ret;
+
+	return staticMetadata_.get();
 }
 
 std::vector<Size>
@@ -667,6 +725,20 @@ int CameraCapabilities::initializeStreamConfigurations()
 			int64_t minFrameDuration = frameDurations->second.min().get<int64_t>() * 1000;
 			int64_t maxFrameDuration = frameDurations->second.max().get<int64_t>() * 1000;
 
+			/*
+			 * Record the resolutions of the video streams capable
+			 * of 120 FPS or more for the constrained high speed
+			 * mode, before the frame rate gets capped below. The
+			 * frame rate is rounded down to a multiple of 30 FPS
+			 * as the batch size is derived from it.
+			 */
+			if (androidFormat == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) {
+				unsigned int fps = floor(1e9 / minFrameDuration + 0.05f);
+				fps -= fps % 30;
+				if (fps >= kMinHighSpeedFps)
+					highSpeedConfigurations_.push_back({ res, fps });
+			}
+
 			/*
 			 * Cap min frame duration to 30 FPS with 1% tolerance.
 			 *
@@ -756,6 +828,165 @@ int CameraCapabilities::initializeStreamConfigurations()
 	return 0;
 }
 
+std::string CameraCapabilities::cachePath() const
+{
+	const char *dir = utils::secure_getenv("LIBCAMERA_HAL_CACHE_DIR");
+	std::string name = camera_->id();
+
+	std::replace_if(name.begin(), name.end(),
+			[](char c) { return !isalnum(c); }, '_');
+
+	return std::string(dir ? dir : kCacheDir) + "/libcamera-hal-" + name + ".cache";
+}
+
+/*
+ * The cached stream configurations are valid for the camera, sensor and
+ * libcamera version that produced them. The libcamera version covers both the
+ * pipeline handlers and the HAL.
+ */
+std::string CameraCapabilities::cacheKey() const
+{
+	const auto &model = camera_->properties().get(properties::Model);
+
+	return CameraManager::version() + " " + camera_->id() + " " +
+	       model.value_or("");
+}
+
+/*
+ * Load the results of initializeStreamConfigurations() from the cache.
+ *
+ * Return 0 on success, or a negative error code if the cache doesn't exist or
+ * isn't valid.
+ */
+int CameraCapabilities::loadStreamConfigurations()
+{
+	std::ifstream file(cachePath());
+	if (!file.is_open())
+		return -ENOENT;
+
+	std::string line;
+	if (!std::getline(file, line) || line != kCacheHeader ||
+	    !std::getline(file, line) || line != cacheKey()) {
+		LOG(HAL, Debug) << "Stream configurations cache is stale";
+		return -EINVAL;
+	}
+
+	std::vector<Camera3StreamConfiguration> streamConfigurations;
+	std::vector<HighSpeedConfiguration> highSpeedConfigurations;
+	std::map<int, PixelFormat> formatsMap;
+	bool rawStreamAvailable = false;
+	int64_t maxFrameDuration = 0;
+	unsigned int maxJpegBufferSize = 0;
+
+	while (std::getline(file, line)) {
+		std::istringstream entry(line);
+		std::string tag;
+
+		entry >> tag;
+
+		if (tag == "raw") {
+			entry >> rawStreamAvailable;
+		} else if (tag == "max-frame-duration") {
+			entry >> maxFrameDuration;
+		} else if (tag == "max-jpeg-buffer-size") {
+			entry >> maxJpegBufferSize;
+		} else if (tag == "format") {
+			int androidFormat;
+			std::string name;
+
+			entry >> androidFormat >> name;
+			formatsMap[androidFormat] = PixelFormat::fromString(name);
+			if (!formatsMap[androidFormat].isValid())
+				return -EINVAL;
+		} else if (tag == "stream") {
+			Camera3StreamConfiguration config;
+
+			entry >> config.resolution.width >> config.resolution.height
+			      >> config.androidFormat >> config.minFrameDurationNsec
+			      >> config.maxFrameDurationNsec;
+			streamConfigurations.push_back(config);
+		} else if (tag == "high-speed") {
+			HighSpeedConfiguration config;
+
+			entry >> config.resolution.width >> config.resolution.height
+			      >> config.maxFps;
+			highSpeedConfigurations.push_back(config);
+		} else {
+			return -EINVAL;
+		}
+
+		if (entry.fail()) {
+			LOG(HAL, Debug) << "Invalid stream configurations cache";
+			return -EINVAL;
+		}
+	}
+
+	if (formatsMap.empty() || streamConfigurations.empty())
+		return -EINVAL;
+
+	streamConfigurations_ = std::move(streamConfigurations);
+	highSpeedConfigurations_ = std::move(highSpeedConfigurations);
+	formatsMap_ = std::move(formatsMap);
+	rawStreamAvailable_ = rawStreamAvailable;
+	maxFrameDuration_ = maxFrameDuration;
+	maxJpegBufferSize_ = maxJpegBufferSize;
+
+	LOG(HAL, Debug) << "Loaded " << streamConfigurations_.size()
+			<< " stream configurations from " << cachePath();
+
+	return 0;
+}
+
+/*
+ * Store the results of initializeStreamConfigurations() in the cache. The cache
+ * file is replaced atomically, failures only cause the next run to probe the
+ * camera again.
+ */
+void CameraCapabilities::saveStreamConfigurations() const
+{
+	std::string path = cachePath();
+	std::string tmpPath = path + ".tmp";
+
+	{
+		std::ofstream file(tmpPath, std::ios::trunc);
+		if (!file.is_open()) {
+			LOG(HAL, Debug) << "Can't create stream configurations cache "
+					<< path;
+			return;
+		}
+
+		file << kCacheHeader << std::endl
+		     << cacheKey() << std::endl
+		     << "raw " << rawStreamAvailable_ << std::endl
+		     << "max-frame-duration " << maxFrameDuration_ << std::endl
+		     << "max-jpeg-buffer-size " << maxJpegBufferSize_ << std::endl;
+
+		for (const auto &[androidFormat, pixelFormat] : formatsMap_)
+			file << "format " << androidFormat << " "
+			     << pixelFormat << std::endl;
+
+		for (const Camera3StreamConfiguration &config : streamConfigurations_)
+			file << "stream " << config.resolution.width << " "
+			     << config.resolution.height << " "
+			     << config.androidFormat << " "
+			     << config.minFrameDurationNsec << " "
+			     << config.maxFrameDurationNsec << std::endl;
+
+		for (const HighSpeedConfiguration &config : highSpeedConfigurations_)
+			file << "high-speed " << config.resolution.width << " "
+			     << config.resolution.height << " "
+			     << config.maxFps << std::endl;
+
+		if (!file.good()) {
+			unlink(tmpPath.c_str());
+			return;
+		}
+	}
+
+	if (rename(tmpPath.c_str(), path.c_str()) < 0)
+		unlink(tmpPath.c_str());
+}
+
 int CameraCapabilities::initializeStaticMetadata()
 {
 	staticMetadata_ = std::make_unique<CameraMetadata>(64, 1024);
@@ -854,6 +1085,7 @@ int CameraCapabilities::initializeStaticMetadata()
 		ANDROID_CONTROL_AWB_MODE,
 		ANDROID_CONTROL_CAPTURE_INTENT,
 		ANDROID_CONTROL_EFFECT_MODE,
+		ANDROID_CONTROL_ENABLE_ZSL,
 		ANDROID_CONTROL_MODE,
 		ANDROID_CONTROL_SCENE_MODE,
 		ANDROID_CONTROL_VIDEO_STABILIZATION_MODE,
@@ -886,6 +1118,7 @@ int CameraCapabilities::initializeStaticMetadata()
 		ANDROID_CONTROL_AWB_STATE,
 		ANDROID_CONTROL_CAPTURE_INTENT,
 		ANDROID_CONTROL_EFFECT_MODE,
+		ANDROID_CONTROL_ENABLE_ZSL,
 		ANDROID_CONTROL_MODE,
 		ANDROID_CONTROL_SCENE_MODE,
 		ANDROID_CONTROL_VIDEO_STABILIZATION_MODE,
@@ -1363,6 +1596,36 @@ int CameraCapabilities::initializeStaticMetadata()
 	staticMetadata_->addEntry(ANDROID_CONTROL_AE_AVAILABLE_TARGET_FPS_RANGES,
 				  availableAeFpsTarget);
 
+	/*
+	 * Report, for each high speed resolution, a variable frame rate range
+	 * for preview and a fixed one for recording. The batch size is the
+	 * number of frames captured per 30 FPS period.
+	 */
+	std::vector<int32_t> highSpeedVideoConfigurations;
+	for (const HighSpeedConfiguration &config : highSpeedConfigurations_) {
+		int32_t width = config.resolution.width;
+		int32_t height = config.resolution.height;
+		int32_t fps = config.maxFps;
+		int32_t batchSize = fps / 30;
+
+		for (int32_t rangeMin : { 30, fps }) {
+			highSpeedVideoConfigurations.insert(
+				highSpeedVideoConfigurations.end(),
+				{ width, height, rangeMin, fps, batchSize });
+		}
+
+		LOG(HAL, Debug)
+			<< "High speed stream: " << config.resolution
+			<< "@" << fps << ", batch size " << batchSize;
+	}
+
+	if (!highSpeedVideoConfigurations.empty()) {
+		staticMetadata_->addEntry(ANDROID_CONTROL_AVAILABLE_HIGH_SPEED_VIDEO_CONFIGURATIONS,
+					  highSpeedVideoConfigurations);
+		availableCharacteristicsKeys_.insert(
+			ANDROID_CONTROL_AVAILABLE_HIGH_SPEED_VIDEO_CONFIGURATIONS);
+	}
+
 	std::vector<int64_t> availableStallDurations;
 	for (const auto &entry : streamConfigurations_) {
 		if (entry.androidFormat != HAL_PIXEL_FORMAT_BLOB)
@@ -1445,6 +1708,20 @@ int CameraCapabilities::initializeStaticMetadata()
 }
 
 /* Translate Android format code to libcamera pixel format. */
+/*
+ * Constrained high speed video requires at least 720p at 120 FPS. The requests
+ * are batched by the CameraDevice to keep the per-request overhead in check.
+ */
+bool CameraCapabilities::highSpeedVideoAvailable() const
+{
+	return std::any_of(highSpeedConfigurations_.begin(),
+			   highSpeedConfigurations_.end(),
+			   [](const HighSpeedConfiguration &config) {
+				   return config.resolution.width >= 1280 &&
+					  config.resolution.height >= 720;
+			   });
+}
+
 PixelFormat CameraCapabilities::toPixelFormat(int format) const
 {
 	auto it = formatsMap_.find(format);
@@ -1560,6 +1837,9 @@ std::unique_ptr<CameraMetadata> CameraCapabilities::requestTemplatePreview() con
 	uint8_t controlMode = ANDROID_CONTROL_MODE_AUTO;
 	requestTemplate->addEntry(ANDROID_CONTROL_MODE, controlMode);
 
+	uint8_t enableZsl = ANDROID_CONTROL_ENABLE_ZSL_FALSE;
+	requestTemplate->addEntry(ANDROID_CONTROL_ENABLE_ZSL, enableZsl);
+
 	float lensAperture = 2.53 / 100;
 	requestTemplate->addEntry(ANDROID_LENS_APERTURE, lensAperture);
 
@@ -10,6 +10,7 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <libcamera/base/class.h>
@@ -28,9 +29,10 @@ public:
 	int initialize(std::shared_ptr<libcamera::Camera> camera,
 		       int orientation, int facing);
 
-	CameraMetadata *staticMetadata() const { return staticMetadata_.get(); }
+	CameraMetadata *staticMetadata();
 	libcamera::PixelFormat toPixelFormat(int format) const;
 	unsigned int maxJpegBufferSize() const { return maxJpegBufferSize_; }
+	bool highSpeedVideoAvailable() const;
 
 	std::unique_ptr<CameraMetadata> requestTemplateManual() const;
 	std::unique_ptr<CameraMetadata> requestTemplatePreview() const;
@@ -47,6 +49,11 @@ private:
 		int64_t maxFrameDurationNsec;
 	};
 
+	struct HighSpeedConfiguration {
+		libcamera::Size resolution;
+		unsigned int maxFps;
+	};
+
 	bool validateManualSensorCapability();
 	bool validateManualPostProcessingCapability();
 	bool validateBurstCaptureCapability();
@@ -63,6 +70,10 @@ private:
 	std::vector<libcamera::Size>
 	initializeRawResolutions(const libcamera::PixelFormat &pixelFormat);
 	int initializeStreamConfigurations();
+	std::string cachePath() const;
+	std::string cacheKey() const;
+	int loadStreamConfigurations();
+	void saveStreamConfigurations() const;
 
 	int initializeStaticMetadata();
 
@@ -76,6 +87,7 @@ private:
 	std::set<camera_metadata_enum_android_request_available_capabilities> capabilities_;
 
 	std::vector<Camera3StreamConfiguration> streamConfigurations_;
+	std::vector<HighSpeedConfiguration> highSpeedConfigurations_;
 	std::map<int, libcamera::PixelFormat> formatsMap_;
 	std::unique_ptr<CameraMetadata> staticMetadata_;
 	unsigned int maxJpegBufferSize_;
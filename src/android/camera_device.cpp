@@ -8,13 +8,18 @@
 #include "camera_device.h"
 
 #include <algorithm>
+#include <array>
 #include <fstream>
+#include <list>
 #include <set>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 #include <vector>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
 #include <libcamera/base/unique_fd.h>
 #include <libcamera/base/utils.h>
 
@@ -24,6 +29,9 @@
 #include <libcamera/formats.h>
 #include <libcamera/property_ids.h>
 
+#include "libcamera/internal/fence_waiter.h"
+#include "libcamera/internal/framebuffer.h"
+
 #include "system/graphics.h"
 
 #include "camera_buffer.h"
@@ -38,6 +46,27 @@ LOG_DECLARE_CATEGORY(HAL)
 
 namespace {
 
+/*
+ * Initial capacity of the result metadata packs.
+ *
+ * \todo Keep this in sync with the actual number of entries.
+ * Currently: 41 entries, 157 bytes
+ *
+ * Reserve more space for the JPEG metadata set by the post-processor.
+ * Currently:
+ * ANDROID_JPEG_GPS_COORDINATES (double x 3) = 24 bytes
+ * ANDROID_JPEG_GPS_PROCESSING_METHOD (byte x 32) = 32 bytes
+ * ANDROID_JPEG_GPS_TIMESTAMP (int64) = 8 bytes
+ * ANDROID_JPEG_SIZE (int32_t) = 4 bytes
+ * ANDROID_JPEG_QUALITY (byte) = 1 byte
+ * ANDROID_JPEG_ORIENTATION (int32_t) = 4 bytes
+ * ANDROID_JPEG_THUMBNAIL_QUALITY (byte) = 1 byte
+ * ANDROID_JPEG_THUMBNAIL_SIZE (int32 x 2) = 8 bytes
+ * Total bytes for JPEG metadata: 82
+ */
+constexpr size_t kResultEntryCapacity = 88;
+constexpr size_t kResultDataCapacity = 166;
+
 /*
  * \struct Camera3StreamConfig
  * \brief Data to store StreamConfiguration associated with camera3_stream(s)
@@ -233,6 +262,142 @@ bool validateCropRotate(const camera3_stream_configuration_t &streamList)
 
 } /* namespace */
 
+/*
+ * Wait asynchronously for the acquire fences of the buffers produced by
+ * post-processing. The fences are added to a FenceWaiter integrated with the
+ * event loop of the camera thread, in which requests complete, and the buffers
+ * are post-processed once their fence is signalled. Fences that are not
+ * signalled in time are passed back to the framework as release fences, with
+ * the buffer in error state.
+ *
+ * The handler lives in the camera thread, all its functions but cancel() are
+ * called from that thread.
+ */
+class CameraDevice::FenceHandler : public Object
+{
+public:
+	FenceHandler(CameraDevice *device)
+		: device_(device)
+	{
+	}
+
+	int wait(Camera3RequestDescriptor::StreamBuffer *buffer);
+	void cancel();
+
+private:
+	/* Timeout equal to the one used by the Rockchip Camera HAL on ChromeOS. */
+	static constexpr std::chrono::milliseconds kTimeout{ 300 };
+
+	struct PendingFence {
+		std::unique_ptr<FrameBuffer> fenceBuffer;
+		Camera3RequestDescriptor::StreamBuffer *buffer;
+		utils::time_point deadline;
+	};
+
+	void fenceSignalled(FrameBuffer *fenceBuffer);
+	void timeout();
+	void fail(std::list<PendingFence>::iterator it, int error);
+
+	CameraDevice *device_;
+
+	std::unique_ptr<FenceWaiter> waiter_;
+	std::unique_ptr<Timer> timer_;
+	std::list<PendingFence> pending_;
+};
+
+/*
+ * Wait for the acquire fence of the buffer. The fence is held by a frame buffer
+ * without planes, as the FenceWaiter tracks the fences of frame buffers.
+ */
+int CameraDevice::FenceHandler::wait(Camera3RequestDescriptor::StreamBuffer *buffer)
+{
+	if (!waiter_) {
+		waiter_ = std::make_unique<FenceWaiter>();
+		waiter_->signalled.connect(this, &FenceHandler::fenceSignalled);
+
+		timer_ = std::make_unique<Timer>();
+		timer_->timeout.connect(this, &FenceHandler::timeout);
+	}
+
+	auto fenceBuffer = std::make_unique<FrameBuffer>(std::vector<FrameBuffer::Plane>{});
+	fenceBuffer->_d()->setFence(std::make_unique<Fence>(std::move(buffer->fence)));
+
+	int ret = waiter_->add(fenceBuffer.get());
+	if (ret < 0) {
+		buffer->fence = fenceBuffer->releaseFence()->release();
+		return ret;
+	}
+
+	pending_.push_back({ std::move(fenceBuffer), buffer,
+			     utils::clock::now() + kTimeout });
+
+	/* Deadlines are ordered, the timer only needs to track the first one. */
+	if (!timer_->isRunning())
+		timer_->start(pending_.front().deadline);
+
+	return 0;
+}
+
+/*
+ * Stop waiting for all fences and complete their buffers in error state. This
+ * is called when the camera is stopped, from any thread.
+ */
+void CameraDevice::FenceHandler::cancel()
+{
+	if (Thread::current() != thread()) {
+		invokeMethod(&FenceHandler::cancel, ConnectionTypeBlocking);
+		return;
+	}
+
+	while (!pending_.empty())
+		fail(pending_.begin(), -ECANCELED);
+
+	/* Destroy the waiter and timer in the thread they belong to. */
+	waiter_.reset();
+	timer_.reset();
+}
+
+void CameraDevice::FenceHandler::fenceSignalled(FrameBuffer *fenceBuffer)
+{
+	auto it = std::find_if(pending_.begin(), pending_.end(),
+			       [&](const PendingFence &pending) {
+				       return pending.fenceBuffer.get() == fenceBuffer;
+			       });
+	if (it == pending_.end())
+		return;
+
+	Camera3RequestDescriptor::StreamBuffer *buffer = it->buffer;
+	pending_.erase(it);
+
+	if (pending_.empty())
+		timer_->stop();
+
+	device_->processStreamBuffer(buffer, 0);
+}
+
+void CameraDevice::FenceHandler::timeout()
+{
+	utils::time_point now = utils::clock::now();
+
+	while (!pending_.empty() && pending_.front().deadline <= now)
+		fail(pending_.begin(), -ETIME);
+
+	if (!pending_.empty())
+		timer_->start(pending_.front().deadline);
+}
+
+void CameraDevice::FenceHandler::fail(std::list<PendingFence>::iterator it,
+				      int error)
+{
+	Camera3RequestDescriptor::StreamBuffer *buffer = it->buffer;
+
+	waiter_->remove(it->fenceBuffer.get());
+	buffer->fence = it->fenceBuffer->releaseFence()->release();
+	pending_.erase(it);
+
+	device_->processStreamBuffer(buffer, error);
+}
+
 /*
  * \class CameraDevice
  *
@@ -247,11 +412,19 @@ bool validateCropRotate(const camera3_stream_configuration_t &streamList)
  */
 
 CameraDevice::CameraDevice(unsigned int id, std::shared_ptr<Camera> camera)
-	: id_(id), state_(State::Stopped), camera_(std::move(camera)),
-	  facing_(CAMERA_FACING_FRONT), orientation_(0)
+	: id_(id), state_(State::Stopped), highSpeedMode_(false), batchSize_(1),
+	  camera_(std::move(camera)),
+	  zslStream_(nullptr),
+	  resultEntryCapacity_(kResultEntryCapacity),
+	  resultDataCapacity_(kResultDataCapacity),
+	  facing_(CAMERA_FACING_FRONT), orientation_(0), postProcessingThreads_(0),
+	  zslFrames_(0)
 {
 	camera_->requestCompleted.connect(this, &CameraDevice::requestComplete);
 
+	fenceHandler_ = std::make_unique<FenceHandler>(this);
+	fenceHandler_->moveToThread(camera_->thread());
+
 	maker_ = "libcamera";
 	model_ = "cameraModel";
 
@@ -275,7 +448,11 @@ CameraDevice::CameraDevice(unsigned int id, std::shared_ptr<Camera> camera)
 	}
 }
 
-CameraDevice::~CameraDevice() = default;
+CameraDevice::~CameraDevice()
+{
+	/* The fence handler must be destroyed in the camera thread. */
+	fenceHandler_.release()->deleteLater();
+}
 
 std::unique_ptr<CameraDevice> CameraDevice::create(unsigned int id,
 						   std::shared_ptr<Camera> cam)
@@ -376,6 +553,10 @@ int CameraDevice::initialize(const CameraConfigData *cameraConfigData)
 		orientation_ = 0;
 	}
 
+	postProcessingThreads_ = cameraConfigData
+			       ? cameraConfigData->postProcessingThreads : 0;
+	zslFrames_ = cameraConfigData ? cameraConfigData->zslFrames : 0;
+
 	return capabilities_.initialize(camera_, orientation_, facing_);
 }
 
@@ -385,6 +566,15 @@ int CameraDevice::initialize(const CameraConfigData *cameraConfigData)
  */
 int CameraDevice::open(const hw_module_t *hardwareModule)
 {
+	/*
+	 * The request templates are built from the static metadata, construct
+	 * it before acquiring the camera if it hasn't been retrieved yet.
+	 */
+	if (!capabilities_.staticMetadata()) {
+		LOG(HAL, Error) << "Failed to construct the static metadata";
+		return -EINVAL;
+	}
+
 	int ret = camera_->acquire();
 	if (ret) {
 		LOG(HAL, Error) << "Failed to acquire the camera";
@@ -416,15 +606,39 @@ void CameraDevice::close()
 
 void CameraDevice::flush()
 {
+	std::vector<Request *> pendingBatch;
+
 	{
 		MutexLocker stateLock(stateMutex_);
 		if (state_ != State::Running)
 			return;
 
 		state_ = State::Flushing;
+		pendingBatch = std::move(pendingBatch_);
+		pendingBatch_.clear();
 	}
 
 	camera_->stop();
+	fenceHandler_->cancel();
+
+	/*
+	 * The requests of an incomplete high speed batch have never been
+	 * queued to the camera, abort them. The last one closes the batch to
+	 * release the results of the others.
+	 */
+	if (!pendingBatch.empty()) {
+		MutexLocker descriptorsLock(descriptorsMutex_);
+		reinterpret_cast<Camera3RequestDescriptor *>(
+			pendingBatch.back()->cookie())->batchLast_ = true;
+	}
+
+	for (Request *request : pendingBatch) {
+		Camera3RequestDescriptor *descriptor =
+			reinterpret_cast<Camera3RequestDescriptor *>(request->cookie());
+
+		abortRequest(descriptor);
+		completeDescriptor(descriptor);
+	}
 
 	MutexLocker stateLock(stateMutex_);
 	state_ = State::Stopped;
@@ -435,13 +649,17 @@ void CameraDevice::stop()
 	MutexLocker stateLock(stateMutex_);
 
 	camera_->stop();
+	fenceHandler_->cancel();
 
 	{
 		MutexLocker descriptorsLock(descriptorsMutex_);
 		descriptors_ = {};
+		completedBatch_.clear();
 	}
 
+	pendingBatch_.clear();
 	streams_.clear();
+	zslStream_ = nullptr;
 
 	state_ = State::Stopped;
 }
@@ -458,7 +676,9 @@ void CameraDevice::setCallbacks(const camera3_callback_ops_t *callbacks)
 
 const camera_metadata_t *CameraDevice::getStaticMetadata()
 {
-	return capabilities_.staticMetadata()->getMetadata();
+	CameraMetadata *staticMetadata = capabilities_.staticMetadata();
+
+	return staticMetadata ? staticMetadata->getMetadata() : nullptr;
 }
 
 /*
@@ -481,10 +701,16 @@ const camera_metadata_t *CameraDevice::constructDefaultRequestSettings(int type)
 	case CAMERA3_TEMPLATE_STILL_CAPTURE:
 		/*
 		 * Use the preview template for still capture, they only differ
-		 * for the torch mode we currently do not support.
+		 * for the torch mode we currently do not support, and for zero
+		 * shutter lag when enabled.
 		 */
 		captureIntent = ANDROID_CONTROL_CAPTURE_INTENT_STILL_CAPTURE;
 		requestTemplate = capabilities_.requestTemplateStill();
+		if (requestTemplate && zslFrames_) {
+			uint8_t enableZsl = ANDROID_CONTROL_ENABLE_ZSL_TRUE;
+			requestTemplate->updateEntry(ANDROID_CONTROL_ENABLE_ZSL,
+						     enableZsl);
+		}
 		break;
 	case CAMERA3_TEMPLATE_VIDEO_RECORD:
 		captureIntent = ANDROID_CONTROL_CAPTURE_INTENT_VIDEO_RECORD;
@@ -531,6 +757,26 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		return -EINVAL;
 	}
 
+	/*
+	 * The constrained high speed mode is limited to a preview and a video
+	 * recording stream, captured at the high speed frame rates reported
+	 * in the static metadata.
+	 */
+	highSpeedMode_ = stream_list->operation_mode ==
+			 CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE;
+	if (highSpeedMode_) {
+		if (!capabilities_.highSpeedVideoAvailable()) {
+			LOG(HAL, Error) << "High speed video is not supported";
+			return -EINVAL;
+		}
+
+		if (stream_list->num_streams > 2) {
+			LOG(HAL, Error)
+				<< "Too many streams for high speed video";
+			return -EINVAL;
+		}
+	}
+
 #if defined(OS_CHROMEOS)
 	if (!validateCropRotate(*stream_list))
 		return -EINVAL;
@@ -764,6 +1010,30 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 			LOG(HAL, Error) << "Failed to configure camera stream";
 			return ret;
 		}
+
+		if (cameraStream.hasZslRing())
+			zslStream_ = &cameraStream;
+	}
+
+	/*
+	 * Preallocate one result metadata pack per request that can be in
+	 * flight, bounded by the number of buffers of the streams.
+	 */
+	unsigned int maxRequests = 0;
+	for (const StreamConfiguration &cfg : *config)
+		maxRequests = std::max(maxRequests, cfg.bufferCount);
+
+	{
+		MutexLocker locker(resultMetadataMutex_);
+
+		while (resultMetadataPool_.size() < maxRequests) {
+			auto metadata = std::make_unique<CameraMetadata>(resultEntryCapacity_,
+									 resultDataCapacity_);
+			if (!metadata->isValid())
+				break;
+
+			resultMetadataPool_.push_back(std::move(metadata));
+		}
 	}
 
 	config_ = std::move(config);
@@ -851,9 +1121,39 @@ int CameraDevice::processControls(Camera3RequestDescriptor *descriptor)
 		controls.set(controls::draft::TestPatternMode, testPatternMode);
 	}
 
+	/*
+	 * The frame rate is fixed by the application in constrained high
+	 * speed mode, it selects the batch size.
+	 */
+	if (highSpeedMode_ &&
+	    settings.getEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, &entry)) {
+		const int32_t *data = entry.data.i32;
+		if (data[0] > 0 && data[1] >= data[0]) {
+			std::array<int64_t, 2> frameDurations = {
+				1000000 / data[1], 1000000 / data[0],
+			};
+			controls.set(controls::FrameDurationLimits, frameDurations);
+		}
+	}
+
 	return 0;
 }
 
+/*
+ * Compute the number of requests batched together in constrained high speed
+ * mode. The framework submits the requests in batches of fps_max / 30, as
+ * reported by ANDROID_CONTROL_AVAILABLE_HIGH_SPEED_VIDEO_CONFIGURATIONS.
+ */
+unsigned int CameraDevice::highSpeedBatchSize(const CameraMetadata &settings) const
+{
+	camera_metadata_ro_entry_t entry;
+	if (!settings.isValid() ||
+	    !settings.getEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, &entry))
+		return 1;
+
+	return std::max(entry.data.i32[1] / 30, 1);
+}
+
 void CameraDevice::abortRequest(Camera3RequestDescriptor *descriptor) const
 {
 	notifyError(descriptor->frameNumber_, nullptr, CAMERA3_MSG_ERROR_REQUEST);
@@ -1078,14 +1378,6 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		requestedStreams.insert(sourceStream);
 	}
 
-	/*
-	 * Translate controls from Android to libcamera and queue the request
-	 * to the camera.
-	 */
-	int ret = processControls(descriptor.get());
-	if (ret)
-		return ret;
-
 	/*
 	 * If flush is in progress set the request status to error and place it
 	 * on the queue to be later completed. If the camera has been stopped we
@@ -1105,6 +1397,27 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		return 0;
 	}
 
+	/*
+	 * Translate controls from Android to libcamera. In constrained high
+	 * speed mode the framework sends the same settings for all requests of
+	 * a batch, translate them for the first request only, as libcamera
+	 * controls persist until overridden.
+	 */
+	bool batchStart = pendingBatch_.empty();
+	if (highSpeedMode_) {
+		if (batchStart)
+			batchSize_ = highSpeedBatchSize(descriptor->settings_);
+
+		descriptor->batchLast_ = pendingBatch_.size() + 1 >= batchSize_;
+	}
+
+	int ret = 0;
+	if (!highSpeedMode_ || batchStart) {
+		ret = processControls(descriptor.get());
+		if (ret)
+			return ret;
+	}
+
 	if (state_ == State::Stopped) {
 		lastSettings_ = {};
 
@@ -1117,6 +1430,26 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		state_ = State::Running;
 	}
 
+	/*
+	 * Keep the zero shutter lag ring filled by capturing the internal
+	 * stream in every request, including the ones that don't need it. The
+	 * queueing time is the target timestamp when selecting a frame from the
+	 * ring for still captures, on the clock of the sensor timestamps.
+	 */
+	if (zslStream_ && requestedStreams.find(zslStream_) == requestedStreams.end()) {
+		FrameBuffer *frameBuffer = zslStream_->getBuffer();
+		if (frameBuffer) {
+			descriptor->zslBuffer_ = frameBuffer;
+			descriptor->request_->addBuffer(zslStream_->stream(),
+							frameBuffer, nullptr);
+		}
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	descriptor->queueTimestamp_ =
+		static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
 	Request *request = descriptor->request_.get();
 
 	{
@@ -1124,7 +1457,21 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		descriptors_.push(std::move(descriptor));
 	}
 
-	camera_->queueRequest(request);
+	if (!highSpeedMode_) {
+		camera_->queueRequest(request);
+		return 0;
+	}
+
+	/*
+	 * Queue the high speed requests together once the batch is complete,
+	 * to let the pipeline handler queue them to the device back-to-back.
+	 */
+	pendingBatch_.push_back(request);
+	if (pendingBatch_.size() < batchSize_)
+		return 0;
+
+	camera_->queueRequests(pendingBatch_);
+	pendingBatch_.clear();
 
 	return 0;
 }
@@ -1169,6 +1516,9 @@ void CameraDevice::requestComplete(Request *request)
 				<< " not successfully completed: "
 				<< request->status();
 
+		if (descriptor->zslBuffer_)
+			zslStream_->putBuffer(descriptor->zslBuffer_);
+
 		abortRequest(descriptor);
 		completeDescriptor(descriptor);
 
@@ -1184,7 +1534,8 @@ void CameraDevice::requestComplete(Request *request)
 	uint64_t sensorTimestamp = static_cast<uint64_t>(request->metadata()
 								 .get(controls::SensorTimestamp)
 								 .value_or(0));
-	notifyShutter(descriptor->frameNumber_, sensorTimestamp);
+	uint64_t timestamp = selectZslFrame(descriptor, sensorTimestamp);
+	notifyShutter(descriptor->frameNumber_, timestamp);
 
 	LOG(HAL, Debug) << "Request " << request->cookie() << " completed with "
 			<< descriptor->request_->buffers().size() << " streams";
@@ -1206,6 +1557,9 @@ void CameraDevice::requestComplete(Request *request)
 		 * correctly.
 		 */
 		descriptor->resultMetadata_ = std::make_unique<CameraMetadata>(0, 0);
+	} else if (timestamp != sensorTimestamp) {
+		descriptor->resultMetadata_->updateEntry(ANDROID_SENSOR_TIMESTAMP,
+							 static_cast<int64_t>(timestamp));
 	}
 
 	/* Handle post-processing. */
@@ -1216,13 +1570,21 @@ void CameraDevice::requestComplete(Request *request)
 	 * slot streamProcessingComplete() can only execute when we are out
 	 * this critical section. This helps to handle synchronous errors here
 	 * itself.
+	 *
+	 * Mapped streams that share the same source stream are queued together
+	 * when their post-processor supports it, to produce all of them in a
+	 * single pass over the source buffer.
 	 */
+	std::map<CameraStream *, std::vector<Camera3RequestDescriptor::StreamBuffer *>> groups;
+
 	auto iter = descriptor->pendingStreamsToProcess_.begin();
 	while (iter != descriptor->pendingStreamsToProcess_.end()) {
 		CameraStream *stream = iter->first;
 		Camera3RequestDescriptor::StreamBuffer *buffer = iter->second;
 
-		FrameBuffer *src = request->findBuffer(stream->stream());
+		const FrameBuffer *src = buffer->srcBuffer;
+		if (!src)
+			src = request->findBuffer(stream->stream());
 		if (!src) {
 			LOG(HAL, Error) << "Failed to find a source stream buffer";
 			setBufferStatus(*buffer, Camera3RequestDescriptor::Status::Error);
@@ -1233,7 +1595,24 @@ void CameraDevice::requestComplete(Request *request)
 		buffer->srcBuffer = src;
 
 		++iter;
-		int ret = stream->process(buffer);
+
+		/*
+		 * Buffers whose acquire fence is still pending are processed
+		 * when the fence is signalled, without blocking the camera
+		 * thread in the meantime.
+		 */
+		int ret;
+		if (buffer->fence.isValid()) {
+			ret = fenceHandler_->wait(buffer);
+			if (!ret)
+				continue;
+
+			LOG(HAL, Error) << "Failed to wait for acquire fence: "
+					<< strerror(-ret);
+		} else {
+			ret = stream->prepare(buffer);
+		}
+
 		if (ret) {
 			setBufferStatus(*buffer, Camera3RequestDescriptor::Status::Error);
 			descriptor->pendingStreamsToProcess_.erase(stream);
@@ -1244,15 +1623,100 @@ void CameraDevice::requestComplete(Request *request)
 			 */
 			if (buffer->internalBuffer)
 				stream->putBuffer(buffer->internalBuffer);
+
+			continue;
 		}
+
+		if (stream->canProcessGroup())
+			groups[stream->sourceStream()].push_back(buffer);
+		else
+			stream->process({ &buffer, 1 });
 	}
 
+	for (const auto &[sourceStream, buffers] : groups)
+		buffers.front()->stream->process(buffers);
+
 	if (descriptor->pendingStreamsToProcess_.empty()) {
 		locker.unlock();
 		completeDescriptor(descriptor);
 	}
 }
 
+/*
+ * Post-process a buffer once the wait for its acquire fence has completed,
+ * after the request completed. The buffer is completed in error state if the
+ * fence hasn't been signalled.
+ */
+void CameraDevice::processStreamBuffer(Camera3RequestDescriptor::StreamBuffer *buffer,
+				       int fenceStatus)
+{
+	CameraStream *stream = buffer->stream;
+
+	if (fenceStatus == -ETIME)
+		LOG(HAL, Error) << "Timeout waiting for acquire fence";
+
+	if (fenceStatus || stream->prepare(buffer)) {
+		streamProcessingComplete(buffer, Camera3RequestDescriptor::Status::Error);
+		return;
+	}
+
+	stream->process({ &buffer, 1 });
+}
+
+/*
+ * Handle the zero shutter lag ring when a request completes. Frames captured
+ * only to fill the ring are stored in it, and still captures with zero shutter
+ * lag enabled are produced from the frame of the ring that is the closest to
+ * the time the request has been queued, which may be the frame just captured.
+ *
+ * Return the timestamp of the frame the still capture is produced from, or the
+ * sensor timestamp of the request otherwise.
+ */
+uint64_t CameraDevice::selectZslFrame(Camera3RequestDescriptor *descriptor,
+				      uint64_t sensorTimestamp)
+{
+	if (!zslStream_)
+		return sensorTimestamp;
+
+	if (descriptor->zslBuffer_) {
+		zslStream_->storeZslFrame(descriptor->zslBuffer_, sensorTimestamp);
+		descriptor->zslBuffer_ = nullptr;
+		return sensorTimestamp;
+	}
+
+	const CameraMetadata &settings = descriptor->settings_;
+	camera_metadata_ro_entry_t entry;
+
+	if (!settings.getEntry(ANDROID_CONTROL_ENABLE_ZSL, &entry) ||
+	    *entry.data.u8 != ANDROID_CONTROL_ENABLE_ZSL_TRUE)
+		return sensorTimestamp;
+
+	if (!settings.getEntry(ANDROID_CONTROL_CAPTURE_INTENT, &entry) ||
+	    *entry.data.u8 != ANDROID_CONTROL_CAPTURE_INTENT_STILL_CAPTURE)
+		return sensorTimestamp;
+
+	for (Camera3RequestDescriptor::StreamBuffer &buffer : descriptor->buffers_) {
+		if (buffer.stream != zslStream_ || !buffer.internalBuffer)
+			continue;
+
+		uint64_t timestamp = sensorTimestamp;
+		buffer.internalBuffer = zslStream_->selectZslFrame(buffer.internalBuffer,
+								   &timestamp,
+								   descriptor->queueTimestamp_);
+		buffer.srcBuffer = buffer.internalBuffer;
+
+		if (timestamp != sensorTimestamp)
+			LOG(HAL, Debug)
+				<< "Request " << descriptor->request_->cookie()
+				<< " captured from ZSL frame "
+				<< (sensorTimestamp - timestamp) / 1000 << "us earlier";
+
+		return timestamp;
+	}
+
+	return sensorTimestamp;
+}
+
 /**
  * \brief Complete the Camera3RequestDescriptor
  * \param[in] descriptor The Camera3RequestDescriptor that has completed
@@ -1282,50 +1746,70 @@ void CameraDevice::completeDescriptor(Camera3RequestDescriptor *descriptor)
  * process_capture_result() callback, and remove the descriptor from the queue.
  * Stop iterating if the descriptor at the front of the queue is not complete.
  *
+ * In constrained high speed mode, completed descriptors are held until the
+ * last descriptor of their batch completes, and the results of the whole batch
+ * are then sent together.
+ *
  * This function should never be called directly in the codebase. Use
  * completeDescriptor() instead.
  */
 void CameraDevice::sendCaptureResults()
 {
 	while (!descriptors_.empty() && !descriptors_.front()->isPending()) {
-		auto descriptor = std::move(descriptors_.front());
+		completedBatch_.push_back(std::move(descriptors_.front()));
 		descriptors_.pop();
 
-		camera3_capture_result_t captureResult = {};
+		/*
+		 * Hold the results of a constrained high speed batch until all
+		 * its requests have completed, and send them back-to-back.
+		 */
+		if (!completedBatch_.back()->batchLast_)
+			continue;
 
-		captureResult.frame_number = descriptor->frameNumber_;
+		for (auto &descriptor : completedBatch_) {
+			camera3_capture_result_t captureResult = {};
 
-		if (descriptor->resultMetadata_)
-			captureResult.result =
-				descriptor->resultMetadata_->getMetadata();
+			captureResult.frame_number = descriptor->frameNumber_;
 
-		std::vector<camera3_stream_buffer_t> resultBuffers;
-		resultBuffers.reserve(descriptor->buffers_.size());
+			if (descriptor->resultMetadata_)
+				captureResult.result =
+					descriptor->resultMetadata_->getMetadata();
 
-		for (auto &buffer : descriptor->buffers_) {
-			camera3_buffer_status status = CAMERA3_BUFFER_STATUS_ERROR;
+			std::vector<camera3_stream_buffer_t> resultBuffers;
+			resultBuffers.reserve(descriptor->buffers_.size());
 
-			if (buffer.status == Camera3RequestDescriptor::Status::Success)
-				status = CAMERA3_BUFFER_STATUS_OK;
+			for (auto &buffer : descriptor->buffers_) {
+				camera3_buffer_status status = CAMERA3_BUFFER_STATUS_ERROR;
 
-			/*
-			 * Pass the buffer fence back to the camera framework as
-			 * a release fence. This instructs the framework to wait
-			 * on the acquire fence in case we haven't done so
-			 * ourselves for any reason.
-			 */
-			resultBuffers.push_back({ buffer.stream->camera3Stream(),
-						  buffer.camera3Buffer, status,
-						  -1, buffer.fence.release() });
-		}
+				if (buffer.status == Camera3RequestDescriptor::Status::Success)
+					status = CAMERA3_BUFFER_STATUS_OK;
 
-		captureResult.num_output_buffers = resultBuffers.size();
-		captureResult.output_buffers = resultBuffers.data();
+				/*
+				 * Pass the buffer fence back to the camera
+				 * framework as a release fence. This instructs
+				 * the framework to wait on the acquire fence in
+				 * case we haven't done so ourselves for any
+				 * reason.
+				 */
+				resultBuffers.push_back({ buffer.stream->camera3Stream(),
+							  buffer.camera3Buffer, status,
+							  -1, buffer.fence.release() });
+			}
+
+			captureResult.num_output_buffers = resultBuffers.size();
+			captureResult.output_buffers = resultBuffers.data();
 
-		if (descriptor->status_ == Camera3RequestDescriptor::Status::Success)
-			captureResult.partial_result = 1;
+			if (descriptor->status_ == Camera3RequestDescriptor::Status::Success)
+				captureResult.partial_result = 1;
 
-		callbacks_->process_capture_result(callbacks_, &captureResult);
+			callbacks_->process_capture_result(callbacks_, &captureResult);
+
+			/* The framework has copied the result metadata, recycle it. */
+			if (descriptor->resultMetadata_)
+				releaseResultMetadata(std::move(descriptor->resultMetadata_));
+		}
+
+		completedBatch_.clear();
 	}
 }
 
@@ -1415,31 +1899,14 @@ void CameraDevice::notifyError(uint32_t frameNumber, camera3_stream_t *stream,
  * Produce a set of fixed result metadata.
  */
 std::unique_ptr<CameraMetadata>
-CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) const
+CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor)
 {
 	const ControlList &metadata = descriptor.request_->metadata();
 	const CameraMetadata &settings = descriptor.settings_;
 	camera_metadata_ro_entry_t entry;
 	bool found;
 
-	/*
-	 * \todo Keep this in sync with the actual number of entries.
-	 * Currently: 40 entries, 156 bytes
-	 *
-	 * Reserve more space for the JPEG metadata set by the post-processor.
-	 * Currently:
-	 * ANDROID_JPEG_GPS_COORDINATES (double x 3) = 24 bytes
-	 * ANDROID_JPEG_GPS_PROCESSING_METHOD (byte x 32) = 32 bytes
-	 * ANDROID_JPEG_GPS_TIMESTAMP (int64) = 8 bytes
-	 * ANDROID_JPEG_SIZE (int32_t) = 4 bytes
-	 * ANDROID_JPEG_QUALITY (byte) = 1 byte
-	 * ANDROID_JPEG_ORIENTATION (int32_t) = 4 bytes
-	 * ANDROID_JPEG_THUMBNAIL_QUALITY (byte) = 1 byte
-	 * ANDROID_JPEG_THUMBNAIL_SIZE (int32 x 2) = 8 bytes
-	 * Total bytes for JPEG metadata: 82
-	 */
-	std::unique_ptr<CameraMetadata> resultMetadata =
-		std::make_unique<CameraMetadata>(88, 166);
+	std::unique_ptr<CameraMetadata> resultMetadata = acquireResultMetadata();
 	if (!resultMetadata->isValid()) {
 		LOG(HAL, Error) << "Failed to allocate result metadata";
 		return nullptr;
@@ -1509,6 +1976,10 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 	value = ANDROID_CONTROL_EFFECT_MODE_OFF;
 	resultMetadata->addEntry(ANDROID_CONTROL_EFFECT_MODE, value);
 
+	found = settings.getEntry(ANDROID_CONTROL_ENABLE_ZSL, &entry);
+	value = found ? *entry.data.u8 : (uint8_t)ANDROID_CONTROL_ENABLE_ZSL_FALSE;
+	resultMetadata->addEntry(ANDROID_CONTROL_ENABLE_ZSL, value);
+
 	value = ANDROID_CONTROL_MODE_AUTO;
 	resultMetadata->addEntry(ANDROID_CONTROL_MODE, value);
 
@@ -1612,3 +2083,44 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 
 	return resultMetadata;
 }
+
+/*
+ * Retrieve an empty result metadata pack from the pool, or allocate a new one
+ * if the pool is empty.
+ */
+std::unique_ptr<CameraMetadata> CameraDevice::acquireResultMetadata()
+{
+	MutexLocker locker(resultMetadataMutex_);
+
+	if (resultMetadataPool_.empty())
+		return std::make_unique<CameraMetadata>(resultEntryCapacity_,
+							resultDataCapacity_);
+
+	std::unique_ptr<CameraMetadata> metadata = std::move(resultMetadataPool_.back());
+	resultMetadataPool_.pop_back();
+	metadata->clear();
+
+	return metadata;
+}
+
+/*
+ * Return a result metadata pack to the pool. Packs that have been resized
+ * raise the capacity of the packs allocated later, and packs smaller than
+ * that capacity are freed, so that the pool converges to packs large enough
+ * for all results.
+ */
+void CameraDevice::releaseResultMetadata(std::unique_ptr<CameraMetadata> metadata)
+{
+	auto [entryCapacity, dataCapacity] = metadata->capacity();
+
+	MutexLocker locker(resultMetadataMutex_);
+
+	resultEntryCapacity_ = std::max(resultEntryCapacity_, entryCapacity);
+	resultDataCapacity_ = std::max(resultDataCapacity_, dataCapacity);
+
+	if (entryCapacity < resultEntryCapacity_ ||
+	    dataCapacity < resultDataCapacity_)
+		return;
+
+	resultMetadataPool_.push_back(std::move(metadata));
+}
@@ -57,6 +57,8 @@ public:
 	const std::string &model() const { return model_; }
 	int facing() const { return facing_; }
 	int orientation() const { return orientation_; }
+	unsigned int postProcessingThreads() const { return postProcessingThreads_; }
+	unsigned int zslFrames() const { return zslFrames_; }
 	unsigned int maxJpegBufferSize() const;
 
 	void setCallbacks(const camera3_callback_ops_t *callbacks);
@@ -82,6 +84,8 @@ private:
 		Running,
 	};
 
+	class FenceHandler;
+
 	void stop() LIBCAMERA_TSA_EXCLUDES(stateMutex_);
 
 	std::unique_ptr<HALFrameBuffer>
@@ -94,13 +98,22 @@ private:
 	void notifyError(uint32_t frameNumber, camera3_stream_t *stream,
 			 camera3_error_msg_code code) const;
 	int processControls(Camera3RequestDescriptor *descriptor);
+	unsigned int highSpeedBatchSize(const CameraMetadata &settings) const;
+	void processStreamBuffer(Camera3RequestDescriptor::StreamBuffer *buffer,
+				 int fenceStatus);
+	uint64_t selectZslFrame(Camera3RequestDescriptor *descriptor,
+				uint64_t sensorTimestamp);
 	void completeDescriptor(Camera3RequestDescriptor *descriptor)
 		LIBCAMERA_TSA_EXCLUDES(descriptorsMutex_);
 	void sendCaptureResults() LIBCAMERA_TSA_REQUIRES(descriptorsMutex_);
 	void setBufferStatus(Camera3RequestDescriptor::StreamBuffer &buffer,
 			     Camera3RequestDescriptor::Status status);
 	std::unique_ptr<CameraMetadata> getResultMetadata(
-		const Camera3RequestDescriptor &descriptor) const;
+		const Camera3RequestDescriptor &descriptor);
+	std::unique_ptr<CameraMetadata> acquireResultMetadata()
+		LIBCAMERA_TSA_EXCLUDES(resultMetadataMutex_);
+	void releaseResultMetadata(std::unique_ptr<CameraMetadata> metadata)
+		LIBCAMERA_TSA_EXCLUDES(resultMetadataMutex_);
 
 	unsigned int id_;
 	camera3_device_t camera3Device_;
@@ -108,6 +121,15 @@ private:
 	libcamera::Mutex stateMutex_; /* Protects access to the camera state. */
 	State state_ LIBCAMERA_TSA_GUARDED_BY(stateMutex_);
 
+	/*
+	 * In constrained high speed mode requests are queued to the camera in
+	 * batches of batchSize_, accumulated in pendingBatch_.
+	 */
+	bool highSpeedMode_;
+	unsigned int batchSize_ LIBCAMERA_TSA_GUARDED_BY(stateMutex_);
+	std::vector<libcamera::Request *> pendingBatch_
+		LIBCAMERA_TSA_GUARDED_BY(stateMutex_);
+
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
 	CameraCapabilities capabilities_;
@@ -116,16 +138,33 @@ private:
 	const camera3_callback_ops_t *callbacks_;
 
 	std::vector<CameraStream> streams_;
+	std::unique_ptr<FenceHandler> fenceHandler_;
+	CameraStream *zslStream_;
 
 	libcamera::Mutex descriptorsMutex_ LIBCAMERA_TSA_ACQUIRED_AFTER(stateMutex_);
 	std::queue<std::unique_ptr<Camera3RequestDescriptor>> descriptors_
 		LIBCAMERA_TSA_GUARDED_BY(descriptorsMutex_);
+	std::vector<std::unique_ptr<Camera3RequestDescriptor>> completedBatch_
+		LIBCAMERA_TSA_GUARDED_BY(descriptorsMutex_);
+
+	/*
+	 * Result metadata packs are recycled once the capture result has been
+	 * sent, to avoid allocating them for every request. New packs are
+	 * allocated with the largest capacity any result has needed so far.
+	 */
+	libcamera::Mutex resultMetadataMutex_;
+	std::vector<std::unique_ptr<CameraMetadata>> resultMetadataPool_
+		LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	size_t resultEntryCapacity_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	size_t resultDataCapacity_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
 
 	std::string maker_;
 	std::string model_;
 
 	int facing_;
 	int orientation_;
+	unsigned int postProcessingThreads_;
+	unsigned int zslFrames_;
 
 	CameraMetadata lastSettings_;
 };
@@ -55,6 +55,8 @@ int CameraHalConfig::Private::parseConfigFile(File &file,
 	 *   "camera0 id":
 	 *     location: value
 	 *     rotation: value
+	 *     post-processing-threads: value (optional)
+	 *     zsl-frames: value (optional)
 	 *     ...
 	 *
 	 *   "camera1 id":
@@ -106,6 +108,13 @@ int CameraHalConfig::Private::parseCameraConfigData(const std::string &cameraId,
 	if (parseRotation(cameraObject, cameraConfigData))
 		return -EINVAL;
 
+	/* Parse optional property "post-processing-threads", 0 selects a default */
+	cameraConfigData.postProcessingThreads =
+		cameraObject["post-processing-threads"].get<uint32_t>(0);
+
+	/* Parse optional property "zsl-frames", 0 disables zero shutter lag */
+	cameraConfigData.zslFrames = cameraObject["zsl-frames"].get<uint32_t>(0);
+
 	return 0;
 }
 
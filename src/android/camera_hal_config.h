@@ -15,6 +15,8 @@
 struct CameraConfigData {
 	int facing = -1;
 	int rotation = -1;
+	unsigned int postProcessingThreads = 0;
+	unsigned int zslFrames = 0;
 };
 
 class CameraHalConfig final : public libcamera::Extensible
@@ -267,6 +267,9 @@ int CameraHalManager::getCameraInfo(unsigned int id, struct camera_info *info)
 	info->device_version = CAMERA_DEVICE_API_VERSION_3_3;
 	info->resource_cost = 0;
 	info->static_camera_characteristics = camera->getStaticMetadata();
+	if (!info->static_camera_characteristics)
+		return -EINVAL;
+
 	info->conflicting_devices = nullptr;
 	info->conflicting_devices_length = 0;
 
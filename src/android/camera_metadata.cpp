@@ -65,6 +65,35 @@ std::tuple<size_t, size_t> CameraMetadata::usage() const
 	return { currentEntryCount, currentDataCount };
 }
 
+std::tuple<size_t, size_t> CameraMetadata::capacity() const
+{
+	if (!metadata_)
+		return { 0, 0 };
+
+	size_t entryCapacity = get_camera_metadata_entry_capacity(metadata_);
+	size_t dataCapacity = get_camera_metadata_data_capacity(metadata_);
+
+	return { entryCapacity, dataCapacity };
+}
+
+/*
+ * \brief Remove all entries from the container, keeping its memory
+ *
+ * The metadata pack is reinitialized in place with its current capacity, and
+ * the container becomes valid again if a previous operation had failed.
+ */
+void CameraMetadata::clear()
+{
+	if (!metadata_)
+		return;
+
+	auto [entryCapacity, dataCapacity] = capacity();
+	metadata_ = place_camera_metadata(metadata_, get_camera_metadata_size(metadata_),
+					  entryCapacity, dataCapacity);
+	valid_ = true;
+	resized_ = false;
+}
+
 bool CameraMetadata::getEntry(uint32_t tag, camera_metadata_ro_entry_t *entry) const
 {
 	if (find_camera_metadata_ro_entry(metadata_, tag, entry))
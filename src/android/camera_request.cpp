@@ -175,6 +175,9 @@ Camera3RequestDescriptor::~Camera3RequestDescriptor() = default;
  * \var Camera3RequestDescriptor::StreamBuffer::dstBuffer
  * \brief Pointer to the destination frame buffer used for post-processing
  *
+ * The buffer is owned by the CameraStream, which caches the mappings of the
+ * camera3 buffers it post-processes to.
+ *
  * \var Camera3RequestDescriptor::StreamBuffer::request
  * \brief Back pointer to the Camera3RequestDescriptor to which the StreamBuffer belongs
  */
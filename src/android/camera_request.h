@@ -9,6 +9,7 @@
 
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <vector>
 
 #include <libcamera/base/class.h>
@@ -50,7 +51,7 @@ public:
 		Status status = Status::Success;
 		libcamera::FrameBuffer *internalBuffer = nullptr;
 		const libcamera::FrameBuffer *srcBuffer = nullptr;
-		std::unique_ptr<CameraBuffer> dstBuffer;
+		CameraBuffer *dstBuffer = nullptr;
 		Camera3RequestDescriptor *request;
 
 	private:
@@ -74,9 +75,12 @@ public:
 
 	CameraMetadata settings_;
 	std::unique_ptr<libcamera::Request> request_;
+	libcamera::FrameBuffer *zslBuffer_ = nullptr;
+	uint64_t queueTimestamp_ = 0;
 	std::unique_ptr<CameraMetadata> resultMetadata_;
 
 	bool complete_ = false;
+	bool batchLast_ = true;
 	Status status_ = Status::Success;
 
 private:
@@ -7,10 +7,13 @@
 
 #include "camera_stream.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <limits>
 #include <string.h>
 #include <sys/mman.h>
-#include <sys/poll.h>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
 #include <libcamera/formats.h>
@@ -29,6 +32,14 @@ using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(HAL)
 
+/*
+ * Default maximum number of post-processing threads per stream, used when the
+ * HAL configuration file doesn't specify it. JPEG encoding of bursts of
+ * full-resolution captures scales with the number of threads, up to the
+ * number of requests in flight.
+ */
+static constexpr unsigned int kMaxPostProcessingThreads = 4;
+
 /*
  * \class CameraStream
  * \brief Map a camera3_stream_t to a StreamConfiguration
@@ -68,6 +79,7 @@ CameraStream::~CameraStream()
 	 * Manually delete buffers and then the allocator to make sure buffers
 	 * are released while the allocator is still valid.
 	 */
+	bufferCache_.clear();
 	allocatedBuffers_.clear();
 	allocator_.reset();
 }
@@ -92,40 +104,32 @@ int CameraStream::configure()
 		output.size.width = camera3Stream_->width;
 		output.size.height = camera3Stream_->height;
 
-		switch (outFormat) {
-		case formats::NV12:
-			postProcessor_ = std::make_unique<PostProcessorYuv>();
-			break;
+		unsigned int threads = cameraDevice_->postProcessingThreads();
+		if (!threads)
+			threads = std::clamp(std::thread::hardware_concurrency(),
+					     1U, kMaxPostProcessingThreads);
 
-		case formats::MJPEG:
-			postProcessor_ = std::make_unique<PostProcessorJpeg>(cameraDevice_);
-			break;
-
-		default:
-			LOG(HAL, Error) << "Unsupported format: " << outFormat;
-			return -EINVAL;
-		}
+		for (unsigned int i = 0; i < threads; i++) {
+			std::unique_ptr<PostProcessor> postProcessor =
+				createPostProcessor(outFormat);
+			if (!postProcessor)
+				return -EINVAL;
 
-		int ret = postProcessor_->configure(configuration(), output);
-		if (ret)
-			return ret;
+			int ret = postProcessor->configure(configuration(), output);
+			if (ret)
+				return ret;
 
-		worker_ = std::make_unique<PostProcessorWorker>(postProcessor_.get());
-		postProcessor_->processComplete.connect(
-			this, [&](Camera3RequestDescriptor::StreamBuffer *streamBuffer,
-				  PostProcessor::Status status) {
-				Camera3RequestDescriptor::Status bufferStatus;
+			postProcessor->processComplete.connect(
+				this, &CameraStream::processComplete);
 
-				if (status == PostProcessor::Status::Success)
-					bufferStatus = Camera3RequestDescriptor::Status::Success;
-				else
-					bufferStatus = Camera3RequestDescriptor::Status::Error;
+			workers_.push_back(std::make_unique<PostProcessorWorker>(postProcessor.get()));
+			postProcessors_.push_back(std::move(postProcessor));
+		}
 
-				cameraDevice_->streamProcessingComplete(streamBuffer,
-									bufferStatus);
-			});
+		processingMutex_ = std::make_unique<Mutex>();
 
-		worker_->start();
+		for (std::unique_ptr<PostProcessorWorker> &worker : workers_)
+			worker->start();
 	}
 
 	allocator_ = std::make_unique<PlatformFrameBufferAllocator>(cameraDevice_);
@@ -136,72 +140,196 @@ int CameraStream::configure()
 	return 0;
 }
 
-int CameraStream::waitFence(int fence)
+std::unique_ptr<PostProcessor> CameraStream::createPostProcessor(const PixelFormat &format)
 {
-	/*
-	 * \todo The implementation here is copied from camera_worker.cpp
-	 * and both should be removed once libcamera is instrumented to handle
-	 * fences waiting in the core.
-	 *
-	 * \todo Better characterize the timeout. Currently equal to the one
-	 * used by the Rockchip Camera HAL on ChromeOS.
-	 */
-	constexpr unsigned int timeoutMs = 300;
-	struct pollfd fds = { fence, POLLIN, 0 };
+	switch (format) {
+	case formats::NV12:
+		return std::make_unique<PostProcessorYuv>();
 
-	do {
-		int ret = poll(&fds, 1, timeoutMs);
-		if (ret == 0)
-			return -ETIME;
+	case formats::MJPEG:
+		return std::make_unique<PostProcessorJpeg>(cameraDevice_);
 
-		if (ret > 0) {
-			if (fds.revents & (POLLERR | POLLNVAL))
-				return -EINVAL;
+	default:
+		LOG(HAL, Error) << "Unsupported format: " << format;
+		return nullptr;
+	}
+}
+
+void CameraStream::processComplete(Camera3RequestDescriptor::StreamBuffer *streamBuffer,
+				   PostProcessor::Status status)
+{
+	std::vector<std::pair<Camera3RequestDescriptor::StreamBuffer *,
+			      PostProcessor::Status>> completed;
+
+	{
+		MutexLocker locker(*processingMutex_);
+
+		auto it = std::find_if(processing_.begin(), processing_.end(),
+				       [&](const auto &entry) {
+					       return entry.first == streamBuffer;
+				       });
+		ASSERT(it != processing_.end());
+		it->second = status;
+
+		/* The thread already delivering completions will handle it. */
+		if (delivering_)
+			return;
+
+		delivering_ = true;
+	}
+
+	/*
+	 * Report completions in queueing order, outside of the lock to avoid
+	 * holding it while calling back into the camera device.
+	 */
+	while (true) {
+		{
+			MutexLocker locker(*processingMutex_);
+
+			while (!processing_.empty() && processing_.front().second) {
+				completed.emplace_back(processing_.front().first,
+						       *processing_.front().second);
+				processing_.pop_front();
+			}
+
+			if (completed.empty()) {
+				delivering_ = false;
+				return;
+			}
+		}
 
-			return 0;
+		for (const auto &[buffer, bufferStatus] : completed) {
+			cameraDevice_->streamProcessingComplete(
+				buffer, bufferStatus == PostProcessor::Status::Success
+					? Camera3RequestDescriptor::Status::Success
+					: Camera3RequestDescriptor::Status::Error);
 		}
-	} while (errno == EINTR || errno == EAGAIN);
 
-	return -errno;
+		completed.clear();
+	}
 }
 
-int CameraStream::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+/*
+ * Mapped streams whose post-processor can produce several outputs in a single
+ * pass are processed together when they share the same source stream, see
+ * CameraDevice::requestComplete().
+ */
+bool CameraStream::canProcessGroup() const
+{
+	return type_ == Type::Mapped && !postProcessors_.empty() &&
+	       postProcessors_.front()->canProcessGroup();
+}
+
+int CameraStream::prepare(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
 {
 	ASSERT(type_ != Type::Direct);
 
-	/* Handle waiting on fences on the destination buffer. */
-	if (streamBuffer->fence.isValid()) {
-		int ret = waitFence(streamBuffer->fence.get());
-		if (ret < 0) {
-			LOG(HAL, Error) << "Failed waiting for fence: "
-					<< streamBuffer->fence.get() << ": "
-					<< strerror(-ret);
-			return ret;
+	/* The acquire fence has been waited for by the CameraDevice. */
+	ASSERT(!streamBuffer->fence.isValid());
+
+	streamBuffer->dstBuffer = mapBuffer(*streamBuffer->camera3Buffer);
+	if (!streamBuffer->dstBuffer) {
+		LOG(HAL, Error) << "Failed to create destination buffer";
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Retrieve the CameraBuffer for a destination buffer handle, creating it if
+ * needed. CameraBuffer instances, and the mappings and registrations they own,
+ * are cached for the lifetime of the stream, which ends when the streams are
+ * reconfigured.
+ *
+ * A handle may be reused by the framework for a different gralloc buffer once
+ * the original one is freed. Cache entries are thus validated against the
+ * identity of the buffer's first file descriptor, and replaced when it
+ * changes. The framework never has more than max_buffers buffers in flight for
+ * the stream, evicting the least recently used entry beyond that never
+ * releases a buffer being processed.
+ */
+CameraBuffer *CameraStream::mapBuffer(buffer_handle_t handle)
+{
+	struct stat st = {};
+
+	for (int i = 0; i < handle->numFds; i++) {
+		if (handle->data[i] == -1)
+			continue;
+
+		if (fstat(handle->data[i], &st) < 0)
+			return nullptr;
+		break;
+	}
+
+	auto it = std::find_if(bufferCache_.begin(), bufferCache_.end(),
+			       [&](const CachedBuffer &entry) {
+				       return entry.handle == handle;
+			       });
+	if (it != bufferCache_.end()) {
+		if (it->device == st.st_dev && it->inode == st.st_ino) {
+			it->lastUse = ++bufferCacheUse_;
+			return it->buffer.get();
 		}
 
-		streamBuffer->fence.reset();
+		bufferCache_.erase(it);
 	}
 
 	const StreamConfiguration &output = configuration();
-	streamBuffer->dstBuffer = std::make_unique<CameraBuffer>(
-		*streamBuffer->camera3Buffer, output.pixelFormat, output.size,
-		PROT_READ | PROT_WRITE);
-	if (!streamBuffer->dstBuffer->isValid()) {
-		LOG(HAL, Error) << "Failed to create destination buffer";
-		return -EINVAL;
+	auto buffer = std::make_unique<CameraBuffer>(handle, output.pixelFormat,
+						     output.size,
+						     PROT_READ | PROT_WRITE);
+	if (!buffer->isValid())
+		return nullptr;
+
+	if (bufferCache_.size() >= std::max(camera3Stream_->max_buffers, 1U)) {
+		auto oldest = std::min_element(bufferCache_.begin(), bufferCache_.end(),
+					       [](const CachedBuffer &a, const CachedBuffer &b) {
+						       return a.lastUse < b.lastUse;
+					       });
+		bufferCache_.erase(oldest);
 	}
 
-	worker_->queueRequest(streamBuffer);
+	bufferCache_.push_back({ handle, st.st_dev, st.st_ino,
+				 ++bufferCacheUse_, std::move(buffer) });
 
-	return 0;
+	return bufferCache_.back().buffer.get();
 }
 
-void CameraStream::flush()
+/*
+ * Queue prepared buffers for post-processing. The buffers may belong to other
+ * streams sharing the same source when this stream can process groups, in
+ * which case their completion is reported by this stream.
+ */
+void CameraStream::process(Span<Camera3RequestDescriptor::StreamBuffer *const> streamBuffers)
 {
-	if (!postProcessor_)
-		return;
+	ASSERT(streamBuffers.size() == 1 || canProcessGroup());
+
+	{
+		MutexLocker locker(*processingMutex_);
+		for (Camera3RequestDescriptor::StreamBuffer *streamBuffer : streamBuffers)
+			processing_.emplace_back(streamBuffer, std::nullopt);
+	}
+
+	/* Queue the request to the least busy worker. */
+	PostProcessorWorker *worker = nullptr;
+	unsigned int minPending = std::numeric_limits<unsigned int>::max();
 
-	worker_->flush();
+	for (std::unique_ptr<PostProcessorWorker> &w : workers_) {
+		unsigned int pending = w->pending();
+		if (pending < minPending) {
+			worker = w.get();
+			minPending = pending;
+		}
+	}
+
+	worker->queueRequest({ streamBuffers.begin(), streamBuffers.end() });
+}
+
+void CameraStream::flush()
+{
+	for (std::unique_ptr<PostProcessorWorker> &worker : workers_)
+		worker->flush();
 }
 
 FrameBuffer *CameraStream::getBuffer()
@@ -244,6 +372,62 @@ void CameraStream::putBuffer(FrameBuffer *buffer)
 	buffers_.push_back(buffer);
 }
 
+/*
+ * Internal streams keep a ring of the most recent frames when zero shutter lag
+ * is enabled in the HAL configuration, to produce still captures from frames
+ * captured before the request was queued.
+ */
+bool CameraStream::hasZslRing() const
+{
+	return type_ == Type::Internal && cameraDevice_->zslFrames();
+}
+
+/*
+ * Store an internal buffer in the ZSL ring, returning the oldest frame to the
+ * buffer pool when the ring is full.
+ */
+void CameraStream::storeZslFrame(FrameBuffer *buffer, uint64_t timestamp)
+{
+	MutexLocker locker(*mutex_);
+
+	zslFrames_.emplace_back(timestamp, buffer);
+
+	while (zslFrames_.size() > cameraDevice_->zslFrames()) {
+		buffers_.push_back(zslFrames_.front().second);
+		zslFrames_.pop_front();
+	}
+}
+
+/*
+ * Store the internal buffer just captured in the ZSL ring and take the frame
+ * of the ring whose timestamp is the closest to the target. The timestamp
+ * holds the one of the captured buffer on input, and the one of the selected
+ * frame on output. The selected frame is handed over to the caller, which
+ * returns it with putBuffer() once processed.
+ */
+FrameBuffer *CameraStream::selectZslFrame(FrameBuffer *buffer,
+					  uint64_t *timestamp, uint64_t target)
+{
+	storeZslFrame(buffer, *timestamp);
+
+	MutexLocker locker(*mutex_);
+
+	auto distance = [target](uint64_t ts) {
+		return ts > target ? ts - target : target - ts;
+	};
+
+	auto best = std::min_element(zslFrames_.begin(), zslFrames_.end(),
+				     [&](const auto &a, const auto &b) {
+					     return distance(a.first) < distance(b.first);
+				     });
+
+	FrameBuffer *frame = best->second;
+	*timestamp = best->first;
+	zslFrames_.erase(best);
+
+	return frame;
+}
+
 /**
  * \class CameraStream::PostProcessorWorker
  * \brief Post-process a CameraStream in an internal thread
@@ -255,9 +439,13 @@ void CameraStream::putBuffer(FrameBuffer *buffer)
  * requests is maintained by the PostProcessorWorker and it will run the
  * post-processing on an internal thread as soon as any request is available on
  * its queue.
+ *
+ * A CameraStream has multiple workers, each with its own PostProcessor, to
+ * process independent requests concurrently. The CameraStream reports their
+ * completion in the order the requests have been queued.
  */
 CameraStream::PostProcessorWorker::PostProcessorWorker(PostProcessor *postProcessor)
-	: postProcessor_(postProcessor)
+	: Thread("PostProcessor"), postProcessor_(postProcessor)
 {
 }
 
@@ -283,17 +471,23 @@ void CameraStream::PostProcessorWorker::start()
 	Thread::start();
 }
 
-void CameraStream::PostProcessorWorker::queueRequest(Camera3RequestDescriptor::StreamBuffer *dest)
+void CameraStream::PostProcessorWorker::queueRequest(std::vector<Camera3RequestDescriptor::StreamBuffer *> dest)
 {
 	{
 		MutexLocker lock(mutex_);
 		ASSERT(state_ == State::Running);
-		requests_.push(dest);
+		requests_.push(std::move(dest));
 	}
 
 	cv_.notify_one();
 }
 
+unsigned int CameraStream::PostProcessorWorker::pending()
+{
+	MutexLocker lock(mutex_);
+	return requests_.size() + (busy_ ? 1 : 0);
+}
+
 void CameraStream::PostProcessorWorker::run()
 {
 	MutexLocker locker(mutex_);
@@ -306,23 +500,30 @@ void CameraStream::PostProcessorWorker::run()
 		if (state_ != State::Running)
 			break;
 
-		Camera3RequestDescriptor::StreamBuffer *streamBuffer = requests_.front();
+		std::vector<Camera3RequestDescriptor::StreamBuffer *> streamBuffers =
+			std::move(requests_.front());
 		requests_.pop();
+		busy_ = true;
 		locker.unlock();
 
-		postProcessor_->process(streamBuffer);
+		if (streamBuffers.size() == 1)
+			postProcessor_->process(streamBuffers[0]);
+		else
+			postProcessor_->processGroup(streamBuffers);
 
 		locker.lock();
+		busy_ = false;
 	}
 
 	if (state_ == State::Flushing) {
-		std::queue<Camera3RequestDescriptor::StreamBuffer *> requests =
+		std::queue<std::vector<Camera3RequestDescriptor::StreamBuffer *>> requests =
 			std::move(requests_);
 		locker.unlock();
 
 		while (!requests.empty()) {
-			postProcessor_->processComplete.emit(
-				requests.front(), PostProcessor::Status::Error);
+			for (Camera3RequestDescriptor::StreamBuffer *streamBuffer : requests.front())
+				postProcessor_->processComplete.emit(
+					streamBuffer, PostProcessor::Status::Error);
 			requests.pop();
 		}
 
@@ -7,13 +7,19 @@
 
 #pragma once
 
+#include <deque>
 #include <memory>
+#include <optional>
 #include <queue>
+#include <stdint.h>
+#include <sys/types.h>
+#include <utility>
 #include <vector>
 
 #include <hardware/camera3.h>
 
 #include <libcamera/base/mutex.h>
+#include <libcamera/base/span.h>
 #include <libcamera/base/thread.h>
 
 #include <libcamera/camera.h>
@@ -24,6 +30,7 @@
 #include "camera_request.h"
 #include "post_processor.h"
 
+class CameraBuffer;
 class CameraDevice;
 class PlatformFrameBufferAllocator;
 
@@ -127,9 +134,15 @@ public:
 	CameraStream *sourceStream() const { return sourceStream_; }
 
 	int configure();
-	int process(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	bool canProcessGroup() const;
+	int prepare(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	void process(libcamera::Span<Camera3RequestDescriptor::StreamBuffer *const> streamBuffers);
 	libcamera::FrameBuffer *getBuffer();
 	void putBuffer(libcamera::FrameBuffer *buffer);
+	bool hasZslRing() const;
+	void storeZslFrame(libcamera::FrameBuffer *buffer, uint64_t timestamp);
+	libcamera::FrameBuffer *selectZslFrame(libcamera::FrameBuffer *buffer,
+					       uint64_t *timestamp, uint64_t target);
 	void flush();
 
 private:
@@ -146,9 +159,11 @@ private:
 		~PostProcessorWorker();
 
 		void start();
-		void queueRequest(Camera3RequestDescriptor::StreamBuffer *request);
+		void queueRequest(std::vector<Camera3RequestDescriptor::StreamBuffer *> request);
 		void flush();
 
+		unsigned int pending();
+
 	protected:
 		void run() override;
 
@@ -158,13 +173,25 @@ private:
 		libcamera::Mutex mutex_;
 		libcamera::ConditionVariable cv_;
 
-		std::queue<Camera3RequestDescriptor::StreamBuffer *> requests_
+		std::queue<std::vector<Camera3RequestDescriptor::StreamBuffer *>> requests_
 			LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		bool busy_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = false;
 
 		State state_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = State::Stopped;
 	};
 
-	int waitFence(int fence);
+	struct CachedBuffer {
+		buffer_handle_t handle;
+		dev_t device;
+		ino_t inode;
+		uint64_t lastUse;
+		std::unique_ptr<CameraBuffer> buffer;
+	};
+
+	std::unique_ptr<PostProcessor> createPostProcessor(const libcamera::PixelFormat &format);
+	CameraBuffer *mapBuffer(buffer_handle_t handle);
+	void processComplete(Camera3RequestDescriptor::StreamBuffer *streamBuffer,
+			     PostProcessor::Status status);
 
 	CameraDevice *const cameraDevice_;
 	const libcamera::CameraConfiguration *config_;
@@ -181,7 +208,37 @@ private:
 	 * an std::vector in CameraDevice.
 	 */
 	std::unique_ptr<libcamera::Mutex> mutex_;
-	std::unique_ptr<PostProcessor> postProcessor_;
 
-	std::unique_ptr<PostProcessorWorker> worker_;
+	/*
+	 * Zero shutter lag ring, the most recent internal buffers captured with
+	 * their sensor timestamp, oldest first.
+	 */
+	std::deque<std::pair<uint64_t, libcamera::FrameBuffer *>> zslFrames_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	/*
+	 * Destination buffers mapped for post-processing, kept across requests
+	 * as the framework cycles through a small set of buffers per stream.
+	 * Only accessed by prepare(), from the camera device thread.
+	 */
+	std::vector<CachedBuffer> bufferCache_;
+	uint64_t bufferCacheUse_ = 0;
+
+	/*
+	 * Each worker thread has its own post-processor, as post-processors
+	 * are not reentrant.
+	 */
+	std::vector<std::unique_ptr<PostProcessor>> postProcessors_;
+	std::vector<std::unique_ptr<PostProcessorWorker>> workers_;
+
+	/*
+	 * Post-processing requests in the order they have been queued, with
+	 * their status once completed. Completions are reported in this order
+	 * by a single thread at a time, the one that sets delivering_.
+	 */
+	std::unique_ptr<libcamera::Mutex> processingMutex_;
+	std::deque<std::pair<Camera3RequestDescriptor::StreamBuffer *,
+			     std::optional<PostProcessor::Status>>> processing_
+		LIBCAMERA_TSA_GUARDED_BY(processingMutex_);
+	bool delivering_ LIBCAMERA_TSA_GUARDED_BY(processingMutex_) = false;
 };
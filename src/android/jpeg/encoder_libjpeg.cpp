@@ -7,6 +7,7 @@
 
 #include "encoder_libjpeg.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
@@ -16,6 +17,8 @@
 #include <vector>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread_pool.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/formats.h>
@@ -32,6 +35,22 @@ LOG_DECLARE_CATEGORY(JPEG)
 
 namespace {
 
+/*
+ * Images are split in horizontal strips of at least kMinStripHeight lines,
+ * encoded concurrently. Smaller images, such as thumbnails, are encoded in a
+ * single pass, as the cost of stitching the strips would outweigh the gain.
+ */
+constexpr unsigned int kMinStripHeight = 256;
+
+/* The restart interval is stored in the 16-bit field of the DRI marker. */
+constexpr unsigned int kMaxRestartInterval = 0xffff;
+
+constexpr uint8_t kMarkerSOF0 = 0xc0;
+constexpr uint8_t kMarkerRST0 = 0xd0;
+constexpr uint8_t kMarkerEOI = 0xd9;
+constexpr uint8_t kMarkerSOS = 0xda;
+constexpr uint8_t kMarkerDRI = 0xdd;
+
 struct JPEGPixelFormatInfo {
 	J_COLOR_SPACE colorSpace;
 	const PixelFormatInfo &pixelFormatInfo;
@@ -68,9 +87,117 @@ const struct JPEGPixelFormatInfo &findPixelInfo(const PixelFormat &format)
 	return iter->second;
 }
 
+/*
+ * Locate the SOF0 and SOS markers in the headers of a baseline JPEG stream,
+ * and the start of the entropy-coded data that follows the SOS header.
+ */
+bool parseHeaders(const uint8_t *data, size_t size, size_t *sof,
+		  size_t *sos, size_t *scan)
+{
+	size_t pos = 2;
+
+	while (pos + 4 <= size) {
+		if (data[pos] != 0xff)
+			return false;
+
+		uint8_t marker = data[pos + 1];
+		size_t length = (data[pos + 2] << 8) | data[pos + 3];
+
+		if (marker == kMarkerSOF0)
+			*sof = pos;
+
+		if (marker == kMarkerSOS) {
+			*sos = pos;
+			*scan = pos + 2 + length;
+			return *scan <= size;
+		}
+
+		pos += 2 + length;
+	}
+
+	return false;
+}
+
 } /* namespace */
 
+/*
+ * A horizontal strip of the image, encoded as a standalone JPEG stream by its
+ * own compressor into a growable memory buffer.
+ */
+class EncoderLibJpeg::Strip
+{
+public:
+	Strip()
+	{
+		compress.err = jpeg_std_error(&jerr);
+		jpeg_create_compress(&compress);
+
+		dest.init_destination = initDestination;
+		dest.empty_output_buffer = emptyOutputBuffer;
+		dest.term_destination = termDestination;
+
+		compress.dest = &dest;
+		compress.client_data = this;
+	}
+
+	~Strip()
+	{
+		jpeg_destroy_compress(&compress);
+	}
+
+	const uint8_t *data() const { return buffer.data(); }
+
+	struct jpeg_compress_struct compress;
+	struct jpeg_error_mgr jerr;
+	struct jpeg_destination_mgr dest;
+
+	unsigned int firstRow;
+	std::vector<JOCTET> buffer;
+	size_t size = 0;
+
+private:
+	static Strip *self(j_compress_ptr cinfo)
+	{
+		return static_cast<Strip *>(cinfo->client_data);
+	}
+
+	static void initDestination(j_compress_ptr cinfo)
+	{
+		Strip *strip = self(cinfo);
+
+		/* Size the buffer for a 4:1 compression ratio to start with. */
+		size_t size = std::max<size_t>(cinfo->image_width * cinfo->image_height *
+					       cinfo->input_components / 4, 4096);
+		if (strip->buffer.size() < size)
+			strip->buffer.resize(size);
+
+		cinfo->dest->next_output_byte = strip->buffer.data();
+		cinfo->dest->free_in_buffer = strip->buffer.size();
+	}
+
+	static boolean emptyOutputBuffer(j_compress_ptr cinfo)
+	{
+		Strip *strip = self(cinfo);
+		size_t size = strip->buffer.size();
+
+		strip->buffer.resize(size * 2);
+
+		cinfo->dest->next_output_byte = strip->buffer.data() + size;
+		cinfo->dest->free_in_buffer = size;
+
+		return TRUE;
+	}
+
+	static void termDestination(j_compress_ptr cinfo)
+	{
+		Strip *strip = self(cinfo);
+
+		strip->size = strip->buffer.size() - cinfo->dest->free_in_buffer;
+	}
+};
+
 EncoderLibJpeg::EncoderLibJpeg()
+	: stripHeight_(0), restartInterval_(0)
 {
 	/* \todo Expand error handling coverage with a custom handler. */
 	compress_.err = jpeg_std_error(&jerr_);
@@ -102,20 +229,82 @@ int EncoderLibJpeg::configure(const StreamConfiguration &cfg)
 	nv_ = pixelFormatInfo_->numPlanes() == 2;
 	nvSwap_ = info.nvSwap;
 
+	/*
+	 * Split large images in strips, encoded concurrently as standalone
+	 * images sharing the same settings and tables, and stitched back
+	 * together with restart markers. The strips must be made of complete
+	 * MCU rows, and restart intervals then span exactly one strip.
+	 */
+	strips_.clear();
+
+	int maxHSampling = 1;
+	int maxVSampling = 1;
+	for (int i = 0; i < compress_.num_components; i++) {
+		maxHSampling = std::max(maxHSampling, compress_.comp_info[i].h_samp_factor);
+		maxVSampling = std::max(maxVSampling, compress_.comp_info[i].v_samp_factor);
+	}
+
+	const unsigned int mcuWidth = DCTSIZE * maxHSampling;
+	const unsigned int mcuHeight = DCTSIZE * maxVSampling;
+	const unsigned int height = cfg.size.height;
+
+	unsigned int count = std::clamp(height / kMinStripHeight, 1U,
+					ThreadPool::instance()->size() + 1);
+	stripHeight_ = utils::alignUp((height + count - 1) / count, mcuHeight);
+	count = (height + stripHeight_ - 1) / stripHeight_;
+	restartInterval_ = (cfg.size.width + mcuWidth - 1) / mcuWidth *
+			   (stripHeight_ / mcuHeight);
+
+	if (count < 2 || restartInterval_ > kMaxRestartInterval)
+		return 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		auto strip = std::make_unique<Strip>();
+		struct jpeg_compress_struct *cinfo = &strip->compress;
+
+		strip->firstRow = i * stripHeight_;
+
+		cinfo->image_width = cfg.size.width;
+		cinfo->image_height = std::min(stripHeight_, height - strip->firstRow);
+		cinfo->in_color_space = info.colorSpace;
+		cinfo->input_components = compress_.input_components;
+
+		jpeg_set_defaults(cinfo);
+
+		strips_.push_back(std::move(strip));
+	}
+
+	LOG(JPEG, Debug)
+		<< "Encoding " << cfg.size << " in " << count
+		<< " strips of " << stripHeight_ << " lines";
+
 	return 0;
 }
 
-void EncoderLibJpeg::compressRGB(const std::vector<Span<uint8_t>> &planes)
+void EncoderLibJpeg::compress(struct jpeg_compress_struct *cinfo,
+			      const std::vector<Span<uint8_t>> &planes,
+			      unsigned int firstRow)
+{
+	if (nv_)
+		compressNV(cinfo, planes, firstRow);
+	else
+		compressRGB(cinfo, planes, firstRow);
+}
+
+void EncoderLibJpeg::compressRGB(struct jpeg_compress_struct *cinfo,
+				 const std::vector<Span<uint8_t>> &planes,
+				 unsigned int firstRow)
 {
-	unsigned char *src = const_cast<unsigned char *>(planes[0].data());
 	/* \todo Stride information should come from buffer configuration. */
-	unsigned int stride = pixelFormatInfo_->stride(compress_.image_width, 0);
+	unsigned int stride = pixelFormatInfo_->stride(cinfo->image_width, 0);
+	unsigned char *src = const_cast<unsigned char *>(planes[0].data()) +
+			     firstRow * stride;
 
 	JSAMPROW row_pointer[1];
 
-	while (compress_.next_scanline < compress_.image_height) {
-		row_pointer[0] = &src[compress_.next_scanline * stride];
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+	while (cinfo->next_scanline < cinfo->image_height) {
+		row_pointer[0] = &src[cinfo->next_scanline * stride];
+		jpeg_write_scanlines(cinfo, row_pointer, 1);
 	}
 }
 
@@ -123,9 +312,11 @@ void EncoderLibJpeg::compressRGB(const std::vector<Span<uint8_t>> &planes)
  * Compress the incoming buffer from a supported NV format.
  * This naively unpacks the semi-planar NV12 to a YUV888 format for libjpeg.
  */
-void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
+void EncoderLibJpeg::compressNV(struct jpeg_compress_struct *cinfo,
+				const std::vector<Span<uint8_t>> &planes,
+				unsigned int firstRow)
 {
-	std::vector<uint8_t> tmprowbuf(compress_.image_width * 3);
+	std::vector<uint8_t> tmprowbuf(cinfo->image_width * 3);
 
 	/*
 	 * \todo Use the raw api, and only unpack the cb/cr samples to new line
@@ -135,10 +326,10 @@ void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
 	 * Possible hints at:
 	 * https://sourceforge.net/p/libjpeg/mailman/message/30815123/
 	 */
-	unsigned int y_stride = pixelFormatInfo_->stride(compress_.image_width, 0);
-	unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
+	unsigned int y_stride = pixelFormatInfo_->stride(cinfo->image_width, 0);
+	unsigned int c_stride = pixelFormatInfo_->stride(cinfo->image_width, 1);
 
-	unsigned int horzSubSample = 2 * compress_.image_width / c_stride;
+	unsigned int horzSubSample = 2 * cinfo->image_width / c_stride;
 	unsigned int vertSubSample = pixelFormatInfo_->planes[1].verticalSubSampling;
 
 	unsigned int c_inc = horzSubSample == 1 ? 2 : 0;
@@ -151,14 +342,14 @@ void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
 	JSAMPROW row_pointer[1];
 	row_pointer[0] = tmprowbuf.data();
 
-	for (unsigned int y = 0; y < compress_.image_height; y++) {
+	for (unsigned int y = firstRow; y < firstRow + cinfo->image_height; y++) {
 		unsigned char *dst = tmprowbuf.data();
 
 		const unsigned char *src_y = src + y * y_stride;
 		const unsigned char *src_cb = src_c + (y / vertSubSample) * c_stride + cb_pos;
 		const unsigned char *src_cr = src_c + (y / vertSubSample) * c_stride + cr_pos;
 
-		for (unsigned int x = 0; x < compress_.image_width; x += 2) {
+		for (unsigned int x = 0; x < cinfo->image_width; x += 2) {
 			dst[0] = *src_y;
 			dst[1] = *src_cb;
 			dst[2] = *src_cr;
@@ -176,7 +367,7 @@ void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
 			dst += 3;
 		}
 
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+		jpeg_write_scanlines(cinfo, row_pointer, 1);
 	}
 }
 
@@ -200,6 +391,11 @@ int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
 			   Span<uint8_t> dest, Span<const uint8_t> exifData,
 			   unsigned int quality)
 {
+	ASSERT(src.size() == pixelFormatInfo_->numPlanes());
+
+	if (!strips_.empty())
+		return encodeStrips(src, dest, exifData, quality);
+
 	unsigned char *destination = dest.data();
 	unsigned long size = dest.size();
 
@@ -226,14 +422,119 @@ int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
 	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
 			 << "x" << compress_.image_height;
 
-	ASSERT(src.size() == pixelFormatInfo_->numPlanes());
-
-	if (nv_)
-		compressNV(src);
-	else
-		compressRGB(src);
+	compress(&compress_, src, 0);
 
 	jpeg_finish_compress(&compress_);
 
 	return size;
 }
+
+int EncoderLibJpeg::encodeStrips(const std::vector<Span<uint8_t>> &src,
+				 Span<uint8_t> dest, Span<const uint8_t> exifData,
+				 unsigned int quality)
+{
+	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
+			 << "x" << compress_.image_height << " in "
+			 << strips_.size() << " strips";
+
+	/* Encode all strips concurrently, the first one with the Exif data. */
+	{
+		TaskGroup group;
+
+		for (const std::unique_ptr<Strip> &strip : strips_) {
+			group.run([&, strip = strip.get()]() {
+				struct jpeg_compress_struct *cinfo = &strip->compress;
+
+				jpeg_set_quality(cinfo, quality, TRUE);
+				jpeg_start_compress(cinfo, TRUE);
+
+				if (strip == strips_[0].get() && exifData.size())
+					jpeg_write_marker(cinfo, JPEG_APP0 + 1,
+							  static_cast<const JOCTET *>(exifData.data()),
+							  exifData.size());
+
+				compress(cinfo, src, strip->firstRow);
+
+				jpeg_finish_compress(cinfo);
+			});
+		}
+
+		group.wait();
+	}
+
+	/*
+	 * Stitch the strips in a single image. The headers of the first strip
+	 * are reused, with the image height patched in the SOF0 marker and a
+	 * DRI marker inserted before the SOS marker. The entropy-coded data of
+	 * the strips follow, separated by RSTn markers. As the strips share
+	 * the same tables and are made of complete MCU rows, each of them is
+	 * equivalent to a restart interval of the full image.
+	 */
+	const Strip &first = *strips_[0];
+	size_t sof = 0, sos, scan;
+
+	if (!parseHeaders(first.data(), first.size, &sof, &sos, &scan) || !sof) {
+		LOG(JPEG, Error) << "Failed to parse JPEG strip headers";
+		return -EINVAL;
+	}
+
+	std::vector<std::pair<const uint8_t *, size_t>> segments;
+	size_t size = scan + 6 + 2;
+
+	for (const std::unique_ptr<Strip> &strip : strips_) {
+		size_t unused, start;
+
+		if (!parseHeaders(strip->data(), strip->size, &unused, &unused, &start) ||
+		    strip->size < start + 2) {
+			LOG(JPEG, Error) << "Failed to parse JPEG strip headers";
+			return -EINVAL;
+		}
+
+		/* Skip the headers and the trailing EOI marker. */
+		segments.emplace_back(strip->data() + start, strip->size - start - 2);
+		size += segments.back().second + 2;
+	}
+
+	/* The last strip isn't followed by a RSTn marker. */
+	size -= 2;
+
+	if (size > dest.size()) {
+		LOG(JPEG, Error)
+			<< "JPEG image of " << size << " bytes exceeds buffer of "
+			<< dest.size() << " bytes";
+		return -ENOSPC;
+	}
+
+	uint8_t *out = dest.data();
+
+	memcpy(out, first.data(), sos);
+	out[sof + 5] = compress_.image_height >> 8;
+	out[sof + 6] = compress_.image_height & 0xff;
+	out += sos;
+
+	const uint8_t dri[] = {
+		0xff, kMarkerDRI, 0x00, 0x04,
+		static_cast<uint8_t>(restartInterval_ >> 8),
+		static_cast<uint8_t>(restartInterval_ & 0xff),
+	};
+	memcpy(out, dri, sizeof(dri));
+	out += sizeof(dri);
+
+	memcpy(out, first.data() + sos, scan - sos);
+	out += scan - sos;
+
+	for (auto [i, segment] : utils::enumerate(segments)) {
+		if (i) {
+			*out++ = 0xff;
+			*out++ = kMarkerRST0 + (i - 1) % 8;
+		}
+
+		memcpy(out, segment.first, segment.second);
+		out += segment.second;
+	}
+
+	*out++ = 0xff;
+	*out++ = kMarkerEOI;
+
+	return size;
+}
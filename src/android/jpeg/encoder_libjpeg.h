@@ -9,6 +9,7 @@
 
 #include "encoder.h"
 
+#include <memory>
 #include <vector>
 
 #include "libcamera/internal/formats.h"
@@ -31,12 +32,30 @@ public:
 		   unsigned int quality);
 
 private:
-	void compressRGB(const std::vector<libcamera::Span<uint8_t>> &planes);
-	void compressNV(const std::vector<libcamera::Span<uint8_t>> &planes);
+	class Strip;
+
+	void compress(struct jpeg_compress_struct *cinfo,
+		      const std::vector<libcamera::Span<uint8_t>> &planes,
+		      unsigned int firstRow);
+	void compressRGB(struct jpeg_compress_struct *cinfo,
+			 const std::vector<libcamera::Span<uint8_t>> &planes,
+			 unsigned int firstRow);
+	void compressNV(struct jpeg_compress_struct *cinfo,
+			const std::vector<libcamera::Span<uint8_t>> &planes,
+			unsigned int firstRow);
+
+	int encodeStrips(const std::vector<libcamera::Span<uint8_t>> &planes,
+			 libcamera::Span<uint8_t> destination,
+			 libcamera::Span<const uint8_t> exifData,
+			 unsigned int quality);
 
 	struct jpeg_compress_struct compress_;
 	struct jpeg_error_mgr jerr_;
 
+	std::vector<std::unique_ptr<Strip>> strips_;
+	unsigned int stripHeight_;
+	unsigned int restartInterval_;
+
 	const libcamera::PixelFormatInfo *pixelFormatInfo_;
 
 	bool nv_;
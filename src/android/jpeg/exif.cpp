@@ -36,7 +36,9 @@ enum class _ExifTag {
  * through the exposed public API.
  *
  * Once all desired properties have been set, the user shall call
- * generate() to process the entries and generate the Exif data.
+ * generate() to process the entries and generate the Exif data. The instance
+ * can then be reused for further images, updating the properties that change
+ * and calling generate() again.
  *
  * Calls to generate() must check the return code to determine if any error
  * occurred during the construction of the Exif data, and if successful the
@@ -125,8 +127,17 @@ ExifEntry *Exif::createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 {
 	ExifContent *content = data_->ifd[ifd];
 
-	/* Replace any existing entry with the same tag. */
+	/*
+	 * Reuse any existing entry with the same tag and layout, as is the
+	 * case for most tags updated for every frame, or replace it.
+	 */
 	ExifEntry *existing = exif_content_get_entry(content, tag);
+	if (existing && existing->format == format &&
+	    existing->components == components && existing->size == size) {
+		exif_entry_ref(existing);
+		return existing;
+	}
+
 	exif_content_remove_entry(content, existing);
 
 	ExifEntry *entry = exif_entry_new_mem(mem_);
@@ -155,6 +166,15 @@ ExifEntry *Exif::createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 	return entry;
 }
 
+void Exif::removeEntry(ExifIfd ifd, ExifTag tag)
+{
+	ExifContent *content = data_->ifd[ifd];
+	ExifEntry *entry = exif_content_get_entry(content, tag);
+
+	if (entry)
+		exif_content_remove_entry(content, entry);
+}
+
 void Exif::setByte(ExifIfd ifd, ExifTag tag, uint8_t item)
 {
 	ExifEntry *entry = createEntry(ifd, tag, EXIF_FORMAT_BYTE, 1, 1);
@@ -474,6 +494,48 @@ void Exif::setWhiteBalance(WhiteBalance wb)
 	setShort(EXIF_IFD_EXIF, EXIF_TAG_WHITE_BALANCE, static_cast<ExifShort>(wb));
 }
 
+/*
+ * The clear*() functions remove optional tags, for callers that reuse the
+ * same Exif instance for multiple images and don't set the tags every time.
+ */
+void Exif::clearThumbnail()
+{
+	thumbnailData_.clear();
+
+	data_->data = nullptr;
+	data_->size = 0;
+
+	removeEntry(EXIF_IFD_0, EXIF_TAG_COMPRESSION);
+}
+
+void Exif::clearGPS()
+{
+	/*
+	 * Only remove the tags set by the setGPS*() functions, and keep any
+	 * entry created by exif_data_fix() at construction time, to produce
+	 * the same data as a new instance.
+	 */
+	static const unsigned int gpsTags[] = {
+		EXIF_TAG_GPS_DATE_STAMP,
+		EXIF_TAG_GPS_TIME_STAMP,
+		EXIF_TAG_GPS_LATITUDE_REF,
+		EXIF_TAG_GPS_LATITUDE,
+		EXIF_TAG_GPS_LONGITUDE_REF,
+		EXIF_TAG_GPS_LONGITUDE,
+		EXIF_TAG_GPS_ALTITUDE_REF,
+		EXIF_TAG_GPS_ALTITUDE,
+		EXIF_TAG_GPS_PROCESSING_METHOD,
+	};
+
+	for (unsigned int tag : gpsTags)
+		removeEntry(EXIF_IFD_GPS, static_cast<ExifTag>(tag));
+}
+
+void Exif::clearAperture()
+{
+	removeEntry(EXIF_IFD_EXIF, EXIF_TAG_FNUMBER);
+}
+
 /**
  * \brief Convert UTF-8 string to UTF-16 string
  * \param[in] str String to convert
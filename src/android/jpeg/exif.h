@@ -76,6 +76,11 @@ public:
 	void setFlash(Flash flash);
 	void setWhiteBalance(WhiteBalance wb);
 
+	void clearThumbnail();
+	void clearGPS();
+	void clearAperture();
+
+	bool isValid() const { return valid_; }
 	libcamera::Span<const uint8_t> data() const { return { exifData_, size_ }; }
 	[[nodiscard]] int generate();
 
@@ -83,6 +88,7 @@ private:
 	ExifEntry *createEntry(ExifIfd ifd, ExifTag tag);
 	ExifEntry *createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 			       unsigned long components, unsigned int size);
+	void removeEntry(ExifIfd ifd, ExifTag tag);
 
 	void setByte(ExifIfd ifd, ExifTag tag, uint8_t item);
 	void setShort(ExifIfd ifd, ExifTag tag, uint16_t item);
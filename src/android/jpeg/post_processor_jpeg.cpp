@@ -20,6 +20,7 @@
 #include "exif.h"
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread_pool.h>
 
 #include <libcamera/formats.h>
 
@@ -56,9 +57,31 @@ int PostProcessorJpeg::configure(const StreamConfiguration &inCfg,
 	encoder_ = std::make_unique<EncoderLibJpeg>();
 #endif
 
+	exif_ = createExif();
+
 	return encoder_->configure(inCfg);
 }
 
+/*
+ * Create an Exif instance with the tags that don't change between images of
+ * the stream. The other tags are set for every image in process().
+ */
+std::unique_ptr<Exif> PostProcessorJpeg::createExif() const
+{
+	auto exif = std::make_unique<Exif>();
+
+	exif->setMake(cameraDevice_->maker());
+	exif->setModel(cameraDevice_->model());
+	exif->setSize(streamSize_);
+
+	exif->setFlash(Exif::Flash::FlashNotPresent);
+	exif->setWhiteBalance(Exif::WhiteBalance::Auto);
+
+	exif->setFocalLength(1.0);
+
+	return exif;
+}
+
 void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
 					  const Size &targetSize,
 					  unsigned int quality,
@@ -69,12 +92,17 @@ void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
 
 	thumbnailer_.createThumbnail(source, targetSize, &rawThumbnail);
 
-	StreamConfiguration thCfg;
-	thCfg.size = targetSize;
-	thCfg.pixelFormat = thumbnailer_.pixelFormat();
-	int ret = thumbnailEncoder_.configure(thCfg);
+	/* Reconfigure the thumbnail encoder only when the size changes. */
+	if (targetSize != thumbnailSize_) {
+		StreamConfiguration thCfg;
+		thCfg.size = targetSize;
+		thCfg.pixelFormat = thumbnailer_.pixelFormat();
 
-	if (!rawThumbnail.empty() && !ret) {
+		int ret = thumbnailEncoder_.configure(thCfg);
+		thumbnailSize_ = ret ? Size() : targetSize;
+	}
+
+	if (!rawThumbnail.empty() && !thumbnailSize_.isNull()) {
 		/*
 		 * \todo Avoid value-initialization of all elements of the
 		 * vector.
@@ -111,7 +139,7 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	ASSERT(encoder_);
 
 	const FrameBuffer &source = *streamBuffer->srcBuffer;
-	CameraBuffer *destination = streamBuffer->dstBuffer.get();
+	CameraBuffer *destination = streamBuffer->dstBuffer;
 
 	ASSERT(destination->numPlanes() == 1);
 
@@ -120,10 +148,18 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	camera_metadata_ro_entry_t entry;
 	int ret;
 
-	/* Set EXIF metadata for various tags. */
-	Exif exif;
-	exif.setMake(cameraDevice_->maker());
-	exif.setModel(cameraDevice_->model());
+	/*
+	 * Set EXIF metadata for the tags that vary between images, and clear
+	 * the optional ones that may have been set for a previous image. The
+	 * instance is recreated if a previous image failed to generate it.
+	 */
+	if (!exif_->isValid())
+		exif_ = createExif();
+
+	Exif &exif = *exif_;
+	exif.clearThumbnail();
+	exif.clearGPS();
+	exif.clearAperture();
 
 	ret = requestMetadata.getEntry(ANDROID_JPEG_ORIENTATION, &entry);
 
@@ -131,7 +167,6 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	resultMetadata->addEntry(ANDROID_JPEG_ORIENTATION, jpegOrientation);
 	exif.setOrientation(jpegOrientation);
 
-	exif.setSize(streamSize_);
 	/*
 	 * We set the frame's EXIF timestamp as the time of encode.
 	 * Since the precision we need for EXIF timestamp is only one
@@ -148,11 +183,6 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	ret = resultMetadata->getEntry(ANDROID_SENSOR_SENSITIVITY, &entry);
 	exif.setISO(ret ? *entry.data.i32 : 100);
 
-	exif.setFlash(Exif::Flash::FlashNotPresent);
-	exif.setWhiteBalance(Exif::WhiteBalance::Auto);
-
-	exif.setFocalLength(1.0);
-
 	ret = requestMetadata.getEntry(ANDROID_JPEG_GPS_TIMESTAMP, &entry);
 	if (ret) {
 		exif.setGPSDateTimestamp(*entry.data.i64);
@@ -160,6 +190,14 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 					 *entry.data.i64);
 	}
 
+	/*
+	 * Generate the thumbnail in the thread pool, concurrently with the
+	 * processing of the other EXIF tags, and wait for it only when the
+	 * EXIF data is generated.
+	 */
+	std::vector<unsigned char> thumbnail;
+	TaskGroup thumbnailTask;
+
 	ret = requestMetadata.getEntry(ANDROID_JPEG_THUMBNAIL_SIZE, &entry);
 	if (ret) {
 		const int32_t *data = entry.data.i32;
@@ -171,10 +209,10 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, quality);
 
 		if (thumbnailSize != Size(0, 0)) {
-			std::vector<unsigned char> thumbnail;
-			generateThumbnail(source, thumbnailSize, quality, &thumbnail);
-			if (!thumbnail.empty())
-				exif.setThumbnail(std::move(thumbnail), Exif::Compression::JPEG);
+			thumbnailTask.run([&, thumbnailSize, quality]() {
+				generateThumbnail(source, thumbnailSize, quality,
+						  &thumbnail);
+			});
 		}
 
 		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_SIZE, data, 2);
@@ -195,6 +233,10 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 					 entry.data.u8, entry.count);
 	}
 
+	thumbnailTask.wait();
+	if (!thumbnail.empty())
+		exif.setThumbnail(std::move(thumbnail), Exif::Compression::JPEG);
+
 	if (exif.generate() != 0)
 		LOG(JPEG, Error) << "Failed to generate valid EXIF data";
 
@@ -7,8 +7,11 @@
 
 #pragma once
 
+#include <memory>
+
 #include "../post_processor.h"
 #include "encoder_libjpeg.h"
+#include "exif.h"
 #include "thumbnailer.h"
 
 #include <libcamera/geometry.h>
@@ -25,6 +28,7 @@ public:
 	void process(Camera3RequestDescriptor::StreamBuffer *streamBuffer) override;
 
 private:
+	std::unique_ptr<Exif> createExif() const;
 	void generateThumbnail(const libcamera::FrameBuffer &source,
 			       const libcamera::Size &targetSize,
 			       unsigned int quality,
@@ -34,5 +38,9 @@ private:
 	std::unique_ptr<Encoder> encoder_;
 	libcamera::Size streamSize_;
 	EncoderLibJpeg thumbnailEncoder_;
+	libcamera::Size thumbnailSize_;
 	Thumbnailer thumbnailer_;
+
+	/* Reused for all images, with the tags constant for the stream set. */
+	std::unique_ptr<Exif> exif_;
 };
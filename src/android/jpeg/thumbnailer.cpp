@@ -7,6 +7,8 @@
 
 #include "thumbnailer.h"
 
+#include <libyuv/scale.h>
+
 #include <libcamera/base/log.h>
 
 #include <libcamera/formats.h>
@@ -18,7 +20,7 @@ using namespace libcamera;
 LOG_DEFINE_CATEGORY(Thumbnailer)
 
 Thumbnailer::Thumbnailer()
-	: valid_(false)
+	: sourceStride_{}, valid_(false)
 {
 }
 
@@ -34,6 +36,10 @@ void Thumbnailer::configure(const Size &sourceSize, PixelFormat pixelFormat)
 		return;
 	}
 
+	const PixelFormatInfo &info = PixelFormatInfo::info(pixelFormat_);
+	sourceStride_[0] = info.stride(sourceSize_.width, 0, 1);
+	sourceStride_[1] = info.stride(sourceSize_.width, 1, 1);
+
 	valid_ = true;
 }
 
@@ -62,35 +68,23 @@ void Thumbnailer::createThumbnail(const FrameBuffer &source,
 	ASSERT(frame.planes().size() == 2);
 	ASSERT(tw % 2 == 0 && th % 2 == 0);
 
-	/* Image scaling block implementing nearest-neighbour algorithm. */
-	unsigned char *src = frame.planes()[0].data();
-	unsigned char *srcC = frame.planes()[1].data();
-	unsigned char *srcCb, *srcCr;
-	unsigned char *dstY, *srcY;
-
 	size_t dstSize = (th * tw) + ((th / 2) * tw);
 	destination->resize(dstSize);
 	unsigned char *dst = destination->data();
 	unsigned char *dstC = dst + th * tw;
 
-	for (unsigned int y = 0; y < th; y += 2) {
-		unsigned int sourceY = (sh * y + th / 2) / th;
-
-		dstY = dst + y * tw;
-		srcY = src + sw * sourceY;
-		srcCb = srcC + (sourceY / 2) * sw + 0;
-		srcCr = srcC + (sourceY / 2) * sw + 1;
-
-		for (unsigned int x = 0; x < tw; x += 2) {
-			unsigned int sourceX = (sw * x + tw / 2) / tw;
-
-			dstY[x] = srcY[sourceX];
-			dstY[tw + x] = srcY[sw + sourceX];
-			dstY[x + 1] = srcY[sourceX + 1];
-			dstY[tw + x + 1] = srcY[sw + sourceX + 1];
-
-			dstC[(y / 2) * tw + x + 0] = srcCb[(sourceX / 2) * 2];
-			dstC[(y / 2) * tw + x + 1] = srcCr[(sourceX / 2) * 2];
-		}
+	/*
+	 * Downscale with a box filter, which averages all the source pixels
+	 * covered by each thumbnail pixel. This avoids the aliasing of
+	 * nearest-neighbour sampling for the large scaling ratios typical of
+	 * thumbnails, and libyuv implements it with SIMD instructions.
+	 */
+	int ret = libyuv::NV12Scale(frame.planes()[0].data(), sourceStride_[0],
+				    frame.planes()[1].data(), sourceStride_[1],
+				    sw, sh, dst, tw, dstC, tw, tw, th,
+				    libyuv::FilterMode::kFilterBox);
+	if (ret) {
+		LOG(Thumbnailer, Error) << "Failed NV12 scaling: " << ret;
+		destination->clear();
 	}
 }
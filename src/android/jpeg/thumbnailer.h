@@ -27,6 +27,7 @@ public:
 private:
 	libcamera::PixelFormat pixelFormat_;
 	libcamera::Size sourceSize_;
+	unsigned int sourceStride_[2];
 
 	bool valid_;
 };
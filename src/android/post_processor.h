@@ -8,6 +8,7 @@
 #pragma once
 
 #include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
 
 #include <libcamera/framebuffer.h>
 #include <libcamera/stream.h>
@@ -29,5 +30,19 @@ public:
 			      const libcamera::StreamConfiguration &outCfg) = 0;
 	virtual void process(Camera3RequestDescriptor::StreamBuffer *streamBuffer) = 0;
 
+	/*
+	 * Post-processors that can produce several outputs from one source
+	 * buffer in a single pass, reading the source only once, override
+	 * canProcessGroup() and processGroup(). The outputs are the buffers of
+	 * different streams sharing the same source, and processComplete is
+	 * emitted once per buffer.
+	 */
+	virtual bool canProcessGroup() const { return false; }
+	virtual void processGroup(libcamera::Span<Camera3RequestDescriptor::StreamBuffer *const> streamBuffers)
+	{
+		for (Camera3RequestDescriptor::StreamBuffer *streamBuffer : streamBuffers)
+			process(streamBuffer);
+	}
+
 	libcamera::Signal<Camera3RequestDescriptor::StreamBuffer *, Status> processComplete;
 };
@@ -7,9 +7,14 @@
 
 #include "post_processor_yuv.h"
 
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
 #include <libyuv/scale.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/formats.h>
 #include <libcamera/geometry.h>
@@ -18,10 +23,26 @@
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 
+#include "../camera_stream.h"
+
 using namespace libcamera;
 
 LOG_DEFINE_CATEGORY(YUV)
 
+namespace {
+
+/*
+ * When scaling a source to multiple outputs, the source is processed in bands
+ * of at least kSourceBandHeight lines, small enough to stay in the CPU caches
+ * while all the outputs are produced from them. Bands are kept at least
+ * kMinOutputBandHeight lines high in the smallest output, to limit the
+ * effect of the band edges on the filter.
+ */
+constexpr unsigned int kSourceBandHeight = 128;
+constexpr unsigned int kMinOutputBandHeight = 32;
+
+} /* namespace */
+
 int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 				const StreamConfiguration &outCfg)
 {
@@ -52,7 +73,7 @@ int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 void PostProcessorYuv::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
 {
 	const FrameBuffer &source = *streamBuffer->srcBuffer;
-	CameraBuffer *destination = streamBuffer->dstBuffer.get();
+	CameraBuffer *destination = streamBuffer->dstBuffer;
 
 	if (!isValidBuffers(source, *destination)) {
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
@@ -87,19 +108,137 @@ void PostProcessorYuv::process(Camera3RequestDescriptor::StreamBuffer *streamBuf
 	processComplete.emit(streamBuffer, PostProcessor::Status::Success);
 }
 
+/*
+ * Produce all the outputs of the group from a single source buffer in one
+ * pass. The source is scaled band by band, each band being scaled to all the
+ * outputs before moving to the next one, so that it is read from memory once.
+ */
+void PostProcessorYuv::processGroup(Span<Camera3RequestDescriptor::StreamBuffer *const> streamBuffers)
+{
+	struct Output {
+		Camera3RequestDescriptor::StreamBuffer *streamBuffer;
+		Size size;
+		unsigned int stride[2];
+		int ret;
+	};
+
+	const FrameBuffer &source = *streamBuffers[0]->srcBuffer;
+	const PixelFormatInfo &nv12Info = PixelFormatInfo::info(formats::NV12);
+	std::vector<Output> outputs;
+
+	for (Camera3RequestDescriptor::StreamBuffer *streamBuffer : streamBuffers) {
+		const camera3_stream_t *camera3Stream = streamBuffer->stream->camera3Stream();
+		Output output{ streamBuffer, { camera3Stream->width, camera3Stream->height }, {}, 0 };
+		unsigned int length[2];
+
+		for (unsigned int i = 0; i < 2; i++) {
+			output.stride[i] = nv12Info.stride(output.size.width, i, 1);
+			length[i] = nv12Info.planeSize(output.size.height, i,
+						       output.stride[i]);
+		}
+
+		if (!isValidSource(source) ||
+		    !isValidDestination(*streamBuffer->dstBuffer, length)) {
+			processComplete.emit(streamBuffer, PostProcessor::Status::Error);
+			continue;
+		}
+
+		outputs.push_back(output);
+	}
+
+	if (outputs.empty())
+		return;
+
+	const MappedFrameBuffer sourceMapped(&source, MappedFrameBuffer::MapFlag::Read);
+	if (!sourceMapped.isValid()) {
+		LOG(YUV, Error) << "Failed to mmap camera frame buffer";
+		for (const Output &output : outputs)
+			processComplete.emit(output.streamBuffer,
+					     PostProcessor::Status::Error);
+		return;
+	}
+
+	/*
+	 * Band boundaries must map exactly to even lines in the source and in
+	 * all outputs, for the chroma and for every band to be scaled with the
+	 * same ratio as the whole frame. The band height is thus a multiple of
+	 * the smallest number of source lines that maps to an even number of
+	 * lines in all outputs. When no such number smaller than the source
+	 * height exists, the source is scaled in a single band.
+	 */
+	const unsigned int sourceHeight = sourceSize_.height;
+	unsigned int minHeight = sourceHeight;
+	unsigned int step = 2;
+
+	for (const Output &output : outputs) {
+		unsigned int divisor = std::gcd(sourceHeight, output.size.height);
+		unsigned int srcLines = sourceHeight / divisor;
+		unsigned int dstLines = output.size.height / divisor;
+
+		minHeight = std::min(minHeight, output.size.height);
+
+		if (step < sourceHeight)
+			step = std::lcm(step, dstLines % 2 ? srcLines * 2 : srcLines);
+	}
+
+	unsigned int bandHeight = std::max(kSourceBandHeight,
+					   kMinOutputBandHeight * sourceHeight / minHeight);
+	bandHeight = std::min(utils::alignUp(bandHeight, step), sourceHeight);
+
+	for (unsigned int srcTop = 0; srcTop < sourceHeight; srcTop += bandHeight) {
+		unsigned int srcBottom = std::min(srcTop + bandHeight, sourceHeight);
+		unsigned int srcHeight = srcBottom - srcTop;
+		const uint8_t *srcY = sourceMapped.planes()[0].data() +
+				      srcTop * sourceStride_[0];
+		const uint8_t *srcUV = sourceMapped.planes()[1].data() +
+				       srcTop / 2 * sourceStride_[1];
+
+		for (Output &output : outputs) {
+			unsigned int top = srcTop * output.size.height / sourceHeight;
+			unsigned int height = srcBottom * output.size.height / sourceHeight - top;
+			CameraBuffer *destination = output.streamBuffer->dstBuffer;
+
+			if (output.ret || !height)
+				continue;
+
+			output.ret = libyuv::NV12Scale(srcY, sourceStride_[0],
+						       srcUV, sourceStride_[1],
+						       sourceSize_.width, srcHeight,
+						       destination->plane(0).data() +
+						       top * output.stride[0],
+						       output.stride[0],
+						       destination->plane(1).data() +
+						       top / 2 * output.stride[1],
+						       output.stride[1],
+						       output.size.width, height,
+						       libyuv::FilterMode::kFilterBilinear);
+		}
+	}
+
+	for (const Output &output : outputs) {
+		if (output.ret)
+			LOG(YUV, Error) << "Failed NV12 scaling: " << output.ret;
+
+		processComplete.emit(output.streamBuffer,
+				     output.ret ? PostProcessor::Status::Error
+						: PostProcessor::Status::Success);
+	}
+}
+
 bool PostProcessorYuv::isValidBuffers(const FrameBuffer &source,
 				      const CameraBuffer &destination) const
+{
+	return isValidSource(source) &&
+	       isValidDestination(destination, destinationLength_);
+}
+
+bool PostProcessorYuv::isValidSource(const FrameBuffer &source) const
 {
 	if (source.planes().size() != 2) {
 		LOG(YUV, Error) << "Invalid number of source planes: "
 				<< source.planes().size();
 		return false;
 	}
-	if (destination.numPlanes() != 2) {
-		LOG(YUV, Error) << "Invalid number of destination planes: "
-				<< destination.numPlanes();
-		return false;
-	}
 
 	if (source.planes()[0].length < sourceLength_[0] ||
 	    source.planes()[1].length < sourceLength_[1]) {
@@ -112,15 +251,27 @@ bool PostProcessorYuv::isValidBuffers(const FrameBuffer &source,
 			<< sourceLength_[1] << "}";
 		return false;
 	}
-	if (destination.plane(0).size() < destinationLength_[0] ||
-	    destination.plane(1).size() < destinationLength_[1]) {
+
+	return true;
+}
+
+bool PostProcessorYuv::isValidDestination(const CameraBuffer &destination,
+					  const unsigned int (&length)[2]) const
+{
+	if (destination.numPlanes() != 2) {
+		LOG(YUV, Error) << "Invalid number of destination planes: "
+				<< destination.numPlanes();
+		return false;
+	}
+
+	if (destination.plane(0).size() < length[0] ||
+	    destination.plane(1).size() < length[1]) {
 		LOG(YUV, Error)
 			<< "The destination planes lengths are too small, actual size: {"
 			<< destination.plane(0).size() << ", "
 			<< destination.plane(1).size()
 			<< "}, expected size: {"
-			<< sourceLength_[0] << ", "
-			<< sourceLength_[1] << "}";
+			<< length[0] << ", " << length[1] << "}";
 		return false;
 	}
 
@@ -20,9 +20,15 @@ public:
 		      const libcamera::StreamConfiguration &outcfg) override;
 	void process(Camera3RequestDescriptor::StreamBuffer *streamBuffer) override;
 
+	bool canProcessGroup() const override { return true; }
+	void processGroup(libcamera::Span<Camera3RequestDescriptor::StreamBuffer *const> streamBuffers) override;
+
 private:
 	bool isValidBuffers(const libcamera::FrameBuffer &source,
 			    const CameraBuffer &destination) const;
+	bool isValidSource(const libcamera::FrameBuffer &source) const;
+	bool isValidDestination(const CameraBuffer &destination,
+				const unsigned int (&length)[2]) const;
 	void calculateLengths(const libcamera::StreamConfiguration &inCfg,
 			      const libcamera::StreamConfiguration &outCfg);
 
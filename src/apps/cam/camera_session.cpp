@@ -5,6 +5,8 @@
  * Camera capture session
  */
 
+#include <algorithm>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits.h>
@@ -18,6 +20,7 @@
 
 #include "camera_session.h"
 #include "capture_script.h"
+#include "capture_stats.h"
 #include "file_sink.h"
 #ifdef HAVE_KMS
 #include "kms_sink.h"
@@ -105,12 +108,6 @@ CameraSession::CameraSession(CameraManager *cm,
 			return;
 		}
 
-		if (roles.size() != 1) {
-			std::cerr << "Display doesn't support multiple streams"
-				  << std::endl;
-			return;
-		}
-
 		if (roles[0] != StreamRole::Viewfinder) {
 			std::cerr << "Display requires a viewfinder stream"
 				  << std::endl;
@@ -217,6 +214,13 @@ int CameraSession::start()
 					   + "-stream" + std::to_string(index);
 	}
 
+	/*
+	 * Deliver completed requests in the event loop, to avoid blocking the
+	 * camera manager thread.
+	 */
+	camera_->setCompletionExecutor([](std::function<void()> task) {
+		EventLoop::instance()->callLater(task);
+	});
 	camera_->requestCompleted.connect(this, &CameraSession::requestComplete);
 
 #ifdef HAVE_KMS
@@ -230,11 +234,13 @@ int CameraSession::start()
 #endif
 
 	if (options_.isSet(OptFile)) {
-		if (!options_[OptFile].toString().empty())
-			sink_ = std::make_unique<FileSink>(camera_.get(), streamNames_,
-							   options_[OptFile]);
-		else
-			sink_ = std::make_unique<FileSink>(camera_.get(), streamNames_);
+		unsigned int queueDepth = std::max(options_[OptFileQueue].toInteger(), 0);
+
+		sink_ = std::make_unique<FileSink>(camera_.get(), streamNames_,
+						   options_[OptFile].toString(),
+						   queueDepth,
+						   options_.isSet(OptFileDirect),
+						   options_.isSet(OptFileCompress));
 	}
 
 	if (sink_) {
@@ -250,6 +256,11 @@ int CameraSession::start()
 
 	allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
 
+	if (options_.isSet(OptBenchmark))
+		stats_ = std::make_unique<CaptureStats>("cam" + std::to_string(cameraIndex_));
+	else
+		stats_.reset();
+
 	return startCapture();
 }
 
@@ -267,6 +278,11 @@ void CameraSession::stop()
 
 	sink_.reset();
 
+	if (stats_) {
+		stats_->stop();
+		reportStats();
+	}
+
 	requests_.clear();
 
 	allocator_.reset();
@@ -337,15 +353,24 @@ int CameraSession::startCapture()
 		return ret;
 	}
 
+	if (stats_)
+		stats_->start();
+
+	std::vector<Request *> requests;
 	for (std::unique_ptr<Request> &request : requests_) {
-		ret = queueRequest(request.get());
-		if (ret < 0) {
-			std::cerr << "Can't queue request" << std::endl;
-			camera_->stop();
-			if (sink_)
-				sink_->stop();
-			return ret;
-		}
+		if (!prepareRequest(request.get()))
+			break;
+
+		requests.push_back(request.get());
+	}
+
+	ret = camera_->queueRequests(requests);
+	if (ret < 0) {
+		std::cerr << "Can't queue requests" << std::endl;
+		camera_->stop();
+		if (sink_)
+			sink_->stop();
+		return ret;
 	}
 
 	if (captureLimit_)
@@ -360,16 +385,34 @@ int CameraSession::startCapture()
 	return 0;
 }
 
-int CameraSession::queueRequest(Request *request)
+bool CameraSession::prepareRequest(Request *request)
 {
 	if (captureLimit_ && queueCount_ >= captureLimit_)
-		return 0;
+		return false;
 
-	if (script_)
-		request->controls() = script_->frameControls(queueCount_);
+	/*
+	 * The request controls are cleared when the request is reused, merge
+	 * the script controls instead of replacing the whole list.
+	 */
+	if (script_) {
+		const ControlList *controls = script_->frameControls(queueCount_);
+		if (controls)
+			request->controls().merge(*controls);
+	}
+
+	if (stats_)
+		stats_->requestQueued(request);
 
 	queueCount_++;
 
+	return true;
+}
+
+int CameraSession::queueRequest(Request *request)
+{
+	if (!prepareRequest(request))
+		return 0;
+
 	return camera_->queueRequest(request);
 }
 
@@ -378,11 +421,7 @@ void CameraSession::requestComplete(Request *request)
 	if (request->status() == Request::RequestCancelled)
 		return;
 
-	/*
-	 * Defer processing of the completed request to the event loop, to avoid
-	 * blocking the camera manager thread.
-	 */
-	EventLoop::instance()->callLater([this, request]() { processRequest(request); });
+	processRequest(request);
 }
 
 void CameraSession::processRequest(Request *request)
@@ -397,46 +436,22 @@ void CameraSession::processRequest(Request *request)
 	if (captureLimit_ && captureCount_ >= captureLimit_)
 		return;
 
-	const Request::BufferMap &buffers = request->buffers();
+	bool requeue = true;
 
 	/*
-	 * Compute the frame rate. The timestamp is arbitrarily retrieved from
-	 * the first buffer, as all buffers should have matching timestamps.
+	 * In benchmark mode, record the request timings instead of printing
+	 * them, as writing to the console slows down high frame rate captures.
 	 */
-	uint64_t ts = buffers.begin()->second->metadata().timestamp;
-	double fps = ts - last_;
-	fps = last_ != 0 && fps ? 1000000000.0 / fps : 0.0;
-	last_ = ts;
-
-	bool requeue = true;
-
-	std::stringstream info;
-	info << ts / 1000000000 << "."
-	     << std::setw(6) << std::setfill('0') << ts / 1000 % 1000000
-	     << " (" << std::fixed << std::setprecision(2) << fps << " fps)";
-
-	for (const auto &[stream, buffer] : buffers) {
-		const FrameMetadata &metadata = buffer->metadata();
-
-		info << " " << streamNames_[stream]
-		     << " seq: " << std::setw(6) << std::setfill('0') << metadata.sequence
-		     << " bytesused: ";
-
-		unsigned int nplane = 0;
-		for (const FrameMetadata::Plane &plane : metadata.planes()) {
-			info << plane.bytesused;
-			if (++nplane < metadata.planes().size())
-				info << "/";
-		}
-	}
+	if (stats_)
+		stats_->requestCompleted(request);
+	else
+		printRequest(request);
 
 	if (sink_) {
 		if (!sink_->processRequest(request))
 			requeue = false;
 	}
 
-	std::cout << info.str() << std::endl;
-
 	if (printMetadata_) {
 		const ControlList &requestMetadata = request->metadata();
 		for (const auto &[key, value] : requestMetadata) {
@@ -467,6 +482,64 @@ void CameraSession::processRequest(Request *request)
 	queueRequest(request);
 }
 
+void CameraSession::printRequest(Request *request)
+{
+	const Request::BufferMap &buffers = request->buffers();
+
+	/*
+	 * Compute the frame rate. The timestamp is arbitrarily retrieved from
+	 * the first buffer, as all buffers should have matching timestamps.
+	 */
+	uint64_t ts = buffers.begin()->second->metadata().timestamp;
+	double fps = ts - last_;
+	fps = last_ != 0 && fps ? 1000000000.0 / fps : 0.0;
+	last_ = ts;
+
+	std::stringstream info;
+	info << ts / 1000000000 << "."
+	     << std::setw(6) << std::setfill('0') << ts / 1000 % 1000000
+	     << " (" << std::fixed << std::setprecision(2) << fps << " fps)";
+
+	for (const auto &[stream, buffer] : buffers) {
+		const FrameMetadata &metadata = buffer->metadata();
+
+		info << " " << streamNames_[stream]
+		     << " seq: " << std::setw(6) << std::setfill('0') << metadata.sequence
+		     << " bytesused: ";
+
+		unsigned int nplane = 0;
+		for (const FrameMetadata::Plane &plane : metadata.planes()) {
+			info << plane.bytesused;
+			if (++nplane < metadata.planes().size())
+				info << "/";
+		}
+	}
+
+	std::cout << info.str() << std::endl;
+}
+
+void CameraSession::reportStats()
+{
+	stats_->print(std::cout);
+
+	if (!options_[OptBenchmark].toString().empty()) {
+		std::string filename = options_[OptBenchmark].toString();
+
+		if (filename == "-") {
+			stats_->writeJson(std::cout);
+			return;
+		}
+
+		std::ofstream file(filename);
+		if (!file) {
+			std::cerr << "Failed to open " << filename << std::endl;
+			return;
+		}
+
+		stats_->writeJson(file);
+	}
+}
+
 void CameraSession::sinkRelease(Request *request)
 {
 	request->reuse(Request::ReuseBuffers);
@@ -24,6 +24,7 @@
 #include "../common/options.h"
 
 class CaptureScript;
+class CaptureStats;
 class FrameSink;
 
 class CameraSession
@@ -52,9 +53,12 @@ public:
 private:
 	int startCapture();
 
+	bool prepareRequest(libcamera::Request *request);
 	int queueRequest(libcamera::Request *request);
 	void requestComplete(libcamera::Request *request);
 	void processRequest(libcamera::Request *request);
+	void printRequest(libcamera::Request *request);
+	void reportStats();
 	void sinkRelease(libcamera::Request *request);
 
 	const OptionsParser::Options &options_;
@@ -62,6 +66,7 @@ private:
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
 
 	std::unique_ptr<CaptureScript> script_;
+	std::unique_ptr<CaptureStats> stats_;
 
 	std::map<const libcamera::Stream *, std::string> streamNames_;
 	std::unique_ptr<FrameSink> sink_;
@@ -37,24 +37,44 @@ CaptureScript::CaptureScript(std::shared_ptr<Camera> camera,
 	if (ret)
 		return;
 
+	compileSchedule();
+
 	valid_ = true;
 }
 
-/* Retrieve the control list associated with a frame number. */
-const ControlList &CaptureScript::frameControls(unsigned int frame)
+/*
+ * Retrieve the control list associated with a frame number, or nullptr if the
+ * script sets no control for the frame.
+ */
+const ControlList *CaptureScript::frameControls(unsigned int frame) const
 {
-	static ControlList controls{};
-	unsigned int idx = frame;
-
 	/* If we loop, repeat the controls every 'loop_' frames. */
 	if (loop_)
-		idx = frame % loop_;
+		frame %= loop_;
 
-	auto it = frameControls_.find(idx);
-	if (it == frameControls_.end())
-		return controls;
+	if (frame >= schedule_.size())
+		return nullptr;
 
-	return it->second;
+	return schedule_[frame];
+}
+
+/*
+ * Index the control lists by frame number, to look them up in constant time
+ * when queuing requests. The schedule covers the whole loop if the script
+ * loops, and stops at the last frame otherwise.
+ */
+void CaptureScript::compileSchedule()
+{
+	unsigned int length = loop_;
+	if (!length && !frameControls_.empty())
+		length = frameControls_.rbegin()->first + 1;
+
+	schedule_.assign(length, nullptr);
+
+	for (const auto &[frame, controls] : frameControls_) {
+		if (!controls.empty())
+			schedule_[frame] = &controls;
+	}
 }
 
 CaptureScript::EventPtr CaptureScript::nextEvent(yaml_event_type_t expectedType)
@@ -270,7 +290,8 @@ int CaptureScript::parseFrame(EventPtr event)
 	if (!event)
 		return -EINVAL;
 
-	ControlList controls{};
+	/* Use the camera controls, so that the list can be merged in requests. */
+	ControlList controls(camera_->controls());
 
 	while (1) {
 		event = nextEvent();
@@ -10,6 +10,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <libcamera/camera.h>
 #include <libcamera/controls.h>
@@ -24,7 +25,7 @@ public:
 
 	bool valid() const { return valid_; }
 
-	const libcamera::ControlList &frameControls(unsigned int frame);
+	const libcamera::ControlList *frameControls(unsigned int frame) const;
 
 private:
 	struct EventDeleter {
@@ -38,6 +39,7 @@ private:
 
 	std::map<std::string, const libcamera::ControlId *> controls_;
 	std::map<unsigned int, libcamera::ControlList> frameControls_;
+	std::vector<const libcamera::ControlList *> schedule_;
 	std::shared_ptr<libcamera::Camera> camera_;
 	yaml_parser_t parser_;
 	unsigned int loop_;
@@ -49,6 +51,7 @@ private:
 	static std::string eventTypeName(yaml_event_type_t type);
 
 	int parseScript(FILE *script);
+	void compileSchedule();
 
 	int parseProperties();
 	int parseProperty();
@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Capture statistics for benchmarking
+ */
+
+#include "capture_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer.h>
+
+using namespace libcamera;
+
+namespace {
+
+constexpr unsigned int kHistogramBins = 10;
+constexpr unsigned int kHistogramWidth = 40;
+
+std::string jsonString(const std::string &str)
+{
+	std::string escaped = "\"";
+
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if (static_cast<unsigned char>(c) < 0x20)
+			continue;
+		escaped += c;
+	}
+
+	return escaped + "\"";
+}
+
+uint64_t timevalToNs(const struct timeval &tv)
+{
+	return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+}
+
+} /* namespace */
+
+/*
+ * Record the timings of a capture session: the interval between request
+ * completions as seen by the application, the interval between sensor
+ * timestamps, the latency between queuing and completion of requests, gaps in
+ * frame sequence numbers, and the CPU time consumed by each thread of the
+ * process. Durations are recorded in nanoseconds and reported in microseconds.
+ */
+CaptureStats::CaptureStats(const std::string &name)
+	: name_(name), lastSensorTimestamp_(0), lastSequence_(0), frames_(0),
+	  gaps_(0), dropped_(0), startUserTime_(0), startSystemTime_(0),
+	  userTime_(0), systemTime_(0)
+{
+}
+
+void CaptureStats::start()
+{
+	startThreadTimes_ = threadTimes();
+	processTimes(&startUserTime_, &startSystemTime_);
+
+	startTime_ = clock::now();
+}
+
+void CaptureStats::stop()
+{
+	stopTime_ = clock::now();
+
+	/*
+	 * Only report the threads that are still running, threads that have
+	 * exited during the capture are accounted in the process CPU time.
+	 */
+	threadTimes_ = threadTimes();
+	for (auto &[tid, times] : threadTimes_) {
+		auto iter = startThreadTimes_.find(tid);
+		if (iter == startThreadTimes_.end())
+			continue;
+
+		times.user -= std::min(times.user, iter->second.user);
+		times.system -= std::min(times.system, iter->second.system);
+	}
+
+	processTimes(&userTime_, &systemTime_);
+	userTime_ -= startUserTime_;
+	systemTime_ -= startSystemTime_;
+
+	intervals_.finalize();
+	sensorIntervals_.finalize();
+	latencies_.finalize();
+
+	queued_.clear();
+}
+
+void CaptureStats::requestQueued(const Request *request)
+{
+	queued_[request] = clock::now();
+}
+
+void CaptureStats::requestCompleted(Request *request)
+{
+	clock::time_point now = clock::now();
+
+	auto iter = queued_.find(request);
+	if (iter != queued_.end()) {
+		latencies_.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				       now - iter->second).count());
+		queued_.erase(iter);
+	}
+
+	if (frames_)
+		intervals_.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				       now - lastCompletion_).count());
+	lastCompletion_ = now;
+
+	const auto sensorTimestamp = request->metadata().get(controls::SensorTimestamp);
+	if (sensorTimestamp) {
+		if (lastSensorTimestamp_ && *sensorTimestamp > lastSensorTimestamp_)
+			sensorIntervals_.add(*sensorTimestamp - lastSensorTimestamp_);
+		lastSensorTimestamp_ = *sensorTimestamp;
+	}
+
+	/* All buffers of a request are expected to have the same sequence. */
+	const FrameBuffer *buffer = request->buffers().begin()->second;
+	unsigned int sequence = buffer->metadata().sequence;
+
+	if (frames_ && sequence - lastSequence_ > 1) {
+		gaps_++;
+		dropped_ += sequence - lastSequence_ - 1;
+	}
+	lastSequence_ = sequence;
+
+	frames_++;
+}
+
+void CaptureStats::print(std::ostream &out) const
+{
+	double duration = std::chrono::duration<double>(stopTime_ - startTime_).count();
+
+	out << name_ << ": " << frames_ << " frames in " << std::fixed
+	    << std::setprecision(3) << duration << "s";
+	if (intervals_.count())
+		out << " (" << std::setprecision(2) << 1e9 / intervals_.mean()
+		    << " fps)";
+	out << ", " << dropped_ << " dropped in " << gaps_ << " gaps" << std::endl;
+
+	intervals_.print(out, "Completion interval");
+	sensorIntervals_.print(out, "Sensor timestamp interval");
+	latencies_.print(out, "Queue to completion latency");
+
+	out << "CPU time: user " << std::setprecision(1) << userTime_ / 1e6
+	    << "ms, system " << systemTime_ / 1e6 << "ms" << std::endl;
+
+	for (const auto &[tid, times] : threadTimes_)
+		out << "  " << std::left << std::setw(16) << times.name
+		    << std::right << " (" << tid << "): user "
+		    << times.user / 1e6 << "ms, system "
+		    << times.system / 1e6 << "ms" << std::endl;
+
+	out << std::defaultfloat;
+}
+
+void CaptureStats::writeJson(std::ostream &out) const
+{
+	double duration = std::chrono::duration<double>(stopTime_ - startTime_).count();
+
+	out << "{" << std::endl
+	    << "  \"camera\": " << jsonString(name_) << "," << std::endl
+	    << "  \"frames\": " << frames_ << "," << std::endl
+	    << "  \"duration\": " << duration << "," << std::endl
+	    << "  \"fps\": " << (intervals_.count() ? 1e9 / intervals_.mean() : 0.0)
+	    << "," << std::endl
+	    << "  \"dropped\": " << dropped_ << "," << std::endl
+	    << "  \"gaps\": " << gaps_ << "," << std::endl;
+
+	out << "  \"completion_interval_us\": ";
+	intervals_.writeJson(out);
+	out << "," << std::endl << "  \"sensor_interval_us\": ";
+	sensorIntervals_.writeJson(out);
+	out << "," << std::endl << "  \"latency_us\": ";
+	latencies_.writeJson(out);
+	out << "," << std::endl;
+
+	out << "  \"cpu_ms\": { \"user\": " << userTime_ / 1e6
+	    << ", \"system\": " << systemTime_ / 1e6 << " }," << std::endl;
+
+	out << "  \"threads\": [";
+	bool first = true;
+	for (const auto &[tid, times] : threadTimes_) {
+		out << (first ? "" : ",") << std::endl
+		    << "    { \"tid\": " << tid
+		    << ", \"name\": " << jsonString(times.name)
+		    << ", \"user_ms\": " << times.user / 1e6
+		    << ", \"system_ms\": " << times.system / 1e6 << " }";
+		first = false;
+	}
+	out << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+/*
+ * Read the CPU time of all threads of the process from procfs. The thread name
+ * is enclosed in parentheses and may contain spaces, the times are read from
+ * the fields that follow it.
+ */
+std::map<pid_t, CaptureStats::ThreadTime> CaptureStats::threadTimes()
+{
+	std::map<pid_t, ThreadTime> times;
+	uint64_t tick = 1000000000ULL / sysconf(_SC_CLK_TCK);
+
+	DIR *dir = opendir("/proc/self/task");
+	if (!dir)
+		return times;
+
+	while (struct dirent *entry = readdir(dir)) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		pid_t tid = atoi(entry->d_name);
+		std::ifstream file("/proc/self/task/" + std::string(entry->d_name) + "/stat");
+		std::string stat;
+		if (!std::getline(file, stat))
+			continue;
+
+		size_t open = stat.find('(');
+		size_t close = stat.rfind(')');
+		if (open == std::string::npos || close == std::string::npos ||
+		    close < open)
+			continue;
+
+		/* Fields 3 (state) to 13 precede utime and stime. */
+		std::istringstream fields(stat.substr(close + 1));
+		std::string field;
+		for (unsigned int i = 0; i < 11; i++)
+			fields >> field;
+
+		uint64_t user = 0, system = 0;
+		if (!(fields >> user >> system))
+			continue;
+
+		times[tid] = { stat.substr(open + 1, close - open - 1),
+			       user * tick, system * tick };
+	}
+
+	closedir(dir);
+
+	return times;
+}
+
+void CaptureStats::processTimes(uint64_t *user, uint64_t *system)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) < 0) {
+		*user = 0;
+		*system = 0;
+		return;
+	}
+
+	*user = timevalToNs(usage.ru_utime);
+	*system = timevalToNs(usage.ru_stime);
+}
+
+void CaptureStats::Series::finalize()
+{
+	std::sort(values_.begin(), values_.end());
+
+	mean_ = 0.0;
+	stddev_ = 0.0;
+
+	if (values_.empty())
+		return;
+
+	for (uint64_t value : values_)
+		mean_ += value;
+	mean_ /= values_.size();
+
+	for (uint64_t value : values_)
+		stddev_ += (value - mean_) * (value - mean_);
+	stddev_ = std::sqrt(stddev_ / values_.size());
+}
+
+uint64_t CaptureStats::Series::percentile(double percentile) const
+{
+	if (values_.empty())
+		return 0;
+
+	size_t index = std::lround(percentile / 100 * (values_.size() - 1));
+	return values_[std::min(index, values_.size() - 1)];
+}
+
+/*
+ * Compute a histogram of the values with kHistogramBins bins of equal width,
+ * covering the range of the values.
+ */
+std::vector<unsigned int> CaptureStats::Series::histogram(uint64_t *start,
+							   uint64_t *width) const
+{
+	std::vector<unsigned int> bins(kHistogramBins);
+
+	*start = min();
+	*width = std::max<uint64_t>((max() - min() + kHistogramBins) / kHistogramBins, 1);
+
+	for (uint64_t value : values_) {
+		size_t bin = (value - *start) / *width;
+		bins[std::min<size_t>(bin, bins.size() - 1)]++;
+	}
+
+	return bins;
+}
+
+void CaptureStats::Series::print(std::ostream &out, const std::string &title) const
+{
+	if (values_.empty())
+		return;
+
+	out << std::setprecision(1)
+	    << title << " (us): min " << min() / 1e3
+	    << " mean " << mean() / 1e3
+	    << " stddev " << stddev() / 1e3
+	    << " p50 " << percentile(50) / 1e3
+	    << " p90 " << percentile(90) / 1e3
+	    << " p99 " << percentile(99) / 1e3
+	    << " max " << max() / 1e3 << std::endl;
+
+	uint64_t start, width;
+	std::vector<unsigned int> bins = histogram(&start, &width);
+	unsigned int peak = *std::max_element(bins.begin(), bins.end());
+
+	for (unsigned int i = 0; i < bins.size(); i++) {
+		unsigned int length = bins[i] * kHistogramWidth / peak;
+
+		out << "  " << std::setw(10) << (start + i * width) / 1e3
+		    << " | " << std::setw(6) << bins[i] << " "
+		    << std::string(length, '#') << std::endl;
+	}
+}
+
+void CaptureStats::Series::writeJson(std::ostream &out) const
+{
+	out << "{ \"count\": " << count()
+	    << ", \"min\": " << min() / 1e3
+	    << ", \"max\": " << max() / 1e3
+	    << ", \"mean\": " << mean() / 1e3
+	    << ", \"stddev\": " << stddev() / 1e3
+	    << ", \"p50\": " << percentile(50) / 1e3
+	    << ", \"p90\": " << percentile(90) / 1e3
+	    << ", \"p99\": " << percentile(99) / 1e3;
+
+	if (!values_.empty()) {
+		uint64_t start, width;
+		std::vector<unsigned int> bins = histogram(&start, &width);
+
+		out << ", \"histogram\": { \"start\": " << start / 1e3
+		    << ", \"width\": " << width / 1e3 << ", \"counts\": [";
+		for (unsigned int i = 0; i < bins.size(); i++)
+			out << (i ? ", " : " ") << bins[i];
+		out << " ] }";
+	}
+
+	out << " }";
+}
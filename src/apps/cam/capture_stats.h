@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Capture statistics for benchmarking
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#include <libcamera/request.h>
+
+class CaptureStats
+{
+public:
+	CaptureStats(const std::string &name);
+
+	void start();
+	void stop();
+
+	void requestQueued(const libcamera::Request *request);
+	void requestCompleted(libcamera::Request *request);
+
+	void print(std::ostream &out) const;
+	void writeJson(std::ostream &out) const;
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	/* A series of durations, in nanoseconds. */
+	class Series
+	{
+	public:
+		void add(uint64_t value) { values_.push_back(value); }
+		void finalize();
+
+		size_t count() const { return values_.size(); }
+		uint64_t min() const { return values_.empty() ? 0 : values_.front(); }
+		uint64_t max() const { return values_.empty() ? 0 : values_.back(); }
+		double mean() const { return mean_; }
+		double stddev() const { return stddev_; }
+		uint64_t percentile(double percentile) const;
+
+		void print(std::ostream &out, const std::string &title) const;
+		void writeJson(std::ostream &out) const;
+
+	private:
+		std::vector<unsigned int> histogram(uint64_t *start, uint64_t *width) const;
+
+		std::vector<uint64_t> values_;
+		double mean_ = 0.0;
+		double stddev_ = 0.0;
+	};
+
+	struct ThreadTime {
+		std::string name;
+		uint64_t user;
+		uint64_t system;
+	};
+
+	static std::map<pid_t, ThreadTime> threadTimes();
+	static void processTimes(uint64_t *user, uint64_t *system);
+
+	std::string name_;
+
+	clock::time_point startTime_;
+	clock::time_point stopTime_;
+	std::unordered_map<const libcamera::Request *, clock::time_point> queued_;
+
+	Series intervals_;
+	Series sensorIntervals_;
+	Series latencies_;
+
+	clock::time_point lastCompletion_;
+	int64_t lastSensorTimestamp_;
+	unsigned int lastSequence_;
+
+	unsigned int frames_;
+	unsigned int gaps_;
+	unsigned int dropped_;
+
+	/* CPU times, in nanoseconds. */
+	std::map<pid_t, ThreadTime> startThreadTimes_;
+	std::map<pid_t, ThreadTime> threadTimes_;
+	uint64_t startUserTime_;
+	uint64_t startSystemTime_;
+	uint64_t userTime_;
+	uint64_t systemTime_;
+};
@@ -5,17 +5,22 @@
  * File Sink
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <libcamera/camera.h>
 
 #include "../common/dng_writer.h"
+#include "../common/event_loop.h"
+#include "../common/frame_container.h"
 #include "../common/image.h"
 #include "../common/ppm_writer.h"
 
@@ -23,19 +28,139 @@
 
 using namespace libcamera;
 
+namespace {
+
+/*
+ * Writes are spread across a few threads, which is enough to keep up with fast
+ * storage without oversubscribing the CPUs.
+ */
+constexpr unsigned int kMaxWriters = 4;
+
+/* Number of frames to preallocate at once when writing to a single file. */
+constexpr unsigned int kPreallocFrames = 64;
+
+/* Alignment of the data address, length and file offset for direct I/O. */
+constexpr size_t kDirectAlignment = 4096;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * Write length bytes of data at offset. With direct I/O, the aligned part of
+ * the data is written in place, and the rest is copied to a bounce buffer and
+ * padded with zeros to the alignment. Return the number of bytes written,
+ * including the padding, or -1 with errno set.
+ */
+ssize_t writeData(int fd, const uint8_t *data, size_t length, off_t offset,
+		  bool direct)
+{
+	if (!direct)
+		return pwrite(fd, data, length, offset);
+
+	static thread_local std::unique_ptr<uint8_t, decltype(&free)> bounce(nullptr, free);
+	static thread_local size_t bounceSize = 0;
+
+	size_t head = 0;
+	if (!(reinterpret_cast<uintptr_t>(data) % kDirectAlignment))
+		head = length / kDirectAlignment * kDirectAlignment;
+
+	if (head) {
+		ssize_t ret = pwrite(fd, data, head, offset);
+
+		/*
+		 * Direct I/O can't access the memory of some dmabuf exporters,
+		 * copy the whole data to the bounce buffer in that case.
+		 */
+		if (ret < 0 && errno == EFAULT)
+			head = 0;
+		else if (ret != static_cast<ssize_t>(head))
+			return ret;
+	}
+
+	size_t tail = length - head;
+	if (!tail)
+		return head;
+
+	size_t padded = alignUp(tail, kDirectAlignment);
+	if (padded > bounceSize) {
+		bounce.reset(static_cast<uint8_t *>(aligned_alloc(kDirectAlignment, padded)));
+		if (!bounce) {
+			bounceSize = 0;
+			errno = ENOMEM;
+			return -1;
+		}
+
+		bounceSize = padded;
+	}
+
+	memcpy(bounce.get(), data + head, tail);
+	memset(bounce.get() + tail, 0, padded - tail);
+
+	ssize_t ret = pwrite(fd, bounce.get(), padded, offset + head);
+	if (ret != static_cast<ssize_t>(padded))
+		return ret;
+
+	return head + padded;
+}
+
+bool checkWrite(ssize_t written, size_t length)
+{
+	if (written < 0) {
+		std::cerr << "write error: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	if (written < static_cast<ssize_t>(length)) {
+		std::cerr << "write error: only " << written
+			  << " bytes written instead of " << length << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+} /* namespace */
+
 FileSink::FileSink([[maybe_unused]] const libcamera::Camera *camera,
 		   const std::map<const libcamera::Stream *, std::string> &streamNames,
-		   const std::string &pattern)
+		   const std::string &pattern, unsigned int queueDepth, bool direct,
+		   [[maybe_unused]] bool compress)
 	:
 #ifdef HAVE_TIFF
-	  camera_(camera),
+	  camera_(camera), compress_(compress),
 #endif
-	  streamNames_(streamNames), pattern_(pattern)
+	  streamNames_(streamNames), pattern_(pattern), queueDepth_(queueDepth),
+	  direct_(direct), fd_(-1), offset_(0), allocated_(0),
+	  pending_(0), maxPending_(0), overruns_(0), writtenCount_(0),
+	  stopping_(false)
 {
+#ifdef HAVE_TIFF
+	dng_ = pattern_.find(".dng", pattern_.size() - 4) != std::string::npos;
+#else
+	dng_ = false;
+#endif /* HAVE_TIFF */
+	ppm_ = pattern_.find(".ppm", pattern_.size() - 4) != std::string::npos;
+	frames_ = pattern_.find(".lcf", pattern_.size() - 4) != std::string::npos;
+
+	if (pattern_.empty() || pattern_.back() == '/')
+		pattern_ += "frame-#.bin";
+
+	singleFile_ = frames_ ||
+		      (!dng_ && !ppm_ && pattern_.find_first_of('#') == std::string::npos);
+
+	if (direct_)
+		alignment_ = kDirectAlignment;
+	else if (frames_)
+		alignment_ = alignof(FrameContainer::FrameHeader);
+	else
+		alignment_ = 1;
 }
 
 FileSink::~FileSink()
 {
+	stop();
 }
 
 int FileSink::configure(const libcamera::CameraConfiguration &config)
@@ -44,6 +169,10 @@ int FileSink::configure(const libcamera::CameraConfiguration &config)
 	if (ret < 0)
 		return ret;
 
+	streamIndices_.clear();
+	for (unsigned int i = 0; i < config.size(); i++)
+		streamIndices_[config.at(i).stream()] = i;
+
 	return 0;
 }
 
@@ -56,47 +185,252 @@ void FileSink::mapBuffer(FrameBuffer *buffer)
 	mappedBuffers_[buffer] = std::move(image);
 }
 
+int FileSink::start()
+{
+	if (singleFile_) {
+		fd_ = open(pattern_.c_str(), O_CREAT | O_WRONLY |
+			   (frames_ ? O_TRUNC : 0) | (direct_ ? O_DIRECT : 0),
+			   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd_ == -1) {
+			int ret = -errno;
+			std::cerr << "failed to open file " << pattern_ << ": "
+				  << strerror(-ret) << std::endl;
+			return ret;
+		}
+
+		if (frames_) {
+			int ret = writeFileHeader();
+			if (ret < 0) {
+				close(fd_);
+				fd_ = -1;
+				return ret;
+			}
+		} else {
+			/* Append the frames to the existing content of the file. */
+			offset_ = alignUp(lseek(fd_, 0, SEEK_END), alignment_);
+		}
+
+		allocated_ = offset_;
+	}
+
+	index_.clear();
+
+	pending_ = 0;
+	maxPending_ = 0;
+	overruns_ = 0;
+	writtenCount_ = 0;
+	stopping_ = false;
+	token_ = std::make_shared<int>();
+
+	unsigned int count = std::clamp(std::thread::hardware_concurrency(),
+					1U, kMaxWriters);
+	for (unsigned int i = 0; i < count; i++)
+		writers_.emplace_back(&FileSink::writerThread, this);
+
+	return 0;
+}
+
+int FileSink::stop()
+{
+	if (!token_)
+		return 0;
+
+	/* Wait for all the queued requests to be written. */
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		stopping_ = true;
+	}
+
+	cond_.notify_all();
+
+	for (std::thread &writer : writers_)
+		writer.join();
+
+	writers_.clear();
+	written_.clear();
+	token_.reset();
+
+	if (fd_ != -1) {
+		if (frames_)
+			writeIndex();
+
+		close(fd_);
+		fd_ = -1;
+	}
+
+	std::cout << "File sink: " << writtenCount_ << " requests written, "
+		  << overruns_ << " dropped with the write queue full, "
+		  << maxPending_ << " pending at most" << std::endl;
+
+	return 0;
+}
+
+/*
+ * Hand the request to the writer threads, and release it once written. When
+ * the write queue is full, the request is released right away and its frames
+ * are dropped, as stalling the capture would drop frames anyway.
+ */
 bool FileSink::processRequest(Request *request)
 {
-	for (auto [stream, buffer] : request->buffers())
-		writeBuffer(stream, buffer, request->metadata());
+	if (queueDepth_ && pending_ >= queueDepth_) {
+		overruns_++;
+		return true;
+	}
 
-	return true;
+	Job job{ request, 0, {} };
+
+	/*
+	 * Reserve the space for the frames in the single file, they can then
+	 * be written in any order.
+	 */
+	if (singleFile_) {
+		if (frames_)
+			job.metadata = FrameContainer::serializeMetadata(request->metadata());
+
+		off_t size = 0;
+		for (const auto &[stream, buffer] : request->buffers()) {
+			if (frames_)
+				index_.push_back(offset_ + size);
+			size += bufferSize(buffer, job.metadata.size());
+		}
+
+		job.offset = offset_;
+		offset_ += size;
+		preallocate(size);
+	}
+
+	pending_++;
+	maxPending_ = std::max(maxPending_, pending_);
+
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		queue_.push_back(std::move(job));
+	}
+
+	cond_.notify_one();
+
+	return false;
 }
 
-void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
-			   [[maybe_unused]] const ControlList &metadata)
+/* Compute the space taken by a frame in the single file. */
+off_t FileSink::bufferSize(FrameBuffer *buffer, size_t metadataSize) const
 {
-	std::string filename;
-	size_t pos;
-	int fd, ret = 0;
+	const Image *image = mappedBuffers_.at(buffer).get();
+	off_t size = 0;
 
-	if (!pattern_.empty())
-		filename = pattern_;
+	if (frames_)
+		size = alignUp(sizeof(FrameContainer::FrameHeader) + metadataSize,
+			       alignment_);
 
-#ifdef HAVE_TIFF
-	bool dng = filename.find(".dng", filename.size() - 4) != std::string::npos;
-#endif /* HAVE_TIFF */
-	bool ppm = filename.find(".ppm", filename.size() - 4) != std::string::npos;
+	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
+		size_t length = std::min<size_t>(buffer->metadata().planes()[i].bytesused,
+						 image->data(i).size());
+		size += alignUp(length, alignment_);
+	}
+
+	return size;
+}
+
+/*
+ * Reserve the disk space ahead of the writes to the single file, to avoid
+ * allocating blocks and fragmenting the file on every write. The file size is
+ * left unchanged.
+ */
+void FileSink::preallocate(off_t size)
+{
+	if (offset_ <= allocated_)
+		return;
+
+	size = std::max<off_t>(size * kPreallocFrames, offset_ - allocated_);
+	if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocated_, size) < 0) {
+		/* Not all file systems support preallocation. */
+		allocated_ = std::numeric_limits<off_t>::max();
+		return;
+	}
+
+	allocated_ += size;
+}
+
+void FileSink::writerThread()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cond_.wait(locker, [&] { return stopping_ || !queue_.empty(); });
+		if (queue_.empty())
+			return;
+
+		Job job = std::move(queue_.front());
+		queue_.pop_front();
+
+		locker.unlock();
+
+		for (auto [stream, buffer] : job.request->buffers()) {
+			Image *image = mappedBuffers_.at(buffer).get();
 
-	if (filename.empty() || filename.back() == '/')
-		filename += "frame-#.bin";
+			image->beginAccess();
 
-	pos = filename.find_first_of('#');
+			if (frames_)
+				writeRecord(stream, buffer, job.metadata, &job.offset);
+			else
+				writeBuffer(stream, buffer, job.request->metadata(),
+					    &job.offset);
+
+			image->endAccess();
+		}
+
+		locker.lock();
+
+		writtenCount_++;
+		written_.push_back(job.request);
+		if (written_.size() > 1)
+			continue;
+
+		std::weak_ptr<int> token = token_;
+		EventLoop::instance()->callLater([this, token]() {
+			if (!token.expired())
+				requestsWritten();
+		});
+	}
+}
+
+void FileSink::requestsWritten()
+{
+	std::vector<Request *> written;
+
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		written.swap(written_);
+	}
+
+	for (Request *request : written) {
+		pending_--;
+		requestProcessed.emit(request);
+	}
+}
+
+void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
+			   [[maybe_unused]] const ControlList &metadata,
+			   off_t *offset)
+{
+	std::string filename = pattern_;
+	int fd, ret = 0;
+
+	size_t pos = filename.find_first_of('#');
 	if (pos != std::string::npos) {
 		std::stringstream ss;
-		ss << streamNames_[stream] << "-" << std::setw(6)
+		ss << streamNames_.at(stream) << "-" << std::setw(6)
 		   << std::setfill('0') << buffer->metadata().sequence;
 		filename.replace(pos, 1, ss.str());
 	}
 
-	Image *image = mappedBuffers_[buffer].get();
+	Image *image = mappedBuffers_.at(buffer).get();
 
 #ifdef HAVE_TIFF
-	if (dng) {
+	if (dng_) {
 		ret = DNGWriter::write(filename.c_str(), camera_,
 				       stream->configuration(), metadata,
-				       buffer, image->data(0).data());
+				       buffer, image->data(0).data(), compress_);
 		if (ret < 0)
 			std::cerr << "failed to write DNG file `" << filename
 				  << "'" << std::endl;
@@ -104,7 +438,7 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 		return;
 	}
 #endif /* HAVE_TIFF */
-	if (ppm) {
+	if (ppm_) {
 		ret = PPMWriter::write(filename.c_str(), stream->configuration(),
 				       image->data(0));
 		if (ret < 0)
@@ -114,14 +448,23 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 		return;
 	}
 
-	fd = open(filename.c_str(), O_CREAT | O_WRONLY |
-		  (pos == std::string::npos ? O_APPEND : O_TRUNC),
-		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-	if (fd == -1) {
-		ret = -errno;
-		std::cerr << "failed to open file " << filename << ": "
-			  << strerror(-ret) << std::endl;
-		return;
+	off_t position = 0;
+	off_t end = 0;
+
+	if (singleFile_) {
+		fd = fd_;
+		position = *offset;
+		*offset += bufferSize(buffer, 0);
+	} else {
+		fd = open(filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC |
+			  (direct_ ? O_DIRECT : 0),
+			  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd == -1) {
+			ret = -errno;
+			std::cerr << "failed to open file " << filename << ": "
+				  << strerror(-ret) << std::endl;
+			return;
+		}
 	}
 
 	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
@@ -140,19 +483,130 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 				  << " larger than plane size " << data.size()
 				  << std::endl;
 
-		ret = ::write(fd, data.data(), length);
-		if (ret < 0) {
-			ret = -errno;
-			std::cerr << "write error: " << strerror(-ret)
-				  << std::endl;
+		ssize_t written = writeData(fd, data.data(), length, position, direct_);
+		if (!checkWrite(written, length))
 			break;
-		} else if (ret != (int)length) {
-			std::cerr << "write error: only " << ret
-				  << " bytes written instead of "
-				  << length << std::endl;
-			break;
-		}
+
+		end = position + length;
+		position = alignUp(end, alignment_);
 	}
 
+	if (singleFile_)
+		return;
+
+	/* Strip the padding of direct writes. */
+	if (direct_ && end && ftruncate(fd, end) < 0)
+		std::cerr << "failed to truncate file " << filename << ": "
+			  << strerror(errno) << std::endl;
+
 	close(fd);
 }
+
+int FileSink::writeFileHeader()
+{
+	FrameContainer::FileHeader header = {};
+
+	memcpy(header.magic, FrameContainer::kFileMagic, sizeof(header.magic));
+	header.version = FrameContainer::kVersion;
+	header.headerSize = alignUp(sizeof(header), alignment_);
+
+	ssize_t written = writeData(fd_, reinterpret_cast<const uint8_t *>(&header),
+				    sizeof(header), 0, direct_);
+	if (!checkWrite(written, sizeof(header)))
+		return -EIO;
+
+	offset_ = header.headerSize;
+
+	return 0;
+}
+
+/*
+ * Write a frame record to the frame container, with the frame description
+ * and the request metadata followed by the planes, at the offset reserved for
+ * the frame.
+ */
+void FileSink::writeRecord(const Stream *stream, FrameBuffer *buffer,
+			   const std::vector<uint8_t> &metadata, off_t *offset)
+{
+	const StreamConfiguration &cfg = stream->configuration();
+	const FrameMetadata &frameMetadata = buffer->metadata();
+	const Image *image = mappedBuffers_.at(buffer).get();
+	off_t start = *offset;
+
+	FrameContainer::FrameHeader header = {};
+	header.magic = FrameContainer::kFrameMagic;
+	header.headerSize = sizeof(header);
+	header.size = bufferSize(buffer, metadata.size());
+
+	header.stream = streamIndices_.at(stream);
+	header.sequence = frameMetadata.sequence;
+	header.timestamp = frameMetadata.timestamp;
+	header.status = frameMetadata.status;
+
+	header.fourcc = cfg.pixelFormat.fourcc();
+	header.modifier = cfg.pixelFormat.modifier();
+	header.width = cfg.size.width;
+	header.height = cfg.size.height;
+	header.stride = cfg.stride;
+	header.numPlanes = std::min<size_t>(buffer->planes().size(),
+					    FrameContainer::kMaxPlanes);
+
+	header.metadataOffset = sizeof(header);
+	header.metadataSize = metadata.size();
+
+	uint64_t position = alignUp(sizeof(header) + metadata.size(), alignment_);
+	for (unsigned int i = 0; i < header.numPlanes; i++) {
+		header.planes[i].offset = position;
+		header.planes[i].length = std::min<size_t>(frameMetadata.planes()[i].bytesused,
+							   image->data(i).size());
+		position += alignUp(header.planes[i].length, alignment_);
+	}
+
+	*offset += header.size;
+
+	std::vector<uint8_t> data(sizeof(header) + metadata.size());
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(header), metadata.data(), metadata.size());
+
+	ssize_t written = writeData(fd_, data.data(), data.size(), start, direct_);
+	if (!checkWrite(written, data.size()))
+		return;
+
+	for (unsigned int i = 0; i < header.numPlanes; i++) {
+		written = writeData(fd_, image->data(i).data(), header.planes[i].length,
+				    start + header.planes[i].offset, direct_);
+		if (!checkWrite(written, header.planes[i].length))
+			return;
+	}
+}
+
+/*
+ * Write the index of the frame container at the end of the file, after all
+ * the frames have been written.
+ */
+void FileSink::writeIndex()
+{
+	size_t count = index_.size();
+	std::vector<uint8_t> data(sizeof(FrameContainer::IndexHeader) +
+				  count * sizeof(uint64_t) +
+				  sizeof(FrameContainer::IndexTrailer));
+
+	FrameContainer::IndexHeader header = {};
+	header.count = count;
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(header), index_.data(), count * sizeof(uint64_t));
+
+	FrameContainer::IndexTrailer trailer = {};
+	trailer.offset = offset_;
+	memcpy(trailer.magic, FrameContainer::kIndexMagic, sizeof(trailer.magic));
+	memcpy(data.data() + data.size() - sizeof(trailer), &trailer, sizeof(trailer));
+
+	ssize_t written = writeData(fd_, data.data(), data.size(), offset_, direct_);
+	if (!checkWrite(written, data.size()))
+		return;
+
+	/* The trailer must end the file, drop the padding and preallocation. */
+	if (ftruncate(fd_, offset_ + data.size()) < 0)
+		std::cerr << "failed to truncate file " << pattern_ << ": "
+			  << strerror(errno) << std::endl;
+}
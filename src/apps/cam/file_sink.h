@@ -7,9 +7,16 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <stdint.h>
 #include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
 
 #include <libcamera/stream.h>
 
@@ -22,24 +29,85 @@ class FileSink : public FrameSink
 public:
 	FileSink(const libcamera::Camera *camera,
 		 const std::map<const libcamera::Stream *, std::string> &streamNames,
-		 const std::string &pattern = "");
+		 const std::string &pattern = "", unsigned int queueDepth = 0,
+		 bool direct = false, bool compress = false);
 	~FileSink();
 
 	int configure(const libcamera::CameraConfiguration &config) override;
 
 	void mapBuffer(libcamera::FrameBuffer *buffer) override;
 
+	int start() override;
+	int stop() override;
+
 	bool processRequest(libcamera::Request *request) override;
 
 private:
+	struct Job {
+		libcamera::Request *request;
+		off_t offset;
+		std::vector<uint8_t> metadata;
+	};
+
+	off_t bufferSize(libcamera::FrameBuffer *buffer, size_t metadataSize) const;
+	void preallocate(off_t size);
+
+	void writerThread();
+	void requestsWritten();
+
 	void writeBuffer(const libcamera::Stream *stream,
 			 libcamera::FrameBuffer *buffer,
-			 const libcamera::ControlList &metadata);
+			 const libcamera::ControlList &metadata,
+			 off_t *offset);
+
+	int writeFileHeader();
+	void writeRecord(const libcamera::Stream *stream,
+			 libcamera::FrameBuffer *buffer,
+			 const std::vector<uint8_t> &metadata, off_t *offset);
+	void writeIndex();
 
 #ifdef HAVE_TIFF
 	const libcamera::Camera *camera_;
+	bool compress_;
 #endif
 	std::map<const libcamera::Stream *, std::string> streamNames_;
 	std::string pattern_;
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<Image>> mappedBuffers_;
+	std::map<const libcamera::Stream *, unsigned int> streamIndices_;
+
+	unsigned int queueDepth_;
+	bool direct_;
+	bool dng_;
+	bool ppm_;
+	bool frames_;
+
+	/*
+	 * All frames are written to a single file for frame containers, or
+	 * when the pattern has no '#'.
+	 */
+	bool singleFile_;
+	size_t alignment_;
+	int fd_;
+	off_t offset_;
+	off_t allocated_;
+	std::vector<uint64_t> index_;
+
+	/* Accessed from the event loop thread only. */
+	unsigned int pending_;
+	unsigned int maxPending_;
+	unsigned int overruns_;
+
+	std::vector<std::thread> writers_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<Job> queue_;
+	std::vector<libcamera::Request *> written_;
+	unsigned int writtenCount_;
+	bool stopping_;
+
+	/*
+	 * Completions posted to the event loop hold a weak reference to the
+	 * token, and are ignored once the sink has been stopped.
+	 */
+	std::shared_ptr<int> token_;
 };
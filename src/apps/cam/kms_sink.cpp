@@ -24,7 +24,8 @@
 #include "drm.h"
 
 KMSSink::KMSSink(const std::string &connectorName)
-	: connector_(nullptr), crtc_(nullptr), plane_(nullptr), mode_(nullptr)
+	: connector_(nullptr), crtc_(nullptr), mode_(nullptr), displayed_(0),
+	  superseded_(0)
 {
 	int ret = dev_.init();
 	if (ret < 0)
@@ -66,54 +67,18 @@ KMSSink::KMSSink(const std::string &connectorName)
 	dev_.requestComplete.connect(this, &KMSSink::requestComplete);
 }
 
-void KMSSink::mapBuffer(libcamera::FrameBuffer *buffer)
-{
-	std::array<uint32_t, 4> strides = {};
-
-	/* \todo Should libcamera report per-plane strides ? */
-	unsigned int uvStrideMultiplier;
-
-	switch (format_) {
-	case libcamera::formats::NV24:
-	case libcamera::formats::NV42:
-		uvStrideMultiplier = 4;
-		break;
-	case libcamera::formats::YUV420:
-	case libcamera::formats::YVU420:
-	case libcamera::formats::YUV422:
-		uvStrideMultiplier = 1;
-		break;
-	default:
-		uvStrideMultiplier = 2;
-		break;
-	}
-
-	strides[0] = stride_;
-	for (unsigned int i = 1; i < buffer->planes().size(); ++i)
-		strides[i] = stride_ * uvStrideMultiplier / 2;
-
-	std::unique_ptr<DRM::FrameBuffer> drmBuffer =
-		dev_.createFrameBuffer(*buffer, format_, size_, strides);
-	if (!drmBuffer)
-		return;
-
-	buffers_.emplace(std::piecewise_construct,
-			 std::forward_as_tuple(buffer),
-			 std::forward_as_tuple(std::move(drmBuffer)));
-}
-
 int KMSSink::configure(const libcamera::CameraConfiguration &config)
 {
 	if (!connector_)
 		return -EINVAL;
 
 	crtc_ = nullptr;
-	plane_ = nullptr;
 	mode_ = nullptr;
+	outputs_.clear();
 
 	const libcamera::StreamConfiguration &cfg = config.at(0);
 
-	/* Find the best mode for the stream size. */
+	/* Find the best mode for the size of the first stream. */
 	const std::vector<DRM::Mode> &modes = connector_->modes();
 
 	unsigned int cfgArea = cfg.size.width * cfg.size.height;
@@ -142,19 +107,33 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 		return -EINVAL;
 	}
 
-	int ret = configurePipeline(cfg.pixelFormat);
+	int ret = configurePipeline(config);
 	if (ret < 0)
 		return ret;
 
-	size_ = cfg.size;
-	stride_ = cfg.stride;
+	for (Output &output : outputs_) {
+		for (const libcamera::StreamConfiguration &streamCfg : config) {
+			if (streamCfg.stream() != output.stream)
+				continue;
+
+			output.size = streamCfg.size;
+			output.stride = streamCfg.stride;
+			configureColorSpace(output, streamCfg);
+		}
+	}
+
+	return 0;
+}
 
-	/* Configure color space. */
-	colorEncoding_ = std::nullopt;
-	colorRange_ = std::nullopt;
+void KMSSink::configureColorSpace(Output &output,
+				  const libcamera::StreamConfiguration &cfg)
+{
+	output.colorEncoding = std::nullopt;
+	output.colorRange = std::nullopt;
 
-	if (cfg.colorSpace->ycbcrEncoding == libcamera::ColorSpace::YcbcrEncoding::None)
-		return 0;
+	if (!cfg.colorSpace ||
+	    cfg.colorSpace->ycbcrEncoding == libcamera::ColorSpace::YcbcrEncoding::None)
+		return;
 
 	/*
 	 * The encoding and range enums are defined in the kernel but not
@@ -171,8 +150,8 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 		DRM_COLOR_YCBCR_FULL_RANGE,
 	};
 
-	const DRM::Property *colorEncoding = plane_->property("COLOR_ENCODING");
-	const DRM::Property *colorRange = plane_->property("COLOR_RANGE");
+	const DRM::Property *colorEncoding = output.plane->property("COLOR_ENCODING");
+	const DRM::Property *colorRange = output.plane->property("COLOR_RANGE");
 
 	if (colorEncoding) {
 		drm_color_encoding encoding;
@@ -192,7 +171,7 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 
 		for (const auto &[id, name] : colorEncoding->enums()) {
 			if (id == encoding) {
-				colorEncoding_ = encoding;
+				output.colorEncoding = encoding;
 				break;
 			}
 		}
@@ -213,26 +192,28 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 
 		for (const auto &[id, name] : colorRange->enums()) {
 			if (id == range) {
-				colorRange_ = range;
+				output.colorRange = range;
 				break;
 			}
 		}
 	}
 
-	if (!colorEncoding_ || !colorRange_)
+	if (!output.colorEncoding || !output.colorRange)
 		std::cerr << "Color space " << cfg.colorSpace->toString()
 			  << " not supported by the display device."
 			  << " Colors may be wrong." << std::endl;
-
-	return 0;
 }
 
-int KMSSink::selectPipeline(const libcamera::PixelFormat &format)
+namespace {
+
+/*
+ * Return the format to use with plane if it supports the requested format or,
+ * for formats with an alpha channel, its X variant. Return an invalid format
+ * otherwise.
+ */
+libcamera::PixelFormat planeFormat(const DRM::Plane *plane,
+				   const libcamera::PixelFormat &format)
 {
-	/*
-	 * If the requested format has an alpha channel, also consider the X
-	 * variant.
-	 */
 	libcamera::PixelFormat xFormat;
 
 	switch (format) {
@@ -250,10 +231,24 @@ int KMSSink::selectPipeline(const libcamera::PixelFormat &format)
 		break;
 	}
 
+	if (plane->supportsFormat(format))
+		return format;
+
+	if (xFormat.isValid() && plane->supportsFormat(xFormat))
+		return xFormat;
+
+	return {};
+}
+
+} /* namespace */
+
+int KMSSink::selectPipeline(const libcamera::CameraConfiguration &config)
+{
 	/*
-	 * Find a CRTC and plane suitable for the request format and the
-	 * connector at the end of the pipeline. Restrict the search to primary
-	 * planes for now.
+	 * Find a CRTC and primary plane suitable for the format of the first
+	 * stream and the connector at the end of the pipeline. Additional
+	 * streams are displayed on overlay planes of the same CRTC, when
+	 * available.
 	 */
 	for (const DRM::Encoder *encoder : connector_->encoders()) {
 		for (const DRM::Crtc *crtc : encoder->possibleCrtcs()) {
@@ -261,52 +256,144 @@ int KMSSink::selectPipeline(const libcamera::PixelFormat &format)
 				if (plane->type() != DRM::Plane::TypePrimary)
 					continue;
 
-				if (plane->supportsFormat(format)) {
-					crtc_ = crtc;
-					plane_ = plane;
-					format_ = format;
-					return 0;
-				}
+				libcamera::PixelFormat format =
+					planeFormat(plane, config.at(0).pixelFormat);
+				if (!format.isValid())
+					continue;
+
+				Output output = {};
+				output.stream = config.at(0).stream();
+				output.plane = plane;
+				output.format = format;
 
-				if (plane->supportsFormat(xFormat)) {
-					crtc_ = crtc;
-					plane_ = plane;
-					format_ = xFormat;
-					return 0;
+				crtc_ = crtc;
+				outputs_.push_back(output);
+				break;
+			}
+
+			if (!crtc_)
+				continue;
+
+			for (unsigned int i = 1; i < config.size(); i++) {
+				const libcamera::StreamConfiguration &cfg = config.at(i);
+
+				for (const DRM::Plane *plane : crtc->planes()) {
+					if (plane->type() != DRM::Plane::TypeOverlay)
+						continue;
+
+					auto used = std::find_if(outputs_.begin(), outputs_.end(),
+								 [plane](const Output &output) {
+									 return output.plane == plane;
+								 });
+					if (used != outputs_.end())
+						continue;
+
+					libcamera::PixelFormat format =
+						planeFormat(plane, cfg.pixelFormat);
+					if (!format.isValid())
+						continue;
+
+					Output output = {};
+					output.stream = cfg.stream();
+					output.plane = plane;
+					output.format = format;
+
+					outputs_.push_back(output);
+					break;
 				}
 			}
+
+			return 0;
 		}
 	}
 
 	return -EPIPE;
 }
 
-int KMSSink::configurePipeline(const libcamera::PixelFormat &format)
+int KMSSink::configurePipeline(const libcamera::CameraConfiguration &config)
 {
-	const int ret = selectPipeline(format);
+	const int ret = selectPipeline(config);
 	if (ret) {
 		std::cerr
 			<< "Unable to find display pipeline for format "
-			<< format << std::endl;
+			<< config.at(0).pixelFormat << std::endl;
 
 		return ret;
 	}
 
+	std::cout << "Using KMS plane";
+	for (const Output &output : outputs_)
+		std::cout << " " << output.plane->id();
 	std::cout
-		<< "Using KMS plane " << plane_->id() << ", CRTC " << crtc_->id()
+		<< ", CRTC " << crtc_->id()
 		<< ", connector " << connector_->name()
 		<< " (" << connector_->id() << "), mode " << mode_->hdisplay
 		<< "x" << mode_->vdisplay << "@" << mode_->vrefresh << std::endl;
 
+	if (outputs_.size() < config.size())
+		std::cerr << "Not enough overlay planes, displaying "
+			  << outputs_.size() << " of " << config.size()
+			  << " streams" << std::endl;
+
 	return 0;
 }
 
+/*
+ * Import the camera frame buffer in DRM. The stream a buffer belongs to isn't
+ * known when buffers are mapped, so buffers are imported the first time they
+ * are displayed.
+ */
+DRM::FrameBuffer *KMSSink::frameBuffer(const Output &output,
+				       libcamera::FrameBuffer *buffer)
+{
+	auto iter = buffers_.find(buffer);
+	if (iter != buffers_.end())
+		return iter->second.get();
+
+	std::array<uint32_t, 4> strides = {};
+
+	/* \todo Should libcamera report per-plane strides ? */
+	unsigned int uvStrideMultiplier;
+
+	switch (output.format) {
+	case libcamera::formats::NV24:
+	case libcamera::formats::NV42:
+		uvStrideMultiplier = 4;
+		break;
+	case libcamera::formats::YUV420:
+	case libcamera::formats::YVU420:
+	case libcamera::formats::YUV422:
+		uvStrideMultiplier = 1;
+		break;
+	default:
+		uvStrideMultiplier = 2;
+		break;
+	}
+
+	strides[0] = output.stride;
+	for (unsigned int i = 1; i < buffer->planes().size(); ++i)
+		strides[i] = output.stride * uvStrideMultiplier / 2;
+
+	std::unique_ptr<DRM::FrameBuffer> drmBuffer =
+		dev_.createFrameBuffer(*buffer, output.format, output.size, strides);
+	if (!drmBuffer)
+		return nullptr;
+
+	DRM::FrameBuffer *fb = drmBuffer.get();
+	buffers_.emplace(buffer, std::move(drmBuffer));
+
+	return fb;
+}
+
 int KMSSink::start()
 {
 	int ret = FrameSink::start();
 	if (ret < 0)
 		return ret;
 
+	displayed_ = 0;
+	superseded_ = 0;
+
 	/* Disable all CRTCs and planes to start from a known valid state. */
 	DRM::AtomicRequest request(&dev_);
 
@@ -337,8 +424,11 @@ int KMSSink::stop()
 	request.addProperty(connector_, "CRTC_ID", 0);
 	request.addProperty(crtc_, "ACTIVE", 0);
 	request.addProperty(crtc_, "MODE_ID", 0);
-	request.addProperty(plane_, "CRTC_ID", 0);
-	request.addProperty(plane_, "FB_ID", 0);
+
+	for (const Output &output : outputs_) {
+		request.addProperty(output.plane, "CRTC_ID", 0);
+		request.addProperty(output.plane, "FB_ID", 0);
+	}
 
 	int ret = request.commit(DRM::AtomicRequest::FlagAllowModeset);
 	if (ret < 0) {
@@ -348,6 +438,9 @@ int KMSSink::stop()
 		return ret;
 	}
 
+	std::cout << "KMS: " << displayed_ << " frames displayed, "
+		  << superseded_ << " superseded" << std::endl;
+
 	/* Free all buffers. */
 	pending_.reset();
 	queued_.reset();
@@ -357,9 +450,29 @@ int KMSSink::stop()
 	return FrameSink::stop();
 }
 
-bool KMSSink::testModeSet(DRM::FrameBuffer *drmBuffer,
-			  const libcamera::Rectangle &src,
-			  const libcamera::Rectangle &dst)
+void KMSSink::addPlaneProperties(DRM::AtomicRequest *request,
+				 const Output &output,
+				 DRM::FrameBuffer *drmBuffer)
+{
+	request->addProperty(output.plane, "CRTC_ID", crtc_->id());
+	request->addProperty(output.plane, "FB_ID", drmBuffer->id());
+	request->addProperty(output.plane, "SRC_X", output.src.x << 16);
+	request->addProperty(output.plane, "SRC_Y", output.src.y << 16);
+	request->addProperty(output.plane, "SRC_W", output.src.width << 16);
+	request->addProperty(output.plane, "SRC_H", output.src.height << 16);
+	request->addProperty(output.plane, "CRTC_X", output.dst.x);
+	request->addProperty(output.plane, "CRTC_Y", output.dst.y);
+	request->addProperty(output.plane, "CRTC_W", output.dst.width);
+	request->addProperty(output.plane, "CRTC_H", output.dst.height);
+
+	if (output.colorEncoding)
+		request->addProperty(output.plane, "COLOR_ENCODING", *output.colorEncoding);
+	if (output.colorRange)
+		request->addProperty(output.plane, "COLOR_RANGE", *output.colorRange);
+}
+
+/* Test the composition of the first drmBuffers.size() outputs. */
+bool KMSSink::testModeSet(const std::vector<DRM::FrameBuffer *> &drmBuffers)
 {
 	DRM::AtomicRequest drmRequest{ &dev_ };
 
@@ -368,40 +481,32 @@ bool KMSSink::testModeSet(DRM::FrameBuffer *drmBuffer,
 	drmRequest.addProperty(crtc_, "ACTIVE", 1);
 	drmRequest.addProperty(crtc_, "MODE_ID", mode_->toBlob(&dev_));
 
-	drmRequest.addProperty(plane_, "CRTC_ID", crtc_->id());
-	drmRequest.addProperty(plane_, "FB_ID", drmBuffer->id());
-	drmRequest.addProperty(plane_, "SRC_X", src.x << 16);
-	drmRequest.addProperty(plane_, "SRC_Y", src.y << 16);
-	drmRequest.addProperty(plane_, "SRC_W", src.width << 16);
-	drmRequest.addProperty(plane_, "SRC_H", src.height << 16);
-	drmRequest.addProperty(plane_, "CRTC_X", dst.x);
-	drmRequest.addProperty(plane_, "CRTC_Y", dst.y);
-	drmRequest.addProperty(plane_, "CRTC_W", dst.width);
-	drmRequest.addProperty(plane_, "CRTC_H", dst.height);
+	for (unsigned int i = 0; i < drmBuffers.size(); i++)
+		addPlaneProperties(&drmRequest, outputs_[i], drmBuffers[i]);
 
 	return !drmRequest.commit(DRM::AtomicRequest::FlagAllowModeset |
 				  DRM::AtomicRequest::FlagTestOnly);
 }
 
-bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
+bool KMSSink::setupPrimaryComposition(DRM::FrameBuffer *drmBuffer)
 {
 	/*
 	 * Test composition options, from most to least desirable, to select the
 	 * best one.
 	 */
-	const libcamera::Rectangle framebuffer{ size_ };
+	Output &primary = outputs_[0];
+	const std::vector<DRM::FrameBuffer *> drmBuffers = { drmBuffer };
+	const libcamera::Rectangle framebuffer{ primary.size };
 	const libcamera::Rectangle display{ 0, 0, mode_->hdisplay, mode_->vdisplay };
 
 	/* 1. Scale the frame buffer to full screen, preserving aspect ratio. */
-	libcamera::Rectangle src = framebuffer;
-	libcamera::Rectangle dst = display.size().boundedToAspectRatio(framebuffer.size())
-						 .centeredTo(display.center());
+	primary.src = framebuffer;
+	primary.dst = display.size().boundedToAspectRatio(framebuffer.size())
+				    .centeredTo(display.center());
 
-	if (testModeSet(drmBuffer, src, dst)) {
+	if (testModeSet(drmBuffers)) {
 		std::cout << "KMS: full-screen scaled output, square pixels"
 			  << std::endl;
-		src_ = src;
-		dst_ = dst;
 		return true;
 	}
 
@@ -409,66 +514,104 @@ bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
 	 * 2. Scale the frame buffer to full screen, without preserving aspect
 	 *    ratio.
 	 */
-	src = framebuffer;
-	dst = display;
+	primary.src = framebuffer;
+	primary.dst = display;
 
-	if (testModeSet(drmBuffer, src, dst)) {
+	if (testModeSet(drmBuffers)) {
 		std::cout << "KMS: full-screen scaled output, non-square pixels"
 			  << std::endl;
-		src_ = src;
-		dst_ = dst;
 		return true;
 	}
 
 	/* 3. Center the frame buffer on the display. */
-	src = display.size().centeredTo(framebuffer.center()).boundedTo(framebuffer);
-	dst = framebuffer.size().centeredTo(display.center()).boundedTo(display);
+	primary.src = display.size().centeredTo(framebuffer.center()).boundedTo(framebuffer);
+	primary.dst = framebuffer.size().centeredTo(display.center()).boundedTo(display);
 
-	if (testModeSet(drmBuffer, src, dst)) {
+	if (testModeSet(drmBuffers)) {
 		std::cout << "KMS: centered output" << std::endl;
-		src_ = src;
-		dst_ = dst;
 		return true;
 	}
 
 	/* 4. Align the frame buffer on the top-left of the display. */
-	src = framebuffer.boundedTo(display);
-	dst = display.boundedTo(framebuffer);
+	primary.src = framebuffer.boundedTo(display);
+	primary.dst = display.boundedTo(framebuffer);
 
-	if (testModeSet(drmBuffer, src, dst)) {
+	if (testModeSet(drmBuffers)) {
 		std::cout << "KMS: top-left aligned output" << std::endl;
-		src_ = src;
-		dst_ = dst;
 		return true;
 	}
 
 	return false;
 }
 
-bool KMSSink::processRequest(libcamera::Request *camRequest)
+bool KMSSink::setupComposition(std::vector<DRM::FrameBuffer *> &drmBuffers)
 {
+	if (!setupPrimaryComposition(drmBuffers[0]))
+		return false;
+
 	/*
-	 * Perform a very crude rate adaptation by simply dropping the request
-	 * if the display queue is full.
+	 * Stack the other streams along the right edge of the display, scaled
+	 * to a quarter of the display size. Streams that can't be composed
+	 * that way are not displayed.
 	 */
-	if (pending_)
-		return true;
+	const libcamera::Size display{ mode_->hdisplay, mode_->vdisplay };
+	const libcamera::Size tile = display / 4;
+	unsigned int y = 0;
+
+	for (unsigned int i = 1; i < outputs_.size();) {
+		Output &output = outputs_[i];
+		const libcamera::Size size = tile.boundedToAspectRatio(output.size);
+
+		output.src = libcamera::Rectangle{ output.size };
+		output.dst = libcamera::Rectangle{
+			static_cast<int>(display.width - size.width),
+			static_cast<int>(y), size
+		};
+
+		std::vector<DRM::FrameBuffer *> buffers(drmBuffers.begin(),
+							drmBuffers.begin() + i + 1);
+		if (y + size.height <= display.height && testModeSet(buffers)) {
+			std::cout << "KMS: stream " << i << " overlay at "
+				  << output.dst << std::endl;
+			y += size.height;
+			i++;
+			continue;
+		}
 
-	libcamera::FrameBuffer *buffer = camRequest->buffers().begin()->second;
-	auto iter = buffers_.find(buffer);
-	if (iter == buffers_.end())
-		return true;
+		std::cerr << "Failed to setup composition for stream " << i
+			  << ", not displaying it" << std::endl;
+		outputs_.erase(outputs_.begin() + i);
+		drmBuffers.erase(drmBuffers.begin() + i);
+	}
+
+	return true;
+}
+
+bool KMSSink::processRequest(libcamera::Request *camRequest)
+{
+	std::vector<DRM::FrameBuffer *> drmBuffers;
 
-	DRM::FrameBuffer *drmBuffer = iter->second.get();
+	for (const Output &output : outputs_) {
+		libcamera::FrameBuffer *buffer = camRequest->findBuffer(output.stream);
+		if (!buffer)
+			return true;
+
+		DRM::FrameBuffer *drmBuffer = frameBuffer(output, buffer);
+		if (!drmBuffer)
+			return true;
+
+		drmBuffers.push_back(drmBuffer);
+	}
 
 	unsigned int flags = DRM::AtomicRequest::FlagAsync;
 	std::unique_ptr<DRM::AtomicRequest> drmRequest =
 		std::make_unique<DRM::AtomicRequest>(&dev_);
-	drmRequest->addProperty(plane_, "FB_ID", drmBuffer->id());
+
+	std::unique_lock<std::mutex> lock(lock_);
 
 	if (!active_ && !queued_) {
 		/* Enable the display pipeline on the first frame. */
-		if (!setupComposition(drmBuffer)) {
+		if (!setupComposition(drmBuffers)) {
 			std::cerr << "Failed to setup composition" << std::endl;
 			return true;
 		}
@@ -478,59 +621,82 @@ bool KMSSink::processRequest(libcamera::Request *camRequest)
 		drmRequest->addProperty(crtc_, "ACTIVE", 1);
 		drmRequest->addProperty(crtc_, "MODE_ID", mode_->toBlob(&dev_));
 
-		drmRequest->addProperty(plane_, "CRTC_ID", crtc_->id());
-		drmRequest->addProperty(plane_, "SRC_X", src_.x << 16);
-		drmRequest->addProperty(plane_, "SRC_Y", src_.y << 16);
-		drmRequest->addProperty(plane_, "SRC_W", src_.width << 16);
-		drmRequest->addProperty(plane_, "SRC_H", src_.height << 16);
-		drmRequest->addProperty(plane_, "CRTC_X", dst_.x);
-		drmRequest->addProperty(plane_, "CRTC_Y", dst_.y);
-		drmRequest->addProperty(plane_, "CRTC_W", dst_.width);
-		drmRequest->addProperty(plane_, "CRTC_H", dst_.height);
-
-		if (colorEncoding_)
-			drmRequest->addProperty(plane_, "COLOR_ENCODING", *colorEncoding_);
-		if (colorRange_)
-			drmRequest->addProperty(plane_, "COLOR_RANGE", *colorRange_);
+		for (unsigned int i = 0; i < outputs_.size(); i++)
+			addPlaneProperties(drmRequest.get(), outputs_[i], drmBuffers[i]);
 
 		flags |= DRM::AtomicRequest::FlagAllowModeset;
+	} else {
+		for (unsigned int i = 0; i < outputs_.size(); i++)
+			drmRequest->addProperty(outputs_[i].plane, "FB_ID",
+						drmBuffers[i]->id());
 	}
 
-	pending_ = std::make_unique<Request>(std::move(drmRequest), camRequest);
+	std::unique_ptr<Request> request =
+		std::make_unique<Request>(std::move(drmRequest), camRequest);
 
-	std::lock_guard<std::mutex> lock(lock_);
+	/*
+	 * If a commit is already waiting for a page flip, keep the frame as
+	 * pending, and return the frame it supersedes to the camera right
+	 * away. The camera never waits for the display.
+	 */
+	if (queued_) {
+		std::unique_ptr<Request> superseded = std::move(pending_);
+		pending_ = std::move(request);
 
-	if (!queued_) {
-		int ret = pending_->drmRequest_->commit(flags);
-		if (ret < 0) {
-			std::cerr
-				<< "Failed to commit atomic request: "
-				<< strerror(-ret) << std::endl;
-			/* \todo Implement error handling */
+		lock.unlock();
+
+		if (superseded) {
+			superseded_++;
+			requestProcessed.emit(superseded->camRequest_);
 		}
 
-		queued_ = std::move(pending_);
+		return false;
+	}
+
+	int ret = request->drmRequest_->commit(flags);
+	if (ret < 0) {
+		std::cerr
+			<< "Failed to commit atomic request: "
+			<< strerror(-ret) << std::endl;
+		return true;
 	}
 
+	queued_ = std::move(request);
+
 	return false;
 }
 
 void KMSSink::requestComplete([[maybe_unused]] DRM::AtomicRequest *request)
 {
-	std::lock_guard<std::mutex> lock(lock_);
-
-	assert(queued_ && queued_->drmRequest_.get() == request);
-
-	/* Complete the active request, if any. */
-	if (active_)
-		requestProcessed.emit(active_->camRequest_);
-
-	/* The queued request becomes active. */
-	active_ = std::move(queued_);
-
-	/* Queue the pending request, if any. */
-	if (pending_) {
-		pending_->drmRequest_->commit(DRM::AtomicRequest::FlagAsync);
-		queued_ = std::move(pending_);
+	std::unique_ptr<Request> released;
+	std::unique_ptr<Request> failed;
+
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+
+		assert(queued_ && queued_->drmRequest_.get() == request);
+
+		/* The queued request becomes active, release the previous one. */
+		released = std::move(active_);
+		active_ = std::move(queued_);
+		displayed_++;
+
+		/* Queue the pending request, if any. */
+		if (pending_) {
+			int ret = pending_->drmRequest_->commit(DRM::AtomicRequest::FlagAsync);
+			if (ret < 0) {
+				std::cerr
+					<< "Failed to commit atomic request: "
+					<< strerror(-ret) << std::endl;
+				failed = std::move(pending_);
+			} else {
+				queued_ = std::move(pending_);
+			}
+		}
 	}
+
+	if (released)
+		requestProcessed.emit(released->camRequest_);
+	if (failed)
+		requestProcessed.emit(failed->camRequest_);
 }
@@ -13,11 +13,13 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <libcamera/base/signal.h>
 
 #include <libcamera/geometry.h>
 #include <libcamera/pixel_format.h>
+#include <libcamera/stream.h>
 
 #include "drm.h"
 #include "frame_sink.h"
@@ -27,8 +29,6 @@ class KMSSink : public FrameSink
 public:
 	KMSSink(const std::string &connectorName);
 
-	void mapBuffer(libcamera::FrameBuffer *buffer) override;
-
 	int configure(const libcamera::CameraConfiguration &config) override;
 	int start() override;
 	int stop() override;
@@ -49,12 +49,34 @@ private:
 		libcamera::Request *camRequest_;
 	};
 
-	int selectPipeline(const libcamera::PixelFormat &format);
-	int configurePipeline(const libcamera::PixelFormat &format);
-	bool testModeSet(DRM::FrameBuffer *drmBuffer,
-			 const libcamera::Rectangle &src,
-			 const libcamera::Rectangle &dst);
-	bool setupComposition(DRM::FrameBuffer *drmBuffer);
+	/* A camera stream displayed on a DRM plane. */
+	struct Output {
+		const libcamera::Stream *stream;
+		const DRM::Plane *plane;
+
+		libcamera::PixelFormat format;
+		libcamera::Size size;
+		unsigned int stride;
+		std::optional<unsigned int> colorEncoding;
+		std::optional<unsigned int> colorRange;
+
+		libcamera::Rectangle src;
+		libcamera::Rectangle dst;
+	};
+
+	int selectPipeline(const libcamera::CameraConfiguration &config);
+	int configurePipeline(const libcamera::CameraConfiguration &config);
+	void configureColorSpace(Output &output,
+				 const libcamera::StreamConfiguration &cfg);
+
+	DRM::FrameBuffer *frameBuffer(const Output &output,
+				      libcamera::FrameBuffer *buffer);
+
+	void addPlaneProperties(DRM::AtomicRequest *request, const Output &output,
+				DRM::FrameBuffer *drmBuffer);
+	bool testModeSet(const std::vector<DRM::FrameBuffer *> &drmBuffers);
+	bool setupPrimaryComposition(DRM::FrameBuffer *drmBuffer);
+	bool setupComposition(std::vector<DRM::FrameBuffer *> &drmBuffers);
 
 	void requestComplete(DRM::AtomicRequest *request);
 
@@ -62,22 +84,25 @@ private:
 
 	const DRM::Connector *connector_;
 	const DRM::Crtc *crtc_;
-	const DRM::Plane *plane_;
 	const DRM::Mode *mode_;
 
-	libcamera::PixelFormat format_;
-	libcamera::Size size_;
-	unsigned int stride_;
-	std::optional<unsigned int> colorEncoding_;
-	std::optional<unsigned int> colorRange_;
-
-	libcamera::Rectangle src_;
-	libcamera::Rectangle dst_;
+	std::vector<Output> outputs_;
 
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<DRM::FrameBuffer>> buffers_;
 
+	/*
+	 * Only one commit can be queued to the CRTC at a time. The active
+	 * request is being displayed, the queued request has been committed
+	 * and waits for the page flip, and the pending request holds the
+	 * latest frame to be committed after the page flip. A new frame
+	 * supersedes the pending one, which is returned to the camera without
+	 * being displayed.
+	 */
 	std::mutex lock_;
 	std::unique_ptr<Request> pending_;
 	std::unique_ptr<Request> queued_;
 	std::unique_ptr<Request> active_;
+
+	unsigned int displayed_;
+	unsigned int superseded_;
 };
@@ -9,6 +9,7 @@
 #include <iomanip>
 #include <iostream>
 #include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <libcamera/libcamera.h>
@@ -75,6 +76,10 @@ int CamApp::init(int argc, char **argv)
 	if (ret < 0)
 		return ret;
 
+	/* Recording is configured through the environment of the library. */
+	if (options_.isSet(OptRecord))
+		setenv("LIBCAMERA_RECORD", options_[OptRecord].toString().c_str(), 1);
+
 	cm_ = std::make_unique<CameraManager>();
 
 	ret = cm_->start();
@@ -127,6 +132,14 @@ int CamApp::parseOptions(int argc, char *argv[])
 	parser.addOption(OptMonitor, OptionNone,
 			 "Monitor for hotplug and unplug camera events",
 			 "monitor");
+	parser.addOption(OptRecord, OptionString,
+			 "Record the IPA inputs of capture sessions to a directory\n"
+			 "For cameras whose pipeline handler supports recording, the IPA\n"
+			 "configuration, request controls, statistics and sensor controls of\n"
+			 "each capture session are written to a '.rec' file in the directory,\n"
+			 "which must exist. The recordings can be replayed to the IPA module\n"
+			 "with the ipa-replay benchmarks.",
+			 "record", ArgumentRequired, "directory");
 
 	/* Sub-options of OptCamera: */
 	parser.addOption(OptCapture, OptionInteger,
@@ -150,15 +163,37 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "to write files, using the default file name. Otherwise it sets the\n"
 			 "full file path and name. The first '#' character in the file name\n"
 			 "is expanded to the camera index, stream name and frame sequence number.\n"
+			 "Without a '#' character, all frames are appended to a single file.\n"
 #ifdef HAVE_TIFF
 			 "If the file name ends with '.dng', then the frame will be written to\n"
 			 "the output file(s) in DNG format.\n"
 #endif
 			 "If the file name ends with '.ppm', then the frame will be written to\n"
 			 "the output file(s) in PPM format.\n"
+			 "If the file name ends with '.lcf', then the frames of all streams will\n"
+			 "be written to a single frame container file, with the format, timestamp\n"
+			 "and metadata of each frame, and an index of the frames.\n"
 			 "The default file name is 'frame-#.bin'.",
 			 "file", ArgumentOptional, "filename", false,
 			 OptCamera);
+	parser.addOption(OptFileQueue, OptionInteger,
+			 "Limit the number of requests waiting to be written to disk\n"
+			 "Frames captured while <depth> requests are waiting are not written,\n"
+			 "and are reported as dropped when the capture stops. By default,\n"
+			 "requests wait until written.",
+			 "file-queue", ArgumentRequired, "depth", false,
+			 OptCamera);
+	parser.addOption(OptFileDirect, OptionNone,
+			 "Write frames to disk with direct I/O, bypassing the page cache\n"
+			 "The planes of the frames are padded to 4096 bytes.",
+			 "file-direct", ArgumentNone, nullptr, false,
+			 OptCamera);
+#ifdef HAVE_TIFF
+	parser.addOption(OptFileCompress, OptionNone,
+			 "Compress the frames written to DNG files with deflate",
+			 "file-compress", ArgumentNone, nullptr, false,
+			 OptCamera);
+#endif
 #ifdef HAVE_SDL
 	parser.addOption(OptSDL, OptionNone, "Display viewfinder through SDL",
 			 "sdl", ArgumentNone, "", false, OptCamera);
@@ -174,6 +209,14 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "Print the metadata for completed requests",
 			 "metadata", ArgumentNone, nullptr, false,
 			 OptCamera);
+	parser.addOption(OptBenchmark, OptionString,
+			 "Measure the capture performance instead of printing each frame\n"
+			 "At the end of the capture, print the statistics of the frame intervals,\n"
+			 "sensor timestamp intervals, request latencies, dropped frames and CPU\n"
+			 "time per thread. If a file name is given, also write the statistics\n"
+			 "to the file in JSON format, or to the standard output for '-'.",
+			 "benchmark", ArgumentOptional, "filename", false,
+			 OptCamera);
 	parser.addOption(OptCaptureScript, OptionString,
 			 "Load a capture session configuration script from a file",
 			 "script", ArgumentRequired, "script", false,
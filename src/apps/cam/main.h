@@ -24,4 +24,9 @@ enum {
 	OptStrictFormats = 257,
 	OptMetadata = 258,
 	OptCaptureScript = 259,
+	OptFileQueue = 260,
+	OptFileDirect = 261,
+	OptFileCompress = 262,
+	OptBenchmark = 263,
+	OptRecord = 264,
 };
@@ -7,6 +7,7 @@
 
 #include "sdl_sink.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <fcntl.h>
 #include <iomanip>
@@ -32,7 +33,7 @@ using namespace libcamera;
 using namespace std::chrono_literals;
 
 SDLSink::SDLSink()
-	: window_(nullptr), renderer_(nullptr), rect_({}),
+	: stride_(0), window_(nullptr), renderer_(nullptr), rect_({}),
 	  init_(false)
 {
 }
@@ -61,20 +62,21 @@ int SDLSink::configure(const libcamera::CameraConfiguration &config)
 	const libcamera::StreamConfiguration &cfg = config.at(0);
 	rect_.w = cfg.size.width;
 	rect_.h = cfg.size.height;
+	pixelFormat_ = cfg.pixelFormat;
+	stride_ = cfg.stride;
 
-	switch (cfg.pixelFormat) {
+	/*
+	 * The texture is created when starting, once SDL has been initialized
+	 * and the display size is known.
+	 */
+	switch (pixelFormat_) {
 #ifdef HAVE_LIBJPEG
 	case libcamera::formats::MJPEG:
-		texture_ = std::make_unique<SDLTextureMJPG>(rect_);
-		break;
 #endif
 #if SDL_VERSION_ATLEAST(2, 0, 16)
 	case libcamera::formats::NV12:
-		texture_ = std::make_unique<SDLTextureNV12>(rect_, cfg.stride);
-		break;
 #endif
 	case libcamera::formats::YUYV:
-		texture_ = std::make_unique<SDLTextureYUYV>(rect_, cfg.stride);
 		break;
 	default:
 		std::cerr << "Unsupported pixel format "
@@ -85,6 +87,59 @@ int SDLSink::configure(const libcamera::CameraConfiguration &config)
 	return 0;
 }
 
+int SDLSink::createTexture()
+{
+	switch (pixelFormat_) {
+#ifdef HAVE_LIBJPEG
+	case libcamera::formats::MJPEG: {
+		int scale = mjpegScale();
+		SDL_Rect rect = {};
+
+		rect.w = (rect_.w + scale - 1) / scale;
+		rect.h = (rect_.h + scale - 1) / scale;
+
+		texture_ = std::make_unique<SDLTextureMJPG>(rect, scale);
+		break;
+	}
+#endif
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+	case libcamera::formats::NV12:
+		texture_ = std::make_unique<SDLTextureNV12>(rect_, stride_);
+		break;
+#endif
+	case libcamera::formats::YUYV:
+		texture_ = std::make_unique<SDLTextureYUYV>(rect_, stride_);
+		break;
+	default:
+		return -EINVAL;
+	};
+
+	return texture_->create(renderer_);
+}
+
+/*
+ * Compute the JPEG DCT scaling factor. When the image is larger than the
+ * display, it can be decoded at a lower resolution, which is much cheaper,
+ * without affecting the displayed image quality. libjpeg supports scaling by
+ * 1/2, 1/4 and 1/8.
+ */
+unsigned int SDLSink::mjpegScale() const
+{
+	SDL_DisplayMode mode;
+
+	int display = SDL_GetWindowDisplayIndex(window_);
+	if (display < 0 || SDL_GetDesktopDisplayMode(display, &mode) ||
+	    mode.w <= 0 || mode.h <= 0)
+		return 1;
+
+	int scale = 1;
+	while (scale < 8 && rect_.w >= mode.w * scale * 2 &&
+	       rect_.h >= mode.h * scale * 2)
+		scale *= 2;
+
+	return scale;
+}
+
 int SDLSink::start()
 {
 	int ret = SDL_Init(SDL_INIT_VIDEO);
@@ -121,10 +176,9 @@ int SDLSink::start()
 		std::cerr << "Failed to set SDL render logical size: "
 			  << SDL_GetError() << std::endl;
 
-	ret = texture_->create(renderer_);
-	if (ret) {
+	ret = createTexture();
+	if (ret)
 		return ret;
-	}
 
 	/* \todo Make the event cancellable to support stop/start cycles. */
 	EventLoop::instance()->addTimerEvent(
@@ -196,6 +250,8 @@ void SDLSink::renderBuffer(FrameBuffer *buffer)
 
 	planes.reserve(buffer->metadata().planes().size());
 
+	image->beginAccess();
+
 	for (const FrameMetadata::Plane &meta : buffer->metadata().planes()) {
 		Span<uint8_t> data = image->data(i);
 		if (meta.bytesused > data.size())
@@ -203,12 +259,15 @@ void SDLSink::renderBuffer(FrameBuffer *buffer)
 				  << " larger than plane size " << data.size()
 				  << std::endl;
 
-		planes.push_back(data);
+		planes.push_back(data.first(std::min<size_t>(meta.bytesused,
+							     data.size())));
 		i++;
 	}
 
 	texture_->update(planes);
 
+	image->endAccess();
+
 	SDL_RenderClear(renderer_);
 	SDL_RenderCopy(renderer_, texture_->get(), nullptr, nullptr);
 	SDL_RenderPresent(renderer_);
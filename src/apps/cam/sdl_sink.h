@@ -10,6 +10,7 @@
 #include <map>
 #include <memory>
 
+#include <libcamera/pixel_format.h>
 #include <libcamera/stream.h>
 
 #include <SDL2/SDL.h>
@@ -33,12 +34,17 @@ public:
 	bool processRequest(libcamera::Request *request) override;
 
 private:
+	int createTexture();
+	unsigned int mjpegScale() const;
+
 	void renderBuffer(libcamera::FrameBuffer *buffer);
 	void processSDLEvents();
 
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<Image>>
 		mappedBuffers_;
 
+	libcamera::PixelFormat pixelFormat_;
+	unsigned int stride_;
 	std::unique_ptr<SDLTexture> texture_;
 
 	SDL_Window *window_;
@@ -37,47 +37,154 @@ struct JpegErrorManager : public jpeg_error_mgr {
 	jmp_buf escape_;
 };
 
-SDLTextureMJPG::SDLTextureMJPG(const SDL_Rect &rect)
-	: SDLTexture(rect, SDL_PIXELFORMAT_RGB24, rect.w * 3),
-	  rgb_(std::make_unique<unsigned char[]>(stride_ * rect.h))
+/*
+ * The decompressor is created once and reused for all frames, to avoid
+ * allocating and initializing the libjpeg state for every frame.
+ */
+class SDLTextureMJPG::Decoder
 {
-}
+public:
+	Decoder(const SDL_Rect &rect, unsigned int scale, int stride)
+		: rect_(rect), scale_(scale), stride_(stride)
+	{
+		cinfo_.err = &errorManager_;
+		jpeg_create_decompress(&cinfo_);
+	}
 
-int SDLTextureMJPG::decompress(Span<const uint8_t> data)
-{
-	struct jpeg_decompress_struct cinfo;
+	~Decoder()
+	{
+		jpeg_destroy_decompress(&cinfo_);
+	}
+
+	int decompress(Span<const uint8_t> data, unsigned char *rgb);
+
+private:
+	struct jpeg_decompress_struct cinfo_;
+	JpegErrorManager errorManager_;
 
-	JpegErrorManager errorManager;
-	if (setjmp(errorManager.escape_)) {
-		/* libjpeg found an error */
-		jpeg_destroy_decompress(&cinfo);
+	const SDL_Rect rect_;
+	const unsigned int scale_;
+	const int stride_;
+};
+
+int SDLTextureMJPG::Decoder::decompress(Span<const uint8_t> data,
+					unsigned char *rgb)
+{
+	if (setjmp(errorManager_.escape_)) {
+		/* libjpeg found an error, reset the decompressor. */
+		jpeg_abort_decompress(&cinfo_);
 		std::cerr << "JPEG decompression error" << std::endl;
 		return -EINVAL;
 	}
 
-	cinfo.err = &errorManager;
-	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo_, data.data(), data.size());
 
-	jpeg_mem_src(&cinfo, data.data(), data.size());
+	jpeg_read_header(&cinfo_, TRUE);
 
-	jpeg_read_header(&cinfo, TRUE);
+	/* Use the DCT scaling to decode a downscaled image. */
+	cinfo_.out_color_space = JCS_RGB;
+	cinfo_.scale_num = 1;
+	cinfo_.scale_denom = scale_;
 
-	jpeg_start_decompress(&cinfo);
+	jpeg_start_decompress(&cinfo_);
 
-	for (int i = 0; cinfo.output_scanline < cinfo.output_height; ++i) {
-		JSAMPROW rowptr = rgb_.get() + i * stride_;
-		jpeg_read_scanlines(&cinfo, &rowptr, 1);
+	if (cinfo_.output_width != static_cast<unsigned int>(rect_.w) ||
+	    cinfo_.output_height != static_cast<unsigned int>(rect_.h)) {
+		jpeg_abort_decompress(&cinfo_);
+		std::cerr << "Unexpected JPEG image size "
+			  << cinfo_.output_width << "x" << cinfo_.output_height
+			  << std::endl;
+		return -EINVAL;
 	}
 
-	jpeg_finish_decompress(&cinfo);
+	while (cinfo_.output_scanline < cinfo_.output_height) {
+		JSAMPROW rowptr = rgb + cinfo_.output_scanline * stride_;
+		jpeg_read_scanlines(&cinfo_, &rowptr, 1);
+	}
 
-	jpeg_destroy_decompress(&cinfo);
+	jpeg_finish_decompress(&cinfo_);
 
 	return 0;
 }
 
+/*
+ * Frames are decoded by a worker thread, to avoid blocking the event loop and
+ * delaying the requeue of requests. The compressed data is copied when the
+ * texture is updated, and the most recent frame replaces any frame that the
+ * worker hasn't started decoding yet. The texture is then updated with the
+ * most recently decoded image, which lags behind the camera by at most one
+ * frame.
+ *
+ * The image is downscaled by the scale factor when decoding, the texture size
+ * must match the scaled size.
+ */
+SDLTextureMJPG::SDLTextureMJPG(const SDL_Rect &rect, unsigned int scale)
+	: SDLTexture(rect, SDL_PIXELFORMAT_RGB24, rect.w * 3),
+	  decoder_(std::make_unique<Decoder>(rect, scale, stride_)),
+	  pendingValid_(false),
+	  rgb_(std::make_unique<unsigned char[]>(stride_ * rect.h)),
+	  rgbValid_(false), stopping_(false), skipped_(0)
+{
+	thread_ = std::thread(&SDLTextureMJPG::decodeThread, this);
+}
+
+SDLTextureMJPG::~SDLTextureMJPG()
+{
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stopping_ = true;
+	}
+
+	cond_.notify_one();
+	thread_.join();
+
+	if (skipped_)
+		std::cout << "SDL: " << skipped_
+			  << " MJPEG frames skipped by the decoder" << std::endl;
+}
+
+void SDLTextureMJPG::decodeThread()
+{
+	std::vector<uint8_t> jpeg;
+	std::unique_ptr<unsigned char[]> rgb =
+		std::make_unique<unsigned char[]>(stride_ * rect_.h);
+
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cond_.wait(locker, [&] { return stopping_ || pendingValid_; });
+		if (stopping_)
+			break;
+
+		jpeg.swap(pending_);
+		pendingValid_ = false;
+
+		locker.unlock();
+		int ret = decoder_->decompress(jpeg, rgb.get());
+		locker.lock();
+
+		if (ret < 0)
+			continue;
+
+		rgb_.swap(rgb);
+		rgbValid_ = true;
+	}
+}
+
 void SDLTextureMJPG::update(const std::vector<libcamera::Span<const uint8_t>> &data)
 {
-	decompress(data[0]);
+	std::lock_guard<std::mutex> locker(mutex_);
+
+	if (pendingValid_)
+		skipped_++;
+
+	pending_.assign(data[0].begin(), data[0].end());
+	pendingValid_ = true;
+	cond_.notify_one();
+
+	if (!rgbValid_)
+		return;
+
 	SDL_UpdateTexture(ptr_, nullptr, rgb_.get(), stride_);
+	rgbValid_ = false;
 }
@@ -7,17 +7,38 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "sdl_texture.h"
 
 class SDLTextureMJPG : public SDLTexture
 {
 public:
-	SDLTextureMJPG(const SDL_Rect &rect);
+	SDLTextureMJPG(const SDL_Rect &rect, unsigned int scale = 1);
+	~SDLTextureMJPG();
 
 	void update(const std::vector<libcamera::Span<const uint8_t>> &data) override;
 
 private:
-	int decompress(libcamera::Span<const uint8_t> data);
+	class Decoder;
+
+	void decodeThread();
+
+	std::unique_ptr<Decoder> decoder_;
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
 
+	/* Protected by mutex_ */
+	std::vector<uint8_t> pending_;
+	bool pendingValid_;
 	std::unique_ptr<unsigned char[]> rgb_;
+	bool rgbValid_;
+	bool stopping_;
+	unsigned int skipped_;
 };
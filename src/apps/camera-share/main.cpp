@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * camera-share - Share a camera with other processes
+ */
+
+#include <getopt.h>
+#include <iostream>
+#include <libgen.h>
+#include <memory>
+#include <signal.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/camera_manager.h>
+
+#include "libcamera/internal/camera_share.h"
+
+using namespace libcamera;
+
+namespace {
+
+void usage(char *argv0)
+{
+	std::cout << "Usage: " << basename(argv0) << " [options]" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Share a camera with other processes through a Unix socket." << std::endl;
+	std::cout << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "  -c, --camera <id|index>  Camera to share, defaults to the first camera" << std::endl;
+	std::cout << "  -r, --role <role>        Stream role (raw, still, video, viewfinder)," << std::endl;
+	std::cout << "                           can be repeated, defaults to viewfinder" << std::endl;
+	std::cout << "  -s, --socket <path>      Socket path, defaults to" << std::endl;
+	std::cout << "                           $XDG_RUNTIME_DIR/libcamera-share" << std::endl;
+	std::cout << "  -h, --help               Display this help message" << std::endl;
+}
+
+bool parseRole(const std::string &name, StreamRole *role)
+{
+	if (name == "raw")
+		*role = StreamRole::Raw;
+	else if (name == "still")
+		*role = StreamRole::StillCapture;
+	else if (name == "video")
+		*role = StreamRole::VideoRecording;
+	else if (name == "viewfinder")
+		*role = StreamRole::Viewfinder;
+	else
+		return false;
+
+	return true;
+}
+
+std::shared_ptr<Camera> findCamera(CameraManager &cm, const std::string &name)
+{
+	if (name.empty()) {
+		std::vector<std::shared_ptr<Camera>> cameras = cm.cameras();
+		return cameras.empty() ? nullptr : cameras.front();
+	}
+
+	std::shared_ptr<Camera> camera = cm.get(name);
+	if (camera)
+		return camera;
+
+	/* Fall back to a 1-based index, as in the cam application. */
+	char *end;
+	unsigned long index = strtoul(name.c_str(), &end, 10);
+	if (*end != '\0' || !index || index > cm.cameras().size())
+		return nullptr;
+
+	return cm.cameras()[index - 1];
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{ "camera", required_argument, nullptr, 'c' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ "role", required_argument, nullptr, 'r' },
+		{ "socket", required_argument, nullptr, 's' },
+		{},
+	};
+
+	std::string cameraName;
+	std::string path;
+	std::vector<StreamRole> roles;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "c:hr:s:", options, nullptr)) != -1) {
+		StreamRole role;
+
+		switch (opt) {
+		case 'c':
+			cameraName = optarg;
+			break;
+		case 'r':
+			if (!parseRole(optarg, &role)) {
+				std::cerr << "Unknown stream role " << optarg << std::endl;
+				return EXIT_FAILURE;
+			}
+			roles.push_back(role);
+			break;
+		case 's':
+			path = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (roles.empty())
+		roles.push_back(StreamRole::Viewfinder);
+
+	if (path.empty()) {
+		const char *runtime = getenv("XDG_RUNTIME_DIR");
+		path = std::string(runtime ? runtime : "/tmp") + "/libcamera-share";
+	}
+
+	/*
+	 * Block the termination signals before any thread is created, and
+	 * handle them in the event loop.
+	 */
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+	UniqueFD sigfd(signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC));
+	if (!sigfd.isValid()) {
+		std::cerr << "Failed to create signalfd" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	CameraManager cm;
+	int ret = cm.start();
+	if (ret) {
+		std::cerr << "Failed to start camera manager: " << ret << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::shared_ptr<Camera> camera = findCamera(cm, cameraName);
+	if (!camera) {
+		std::cerr << "Camera not found" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (camera->acquire()) {
+		std::cerr << "Failed to acquire camera " << camera->id() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::unique_ptr<CameraConfiguration> config = camera->generateConfiguration(roles);
+	if (!config || config->validate() == CameraConfiguration::Invalid ||
+	    camera->configure(config.get())) {
+		std::cerr << "Failed to configure camera" << std::endl;
+		camera->release();
+		return EXIT_FAILURE;
+	}
+
+	for (const StreamConfiguration &cfg : *config)
+		std::cout << "Stream " << cfg.toString() << std::endl;
+
+	bool quit = false;
+	EventNotifier notifier(sigfd.get(), EventNotifier::Read);
+	notifier.activated.connect(&notifier, [&]() {
+		struct signalfd_siginfo info;
+		if (read(sigfd.get(), &info, sizeof(info)) == sizeof(info))
+			quit = true;
+	});
+
+	{
+		CameraShareServer server(camera);
+
+		ret = server.start(path, config.get());
+		if (ret) {
+			std::cerr << "Failed to share camera: " << ret << std::endl;
+			camera->release();
+			return EXIT_FAILURE;
+		}
+
+		std::cout << "Sharing " << camera->id() << " on " << path << std::endl;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		while (!quit)
+			dispatcher->processEvents();
+
+		server.stop();
+	}
+
+	camera->release();
+
+	return EXIT_SUCCESS;
+}
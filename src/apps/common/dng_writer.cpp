@@ -8,12 +8,18 @@
 #include "dng_writer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <endian.h>
 #include <iostream>
 #include <map>
+#include <string.h>
+#include <thread>
 #include <vector>
 
 #include <tiffio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include <libcamera/control_ids.h>
 #include <libcamera/formats.h>
@@ -130,6 +136,36 @@ struct Matrix3d {
 
 namespace {
 
+/* Maximum number of threads used to pack and compress the RAW image. */
+constexpr unsigned int kMaxThreads = 4;
+
+/* Approximate size of the RAW image strips. */
+constexpr unsigned int kStripSize = 1024 * 1024;
+
+/*
+ * Split the [0, count[ range in contiguous chunks, and call func(begin, end)
+ * for each chunk from a separate thread.
+ */
+template<typename Func>
+void parallelFor(unsigned int count, Func func)
+{
+	unsigned int threads = std::clamp(std::thread::hardware_concurrency(),
+					  1U, kMaxThreads);
+	threads = std::max(std::min(threads, count), 1U);
+
+	std::vector<std::thread> workers;
+	unsigned int begin = 0;
+
+	for (unsigned int i = 0; i < threads; i++) {
+		unsigned int end = static_cast<uint64_t>(count) * (i + 1) / threads;
+		workers.emplace_back(func, begin, end);
+		begin = end;
+	}
+
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
 void packScanlineRaw8(void *output, const void *input, unsigned int width)
 {
 	const uint8_t *in = static_cast<const uint8_t *>(input);
@@ -517,16 +553,247 @@ const std::map<PixelFormat, FormatInfo> formatInfo = {
 	} },
 };
 
+/*
+ * Decompression of the Raspberry Pi PiSP compressed Bayer formats. Each block
+ * of 8 pixels is stored in two little-endian 32-bit words, the first one
+ * holding the 4 even pixels and the second one the 4 odd pixels. Each word
+ * stores a 2-bit quantisation mode and 4 quantised samples computed relative
+ * to each other. The compression offset is subtracted by the hardware before
+ * compression, and needs to be added back.
+ */
+constexpr uint32_t kPiSPDefaultCompressionOffset = 2048;
+
+uint16_t dequantizePiSP(int q, unsigned int qmode)
+{
+	int value;
+
+	switch (qmode) {
+	case 0:
+		value = q < 320 ? 16 * q : 32 * (q - 160);
+		break;
+	case 1:
+		value = 64 * q;
+		break;
+	case 2:
+		value = 128 * q;
+		break;
+	default:
+		value = q < 94 ? 256 * q
+		      : q < 133 ? 512 * (q - 47)
+		      : q < 165 ? 1024 * (q - 90)
+		      : 2048 * (q - 124);
+		break;
+	}
+
+	return std::clamp(value, 0, 0xffff);
+}
+
+void uncompressSubBlockPiSP(uint16_t *output, uint32_t w)
+{
+	unsigned int qmode = w & 3;
+	int q[4];
+
+	if (qmode < 3) {
+		int field0 = (w >> 2) & 511;
+		int field1 = (w >> 11) & 127;
+		int field2 = (w >> 18) & 127;
+		int field3 = (w >> 25) & 127;
+
+		if (qmode == 2 && field0 >= 384) {
+			q[1] = field0;
+			q[2] = field1 + 384;
+		} else {
+			q[1] = field1 >= 64 ? field0 : field0 + 64 - field1;
+			q[2] = field0 + field1 - 64;
+		}
+
+		q[0] = q[1] + field2 - 64;
+		q[3] = q[2] + field3 - 64;
+	} else {
+		int pack0 = (w >> 2) & 32767;
+		int pack1 = (w >> 17) & 32767;
+
+		q[0] = (pack0 & 15) + 16 * ((pack0 >> 8) / 11);
+		q[1] = ((pack0 >> 4) & 15) + 16 * ((pack0 >> 8) % 11);
+		q[2] = (pack1 & 15) + 16 * ((pack1 >> 8) / 11);
+		q[3] = ((pack1 >> 4) & 15) + 16 * ((pack1 >> 8) % 11);
+	}
+
+	for (unsigned int i = 0; i < 4; i++)
+		output[i * 2] = dequantizePiSP(q[i], qmode);
+}
+
+void uncompressScanlinePiSP(uint16_t *output, const uint8_t *input,
+			    unsigned int width, uint32_t offset)
+{
+	for (unsigned int x = 0; x < width; x += 8, input += 8) {
+		uint16_t block[8];
+
+		uncompressSubBlockPiSP(&block[0], le32toh(*reinterpret_cast<const uint32_t *>(input)));
+		uncompressSubBlockPiSP(&block[1], le32toh(*reinterpret_cast<const uint32_t *>(input + 4)));
+
+		for (unsigned int i = 0; i < 8 && x + i < width; i++)
+			output[x + i] = std::min<uint32_t>(block[i] + offset, 0xffff);
+	}
+}
+
+/* Map the compressed formats to the format they decompress to. */
+const std::map<PixelFormat, PixelFormat> compressedFormats = {
+	{ formats::BGGR_PISP_COMP1, formats::SBGGR16 },
+	{ formats::GBRG_PISP_COMP1, formats::SGBRG16 },
+	{ formats::GRBG_PISP_COMP1, formats::SGRBG16 },
+	{ formats::RGGB_PISP_COMP1, formats::SRGGB16 },
+};
+
+/*
+ * Write the RAW image in strips of kStripSize bytes. The scanlines are packed
+ * to a buffer from multiple threads, and with compression enabled, the strips
+ * are compressed in parallel as well when zlib is available.
+ */
+int writeRawStrips(TIFF *tif, const FormatInfo &info,
+		   const StreamConfiguration &config, const void *data,
+		   [[maybe_unused]] bool compress)
+{
+	const unsigned int width = config.size.width;
+	const unsigned int height = config.size.height;
+	const size_t rowSize = (width * info.bitsPerSample + 7) / 8;
+	const unsigned int rowsPerStrip =
+		std::clamp<size_t>(kStripSize / rowSize, 1, height);
+	const unsigned int strips = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+
+	std::vector<uint8_t> image(rowSize * height);
+	const uint8_t *input = static_cast<const uint8_t *>(data);
+
+	parallelFor(height, [&](unsigned int begin, unsigned int end) {
+		/*
+		 * The pack functions may write past the end of the scanline
+		 * when the width isn't a multiple of the pixel group size. Pack
+		 * the last line of the chunk to a scratch buffer, to avoid
+		 * racing with the thread packing the next line.
+		 */
+		std::vector<uint8_t> scanline(rowSize + 16);
+
+		for (unsigned int y = begin; y < end; y++) {
+			const uint8_t *row = input + static_cast<size_t>(y) * config.stride;
+			uint8_t *out = image.data() + y * rowSize;
+
+			if (y == end - 1) {
+				info.packScanline(scanline.data(), row, width);
+				memcpy(out, scanline.data(), rowSize);
+			} else {
+				info.packScanline(out, row, width);
+			}
+		}
+	});
+
+	auto stripData = [&](unsigned int strip) {
+		return image.data() + static_cast<size_t>(strip) * rowsPerStrip * rowSize;
+	};
+	auto stripSize = [&](unsigned int strip) {
+		unsigned int rows = std::min(rowsPerStrip, height - strip * rowsPerStrip);
+		return rows * rowSize;
+	};
+
+#ifdef HAVE_ZLIB
+	if (compress) {
+		std::vector<std::vector<uint8_t>> compressed(strips);
+		std::atomic<bool> failed = false;
+
+		parallelFor(strips, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int strip = begin; strip < end; strip++) {
+				uLongf size = compressBound(stripSize(strip));
+				compressed[strip].resize(size);
+
+				int ret = compress2(compressed[strip].data(), &size,
+						    stripData(strip), stripSize(strip),
+						    Z_DEFAULT_COMPRESSION);
+				if (ret != Z_OK)
+					failed = true;
+
+				compressed[strip].resize(size);
+			}
+		});
+
+		if (failed) {
+			std::cerr << "Failed to compress RAW image" << std::endl;
+			return -EINVAL;
+		}
+
+		for (unsigned int strip = 0; strip < strips; strip++) {
+			if (TIFFWriteRawStrip(tif, strip, compressed[strip].data(),
+					      compressed[strip].size()) < 0) {
+				std::cerr << "Failed to write RAW strip" << std::endl;
+				return -EINVAL;
+			}
+		}
+
+		return 0;
+	}
+#endif
+
+	for (unsigned int strip = 0; strip < strips; strip++) {
+		if (TIFFWriteEncodedStrip(tif, strip, stripData(strip),
+					  stripSize(strip)) < 0) {
+			std::cerr << "Failed to write RAW strip" << std::endl;
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
 } /* namespace */
 
 int DNGWriter::write(const char *filename, const Camera *camera,
 		     const StreamConfiguration &config,
 		     const ControlList &metadata,
 		     [[maybe_unused]] const FrameBuffer *buffer,
-		     const void *data)
+		     const void *data, bool compress)
 {
 	const ControlList &cameraProperties = camera->properties();
 
+	/*
+	 * Decompress the compressed formats to 16-bit samples, and write them
+	 * as such.
+	 */
+	const auto comp = compressedFormats.find(config.pixelFormat);
+	if (comp != compressedFormats.cend()) {
+		uint32_t offset = kPiSPDefaultCompressionOffset;
+
+#ifdef LIBCAMERA_HAS_RPI_VENDOR_CONTROLS
+		const auto &mode = metadata.get(controls::rpi::PispRawCompressionMode);
+		if (mode && *mode != controls::rpi::PispRawCompressionMode1) {
+			std::cerr << "Unsupported compression mode " << *mode
+				  << std::endl;
+			return -EINVAL;
+		}
+
+		const auto &compOffset = metadata.get(controls::rpi::PispRawCompressionOffset);
+		if (compOffset)
+			offset = *compOffset;
+#endif
+
+		StreamConfiguration unpacked = config;
+		unpacked.pixelFormat = comp->second;
+		unpacked.stride = config.size.width * 2;
+
+		const unsigned int width = config.size.width;
+		std::vector<uint16_t> image(static_cast<size_t>(width) * config.size.height);
+		const uint8_t *input = static_cast<const uint8_t *>(data);
+
+		parallelFor(config.size.height, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int y = begin; y < end; y++)
+				uncompressScanlinePiSP(image.data() + static_cast<size_t>(y) * width,
+						       input + static_cast<size_t>(y) * config.stride,
+						       width, offset);
+		});
+
+		return write(filename, camera, unpacked, metadata, buffer,
+			     image.data(), compress);
+	}
+
 	const auto it = formatInfo.find(config.pixelFormat);
 	if (it == formatInfo.cend()) {
 		std::cerr << "Unsupported pixel format" << std::endl;
@@ -540,12 +807,8 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 		return -EINVAL;
 	}
 
-	/*
-	 * Scanline buffer, has to be large enough to store both a RAW scanline
-	 * or a thumbnail scanline. The latter will always be much smaller than
-	 * the former as we downscale by 16 in both directions.
-	 */
-	std::vector<uint8_t> scanline((config.size.width * info->bitsPerSample + 7) / 8);
+	/* Scanline buffer for the thumbnail, downscaled by 16 to RGB888. */
+	std::vector<uint8_t> scanline(config.size.width / 16 * 3);
 
 	toff_t rawIFDOffset = 0;
 	toff_t exifIFDOffset = 0;
@@ -689,7 +952,8 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, config.size.width);
 	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, config.size.height);
 	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, info->bitsPerSample);
-	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+	TIFFSetField(tif, TIFFTAG_COMPRESSION,
+		     compress ? COMPRESSION_ADOBE_DEFLATE : COMPRESSION_NONE);
 	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
 	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
 	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
@@ -746,18 +1010,10 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
 
 	/* Write RAW content. */
-	row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height; y++) {
-		info->packScanline(scanline.data(), row, config.size.width);
-
-		if (TIFFWriteScanline(tif, scanline.data(), y, 0) != 1) {
-			std::cerr << "Failed to write RAW scanline"
-				  << std::endl;
-			TIFFClose(tif);
-			return -EINVAL;
-		}
-
-		row += config.stride;
+	int ret = writeRawStrips(tif, *info, config, data, compress);
+	if (ret < 0) {
+		TIFFClose(tif);
+		return ret;
 	}
 
 	/* Checkpoint the IFD to retrieve its offset, and write it out. */
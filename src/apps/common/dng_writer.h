@@ -21,7 +21,8 @@ public:
 	static int write(const char *filename, const libcamera::Camera *camera,
 			 const libcamera::StreamConfiguration &config,
 			 const libcamera::ControlList &metadata,
-			 const libcamera::FrameBuffer *buffer, const void *data);
+			 const libcamera::FrameBuffer *buffer, const void *data,
+			 bool compress = false);
 };
 
 #endif /* HAVE_TIFF */
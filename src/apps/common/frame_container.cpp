@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Frame container file format
+ */
+
+#include "frame_container.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libcamera/control_ids.h>
+
+using namespace libcamera;
+
+namespace FrameContainer {
+
+namespace {
+
+/* Metadata entries are stored back to back, aligned to 8 bytes. */
+struct MetadataEntry {
+	uint32_t id;
+	uint8_t type;
+	uint8_t isArray;
+	uint16_t reserved;
+	uint32_t numElements;
+	uint32_t size;
+};
+
+size_t alignEntry(size_t size)
+{
+	return (size + 7) & ~static_cast<size_t>(7);
+}
+
+} /* namespace */
+
+std::vector<uint8_t> serializeMetadata(const ControlList &metadata)
+{
+	std::vector<uint8_t> data;
+
+	for (const auto &[id, value] : metadata) {
+		Span<const uint8_t> bytes = value.data();
+		size_t offset = data.size();
+
+		data.resize(offset + alignEntry(sizeof(MetadataEntry) + bytes.size()));
+
+		MetadataEntry entry = {};
+		entry.id = id;
+		entry.type = value.type();
+		entry.isArray = value.isArray();
+		entry.numElements = value.numElements();
+		entry.size = bytes.size();
+
+		memcpy(data.data() + offset, &entry, sizeof(entry));
+		memcpy(data.data() + offset + sizeof(entry), bytes.data(), bytes.size());
+	}
+
+	return data;
+}
+
+ControlList deserializeMetadata(Span<const uint8_t> data)
+{
+	ControlList metadata(controls::controls);
+
+	while (data.size() >= sizeof(MetadataEntry)) {
+		MetadataEntry entry;
+		memcpy(&entry, data.data(), sizeof(entry));
+
+		size_t size = alignEntry(sizeof(entry) + entry.size);
+		if (sizeof(entry) + entry.size > data.size())
+			break;
+
+		ControlValue value;
+		value.reserve(static_cast<ControlType>(entry.type), entry.isArray,
+			      entry.numElements);
+
+		Span<uint8_t> bytes = value.data();
+		if (bytes.size() == entry.size) {
+			memcpy(bytes.data(), data.data() + sizeof(entry), entry.size);
+			metadata.set(entry.id, value);
+		}
+
+		data = data.subspan(std::min(size, data.size()));
+	}
+
+	return metadata;
+}
+
+} /* namespace FrameContainer */
+
+using namespace FrameContainer;
+
+/*
+ * Read frames from a frame container. The file is mapped in memory, and frames
+ * are located through the index, or by walking the records if the file has no
+ * valid index. Only the frames with a complete record are reported.
+ */
+FrameContainerReader::FrameContainerReader()
+	: data_(nullptr), size_(0)
+{
+}
+
+FrameContainerReader::~FrameContainerReader()
+{
+	close();
+}
+
+int FrameContainerReader::open(const std::string &filename)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		int ret = -errno;
+		std::cerr << "Failed to open " << filename << ": "
+			  << strerror(-ret) << std::endl;
+		return ret;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+		::close(fd);
+		std::cerr << "Invalid frame container " << filename << std::endl;
+		return -EINVAL;
+	}
+
+	void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		int ret = -errno;
+		std::cerr << "Failed to map " << filename << ": "
+			  << strerror(-ret) << std::endl;
+		return ret;
+	}
+
+	data_ = static_cast<const uint8_t *>(map);
+	size_ = st.st_size;
+
+	const FileHeader *fileHeader = reinterpret_cast<const FileHeader *>(data_);
+	if (memcmp(fileHeader->magic, kFileMagic, sizeof(kFileMagic)) ||
+	    fileHeader->version != kVersion ||
+	    fileHeader->headerSize < sizeof(FileHeader) ||
+	    fileHeader->headerSize > size_) {
+		std::cerr << "Invalid frame container " << filename << std::endl;
+		close();
+		return -EINVAL;
+	}
+
+	if (readIndex() < 0)
+		scan();
+
+	return 0;
+}
+
+void FrameContainerReader::close()
+{
+	if (data_)
+		munmap(const_cast<uint8_t *>(data_), size_);
+
+	data_ = nullptr;
+	size_ = 0;
+	offsets_.clear();
+}
+
+const FrameHeader *FrameContainerReader::header(size_t index) const
+{
+	if (index >= offsets_.size())
+		return nullptr;
+
+	return reinterpret_cast<const FrameHeader *>(data_ + offsets_[index]);
+}
+
+Span<const uint8_t> FrameContainerReader::plane(size_t index, unsigned int plane) const
+{
+	const FrameHeader *frame = header(index);
+	if (!frame || plane >= frame->numPlanes)
+		return {};
+
+	const uint8_t *record = data_ + offsets_[index];
+	return { record + frame->planes[plane].offset, frame->planes[plane].length };
+}
+
+ControlList FrameContainerReader::metadata(size_t index) const
+{
+	const FrameHeader *frame = header(index);
+	if (!frame)
+		return ControlList(controls::controls);
+
+	const uint8_t *record = data_ + offsets_[index];
+	return deserializeMetadata({ record + frame->metadataOffset, frame->metadataSize });
+}
+
+bool FrameContainerReader::validRecord(uint64_t offset) const
+{
+	if (offset % alignof(FrameHeader) || offset > size_ ||
+	    size_ - offset < sizeof(FrameHeader))
+		return false;
+
+	const FrameHeader *frame = reinterpret_cast<const FrameHeader *>(data_ + offset);
+	if (frame->magic != kFrameMagic || frame->headerSize < sizeof(FrameHeader) ||
+	    frame->size < frame->headerSize || frame->size > size_ - offset ||
+	    frame->numPlanes > kMaxPlanes)
+		return false;
+
+	if (static_cast<uint64_t>(frame->metadataOffset) + frame->metadataSize > frame->size)
+		return false;
+
+	for (unsigned int i = 0; i < frame->numPlanes; i++) {
+		if (frame->planes[i].offset > frame->size ||
+		    frame->planes[i].length > frame->size - frame->planes[i].offset)
+			return false;
+	}
+
+	return true;
+}
+
+int FrameContainerReader::readIndex()
+{
+	if (size_ < sizeof(IndexTrailer))
+		return -ENOENT;
+
+	const IndexTrailer *trailer =
+		reinterpret_cast<const IndexTrailer *>(data_ + size_ - sizeof(IndexTrailer));
+	if (memcmp(trailer->magic, kIndexMagic, sizeof(kIndexMagic)) ||
+	    trailer->offset % alignof(IndexHeader) ||
+	    trailer->offset > size_ - sizeof(IndexTrailer) - sizeof(IndexHeader))
+		return -ENOENT;
+
+	const IndexHeader *index =
+		reinterpret_cast<const IndexHeader *>(data_ + trailer->offset);
+	size_t available = size_ - sizeof(IndexTrailer) - trailer->offset -
+			   sizeof(IndexHeader);
+	if (index->count > available / sizeof(uint64_t))
+		return -EINVAL;
+
+	const uint64_t *offsets = reinterpret_cast<const uint64_t *>(index + 1);
+	for (uint64_t i = 0; i < index->count; i++) {
+		if (!validRecord(offsets[i])) {
+			offsets_.clear();
+			return -EINVAL;
+		}
+
+		offsets_.push_back(offsets[i]);
+	}
+
+	return 0;
+}
+
+void FrameContainerReader::scan()
+{
+	const FileHeader *fileHeader = reinterpret_cast<const FileHeader *>(data_);
+	uint64_t offset = fileHeader->headerSize;
+
+	/*
+	 * Records are stored back to back. Writers may leave gaps of zeros for
+	 * frames that haven't been written, skip them.
+	 */
+	while (offset < size_) {
+		if (!validRecord(offset)) {
+			offset += alignof(FrameHeader);
+			continue;
+		}
+
+		offsets_.push_back(offset);
+		offset += reinterpret_cast<const FrameHeader *>(data_ + offset)->size;
+	}
+}
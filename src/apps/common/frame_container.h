@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Frame container file format
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/span.h>
+
+#include <libcamera/controls.h>
+
+/*
+ * A frame container stores the frames of all the streams of a capture in a
+ * single file. The file starts with a FileHeader, followed by one record per
+ * frame, and ends with an optional index written when the capture stops:
+ *
+ *   FileHeader
+ *   FrameHeader, metadata, plane data	(repeated for each frame)
+ *   IndexHeader, uint64_t offsets[]
+ *   IndexTrailer
+ *
+ * Offsets in the FrameHeader are relative to the start of the record, and the
+ * record size includes any padding. Values are stored in the host byte order.
+ * Files without an index, such as captures that haven't been stopped cleanly,
+ * can be read by walking the records.
+ */
+namespace FrameContainer {
+
+constexpr char kFileMagic[8] = { 'L', 'C', 'F', 'R', 'A', 'M', 'E', 'S' };
+constexpr char kIndexMagic[8] = { 'L', 'C', 'F', 'I', 'N', 'D', 'E', 'X' };
+constexpr uint32_t kFrameMagic = 0x4d415246; /* "FRAM" */
+constexpr uint32_t kVersion = 1;
+constexpr unsigned int kMaxPlanes = 4;
+
+struct FileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+};
+
+struct FrameHeader {
+	uint32_t magic;
+	uint32_t headerSize;
+	uint64_t size;
+
+	uint32_t stream;
+	uint32_t sequence;
+	uint64_t timestamp;
+	uint32_t status;
+
+	uint32_t fourcc;
+	uint64_t modifier;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t numPlanes;
+
+	uint32_t metadataOffset;
+	uint32_t metadataSize;
+
+	struct {
+		uint64_t offset;
+		uint64_t length;
+	} planes[kMaxPlanes];
+};
+
+struct IndexHeader {
+	uint64_t count;
+};
+
+struct IndexTrailer {
+	uint64_t offset;
+	char magic[8];
+};
+
+std::vector<uint8_t> serializeMetadata(const libcamera::ControlList &metadata);
+libcamera::ControlList deserializeMetadata(libcamera::Span<const uint8_t> data);
+
+} /* namespace FrameContainer */
+
+class FrameContainerReader
+{
+public:
+	FrameContainerReader();
+	~FrameContainerReader();
+
+	int open(const std::string &filename);
+	void close();
+
+	size_t count() const { return offsets_.size(); }
+
+	const FrameContainer::FrameHeader *header(size_t index) const;
+	libcamera::Span<const uint8_t> plane(size_t index, unsigned int plane) const;
+	libcamera::ControlList metadata(size_t index) const;
+
+private:
+	LIBCAMERA_DISABLE_COPY(FrameContainerReader)
+
+	bool validRecord(uint64_t offset) const;
+	int readIndex();
+	void scan();
+
+	const uint8_t *data_;
+	size_t size_;
+	std::vector<uint64_t> offsets_;
+};
@@ -12,9 +12,12 @@
 #include <iostream>
 #include <map>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <linux/dma-buf.h>
+
 using namespace libcamera;
 
 std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode mode)
@@ -25,11 +28,15 @@ std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode
 
 	int mmapFlags = 0;
 
-	if (mode & MapMode::ReadOnly)
+	if (mode & MapMode::ReadOnly) {
 		mmapFlags |= PROT_READ;
+		image->syncFlags_ |= DMA_BUF_SYNC_READ;
+	}
 
-	if (mode & MapMode::WriteOnly)
+	if (mode & MapMode::WriteOnly) {
 		mmapFlags |= PROT_WRITE;
+		image->syncFlags_ |= DMA_BUF_SYNC_WRITE;
+	}
 
 	struct MappedBufferInfo {
 		uint8_t *address = nullptr;
@@ -74,6 +81,7 @@ std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode
 			}
 
 			info.address = static_cast<uint8_t *>(address);
+			image->fds_.push_back(fd);
 			image->maps_.emplace_back(info.address, info.mapLength);
 		}
 
@@ -83,7 +91,10 @@ std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode
 	return image;
 }
 
-Image::Image() = default;
+Image::Image()
+	: syncFlags_(0)
+{
+}
 
 Image::~Image()
 {
@@ -107,3 +118,32 @@ Span<const uint8_t> Image::data(unsigned int plane) const
 	assert(plane <= planes_.size());
 	return planes_[plane];
 }
+
+/*
+ * Images are typically mapped once and reused for every frame captured in the
+ * buffer. Buffers may be allocated from cached memory, CPU access to the pixel
+ * data shall then be bracketed with beginAccess() and endAccess() calls for
+ * every frame, to synchronize the CPU caches with the device. The file
+ * descriptors are borrowed from the frame buffer, which must outlive the image.
+ */
+void Image::beginAccess() const
+{
+	sync(DMA_BUF_SYNC_START | syncFlags_);
+}
+
+void Image::endAccess() const
+{
+	sync(DMA_BUF_SYNC_END | syncFlags_);
+}
+
+void Image::sync(uint64_t flags) const
+{
+	struct dma_buf_sync sync = { flags };
+
+	for (int fd : fds_) {
+		/* Not all mappable file descriptors are dmabufs, ignore ENOTTY. */
+		if (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0 && errno != ENOTTY)
+			std::cerr << "Failed to sync dmabuf: " << strerror(errno)
+				  << std::endl;
+	}
+}
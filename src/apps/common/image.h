@@ -36,11 +36,18 @@ public:
 	libcamera::Span<uint8_t> data(unsigned int plane);
 	libcamera::Span<const uint8_t> data(unsigned int plane) const;
 
+	void beginAccess() const;
+	void endAccess() const;
+
 private:
 	LIBCAMERA_DISABLE_COPY(Image)
 
 	Image();
 
+	void sync(uint64_t flags) const;
+
+	uint64_t syncFlags_;
+	std::vector<int> fds_;
 	std::vector<libcamera::Span<uint8_t>> maps_;
 	std::vector<libcamera::Span<uint8_t>> planes_;
 };
@@ -9,19 +9,37 @@
 
 #include <libcamera/libcamera.h>
 
+/* Pass/fail thresholds for the performance tests. */
+struct PerformanceLimits {
+	/* Minimum frame rate, in percent of the expected frame rate. */
+	unsigned int minFrameRate = 95;
+	/* Maximum frame interval jitter, in percent of the frame interval. */
+	unsigned int maxJitter = 10;
+	/*
+	 * Maximum 99th percentile request latency in milliseconds, 0 to derive
+	 * it from the number of requests in flight and the frame interval.
+	 */
+	unsigned int maxLatency = 0;
+	/* Maximum number of dropped frames. */
+	unsigned int maxDropped = 0;
+};
+
 class Environment
 {
 public:
 	static Environment *get();
 
 	void setup(libcamera::CameraManager *cm, std::string cameraId);
+	void setPerformanceLimits(const PerformanceLimits &limits);
 
 	const std::string &cameraId() const { return cameraId_; }
 	libcamera::CameraManager *cm() const { return cm_; }
+	const PerformanceLimits &performanceLimits() const { return performanceLimits_; }
 
 private:
 	Environment() = default;
 
 	std::string cameraId_;
 	libcamera::CameraManager *cm_;
+	PerformanceLimits performanceLimits_;
 };
@@ -7,6 +7,10 @@
 
 #include "capture.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits.h>
+
 #include <gtest/gtest.h>
 
 using namespace libcamera;
@@ -24,7 +28,12 @@ Capture::~Capture()
 
 void Capture::configure(StreamRole role)
 {
-	config_ = camera_->generateConfiguration({ role });
+	configure(Span<const StreamRole>(&role, 1));
+}
+
+void Capture::configure(Span<const StreamRole> roles)
+{
+	config_ = camera_->generateConfiguration(roles);
 
 	if (!config_) {
 		std::cout << "Role not supported by camera" << std::endl;
@@ -33,6 +42,14 @@ void Capture::configure(StreamRole role)
 
 	if (config_->validate() != CameraConfiguration::Valid) {
 		config_.reset();
+
+		/* Not all cameras support all stream combinations. */
+		if (roles.size() > 1) {
+			std::cout << "Stream combination not supported by camera"
+				  << std::endl;
+			GTEST_SKIP();
+		}
+
 		FAIL() << "Configuration not valid";
 	}
 
@@ -42,17 +59,18 @@ void Capture::configure(StreamRole role)
 	}
 }
 
-void Capture::start()
+void Capture::start(const ControlList *controls)
 {
-	Stream *stream = config_->at(0).stream();
-	int count = allocator_->allocate(stream);
+	for (const StreamConfiguration &cfg : *config_) {
+		int count = allocator_->allocate(cfg.stream());
 
-	ASSERT_GE(count, 0) << "Failed to allocate buffers";
-	EXPECT_EQ(count, config_->at(0).bufferCount) << "Allocated less buffers than expected";
+		ASSERT_GE(count, 0) << "Failed to allocate buffers";
+		EXPECT_EQ(count, cfg.bufferCount) << "Allocated less buffers than expected";
+	}
 
 	camera_->requestCompleted.connect(this, &Capture::requestComplete);
 
-	ASSERT_EQ(camera_->start(), 0) << "Failed to start camera";
+	ASSERT_EQ(camera_->start(controls), 0) << "Failed to start camera";
 }
 
 void Capture::stop()
@@ -64,9 +82,9 @@ void Capture::stop()
 
 	camera_->requestCompleted.disconnect(this);
 
-	Stream *stream = config_->at(0).stream();
 	requests_.clear();
-	allocator_->free(stream);
+	for (const StreamConfiguration &cfg : *config_)
+		allocator_->free(cfg.stream());
 }
 
 /* CaptureBalanced */
@@ -194,3 +212,182 @@ void CaptureUnbalanced::requestComplete(Request *request)
 	if (camera_->queueRequest(request))
 		loop_->exit(-EINVAL);
 }
+
+/* CapturePerformance */
+
+CapturePerformance::CapturePerformance(std::shared_ptr<Camera> camera)
+	: Capture(camera), expectedInterval_(0)
+{
+}
+
+/*
+ * Capture numFrames frames, after numWarmupFrames frames that are ignored to
+ * let the pipeline settle. The camera runs at the shortest frame duration it
+ * supports, when it reports the FrameDurationLimits control.
+ */
+void CapturePerformance::capture(unsigned int numFrames, unsigned int numWarmupFrames)
+{
+	ControlList controls(controls::controls);
+
+	expectedInterval_ = 0;
+
+	const auto it = camera_->controls().find(&controls::FrameDurationLimits);
+	if (it != camera_->controls().end()) {
+		const ControlValue &min = it->second.min();
+
+		if (min.type() == ControlTypeInteger64 && !min.isArray()) {
+			int64_t duration = min.get<int64_t>();
+
+			controls.set(controls::FrameDurationLimits, { duration, duration });
+			expectedInterval_ = duration * 1000;
+		}
+	}
+
+	start(&controls);
+
+	/* Use as many requests as the stream with the least buffers allows. */
+	unsigned int numRequests = UINT_MAX;
+	for (const StreamConfiguration &cfg : *config_)
+		numRequests = std::min<unsigned int>(numRequests,
+						     allocator_->buffers(cfg.stream()).size());
+
+	queueCount_ = 0;
+	captureCount_ = 0;
+	warmupCount_ = numWarmupFrames;
+	captureLimit_ = numFrames + numWarmupFrames;
+
+	samples_.clear();
+	samples_.reserve(numFrames);
+	queueTimes_.assign(numRequests, {});
+
+	loop_ = new EventLoop();
+
+	for (unsigned int i = 0; i < numRequests; i++) {
+		std::unique_ptr<Request> request = camera_->createRequest(i);
+		ASSERT_TRUE(request) << "Can't create request";
+
+		for (const StreamConfiguration &cfg : *config_) {
+			Stream *stream = cfg.stream();
+			FrameBuffer *buffer = allocator_->buffers(stream)[i].get();
+
+			ASSERT_EQ(request->addBuffer(stream, buffer), 0)
+				<< "Can't set buffer for request";
+		}
+
+		requests_.push_back(std::move(request));
+	}
+
+	for (std::unique_ptr<Request> &request : requests_)
+		ASSERT_EQ(queueRequest(request.get()), 0) << "Failed to queue request";
+
+	/* Run capture session. */
+	loop_->exec();
+	stop();
+	delete loop_;
+
+	ASSERT_EQ(captureCount_, captureLimit_);
+}
+
+/*
+ * Compute the capture statistics. Frame intervals are normalized by the
+ * difference of sequence numbers, so that dropped frames are reported in the
+ * dropped count and not as jitter.
+ */
+CapturePerformance::Results CapturePerformance::results() const
+{
+	Results results = {};
+
+	results.frames = samples_.size();
+	results.requests = queueTimes_.size();
+	results.expectedInterval = expectedInterval_;
+
+	std::vector<double> intervals;
+
+	for (unsigned int i = 1; i < samples_.size(); i++) {
+		const Sample &prev = samples_[i - 1];
+		const Sample &cur = samples_[i];
+		unsigned int delta = cur.sequence - prev.sequence;
+
+		if (!delta)
+			continue;
+
+		results.dropped += delta - 1;
+		intervals.push_back(static_cast<double>(cur.timestamp - prev.timestamp) / delta);
+	}
+
+	if (samples_.size() > 1)
+		results.meanInterval = static_cast<double>(samples_.back().timestamp -
+							   samples_.front().timestamp) /
+				       (samples_.size() - 1);
+
+	if (!intervals.empty()) {
+		double mean = 0.0;
+		for (double interval : intervals)
+			mean += interval;
+		mean /= intervals.size();
+
+		double variance = 0.0;
+		for (double interval : intervals)
+			variance += (interval - mean) * (interval - mean);
+		variance /= intervals.size();
+
+		results.jitter = std::sqrt(variance);
+	}
+
+	for (const Sample &sample : samples_)
+		results.latencies.push_back(sample.latency);
+
+	std::sort(results.latencies.begin(), results.latencies.end());
+
+	return results;
+}
+
+int CapturePerformance::queueRequest(Request *request)
+{
+	queueCount_++;
+	if (queueCount_ > captureLimit_)
+		return 0;
+
+	queueTimes_[request->cookie()] = std::chrono::steady_clock::now();
+
+	return camera_->queueRequest(request);
+}
+
+void CapturePerformance::requestComplete(Request *request)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	EXPECT_EQ(request->status(), Request::Status::RequestComplete)
+		<< "Request didn't complete successfully";
+
+	if (captureCount_++ >= warmupCount_) {
+		const FrameMetadata &metadata = request->buffers().begin()->second->metadata();
+		Sample sample;
+
+		sample.timestamp = request->metadata().get(controls::SensorTimestamp)
+					   .value_or(metadata.timestamp);
+		sample.sequence = metadata.sequence;
+		sample.latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			now - queueTimes_[request->cookie()]).count();
+
+		samples_.push_back(sample);
+	}
+
+	if (captureCount_ >= captureLimit_) {
+		loop_->exit(0);
+		return;
+	}
+
+	request->reuse(Request::ReuseBuffers);
+	if (queueRequest(request))
+		loop_->exit(-EINVAL);
+}
+
+uint64_t CapturePerformance::Results::latency(double percentile) const
+{
+	if (latencies.empty())
+		return 0;
+
+	size_t index = std::lround(percentile / 100 * (latencies.size() - 1));
+	return latencies[std::min(index, latencies.size() - 1)];
+}
@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <stdint.h>
+#include <vector>
 
 #include <libcamera/libcamera.h>
 
@@ -17,12 +20,13 @@ class Capture
 {
 public:
 	void configure(libcamera::StreamRole role);
+	void configure(libcamera::Span<const libcamera::StreamRole> roles);
 
 protected:
 	Capture(std::shared_ptr<libcamera::Camera> camera);
 	virtual ~Capture();
 
-	void start();
+	void start(const libcamera::ControlList *controls = nullptr);
 	void stop();
 
 	virtual void requestComplete(libcamera::Request *request) = 0;
@@ -64,3 +68,48 @@ private:
 	unsigned int captureCount_;
 	unsigned int captureLimit_;
 };
+
+class CapturePerformance : public Capture
+{
+public:
+	struct Results {
+		unsigned int frames;
+		unsigned int requests;
+		unsigned int dropped;
+
+		/* Frame intervals, in nanoseconds. */
+		uint64_t expectedInterval;
+		double meanInterval;
+		double jitter;
+
+		/* Queue to completion latencies, sorted, in nanoseconds. */
+		std::vector<uint64_t> latencies;
+
+		uint64_t latency(double percentile) const;
+	};
+
+	CapturePerformance(std::shared_ptr<libcamera::Camera> camera);
+
+	void capture(unsigned int numFrames, unsigned int numWarmupFrames);
+
+	Results results() const;
+
+private:
+	struct Sample {
+		uint64_t timestamp;
+		unsigned int sequence;
+		uint64_t latency;
+	};
+
+	int queueRequest(libcamera::Request *request);
+	void requestComplete(libcamera::Request *request) override;
+
+	uint64_t expectedInterval_;
+	std::vector<std::chrono::steady_clock::time_point> queueTimes_;
+	std::vector<Sample> samples_;
+
+	unsigned int queueCount_;
+	unsigned int captureCount_;
+	unsigned int captureLimit_;
+	unsigned int warmupCount_;
+};
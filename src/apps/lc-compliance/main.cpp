@@ -25,6 +25,10 @@ enum {
 	OptList = 'l',
 	OptFilter = 'f',
 	OptHelp = 'h',
+	OptPerfMinFrameRate = 256,
+	OptPerfMaxJitter = 257,
+	OptPerfMaxLatency = 258,
+	OptPerfMaxDropped = 259,
 };
 
 /*
@@ -75,6 +79,18 @@ static int initCamera(CameraManager *cm, OptionsParser::Options options)
 
 	Environment::get()->setup(cm, cameraId);
 
+	PerformanceLimits limits;
+	if (options.isSet(OptPerfMinFrameRate))
+		limits.minFrameRate = options[OptPerfMinFrameRate].toInteger();
+	if (options.isSet(OptPerfMaxJitter))
+		limits.maxJitter = options[OptPerfMaxJitter].toInteger();
+	if (options.isSet(OptPerfMaxLatency))
+		limits.maxLatency = options[OptPerfMaxLatency].toInteger();
+	if (options.isSet(OptPerfMaxDropped))
+		limits.maxDropped = options[OptPerfMaxDropped].toInteger();
+
+	Environment::get()->setPerformanceLimits(limits);
+
 	std::cout << "Using camera " << cameraId << std::endl;
 
 	return 0;
@@ -148,6 +164,22 @@ static int parseOptions(int argc, char **argv, OptionsParser::Options *options)
 			 ArgumentRequired, "filter");
 	parser.addOption(OptHelp, OptionNone, "Display this help message",
 			 "help");
+	parser.addOption(OptPerfMinFrameRate, OptionInteger,
+			 "Minimum frame rate for the performance tests, in percent of the\n"
+			 "frame rate requested through FrameDurationLimits (default 95)",
+			 "perf-min-fps", ArgumentRequired, "percent");
+	parser.addOption(OptPerfMaxJitter, OptionInteger,
+			 "Maximum frame interval jitter for the performance tests, in\n"
+			 "percent of the frame interval (default 10)",
+			 "perf-max-jitter", ArgumentRequired, "percent");
+	parser.addOption(OptPerfMaxLatency, OptionInteger,
+			 "Maximum 99th percentile request latency for the performance\n"
+			 "tests, in milliseconds (default derived from the frame interval)",
+			 "perf-max-latency", ArgumentRequired, "ms");
+	parser.addOption(OptPerfMaxDropped, OptionInteger,
+			 "Maximum number of dropped frames for the performance tests\n"
+			 "(default 0)",
+			 "perf-max-drops", ArgumentRequired, "count");
 
 	*options = parser.parse(argc, argv);
 	if (!options->valid())
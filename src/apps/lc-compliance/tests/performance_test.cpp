@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Test camera capture performance
+ */
+
+#include "capture.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "environment.h"
+
+using namespace libcamera;
+
+namespace {
+
+constexpr unsigned int kNumFrames = 120;
+constexpr unsigned int kNumWarmupFrames = 10;
+
+const std::vector<std::vector<StreamRole>> ROLES = {
+	{ StreamRole::Raw },
+	{ StreamRole::StillCapture },
+	{ StreamRole::VideoRecording },
+	{ StreamRole::Viewfinder },
+	{ StreamRole::Viewfinder, StreamRole::StillCapture },
+	{ StreamRole::Viewfinder, StreamRole::VideoRecording },
+	{ StreamRole::Raw, StreamRole::Viewfinder },
+};
+
+} /* namespace */
+
+class Performance : public testing::TestWithParam<std::vector<StreamRole>>
+{
+public:
+	static std::string nameParameters(const testing::TestParamInfo<Performance::ParamType> &info);
+
+protected:
+	void SetUp() override;
+	void TearDown() override;
+
+	std::shared_ptr<Camera> camera_;
+};
+
+void Performance::SetUp()
+{
+	Environment *env = Environment::get();
+
+	camera_ = env->cm()->get(env->cameraId());
+
+	ASSERT_EQ(camera_->acquire(), 0);
+}
+
+void Performance::TearDown()
+{
+	if (!camera_)
+		return;
+
+	camera_->release();
+	camera_.reset();
+}
+
+std::string Performance::nameParameters(const testing::TestParamInfo<Performance::ParamType> &info)
+{
+	std::map<StreamRole, std::string> rolesMap = {
+		{ StreamRole::Raw, "Raw" },
+		{ StreamRole::StillCapture, "StillCapture" },
+		{ StreamRole::VideoRecording, "VideoRecording" },
+		{ StreamRole::Viewfinder, "Viewfinder" }
+	};
+
+	std::string name;
+	for (StreamRole role : info.param) {
+		if (!name.empty())
+			name += "_";
+		name += rolesMap[role];
+	}
+
+	return name;
+}
+
+/*
+ * Test sustained capture performance
+ *
+ * Captures frames at the shortest frame duration supported by the camera, and
+ * checks the frame rate, the frame interval jitter, the number of dropped
+ * frames and the request latency against the limits set on the command line.
+ * Example failure is a pipeline handler that can't keep up with the sensor
+ * frame rate, or that holds on to requests for longer than necessary.
+ */
+TEST_P(Performance, Capture)
+{
+	const PerformanceLimits &limits = Environment::get()->performanceLimits();
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(GetParam());
+
+	capture.capture(kNumFrames, kNumWarmupFrames);
+
+	CapturePerformance::Results results = capture.results();
+	ASSERT_GE(results.frames, 2U) << "Not enough frames captured";
+
+	/*
+	 * Use the mean interval as a reference when the camera doesn't report
+	 * the frame duration, the frame rate can't be checked in that case.
+	 */
+	double interval = results.expectedInterval ? results.expectedInterval
+						   : results.meanInterval;
+	double frameRate = 1e9 / results.meanInterval;
+
+	uint64_t maxLatency = limits.maxLatency
+			    ? limits.maxLatency * 1000000ULL
+			    : static_cast<uint64_t>((results.requests + 2) * interval);
+
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(2)
+	       << "frames: " << results.frames
+	       << ", dropped: " << results.dropped
+	       << ", fps: " << frameRate;
+	if (results.expectedInterval)
+		report << " (expected " << 1e9 / results.expectedInterval << ")";
+	report << ", jitter: " << results.jitter / 1000 << " us"
+	       << ", latency p50/p90/p99/max: "
+	       << results.latency(50) / 1000 << "/"
+	       << results.latency(90) / 1000 << "/"
+	       << results.latency(99) / 1000 << "/"
+	       << results.latency(100) / 1000 << " us";
+
+	std::cout << report.str() << std::endl;
+
+	RecordProperty("frames", results.frames);
+	RecordProperty("dropped", results.dropped);
+	RecordProperty("fps", std::to_string(frameRate));
+	RecordProperty("jitter_us", std::to_string(results.jitter / 1000));
+	RecordProperty("latency_p50_us", results.latency(50) / 1000);
+	RecordProperty("latency_p99_us", results.latency(99) / 1000);
+
+	EXPECT_LE(results.dropped, limits.maxDropped)
+		<< "Too many dropped frames";
+
+	if (results.expectedInterval) {
+		EXPECT_GE(frameRate, 1e9 / results.expectedInterval * limits.minFrameRate / 100)
+			<< "Frame rate too low";
+	}
+
+	EXPECT_LE(results.jitter, interval * limits.maxJitter / 100)
+		<< "Frame interval jitter too high";
+
+	EXPECT_LE(results.latency(99), maxLatency)
+		<< "Request latency too high";
+}
+
+INSTANTIATE_TEST_SUITE_P(PerformanceTests,
+			 Performance,
+			 testing::ValuesIn(ROLES),
+			 Performance::nameParameters);
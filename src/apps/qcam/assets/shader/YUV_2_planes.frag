@@ -9,6 +9,14 @@
 precision mediump float;
 #endif
 
+/*
+ * The second component of the UV plane is stored in alpha when uploaded as a
+ * luminance-alpha texture, and in green when imported as a GR88 image.
+ */
+#ifndef TEX_UV_SECOND
+#define TEX_UV_SECOND a
+#endif
+
 varying vec2 textureOut;
 uniform sampler2D tex_y;
 uniform sampler2D tex_u;
@@ -28,9 +36,9 @@ void main(void)
 	yuv.x = texture2D(tex_y, textureOut).r;
 #if defined(YUV_PATTERN_UV)
 	yuv.y = texture2D(tex_u, textureOut).r;
-	yuv.z = texture2D(tex_u, textureOut).a;
+	yuv.z = texture2D(tex_u, textureOut).TEX_UV_SECOND;
 #elif defined(YUV_PATTERN_VU)
-	yuv.y = texture2D(tex_u, textureOut).a;
+	yuv.y = texture2D(tex_u, textureOut).TEX_UV_SECOND;
 	yuv.z = texture2D(tex_u, textureOut).r;
 #else
 #error Invalid pattern
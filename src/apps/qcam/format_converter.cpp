@@ -7,8 +7,12 @@
 
 #include "format_converter.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <stdint.h>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include <QImage>
 
@@ -30,6 +34,18 @@
 #define CLIP(x)			CLAMP(x,0,255)
 #endif
 
+/*
+ * SSE2 and NEON are available on all x86_64 and aarch64 CPUs, no runtime
+ * detection is needed.
+ */
+#if __x86_64__
+#define FORMAT_CONVERTER_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif __aarch64__
+#define FORMAT_CONVERTER_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
 int FormatConverter::configure(const libcamera::PixelFormat &format,
 			       const QSize &size, unsigned int stride)
 {
@@ -212,148 +228,283 @@ static void yuv_to_rgb(int y, int u, int v, int *r, int *g, int *b)
 	*b = CLIP(( 298 * c + 516 * d           + 128) >> RGBSHIFT);
 }
 
+namespace {
+
+/* Maximum number of threads used to convert an image. */
+constexpr unsigned int kMaxThreads = 4;
+
+/* Minimum number of lines converted by each thread. */
+constexpr unsigned int kMinLinesPerThread = 32;
+
+/*
+ * Split the [0, count[ lines range in contiguous chunks, and call
+ * func(begin, end) for each chunk from a separate thread. Small images are
+ * converted in the calling thread.
+ */
+template<typename Func>
+void parallelFor(unsigned int count, Func func)
+{
+	unsigned int threads = std::clamp(std::thread::hardware_concurrency(),
+					  1U, kMaxThreads);
+	threads = std::max(std::min(threads, count / kMinLinesPerThread), 1U);
+
+	if (threads == 1) {
+		func(0, count);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	unsigned int begin = 0;
+
+	for (unsigned int i = 0; i < threads; i++) {
+		unsigned int end = static_cast<uint64_t>(count) * (i + 1) / threads;
+		workers.emplace_back(func, begin, end);
+		begin = end;
+	}
+
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+/*
+ * Convert a line of pixels from YUV to XRGB8888, with one chroma sample per
+ * pixel. The vectorized code computes the same values as yuv_to_rgb(), 8 pixels
+ * at a time, with the remaining pixels converted by the scalar code.
+ */
+void yuvToRgbLine(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
+		  uint8_t *dst, unsigned int width)
+{
+	unsigned int x = 0;
+
+#if FORMAT_CONVERTER_SIMD_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+	const __m128i offsetY = _mm_set1_epi16(16);
+	const __m128i offsetC = _mm_set1_epi16(128);
+	const __m128i rounding = _mm_set1_epi32(128);
+
+	/* Coefficients pairs, multiplied and summed by _mm_madd_epi16(). */
+	const __m128i coeffRCE = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+	const __m128i coeffGCD = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+	const __m128i coeffGE = _mm_setr_epi16(-208, 128, -208, 128, -208, 128, -208, 128);
+	const __m128i coeffBCD = _mm_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516);
+
+	for (; x + 8 <= width; x += 8) {
+		const __m128i y = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(srcY + x));
+		const __m128i u = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(srcU + x));
+		const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(srcV + x));
+
+		const __m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(y, zero), offsetY);
+		const __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(u, zero), offsetC);
+		const __m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), offsetC);
+
+		const __m128i ceLo = _mm_unpacklo_epi16(c, e);
+		const __m128i ceHi = _mm_unpackhi_epi16(c, e);
+		const __m128i cdLo = _mm_unpacklo_epi16(c, d);
+		const __m128i cdHi = _mm_unpackhi_epi16(c, d);
+		const __m128i e1Lo = _mm_unpacklo_epi16(e, one);
+		const __m128i e1Hi = _mm_unpackhi_epi16(e, one);
+
+		__m128i rLo = _mm_add_epi32(_mm_madd_epi16(ceLo, coeffRCE), rounding);
+		__m128i rHi = _mm_add_epi32(_mm_madd_epi16(ceHi, coeffRCE), rounding);
+		__m128i gLo = _mm_add_epi32(_mm_madd_epi16(cdLo, coeffGCD),
+					    _mm_madd_epi16(e1Lo, coeffGE));
+		__m128i gHi = _mm_add_epi32(_mm_madd_epi16(cdHi, coeffGCD),
+					    _mm_madd_epi16(e1Hi, coeffGE));
+		__m128i bLo = _mm_add_epi32(_mm_madd_epi16(cdLo, coeffBCD), rounding);
+		__m128i bHi = _mm_add_epi32(_mm_madd_epi16(cdHi, coeffBCD), rounding);
+
+		/* Shift, and saturate to [0, 255] when packing to bytes. */
+		__m128i r = _mm_packs_epi32(_mm_srai_epi32(rLo, RGBSHIFT),
+					    _mm_srai_epi32(rHi, RGBSHIFT));
+		__m128i g = _mm_packs_epi32(_mm_srai_epi32(gLo, RGBSHIFT),
+					    _mm_srai_epi32(gHi, RGBSHIFT));
+		__m128i b = _mm_packs_epi32(_mm_srai_epi32(bLo, RGBSHIFT),
+					    _mm_srai_epi32(bHi, RGBSHIFT));
+
+		r = _mm_packus_epi16(r, r);
+		g = _mm_packus_epi16(g, g);
+		b = _mm_packus_epi16(b, b);
+
+		const __m128i bg = _mm_unpacklo_epi8(b, g);
+		const __m128i ra = _mm_unpacklo_epi8(r, alpha);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+				 _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4 + 16),
+				 _mm_unpackhi_epi16(bg, ra));
+	}
+#elif FORMAT_CONVERTER_SIMD_NEON
+	const int16x8_t offsetY = vdupq_n_s16(16);
+	const int16x8_t offsetC = vdupq_n_s16(128);
+
+	for (; x + 8 <= width; x += 8) {
+		const int16x8_t c = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(srcY + x))),
+					      offsetY);
+		const int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(srcU + x))),
+					      offsetC);
+		const int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(srcV + x))),
+					      offsetC);
+
+		const int16x4_t cLo = vget_low_s16(c);
+		const int16x4_t cHi = vget_high_s16(c);
+		const int16x4_t dLo = vget_low_s16(d);
+		const int16x4_t dHi = vget_high_s16(d);
+		const int16x4_t eLo = vget_low_s16(e);
+		const int16x4_t eHi = vget_high_s16(e);
+
+		const int32x4_t yLo = vmull_n_s16(cLo, 298);
+		const int32x4_t yHi = vmull_n_s16(cHi, 298);
+
+		int32x4_t rLo = vmlal_n_s16(yLo, eLo, 409);
+		int32x4_t rHi = vmlal_n_s16(yHi, eHi, 409);
+		int32x4_t gLo = vmlal_n_s16(vmlal_n_s16(yLo, dLo, -100), eLo, -208);
+		int32x4_t gHi = vmlal_n_s16(vmlal_n_s16(yHi, dHi, -100), eHi, -208);
+		int32x4_t bLo = vmlal_n_s16(yLo, dLo, 516);
+		int32x4_t bHi = vmlal_n_s16(yHi, dHi, 516);
+
+		/*
+		 * Round and shift, and saturate to [0, 255] when narrowing to
+		 * bytes.
+		 */
+		uint8x8x4_t bgra;
+		bgra.val[0] = vqmovun_s16(vcombine_s16(vrshrn_n_s32(bLo, RGBSHIFT),
+						       vrshrn_n_s32(bHi, RGBSHIFT)));
+		bgra.val[1] = vqmovun_s16(vcombine_s16(vrshrn_n_s32(gLo, RGBSHIFT),
+						       vrshrn_n_s32(gHi, RGBSHIFT)));
+		bgra.val[2] = vqmovun_s16(vcombine_s16(vrshrn_n_s32(rLo, RGBSHIFT),
+						       vrshrn_n_s32(rHi, RGBSHIFT)));
+		bgra.val[3] = vdup_n_u8(0xff);
+
+		vst4_u8(dst + x * 4, bgra);
+	}
+#endif
+
+	for (; x < width; x++) {
+		int r, g, b;
+
+		yuv_to_rgb(srcY[x], srcU[x], srcV[x], &r, &g, &b);
+		dst[x * 4 + 0] = b;
+		dst[x * 4 + 1] = g;
+		dst[x * 4 + 2] = r;
+		dst[x * 4 + 3] = 0xff;
+	}
+}
+
+} /* namespace */
+
 void FormatConverter::convertRGB(const Image *srcImage, unsigned char *dst)
 {
 	const unsigned char *src = srcImage->data(0).data();
-	unsigned int x, y;
-	int r, g, b;
-
-	for (y = 0; y < height_; y++) {
-		for (x = 0; x < width_; x++) {
-			r = src[bpp_ * x + r_pos_];
-			g = src[bpp_ * x + g_pos_];
-			b = src[bpp_ * x + b_pos_];
-
-			dst[4 * x + 0] = b;
-			dst[4 * x + 1] = g;
-			dst[4 * x + 2] = r;
-			dst[4 * x + 3] = 0xff;
-		}
 
-		src += stride_;
-		dst += width_ * 4;
-	}
+	parallelFor(height_, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int y = begin; y < end; y++) {
+			const unsigned char *line = src + y * stride_;
+			unsigned char *out = dst + y * width_ * 4;
+
+			for (unsigned int x = 0; x < width_; x++) {
+				out[4 * x + 0] = line[bpp_ * x + b_pos_];
+				out[4 * x + 1] = line[bpp_ * x + g_pos_];
+				out[4 * x + 2] = line[bpp_ * x + r_pos_];
+				out[4 * x + 3] = 0xff;
+			}
+		}
+	});
 }
 
+/*
+ * The YUV formats are converted line by line. The luma and chroma samples of
+ * each line are first gathered in separate buffers, with one chroma sample per
+ * pixel, and then converted by the vectorized yuvToRgbLine(). Lines are split
+ * between multiple threads.
+ */
 void FormatConverter::convertYUVPacked(const Image *srcImage, unsigned char *dst)
 {
 	const unsigned char *src = srcImage->data(0).data();
-	unsigned int src_x, src_y, dst_x, dst_y;
-	unsigned int src_stride;
-	unsigned int dst_stride;
-	unsigned int cr_pos;
-	int r, g, b, y, cr, cb;
-
-	cr_pos = (cb_pos_ + 2) % 4;
-	src_stride = stride_;
-	dst_stride = width_ * 4;
-
-	for (src_y = 0, dst_y = 0; dst_y < height_; src_y++, dst_y++) {
-		for (src_x = 0, dst_x = 0; dst_x < width_; ) {
-			cb = src[src_y * src_stride + src_x * 4 + cb_pos_];
-			cr = src[src_y * src_stride + src_x * 4 + cr_pos];
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_ + 2];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			src_x++;
+	unsigned int cr_pos = (cb_pos_ + 2) % 4;
+	/* Round the buffers size up, the loop below converts pixels in pairs. */
+	unsigned int lineWidth = (width_ + 1) & ~1U;
+
+	parallelFor(height_, [&](unsigned int begin, unsigned int end) {
+		std::vector<uint8_t> buffer(lineWidth * 3);
+		uint8_t *line_y = buffer.data();
+		uint8_t *line_cb = line_y + lineWidth;
+		uint8_t *line_cr = line_cb + lineWidth;
+
+		for (unsigned int y = begin; y < end; y++) {
+			const unsigned char *line = src + y * stride_;
+
+			for (unsigned int x = 0; x < width_; x += 2) {
+				const unsigned char *pixels = line + x * 2;
+
+				line_y[x] = pixels[y_pos_];
+				line_y[x + 1] = pixels[y_pos_ + 2];
+				line_cb[x] = line_cb[x + 1] = pixels[cb_pos_];
+				line_cr[x] = line_cr[x + 1] = pixels[cr_pos];
+			}
+
+			yuvToRgbLine(line_y, line_cb, line_cr,
+				     dst + y * width_ * 4, width_);
 		}
-	}
+	});
 }
 
 void FormatConverter::convertYUVPlanar(const Image *srcImage, unsigned char *dst)
 {
 	unsigned int c_stride = stride_ / horzSubSample_;
-	unsigned int c_inc = horzSubSample_ == 1 ? 1 : 0;
+	unsigned int c_shift = horzSubSample_ == 2 ? 1 : 0;
 	const unsigned char *src_y = srcImage->data(0).data();
 	const unsigned char *src_cb = srcImage->data(1).data();
 	const unsigned char *src_cr = srcImage->data(2).data();
-	int r, g, b;
 
 	if (nvSwap_)
 		std::swap(src_cb, src_cr);
 
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *line_y = src_y + y * stride_;
-		const unsigned char *line_cb = src_cb + (y / vertSubSample_) *
-					       c_stride;
-		const unsigned char *line_cr = src_cr + (y / vertSubSample_) *
-					       c_stride;
-
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += c_inc;
-			line_cr += c_inc;
-			dst += 4;
-
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += 1;
-			line_cr += 1;
-			dst += 4;
+	parallelFor(height_, [&](unsigned int begin, unsigned int end) {
+		std::vector<uint8_t> buffer(width_ * 2);
+		uint8_t *line_cb = buffer.data();
+		uint8_t *line_cr = line_cb + width_;
+
+		for (unsigned int y = begin; y < end; y++) {
+			const unsigned char *cb = src_cb + (y / vertSubSample_) * c_stride;
+			const unsigned char *cr = src_cr + (y / vertSubSample_) * c_stride;
+
+			for (unsigned int x = 0; x < width_; x++) {
+				line_cb[x] = cb[x >> c_shift];
+				line_cr[x] = cr[x >> c_shift];
+			}
+
+			yuvToRgbLine(src_y + y * stride_, line_cb, line_cr,
+				     dst + y * width_ * 4, width_);
 		}
-	}
+	});
 }
 
 void FormatConverter::convertYUVSemiPlanar(const Image *srcImage, unsigned char *dst)
 {
 	unsigned int c_stride = stride_ * (2 / horzSubSample_);
-	unsigned int c_inc = horzSubSample_ == 1 ? 2 : 0;
+	unsigned int c_shift = horzSubSample_ == 2 ? 1 : 0;
 	unsigned int cb_pos = nvSwap_ ? 1 : 0;
 	unsigned int cr_pos = nvSwap_ ? 0 : 1;
 	const unsigned char *src = srcImage->data(0).data();
 	const unsigned char *src_c = srcImage->data(1).data();
-	int r, g, b;
-
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *src_y = src + y * stride_;
-		const unsigned char *src_cb = src_c + (y / vertSubSample_) *
-					      c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample_) *
-					      c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 4;
-
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 4;
+
+	parallelFor(height_, [&](unsigned int begin, unsigned int end) {
+		std::vector<uint8_t> buffer(width_ * 2);
+		uint8_t *line_cb = buffer.data();
+		uint8_t *line_cr = line_cb + width_;
+
+		for (unsigned int y = begin; y < end; y++) {
+			const unsigned char *c = src_c + (y / vertSubSample_) * c_stride;
+
+			for (unsigned int x = 0; x < width_; x++) {
+				line_cb[x] = c[(x >> c_shift) * 2 + cb_pos];
+				line_cr[x] = c[(x >> c_shift) * 2 + cr_pos];
+			}
+
+			yuvToRgbLine(src + y * stride_, line_cb, line_cr,
+				     dst + y * width_ * 4, width_);
 		}
-	}
+	});
 }
@@ -662,10 +662,13 @@ void MainWindow::processRaw(FrameBuffer *buffer,
 							"DNG Files (*.dng)");
 
 	if (!filename.isEmpty()) {
-		uint8_t *memory = mappedBuffers_[buffer]->data(0).data();
+		Image *image = mappedBuffers_[buffer].get();
+
+		image->beginAccess();
 		DNGWriter::write(filename.toStdString().c_str(), camera_.get(),
 				 rawStream_->configuration(), metadata, buffer,
-				 memory);
+				 image->data(0).data());
+		image->endAccess();
 	}
 #endif
 
@@ -745,12 +748,21 @@ void MainWindow::processViewfinder(FrameBuffer *buffer)
 		<< "} timestamp:" << metadata.timestamp
 		<< "fps:" << Qt::fixed << qSetRealNumberPrecision(2) << fps;
 
-	/* Render the frame on the viewfinder. */
-	viewfinder_->render(buffer, mappedBuffers_[buffer].get());
+	/*
+	 * Render the frame on the viewfinder. The viewfinder accesses the
+	 * image until it signals render completion.
+	 */
+	Image *image = mappedBuffers_[buffer].get();
+	image->beginAccess();
+	viewfinder_->render(buffer, image);
 }
 
 void MainWindow::renderComplete(FrameBuffer *buffer)
 {
+	auto iter = mappedBuffers_.find(buffer);
+	if (iter != mappedBuffers_.end())
+		iter->second->endAccess();
+
 	Request *request;
 	{
 		QMutexLocker locker(&mutex_);
@@ -58,15 +58,37 @@ static const QList<libcamera::PixelFormat> supportedFormats{
 	libcamera::formats::SRGGB12_CSI2P,
 };
 
+#ifdef HAVE_EGL
+namespace {
+
+/* DRM_FORMAT_GR88, not defined by libcamera */
+constexpr uint32_t kFourccGR88 = 'G' | ('R' << 8) | ('8' << 16) | ('8' << 24);
+
+bool hasExtension(const char *extensions, const char *name)
+{
+	return extensions && QByteArray(extensions).split(' ').contains(name);
+}
+
+} /* namespace */
+#endif
+
 ViewFinderGL::ViewFinderGL(QWidget *parent)
 	: QOpenGLWidget(parent), buffer_(nullptr),
 	  colorSpace_(libcamera::ColorSpace::Raw), image_(nullptr),
 	  vertexBuffer_(QOpenGLBuffer::VertexBuffer)
+#ifdef HAVE_EGL
+	  , dmaBufImport_(false), dmaBufModifiers_(false),
+	  eglDisplay_(EGL_NO_DISPLAY), eglCreateImageKHR_(nullptr),
+	  eglDestroyImageKHR_(nullptr), glEGLImageTargetTexture2DOES_(nullptr)
+#endif
 {
 }
 
 ViewFinderGL::~ViewFinderGL()
 {
+#ifdef HAVE_EGL
+	releaseImportedBuffers();
+#endif
 	removeShader();
 }
 
@@ -79,16 +101,17 @@ int ViewFinderGL::setFormat(const libcamera::PixelFormat &format, const QSize &s
 			    const libcamera::ColorSpace &colorSpace,
 			    unsigned int stride)
 {
+#ifdef HAVE_EGL
+	/* Imported buffers depend on the format, import them again. */
+	releaseImportedBuffers();
+#endif
+
 	if (format != format_ || colorSpace != colorSpace_) {
 		/*
 		 * If the fragment already exists, remove it and create a new
 		 * one for the new format.
 		 */
-		if (shaderProgram_.isLinked()) {
-			shaderProgram_.release();
-			shaderProgram_.removeShader(fragmentShader_.get());
-			fragmentShader_.reset();
-		}
+		removeFragmentShader();
 
 		if (!selectFormat(format))
 			return -1;
@@ -113,6 +136,11 @@ void ViewFinderGL::stop()
 		buffer_ = nullptr;
 		image_ = nullptr;
 	}
+
+#ifdef HAVE_EGL
+	/* The buffers are freed after the capture stops. */
+	releaseImportedBuffers();
+#endif
 }
 
 QImage ViewFinderGL::getCurrentImage()
@@ -393,6 +421,91 @@ void ViewFinderGL::selectColorSpace(const libcamera::ColorSpace &colorSpace)
 		.arg(offset, 0, 'f', 1));
 }
 
+/*
+ * Return the textures the frame planes are loaded in. The textures are as wide
+ * as the planes stride, the vertex shader maps the active portion of the image.
+ */
+std::vector<ViewFinderGL::TextureLayout> ViewFinderGL::textureLayout() const
+{
+	const unsigned int height = size_.height();
+
+	switch (format_) {
+	case libcamera::formats::NV12:
+	case libcamera::formats::NV21:
+	case libcamera::formats::NV16:
+	case libcamera::formats::NV61:
+	case libcamera::formats::NV24:
+	case libcamera::formats::NV42:
+		/* Texture Y, and texture UV/VU */
+		return {
+			{ 0, 0, GL_LUMINANCE, stride_, height },
+			{ 1, 1, GL_LUMINANCE_ALPHA, stride_ / horzSubSample_,
+			  height / vertSubSample_ },
+		};
+
+	case libcamera::formats::YUV420:
+		/* Textures Y, U and V */
+		return {
+			{ 0, 0, GL_LUMINANCE, stride_, height },
+			{ 1, 1, GL_LUMINANCE, stride_ / horzSubSample_,
+			  height / vertSubSample_ },
+			{ 2, 2, GL_LUMINANCE, stride_ / horzSubSample_,
+			  height / vertSubSample_ },
+		};
+
+	case libcamera::formats::YVU420:
+		/* Textures Y, V and U */
+		return {
+			{ 0, 0, GL_LUMINANCE, stride_, height },
+			{ 1, 2, GL_LUMINANCE, stride_ / horzSubSample_,
+			  height / vertSubSample_ },
+			{ 2, 1, GL_LUMINANCE, stride_ / horzSubSample_,
+			  height / vertSubSample_ },
+		};
+
+	case libcamera::formats::UYVY:
+	case libcamera::formats::VYUY:
+	case libcamera::formats::YUYV:
+	case libcamera::formats::YVYU:
+		/*
+		 * Packed YUV formats are stored in a RGBA texture to match the
+		 * OpenGL texel size with the 4 bytes repeating pattern in YUV.
+		 * The texture width is thus half of the image width.
+		 */
+	case libcamera::formats::ABGR8888:
+	case libcamera::formats::ARGB8888:
+	case libcamera::formats::BGRA8888:
+	case libcamera::formats::RGBA8888:
+		return { { 0, 0, GL_RGBA, stride_ / 4, height } };
+
+	case libcamera::formats::BGR888:
+	case libcamera::formats::RGB888:
+		return { { 0, 0, GL_RGB, stride_ / 3, height } };
+
+	case libcamera::formats::SBGGR8:
+	case libcamera::formats::SGBRG8:
+	case libcamera::formats::SGRBG8:
+	case libcamera::formats::SRGGB8:
+	case libcamera::formats::SBGGR10_CSI2P:
+	case libcamera::formats::SGBRG10_CSI2P:
+	case libcamera::formats::SGRBG10_CSI2P:
+	case libcamera::formats::SRGGB10_CSI2P:
+	case libcamera::formats::SBGGR12_CSI2P:
+	case libcamera::formats::SGBRG12_CSI2P:
+	case libcamera::formats::SGRBG12_CSI2P:
+	case libcamera::formats::SRGGB12_CSI2P:
+		/*
+		 * Raw Bayer 8-bit, and packed raw Bayer 10-bit/12-bit formats
+		 * are stored in a GL_LUMINANCE texture. The texture width is
+		 * equal to the stride.
+		 */
+		return { { 0, 0, GL_LUMINANCE, stride_, height } };
+
+	default:
+		return {};
+	}
+}
+
 bool ViewFinderGL::createVertexShader()
 {
 	/* Create Vertex Shader */
@@ -427,6 +540,11 @@ bool ViewFinderGL::createFragmentShader()
 	}
 
 	QString defines = fragmentShaderDefines_.join('\n') + "\n";
+#ifdef HAVE_EGL
+	/* Imported UV planes store the second component in green. */
+	if (dmaBufImport_)
+		defines += "#define TEX_UV_SECOND g\n";
+#endif
 	QByteArray src = file.readAll();
 	src.prepend(defines.toUtf8());
 
@@ -486,9 +604,9 @@ bool ViewFinderGL::createFragmentShader()
 	return true;
 }
 
-void ViewFinderGL::configureTexture(QOpenGLTexture &texture)
+void ViewFinderGL::configureTexture(GLuint texture)
 {
-	glBindTexture(GL_TEXTURE_2D, texture.textureId());
+	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
 			textureMinMagFilters_);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
@@ -497,6 +615,15 @@ void ViewFinderGL::configureTexture(QOpenGLTexture &texture)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
+void ViewFinderGL::removeFragmentShader()
+{
+	if (shaderProgram_.isLinked()) {
+		shaderProgram_.release();
+		shaderProgram_.removeShader(fragmentShader_.get());
+		fragmentShader_.reset();
+	}
+}
+
 void ViewFinderGL::removeShader()
 {
 	if (shaderProgram_.isLinked()) {
@@ -536,11 +663,197 @@ void ViewFinderGL::initializeGL()
 	if (!createVertexShader())
 		qWarning() << "[ViewFinderGL]: create vertex shader failed.";
 
+#ifdef HAVE_EGL
+	initDmaBufImport();
+#endif
+
 	glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
 }
 
+#ifdef HAVE_EGL
+/*
+ * Frame buffers can be imported as EGL images and sampled directly, without
+ * copying frames to textures, when the context has been created through EGL
+ * with support for dmabuf import.
+ */
+void ViewFinderGL::initDmaBufImport()
+{
+	dmaBufImport_ = false;
+
+	eglDisplay_ = eglGetCurrentDisplay();
+	if (eglDisplay_ == EGL_NO_DISPLAY)
+		return;
+
+	const char *extensions = eglQueryString(eglDisplay_, EGL_EXTENSIONS);
+	if (!hasExtension(extensions, "EGL_EXT_image_dma_buf_import") ||
+	    !context()->hasExtension("GL_OES_EGL_image"))
+		return;
+
+	dmaBufModifiers_ = hasExtension(extensions,
+					"EGL_EXT_image_dma_buf_import_modifiers");
+
+	eglCreateImageKHR_ = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+		eglGetProcAddress("eglCreateImageKHR"));
+	eglDestroyImageKHR_ = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+		eglGetProcAddress("eglDestroyImageKHR"));
+	glEGLImageTargetTexture2DOES_ = reinterpret_cast<EGLImageTargetTexture2DOES>(
+		eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+	if (!eglCreateImageKHR_ || !eglDestroyImageKHR_ ||
+	    !glEGLImageTargetTexture2DOES_)
+		return;
+
+	dmaBufImport_ = true;
+}
+
+/*
+ * Import the planes of a frame buffer as EGL images, with one single-plane
+ * image per texture. The images use the same layout as uploaded textures, so
+ * the shaders sample them the same way. Imported buffers are cached until the
+ * format changes or the capture stops.
+ */
+const ViewFinderGL::ImportedBuffer *
+ViewFinderGL::importBuffer(libcamera::FrameBuffer *buffer)
+{
+	auto iter = importedBuffers_.find(buffer);
+	if (iter != importedBuffers_.end())
+		return &iter->second;
+
+	const std::vector<libcamera::FrameBuffer::Plane> &planes = buffer->planes();
+	const uint64_t modifier = format_.modifier();
+	ImportedBuffer imported = {};
+
+	if (modifier && !dmaBufModifiers_)
+		return nullptr;
+
+	for (const TextureLayout &layout : textureLayout()) {
+		uint32_t fourcc;
+		unsigned int bpp;
+
+		switch (layout.format) {
+		case GL_LUMINANCE:
+			fourcc = libcamera::formats::R8.fourcc();
+			bpp = 1;
+			break;
+		case GL_LUMINANCE_ALPHA:
+			fourcc = kFourccGR88;
+			bpp = 2;
+			break;
+		case GL_RGB:
+			fourcc = libcamera::formats::BGR888.fourcc();
+			bpp = 3;
+			break;
+		case GL_RGBA:
+		default:
+			fourcc = libcamera::formats::ABGR8888.fourcc();
+			bpp = 4;
+			break;
+		}
+
+		if (layout.plane >= planes.size()) {
+			destroyImportedBuffer(imported);
+			return nullptr;
+		}
+
+		const libcamera::FrameBuffer::Plane &plane = planes[layout.plane];
+
+		std::vector<EGLint> attribs = {
+			EGL_WIDTH, static_cast<EGLint>(layout.width),
+			EGL_HEIGHT, static_cast<EGLint>(layout.height),
+			EGL_LINUX_DRM_FOURCC_EXT, static_cast<EGLint>(fourcc),
+			EGL_DMA_BUF_PLANE0_FD_EXT, plane.fd.get(),
+			EGL_DMA_BUF_PLANE0_OFFSET_EXT, static_cast<EGLint>(plane.offset),
+			EGL_DMA_BUF_PLANE0_PITCH_EXT, static_cast<EGLint>(layout.width * bpp),
+		};
+
+		if (modifier) {
+			attribs.push_back(EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT);
+			attribs.push_back(static_cast<EGLint>(modifier & 0xffffffff));
+			attribs.push_back(EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT);
+			attribs.push_back(static_cast<EGLint>(modifier >> 32));
+		}
+
+		attribs.push_back(EGL_NONE);
+
+		EGLImageKHR image = eglCreateImageKHR_(eglDisplay_, EGL_NO_CONTEXT,
+						       EGL_LINUX_DMA_BUF_EXT,
+						       nullptr, attribs.data());
+		if (image == EGL_NO_IMAGE_KHR) {
+			destroyImportedBuffer(imported);
+			return nullptr;
+		}
+
+		imported.images[layout.unit] = image;
+
+		glGenTextures(1, &imported.textures[layout.unit]);
+		glBindTexture(GL_TEXTURE_2D, imported.textures[layout.unit]);
+		glEGLImageTargetTexture2DOES_(GL_TEXTURE_2D, image);
+
+		if (glGetError() != GL_NO_ERROR) {
+			destroyImportedBuffer(imported);
+			return nullptr;
+		}
+	}
+
+	return &importedBuffers_.emplace(buffer, imported).first->second;
+}
+
+/* Must be called with the context current */
+void ViewFinderGL::destroyImportedBuffer(ImportedBuffer &imported)
+{
+	for (unsigned int i = 0; i < imported.images.size(); i++) {
+		if (imported.textures[i])
+			glDeleteTextures(1, &imported.textures[i]);
+		if (imported.images[i])
+			eglDestroyImageKHR_(eglDisplay_, imported.images[i]);
+	}
+
+	imported = {};
+}
+
+void ViewFinderGL::releaseImportedBuffers()
+{
+	if (importedBuffers_.empty())
+		return;
+
+	makeCurrent();
+
+	for (auto &[buffer, imported] : importedBuffers_)
+		destroyImportedBuffer(imported);
+
+	importedBuffers_.clear();
+
+	doneCurrent();
+}
+#endif
+
 void ViewFinderGL::doRender()
 {
+#ifdef HAVE_EGL
+	const ImportedBuffer *imported = dmaBufImport_ ? importBuffer(buffer_) : nullptr;
+#endif
+
+	for (const TextureLayout &layout : textureLayout()) {
+		glActiveTexture(GL_TEXTURE0 + layout.unit);
+
+#ifdef HAVE_EGL
+		if (imported) {
+			configureTexture(imported->textures[layout.unit]);
+			continue;
+		}
+#endif
+
+		configureTexture(textures_[layout.unit]->textureId());
+		glTexImage2D(GL_TEXTURE_2D,
+			     0,
+			     layout.format,
+			     layout.width,
+			     layout.height,
+			     0,
+			     layout.format,
+			     GL_UNSIGNED_BYTE,
+			     image_->data(layout.plane).data());
+	}
+
 	/* Stride of the first plane, in pixels. */
 	unsigned int stridePixels;
 
@@ -551,125 +864,17 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::NV61:
 	case libcamera::formats::NV24:
 	case libcamera::formats::NV42:
-		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
-
-		/* Activate texture UV/VU */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE_ALPHA,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE_ALPHA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
 
 		stridePixels = stride_;
 		break;
 
 	case libcamera::formats::YUV420:
-		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
-		shaderProgram_.setUniformValue(textureUniformY_, 0);
-
-		/* Activate texture U */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
-		shaderProgram_.setUniformValue(textureUniformU_, 1);
-
-		/* Activate texture V */
-		glActiveTexture(GL_TEXTURE2);
-		configureTexture(*textures_[2]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(2).data());
-		shaderProgram_.setUniformValue(textureUniformV_, 2);
-
-		stridePixels = stride_;
-		break;
-
 	case libcamera::formats::YVU420:
-		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
-
-		/* Activate texture V */
-		glActiveTexture(GL_TEXTURE2);
-		configureTexture(*textures_[2]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
-		shaderProgram_.setUniformValue(textureUniformV_, 2);
-
-		/* Activate texture U */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(2).data());
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
+		shaderProgram_.setUniformValue(textureUniformV_, 2);
 
 		stridePixels = stride_;
 		break;
@@ -678,22 +883,6 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::VYUY:
 	case libcamera::formats::YUYV:
 	case libcamera::formats::YVYU:
-		/*
-		 * Packed YUV formats are stored in a RGBA texture to match the
-		 * OpenGL texel size with the 4 bytes repeating pattern in YUV.
-		 * The texture width is thus half of the image_ with.
-		 */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGBA,
-			     stride_ / 4,
-			     size_.height(),
-			     0,
-			     GL_RGBA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/*
@@ -713,17 +902,6 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::ARGB8888:
 	case libcamera::formats::BGRA8888:
 	case libcamera::formats::RGBA8888:
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGBA,
-			     stride_ / 4,
-			     size_.height(),
-			     0,
-			     GL_RGBA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		stridePixels = stride_ / 4;
@@ -731,17 +909,6 @@ void ViewFinderGL::doRender()
 
 	case libcamera::formats::BGR888:
 	case libcamera::formats::RGB888:
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGB,
-			     stride_ / 3,
-			     size_.height(),
-			     0,
-			     GL_RGB,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		stridePixels = stride_ / 3;
@@ -759,22 +926,6 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::SGBRG12_CSI2P:
 	case libcamera::formats::SGRBG12_CSI2P:
 	case libcamera::formats::SRGGB12_CSI2P:
-		/*
-		 * Raw Bayer 8-bit, and packed raw Bayer 10-bit/12-bit formats
-		 * are stored in a GL_LUMINANCE texture. The texture width is
-		 * equal to the stride.
-		 */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 		shaderProgram_.setUniformValue(textureUniformBayerFirstRed_,
 					       firstRed_);
@@ -809,6 +960,25 @@ void ViewFinderGL::doRender()
 
 void ViewFinderGL::paintGL()
 {
+#ifdef HAVE_EGL
+	/*
+	 * Fall back to texture uploads if the frame buffer can't be imported.
+	 * The fragment shader samples imported textures differently, create it
+	 * again.
+	 */
+	if (image_ && dmaBufImport_ && !importBuffer(buffer_)) {
+		qWarning() << "[ViewFinderGL]:"
+			   << "dmabuf import failed, uploading frames to textures";
+
+		for (auto &[buffer, imported] : importedBuffers_)
+			destroyImportedBuffer(imported);
+		importedBuffers_.clear();
+
+		dmaBufImport_ = false;
+		removeFragmentShader();
+	}
+#endif
+
 	if (!fragmentShader_)
 		if (!createFragmentShader()) {
 			qWarning() << "[ViewFinderGL]:"
@@ -8,7 +8,9 @@
 #pragma once
 
 #include <array>
+#include <map>
 #include <memory>
+#include <vector>
 
 #include <QImage>
 #include <QMutex>
@@ -23,6 +25,12 @@
 #include <libcamera/formats.h>
 #include <libcamera/framebuffer.h>
 
+#ifdef HAVE_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 #include "viewfinder.h"
 
 class ViewFinderGL : public QOpenGLWidget,
@@ -55,15 +63,41 @@ protected:
 	QSize sizeHint() const override;
 
 private:
+	/* Layout of a frame plane in a texture */
+	struct TextureLayout {
+		unsigned int plane;
+		unsigned int unit;
+		GLenum format;
+		unsigned int width;
+		unsigned int height;
+	};
+
 	bool selectFormat(const libcamera::PixelFormat &format);
 	void selectColorSpace(const libcamera::ColorSpace &colorSpace);
+	std::vector<TextureLayout> textureLayout() const;
 
-	void configureTexture(QOpenGLTexture &texture);
+	void configureTexture(GLuint texture);
 	bool createFragmentShader();
 	bool createVertexShader();
+	void removeFragmentShader();
 	void removeShader();
 	void doRender();
 
+#ifdef HAVE_EGL
+	/* Textures of a frame buffer imported through EGL, indexed by unit */
+	struct ImportedBuffer {
+		std::array<EGLImageKHR, 3> images;
+		std::array<GLuint, 3> textures;
+	};
+
+	using EGLImageTargetTexture2DOES = void (*)(GLenum target, void *image);
+
+	void initDmaBufImport();
+	const ImportedBuffer *importBuffer(libcamera::FrameBuffer *buffer);
+	void destroyImportedBuffer(ImportedBuffer &imported);
+	void releaseImportedBuffers();
+#endif
+
 	/* Captured image size, format and buffer */
 	libcamera::FrameBuffer *buffer_;
 	libcamera::PixelFormat format_;
@@ -103,5 +137,16 @@ private:
 	GLuint textureUniformBayerFirstRed_;
 	QPointF firstRed_;
 
+#ifdef HAVE_EGL
+	/* Zero-copy import of frame buffers */
+	bool dmaBufImport_;
+	bool dmaBufModifiers_;
+	EGLDisplay eglDisplay_;
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_;
+	EGLImageTargetTexture2DOES glEGLImageTargetTexture2DOES_;
+	std::map<libcamera::FrameBuffer *, ImportedBuffer> importedBuffers_;
+#endif
+
 	QMutex mutex_; /* Prevent concurrent access to image_ */
 };
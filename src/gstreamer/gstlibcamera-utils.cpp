@@ -11,6 +11,8 @@
 #include <libcamera/control_ids.h>
 #include <libcamera/formats.h>
 
+#include <gst/allocators/allocators.h>
+
 using namespace libcamera;
 
 static struct {
@@ -302,11 +304,41 @@ bayer_format_to_string(int format)
 	return NULL;
 }
 
+/*
+ * Formats with a DRM modifier, such as tiled or compressed formats, are only
+ * expressed as DMA_DRM formats, which require the DMABuf caps feature.
+ */
+static GstCapsFeatures *
+caps_features_from_format([[maybe_unused]] const PixelFormat &format)
+{
+#if GST_CHECK_VERSION(1, 24, 0)
+	if (format.modifier())
+		return gst_caps_features_new(GST_CAPS_FEATURE_MEMORY_DMABUF, nullptr);
+#endif
+
+	return nullptr;
+}
+
 static GstStructure *
 bare_structure_from_format(const PixelFormat &format)
 {
 	GstVideoFormat gst_format = pixel_format_to_gst_format(format);
 
+#if GST_CHECK_VERSION(1, 24, 0)
+	if (format.modifier()) {
+		g_autofree gchar *drm_format =
+			gst_video_dma_drm_fourcc_to_string(format.fourcc(),
+							   format.modifier());
+		if (!drm_format)
+			return nullptr;
+
+		return gst_structure_new("video/x-raw",
+					 "format", G_TYPE_STRING, "DMA_DRM",
+					 "drm-format", G_TYPE_STRING, drm_format,
+					 nullptr);
+	}
+#endif
+
 	if (gst_format == GST_VIDEO_FORMAT_UNKNOWN)
 		return nullptr;
 
@@ -350,7 +382,8 @@ gst_libcamera_stream_formats_to_caps(const StreamFormats &formats)
 					  "width", G_TYPE_INT, size.width,
 					  "height", G_TYPE_INT, size.height,
 					  nullptr);
-			gst_caps_append_structure(caps, s);
+			gst_caps_append_structure_full(caps, s,
+						       caps_features_from_format(pixelformat));
 		}
 
 		const SizeRange &range = formats.range(pixelformat);
@@ -373,7 +406,8 @@ gst_libcamera_stream_formats_to_caps(const StreamFormats &formats)
 			}
 			g_value_unset(&val);
 
-			caps = gst_caps_merge_structure(caps, s);
+			caps = gst_caps_merge_structure_full(caps, s,
+							     caps_features_from_format(pixelformat));
 		}
 	}
 
@@ -402,7 +436,8 @@ gst_libcamera_stream_configuration_to_caps(const StreamConfiguration &stream_cfg
 				ColorSpace::toString(stream_cfg.colorSpace).c_str());
 	}
 
-	gst_caps_append_structure(caps, s);
+	gst_caps_append_structure_full(caps, s,
+				       caps_features_from_format(stream_cfg.pixelFormat));
 
 	return caps;
 }
@@ -465,8 +500,17 @@ gst_libcamera_configure_stream_from_caps(StreamConfiguration &stream_cfg,
 		s = gst_caps_get_structure(caps, best_in_range);
 
 	if (gst_structure_has_name(s, "video/x-raw")) {
-		const gchar *format = gst_video_format_to_string(gst_format);
+		g_autoptr(GstStructure) bare_s = bare_structure_from_format(stream_cfg.pixelFormat);
+		const gchar *format = bare_s ? gst_structure_get_string(bare_s, "format")
+					     : nullptr;
+		if (!format)
+			format = gst_video_format_to_string(gst_format);
 		gst_structure_fixate_field_string(s, "format", format);
+
+		const gchar *drm_format = bare_s ? gst_structure_get_string(bare_s, "drm-format")
+						 : nullptr;
+		if (drm_format && gst_structure_has_field(s, "drm-format"))
+			gst_structure_fixate_field_string(s, "drm-format", drm_format);
 	}
 
 	/* Then configure the stream with the result. */
@@ -474,6 +518,18 @@ gst_libcamera_configure_stream_from_caps(StreamConfiguration &stream_cfg,
 		const gchar *format = gst_structure_get_string(s, "format");
 		gst_format = gst_video_format_from_string(format);
 		stream_cfg.pixelFormat = gst_format_to_pixel_format(gst_format);
+
+#if GST_CHECK_VERSION(1, 24, 0)
+		if (gst_format == GST_VIDEO_FORMAT_DMA_DRM) {
+			const gchar *drm_format = gst_structure_get_string(s, "drm-format");
+			guint64 modifier = 0;
+			guint32 fourcc = drm_format
+				       ? gst_video_dma_drm_fourcc_from_string(drm_format, &modifier)
+				       : 0;
+
+			stream_cfg.pixelFormat = PixelFormat(fourcc, modifier);
+		}
+#endif
 	} else if (gst_structure_has_name(s, "image/jpeg")) {
 		stream_cfg.pixelFormat = formats::MJPEG;
 	} else {
@@ -498,6 +554,67 @@ gst_libcamera_configure_stream_from_caps(StreamConfiguration &stream_cfg,
 	}
 }
 
+/*
+ * Describe the layout of the planes of a buffer captured by the camera with a
+ * GstVideoMeta, as the stride selected by the pipeline handler may differ from
+ * the default stride of the format. Buffers that already carry a video meta,
+ * such as the buffers of downstream pools, are left untouched. Return the meta
+ * added to the buffer, or nullptr if none was added.
+ */
+GstVideoMeta *
+gst_libcamera_buffer_add_video_meta(GstBuffer *buffer,
+				    const StreamConfiguration &stream_cfg)
+{
+	GstVideoFormat gst_format = pixel_format_to_gst_format(stream_cfg.pixelFormat);
+	gsize offsets[GST_VIDEO_MAX_PLANES] = {};
+	gint strides[GST_VIDEO_MAX_PLANES] = {};
+	guint n_planes = gst_buffer_n_memory(buffer);
+
+	if (gst_buffer_get_video_meta(buffer) || !n_planes ||
+	    n_planes > GST_VIDEO_MAX_PLANES)
+		return nullptr;
+
+	if (gst_format == GST_VIDEO_FORMAT_UNKNOWN ||
+	    gst_format == GST_VIDEO_FORMAT_ENCODED) {
+#if GST_CHECK_VERSION(1, 24, 0)
+		if (!stream_cfg.pixelFormat.modifier())
+			return nullptr;
+
+		/*
+		 * The layout of modified formats is opaque, their planes share
+		 * the stride of the first plane.
+		 */
+		gst_format = GST_VIDEO_FORMAT_DMA_DRM;
+		for (guint i = 0; i < n_planes; i++)
+			strides[i] = stream_cfg.stride;
+#else
+		return nullptr;
+#endif
+	} else {
+		GstVideoInfo info;
+
+		if (!gst_video_info_set_format(&info, gst_format,
+					       stream_cfg.size.width,
+					       stream_cfg.size.height) ||
+		    GST_VIDEO_INFO_N_PLANES(&info) != n_planes)
+			return nullptr;
+
+		/* Scale the default strides to the stride of the first plane. */
+		for (guint i = 0; i < n_planes; i++)
+			strides[i] = static_cast<guint64>(stream_cfg.stride) *
+				     GST_VIDEO_INFO_PLANE_STRIDE(&info, i) /
+				     GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+	}
+
+	/* Each plane of the frame buffer is stored in its own memory. */
+	for (guint i = 1; i < n_planes; i++)
+		offsets[i] = offsets[i - 1] + gst_buffer_peek_memory(buffer, i - 1)->size;
+
+	return gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE, gst_format,
+					      stream_cfg.size.width, stream_cfg.size.height,
+					      n_planes, offsets, strides);
+}
+
 void gst_libcamera_get_framerate_from_caps(GstCaps *caps,
 					   GstStructure *element_caps)
 {
@@ -8,22 +8,49 @@
 
 #include "gstlibcamerapad.h"
 
+#include <algorithm>
+#include <deque>
+
 #include <libcamera/stream.h>
 
 #include "gstlibcamera-utils.h"
 
 using namespace libcamera;
 
+enum GstLibcameraPadLeaky {
+	GST_LIBCAMERA_PAD_LEAKY_NO,
+	GST_LIBCAMERA_PAD_LEAKY_UPSTREAM,
+	GST_LIBCAMERA_PAD_LEAKY_DOWNSTREAM,
+};
+
 struct _GstLibcameraPad {
 	GstPad parent;
 	StreamRole role;
 	GstLibcameraPool *pool;
-	GstClockTime latency;
+	GstClockTime min_latency;
+	GstClockTime max_latency;
+
+	/*
+	 * The push thread state, protected by the object lock. The buffers
+	 * and serialized events are queued for the pad task when threaded is
+	 * set, and pushed directly otherwise.
+	 */
+	guint queue_size;
+	GstLibcameraPadLeaky leaky;
+	gboolean threaded;
+	gboolean flushing;
+	gboolean pushing;
+	gboolean event_result;
+	GstFlowReturn flow;
+	std::deque<GstMiniObject *> *queue;
+	GCond cond;
 };
 
 enum {
 	PROP_0,
-	PROP_STREAM_ROLE
+	PROP_STREAM_ROLE,
+	PROP_QUEUE_SIZE,
+	PROP_LEAKY,
 };
 
 G_DEFINE_TYPE(GstLibcameraPad, gst_libcamera_pad, GST_TYPE_PAD)
@@ -39,6 +66,12 @@ gst_libcamera_pad_set_property(GObject *object, guint prop_id,
 	case PROP_STREAM_ROLE:
 		self->role = (StreamRole)g_value_get_enum(value);
 		break;
+	case PROP_QUEUE_SIZE:
+		self->queue_size = g_value_get_uint(value);
+		break;
+	case PROP_LEAKY:
+		self->leaky = static_cast<GstLibcameraPadLeaky>(g_value_get_enum(value));
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -56,6 +89,12 @@ gst_libcamera_pad_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_STREAM_ROLE:
 		g_value_set_enum(value, static_cast<gint>(self->role));
 		break;
+	case PROP_QUEUE_SIZE:
+		g_value_set_uint(value, self->queue_size);
+		break;
+	case PROP_LEAKY:
+		g_value_set_enum(value, static_cast<gint>(self->leaky));
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -70,9 +109,9 @@ gst_libcamera_pad_query(GstPad *pad, GstObject *parent, GstQuery *query)
 	if (query->type != GST_QUERY_LATENCY)
 		return gst_pad_query_default(pad, parent, query);
 
-	/* TRUE here means live, we assumes that max latency is the same as min
-	 * as we have no idea that duration of frames. */
-	gst_query_set_latency(query, TRUE, self->latency, self->latency);
+	/* TRUE here means live. */
+	GLibLocker lock(GST_OBJECT(self));
+	gst_query_set_latency(query, TRUE, self->min_latency, self->max_latency);
 	return TRUE;
 }
 
@@ -80,6 +119,49 @@ static void
 gst_libcamera_pad_init(GstLibcameraPad *self)
 {
 	GST_PAD_QUERYFUNC(self) = gst_libcamera_pad_query;
+
+	self->queue = new std::deque<GstMiniObject *>();
+	g_cond_init(&self->cond);
+}
+
+static void
+gst_libcamera_pad_finalize(GObject *object)
+{
+	auto *self = GST_LIBCAMERA_PAD(object);
+
+	for (GstMiniObject *item : *self->queue)
+		gst_mini_object_unref(item);
+	delete self->queue;
+	g_cond_clear(&self->cond);
+
+	G_OBJECT_CLASS(gst_libcamera_pad_parent_class)->finalize(object);
+}
+
+static GType
+gst_libcamera_pad_leaky_get_type()
+{
+	static GType type = 0;
+	static const GEnumValue values[] = {
+		{
+			GST_LIBCAMERA_PAD_LEAKY_NO,
+			"Not leaky",
+			"no",
+		}, {
+			GST_LIBCAMERA_PAD_LEAKY_UPSTREAM,
+			"Leaky on upstream (new buffers)",
+			"upstream",
+		}, {
+			GST_LIBCAMERA_PAD_LEAKY_DOWNSTREAM,
+			"Leaky on downstream (old buffers)",
+			"downstream",
+		},
+		{ 0, NULL, NULL }
+	};
+
+	if (!type)
+		type = g_enum_register_static("GstLibcameraPadLeaky", values);
+
+	return type;
 }
 
 static GType
@@ -116,6 +198,7 @@ gst_libcamera_pad_class_init(GstLibcameraPadClass *klass)
 
 	object_class->set_property = gst_libcamera_pad_set_property;
 	object_class->get_property = gst_libcamera_pad_get_property;
+	object_class->finalize = gst_libcamera_pad_finalize;
 
 	auto *spec = g_param_spec_enum("stream-role", "Stream Role",
 				       "The selected stream role",
@@ -126,6 +209,24 @@ gst_libcamera_pad_class_init(GstLibcameraPadClass *klass)
 						     | G_PARAM_READWRITE
 						     | G_PARAM_STATIC_STRINGS));
 	g_object_class_install_property(object_class, PROP_STREAM_ROLE, spec);
+
+	spec = g_param_spec_uint("queue-size", "Queue Size",
+				 "Number of buffers queued to a dedicated streaming thread, "
+				 "0 to push from the element streaming thread",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(GST_PARAM_MUTABLE_READY
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_QUEUE_SIZE, spec);
+
+	spec = g_param_spec_enum("leaky", "Leaky",
+				 "Where to drop buffers when the queue is full",
+				 gst_libcamera_pad_leaky_get_type(),
+				 GST_LIBCAMERA_PAD_LEAKY_NO,
+				 (GParamFlags)(GST_PARAM_MUTABLE_READY
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_LEAKY, spec);
 }
 
 StreamRole
@@ -165,9 +266,202 @@ gst_libcamera_pad_get_stream(GstPad *pad)
 }
 
 void
-gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency)
+gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime min_latency,
+			      GstClockTime max_latency)
 {
 	auto *self = GST_LIBCAMERA_PAD(pad);
 	GLibLocker lock(GST_OBJECT(self));
-	self->latency = latency;
+	self->min_latency = min_latency;
+	self->max_latency = max_latency;
+}
+
+static void
+gst_libcamera_pad_loop(gpointer user_data)
+{
+	auto *self = GST_LIBCAMERA_PAD(user_data);
+	GstMiniObject *item = nullptr;
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		while (self->queue->empty() && !self->flushing)
+			g_cond_wait(&self->cond, GST_OBJECT_GET_LOCK(self));
+
+		if (!self->flushing) {
+			item = self->queue->front();
+			self->queue->pop_front();
+			self->pushing = TRUE;
+			g_cond_broadcast(&self->cond);
+		}
+	}
+
+	if (!item) {
+		gst_pad_pause_task(GST_PAD(self));
+		return;
+	}
+
+	if (GST_IS_BUFFER(item)) {
+		GstFlowReturn ret = gst_pad_push(GST_PAD(self), GST_BUFFER(item));
+
+		GLibLocker lock(GST_OBJECT(self));
+		self->flow = ret;
+		self->pushing = FALSE;
+		g_cond_broadcast(&self->cond);
+	} else {
+		gboolean ret = gst_pad_push_event(GST_PAD(self), GST_EVENT(item));
+
+		GLibLocker lock(GST_OBJECT(self));
+		self->event_result = ret;
+		self->pushing = FALSE;
+		g_cond_broadcast(&self->cond);
+	}
+}
+
+/*
+ * Start the push thread of the pad if it has a queue. Must be called before
+ * pushing any data when the element starts streaming.
+ */
+void
+gst_libcamera_pad_start(GstPad *pad)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		self->threaded = self->queue_size > 0;
+		self->flushing = FALSE;
+		self->pushing = FALSE;
+		self->flow = GST_FLOW_OK;
+	}
+
+	if (self->threaded)
+		gst_pad_start_task(pad, gst_libcamera_pad_loop, self, nullptr);
+}
+
+/* Stop the push thread and drop the queued buffers and events. */
+void
+gst_libcamera_pad_stop(GstPad *pad)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	gst_libcamera_pad_set_flushing(pad);
+	gst_pad_stop_task(pad);
+
+	GLibLocker lock(GST_OBJECT(self));
+	for (GstMiniObject *item : *self->queue)
+		gst_mini_object_unref(item);
+	self->queue->clear();
+	self->threaded = FALSE;
+}
+
+/*
+ * Unblock the push thread, and the element streaming thread waiting for room in
+ * the queue. Nothing is pushed until the pad is started again.
+ */
+void
+gst_libcamera_pad_set_flushing(GstPad *pad)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GLibLocker lock(GST_OBJECT(self));
+
+	self->flushing = TRUE;
+	g_cond_broadcast(&self->cond);
+}
+
+/*
+ * Queue a buffer for the push thread. When the queue is full, the leaky policy
+ * decides whether to drop a buffer or to wait for room. Must be called with the
+ * object lock held.
+ */
+static GstFlowReturn
+gst_libcamera_pad_queue_buffer(GstLibcameraPad *self, GstBuffer *buffer)
+{
+	while (!self->flushing && self->queue->size() >= self->queue_size) {
+		if (self->leaky == GST_LIBCAMERA_PAD_LEAKY_UPSTREAM) {
+			GST_DEBUG_OBJECT(self, "Queue full, dropping new buffer");
+			gst_buffer_unref(buffer);
+			return self->flow;
+		}
+
+		if (self->leaky == GST_LIBCAMERA_PAD_LEAKY_DOWNSTREAM) {
+			/* Serialized events are never dropped. */
+			auto old = std::find_if(self->queue->begin(), self->queue->end(),
+						[](GstMiniObject *item) { return GST_IS_BUFFER(item); });
+			if (old != self->queue->end()) {
+				GST_DEBUG_OBJECT(self, "Queue full, dropping old buffer");
+				gst_mini_object_unref(*old);
+				self->queue->erase(old);
+				continue;
+			}
+		}
+
+		g_cond_wait(&self->cond, GST_OBJECT_GET_LOCK(self));
+	}
+
+	if (self->flushing) {
+		gst_buffer_unref(buffer);
+		return GST_FLOW_FLUSHING;
+	}
+
+	self->queue->push_back(GST_MINI_OBJECT(buffer));
+	g_cond_broadcast(&self->cond);
+
+	return self->flow;
+}
+
+/*
+ * Push a buffer on the pad, or queue it for the push thread. In the latter
+ * case, the flow return of the last buffer pushed by the thread is returned.
+ */
+GstFlowReturn
+gst_libcamera_pad_push(GstPad *pad, GstBuffer *buffer)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		if (self->threaded)
+			return gst_libcamera_pad_queue_buffer(self, buffer);
+	}
+
+	return gst_pad_push(pad, buffer);
+}
+
+/*
+ * Push a serialized event on the pad, or queue it for the push thread. Caps
+ * events are waited for, as the element queries downstream for the new caps
+ * right after pushing them.
+ */
+gboolean
+gst_libcamera_pad_push_event(GstPad *pad, GstEvent *event)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		if (self->threaded) {
+			bool wait = GST_EVENT_TYPE(event) == GST_EVENT_CAPS;
+
+			if (self->flushing) {
+				gst_event_unref(event);
+				return FALSE;
+			}
+
+			self->queue->push_back(GST_MINI_OBJECT(event));
+			g_cond_broadcast(&self->cond);
+
+			if (!wait)
+				return TRUE;
+
+			while (!self->flushing &&
+			       (!self->queue->empty() || self->pushing))
+				g_cond_wait(&self->cond, GST_OBJECT_GET_LOCK(self));
+
+			return !self->flushing && self->event_result;
+		}
+	}
+
+	return gst_pad_push_event(pad, event);
 }
@@ -25,4 +25,15 @@ void gst_libcamera_pad_set_pool(GstPad *pad, GstLibcameraPool *pool);
 
 libcamera::Stream *gst_libcamera_pad_get_stream(GstPad *pad);
 
-void gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency);
+void gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime min_latency,
+				   GstClockTime max_latency);
+
+void gst_libcamera_pad_start(GstPad *pad);
+
+void gst_libcamera_pad_stop(GstPad *pad);
+
+void gst_libcamera_pad_set_flushing(GstPad *pad);
+
+GstFlowReturn gst_libcamera_pad_push(GstPad *pad, GstBuffer *buffer);
+
+gboolean gst_libcamera_pad_push_event(GstPad *pad, GstEvent *event);
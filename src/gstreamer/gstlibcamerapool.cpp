@@ -8,9 +8,19 @@
 
 #include "gstlibcamerapool.h"
 
+#include <algorithm>
 #include <deque>
+#include <map>
+#include <sys/stat.h>
+#include <utility>
+
+#include <libcamera/base/shared_fd.h>
+
+#include <libcamera/framebuffer.h>
 #include <libcamera/stream.h>
 
+#include <gst/allocators/allocators.h>
+
 #include "gstlibcamera-utils.h"
 
 using namespace libcamera;
@@ -28,6 +38,16 @@ struct _GstLibcameraPool {
 	std::deque<GstBuffer *> *queue;
 	GstLibcameraAllocator *allocator;
 	Stream *stream;
+
+	/*
+	 * In import mode, the downstream pool and the frame buffers wrapping
+	 * its dmabufs, indexed by the identity of their first plane dmabuf.
+	 * The frame buffers are only accessed from the streaming thread.
+	 */
+	GstBufferPool *downstream;
+	GstVideoInfo info;
+	gboolean has_info;
+	std::map<std::pair<dev_t, ino_t>, std::unique_ptr<FrameBuffer>> *imported;
 };
 
 G_DEFINE_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_TYPE_BUFFER_POOL)
@@ -63,6 +83,14 @@ gst_libcamera_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
 		return GST_FLOW_ERROR;
 	}
 
+	/*
+	 * All the frame buffers of the stream share the same layout, keep the
+	 * video meta attached to the buffer when it returns to the pool.
+	 */
+	GstVideoMeta *meta = gst_libcamera_buffer_add_video_meta(buf, self->stream->configuration());
+	if (meta)
+		GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
+
 	*buffer = buf;
 	return GST_FLOW_OK;
 }
@@ -98,6 +126,7 @@ static void
 gst_libcamera_pool_init(GstLibcameraPool *self)
 {
 	self->queue = new std::deque<GstBuffer *>();
+	self->imported = new std::map<std::pair<dev_t, ino_t>, std::unique_ptr<FrameBuffer>>();
 }
 
 static void
@@ -110,7 +139,13 @@ gst_libcamera_pool_finalize(GObject *object)
 		gst_buffer_unref(buf);
 
 	delete self->queue;
-	g_object_unref(self->allocator);
+	delete self->imported;
+	g_clear_object(&self->allocator);
+
+	if (self->downstream) {
+		gst_buffer_pool_set_active(self->downstream, FALSE);
+		gst_object_unref(self->downstream);
+	}
 
 	G_OBJECT_CLASS(gst_libcamera_pool_parent_class)->finalize(object);
 }
@@ -150,6 +185,218 @@ gst_libcamera_pool_new(GstLibcameraAllocator *allocator, Stream *stream)
 	return pool;
 }
 
+struct PlaneLayout {
+	int fd;
+	unsigned int offset;
+	unsigned int length;
+};
+
+/*
+ * Locate the planes of a downstream buffer in its dmabufs. The camera writes
+ * frames with the stride of the stream configuration, buffers with a different
+ * layout can't be imported.
+ */
+static bool
+gst_libcamera_pool_get_layout(GstLibcameraPool *self, GstBuffer *buffer,
+			      std::vector<PlaneLayout> &layout)
+{
+	const StreamConfiguration &cfg = self->stream->configuration();
+	gsize offsets[GST_VIDEO_MAX_PLANES] = {};
+	gint strides[GST_VIDEO_MAX_PLANES] = { static_cast<gint>(cfg.stride) };
+	guint n_planes = 1;
+
+	if (gst_buffer_get_size(buffer) < cfg.frameSize)
+		return false;
+
+	if (self->has_info) {
+		GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+
+		n_planes = GST_VIDEO_INFO_N_PLANES(&self->info);
+		for (guint i = 0; i < n_planes; i++) {
+			offsets[i] = meta ? meta->offset[i]
+					  : GST_VIDEO_INFO_PLANE_OFFSET(&self->info, i);
+			strides[i] = meta ? meta->stride[i]
+					  : GST_VIDEO_INFO_PLANE_STRIDE(&self->info, i);
+		}
+	}
+
+	if (strides[0] != static_cast<gint>(cfg.stride))
+		return false;
+
+	for (guint i = 0; i < n_planes; i++) {
+		guint index, length;
+		gsize skip;
+
+		if (!gst_buffer_find_memory(buffer, offsets[i], 1, &index,
+					    &length, &skip))
+			return false;
+
+		GstMemory *mem = gst_buffer_peek_memory(buffer, index);
+		if (!gst_is_dmabuf_memory(mem))
+			return false;
+
+		/* Planes stored in the same memory end where the next starts. */
+		gsize size = mem->size - skip;
+		if (i + 1 < n_planes && offsets[i + 1] > offsets[i])
+			size = std::min(size, offsets[i + 1] - offsets[i]);
+
+		layout.push_back({ gst_dmabuf_memory_get_fd(mem),
+				   static_cast<unsigned int>(mem->offset + skip),
+				   static_cast<unsigned int>(size) });
+	}
+
+	return true;
+}
+
+/*
+ * Retrieve the frame buffer wrapping the dmabufs of a downstream buffer. The
+ * downstream pool may reuse the same dmabufs with different GstBuffer and
+ * GstMemory instances, frame buffers are thus cached by dmabuf identity, and
+ * created the first time a dmabuf is seen.
+ */
+static FrameBuffer *
+gst_libcamera_pool_import_buffer(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	std::vector<PlaneLayout> layout;
+	struct stat st;
+
+	if (!gst_libcamera_pool_get_layout(self, buffer, layout) ||
+	    fstat(layout[0].fd, &st) < 0) {
+		GST_ERROR_OBJECT(self, "Buffer %" GST_PTR_FORMAT " can't be imported",
+				 buffer);
+		return nullptr;
+	}
+
+	auto key = std::make_pair(st.st_dev, st.st_ino);
+	auto iter = self->imported->find(key);
+	if (iter != self->imported->end()) {
+		const std::vector<FrameBuffer::Plane> &planes = iter->second->planes();
+		bool match = planes.size() == layout.size();
+
+		for (guint i = 0; match && i < planes.size(); i++)
+			match = planes[i].offset == layout[i].offset &&
+				planes[i].length == layout[i].length;
+
+		if (match)
+			return iter->second.get();
+
+		self->imported->erase(iter);
+	}
+
+	std::vector<FrameBuffer::Plane> planes;
+	for (const PlaneLayout &plane : layout) {
+		FrameBuffer::Plane fbPlane;
+		fbPlane.fd = SharedFD(plane.fd);
+		fbPlane.offset = plane.offset;
+		fbPlane.length = plane.length;
+		planes.push_back(std::move(fbPlane));
+	}
+
+	auto frame = std::make_unique<FrameBuffer>(planes);
+	FrameBuffer *fb = frame.get();
+	self->imported->emplace(key, std::move(frame));
+
+	GST_DEBUG_OBJECT(self, "Imported %zu frame buffers", self->imported->size());
+
+	return fb;
+}
+
+/*
+ * Create a pool capturing into the buffers of the \a downstream pool proposed
+ * by an allocation query. The downstream pool is configured for the stream and
+ * activated, and a test buffer is imported to check that the pool produces
+ * dmabufs the camera can capture into. Return nullptr otherwise.
+ */
+GstLibcameraPool *
+gst_libcamera_pool_new_import(GstBufferPool *downstream, Stream *stream,
+			      GstCaps *caps, guint min_buffers,
+			      gboolean video_meta)
+{
+	const StreamConfiguration &cfg = stream->configuration();
+	GstStructure *config = gst_buffer_pool_get_config(downstream);
+	guint count = min_buffers + cfg.bufferCount;
+
+	gst_buffer_pool_config_set_params(config, caps, cfg.frameSize, count, count);
+	if (video_meta && gst_buffer_pool_has_option(downstream, GST_BUFFER_POOL_OPTION_VIDEO_META))
+		gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+	if (!gst_buffer_pool_set_config(downstream, config) ||
+	    !gst_buffer_pool_set_active(downstream, TRUE))
+		return nullptr;
+
+	auto *pool = GST_LIBCAMERA_POOL(g_object_new(GST_TYPE_LIBCAMERA_POOL, nullptr));
+
+	pool->downstream = GST_BUFFER_POOL(gst_object_ref(downstream));
+	pool->stream = stream;
+	pool->has_info = gst_video_info_from_caps(&pool->info, caps);
+
+	GstBuffer *buffer;
+	FrameBuffer *frame;
+	if (gst_libcamera_pool_acquire_frame(pool, &buffer, &frame, TRUE) != GST_FLOW_OK) {
+		g_object_unref(pool);
+		return nullptr;
+	}
+
+	gst_buffer_unref(buffer);
+
+	return pool;
+}
+
+gboolean
+gst_libcamera_pool_is_import(GstLibcameraPool *self)
+{
+	return self->downstream != nullptr;
+}
+
+/*
+ * Acquire a buffer and the frame buffer to capture into it. Only the downstream
+ * pool of an import mode pool can be waited on, the pool otherwise signals
+ * buffer-notify when its buffers are released.
+ */
+GstFlowReturn
+gst_libcamera_pool_acquire_frame(GstLibcameraPool *self, GstBuffer **buffer,
+				 FrameBuffer **frame, gboolean wait)
+{
+	GstFlowReturn ret;
+
+	if (!self->downstream) {
+		ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(self),
+						     buffer, nullptr);
+		if (ret == GST_FLOW_OK)
+			*frame = gst_libcamera_buffer_get_frame_buffer(*buffer);
+
+		return ret;
+	}
+
+	GstBufferPoolAcquireParams params = {};
+	if (!wait)
+		params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+	ret = gst_buffer_pool_acquire_buffer(self->downstream, buffer, &params);
+	if (ret != GST_FLOW_OK)
+		return ret;
+
+	*frame = gst_libcamera_pool_import_buffer(self, *buffer);
+	if (!*frame) {
+		gst_buffer_unref(*buffer);
+		*buffer = nullptr;
+		return GST_FLOW_ERROR;
+	}
+
+	return GST_FLOW_OK;
+}
+
+/*
+ * Unblock the streaming thread waiting for a buffer from the downstream pool.
+ * The pool stays flushing until it is destroyed.
+ */
+void
+gst_libcamera_pool_set_flushing(GstLibcameraPool *self)
+{
+	if (self->downstream)
+		gst_buffer_pool_set_flushing(self->downstream, TRUE);
+}
+
 Stream *
 gst_libcamera_pool_get_stream(GstLibcameraPool *self)
 {
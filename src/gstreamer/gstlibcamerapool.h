@@ -7,6 +7,10 @@
  *
  * This is a partial implementation of GstBufferPool intended for internal use
  * only. This pool cannot be configured or activated.
+ *
+ * In import mode, the pool doesn't own any buffer. Buffers are acquired from a
+ * downstream dmabuf pool instead, and wrapped into FrameBuffer instances to be
+ * captured into directly.
  */
 
 #pragma once
@@ -23,6 +27,20 @@ G_DECLARE_FINAL_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_LIBCAMERA, POOL,
 GstLibcameraPool *gst_libcamera_pool_new(GstLibcameraAllocator *allocator,
 					 libcamera::Stream *stream);
 
+GstLibcameraPool *gst_libcamera_pool_new_import(GstBufferPool *downstream,
+						libcamera::Stream *stream,
+						GstCaps *caps, guint min_buffers,
+						gboolean video_meta);
+
+gboolean gst_libcamera_pool_is_import(GstLibcameraPool *self);
+
+GstFlowReturn gst_libcamera_pool_acquire_frame(GstLibcameraPool *self,
+					       GstBuffer **buffer,
+					       libcamera::FrameBuffer **frame,
+					       gboolean wait);
+
+void gst_libcamera_pool_set_flushing(GstLibcameraPool *self);
+
 libcamera::Stream *gst_libcamera_pool_get_stream(GstLibcameraPool *self);
 
 libcamera::FrameBuffer *gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer);
@@ -15,7 +15,6 @@
  *    + Evaluate if a single streaming thread is fine
  *  - Add application driven request (snapshot)
  *  - Add framerate control
- *  - Add buffer importation support
  *
  *  Requires new libcamera API:
  *  - Add framerate negotiation support
@@ -27,8 +26,8 @@
 
 #include "gstlibcamerasrc.h"
 
+#include <algorithm>
 #include <atomic>
-#include <queue>
 #include <vector>
 
 #include <libcamera/camera.h>
@@ -48,21 +47,26 @@ GST_DEBUG_CATEGORY_STATIC(source_debug);
 #define GST_CAT_DEFAULT source_debug
 
 struct RequestWrap {
-	RequestWrap(std::unique_ptr<Request> request);
+	RequestWrap();
 	~RequestWrap();
 
-	void attachBuffer(Stream *stream, GstBuffer *buffer);
+	void attachBuffer(Stream *stream, GstBuffer *buffer, FrameBuffer *fb);
 	GstBuffer *detachBuffer(Stream *stream);
+	void recycle();
 
 	std::unique_ptr<Request> request_;
 	std::map<Stream *, GstBuffer *> buffers_;
 
-	GstClockTime latency_;
+	GstClockTime timestamp_;
+	GstClockTime frameDuration_;
 	GstClockTime pts_;
+
+	std::atomic<RequestWrap *> next_;
 };
 
-RequestWrap::RequestWrap(std::unique_ptr<Request> request)
-	: request_(std::move(request)), latency_(0), pts_(GST_CLOCK_TIME_NONE)
+RequestWrap::RequestWrap()
+	: timestamp_(0), frameDuration_(0), pts_(GST_CLOCK_TIME_NONE),
+	  next_(nullptr)
 {
 }
 
@@ -74,10 +78,9 @@ RequestWrap::~RequestWrap()
 	}
 }
 
-void RequestWrap::attachBuffer(Stream *stream, GstBuffer *buffer)
+void RequestWrap::attachBuffer(Stream *stream, GstBuffer *buffer,
+			       FrameBuffer *fb)
 {
-	FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
-
 	request_->addBuffer(stream, fb);
 
 	auto item = buffers_.find(stream);
@@ -102,6 +105,111 @@ GstBuffer *RequestWrap::detachBuffer(Stream *stream)
 	return buffer;
 }
 
+/*
+ * Prepare the wrap to be queued again. The buffers_ entries are kept, with no
+ * buffer attached, so that attaching buffers doesn't allocate map nodes.
+ */
+void RequestWrap::recycle()
+{
+	for (std::pair<Stream *const, GstBuffer *> &item : buffers_) {
+		if (item.second) {
+			gst_buffer_unref(item.second);
+			item.second = nullptr;
+		}
+	}
+
+	request_->reuse();
+
+	timestamp_ = 0;
+	frameDuration_ = 0;
+	pts_ = GST_CLOCK_TIME_NONE;
+}
+
+/*
+ * A lock-free queue handing completed requests from the camera thread to the
+ * streaming thread. This is an intrusive single consumer queue (as described
+ * by Dmitry Vyukov) linking the RequestWrap instances through their next_
+ * member, pushing never blocks nor allocates memory.
+ *
+ * A pop may fail while a push is in progress, even if earlier requests have
+ * been pushed. The size() is only updated once a push completes, and is thus
+ * a reliable indication that another pop should be attempted.
+ */
+class RequestQueue
+{
+public:
+	RequestQueue()
+		: head_(&stub_), tail_(&stub_), size_(0)
+	{
+	}
+
+	~RequestQueue()
+	{
+		clear();
+	}
+
+	/* Return the number of requests queued before this one. */
+	unsigned int push(std::unique_ptr<RequestWrap> wrap)
+	{
+		link(wrap.release());
+		return size_.fetch_add(1, std::memory_order_acq_rel);
+	}
+
+	std::unique_ptr<RequestWrap> pop()
+	{
+		RequestWrap *tail = tail_;
+		RequestWrap *next = tail->next_.load(std::memory_order_acquire);
+
+		if (tail == &stub_) {
+			if (!next)
+				return nullptr;
+
+			tail_ = tail = next;
+			next = next->next_.load(std::memory_order_acquire);
+		}
+
+		if (!next) {
+			/* Push the stub back to detach the last request. */
+			if (tail != head_.load(std::memory_order_acquire))
+				return nullptr;
+
+			link(&stub_);
+			next = tail->next_.load(std::memory_order_acquire);
+			if (!next)
+				return nullptr;
+		}
+
+		tail_ = next;
+		size_.fetch_sub(1, std::memory_order_acq_rel);
+
+		return std::unique_ptr<RequestWrap>(tail);
+	}
+
+	unsigned int size() const
+	{
+		return size_.load(std::memory_order_acquire);
+	}
+
+	void clear()
+	{
+		while (pop())
+			;
+	}
+
+private:
+	void link(RequestWrap *wrap)
+	{
+		wrap->next_.store(nullptr, std::memory_order_relaxed);
+		RequestWrap *prev = head_.exchange(wrap, std::memory_order_acq_rel);
+		prev->next_.store(wrap, std::memory_order_release);
+	}
+
+	RequestWrap stub_;
+	std::atomic<RequestWrap *> head_;
+	RequestWrap *tail_; /* Only accessed by the consumer */
+	std::atomic<unsigned int> size_;
+};
+
 /* Used for C++ object with destructors. */
 struct GstLibcameraSrcState {
 	GstLibcameraSrc *src_;
@@ -113,9 +221,24 @@ struct GstLibcameraSrcState {
 	std::vector<GstPad *> srcpads_; /* Protected by stream_lock */
 
 	/*
-	 * Contention on this lock_ must be minimized, as it has to be taken in
-	 * the realtime-sensitive requestCompleted() handler to protect
-	 * queuedRequests_ and completedRequests_.
+	 * The realtime-sensitive requestCompleted() handler doesn't take any
+	 * lock. Queued requests are owned by the camera, and referenced by the
+	 * request cookie, while completed requests are handed to the streaming
+	 * thread through a lock-free queue.
+	 */
+	std::atomic<unsigned int> queuedRequests_{ 0 };
+	RequestQueue completedRequests_;
+
+	/*
+	 * Requests are recycled once their buffers have been pushed, or when
+	 * they can't be queued, to avoid allocating a request per frame.
+	 * Cancelled requests are deleted in the camera thread.
+	 */
+	std::vector<std::unique_ptr<RequestWrap>> freeRequests_; /* Protected by stream_lock */
+
+	/*
+	 * The lock_ protects the import pool the streaming thread waits on for
+	 * a buffer, and whether waiting is allowed.
 	 *
 	 * stream_lock must be taken before lock_ in contexts where both locks
 	 * need to be taken. In particular, this means that the lock_ must not
@@ -123,16 +246,20 @@ struct GstLibcameraSrcState {
 	 * gst_pad_query()).
 	 */
 	GMutex lock_;
-	std::queue<std::unique_ptr<RequestWrap>> queuedRequests_;
-	std::queue<std::unique_ptr<RequestWrap>> completedRequests_;
+	GstLibcameraPool *blockingPool_ = nullptr;
+	bool flushing_ = false;
 
 	ControlList initControls_;
 	guint group_id_;
+	guint queueDepth_; /* Protected by stream_lock */
 
+	std::unique_ptr<RequestWrap> acquireRequest();
+	void releaseRequest(std::unique_ptr<RequestWrap> wrap);
 	int queueRequest();
 	void requestCompleted(Request *request);
 	int processRequest();
 	void clearRequests();
+	void unblock();
 };
 
 struct _GstLibcameraSrc {
@@ -143,6 +270,7 @@ struct _GstLibcameraSrc {
 
 	gchar *camera_name;
 	controls::AfModeEnum auto_focus_mode = controls::AfModeManual;
+	guint queue_depth;
 
 	std::atomic<GstEvent *> pending_eos;
 
@@ -155,6 +283,7 @@ enum {
 	PROP_0,
 	PROP_CAMERA_NAME,
 	PROP_AUTO_FOCUS_MODE,
+	PROP_QUEUE_DEPTH,
 };
 
 static void gst_libcamera_src_child_proxy_init(gpointer g_iface,
@@ -166,7 +295,13 @@ G_DEFINE_TYPE_WITH_CODE(GstLibcameraSrc, gst_libcamera_src, GST_TYPE_ELEMENT,
 			GST_DEBUG_CATEGORY_INIT(source_debug, "libcamerasrc", 0,
 						"libcamera Source"))
 
+#if GST_CHECK_VERSION(1, 24, 0)
+#define TEMPLATE_CAPS GST_STATIC_CAPS("video/x-raw; "				\
+				      "video/x-raw(memory:DMABuf), format=DMA_DRM; "	\
+				      "image/jpeg; video/x-bayer")
+#else
 #define TEMPLATE_CAPS GST_STATIC_CAPS("video/x-raw; image/jpeg; video/x-bayer")
+#endif
 
 /* For the simple case, we have a src pad that is always present. */
 GstStaticPadTemplate src_template = {
@@ -178,44 +313,98 @@ GstStaticPadTemplate request_src_template = {
 	"src_%u", GST_PAD_SRC, GST_PAD_REQUEST, TEMPLATE_CAPS
 };
 
+/* Must be called with stream_lock held. */
+std::unique_ptr<RequestWrap> GstLibcameraSrcState::acquireRequest()
+{
+	if (!freeRequests_.empty()) {
+		std::unique_ptr<RequestWrap> wrap = std::move(freeRequests_.back());
+		freeRequests_.pop_back();
+		return wrap;
+	}
+
+	/* The cookie is preserved when the request is reused. */
+	std::unique_ptr<RequestWrap> wrap = std::make_unique<RequestWrap>();
+	wrap->request_ = cam_->createRequest(reinterpret_cast<uint64_t>(wrap.get()));
+	if (!wrap->request_)
+		return nullptr;
+
+	return wrap;
+}
+
+/* Must be called with stream_lock held. */
+void GstLibcameraSrcState::releaseRequest(std::unique_ptr<RequestWrap> wrap)
+{
+	wrap->recycle();
+	freeRequests_.push_back(std::move(wrap));
+}
+
 /* Must be called with stream_lock held. */
 int GstLibcameraSrcState::queueRequest()
 {
-	std::unique_ptr<Request> request = cam_->createRequest();
-	if (!request)
-		return -ENOMEM;
+	if (queueDepth_ && queuedRequests_ >= queueDepth_)
+		return -ENOBUFS;
 
-	std::unique_ptr<RequestWrap> wrap =
-		std::make_unique<RequestWrap>(std::move(request));
+	std::unique_ptr<RequestWrap> wrap = acquireRequest();
+	if (!wrap)
+		return -ENOMEM;
 
 	for (GstPad *srcpad : srcpads_) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
 		GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
+		bool import = gst_libcamera_pool_is_import(pool);
+		bool wait = false;
 		GstBuffer *buffer;
+		FrameBuffer *fb;
 		GstFlowReturn ret;
 
-		ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool),
-						     &buffer, nullptr);
+		/*
+		 * Downstream pools don't notify when buffers are released.
+		 * Wait for a buffer when no request is in flight, as nothing
+		 * would resume the task otherwise. Waiting with requests in
+		 * flight could deadlock, as the completed requests hold the
+		 * buffers downstream waits for.
+		 */
+		if (import) {
+			GLibLocker locker(&lock_);
+			wait = !flushing_ && !queuedRequests_ &&
+			       !completedRequests_.size();
+			if (wait)
+				blockingPool_ = pool;
+		}
+
+		ret = gst_libcamera_pool_acquire_frame(pool, &buffer, &fb, wait);
+
+		if (wait) {
+			GLibLocker locker(&lock_);
+			blockingPool_ = nullptr;
+		}
+
 		if (ret != GST_FLOW_OK) {
 			/*
-			 * RequestWrap has ownership of the request, and we
-			 * won't be queueing this one due to lack of buffers.
+			 * We won't be queueing this request due to lack of
+			 * buffers, return the buffers attached so far to their
+			 * pools and keep the request for later.
 			 */
-			return -ENOBUFS;
+			releaseRequest(std::move(wrap));
+			return import && ret == GST_FLOW_EOS ? -EAGAIN : -ENOBUFS;
 		}
 
-		wrap->attachBuffer(stream, buffer);
+		wrap->attachBuffer(stream, buffer, fb);
 	}
 
 	GST_TRACE_OBJECT(src_, "Requesting buffers");
-	cam_->queueRequest(wrap->request_.get());
 
-	{
-		GLibLocker locker(&lock_);
-		queuedRequests_.push(std::move(wrap));
+	/* The camera owns the RequestWrap until the request completes. */
+	queuedRequests_++;
+	int ret = cam_->queueRequest(wrap->request_.get());
+	if (ret < 0) {
+		queuedRequests_--;
+		releaseRequest(std::move(wrap));
+		return ret;
 	}
 
-	/* The RequestWrap will be deleted in the completion handler. */
+	wrap.release();
+
 	return 0;
 }
 
@@ -224,15 +413,8 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 {
 	GST_DEBUG_OBJECT(src_, "buffers are ready");
 
-	std::unique_ptr<RequestWrap> wrap;
-
-	{
-		GLibLocker locker(&lock_);
-		wrap = std::move(queuedRequests_.front());
-		queuedRequests_.pop();
-	}
-
-	g_return_if_fail(wrap->request_.get() == request);
+	std::unique_ptr<RequestWrap> wrap(reinterpret_cast<RequestWrap *>(request->cookie()));
+	queuedRequests_--;
 
 	if ((request->status() == Request::RequestCancelled)) {
 		GST_DEBUG_OBJECT(src_, "Request was cancelled");
@@ -250,62 +432,67 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 		/* Deduced from: sys_now - sys_base_time == gst_now - gst_base_time */
 		GstClockTime sys_base_time = sys_now - (gst_now - gst_base_time);
 		wrap->pts_ = timestamp - sys_base_time;
-		wrap->latency_ = sys_now - timestamp;
-	}
+		wrap->timestamp_ = timestamp;
 
-	{
-		GLibLocker locker(&lock_);
-		completedRequests_.push(std::move(wrap));
+		const auto &duration = request->metadata().get(controls::FrameDuration);
+		wrap->frameDuration_ = duration.value_or(0) * 1000;
 	}
 
-	gst_task_resume(src_->task);
+	/*
+	 * Only resume the task when the queue was empty, the streaming thread
+	 * processes all the requests that complete in the meantime.
+	 */
+	if (!completedRequests_.push(std::move(wrap)))
+		gst_task_resume(src_->task);
 }
 
 /* Must be called with stream_lock held. */
 int GstLibcameraSrcState::processRequest()
 {
-	std::unique_ptr<RequestWrap> wrap;
-	int err = 0;
-
-	{
-		GLibLocker locker(&lock_);
-
-		if (!completedRequests_.empty()) {
-			wrap = std::move(completedRequests_.front());
-			completedRequests_.pop();
-		}
-
-		if (completedRequests_.empty())
-			err = -ENOBUFS;
-	}
+	std::unique_ptr<RequestWrap> wrap = completedRequests_.pop();
+	int err = completedRequests_.size() ? 0 : -ENOBUFS;
 
 	if (!wrap)
-		return -ENOBUFS;
+		return err;
 
 	GstFlowReturn ret = GST_FLOW_OK;
 	gst_flow_combiner_reset(src_->flow_combiner);
 
+	/*
+	 * The minimum latency is the delay between the capture and the push,
+	 * measured on the current frame. Up to the number of requests in
+	 * flight can be captured ahead of it, which bounds the maximum latency.
+	 */
+	GstClockTime min_latency = g_get_monotonic_time() * 1000 - wrap->timestamp_;
+	GstClockTime max_latency = min_latency + wrap->frameDuration_ *
+		(queueDepth_ ? queueDepth_ : config_->at(0).bufferCount);
+
 	for (GstPad *srcpad : srcpads_) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
 		GstBuffer *buffer = wrap->detachBuffer(stream);
 
-		FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
+		FrameBuffer *fb = wrap->request_->findBuffer(stream);
 
 		if (GST_CLOCK_TIME_IS_VALID(wrap->pts_)) {
 			GST_BUFFER_PTS(buffer) = wrap->pts_;
-			gst_libcamera_pad_set_latency(srcpad, wrap->latency_);
+			gst_libcamera_pad_set_latency(srcpad, min_latency, max_latency);
 		} else {
 			GST_BUFFER_PTS(buffer) = 0;
 		}
 
+		/* Buffers of the libcamera pools carry a pooled meta already. */
+		gst_libcamera_buffer_add_video_meta(buffer, stream->configuration());
+
 		GST_BUFFER_OFFSET(buffer) = fb->metadata().sequence;
 		GST_BUFFER_OFFSET_END(buffer) = fb->metadata().sequence;
 
-		ret = gst_pad_push(srcpad, buffer);
+		ret = gst_libcamera_pad_push(srcpad, buffer);
 		ret = gst_flow_combiner_update_pad_flow(src_->flow_combiner,
 							srcpad, ret);
 	}
 
+	releaseRequest(std::move(wrap));
+
 	switch (ret) {
 	case GST_FLOW_OK:
 		break;
@@ -331,7 +518,7 @@ int GstLibcameraSrcState::processRequest()
 		guint32 seqnum = gst_util_seqnum_next();
 		gst_event_set_seqnum(eos, seqnum);
 		for (GstPad *srcpad : srcpads_)
-			gst_pad_push_event(srcpad, gst_event_ref(eos));
+			gst_libcamera_pad_push_event(srcpad, gst_event_ref(eos));
 
 		err = -EPIPE;
 		break;
@@ -353,8 +540,28 @@ int GstLibcameraSrcState::processRequest()
 
 void GstLibcameraSrcState::clearRequests()
 {
-	GLibLocker locker(&lock_);
-	completedRequests_ = {};
+	completedRequests_.clear();
+	freeRequests_.clear();
+}
+
+/*
+ * Prevent the streaming thread from waiting for buffers, or for room in the
+ * queues of the pad push threads, until restarted.
+ */
+void GstLibcameraSrcState::unblock()
+{
+	{
+		GLibLocker locker(&lock_);
+
+		flushing_ = true;
+		if (blockingPool_)
+			gst_libcamera_pool_set_flushing(blockingPool_);
+	}
+
+	/* The streaming thread holds the stream_lock, walk the element pads. */
+	GLibLocker locker(GST_OBJECT(src_));
+	for (GList *item = GST_ELEMENT(src_)->srcpads; item; item = item->next)
+		gst_libcamera_pad_set_flushing(GST_PAD(item->data));
 }
 
 static bool
@@ -419,6 +626,40 @@ gst_libcamera_src_open(GstLibcameraSrc *self)
 	return true;
 }
 
+/*
+ * Create a pool importing the buffers of the pool proposed by downstream in
+ * the allocation query, if any. Return nullptr if the proposed pool doesn't
+ * produce dmabufs the camera can capture into.
+ */
+static GstLibcameraPool *
+gst_libcamera_src_import_pool(GstLibcameraSrc *self, GstPad *srcpad,
+			      GstCaps *caps, Stream *stream)
+{
+	g_autoptr(GstQuery) query = gst_query_new_allocation(caps, TRUE);
+	GstBufferPool *downstream = nullptr;
+	guint size, min, max;
+
+	if (!gst_pad_peer_query(srcpad, query) ||
+	    !gst_query_get_n_allocation_pools(query))
+		return nullptr;
+
+	gst_query_parse_nth_allocation_pool(query, 0, &downstream, &size, &min, &max);
+	if (!downstream)
+		return nullptr;
+
+	gboolean video_meta = gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE,
+							     nullptr);
+	GstLibcameraPool *pool = gst_libcamera_pool_new_import(downstream, stream, caps,
+							       min, video_meta);
+	if (!pool)
+		GST_DEBUG_OBJECT(self, "Can't import buffers from %" GST_PTR_FORMAT,
+				 downstream);
+
+	gst_object_unref(downstream);
+
+	return pool;
+}
+
 /* Must be called with stream_lock held. */
 static bool
 gst_libcamera_src_negotiate(GstLibcameraSrc *self)
@@ -462,7 +703,13 @@ gst_libcamera_src_negotiate(GstLibcameraSrc *self)
 	/*
 	 * Regardless if it has been modified, create clean caps and push the
 	 * caps event. Downstream will decide if the caps are acceptable.
+	 *
+	 * Then capture directly into the buffers of the pool proposed by
+	 * downstream when it can be imported, to avoid copies in downstream
+	 * elements that require their own memory.
 	 */
+	std::vector<GstLibcameraPool *> pools;
+
 	for (gsize i = 0; i < state->srcpads_.size(); i++) {
 		GstPad *srcpad = state->srcpads_[i];
 		const StreamConfiguration &stream_cfg = state->config_->at(i);
@@ -470,29 +717,47 @@ gst_libcamera_src_negotiate(GstLibcameraSrc *self)
 		g_autoptr(GstCaps) caps = gst_libcamera_stream_configuration_to_caps(stream_cfg);
 		gst_libcamera_framerate_to_caps(caps, element_caps);
 
-		if (!gst_pad_push_event(srcpad, gst_event_new_caps(caps)))
+		if (!gst_libcamera_pad_push_event(srcpad, gst_event_new_caps(caps))) {
+			for (GstLibcameraPool *pool : pools)
+				g_clear_object(&pool);
 			return false;
+		}
+
+		pools.push_back(gst_libcamera_src_import_pool(self, srcpad, caps,
+							      stream_cfg.stream()));
 	}
 
 	if (self->allocator)
 		g_clear_object(&self->allocator);
 
-	self->allocator = gst_libcamera_allocator_new(state->cam_, state->config_.get());
-	if (!self->allocator) {
-		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
-				  ("Failed to allocate memory"),
-				  ("gst_libcamera_allocator_new() failed."));
-		return false;
+	/* Allocate buffers from the camera unless all the pools are imported. */
+	if (std::find(pools.begin(), pools.end(), nullptr) != pools.end()) {
+		self->allocator = gst_libcamera_allocator_new(state->cam_, state->config_.get());
+		if (!self->allocator) {
+			for (GstLibcameraPool *pool : pools)
+				g_clear_object(&pool);
+
+			GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
+					  ("Failed to allocate memory"),
+					  ("gst_libcamera_allocator_new() failed."));
+			return false;
+		}
 	}
 
 	for (gsize i = 0; i < state->srcpads_.size(); i++) {
 		GstPad *srcpad = state->srcpads_[i];
 		const StreamConfiguration &stream_cfg = state->config_->at(i);
+		GstLibcameraPool *pool = pools[i];
 
-		GstLibcameraPool *pool = gst_libcamera_pool_new(self->allocator,
-								stream_cfg.stream());
-		g_signal_connect_swapped(pool, "buffer-notify",
-					 G_CALLBACK(gst_task_resume), self->task);
+		if (pool) {
+			GST_INFO_OBJECT(self, "Importing buffers from downstream on %s",
+					GST_PAD_NAME(srcpad));
+		} else {
+			pool = gst_libcamera_pool_new(self->allocator,
+						      stream_cfg.stream());
+			g_signal_connect_swapped(pool, "buffer-notify",
+						 G_CALLBACK(gst_task_resume), self->task);
+		}
 
 		gst_libcamera_pad_set_pool(srcpad, pool);
 
@@ -526,7 +791,7 @@ gst_libcamera_src_task_run(gpointer user_data)
 	g_autoptr(GstEvent) event = self->pending_eos.exchange(nullptr);
 	if (event) {
 		for (GstPad *srcpad : state->srcpads_)
-			gst_pad_push_event(srcpad, gst_event_ref(event));
+			gst_libcamera_pad_push_event(srcpad, gst_event_ref(event));
 
 		return;
 	}
@@ -580,6 +845,14 @@ gst_libcamera_src_task_run(gpointer user_data)
 		gst_task_stop(self->task);
 		return;
 
+	case -EAGAIN:
+		/*
+		 * A downstream pool has no buffer available. Iterate again to
+		 * wait for one if no queued request will resume the task.
+		 */
+		doResume = !state->queuedRequests_;
+		break;
+
 	case -ENOBUFS:
 	default:
 		break;
@@ -621,15 +894,27 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 
 	GST_DEBUG_OBJECT(self, "Streaming thread has started");
 
+	{
+		GLibLocker locker(&state->lock_);
+		state->flushing_ = false;
+	}
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		state->queueDepth_ = self->queue_depth;
+	}
+
 	gint stream_id_num = 0;
 	std::vector<StreamRole> roles;
 	for (GstPad *srcpad : state->srcpads_) {
+		gst_libcamera_pad_start(srcpad);
+
 		/* Create stream-id and push stream-start. */
 		g_autofree gchar *stream_id_intermediate = g_strdup_printf("%i%i", state->group_id_, stream_id_num++);
 		g_autofree gchar *stream_id = gst_pad_create_stream_id(srcpad, GST_ELEMENT(self), stream_id_intermediate);
 		GstEvent *event = gst_event_new_stream_start(stream_id);
 		gst_event_set_group_id(event, state->group_id_);
-		gst_pad_push_event(srcpad, event);
+		gst_libcamera_pad_push_event(srcpad, event);
 
 		/* Collect the streams roles for the next iteration. */
 		roles.push_back(gst_libcamera_pad_get_role(srcpad));
@@ -660,7 +945,7 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		/* Send an open segment event with time format. */
 		GstSegment segment;
 		gst_segment_init(&segment, GST_FORMAT_TIME);
-		gst_pad_push_event(srcpad, gst_event_new_segment(&segment));
+		gst_libcamera_pad_push_event(srcpad, gst_event_new_segment(&segment));
 	}
 
 	if (self->auto_focus_mode != controls::AfModeManual) {
@@ -683,6 +968,14 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		gst_task_stop(task);
 		return;
 	}
+
+	/*
+	 * Fill the pipeline up to the queue depth, or with all the available
+	 * buffers, before the first iteration. The task then keeps it filled
+	 * as requests complete.
+	 */
+	while (!state->queueRequest())
+		;
 }
 
 static void
@@ -700,8 +993,10 @@ gst_libcamera_src_task_leave([[maybe_unused]] GstTask *task,
 
 	{
 		GLibRecLocker locker(&self->stream_lock);
-		for (GstPad *srcpad : state->srcpads_)
+		for (GstPad *srcpad : state->srcpads_) {
+			gst_libcamera_pad_stop(srcpad);
 			gst_libcamera_pad_set_pool(srcpad, nullptr);
+		}
 	}
 
 	g_clear_object(&self->allocator);
@@ -745,6 +1040,9 @@ gst_libcamera_src_set_property(GObject *object, guint prop_id,
 	case PROP_AUTO_FOCUS_MODE:
 		self->auto_focus_mode = static_cast<controls::AfModeEnum>(g_value_get_enum(value));
 		break;
+	case PROP_QUEUE_DEPTH:
+		self->queue_depth = g_value_get_uint(value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -765,6 +1063,9 @@ gst_libcamera_src_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_AUTO_FOCUS_MODE:
 		g_value_set_enum(value, static_cast<gint>(self->auto_focus_mode));
 		break;
+	case PROP_QUEUE_DEPTH:
+		g_value_set_uint(value, self->queue_depth);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -778,6 +1079,14 @@ gst_libcamera_src_change_state(GstElement *element, GstStateChange transition)
 	GstStateChangeReturn ret = GST_STATE_CHANGE_SUCCESS;
 	GstElementClass *klass = GST_ELEMENT_CLASS(gst_libcamera_src_parent_class);
 
+	/*
+	 * The streaming thread may wait for a buffer from a downstream pool,
+	 * and the pad push threads for buffers to push. Unblock them before
+	 * pads deactivation.
+	 */
+	if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+		self->state->unblock();
+
 	ret = klass->change_state(element, transition);
 	if (ret == GST_STATE_CHANGE_FAILURE)
 		return ret;
@@ -801,13 +1110,6 @@ gst_libcamera_src_change_state(GstElement *element, GstStateChange transition)
 		ret = GST_STATE_CHANGE_NO_PREROLL;
 		break;
 	case GST_STATE_CHANGE_PAUSED_TO_READY:
-		/*
-		 * \todo this might require some thread unblocking in the future
-		 * if the streaming thread starts doing any kind of blocking
-		 * operations. If this was the case, we would need to do so
-		 * before pad deactivation, so before chaining to the parent
-		 * change_state function.
-		 */
 		gst_task_join(self->task);
 		break;
 	case GST_STATE_CHANGE_READY_TO_NULL:
@@ -975,6 +1277,15 @@ gst_libcamera_src_class_init(GstLibcameraSrcClass *klass)
 				 static_cast<gint>(controls::AfModeManual),
 				 G_PARAM_WRITABLE);
 	g_object_class_install_property(object_class, PROP_AUTO_FOCUS_MODE, spec);
+
+	spec = g_param_spec_uint("queue-depth", "Queue Depth",
+				 "Maximum number of requests queued to the camera, "
+				 "0 to queue as many as buffers are available.",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(GST_PARAM_MUTABLE_READY
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_QUEUE_DEPTH, spec);
 }
 
 /* GstChildProxy implementation */
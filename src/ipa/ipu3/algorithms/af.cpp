@@ -359,21 +359,40 @@ void Af::afIgnoreFrameReset()
  */
 double Af::afEstimateVariance(Span<const y_table_item_t> y_items, bool isY1)
 {
-	uint32_t total = 0;
-	double mean;
-	double var_sum = 0;
+	if (y_items.empty())
+		return 0.0;
 
-	for (auto y : y_items)
-		total += isY1 ? y.y1_avg : y.y2_avg;
+	/*
+	 * Accumulate the sum and the sum of squares in a single pass, with
+	 * integer arithmetic. The values are 16-bit wide, so the sums can't
+	 * overflow for the largest AF grid. The variance is then computed
+	 * around the mean truncated to an integer, as for a two-pass
+	 * computation:
+	 *
+	 *     sum((y - mean)^2) = sum(y^2) - 2 * mean * sum(y) + n * mean^2
+	 */
+	auto accumulate = [&](auto value) {
+		uint64_t sum = 0;
+		uint64_t sumSquares = 0;
+
+		for (const y_table_item_t &y : y_items) {
+			uint64_t v = value(y);
+			sum += v;
+			sumSquares += v * v;
+		}
 
-	mean = total / y_items.size();
+		return std::make_pair(sum, sumSquares);
+	};
 
-	for (auto y : y_items) {
-		double avg = isY1 ? y.y1_avg : y.y2_avg;
-		var_sum += pow(avg - mean, 2);
-	}
+	auto [total, totalSquares] = isY1
+		? accumulate([](const y_table_item_t &y) { return y.y1_avg; })
+		: accumulate([](const y_table_item_t &y) { return y.y2_avg; });
+
+	uint64_t count = y_items.size();
+	uint64_t mean = total / count;
+	int64_t varSum = totalSquares - 2 * mean * total + count * mean * mean;
 
-	return var_sum / y_items.size();
+	return static_cast<double>(varSum) / count;
 }
 
 /**
@@ -122,12 +122,14 @@ int Agc::configure(IPAContext &context,
 	return 0;
 }
 
-Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
-			       const ipu3_uapi_grid_config &grid)
+void Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
+			  const ipu3_uapi_grid_config &grid)
 {
 	uint32_t hist[knumHistogramBins] = { 0 };
 
-	rgbTriples_.clear();
+	redSum_.reset();
+	greenSum_.reset();
+	blueSum_.reset();
 
 	for (unsigned int cellY = 0; cellY < grid.height; cellY++) {
 		for (unsigned int cellX = 0; cellX < grid.width; cellX++) {
@@ -137,11 +139,9 @@ Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
 				reinterpret_cast<const ipu3_uapi_awb_set_item *>(
 					&stats->awb_raw_buffer.meta_data[cellPosition]);
 
-			rgbTriples_.push_back({
-				cell->R_avg,
-				(cell->Gr_avg + cell->Gb_avg) / 2,
-				cell->B_avg
-			});
+			redSum_.add(cell->R_avg);
+			greenSum_.add((cell->Gr_avg + cell->Gb_avg) / 2);
+			blueSum_.add(cell->B_avg);
 
 			/*
 			 * Store the average green value to estimate the
@@ -152,7 +152,11 @@ Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
 		}
 	}
 
-	return Histogram(Span<uint32_t>(hist));
+	redSum_.update();
+	greenSum_.update();
+	blueSum_.update();
+
+	hist_.assign(Span<uint32_t>(hist));
 }
 
 /**
@@ -177,13 +181,9 @@ Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
  */
 double Agc::estimateLuminance(double gain) const
 {
-	double redSum = 0, greenSum = 0, blueSum = 0;
-
-	for (unsigned int i = 0; i < rgbTriples_.size(); i++) {
-		redSum += std::min(std::get<0>(rgbTriples_[i]) * gain, 255.0);
-		greenSum += std::min(std::get<1>(rgbTriples_[i]) * gain, 255.0);
-		blueSum += std::min(std::get<2>(rgbTriples_[i]) * gain, 255.0);
-	}
+	double redSum = redSum_.sum(gain);
+	double greenSum = greenSum_.sum(gain);
+	double blueSum = blueSum_.sum(gain);
 
 	double ySum = redSum * rGain_ * 0.299
 		    + greenSum * gGain_ * 0.587
@@ -208,7 +208,7 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 		  const ipu3_uapi_stats_3a *stats,
 		  ControlList &metadata)
 {
-	Histogram hist = parseStatistics(stats, context.configuration.grid.bdsGrid);
+	parseStatistics(stats, context.configuration.grid.bdsGrid);
 	rGain_ = context.activeState.awb.gains.red;
 	gGain_ = context.activeState.awb.gains.blue;
 	bGain_ = context.activeState.awb.gains.green;
@@ -226,7 +226,7 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	double aGain, dGain;
 	std::tie(shutterTime, aGain, dGain) =
 		calculateNewEv(context.activeState.agc.constraintMode,
-			       context.activeState.agc.exposureMode, hist,
+			       context.activeState.agc.exposureMode, hist_,
 			       effectiveExposureValue);
 
 	LOG(IPU3Agc, Debug)
@@ -353,41 +353,57 @@ void Awb::generateZones()
 /* Translate the IPU3 statistics into the default statistics zone array */
 void Awb::generateAwbStats(const ipu3_uapi_stats_3a *stats)
 {
+	const ipu3_uapi_awb_set_item *cells = stats->awb_raw_buffer.meta_data;
+
 	/*
 	 * Generate a (kAwbStatsSizeX x kAwbStatsSizeY) array from the IPU3 grid which is
 	 * (grid.width x grid.height).
+	 *
+	 * The cells are traversed in memory order, one line at a time,
+	 * accumulating each run of cellsPerZoneX_ cells into the zone it
+	 * belongs to. This avoids computing the zone of every cell, and keeps
+	 * the accumulators of a line of zones hot in the cache.
 	 */
-	for (unsigned int cellY = 0; cellY < kAwbStatsSizeY * cellsPerZoneY_; cellY++) {
-		for (unsigned int cellX = 0; cellX < kAwbStatsSizeX * cellsPerZoneX_; cellX++) {
-			uint32_t cellPosition = cellY * stride_ + cellX;
-			uint32_t zoneX = cellX / cellsPerZoneX_;
-			uint32_t zoneY = cellY / cellsPerZoneY_;
-
-			uint32_t awbZonePosition = zoneY * kAwbStatsSizeX + zoneX;
-
-			/* Cast the initial IPU3 structure to simplify the reading */
-			const ipu3_uapi_awb_set_item *currentCell =
-				reinterpret_cast<const ipu3_uapi_awb_set_item *>(
-					&stats->awb_raw_buffer.meta_data[cellPosition]
-				);
-
-			/*
-			 * Use cells which have less than 90%
-			 * saturation as an initial means to include
-			 * otherwise bright cells which are not fully
-			 * saturated.
-			 *
-			 * \todo The 90% saturation rate may require
-			 * further empirical measurements and
-			 * optimisation during camera tuning phases.
-			 */
-			if (currentCell->sat_ratio <= kMinCellsPerZoneRatio) {
-				/* The cell is not saturated, use the current cell */
-				awbStats_[awbZonePosition].counted++;
-				uint32_t greenValue = currentCell->Gr_avg + currentCell->Gb_avg;
-				awbStats_[awbZonePosition].sum.green += greenValue / 2;
-				awbStats_[awbZonePosition].sum.red += currentCell->R_avg;
-				awbStats_[awbZonePosition].sum.blue += currentCell->B_avg;
+	for (unsigned int zoneY = 0; zoneY < kAwbStatsSizeY; zoneY++) {
+		Accumulator *zones = &awbStats_[zoneY * kAwbStatsSizeX];
+
+		for (unsigned int y = 0; y < cellsPerZoneY_; y++) {
+			unsigned int cellY = zoneY * cellsPerZoneY_ + y;
+			const ipu3_uapi_awb_set_item *cell = &cells[cellY * stride_];
+
+			for (unsigned int zoneX = 0; zoneX < kAwbStatsSizeX; zoneX++) {
+				unsigned int counted = 0;
+				uint32_t red = 0;
+				uint32_t green = 0;
+				uint32_t blue = 0;
+
+				for (unsigned int x = 0; x < cellsPerZoneX_; x++, cell++) {
+					/*
+					 * Use cells which have less than 90%
+					 * saturation as an initial means to
+					 * include otherwise bright cells which
+					 * are not fully saturated.
+					 *
+					 * The accumulation is branchless to
+					 * let the compiler vectorize the loop.
+					 *
+					 * \todo The 90% saturation rate may
+					 * require further empirical
+					 * measurements and optimisation during
+					 * camera tuning phases.
+					 */
+					uint32_t valid = cell->sat_ratio <= kMinCellsPerZoneRatio;
+
+					counted += valid;
+					green += valid * ((cell->Gr_avg + cell->Gb_avg) / 2);
+					red += valid * cell->R_avg;
+					blue += valid * cell->B_avg;
+				}
+
+				zones[zoneX].counted += counted;
+				zones[zoneX].sum.green += green;
+				zones[zoneX].sum.red += red;
+				zones[zoneX].sum.blue += blue;
 			}
 		}
 	}
@@ -224,6 +224,7 @@ void IPAIPU3::updateSessionConfiguration(const ControlInfoMap &sensorControls)
 	 */
 	context_.configuration.agc.minShutterSpeed = minExposure * context_.configuration.sensor.lineDuration;
 	context_.configuration.agc.maxShutterSpeed = maxExposure * context_.configuration.sensor.lineDuration;
+	camHelper_->setGainCodeRange(minGain, maxGain);
 	context_.configuration.agc.minAnalogueGain = camHelper_->gain(minGain);
 	context_.configuration.agc.maxAnalogueGain = camHelper_->gain(maxGain);
 }
@@ -362,6 +363,7 @@ int IPAIPU3::start()
 	 * Set the sensors V4L2 controls before the first frame to ensure that
 	 * we have an expected and known configuration from the start.
 	 */
+	resetTimings();
 	setControls(0);
 
 	return 0;
@@ -372,6 +374,7 @@ int IPAIPU3::start()
  */
 void IPAIPU3::stop()
 {
+	logTimings();
 	context_.frameContexts.clear();
 }
 
@@ -494,6 +497,9 @@ int IPAIPU3::configure(const IPAConfigInfo &configInfo,
 
 	/* Update the IPASessionConfiguration using the sensor settings. */
 	updateSessionConfiguration(sensorCtrls_);
+	setFrameDuration(context_.configuration.sensor.lineDuration *
+			 (sensorInfo_.outputSize.height +
+			  context_.configuration.sensor.defVBlank));
 
 	for (auto const &algo : algorithms()) {
 		int ret = algo->configure(context_, configInfo);
@@ -565,8 +571,7 @@ void IPAIPU3::fillParamsBuffer(const uint32_t frame, const uint32_t bufferId)
 
 	IPAFrameContext &frameContext = context_.frameContexts.get(frame);
 
-	for (auto const &algo : algorithms())
-		algo->prepare(context_, frame, frameContext, params);
+	prepare(context_, frame, frameContext, params);
 
 	paramsBufferReady.emit(frame);
 }
@@ -603,8 +608,7 @@ void IPAIPU3::processStatsBuffer(const uint32_t frame,
 
 	ControlList metadata(controls::controls);
 
-	for (auto const &algo : algorithms())
-		algo->process(context_, frame, frameContext, stats, metadata);
+	process(context_, frame, frameContext, stats, metadata);
 
 	setControls(frame);
 
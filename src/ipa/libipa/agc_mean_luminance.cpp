@@ -392,6 +392,91 @@ void AgcMeanLuminance::setLimits(utils::Duration minShutter,
  * \brief Get the constraint modes that have been parsed from tuning data
  */
 
+/**
+ * \class AgcMeanLuminance::SaturatedSum
+ * \brief Sum of 8-bit zone values scaled by a gain and saturated to 255
+ *
+ * The luminance estimation performed by derived classes typically sums the
+ * mean values of all statistics zones, multiplied by a gain and saturated to
+ * the maximum value. As estimateLuminance() is called repeatedly with
+ * different gains for the same statistics, computing the sum zone by zone
+ * costs as many iterations over the zones.
+ *
+ * This class instead records the distribution of the zone values once per
+ * frame, with add() and update(). The saturated sum for any gain is then
+ * computed in constant time by sum(), independently of the number of zones.
+ */
+
+/**
+ * \brief Construct an empty SaturatedSum
+ */
+AgcMeanLuminance::SaturatedSum::SaturatedSum()
+{
+	reset();
+	update();
+}
+
+/**
+ * \brief Remove all the values from the sum
+ *
+ * update() shall be called after adding the new values.
+ */
+void AgcMeanLuminance::SaturatedSum::reset()
+{
+	counts_.fill(0);
+}
+
+/**
+ * \fn AgcMeanLuminance::SaturatedSum::add()
+ * \brief Add a zone value to the sum
+ * \param[in] value The zone value
+ */
+
+/**
+ * \brief Update the sum after adding values
+ *
+ * This function shall be called after adding all the values for a frame, and
+ * before calling sum() or size().
+ */
+void AgcMeanLuminance::SaturatedSum::update()
+{
+	uint32_t count = 0;
+	uint64_t sum = 0;
+
+	for (unsigned int value = 0; value < counts_.size(); value++) {
+		count += counts_[value];
+		sum += static_cast<uint64_t>(value) * counts_[value];
+		cumulativeCounts_[value] = count;
+		cumulativeSums_[value] = sum;
+	}
+
+	size_ = count;
+}
+
+/**
+ * \fn AgcMeanLuminance::SaturatedSum::size()
+ * \brief Retrieve the number of values in the sum
+ * \return The number of values
+ */
+
+/**
+ * \brief Compute the sum of all values multiplied by \a gain, saturated to 255
+ * \param[in] gain The gain applied to the values
+ *
+ * The result is equal to the sum of min(value * gain, 255) over all values.
+ *
+ * \return The saturated sum
+ */
+double AgcMeanLuminance::SaturatedSum::sum(double gain) const
+{
+	/* Values above the limit saturate when multiplied by the gain. */
+	unsigned int limit = gain > 1.0 ? static_cast<unsigned int>(255.0 / gain)
+					: 255;
+
+	return gain * cumulativeSums_[limit] +
+	       255.0 * (size_ - cumulativeCounts_[limit]);
+}
+
 /**
  * \fn AgcMeanLuminance::exposureModeHelpers()
  * \brief Get the ExposureModeHelpers that have been parsed from tuning data
@@ -7,8 +7,10 @@
 
 #pragma once
 
+#include <array>
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <tuple>
 #include <vector>
 
@@ -71,6 +73,26 @@ public:
 		frameCount_ = 0;
 	}
 
+protected:
+	class SaturatedSum
+	{
+	public:
+		SaturatedSum();
+
+		void reset();
+		void add(uint8_t value) { counts_[value]++; }
+		void update();
+
+		unsigned int size() const { return size_; }
+		double sum(double gain) const;
+
+	private:
+		std::array<uint32_t, 256> counts_;
+		std::array<uint32_t, 256> cumulativeCounts_;
+		std::array<uint64_t, 256> cumulativeSums_;
+		unsigned int size_;
+	};
+
 private:
 	virtual double estimateLuminance(const double gain) const = 0;
 
@@ -164,6 +164,18 @@ namespace ipa {
  * corresponding to the factory
  */
 
+/**
+ * \fn AlgorithmFactory::overridesProcess()
+ * \brief Check if the Algorithm subclass implements process()
+ *
+ * The Module skips the algorithms that don't override Algorithm::process()
+ * when processing statistics, to avoid calling empty functions for every
+ * frame.
+ *
+ * \return True if the Algorithm subclass overrides Algorithm::process(), false
+ * otherwise
+ */
+
 /**
  * \def REGISTER_IPA_ALGORITHM
  * \brief Register an algorithm with the IPA module
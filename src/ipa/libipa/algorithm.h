@@ -9,6 +9,7 @@
 #include <memory>
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 
 #include <libcamera/controls.h>
 
@@ -76,6 +77,7 @@ public:
 	const std::string &name() const { return name_; }
 
 	virtual std::unique_ptr<Algorithm<_Module>> create() const = 0;
+	virtual bool overridesProcess() const = 0;
 
 private:
 	std::string name_;
@@ -96,6 +98,14 @@ public:
 	{
 		return std::make_unique<_Algorithm>();
 	}
+
+	bool overridesProcess() const override
+	{
+		using Base = Algorithm<typename _Algorithm::Module>;
+
+		return !std::is_same_v<decltype(&_Algorithm::process),
+				       decltype(&Base::process)>;
+	}
 };
 
 #define REGISTER_IPA_ALGORITHM(algorithm, name) \
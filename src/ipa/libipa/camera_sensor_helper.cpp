@@ -7,6 +7,7 @@
  */
 #include "camera_sensor_helper.h"
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
@@ -88,6 +89,12 @@ uint32_t CameraSensorHelper::gainCode(double gain) const
 {
 	const AnalogueGainConstants &k = gainConstants_;
 
+	if (!gainTable_.empty() && gain >= gainTable_.front() &&
+	    gain <= gainTable_.back()) {
+		auto iter = std::upper_bound(gainTable_.begin(), gainTable_.end(), gain);
+		return gainTableMin_ + (iter - gainTable_.begin()) - 1;
+	}
+
 	switch (gainType_) {
 	case AnalogueGainLinear:
 		ASSERT(k.linear.m0 == 0 || k.linear.m1 == 0);
@@ -121,6 +128,9 @@ double CameraSensorHelper::gain(uint32_t gainCode) const
 	const AnalogueGainConstants &k = gainConstants_;
 	double gain = static_cast<double>(gainCode);
 
+	if (gainCode >= gainTableMin_ && gainCode - gainTableMin_ < gainTable_.size())
+		return gainTable_[gainCode - gainTableMin_];
+
 	switch (gainType_) {
 	case AnalogueGainLinear:
 		ASSERT(k.linear.m0 == 0 || k.linear.m1 == 0);
@@ -139,6 +149,51 @@ double CameraSensorHelper::gain(uint32_t gainCode) const
 	}
 }
 
+/**
+ * \brief Set the range of gain codes supported by the sensor
+ * \param[in] minCode The minimum gain code
+ * \param[in] maxCode The maximum gain code
+ *
+ * Precompute the gain of all codes in the [\a minCode, \a maxCode] range,
+ * typically the range of the V4L2_CID_ANALOGUE_GAIN control, to speed up the
+ * gain() and gainCode() functions for values within the range. gainCode()
+ * then returns the code of the highest achievable gain lower than or equal to
+ * the requested gain, with a binary search instead of transcendental math.
+ *
+ * The table is only built when the gain increases monotonically with the gain
+ * code, and when the range doesn't exceed 4096 codes. It is used by the
+ * analogue gain models of this class, helpers that override gain() and
+ * gainCode() are not affected. Calling this function again replaces the
+ * table.
+ */
+void CameraSensorHelper::setGainCodeRange(uint32_t minCode, uint32_t maxCode)
+{
+	static constexpr uint32_t kMaxTableSize = 4096;
+
+	gainTable_.clear();
+	gainTableMin_ = 0;
+
+	if (minCode > maxCode || maxCode - minCode >= kMaxTableSize)
+		return;
+
+	std::vector<double> table;
+	table.reserve(maxCode - minCode + 1);
+
+	for (uint32_t code = minCode; code <= maxCode; code++) {
+		double value = gain(code);
+		if (!table.empty() && value <= table.back()) {
+			LOG(CameraSensorHelper, Debug)
+				<< "Gain is not monotonic, not building gain table";
+			return;
+		}
+
+		table.push_back(value);
+	}
+
+	gainTableMin_ = minCode;
+	gainTable_ = std::move(table);
+}
+
 /**
  * \enum CameraSensorHelper::AnalogueGainType
  * \brief The gain calculation modes as defined by the MIPI CCS
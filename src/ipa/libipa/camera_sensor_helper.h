@@ -30,6 +30,8 @@ public:
 	virtual uint32_t gainCode(double gain) const;
 	virtual double gain(uint32_t gainCode) const;
 
+	void setGainCodeRange(uint32_t minCode, uint32_t maxCode);
+
 protected:
 	enum AnalogueGainType {
 		AnalogueGainLinear,
@@ -59,6 +61,9 @@ protected:
 
 private:
 	LIBCAMERA_DISABLE_COPY_AND_MOVE(CameraSensorHelper)
+
+	uint32_t gainTableMin_ = 0;
+	std::vector<double> gainTable_;
 };
 
 class CameraSensorHelperFactoryBase
@@ -135,6 +135,36 @@ namespace ipa {
  * \return A reference to the FrameContext for sequence \a frame
  */
 
+/**
+ * \fn FCQueue::publish(uint32_t frame, Func &&func)
+ * \brief Publish results to the FrameContext for the \a frame from any thread
+ * \param[in] frame The frame context sequence number
+ * \param[in] func The function that stores the results in the frame context
+ *
+ * All other FCQueue functions shall be called from the IPA module thread. This
+ * function allows algorithms that offload processing to worker threads to
+ * store the results in the frame context of an in-flight frame, without
+ * locks.
+ *
+ * Each context slot carries the sequence number of the frame it has been
+ * initialised for, and an ownership flag. This function takes ownership of the
+ * slot atomically and calls \a func with the frame context if the slot still
+ * belongs to \a frame. If the slot has been reused for a newer frame, the
+ * results are stale, and \a func isn't called. The IPA module thread waits for
+ * the ownership to be released before reinitialising a slot, which normally
+ * never happens as the slot of a frame is only reused once more frames than
+ * the queue size have been queued.
+ *
+ * \a func shall only write fields that the IPA module thread doesn't access
+ * until it has been notified of the completion of the work, and the
+ * notification shall synchronise the two threads, for instance through a
+ * queued method invocation.
+ *
+ * \return True if the results have been published, or false if the frame
+ * context is being accessed by another worker thread or has been reused for a
+ * newer frame
+ */
+
 } /* namespace ipa */
 
 } /* namespace libcamera */
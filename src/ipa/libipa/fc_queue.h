@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <stdint.h>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/log.h>
@@ -32,14 +35,17 @@ class FCQueue
 {
 public:
 	FCQueue(unsigned int size)
-		: contexts_(size)
+		: contexts_(size), slots_(size)
 	{
 	}
 
 	void clear()
 	{
-		for (FrameContext &ctx : contexts_)
-			ctx.frame = 0;
+		for (unsigned int i = 0; i < contexts_.size(); i++) {
+			lockSlot(i);
+			contexts_[i].frame = 0;
+			unlockSlot(i, 0);
+		}
 	}
 
 	FrameContext &alloc(const uint32_t frame)
@@ -103,14 +109,68 @@ public:
 		return frameContext;
 	}
 
+	template<typename Func>
+	bool publish(uint32_t frame, Func &&func)
+	{
+		unsigned int index = frame % contexts_.size();
+		Slot &slot = slots_[index];
+
+		bool busy = false;
+		if (!slot.busy.compare_exchange_strong(busy, true,
+						       std::memory_order_acquire))
+			return false;
+
+		bool valid = slot.frame.load(std::memory_order_relaxed) == frame;
+		if (valid)
+			std::forward<Func>(func)(contexts_[index]);
+
+		slot.busy.store(false, std::memory_order_release);
+
+		return valid;
+	}
+
 private:
+	struct Slot {
+		std::atomic<uint32_t> frame{ 0 };
+		std::atomic<bool> busy{ false };
+	};
+
+	void lockSlot(unsigned int index)
+	{
+		Slot &slot = slots_[index];
+		bool busy = false;
+
+		while (!slot.busy.compare_exchange_weak(busy, true,
+							std::memory_order_acquire)) {
+			busy = false;
+			std::this_thread::yield();
+		}
+	}
+
+	void unlockSlot(unsigned int index, uint32_t frame)
+	{
+		Slot &slot = slots_[index];
+
+		slot.frame.store(frame, std::memory_order_relaxed);
+		slot.busy.store(false, std::memory_order_release);
+	}
+
 	void init(FrameContext &frameContext, const uint32_t frame)
 	{
+		unsigned int index = &frameContext - contexts_.data();
+
+		/*
+		 * Wait for worker threads publishing results for the previous
+		 * frame using this slot before reinitialising it.
+		 */
+		lockSlot(index);
 		frameContext = {};
 		frameContext.frame = frame;
+		unlockSlot(index, frame);
 	}
 
 	std::vector<FrameContext> contexts_;
+	std::vector<Slot> slots_;
 };
 
 } /* namespace ipa */
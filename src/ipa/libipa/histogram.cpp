@@ -42,6 +42,27 @@ namespace ipa {
  * \param[in] data A (non-cumulative) histogram
  */
 Histogram::Histogram(Span<const uint32_t> data)
+{
+	assign(data);
+}
+
+/**
+ * \fn Histogram::Histogram(Span<const uint32_t> data, Transform transform)
+ * \brief Create a cumulative histogram
+ * \param[in] data A (non-cumulative) histogram
+ * \param[in] transform The transformation function to apply to every bin
+ */
+
+/**
+ * \brief Rebuild the cumulative histogram from new data
+ * \param[in] data A (non-cumulative) histogram
+ *
+ * The histogram storage is reused, and is only reallocated when \a data has
+ * more bins than any data previously assigned to the histogram. Algorithms
+ * that compute a histogram for every frame should store a Histogram and
+ * rebuild it with this function instead of constructing a new one.
+ */
+void Histogram::assign(Span<const uint32_t> data)
 {
 	cumulative_.resize(data.size() + 1);
 	cumulative_[0] = 0;
@@ -50,10 +71,12 @@ Histogram::Histogram(Span<const uint32_t> data)
 }
 
 /**
- * \fn Histogram::Histogram(Span<const uint32_t> data, Transform transform)
- * \brief Create a cumulative histogram
+ * \fn Histogram::assign(Span<const uint32_t> data, Transform transform)
+ * \brief Rebuild the cumulative histogram from new data
  * \param[in] data A (non-cumulative) histogram
  * \param[in] transform The transformation function to apply to every bin
+ *
+ * \sa assign(Span<const uint32_t> data)
  */
 
 /**
@@ -29,6 +29,15 @@ public:
 	template<typename Transform,
 		 std::enable_if_t<std::is_invocable_v<Transform, uint32_t>> * = nullptr>
 	Histogram(Span<const uint32_t> data, Transform transform)
+	{
+		assign(data, transform);
+	}
+
+	void assign(Span<const uint32_t> data);
+
+	template<typename Transform,
+		 std::enable_if_t<std::is_invocable_v<Transform, uint32_t>> * = nullptr>
+	void assign(Span<const uint32_t> data, Transform transform)
 	{
 		cumulative_.resize(data.size() + 1);
 		cumulative_[0] = 0;
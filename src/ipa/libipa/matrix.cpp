@@ -34,13 +34,13 @@ namespace ipa {
  */
 
 /**
- * \fn Matrix::Matrix(const std::vector<T> &data)
+ * \fn Matrix::Matrix(const std::array<T, Rows * Cols> &data)
  * \brief Construct a matrix from supplied data
  * \param[in] data Data from which to construct a matrix
  *
- * \a data is a one-dimensional vector and will be turned into a matrix in
- * row-major order. The size of \a data must be equal to the product of the
- * number of rows and columns of the matrix (Rows x Cols).
+ * \a data is a one-dimensional array and will be turned into a matrix in
+ * row-major order. Its size is the product of the number of rows and columns
+ * of the matrix (Rows x Cols).
  */
 
 /**
@@ -122,6 +122,21 @@ namespace ipa {
  * \return Matrix sum of matrices \a m1 and \a m2
  */
 
+/**
+ * \fn Matrix<T, Rows, Cols> lerp(const Matrix<T, Rows, Cols> &m1, const Matrix<T, Rows, Cols> &m2, double lambda)
+ * \brief Linearly interpolate between two matrices
+ * \param[in] m1 The matrix at \a lambda = 0
+ * \param[in] m2 The matrix at \a lambda = 1
+ * \param[in] lambda The interpolation factor
+ *
+ * Each element is computed as m1 + lambda * (m2 - m1) in a single pass, in
+ * double precision, and is converted to T once. This avoids the temporary
+ * matrices and the intermediate rounding of integer elements incurred by
+ * scaling and summing the two matrices separately.
+ *
+ * \return The interpolated matrix
+ */
+
 #ifndef __DOXYGEN__
 /*
  * The YAML data shall be a list of numerical values. Its size shall be equal
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <sstream>
 #include <vector>
@@ -31,17 +32,17 @@ template<typename T, unsigned int Rows, unsigned int Cols>
 class Matrix
 {
 public:
-	Matrix()
+	constexpr Matrix()
+		: data_{}
 	{
-		data_.fill(static_cast<T>(0));
 	}
 
-	Matrix(const std::vector<T> &data)
+	constexpr Matrix(const std::array<T, Rows * Cols> &data)
+		: data_(data)
 	{
-		std::copy(data.begin(), data.end(), data_.begin());
 	}
 
-	static Matrix identity()
+	static constexpr Matrix identity()
 	{
 		Matrix ret;
 		for (size_t i = 0; i < std::min(Rows, Cols); i++)
@@ -69,12 +70,12 @@ public:
 		return out.str();
 	}
 
-	Span<const T, Cols> operator[](size_t i) const
+	constexpr Span<const T, Cols> operator[](size_t i) const
 	{
 		return Span<const T, Cols>{ &data_.data()[i * Cols], Cols };
 	}
 
-	Span<T, Cols> operator[](size_t i)
+	constexpr Span<T, Cols> operator[](size_t i)
 	{
 		return Span<T, Cols>{ &data_.data()[i * Cols], Cols };
 	}
@@ -101,7 +102,7 @@ template<typename T, typename U, unsigned int Rows, unsigned int Cols,
 #else
 template<typename T, typename U, unsigned int Rows, unsigned int Cols>
 #endif /* __DOXYGEN__ */
-Matrix<U, Rows, Cols> operator*(T d, const Matrix<U, Rows, Cols> &m)
+constexpr Matrix<U, Rows, Cols> operator*(T d, const Matrix<U, Rows, Cols> &m)
 {
 	Matrix<U, Rows, Cols> result;
 
@@ -119,7 +120,7 @@ template<typename T, typename U, unsigned int Rows, unsigned int Cols,
 #else
 template<typename T, typename U, unsigned int Rows, unsigned int Cols>
 #endif /* __DOXYGEN__ */
-Matrix<U, Rows, Cols> operator*(const Matrix<U, Rows, Cols> &m, T d)
+constexpr Matrix<U, Rows, Cols> operator*(const Matrix<U, Rows, Cols> &m, T d)
 {
 	return d * m;
 }
@@ -132,7 +133,7 @@ template<typename T,
 #else
 template<typename T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned in C2>
 #endif /* __DOXYGEN__ */
-Matrix<T, R1, C2> operator*(const Matrix<T, R1, C1> &m1, const Matrix<T, R2, C2> &m2)
+constexpr Matrix<T, R1, C2> operator*(const Matrix<T, R1, C1> &m1, const Matrix<T, R2, C2> &m2)
 {
 	Matrix<T, R1, C2> result;
 
@@ -151,7 +152,7 @@ Matrix<T, R1, C2> operator*(const Matrix<T, R1, C1> &m1, const Matrix<T, R2, C2>
 }
 
 template<typename T, unsigned int Rows, unsigned int Cols>
-Matrix<T, Rows, Cols> operator+(const Matrix<T, Rows, Cols> &m1, const Matrix<T, Rows, Cols> &m2)
+constexpr Matrix<T, Rows, Cols> operator+(const Matrix<T, Rows, Cols> &m1, const Matrix<T, Rows, Cols> &m2)
 {
 	Matrix<T, Rows, Cols> result;
 
@@ -163,6 +164,20 @@ Matrix<T, Rows, Cols> operator+(const Matrix<T, Rows, Cols> &m1, const Matrix<T,
 	return result;
 }
 
+template<typename T, unsigned int Rows, unsigned int Cols>
+constexpr Matrix<T, Rows, Cols> lerp(const Matrix<T, Rows, Cols> &m1,
+				     const Matrix<T, Rows, Cols> &m2, double lambda)
+{
+	Matrix<T, Rows, Cols> result;
+
+	for (unsigned int i = 0; i < Rows; i++) {
+		for (unsigned int j = 0; j < Cols; j++)
+			result[i][j] = static_cast<T>(m1[i][j] + lambda * (m2[i][j] - m1[i][j]));
+	}
+
+	return result;
+}
+
 #ifndef __DOXYGEN__
 bool matrixValidateYaml(const YamlObject &obj, unsigned int size);
 #endif /* __DOXYGEN__ */
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <algorithm>
+#include <iterator>
 #include <map>
 #include <string>
 #include <tuple>
@@ -99,18 +100,16 @@ public:
 		if (ct >= matrices_.rbegin()->first)
 			return matrices_.rbegin()->second;
 
-		if (matrices_.find(ct) != matrices_.end())
-			return matrices_[ct];
+		/* The above three guarantee that this will succeed */
+		auto upper = matrices_.lower_bound(ct);
+		if (upper->first == ct)
+			return upper->second;
 
-		/* The above four guarantee that this will succeed */
-		auto iter = matrices_.upper_bound(ct);
-		unsigned int ctUpper = iter->first;
-		unsigned int ctLower = (--iter)->first;
+		auto lower = std::prev(upper);
 
-		double lambda = (ct - ctLower) / static_cast<double>(ctUpper - ctLower);
-		Matrix<T, R, C> ret =
-			lambda * matrices_[ctUpper] + (1.0 - lambda) * matrices_[ctLower];
-		return ret;
+		double lambda = (ct - lower->first) /
+				static_cast<double>(upper->first - lower->first);
+		return lerp(lower->second, upper->second, lambda);
 	}
 
 private:
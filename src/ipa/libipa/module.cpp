@@ -97,6 +97,62 @@ namespace ipa {
  * \return 0 on success, or a negative error code on failure
  */
 
+/**
+ * \fn Module::prepare()
+ * \brief Prepare the ISP parameters with all algorithms
+ * \param[in] context The shared IPA context
+ * \param[in] frame The frame context sequence number
+ * \param[in] frameContext The FrameContext for this frame
+ * \param[out] params The ISP specific parameters
+ *
+ * This function calls the Algorithm::prepare() function of all algorithms in
+ * sequence, and records their execution time.
+ */
+
+/**
+ * \fn Module::process()
+ * \brief Process statistics with all algorithms
+ * \param[in] context The shared IPA context
+ * \param[in] frame The frame context sequence number
+ * \param[in] frameContext The current frame's context
+ * \param[in] stats The IPA statistics and ISP results
+ * \param[out] metadata Metadata for the frame, filled by the algorithms
+ * \param[in] filter Optional function to select the algorithms to run
+ *
+ * This function calls the Algorithm::process() function of all algorithms for
+ * which \a filter returns true, or all algorithms if no \a filter is given, in
+ * the order of the tuning file, and records their execution time. Algorithms
+ * that don't override Algorithm::process() are skipped.
+ */
+
+/**
+ * \fn Module::setFrameDuration()
+ * \brief Set the frame duration used to detect overruns
+ * \param[in] duration The frame duration
+ *
+ * The execution times recorded by prepare() and process(), for individual
+ * algorithms and for all algorithms, are counted as overruns when they exceed
+ * the frame \a duration.
+ */
+
+/**
+ * \fn Module::resetTimings()
+ * \brief Reset the execution time statistics of all algorithms
+ *
+ * IPA modules should call this function when starting the camera, to profile
+ * each streaming session separately.
+ */
+
+/**
+ * \fn Module::logTimings()
+ * \brief Log the execution time statistics of all algorithms
+ *
+ * Log the minimum, mean, 99th percentile and maximum execution times of the
+ * prepare() and process() functions of all algorithms, as well as the number
+ * of overruns of the frame duration. IPA modules should call this function
+ * when stopping the camera.
+ */
+
 /**
  * \fn Module::registerAlgorithm()
  * \brief Add an algorithm factory class to the list of available algorithms
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <functional>
 #include <list>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -15,9 +17,12 @@
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
 
+#include <libcamera/controls.h>
+
 #include "libcamera/internal/yaml_parser.h"
 
 #include "algorithm.h"
+#include "timing_stats.h"
 
 namespace libcamera {
 
@@ -52,12 +57,14 @@ public:
 				LOG(IPAModuleAlgo, Error)
 					<< "Invalid YAML syntax for algorithm " << i;
 				algorithms_.clear();
+				processing_.clear();
 				return -EINVAL;
 			}
 
 			int ret = createAlgorithm(context, algo);
 			if (ret) {
 				algorithms_.clear();
+				processing_.clear();
 				return ret;
 			}
 		}
@@ -65,22 +72,104 @@ public:
 		return 0;
 	}
 
+	void prepare(Context &context, const uint32_t frame,
+		     FrameContext &frameContext, Params *params)
+	{
+		utils::time_point begin = utils::clock::now();
+
+		for (const auto &algo : algorithms_) {
+			utils::time_point start = utils::clock::now();
+			algo->prepare(context, frame, frameContext, params);
+			timings_.at(algo.get()).prepare.record(utils::clock::now() - start);
+		}
+
+		prepareTiming_.record(utils::clock::now() - begin);
+	}
+
+	void process(Context &context, const uint32_t frame,
+		     FrameContext &frameContext, const Stats *stats,
+		     ControlList &metadata,
+		     const std::function<bool(const Algorithm<Module> &)> &filter = {})
+	{
+		utils::time_point begin = utils::clock::now();
+
+		for (Algorithm<Module> *algo : processing_) {
+			if (filter && !filter(*algo))
+				continue;
+
+			utils::time_point start = utils::clock::now();
+			algo->process(context, frame, frameContext, stats, metadata);
+			timings_.at(algo).process.record(utils::clock::now() - start);
+		}
+
+		processTiming_.record(utils::clock::now() - begin);
+	}
+
+	void setFrameDuration(utils::Duration duration)
+	{
+		prepareTiming_.setBudget(duration);
+		processTiming_.setBudget(duration);
+
+		for (auto &[algo, timings] : timings_) {
+			timings.prepare.setBudget(duration);
+			timings.process.setBudget(duration);
+		}
+	}
+
+	void resetTimings()
+	{
+		prepareTiming_.reset();
+		processTiming_.reset();
+
+		for (auto &[algo, timings] : timings_) {
+			timings.prepare.reset();
+			timings.process.reset();
+		}
+	}
+
+	void logTimings() const
+	{
+		if (!processTiming_.count() && !prepareTiming_.count())
+			return;
+
+		LOG(IPAModuleAlgo, Info)
+			<< "Total: prepare " << prepareTiming_.toString()
+			<< ", process " << processTiming_.toString();
+
+		for (const auto &algo : algorithms_) {
+			const AlgorithmTimings &timings = timings_.at(algo.get());
+
+			LOG(IPAModuleAlgo, Info)
+				<< timings.name << ": prepare "
+				<< timings.prepare.toString() << ", process "
+				<< timings.process.toString();
+		}
+	}
+
 	static void registerAlgorithm(AlgorithmFactoryBase<Module> *factory)
 	{
 		factories().push_back(factory);
 	}
 
 private:
+	struct AlgorithmTimings {
+		std::string name;
+		TimingStats prepare;
+		TimingStats process;
+	};
+
 	int createAlgorithm(Context &context, const YamlObject &data)
 	{
 		const auto &[name, algoData] = *data.asDict().begin();
-		std::unique_ptr<Algorithm<Module>> algo = createAlgorithm(name);
-		if (!algo) {
+		const AlgorithmFactoryBase<Module> *factory = findFactory(name);
+		if (!factory) {
 			LOG(IPAModuleAlgo, Error)
 				<< "Algorithm '" << name << "' not found";
 			return -EINVAL;
 		}
 
+		std::unique_ptr<Algorithm<Module>> algo = factory->create();
+
 		int ret = algo->init(context, algoData);
 		if (ret) {
 			LOG(IPAModuleAlgo, Error)
@@ -91,15 +180,18 @@ private:
 		LOG(IPAModuleAlgo, Debug)
 			<< "Instantiated algorithm '" << name << "'";
 
+		timings_[algo.get()].name = name;
+		if (factory->overridesProcess())
+			processing_.push_back(algo.get());
 		algorithms_.push_back(std::move(algo));
 		return 0;
 	}
 
-	static std::unique_ptr<Algorithm<Module>> createAlgorithm(const std::string &name)
+	static const AlgorithmFactoryBase<Module> *findFactory(const std::string &name)
 	{
 		for (const AlgorithmFactoryBase<Module> *factory : factories()) {
 			if (factory->name() == name)
-				return factory->create();
+				return factory;
 		}
 
 		return nullptr;
@@ -117,6 +209,11 @@ private:
 	}
 
 	std::list<std::unique_ptr<Algorithm<Module>>> algorithms_;
+	std::vector<Algorithm<Module> *> processing_;
+
+	std::map<const Algorithm<Module> *, AlgorithmTimings> timings_;
+	TimingStats prepareTiming_;
+	TimingStats processTiming_;
 };
 
 } /* namespace ipa */
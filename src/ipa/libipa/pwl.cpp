@@ -213,6 +213,27 @@ double Pwl::eval(double x, int *span, bool updateSpan) const
 		       (points_[index + 1].x() - points_[index].x());
 }
 
+/**
+ * \brief Evaluate the piecewise linear function at multiple positions
+ * \param[in] x The x values to input into the function
+ * \param[out] y The results of evaluating the function at each position of \a x
+ *
+ * Evaluate the function for all values of \a x, carrying the span found for
+ * each value over to the next one. When the values of \a x are sorted, as for
+ * the sampling points of a lookup table, the whole evaluation walks the
+ * function once instead of searching for the span of every value.
+ *
+ * The \a x and \a y spans shall have the same size.
+ */
+void Pwl::eval(Span<const double> x, Span<double> y) const
+{
+	assert(x.size() == y.size());
+
+	int span = -1;
+	for (size_t i = 0; i < x.size(); i++)
+		y[i] = eval(x[i], &span);
+}
+
 int Pwl::findSpan(double x, int span) const
 {
 	/*
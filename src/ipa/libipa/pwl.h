@@ -13,6 +13,8 @@
 #include <utility>
 #include <vector>
 
+#include <libcamera/base/span.h>
+
 #include "libcamera/internal/yaml_parser.h"
 
 #include "vector.h"
@@ -59,6 +61,7 @@ public:
 
 	double eval(double x, int *span = nullptr,
 		    bool updateSpan = true) const;
+	void eval(Span<const double> x, Span<double> y) const;
 
 	std::pair<Pwl, bool> inverse(double eps = 1e-6) const;
 	Pwl compose(const Pwl &other, double eps = 1e-6) const;
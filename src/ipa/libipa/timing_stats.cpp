@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Execution time statistics for IPA algorithms
+ */
+
+#include "timing_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+/**
+ * \file timing_stats.h
+ * \brief Execution time statistics for IPA algorithms
+ */
+
+namespace libcamera {
+
+using namespace std::literals::chrono_literals;
+
+namespace ipa {
+
+/**
+ * \class TimingStats
+ * \brief Accumulate execution time statistics
+ *
+ * The TimingStats class records execution times and computes their minimum,
+ * mean, maximum and percentiles. It is used to profile the algorithms of IPA
+ * modules on the target, without external tools.
+ *
+ * Percentiles are computed from a histogram with logarithmic bins, four per
+ * octave, starting at 1µs. Recording a sample is thus a constant time
+ * operation, and the reported percentiles are rounded up to the upper edge of
+ * the bin, within 19% of the exact value.
+ *
+ * Samples longer than the budget, when set with setBudget(), are also counted
+ * as overruns. The budget is typically the frame duration.
+ */
+
+TimingStats::TimingStats()
+	: budget_(0s)
+{
+	reset();
+}
+
+/**
+ * \brief Reset the statistics
+ *
+ * The budget is preserved.
+ */
+void TimingStats::reset()
+{
+	bins_.fill(0);
+	count_ = 0;
+	overruns_ = 0;
+	min_ = 0s;
+	max_ = 0s;
+	sum_ = 0s;
+}
+
+/**
+ * \brief Record an execution time sample
+ * \param[in] duration The execution time
+ */
+void TimingStats::record(utils::Duration duration)
+{
+	double us = duration.get<std::micro>();
+	unsigned int bin = 0;
+
+	/* Bin 0 stores samples shorter than 1µs. */
+	if (us >= 1.0)
+		bin = std::min<unsigned int>(std::log2(us) * kBinsPerOctave + 1,
+					     kNumBins - 1);
+
+	bins_[bin]++;
+
+	if (!count_ || duration < min_)
+		min_ = duration;
+	if (duration > max_)
+		max_ = duration;
+
+	sum_ += duration;
+	count_++;
+
+	if (budget_ > 0s && duration > budget_)
+		overruns_++;
+}
+
+/**
+ * \fn TimingStats::setBudget()
+ * \brief Set the execution time budget
+ * \param[in] budget The execution time budget, or 0 to disable overrun counting
+ */
+
+/**
+ * \fn TimingStats::budget()
+ * \brief Retrieve the execution time budget
+ * \return The execution time budget
+ */
+
+/**
+ * \fn TimingStats::count()
+ * \brief Retrieve the number of recorded samples
+ * \return The number of recorded samples
+ */
+
+/**
+ * \fn TimingStats::overruns()
+ * \brief Retrieve the number of samples that exceeded the budget
+ * \return The number of overruns
+ */
+
+/**
+ * \fn TimingStats::min()
+ * \brief Retrieve the shortest recorded execution time
+ * \return The shortest execution time, or 0 if no sample has been recorded
+ */
+
+/**
+ * \fn TimingStats::max()
+ * \brief Retrieve the longest recorded execution time
+ * \return The longest execution time, or 0 if no sample has been recorded
+ */
+
+/**
+ * \brief Retrieve the mean execution time
+ * \return The mean execution time, or 0 if no sample has been recorded
+ */
+utils::Duration TimingStats::mean() const
+{
+	if (!count_)
+		return 0s;
+
+	return sum_ / count_;
+}
+
+/**
+ * \brief Retrieve a percentile of the execution time
+ * \param[in] p The percentile, in the [0, 100] range
+ * \return The execution time below which \a p percent of the samples fall,
+ * rounded up to the histogram bin and capped by the maximum
+ */
+utils::Duration TimingStats::percentile(double p) const
+{
+	if (!count_)
+		return 0s;
+
+	uint64_t target = std::ceil(std::clamp(p, 0.0, 100.0) * count_ / 100);
+	uint64_t seen = 0;
+	unsigned int bin;
+
+	for (bin = 0; bin < kNumBins - 1; bin++) {
+		seen += bins_[bin];
+		if (seen >= target)
+			break;
+	}
+
+	utils::Duration edge = std::exp2(static_cast<double>(bin) / kBinsPerOctave) * 1us;
+	return std::clamp(edge, min_, max_);
+}
+
+/**
+ * \brief Format the statistics as a string
+ * \return A string describing the statistics
+ */
+std::string TimingStats::toString() const
+{
+	std::stringstream ss;
+
+	ss << "min " << min() << " mean " << mean()
+	   << " p99 " << percentile(99) << " max " << max()
+	   << " (" << count_ << " samples";
+
+	if (budget_ > 0s)
+		ss << ", " << overruns_ << " overruns";
+
+	ss << ")";
+
+	return ss.str();
+}
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Execution time statistics for IPA algorithms
+ */
+
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <string>
+
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+namespace ipa {
+
+class TimingStats
+{
+public:
+	TimingStats();
+
+	void reset();
+	void record(utils::Duration duration);
+
+	void setBudget(utils::Duration budget) { budget_ = budget; }
+	utils::Duration budget() const { return budget_; }
+
+	unsigned int count() const { return count_; }
+	unsigned int overruns() const { return overruns_; }
+
+	utils::Duration min() const { return min_; }
+	utils::Duration max() const { return max_; }
+	utils::Duration mean() const;
+	utils::Duration percentile(double p) const;
+
+	std::string toString() const;
+
+private:
+	static constexpr unsigned int kBinsPerOctave = 4;
+	static constexpr unsigned int kNumBins = 24 * kBinsPerOctave + 1;
+
+	std::array<uint32_t, kNumBins> bins_;
+	unsigned int count_;
+	unsigned int overruns_;
+	utils::Duration budget_;
+	utils::Duration min_;
+	utils::Duration max_;
+	utils::Duration sum_;
+};
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
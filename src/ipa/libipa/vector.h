@@ -41,13 +41,13 @@ public:
 			data_[i] = data[i];
 	}
 
-	const T &operator[](size_t i) const
+	constexpr const T &operator[](size_t i) const
 	{
 		ASSERT(i < data_.size());
 		return data_[i];
 	}
 
-	T &operator[](size_t i)
+	constexpr T &operator[](size_t i)
 	{
 		ASSERT(i < data_.size());
 		return data_[i];
@@ -139,11 +139,11 @@ public:
 	}
 
 private:
-	std::array<T, Rows> data_;
+	std::array<T, Rows> data_ = {};
 };
 
 template<typename T, unsigned int Rows, unsigned int Cols>
-Vector<T, Rows> operator*(const Matrix<T, Rows, Cols> &m, const Vector<T, Cols> &v)
+constexpr Vector<T, Rows> operator*(const Matrix<T, Rows, Cols> &m, const Vector<T, Cols> &v)
 {
 	Vector<T, Rows> result;
 
@@ -374,11 +374,11 @@ void Agc::fillMetadata(IPAContext &context, IPAFrameContext &frameContext,
  */
 double Agc::estimateLuminance(double gain) const
 {
-	double ySum = 0.0;
+	if (!expMeans_.size())
+		return 0.0;
 
 	/* Sum the averages, saturated to 255. */
-	for (uint8_t expMean : expMeans_)
-		ySum += std::min(expMean * gain, 255.0);
+	double ySum = expMeans_.sum(gain);
 
 	/* \todo Weight with the AWB gains */
 
@@ -417,9 +417,12 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	ASSERT(stats->meas_type & RKISP1_CIF_ISP_STAT_AUTOEXP);
 
 	/* The lower 4 bits are fractional and meant to be discarded. */
-	Histogram hist({ params->hist.hist_bins, context.hw->numHistogramBins },
-		       [](uint32_t x) { return x >> 4; });
-	expMeans_ = { params->ae.exp_mean, context.hw->numAeCells };
+	hist_.assign({ params->hist.hist_bins, context.hw->numHistogramBins },
+		     [](uint32_t x) { return x >> 4; });
+	expMeans_.reset();
+	for (uint8_t expMean : Span<const uint8_t>(params->ae.exp_mean, context.hw->numAeCells))
+		expMeans_.add(expMean);
+	expMeans_.update();
 
 	utils::Duration maxShutterSpeed =
 		std::clamp(frameContext.agc.maxFrameDuration,
@@ -444,7 +447,7 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	std::tie(shutterTime, aGain, dGain) =
 		calculateNewEv(frameContext.agc.constraintMode,
 			       frameContext.agc.exposureMode,
-			       hist, effectiveExposureValue);
+			       hist_, effectiveExposureValue);
 
 	LOG(RkISP1Agc, Debug)
 		<< "Divided up shutter, analogue gain and digital gain are "
@@ -456,7 +459,8 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	activeState.agc.automatic.gain = aGain;
 
 	fillMetadata(context, frameContext, metadata);
-	expMeans_ = {};
+	expMeans_.reset();
+	expMeans_.update();
 }
 
 REGISTER_IPA_ALGORITHM(Agc, "Agc")
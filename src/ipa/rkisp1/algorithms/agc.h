@@ -52,7 +52,8 @@ private:
 			  ControlList &metadata);
 	double estimateLuminance(double gain) const override;
 
-	Span<const uint8_t> expMeans_;
+	SaturatedSum expMeans_;
+	Histogram hist_;
 
 	std::map<int32_t, std::vector<uint8_t>> meteringModes_;
 };
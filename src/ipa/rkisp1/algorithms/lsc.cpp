@@ -36,6 +36,11 @@ namespace ipa::rkisp1::algorithms {
  * The Lens Shading Correction algorithm applies multipliers to all pixels
  * to compensate for the lens shading effect. The coefficients are
  * specified in a downscaled table in the YAML tuning file.
+ *
+ * The colour temperature estimated by the AWB algorithm is quantised to
+ * multiples of the 'ct-step' tuning parameter (100K by default) to select the
+ * table. Tables interpolated between two sets are cached, and the parameters
+ * are only programmed when the quantised colour temperature changes.
  */
 
 LOG_DEFINE_CATEGORY(RkISP1Lsc)
@@ -90,7 +95,7 @@ static std::vector<uint16_t> parseTable(const YamlObject &tuningData,
 }
 
 LensShadingCorrection::LensShadingCorrection()
-	: lastCt_({ 0, 0 })
+	: ctStep_(100), lastCt_(0)
 {
 }
 
@@ -106,6 +111,12 @@ int LensShadingCorrection::init([[maybe_unused]] IPAContext &context,
 	if (xSize_.empty() || ySize_.empty())
 		return -EINVAL;
 
+	ctStep_ = tuningData["ct-step"].get<uint32_t>(100);
+	if (!ctStep_) {
+		LOG(RkISP1Lsc, Error) << "Invalid 'ct-step' value";
+		return -EINVAL;
+	}
+
 	/* Get all defined sets to apply. */
 	const YamlObject &yamlSets = tuningData["sets"];
 	if (!yamlSets.isList()) {
@@ -181,6 +192,9 @@ int LensShadingCorrection::configure(IPAContext &context,
 		yGrad_[i] = std::round(32768 / ySizes_[i]);
 	}
 
+	/* Program the tables for the first frame. */
+	lastCt_ = 0;
+
 	context.configuration.lsc.enabled = true;
 	return 0;
 }
@@ -211,35 +225,74 @@ void LensShadingCorrection::copyTable(rkisp1_cif_isp_lsc_config &config,
 /*
  * Interpolate LSC parameters based on color temperature value.
  */
-void LensShadingCorrection::interpolateTable(rkisp1_cif_isp_lsc_config &config,
+void LensShadingCorrection::interpolateTable(Components &set,
 					     const Components &set0,
 					     const Components &set1,
 					     const uint32_t ct)
 {
 	double coeff0 = (set1.ct - ct) / static_cast<double>(set1.ct - set0.ct);
 	double coeff1 = (ct - set0.ct) / static_cast<double>(set1.ct - set0.ct);
+	unsigned int samples = set0.r.size();
+
+	set.ct = ct;
+	set.r.resize(samples);
+	set.gr.resize(samples);
+	set.gb.resize(samples);
+	set.b.resize(samples);
+
+	for (unsigned int sample = 0; sample < samples; ++sample) {
+		set.r[sample] = set0.r[sample] * coeff0 + set1.r[sample] * coeff1;
+		set.gr[sample] = set0.gr[sample] * coeff0 + set1.gr[sample] * coeff1;
+		set.gb[sample] = set0.gb[sample] * coeff0 + set1.gb[sample] * coeff1;
+		set.b[sample] = set0.b[sample] * coeff0 + set1.b[sample] * coeff1;
+	}
+}
 
-	for (unsigned int i = 0; i < RKISP1_CIF_ISP_LSC_SAMPLES_MAX; ++i) {
-		for (unsigned int j = 0; j < RKISP1_CIF_ISP_LSC_SAMPLES_MAX; ++j) {
-			unsigned int sample = i * RKISP1_CIF_ISP_LSC_SAMPLES_MAX + j;
-
-			config.r_data_tbl[i][j] =
-				set0.r[sample] * coeff0 +
-				set1.r[sample] * coeff1;
+/*
+ * Retrieve the tables for a quantised color temperature, rounding to the
+ * nearest set or interpolating between the neighbouring sets. Interpolated
+ * tables are cached, as the number of quantised color temperatures is bounded
+ * by the range of the sets.
+ */
+const LensShadingCorrection::Components &LensShadingCorrection::table(uint32_t ct)
+{
+	/* The color temperature matches exactly one of the available sets. */
+	auto iter = sets_.find(ct);
+	if (iter != sets_.end())
+		return iter->second;
 
-			config.gr_data_tbl[i][j] =
-				set0.gr[sample] * coeff0 +
-				set1.gr[sample] * coeff1;
+	auto cached = interpolated_.find(ct);
+	if (cached != interpolated_.end())
+		return cached->second;
 
-			config.gb_data_tbl[i][j] =
-				set0.gb[sample] * coeff0 +
-				set1.gb[sample] * coeff1;
+	/* No shortcuts left; we need to round or interpolate */
+	iter = sets_.upper_bound(ct);
+	const Components &set1 = iter->second;
+	const Components &set0 = (--iter)->second;
+	uint32_t ct0 = set0.ct;
+	uint32_t ct1 = set1.ct;
+	uint32_t diff0 = ct - ct0;
+	uint32_t diff1 = ct1 - ct;
+	static constexpr double kThreshold = 0.1;
+	float threshold = kThreshold * (ct1 - ct0);
 
-			config.b_data_tbl[i][j] =
-				set0.b[sample] * coeff0 +
-				set1.b[sample] * coeff1;
-		}
+	if (diff0 < threshold || diff1 < threshold) {
+		const Components &set = diff0 < diff1 ? set0 : set1;
+		LOG(RkISP1Lsc, Debug) << "using LSC table for " << set.ct;
+		return set;
 	}
+
+	/*
+	 * ct is not within 10% of the difference between the neighbouring
+	 * color temperatures, so we need to interpolate.
+	 */
+	LOG(RkISP1Lsc, Debug)
+		<< "ct is " << ct << ", interpolating between "
+		<< ct0 << " and " << ct1;
+
+	Components &set = interpolated_[ct];
+	interpolateTable(set, set0, set1, ct);
+	return set;
 }
 
 /**
@@ -269,70 +322,27 @@ void LensShadingCorrection::prepare(IPAContext &context,
 		return;
 	}
 
-	uint32_t ct = context.activeState.awb.temperatureK;
-	ct = std::clamp(ct, sets_.cbegin()->first, sets_.crbegin()->first);
-
 	/*
-	 * If the original is the same, then it means the same adjustment would
-	 * be made. If the adjusted is the same, then it means that it's the
-	 * same as what was actually applied. Thus in these cases we can skip
-	 * reprogramming the LSC.
-	 *
-	 * original == adjusted can only happen if an interpolation
-	 * happened, or if original has an exact entry in sets_. This means
-	 * that if original != adjusted, then original was adjusted to
-	 * the nearest available entry in sets_, resulting in adjusted.
-	 * Clearly, any ct value that is in between original and adjusted
-	 * will be adjusted to the same adjusted value, so we can skip
-	 * reprogramming the LSC table.
-	 *
-	 * We also skip updating the original value, as the last one had a
-	 * larger bound and thus a larger range of ct values that will be
-	 * adjusted to the same adjusted.
+	 * Quantise the color temperature to avoid reprogramming the tables for
+	 * small variations of the estimate, which have no visible effect.
 	 */
-	if ((lastCt_.original <= ct && ct <= lastCt_.adjusted) ||
-	    (lastCt_.adjusted <= ct && ct <= lastCt_.original))
-		return;
+	uint32_t ct = context.activeState.awb.temperatureK;
+	ct = (ct + ctStep_ / 2) / ctStep_ * ctStep_;
+	ct = std::clamp(ct, sets_.cbegin()->first, sets_.crbegin()->first);
 
-	setParameters(params);
+	const Components &set = table(ct);
 
 	/*
-	 * The color temperature matches exactly one of the available LSC tables.
+	 * Skip reprogramming the tables if they are the same as the ones
+	 * previously applied, either because the quantised color temperature
+	 * hasn't changed or because it rounds to the same set.
 	 */
-	if (sets_.count(ct)) {
-		copyTable(config, sets_[ct]);
-		lastCt_ = { ct, ct };
-		return;
-	}
-
-	/* No shortcuts left; we need to round or interpolate */
-	auto iter = sets_.upper_bound(ct);
-	const Components &set1 = iter->second;
-	const Components &set0 = (--iter)->second;
-	uint32_t ct0 = set0.ct;
-	uint32_t ct1 = set1.ct;
-	uint32_t diff0 = ct - ct0;
-	uint32_t diff1 = ct1 - ct;
-	static constexpr double kThreshold = 0.1;
-	float threshold = kThreshold * (ct1 - ct0);
-
-	if (diff0 < threshold || diff1 < threshold) {
-		const Components &set = diff0 < diff1 ? set0 : set1;
-		LOG(RkISP1Lsc, Debug) << "using LSC table for " << set.ct;
-		copyTable(config, set);
-		lastCt_ = { ct, set.ct };
+	if (set.ct == lastCt_)
 		return;
-	}
 
-	/*
-	 * ct is not within 10% of the difference between the neighbouring
-	 * color temperatures, so we need to interpolate.
-	 */
-	LOG(RkISP1Lsc, Debug)
-		<< "ct is " << ct << ", interpolating between "
-		<< ct0 << " and " << ct1;
-	interpolateTable(config, set0, set1, ct);
-	lastCt_ = { ct, ct };
+	setParameters(params);
+	copyTable(config, set);
+	lastCt_ = set.ct;
 }
 
 REGISTER_IPA_ALGORITHM(LensShadingCorrection, "LensShadingCorrection")
@@ -38,21 +38,20 @@ private:
 
 	void setParameters(rkisp1_params_cfg *params);
 	void copyTable(rkisp1_cif_isp_lsc_config &config, const Components &set0);
-	void interpolateTable(rkisp1_cif_isp_lsc_config &config,
-			      const Components &set0, const Components &set1,
-			      const uint32_t ct);
+	void interpolateTable(Components &set, const Components &set0,
+			      const Components &set1, const uint32_t ct);
+	const Components &table(uint32_t ct);
 
 	std::map<uint32_t, Components> sets_;
+	std::map<uint32_t, Components> interpolated_;
+	uint32_t ctStep_;
 	std::vector<double> xSize_;
 	std::vector<double> ySize_;
 	uint16_t xGrad_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 	uint16_t yGrad_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 	uint16_t xSizes_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 	uint16_t ySizes_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
-	struct {
-		uint32_t original;
-		uint32_t adjusted;
-	} lastCt_;
+	uint32_t lastCt_;
 };
 
 } /* namespace ipa::rkisp1::algorithms */
@@ -193,6 +193,7 @@ int IPARkISP1::init(const IPASettings &settings, unsigned int hwRevision,
 
 int IPARkISP1::start()
 {
+	resetTimings();
 	setControls(0);
 
 	return 0;
@@ -200,6 +201,7 @@ int IPARkISP1::start()
 
 void IPARkISP1::stop()
 {
+	logTimings();
 	context_.frameContexts.clear();
 }
 
@@ -231,6 +233,8 @@ int IPARkISP1::configure(const IPAConfigInfo &ipaConfig,
 	context_.configuration.sensor.defVBlank = vBlank.def().get<int32_t>();
 	context_.configuration.sensor.size = info.outputSize;
 	context_.configuration.sensor.lineDuration = info.minLineLength * 1.0s / info.pixelRate;
+	setFrameDuration(context_.configuration.sensor.lineDuration *
+			 (info.outputSize.height + context_.configuration.sensor.defVBlank));
 
 	/* Update the camera controls using the new sensor settings. */
 	updateControls(info, sensorControls_, ipaControls);
@@ -246,6 +250,7 @@ int IPARkISP1::configure(const IPAConfigInfo &ipaConfig,
 		minExposure * context_.configuration.sensor.lineDuration;
 	context_.configuration.sensor.maxShutterSpeed =
 		maxExposure * context_.configuration.sensor.lineDuration;
+	context_.camHelper->setGainCodeRange(minGain, maxGain);
 	context_.configuration.sensor.minAnalogueGain =
 		context_.camHelper->gain(minGain);
 	context_.configuration.sensor.maxAnalogueGain =
@@ -327,8 +332,7 @@ void IPARkISP1::fillParamsBuffer(const uint32_t frame, const uint32_t bufferId)
 	/* Prepare parameters buffer. */
 	memset(params, 0, sizeof(*params));
 
-	for (auto const &algo : algorithms())
-		algo->prepare(context_, frame, frameContext, params);
+	prepare(context_, frame, frameContext, params);
 
 	paramsBufferReady.emit(frame);
 }
@@ -354,12 +358,10 @@ void IPARkISP1::processStatsBuffer(const uint32_t frame, const uint32_t bufferId
 
 	ControlList metadata(controls::controls);
 
-	for (auto const &a : algorithms()) {
-		Algorithm *algo = static_cast<Algorithm *>(a.get());
-		if (algo->disabled_)
-			continue;
-		algo->process(context_, frame, frameContext, stats, metadata);
-	}
+	process(context_, frame, frameContext, stats, metadata,
+		[](const auto &algo) {
+			return !static_cast<const Algorithm &>(algo).disabled_;
+		});
 
 	setControls(frame);
 
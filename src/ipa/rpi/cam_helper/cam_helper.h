@@ -115,6 +115,9 @@ private:
 	 * in units of lines.
 	 */
 	unsigned int frameIntegrationDiff_;
+
+	/* Kept across frames to reuse the map nodes. */
+	MdParser::RegisterMap registers_;
 };
 
 /*
@@ -127,8 +127,14 @@ public:
 			       RegisterMap &registers) override;
 
 private:
-	/* Maps register address to offset in the buffer. */
-	using OffsetMap = std::map<uint32_t, std::optional<uint32_t>>;
+	/* Offsets of the tag and of the value of a register in the buffer. */
+	struct Offset {
+		uint32_t tag;
+		uint32_t value;
+	};
+
+	/* Maps register address to offsets in the buffer. */
+	using OffsetMap = std::map<uint32_t, std::optional<Offset>>;
 
 	/*
 	 * Note that error codes > 0 are regarded as non-fatal; codes < 0
@@ -148,6 +154,7 @@ private:
 	};
 
 	ParseStatus findRegs(libcamera::Span<const uint8_t> buffer);
+	bool validateOffsets(libcamera::Span<const uint8_t> buffer) const;
 
 	OffsetMap offsets_;
 };
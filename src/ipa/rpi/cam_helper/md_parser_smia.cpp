@@ -36,6 +36,14 @@ MdParserSmia::MdParserSmia(std::initializer_list<uint32_t> registerList)
 MdParser::Status MdParserSmia::parse(libcamera::Span<const uint8_t> buffer,
 				     RegisterMap &registers)
 {
+	/*
+	 * The register layout doesn't change for a given sensor mode, so the
+	 * offsets found by the last full parse are reused. Check that they
+	 * still point to register values, and parse again if they don't.
+	 */
+	if (!reset_ && !validateOffsets(buffer))
+		reset_ = true;
+
 	if (reset_) {
 		/*
 		 * Search again through the metadata for all the registers
@@ -59,19 +67,48 @@ MdParser::Status MdParserSmia::parse(libcamera::Span<const uint8_t> buffer,
 		reset_ = false;
 	}
 
-	/* Populate the register values requested. */
-	registers.clear();
+	/*
+	 * Populate the register values requested. The map is only cleared if
+	 * it holds other registers, to reuse its nodes across frames.
+	 */
+	if (registers.size() != offsets_.size())
+		registers.clear();
+
 	for (const auto &[reg, offset] : offsets_) {
 		if (!offset) {
 			reset_ = true;
 			return NOTFOUND;
 		}
-		registers[reg] = buffer[offset.value()];
+		registers[reg] = buffer[offset->value];
+	}
+
+	/* Drop any registers left from a different register list. */
+	for (auto it = registers.begin(); registers.size() > offsets_.size();) {
+		if (!offsets_.count(it->first))
+			it = registers.erase(it);
+		else
+			++it;
 	}
 
 	return OK;
 }
 
+bool MdParserSmia::validateOffsets(libcamera::Span<const uint8_t> buffer) const
+{
+	if (buffer.empty() || buffer[0] != LineStart)
+		return false;
+
+	for (const auto &[reg, offset] : offsets_) {
+		if (!offset)
+			return false;
+
+		if (offset->value >= buffer.size() || buffer[offset->tag] != RegValue)
+			return false;
+	}
+
+	return true;
+}
+
 MdParserSmia::ParseStatus MdParserSmia::findRegs(libcamera::Span<const uint8_t> buffer)
 {
 	ASSERT(offsets_.size());
@@ -84,6 +121,7 @@ MdParserSmia::ParseStatus MdParserSmia::findRegs(libcamera::Span<const uint8_t>
 	unsigned int regNum = 0, regsDone = 0;
 
 	while (1) {
+		unsigned int tagOffset = currentOffset;
 		int tag = buffer[currentOffset++];
 
 		/* Non-dummy bytes come in even-sized blocks: skip can only ever follow tag */
@@ -139,7 +177,7 @@ MdParserSmia::ParseStatus MdParserSmia::findRegs(libcamera::Span<const uint8_t>
 				auto reg = offsets_.find(regNum);
 
 				if (reg != offsets_.end()) {
-					offsets_[regNum] = currentOffset - 1;
+					reg->second = Offset{ tagOffset, currentOffset - 1 };
 
 					if (++regsDone == offsets_.size())
 						return ParseOk;
@@ -282,6 +282,10 @@ void IpaBase::start(const ControlList &controls, StartResult *result)
 
 	controller_.switchMode(mode_, &metadata);
 
+	/* Profile the algorithms against the shortest frame duration. */
+	controller_.setFrameDuration(mode_.minFrameDuration);
+	controller_.resetTimings();
+
 	/* Reset the frame lengths queue state. */
 	lastTimeout_ = 0s;
 	frameLengths_.clear();
@@ -352,6 +356,11 @@ void IpaBase::start(const ControlList &controls, StartResult *result)
 	platformStart(controls, result);
 }
 
+void IpaBase::stop()
+{
+	controller_.logTimings();
+}
+
 void IpaBase::mapBuffers(const std::vector<IPABuffer> &buffers)
 {
 	for (const IPABuffer &buffer : buffers) {
@@ -505,6 +514,36 @@ void IpaBase::processStats(const ProcessParams &params)
 	processStatsComplete.emit(params.buffers);
 }
 
+RPiController::StatisticsPtr
+IpaBase::acquireStatistics(RPiController::Statistics::AgcStatsPos agcStatsPos,
+			   RPiController::Statistics::ColourStatsPos colourStatsPos)
+{
+	using namespace RPiController;
+
+	/*
+	 * Algorithms may keep a reference to the statistics past the frame,
+	 * for instance while an asynchronous job uses them. Reuse the first
+	 * pooled object that isn't referenced anymore, its region and
+	 * histogram storage is then reused by the platform instead of being
+	 * reallocated for every frame.
+	 *
+	 * The platform must fill the same fields of the statistics for every
+	 * frame, as the contents of recycled objects are not reset.
+	 */
+	for (const StatisticsPtr &statistics : statisticsPool_) {
+		if (statistics.use_count() == 1 &&
+		    statistics->agcStatsPos == agcStatsPos &&
+		    statistics->colourStatsPos == colourStatsPos)
+			return statistics;
+	}
+
+	StatisticsPtr statistics = std::make_shared<Statistics>(agcStatsPos, colourStatsPos);
+	if (statisticsPool_.size() < maxPooledStatistics)
+		statisticsPool_.push_back(statistics);
+
+	return statistics;
+}
+
 void IpaBase::setMode(const IPACameraSensorInfo &sensorInfo)
 {
 	mode_.bitdepth = sensorInfo.bitsPerPixel;
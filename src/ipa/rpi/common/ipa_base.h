@@ -40,7 +40,7 @@ public:
 			  ConfigResult *result) override;
 
 	void start(const ControlList &controls, StartResult *result) override;
-	void stop() override {}
+	void stop() override;
 
 	void mapBuffers(const std::vector<IPABuffer> &buffers) override;
 	void unmapBuffers(const std::vector<unsigned int> &ids) override;
@@ -76,6 +76,10 @@ protected:
 	/* Whether the stitch block (if available) needs to swap buffers. */
 	bool stitchSwapBuffers_;
 
+	RPiController::StatisticsPtr
+	acquireStatistics(RPiController::Statistics::AgcStatsPos agcStatsPos,
+			  RPiController::Statistics::ColourStatsPos colourStatsPos);
+
 private:
 	/* Number of metadata objects available in the context list. */
 	static constexpr unsigned int numMetadataContexts = 16;
@@ -106,6 +110,10 @@ private:
 
 	std::array<RPiController::Metadata, numMetadataContexts> rpiMetadata_;
 
+	/* Statistics objects recycled across frames, see acquireStatistics(). */
+	static constexpr unsigned int maxPooledStatistics = 8;
+	std::vector<RPiController::StatisticsPtr> statisticsPool_;
+
 	/*
 	 * We count frames to decide if the frame must be hidden (e.g. from
 	 * display) or mistrusted (i.e. not given to the control algos).
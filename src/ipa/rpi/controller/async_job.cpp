@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Asynchronous algorithm job
+ */
+
+#include <libcamera/base/log.h>
+
+#include "async_job.h"
+#include "controller.h"
+
+using namespace RPiController;
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(RPiController)
+
+AsyncJob::AsyncJob(Controller *controller, std::function<void()> func)
+	: controller_(controller), func_(std::move(func)), finished_(false),
+	  started_(false), lateReported_(false), startFrame_(0), deadline_(0),
+	  group_(1, controller->getThreadPool())
+{
+}
+
+AsyncJob::~AsyncJob()
+{
+	group_.wait();
+}
+
+void AsyncJob::start(unsigned int deadline)
+{
+	if (started_)
+		return;
+
+	started_ = true;
+	lateReported_ = false;
+	startFrame_ = controller_->getFrameCount();
+	deadline_ = deadline;
+	finished_.store(false, std::memory_order_relaxed);
+
+	group_.run([this]() {
+		func_();
+		/* Publish the results written by the job to the caller. */
+		finished_.store(true, std::memory_order_release);
+	});
+}
+
+bool AsyncJob::fetch()
+{
+	if (!started_)
+		return false;
+
+	if (!finished_.load(std::memory_order_acquire)) {
+		if (late() && !lateReported_) {
+			LOG(RPiController, Debug)
+				<< "Async job late by "
+				<< controller_->getFrameCount() - startFrame_ - deadline_
+				<< " frames";
+			lateReported_ = true;
+		}
+		return false;
+	}
+
+	started_ = false;
+	return true;
+}
+
+void AsyncJob::wait()
+{
+	if (!started_)
+		return;
+
+	group_.wait();
+	started_ = false;
+}
+
+bool AsyncJob::late() const
+{
+	return started_ && deadline_ &&
+	       controller_->getFrameCount() - startFrame_ > deadline_;
+}
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Asynchronous algorithm job
+ */
+#pragma once
+
+/*
+ * An AsyncJob runs the expensive part of a control algorithm on the thread
+ * pool shared by all the algorithms, so that prepare() and process() never
+ * block on it. Only one instance of the job runs at a time. The job is
+ * started from process(), and its results are fetched in a later prepare()
+ * once it has finished.
+ */
+
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+#include <libcamera/base/thread_pool.h>
+
+namespace RPiController {
+
+class Controller;
+
+class AsyncJob
+{
+public:
+	AsyncJob(Controller *controller, std::function<void()> func);
+	~AsyncJob();
+	/*
+	 * Start the job. The deadline is the number of frames after which
+	 * the results are considered late, 0 for no deadline.
+	 */
+	void start(unsigned int deadline = 0);
+	/* True if the job has been started and its results not fetched yet. */
+	bool running() const { return started_; }
+	/*
+	 * Return true, without blocking, if the job has finished. The caller
+	 * then owns the results and the job can be started again.
+	 */
+	bool fetch();
+	/* Wait for a started job to finish, and drop its results. */
+	void wait();
+	/* True if the running job has missed its deadline. */
+	bool late() const;
+
+private:
+	Controller *controller_;
+	std::function<void()> func_;
+	std::atomic<bool> finished_;
+	/* The following are only for the synchronous thread to use. */
+	bool started_;
+	bool lateReported_;
+	uint64_t startFrame_;
+	unsigned int deadline_;
+	/* Last, so that the job is waited for before anything is destroyed. */
+	libcamera::TaskGroup group_;
+};
+
+} /* namespace RPiController */
@@ -76,7 +76,7 @@ static const std::map<std::string, Controller::HardwareConfig> HardwareConfigMap
 };
 
 Controller::Controller()
-	: switchModeCalled_(false)
+	: switchModeCalled_(false), frameCount_(0)
 {
 }
 
@@ -147,6 +147,7 @@ int Controller::createAlgorithm(const std::string &name, const YamlObject &param
 		return ret;
 
 	algorithms_.push_back(AlgorithmPtr(algo));
+	timings_.emplace_back();
 	return 0;
 }
 
@@ -166,15 +167,70 @@ void Controller::switchMode(CameraMode const &cameraMode, Metadata *metadata)
 void Controller::prepare(Metadata *imageMetadata)
 {
 	assert(switchModeCalled_);
-	for (auto &algo : algorithms_)
-		algo->prepare(imageMetadata);
+	frameCount_++;
+
+	utils::time_point begin = utils::clock::now();
+	for (unsigned int i = 0; i < algorithms_.size(); i++) {
+		utils::time_point start = utils::clock::now();
+		algorithms_[i]->prepare(imageMetadata);
+		timings_[i].prepare.record(utils::clock::now() - start);
+	}
+	prepareTiming_.record(utils::clock::now() - begin);
 }
 
 void Controller::process(StatisticsPtr stats, Metadata *imageMetadata)
 {
 	assert(switchModeCalled_);
-	for (auto &algo : algorithms_)
-		algo->process(stats, imageMetadata);
+
+	utils::time_point begin = utils::clock::now();
+	for (unsigned int i = 0; i < algorithms_.size(); i++) {
+		utils::time_point start = utils::clock::now();
+		algorithms_[i]->process(stats, imageMetadata);
+		timings_[i].process.record(utils::clock::now() - start);
+	}
+	processTiming_.record(utils::clock::now() - begin);
+}
+
+/*
+ * Execution times of the prepare and process calls that exceed the frame
+ * duration are counted as overruns.
+ */
+void Controller::setFrameDuration(utils::Duration duration)
+{
+	prepareTiming_.setBudget(duration);
+	processTiming_.setBudget(duration);
+
+	for (AlgorithmTimings &timings : timings_) {
+		timings.prepare.setBudget(duration);
+		timings.process.setBudget(duration);
+	}
+}
+
+void Controller::resetTimings()
+{
+	prepareTiming_.reset();
+	processTiming_.reset();
+
+	for (AlgorithmTimings &timings : timings_) {
+		timings.prepare.reset();
+		timings.process.reset();
+	}
+}
+
+void Controller::logTimings() const
+{
+	if (!prepareTiming_.count() && !processTiming_.count())
+		return;
+
+	LOG(RPiController, Info)
+		<< "Total: prepare " << prepareTiming_.toString()
+		<< ", process " << processTiming_.toString();
+
+	for (unsigned int i = 0; i < algorithms_.size(); i++)
+		LOG(RPiController, Info)
+			<< algorithms_[i]->name() << ": prepare "
+			<< timings_[i].prepare.toString() << ", process "
+			<< timings_[i].process.toString();
 }
 
 Metadata &Controller::getGlobalMetadata()
@@ -202,6 +258,20 @@ Algorithm *Controller::getAlgorithm(std::string const &name) const
 	return nullptr;
 }
 
+uint64_t Controller::getFrameCount() const
+{
+	return frameCount_;
+}
+
+ThreadPool *Controller::getThreadPool() const
+{
+	/*
+	 * All the asynchronous jobs of all the algorithms share the process
+	 * wide pool, which is sized to the number of CPUs.
+	 */
+	return ThreadPool::instance();
+}
+
 const std::string &Controller::getTarget() const
 {
 	return target_;
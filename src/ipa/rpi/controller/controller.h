@@ -12,12 +12,16 @@
  * convenient manner.
  */
 
+#include <stdint.h>
 #include <vector>
 #include <string>
 
+#include <libcamera/base/thread_pool.h>
 #include <libcamera/base/utils.h>
 #include "libcamera/internal/yaml_parser.h"
 
+#include "libipa/timing_stats.h"
+
 #include "camera_mode.h"
 #include "device_status.h"
 #include "metadata.h"
@@ -60,8 +64,13 @@ public:
 	void process(StatisticsPtr stats, Metadata *imageMetadata);
 	Metadata &getGlobalMetadata();
 	Algorithm *getAlgorithm(std::string const &name) const;
+	uint64_t getFrameCount() const;
+	libcamera::ThreadPool *getThreadPool() const;
 	const std::string &getTarget() const;
 	const HardwareConfig &getHardwareConfig() const;
+	void setFrameDuration(libcamera::utils::Duration duration);
+	void resetTimings();
+	void logTimings() const;
 
 protected:
 	int createAlgorithm(const std::string &name, const libcamera::YamlObject &params);
@@ -71,7 +80,18 @@ protected:
 	bool switchModeCalled_;
 
 private:
+	struct AlgorithmTimings {
+		libcamera::ipa::TimingStats prepare;
+		libcamera::ipa::TimingStats process;
+	};
+
 	std::string target_;
+	uint64_t frameCount_;
+
+	/* Execution times, indexed as algorithms_. */
+	std::vector<AlgorithmTimings> timings_;
+	libcamera::ipa::TimingStats prepareTiming_;
+	libcamera::ipa::TimingStats processTiming_;
 };
 
 } /* namespace RPiController */
@@ -26,8 +26,14 @@ public:
 	}
 
 	template<typename T> Histogram(T *histogram, int num)
+	{
+		assign(histogram, num);
+	}
+	/* Replace the contents, reusing the storage when possible. */
+	template<typename T> void assign(T *histogram, int num)
 	{
 		assert(num);
+		cumulative_.clear();
 		cumulative_.reserve(num + 1);
 		cumulative_.push_back(0);
 		for (int i = 0; i < num; i++)
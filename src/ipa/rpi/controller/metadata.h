@@ -12,11 +12,19 @@
 #include <map>
 #include <mutex>
 #include <string>
+#include <string_view>
 
 #include <libcamera/base/thread_annotations.h>
 
 namespace RPiController {
 
+/*
+ * Metadata is cleared and filled again for every frame, with the same tags and
+ * types. To avoid allocating memory in the steady state, clearing the metadata
+ * only invalidates its entries, and setting a tag that already holds a value of
+ * the same type assigns the value in place. Tags are looked up through
+ * std::string_view, so string literals don't create temporary strings.
+ */
 class LIBCAMERA_TSA_CAPABILITY("mutex") Metadata
 {
 public:
@@ -36,27 +44,28 @@ public:
 	}
 
 	template<typename T>
-	void set(std::string const &tag, T const &value)
+	void set(std::string_view tag, T const &value)
 	{
 		std::scoped_lock lock(mutex_);
-		data_[tag] = value;
+		setLocked(tag, value);
 	}
 
 	template<typename T>
-	int get(std::string const &tag, T &value) const
+	int get(std::string_view tag, T &value) const
 	{
 		std::scoped_lock lock(mutex_);
-		auto it = data_.find(tag);
-		if (it == data_.end())
+		const Entry *entry = find(tag);
+		if (!entry)
 			return -1;
-		value = std::any_cast<T>(it->second);
+		value = std::any_cast<T>(entry->value);
 		return 0;
 	}
 
 	void clear()
 	{
 		std::scoped_lock lock(mutex_);
-		data_.clear();
+		for (auto &[tag, entry] : data_)
+			entry.valid = false;
 	}
 
 	Metadata &operator=(Metadata const &other)
@@ -77,7 +86,22 @@ public:
 	void merge(Metadata &other)
 	{
 		std::scoped_lock lock(mutex_, other.mutex_);
-		data_.merge(other.data_);
+		/*
+		 * Move the items whose key doesn't exist here, the other items
+		 * are left in other.
+		 */
+		for (auto &[tag, entry] : other.data_) {
+			if (!entry.valid)
+				continue;
+
+			Entry &dst = data_[tag];
+			if (dst.valid)
+				continue;
+
+			dst.value = std::move(entry.value);
+			dst.valid = true;
+			entry.valid = false;
+		}
 	}
 
 	void mergeCopy(const Metadata &other)
@@ -87,27 +111,47 @@ public:
 		 * If the metadata key exists, ignore this item and copy only
 		 * unique key/value pairs.
 		 */
-		data_.insert(other.data_.begin(), other.data_.end());
+		for (auto const &[tag, entry] : other.data_) {
+			if (!entry.valid)
+				continue;
+
+			Entry &dst = data_[tag];
+			if (dst.valid)
+				continue;
+
+			dst.value = entry.value;
+			dst.valid = true;
+		}
 	}
 
 	template<typename T>
-	T *getLocked(std::string const &tag)
+	T *getLocked(std::string_view tag)
 	{
 		/*
 		 * This allows in-place access to the Metadata contents,
 		 * for which you should be holding the lock.
 		 */
-		auto it = data_.find(tag);
-		if (it == data_.end())
+		Entry *entry = find(tag);
+		if (!entry)
 			return nullptr;
-		return std::any_cast<T>(&it->second);
+		return std::any_cast<T>(&entry->value);
 	}
 
 	template<typename T>
-	void setLocked(std::string const &tag, T const &value)
+	void setLocked(std::string_view tag, T const &value)
 	{
 		/* Use this only if you're holding the lock yourself. */
-		data_[tag] = value;
+		auto it = data_.find(tag);
+		if (it == data_.end())
+			it = data_.emplace(std::string(tag), Entry{}).first;
+
+		Entry &entry = it->second;
+		T *current = std::any_cast<T>(&entry.value);
+		if (current)
+			*current = value;
+		else
+			entry.value = value;
+		entry.valid = true;
 	}
 
 	/*
@@ -120,8 +164,30 @@ public:
 	void unlock() LIBCAMERA_TSA_RELEASE() { mutex_.unlock(); }
 
 private:
+	struct Entry {
+		std::any value;
+		/* False if the entry has been cleared, value is then stale. */
+		bool valid = false;
+	};
+
+	Entry *find(std::string_view tag)
+	{
+		auto it = data_.find(tag);
+		if (it == data_.end() || !it->second.valid)
+			return nullptr;
+		return &it->second;
+	}
+
+	const Entry *find(std::string_view tag) const
+	{
+		auto it = data_.find(tag);
+		if (it == data_.end() || !it->second.valid)
+			return nullptr;
+		return &it->second;
+	}
+
 	mutable std::mutex mutex_;
-	std::map<std::string, std::any> data_;
+	std::map<std::string, Entry, std::less<>> data_;
 };
 
 } /* namespace RPiController */
@@ -301,6 +301,17 @@ void Af::computeWeights(RegionWeights *wgts, unsigned rows, unsigned cols)
 			}
 		}
 	}
+
+	/*
+	 * The AF window usually covers a small part of the image. Record the
+	 * weighted regions, so that the per-frame accumulations only visit
+	 * them, in memory order.
+	 */
+	wgts->active.clear();
+	for (unsigned i = 0; i < wgts->w.size(); ++i) {
+		if (wgts->w[i])
+			wgts->active.push_back(i);
+	}
 }
 
 void Af::invalidateWeights()
@@ -318,21 +329,23 @@ bool Af::getPhase(PdafRegions const &regions, double &phase, double &conf)
 		computeWeights(&phaseWeights_, size.height, size.width);
 	}
 
+	const unsigned confThresh = cfg_.confThresh;
+	const unsigned confClip = cfg_.confClip;
+	const unsigned confOffset = confThresh >> 2;
+	const auto stats = regions.begin();
+	const uint16_t *weights = phaseWeights_.w.data();
+
 	uint32_t sumWc = 0;
 	int64_t sumWcp = 0;
-	for (unsigned i = 0; i < regions.numRegions(); ++i) {
-		unsigned w = phaseWeights_.w[i];
-		if (w) {
-			const PdafData &data = regions.get(i).val;
-			unsigned c = data.conf;
-			if (c >= cfg_.confThresh) {
-				if (c > cfg_.confClip)
-					c = cfg_.confClip;
-				c -= (cfg_.confThresh >> 2);
-				sumWc += w * c;
-				c -= (cfg_.confThresh >> 2);
-				sumWcp += (int64_t)(w * c) * (int64_t)data.phase;
-			}
+	for (unsigned i : phaseWeights_.active) {
+		const PdafData &data = stats[i].val;
+		unsigned c = data.conf;
+		if (c >= confThresh) {
+			unsigned w = weights[i];
+			c = std::min(c, confClip) - confOffset;
+			sumWc += w * c;
+			c -= confOffset;
+			sumWcp += (int64_t)(w * c) * (int64_t)data.phase;
 		}
 	}
 
@@ -357,9 +370,12 @@ double Af::getContrast(const FocusRegions &focusStats)
 		computeWeights(&contrastWeights_, size.height, size.width);
 	}
 
+	const auto stats = focusStats.begin();
+	const uint16_t *weights = contrastWeights_.w.data();
+
 	uint64_t sumWc = 0;
-	for (unsigned i = 0; i < focusStats.numRegions(); ++i)
-		sumWc += contrastWeights_.w[i] * focusStats.get(i).val;
+	for (unsigned i : contrastWeights_.active)
+		sumWc += weights[i] * stats[i].val;
 
 	return (contrastWeights_.sum > 0) ? ((double)sumWc / (double)contrastWeights_.sum) : 0.0;
 }
@@ -29,20 +29,13 @@ LOG_DEFINE_CATEGORY(RPiAlsc)
 static const double InsufficientData = -1.0;
 
 Alsc::Alsc(Controller *controller)
-	: Algorithm(controller)
+	: Algorithm(controller),
+	  asyncJob_(controller, std::bind(&Alsc::doAlsc, this))
 {
-	asyncAbort_ = asyncStart_ = asyncStarted_ = asyncFinished_ = false;
-	asyncThread_ = std::thread(std::bind(&Alsc::asyncFunc, this));
 }
 
 Alsc::~Alsc()
 {
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncAbort_ = true;
-	}
-	asyncSignal_.notify_one();
-	asyncThread_.join();
 }
 
 char const *Alsc::name() const
@@ -232,18 +225,6 @@ void Alsc::initialise()
 		m.resize(XY);
 }
 
-void Alsc::waitForAysncThread()
-{
-	if (asyncStarted_) {
-		asyncStarted_ = false;
-		std::unique_lock<std::mutex> lock(mutex_);
-		syncSignal_.wait(lock, [&] {
-			return asyncFinished_;
-		});
-		asyncFinished_ = false;
-	}
-}
-
 static bool compareModes(CameraMode const &cm0, CameraMode const &cm1)
 {
 	/*
@@ -282,7 +263,7 @@ void Alsc::switchMode(CameraMode const &cameraMode,
 	ct_ = getCt(metadata, ct_);
 
 	/* Ensure the other thread isn't running while we do this. */
-	waitForAysncThread();
+	asyncJob_.wait();
 
 	cameraMode_ = cameraMode;
 
@@ -320,8 +301,6 @@ void Alsc::switchMode(CameraMode const &cameraMode,
 void Alsc::fetchAsyncResults()
 {
 	LOG(RPiAlsc, Debug) << "Fetch ALSC results";
-	asyncFinished_ = false;
-	asyncStarted_ = false;
 	syncResults_ = asyncResults_;
 }
 
@@ -373,12 +352,7 @@ void Alsc::restartAsync(StatisticsPtr &stats, Metadata *imageMetadata)
 	 */
 	copyStats(statistics_, stats, prevSyncResults_);
 	framePhase_ = 0;
-	asyncStarted_ = true;
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncStart_ = true;
-	}
-	asyncSignal_.notify_one();
+	asyncJob_.start(config_.framePeriod);
 }
 
 void Alsc::prepare(Metadata *imageMetadata)
@@ -394,11 +368,8 @@ void Alsc::prepare(Metadata *imageMetadata)
 			       : config_.speed;
 	LOG(RPiAlsc, Debug)
 		<< "frame count " << frameCount_ << " speed " << speed;
-	{
-		std::unique_lock<std::mutex> lock(mutex_);
-		if (asyncStarted_ && asyncFinished_)
-			fetchAsyncResults();
-	}
+	if (asyncJob_.fetch())
+		fetchAsyncResults();
 	/* Apply IIR filter to results and program into the pipeline. */
 	for (unsigned int j = 0; j < syncResults_.size(); j++) {
 		for (unsigned int i = 0; i < syncResults_[j].size(); i++)
@@ -430,32 +401,11 @@ void Alsc::process(StatisticsPtr &stats, Metadata *imageMetadata)
 	LOG(RPiAlsc, Debug) << "frame_phase " << framePhase_;
 	if (framePhase_ >= (int)config_.framePeriod ||
 	    frameCount2_ < (int)config_.startupFrames) {
-		if (asyncStarted_ == false)
+		if (!asyncJob_.running())
 			restartAsync(stats, imageMetadata);
 	}
 }
 
-void Alsc::asyncFunc()
-{
-	while (true) {
-		{
-			std::unique_lock<std::mutex> lock(mutex_);
-			asyncSignal_.wait(lock, [&] {
-				return asyncStart_ || asyncAbort_;
-			});
-			asyncStart_ = false;
-			if (asyncAbort_)
-				break;
-		}
-		doAlsc();
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			asyncFinished_ = true;
-		}
-		syncSignal_.notify_one();
-	}
-}
-
 void getCalTable(double ct, std::vector<AlscCalibration> const &calibrations,
 		 Array2D<double> &calTable)
 {
@@ -7,15 +7,13 @@
 #pragma once
 
 #include <array>
-#include <mutex>
-#include <condition_variable>
-#include <thread>
 #include <vector>
 
 #include <libcamera/geometry.h>
 
 #include "../algorithm.h"
 #include "../alsc_status.h"
+#include "../async_job.h"
 #include "../statistics.h"
 
 namespace RPiController {
@@ -122,26 +120,11 @@ private:
 	bool firstTime_;
 	CameraMode cameraMode_;
 	Array2D<double> luminanceTable_;
-	std::thread asyncThread_;
-	void asyncFunc(); /* asynchronous thread function */
-	std::mutex mutex_;
-	/* condvar for async thread to wait on */
-	std::condition_variable asyncSignal_;
-	/* condvar for synchronous thread to wait on */
-	std::condition_variable syncSignal_;
-	/* for sync thread to check  if async thread finished (requires mutex) */
-	bool asyncFinished_;
-	/* for async thread to check if it's been told to run (requires mutex) */
-	bool asyncStart_;
-	/* for async thread to check if it's been told to quit (requires mutex) */
-	bool asyncAbort_;
 
 	/*
 	 * The following are only for the synchronous thread to use:
-	 * for sync thread to note its has asked async thread to run
+	 * counts up to framePeriod before restarting the async job
 	 */
-	bool asyncStarted_;
-	/* counts up to framePeriod before restarting the async thread */
 	int framePhase_;
 	/* counts up to startupFrames */
 	int frameCount_;
@@ -149,13 +132,12 @@ private:
 	int frameCount2_;
 	std::array<Array2D<double>, 3> syncResults_;
 	std::array<Array2D<double>, 3> prevSyncResults_;
-	void waitForAysncThread();
 	/*
-	 * The following are for the asynchronous thread to use, though the main
-	 * thread can set/reset them if the async thread is known to be idle:
+	 * The following are for the asynchronous job to use, though the main
+	 * thread can set/reset them if the async job is known to be idle:
 	 */
 	void restartAsync(StatisticsPtr &stats, Metadata *imageMetadata);
-	/* copy out the results from the async thread so that it can be restarted */
+	/* copy out the results from the async job so that it can be restarted */
 	void fetchAsyncResults();
 	double ct_;
 	RgbyRegions statistics_;
@@ -169,6 +151,9 @@ private:
 	/* Temporaries for the computations */
 	std::array<Array2D<double>, 5> tmpC_;
 	std::array<SparseArray<double>, 3> tmpM_;
+
+	/* Last, so that it is destroyed before the data it uses. */
+	AsyncJob asyncJob_;
 };
 
 } /* namespace RPiController */
@@ -171,22 +171,15 @@ int AwbConfig::read(const libcamera::YamlObject &params)
 }
 
 Awb::Awb(Controller *controller)
-	: AwbAlgorithm(controller)
+	: AwbAlgorithm(controller),
+	  asyncJob_(controller, std::bind(&Awb::doAwb, this))
 {
-	asyncAbort_ = asyncStart_ = asyncStarted_ = asyncFinished_ = false;
 	mode_ = nullptr;
 	manualR_ = manualB_ = 0.0;
-	asyncThread_ = std::thread(std::bind(&Awb::asyncFunc, this));
 }
 
 Awb::~Awb()
 {
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncAbort_ = true;
-	}
-	asyncSignal_.notify_one();
-	asyncThread_.join();
 }
 
 char const *Awb::name() const
@@ -297,11 +290,9 @@ bool Awb::isAutoEnabled() const
 void Awb::fetchAsyncResults()
 {
 	LOG(RPiAwb, Debug) << "Fetch AWB results";
-	asyncFinished_ = false;
-	asyncStarted_ = false;
 	/*
 	 * It's possible manual gains could be set even while the async
-	 * thread was running, so only copy the results if still in auto mode.
+	 * job was running, so only copy the results if still in auto mode.
 	 */
 	if (isAutoEnabled())
 		syncResults_ = asyncResults_;
@@ -319,15 +310,10 @@ void Awb::restartAsync(StatisticsPtr &stats, double lux)
 			: (mode_ == nullptr ? config_.defaultMode : mode_);
 	lux_ = lux;
 	framePhase_ = 0;
-	asyncStarted_ = true;
 	size_t len = modeName_.copy(asyncResults_.mode,
 				    sizeof(asyncResults_.mode) - 1);
 	asyncResults_.mode[len] = '\0';
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncStart_ = true;
-	}
-	asyncSignal_.notify_one();
+	asyncJob_.start(config_.framePeriod);
 }
 
 void Awb::prepare(Metadata *imageMetadata)
@@ -339,11 +325,8 @@ void Awb::prepare(Metadata *imageMetadata)
 			       : config_.speed;
 	LOG(RPiAwb, Debug)
 		<< "frame_count " << frameCount_ << " speed " << speed;
-	{
-		std::unique_lock<std::mutex> lock(mutex_);
-		if (asyncStarted_ && asyncFinished_)
-			fetchAsyncResults();
-	}
+	if (asyncJob_.fetch())
+		fetchAsyncResults();
 	/* Finally apply IIR filter to results and put into metadata. */
 	memcpy(prevSyncResults_.mode, syncResults_.mode,
 	       sizeof(prevSyncResults_.mode));
@@ -364,11 +347,11 @@ void Awb::prepare(Metadata *imageMetadata)
 
 void Awb::process(StatisticsPtr &stats, Metadata *imageMetadata)
 {
-	/* Count frames since we last poked the async thread. */
+	/* Count frames since we last poked the async job. */
 	if (framePhase_ < (int)config_.framePeriod)
 		framePhase_++;
 	LOG(RPiAwb, Debug) << "frame_phase " << framePhase_;
-	/* We do not restart the async thread if we're not in auto mode. */
+	/* We do not restart the async job if we're not in auto mode. */
 	if (isAutoEnabled() &&
 	    (framePhase_ >= (int)config_.framePeriod ||
 	     frameCount_ < (int)config_.startupFrames)) {
@@ -379,32 +362,11 @@ void Awb::process(StatisticsPtr &stats, Metadata *imageMetadata)
 			LOG(RPiAwb, Debug) << "No lux metadata found";
 		LOG(RPiAwb, Debug) << "Awb lux value is " << luxStatus.lux;
 
-		if (asyncStarted_ == false)
+		if (!asyncJob_.running())
 			restartAsync(stats, luxStatus.lux);
 	}
 }
 
-void Awb::asyncFunc()
-{
-	while (true) {
-		{
-			std::unique_lock<std::mutex> lock(mutex_);
-			asyncSignal_.wait(lock, [&] {
-				return asyncStart_ || asyncAbort_;
-			});
-			asyncStart_ = false;
-			if (asyncAbort_)
-				break;
-		}
-		doAwb();
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			asyncFinished_ = true;
-		}
-		syncSignal_.notify_one();
-	}
-}
-
 static void generateStats(std::vector<Awb::RGB> &zones,
 			  StatisticsPtr &stats, double minPixels,
 			  double minG, Metadata &globalMetadata)
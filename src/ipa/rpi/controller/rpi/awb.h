@@ -6,12 +6,9 @@
  */
 #pragma once
 
-#include <mutex>
-#include <condition_variable>
-#include <thread>
-
 #include <libcamera/geometry.h>
 
+#include "../async_job.h"
 #include "../awb_algorithm.h"
 #include "../awb_status.h"
 #include "../statistics.h"
@@ -123,37 +120,22 @@ private:
 	bool isAutoEnabled() const;
 	/* configuration is read-only, and available to both threads */
 	AwbConfig config_;
-	std::thread asyncThread_;
-	void asyncFunc(); /* asynchronous thread function */
-	std::mutex mutex_;
-	/* condvar for async thread to wait on */
-	std::condition_variable asyncSignal_;
-	/* condvar for synchronous thread to wait on */
-	std::condition_variable syncSignal_;
-	/* for sync thread to check  if async thread finished (requires mutex) */
-	bool asyncFinished_;
-	/* for async thread to check if it's been told to run (requires mutex) */
-	bool asyncStart_;
-	/* for async thread to check if it's been told to quit (requires mutex) */
-	bool asyncAbort_;
 
 	/*
 	 * The following are only for the synchronous thread to use:
-	 * for sync thread to note its has asked async thread to run
+	 * counts up to framePeriod before restarting the async job
 	 */
-	bool asyncStarted_;
-	/* counts up to framePeriod before restarting the async thread */
 	int framePhase_;
 	int frameCount_; /* counts up to startup_frames */
 	AwbStatus syncResults_;
 	AwbStatus prevSyncResults_;
 	std::string modeName_;
 	/*
-	 * The following are for the asynchronous thread to use, though the main
-	 * thread can set/reset them if the async thread is known to be idle:
+	 * The following are for the asynchronous job to use, though the main
+	 * thread can set/reset them if the async job is known to be idle:
 	 */
 	void restartAsync(StatisticsPtr &stats, double lux);
-	/* copy out the results from the async thread so that it can be restarted */
+	/* copy out the results from the async job so that it can be restarted */
 	void fetchAsyncResults();
 	StatisticsPtr statistics_;
 	AwbMode *mode_;
@@ -173,6 +155,9 @@ private:
 	double manualR_;
 	/* manual b setting */
 	double manualB_;
+
+	/* Last, so that it is destroyed before the data it uses. */
+	AsyncJob asyncJob_;
 };
 
 static inline Awb::RGB operator+(Awb::RGB const &a, Awb::RGB const &b)
@@ -276,6 +276,7 @@ bool Hdr::updateTonemap([[maybe_unused]] StatisticsPtr &stats, HdrConfig &config
 
 	/* Generate the tonemap, including the contrast adjustment factors. */
 	libcamera::ipa::Pwl tonemap;
+	int span = -1;
 	tonemap.append(0, 0);
 	for (unsigned int i = 0; i <= 6; i++) {
 		double x = 1 << (i + 9); /* x loops from 512 to 32768 inclusive */
@@ -283,7 +284,7 @@ bool Hdr::updateTonemap([[maybe_unused]] StatisticsPtr &stats, HdrConfig &config
 		if (i < config.contrastAdjustments.size())
 			y *= config.contrastAdjustments[i];
 		if (!tonemap_.empty())
-			y = y * config.speed + tonemap_.eval(x) * (1 - config.speed);
+			y = y * config.speed + tonemap_.eval(x, &span) * (1 - config.speed);
 		tonemap.append(x, y);
 	}
 	tonemap.append(65535, 65535);
@@ -78,6 +78,7 @@ int generateLut(const ipa::Pwl &pwl, uint32_t *lut, std::size_t lutSize,
 		return -EINVAL;
 
 	int lastY = 0;
+	int span = -1;
 	for (unsigned int i = 0; i < lutSize; i++) {
 		int x, y;
 		if (i < 32)
@@ -87,7 +88,7 @@ int generateLut(const ipa::Pwl &pwl, uint32_t *lut, std::size_t lutSize,
 		else
 			x = std::min(65535u, (i - 48) * 2048 + 32768);
 
-		y = pwl.eval(x);
+		y = pwl.eval(x, &span);
 		if (y < 0 || (i && y < lastY)) {
 			LOG(IPARPI, Error)
 				<< "Malformed PWL for Gamma, disabling!";
@@ -451,12 +452,11 @@ RPiController::StatisticsPtr IpaPiSP::platformProcessStats(Span<uint8_t> mem)
 
 	unsigned int i;
 	StatisticsPtr statistics =
-		std::make_unique<Statistics>(Statistics::AgcStatsPos::PostWb,
-					     Statistics::ColourStatsPos::PreLsc);
+		acquireStatistics(Statistics::AgcStatsPos::PostWb,
+				  Statistics::ColourStatsPos::PreLsc);
 
 	/* RGB histograms are not used, so do not populate them. */
-	statistics->yHist = RPiController::Histogram(stats->agc.histogram,
-						     PISP_AGC_STATS_NUM_BINS);
+	statistics->yHist.assign(stats->agc.histogram, PISP_AGC_STATS_NUM_BINS);
 
 	statistics->awbRegions.init({ PISP_AWB_STATS_SIZE, PISP_AWB_STATS_SIZE });
 	for (i = 0; i < statistics->awbRegions.numRegions(); i++)
@@ -200,14 +200,13 @@ RPiController::StatisticsPtr IpaVc4::platformProcessStats(Span<uint8_t> mem)
 	using namespace RPiController;
 
 	const bcm2835_isp_stats *stats = reinterpret_cast<bcm2835_isp_stats *>(mem.data());
-	StatisticsPtr statistics = std::make_shared<Statistics>(Statistics::AgcStatsPos::PreWb,
-								Statistics::ColourStatsPos::PostLsc);
+	StatisticsPtr statistics = acquireStatistics(Statistics::AgcStatsPos::PreWb,
+						     Statistics::ColourStatsPos::PostLsc);
 	const Controller::HardwareConfig &hw = controller_.getHardwareConfig();
 	unsigned int i;
 
 	/* RGB histograms are not used, so do not populate them. */
-	statistics->yHist = RPiController::Histogram(stats->hist[0].g_hist,
-						     hw.numHistogramBins);
+	statistics->yHist.assign(stats->hist[0].g_hist, hw.numHistogramBins);
 
 	/* All region sums are based on a 16-bit normalised pipeline bit-depth. */
 	unsigned int scale = Statistics::NormalisationFactorPow2 - hw.pipelineWidth;
@@ -370,13 +369,15 @@ void IpaVc4::applyGamma(const struct ContrastStatus *contrastStatus, ControlList
 {
 	const unsigned int numGammaPoints = controller_.getHardwareConfig().numGammaPoints;
 	struct bcm2835_isp_gamma gamma;
+	int span = -1;
 
+	/* The points are in ascending order, carry the span over. */
 	for (unsigned int i = 0; i < numGammaPoints - 1; i++) {
 		int x = i < 16 ? i * 1024
 			       : (i < 24 ? (i - 16) * 2048 + 16384
 					 : (i - 24) * 4096 + 32768);
 		gamma.x[i] = x;
-		gamma.y[i] = std::min<uint16_t>(65535, contrastStatus->gammaCurve.eval(x));
+		gamma.y[i] = std::min<uint16_t>(65535, contrastStatus->gammaCurve.eval(x, &span));
 	}
 
 	gamma.x[numGammaPoints - 1] = 65535;
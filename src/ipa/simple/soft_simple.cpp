@@ -59,7 +59,8 @@ class IPASoftSimple : public ipa::soft::IPASoftInterface
 public:
 	IPASoftSimple()
 		: params_(nullptr), stats_(nullptr), blackLevel_(BlackLevel()),
-		  ignoreUpdates_(0)
+		  gainR_(256), gainB_(256), tablesSequence_(0), buffersSequence_{},
+		  awbInterval_(1), frameCount_(0), ignoreUpdates_(0)
 	{
 	}
 
@@ -74,9 +75,13 @@ public:
 	int start() override;
 	void stop() override;
 
-	void processStats(const ControlList &sensorControls) override;
+	void fillParamsBuffer(const uint32_t frame, const uint32_t bufferId) override;
+	void processStats(const uint32_t statsBufferId,
+			  const ControlList &sensorControls) override;
 
 private:
+	bool updateGammaTable(uint8_t blackLevel);
+	void updateLookupTables();
 	void updateExposure(double exposureMSV);
 
 	DebayerParams *params_;
@@ -88,6 +93,20 @@ private:
 	static constexpr unsigned int kGammaLookupSize = 1024;
 	std::array<uint8_t, kGammaLookupSize> gammaTable_;
 	int lastBlackLevel_ = -1;
+	unsigned int gainR_;
+	unsigned int gainB_;
+
+	/*
+	 * The lookup tables are computed when the gains or the gamma table
+	 * change, and copied to the parameters buffers that don't hold the
+	 * latest version yet.
+	 */
+	DebayerParams tables_;
+	unsigned int tablesSequence_;
+	std::array<unsigned int, kDebayerParamsBufferCount> buffersSequence_;
+
+	unsigned int awbInterval_;
+	unsigned int frameCount_;
 
 	int32_t exposureMin_, exposureMax_;
 	int32_t exposure_;
@@ -99,9 +118,9 @@ private:
 IPASoftSimple::~IPASoftSimple()
 {
 	if (stats_)
-		munmap(stats_, sizeof(SwIspStats));
+		munmap(stats_, sizeof(SwIspStatsBuffers));
 	if (params_)
-		munmap(params_, sizeof(DebayerParams));
+		munmap(params_, sizeof(DebayerParamsBuffers));
 }
 
 int IPASoftSimple::init(const IPASettings &settings,
@@ -134,6 +153,12 @@ int IPASoftSimple::init(const IPASettings &settings,
 	unsigned int version = (*data)["version"].get<uint32_t>(0);
 	LOG(IPASoft, Debug) << "Tuning file version " << version;
 
+	/*
+	 * The white balance changes slowly, there is no need to compute the
+	 * gains for every frame.
+	 */
+	awbInterval_ = std::max((*data)["awb-interval"].get<uint32_t>(1), 1U);
+
 	params_ = nullptr;
 	stats_ = nullptr;
 
@@ -148,7 +173,7 @@ int IPASoftSimple::init(const IPASettings &settings,
 	}
 
 	{
-		void *mem = mmap(nullptr, sizeof(DebayerParams), PROT_WRITE,
+		void *mem = mmap(nullptr, sizeof(DebayerParamsBuffers), PROT_WRITE,
 				 MAP_SHARED, fdParams.get(), 0);
 		if (mem == MAP_FAILED) {
 			LOG(IPASoft, Error) << "Unable to map Parameters";
@@ -159,7 +184,7 @@ int IPASoftSimple::init(const IPASettings &settings,
 	}
 
 	{
-		void *mem = mmap(nullptr, sizeof(SwIspStats), PROT_READ,
+		void *mem = mmap(nullptr, sizeof(SwIspStatsBuffers), PROT_READ,
 				 MAP_SHARED, fdStats.get(), 0);
 		if (mem == MAP_FAILED) {
 			LOG(IPASoft, Error) << "Unable to map Statistics";
@@ -206,6 +231,7 @@ int IPASoftSimple::configure(const ControlInfoMap &sensorInfoMap)
 	int32_t againMax = gainInfo.max().get<int32_t>();
 
 	if (camHelper_) {
+		camHelper_->setGainCodeRange(againMin, againMax);
 		againMin_ = camHelper_->gain(againMin);
 		againMax_ = camHelper_->gain(againMax);
 		againMinStep_ = (againMax_ - againMin_) / 100.0;
@@ -238,6 +264,8 @@ int IPASoftSimple::configure(const ControlInfoMap &sensorInfoMap)
 
 int IPASoftSimple::start()
 {
+	frameCount_ = 0;
+
 	return 0;
 }
 
@@ -245,65 +273,122 @@ void IPASoftSimple::stop()
 {
 }
 
-void IPASoftSimple::processStats(const ControlList &sensorControls)
+bool IPASoftSimple::updateGammaTable(uint8_t blackLevel)
 {
-	SwIspStats::Histogram histogram = stats_->yHistogram;
-	if (ignoreUpdates_ > 0)
-		blackLevel_.update(histogram);
-	const uint8_t blackLevel = blackLevel_.get();
+	if (blackLevel == lastBlackLevel_)
+		return false;
 
-	/*
-	 * Black level must be subtracted to get the correct AWB ratios, they
-	 * would be off if they were computed from the whole brightness range
-	 * rather than from the sensor range.
-	 */
-	const uint64_t nPixels = std::accumulate(
-		histogram.begin(), histogram.end(), 0);
-	const uint64_t offset = blackLevel * nPixels;
-	const uint64_t sumR = stats_->sumR_ - offset / 4;
-	const uint64_t sumG = stats_->sumG_ - offset / 2;
-	const uint64_t sumB = stats_->sumB_ - offset / 4;
+	constexpr float gamma = 0.5;
+	const unsigned int blackIndex = blackLevel * kGammaLookupSize / 256;
+	std::fill(gammaTable_.begin(), gammaTable_.begin() + blackIndex, 0);
+	const float divisor = kGammaLookupSize - blackIndex - 1.0;
+	for (unsigned int i = blackIndex; i < kGammaLookupSize; i++)
+		gammaTable_[i] = UINT8_MAX *
+				 std::pow((i - blackIndex) / divisor, gamma);
 
-	/*
-	 * Calculate red and blue gains for AWB.
-	 * Clamp max gain at 4.0, this also avoids 0 division.
-	 * Gain: 128 = 0.5, 256 = 1.0, 512 = 2.0, etc.
-	 */
-	const unsigned int gainR = sumR <= sumG / 4 ? 1024 : 256 * sumG / sumR;
-	const unsigned int gainB = sumB <= sumG / 4 ? 1024 : 256 * sumG / sumB;
+	lastBlackLevel_ = blackLevel;
+
+	return true;
+}
+
+void IPASoftSimple::updateLookupTables()
+{
 	/* Green gain and gamma values are fixed */
 	constexpr unsigned int gainG = 256;
 
-	/* Update the gamma table if needed */
-	if (blackLevel != lastBlackLevel_) {
-		constexpr float gamma = 0.5;
-		const unsigned int blackIndex = blackLevel * kGammaLookupSize / 256;
-		std::fill(gammaTable_.begin(), gammaTable_.begin() + blackIndex, 0);
-		const float divisor = kGammaLookupSize - blackIndex - 1.0;
-		for (unsigned int i = blackIndex; i < kGammaLookupSize; i++)
-			gammaTable_[i] = UINT8_MAX *
-					 std::pow((i - blackIndex) / divisor, gamma);
-
-		lastBlackLevel_ = blackLevel;
-	}
-
 	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
 		constexpr unsigned int div =
 			DebayerParams::kRGBLookupSize * 256 / kGammaLookupSize;
 		unsigned int idx;
 
 		/* Apply gamma after gain! */
-		idx = std::min({ i * gainR / div, (kGammaLookupSize - 1) });
-		params_->red[i] = gammaTable_[idx];
+		idx = std::min({ i * gainR_ / div, (kGammaLookupSize - 1) });
+		tables_.red[i] = gammaTable_[idx];
 
 		idx = std::min({ i * gainG / div, (kGammaLookupSize - 1) });
-		params_->green[i] = gammaTable_[idx];
+		tables_.green[i] = gammaTable_[idx];
+
+		idx = std::min({ i * gainB_ / div, (kGammaLookupSize - 1) });
+		tables_.blue[i] = gammaTable_[idx];
+	}
+
+	tablesSequence_++;
+}
+
+void IPASoftSimple::fillParamsBuffer([[maybe_unused]] const uint32_t frame,
+				     const uint32_t bufferId)
+{
+	if (bufferId >= kDebayerParamsBufferCount) {
+		LOG(IPASoft, Error) << "Invalid parameters buffer " << bufferId;
+		return;
+	}
+
+	/* Use the default black level until the statistics provide one. */
+	if (lastBlackLevel_ < 0) {
+		updateGammaTable(blackLevel_.get());
+		updateLookupTables();
+	}
+
+	if (buffersSequence_[bufferId] != tablesSequence_) {
+		params_[bufferId] = tables_;
+		buffersSequence_[bufferId] = tablesSequence_;
+	}
+
+	setIspParams.emit(bufferId);
+}
 
-		idx = std::min({ i * gainB / div, (kGammaLookupSize - 1) });
-		params_->blue[i] = gammaTable_[idx];
+void IPASoftSimple::processStats(const uint32_t statsBufferId,
+				 const ControlList &sensorControls)
+{
+	if (statsBufferId >= kSwIspStatsBufferCount) {
+		LOG(IPASoft, Error) << "Invalid statistics buffer " << statsBufferId;
+		return;
+	}
+
+	/*
+	 * Copy the statistics and release the buffer right away, to keep it
+	 * available to the Software ISP for the next frames.
+	 */
+	const SwIspStats stats = stats_[statsBufferId];
+	releaseStatsBuffer.emit(statsBufferId);
+
+	SwIspStats::Histogram histogram = stats.yHistogram;
+	if (ignoreUpdates_ > 0)
+		blackLevel_.update(histogram);
+	const uint8_t blackLevel = blackLevel_.get();
+
+	bool tablesChanged = updateGammaTable(blackLevel);
+
+	if (frameCount_++ % awbInterval_ == 0) {
+		/*
+		 * Black level must be subtracted to get the correct AWB
+		 * ratios, they would be off if they were computed from the
+		 * whole brightness range rather than from the sensor range.
+		 */
+		const uint64_t nPixels = std::accumulate(
+			histogram.begin(), histogram.end(), 0);
+		const uint64_t offset = blackLevel * nPixels;
+		const uint64_t sumR = stats.sumR_ - offset / 4;
+		const uint64_t sumG = stats.sumG_ - offset / 2;
+		const uint64_t sumB = stats.sumB_ - offset / 4;
+
+		/*
+		 * Calculate red and blue gains for AWB.
+		 * Clamp max gain at 4.0, this also avoids 0 division.
+		 * Gain: 128 = 0.5, 256 = 1.0, 512 = 2.0, etc.
+		 */
+		unsigned int gainR = sumR <= sumG / 4 ? 1024 : 256 * sumG / sumR;
+		unsigned int gainB = sumB <= sumG / 4 ? 1024 : 256 * sumG / sumB;
+
+		if (gainR != gainR_ || gainB != gainB_) {
+			gainR_ = gainR;
+			gainB_ = gainB;
+			tablesChanged = true;
+		}
 	}
 
-	setIspParams.emit();
+	if (tablesChanged)
+		updateLookupTables();
 
 	/* \todo Switch to the libipa/algorithm.h API someday. */
 
@@ -334,7 +419,7 @@ void IPASoftSimple::processStats(const ControlList &sensorControls)
 
 	for (unsigned int i = 0; i < histogramSize; i++) {
 		unsigned int idx = (i - (i / yHistValsPerBinMod)) / yHistValsPerBin;
-		exposureBins[idx] += stats_->yHistogram[blackLevelHistIdx + i];
+		exposureBins[idx] += stats.yHistogram[blackLevelHistIdx + i];
 	}
 
 	for (unsigned int i = 0; i < kExposureBinsCount; i++) {
@@ -370,7 +455,7 @@ void IPASoftSimple::processStats(const ControlList &sensorControls)
 
 	LOG(IPASoft, Debug) << "exposureMSV " << exposureMSV
 			    << " exp " << exposure_ << " again " << again_
-			    << " gain R/B " << gainR << "/" << gainB
+			    << " gain R/B " << gainR_ << "/" << gainB_
 			    << " black level " << static_cast<unsigned int>(blackLevel);
 }
 
@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Heap allocation accounting
+ */
+
+#include <libcamera/base/allocation_tracker.h>
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+/**
+ * \file base/allocation_tracker.h
+ * \brief Heap allocation accounting
+ */
+
+namespace libcamera {
+
+#ifndef __DOXYGEN__
+namespace {
+
+std::atomic<uint64_t> processAllocations;
+std::atomic<uint64_t> processBytes;
+
+thread_local uint64_t threadAllocations = 0;
+thread_local uint64_t threadBytes = 0;
+
+} /* namespace */
+#endif /* __DOXYGEN__ */
+
+/**
+ * \struct AllocationCounters
+ * \brief Counters of heap allocations
+ *
+ * \var AllocationCounters::allocations
+ * \brief The number of heap allocations
+ *
+ * \var AllocationCounters::bytes
+ * \brief The total size of the heap allocations in bytes
+ *
+ * \fn AllocationCounters::operator-()
+ * \brief Compute the allocations between two snapshots of the counters
+ * \param[in] other The earlier snapshot
+ * \return The difference between the counters and \a other
+ */
+
+/**
+ * \class AllocationTracker
+ * \brief Count the heap allocations of the process
+ *
+ * When libcamera is compiled with the alloc_tracking option, the global
+ * allocation functions of the C++ runtime are replaced with versions that count
+ * the allocations and their size, for the whole process and for each thread.
+ * As the replacement applies to the whole process, this is only meant to debug
+ * allocations in the steady state of the capture, and shall not be enabled in
+ * production builds.
+ *
+ * The counters are reported by Thread statistics for each receiver class, and
+ * in the HeapAllocations metadata of requests.
+ *
+ * Allocations with malloc() and other C library functions are not counted.
+ */
+
+/**
+ * \brief Check if the allocation tracking is enabled
+ * \return True if libcamera has been compiled with allocation tracking, false
+ * otherwise
+ */
+bool AllocationTracker::enabled()
+{
+#if LIBCAMERA_ALLOC_TRACKING
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * \brief Retrieve the allocation counters of the current thread
+ *
+ * The counters are zero when allocation tracking is disabled.
+ *
+ * \return The allocation counters of the current thread
+ */
+AllocationCounters AllocationTracker::thread()
+{
+	return { threadAllocations, threadBytes };
+}
+
+/**
+ * \brief Retrieve the allocation counters of the process
+ *
+ * The counters are zero when allocation tracking is disabled.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The allocation counters of the process
+ */
+AllocationCounters AllocationTracker::process()
+{
+	return { processAllocations.load(std::memory_order_relaxed),
+		 processBytes.load(std::memory_order_relaxed) };
+}
+
+} /* namespace libcamera */
+
+#if LIBCAMERA_ALLOC_TRACKING && !defined(__DOXYGEN__)
+
+namespace {
+
+void *trackedAllocate(std::size_t size, std::size_t alignment = 0)
+{
+	using namespace libcamera;
+
+	void *ptr;
+
+	if (!size)
+		size = 1;
+
+	if (alignment) {
+		if (posix_memalign(&ptr, alignment, size))
+			ptr = nullptr;
+	} else {
+		ptr = malloc(size);
+	}
+
+	if (!ptr)
+		return nullptr;
+
+	threadAllocations++;
+	threadBytes += size;
+	processAllocations.fetch_add(1, std::memory_order_relaxed);
+	processBytes.fetch_add(size, std::memory_order_relaxed);
+
+	return ptr;
+}
+
+} /* namespace */
+
+void *operator new(std::size_t size)
+{
+	void *ptr = trackedAllocate(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return trackedAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return trackedAllocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+	void *ptr = trackedAllocate(size, static_cast<std::size_t>(alignment));
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+
+#endif /* LIBCAMERA_ALLOC_TRACKING */
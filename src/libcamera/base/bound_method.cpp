@@ -6,6 +6,10 @@
  */
 
 #include <libcamera/base/bound_method.h>
+
+#include <typeinfo>
+
+#include <libcamera/base/memory_pool.h>
 #include <libcamera/base/message.h>
 #include <libcamera/base/object.h>
 #include <libcamera/base/semaphore.h>
@@ -50,6 +54,22 @@ namespace libcamera {
  * blocks until the receiver signals the completion of the invocation.
  */
 
+#ifndef __DOXYGEN__
+namespace details {
+
+void *poolAllocate(std::size_t size)
+{
+	return MemoryPool::allocate(size);
+}
+
+void poolDeallocate(void *ptr, std::size_t size)
+{
+	MemoryPool::deallocate(ptr, size);
+}
+
+} /* namespace details */
+#endif /* __DOXYGEN__ */
+
 /**
  * \brief Invoke the bound method with packed arguments
  * \param[in] pack Packed arguments
@@ -81,11 +101,25 @@ bool BoundMethodBase::activatePack(std::shared_ptr<BoundMethodPackBase> pack,
 
 	switch (type) {
 	case ConnectionTypeDirect:
-	default:
+	default: {
+		Thread *thread = Thread::current();
+		Thread::ProfileSample sample{};
+		bool sampled = thread->profileEnter();
+		if (sampled) {
+			sample.receiver = object_ ? &typeid(*object_) : nullptr;
+			sample.slot = &typeid(*this);
+			sample.type = Message::None;
+			sample.start = utils::clock::now();
+		}
+
 		invokePack(pack.get());
+
+		thread->profileLeave(sampled ? &sample : nullptr);
+
 		if (deleteMethod)
 			delete this;
 		return true;
+	}
 
 	case ConnectionTypeQueued: {
 		std::unique_ptr<Message> msg =
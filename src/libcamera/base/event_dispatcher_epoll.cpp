@@ -0,0 +1,403 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Epoll-based event dispatcher
+ */
+
+#include <libcamera/base/event_dispatcher_epoll.h>
+
+#include <errno.h>
+#include <iomanip>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/utils.h>
+
+/**
+ * \file base/event_dispatcher_epoll.h
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Event)
+
+static const char *notifierType(EventNotifier::Type type)
+{
+	if (type == EventNotifier::Read)
+		return "read";
+	if (type == EventNotifier::Write)
+		return "write";
+	if (type == EventNotifier::Exception)
+		return "exception";
+
+	return "";
+}
+
+/**
+ * \class EventDispatcherEpoll
+ * \brief An epoll-based event dispatcher
+ *
+ * Unlike the EventDispatcherPoll, this dispatcher keeps the file descriptors
+ * of the event notifiers registered with the kernel, and only updates the
+ * registration when notifiers are enabled or disabled. Waiting for events thus
+ * doesn't depend on the number of registered notifiers, and dispatching only
+ * iterates over the file descriptors that are ready.
+ *
+ * The notifiers are level-triggered, with the same semantics as for the
+ * EventDispatcherPoll. Timers are stored in a TimerWheel, and a timerfd is armed
+ * with the exact deadline of the next timer, providing nanosecond resolution.
+ *
+ * As the kernel tracks the file descriptions and not the file descriptor
+ * numbers, event notifiers must be disabled or destroyed before their file
+ * descriptor is closed. Otherwise, events may still be reported for the file
+ * if it is referenced by another file descriptor.
+ */
+
+/*
+ * Maximum number of events retrieved per wait. Further events are reported by
+ * the next wait, as notifiers are level-triggered.
+ */
+static constexpr unsigned int kMaxEvents = 32;
+
+EventDispatcherEpoll::EventDispatcherEpoll()
+	: processingFd_(-1)
+{
+	/*
+	 * Create the epoll, event and timer fds. Failures are fatal as we
+	 * can't implement an interruptible dispatcher without them.
+	 */
+	epollfd_ = UniqueFD(epoll_create1(EPOLL_CLOEXEC));
+	if (!epollfd_.isValid())
+		LOG(Event, Fatal) << "Unable to create epoll fd";
+
+	eventfd_ = UniqueFD(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+	if (!eventfd_.isValid())
+		LOG(Event, Fatal) << "Unable to create eventfd";
+
+	timerfd_ = UniqueFD(timerfd_create(CLOCK_MONOTONIC,
+					   TFD_CLOEXEC | TFD_NONBLOCK));
+	if (!timerfd_.isValid())
+		LOG(Event, Fatal) << "Unable to create timerfd";
+
+	if (updateFd(eventfd_.get(), 0, EPOLLIN) < 0 ||
+	    updateFd(timerfd_.get(), 0, EPOLLIN) < 0)
+		LOG(Event, Fatal) << "Unable to register internal fds";
+
+	events_.resize(kMaxEvents);
+}
+
+EventDispatcherEpoll::~EventDispatcherEpoll()
+{
+}
+
+void EventDispatcherEpoll::registerEventNotifier(EventNotifier *notifier)
+{
+	EventNotifierSetEpoll &set = notifiers_[notifier->fd()];
+	EventNotifier::Type type = notifier->type();
+
+	if (set.notifiers[type] && set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< "Ignoring duplicate " << notifierType(type)
+			<< " notifier for fd " << notifier->fd();
+		return;
+	}
+
+	uint32_t events = set.events();
+	set.notifiers[type] = notifier;
+
+	if (updateFd(notifier->fd(), events, set.events()) < 0) {
+		LOG(Event, Warning)
+			<< "Disabling " << notifierType(type)
+			<< " due to invalid file descriptor " << notifier->fd();
+		set.notifiers[type] = nullptr;
+
+		if (!set.events() && notifier->fd() != processingFd_)
+			notifiers_.erase(notifier->fd());
+	}
+}
+
+void EventDispatcherEpoll::unregisterEventNotifier(EventNotifier *notifier)
+{
+	auto iter = notifiers_.find(notifier->fd());
+	if (iter == notifiers_.end())
+		return;
+
+	EventNotifierSetEpoll &set = iter->second;
+	EventNotifier::Type type = notifier->type();
+
+	if (!set.notifiers[type])
+		return;
+
+	if (set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< notifierType(type) << " notifier for fd "
+			<< notifier->fd() << " is not registered";
+		return;
+	}
+
+	uint32_t events = set.events();
+	set.notifiers[type] = nullptr;
+
+	/*
+	 * The file descriptor may already have been closed, in which case the
+	 * kernel has removed it from the epoll set already.
+	 */
+	updateFd(notifier->fd(), events, set.events());
+
+	/*
+	 * Don't race with event processing if this function is called from an
+	 * event notifier for the same fd. The notifiers_ entry will be erased
+	 * by processNotifiers().
+	 */
+	if (notifier->fd() == processingFd_)
+		return;
+
+	if (!set.events())
+		notifiers_.erase(iter);
+}
+
+void EventDispatcherEpoll::registerTimer(Timer *timer)
+{
+	timers_.add(timer);
+}
+
+void EventDispatcherEpoll::unregisterTimer(Timer *timer)
+{
+	timers_.remove(timer);
+}
+
+void EventDispatcherEpoll::processEvents()
+{
+	Thread *thread = Thread::current();
+	utils::time_point start;
+	int ret;
+
+	thread->dispatchMessages();
+
+	updateTimer();
+
+	/* Wait for events and process notifiers and timers. */
+	bool stats = thread->statisticsEnabled();
+	if (stats) {
+		start = utils::clock::now();
+		thread->accountWaitStart(start);
+	}
+
+	do {
+		ret = epoll_wait(epollfd_.get(), events_.data(),
+				 events_.size(), -1);
+	} while (ret == -1 && errno == EINTR);
+
+	if (stats)
+		thread->accountWait(start, utils::clock::now());
+
+	if (ret < 0) {
+		ret = -errno;
+		LOG(Event, Warning) << "epoll_wait() failed with " << strerror(-ret);
+	}
+
+	for (int i = 0; i < ret; i++) {
+		const struct epoll_event &event = events_[i];
+
+		if (event.data.fd == eventfd_.get())
+			processInterrupt();
+		else if (event.data.fd == timerfd_.get())
+			processTimerfd();
+		else
+			processNotifiers(event);
+	}
+
+	processTimers();
+}
+
+void EventDispatcherEpoll::interrupt()
+{
+	uint64_t value = 1;
+	ssize_t ret = write(eventfd_.get(), &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to interrupt event dispatcher ("
+			<< ret << ")";
+	}
+}
+
+uint32_t EventDispatcherEpoll::EventNotifierSetEpoll::events() const
+{
+	uint32_t events = 0;
+
+	if (notifiers[EventNotifier::Read])
+		events |= EPOLLIN;
+	if (notifiers[EventNotifier::Write])
+		events |= EPOLLOUT;
+	if (notifiers[EventNotifier::Exception])
+		events |= EPOLLPRI;
+
+	return events;
+}
+
+/*
+ * Add, modify or remove the fd in the epoll set, depending on the events
+ * monitored before and after the change.
+ */
+int EventDispatcherEpoll::updateFd(int fd, uint32_t oldEvents, uint32_t newEvents)
+{
+	if (oldEvents == newEvents)
+		return 0;
+
+	struct epoll_event event = {};
+	event.events = newEvents;
+	event.data.fd = fd;
+
+	int op = !oldEvents ? EPOLL_CTL_ADD
+	       : !newEvents ? EPOLL_CTL_DEL
+	       : EPOLL_CTL_MOD;
+
+	int ret = epoll_ctl(epollfd_.get(), op, fd, &event);
+
+	/*
+	 * The kernel removes closed files from the epoll set. If the fd number
+	 * has been reused since then, it needs to be added again.
+	 */
+	if (ret < 0 && errno == ENOENT && op == EPOLL_CTL_MOD)
+		ret = epoll_ctl(epollfd_.get(), EPOLL_CTL_ADD, fd, &event);
+
+	if (ret < 0) {
+		ret = -errno;
+		LOG(Event, Debug)
+			<< "Failed to update fd " << fd << " in epoll set: "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Arm the timerfd with the next deadline of the timer wheel, or disarm it if no
+ * timer is running. The timerfd is only reprogrammed when the deadline changes.
+ */
+void EventDispatcherEpoll::updateTimer()
+{
+	bool hasTimers = !timers_.empty();
+	utils::time_point deadline = hasTimers ? timers_.nextDeadline()
+					       : utils::time_point();
+
+	if (deadline == timerDeadline_)
+		return;
+
+	struct itimerspec spec = {};
+
+	if (hasTimers) {
+		spec.it_value = utils::duration_to_timespec(deadline.time_since_epoch());
+
+		/* A zero value disarms the timer, make sure it expires. */
+		if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec)
+			spec.it_value.tv_nsec = 1;
+
+		LOG(Event, Debug)
+			<< "next timer expires at "
+			<< spec.it_value.tv_sec << "."
+			<< std::setfill('0') << std::setw(9)
+			<< spec.it_value.tv_nsec;
+	}
+
+	int ret = timerfd_settime(timerfd_.get(), TFD_TIMER_ABSTIME, &spec, nullptr);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to arm timerfd: " << strerror(-ret);
+		return;
+	}
+
+	timerDeadline_ = deadline;
+}
+
+void EventDispatcherEpoll::processInterrupt()
+{
+	uint64_t value;
+	ssize_t ret = read(eventfd_.get(), &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to process interrupt (" << ret << ")";
+	}
+}
+
+void EventDispatcherEpoll::processTimerfd()
+{
+	uint64_t expirations;
+	ssize_t ret = read(timerfd_.get(), &expirations, sizeof(expirations));
+	if (ret != sizeof(expirations)) {
+		if (ret < 0)
+			ret = -errno;
+		/* The timerfd may have been rearmed since it has expired. */
+		if (ret != -EAGAIN)
+			LOG(Event, Error)
+				<< "Failed to process timerfd (" << ret << ")";
+		return;
+	}
+
+	/* The timerfd is disarmed once expired, rearm it on the next wait. */
+	timerDeadline_ = utils::time_point();
+}
+
+void EventDispatcherEpoll::processNotifiers(const struct epoll_event &event)
+{
+	static const struct {
+		EventNotifier::Type type;
+		uint32_t events;
+	} events[] = {
+		{ EventNotifier::Read, EPOLLIN },
+		{ EventNotifier::Write, EPOLLOUT },
+		{ EventNotifier::Exception, EPOLLPRI },
+	};
+
+	/*
+	 * The notifiers may have been unregistered by a previous event, stop
+	 * monitoring the fd if it hasn't been removed from the epoll set yet.
+	 */
+	auto iter = notifiers_.find(event.data.fd);
+	if (iter == notifiers_.end()) {
+		updateFd(event.data.fd, event.events, 0);
+		return;
+	}
+
+	EventNotifierSetEpoll &set = iter->second;
+
+	processingFd_ = event.data.fd;
+
+	for (const auto &ev : events) {
+		EventNotifier *notifier = set.notifiers[ev.type];
+
+		if (notifier && event.events & ev.events)
+			notifier->activated.emit();
+	}
+
+	processingFd_ = -1;
+
+	/* Erase the notifiers_ entry if it is now empty. */
+	if (!set.events())
+		notifiers_.erase(iter);
+}
+
+void EventDispatcherEpoll::processTimers()
+{
+	utils::time_point now = utils::clock::now();
+
+	while (Timer *timer = timers_.pop(now)) {
+		timer->stop();
+		timer->timeout.emit();
+	}
+}
+
+} /* namespace libcamera */
@@ -113,38 +113,21 @@ void EventDispatcherPoll::unregisterEventNotifier(EventNotifier *notifier)
 
 void EventDispatcherPoll::registerTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if ((*iter)->deadline() > timer->deadline()) {
-			timers_.insert(iter, timer);
-			return;
-		}
-	}
-
-	timers_.push_back(timer);
+	timers_.add(timer);
 }
 
 void EventDispatcherPoll::unregisterTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if (*iter == timer) {
-			timers_.erase(iter);
-			return;
-		}
-
-		/*
-		 * As the timers list is ordered, we can stop as soon as we go
-		 * past the deadline.
-		 */
-		if ((*iter)->deadline() > timer->deadline())
-			break;
-	}
+	timers_.remove(timer);
 }
 
 void EventDispatcherPoll::processEvents()
 {
+	Thread *thread = Thread::current();
+	utils::time_point start;
 	int ret;
 
-	Thread::current()->dispatchMessages();
+	thread->dispatchMessages();
 
 	/* Create the pollfd array. */
 	std::vector<struct pollfd> pollfds;
@@ -156,10 +139,19 @@ void EventDispatcherPoll::processEvents()
 	pollfds.push_back({ eventfd_.get(), POLLIN, 0 });
 
 	/* Wait for events and process notifiers and timers. */
+	bool stats = thread->statisticsEnabled();
+	if (stats) {
+		start = utils::clock::now();
+		thread->accountWaitStart(start);
+	}
+
 	do {
 		ret = poll(&pollfds);
 	} while (ret == -1 && errno == EINTR);
 
+	if (stats)
+		thread->accountWait(start, utils::clock::now());
+
 	if (ret < 0) {
 		ret = -errno;
 		LOG(Event, Warning) << "poll() failed with " << strerror(-ret);
@@ -202,26 +194,27 @@ short EventDispatcherPoll::EventNotifierSetPoll::events() const
 int EventDispatcherPoll::poll(std::vector<struct pollfd> *pollfds)
 {
 	/* Compute the timeout. */
-	Timer *nextTimer = !timers_.empty() ? timers_.front() : nullptr;
+	bool hasTimers = !timers_.empty();
 	struct timespec timeout;
 
-	if (nextTimer) {
+	if (hasTimers) {
 		utils::time_point now = utils::clock::now();
+		utils::time_point deadline = timers_.nextDeadline();
 
-		if (nextTimer->deadline() > now)
-			timeout = utils::duration_to_timespec(nextTimer->deadline() - now);
+		if (deadline > now)
+			timeout = utils::duration_to_timespec(deadline - now);
 		else
 			timeout = { 0, 0 };
 
 		LOG(Event, Debug)
-			<< "next timer " << nextTimer << " expires in "
+			<< "next timer expires in "
 			<< timeout.tv_sec << "."
 			<< std::setfill('0') << std::setw(9)
 			<< timeout.tv_nsec;
 	}
 
 	return ppoll(pollfds->data(), pollfds->size(),
-		     nextTimer ? &timeout : nullptr, nullptr);
+		     hasTimers ? &timeout : nullptr, nullptr);
 }
 
 void EventDispatcherPoll::processInterrupt(const struct pollfd &pfd)
@@ -293,12 +286,7 @@ void EventDispatcherPoll::processTimers()
 {
 	utils::time_point now = utils::clock::now();
 
-	while (!timers_.empty()) {
-		Timer *timer = timers_.front();
-		if (timer->deadline() > now)
-			break;
-
-		timers_.pop_front();
+	while (Timer *timer = timers_.pop(now)) {
 		timer->stop();
 		timer->timeout.emit();
 	}
@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Sorted associative container with inline storage
+ */
+
+#include <libcamera/base/flat_map.h>
+
+/**
+ * \file base/flat_map.h
+ * \brief Sorted associative container with inline storage
+ */
+
+namespace libcamera {
+
+/**
+ * \class FlatMap
+ * \brief Sorted associative container optimized for a small number of entries
+ * \tparam Key The key type
+ * \tparam T The mapped type
+ * \tparam N The number of entries stored inline
+ * \tparam Compare The key comparison function
+ *
+ * The FlatMap class implements a subset of the std::map API on top of a sorted
+ * array of key-value pairs. The first \a N entries are stored inline in the
+ * FlatMap instance, inserting more entries moves all of them to heap-allocated
+ * storage. Lookups are binary searches in contiguous memory, and clearing the
+ * map keeps its storage, which makes the container suitable for small maps that
+ * are repeatedly filled and cleared in hot paths.
+ *
+ * Entries are iterated in ascending key order, as with std::map. Unlike with
+ * std::map, inserting or erasing entries invalidates all iterators and
+ * references to entries. The \a Key and \a T types must be default
+ * constructible and move assignable.
+ */
+
+/**
+ * \typedef FlatMap::key_type
+ * \brief The key type
+ */
+
+/**
+ * \typedef FlatMap::mapped_type
+ * \brief The mapped type
+ */
+
+/**
+ * \typedef FlatMap::value_type
+ * \brief The type of the entries, a pair of key and mapped value
+ */
+
+/**
+ * \typedef FlatMap::size_type
+ * \brief The type used to express the number of entries
+ */
+
+/**
+ * \typedef FlatMap::key_compare
+ * \brief The key comparison function type
+ */
+
+/**
+ * \typedef FlatMap::iterator
+ * \brief Random access iterator over the entries
+ */
+
+/**
+ * \typedef FlatMap::const_iterator
+ * \brief Constant random access iterator over the entries
+ */
+
+/**
+ * \fn FlatMap::FlatMap()
+ * \brief Construct an empty map
+ */
+
+/**
+ * \fn FlatMap::FlatMap(std::initializer_list<value_type> init)
+ * \brief Construct a map from an initializer list of entries
+ * \param[in] init The entries
+ *
+ * Entries whose key is already present in the map are ignored.
+ */
+
+/**
+ * \fn FlatMap::begin()
+ * \brief Retrieve an iterator to the first entry
+ * \return An iterator to the first entry
+ */
+
+/**
+ * \fn FlatMap::begin() const
+ * \copydoc FlatMap::begin()
+ */
+
+/**
+ * \fn FlatMap::cbegin()
+ * \brief Retrieve a constant iterator to the first entry
+ * \return A constant iterator to the first entry
+ */
+
+/**
+ * \fn FlatMap::end()
+ * \brief Retrieve an iterator pointing to the past-the-end entry
+ * \return An iterator to the element following the last entry
+ */
+
+/**
+ * \fn FlatMap::end() const
+ * \copydoc FlatMap::end()
+ */
+
+/**
+ * \fn FlatMap::cend()
+ * \brief Retrieve a constant iterator pointing to the past-the-end entry
+ * \return A constant iterator to the element following the last entry
+ */
+
+/**
+ * \fn FlatMap::empty()
+ * \brief Check if the map is empty
+ * \return True if the map contains no entry, false otherwise
+ */
+
+/**
+ * \fn FlatMap::size()
+ * \brief Retrieve the number of entries in the map
+ * \return The number of entries
+ */
+
+/**
+ * \fn FlatMap::clear()
+ * \brief Remove all entries from the map
+ *
+ * The storage of the map is kept, inserting entries after clearing the map
+ * doesn't allocate memory unless the map grows larger than it was before.
+ */
+
+/**
+ * \fn FlatMap::find(const Key &key)
+ * \brief Find the entry for \a key
+ * \param[in] key The key
+ * \return An iterator to the entry, or end() if the key isn't present
+ */
+
+/**
+ * \fn FlatMap::find(const Key &key) const
+ * \copydoc FlatMap::find(const Key &key)
+ */
+
+/**
+ * \fn FlatMap::count()
+ * \brief Count the entries for \a key
+ * \param[in] key The key
+ * \return 1 if the key is present in the map, 0 otherwise
+ */
+
+/**
+ * \fn FlatMap::contains()
+ * \brief Check if the map contains an entry for \a key
+ * \param[in] key The key
+ * \return True if the key is present in the map, false otherwise
+ */
+
+/**
+ * \fn FlatMap::at(const Key &key)
+ * \brief Retrieve the value mapped to \a key
+ * \param[in] key The key
+ *
+ * The behaviour is undefined if the key isn't present in the map.
+ *
+ * \return A reference to the mapped value
+ */
+
+/**
+ * \fn FlatMap::at(const Key &key) const
+ * \copydoc FlatMap::at(const Key &key)
+ */
+
+/**
+ * \fn FlatMap::operator[]()
+ * \brief Retrieve the value mapped to \a key, inserting it if needed
+ * \param[in] key The key
+ *
+ * If the key isn't present in the map, a default-constructed value is inserted
+ * for it.
+ *
+ * \return A reference to the mapped value
+ */
+
+/**
+ * \fn FlatMap::insert()
+ * \brief Insert an entry in the map
+ * \param[in] value The entry
+ *
+ * The entry is inserted only if its key isn't already present in the map.
+ *
+ * \return A pair of an iterator to the entry with the key, and a boolean that
+ * tells whether the entry has been inserted
+ */
+
+/**
+ * \fn FlatMap::emplace()
+ * \brief Insert an entry in the map
+ * \param[in] key The key
+ * \param[in] value The mapped value
+ *
+ * The entry is inserted only if the \a key isn't already present in the map.
+ *
+ * \return A pair of an iterator to the entry with the key, and a boolean that
+ * tells whether the entry has been inserted
+ */
+
+/**
+ * \fn FlatMap::erase(const_iterator pos)
+ * \brief Remove the entry at \a pos
+ * \param[in] pos An iterator to the entry
+ * \return An iterator to the entry following the removed entry
+ */
+
+/**
+ * \fn FlatMap::erase(const Key &key)
+ * \brief Remove the entry for \a key
+ * \param[in] key The key
+ * \return The number of entries removed, 0 or 1
+ */
+
+/**
+ * \fn bool operator==(const FlatMap<Key, T, N, Compare> &lhs, const FlatMap<Key, T, N, Compare> &rhs)
+ * \brief Compare two maps for equality
+ * \param[in] lhs The first map
+ * \param[in] rhs The second map
+ * \return True if the two maps contain the same entries, false otherwise
+ */
+
+/**
+ * \fn bool operator!=(const FlatMap<Key, T, N, Compare> &lhs, const FlatMap<Key, T, N, Compare> &rhs)
+ * \brief Compare two maps for inequality
+ * \param[in] lhs The first map
+ * \param[in] rhs The second map
+ * \return True if the two maps differ, false otherwise
+ */
+
+} /* namespace libcamera */
@@ -8,6 +8,7 @@
 #include <libcamera/base/log.h>
 
 #include <array>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <list>
@@ -15,6 +16,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <thread>
 #include <time.h>
 #include <unordered_set>
 
@@ -52,6 +54,14 @@
  * of the file. The file must be writable and is truncated if it exists. If any
  * error occurs when opening the file, the file is ignored and the log is output
  * to std::cerr.
+ *
+ * Log messages are written synchronously by default, from the thread that logs
+ * them. Setting the LIBCAMERA_LOG_ASYNC environment variable to a non-empty
+ * string defers writing to a dedicated thread, decoupling the logging threads
+ * from the latency of the log output. Messages are then queued to a
+ * fixed-size buffer, and dropped when the buffer is full. The number of
+ * dropped messages is reported in the log. Fatal messages are always written
+ * synchronously.
  */
 
 /**
@@ -112,6 +122,10 @@ public:
 
 	bool isValid() const;
 	void write(const LogMessage &msg);
+	void write(const utils::time_point &timestamp, pid_t threadId,
+		   LogSeverity severity, const LogCategory &category,
+		   const std::string &fileInfo, const std::string &prefix,
+		   const std::string &msg);
 	void write(const std::string &msg);
 
 private:
@@ -206,6 +220,25 @@ constexpr const char *kColorBrightWhite = "\033[1;37m";
  * \param[in] msg Message to write
  */
 void LogOutput::write(const LogMessage &msg)
+{
+	write(msg.timestamp(), Thread::currentId(), msg.severity(),
+	      msg.category(), msg.fileInfo(), msg.prefix(), msg.msg());
+}
+
+/**
+ * \brief Write message to log output
+ * \param[in] timestamp The message timestamp
+ * \param[in] threadId The ID of the thread that logged the message
+ * \param[in] severity The message severity
+ * \param[in] category The message category
+ * \param[in] fileInfo The message file information
+ * \param[in] prefix The message prefix
+ * \param[in] msg The message text
+ */
+void LogOutput::write(const utils::time_point &timestamp, pid_t threadId,
+		      LogSeverity severity, const LogCategory &category,
+		      const std::string &fileInfo, const std::string &prefix,
+		      const std::string &msg)
 {
 	static const char *const severityColors[] = {
 		kColorBrightCyan,
@@ -220,7 +253,6 @@ void LogOutput::write(const LogMessage &msg)
 	const char *prefixColor = color_ ? kColorGreen : "";
 	const char *resetColor = color_ ? kColorReset : "";
 	const char *severityColor = "";
-	LogSeverity severity = msg.severity();
 	std::string str;
 
 	if (color_) {
@@ -233,22 +265,22 @@ void LogOutput::write(const LogMessage &msg)
 	switch (target_) {
 	case LoggingTargetSyslog:
 		str = std::string(log_severity_name(severity)) + " "
-		    + msg.category().name() + " " + msg.fileInfo() + " ";
-		if (!msg.prefix().empty())
-			str += msg.prefix() + ": ";
-		str += msg.msg();
+		    + category.name() + " " + fileInfo + " ";
+		if (!prefix.empty())
+			str += prefix + ": ";
+		str += msg;
 		writeSyslog(severity, str);
 		break;
 	case LoggingTargetStream:
 	case LoggingTargetFile:
-		str = "[" + utils::time_point_to_string(msg.timestamp()) + "] ["
-		    + std::to_string(Thread::currentId()) + "] "
+		str = "[" + utils::time_point_to_string(timestamp) + "] ["
+		    + std::to_string(threadId) + "] "
 		    + severityColor + log_severity_name(severity) + " "
-		    + categoryColor + msg.category().name() + " "
-		    + fileColor + msg.fileInfo() + " ";
-		if (!msg.prefix().empty())
-			str += prefixColor + msg.prefix() + ": ";
-		str += resetColor + msg.msg();
+		    + categoryColor + category.name() + " "
+		    + fileColor + fileInfo + " ";
+		if (!prefix.empty())
+			str += prefixColor + prefix + ": ";
+		str += resetColor + msg;
 		writeStream(str);
 		break;
 	default:
@@ -286,6 +318,224 @@ void LogOutput::writeStream(const std::string &str)
 	stream_->flush();
 }
 
+/**
+ * \brief Asynchronous log writer
+ *
+ * The LogRing class decouples writing log messages to the log output from the
+ * threads that log them. Messages are copied to a preallocated ring buffer
+ * without locking, and a dedicated thread formats and writes them to the
+ * current log output. When the ring buffer is full, messages are dropped
+ * instead of blocking the logging thread, and the number of dropped messages
+ * is reported to the log output.
+ *
+ * The ring buffer implements a bounded multiple-producer single-consumer
+ * queue, with a sequence number per slot to synchronize the producers and the
+ * consumer.
+ */
+class LogRing
+{
+public:
+	LogRing(const std::shared_ptr<LogOutput> *output);
+	~LogRing();
+
+	void push(const LogMessage &msg);
+	void flush();
+
+private:
+	struct Slot {
+		std::atomic<std::size_t> sequence;
+		utils::time_point timestamp;
+		pid_t threadId;
+		LogSeverity severity;
+		const LogCategory *category;
+		std::string fileInfo;
+		std::string prefix;
+		std::string msg;
+	};
+
+	static constexpr std::size_t kNumSlots = 1024;
+	static constexpr std::size_t kMessageSize = 256;
+
+	bool available() const;
+	void writeEntries();
+	void run();
+
+	const std::shared_ptr<LogOutput> *output_;
+	std::unique_ptr<Slot[]> slots_;
+
+	std::atomic<std::size_t> head_;
+	std::size_t tail_;
+	std::atomic<unsigned int> dropped_;
+	std::atomic<bool> sleeping_;
+
+	Mutex mutex_;
+	ConditionVariable wakeup_;
+	ConditionVariable flushed_;
+	std::size_t written_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool stop_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	std::thread thread_;
+};
+
+/**
+ * \brief Construct an asynchronous log writer
+ * \param[in] output Pointer to the log output to write messages to
+ *
+ * The \a output is loaded atomically for every batch of messages, it may thus
+ * be replaced at any time.
+ */
+LogRing::LogRing(const std::shared_ptr<LogOutput> *output)
+	: output_(output), slots_(std::make_unique<Slot[]>(kNumSlots)),
+	  head_(0), tail_(0), dropped_(0), sleeping_(false), written_(0),
+	  stop_(false)
+{
+	for (std::size_t i = 0; i < kNumSlots; i++) {
+		Slot &slot = slots_[i];
+
+		slot.sequence.store(i, std::memory_order_relaxed);
+
+		/* Preallocate the strings for typical messages. */
+		slot.fileInfo.reserve(64);
+		slot.prefix.reserve(64);
+		slot.msg.reserve(kMessageSize);
+	}
+
+	thread_ = std::thread(&LogRing::run, this);
+}
+
+LogRing::~LogRing()
+{
+	{
+		MutexLocker locker(mutex_);
+		stop_ = true;
+	}
+
+	wakeup_.notify_one();
+	thread_.join();
+}
+
+/**
+ * \brief Queue a message for writing
+ * \param[in] msg The message
+ *
+ * \context This function is \threadsafe.
+ */
+void LogRing::push(const LogMessage &msg)
+{
+	std::size_t pos = head_.load(std::memory_order_relaxed);
+	Slot *slot;
+
+	while (true) {
+		slot = &slots_[pos % kNumSlots];
+
+		std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) -
+				static_cast<intptr_t>(pos);
+
+		if (diff == 0) {
+			if (head_.compare_exchange_weak(pos, pos + 1,
+							std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			/* The ring is full, drop the message. */
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = head_.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->timestamp = msg.timestamp();
+	slot->threadId = Thread::currentId();
+	slot->severity = msg.severity();
+	slot->category = &msg.category();
+	slot->fileInfo = msg.fileInfo();
+	slot->prefix = msg.prefix();
+	slot->msg = msg.msg();
+
+	slot->sequence.store(pos + 1, std::memory_order_release);
+
+	/*
+	 * Wake up the writer thread if it's sleeping. The fence pairs with the
+	 * one in run() to guarantee that either the writer sees the message, or
+	 * this thread sees the writer sleeping.
+	 */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping_.load(std::memory_order_relaxed)) {
+		MutexLocker locker(mutex_);
+		wakeup_.notify_one();
+	}
+}
+
+/**
+ * \brief Wait until all queued messages have been written
+ *
+ * \context This function is \threadsafe.
+ */
+void LogRing::flush()
+{
+	std::size_t head = head_.load(std::memory_order_relaxed);
+
+	MutexLocker locker(mutex_);
+	wakeup_.notify_one();
+	flushed_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+		return written_ >= head;
+	});
+}
+
+bool LogRing::available() const
+{
+	const Slot &slot = slots_[tail_ % kNumSlots];
+	return slot.sequence.load(std::memory_order_acquire) == tail_ + 1;
+}
+
+void LogRing::writeEntries()
+{
+	std::shared_ptr<LogOutput> output = std::atomic_load(output_);
+
+	while (available()) {
+		Slot &slot = slots_[tail_ % kNumSlots];
+
+		if (output)
+			output->write(slot.timestamp, slot.threadId, slot.severity,
+				      *slot.category, slot.fileInfo, slot.prefix,
+				      slot.msg);
+
+		slot.sequence.store(tail_ + kNumSlots, std::memory_order_release);
+		tail_++;
+	}
+
+	unsigned int dropped = dropped_.exchange(0, std::memory_order_relaxed);
+	if (dropped && output)
+		output->write(std::to_string(dropped) + " log messages dropped\n");
+}
+
+void LogRing::run()
+{
+	MutexLocker locker(mutex_);
+
+	while (!stop_) {
+		locker.unlock();
+		writeEntries();
+		locker.lock();
+
+		written_ = tail_;
+		flushed_.notify_all();
+
+		sleeping_.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		wakeup_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return stop_ || available();
+		});
+
+		sleeping_.store(false, std::memory_order_relaxed);
+	}
+
+	locker.unlock();
+	writeEntries();
+}
+
 /**
  * \brief Message logger
  *
@@ -323,6 +573,7 @@ private:
 	std::list<std::pair<std::string, LogSeverity>> levels_;
 
 	std::shared_ptr<LogOutput> output_;
+	std::unique_ptr<LogRing> ring_;
 };
 
 bool Logger::destroyed_ = false;
@@ -437,6 +688,9 @@ Logger::~Logger()
 {
 	destroyed_ = true;
 
+	/* Write all pending messages before destroying the categories. */
+	ring_.reset();
+
 	for (LogCategory *category : categories_)
 		delete category;
 }
@@ -465,6 +719,19 @@ Logger *Logger::instance()
  */
 void Logger::write(const LogMessage &msg)
 {
+	/*
+	 * Fatal messages are written synchronously, after all pending messages,
+	 * as the program is about to abort.
+	 */
+	if (ring_) {
+		if (msg.severity() != LogFatal) {
+			ring_->push(msg);
+			return;
+		}
+
+		ring_->flush();
+	}
+
 	std::shared_ptr<LogOutput> output = std::atomic_load(&output_);
 	if (!output)
 		return;
@@ -477,6 +744,9 @@ void Logger::write(const LogMessage &msg)
  */
 void Logger::backtrace()
 {
+	if (ring_)
+		ring_->flush();
+
 	std::shared_ptr<LogOutput> output = std::atomic_load(&output_);
 	if (!output)
 		return;
@@ -583,6 +853,10 @@ void Logger::logSetLevel(const char *category, const char *level)
  * If the environment variable is not set, log to std::cerr. The log messages
  * are then colored by default. This can be overridden by setting the
  * LIBCAMERA_LOG_NO_COLOR environment variable to disable coloring.
+ *
+ * If the LIBCAMERA_LOG_ASYNC environment variable is set to a non-empty
+ * string, messages are written to the log output asynchronously by a
+ * dedicated thread.
  */
 Logger::Logger()
 {
@@ -591,6 +865,10 @@ Logger::Logger()
 
 	parseLogFile();
 	parseLogLevels();
+
+	const char *async = utils::secure_getenv("LIBCAMERA_LOG_ASYNC");
+	if (async && async[0] != '\0')
+		ring_ = std::make_unique<LogRing>(&output_);
 }
 
 /**
@@ -1085,6 +1363,12 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
  * If the severity is set to Fatal, execution is aborted and the program
  * terminates immediately after printing the message.
  *
+ * The severity check against the log level of the category is performed before
+ * the message is constructed. The stream insertion operations are thus not
+ * evaluated when the message is discarded, and must not have side effects.
+ * Additionally, messages with a severity lower than the minimum severity
+ * selected with the log_min_severity build option are removed at compile time.
+ *
  * \warning Logging from the destructor of a global object, either directly or
  * indirectly, results in undefined behaviour.
  *
@@ -8,7 +8,9 @@
 #include <libcamera/base/memfd.h>
 
 #include <fcntl.h>
+#include <fstream>
 #include <string.h>
+#include <string>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 #include <unistd.h>
@@ -30,6 +32,10 @@ namespace {
 #define F_SEAL_GROW		0x0004
 #endif
 
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB		0x0004U
+#endif
+
 #if not HAVE_MEMFD_CREATE
 int memfd_create(const char *name, unsigned int flags)
 {
@@ -69,21 +75,56 @@ LOG_DECLARE_CATEGORY(File)
  * \brief A bitwise combination of MemFd::Seal values
  */
 
+/**
+ * \enum MemFd::Option
+ * \brief Options for the MemFd::create() function
+ * \var MemFd::Option::None
+ * \brief No option (used as default value)
+ * \var MemFd::Option::HugePages
+ * \brief Back the file with huge pages from the hugetlbfs pool
+ */
+
+/**
+ * \typedef MemFd::Options
+ * \brief A bitwise combination of MemFd::Option values
+ */
+
 /**
  * \brief Create an anonymous file
  * \param[in] name The file name (displayed in symbolic links in /proc/self/fd/)
  * \param[in] size The file size
  * \param[in] seals The file seals
+ * \param[in] options The file creation options
  *
  * This function is a helper that wraps anonymous file (memfd) creation and
  * sets the file size and optional seals.
  *
+ * With the Option::HugePages option, the file is backed by huge pages, which
+ * reduces the TLB misses when large files are accessed by the CPU. The size is
+ * then rounded up to a multiple of the huge page size. Huge pages are taken
+ * from the pool reserved by the system administrator, and the allocation of
+ * the pages may fail when they are first used if the pool is exhausted.
+ *
  * \return The descriptor of the anonymous file if creation succeeded, or an
  * invalid UniqueFD otherwise
  */
-UniqueFD MemFd::create(const char *name, std::size_t size, Seals seals)
+UniqueFD MemFd::create(const char *name, std::size_t size, Seals seals,
+		       Options options)
 {
-	int ret = memfd_create(name, MFD_ALLOW_SEALING | MFD_CLOEXEC);
+	unsigned int flags = MFD_ALLOW_SEALING | MFD_CLOEXEC;
+
+	if (options & Option::HugePages) {
+		std::size_t pageSize = hugePageSize();
+		if (!pageSize) {
+			LOG(File, Error) << "Huge pages are not supported";
+			return {};
+		}
+
+		size = (size + pageSize - 1) / pageSize * pageSize;
+		flags |= MFD_HUGETLB;
+	}
+
+	int ret = memfd_create(name, flags);
 	if (ret < 0) {
 		ret = errno;
 		LOG(File, Error)
@@ -120,4 +161,29 @@ UniqueFD MemFd::create(const char *name, std::size_t size, Seals seals)
 	return memfd;
 }
 
+/**
+ * \brief Retrieve the size of the huge pages used by Option::HugePages
+ * \return The default huge page size in bytes, or 0 if huge pages are not
+ * supported by the system
+ */
+std::size_t MemFd::hugePageSize()
+{
+	static const std::size_t pageSize = []() -> std::size_t {
+		std::ifstream meminfo("/proc/meminfo");
+		std::string line;
+
+		while (std::getline(meminfo, line)) {
+			if (line.compare(0, 13, "Hugepagesize:"))
+				continue;
+
+			/* The size is expressed in kB. */
+			return std::stoul(line.substr(13)) * 1024;
+		}
+
+		return 0;
+	}();
+
+	return pageSize;
+}
+
 } /* namespace libcamera */
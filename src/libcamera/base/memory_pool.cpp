@@ -0,0 +1,280 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Small object memory pool
+ */
+
+#include <libcamera/base/memory_pool.h>
+
+#include <atomic>
+#include <iterator>
+#include <new>
+
+/**
+ * \file base/memory_pool.h
+ * \brief Small object memory pool
+ */
+
+namespace libcamera {
+
+#ifndef __DOXYGEN__
+namespace {
+
+/* Payload size of the blocks in each size class. */
+constexpr std::size_t kBlockSizes[] = { 64, 128, 256, 512 };
+constexpr unsigned int kNumClasses = std::size(kBlockSizes);
+
+std::atomic<uint64_t> heapAllocationCount;
+
+class BlockCache;
+
+/*
+ * Header of a memory block, followed by the payload. The header is aligned to
+ * guarantee the payload is suitably aligned for any fundamental type.
+ */
+struct alignas(std::max_align_t) BlockHeader {
+	BlockCache *cache;
+	BlockHeader *next;
+};
+
+int sizeClass(std::size_t size)
+{
+	for (unsigned int i = 0; i < kNumClasses; i++) {
+		if (size <= kBlockSizes[i])
+			return i;
+	}
+
+	return -1;
+}
+
+BlockHeader *newBlock(unsigned int index, BlockCache *cache)
+{
+	void *mem = ::operator new(sizeof(BlockHeader) + kBlockSizes[index]);
+	heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	BlockHeader *block = static_cast<BlockHeader *>(mem);
+	block->cache = cache;
+	block->next = nullptr;
+
+	return block;
+}
+
+void freeBlocks(BlockHeader *block)
+{
+	while (block) {
+		BlockHeader *next = block->next;
+		::operator delete(block);
+		block = next;
+	}
+}
+
+/*
+ * A per-thread cache of free blocks. Blocks are allocated from and returned to
+ * the cache of the thread that allocated them. Blocks freed by the owner
+ * thread are added to a private free list, while blocks freed by other
+ * threads are pushed to a lock-free stack that the owner thread collects when
+ * its free list runs out.
+ *
+ * The cache is reference-counted, with one reference held by the owner thread
+ * and one by every block in use. This keeps the cache alive after its thread
+ * exits, until all its blocks have been freed.
+ */
+class BlockCache
+{
+public:
+	BlockCache()
+		: refs_(1)
+	{
+		for (unsigned int i = 0; i < kNumClasses; i++) {
+			free_[i] = nullptr;
+			remote_[i].store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	void *allocate(unsigned int index)
+	{
+		BlockHeader *block = free_[index];
+		if (!block)
+			block = remote_[index].exchange(nullptr, std::memory_order_acquire);
+
+		if (block)
+			free_[index] = block->next;
+		else
+			block = newBlock(index, this);
+
+		refs_.fetch_add(1, std::memory_order_relaxed);
+
+		return block + 1;
+	}
+
+	void deallocate(BlockHeader *block, unsigned int index)
+	{
+		block->next = free_[index];
+		free_[index] = block;
+
+		/* The owner thread reference keeps the count above zero. */
+		refs_.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void deallocateRemote(BlockHeader *block, unsigned int index)
+	{
+		block->next = remote_[index].load(std::memory_order_relaxed);
+		while (!remote_[index].compare_exchange_weak(block->next, block,
+							     std::memory_order_release,
+							     std::memory_order_relaxed))
+			;
+
+		unref();
+	}
+
+	void release()
+	{
+		for (unsigned int i = 0; i < kNumClasses; i++) {
+			freeBlocks(free_[i]);
+			free_[i] = nullptr;
+			freeBlocks(remote_[i].exchange(nullptr, std::memory_order_acquire));
+		}
+
+		unref();
+	}
+
+private:
+	void unref()
+	{
+		if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+
+		/*
+		 * The owner thread has exited and all blocks have been freed, so
+		 * nobody else can access the cache anymore.
+		 */
+		for (unsigned int i = 0; i < kNumClasses; i++)
+			freeBlocks(remote_[i].exchange(nullptr, std::memory_order_acquire));
+
+		delete this;
+	}
+
+	BlockHeader *free_[kNumClasses];
+	std::atomic<BlockHeader *> remote_[kNumClasses];
+	std::atomic<unsigned int> refs_;
+};
+
+thread_local BlockCache *threadCache = nullptr;
+thread_local bool threadExited = false;
+
+struct ThreadCacheReleaser {
+	~ThreadCacheReleaser()
+	{
+		threadExited = true;
+
+		if (threadCache) {
+			threadCache->release();
+			threadCache = nullptr;
+		}
+	}
+};
+
+/*
+ * Retrieve the cache of the current thread, creating it on first use. Blocks
+ * allocated after the thread-local storage destructors have run are not
+ * cached, and nullptr is returned in that case.
+ */
+BlockCache *currentCache()
+{
+	if (threadCache || threadExited)
+		return threadCache;
+
+	static thread_local ThreadCacheReleaser releaser [[maybe_unused]];
+	threadCache = new BlockCache();
+
+	return threadCache;
+}
+
+} /* namespace */
+#endif /* __DOXYGEN__ */
+
+/**
+ * \class MemoryPool
+ * \brief Allocator for small, short-lived objects
+ *
+ * The MemoryPool allocates memory blocks from per-thread caches of free
+ * blocks, falling back to the system heap when the cache is empty. Blocks are
+ * returned to the cache of the thread that allocated them, regardless of the
+ * thread that frees them, without any lock. Once the caches are warm, objects
+ * created and destroyed at a steady rate, such as the messages posted to a
+ * thread, thus don't cause any heap allocation.
+ *
+ * Allocations larger than 512 bytes are not cached.
+ */
+
+/**
+ * \brief Allocate a memory block
+ * \param[in] size The block size in bytes
+ *
+ * The block is suitably aligned for objects of any fundamental type. It shall
+ * be freed with deallocate(), using the same \a size.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return A pointer to the allocated memory block
+ */
+void *MemoryPool::allocate(std::size_t size)
+{
+	int index = sizeClass(size);
+	if (index < 0) {
+		heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+		return ::operator new(size);
+	}
+
+	BlockCache *cache = currentCache();
+	if (!cache)
+		return newBlock(index, nullptr) + 1;
+
+	return cache->allocate(index);
+}
+
+/**
+ * \brief Free a memory block
+ * \param[in] ptr The memory block, allocated by allocate()
+ * \param[in] size The block size in bytes, as passed to allocate()
+ *
+ * \context This function is \threadsafe.
+ */
+void MemoryPool::deallocate(void *ptr, std::size_t size)
+{
+	if (!ptr)
+		return;
+
+	int index = sizeClass(size);
+	if (index < 0) {
+		::operator delete(ptr);
+		return;
+	}
+
+	BlockHeader *block = static_cast<BlockHeader *>(ptr) - 1;
+	BlockCache *cache = block->cache;
+
+	if (!cache)
+		::operator delete(block);
+	else if (cache == threadCache)
+		cache->deallocate(block, index);
+	else
+		cache->deallocateRemote(block, index);
+}
+
+/**
+ * \brief Retrieve the number of heap allocations performed by the pool
+ *
+ * This function returns the total number of memory blocks the pool has
+ * allocated from the system heap, for all threads. It is meant to verify that
+ * the pool doesn't allocate memory in steady state.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The number of heap allocations
+ */
+uint64_t MemoryPool::heapAllocations()
+{
+	return heapAllocationCount.load(std::memory_order_relaxed);
+}
+
+} /* namespace libcamera */
@@ -8,6 +8,7 @@
 #include <libcamera/base/message.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/memory_pool.h>
 #include <libcamera/base/signal.h>
 
 /**
@@ -59,7 +60,7 @@ std::atomic_uint Message::nextUserType_{ Message::UserMessage };
  * \param[in] type The message type
  */
 Message::Message(Message::Type type)
-	: type_(type)
+	: type_(type), receiver_(nullptr), next_(nullptr)
 {
 }
 
@@ -138,6 +139,37 @@ InvokeMessage::~InvokeMessage()
 		delete method_;
 }
 
+/**
+ * \brief Allocate memory for an InvokeMessage
+ * \param[in] size The allocation size in bytes
+ *
+ * Invoke messages are created for every queued method invocation and signal
+ * emission. They are allocated from the MemoryPool to avoid heap allocations
+ * in steady state.
+ *
+ * \return A pointer to the allocated memory
+ */
+void *InvokeMessage::operator new(std::size_t size)
+{
+	return MemoryPool::allocate(size);
+}
+
+/**
+ * \brief Free memory allocated for an InvokeMessage
+ * \param[in] ptr The memory to free
+ * \param[in] size The allocation size in bytes
+ */
+void InvokeMessage::operator delete(void *ptr, std::size_t size)
+{
+	MemoryPool::deallocate(ptr, size);
+}
+
+/**
+ * \fn InvokeMessage::method()
+ * \brief Retrieve the method to be invoked
+ * \return The method to be invoked
+ */
+
 /**
  * \fn InvokeMessage::semaphore()
  * \brief Retrieve the message semaphore passed to the constructor
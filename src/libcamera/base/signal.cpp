@@ -7,6 +7,8 @@
 
 #include <libcamera/base/signal.h>
 
+#include <algorithm>
+
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/object.h>
 
@@ -20,14 +22,45 @@ namespace libcamera {
 namespace {
 
 /*
- * Mutex to protect the SignalBase::slots_ and Object::signals_ lists. If lock
- * contention needs to be decreased, this could be replaced with locks in
- * Object and SignalBase, or with a mutex pool.
+ * Mutex to serialize the modifications of the SignalBase slots and of the
+ * Object::signals_ lists. Emission doesn't take the lock. If lock contention
+ * needs to be decreased, this could be replaced with locks in Object and
+ * SignalBase, or with a mutex pool.
  */
 Mutex signalsLock;
 
 } /* namespace */
 
+/*
+ * The slots connected to a signal are stored in a reference-counted array,
+ * which is replaced by a new array when slots are connected or disconnected.
+ * Emission takes a reference to the current array without locking, and
+ * releases it once all slots have been called.
+ *
+ * To guard against the array being freed between the time it is loaded and
+ * the time its reference is taken, emitters count themselves in emitters_ in
+ * the meantime. The signal reference to replaced arrays is only dropped when
+ * no emitter is counted, and is otherwise deferred to the last emitter.
+ *
+ * Disconnected slots are freed with the array they have been removed from. As
+ * slots may also be referenced by older arrays still in use, replaced arrays
+ * hold a reference to the array that replaced them, ensuring they are freed
+ * in order.
+ */
+
+SignalBase::SignalBase()
+	: slots_(nullptr), emitters_(0), retired_(false)
+{
+}
+
+SignalBase::~SignalBase()
+{
+	MutexLocker locker(signalsLock);
+
+	reclaim();
+	releaseSlots(slots_.load());
+}
+
 void SignalBase::connect(BoundMethodBase *slot)
 {
 	MutexLocker locker(signalsLock);
@@ -35,38 +68,149 @@ void SignalBase::connect(BoundMethodBase *slot)
 	Object *object = slot->object();
 	if (object)
 		object->connect(this);
-	slots_.push_back(slot);
+
+	const SlotArray *current = slots_.load();
+	std::size_t size = current ? current->slots.size() : 0;
+
+	SlotArray *slots = new SlotArray(size + 1);
+	for (std::size_t i = 0; i < size; i++)
+		slots->slots[i].store(current->slots[i].load(), std::memory_order_relaxed);
+	slots->slots[size].store(slot, std::memory_order_relaxed);
+
+	publish(slots);
 }
 
 void SignalBase::disconnect(Object *object)
 {
-	disconnect([object](SlotList::iterator &iter) {
-		return (*iter)->match(object);
+	disconnect([object](BoundMethodBase *slot) {
+		return slot->match(object);
 	});
 }
 
-void SignalBase::disconnect(std::function<bool(SlotList::iterator &)> match)
+void SignalBase::disconnect(std::function<bool(BoundMethodBase *)> match)
 {
 	MutexLocker locker(signalsLock);
 
-	for (auto iter = slots_.begin(); iter != slots_.end(); ) {
-		if (match(iter)) {
-			Object *object = (*iter)->object();
-			if (object)
-				object->disconnect(this);
-
-			delete *iter;
-			iter = slots_.erase(iter);
-		} else {
-			++iter;
-		}
+	SlotArray *current = slots_.load();
+	if (!current)
+		return;
+
+	std::vector<BoundMethodBase *> kept;
+
+	for (const auto &entry : current->slots) {
+		BoundMethodBase *slot = entry.load();
+		if (match(slot))
+			current->removed.push_back(slot);
+		else
+			kept.push_back(slot);
+	}
+
+	if (current->removed.empty())
+		return;
+
+	for (BoundMethodBase *slot : current->removed) {
+		Object *object = slot->object();
+		if (object)
+			object->disconnect(this);
+	}
+
+	/*
+	 * Clear the removed slots from the arrays that emitters may be
+	 * iterating, to prevent them from being called.
+	 */
+	for (auto &entry : current->slots) {
+		const std::vector<BoundMethodBase *> &removed = current->removed;
+		if (std::find(removed.begin(), removed.end(), entry.load()) != removed.end())
+			entry.store(nullptr);
+	}
+
+	SlotArray *slots = nullptr;
+	if (!kept.empty()) {
+		slots = new SlotArray(kept.size());
+		for (std::size_t i = 0; i < kept.size(); i++)
+			slots->slots[i].store(kept[i], std::memory_order_relaxed);
+	}
+
+	publish(slots);
+}
+
+/*
+ * Retrieve the current slot array with a reference. The array, and the slots
+ * it references, remain valid until the reference is released with
+ * releaseSlots(), even if the signal is destroyed.
+ */
+SignalBase::SlotArray *SignalBase::acquireSlots()
+{
+	emitters_.fetch_add(1);
+
+	SlotArray *slots = slots_.load();
+	if (slots)
+		slots->refs.fetch_add(1, std::memory_order_relaxed);
+
+	if (emitters_.fetch_sub(1) == 1 && retired_.load()) {
+		MutexLocker locker(signalsLock);
+		reclaim();
 	}
+
+	return slots;
 }
 
-SignalBase::SlotList SignalBase::slots()
+/*
+ * Release a reference to a slot array acquired with acquireSlots(), freeing
+ * the array and the slots removed from it when it becomes unused.
+ */
+void SignalBase::releaseSlots(SlotArray *slots)
 {
-	MutexLocker locker(signalsLock);
-	return slots_;
+	while (slots && slots->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		SlotArray *next = slots->next;
+
+		for (BoundMethodBase *slot : slots->removed)
+			delete slot;
+		delete slots;
+
+		slots = next;
+	}
+}
+
+/*
+ * Replace the current slot array with \a slots, and drop the signal reference
+ * to the previous array, or defer it if emitters are acquiring the array. Shall
+ * be called with the signalsLock held.
+ */
+void SignalBase::publish(SlotArray *slots)
+{
+	SlotArray *previous = slots_.exchange(slots);
+	if (!previous)
+		return;
+
+	previous->next = slots;
+	if (slots)
+		slots->refs.fetch_add(1, std::memory_order_relaxed);
+
+	retiredArrays_.push_back(previous);
+
+	/*
+	 * Flag the retired array before checking for emitters, in case the
+	 * last emitter leaves concurrently.
+	 */
+	retired_.store(true);
+	reclaim();
+}
+
+/*
+ * Drop the signal reference to the retired arrays if no emitter is acquiring
+ * an array. Shall be called with the signalsLock held.
+ */
+void SignalBase::reclaim()
+{
+	if (emitters_.load())
+		return;
+
+	retired_.store(false);
+
+	for (SlotArray *slots : retiredArrays_)
+		releaseSlots(slots);
+	retiredArrays_.clear();
 }
 
 /**
@@ -105,6 +249,13 @@ SignalBase::SlotList SignalBase::slots()
  * arguments. The emitter shall thus ensure that any pointer or reference
  * passed through the signal will remain valid after the signal is emitted.
  *
+ * Slots may connect and disconnect slots while the signal is being emitted,
+ * and may destroy the signal. Slots connected during emission are only called
+ * by subsequent emissions, while slots disconnected during emission are
+ * skipped by the emission in progress. Unless slots are connected or
+ * disconnected concurrently, emission doesn't allocate memory or take any
+ * lock, making it suitable for signals emitted at high rates.
+ *
  * Duplicate connections between a signal and a slot are not expected and use of
  * the Object class to manage signals will enforce this restriction.
  */
@@ -7,13 +7,29 @@
 
 #include <libcamera/base/thread.h>
 
+#include <algorithm>
 #include <atomic>
-#include <list>
+#include <chrono>
+#include <cxxabi.h>
+#include <errno.h>
+#include <limits.h>
+#include <map>
+#include <optional>
+#include <sched.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
 #include <unistd.h>
+#include <vector>
 
+#include <libcamera/base/allocation_tracker.h>
 #include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/event_dispatcher_epoll.h>
 #include <libcamera/base/event_dispatcher_poll.h>
 #include <libcamera/base/log.h>
 #include <libcamera/base/message.h>
@@ -115,18 +131,32 @@ class ThreadMain;
 
 /**
  * \brief A queue of posted messages
+ *
+ * Messages are posted from any thread to a lock-free intrusive stack, and
+ * fetched in batches by the thread that owns the queue, which moves them to a
+ * private list in posting order. Only the stack is shared between threads,
+ * posting a message thus requires neither a lock nor a memory allocation.
  */
 class MessageQueue
 {
 public:
+	~MessageQueue();
+
+	void post(std::unique_ptr<Message> msg);
+	void fetch();
+	void compact();
+
 	/**
-	 * \brief List of queued Message instances
+	 * \brief Stack of posted Message instances, most recent first
 	 */
-	std::list<std::unique_ptr<Message>> list_;
+	std::atomic<Message *> posted_ = nullptr;
 	/**
-	 * \brief Protects the \ref list_
+	 * \brief List of fetched Message instances, in posting order
+	 *
+	 * Dispatched and removed messages are set to null, and erased by
+	 * compact().
 	 */
-	Mutex mutex_;
+	std::vector<std::unique_ptr<Message>> list_;
 	/**
 	 * \brief The recursion level for recursive Thread::dispatchMessages()
 	 * calls
@@ -134,6 +164,308 @@ public:
 	unsigned int recursion_ = 0;
 };
 
+MessageQueue::~MessageQueue()
+{
+	fetch();
+}
+
+/**
+ * \brief Post a message to the queue
+ * \param[in] msg The message
+ *
+ * \context This function is \threadsafe.
+ */
+void MessageQueue::post(std::unique_ptr<Message> msg)
+{
+	Message *message = msg.release();
+
+	message->next_ = posted_.load(std::memory_order_relaxed);
+	while (!posted_.compare_exchange_weak(message->next_, message,
+					      std::memory_order_release,
+					      std::memory_order_relaxed))
+		;
+}
+
+/**
+ * \brief Move all posted messages to the end of the \ref list_
+ *
+ * This function shall only be called from the thread that owns the queue, or
+ * when the thread isn't running.
+ */
+void MessageQueue::fetch()
+{
+	Message *message = posted_.exchange(nullptr, std::memory_order_acquire);
+	if (!message)
+		return;
+
+	/* The stack holds the most recent message first, reverse it. */
+	std::size_t first = list_.size();
+
+	while (message) {
+		Message *next = message->next_;
+		message->next_ = nullptr;
+		list_.emplace_back(message);
+		message = next;
+	}
+
+	std::reverse(list_.begin() + first, list_.end());
+}
+
+/**
+ * \brief Erase the null entries from the \ref list_
+ *
+ * This function shall not be called while the list is iterated, as it
+ * invalidates the indices of the messages.
+ */
+void MessageQueue::compact()
+{
+	list_.erase(std::remove(list_.begin(), list_.end(), nullptr),
+		    list_.end());
+}
+
+/**
+ * \brief CPU affinity and scheduling parameters of a thread
+ */
+struct ThreadAttributes {
+	/** \brief The CPUs the thread may run on, empty for all CPUs */
+	std::vector<unsigned int> cpus;
+	/** \brief Whether the scheduling policy and priority have been set */
+	bool scheduling = false;
+	/** \brief The scheduling policy */
+	Thread::SchedulingPolicy policy = Thread::SchedulingPolicy::Other;
+	/** \brief The scheduling priority */
+	int priority = 0;
+};
+
+namespace {
+
+int schedulingPolicy(Thread::SchedulingPolicy policy)
+{
+	switch (policy) {
+	case Thread::SchedulingPolicy::Fifo:
+		return SCHED_FIFO;
+	case Thread::SchedulingPolicy::RoundRobin:
+		return SCHED_RR;
+	case Thread::SchedulingPolicy::Other:
+	default:
+		return SCHED_OTHER;
+	}
+}
+
+int validatePriority(Thread::SchedulingPolicy policy, int priority)
+{
+	int pol = schedulingPolicy(policy);
+
+	if (priority < sched_get_priority_min(pol) ||
+	    priority > sched_get_priority_max(pol))
+		return -EINVAL;
+
+	return 0;
+}
+
+int applyAffinity(pthread_t thread, const std::vector<unsigned int> &cpus)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	for (unsigned int cpu : cpus)
+		CPU_SET(cpu, &set);
+
+	return -pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+int applyPriority(pthread_t thread, Thread::SchedulingPolicy policy,
+		  int priority)
+{
+	struct sched_param param = {};
+	param.sched_priority = priority;
+
+	return -pthread_setschedparam(thread, schedulingPolicy(policy), &param);
+}
+
+/* Apply the name and attributes to the current thread. */
+void applyAttributes(const std::string &name, const ThreadAttributes &attributes)
+{
+	pthread_t self = pthread_self();
+	int ret;
+
+	if (!name.empty())
+		pthread_setname_np(self, name.substr(0, 15).c_str());
+
+	if (!attributes.cpus.empty()) {
+		ret = applyAffinity(self, attributes.cpus);
+		if (ret < 0)
+			LOG(Thread, Warning)
+				<< "Failed to set affinity of thread '" << name
+				<< "': " << strerror(-ret);
+	}
+
+	if (attributes.scheduling) {
+		ret = applyPriority(self, attributes.policy, attributes.priority);
+		if (ret < 0)
+			LOG(Thread, Warning)
+				<< "Failed to set priority of thread '" << name
+				<< "': " << strerror(-ret);
+	}
+}
+
+/*
+ * Parse a list of CPUs, expressed as comma-separated CPU numbers or ranges
+ * (e.g. "0,2-3").
+ */
+bool parseCpus(const std::string &str, std::vector<unsigned int> *cpus)
+{
+	for (const std::string &range : utils::split(str, ",")) {
+		const char *start = range.c_str();
+		char *end;
+
+		unsigned long first = strtoul(start, &end, 10);
+		unsigned long last = first;
+
+		if (end == start)
+			return false;
+
+		if (*end == '-') {
+			start = end + 1;
+			last = strtoul(start, &end, 10);
+			if (end == start)
+				return false;
+		}
+
+		if (*end != '\0' || first > last || last >= CPU_SETSIZE)
+			return false;
+
+		for (unsigned long cpu = first; cpu <= last; cpu++)
+			cpus->push_back(cpu);
+	}
+
+	return !cpus->empty();
+}
+
+/*
+ * Parse the LIBCAMERA_THREAD_CONFIG environment variable. The variable
+ * contains a semicolon-separated list of entries, each formatted as
+ * 'name:cpus:policy:priority', with all fields but the name being optional.
+ */
+std::map<std::string, ThreadAttributes> parseThreadConfig()
+{
+	std::map<std::string, ThreadAttributes> configs;
+
+	const char *env = utils::secure_getenv("LIBCAMERA_THREAD_CONFIG");
+	if (!env)
+		return configs;
+
+	for (const std::string &entry : utils::split(env, ";")) {
+		if (entry.empty())
+			continue;
+
+		std::vector<std::string> fields;
+		for (const std::string &field : utils::split(entry, ":"))
+			fields.push_back(field);
+
+		ThreadAttributes attributes;
+		bool valid = !fields[0].empty() && fields.size() <= 4;
+
+		if (valid && fields.size() > 1 && !fields[1].empty())
+			valid = parseCpus(fields[1], &attributes.cpus);
+
+		if (valid && fields.size() > 2 && !fields[2].empty()) {
+			attributes.scheduling = true;
+
+			if (fields[2] == "other")
+				attributes.policy = Thread::SchedulingPolicy::Other;
+			else if (fields[2] == "fifo")
+				attributes.policy = Thread::SchedulingPolicy::Fifo;
+			else if (fields[2] == "rr")
+				attributes.policy = Thread::SchedulingPolicy::RoundRobin;
+			else
+				valid = false;
+		}
+
+		if (valid && fields.size() > 3 && !fields[3].empty()) {
+			char *end;
+			attributes.priority = strtol(fields[3].c_str(), &end, 10);
+			valid = *end == '\0' &&
+				!validatePriority(attributes.policy,
+						  attributes.priority);
+		}
+
+		if (!valid) {
+			LOG(Thread, Error)
+				<< "Invalid thread configuration '" << entry << "'";
+			continue;
+		}
+
+		configs[fields[0]] = std::move(attributes);
+	}
+
+	return configs;
+}
+
+/*
+ * Parse the LIBCAMERA_THREAD_STATS environment variable. Return the threshold
+ * above which dispatching a message is logged, zero to disable logging, or
+ * std::nullopt if the statistics are disabled.
+ */
+std::optional<utils::duration> parseStatsConfig()
+{
+	const char *env = utils::secure_getenv("LIBCAMERA_THREAD_STATS");
+	if (!env)
+		return std::nullopt;
+
+	char *end;
+	unsigned long threshold = strtoul(env, &end, 10);
+	if (end == env || *end != '\0') {
+		LOG(Thread, Error)
+			<< "Invalid LIBCAMERA_THREAD_STATS value '" << env << "'";
+		return std::nullopt;
+	}
+
+	return std::chrono::milliseconds(threshold);
+}
+
+/*
+ * Parse the LIBCAMERA_THREAD_PROFILE environment variable. Return the
+ * profiling interval, or zero if profiling is disabled.
+ */
+unsigned int parseProfileConfig()
+{
+	const char *env = utils::secure_getenv("LIBCAMERA_THREAD_PROFILE");
+	if (!env || env[0] == '\0')
+		return 0;
+
+	char *end;
+	unsigned long interval = strtoul(env, &end, 10);
+	if (end == env || *end != '\0' || interval > UINT_MAX) {
+		LOG(Thread, Error)
+			<< "Invalid LIBCAMERA_THREAD_PROFILE value '" << env << "'";
+		return 0;
+	}
+
+	return interval;
+}
+
+/*
+ * The nesting depth of the slots invoked by the current thread, and the number
+ * of top-level invocations since the last sample. Slots invoked by other slots
+ * are accounted for in the time of the top-level slot.
+ */
+thread_local unsigned int profileDepth = 0;
+thread_local unsigned int profileCounter = 0;
+
+std::string demangle(const char *name)
+{
+	char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, nullptr);
+	if (!demangled)
+		return name;
+
+	std::string result = demangled;
+	free(demangled);
+	return result;
+}
+
+} /* namespace */
+
 /**
  * \brief Thread-local internal data
  */
@@ -141,7 +473,9 @@ class ThreadData
 {
 public:
 	ThreadData()
-		: thread_(nullptr), running_(false), dispatcher_(nullptr)
+		: thread_(nullptr), running_(false), dispatcher_(nullptr),
+		  statsEnabled_(false), slowDispatch_(utils::duration::zero()),
+		  waiting_(false), profileInterval_(0), profileDispatches_(0)
 	{
 	}
 
@@ -151,10 +485,24 @@ private:
 	friend class Thread;
 	friend class ThreadMain;
 
+	void recordQueueDepth(std::size_t depth)
+		LIBCAMERA_TSA_EXCLUDES(statsMutex_);
+	void recordDispatch(std::type_index receiver, Message::Type type,
+			    utils::time_point posted, utils::time_point start,
+			    utils::time_point end,
+			    const AllocationCounters &allocations)
+		LIBCAMERA_TSA_EXCLUDES(statsMutex_);
+	void recordSample(const Thread::ProfileSample &sample,
+			  utils::duration duration)
+		LIBCAMERA_TSA_EXCLUDES(statsMutex_);
+
 	Thread *thread_;
 	bool running_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 	pid_t tid_;
 
+	std::string name_;
+	ThreadAttributes attributes_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
 	Mutex mutex_;
 
 	std::atomic<EventDispatcher *> dispatcher_;
@@ -164,8 +512,122 @@ private:
 	int exitCode_;
 
 	MessageQueue messages_;
+
+	std::atomic<bool> statsEnabled_;
+	utils::duration slowDispatch_;
+	Mutex statsMutex_;
+	ThreadStatistics stats_ LIBCAMERA_TSA_GUARDED_BY(statsMutex_);
+	std::map<std::type_index, std::size_t> receivers_
+		LIBCAMERA_TSA_GUARDED_BY(statsMutex_);
+	utils::time_point lastWake_ LIBCAMERA_TSA_GUARDED_BY(statsMutex_);
+	bool waiting_ LIBCAMERA_TSA_GUARDED_BY(statsMutex_);
+
+	using ProfileKey = std::tuple<std::type_index, std::type_index, Message::Type>;
+
+	std::atomic<unsigned int> profileInterval_;
+	std::atomic<uint64_t> profileDispatches_;
+	ThreadProfile profile_ LIBCAMERA_TSA_GUARDED_BY(statsMutex_);
+	std::map<ProfileKey, std::size_t> profileSlots_
+		LIBCAMERA_TSA_GUARDED_BY(statsMutex_);
 };
 
+/*
+ * Record the depth of the message queue as seen when fetching the posted
+ * messages.
+ */
+void ThreadData::recordQueueDepth(std::size_t depth)
+{
+	MutexLocker locker(statsMutex_);
+	stats_.maxQueueDepth = std::max(stats_.maxQueueDepth, depth);
+}
+
+/*
+ * Record the dispatch of a message of \a type to a \a receiver, from \a start
+ * to \a end, for a message posted at time \a posted. The receiver performed
+ * the heap \a allocations while handling the message.
+ */
+void ThreadData::recordDispatch(std::type_index receiver, Message::Type type,
+				utils::time_point posted, utils::time_point start,
+				utils::time_point end,
+				const AllocationCounters &allocations)
+{
+	utils::duration duration = end - start;
+
+	MutexLocker locker(statsMutex_);
+
+	stats_.messages++;
+
+	/* Messages posted before enabling statistics have no timestamp. */
+	if (posted != utils::time_point()) {
+		uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+			start - posted).count();
+		unsigned int bucket = latency < 2 ? 0 : 63 - __builtin_clzll(latency);
+
+		stats_.latency[std::min(bucket, ThreadStatistics::kLatencyBuckets - 1)]++;
+	}
+
+	auto [iter, inserted] = receivers_.try_emplace(receiver,
+							stats_.receivers.size());
+	if (inserted)
+		stats_.receivers.push_back({ demangle(receiver.name()), 0, {}, {}, 0, 0 });
+
+	ThreadStatistics::Receiver &stats = stats_.receivers[iter->second];
+	stats.messages++;
+	stats.totalTime += duration;
+	stats.maxTime = std::max(stats.maxTime, duration);
+	stats.allocations += allocations.allocations;
+	stats.allocatedBytes += allocations.bytes;
+
+	if (slowDispatch_ == utils::duration::zero() || duration <= slowDispatch_)
+		return;
+
+	std::string name = stats.name;
+
+	locker.unlock();
+
+	LOG(Thread, Warning)
+		<< "Thread '" << name_ << "' blocked for "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
+		<< "us dispatching message type " << type << " to " << name;
+}
+
+/*
+ * Record a profiling \a sample of a slot invocation that lasted \a duration.
+ * Samples are aggregated by receiver class, slot and message type.
+ */
+void ThreadData::recordSample(const Thread::ProfileSample &sample,
+			      utils::duration duration)
+{
+	const std::type_info &receiver = sample.receiver ? *sample.receiver : typeid(void);
+	const std::type_info &slot = sample.slot ? *sample.slot : typeid(void);
+
+	MutexLocker locker(statsMutex_);
+
+	auto [iter, inserted] = profileSlots_.try_emplace({ receiver, slot, sample.type },
+							  profile_.slots.size());
+	if (inserted) {
+		std::string slotName;
+
+		if (sample.slot) {
+			slotName = demangle(slot.name());
+		} else {
+			std::stringstream ss;
+			ss << "message type " << sample.type;
+			slotName = ss.str();
+		}
+
+		profile_.slots.push_back({
+			sample.receiver ? demangle(receiver.name()) : std::string{},
+			std::move(slotName), 0, {}, {}
+		});
+	}
+
+	ThreadProfile::Slot &stats = profile_.slots[iter->second];
+	stats.samples++;
+	stats.totalTime += duration;
+	stats.maxTime = std::max(stats.maxTime, duration);
+}
+
 /**
  * \brief Thread wrapper for the main thread
  */
@@ -206,6 +668,143 @@ ThreadData *ThreadData::current()
 	return data;
 }
 
+/**
+ * \struct ThreadStatistics
+ * \brief Event loop statistics of a Thread
+ *
+ * \sa \ref thread-statistics
+ */
+
+/**
+ * \var ThreadStatistics::kLatencyBuckets
+ * \brief The number of buckets of the latency histogram
+ */
+
+/**
+ * \struct ThreadStatistics::Receiver
+ * \brief Dispatch statistics of a receiver class
+ *
+ * \var ThreadStatistics::Receiver::name
+ * \brief The demangled name of the receiver class
+ * \var ThreadStatistics::Receiver::messages
+ * \brief The number of messages dispatched to receivers of the class
+ * \var ThreadStatistics::Receiver::totalTime
+ * \brief The total time spent dispatching the messages
+ * \var ThreadStatistics::Receiver::maxTime
+ * \brief The longest time spent dispatching a single message
+ * \var ThreadStatistics::Receiver::allocations
+ * \brief The number of heap allocations while dispatching the messages
+ * \var ThreadStatistics::Receiver::allocatedBytes
+ * \brief The size in bytes of the heap allocations while dispatching the
+ * messages
+ *
+ * The allocations are only counted when libcamera is compiled with allocation
+ * tracking, and are zero otherwise.
+ *
+ * \sa AllocationTracker
+ */
+
+/**
+ * \var ThreadStatistics::messages
+ * \brief The number of dispatched messages
+ *
+ * \var ThreadStatistics::maxQueueDepth
+ * \brief The largest number of messages found pending in the message queue
+ *
+ * \var ThreadStatistics::latency
+ * \brief Histogram of the latency between posting and dispatching messages
+ *
+ * Bucket i counts the messages dispatched between 2^i and 2^(i+1) µs after
+ * being posted. Bucket 0 also counts the messages dispatched in less than
+ * 1µs, and the last bucket all the messages dispatched later than its lower
+ * bound.
+ *
+ * \var ThreadStatistics::receivers
+ * \brief Dispatch statistics by receiver class, in order of first dispatch
+ *
+ * \var ThreadStatistics::waitTime
+ * \brief The time the event dispatcher spent waiting for events
+ *
+ * \var ThreadStatistics::busyTime
+ * \brief The time the event loop spent between waits, processing messages,
+ * events and timers
+ */
+
+/**
+ * \struct ThreadProfile
+ * \brief Sampling profile of the slots invoked by a Thread
+ *
+ * \sa \ref thread-profiling
+ */
+
+/**
+ * \struct ThreadProfile::Slot
+ * \brief Profile of a slot
+ *
+ * \var ThreadProfile::Slot::receiver
+ * \brief The demangled name of the receiver object class
+ * \var ThreadProfile::Slot::slot
+ * \brief The demangled name of the bound method type, which identifies the
+ * receiver class and arguments of member functions and the location of
+ * lambda functions, or the message type for messages other than method
+ * invocations
+ * \var ThreadProfile::Slot::samples
+ * \brief The number of sampled invocations
+ * \var ThreadProfile::Slot::totalTime
+ * \brief The total time of the sampled invocations
+ * \var ThreadProfile::Slot::maxTime
+ * \brief The longest sampled invocation
+ */
+
+/**
+ * \var ThreadProfile::interval
+ * \brief The sampling interval, one of every \a interval invocations is
+ * sampled
+ *
+ * \var ThreadProfile::dispatches
+ * \brief The number of top-level slot invocations while profiling was enabled
+ *
+ * \var ThreadProfile::slots
+ * \brief The profile by slot, in order of first sample
+ */
+
+/**
+ * \brief Assemble and return a string describing the profile
+ *
+ * The slots are listed by decreasing total time, extrapolated to all
+ * invocations by multiplying the sampled time by the sampling interval.
+ *
+ * \return A string describing the profile
+ */
+std::string ThreadProfile::toString() const
+{
+	std::vector<const Slot *> sorted;
+	for (const Slot &slot : slots)
+		sorted.push_back(&slot);
+
+	std::sort(sorted.begin(), sorted.end(), [](const Slot *a, const Slot *b) {
+		return a->totalTime > b->totalTime;
+	});
+
+	std::stringstream ss;
+	ss << dispatches << " dispatches, sampling interval " << interval;
+
+	for (const Slot *slot : sorted) {
+		auto total = std::chrono::duration_cast<std::chrono::microseconds>(
+			slot->totalTime * interval);
+		auto max = std::chrono::duration_cast<std::chrono::microseconds>(
+			slot->maxTime);
+
+		ss << std::endl << "  " << total.count() << "us (" << slot->samples
+		   << " samples, max " << max.count() << "us) ";
+		if (!slot->receiver.empty())
+			ss << slot->receiver << ": ";
+		ss << slot->slot;
+	}
+
+	return ss.str();
+}
+
 /**
  * \class Thread
  * \brief A thread of execution
@@ -218,6 +817,46 @@ ThreadData *ThreadData::current()
  * sent to the objects living in the thread. This behaviour can be modified by
  * overriding the run() function.
  *
+ * \section thread-attributes Thread Attributes
+ *
+ * Threads are identified by a name that describes their role, such as
+ * "CameraManager", "PipelineHandler", "SoftwareIsp", "IPA", "PostProcessor" or
+ * "ThreadPool" for the threads created internally by libcamera. The CPU affinity and scheduling parameters
+ * of a thread can be set with setAffinity() and setPriority(). Their defaults
+ * are taken from the LIBCAMERA_THREAD_CONFIG environment variable, which maps
+ * thread names to CPUs, a scheduling policy and a priority, to allow pinning
+ * the libcamera threads without modifying the application.
+ *
+ * \section thread-statistics Event Loop Statistics
+ *
+ * To help diagnosing latency issues, threads can collect statistics about
+ * their event loop, enabled with setStatisticsEnabled() or for all threads
+ * with the LIBCAMERA_THREAD_STATS environment variable. The statistics record
+ * the high-water mark of the message queue depth, a histogram of the latency
+ * between posting and dispatching messages, the time spent dispatching
+ * messages by receiver class, and the time the event dispatcher spent waiting
+ * for events or busy. When libcamera is compiled with allocation tracking, the
+ * heap allocations performed while dispatching messages are also counted by
+ * receiver class. They are retrieved with statistics(). The environment
+ * variable additionally sets a threshold above which dispatching a message
+ * is logged with a warning naming the receiver class, to identify the slots
+ * that block the event loop.
+ *
+ * Collecting statistics requires reading the clock for every message and
+ * event loop iteration, and is thus disabled by default.
+ *
+ * \section thread-profiling Slot Profiling
+ *
+ * To identify the slots that consume CPU time in production, at a lower cost
+ * than the statistics, threads can sample one of every N top-level slot
+ * invocations, enabled with setProfilingInterval() or for all threads with the
+ * LIBCAMERA_THREAD_PROFILE environment variable. Top-level invocations are the
+ * messages dispatched by the event loop, including queued method invocations,
+ * and the slots of Object instances connected directly to the signals emitted
+ * by event notifiers and timers. Slots invoked from other slots are accounted for in the time of
+ * the top-level slot. The samples are aggregated by receiver class and bound
+ * method type, retrieved with profile(), and logged when the thread finishes.
+ *
  * \section thread-stop Stopping Threads
  *
  * Threads can't be forcibly stopped. Instead, a thread user first requests the
@@ -260,13 +899,55 @@ ThreadData *ThreadData::current()
  * deleted without being processed when the Thread instance is destroyed.
  */
 
+/**
+ * \enum Thread::SchedulingPolicy
+ * \brief The scheduling policy of a thread
+ * \var Thread::SchedulingPolicy::Other
+ * \brief The default time-sharing policy (SCHED_OTHER)
+ * \var Thread::SchedulingPolicy::Fifo
+ * \brief The first-in, first-out real-time policy (SCHED_FIFO)
+ * \var Thread::SchedulingPolicy::RoundRobin
+ * \brief The round-robin real-time policy (SCHED_RR)
+ */
+
 /**
  * \brief Create a thread
+ * \param[in] name The thread name
+ *
+ * The \a name identifies the role of the thread. It is set as the name of the
+ * system thread when the thread starts, truncated to 15 characters, and is
+ * used to look up the default CPU affinity and scheduling parameters of the
+ * thread in the LIBCAMERA_THREAD_CONFIG environment variable.
  */
-Thread::Thread()
+Thread::Thread(const std::string &name)
 {
 	data_ = new ThreadData;
 	data_->thread_ = this;
+	data_->name_ = name;
+
+	static const std::optional<utils::duration> statsConfig =
+		parseStatsConfig();
+
+	if (statsConfig) {
+		data_->statsEnabled_ = true;
+		data_->slowDispatch_ = *statsConfig;
+	}
+
+	static const unsigned int profileConfig = parseProfileConfig();
+	data_->profileInterval_ = profileConfig;
+
+	if (name.empty())
+		return;
+
+	static const std::map<std::string, ThreadAttributes> configs =
+		parseThreadConfig();
+
+	auto iter = configs.find(name);
+	if (iter == configs.end())
+		return;
+
+	MutexLocker locker(data_->mutex_);
+	data_->attributes_ = iter->second;
 }
 
 Thread::~Thread()
@@ -275,6 +956,315 @@ Thread::~Thread()
 	delete data_;
 }
 
+/**
+ * \brief Retrieve the thread name
+ * \return The thread name
+ */
+const std::string &Thread::name() const
+{
+	return data_->name_;
+}
+
+/**
+ * \brief Set the CPU affinity of the thread
+ * \param[in] cpus The CPUs the thread is allowed to run on
+ *
+ * If the thread is running the affinity is applied immediately, otherwise it is
+ * applied when the thread starts. The affinity overrides the default set by the
+ * LIBCAMERA_THREAD_CONFIG environment variable.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The CPU list is empty or contains an invalid CPU
+ * \retval -ENOTSUP The thread is running and isn't the current thread, and
+ * the affinity can't be changed from outside of the thread
+ */
+int Thread::setAffinity(Span<const unsigned int> cpus)
+{
+	if (cpus.empty())
+		return -EINVAL;
+
+	for (unsigned int cpu : cpus) {
+		if (cpu >= CPU_SETSIZE)
+			return -EINVAL;
+	}
+
+	MutexLocker locker(data_->mutex_);
+
+	data_->attributes_.cpus.assign(cpus.begin(), cpus.end());
+
+	if (!data_->running_)
+		return 0;
+
+	pthread_t handle;
+	if (!nativeHandle(&handle))
+		return -ENOTSUP;
+
+	return applyAffinity(handle, data_->attributes_.cpus);
+}
+
+/**
+ * \brief Set the scheduling policy and priority of the thread
+ * \param[in] policy The scheduling policy
+ * \param[in] priority The scheduling priority
+ *
+ * The \a priority shall be 0 for SchedulingPolicy::Other, and between 1 and
+ * 99 for the real-time policies. Real-time policies usually require the
+ * CAP_SYS_NICE capability or an appropriate RLIMIT_RTPRIO limit.
+ *
+ * If the thread is running the parameters are applied immediately, otherwise
+ * they are applied when the thread starts, and failures are then only logged.
+ * The parameters override the defaults set by the LIBCAMERA_THREAD_CONFIG
+ * environment variable.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The priority is out of range for the policy
+ * \retval -EPERM The caller lacks the privileges to set the parameters
+ * \retval -ENOTSUP The thread is running and isn't the current thread, and
+ * the parameters can't be changed from outside of the thread
+ */
+int Thread::setPriority(SchedulingPolicy policy, int priority)
+{
+	int ret = validatePriority(policy, priority);
+	if (ret)
+		return ret;
+
+	MutexLocker locker(data_->mutex_);
+
+	data_->attributes_.scheduling = true;
+	data_->attributes_.policy = policy;
+	data_->attributes_.priority = priority;
+
+	if (!data_->running_)
+		return 0;
+
+	pthread_t handle;
+	if (!nativeHandle(&handle))
+		return -ENOTSUP;
+
+	return applyPriority(handle, policy, priority);
+}
+
+/*
+ * Retrieve the native handle of a running thread. The handle of the main
+ * thread is only available from the main thread itself.
+ */
+bool Thread::nativeHandle(pthread_t *handle)
+{
+	if (thread_.joinable()) {
+		*handle = thread_.native_handle();
+		return true;
+	}
+
+	if (Thread::current() == this) {
+		*handle = pthread_self();
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * \brief Enable or disable the event loop statistics
+ * \param[in] enable Whether to collect statistics
+ *
+ * Statistics collection is disabled by default, unless the
+ * LIBCAMERA_THREAD_STATS environment variable is set. Disabling statistics
+ * preserves the statistics collected so far.
+ *
+ * \context This function is \threadsafe.
+ */
+void Thread::setStatisticsEnabled(bool enable)
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	data_->statsEnabled_.store(enable, std::memory_order_relaxed);
+	data_->lastWake_ = {};
+}
+
+/**
+ * \brief Check if the event loop statistics are enabled
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return True if statistics are collected, false otherwise
+ */
+bool Thread::statisticsEnabled() const
+{
+	return data_->statsEnabled_.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief Retrieve the event loop statistics
+ *
+ * When the thread isn't waiting for events, the busy time includes the time
+ * elapsed since the end of the last wait.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return A snapshot of the statistics collected since the thread was created
+ * or the statistics were last reset
+ */
+ThreadStatistics Thread::statistics() const
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	ThreadStatistics stats = data_->stats_;
+
+	/* Account for the busy period in progress. */
+	if (!data_->waiting_ && data_->lastWake_ != utils::time_point())
+		stats.busyTime += utils::clock::now() - data_->lastWake_;
+
+	return stats;
+}
+
+/**
+ * \brief Reset the event loop statistics
+ *
+ * \context This function is \threadsafe.
+ */
+void Thread::resetStatistics()
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	data_->stats_ = {};
+	data_->receivers_.clear();
+	data_->lastWake_ = {};
+}
+
+/**
+ * \brief Enable or disable the slot profiling
+ * \param[in] interval The sampling interval, 0 to disable profiling
+ *
+ * Profiling is disabled by default, unless the LIBCAMERA_THREAD_PROFILE
+ * environment variable is set. When enabled, one of every \a interval top-level
+ * slot invocations is sampled. Disabling profiling preserves the profile
+ * collected so far.
+ *
+ * \context This function is \threadsafe.
+ */
+void Thread::setProfilingInterval(unsigned int interval)
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	data_->profileInterval_.store(interval, std::memory_order_relaxed);
+	data_->profile_.interval = interval;
+}
+
+/**
+ * \brief Retrieve the slot profiling interval
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The sampling interval, or 0 if profiling is disabled
+ */
+unsigned int Thread::profilingInterval() const
+{
+	return data_->profileInterval_.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief Retrieve the slot profile
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return A snapshot of the profile collected since the thread was created or
+ * the profile was last reset
+ */
+ThreadProfile Thread::profile() const
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	ThreadProfile profile = data_->profile_;
+	profile.interval = data_->profileInterval_.load(std::memory_order_relaxed);
+	profile.dispatches = data_->profileDispatches_.load(std::memory_order_relaxed);
+
+	return profile;
+}
+
+/**
+ * \brief Reset the slot profile
+ *
+ * \context This function is \threadsafe.
+ */
+void Thread::resetProfile()
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	data_->profile_ = {};
+	data_->profileSlots_.clear();
+	data_->profileDispatches_.store(0, std::memory_order_relaxed);
+}
+
+/*
+ * Enter a slot invocation in the current thread. Return true if the invocation
+ * is a top-level invocation selected for sampling, in which case the caller
+ * shall fill a ProfileSample and pass it to profileLeave(). profileLeave()
+ * shall be called for every invocation, with a null sample if it isn't
+ * sampled.
+ */
+bool Thread::profileEnter()
+{
+	if (profileDepth++)
+		return false;
+
+	unsigned int interval = data_->profileInterval_.load(std::memory_order_relaxed);
+	if (!interval)
+		return false;
+
+	data_->profileDispatches_.fetch_add(1, std::memory_order_relaxed);
+
+	if (++profileCounter < interval)
+		return false;
+
+	profileCounter = 0;
+	return true;
+}
+
+/*
+ * Leave a slot invocation in the current thread, and record the \a sample if
+ * the invocation has been sampled.
+ */
+void Thread::profileLeave(const ProfileSample *sample)
+{
+	profileDepth--;
+
+	if (sample)
+		data_->recordSample(*sample, utils::clock::now() - sample->start);
+}
+
+/*
+ * Account for the event dispatcher starting to wait for events at \a start.
+ * The time elapsed since the end of the previous wait is accounted as busy.
+ * This is called by the event dispatchers when statistics are enabled.
+ */
+void Thread::accountWaitStart(utils::time_point start)
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	if (data_->lastWake_ != utils::time_point())
+		data_->stats_.busyTime += start - data_->lastWake_;
+
+	data_->waiting_ = true;
+}
+
+/*
+ * Account for the event dispatcher waiting for events from \a start to \a end.
+ * This is called by the event dispatchers when statistics are enabled, after
+ * accountWaitStart().
+ */
+void Thread::accountWait(utils::time_point start, utils::time_point end)
+{
+	MutexLocker locker(data_->statsMutex_);
+
+	data_->stats_.waitTime += end - start;
+	data_->lastWake_ = end;
+	data_->waiting_ = false;
+}
+
 /**
  * \brief Start the thread
  */
@@ -317,6 +1307,11 @@ void Thread::startThread()
 	data_->tid_ = syscall(SYS_gettid);
 	currentThreadData = data_;
 
+	{
+		MutexLocker locker(data_->mutex_);
+		applyAttributes(data_->name_, data_->attributes_);
+	}
+
 	run();
 }
 
@@ -381,6 +1376,14 @@ void Thread::finishThread()
 	data_->running_ = false;
 	data_->mutex_.unlock();
 
+	if (profilingInterval()) {
+		ThreadProfile profile = this->profile();
+		if (!profile.slots.empty())
+			LOG(Thread, Info)
+				<< "Profile of thread '" << data_->name_ << "': "
+				<< profile.toString();
+	}
+
 	finished.emit();
 	data_->cv_.notify_all();
 }
@@ -507,13 +1510,51 @@ pid_t Thread::currentId()
  */
 EventDispatcher *Thread::eventDispatcher()
 {
-	if (!data_->dispatcher_.load(std::memory_order_relaxed))
-		data_->dispatcher_.store(new EventDispatcherPoll(),
-					 std::memory_order_release);
+	if (!data_->dispatcher_.load(std::memory_order_relaxed)) {
+		const char *type = utils::secure_getenv("LIBCAMERA_EVENT_DISPATCHER");
+		EventDispatcher *dispatcher;
+
+		if (type && !strcmp(type, "epoll"))
+			dispatcher = new EventDispatcherEpoll();
+		else
+			dispatcher = new EventDispatcherPoll();
+
+		data_->dispatcher_.store(dispatcher, std::memory_order_release);
+	}
 
 	return data_->dispatcher_.load(std::memory_order_relaxed);
 }
 
+/**
+ * \brief Set the event dispatcher for the thread
+ * \param[in] dispatcher The event dispatcher
+ *
+ * The thread creates an event dispatcher the first time it is needed, of the
+ * type selected by the LIBCAMERA_EVENT_DISPATCHER environment variable. This
+ * function overrides the selection for this thread, for instance to use the
+ * EventDispatcherEpoll in threads that handle a large number of file
+ * descriptors. It shall be called before the event dispatcher is first used,
+ * typically before starting the thread. The thread takes ownership of the
+ * \a dispatcher.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or -EBUSY if the thread already has an event dispatcher
+ */
+int Thread::setEventDispatcher(std::unique_ptr<EventDispatcher> dispatcher)
+{
+	EventDispatcher *expected = nullptr;
+
+	if (!data_->dispatcher_.compare_exchange_strong(expected, dispatcher.get(),
+							std::memory_order_release,
+							std::memory_order_relaxed))
+		return -EBUSY;
+
+	dispatcher.release();
+
+	return 0;
+}
+
 /**
  * \brief Post a message to the thread for the \a receiver
  * \param[in] msg The message
@@ -542,10 +1583,16 @@ void Thread::postMessage(std::unique_ptr<Message> msg, Object *receiver)
 
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
-	data_->messages_.list_.push_back(std::move(msg));
+	/*
+	 * Account for the message before posting it, the receiver's thread may
+	 * dispatch it right away.
+	 */
 	receiver->pendingMessages_++;
-	locker.unlock();
+
+	if (data_->statsEnabled_.load(std::memory_order_relaxed))
+		msg->posted_ = utils::clock::now();
+
+	data_->messages_.post(std::move(msg));
 
 	EventDispatcher *dispatcher =
 		data_->dispatcher_.load(std::memory_order_acquire);
@@ -563,12 +1610,14 @@ void Thread::removeMessages(Object *receiver)
 {
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
 	if (!receiver->pendingMessages_)
 		return;
 
+	MessageQueue &queue = data_->messages_;
+	queue.fetch();
+
 	std::vector<std::unique_ptr<Message>> toDelete;
-	for (std::unique_ptr<Message> &msg : data_->messages_.list_) {
+	for (std::unique_ptr<Message> &msg : queue.list_) {
 		if (!msg)
 			continue;
 		if (msg->receiver_ != receiver)
@@ -576,16 +1625,18 @@ void Thread::removeMessages(Object *receiver)
 
 		/*
 		 * Move the message to the pending deletion list to delete it
-		 * after releasing the lock. The messages list element will
-		 * contain a null pointer, and will be removed when dispatching
-		 * messages.
+		 * after updating the list, as deleting a message may post new
+		 * messages. The messages list element will contain a null
+		 * pointer, and will be removed when dispatching messages.
 		 */
 		toDelete.push_back(std::move(msg));
 		receiver->pendingMessages_--;
 	}
 
 	ASSERT(!receiver->pendingMessages_);
-	locker.unlock();
+
+	if (!queue.recursion_)
+		queue.compact();
 
 	toDelete.clear();
 }
@@ -604,55 +1655,93 @@ void Thread::removeMessages(Object *receiver)
  *
  * This function is not thread-safe, but it may be called recursively in the
  * same thread from an object's message handler. It guarantees delivery of
- * messages in the order they have been posted in all cases.
+ * messages in the order they have been posted in all cases. Messages posted
+ * while dispatching are dispatched as well.
  */
 void Thread::dispatchMessages(Message::Type type)
 {
 	ASSERT(data_ == ThreadData::current());
 
-	++data_->messages_.recursion_;
+	MessageQueue &queue = data_->messages_;
+	std::vector<std::unique_ptr<Message>> &messages = queue.list_;
 
-	MutexLocker locker(data_->messages_.mutex_);
+	bool stats = data_->statsEnabled_.load(std::memory_order_relaxed);
 
-	std::list<std::unique_ptr<Message>> &messages = data_->messages_.list_;
+	++queue.recursion_;
 
-	for (std::unique_ptr<Message> &msg : messages) {
-		if (!msg)
+	/*
+	 * Iterate by index, as message handlers may fetch new messages and
+	 * grow the list.
+	 */
+	for (std::size_t i = 0; ; i++) {
+		if (i == messages.size()) {
+			queue.fetch();
+			if (i == messages.size())
+				break;
+
+			if (stats)
+				data_->recordQueueDepth(messages.size() - i);
+		}
+
+		if (!messages[i])
 			continue;
 
-		if (type != Message::Type::None && msg->type() != type)
+		if (type != Message::Type::None && messages[i]->type() != type)
 			continue;
 
 		/*
 		 * Move the message, setting the entry in the list to null. It
-		 * will cause recursive calls to ignore the entry, and the erase
-		 * loop at the end of the function to delete it from the list.
+		 * will cause recursive calls to ignore the entry, and the
+		 * compaction at the end of the function to erase it from the
+		 * list.
 		 */
-		std::unique_ptr<Message> message = std::move(msg);
+		std::unique_ptr<Message> message = std::move(messages[i]);
 
 		Object *receiver = message->receiver_;
 		ASSERT(data_ == receiver->thread()->data_);
 		receiver->pendingMessages_--;
 
-		locker.unlock();
-		receiver->message(message.get());
+		ProfileSample sample{};
+		bool sampled = profileEnter();
+		if (sampled) {
+			sample.receiver = &typeid(*receiver);
+			sample.slot = message->type() == Message::InvokeMessage
+				    ? &typeid(*static_cast<InvokeMessage *>(message.get())->method())
+				    : nullptr;
+			sample.type = message->type();
+			sample.start = utils::clock::now();
+		}
+
+		if (stats) {
+			/* The receiver may be deleted by the message. */
+			std::type_index receiverType = typeid(*receiver);
+			AllocationCounters allocations = AllocationTracker::thread();
+			utils::time_point start = utils::clock::now();
+
+			receiver->message(message.get());
+
+			utils::time_point end = utils::clock::now();
+			allocations = AllocationTracker::thread() - allocations;
+
+			data_->recordDispatch(receiverType, message->type(),
+					      message->posted_, start, end,
+					      allocations);
+		} else {
+			receiver->message(message.get());
+		}
+
+		profileLeave(sampled ? &sample : nullptr);
+
 		message.reset();
-		locker.lock();
 	}
 
 	/*
 	 * If the recursion level is 0, erase all null messages in the list. We
-	 * can't do so during recursion, as it would invalidate the iterator of
+	 * can't do so during recursion, as it would invalidate the indices of
 	 * the outer calls.
 	 */
-	if (!--data_->messages_.recursion_) {
-		for (auto iter = messages.begin(); iter != messages.end(); ) {
-			if (!*iter)
-				iter = messages.erase(iter);
-			else
-				++iter;
-		}
-	}
+	if (!--queue.recursion_)
+		queue.compact();
 }
 
 /**
@@ -664,9 +1753,12 @@ void Thread::moveObject(Object *object)
 	ThreadData *currentData = object->thread_->data_;
 	ThreadData *targetData = data_;
 
-	MutexLocker lockerFrom(currentData->messages_.mutex_, std::defer_lock);
-	MutexLocker lockerTo(targetData->messages_.mutex_, std::defer_lock);
-	std::lock(lockerFrom, lockerTo);
+	/*
+	 * This is called from the object's current thread, which owns the
+	 * current message queue. Fetch all the messages posted to it so far to
+	 * move them along with the object.
+	 */
+	currentData->messages_.fetch();
 
 	moveObject(object, currentData, targetData);
 }
@@ -674,6 +1766,12 @@ void Thread::moveObject(Object *object)
 void Thread::moveObject(Object *object, ThreadData *currentData,
 			ThreadData *targetData)
 {
+	/*
+	 * Update the object's thread before moving its messages, as the new
+	 * thread may dispatch them as soon as they're posted.
+	 */
+	object->thread_ = this;
+
 	/* Move pending messages to the message queue of the new thread. */
 	if (object->pendingMessages_) {
 		unsigned int movedMessages = 0;
@@ -684,7 +1782,7 @@ void Thread::moveObject(Object *object, ThreadData *currentData,
 			if (msg->receiver_ != object)
 				continue;
 
-			targetData->messages_.list_.push_back(std::move(msg));
+			targetData->messages_.post(std::move(msg));
 			movedMessages++;
 		}
 
@@ -696,8 +1794,6 @@ void Thread::moveObject(Object *object, ThreadData *currentData,
 		}
 	}
 
-	object->thread_ = this;
-
 	/* Move all children. */
 	for (auto child : object->children_)
 		moveObject(child, currentData, targetData);
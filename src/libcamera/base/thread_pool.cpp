@@ -0,0 +1,416 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Work-stealing thread pool
+ */
+
+#include <libcamera/base/thread_pool.h>
+
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <stdlib.h>
+#include <thread>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
+
+/**
+ * \file base/thread_pool.h
+ * \brief Work-stealing thread pool
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(ThreadPool)
+
+namespace {
+
+/* Identify the pool worker running in the current thread, if any. */
+thread_local const ThreadPool *currentPool = nullptr;
+thread_local unsigned int currentIndex = 0;
+
+unsigned int defaultPoolSize()
+{
+	unsigned int size = std::max(std::thread::hardware_concurrency(), 1U);
+
+	const char *env = utils::secure_getenv("LIBCAMERA_THREAD_POOL_SIZE");
+	if (env) {
+		char *end;
+		unsigned long value = strtoul(env, &end, 10);
+		if (*end != '\0' || value < 1 || value > 64)
+			LOG(ThreadPool, Warning)
+				<< "Invalid LIBCAMERA_THREAD_POOL_SIZE value '"
+				<< env << "'";
+		else
+			size = value;
+	}
+
+	return size;
+}
+
+} /* namespace */
+
+class ThreadPool::Worker : public Thread
+{
+public:
+	Worker(ThreadPool *pool, unsigned int index)
+		: Thread("ThreadPool"), pool_(pool), index_(index)
+	{
+	}
+
+	Mutex mutex_;
+	std::deque<Task> tasks_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+protected:
+	void run() override
+	{
+		pool_->work(index_);
+	}
+
+private:
+	ThreadPool *pool_;
+	unsigned int index_;
+};
+
+/**
+ * \class ThreadPool
+ * \brief Pool of worker threads executing short-lived tasks
+ *
+ * The ThreadPool runs tasks on a fixed number of worker threads, allowing
+ * components that need to parallelize computations to share threads instead
+ * of each creating their own. This avoids oversubscribing the CPUs, which is
+ * especially costly on small systems.
+ *
+ * Tasks are posted to the pool with post(), or with submit() when the caller
+ * needs to retrieve a result through a std::future. They are run in an
+ * unspecified order on any of the worker threads. Each worker has its own task
+ * queue. Tasks posted from a worker are added to the queue of that worker,
+ * which processes them in LIFO order to benefit from warm caches, while tasks
+ * posted from other threads are distributed to the workers in a round-robin
+ * fashion. Idle workers steal tasks from the queues of the other workers in
+ * FIFO order.
+ *
+ * Tasks shall not block waiting for other tasks, as this may deadlock the pool
+ * when all the workers are waiting. The TaskGroup class should be used
+ * instead, as its wait() function runs the pending tasks of the group in the
+ * calling thread.
+ *
+ * A process-wide pool is available through instance(). Its workers are named
+ * "ThreadPool", which allows configuring their CPU affinity and scheduling
+ * policy with the LIBCAMERA_THREAD_CONFIG environment variable. All functions
+ * of this class are thread-safe.
+ */
+
+/**
+ * \typedef ThreadPool::Task
+ * \brief A task to be run by the pool
+ */
+
+/**
+ * \brief Construct a thread pool with \a size worker threads
+ * \param[in] size The number of worker threads, at least 1
+ */
+ThreadPool::ThreadPool(unsigned int size)
+	: next_(0), pending_(0), stopping_(false)
+{
+	size = std::max(size, 1U);
+
+	for (unsigned int i = 0; i < size; i++)
+		workers_.push_back(std::make_unique<Worker>(this, i));
+
+	for (std::unique_ptr<Worker> &worker : workers_)
+		worker->start();
+}
+
+/**
+ * \brief Destroy the thread pool
+ *
+ * All the tasks posted to the pool are run before the worker threads are
+ * stopped.
+ */
+ThreadPool::~ThreadPool()
+{
+	{
+		MutexLocker locker(mutex_);
+		stopping_ = true;
+	}
+
+	cv_.notify_all();
+
+	for (std::unique_ptr<Worker> &worker : workers_)
+		worker->wait();
+}
+
+/**
+ * \brief Retrieve the process-wide thread pool
+ *
+ * The pool is created on the first call to this function. Its size defaults to
+ * the number of CPUs in the system, and can be overridden with the
+ * LIBCAMERA_THREAD_POOL_SIZE environment variable.
+ *
+ * \return The process-wide thread pool
+ */
+ThreadPool *ThreadPool::instance()
+{
+	static ThreadPool pool(defaultPoolSize());
+	return &pool;
+}
+
+/**
+ * \fn ThreadPool::size()
+ * \brief Retrieve the number of worker threads
+ * \return The number of worker threads
+ */
+
+/**
+ * \brief Post a task to the pool
+ * \param[in] task The task to run
+ */
+void ThreadPool::post(Task task)
+{
+	unsigned int index = currentPool == this
+			   ? currentIndex
+			   : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+	Worker *worker = workers_[index].get();
+
+	{
+		MutexLocker locker(worker->mutex_);
+		worker->tasks_.push_back(std::move(task));
+	}
+
+	/*
+	 * Update the pending count with the pool lock held to avoid racing with
+	 * workers going to sleep.
+	 */
+	{
+		MutexLocker locker(mutex_);
+		pending_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	cv_.notify_one();
+}
+
+/**
+ * \fn ThreadPool::submit()
+ * \brief Submit a function to the pool and retrieve its result asynchronously
+ * \param[in] func The function to run
+ *
+ * The function \a func is run in a task, and its return value or the exception
+ * it throws is stored in the returned future.
+ *
+ * \return A future holding the result of \a func
+ */
+
+/*
+ * Run one task from the queue of the worker \a index, or steal one from the
+ * other workers if the queue is empty. Return false if no task was found.
+ */
+bool ThreadPool::runTask(unsigned int index)
+{
+	Task task;
+
+	for (unsigned int i = 0; i < workers_.size() && !task; i++) {
+		Worker *worker = workers_[(index + i) % workers_.size()].get();
+
+		MutexLocker locker(worker->mutex_);
+		if (worker->tasks_.empty())
+			continue;
+
+		if (!i) {
+			task = std::move(worker->tasks_.back());
+			worker->tasks_.pop_back();
+		} else {
+			task = std::move(worker->tasks_.front());
+			worker->tasks_.pop_front();
+		}
+	}
+
+	if (!task)
+		return false;
+
+	pending_.fetch_sub(1, std::memory_order_relaxed);
+
+	task();
+
+	return true;
+}
+
+void ThreadPool::work(unsigned int index)
+{
+	currentPool = this;
+	currentIndex = index;
+
+	while (true) {
+		if (runTask(index))
+			continue;
+
+		MutexLocker locker(mutex_);
+		cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return stopping_ || pending_.load(std::memory_order_relaxed) > 0;
+		});
+
+		if (stopping_ && pending_.load(std::memory_order_relaxed) <= 0)
+			break;
+	}
+
+	currentPool = nullptr;
+}
+
+/*
+ * State of a task group, shared with the runners posted to the pool. Runners
+ * may start after the group has been destroyed if all the tasks have been run
+ * by other threads, they then only access the shared state.
+ */
+struct TaskGroup::State {
+	State(TaskGroup *g, unsigned int max)
+		: group(g), maxConcurrency(max), active(0), runners(0)
+	{
+	}
+
+	TaskGroup *group;
+	const unsigned int maxConcurrency;
+
+	Mutex mutex;
+	ConditionVariable cv;
+	std::queue<ThreadPool::Task> tasks LIBCAMERA_TSA_GUARDED_BY(mutex);
+	unsigned int active LIBCAMERA_TSA_GUARDED_BY(mutex);
+	unsigned int runners LIBCAMERA_TSA_GUARDED_BY(mutex);
+};
+
+/**
+ * \class TaskGroup
+ * \brief Group of tasks run concurrently on a ThreadPool
+ *
+ * The TaskGroup runs a set of tasks on a thread pool with a bounded number of
+ * concurrent workers, and tracks their completion. Tasks are added to the
+ * group with run(), and the caller can then wait for all of them to complete
+ * with wait(), or be notified asynchronously through the finished signal.
+ *
+ * The wait() function runs the tasks that haven't been picked by a worker in
+ * the calling thread. This guarantees forward progress when the pool is busy,
+ * for instance when the group is used from a task running on the same pool,
+ * and makes use of the calling thread instead of leaving it idle.
+ *
+ * The run() and wait() functions are thread-safe.
+ */
+
+/**
+ * \brief Construct a task group
+ * \param[in] maxConcurrency The maximum number of pool workers running the
+ * tasks of the group concurrently, or 0 to use all the workers of the pool
+ * \param[in] pool The pool to run the tasks on
+ *
+ * The thread calling wait() isn't counted in \a maxConcurrency.
+ */
+TaskGroup::TaskGroup(unsigned int maxConcurrency, ThreadPool *pool)
+	: pool_(pool),
+	  state_(std::make_shared<State>(this, maxConcurrency ? maxConcurrency
+								: pool->size()))
+{
+}
+
+/**
+ * \brief Destroy the task group
+ *
+ * The destructor waits for all the tasks of the group to complete.
+ */
+TaskGroup::~TaskGroup()
+{
+	wait();
+}
+
+/**
+ * \brief Add a task to the group
+ * \param[in] task The task to run
+ */
+void TaskGroup::run(ThreadPool::Task task)
+{
+	bool spawn;
+
+	{
+		MutexLocker locker(state_->mutex);
+		state_->tasks.push(std::move(task));
+
+		spawn = state_->runners < state_->maxConcurrency;
+		if (spawn)
+			state_->runners++;
+	}
+
+	/* Wake up wait() to run the task if all runners are busy. */
+	state_->cv.notify_all();
+
+	if (spawn)
+		pool_->post([state = state_]() { runTasks(state.get(), true); });
+}
+
+/**
+ * \brief Wait for all the tasks of the group to complete
+ *
+ * The tasks that haven't been started yet are run in the calling thread. This
+ * function returns once all the tasks added to the group have completed, and
+ * the finished signal, if emitted, has returned.
+ */
+void TaskGroup::wait()
+{
+	State *state = state_.get();
+
+	while (true) {
+		runTasks(state, false);
+
+		MutexLocker locker(state->mutex);
+		state->cv.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(state->mutex) {
+			return !state->tasks.empty() || !state->active;
+		});
+
+		if (state->tasks.empty() && !state->active)
+			break;
+	}
+}
+
+/**
+ * \var TaskGroup::finished
+ * \brief Signal emitted when all the tasks of the group have completed
+ *
+ * The signal is emitted from the thread that completed the last task, which
+ * is usually a pool worker thread. It is emitted every time the group becomes
+ * idle.
+ */
+
+/*
+ * Run tasks from the group queue until it is empty. When called from a pool
+ * worker (\a runner is true), release the runner slot on return.
+ *
+ * The group itself is only accessed to emit the finished signal, while the
+ * task that completed last is still accounted as active. This guarantees that
+ * wait(), and thus the group destructor, doesn't return before the signal
+ * emission completes.
+ */
+void TaskGroup::runTasks(State *state, bool runner)
+{
+	MutexLocker locker(state->mutex);
+
+	while (!state->tasks.empty()) {
+		ThreadPool::Task task = std::move(state->tasks.front());
+		state->tasks.pop();
+		state->active++;
+
+		locker.unlock();
+		task();
+		locker.lock();
+
+		if (state->tasks.empty() && state->active == 1) {
+			locker.unlock();
+			state->group->finished.emit();
+			locker.lock();
+		}
+
+		if (!--state->active)
+			state->cv.notify_all();
+	}
+
+	if (runner)
+		state->runners--;
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Hierarchical timer wheel
+ */
+
+#include <libcamera/base/timer_wheel.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <libcamera/base/timer.h>
+
+/**
+ * \file base/timer_wheel.h
+ * \brief Hierarchical timer wheel
+ */
+
+namespace libcamera {
+
+namespace {
+
+/*
+ * Return the distance from slot \a from to the first occupied slot in the
+ * \a occupied bitmap, in circular order, or -1 if no slot is occupied.
+ */
+int nextSlot(uint64_t occupied, unsigned int from)
+{
+	if (!occupied)
+		return -1;
+
+	uint64_t rotated = (occupied >> from) | (occupied << ((64 - from) & 63));
+	return __builtin_ctzll(rotated);
+}
+
+} /* namespace */
+
+/**
+ * \class TimerWheel
+ * \brief Hierarchical timer wheel to track the running timers of a dispatcher
+ *
+ * The TimerWheel stores timers in a hierarchy of wheels of 64 slots each. The
+ * slots of the first level span one tick of 2^16 ns, and each level spans 64
+ * times the duration of the slots of the previous level. A timer is stored in
+ * the level matching the distance to its deadline, in the slot covering the
+ * deadline, and is cascaded to a lower level when the wheel clock enters the
+ * slot. Adding and removing timers is thus performed in constant time, as
+ * timers are linked in intrusive lists, regardless of the number of running
+ * timers.
+ *
+ * Wheel ticks only group timers. The exact deadline of the timers is used to
+ * compute the next wakeup time with nextDeadline(), and timers are only
+ * reported as expired by pop() once their deadline has passed.
+ *
+ * The TimerWheel isn't thread-safe, it is meant to be owned by an event
+ * dispatcher and accessed from the dispatcher's thread only.
+ */
+
+TimerWheel::TimerWheel()
+	: slots_{}, occupied_{}, expired_(nullptr), clock_(0), count_(0)
+{
+}
+
+/**
+ * \brief Add a timer to the wheel
+ * \param[in] timer The timer
+ *
+ * The \a timer is inserted based on its current deadline. It shall not already
+ * be present in the wheel.
+ */
+void TimerWheel::add(Timer *timer)
+{
+	/* Catch up with the current time when the wheel is idle. */
+	if (!count_)
+		clock_ = std::max(clock_, ticks(utils::clock::now()));
+
+	insert(timer);
+}
+
+/**
+ * \brief Remove a timer from the wheel
+ * \param[in] timer The timer
+ *
+ * Removing a timer that isn't present in the wheel is a no-op.
+ */
+void TimerWheel::remove(Timer *timer)
+{
+	if (timer->wheelPrev_)
+		unlink(timer);
+}
+
+/**
+ * \fn TimerWheel::empty()
+ * \brief Check if the wheel contains no timer
+ * \return True if the wheel is empty, false otherwise
+ */
+
+/**
+ * \brief Retrieve the deadline of the earliest timer
+ *
+ * As the slots of each level are ordered in time, the earliest timer is found
+ * in the first occupied slot of one of the levels, and only those slots are
+ * searched.
+ *
+ * \return The deadline of the earliest timer, or utils::time_point::max() if
+ * the wheel is empty
+ */
+utils::time_point TimerWheel::nextDeadline() const
+{
+	if (expired_)
+		return expired_->deadline();
+
+	utils::time_point deadline = utils::time_point::max();
+
+	for (unsigned int level = 0; level < kLevels; level++) {
+		unsigned int shift = level * kSlotShift;
+		uint64_t window = (clock_ >> shift) + (level ? 1 : 0);
+
+		int distance = nextSlot(occupied_[level], window & (kSlots - 1));
+		if (distance < 0)
+			continue;
+
+		unsigned int slot = level * kSlots
+				  + ((window + distance) & (kSlots - 1));
+		for (Timer *timer = slots_[slot]; timer; timer = timer->wheelNext_)
+			deadline = std::min(deadline, timer->deadline());
+	}
+
+	return deadline;
+}
+
+/**
+ * \brief Remove the next expired timer from the wheel
+ * \param[in] now The current time
+ *
+ * Expired timers are returned in deadline order. The caller shall call this
+ * function repeatedly until it returns nullptr to process all the timers that
+ * have expired at time \a now.
+ *
+ * \return The expired timer with the earliest deadline, or nullptr if no timer
+ * has expired
+ */
+Timer *TimerWheel::pop(utils::time_point now)
+{
+	advance(now);
+
+	Timer *timer = expired_;
+	if (timer)
+		unlink(timer);
+
+	return timer;
+}
+
+uint64_t TimerWheel::ticks(utils::time_point time)
+{
+	int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		time.time_since_epoch()).count();
+
+	return ns > 0 ? static_cast<uint64_t>(ns) >> kTickShift : 0;
+}
+
+void TimerWheel::insert(Timer *timer)
+{
+	uint64_t tick = ticks(timer->deadline());
+
+	/* Timers due in the current tick are kept in the current slot. */
+	if (tick <= clock_) {
+		link(timer, clock_ & (kSlots - 1));
+		return;
+	}
+
+	uint64_t delta = tick - clock_;
+	unsigned int level = (63 - __builtin_clzll(delta)) / kSlotShift;
+	level = std::min(level, kLevels - 1);
+
+	unsigned int index = (tick >> (level * kSlotShift)) & (kSlots - 1);
+	link(timer, level * kSlots + index);
+}
+
+void TimerWheel::link(Timer *timer, unsigned int slot)
+{
+	Timer **head = &slots_[slot];
+
+	timer->wheelNext_ = *head;
+	if (timer->wheelNext_)
+		timer->wheelNext_->wheelPrev_ = &timer->wheelNext_;
+
+	*head = timer;
+	timer->wheelPrev_ = head;
+	timer->wheelSlot_ = slot;
+
+	occupied_[slot / kSlots] |= 1ULL << (slot % kSlots);
+	count_++;
+}
+
+void TimerWheel::unlink(Timer *timer)
+{
+	*timer->wheelPrev_ = timer->wheelNext_;
+	if (timer->wheelNext_)
+		timer->wheelNext_->wheelPrev_ = timer->wheelPrev_;
+
+	timer->wheelNext_ = nullptr;
+	timer->wheelPrev_ = nullptr;
+
+	unsigned int slot = timer->wheelSlot_;
+	if (slot != kExpired && !slots_[slot])
+		occupied_[slot / kSlots] &= ~(1ULL << (slot % kSlots));
+
+	count_--;
+}
+
+/*
+ * Advance the wheel clock to \a now, cascading timers to lower levels and
+ * moving the timers whose deadline has passed to the expired list. The clock
+ * jumps directly to the next tick that has timers to process, making the cost
+ * independent of the time elapsed since the last call.
+ */
+void TimerWheel::advance(utils::time_point now)
+{
+	uint64_t target = ticks(now);
+
+	while (true) {
+		expireSlot(clock_ & (kSlots - 1), now);
+
+		if (clock_ >= target)
+			break;
+
+		uint64_t next = target;
+
+		int distance = nextSlot(occupied_[0], (clock_ + 1) & (kSlots - 1));
+		if (distance >= 0)
+			next = std::min(next, clock_ + 1 + distance);
+
+		for (unsigned int level = 1; level < kLevels; level++) {
+			unsigned int shift = level * kSlotShift;
+			uint64_t window = (clock_ >> shift) + 1;
+
+			distance = nextSlot(occupied_[level], window & (kSlots - 1));
+			if (distance >= 0)
+				next = std::min(next, (window + distance) << shift);
+		}
+
+		clock_ = next;
+
+		for (unsigned int level = kLevels - 1; level > 0; level--) {
+			uint64_t mask = (1ULL << (level * kSlotShift)) - 1;
+			if (!(clock_ & mask))
+				cascade(level);
+		}
+	}
+}
+
+void TimerWheel::expireSlot(unsigned int slot, utils::time_point now)
+{
+	Timer *timer = slots_[slot];
+
+	while (timer) {
+		Timer *next = timer->wheelNext_;
+
+		if (timer->deadline() <= now) {
+			unlink(timer);
+
+			/* Keep the expired list sorted by deadline. */
+			Timer **pos = &expired_;
+			while (*pos && (*pos)->deadline() <= timer->deadline())
+				pos = &(*pos)->wheelNext_;
+
+			timer->wheelNext_ = *pos;
+			if (timer->wheelNext_)
+				timer->wheelNext_->wheelPrev_ = &timer->wheelNext_;
+
+			*pos = timer;
+			timer->wheelPrev_ = pos;
+			timer->wheelSlot_ = kExpired;
+			count_++;
+		}
+
+		timer = next;
+	}
+}
+
+void TimerWheel::cascade(unsigned int level)
+{
+	unsigned int slot = level * kSlots
+			  + ((clock_ >> (level * kSlotShift)) & (kSlots - 1));
+	Timer *timer = slots_[slot];
+
+	while (timer) {
+		Timer *next = timer->wheelNext_;
+
+		unlink(timer);
+		insert(timer);
+
+		timer = next;
+	}
+}
+
+} /* namespace libcamera */
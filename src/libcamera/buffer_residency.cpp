@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Buffer residency tracking
+ */
+
+#include "libcamera/internal/buffer_residency.h"
+
+#include <algorithm>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/metrics.h"
+
+/**
+ * \file buffer_residency.h
+ * \brief Tracking of the time buffers spend in the pipeline and application
+ */
+
+namespace libcamera {
+
+/**
+ * \class BufferResidency
+ * \brief Estimate the number of buffers a stream needs from their residency
+ *
+ * The number of buffers of a stream is chosen by the application through
+ * StreamConfiguration::bufferCount, usually from a default picked by the
+ * pipeline handler. Too few buffers cause frame drops when the application or
+ * the pipeline are late, while too many waste memory and increase latency.
+ *
+ * The BufferResidency class measures, for each buffer of a stream, the time it
+ * is busy in every capture cycle. A buffer is needed from the start of the
+ * frame it captures, as reported by FrameMetadata::timestamp, or from the time
+ * it is queued if it is queued later. It stays busy until it completes, and
+ * then while the application holds it, until it is queued again. The number of
+ * buffers the stream needs in steady state is the longest busy time divided by
+ * the frame interval, rounded up, by Little's law.
+ *
+ * The estimate uses the longest busy time and the median frame interval over
+ * the last kWindow cycles, and is only reported after kMinSamples cycles. It
+ * covers jitter observed in that window, but doesn't account for the minimum
+ * number of buffers the device may require, which pipeline handlers enforce
+ * when validating the configuration.
+ *
+ * Times are expressed in nanoseconds on the CLOCK_MONOTONIC clock used by
+ * FrameMetadata::timestamp.
+ */
+
+/**
+ * \var BufferResidency::kWindow
+ * \brief The number of cycles used for the estimate
+ */
+
+/**
+ * \var BufferResidency::kMinSamples
+ * \brief The minimum number of cycles before an estimate is reported
+ */
+
+/**
+ * \brief Construct a BufferResidency
+ * \param[in] latency Histogram to record the time buffers spend in the pipeline
+ * \param[in] hold Histogram to record the time the application holds buffers
+ *
+ * The histograms record times in microseconds, and are optional.
+ */
+BufferResidency::BufferResidency(MetricHistogram *latency, MetricHistogram *hold)
+	: latency_(latency), hold_(hold), lastCompleted_(0), intervals_{},
+	  busy_{}, numIntervals_(0), numBusy_(0), recommended_(0)
+{
+}
+
+/**
+ * \brief Record the queuing of a buffer to the device
+ * \param[in] buffer The buffer
+ * \param[in] time The time at which the buffer is queued
+ *
+ * Queuing a buffer that has completed before ends its previous cycle, and
+ * updates the estimate.
+ */
+void BufferResidency::bufferQueued(const FrameBuffer *buffer, int64_t time)
+{
+	auto [it, inserted] = buffers_.try_emplace(buffer, Entry{});
+	Entry &entry = it->second;
+
+	if (!inserted && entry.completed && time >= entry.completed) {
+		int64_t hold = time - entry.completed;
+		if (hold_)
+			hold_->record(hold / 1000);
+
+		busy_[numBusy_++ % kWindow] = entry.latency + hold;
+		update();
+	}
+
+	entry = { time, 0, 0 };
+}
+
+/**
+ * \brief Record the completion of a buffer
+ * \param[in] buffer The buffer
+ * \param[in] time The time at which the buffer completes
+ *
+ * Buffers that don't complete successfully are ignored until they are queued
+ * again.
+ */
+void BufferResidency::bufferCompleted(const FrameBuffer *buffer, int64_t time)
+{
+	auto it = buffers_.find(buffer);
+	if (it == buffers_.end())
+		return;
+
+	Entry &entry = it->second;
+	const FrameMetadata &metadata = buffer->metadata();
+
+	if (metadata.status != FrameMetadata::FrameSuccess) {
+		buffers_.erase(it);
+		return;
+	}
+
+	/*
+	 * The buffer is needed from the start of its frame. Fall back to the
+	 * completion of the previous buffer when the timestamp isn't usable.
+	 */
+	int64_t start = static_cast<int64_t>(metadata.timestamp);
+	if (!start || start > time)
+		start = lastCompleted_;
+	start = std::max(start, entry.queued);
+
+	entry.latency = time - start;
+	entry.completed = time;
+
+	if (latency_)
+		latency_->record(entry.latency / 1000);
+
+	if (lastCompleted_ && time > lastCompleted_)
+		intervals_[numIntervals_++ % kWindow] = time - lastCompleted_;
+	lastCompleted_ = time;
+}
+
+/**
+ * \brief Reset the tracking of buffers when the stream stops
+ *
+ * The buffers may be freed once the stream stops, forget them. The estimate
+ * and the samples it is computed from are kept, and account for the cycles of
+ * the next capture session too.
+ */
+void BufferResidency::reset()
+{
+	buffers_.clear();
+	lastCompleted_ = 0;
+}
+
+/**
+ * \fn BufferResidency::recommendedCount()
+ * \brief Retrieve the estimated number of buffers the stream needs
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The number of buffers, or 0 if not enough cycles have been measured
+ */
+
+void BufferResidency::update()
+{
+	unsigned int numIntervals = std::min(numIntervals_, kWindow);
+	unsigned int numBusy = std::min(numBusy_, kWindow);
+
+	if (numIntervals < kMinSamples || numBusy < kMinSamples)
+		return;
+
+	std::array<int64_t, kWindow> intervals = intervals_;
+	auto median = intervals.begin() + numIntervals / 2;
+	std::nth_element(intervals.begin(), median,
+			 intervals.begin() + numIntervals);
+
+	int64_t interval = *median;
+	int64_t busy = *std::max_element(busy_.begin(), busy_.begin() + numBusy);
+
+	unsigned int count = std::max<int64_t>((busy + interval - 1) / interval, 1);
+	recommended_.store(count, std::memory_order_relaxed);
+}
+
+} /* namespace libcamera */
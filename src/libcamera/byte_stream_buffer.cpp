@@ -42,6 +42,14 @@ LOG_DEFINE_CATEGORY(Serialization)
  * the same location multiple times is thus not possible. Bytes may also be
  * skipped with the skip() function.
  *
+ * Bulk accesses avoid the cost of per-element copies and boundary checks.
+ * Arrays are read and written in a single operation through Span. Multiple
+ * separately stored buffers can be written with a single boundary check with
+ * write(std::initializer_list<Span<const uint8_t>>). To avoid copies
+ * altogether, read<T>(size_t) returns a pointer to data in the buffer, and
+ * reserve() returns a pointer to memory in the buffer where data can be
+ * constructed in place.
+ *
  *
  * The ByteStreamBuffer also supports carving out pieces of memory into other
  * ByteStreamBuffer instances. Like a read or write operation, a carveOut()
@@ -273,6 +281,81 @@ int ByteStreamBuffer::skip(size_t size)
  * \retval -ENOSPC no more space is available in the managed memory buffer
  */
 
+/**
+ * \brief Write multiple buffers to the managed memory buffer
+ * \param[in] data The buffers to write to memory
+ *
+ * This function writes the concatenation of all buffers in \a data to the
+ * managed memory buffer. The space is checked once for all buffers, and if it
+ * is insufficient, no data is written.
+ *
+ * \return 0 on success, a negative error code otherwise
+ * \retval -EACCES attempting to write to a read buffer
+ * \retval -ENOSPC no more space is available in the managed memory buffer
+ */
+int ByteStreamBuffer::write(std::initializer_list<Span<const uint8_t>> data)
+{
+	size_t size = 0;
+	for (const Span<const uint8_t> &buffer : data)
+		size += buffer.size();
+
+	uint8_t *dst = reserve(size, 1);
+	if (!dst)
+		return !write_ ? -EACCES : -ENOSPC;
+
+	for (const Span<const uint8_t> &buffer : data) {
+		memcpy(dst, buffer.data(), buffer.size());
+		dst += buffer.size();
+	}
+
+	return 0;
+}
+
+/**
+ * \fn template<typename T> T *ByteStreamBuffer::reserve(size_t count)
+ * \brief Reserve memory in the managed memory buffer for in-place writes
+ * \param[in] count Number of data items to reserve
+ *
+ * This function reserves memory for \a count elements of type \a T in the
+ * buffer, and returns a pointer to the first element. The caller can then
+ * construct the data in place instead of preparing it separately and copying
+ * it with write(). The reserved memory is not initialized. If memory can't be
+ * reserved for any reason (usually due to reserving more memory than
+ * available), the function returns nullptr.
+ *
+ * As the buffer doesn't provide alignment guarantees, this function shall only
+ * be used with types that have no alignment requirements beyond those of the
+ * data stored in the buffer.
+ *
+ * \return A pointer to the reserved memory on success, or nullptr otherwise
+ */
+
+uint8_t *ByteStreamBuffer::reserve(size_t size, size_t count)
+{
+	if (!write_)
+		return nullptr;
+
+	if (overflow_)
+		return nullptr;
+
+	size_t bytes;
+	if (__builtin_mul_overflow(size, count, &bytes)) {
+		setOverflow();
+		return nullptr;
+	}
+
+	if (write_ + bytes > base_ + size_) {
+		LOG(Serialization, Error)
+			<< "Unable to write " << bytes << " bytes: no space left";
+		setOverflow();
+		return nullptr;
+	}
+
+	uint8_t *data = write_;
+	write_ += bytes;
+	return data;
+}
+
 const uint8_t *ByteStreamBuffer::read(size_t size, size_t count)
 {
 	if (!read_)
@@ -7,12 +7,15 @@
 
 #include <libcamera/camera.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <iomanip>
+#include <vector>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/color_space.h>
 #include <libcamera/framebuffer_allocator.h>
@@ -583,9 +586,37 @@ CameraConfiguration::Status CameraConfiguration::validateColorSpaces(ColorSpaceF
  * \param[in] pipe The pipeline handler responsible for the camera device
  */
 Camera::Private::Private(PipelineHandler *pipe)
-	: requestSequence_(0), pipe_(pipe->shared_from_this()),
-	  disconnected_(false), state_(CameraAvailable)
+	: requestSequence_(0), starved_(false), metadataOnlyRequests_(false),
+	  memory_(std::make_shared<MemoryAccount>()),
+	  pipe_(pipe->shared_from_this()), disconnected_(false),
+	  state_(CameraAvailable)
 {
+	fenceWaiter_.signalled.connect(this, [](FrameBuffer *buffer) {
+		buffer->request()->_d()->fenceSignalled(buffer);
+	});
+
+	requestsCompleted_ = metrics_.counter("requests_completed");
+	requestsCancelled_ = metrics_.counter("requests_cancelled");
+	bufferErrors_ = metrics_.counter("buffer_errors");
+	framesDropped_ = metrics_.counter("frames_dropped");
+	frameDropCauseCounters_ = {
+		metrics_.counter("frames_dropped_kernel"),
+		metrics_.counter("frames_dropped_starvation"),
+		metrics_.counter("frames_dropped_overrun"),
+		metrics_.counter("frames_dropped_params_underrun"),
+	};
+	requestLatency_ = metrics_.histogram("request_latency_us",
+					     { 1000, 2000, 5000, 10000, 20000,
+					       50000, 100000, 200000, 500000,
+					       1000000 });
+	bufferLatency_ = metrics_.histogram("buffer_latency_us",
+					    { 1000, 2000, 5000, 10000, 20000,
+					      50000, 100000, 200000, 500000,
+					      1000000 });
+	bufferHold_ = metrics_.histogram("buffer_hold_us",
+					 { 1000, 2000, 5000, 10000, 20000,
+					   50000, 100000, 200000, 500000,
+					   1000000 });
 }
 
 Camera::Private::~Private()
@@ -638,6 +669,21 @@ Camera::Private::~Private()
  * when creating the camera, and shall not be modified afterwards.
  */
 
+/**
+ * \var Camera::Private::metadataIds_
+ * \brief The metadata controls reported by the camera in completed requests
+ *
+ * Pipeline handlers should list all the metadata controls they set in
+ * Request::metadata() when creating the camera. Requests reserve storage for
+ * those controls when they are created, so that recycling a request with
+ * Request::reuse() doesn't reallocate its metadata list.
+ */
+
+/**
+ * \var Camera::Private::fenceWaiter_
+ * \brief The waiter shared by all requests of the camera for their fences
+ */
+
 /**
  * \var Camera::Private::requestSequence_
  * \brief The queuing sequence number of the request
@@ -649,6 +695,71 @@ Camera::Private::~Private()
  * over a single capture session.
  */
 
+/**
+ * \var Camera::Private::streamSequences_
+ * \brief The frame sequence number of the last completed buffer of each stream
+ *
+ * The map only contains the streams of the last completed request, to detect
+ * gaps in the sequence numbers of consecutive requests for the same stream.
+ */
+
+/**
+ * \var Camera::Private::frameDropCauses_
+ * \brief The causes of frames dropped by the pipeline handler, by sequence
+ */
+
+/**
+ * \var Camera::Private::starved_
+ * \brief Whether the pipeline ran out of requests while running
+ *
+ * The flag is set when a request is queued to the device while no other
+ * request is in flight, and is used to attribute the next frames drop to
+ * application starvation.
+ */
+
+/**
+ * \var Camera::Private::metadataOnlyRequests_
+ * \brief Whether the camera accepts requests that contain no buffer
+ *
+ * Pipeline handlers that keep capturing frames and running the IPA without
+ * application buffers set this flag in their configure() implementation, for
+ * the configurations in which requests without buffers complete with their
+ * metadata. The flag is reset before every configuration.
+ */
+
+/**
+ * \var Camera::Private::metrics_
+ * \brief The metrics of the camera
+ *
+ * The registry holds the metrics common to all cameras, updated by
+ * recordRequestMetrics(). Pipeline handlers can register additional metrics
+ * specific to their platform.
+ *
+ * \sa Camera::metrics()
+ */
+
+/**
+ * \var Camera::Private::memory_
+ * \brief The memory account of the camera
+ *
+ * The frame buffers allocated with a FrameBufferAllocator are charged
+ * on the account automatically. Pipeline handlers shall charge the memory they
+ * allocate internally for the camera, such as buffer pools and shared memory.
+ *
+ * \sa Camera::memoryUsage()
+ */
+
+/**
+ * \var Camera::Private::bufferResidency_
+ * \brief The buffer residency trackers of the active streams
+ *
+ * The trackers are created when the camera is configured, and estimate the
+ * number of buffers each stream needs from the timing of the buffers queued
+ * and completed by the pipeline handler.
+ *
+ * \sa Camera::recommendedBufferCount()
+ */
+
 static const char *const camera_state_names[] = {
 	"Available",
 	"Acquired",
@@ -667,6 +778,291 @@ bool Camera::Private::isRunning() const
 	return state_.load(std::memory_order_acquire) == CameraRunning;
 }
 
+/**
+ * \brief Update the camera metrics for a completed request
+ * \param[in] request The completed request
+ *
+ * This function is called by the pipeline handler when \a request completes. It
+ * counts completed and cancelled requests and buffers in an error state, and
+ * records the latency between queuing and completion of the request. Dropped
+ * frames are counted separately by detectFrameDrops().
+ */
+void Camera::Private::recordRequestMetrics(const Request *request)
+{
+	if (request->status() == Request::RequestCancelled) {
+		requestsCancelled_->add();
+		return;
+	}
+
+	requestsCompleted_->add();
+
+	const std::array<int64_t, Request::Private::StageCount> &timeline =
+		request->_d()->timeline();
+	int64_t queued = timeline[Request::Private::StageQueued];
+	int64_t completed = timeline[Request::Private::StageCompleted];
+	if (queued && completed > queued)
+		requestLatency_->record((completed - queued) / 1000);
+
+	for (const auto &[stream, buffer] : request->buffers()) {
+		if (buffer->metadata().status == FrameMetadata::FrameError)
+			bufferErrors_->add();
+	}
+}
+
+/**
+ * \brief Record the buffers of a request queued to the device
+ * \param[in] request The request
+ *
+ * This function is called by the pipeline handler when \a request is queued to
+ * the device, to track the residency of its buffers.
+ */
+void Camera::Private::recordBuffersQueued(const Request *request)
+{
+	int64_t now = utils::clock::now().time_since_epoch().count();
+
+	for (const auto &[stream, buffer] : request->buffers()) {
+		auto it = bufferResidency_.find(stream);
+		if (it != bufferResidency_.end())
+			it->second->bufferQueued(buffer, now);
+	}
+}
+
+/**
+ * \brief Record the completion of a buffer
+ * \param[in] request The request the buffer belongs to
+ * \param[in] buffer The buffer that has completed
+ *
+ * This function is called by the pipeline handler when \a buffer completes, to
+ * track its residency.
+ */
+void Camera::Private::recordBufferCompleted(const Request *request,
+					    const FrameBuffer *buffer)
+{
+	int64_t now = utils::clock::now().time_since_epoch().count();
+
+	for (const auto &[stream, streamBuffer] : request->buffers()) {
+		if (streamBuffer != buffer)
+			continue;
+
+		auto it = bufferResidency_.find(stream);
+		if (it != bufferResidency_.end())
+			it->second->bufferCompleted(buffer, now);
+		return;
+	}
+}
+
+/**
+ * \brief Reset the buffer residency tracking when the camera stops
+ *
+ * The estimated number of buffers of each stream is logged, as a hint to tune
+ * StreamConfiguration::bufferCount.
+ */
+void Camera::Private::resetBufferResidency()
+{
+	for (auto &[stream, residency] : bufferResidency_) {
+		residency->reset();
+
+		unsigned int count = residency->recommendedCount();
+		if (!count)
+			continue;
+
+		const StreamConfiguration &cfg = stream->configuration();
+		LOG(Camera, Debug)
+			<< "Stream " << cfg.toString() << " uses "
+			<< cfg.bufferCount << " buffers, " << count
+			<< " needed in steady state";
+	}
+}
+
+/**
+ * \brief Record the cause of a frame drop
+ * \param[in] sequence The sequence number of the dropped frame
+ * \param[in] cause The cause of the drop
+ *
+ * This function is called by the pipeline handler when it drops a frame, to
+ * attribute the gap in the sequence numbers detected by detectFrameDrops() to
+ * \a cause.
+ */
+void Camera::Private::frameDropped(uint32_t sequence,
+				   controls::FrameDropCauseEnum cause)
+{
+	frameDropCauses_.try_emplace(sequence, cause);
+}
+
+/**
+ * \brief Detect the frames dropped before a completed request
+ * \param[in] request The completed request
+ *
+ * Compare the sequence numbers of the buffers of \a request with the buffers
+ * of the previous completed request for each stream. Gaps are reported in the
+ * FramesDropped and FrameDropCause metadata of \a request, and counted in the
+ * camera metrics.
+ *
+ * The cause of the drop is the one recorded by the pipeline handler with
+ * frameDropped() for the first dropped frame that has one. Otherwise, if the
+ * pipeline ran out of requests, the drop is attributed to application
+ * starvation, and to the kernel in all other cases.
+ */
+void Camera::Private::detectFrameDrops(Request *request)
+{
+	if (request->status() == Request::RequestCancelled)
+		return;
+
+	uint32_t dropped = 0;
+	uint32_t first = 0;
+	uint32_t last = 0;
+
+	std::map<const Stream *, uint32_t> sequences;
+	for (const auto &[stream, buffer] : request->buffers()) {
+		const FrameMetadata &metadata = buffer->metadata();
+		if (metadata.status != FrameMetadata::FrameSuccess)
+			continue;
+
+		sequences[stream] = metadata.sequence;
+
+		auto iter = streamSequences_.find(stream);
+		if (iter == streamSequences_.end() ||
+		    metadata.sequence <= iter->second + 1)
+			continue;
+
+		uint32_t gap = metadata.sequence - iter->second - 1;
+		if (gap > dropped) {
+			dropped = gap;
+			first = iter->second + 1;
+			last = metadata.sequence;
+		}
+	}
+
+	streamSequences_ = std::move(sequences);
+
+	if (dropped) {
+		controls::FrameDropCauseEnum cause = starved_
+						   ? controls::FrameDropStarvation
+						   : controls::FrameDropKernel;
+
+		auto iter = frameDropCauses_.lower_bound(first);
+		if (iter != frameDropCauses_.end() && iter->first < last)
+			cause = iter->second;
+
+		request->metadata().set(controls::FramesDropped, dropped);
+		request->metadata().set(controls::FrameDropCause, cause);
+
+		framesDropped_->add(dropped);
+		frameDropCauseCounters_[cause]->add(dropped);
+
+		LOG(Camera, Debug)
+			<< "Dropped " << dropped << " frames before request "
+			<< request->sequence() << ", cause " << cause;
+	}
+
+	/* Drop the causes of the frames that precede this request. */
+	if (!streamSequences_.empty()) {
+		uint32_t sequence = streamSequences_.begin()->second;
+		frameDropCauses_.erase(frameDropCauses_.begin(),
+				       frameDropCauses_.upper_bound(sequence));
+	}
+
+	starved_ = false;
+}
+
+/**
+ * \brief Reset the frames drop detection state
+ *
+ * This function is called when the camera is stopped, as frame sequence
+ * numbers restart from 0 in the next capture session.
+ */
+void Camera::Private::resetFrameDrops()
+{
+	streamSequences_.clear();
+	frameDropCauses_.clear();
+	starved_ = false;
+}
+
+/**
+ * \brief Notify the application of buffer completion
+ * \param[in] request The request the buffer belongs to
+ * \param[in] buffer The buffer that has completed
+ *
+ * This function is called by the pipeline handler to notify the camera that
+ * the \a buffer has completed. It emits the Camera::bufferCompleted signal,
+ * through the completion executor if one has been set.
+ */
+void Camera::Private::bufferComplete(Request *request, FrameBuffer *buffer)
+{
+	Camera *camera = _o<Camera>();
+
+	if (!executor_) {
+		camera->bufferCompleted.emit(request, buffer);
+		return;
+	}
+
+	executor_([camera = camera->shared_from_this(), request, buffer]() {
+		camera->bufferCompleted.emit(request, buffer);
+	});
+}
+
+/**
+ * \brief Notify the application of partial request metadata
+ * \param[in] request The request the metadata belongs to
+ * \param[in] metadata The metadata that has become available
+ *
+ * This function is called by the pipeline handler to notify the camera that
+ * \a metadata for the \a request is available. It emits the
+ * Camera::metadataAvailable signal, through the completion executor if one has
+ * been set, in which case the \a metadata is copied.
+ */
+void Camera::Private::metadataAvailable(Request *request, const ControlList &metadata)
+{
+	Camera *camera = _o<Camera>();
+
+	if (!executor_) {
+		camera->metadataAvailable.emit(request, metadata);
+		return;
+	}
+
+	executor_([camera = camera->shared_from_this(), request, metadata]() {
+		camera->metadataAvailable.emit(request, metadata);
+	});
+}
+
+/**
+ * \brief Check if a request can be queued to the camera
+ * \param[in] request The request
+ *
+ * \return 0 if the request is valid, or a negative error code otherwise
+ * \retval -EXDEV The request does not belong to this camera
+ * \retval -EINVAL The request is invalid
+ */
+int Camera::Private::validateRequest(const Request *request) const
+{
+	/* Requests can only be queued to the camera that created them. */
+	if (request->_d()->camera() != _o<Camera>()) {
+		LOG(Camera, Error) << "Request was not created by this camera";
+		return -EXDEV;
+	}
+
+	if (request->status() != Request::RequestPending) {
+		LOG(Camera, Error) << request->toString() << " is not valid";
+		return -EINVAL;
+	}
+
+	if (request->buffers().empty() && !metadataOnlyRequests_) {
+		LOG(Camera, Error) << "Request contains no buffers";
+		return -EINVAL;
+	}
+
+	for (auto const &it : request->buffers()) {
+		const Stream *stream = it.first;
+
+		if (activeStreams_.find(stream) == activeStreams_.end()) {
+			LOG(Camera, Error) << "Invalid request";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
 int Camera::Private::isAccessAllowed(State state, bool allowDisconnected,
 				     const char *from) const
 {
@@ -888,6 +1284,24 @@ const std::string &Camera::id() const
  * completed
  */
 
+/**
+ * \var Camera::metadataAvailable
+ * \brief Signal emitted when partial metadata for a request queued to the
+ * camera is available
+ *
+ * Pipeline handlers may report metadata for a request before the request
+ * completes, as soon as they are known, for instance the sensor timestamp at
+ * the end of frame and the algorithms results when the IPA has processed the
+ * frame statistics. This signal is emitted with the \a metadata that has just
+ * become available, and is emitted any number of times, including none, before
+ * the requestCompleted signal for the request. The metadata is also merged in
+ * the Request::metadata() list, which contains all the metadata once the
+ * request completes.
+ *
+ * Slots shall only access the metadata passed to the signal, as the request
+ * metadata list may be modified concurrently until the request completes.
+ */
+
 /**
  * \var Camera::requestCompleted
  * \brief Signal emitted when a request queued to the camera has completed
@@ -911,6 +1325,7 @@ Camera::Camera(std::unique_ptr<Private> d, const std::string &id,
 {
 	_d()->id_ = id;
 	_d()->streams_ = streams;
+	_d()->metrics_.setScope(id);
 	_d()->validator_ = std::make_unique<CameraControlValidator>(this);
 }
 
@@ -1064,6 +1479,75 @@ const ControlList &Camera::properties() const
 	return _d()->properties_;
 }
 
+/**
+ * \brief Retrieve the runtime metrics of the camera
+ *
+ * Cameras count events related to their health, such as dropped frames,
+ * cancelled requests and buffer errors, and record the distribution of the
+ * request latency. Pipeline handlers may report additional platform-specific
+ * metrics. The metrics are collected at all times, and are cumulative over the
+ * lifetime of the camera.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return A snapshot of the camera metrics
+ */
+std::vector<Metric> Camera::metrics() const
+{
+	return _d()->metrics_.metrics();
+}
+
+/**
+ * \brief Retrieve the memory footprint of the camera
+ *
+ * The memory footprint includes the frame buffers allocated for the camera
+ * with a FrameBufferAllocator, and the memory allocated internally by the
+ * pipeline handler for the camera, such as buffer pools, shared memory and
+ * the buffers of the software ISP. It is broken down by type of memory, with
+ * the peak memory use over the lifetime of the camera.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return A snapshot of the camera memory footprint
+ */
+MemoryUsage Camera::memoryUsage() const
+{
+	return _d()->memory_->usage();
+}
+
+/**
+ * \brief Retrieve the number of buffers a stream needs in steady state
+ * \param[in] stream The stream
+ *
+ * The camera measures, for each buffer of the active streams, the time it
+ * spends in the pipeline and held by the application, and estimates the
+ * minimum number of buffers each stream needs to capture frames without drops
+ * at its frame rate. The estimate is available after a few frames have been
+ * captured, and is updated continuously. It covers the jitter observed over
+ * the last frames, and is kept across capture sessions until the camera is
+ * configured again.
+ *
+ * Applications can use the estimate to adjust StreamConfiguration::bufferCount
+ * when configuring the camera again, to trim memory use or avoid frame drops.
+ * The estimate doesn't account for the minimum number of buffers the device
+ * requires, configurations shall be validated as usual.
+ *
+ * \context This function is \threadsafe, except against configure().
+ *
+ * \return The number of buffers, or 0 if \a stream isn't active or not enough
+ * frames have been captured yet
+ */
+unsigned int Camera::recommendedBufferCount(const Stream *stream) const
+{
+	const Private *const d = _d();
+
+	auto it = d->bufferResidency_.find(stream);
+	if (it == d->bufferResidency_.end())
+		return 0;
+
+	return it->second->recommendedCount();
+}
+
 /**
  * \brief Retrieve all the camera's stream information
  *
@@ -1190,6 +1674,8 @@ int Camera::configure(CameraConfiguration *config)
 
 	LOG(Camera, Info) << msg.str();
 
+	d->metadataOnlyRequests_ = false;
+
 	ret = d->pipe_->invokeMethod(&PipelineHandler::configure,
 				     ConnectionTypeBlocking, this, config);
 	if (ret)
@@ -1209,6 +1695,23 @@ int Camera::configure(CameraConfiguration *config)
 		d->activeStreams_.insert(stream);
 	}
 
+	/* The pipeline handler may have updated the camera controls. */
+	d->validator_->update();
+
+	d->governor_.reset();
+	const char *governor = utils::secure_getenv("LIBCAMERA_FRAME_RATE_GOVERNOR");
+	if (governor && *governor != '\0') {
+		auto it = d->controlInfo_.find(&controls::FrameDurationLimits);
+		if (it != d->controlInfo_.end())
+			d->governor_ = std::make_unique<FrameRateGovernor>(it->second);
+	}
+
+	d->bufferResidency_.clear();
+	for (const Stream *stream : d->activeStreams_)
+		d->bufferResidency_[stream] =
+			std::make_unique<BufferResidency>(d->bufferLatency_,
+							  d->bufferHold_);
+
 	d->setState(Private::CameraConfigured);
 
 	return 0;
@@ -1260,7 +1763,17 @@ std::unique_ptr<Request> Camera::createRequest(uint64_t cookie)
  *
  * After allocating the request with createRequest(), the application shall
  * fill it with at least one capture buffer before queuing it. Requests that
- * contain no buffers are invalid and are rejected without being queued.
+ * contain no buffers are invalid and are rejected without being queued, unless
+ * the pipeline handler supports metadata-only requests in the current
+ * configuration.
+ *
+ * Metadata-only requests carry controls and return metadata, without capturing
+ * any image to the application. They keep the algorithms running, for instance
+ * to keep AE and AWB converged at a low frame rate while monitoring a scene.
+ * Buffers for any of the configured streams can be added again to the next
+ * requests to resume capture without reconfiguring the camera. Support for
+ * metadata-only requests can be tested by queueing one: the request is rejected
+ * with -EINVAL if it isn't supported.
  *
  * Once the request has been queued, the camera will notify its completion
  * through the \ref requestCompleted signal.
@@ -1283,39 +1796,138 @@ int Camera::queueRequest(Request *request)
 	if (ret < 0)
 		return ret;
 
-	/* Requests can only be queued to the camera that created them. */
-	if (request->_d()->camera() != this) {
-		LOG(Camera, Error) << "Request was not created by this camera";
-		return -EXDEV;
-	}
-
-	if (request->status() != Request::RequestPending) {
-		LOG(Camera, Error) << request->toString() << " is not valid";
-		return -EINVAL;
-	}
-
 	/*
 	 * The camera state may change until the end of the function. No locking
 	 * is however needed as PipelineHandler::queueRequest() will handle
 	 * this.
 	 */
 
-	if (request->buffers().empty()) {
-		LOG(Camera, Error) << "Request contains no buffers";
-		return -EINVAL;
-	}
+	ret = d->validateRequest(request);
+	if (ret < 0)
+		return ret;
 
-	for (auto const &it : request->buffers()) {
-		const Stream *stream = it.first;
+	if (d->governor_)
+		d->governor_->requestQueued(request->controls());
 
-		if (d->activeStreams_.find(stream) == d->activeStreams_.end()) {
-			LOG(Camera, Error) << "Invalid request";
+	request->_d()->recordStage(Request::Private::StageQueued);
+
+	d->pipe_->invokeMethod(&PipelineHandler::queueRequest,
+			       ConnectionTypeQueued, request);
+
+	return 0;
+}
+
+/**
+ * \brief Queue multiple requests to the camera
+ * \param[in] requests The requests to queue to the camera
+ *
+ * This function queues all the \a requests to the camera for capture, in the
+ * order they are stored in the span. It behaves as calling queueRequest() for
+ * each request, but passes all of them to the pipeline handler at once, which
+ * can then queue them to the device back-to-back. Applications should prefer
+ * this function when they have multiple requests ready, such as when starting
+ * capture.
+ *
+ * All requests are validated before any of them is queued. If any request is
+ * invalid, or if the same request appears multiple times, no request is queued
+ * and an error is returned.
+ *
+ * \context This function is \threadsafe. It may only be called when the camera
+ * is in the Running state as defined in \ref camera_operation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not running so requests can't be queued
+ * \retval -EXDEV A request does not belong to this camera
+ * \retval -EINVAL A request is invalid
+ */
+int Camera::queueRequests(Span<Request *const> requests)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraRunning);
+	if (ret < 0)
+		return ret;
+
+	for (auto it = requests.begin(); it != requests.end(); ++it) {
+		ret = d->validateRequest(*it);
+		if (ret < 0)
+			return ret;
+
+		if (std::find(requests.begin(), it, *it) != it) {
+			LOG(Camera, Error)
+				<< (*it)->toString() << " is queued multiple times";
 			return -EINVAL;
 		}
 	}
 
-	d->pipe_->invokeMethod(&PipelineHandler::queueRequest,
-			       ConnectionTypeQueued, request);
+	if (requests.empty())
+		return 0;
+
+	for (Request *request : requests) {
+		if (d->governor_)
+			d->governor_->requestQueued(request->controls());
+
+		request->_d()->recordStage(Request::Private::StageQueued);
+	}
+
+	d->pipe_->invokeMethod(&PipelineHandler::queueRequests,
+			       ConnectionTypeQueued,
+			       std::vector<Request *>(requests.begin(), requests.end()));
+
+	return 0;
+}
+
+/**
+ * \typedef Camera::Executor
+ * \brief A function that runs completion tasks in the application's context
+ *
+ * The executor is called in the libcamera internal thread that completes
+ * buffers and requests, with a \a task to run. It shall arrange for the task
+ * to be run later, typically by posting it to the event loop of the thread
+ * that consumes the completions, and shall run tasks in the order it receives
+ * them.
+ */
+
+/**
+ * \brief Set the executor that delivers completion signals
+ * \param[in] executor The executor
+ *
+ * By default, the bufferCompleted and requestCompleted signals are emitted in
+ * a libcamera internal thread, and applications typically forward the
+ * completions to their own thread. This function instead lets applications
+ * supply an \a executor that runs the signal emission directly where
+ * completions are consumed, avoiding the need for an additional hop.
+ *
+ * When an executor is set, the signals are emitted from the tasks passed to
+ * the executor. The execution order of the tasks determines the order in which
+ * the signals are emitted, which is the same as without an executor when
+ * tasks are run in the order they are submitted. Passing an empty executor
+ * restores emission of the signals in the libcamera internal thread.
+ *
+ * As signal emission is deferred to the executor, completion of requests
+ * cancelled by stop() may be delivered after stop() returns. Applications
+ * shall keep the requests valid until they have received all completions.
+ *
+ * \context This function shall be synchronized by the caller with other
+ * functions that affect the camera state. It may only be called when the
+ * camera is in the Acquired or Configured state as defined in
+ * \ref camera_operation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in the Acquired or Configured state
+ */
+int Camera::setCompletionExecutor(Executor executor)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraAcquired,
+				     Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	d->executor_ = std::move(executor);
 
 	return 0;
 }
@@ -1350,6 +1962,9 @@ int Camera::start(const ControlList *controls)
 
 	ASSERT(d->requestSequence_ == 0);
 
+	if (d->governor_)
+		d->governor_->start(controls);
+
 	ret = d->pipe_->invokeMethod(&PipelineHandler::start,
 				     ConnectionTypeBlocking, this, controls);
 	if (ret)
@@ -1418,7 +2033,16 @@ void Camera::requestComplete(Request *request)
 				  true))
 		LOG(Camera, Fatal) << "Trying to complete a request when stopped";
 
-	requestCompleted.emit(request);
+	Private *const d = _d();
+
+	if (!d->executor_) {
+		requestCompleted.emit(request);
+		return;
+	}
+
+	d->executor_([camera = shared_from_this(), request]() {
+		camera->requestCompleted.emit(request);
+	});
 }
 
 } /* namespace libcamera */
@@ -7,6 +7,8 @@
 
 #include "libcamera/internal/camera_controls.h"
 
+#include <algorithm>
+
 #include <libcamera/camera.h>
 #include <libcamera/controls.h>
 
@@ -23,7 +25,28 @@ namespace libcamera {
  *
  * This ControlValidator specialisation validates that controls exist in the
  * Camera associated with the validator.
+ *
+ * Controls are validated every time they are set in a request. To avoid
+ * looking them up in the camera's ControlInfoMap, which costs two hash
+ * lookups, the validator keeps a table of the ControlInfo of the camera
+ * controls indexed by numerical ID. As control IDs are allocated in ranges
+ * starting at widely spaced base values for each vendor, the table is split in
+ * dense ranges of consecutive IDs, and a lookup only costs a few array
+ * accesses.
+ *
+ * The table stores pointers to the camera's ControlInfoMap entries, and must
+ * be updated with update() every time the camera controls are replaced.
+ */
+
+namespace {
+
+/*
+ * Maximum number of unused IDs between two controls in the same range of the
+ * table.
  */
+constexpr unsigned int kMaxRangeGap = 64;
+
+} /* namespace */
 
 /**
  * \brief Construst a CameraControlValidator for the \a camera
@@ -32,6 +55,7 @@ namespace libcamera {
 CameraControlValidator::CameraControlValidator(Camera *camera)
 	: camera_(camera)
 {
+	update();
 }
 
 const std::string &CameraControlValidator::name() const
@@ -45,9 +69,63 @@ const std::string &CameraControlValidator::name() const
  * \return True if the control is valid, false otherwise
  */
 bool CameraControlValidator::validate(unsigned int id) const
+{
+	return info(id) != nullptr;
+}
+
+/**
+ * \brief Update the validation table from the camera controls
+ *
+ * This function shall be called every time the controls of the camera are
+ * replaced, typically when the pipeline handler updates them at configure()
+ * time, and when no request is being validated concurrently.
+ */
+void CameraControlValidator::update()
 {
 	const ControlInfoMap &controls = camera_->controls();
-	return controls.find(id) != controls.end();
+
+	std::vector<std::pair<unsigned int, const ControlInfo *>> entries;
+	entries.reserve(controls.size());
+	for (const auto &[id, info] : controls)
+		entries.emplace_back(id->id(), &info);
+
+	std::sort(entries.begin(), entries.end());
+
+	ranges_.clear();
+
+	for (const auto &[id, info] : entries) {
+		if (ranges_.empty() ||
+		    id - ranges_.back().first >= ranges_.back().infos.size() + kMaxRangeGap)
+			ranges_.push_back({ id, {} });
+
+		Range &range = ranges_.back();
+		range.infos.resize(id - range.first + 1, nullptr);
+		range.infos.back() = info;
+	}
+}
+
+/**
+ * \brief Retrieve the information of a camera control
+ * \param[in] id The control ID
+ *
+ * Pipeline handlers can use this function to look up the limits of a control
+ * they process, without going through the camera's ControlInfoMap.
+ *
+ * \return The control information, or nullptr if the camera doesn't support
+ * the control
+ */
+const ControlInfo *CameraControlValidator::info(unsigned int id) const
+{
+	for (const Range &range : ranges_) {
+		if (id < range.first)
+			break;
+
+		unsigned int index = id - range.first;
+		if (index < range.infos.size())
+			return range.infos[index];
+	}
+
+	return nullptr;
 }
 
 } /* namespace libcamera */
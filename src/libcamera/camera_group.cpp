@@ -0,0 +1,472 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Group of cameras operated in lockstep
+ */
+
+#include <libcamera/camera_group.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/request.h>
+
+#include "libcamera/internal/camera.h"
+#include "libcamera/internal/camera_group.h"
+#include "libcamera/internal/camera_sensor_properties.h"
+#include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/request.h"
+
+/**
+ * \file camera_group.h
+ * \brief Group of cameras configured, started and stopped together
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CameraGroup)
+
+namespace {
+
+int setSyncMode(Camera *camera, SensorSyncMode mode)
+{
+	PipelineHandler *pipe = camera->_d()->pipe();
+
+	return pipe->invokeMethod(&PipelineHandler::setSyncMode,
+				  ConnectionTypeBlocking, camera, mode);
+}
+
+} /* namespace */
+
+/**
+ * \class CameraGroup
+ * \brief Operate multiple cameras in lockstep
+ *
+ * Applications that combine the frames of several cameras, such as stereo or
+ * panoramic capture, need the frames of all cameras to be exposed at the same
+ * time. Pairing the frames of independent cameras after capture by comparing
+ * their timestamps requires buffering frames and adds latency. The CameraGroup
+ * class instead operates a group of cameras together: the cameras are
+ * configured and started as a group, and requests are queued to all cameras at
+ * once and complete as a group.
+ *
+ * When all cameras in the group support hardware synchronisation, start()
+ * sets the sensor of the first camera as the leader of the group and the
+ * sensors of the other cameras as followers, so that all sensors expose their
+ * frames on the same synchronisation signal. Otherwise the cameras run freely
+ * and the group only keeps their requests in lockstep. The
+ * hardwareSynchronised() function tells which mode is in use.
+ *
+ * The cameras shall be acquired by the application before being grouped, and
+ * shall not be operated directly while they are part of a running group.
+ * Buffers are allocated and requests created for each camera as usual.
+ */
+
+/**
+ * \class CameraGroup::Private
+ * \brief Private data of a CameraGroup
+ *
+ * The requests of the group are tracked in groups_ from the time they are
+ * queued until all the requests of a group complete. Complete groups are then
+ * moved, in the order they were queued, to completed_, from which a single
+ * thread at a time emits the requestsCompleted signal.
+ */
+
+/**
+ * \brief Construct a CameraGroup::Private instance
+ * \param[in] cameras The cameras in the group
+ */
+CameraGroup::Private::Private(std::vector<std::shared_ptr<Camera>> cameras)
+	: cameras_(std::move(cameras)), configured_(false), synchronised_(false),
+	  running_(false), dispatching_(false)
+{
+}
+
+/**
+ * \brief Handle the completion of a request by one of the cameras
+ * \param[in] request The completed request
+ */
+void CameraGroup::Private::requestComplete(Request *request)
+{
+	retireRequests(request, 1);
+}
+
+/**
+ * \brief Account for requests that won't be pending anymore
+ * \param[in] request The request that completed or failed to be queued
+ * \param[in] count The number of requests of the group to account for
+ *
+ * Emit the requestsCompleted signal for all the groups at the front of the
+ * queue that have no pending request anymore.
+ */
+void CameraGroup::Private::retireRequests(Request *request, unsigned int count)
+{
+	MutexLocker locker(lock_);
+
+	auto group = std::find_if(groups_.begin(), groups_.end(),
+				  [&](const Group &g) {
+					  return std::find(g.requests.begin(), g.requests.end(),
+							   request) != g.requests.end();
+				  });
+	/* Ignore requests queued to the cameras directly. */
+	if (group == groups_.end())
+		return;
+
+	group->pending -= count;
+
+	while (!groups_.empty() && !groups_.front().pending) {
+		completed_.push_back(std::move(groups_.front().requests));
+		groups_.pop_front();
+	}
+
+	/*
+	 * Only one thread emits the signal at a time to guarantee the group
+	 * ordering. Groups completed by other threads, or by slots, are emitted
+	 * by the thread already dispatching.
+	 */
+	if (dispatching_)
+		return;
+
+	dispatching_ = true;
+
+	while (!completed_.empty()) {
+		std::vector<Request *> requests = std::move(completed_.front());
+		completed_.pop_front();
+
+		locker.unlock();
+		checkSequences(requests);
+		_o<CameraGroup>()->requestsCompleted.emit(requests);
+		locker.lock();
+	}
+
+	dispatching_ = false;
+}
+
+/**
+ * \brief Check that the frames of a completed group are in step
+ * \param[in] requests The requests of the group
+ *
+ * The frame sequences of cameras that run freely start at different times.
+ * Record the sequence offsets between the cameras for the first group, and
+ * report any later change, caused by a frame dropped by one of the cameras.
+ */
+void CameraGroup::Private::checkSequences(const std::vector<Request *> &requests)
+{
+	if (requests.size() < 2)
+		return;
+
+	std::vector<int64_t> sequences;
+	for (const Request *request : requests) {
+		if (request->status() != Request::RequestComplete ||
+		    request->buffers().empty())
+			return;
+
+		const FrameBuffer *buffer = request->buffers().begin()->second;
+		sequences.push_back(buffer->metadata().sequence);
+	}
+
+	bool initial = sequenceOffsets_.empty();
+	sequenceOffsets_.resize(sequences.size());
+
+	for (unsigned int i = 1; i < sequences.size(); ++i) {
+		int64_t offset = sequences[i] - sequences[0];
+		if (!initial && offset != sequenceOffsets_[i])
+			LOG(CameraGroup, Warning)
+				<< "Camera " << cameras_[i]->id()
+				<< " out of step by " << offset - sequenceOffsets_[i]
+				<< " frames at sequence " << sequences[i];
+
+		sequenceOffsets_[i] = offset;
+	}
+}
+
+/**
+ * \brief Set the sensors of all cameras back to free running mode
+ */
+void CameraGroup::Private::resetSyncModes()
+{
+	for (const std::shared_ptr<Camera> &camera : cameras_)
+		setSyncMode(camera.get(), SensorSyncMode::Off);
+}
+
+/**
+ * \brief Construct a group of cameras
+ * \param[in] cameras The cameras in the group, the first one being the leader
+ */
+CameraGroup::CameraGroup(std::vector<std::shared_ptr<Camera>> cameras)
+	: Extensible(std::make_unique<Private>(std::move(cameras)))
+{
+	Private *const d = _d();
+
+	for (const std::shared_ptr<Camera> &camera : d->cameras_)
+		camera->requestCompleted.connect(d, &Private::requestComplete);
+}
+
+/**
+ * \brief Destroy the group, stopping the cameras if they are running
+ */
+CameraGroup::~CameraGroup()
+{
+	Private *const d = _d();
+
+	stop();
+
+	for (const std::shared_ptr<Camera> &camera : d->cameras_)
+		camera->requestCompleted.disconnect(d, &Private::requestComplete);
+}
+
+/**
+ * \brief Retrieve the cameras in the group
+ * \return The cameras in the group, in the order they were given at
+ * construction time
+ */
+const std::vector<std::shared_ptr<Camera>> &CameraGroup::cameras() const
+{
+	return _d()->cameras_;
+}
+
+/**
+ * \brief Check if the group is hardware synchronised
+ *
+ * The synchronisation mode is selected by start(), this function thus returns
+ * false until the group is started.
+ *
+ * \return True if the sensors of all cameras are synchronised by hardware,
+ * false otherwise
+ */
+bool CameraGroup::hardwareSynchronised() const
+{
+	return _d()->synchronised_;
+}
+
+/**
+ * \brief Configure all the cameras in the group
+ * \param[in] configs The configurations, one per camera in the group order
+ *
+ * All configurations are validated before any camera is configured, such that
+ * an invalid configuration for one camera leaves all the cameras untouched.
+ * The configurations may be adjusted by the validation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The number of configurations doesn't match the number of
+ * cameras, or one of the configurations is invalid
+ * \retval -EBUSY The group is running
+ */
+int CameraGroup::configure(const std::vector<CameraConfiguration *> &configs)
+{
+	Private *const d = _d();
+
+	if (d->running_)
+		return -EBUSY;
+
+	if (configs.size() != d->cameras_.size()) {
+		LOG(CameraGroup, Error)
+			<< "Expected " << d->cameras_.size() << " configurations, got "
+			<< configs.size();
+		return -EINVAL;
+	}
+
+	for (unsigned int i = 0; i < configs.size(); ++i) {
+		if (configs[i]->validate() == CameraConfiguration::Invalid) {
+			LOG(CameraGroup, Error)
+				<< "Invalid configuration for camera "
+				<< d->cameras_[i]->id();
+			return -EINVAL;
+		}
+	}
+
+	d->configured_ = false;
+
+	for (unsigned int i = 0; i < configs.size(); ++i) {
+		int ret = d->cameras_[i]->configure(configs[i]);
+		if (ret)
+			return ret;
+	}
+
+	d->configured_ = true;
+
+	return 0;
+}
+
+/**
+ * \brief Start capture on all the cameras in the group
+ * \param[in] controls Controls to be applied to all cameras before starting
+ *
+ * If the sensors of all cameras support hardware synchronisation, they are set
+ * to the leader and follower modes before starting. The followers are started
+ * first and the leader last, such that no follower misses the first
+ * synchronisation signal. If any camera fails to start, the cameras already
+ * started are stopped.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EACCES The group hasn't been configured
+ * \retval -EBUSY The group is already running
+ */
+int CameraGroup::start(const ControlList *controls)
+{
+	Private *const d = _d();
+
+	if (d->running_)
+		return -EBUSY;
+
+	if (!d->configured_)
+		return -EACCES;
+
+	d->synchronised_ = false;
+
+	if (d->cameras_.size() > 1) {
+		int ret = 0;
+
+		for (unsigned int i = 1; i < d->cameras_.size() && !ret; ++i)
+			ret = setSyncMode(d->cameras_[i].get(), SensorSyncMode::Follower);
+		if (!ret)
+			ret = setSyncMode(d->cameras_[0].get(), SensorSyncMode::Leader);
+
+		if (ret) {
+			if (ret != -ENOTSUP)
+				LOG(CameraGroup, Warning)
+					<< "Failed to set synchronisation mode: "
+					<< strerror(-ret);
+			d->resetSyncModes();
+		} else {
+			d->synchronised_ = true;
+		}
+	}
+
+	LOG(CameraGroup, Debug)
+		<< "Starting " << d->cameras_.size() << " cameras, "
+		<< (d->synchronised_ ? "hardware" : "not") << " synchronised";
+
+	d->sequenceOffsets_.clear();
+
+	for (auto it = d->cameras_.rbegin(); it != d->cameras_.rend(); ++it) {
+		int ret = (*it)->start(controls);
+		if (!ret)
+			continue;
+
+		LOG(CameraGroup, Error)
+			<< "Failed to start camera " << (*it)->id();
+
+		for (auto started = d->cameras_.rbegin(); started != it; ++started)
+			(*started)->stop();
+
+		d->resetSyncModes();
+		d->synchronised_ = false;
+		return ret;
+	}
+
+	d->running_ = true;
+
+	return 0;
+}
+
+/**
+ * \brief Stop capture on all the cameras in the group
+ *
+ * Pending requests are cancelled, and their groups complete through the
+ * requestsCompleted signal before this function returns. The camera sensors
+ * are set back to free running mode.
+ *
+ * \return 0 on success or the first error returned by Camera::stop()
+ */
+int CameraGroup::stop()
+{
+	Private *const d = _d();
+
+	if (!d->running_)
+		return 0;
+
+	int result = 0;
+
+	for (const std::shared_ptr<Camera> &camera : d->cameras_) {
+		int ret = camera->stop();
+		if (ret && !result)
+			result = ret;
+	}
+
+	d->resetSyncModes();
+	d->running_ = false;
+
+	return result;
+}
+
+/**
+ * \brief Queue a group of requests, one for each camera
+ * \param[in] requests The requests, one per camera in the group order
+ *
+ * Each request shall have been created by the camera it is queued to. The
+ * requests complete as a group through the requestsCompleted signal, in the
+ * order in which they have been queued.
+ *
+ * If a camera fails to queue its request after the requests of the previous
+ * cameras have been queued, the group still completes once those requests
+ * complete, and the requests that couldn't be queued stay in the pending
+ * state.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EACCES The group isn't running
+ * \retval -EINVAL The requests don't match the cameras of the group
+ */
+int CameraGroup::queueRequests(const std::vector<Request *> &requests)
+{
+	Private *const d = _d();
+
+	if (!d->running_)
+		return -EACCES;
+
+	if (requests.size() != d->cameras_.size())
+		return -EINVAL;
+
+	for (unsigned int i = 0; i < requests.size(); ++i) {
+		if (requests[i]->_d()->camera() != d->cameras_[i].get() ||
+		    requests[i]->status() != Request::RequestPending) {
+			LOG(CameraGroup, Error)
+				<< "Invalid request for camera " << d->cameras_[i]->id();
+			return -EINVAL;
+		}
+	}
+
+	{
+		MutexLocker locker(d->lock_);
+		d->groups_.push_back({ requests, static_cast<unsigned int>(requests.size()) });
+	}
+
+	for (unsigned int i = 0; i < requests.size(); ++i) {
+		int ret = d->cameras_[i]->queueRequest(requests[i]);
+		if (!ret)
+			continue;
+
+		if (i == 0) {
+			MutexLocker locker(d->lock_);
+			auto group = std::find_if(d->groups_.begin(), d->groups_.end(),
+						  [&](const Private::Group &g) {
+							  return g.requests[0] == requests[0];
+						  });
+			d->groups_.erase(group);
+		} else {
+			d->retireRequests(requests[i], requests.size() - i);
+		}
+
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \var CameraGroup::requestsCompleted
+ * \brief Signal emitted when all the requests of a group have completed
+ *
+ * The requests are passed in the group order. Groups complete in the order they
+ * have been queued, even when a camera completes its request before the
+ * previous groups are complete. The signal is emitted from the thread that
+ * completes the last request of the group, slots shall thus be thread-safe.
+ */
+
+} /* namespace libcamera */
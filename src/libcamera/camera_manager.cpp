@@ -7,6 +7,9 @@
 
 #include "libcamera/internal/camera_manager.h"
 
+#include <fstream>
+#include <stdlib.h>
+
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
 
@@ -15,6 +18,8 @@
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/ipc_pipe_unixsocket.h"
+#include "libcamera/internal/metrics.h"
 #include "libcamera/internal/pipeline_handler.h"
 
 /**
@@ -36,11 +41,60 @@ namespace libcamera {
 LOG_DEFINE_CATEGORY(Camera)
 
 #ifndef __DOXYGEN_PUBLIC__
+/*
+ * A thread running pipeline handlers, used when the LIBCAMERA_PIPELINE_THREADS
+ * environment variable is set. Pipeline handlers are created and matched in
+ * the thread, all the objects they create, including their cameras, their
+ * devices and the event notifiers and timers of the devices, are thus bound
+ * to the thread.
+ */
+class PipelineHandlerThread : public Thread
+{
+public:
+	PipelineHandlerThread()
+		: Thread("PipelineHandler")
+	{
+		matcher_.moveToThread(this);
+	}
+
+	bool match(const PipelineHandlerFactoryBase *factory,
+		   CameraManager *manager, DeviceEnumerator *enumerator)
+	{
+		return matcher_.invokeMethod(&Matcher::match, ConnectionTypeBlocking,
+					     factory, manager, enumerator);
+	}
+
+protected:
+	void run() override
+	{
+		exec();
+
+		/* Spare IPA workers are bound to the thread that spawned them. */
+		IPCPipeUnixSocket::releaseSpareWorkers();
+	}
+
+private:
+	class Matcher : public Object
+	{
+	public:
+		bool match(const PipelineHandlerFactoryBase *factory,
+			   CameraManager *manager, DeviceEnumerator *enumerator)
+		{
+			std::shared_ptr<PipelineHandler> pipe = factory->create(manager);
+			return pipe->match(enumerator);
+		}
+	};
+
+	Matcher matcher_;
+};
+
 CameraManager::Private::Private()
-	: initialized_(false)
+	: Thread("CameraManager"), initialized_(false), nextPipelineThread_(0)
 {
 }
 
+CameraManager::Private::~Private() = default;
+
 int CameraManager::Private::start()
 {
 	int status;
@@ -93,6 +147,7 @@ int CameraManager::Private::init()
 	if (!enumerator_ || enumerator_->enumerate())
 		return -ENODEV;
 
+	createPipelineThreads();
 	createPipelineHandlers();
 	enumerator_->devicesAdded.connect(this, &Private::createPipelineHandlers);
 
@@ -150,9 +205,20 @@ void CameraManager::Private::pipelineFactoryMatch(const PipelineHandlerFactoryBa
 
 	/* Provide as many matching pipelines as possible. */
 	while (1) {
-		std::shared_ptr<PipelineHandler> pipe = factory->create(o);
-		if (!pipe->match(enumerator_.get()))
-			break;
+		if (pipelineThreads_.empty()) {
+			std::shared_ptr<PipelineHandler> pipe = factory->create(o);
+			if (!pipe->match(enumerator_.get()))
+				break;
+		} else {
+			/* Distribute the pipeline handlers over the threads. */
+			PipelineHandlerThread *thread =
+				pipelineThreads_[nextPipelineThread_].get();
+			if (!thread->match(factory, o, enumerator_.get()))
+				break;
+
+			nextPipelineThread_ = (nextPipelineThread_ + 1) %
+					      pipelineThreads_.size();
+		}
 
 		LOG(Camera, Debug)
 			<< "Pipeline handler \"" << factory->name()
@@ -160,10 +226,67 @@ void CameraManager::Private::pipelineFactoryMatch(const PipelineHandlerFactoryBa
 	}
 }
 
+/*
+ * By default, all pipeline handlers run in the CameraManager thread, and a slow
+ * slot of one camera delays the events of all the other cameras. When the
+ * LIBCAMERA_PIPELINE_THREADS environment variable is set to a number of
+ * threads, pipeline handlers are distributed over a pool of threads of that
+ * size instead, and a number of threads equal to or larger than the number of
+ * pipeline handler instances dedicates a thread to each of them.
+ */
+void CameraManager::Private::createPipelineThreads()
+{
+	static constexpr unsigned int kMaxPipelineThreads = 16;
+
+	const char *env = utils::secure_getenv("LIBCAMERA_PIPELINE_THREADS");
+	if (!env || env[0] == '\0')
+		return;
+
+	char *end;
+	unsigned long count = strtoul(env, &end, 10);
+	if (*end != '\0' || count > kMaxPipelineThreads) {
+		LOG(Camera, Warning)
+			<< "Invalid pipeline handler threads count '" << env
+			<< "', running pipeline handlers in the CameraManager thread";
+		return;
+	}
+
+	for (unsigned long i = 0; i < count; i++) {
+		pipelineThreads_.push_back(std::make_unique<PipelineHandlerThread>());
+		pipelineThreads_.back()->start();
+	}
+
+	if (count)
+		LOG(Camera, Debug)
+			<< "Running pipeline handlers in " << count << " threads";
+}
+
+/*
+ * Write the metrics to the file named by the LIBCAMERA_METRICS_FILE environment
+ * variable, one metric per line, before the cameras get destroyed.
+ */
+void CameraManager::Private::dumpMetrics()
+{
+	const char *path = utils::secure_getenv("LIBCAMERA_METRICS_FILE");
+	if (!path || path[0] == '\0')
+		return;
+
+	std::ofstream file(path, std::ios::out | std::ios::app);
+	if (!file.is_open()) {
+		LOG(Camera, Warning) << "Failed to open metrics file " << path;
+		return;
+	}
+
+	for (const Metric &metric : MetricsRegistry::allMetrics())
+		file << metric.toString() << std::endl;
+}
+
 void CameraManager::Private::cleanup()
 {
 	enumerator_->devicesAdded.disconnect(this);
 
+	dumpMetrics();
+
 	/*
 	 * Release all references to cameras to ensure they all get destroyed
 	 * before the device enumerator deletes the media devices. Cameras are
@@ -178,6 +301,19 @@ void CameraManager::Private::cleanup()
 
 	dispatchMessages(Message::Type::DeferredDelete);
 
+	/*
+	 * Cameras bound to pipeline handler threads are deleted, along with
+	 * their pipeline handler, when the threads finish.
+	 */
+	for (std::unique_ptr<PipelineHandlerThread> &thread : pipelineThreads_) {
+		thread->exit();
+		thread->wait();
+	}
+
+	pipelineThreads_.clear();
+
+	IPCPipeUnixSocket::releaseSpareWorkers();
+
 	enumerator_.reset(nullptr);
 }
 
@@ -192,11 +328,12 @@ void CameraManager::Private::cleanup()
  * Device numbers from the SystemDevices property are used by the V4L2
  * compatibility layer to map V4L2 device nodes to Camera instances.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the pipeline handler thread of
+ * the camera.
  */
 void CameraManager::Private::addCamera(std::shared_ptr<Camera> camera)
 {
-	ASSERT(Thread::current() == this);
+	ASSERT(Thread::current() == camera->thread());
 
 	MutexLocker locker(mutex_);
 
@@ -226,11 +363,12 @@ void CameraManager::Private::addCamera(std::shared_ptr<Camera> camera)
  * camera manager. Unregistered cameras won't be reported anymore by the
  * cameras() and get() calls, but references may still exist in applications.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the pipeline handler thread of
+ * the camera.
  */
 void CameraManager::Private::removeCamera(std::shared_ptr<Camera> camera)
 {
-	ASSERT(Thread::current() == this);
+	ASSERT(Thread::current() == camera->thread());
 
 	MutexLocker locker(mutex_);
 
@@ -385,6 +523,23 @@ std::shared_ptr<Camera> CameraManager::get(const std::string &id)
 	return nullptr;
 }
 
+/**
+ * \brief Retrieve the runtime metrics of all cameras and devices
+ *
+ * This function returns the metrics of all cameras, as reported by
+ * Camera::metrics(), along with the metrics of the devices used by the
+ * pipeline handlers. Metrics are identified by their scope, which is the camera
+ * ID for camera metrics and the device node for device metrics.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return A snapshot of all metrics
+ */
+std::vector<Metric> CameraManager::metrics() const
+{
+	return MetricsRegistry::allMetrics();
+}
+
 /**
  * \var CameraManager::cameraAdded
  * \brief Notify of a new camera added to the system
@@ -395,9 +550,10 @@ std::shared_ptr<Camera> CameraManager::get(const std::string &id)
  * connected to the system. When the signal is emitted the new camera is already
  * available from the list of cameras().
  *
- * The signal is emitted from the CameraManager thread. Applications shall
- * minimize the time spent in the signal handler and shall in particular not
- * perform any blocking operation.
+ * The signal is emitted from the pipeline handler thread of the camera, which
+ * is the CameraManager thread unless pipeline handler threads are enabled.
+ * Applications shall minimize the time spent in the signal handler and shall
+ * in particular not perform any blocking operation.
  */
 
 /**
@@ -408,9 +564,10 @@ std::shared_ptr<Camera> CameraManager::get(const std::string &id)
  * signal is emitted the camera is not available from the list of cameras()
  * anymore.
  *
- * The signal is emitted from the CameraManager thread. Applications shall
- * minimize the time spent in the signal handler and shall in particular not
- * perform any blocking operation.
+ * The signal is emitted from the pipeline handler thread of the camera, which
+ * is the CameraManager thread unless pipeline handler threads are enabled.
+ * Applications shall minimize the time spent in the signal handler and shall
+ * in particular not perform any blocking operation.
  */
 
 /**
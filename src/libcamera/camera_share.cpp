@@ -0,0 +1,988 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Camera sharing between processes
+ */
+
+#include "libcamera/internal/camera_share.h"
+
+#include <algorithm>
+#include <array>
+#include <errno.h>
+#include <limits.h>
+#include <set>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+#include <libcamera/base/message.h>
+#include <libcamera/base/shared_fd.h>
+#include <libcamera/base/thread.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/framebuffer_allocator.h>
+#include <libcamera/request.h>
+
+#include "libcamera/internal/byte_stream_buffer.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/ipc_unixsocket.h"
+
+/**
+ * \file camera_share.h
+ * \brief Sharing of a camera between processes
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CameraShare)
+
+namespace {
+
+/*
+ * Messages exchanged on the IPC channel. The Stream messages are sent by the
+ * server when a client connects, one per stream, and carry the buffer file
+ * descriptors. Frame messages only reference buffers by index, the frame data
+ * is never copied.
+ */
+enum ShareMessageType : uint32_t {
+	ShareMessageStream = 0,
+	ShareMessageFrame = 1,
+	ShareMessageSubscribe = 2,
+	ShareMessageRelease = 3,
+};
+
+struct ShareStream {
+	uint32_t type;
+	uint32_t index;
+	uint32_t count;
+	uint32_t fourcc;
+	uint64_t modifier;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t frameSize;
+	uint32_t numBuffers;
+	uint32_t numPlanes;
+	/*
+	 * Followed by numBuffers * numPlanes SharePlane entries. Planes of a
+	 * buffer that share a dmabuf reference the same file descriptor.
+	 */
+};
+
+struct SharePlane {
+	uint32_t fd;
+	uint32_t offset;
+	uint32_t length;
+};
+
+constexpr unsigned int kMaxPlanes = 4;
+
+struct ShareFrame {
+	uint32_t type;
+	uint32_t stream;
+	uint32_t buffer;
+	uint32_t status;
+	uint32_t sequence;
+	uint32_t numPlanes;
+	uint64_t timestamp;
+	uint32_t bytesused[kMaxPlanes];
+	uint32_t metadataSize;
+	/* Followed by the serialized metadata. */
+};
+
+struct ShareSubscribe {
+	uint32_t type;
+	uint32_t streams;
+};
+
+struct ShareRelease {
+	uint32_t type;
+	uint32_t stream;
+	uint32_t buffer;
+};
+
+/* The maximum number of file descriptors in one SCM_RIGHTS message. */
+constexpr unsigned int kMaxFds = 253;
+
+/* The maximum number of streams, bounded by the subscription mask. */
+constexpr unsigned int kMaxStreams = 32;
+
+template<typename T>
+void appendPOD(std::vector<uint8_t> &data, const T &value)
+{
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(value));
+}
+
+template<typename T>
+bool readPOD(const std::vector<uint8_t> &data, size_t offset, T *value)
+{
+	if (offset + sizeof(*value) > data.size())
+		return false;
+
+	memcpy(value, data.data() + offset, sizeof(*value));
+	return true;
+}
+
+int fillAddress(const std::string &path, struct sockaddr_un *addr)
+{
+	if (path.size() >= sizeof(addr->sun_path))
+		return -ENAMETOOLONG;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path, path.c_str(), path.size());
+
+	return 0;
+}
+
+} /* namespace */
+
+/**
+ * \class CameraShareServer
+ * \brief Share a camera with other processes
+ *
+ * Only one process can acquire a camera. The CameraShareServer class lets the
+ * process that owns the camera distribute its frames to other processes, the
+ * clients, which connect to a Unix socket with the CameraShareClient class.
+ *
+ * The server allocates the buffers of all configured streams, creates one
+ * request per buffer index and keeps the camera running. When a client
+ * connects, the server creates an IPCUnixSocket channel for it, passes the
+ * channel to the client over the connection, and sends the configuration of
+ * all streams along with the dmabuf file descriptors of their buffers. The
+ * connection itself is kept open to detect when either side goes away.
+ *
+ * Clients then subscribe to the streams they are interested in. Every
+ * completed buffer is announced to the subscribed clients by index, along with
+ * the request metadata serialized with a ControlSerializer. Frames are never
+ * copied, clients access the buffers through the file descriptors imported
+ * when connecting.
+ *
+ * A buffer is referenced by every client it has been sent to, until the client
+ * releases it. The request is queued back to the camera once all its buffers
+ * have been released by all clients, or immediately if no client is
+ * subscribed. To keep the camera running when a client is slow, buffers are
+ * not sent to a client that already holds all but one of the buffers of a
+ * stream, the client then misses frames. The buffers held by a client are
+ * released when it disconnects.
+ *
+ * The server is bound to the thread it is created in, which must run an event
+ * loop.
+ */
+
+struct CameraShareServer::Client {
+	UniqueFD control;
+	std::unique_ptr<EventNotifier> controlNotifier;
+	IPCUnixSocket socket;
+	ControlSerializer serializer{ ControlSerializer::Role::Proxy };
+
+	uint32_t subscriptions = 0;
+	std::set<std::pair<unsigned int, unsigned int>> held;
+
+	unsigned int heldBuffers(unsigned int stream) const
+	{
+		return std::count_if(held.begin(), held.end(),
+				     [stream](const auto &buffer) {
+					     return buffer.first == stream;
+				     });
+	}
+};
+
+/**
+ * \brief Construct a CameraShareServer for \a camera
+ * \param[in] camera The camera to share
+ */
+CameraShareServer::CameraShareServer(std::shared_ptr<Camera> camera)
+	: camera_(std::move(camera)), running_(false)
+{
+}
+
+CameraShareServer::~CameraShareServer()
+{
+	stop();
+}
+
+/**
+ * \brief Start sharing the camera
+ * \param[in] path The path of the Unix socket clients connect to
+ * \param[in] config The configuration the camera has been configured with
+ *
+ * The camera shall have been acquired and configured with \a config by the
+ * caller. This function allocates the buffers of all streams, starts the
+ * camera and listens for client connections on \a path. An existing socket at
+ * \a path is replaced.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraShareServer::start(const std::string &path,
+			     const CameraConfiguration *config)
+{
+	if (running_)
+		return -EBUSY;
+
+	if (!config || config->empty() || config->size() > kMaxStreams)
+		return -EINVAL;
+
+	allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+
+	unsigned int numRequests = UINT_MAX;
+	for (const StreamConfiguration &cfg : *config) {
+		Stream *stream = cfg.stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0) {
+			LOG(CameraShare, Error)
+				<< "Failed to allocate buffers: " << strerror(-ret);
+			stop();
+			return ret;
+		}
+
+		const auto &buffers = allocator_->buffers(stream);
+		unsigned int numFds = 0;
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers)
+			numFds += buffer->planes().size();
+
+		if (buffers.front()->planes().size() > kMaxPlanes ||
+		    numFds > kMaxFds) {
+			LOG(CameraShare, Error)
+				<< "Too many planes or buffers for stream "
+				<< streams_.size();
+			stop();
+			return -EINVAL;
+		}
+
+		streams_.push_back(stream);
+		numRequests = std::min<unsigned int>(numRequests, ret);
+	}
+
+	for (unsigned int i = 0; i < numRequests; i++) {
+		std::unique_ptr<Request> request = camera_->createRequest(i);
+		if (!request) {
+			stop();
+			return -ENOMEM;
+		}
+
+		for (Stream *stream : streams_) {
+			int ret = request->addBuffer(stream,
+						     allocator_->buffers(stream)[i].get());
+			if (ret < 0) {
+				stop();
+				return ret;
+			}
+		}
+
+		requests_.push_back(std::move(request));
+	}
+
+	references_.assign(numRequests, 0);
+
+	int ret = listen(path);
+	if (ret < 0) {
+		stop();
+		return ret;
+	}
+
+	camera_->requestCompleted.connect(this, &CameraShareServer::requestComplete);
+
+	ret = camera_->start();
+	if (ret < 0) {
+		LOG(CameraShare, Error)
+			<< "Failed to start camera: " << strerror(-ret);
+		stop();
+		return ret;
+	}
+
+	running_ = true;
+
+	for (std::unique_ptr<Request> &request : requests_) {
+		ret = camera_->queueRequest(request.get());
+		if (ret < 0) {
+			LOG(CameraShare, Error)
+				<< "Failed to queue request: " << strerror(-ret);
+			stop();
+			return ret;
+		}
+	}
+
+	LOG(CameraShare, Info)
+		<< "Sharing camera " << camera_->id() << " with "
+		<< streams_.size() << " streams on " << path_;
+
+	return 0;
+}
+
+/**
+ * \brief Stop sharing the camera
+ *
+ * Disconnect all clients, stop the camera and free the buffers. Clients keep
+ * access to the buffers they have imported until they close them.
+ */
+void CameraShareServer::stop()
+{
+	bool running = running_;
+	running_ = false;
+
+	while (!clients_.empty())
+		removeClient(clients_.front().get());
+
+	if (running) {
+		camera_->stop();
+
+		/*
+		 * Deliver the completion of the cancelled requests before
+		 * freeing them.
+		 */
+		Thread::current()->dispatchMessages(Message::Type::InvokeMessage);
+	}
+
+	camera_->requestCompleted.disconnect(this);
+
+	listenNotifier_.reset();
+	if (listenFd_.isValid()) {
+		listenFd_.reset();
+		unlink(path_.c_str());
+	}
+
+	requests_.clear();
+	references_.clear();
+	streams_.clear();
+	allocator_.reset();
+}
+
+/**
+ * \fn CameraShareServer::isRunning()
+ * \brief Check if the server is sharing the camera
+ * \return True if the server has been started, false otherwise
+ */
+
+/**
+ * \fn CameraShareServer::clients()
+ * \brief Retrieve the number of connected clients
+ * \return The number of connected clients
+ */
+
+int CameraShareServer::listen(const std::string &path)
+{
+	struct sockaddr_un addr;
+	int ret = fillAddress(path, &addr);
+	if (ret < 0)
+		return ret;
+
+	UniqueFD fd(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+	if (!fd.isValid()) {
+		ret = -errno;
+		LOG(CameraShare, Error)
+			<< "Failed to create socket: " << strerror(-ret);
+		return ret;
+	}
+
+	unlink(path.c_str());
+
+	if (::bind(fd.get(), reinterpret_cast<struct sockaddr *>(&addr),
+		   sizeof(addr)) < 0 ||
+	    ::listen(fd.get(), 8) < 0) {
+		ret = -errno;
+		LOG(CameraShare, Error)
+			<< "Failed to listen on " << path << ": " << strerror(-ret);
+		return ret;
+	}
+
+	path_ = path;
+	listenFd_ = std::move(fd);
+	listenNotifier_ = std::make_unique<EventNotifier>(listenFd_.get(),
+							  EventNotifier::Read);
+	listenNotifier_->activated.connect(this, &CameraShareServer::newConnection);
+
+	return 0;
+}
+
+void CameraShareServer::newConnection()
+{
+	UniqueFD fd(accept4(listenFd_.get(), nullptr, nullptr,
+			    SOCK_NONBLOCK | SOCK_CLOEXEC));
+	if (!fd.isValid()) {
+		LOG(CameraShare, Warning)
+			<< "Failed to accept connection: " << strerror(errno);
+		return;
+	}
+
+	std::unique_ptr<Client> client = std::make_unique<Client>();
+	Client *c = client.get();
+
+	client->control = std::move(fd);
+
+	UniqueFD remote = client->socket.create();
+	if (!remote.isValid())
+		return;
+
+	/* Pass the IPC channel to the client over the connection. */
+	char byte = 0;
+	struct iovec iov = { &byte, sizeof(byte) };
+	std::array<uint8_t, CMSG_SPACE(sizeof(int))> buf = {};
+
+	struct msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf.data();
+	msg.msg_controllen = buf.size();
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	int remoteFd = remote.get();
+	memcpy(CMSG_DATA(cmsg), &remoteFd, sizeof(remoteFd));
+
+	if (sendmsg(client->control.get(), &msg, MSG_NOSIGNAL) < 0) {
+		LOG(CameraShare, Warning)
+			<< "Failed to pass channel to client: " << strerror(errno);
+		return;
+	}
+
+	client->controlNotifier =
+		std::make_unique<EventNotifier>(client->control.get(),
+						EventNotifier::Read);
+	client->controlNotifier->activated.connect(this, [this, c]() {
+		clientHangup(c);
+	});
+	client->socket.readyRead.connect(this, [this, c]() {
+		clientMessage(c);
+	});
+
+	int ret = sendStreams(c);
+	if (ret < 0) {
+		LOG(CameraShare, Warning)
+			<< "Failed to send streams to client: " << strerror(-ret);
+		return;
+	}
+
+	clients_.push_back(std::move(client));
+
+	LOG(CameraShare, Debug) << clients_.size() << " clients connected";
+}
+
+int CameraShareServer::sendStreams(Client *client)
+{
+	for (unsigned int i = 0; i < streams_.size(); i++) {
+		const Stream *stream = streams_[i];
+		const StreamConfiguration &cfg = stream->configuration();
+		const auto &buffers = allocator_->buffers(const_cast<Stream *>(stream));
+
+		ShareStream header = {};
+		header.type = ShareMessageStream;
+		header.index = i;
+		header.count = streams_.size();
+		header.fourcc = cfg.pixelFormat.fourcc();
+		header.modifier = cfg.pixelFormat.modifier();
+		header.width = cfg.size.width;
+		header.height = cfg.size.height;
+		header.stride = cfg.stride;
+		header.frameSize = cfg.frameSize;
+		header.numBuffers = requests_.size();
+		header.numPlanes = buffers.front()->planes().size();
+
+		IPCUnixSocket::Payload payload;
+		appendPOD(payload.data, header);
+
+		for (unsigned int j = 0; j < header.numBuffers; j++) {
+			const std::vector<FrameBuffer::Plane> &planes =
+				buffers[j]->planes();
+			if (planes.size() != header.numPlanes)
+				return -EINVAL;
+
+			unsigned int first = payload.fds.size();
+
+			for (const FrameBuffer::Plane &plane : planes) {
+				auto it = std::find(payload.fds.begin() + first,
+						    payload.fds.end(), plane.fd.get());
+				if (it == payload.fds.end())
+					it = payload.fds.insert(it, plane.fd.get());
+
+				uint32_t fd = it - payload.fds.begin();
+				appendPOD(payload.data, SharePlane{ fd, plane.offset, plane.length });
+			}
+		}
+
+		int ret = client->socket.send(payload);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+void CameraShareServer::clientMessage(Client *client)
+{
+	IPCUnixSocket::Payload payload;
+	int ret = client->socket.receive(&payload);
+	if (ret < 0)
+		return;
+
+	/* Clients aren't expected to send file descriptors. */
+	for (int32_t fd : payload.fds)
+		close(fd);
+
+	uint32_t type;
+	if (!readPOD(payload.data, 0, &type))
+		return;
+
+	switch (type) {
+	case ShareMessageSubscribe: {
+		ShareSubscribe subscribe;
+		if (!readPOD(payload.data, 0, &subscribe))
+			break;
+
+		client->subscriptions = subscribe.streams;
+		break;
+	}
+
+	case ShareMessageRelease: {
+		ShareRelease release;
+		if (!readPOD(payload.data, 0, &release))
+			break;
+
+		releaseBuffer(client, release.stream, release.buffer);
+		break;
+	}
+
+	default:
+		LOG(CameraShare, Warning)
+			<< "Unknown message " << type << " from client";
+		break;
+	}
+}
+
+void CameraShareServer::clientHangup(Client *client)
+{
+	char byte;
+	ssize_t ret = recv(client->control.get(), &byte, sizeof(byte), 0);
+	if (ret < 0 && errno == EAGAIN)
+		return;
+
+	/* The event notifier can't be destroyed from its own signal handler. */
+	client->controlNotifier->setEnabled(false);
+	client->controlNotifier.release()->deleteLater();
+
+	removeClient(client);
+}
+
+void CameraShareServer::removeClient(Client *client)
+{
+	auto it = std::find_if(clients_.begin(), clients_.end(),
+			       [client](const std::unique_ptr<Client> &c) {
+				       return c.get() == client;
+			       });
+
+	/* Release all the buffers held by the client. */
+	while (!client->held.empty()) {
+		auto [stream, index] = *client->held.begin();
+		releaseBuffer(client, stream, index);
+	}
+
+	clients_.erase(it);
+
+	LOG(CameraShare, Debug) << clients_.size() << " clients connected";
+}
+
+void CameraShareServer::requestComplete(Request *request)
+{
+	if (!running_ || request->status() == Request::RequestCancelled)
+		return;
+
+	unsigned int index = request->cookie();
+
+	for (unsigned int i = 0; i < streams_.size(); i++) {
+		FrameBuffer *buffer = request->findBuffer(streams_[i]);
+		const FrameMetadata &metadata = buffer->metadata();
+
+		for (std::unique_ptr<Client> &client : clients_) {
+			if (!(client->subscriptions & (1U << i)))
+				continue;
+
+			/* Skip slow clients to keep the camera running. */
+			if (client->heldBuffers(i) + 1 >= requests_.size())
+				continue;
+
+			ShareFrame frame = {};
+			frame.type = ShareMessageFrame;
+			frame.stream = i;
+			frame.buffer = index;
+			frame.status = metadata.status;
+			frame.sequence = metadata.sequence;
+			frame.timestamp = metadata.timestamp;
+			frame.numPlanes = std::min<size_t>(metadata.planes().size(), kMaxPlanes);
+			for (unsigned int j = 0; j < frame.numPlanes; j++)
+				frame.bytesused[j] = metadata.planes()[j].bytesused;
+
+			std::vector<uint8_t> data(client->serializer.binarySize(request->metadata()));
+			ByteStreamBuffer stream(data.data(), data.size());
+			if (client->serializer.serialize(request->metadata(), stream) < 0)
+				data.clear();
+
+			frame.metadataSize = data.size();
+
+			if (client->socket.send({ { reinterpret_cast<const uint8_t *>(&frame), sizeof(frame) },
+						  data },
+						{}) < 0)
+				continue;
+
+			client->held.emplace(i, index);
+			references_[index]++;
+		}
+	}
+
+	if (!references_[index]) {
+		request->reuse(Request::ReuseBuffers);
+		camera_->queueRequest(request);
+	}
+}
+
+void CameraShareServer::releaseBuffer(Client *client, unsigned int stream,
+				      unsigned int index)
+{
+	/* Ignore buffers that the client doesn't hold. */
+	if (!client->held.erase({ stream, index }))
+		return;
+
+	if (--references_[index] || !running_)
+		return;
+
+	Request *request = requests_[index].get();
+	request->reuse(Request::ReuseBuffers);
+	camera_->queueRequest(request);
+}
+
+/**
+ * \class CameraShareClient
+ * \brief Receive frames from a camera shared by another process
+ *
+ * The CameraShareClient class connects to a CameraShareServer through its Unix
+ * socket. Once connected, the configuration and buffers of all the streams of
+ * the shared camera are received, and the \ref streamsReady signal is emitted.
+ * The buffers can then be mapped by the client.
+ *
+ * After subscribing to streams with subscribe(), the \ref frameReady signal is
+ * emitted for every frame of those streams, with the buffer and the request
+ * metadata. The buffer metadata is updated before the signal is emitted. The
+ * buffer shall be released with release() once the client is done with it, as
+ * the server doesn't reuse buffers held by clients.
+ *
+ * The client is bound to the thread it is created in, which must run an event
+ * loop.
+ */
+
+/**
+ * \struct CameraShareClient::StreamInfo
+ * \brief A stream of the shared camera
+ *
+ * \var CameraShareClient::StreamInfo::configuration
+ * \brief The stream configuration
+ *
+ * \var CameraShareClient::StreamInfo::buffers
+ * \brief The stream buffers, imported from the server
+ */
+
+/**
+ * \var CameraShareClient::streamsReady
+ * \brief Signal emitted when the configuration of all streams has been received
+ */
+
+/**
+ * \var CameraShareClient::frameReady
+ * \brief Signal emitted when a frame has been received
+ *
+ * The signal carries the stream index, the buffer and the request metadata.
+ */
+
+/**
+ * \var CameraShareClient::disconnected
+ * \brief Signal emitted when the connection to the server is lost
+ */
+
+CameraShareClient::CameraShareClient()
+	: serializer_(ControlSerializer::Role::Worker), numStreams_(0)
+{
+}
+
+CameraShareClient::~CameraShareClient()
+{
+	disconnect();
+}
+
+/**
+ * \brief Connect to a camera share server
+ * \param[in] path The path of the server Unix socket
+ *
+ * The connection completes asynchronously, the \ref streamsReady signal is
+ * emitted once the streams of the shared camera have been received.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraShareClient::connect(const std::string &path)
+{
+	if (isConnected())
+		return -EBUSY;
+
+	struct sockaddr_un addr;
+	int ret = fillAddress(path, &addr);
+	if (ret < 0)
+		return ret;
+
+	UniqueFD fd(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+	if (!fd.isValid())
+		return -errno;
+
+	if (::connect(fd.get(), reinterpret_cast<struct sockaddr *>(&addr),
+		      sizeof(addr)) < 0) {
+		ret = -errno;
+		LOG(CameraShare, Error)
+			<< "Failed to connect to " << path << ": " << strerror(-ret);
+		return ret;
+	}
+
+	control_ = std::move(fd);
+	controlNotifier_ = std::make_unique<EventNotifier>(control_.get(),
+							   EventNotifier::Read);
+	controlNotifier_->activated.connect(this, &CameraShareClient::controlReady);
+
+	return 0;
+}
+
+/**
+ * \brief Disconnect from the server
+ *
+ * The buffers held by the client are released by the server. The buffers of
+ * the streams are freed.
+ */
+void CameraShareClient::disconnect()
+{
+	controlNotifier_.reset();
+	control_.reset();
+	socket_.reset();
+	serializer_.reset();
+
+	numStreams_ = 0;
+	streams_.clear();
+}
+
+/**
+ * \fn CameraShareClient::isConnected()
+ * \brief Check if the client is connected to a server
+ * \return True if the client is connected, false otherwise
+ */
+
+/**
+ * \fn CameraShareClient::streams()
+ * \brief Retrieve the streams of the shared camera
+ *
+ * The streams are available once the \ref streamsReady signal has been
+ * emitted.
+ *
+ * \return The streams of the shared camera
+ */
+
+/**
+ * \brief Select the streams to receive frames for
+ * \param[in] streams The indices of the streams to subscribe to
+ *
+ * Replace the current subscriptions with \a streams. An empty list stops the
+ * reception of frames.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraShareClient::subscribe(const std::vector<unsigned int> &streams)
+{
+	if (!socket_ || streams_.size() != numStreams_)
+		return -ENOTCONN;
+
+	ShareSubscribe subscribe = {};
+	subscribe.type = ShareMessageSubscribe;
+
+	for (unsigned int stream : streams) {
+		if (stream >= streams_.size())
+			return -EINVAL;
+
+		subscribe.streams |= 1U << stream;
+	}
+
+	IPCUnixSocket::Payload payload;
+	appendPOD(payload.data, subscribe);
+
+	return socket_->send(payload);
+}
+
+/**
+ * \brief Release a buffer received through the frameReady signal
+ * \param[in] stream The stream index
+ * \param[in] buffer The buffer to release
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraShareClient::release(unsigned int stream, FrameBuffer *buffer)
+{
+	if (!socket_)
+		return -ENOTCONN;
+
+	if (stream >= streams_.size())
+		return -EINVAL;
+
+	const auto &buffers = streams_[stream].buffers;
+	auto it = std::find_if(buffers.begin(), buffers.end(),
+			       [buffer](const std::unique_ptr<FrameBuffer> &b) {
+				       return b.get() == buffer;
+			       });
+	if (it == buffers.end())
+		return -EINVAL;
+
+	ShareRelease release = {};
+	release.type = ShareMessageRelease;
+	release.stream = stream;
+	release.buffer = it - buffers.begin();
+
+	/* Releases are not urgent, batch them with the other messages. */
+	return socket_->sendBatched({ { reinterpret_cast<const uint8_t *>(&release),
+					sizeof(release) } },
+				    {});
+}
+
+void CameraShareClient::message()
+{
+	IPCUnixSocket::Payload payload;
+	if (socket_->receive(&payload) < 0)
+		return;
+
+	std::vector<SharedFD> fds;
+	for (int32_t &fd : payload.fds)
+		fds.emplace_back(std::move(fd));
+
+	uint32_t type;
+	if (!readPOD(payload.data, 0, &type))
+		return;
+
+	if (type == ShareMessageStream) {
+		ShareStream header;
+		if (!readPOD(payload.data, 0, &header) ||
+		    header.index != streams_.size() || header.count > kMaxStreams ||
+		    fds.size() > header.numBuffers * header.numPlanes ||
+		    header.numPlanes > kMaxPlanes) {
+			LOG(CameraShare, Error) << "Invalid stream message";
+			return;
+		}
+
+		StreamInfo info;
+		info.configuration.pixelFormat = PixelFormat(header.fourcc, header.modifier);
+		info.configuration.size = Size(header.width, header.height);
+		info.configuration.stride = header.stride;
+		info.configuration.frameSize = header.frameSize;
+		info.configuration.bufferCount = header.numBuffers;
+
+		size_t offset = sizeof(header);
+		for (unsigned int i = 0; i < header.numBuffers; i++) {
+			std::vector<FrameBuffer::Plane> planes(header.numPlanes);
+
+			for (FrameBuffer::Plane &plane : planes) {
+				SharePlane p;
+				if (!readPOD(payload.data, offset, &p) ||
+				    p.fd >= fds.size()) {
+					LOG(CameraShare, Error) << "Invalid stream message";
+					return;
+				}
+
+				plane.fd = fds[p.fd];
+				plane.offset = p.offset;
+				plane.length = p.length;
+				offset += sizeof(p);
+			}
+
+			info.buffers.push_back(std::make_unique<FrameBuffer>(planes));
+		}
+
+		numStreams_ = header.count;
+		streams_.push_back(std::move(info));
+
+		if (streams_.size() == numStreams_)
+			streamsReady.emit();
+
+		return;
+	}
+
+	if (type != ShareMessageFrame)
+		return;
+
+	ShareFrame frame;
+	if (!readPOD(payload.data, 0, &frame) ||
+	    frame.stream >= streams_.size() ||
+	    frame.buffer >= streams_[frame.stream].buffers.size() ||
+	    sizeof(frame) + frame.metadataSize > payload.data.size()) {
+		LOG(CameraShare, Error) << "Invalid frame message";
+		return;
+	}
+
+	FrameBuffer *buffer = streams_[frame.stream].buffers[frame.buffer].get();
+	FrameMetadata &metadata = buffer->_d()->metadata();
+	metadata.status = static_cast<FrameMetadata::Status>(frame.status);
+	metadata.sequence = frame.sequence;
+	metadata.timestamp = frame.timestamp;
+
+	Span<FrameMetadata::Plane> planes = metadata.planes();
+	for (unsigned int i = 0; i < std::min<size_t>(planes.size(), frame.numPlanes); i++)
+		planes[i].bytesused = frame.bytesused[i];
+
+	ControlList list;
+	if (frame.metadataSize) {
+		ByteStreamBuffer data(payload.data.data() + sizeof(frame),
+				      frame.metadataSize);
+		list = serializer_.deserialize<ControlList>(data);
+	}
+
+	frameReady.emit(frame.stream, buffer, list);
+}
+
+void CameraShareClient::controlReady()
+{
+	char byte;
+	struct iovec iov = { &byte, sizeof(byte) };
+	std::array<uint8_t, CMSG_SPACE(sizeof(int))> buf = {};
+
+	struct msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf.data();
+	msg.msg_controllen = buf.size();
+
+	ssize_t ret = recvmsg(control_.get(), &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (ret < 0 && errno == EAGAIN)
+		return;
+
+	/*
+	 * The server sends the IPC channel as the only message on the
+	 * connection. Anything else means the connection has been closed.
+	 */
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (ret > 0 && !socket_ && cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+	    cmsg->cmsg_type == SCM_RIGHTS &&
+	    cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+		int fd;
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+		socket_ = std::make_unique<IPCUnixSocket>();
+		socket_->bind(UniqueFD(fd));
+		socket_->readyRead.connect(this, &CameraShareClient::message);
+		return;
+	}
+
+	LOG(CameraShare, Info) << "Disconnected from server";
+
+	/* The event notifier can't be destroyed from its own signal handler. */
+	controlNotifier_->setEnabled(false);
+	controlNotifier_.release()->deleteLater();
+
+	disconnect();
+	disconnected.emit();
+}
+
+} /* namespace libcamera */
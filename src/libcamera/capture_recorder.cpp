@@ -0,0 +1,401 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Capture session recording and replay
+ */
+
+#include "libcamera/internal/capture_recorder.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+#include <libcamera/controls.h>
+
+/**
+ * \file capture_recorder.h
+ * \brief Record the IPA inputs of capture sessions for later replay
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CaptureRecorder)
+
+namespace {
+
+constexpr uint32_t kRecordingMagic = 0x4352434c; /* "LCRC" */
+constexpr uint32_t kRecordingVersion = 1;
+
+struct RecordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pipeLength;
+};
+
+struct ChunkHeader {
+	uint32_t type;
+	uint32_t frame;
+	uint64_t timestamp;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+struct ControlHeader {
+	uint32_t id;
+	uint32_t type;
+	uint32_t isArray;
+	uint32_t numElements;
+	uint32_t size;
+};
+
+template<typename T>
+Span<const uint8_t> asBytes(const T &data)
+{
+	return { reinterpret_cast<const uint8_t *>(&data), sizeof(data) };
+}
+
+template<typename T>
+Span<uint8_t> asBytes(T &data)
+{
+	return { reinterpret_cast<uint8_t *>(&data), sizeof(data) };
+}
+
+} /* namespace */
+
+/**
+ * \struct CaptureChunk
+ * \brief A unit of data in a capture recording
+ *
+ * Capture recordings store the inputs of the IPA module of a camera during a
+ * capture session as a sequence of chunks, in the order in which the pipeline
+ * handler passed them to the IPA module. The content of the Init and Configure
+ * chunks is specific to the pipeline handler, the content of the other chunk
+ * types is common to all pipeline handlers.
+ */
+
+/**
+ * \enum CaptureChunk::Type
+ * \brief The type of the chunk data
+ * \var CaptureChunk::Type::Init
+ * \brief The IPA module initialization parameters
+ * \var CaptureChunk::Type::Configure
+ * \brief The IPA module configuration parameters
+ * \var CaptureChunk::Type::Request
+ * \brief The controls of a request, encoded with encodeControls()
+ * \var CaptureChunk::Type::Statistics
+ * \brief The content of a hardware statistics buffer
+ * \var CaptureChunk::Type::SensorControls
+ * \brief The sensor controls applied to a frame, encoded with
+ * encodeControls()
+ */
+
+/**
+ * \var CaptureChunk::type
+ * \brief The chunk type
+ *
+ * \var CaptureChunk::frame
+ * \brief The frame number the pipeline handler passed to the IPA module
+ *
+ * \var CaptureChunk::timestamp
+ * \brief The timestamp of the frame in nanoseconds, or 0 if not known
+ *
+ * \var CaptureChunk::data
+ * \brief The chunk data
+ */
+
+/**
+ * \brief Encode a list of controls in a self-contained binary format
+ * \param[in] controls The control list
+ *
+ * Unlike the ControlSerializer, the encoding doesn't reference a ControlInfoMap
+ * and can be decoded independently of the other chunks of a recording.
+ *
+ * \return The encoded controls
+ */
+std::vector<uint8_t> CaptureChunk::encodeControls(const ControlList &controls)
+{
+	std::vector<uint8_t> data;
+
+	uint32_t count = controls.size();
+	Span<const uint8_t> bytes = asBytes(count);
+	data.insert(data.end(), bytes.begin(), bytes.end());
+
+	for (const auto &[id, value] : controls) {
+		Span<const uint8_t> values = value.data();
+
+		ControlHeader header;
+		header.id = id;
+		header.type = value.type();
+		header.isArray = value.isArray();
+		header.numElements = value.numElements();
+		header.size = values.size();
+
+		bytes = asBytes(header);
+		data.insert(data.end(), bytes.begin(), bytes.end());
+		data.insert(data.end(), values.begin(), values.end());
+	}
+
+	return data;
+}
+
+/**
+ * \brief Decode a list of controls encoded with encodeControls()
+ * \param[in] data The encoded controls
+ * \param[inout] controls The control list to add the controls to
+ *
+ * \return 0 on success or a negative error code if the data is invalid
+ */
+int CaptureChunk::decodeControls(Span<const uint8_t> data, ControlList *controls)
+{
+	uint32_t count;
+	if (data.size() < sizeof(count))
+		return -EINVAL;
+
+	memcpy(&count, data.data(), sizeof(count));
+	data = data.subspan(sizeof(count));
+
+	for (uint32_t i = 0; i < count; i++) {
+		ControlHeader header;
+		if (data.size() < sizeof(header))
+			return -EINVAL;
+
+		memcpy(&header, data.data(), sizeof(header));
+		data = data.subspan(sizeof(header));
+
+		if (header.type > ControlTypeSize || data.size() < header.size)
+			return -EINVAL;
+
+		ControlValue value;
+		value.reserve(static_cast<ControlType>(header.type),
+			      header.isArray, header.numElements);
+		if (value.data().size() != header.size)
+			return -EINVAL;
+
+		memcpy(value.data().data(), data.data(), header.size);
+		data = data.subspan(header.size);
+
+		controls->set(header.id, value);
+	}
+
+	return 0;
+}
+
+/**
+ * \class CaptureRecorder
+ * \brief Record the IPA inputs of capture sessions to files
+ *
+ * To benchmark and regression-test IPA modules without camera sensors,
+ * pipeline handlers can record the data they pass to their IPA module during
+ * capture sessions: the initialization and configuration parameters, the
+ * request controls, the hardware statistics and the sensor controls applied
+ * to each frame. The recordings can then be replayed to the same IPA module
+ * with the CaptureRecording class.
+ *
+ * Recording is enabled by setting the LIBCAMERA_RECORD environment variable to
+ * the path of an existing directory. Each capture session, from open() to
+ * close(), is recorded to a new file in that directory. Chunks are written
+ * synchronously, recording is thus meant for data collection only, and may
+ * affect the timings of the capture session.
+ */
+
+/**
+ * \brief Construct a CaptureRecorder
+ * \param[in] pipe The pipeline handler name, used to name the recordings
+ */
+CaptureRecorder::CaptureRecorder(const std::string &pipe)
+	: pipe_(pipe), sessions_(0)
+{
+	const char *directory = utils::secure_getenv("LIBCAMERA_RECORD");
+	if (directory && directory[0] != '\0')
+		directory_ = directory;
+}
+
+/**
+ * \fn CaptureRecorder::isEnabled()
+ * \brief Check if recording has been enabled through the environment
+ * \return True if recording is enabled, false otherwise
+ */
+
+/**
+ * \fn CaptureRecorder::isOpen()
+ * \brief Check if a recording is in progress
+ * \return True if a recording is in progress, false otherwise
+ */
+
+/**
+ * \brief Start recording a capture session to a new file
+ *
+ * Any recording in progress is closed first. This function does nothing if
+ * recording isn't enabled.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CaptureRecorder::open()
+{
+	close();
+
+	if (!isEnabled())
+		return 0;
+
+	std::string name;
+	do {
+		name = directory_ + "/" + pipe_ + "-" + std::to_string(getpid()) +
+		       "-" + std::to_string(sessions_++) + ".rec";
+	} while (File::exists(name));
+
+	file_.setFileName(name);
+	if (!file_.open(File::OpenModeFlag::WriteOnly)) {
+		int ret = file_.error();
+		LOG(CaptureRecorder, Error)
+			<< "Failed to create recording '" << name << "': "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	RecordingHeader header;
+	header.magic = kRecordingMagic;
+	header.version = kRecordingVersion;
+	header.pipeLength = pipe_.size();
+
+	Span<const uint8_t> pipe{ reinterpret_cast<const uint8_t *>(pipe_.data()),
+				  pipe_.size() };
+	if (file_.write(asBytes(header)) != sizeof(header) ||
+	    file_.write(pipe) != static_cast<ssize_t>(pipe.size())) {
+		LOG(CaptureRecorder, Error)
+			<< "Failed to write recording '" << name << "'";
+		close();
+		return -EIO;
+	}
+
+	LOG(CaptureRecorder, Info) << "Recording to '" << name << "'";
+
+	return 0;
+}
+
+/**
+ * \brief Stop recording the current capture session
+ */
+void CaptureRecorder::close()
+{
+	file_.close();
+}
+
+/**
+ * \brief Write a chunk to the current recording
+ * \param[in] type The chunk type
+ * \param[in] frame The frame number the chunk relates to
+ * \param[in] timestamp The frame timestamp in nanoseconds, or 0 if not known
+ * \param[in] data The chunk data
+ *
+ * This function does nothing if no recording is in progress. The recording is
+ * closed if the chunk can't be written.
+ */
+void CaptureRecorder::write(CaptureChunk::Type type, uint32_t frame,
+			    uint64_t timestamp, Span<const uint8_t> data)
+{
+	if (!isOpen())
+		return;
+
+	ChunkHeader header;
+	header.type = static_cast<uint32_t>(type);
+	header.frame = frame;
+	header.timestamp = timestamp;
+	header.size = data.size();
+	header.reserved = 0;
+
+	if (file_.write(asBytes(header)) != sizeof(header) ||
+	    file_.write(data) != static_cast<ssize_t>(data.size())) {
+		LOG(CaptureRecorder, Error)
+			<< "Failed to write recording '" << file_.fileName()
+			<< "', stopping";
+		close();
+	}
+}
+
+/**
+ * \class CaptureRecording
+ * \brief Read a capture recording written by the CaptureRecorder
+ */
+
+/**
+ * \brief Construct a CaptureRecording for the file at \a path
+ * \param[in] path The path to the recording
+ */
+CaptureRecording::CaptureRecording(const std::string &path)
+	: file_(path)
+{
+}
+
+/**
+ * \brief Open the recording and read its header
+ * \return 0 on success or a negative error code otherwise
+ */
+int CaptureRecording::open()
+{
+	if (!file_.open(File::OpenModeFlag::ReadOnly))
+		return file_.error();
+
+	RecordingHeader header;
+	if (file_.read(asBytes(header)) != sizeof(header) ||
+	    header.magic != kRecordingMagic) {
+		LOG(CaptureRecorder, Error)
+			<< "'" << file_.fileName() << "' is not a capture recording";
+		return -EINVAL;
+	}
+
+	if (header.version != kRecordingVersion) {
+		LOG(CaptureRecorder, Error)
+			<< "Unsupported capture recording version "
+			<< header.version;
+		return -ENOTSUP;
+	}
+
+	pipe_.resize(header.pipeLength);
+	Span<uint8_t> pipe{ reinterpret_cast<uint8_t *>(pipe_.data()),
+			    pipe_.size() };
+	if (file_.read(pipe) != static_cast<ssize_t>(pipe.size()))
+		return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * \fn CaptureRecording::pipe()
+ * \brief Retrieve the name of the pipeline handler that made the recording
+ * \return The pipeline handler name
+ */
+
+/**
+ * \brief Read the next chunk of the recording
+ * \param[out] chunk The chunk
+ * \return 0 on success, -ENODATA at the end of the recording, or another
+ * negative error code if the recording is truncated or can't be read
+ */
+int CaptureRecording::next(CaptureChunk *chunk)
+{
+	ChunkHeader header;
+	ssize_t ret = file_.read(asBytes(header));
+	if (ret == 0)
+		return -ENODATA;
+	if (ret < 0)
+		return ret;
+	if (ret != sizeof(header))
+		return -EINVAL;
+
+	chunk->type = static_cast<CaptureChunk::Type>(header.type);
+	chunk->frame = header.frame;
+	chunk->timestamp = header.timestamp;
+	chunk->data.resize(header.size);
+
+	ret = file_.read(chunk->data);
+	if (ret < 0)
+		return ret;
+	if (ret != header.size)
+		return -EINVAL;
+
+	return 0;
+}
+
+} /* namespace libcamera */
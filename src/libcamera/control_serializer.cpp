@@ -9,10 +9,12 @@
 
 #include <algorithm>
 #include <memory>
+#include <stdlib.h>
 #include <vector>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/span.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
@@ -31,6 +33,51 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(Serializer)
 
+namespace {
+
+enum ipa_controls_id_map_type idMapTypeOf(const ControlIdMap *idmap)
+{
+	if (idmap == &controls::controls)
+		return IPA_CONTROL_ID_MAP_CONTROLS;
+	else if (idmap == &properties::properties)
+		return IPA_CONTROL_ID_MAP_PROPERTIES;
+	else
+		return IPA_CONTROL_ID_MAP_V4L2;
+}
+
+/*
+ * Call \a func for every control of \a list whose value differs from
+ * \a baseline, and with an empty value for every control of \a baseline not
+ * present in \a list. Both lists are iterated in ascending ID order.
+ */
+template<typename Func>
+void forEachChange(const ControlList &baseline, const ControlList &list,
+		   Func func)
+{
+	static const ControlValue removed;
+
+	auto base = baseline.begin();
+	auto ctrl = list.begin();
+
+	while (base != baseline.end() || ctrl != list.end()) {
+		if (ctrl == list.end() ||
+		    (base != baseline.end() && base->first < ctrl->first)) {
+			func(base->first, removed);
+			++base;
+		} else if (base == baseline.end() || ctrl->first < base->first) {
+			func(ctrl->first, ctrl->second);
+			++ctrl;
+		} else {
+			if (ctrl->second != base->second)
+				func(ctrl->first, ctrl->second);
+			++base;
+			++ctrl;
+		}
+	}
+}
+
+} /* namespace */
+
 /**
  * \class ControlSerializer
  * \brief Serializer and deserializer for control-related classes
@@ -83,6 +130,17 @@ LOG_DEFINE_CATEGORY(Serializer)
  * that time. A reset of the serializer invalidates all ControlList and
  * ControlInfoMap that have been previously deserialized. The caller shall thus
  * proceed with care to avoid stale references.
+ *
+ * Control lists exchanged for every frame, such as metadata, usually differ
+ * little from one frame to the next. To reduce the amount of data transferred,
+ * the serializer can optionally delta-encode ControlList instances with
+ * setDeltaEncoding(). Lists associated with the same ControlInfoMap, or with
+ * the same global ControlIdMap when they have no ControlInfoMap, form a
+ * stream. The serializer keeps the last list of each stream as a baseline, and
+ * only serializes the controls that changed since the baseline, with a full
+ * keyframe sent periodically. Deserialization of delta-encoded lists is always
+ * supported and doesn't need to be enabled. It requires all lists of a stream
+ * to be deserialized, in the order they have been serialized.
  */
 
 /**
@@ -124,6 +182,12 @@ ControlSerializer::ControlSerializer(Role role)
 	 */
 	serialSeed_ = role == Role::Proxy ? 1 : 2;
 	serial_ = serialSeed_;
+
+	keyframeInterval_ = 0;
+
+	const char *interval = utils::secure_getenv("LIBCAMERA_IPA_CONTROLS_DELTA");
+	if (interval)
+		setDeltaEncoding(strtoul(interval, nullptr, 10));
 }
 
 /**
@@ -140,6 +204,30 @@ void ControlSerializer::reset()
 	infoMaps_.clear();
 	controlIds_.clear();
 	controlIdMaps_.clear();
+
+	txStreams_.clear();
+	rxStreams_.clear();
+}
+
+/**
+ * \brief Enable or disable delta encoding of control lists
+ * \param[in] keyframeInterval The number of lists in a stream between
+ * keyframes, or 0 to disable delta encoding
+ *
+ * When delta encoding is enabled, ControlList instances are serialized as
+ * the set of changes relative to the previous list of the same stream. Every
+ * \a keyframeInterval lists, and for the first list of every stream, the full
+ * list is serialized instead. This bounds the number of lists lost if the
+ * serialized data of a list doesn't reach the deserializer.
+ *
+ * Delta encoding is disabled by default, unless the
+ * LIBCAMERA_IPA_CONTROLS_DELTA environment variable is set to the keyframe
+ * interval.
+ */
+void ControlSerializer::setDeltaEncoding(unsigned int keyframeInterval)
+{
+	keyframeInterval_ = keyframeInterval;
+	txStreams_.clear();
 }
 
 size_t ControlSerializer::binarySize(const ControlValue &value)
@@ -177,14 +265,26 @@ size_t ControlSerializer::binarySize(const ControlInfoMap &infoMap)
  * \param[in] list The control list
  *
  * Compute and return the size in bytes required to store the serialized
- * ControlList.
+ * ControlList. When delta encoding is enabled, the size is computed for the
+ * next call to serialize(), and is only valid until then.
  *
  * \return The size in bytes required to store the serialized ControlList
  */
-size_t ControlSerializer::binarySize(const ControlList &list)
+size_t ControlSerializer::binarySize(const ControlList &list) const
 {
-	size_t size = sizeof(struct ipa_controls_header)
-		    + list.size() * sizeof(struct ipa_control_value_entry);
+	size_t size = sizeof(struct ipa_controls_header);
+
+	const ControlList *baseline = deltaBaseline(list);
+	if (baseline) {
+		forEachChange(*baseline, list,
+			      [&](unsigned int, const ControlValue &value) {
+				      size += sizeof(struct ipa_control_value_entry)
+					    + binarySize(value);
+			      });
+		return size;
+	}
+
+	size += list.size() * sizeof(struct ipa_control_value_entry);
 
 	for (const auto &ctrl : list)
 		size += binarySize(ctrl.second);
@@ -192,12 +292,52 @@ size_t ControlSerializer::binarySize(const ControlList &list)
 	return size;
 }
 
+bool ControlSerializer::deltaStreamKey(const ControlList &list,
+				       DeltaStreamKey *key) const
+{
+	if (!keyframeInterval_)
+		return false;
+
+	unsigned int infoMapHandle = 0;
+	if (list.infoMap()) {
+		auto iter = infoMapHandles_.find(list.infoMap());
+		if (iter == infoMapHandles_.end())
+			return false;
+
+		infoMapHandle = iter->second;
+	}
+
+	*key = { infoMapHandle, idMapTypeOf(list.idMap()) };
+	return true;
+}
+
+/*
+ * Retrieve the baseline to delta-encode \a list against, or nullptr if the
+ * list shall be serialized in full.
+ */
+const ControlList *ControlSerializer::deltaBaseline(const ControlList &list) const
+{
+	DeltaStreamKey key;
+	if (!deltaStreamKey(list, &key))
+		return nullptr;
+
+	auto iter = txStreams_.find(key);
+	if (iter == txStreams_.end())
+		return nullptr;
+
+	const DeltaStream &stream = iter->second;
+	if (stream.sinceKeyframe + 1 >= keyframeInterval_)
+		return nullptr;
+
+	return &stream.baseline;
+}
+
 void ControlSerializer::store(const ControlValue &value,
 			      ByteStreamBuffer &buffer)
 {
 	const ControlType type = value.type();
-	buffer.write(&type);
-	buffer.write(value.data());
+	buffer.write({ { reinterpret_cast<const uint8_t *>(&type), sizeof(type) },
+		       value.data() });
 }
 
 void ControlSerializer::store(const ControlInfo &info, ByteStreamBuffer &buffer)
@@ -237,14 +377,7 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
 	for (const auto &ctrl : infoMap)
 		valuesSize += binarySize(ctrl.second);
 
-	const ControlIdMap *idmap = &infoMap.idmap();
-	enum ipa_controls_id_map_type idMapType;
-	if (idmap == &controls::controls)
-		idMapType = IPA_CONTROL_ID_MAP_CONTROLS;
-	else if (idmap == &properties::properties)
-		idMapType = IPA_CONTROL_ID_MAP_PROPERTIES;
-	else
-		idMapType = IPA_CONTROL_ID_MAP_V4L2;
+	enum ipa_controls_id_map_type idMapType = idMapTypeOf(&infoMap.idmap());
 
 	/* Prepare the packet header. */
 	struct ipa_controls_header hdr;
@@ -254,6 +387,9 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
 	hdr.size = sizeof(hdr) + entriesSize + valuesSize;
 	hdr.data_offset = sizeof(hdr) + entriesSize;
 	hdr.id_map_type = idMapType;
+	hdr.flags = 0;
+	hdr.stream = 0;
+	hdr.sequence = 0;
 
 	buffer.write(&hdr);
 
@@ -277,11 +413,15 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
 		const ControlId *id = ctrl.first;
 		const ControlInfo &info = ctrl.second;
 
-		struct ipa_control_info_entry entry;
-		entry.id = id->id();
-		entry.type = id->type();
-		entry.offset = values.offset();
-		entries.write(&entry);
+		struct ipa_control_info_entry *entry =
+			entries.reserve<ipa_control_info_entry>();
+		if (!entry)
+			break;
+
+		*entry = {};
+		entry->id = id->id();
+		entry->type = id->type();
+		entry->offset = values.offset();
 
 		store(info, values);
 	}
@@ -331,28 +471,52 @@ int ControlSerializer::serialize(const ControlList &list,
 		infoMapHandle = 0;
 	}
 
-	const ControlIdMap *idmap = list.idMap();
-	enum ipa_controls_id_map_type idMapType;
-	if (idmap == &controls::controls)
-		idMapType = IPA_CONTROL_ID_MAP_CONTROLS;
-	else if (idmap == &properties::properties)
-		idMapType = IPA_CONTROL_ID_MAP_PROPERTIES;
-	else
-		idMapType = IPA_CONTROL_ID_MAP_V4L2;
+	enum ipa_controls_id_map_type idMapType = idMapTypeOf(list.idMap());
+
+	/*
+	 * Look up the delta stream the list belongs to, creating it if needed,
+	 * and decide whether to serialize a keyframe or a delta.
+	 */
+	DeltaStream *stream = nullptr;
+	const ControlList *baseline = deltaBaseline(list);
+
+	DeltaStreamKey key;
+	if (deltaStreamKey(list, &key)) {
+		auto iter = txStreams_.find(key);
+		if (iter == txStreams_.end()) {
+			uint16_t id = txStreams_.size() + 1;
+			iter = txStreams_.emplace(key, DeltaStream{ id, 0, 0, {} }).first;
+		}
+
+		stream = &iter->second;
+	}
 
-	size_t entriesSize = list.size() * sizeof(struct ipa_control_value_entry);
+	size_t entriesCount = 0;
 	size_t valuesSize = 0;
-	for (const auto &ctrl : list)
-		valuesSize += binarySize(ctrl.second);
+	auto countEntry = [&](unsigned int, const ControlValue &value) {
+		entriesCount++;
+		valuesSize += binarySize(value);
+	};
+
+	if (baseline)
+		forEachChange(*baseline, list, countEntry);
+	else
+		for (const auto &ctrl : list)
+			countEntry(ctrl.first, ctrl.second);
+
+	size_t entriesSize = entriesCount * sizeof(struct ipa_control_value_entry);
 
 	/* Prepare the packet header. */
 	struct ipa_controls_header hdr;
 	hdr.version = IPA_CONTROLS_FORMAT_VERSION;
 	hdr.handle = infoMapHandle;
-	hdr.entries = list.size();
+	hdr.entries = entriesCount;
 	hdr.size = sizeof(hdr) + entriesSize + valuesSize;
 	hdr.data_offset = sizeof(hdr) + entriesSize;
 	hdr.id_map_type = idMapType;
+	hdr.flags = baseline ? IPA_CONTROLS_FLAG_DELTA : 0;
+	hdr.stream = stream ? stream->id : 0;
+	hdr.sequence = stream ? stream->sequence + 1 : 0;
 
 	buffer.write(&hdr);
 
@@ -360,24 +524,37 @@ int ControlSerializer::serialize(const ControlList &list,
 	ByteStreamBuffer values = buffer.carveOut(valuesSize);
 
 	/* Serialize all entries. */
-	for (const auto &ctrl : list) {
-		unsigned int id = ctrl.first;
-		const ControlValue &value = ctrl.second;
-
-		struct ipa_control_value_entry entry;
-		entry.id = id;
-		entry.type = value.type();
-		entry.is_array = value.isArray();
-		entry.count = value.numElements();
-		entry.offset = values.offset();
-		entries.write(&entry);
+	auto storeEntry = [&](unsigned int id, const ControlValue &value) {
+		struct ipa_control_value_entry *entry =
+			entries.reserve<ipa_control_value_entry>();
+		if (!entry)
+			return;
+
+		*entry = {};
+		entry->id = id;
+		entry->type = value.type();
+		entry->is_array = value.isArray();
+		entry->count = value.numElements();
+		entry->offset = values.offset();
 
 		store(value, values);
-	}
+	};
+
+	if (baseline)
+		forEachChange(*baseline, list, storeEntry);
+	else
+		for (const auto &ctrl : list)
+			storeEntry(ctrl.first, ctrl.second);
 
 	if (buffer.overflow())
 		return -ENOSPC;
 
+	if (stream) {
+		stream->sequence = hdr.sequence;
+		stream->sinceKeyframe = baseline ? stream->sinceKeyframe + 1 : 0;
+		stream->baseline = list;
+	}
+
 	return 0;
 }
 
@@ -609,6 +786,26 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 	 */
 	ControlList ctrls(*idMap);
 
+	DeltaStream *stream = nullptr;
+	if (hdr->stream) {
+		auto iter = rxStreams_.find(hdr->stream);
+
+		if (hdr->flags & IPA_CONTROLS_FLAG_DELTA) {
+			if (iter == rxStreams_.end() ||
+			    iter->second.sequence + 1 != hdr->sequence) {
+				LOG(Serializer, Error)
+					<< "Can't deserialize ControlList: missing baseline for stream "
+					<< hdr->stream;
+				return {};
+			}
+		} else if (iter == rxStreams_.end()) {
+			iter = rxStreams_.emplace(hdr->stream,
+						  DeltaStream{ hdr->stream, 0, 0, {} }).first;
+		}
+
+		stream = &iter->second;
+	}
+
 	for (unsigned int i = 0; i < hdr->entries; ++i) {
 		const struct ipa_control_value_entry *entry =
 			entries.read<decltype(*entry)>();
@@ -628,6 +825,38 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 			  loadControlValue(values, entry->is_array, entry->count));
 	}
 
+	if (!stream)
+		return ctrls;
+
+	/* Apply the changes to the baseline to reconstruct delta lists. */
+	if (hdr->flags & IPA_CONTROLS_FLAG_DELTA) {
+		ControlList changes = std::move(ctrls);
+		ctrls = ControlList(*idMap);
+		ctrls.reserve(stream->baseline.size() + changes.size());
+
+		auto base = stream->baseline.begin();
+		auto change = changes.begin();
+
+		while (base != stream->baseline.end() || change != changes.end()) {
+			if (change == changes.end() ||
+			    (base != stream->baseline.end() && base->first < change->first)) {
+				ctrls.set(base->first, base->second);
+				++base;
+				continue;
+			}
+
+			if (base != stream->baseline.end() && base->first == change->first)
+				++base;
+
+			if (!change->second.isNone())
+				ctrls.set(change->first, change->second);
+			++change;
+		}
+	}
+
+	stream->sequence = hdr->sequence;
+	stream->baseline = ctrls;
+
 	return ctrls;
 }
 
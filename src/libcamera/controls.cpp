@@ -7,7 +7,9 @@
 
 #include <libcamera/controls.h>
 
+#include <algorithm>
 #include <iomanip>
+#include <iterator>
 #include <sstream>
 #include <string>
 #include <string.h>
@@ -87,10 +89,16 @@ static constexpr size_t ControlValueSize[] = {
 /**
  * \class ControlValue
  * \brief Abstract type representing the value of a control
+ *
+ * Values up to 56 bytes are stored inline in the ControlValue instance, larger
+ * values are stored in a separately allocated buffer. This covers all scalar
+ * and Rectangle or Size values, as well as short arrays such as colour gains,
+ * frame duration limits or a 3x3 colour correction matrix, without any memory
+ * allocation, and keeps the ControlValue size to a single cache line.
  */
 
 /** \todo Revisit the ControlValue layout when stabilizing the ABI */
-static_assert(sizeof(ControlValue) == 16, "Invalid size of ControlValue class");
+static_assert(sizeof(ControlValue) == 64, "Invalid size of ControlValue class");
 
 /**
  * \brief Construct an empty ControlValue.
@@ -150,6 +158,51 @@ ControlValue &ControlValue::operator=(const ControlValue &other)
 	return *this;
 }
 
+/**
+ * \brief Construct a ControlValue by moving the content of \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The \a other value is left empty.
+ */
+ControlValue::ControlValue(ControlValue &&other) noexcept
+	: type_(other.type_), isArray_(other.isArray_),
+	  numElements_(other.numElements_)
+{
+	memcpy(value_, other.value_, sizeof(value_));
+
+	other.type_ = ControlTypeNone;
+	other.isArray_ = false;
+	other.numElements_ = 0;
+}
+
+/**
+ * \brief Replace the content of the ControlValue by moving the content of
+ * \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The \a other value is left empty.
+ *
+ * \return The ControlValue with its content replaced with the one of \a other
+ */
+ControlValue &ControlValue::operator=(ControlValue &&other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	release();
+
+	type_ = other.type_;
+	isArray_ = other.isArray_;
+	numElements_ = other.numElements_;
+	memcpy(value_, other.value_, sizeof(value_));
+
+	other.type_ = ControlTypeNone;
+	other.isArray_ = false;
+	other.numElements_ = 0;
+
+	return *this;
+}
+
 /**
  * \fn ControlValue::type()
  * \brief Retrieve the data type of the value
@@ -188,7 +241,7 @@ Span<const uint8_t> ControlValue::data() const
 	std::size_t size = numElements_ * ControlValueSize[type_];
 	const uint8_t *data = size > sizeof(value_)
 			    ? reinterpret_cast<const uint8_t *>(storage_)
-			    : reinterpret_cast<const uint8_t *>(&value_);
+			    : value_;
 	return { data, size };
 }
 
@@ -815,6 +868,12 @@ ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
  * Control lists are constructed with a map of all the controls supported by
  * their object, and an optional ControlValidator to further validate the
  * controls.
+ *
+ * Controls are stored in a flat array sorted by numerical ID, and iterating
+ * over a ControlList visits the controls in that order. As lists are small and
+ * usually populated in increasing ID order, this minimizes memory allocations
+ * compared to a node-based container. Adding a control to a list invalidates
+ * iterators and references to the values it contains.
  */
 
 /**
@@ -905,6 +964,18 @@ ControlList::ControlList(const ControlInfoMap &infoMap,
 /**
  * \fn ControlList::clear()
  * \brief Removes all controls from the list
+ *
+ * The memory allocated for the list is kept, to be reused when adding controls
+ * again.
+ */
+
+/**
+ * \fn ControlList::reserve()
+ * \brief Preallocate memory for controls
+ * \param[in] size The number of controls to allocate memory for
+ *
+ * Reserving memory avoids reallocations when the number of controls to be
+ * added to the list is known in advance.
  */
 
 /**
@@ -932,8 +1003,7 @@ ControlList::ControlList(const ControlInfoMap &infoMap,
  * Only control lists created from the same ControlIdMap or ControlInfoMap may
  * be merged. Attempting to do otherwise results in undefined behaviour.
  *
- * \todo Reimplement or implement an overloaded version which internally uses
- * std::unordered_map::merge() and accepts a non-const argument.
+ * As both lists are sorted, merging is performed in linear time.
  */
 void ControlList::merge(const ControlList &source, MergePolicy policy)
 {
@@ -949,16 +1019,48 @@ void ControlList::merge(const ControlList &source, MergePolicy policy)
 	 * See https://bugs.libcamera.org/show_bug.cgi?id=31 for further details
 	 */
 
-	for (const auto &ctrl : source) {
-		if (policy == MergePolicy::KeepExisting && contains(ctrl.first)) {
-			const ControlId *id = idmap_->at(ctrl.first);
+	if (&source == this || source.empty())
+		return;
+
+	ControlListMap merged;
+	merged.reserve(controls_.size() + source.size());
+
+	auto dst = std::make_move_iterator(controls_.begin());
+	auto dstEnd = std::make_move_iterator(controls_.end());
+	auto src = source.begin();
+
+	while (dst != dstEnd || src != source.end()) {
+		if (src == source.end() || (dst != dstEnd && dst->first < src->first)) {
+			merged.push_back(*dst++);
+			continue;
+		}
+
+		if (dst == dstEnd || src->first < dst->first) {
+			if (!validator_ || validator_->validate(src->first))
+				merged.push_back(*src);
+			else
+				LOG(Controls, Error)
+					<< "Control " << utils::hex(src->first)
+					<< " is not valid for " << validator_->name();
+			++src;
+			continue;
+		}
+
+		/* The control is present in both lists. */
+		if (policy == MergePolicy::KeepExisting) {
+			const ControlId *id = idmap_->at(src->first);
 			LOG(Controls, Warning)
 				<< "Control " << id->name() << " not overwritten";
-			continue;
+			merged.push_back(*dst);
+		} else {
+			merged.push_back(*src);
 		}
 
-		set(ctrl.first, ctrl.second);
+		++dst;
+		++src;
 	}
+
+	controls_ = std::move(merged);
 }
 
 /**
@@ -969,7 +1071,7 @@ void ControlList::merge(const ControlList &source, MergePolicy policy)
  */
 bool ControlList::contains(unsigned int id) const
 {
-	return controls_.find(id) != controls_.end();
+	return lookup(id) != controls_.end();
 }
 
 /**
@@ -1064,9 +1166,22 @@ void ControlList::set(unsigned int id, const ControlValue &value)
  * nullptr is returned in that case.
  */
 
+ControlList::const_iterator ControlList::lookup(unsigned int id) const
+{
+	auto iter = std::lower_bound(controls_.begin(), controls_.end(), id,
+				     [](const ControlListMap::value_type &ctrl,
+					unsigned int ctrlId) {
+					     return ctrl.first < ctrlId;
+				     });
+	if (iter == controls_.end() || iter->first != id)
+		return controls_.end();
+
+	return iter;
+}
+
 const ControlValue *ControlList::find(unsigned int id) const
 {
-	const auto iter = controls_.find(id);
+	const auto iter = lookup(id);
 	if (iter == controls_.end()) {
 		LOG(Controls, Error)
 			<< "Control " << utils::hex(id) << " not found";
@@ -1086,7 +1201,19 @@ ControlValue *ControlList::find(unsigned int id)
 		return nullptr;
 	}
 
-	return &controls_[id];
+	/* Controls are usually added in increasing ID order. */
+	if (controls_.empty() || controls_.back().first < id)
+		return &controls_.emplace_back(id, ControlValue{}).second;
+
+	auto iter = std::lower_bound(controls_.begin(), controls_.end(), id,
+				     [](const ControlListMap::value_type &ctrl,
+					unsigned int ctrlId) {
+					     return ctrl.first < ctrlId;
+				     });
+	if (iter->first != id)
+		iter = controls_.emplace(iter, id, ControlValue{});
+
+	return &iter->second;
 }
 
 } /* namespace libcamera */
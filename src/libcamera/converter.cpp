@@ -40,9 +40,14 @@ LOG_DEFINE_CATEGORY(Converter)
  *
  * This searches for the entity implementing the data streaming function in the
  * media graph entities and use its device node as the converter device node.
+ * Converters that don't rely on a media device, such as software converters,
+ * pass a null \a media, and have no device node.
  */
 Converter::Converter(MediaDevice *media)
 {
+	if (!media)
+		return;
+
 	const std::vector<MediaEntity *> &entities = media->entities();
 	auto it = std::find_if(entities.begin(), entities.end(),
 			       [](MediaEntity *entity) {
@@ -235,6 +240,39 @@ std::unique_ptr<Converter> ConverterFactoryBase::create(MediaDevice *media)
 	return nullptr;
 }
 
+/**
+ * \brief Create an instance of the converter from the factory named \a name
+ * \param[in] name The converter factory name
+ *
+ * This function creates converters that don't rely on a media device, such as
+ * software converters, by passing a null media device to the factory. Aliases
+ * are not considered.
+ *
+ * \return A new instance of the converter subclass, or null if no factory
+ * matches \a name or the converter isn't valid
+ */
+std::unique_ptr<Converter> ConverterFactoryBase::create(const std::string &name)
+{
+	const std::vector<ConverterFactoryBase *> &factories =
+		ConverterFactoryBase::factories();
+
+	for (const ConverterFactoryBase *factory : factories) {
+		if (factory->name_ != name)
+			continue;
+
+		LOG(Converter, Debug)
+			<< "Creating converter from " << name << " factory";
+
+		std::unique_ptr<Converter> converter = factory->createInstance(nullptr);
+		if (converter->isValid())
+			return converter;
+
+		break;
+	}
+
+	return nullptr;
+}
+
 /**
  * \brief Add a converter factory to the registry
  * \param[in] factory Factory to use to construct the converter class
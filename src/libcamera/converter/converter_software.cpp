@@ -0,0 +1,658 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * CPU-based format converter
+ */
+
+#include "libcamera/internal/converter/converter_software.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <errno.h>
+#include <string.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+#include <libcamera/color_space.h>
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/framebuffer.h"
+
+/**
+ * \file converter/converter_software.h
+ * \brief CPU-based converter
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Converter)
+
+namespace {
+
+/* Minimum number of input rows processed by a stripe. */
+constexpr unsigned int kMinStripeRows = 32;
+
+/* Fractional bits of the fixed-point colour conversion coefficients. */
+constexpr unsigned int kColourShift = 14;
+
+} /* namespace */
+
+const std::array<SoftwareConverter::Layout, 10> SoftwareConverter::layouts_ = { {
+	{ formats::YUYV, true, 2, { 0, 1, 2, 3 } },
+	{ formats::YVYU, true, 2, { 0, 3, 2, 1 } },
+	{ formats::UYVY, true, 2, { 1, 0, 3, 2 } },
+	{ formats::VYUY, true, 2, { 1, 2, 3, 0 } },
+	{ formats::RGB888, false, 3, { 2, 1, 0, -1 } },
+	{ formats::BGR888, false, 3, { 0, 1, 2, -1 } },
+	{ formats::XRGB8888, false, 4, { 2, 1, 0, 3 } },
+	{ formats::XBGR8888, false, 4, { 0, 1, 2, 3 } },
+	{ formats::ARGB8888, false, 4, { 2, 1, 0, 3 } },
+	{ formats::ABGR8888, false, 4, { 0, 1, 2, 3 } },
+} };
+
+/**
+ * \class SoftwareConverter
+ * \brief Format converter running on the CPU
+ *
+ * The SoftwareConverter class implements the Converter interface on the CPU,
+ * for platforms that lack a memory-to-memory converter device. It converts
+ * between packed YUV 4:2:2 and 24-bit or 32-bit RGB formats, and scales the
+ * image down with nearest neighbour sampling. Conversion between YUV and RGB
+ * uses the Y'CbCr encoding and quantization range of the YUV side colour
+ * space, and defaults to the Rec. 601 limited range encoding.
+ *
+ * All the outputs of a job are produced in a single pass over the input
+ * image. The image is split in horizontal stripes processed concurrently on
+ * the libcamera thread pool, and each input row is read and unpacked once for
+ * all the outputs that sample it. Outputs that have the same format and size
+ * as the input are copied row by row.
+ *
+ * The converter is bound to the thread it is created in, which is expected to
+ * be the pipeline handler thread. Jobs are completed, and the inputBufferReady
+ * and outputBufferReady signals emitted, in that thread.
+ */
+
+/**
+ * \brief Construct a SoftwareConverter instance
+ * \param[in] media Unused, the converter doesn't rely on a media device
+ */
+SoftwareConverter::SoftwareConverter([[maybe_unused]] MediaDevice *media)
+	: Converter(nullptr),
+	  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf),
+	  stripes_(1), running_(false), nextJobId_(0),
+	  tasks_(std::make_unique<TaskGroup>())
+{
+	if (!dmaHeap_.isValid())
+		LOG(Converter, Error)
+			<< "Failed to create DmaBufAllocator object";
+}
+
+/**
+ * \fn libcamera::SoftwareConverter::loadConfiguration
+ * \details \copydetails libcamera::Converter::loadConfiguration
+ */
+
+/**
+ * \fn libcamera::SoftwareConverter::isValid
+ * \details \copydetails libcamera::Converter::isValid
+ */
+
+/**
+ * \details \copydetails libcamera::Converter::formats
+ */
+std::vector<PixelFormat> SoftwareConverter::formats(PixelFormat input)
+{
+	if (!layout(input))
+		return {};
+
+	std::vector<PixelFormat> formats;
+	formats.reserve(layouts_.size());
+
+	/* List the input format first to make it the default. */
+	formats.push_back(input);
+	for (const Layout &l : layouts_) {
+		if (l.format != input)
+			formats.push_back(l.format);
+	}
+
+	return formats;
+}
+
+/**
+ * \details \copydetails libcamera::Converter::sizes
+ */
+SizeRange SoftwareConverter::sizes(const Size &input)
+{
+	/* Only downscaling is supported. */
+	return SizeRange(Size(16, 16).boundedTo(input), input);
+}
+
+/**
+ * \details \copydetails libcamera::Converter::strideAndFrameSize
+ */
+std::tuple<unsigned int, unsigned int>
+SoftwareConverter::strideAndFrameSize(const PixelFormat &pixelFormat,
+				      const Size &size)
+{
+	const Layout *l = layout(pixelFormat);
+	if (!l)
+		return std::make_tuple(0, 0);
+
+	unsigned int stride = utils::alignUp(size.width * l->bytesPerPixel, 8);
+
+	return std::make_tuple(stride, stride * size.height);
+}
+
+/**
+ * \details \copydetails libcamera::Converter::configure
+ */
+int SoftwareConverter::configure(const StreamConfiguration &inputCfg,
+				 const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
+{
+	outputs_.clear();
+
+	input_.layout = layout(inputCfg.pixelFormat);
+	if (!input_.layout) {
+		LOG(Converter, Error)
+			<< "Unsupported input format " << inputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	input_.size = inputCfg.size;
+	input_.stride = inputCfg.stride;
+
+	if (input_.layout->yuv && input_.size.width % 2) {
+		LOG(Converter, Error)
+			<< "Odd input width " << input_.size.width
+			<< " not supported for " << inputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	/*
+	 * Compute the matrix for the conversion between the RGB and YUV
+	 * components, from the colour space of the YUV side.
+	 */
+	auto colourMatrix = [](const std::optional<ColorSpace> &colorSpace,
+			       bool toRgb) {
+		double kr = 0.299;
+		double kb = 0.114;
+		bool full = false;
+
+		if (colorSpace) {
+			switch (colorSpace->ycbcrEncoding) {
+			case ColorSpace::YcbcrEncoding::Rec709:
+				kr = 0.2126;
+				kb = 0.0722;
+				break;
+			case ColorSpace::YcbcrEncoding::Rec2020:
+				kr = 0.2627;
+				kb = 0.0593;
+				break;
+			default:
+				break;
+			}
+
+			full = colorSpace->range == ColorSpace::Range::Full;
+		}
+
+		const double kg = 1.0 - kr - kb;
+		const double yScale = full ? 1.0 : 219.0 / 255.0;
+		const double cScale = full ? 1.0 : 224.0 / 255.0;
+		const int32_t yOffset = full ? 0 : 16;
+
+		double m[3][3];
+		ColourMatrix matrix;
+
+		if (toRgb) {
+			const double yr = 1.0 / yScale;
+			const double cr = 1.0 / cScale;
+
+			m[0][0] = yr;
+			m[0][1] = 0.0;
+			m[0][2] = 2.0 * (1.0 - kr) * cr;
+			m[1][0] = yr;
+			m[1][1] = -2.0 * kb * (1.0 - kb) / kg * cr;
+			m[1][2] = -2.0 * kr * (1.0 - kr) / kg * cr;
+			m[2][0] = yr;
+			m[2][1] = 2.0 * (1.0 - kb) * cr;
+			m[2][2] = 0.0;
+
+			matrix.inOffsets = { yOffset, 128, 128 };
+			matrix.outOffsets = { 0, 0, 0 };
+		} else {
+			m[0][0] = kr * yScale;
+			m[0][1] = kg * yScale;
+			m[0][2] = kb * yScale;
+			m[1][0] = -kr / (2.0 * (1.0 - kb)) * cScale;
+			m[1][1] = -kg / (2.0 * (1.0 - kb)) * cScale;
+			m[1][2] = 0.5 * cScale;
+			m[2][0] = 0.5 * cScale;
+			m[2][1] = -kg / (2.0 * (1.0 - kr)) * cScale;
+			m[2][2] = -kb / (2.0 * (1.0 - kr)) * cScale;
+
+			matrix.inOffsets = { 0, 0, 0 };
+			matrix.outOffsets = { yOffset, 128, 128 };
+		}
+
+		for (unsigned int i = 0; i < 3; i++) {
+			for (unsigned int j = 0; j < 3; j++)
+				matrix.coeffs[i][j] = std::lround(m[i][j] * (1 << kColourShift));
+		}
+
+		return matrix;
+	};
+
+	/* Sample the centre of the input pixels covered by each output pixel. */
+	auto sampleMap = [](unsigned int input, unsigned int output) {
+		std::vector<unsigned int> map(output);
+		for (unsigned int i = 0; i < output; i++)
+			map[i] = (2 * i + 1) * input / (2 * output);
+		return map;
+	};
+
+	for (const StreamConfiguration &cfg : outputCfgs) {
+		Plane plane;
+
+		plane.layout = layout(cfg.pixelFormat);
+		if (!plane.layout) {
+			LOG(Converter, Error)
+				<< "Unsupported output format " << cfg.pixelFormat;
+			outputs_.clear();
+			return -EINVAL;
+		}
+
+		if (!sizes(input_.size).contains(cfg.size) ||
+		    (plane.layout->yuv && cfg.size.width % 2)) {
+			LOG(Converter, Error)
+				<< "Unsupported output size " << cfg.size
+				<< " for input size " << input_.size;
+			outputs_.clear();
+			return -EINVAL;
+		}
+
+		plane.size = cfg.size;
+		plane.stride = std::get<0>(strideAndFrameSize(cfg.pixelFormat, cfg.size));
+		plane.stride = std::max(plane.stride, cfg.stride);
+		plane.xmap = sampleMap(input_.size.width, cfg.size.width);
+		plane.ymap = sampleMap(input_.size.height, cfg.size.height);
+		plane.copy = plane.layout == input_.layout && plane.size == input_.size;
+
+		if (plane.layout->yuv != input_.layout->yuv)
+			plane.matrix = input_.layout->yuv
+					     ? colourMatrix(inputCfg.colorSpace, true)
+					     : colourMatrix(cfg.colorSpace, false);
+
+		outputs_.emplace(cfg.stream(), std::move(plane));
+	}
+
+	stripes_ = std::clamp(input_.size.height / kMinStripeRows, 1U,
+			      ThreadPool::instance()->size());
+
+	LOG(Converter, Debug)
+		<< "Converting " << inputCfg.toString() << " to "
+		<< outputs_.size() << " outputs in " << stripes_ << " stripes";
+
+	return 0;
+}
+
+/**
+ * \details \copydetails libcamera::Converter::exportBuffers
+ */
+int SoftwareConverter::exportBuffers(const Stream *stream, unsigned int count,
+				     std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	auto it = outputs_.find(stream);
+	if (it == outputs_.end())
+		return -EINVAL;
+
+	const Plane &plane = it->second;
+	const size_t frameSize = plane.stride * plane.size.height;
+
+	for (unsigned int i = 0; i < count; i++) {
+		const std::string name = "frame-" + std::to_string(i);
+
+		std::vector<FrameBuffer::Plane> planes(1);
+		planes[0].offset = 0;
+		planes[0].length = frameSize;
+
+		std::unique_ptr<FrameBuffer> buffer =
+			dmaHeap_.exportFrameBuffer(name.c_str(), frameSize,
+						   std::move(planes));
+		if (!buffer) {
+			LOG(Converter, Error)
+				<< "failed to allocate a dma_buf";
+			return -ENOMEM;
+		}
+
+		buffers->push_back(std::move(buffer));
+	}
+
+	return count;
+}
+
+/**
+ * \details \copydetails libcamera::Converter::start
+ */
+int SoftwareConverter::start()
+{
+	running_ = true;
+
+	return 0;
+}
+
+/**
+ * \details \copydetails libcamera::Converter::stop
+ *
+ * Jobs in flight are run to completion before the function returns.
+ */
+void SoftwareConverter::stop()
+{
+	running_ = false;
+
+	tasks_->wait();
+
+	while (!activeJobs_.empty())
+		completeJob(activeJobs_.begin());
+}
+
+/**
+ * \details \copydetails libcamera::Converter::queueBuffers
+ */
+int SoftwareConverter::queueBuffers(FrameBuffer *input,
+				    const Request::BufferMap &outputs)
+{
+	if (!running_)
+		return -EINVAL;
+
+	/*
+	 * At least one output is required, and all outputs must reference a
+	 * configured stream.
+	 */
+	if (outputs.empty())
+		return -EINVAL;
+
+	for (auto [stream, buffer] : outputs) {
+		if (!buffer || !outputs_.count(stream))
+			return -EINVAL;
+	}
+
+	Job &job = activeJobs_.emplace_back();
+	job.id = nextJobId_++;
+	job.input = input;
+	job.outputs = outputs;
+
+	job.out.reserve(outputs.size());
+	job.in.emplace(input, MappedFrameBuffer::MapFlag::Read |
+			      MappedFrameBuffer::MapFlag::Populate);
+	bool mapped = job.in->isValid() &&
+		      job.in->planes()[0].size() >= input_.stride * input_.size.height;
+
+	for (auto [stream, buffer] : outputs) {
+		const Plane &plane = outputs_.at(stream);
+
+		/* Copy metadata from the input buffer. */
+		FrameMetadata &metadata = buffer->_d()->metadata();
+		metadata.status = input->metadata().status;
+		metadata.sequence = input->metadata().sequence;
+		metadata.timestamp = input->metadata().timestamp;
+
+		MappedFrameBuffer out(buffer, MappedFrameBuffer::MapFlag::Write |
+					      MappedFrameBuffer::MapFlag::Populate);
+		mapped &= out.isValid() &&
+			  out.planes()[0].size() >= plane.stride * plane.size.height;
+
+		job.out.emplace_back(&plane, std::move(out));
+	}
+
+	/*
+	 * Complete the job asynchronously on mapping errors, to emit the
+	 * completion signals from the same context as for successful jobs.
+	 */
+	if (!mapped) {
+		LOG(Converter, Error) << "mmap-ing buffer(s) failed";
+
+		for (auto [stream, buffer] : outputs)
+			buffer->_d()->metadata().status = FrameMetadata::FrameError;
+
+		invokeMethod(&SoftwareConverter::jobDone, ConnectionTypeQueued,
+			     job.id);
+		return 0;
+	}
+
+	job.remaining = stripes_;
+
+	for (unsigned int i = 0; i < stripes_; i++) {
+		unsigned int first = input_.size.height * i / stripes_;
+		unsigned int last = input_.size.height * (i + 1) / stripes_;
+
+		tasks_->run([this, job = &job, first, last]() {
+			processStripe(job, first, last);
+
+			if (job->remaining.fetch_sub(1) == 1)
+				invokeMethod(&SoftwareConverter::jobDone,
+					     ConnectionTypeQueued, job->id);
+		});
+	}
+
+	return 0;
+}
+
+const SoftwareConverter::Layout *SoftwareConverter::layout(const PixelFormat &format)
+{
+	auto it = std::find_if(layouts_.begin(), layouts_.end(),
+			       [&](const Layout &l) { return l.format == format; });
+	if (it == layouts_.end())
+		return nullptr;
+
+	return &*it;
+}
+
+/*
+ * Unpack a row of \a width pixels from \a src to one byte per component, in
+ * the Y, U, V or R, G, B planes of \a row. Chroma components of YUV 4:2:2
+ * formats are duplicated for the two pixels of a pair.
+ */
+void SoftwareConverter::unpackRow(const Layout &layout, const uint8_t *src,
+				  unsigned int width, uint8_t *row[3])
+{
+	uint8_t *c0 = row[0];
+	uint8_t *c1 = row[1];
+	uint8_t *c2 = row[2];
+	const int o0 = layout.offsets[0];
+	const int o1 = layout.offsets[1];
+	const int o2 = layout.offsets[2];
+
+	if (layout.yuv) {
+		const int o3 = layout.offsets[3];
+
+		for (unsigned int x = 0; x < width / 2; x++, src += 4) {
+			c0[2 * x] = src[o0];
+			c0[2 * x + 1] = src[o2];
+			c1[2 * x] = c1[2 * x + 1] = src[o1];
+			c2[2 * x] = c2[2 * x + 1] = src[o3];
+		}
+
+		return;
+	}
+
+	const unsigned int bpp = layout.bytesPerPixel;
+
+	for (unsigned int x = 0; x < width; x++, src += bpp) {
+		c0[x] = src[o0];
+		c1[x] = src[o1];
+		c2[x] = src[o2];
+	}
+}
+
+/*
+ * Produce a row of the output \a plane in \a dst from an unpacked input row,
+ * sampling the columns given by the plane horizontal map and converting
+ * between RGB and YUV if needed.
+ */
+void SoftwareConverter::packRow(const Plane &plane, uint8_t *const row[3],
+				uint8_t *dst)
+{
+	const Layout &layout = *plane.layout;
+	const unsigned int *xmap = plane.xmap.data();
+	const unsigned int width = plane.size.width;
+	const int o0 = layout.offsets[0];
+	const int o1 = layout.offsets[1];
+	const int o2 = layout.offsets[2];
+	const int o3 = layout.offsets[3];
+
+	auto sample = [&](unsigned int x, uint8_t out[3]) {
+		const unsigned int sx = xmap[x];
+		const int32_t in[3] = { row[0][sx], row[1][sx], row[2][sx] };
+
+		if (!plane.matrix) {
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+			return;
+		}
+
+		const ColourMatrix &m = *plane.matrix;
+
+		for (unsigned int i = 0; i < 3; i++) {
+			int32_t value = m.coeffs[i][0] * (in[0] - m.inOffsets[0]) +
+					m.coeffs[i][1] * (in[1] - m.inOffsets[1]) +
+					m.coeffs[i][2] * (in[2] - m.inOffsets[2]);
+			value = ((value + (1 << (kColourShift - 1))) >> kColourShift) +
+				m.outOffsets[i];
+			out[i] = std::clamp(value, 0, 255);
+		}
+	};
+
+	uint8_t p0[3];
+	uint8_t p1[3];
+
+	if (layout.yuv) {
+		for (unsigned int x = 0; x < width; x += 2, dst += 4) {
+			sample(x, p0);
+			sample(x + 1, p1);
+
+			dst[o0] = p0[0];
+			dst[o1] = (p0[1] + p1[1] + 1) / 2;
+			dst[o2] = p1[0];
+			dst[o3] = (p0[2] + p1[2] + 1) / 2;
+		}
+
+		return;
+	}
+
+	const unsigned int bpp = layout.bytesPerPixel;
+
+	for (unsigned int x = 0; x < width; x++, dst += bpp) {
+		sample(x, p0);
+
+		dst[o0] = p0[0];
+		dst[o1] = p0[1];
+		dst[o2] = p0[2];
+		if (o3 >= 0)
+			dst[o3] = 0xff;
+	}
+}
+
+/*
+ * Process the input rows [first, last[ of a job, for all its outputs. The
+ * vertical maps of the outputs are monotonic, the output rows sampling the
+ * stripe are thus contiguous, and each input row is unpacked at most once.
+ */
+void SoftwareConverter::processStripe(Job *job, unsigned int first, unsigned int last)
+{
+	struct Cursor {
+		const Plane *plane;
+		uint8_t *data;
+		unsigned int y;
+		unsigned int end;
+	};
+
+	std::vector<Cursor> cursors;
+	cursors.reserve(job->out.size());
+
+	for (auto &[plane, mapped] : job->out) {
+		const std::vector<unsigned int> &ymap = plane->ymap;
+		unsigned int y = std::lower_bound(ymap.begin(), ymap.end(), first) - ymap.begin();
+		unsigned int end = std::lower_bound(ymap.begin(), ymap.end(), last) - ymap.begin();
+
+		cursors.push_back({ plane, mapped.planes()[0].data(), y, end });
+	}
+
+	const unsigned int width = input_.size.width;
+	std::vector<uint8_t> buffer(3 * width);
+	uint8_t *row[3] = { buffer.data(), buffer.data() + width,
+			    buffer.data() + 2 * width };
+
+	const uint8_t *src = job->in->planes()[0].data();
+	const unsigned int lineSize = width * input_.layout->bytesPerPixel;
+
+	for (unsigned int sy = first; sy < last; sy++) {
+		const uint8_t *line = src + sy * input_.stride;
+		bool unpacked = false;
+
+		for (Cursor &cursor : cursors) {
+			const Plane &plane = *cursor.plane;
+
+			for (; cursor.y < cursor.end && plane.ymap[cursor.y] == sy; cursor.y++) {
+				uint8_t *dst = cursor.data + cursor.y * plane.stride;
+
+				if (plane.copy) {
+					memcpy(dst, line, lineSize);
+					continue;
+				}
+
+				if (!unpacked) {
+					unpackRow(*input_.layout, line, width, row);
+					unpacked = true;
+				}
+
+				packRow(plane, row, dst);
+			}
+		}
+	}
+}
+
+void SoftwareConverter::jobDone(uint64_t id)
+{
+	auto it = std::find_if(activeJobs_.begin(), activeJobs_.end(),
+			       [id](const Job &job) { return job.id == id; });
+
+	/* The job may have been completed by stop() already. */
+	if (it == activeJobs_.end())
+		return;
+
+	completeJob(it);
+}
+
+void SoftwareConverter::completeJob(std::list<Job>::iterator job)
+{
+	FrameBuffer *input = job->input;
+	Request::BufferMap outputs = std::move(job->outputs);
+
+	for (auto [stream, buffer] : outputs) {
+		const Plane &plane = outputs_.at(stream);
+		Span<FrameMetadata::Plane> planes = buffer->_d()->metadata().planes();
+		planes[0].bytesused = plane.stride * plane.size.height;
+	}
+
+	/*
+	 * Unmap the buffers, ending CPU access, before handing them back. The
+	 * job is removed first as the signal handlers may queue new jobs or
+	 * stop the converter.
+	 */
+	activeJobs_.erase(job);
+
+	for (auto [stream, buffer] : outputs)
+		outputBufferReady.emit(buffer);
+
+	inputBufferReady.emit(input);
+}
+
+REGISTER_CONVERTER("software", SoftwareConverter, {})
+
+} /* namespace libcamera */
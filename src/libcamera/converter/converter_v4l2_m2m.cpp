@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <limits.h>
+#include <stdlib.h>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/signal.h>
@@ -19,6 +20,7 @@
 #include <libcamera/geometry.h>
 #include <libcamera/stream.h>
 
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
@@ -142,6 +144,15 @@ void V4L2M2MConverter::V4L2M2MStream::stop()
 	m2m_->output()->releaseBuffers();
 }
 
+unsigned int V4L2M2MConverter::V4L2M2MStream::maxQueueDepth() const
+{
+	/*
+	 * A job holds one input and one output buffer of each stream, the
+	 * number of imported buffers bounds the number of jobs in flight.
+	 */
+	return std::min(inputBufferCount_, outputBufferCount_);
+}
+
 int V4L2M2MConverter::V4L2M2MStream::queueBuffers(FrameBuffer *input, FrameBuffer *output)
 {
 	int ret = m2m_->output()->queueBuffer(input);
@@ -162,19 +173,12 @@ std::string V4L2M2MConverter::V4L2M2MStream::logPrefix() const
 
 void V4L2M2MConverter::V4L2M2MStream::outputBufferReady(FrameBuffer *buffer)
 {
-	auto it = converter_->queue_.find(buffer);
-	if (it == converter_->queue_.end())
-		return;
-
-	if (!--it->second) {
-		converter_->inputBufferReady.emit(buffer);
-		converter_->queue_.erase(it);
-	}
+	converter_->inputDone(buffer);
 }
 
 void V4L2M2MConverter::V4L2M2MStream::captureBufferReady(FrameBuffer *buffer)
 {
-	converter_->outputBufferReady.emit(buffer);
+	converter_->outputDone(buffer);
 }
 
 /* -----------------------------------------------------------------------------
@@ -185,6 +189,18 @@ void V4L2M2MConverter::V4L2M2MStream::captureBufferReady(FrameBuffer *buffer)
  * \class libcamera::V4L2M2MConverter
  * \brief The V4L2 M2M converter implements the converter interface based on
  * V4L2 M2M device.
+ *
+ * Each call to queueBuffers() creates a conversion job, made of one input
+ * buffer and one output buffer per stream. Jobs are queued to the M2M devices
+ * without waiting for the previous ones to complete, up to a maximum queue
+ * depth, in order to keep the hardware busy. The depth defaults to the number
+ * of buffers configured on the streams, and can be overridden with the
+ * LIBCAMERA_CONVERTER_QUEUE_DEPTH environment variable. Jobs queued beyond the
+ * depth are held by the converter and submitted when older jobs complete.
+ *
+ * The latency of each job, from its submission to the device to the
+ * completion of all its buffers, is logged at the debug level, and a summary
+ * is logged when the converter is stopped.
 */
 
 /**
@@ -194,8 +210,13 @@ void V4L2M2MConverter::V4L2M2MStream::captureBufferReady(FrameBuffer *buffer)
  */
 
 V4L2M2MConverter::V4L2M2MConverter(MediaDevice *media)
-	: Converter(media)
+	: Converter(media), queueDepth_(0), maxQueueDepth_(0), running_(false),
+	  completedJobs_(0)
 {
+	const char *env = utils::secure_getenv("LIBCAMERA_CONVERTER_QUEUE_DEPTH");
+	if (env)
+		queueDepth_ = std::strtoul(env, nullptr, 10);
+
 	if (deviceNode().empty())
 		return;
 
@@ -381,6 +402,21 @@ int V4L2M2MConverter::start()
 {
 	int ret;
 
+	maxQueueDepth_ = UINT_MAX;
+	for (const auto &iter : streams_)
+		maxQueueDepth_ = std::min(maxQueueDepth_, iter.second->maxQueueDepth());
+
+	if (queueDepth_)
+		maxQueueDepth_ = std::min(maxQueueDepth_, queueDepth_);
+
+	LOG(Converter, Debug) << "Queue depth set to " << maxQueueDepth_;
+
+	completedJobs_ = 0;
+	totalLatency_ = {};
+	maxLatency_ = {};
+
+	running_ = true;
+
 	for (auto &iter : streams_) {
 		ret = iter.second->start();
 		if (ret < 0) {
@@ -397,15 +433,35 @@ int V4L2M2MConverter::start()
  */
 void V4L2M2MConverter::stop()
 {
+	running_ = false;
+
+	/*
+	 * Stopping the streams cancels the jobs queued to the devices, which
+	 * complete through the buffer ready handlers. Cancel the jobs that
+	 * haven't been submitted yet.
+	 */
 	for (auto &iter : streams_)
 		iter.second->stop();
+
+	while (!pendingJobs_.empty()) {
+		cancelJob(pendingJobs_.front());
+		pendingJobs_.pop();
+	}
+
+	activeJobs_.clear();
+
+	if (completedJobs_)
+		LOG(Converter, Debug)
+			<< completedJobs_ << " jobs completed, latency average "
+			<< utils::Duration(totalLatency_ / completedJobs_).get<std::micro>()
+			<< "us, max " << maxLatency_.get<std::micro>() << "us";
 }
 
 /**
  * \copydoc libcamera::Converter::queueBuffers
  */
 int V4L2M2MConverter::queueBuffers(FrameBuffer *input,
-				   const std::map<const Stream *, FrameBuffer *> &outputs)
+				   const Request::BufferMap &outputs)
 {
 	std::set<FrameBuffer *> outputBufs;
 	int ret;
@@ -428,25 +484,156 @@ int V4L2M2MConverter::queueBuffers(FrameBuffer *input,
 	if (outputBufs.size() != streams_.size())
 		return -EINVAL;
 
-	/* Queue the input and output buffers to all the streams. */
-	for (auto [stream, buffer] : outputs) {
-		ret = streams_.at(stream)->queueBuffers(input, buffer);
-		if (ret < 0)
+	if (!running_)
+		return -EINVAL;
+
+	/*
+	 * Submit the job right away if the queue depth allows it, otherwise
+	 * hold it until an older job completes. Errors when submitting held
+	 * jobs can't be reported to the caller, those jobs are completed with
+	 * their buffers marked as cancelled.
+	 */
+	if (pendingJobs_.empty() && activeJobs_.size() < maxQueueDepth_) {
+		Job job{ input, outputs, 0, 0, {} };
+
+		ret = queueJob(job);
+		if (ret < 0 && !job.inputRefs)
 			return ret;
+
+		if (ret < 0)
+			cancelJob(job);
+
+		activeJobs_.push_back(std::move(job));
+		return ret;
 	}
 
+	pendingJobs_.push({ input, outputs, 0, 0, {} });
+
+	return 0;
+}
+
+int V4L2M2MConverter::queueJob(Job &job)
+{
+	job.queued = utils::clock::now();
+
 	/*
-	 * Add the input buffer to the queue, with the number of streams as a
-	 * reference count. Completion of the input buffer will be signalled by
-	 * the stream that releases the last reference.
+	 * Queue the input and output buffers to all the streams. The input
+	 * buffer is reference-counted, its completion is signalled by the
+	 * stream that releases the last reference.
 	 */
-	queue_.emplace(std::piecewise_construct,
-		       std::forward_as_tuple(input),
-		       std::forward_as_tuple(outputs.size()));
+	for (auto [stream, buffer] : job.outputs) {
+		int ret = streams_.at(stream)->queueBuffers(job.input, buffer);
+		if (ret < 0)
+			return ret;
+
+		job.inputRefs++;
+		job.outputsPending++;
+	}
 
 	return 0;
 }
 
+void V4L2M2MConverter::cancelJob(Job &job)
+{
+	/*
+	 * Outputs are queued in order, the first outputsPending buffers have
+	 * reached the devices and will complete normally.
+	 */
+	unsigned int queued = job.outputsPending;
+
+	for (auto [stream, buffer] : job.outputs) {
+		if (queued) {
+			queued--;
+			continue;
+		}
+
+		buffer->_d()->cancel();
+		outputBufferReady.emit(buffer);
+	}
+
+	if (!job.inputRefs)
+		inputBufferReady.emit(job.input);
+}
+
+void V4L2M2MConverter::processJobs()
+{
+	while (running_ && !pendingJobs_.empty() &&
+	       activeJobs_.size() < maxQueueDepth_) {
+		Job job = std::move(pendingJobs_.front());
+		pendingJobs_.pop();
+
+		int ret = queueJob(job);
+		if (ret < 0) {
+			LOG(Converter, Error)
+				<< "Failed to queue job: " << strerror(-ret);
+			cancelJob(job);
+			if (!job.inputRefs)
+				continue;
+		}
+
+		activeJobs_.push_back(std::move(job));
+	}
+}
+
+void V4L2M2MConverter::inputDone(FrameBuffer *buffer)
+{
+	auto it = std::find_if(activeJobs_.begin(), activeJobs_.end(),
+			       [buffer](const Job &job) {
+				       return job.input == buffer && job.inputRefs;
+			       });
+	if (it == activeJobs_.end())
+		return;
+
+	if (--it->inputRefs)
+		return;
+
+	inputBufferReady.emit(buffer);
+
+	if (!it->outputsPending)
+		completeJob(it);
+}
+
+void V4L2M2MConverter::outputDone(FrameBuffer *buffer)
+{
+	auto it = std::find_if(activeJobs_.begin(), activeJobs_.end(),
+			       [buffer](const Job &job) {
+				       for (const auto &output : job.outputs) {
+					       if (output.second == buffer)
+						       return job.outputsPending > 0;
+				       }
+				       return false;
+			       });
+
+	outputBufferReady.emit(buffer);
+
+	if (it == activeJobs_.end())
+		return;
+
+	if (--it->outputsPending)
+		return;
+
+	if (!it->inputRefs)
+		completeJob(it);
+}
+
+void V4L2M2MConverter::completeJob(std::list<Job>::iterator job)
+{
+	utils::Duration latency = utils::clock::now() - job->queued;
+
+	activeJobs_.erase(job);
+
+	completedJobs_++;
+	totalLatency_ += latency;
+	maxLatency_ = std::max(maxLatency_, latency);
+
+	LOG(Converter, Debug)
+		<< "Job completed in " << latency.get<std::micro>() << "us, "
+		<< activeJobs_.size() << " in flight, "
+		<< pendingJobs_.size() << " pending";
+
+	processJobs();
+}
+
 static std::initializer_list<std::string> compatibles = {
 	"mtk-mdp",
 	"pxp",
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Coroutine wrappers for asynchronous capture
+ */
+
+#include <libcamera/coroutine.h>
+
+/**
+ * \file coroutine.h
+ * \brief Awaitable wrappers around the asynchronous Camera API
+ *
+ * The Camera class reports request completion through the
+ * Camera::requestCompleted signal, which forces applications to write their
+ * capture loop as callbacks. The classes in this file let applications that
+ * use C++20 coroutines await completed requests instead:
+ *
+ * \code{.cpp}
+ * Task captureLoop(AsyncCamera &camera)
+ * {
+ * 	while (running) {
+ * 		Request *request = co_await camera.nextCompleted();
+ *
+ * 		processRequest(request);
+ *
+ * 		request->reuse(Request::ReuseBuffers);
+ * 		camera.queueRequest(request);
+ * 	}
+ * }
+ * \endcode
+ *
+ * The file is header-only, and its content is only available when the
+ * application is compiled with coroutine support. libcamera itself doesn't
+ * depend on C++20.
+ */
+
+namespace libcamera {
+
+/**
+ * \typedef CoroutineResumer
+ * \brief A function that resumes a coroutine in the application's context
+ *
+ * The resumer is called with the \a handle of a suspended coroutine, from the
+ * thread that completes the event the coroutine awaits. It shall arrange for
+ * the coroutine to be resumed, typically by posting a task that calls
+ * handle.resume() to the event loop of the thread that owns the coroutine.
+ *
+ * An empty resumer resumes the coroutine synchronously in the completing
+ * thread.
+ */
+
+/**
+ * \class CompletionQueue
+ * \brief A single-producer, single-consumer queue of completions to await
+ * \tparam T The type of the completions
+ *
+ * The CompletionQueue stores completions pushed by a producer thread until a
+ * consumer coroutine awaits them with next(). Its storage is allocated at
+ * construction time, and pushing and popping completions neither allocates
+ * memory nor takes locks. At most one coroutine shall await the queue at a
+ * time.
+ *
+ * When a completion is pushed while a coroutine awaits the queue, the
+ * coroutine is resumed through the resumer passed to the constructor. When a
+ * completion is already available, awaiting the queue doesn't suspend the
+ * coroutine, which avoids needless wakeups when the consumer runs behind the
+ * producer.
+ */
+
+/**
+ * \class CompletionQueue::Awaiter
+ * \brief The awaitable returned by CompletionQueue::next()
+ *
+ * Awaiting the Awaiter returns the oldest completion of the queue, suspending
+ * the coroutine until one is available.
+ */
+
+/**
+ * \fn CompletionQueue::Awaiter::Awaiter()
+ * \brief Construct an Awaiter for \a queue
+ * \param[in] queue The completion queue
+ */
+
+/**
+ * \fn CompletionQueue::Awaiter::await_ready()
+ * \brief Check if a completion is available without suspending
+ * \return True if the queue isn't empty, false otherwise
+ */
+
+/**
+ * \fn CompletionQueue::Awaiter::await_suspend()
+ * \brief Suspend the awaiting coroutine until a completion is pushed
+ * \param[in] handle The awaiting coroutine
+ * \return True if the coroutine is suspended, false if a completion has been
+ * pushed concurrently
+ */
+
+/**
+ * \fn CompletionQueue::Awaiter::await_resume()
+ * \brief Pop the completion for the resumed coroutine
+ * \return The oldest completion of the queue
+ */
+
+/**
+ * \fn CompletionQueue::CompletionQueue()
+ * \brief Construct a CompletionQueue
+ * \param[in] capacity The maximum number of completions the queue can hold
+ * \param[in] resumer The function that resumes the awaiting coroutine
+ */
+
+/**
+ * \fn CompletionQueue::capacity()
+ * \brief Retrieve the maximum number of completions the queue can hold
+ * \return The capacity of the queue
+ */
+
+/**
+ * \fn CompletionQueue::empty()
+ * \brief Check if the queue is empty
+ * \return True if the queue holds no completion, false otherwise
+ */
+
+/**
+ * \fn CompletionQueue::push()
+ * \brief Push a completion to the queue
+ * \param[in] value The completion
+ *
+ * This function shall only be called by the producer. If a coroutine awaits
+ * the queue, it is resumed through the resumer before the function returns.
+ *
+ * \return True if the completion has been pushed, false if the queue is full
+ */
+
+/**
+ * \fn CompletionQueue::pop()
+ * \brief Pop the oldest completion from the queue
+ *
+ * This function shall only be called by the consumer, when the queue isn't
+ * empty.
+ *
+ * \return The oldest completion
+ */
+
+/**
+ * \fn CompletionQueue::next()
+ * \brief Await the next completion
+ * \return An awaitable that returns the oldest completion of the queue
+ */
+
+/**
+ * \fn CompletionQueue::resume()
+ * \brief Resume a coroutine through the resumer of the queue
+ * \param[in] handle The coroutine
+ */
+
+/**
+ * \class AsyncCamera
+ * \brief Awaitable request completion for a Camera
+ *
+ * The AsyncCamera wraps a Camera and queues its completed requests in a
+ * CompletionQueue, to let a coroutine await them with nextCompleted().
+ * Alternatively, capture() queues a single request and resumes the awaiting
+ * coroutine when that request completes.
+ *
+ * The Camera::requestCompleted signal is emitted in a libcamera internal
+ * thread, in which coroutines are resumed by default. Applications shall
+ * either supply a resumer that moves the coroutine to their own executor, or
+ * set a completion executor on the camera with
+ * Camera::setCompletionExecutor() to receive the signal where the coroutine
+ * runs.
+ *
+ * The AsyncCamera shall be created before the camera is started, and shall
+ * outlive the coroutines that await it.
+ */
+
+/**
+ * \class AsyncCamera::CaptureAwaiter
+ * \brief The awaitable returned by AsyncCamera::capture()
+ *
+ * Awaiting the CaptureAwaiter queues the request to the camera and suspends the
+ * coroutine until the request completes. The result of the co_await
+ * expression is 0 once the request has completed, or the error code returned
+ * by Camera::queueRequest() if the request couldn't be queued, in which case
+ * the coroutine isn't suspended.
+ */
+
+/**
+ * \fn AsyncCamera::CaptureAwaiter::CaptureAwaiter()
+ * \brief Construct a CaptureAwaiter
+ * \param[in] camera The camera
+ * \param[in] request The request to capture
+ */
+
+/**
+ * \fn AsyncCamera::CaptureAwaiter::await_ready()
+ * \brief Report that the coroutine has to be suspended
+ * \return False
+ */
+
+/**
+ * \fn AsyncCamera::CaptureAwaiter::await_suspend()
+ * \brief Queue the request and suspend the coroutine until it completes
+ * \param[in] handle The awaiting coroutine
+ * \return True if the coroutine is suspended, false if the request couldn't be
+ * queued
+ */
+
+/**
+ * \fn AsyncCamera::CaptureAwaiter::await_resume()
+ * \brief Retrieve the result of the capture
+ * \return 0 on success or a negative error code otherwise
+ */
+
+/**
+ * \fn AsyncCamera::AsyncCamera()
+ * \brief Construct an AsyncCamera
+ * \param[in] camera The camera
+ * \param[in] capacity The maximum number of requests in flight
+ * \param[in] resumer The function that resumes the awaiting coroutines
+ *
+ * The \a capacity shall be at least the number of requests the application
+ * has queued at any time, as completed requests that don't fit in the queue
+ * are lost.
+ */
+
+/**
+ * \fn AsyncCamera::camera()
+ * \brief Retrieve the camera
+ * \return The camera
+ */
+
+/**
+ * \fn AsyncCamera::queueRequest()
+ * \brief Queue a request to the camera
+ * \param[in] request The request
+ *
+ * This function is a shortcut for Camera::queueRequest(). The request
+ * completion is delivered through nextCompleted().
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+
+/**
+ * \fn AsyncCamera::nextCompleted()
+ * \brief Await the next completed request
+ *
+ * Requests are returned in completion order. At most one coroutine shall await
+ * nextCompleted() at a time.
+ *
+ * \return An awaitable that returns the next completed request
+ */
+
+/**
+ * \fn AsyncCamera::capture()
+ * \brief Queue a request and await its completion
+ * \param[in] request The request
+ *
+ * The completion of \a request resumes the awaiting coroutine directly, other
+ * requests are still delivered through nextCompleted(). At most one capture()
+ * shall be in progress at a time.
+ *
+ * \return An awaitable that queues \a request and completes with it
+ */
+
+} /* namespace libcamera */
@@ -7,10 +7,13 @@
 
 #include "libcamera/internal/delayed_controls.h"
 
+#include <algorithm>
+
 #include <libcamera/base/log.h>
 
 #include <libcamera/controls.h>
 
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/v4l2_device.h"
 
 /**
@@ -36,6 +39,17 @@ LOG_DEFINE_CATEGORY(DelayedControls)
  * control depth the controls are guaranteed to take effect for the correct
  * request. The control depth is determined by the control with the greatest
  * delay.
+ *
+ * Each set of controls pushed to the queue can be associated with a cookie,
+ * an opaque value chosen by the caller, and retrieved along with the controls
+ * in effect at a given sequence number. Pipeline handlers use it to match the
+ * sensor controls with the IPA context they have been computed for.
+ *
+ * The controls are stored in a dense array, looked up by a linear search on
+ * the small number of controls handled by an instance, and the lists of
+ * controls written to the device and returned by get() are reused across
+ * frames. This keeps the per-frame operations free of hash lookups and of
+ * most memory allocations.
  */
 
 /**
@@ -73,13 +87,14 @@ LOG_DEFINE_CATEGORY(DelayedControls)
  */
 DelayedControls::DelayedControls(V4L2Device *device,
 				 const std::unordered_map<uint32_t, ControlParams> &controlParams)
-	: device_(device), maxDelay_(0)
+	: device_(device), maxDelay_(0), current_(device->controls()),
+	  pending_(device->controls()), priority_(device->controls())
 {
 	const ControlInfoMap &controls = device_->controls();
 
 	/*
-	 * Create a map of control ids to delays for controls exposed by the
-	 * device.
+	 * Create the array of controls exposed by the device, sorted by
+	 * numerical id.
 	 */
 	for (auto const &param : controlParams) {
 		auto it = controls.find(param.first);
@@ -94,92 +109,110 @@ DelayedControls::DelayedControls(V4L2Device *device,
 
 		const ControlId *id = it->first;
 
-		controlParams_[id] = param.second;
+		controls_.push_back({ id, param.second, {} });
 
 		LOG(DelayedControls, Debug)
-			<< "Set a delay of " << controlParams_[id].delay
-			<< " and priority write flag " << controlParams_[id].priorityWrite
+			<< "Set a delay of " << param.second.delay
+			<< " and priority write flag " << param.second.priorityWrite
 			<< " for " << id->name();
 
-		maxDelay_ = std::max(maxDelay_, controlParams_[id].delay);
+		maxDelay_ = std::max(maxDelay_, param.second.delay);
 	}
 
+	std::sort(controls_.begin(), controls_.end(),
+		  [](const Control &a, const Control &b) {
+			  return a.id->id() < b.id->id();
+		  });
+
+	for (const Control &ctrl : controls_)
+		ids_.push_back(ctrl.id->id());
+
 	reset();
 }
 
+DelayedControls::Control *DelayedControls::findControl(unsigned int id)
+{
+	for (Control &ctrl : controls_) {
+		if (ctrl.id->id() == id)
+			return &ctrl;
+	}
+
+	return nullptr;
+}
+
 /**
  * \brief Reset state machine
+ * \param[in] cookie The cookie associated with the initial controls
  *
  * Resets the state machine to a starting position based on control values
  * retrieved from the device.
  */
-void DelayedControls::reset()
+void DelayedControls::reset(unsigned int cookie)
 {
 	queueCount_ = 1;
 	writeCount_ = 0;
+	cookies_[0] = cookie;
 
 	/* Retrieve control as reported by the device. */
-	std::vector<uint32_t> ids;
-	for (auto const &param : controlParams_)
-		ids.push_back(param.first->id());
-
-	ControlList controls = device_->getControls(ids);
+	ControlList controls = device_->getControls(ids_);
 
 	/* Seed the control queue with the controls reported by the device. */
-	values_.clear();
-	for (const auto &ctrl : controls) {
-		const ControlId *id = device_->controls().idmap().at(ctrl.first);
+	for (Control &ctrl : controls_)
+		ctrl.values = {};
+
+	for (const auto &[id, value] : controls) {
+		Control *ctrl = findControl(id);
+		if (!ctrl)
+			continue;
+
 		/*
 		 * Do not mark this control value as updated, it does not need
 		 * to be written to to device on startup.
 		 */
-		values_[id][0] = Info(ctrl.second, false);
+		ctrl->values[0] = Info(value, false);
 	}
 }
 
 /**
  * \brief Push a set of controls on the queue
  * \param[in] controls List of controls to add to the device queue
+ * \param[in] cookie The cookie associated with \a controls
  *
  * Push a set of controls to the control queue. This increases the control queue
  * depth by one.
  *
  * \returns true if \a controls are accepted, or false otherwise
  */
-bool DelayedControls::push(const ControlList &controls)
+bool DelayedControls::push(const ControlList &controls, unsigned int cookie)
 {
 	/* Copy state from previous frame. */
-	for (auto &ctrl : values_) {
-		Info &info = ctrl.second[queueCount_];
-		info = values_[ctrl.first][queueCount_ - 1];
+	for (Control &ctrl : controls_) {
+		Info &info = ctrl.values[queueCount_];
+		info = ctrl.values[queueCount_ - 1];
 		info.updated = false;
 	}
 
 	/* Update with new controls. */
-	const ControlIdMap &idmap = device_->controls().idmap();
 	for (const auto &control : controls) {
-		const auto &it = idmap.find(control.first);
-		if (it == idmap.end()) {
-			LOG(DelayedControls, Warning)
-				<< "Unknown control " << control.first;
+		Control *ctrl = findControl(control.first);
+		if (!ctrl) {
+			if (!device_->controls().idmap().count(control.first))
+				LOG(DelayedControls, Warning)
+					<< "Unknown control " << control.first;
 			return false;
 		}
 
-		const ControlId *id = it->second;
-
-		if (controlParams_.find(id) == controlParams_.end())
-			return false;
-
-		Info &info = values_[id][queueCount_];
+		Info &info = ctrl->values[queueCount_];
 
 		info = Info(control.second);
 
 		LOG(DelayedControls, Debug)
-			<< "Queuing " << id->name()
+			<< "Queuing " << ctrl->id->name()
 			<< " to " << info.toString()
 			<< " at index " << queueCount_;
 	}
 
+	cookies_[queueCount_] = cookie;
 	queueCount_++;
 
 	return true;
@@ -188,6 +221,7 @@ bool DelayedControls::push(const ControlList &controls)
 /**
  * \brief Read back controls in effect at a sequence number
  * \param[in] sequence The sequence number to get controls for
+ * \param[out] cookie The cookie associated with the controls, if not null
  *
  * Read back what controls where in effect at a specific sequence number. The
  * history is a ring buffer of 16 entries where new and old values coexist. It's
@@ -198,26 +232,30 @@ bool DelayedControls::push(const ControlList &controls)
  * push(). The max history from the current sequence number that yields valid
  * values are thus 16 minus number of controls pushed.
  *
+ * The returned list is reused by the next call to get(), callers that need to
+ * keep the controls shall copy it.
+ *
  * \return The controls at \a sequence number
  */
-ControlList DelayedControls::get(uint32_t sequence)
+const ControlList &DelayedControls::get(uint32_t sequence, unsigned int *cookie)
 {
 	unsigned int index = std::max<int>(0, sequence - maxDelay_);
 
-	ControlList out(device_->controls());
-	for (const auto &ctrl : values_) {
-		const ControlId *id = ctrl.first;
-		const Info &info = ctrl.second[index];
+	for (const Control &ctrl : controls_) {
+		const Info &info = ctrl.values[index];
 
-		out.set(id->id(), info);
+		current_.set(ctrl.id->id(), info);
 
 		LOG(DelayedControls, Debug)
-			<< "Reading " << id->name()
+			<< "Reading " << ctrl.id->name()
 			<< " to " << info.toString()
 			<< " at index " << index;
 	}
 
-	return out;
+	if (cookie)
+		*cookie = cookies_[index];
+
+	return current_;
 }
 
 /**
@@ -237,32 +275,31 @@ void DelayedControls::applyControls(uint32_t sequence)
 	 * Create control list peeking ahead in the value queue to ensure
 	 * values are set in time to satisfy the sensor delay.
 	 */
-	ControlList out(device_->controls());
-	for (auto &ctrl : values_) {
-		const ControlId *id = ctrl.first;
-		unsigned int delayDiff = maxDelay_ - controlParams_[id].delay;
+	pending_.clear();
+	for (Control &ctrl : controls_) {
+		unsigned int delayDiff = maxDelay_ - ctrl.params.delay;
 		unsigned int index = std::max<int>(0, writeCount_ - delayDiff);
-		Info &info = ctrl.second[index];
+		Info &info = ctrl.values[index];
 
 		if (info.updated) {
-			if (controlParams_[id].priorityWrite) {
+			if (ctrl.params.priorityWrite) {
 				/*
 				 * This control must be written now, it could
 				 * affect validity of the other controls.
 				 */
-				ControlList priority(device_->controls());
-				priority.set(id->id(), info);
-				device_->setControls(&priority);
+				priority_.clear();
+				priority_.set(ctrl.id->id(), info);
+				device_->setControls(&priority_);
 			} else {
 				/*
 				 * Batch up the list of controls and write them
 				 * at the end of the function.
 				 */
-				out.set(id->id(), info);
+				pending_.set(ctrl.id->id(), info);
 			}
 
 			LOG(DelayedControls, Debug)
-				<< "Setting " << id->name()
+				<< "Setting " << ctrl.id->name()
 				<< " to " << info.toString()
 				<< " at index " << index;
 
@@ -276,10 +313,14 @@ void DelayedControls::applyControls(uint32_t sequence)
 	while (writeCount_ > queueCount_) {
 		LOG(DelayedControls, Debug)
 			<< "Queue is empty, auto queue no-op.";
-		push({});
+		push({}, cookies_[queueCount_ - 1]);
 	}
 
-	device_->setControls(&out);
+	LIBCAMERA_TRACEPOINT(delayed_controls_apply, device_->deviceNode().c_str(),
+			     sequence, pending_.size());
+
+	if (!pending_.empty())
+		device_->setControls(&pending_);
 }
 
 } /* namespace libcamera */
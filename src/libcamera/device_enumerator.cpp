@@ -10,6 +10,7 @@
 #include <string.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread_pool.h>
 
 #include "libcamera/internal/device_enumerator_sysfs.h"
 #include "libcamera/internal/device_enumerator_udev.h"
@@ -234,14 +235,55 @@ std::unique_ptr<MediaDevice> DeviceEnumerator::createDevice(const std::string &d
 	return media;
 }
 
+/**
+ * \brief Create multiple media device instances concurrently
+ * \param[in] deviceNodes Paths to the media devices to create
+ *
+ * Create a media device for each entry of \a deviceNodes as createDevice()
+ * does. Populating a media graph is a sequence of blocking ioctls, the media
+ * devices are thus created in parallel on the process-wide thread pool, which
+ * shortens enumeration on systems with multiple media devices.
+ *
+ * The returned media devices are stored in the same order as \a deviceNodes,
+ * to keep the order in which they are added to the enumerator, and thus the
+ * order of cameras, deterministic.
+ *
+ * \return The created media device instances, with a nullptr entry for each
+ * device that failed to be created
+ */
+std::vector<std::unique_ptr<MediaDevice>>
+DeviceEnumerator::createDevices(const std::vector<std::string> &deviceNodes)
+{
+	std::vector<std::unique_ptr<MediaDevice>> devices(deviceNodes.size());
+
+	if (deviceNodes.size() <= 1) {
+		if (!deviceNodes.empty())
+			devices[0] = createDevice(deviceNodes[0]);
+		return devices;
+	}
+
+	TaskGroup tasks;
+
+	for (unsigned int i = 0; i < deviceNodes.size(); ++i) {
+		tasks.run([this, &deviceNodes, &devices, i]() {
+			devices[i] = createDevice(deviceNodes[i]);
+		});
+	}
+
+	tasks.wait();
+
+	return devices;
+}
+
 /**
 * \var DeviceEnumerator::devicesAdded
 * \brief Notify of new media devices being found
 *
 * This signal is emitted when the device enumerator finds new media devices in
 * the system. It may be emitted for every newly detected device, or once for
-* multiple devices, at the discretion of the device enumerator. Not all device
-* enumerator types may support dynamic detection of new devices.
+* multiple devices, at the discretion of the device enumerator. It is not
+* emitted for the devices found by enumerate(). Not all device enumerator types
+* may support dynamic detection of new devices.
 */
 
 /**
@@ -259,9 +301,6 @@ void DeviceEnumerator::addDevice(std::unique_ptr<MediaDevice> media)
 		<< "Added device " << media->deviceNode() << ": " << media->driver();
 
 	devices_.push_back(std::move(media));
-
-	/* \todo To batch multiple additions, emit with a small delay here. */
-	devicesAdded.emit();
 }
 
 /**
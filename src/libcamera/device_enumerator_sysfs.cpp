@@ -53,6 +53,8 @@ int DeviceEnumeratorSysfs::enumerate()
 		return -ENODEV;
 	}
 
+	std::vector<std::string> devnodes;
+
 	while ((ent = readdir(dir)) != nullptr) {
 		if (strncmp(ent->d_name, "media", 5))
 			continue;
@@ -73,7 +75,12 @@ int DeviceEnumeratorSysfs::enumerate()
 			continue;
 		}
 
-		std::unique_ptr<MediaDevice> media = createDevice(devnode);
+		devnodes.push_back(devnode);
+	}
+
+	closedir(dir);
+
+	for (std::unique_ptr<MediaDevice> &media : createDevices(devnodes)) {
 		if (!media)
 			continue;
 
@@ -88,8 +95,6 @@ int DeviceEnumeratorSysfs::enumerate()
 		addDevice(std::move(media));
 	}
 
-	closedir(dir);
-
 	return 0;
 }
 
@@ -8,6 +8,7 @@
 #include "libcamera/internal/device_enumerator_udev.h"
 
 #include <algorithm>
+#include <chrono>
 #include <fcntl.h>
 #include <libudev.h>
 #include <list>
@@ -17,6 +18,7 @@
 #include <sys/ioctl.h>
 #include <sys/sysmacros.h>
 #include <unistd.h>
+#include <vector>
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
@@ -27,15 +29,32 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(DeviceEnumerator)
 
+namespace {
+
+/*
+ * Delay between the last hotplug event and the processing of the batch of
+ * added devices. Plugging a USB hub with multiple cameras generates a burst of
+ * events, this processes them with a single pipeline handlers match. The
+ * processing of a batch is never delayed by more than kHotplugMaxDelay.
+ */
+constexpr std::chrono::milliseconds kHotplugDelay{ 100 };
+constexpr std::chrono::milliseconds kHotplugMaxDelay{ 500 };
+
+} /* namespace */
+
 DeviceEnumeratorUdev::DeviceEnumeratorUdev()
-	: udev_(nullptr), monitor_(nullptr), notifier_(nullptr)
+	: udev_(nullptr), monitor_(nullptr), notifier_(nullptr), added_(0)
 {
+	timer_.timeout.connect(this, &DeviceEnumeratorUdev::processEvents);
 }
 
 DeviceEnumeratorUdev::~DeviceEnumeratorUdev()
 {
 	delete notifier_;
 
+	for (struct udev_device *dev : events_)
+		udev_device_unref(dev);
+
 	if (monitor_)
 		udev_monitor_unref(monitor_);
 	if (udev_)
@@ -82,32 +101,7 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 		if (!media)
 			return -ENODEV;
 
-		DependencyMap deps;
-		int ret = populateMediaDevice(media.get(), &deps);
-		if (ret < 0) {
-			LOG(DeviceEnumerator, Warning)
-				<< "Failed to populate media device "
-				<< media->deviceNode()
-				<< " (" << media->driver() << "), skipping";
-			return ret;
-		}
-
-		if (!deps.empty()) {
-			LOG(DeviceEnumerator, Debug)
-				<< "Defer media device " << media->deviceNode()
-				<< " due to " << deps.size()
-				<< " missing dependencies";
-
-			pending_.emplace_back(std::move(media), std::move(deps));
-			MediaDeviceDeps *mediaDeps = &pending_.back();
-			for (const auto &dep : mediaDeps->deps_)
-				devMap_[dep.first] = mediaDeps;
-
-			return 0;
-		}
-
-		addDevice(std::move(media));
-		return 0;
+		return addMediaDevice(std::move(media));
 	}
 
 	if (!strcmp(subsystem, "video4linux")) {
@@ -118,10 +112,45 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 	return -ENODEV;
 }
 
+int DeviceEnumeratorUdev::addMediaDevice(std::unique_ptr<MediaDevice> media)
+{
+	DependencyMap deps;
+	int ret = populateMediaDevice(media.get(), &deps);
+	if (ret < 0) {
+		LOG(DeviceEnumerator, Warning)
+			<< "Failed to populate media device "
+			<< media->deviceNode()
+			<< " (" << media->driver() << "), skipping";
+		return ret;
+	}
+
+	if (!deps.empty()) {
+		LOG(DeviceEnumerator, Debug)
+			<< "Defer media device " << media->deviceNode()
+			<< " due to " << deps.size()
+			<< " missing dependencies";
+
+		pending_.emplace_back(std::move(media), std::move(deps));
+		MediaDeviceDeps *mediaDeps = &pending_.back();
+		for (const auto &dep : mediaDeps->deps_)
+			devMap_[dep.first] = mediaDeps;
+
+		return 0;
+	}
+
+	addDevice(std::move(media));
+	added_++;
+	return 0;
+}
+
 int DeviceEnumeratorUdev::enumerate()
 {
 	struct udev_enumerate *udev_enum = nullptr;
 	struct udev_list_entry *ents, *ent;
+	std::vector<struct udev_device *> devices;
+	std::vector<std::string> mediaNodes;
+	std::vector<std::unique_ptr<MediaDevice>> mediaDevices;
+	std::vector<std::unique_ptr<MediaDevice>>::iterator media;
 	int ret;
 
 	udev_enum = udev_enumerate_new(udev_);
@@ -170,10 +199,35 @@ int DeviceEnumeratorUdev::enumerate()
 			continue;
 		}
 
-		if (addUdevDevice(dev) < 0)
+		devices.push_back(dev);
+
+		const char *subsystem = udev_device_get_subsystem(dev);
+		if (subsystem && !strcmp(subsystem, "media"))
+			mediaNodes.push_back(devnode);
+	}
+
+	/*
+	 * Create all the media devices concurrently, and then add them and the
+	 * V4L2 devices in enumeration order.
+	 */
+	mediaDevices = createDevices(mediaNodes);
+	media = mediaDevices.begin();
+
+	for (struct udev_device *dev : devices) {
+		const char *syspath = udev_device_get_syspath(dev);
+		const char *subsystem = udev_device_get_subsystem(dev);
+
+		if (subsystem && !strcmp(subsystem, "media")) {
+			if (!*media || addMediaDevice(std::move(*media)) < 0)
+				LOG(DeviceEnumerator, Warning)
+					<< "Failed to add device for '"
+					<< syspath << "', skipping";
+			++media;
+		} else if (addUdevDevice(dev) < 0) {
 			LOG(DeviceEnumerator, Warning)
 				<< "Failed to add device for '"
 				<< syspath << "', skipping";
+		}
 
 		udev_device_unref(dev);
 	}
@@ -324,29 +378,107 @@ int DeviceEnumeratorUdev::addV4L2Device(dev_t devnum)
 			<< deps->media_->deviceNode() << " found";
 		addDevice(std::move(deps->media_));
 		pending_.remove(*deps);
+		added_++;
 	}
 
 	return 0;
 }
 
+/*
+ * Remove a media device, dropping it from the pending devices if its
+ * dependencies haven't all been found yet.
+ */
+void DeviceEnumeratorUdev::removeMediaDevice(const std::string &deviceNode)
+{
+	for (MediaDeviceDeps &deps : pending_) {
+		if (deps.media_->deviceNode() != deviceNode)
+			continue;
+
+		for (const auto &dep : deps.deps_)
+			devMap_.erase(dep.first);
+
+		LOG(DeviceEnumerator, Debug)
+			<< "Pending media device " << deviceNode << " removed";
+
+		pending_.remove(deps);
+		return;
+	}
+
+	removeDevice(deviceNode);
+}
+
 void DeviceEnumeratorUdev::udevNotify()
 {
-	struct udev_device *dev = udev_monitor_receive_device(monitor_);
-	std::string_view action(udev_device_get_action(dev));
-	std::string_view deviceNode(udev_device_get_devnode(dev));
+	struct udev_device *dev;
 
-	LOG(DeviceEnumerator, Debug)
-		<< action << " device " << deviceNode;
+	/* Drain all the events available on the monitor socket. */
+	while ((dev = udev_monitor_receive_device(monitor_))) {
+		std::string_view action(udev_device_get_action(dev));
+		const char *node = udev_device_get_devnode(dev);
+		std::string_view deviceNode(node ? node : "");
+
+		LOG(DeviceEnumerator, Debug)
+			<< action << " device " << deviceNode;
+
+		if (action == "add") {
+			auto now = std::chrono::steady_clock::now();
+			if (events_.empty())
+				batchStart_ = now;
+
+			events_.push_back(dev);
+			timer_.start(std::min(now + kHotplugDelay,
+					      batchStart_ + kHotplugMaxDelay));
+			continue;
+		}
+
+		if (action == "remove") {
+			/*
+			 * A device removed before its addition has been
+			 * processed is ignored.
+			 */
+			auto iter = std::find_if(events_.begin(), events_.end(),
+						 [&](struct udev_device *event) {
+							 const char *n = udev_device_get_devnode(event);
+							 return n && deviceNode == n;
+						 });
+			if (iter != events_.end()) {
+				udev_device_unref(*iter);
+				events_.erase(iter);
+			} else {
+				const char *subsystem = udev_device_get_subsystem(dev);
+				if (subsystem && !strcmp(subsystem, "media"))
+					removeMediaDevice(std::string(deviceNode));
+			}
+		}
+
+		udev_device_unref(dev);
+	}
+}
 
-	if (action == "add") {
+/*
+ * Process a batch of added devices, and notify pipeline handlers once if new
+ * media devices are ready to be matched.
+ */
+void DeviceEnumeratorUdev::processEvents()
+{
+	std::vector<struct udev_device *> events = std::move(events_);
+	events_.clear();
+
+	added_ = 0;
+
+	for (struct udev_device *dev : events) {
 		addUdevDevice(dev);
-	} else if (action == "remove") {
-		const char *subsystem = udev_device_get_subsystem(dev);
-		if (subsystem && !strcmp(subsystem, "media"))
-			removeDevice(std::string(deviceNode));
+		udev_device_unref(dev);
 	}
 
-	udev_device_unref(dev);
+	if (!added_)
+		return;
+
+	LOG(DeviceEnumerator, Debug)
+		<< "Processed " << events.size() << " hotplug events, "
+		<< added_ << " media devices added";
+
+	devicesAdded.emit();
 }
 
 } /* namespace libcamera */
@@ -9,6 +9,7 @@
 #include "libcamera/internal/dma_buf_allocator.h"
 
 #include <array>
+#include <deque>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -22,6 +23,10 @@
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/memfd.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/shared_fd.h>
+
+#include "libcamera/internal/framebuffer.h"
 
 /**
  * \file dma_buf_allocator.cpp
@@ -60,6 +65,19 @@ LOG_DEFINE_CATEGORY(DmaBufAllocator)
  * Different providers may provide dma-buffers with different properties for
  * the underlying memory. Which providers are acceptable is specified through
  * the type argument passed to the DmaBufAllocator() constructor.
+ *
+ * Allocating dma-buffers is expensive, and frequent allocations of large
+ * physically-contiguous buffers fragment the CMA area. The allocator can keep
+ * released buffers in a pool, sorted in size classes, to serve later
+ * allocations of the same size class without going through the provider. The
+ * pool is disabled by default, and is enabled by setting its size limit with
+ * setPoolLimit(). Buffers are returned to the pool explicitly with recycle(),
+ * or automatically when frame buffers created by exportFrameBuffer() are
+ * destroyed.
+ *
+ * Large buffers accessed by the CPU, such as the buffers of a software ISP,
+ * suffer from TLB misses when they are backed by regular pages. Use cases that
+ * access buffers in full can opt in to huge pages with setHugePages().
  */
 
 /**
@@ -78,6 +96,137 @@ LOG_DEFINE_CATEGORY(DmaBufAllocator)
  * \brief A bitwise combination of DmaBufAllocator::DmaBufAllocatorFlag values
  */
 
+#ifndef __DOXYGEN__
+class DmaBufAllocator::Pool
+{
+public:
+	Pool()
+		: limit_(0), size_(0)
+	{
+	}
+
+	std::size_t sizeClass(std::size_t size);
+	void setLimit(std::size_t bytes);
+
+	UniqueFD get(std::size_t size);
+	void put(UniqueFD fd);
+
+private:
+	struct Entry {
+		std::size_t size;
+		UniqueFD fd;
+	};
+
+	void trim() LIBCAMERA_TSA_REQUIRES(lock_);
+
+	Mutex lock_;
+	std::size_t limit_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+	std::size_t size_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+	/* Pooled buffers, from the least to the most recently recycled. */
+	std::deque<Entry> buffers_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+};
+
+/*
+ * Round the size up to its size class when the pool is enabled. Sizes are
+ * rounded to a whole number of pages, and sizes larger than 16 pages to a
+ * multiple of 1/16th of their largest power of two, which bounds the wasted
+ * memory to 6.25% while letting buffers of slightly different sizes share a
+ * size class.
+ */
+std::size_t DmaBufAllocator::Pool::sizeClass(std::size_t size)
+{
+	{
+		MutexLocker locker(lock_);
+		if (!limit_)
+			return size;
+	}
+
+	const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+	std::size_t step = pageSize;
+
+	while (size > step * 16)
+		step *= 2;
+
+	return (size + step - 1) / step * step;
+}
+
+void DmaBufAllocator::Pool::setLimit(std::size_t bytes)
+{
+	MutexLocker locker(lock_);
+
+	limit_ = bytes;
+	trim();
+}
+
+UniqueFD DmaBufAllocator::Pool::get(std::size_t size)
+{
+	MutexLocker locker(lock_);
+
+	for (auto it = buffers_.rbegin(); it != buffers_.rend(); ++it) {
+		if (it->size != size)
+			continue;
+
+		UniqueFD fd = std::move(it->fd);
+		size_ -= it->size;
+		buffers_.erase(std::next(it).base());
+		return fd;
+	}
+
+	return {};
+}
+
+void DmaBufAllocator::Pool::put(UniqueFD fd)
+{
+	off_t size = lseek(fd.get(), 0, SEEK_END);
+	if (size < 0)
+		return;
+
+	MutexLocker locker(lock_);
+
+	if (static_cast<std::size_t>(size) > limit_)
+		return;
+
+	buffers_.push_back({ static_cast<std::size_t>(size), std::move(fd) });
+	size_ += size;
+	trim();
+}
+
+void DmaBufAllocator::Pool::trim()
+{
+	while (size_ > limit_) {
+		size_ -= buffers_.front().size;
+		buffers_.pop_front();
+	}
+}
+
+class DmaBufAllocator::PooledFrameBuffer : public FrameBuffer::Private
+{
+public:
+	PooledFrameBuffer(const std::vector<FrameBuffer::Plane> &planes,
+			  SharedFD fd, std::weak_ptr<Pool> pool)
+		: FrameBuffer::Private(planes), fd_(std::move(fd)),
+		  pool_(std::move(pool))
+	{
+	}
+
+	~PooledFrameBuffer()
+	{
+		/*
+		 * The planes and fd_ share the only descriptor of the dma-buf
+		 * while the frame buffer is in use, duplicate it to recycle the
+		 * dma-buf.
+		 */
+		std::shared_ptr<Pool> pool = pool_.lock();
+		if (pool)
+			pool->put(fd_.dup());
+	}
+
+private:
+	SharedFD fd_;
+	std::weak_ptr<Pool> pool_;
+};
+#endif /* __DOXYGEN__ */
+
 /**
  * \brief Construct a DmaBufAllocator of a given type
  * \param[in] type The type(s) of the dma-buf providers to allocate from
@@ -90,11 +239,43 @@ LOG_DEFINE_CATEGORY(DmaBufAllocator)
  * Multiple types can be selected by combining type flags, in which case
  * the constructed DmaBufAllocator will match one of the types. If multiple
  * requested types can work on the system, which provider is used is undefined.
+ * Use the DmaBufAllocator(std::initializer_list<DmaBufAllocatorFlag>)
+ * constructor to select the provider by order of preference.
  */
 DmaBufAllocator::DmaBufAllocator(DmaBufAllocatorFlags type)
+	: hugePages_(false), pool_(std::make_shared<Pool>())
+{
+	if (!open(type))
+		LOG(DmaBufAllocator, Error) << "Could not open any dma-buf provider";
+}
+
+/**
+ * \brief Construct a DmaBufAllocator from a list of preferred types
+ * \param[in] preferences The types of the dma-buf providers, by order of
+ * preference
+ *
+ * The dma-buf provider is the first provider in the \a preferences list that
+ * can be accessed. This allows use cases to express policies such as
+ * preferring physically-contiguous memory, but falling back to the system heap
+ * or udmabuf when no CMA heap is available. If none of the providers can be
+ * accessed, the constructed DmaBufAllocator instance is invalid as indicated by
+ * the isValid() function.
+ */
+DmaBufAllocator::DmaBufAllocator(std::initializer_list<DmaBufAllocatorFlag> preferences)
+	: hugePages_(false), pool_(std::make_shared<Pool>())
+{
+	for (DmaBufAllocatorFlag type : preferences) {
+		if (open(type))
+			return;
+	}
+
+	LOG(DmaBufAllocator, Error) << "Could not open any dma-buf provider";
+}
+
+bool DmaBufAllocator::open(DmaBufAllocatorFlags types)
 {
 	for (const auto &info : providerInfos) {
-		if (!(type & info.type))
+		if (!(types & info.type))
 			continue;
 
 		int ret = ::open(info.deviceNodeName, O_RDWR | O_CLOEXEC, 0);
@@ -109,11 +290,10 @@ DmaBufAllocator::DmaBufAllocator(DmaBufAllocatorFlags type)
 		LOG(DmaBufAllocator, Debug) << "Using " << info.deviceNodeName;
 		providerHandle_ = UniqueFD(ret);
 		type_ = info.type;
-		break;
+		return true;
 	}
 
-	if (!providerHandle_.isValid())
-		LOG(DmaBufAllocator, Error) << "Could not open any dma-buf provider";
+	return false;
 }
 
 /**
@@ -126,29 +306,83 @@ DmaBufAllocator::~DmaBufAllocator() = default;
  * \brief Check if the DmaBufAllocator instance is valid
  * \return True if the DmaBufAllocator is valid, false otherwise
  */
+
+/**
+ * \fn DmaBufAllocator::type()
+ * \brief Retrieve the type of the dma-buf provider
+ *
+ * The return value is undefined if the DmaBufAllocator instance is invalid.
+ *
+ * \return The type of the dma-buf provider used by the allocator
+ */
+
 UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
 {
 	/* Size must be a multiple of the page size. Round it up. */
 	std::size_t pageMask = sysconf(_SC_PAGESIZE) - 1;
 	size = (size + pageMask) & ~pageMask;
 
+	/*
+	 * Try huge pages first when enabled. The huge page pool may be empty,
+	 * and older kernels don't support udmabuf on hugetlbfs, fall back to
+	 * regular pages silently in that case.
+	 */
+	std::size_t hugePageSize = MemFd::hugePageSize();
+	if (hugePages_ && hugePageSize && size >= hugePageSize) {
+		UniqueFD fd = createUDmaBuf(name, size, MemFd::Option::HugePages);
+		if (fd.isValid())
+			return fd;
+
+		LOG(DmaBufAllocator, Debug)
+			<< "Huge pages unavailable for " << name
+			<< ", using regular pages";
+	}
+
+	UniqueFD fd = createUDmaBuf(name, size, MemFd::Option::None);
+	if (!fd.isValid())
+		LOG(DmaBufAllocator, Error)
+			<< "Failed to create dma buf for " << name;
+
+	return fd;
+}
+
+UniqueFD DmaBufAllocator::createUDmaBuf(const char *name, std::size_t size,
+					MemFd::Options options)
+{
 	/* udmabuf dma-buffers *must* have the F_SEAL_SHRINK seal. */
-	UniqueFD memfd = MemFd::create(name, size, MemFd::Seal::Shrink);
+	UniqueFD memfd = MemFd::create(name, size, MemFd::Seal::Shrink, options);
 	if (!memfd.isValid())
 		return {};
 
+	/* The memfd size may have been rounded up to the huge page size. */
+	off_t length = lseek(memfd.get(), 0, SEEK_END);
+	if (length < 0)
+		return {};
+
+	/*
+	 * Huge pages are only allocated when used. Fault them in now, to
+	 * detect an exhausted pool here instead of with a SIGBUS later.
+	 */
+	if ((options & MemFd::Option::HugePages) &&
+	    fallocate(memfd.get(), 0, 0, length) < 0) {
+		LOG(DmaBufAllocator, Debug)
+			<< "Failed to reserve huge pages for " << name
+			<< ": " << strerror(errno);
+		return {};
+	}
+
 	struct udmabuf_create create;
 
 	create.memfd = memfd.get();
 	create.flags = UDMABUF_FLAGS_CLOEXEC;
 	create.offset = 0;
-	create.size = size;
+	create.size = length;
 
 	int ret = ::ioctl(providerHandle_.get(), UDMABUF_CREATE, &create);
 	if (ret < 0) {
 		ret = errno;
-		LOG(DmaBufAllocator, Error)
-			<< "Failed to create dma buf for " << name
+		LOG(DmaBufAllocator, Debug)
+			<< "UDMABUF_CREATE failed for " << name
 			<< ": " << strerror(ret);
 		return {};
 	}
@@ -188,7 +422,9 @@ UniqueFD DmaBufAllocator::allocFromHeap(const char *name, std::size_t size)
  * \param [in] name The name to set for the allocated buffer
  * \param [in] size The size of the buffer to allocate
  *
- * Allocates a dma-buf with read/write access.
+ * Allocates a dma-buf with read/write access. When the pool is enabled, the
+ * size is rounded up to its size class, and a pooled buffer of the same size
+ * class is reused if available.
  *
  * If the allocation fails, return an invalid UniqueFD.
  *
@@ -199,10 +435,130 @@ UniqueFD DmaBufAllocator::alloc(const char *name, std::size_t size)
 	if (!name)
 		return {};
 
+	/*
+	 * Round large buffers to the huge page size before looking up the pool,
+	 * to let pooled huge page buffers be reused.
+	 */
+	std::size_t hugePageSize = MemFd::hugePageSize();
+	if (hugePages_ && type_ == DmaBufAllocatorFlag::UDmaBuf &&
+	    hugePageSize && size >= hugePageSize)
+		size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+
+	size = pool_->sizeClass(size);
+
+	UniqueFD fd = pool_->get(size);
+	if (fd.isValid()) {
+		/* Renaming is informative only, ignore errors. */
+		::ioctl(fd.get(), DMA_BUF_SET_NAME, name);
+
+		LOG(DmaBufAllocator, Debug)
+			<< "Reusing pooled dma-buf of " << size
+			<< " bytes for " << name;
+		return fd;
+	}
+
 	if (type_ == DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf)
 		return allocFromUDmaBuf(name, size);
 	else
 		return allocFromHeap(name, size);
 }
 
+/**
+ * \brief Set the maximum size of the buffer pool
+ * \param[in] bytes The maximum total size of the pooled buffers, in bytes
+ *
+ * Recycled buffers are kept in the pool as long as the total size of the pooled
+ * buffers doesn't exceed \a bytes, the least recently recycled buffers are
+ * freed first. A limit of 0, the default, disables the pool and frees all
+ * pooled buffers.
+ */
+void DmaBufAllocator::setPoolLimit(std::size_t bytes)
+{
+	pool_->setLimit(bytes);
+}
+
+/**
+ * \brief Enable or disable huge pages for large buffers
+ * \param[in] enable Whether to use huge pages
+ *
+ * When enabled, buffers of at least one huge page allocated from udmabuf are
+ * backed by huge pages, and their size is rounded up to a multiple of the huge
+ * page size. This reduces the cost of CPU accesses to large buffers. Huge pages
+ * are taken from the pool reserved by the system administrator
+ * (/proc/sys/vm/nr_hugepages), allocations fall back to regular pages when the
+ * pool is exhausted. The option has no effect for dma-heap providers, which
+ * manage their memory themselves. Huge pages are disabled by default.
+ */
+void DmaBufAllocator::setHugePages(bool enable)
+{
+	hugePages_ = enable;
+}
+
+/**
+ * \brief Return a buffer to the pool
+ * \param[in] fd The buffer
+ *
+ * The buffer \a fd, allocated by this allocator, is added to the pool to be
+ * reused by later allocations, or freed if the pool is disabled or the buffer
+ * doesn't fit in the pool. The caller shall ensure that no other reference to
+ * the buffer is in use, as the memory will be handed to another user.
+ *
+ * This function is thread-safe.
+ */
+void DmaBufAllocator::recycle(UniqueFD fd)
+{
+	if (fd.isValid())
+		pool_->put(std::move(fd));
+}
+
+/**
+ * \brief Allocate a frame buffer backed by a single dma-buf
+ * \param[in] name The name to set for the allocated buffer
+ * \param[in] size The size of the buffer to allocate
+ * \param[in] planes The frame buffer planes
+ *
+ * Allocate a dma-buf of \a size bytes with alloc(), and create a frame buffer
+ * with \a planes stored in the dma-buf. The file descriptor of the planes is
+ * set by this function, their offset and length shall be set by the caller.
+ *
+ * The memory type of the frame buffer is set according to the dma-buf
+ * provider, for memory accounting with MemoryAccount.
+ *
+ * When the frame buffer is destroyed, the dma-buf is recycled in the pool of
+ * this allocator, if the allocator still exists. Users of the frame buffer
+ * shall thus not keep references to the dma-buf file descriptor after
+ * destroying the frame buffer.
+ *
+ * \return The frame buffer on success, or nullptr if the allocation fails
+ */
+std::unique_ptr<FrameBuffer>
+DmaBufAllocator::exportFrameBuffer(const char *name, std::size_t size,
+				   std::vector<FrameBuffer::Plane> planes)
+{
+	UniqueFD fd = alloc(name, size);
+	if (!fd.isValid())
+		return nullptr;
+
+	SharedFD shared(std::move(fd));
+
+	for (FrameBuffer::Plane &plane : planes)
+		plane.fd = shared;
+
+	auto buffer = std::make_unique<PooledFrameBuffer>(planes, shared, pool_);
+
+	switch (type_) {
+	case DmaBufAllocatorFlag::CmaHeap:
+		buffer->setMemoryType(MemoryUsage::Type::DmaHeapCma);
+		break;
+	case DmaBufAllocatorFlag::SystemHeap:
+		buffer->setMemoryType(MemoryUsage::Type::DmaHeapSystem);
+		break;
+	case DmaBufAllocatorFlag::UDmaBuf:
+		buffer->setMemoryType(MemoryUsage::Type::Anonymous);
+		break;
+	}
+
+	return std::make_unique<FrameBuffer>(std::move(buffer));
+}
+
 } /* namespace libcamera */
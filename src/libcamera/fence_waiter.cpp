@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Shared waiter for frame buffer fences
+ */
+
+#include "libcamera/internal/fence_waiter.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+
+#include <libcamera/fence.h>
+
+#include "libcamera/internal/framebuffer.h"
+
+/**
+ * \file fence_waiter.h
+ * \brief Shared waiter for frame buffer fences
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Fence)
+
+/*
+ * Maximum number of fences retrieved per wait. Further fences are reported by
+ * the next iteration of the event loop, as the waiter is level-triggered.
+ */
+static constexpr unsigned int kMaxEvents = 16;
+
+/**
+ * \class FenceWaiter
+ * \brief Wait for the fences of frame buffers to be signalled
+ *
+ * The FenceWaiter class waits for the acquire fences of frame buffers, and
+ * emits the signalled signal when a fence is signalled. It is meant to be
+ * shared by all requests of a camera.
+ *
+ * Instead of creating one EventNotifier per fence, the fence file descriptors
+ * are added to an internal epoll instance. Only the epoll file descriptor is
+ * registered with the event dispatcher, once, through a single notifier.
+ * Waiting for a fence thus costs one epoll_ctl() call to add it and one to
+ * remove it, and all fences signalled at the same time are reported in one
+ * event loop iteration.
+ *
+ * The epoll instance and the notifier are created when the first fence is
+ * added, and are bound to the thread that adds it. All functions shall be
+ * called from that thread.
+ */
+
+/**
+ * \brief Construct a FenceWaiter
+ */
+FenceWaiter::FenceWaiter() = default;
+
+FenceWaiter::~FenceWaiter() = default;
+
+/**
+ * \brief Wait for the fence of \a buffer to be signalled
+ * \param[in] buffer The frame buffer
+ *
+ * Add the fence of \a buffer to the waiter. The signalled signal will be
+ * emitted with \a buffer when the fence is signalled, unless the buffer is
+ * removed from the waiter with remove() first. The fence is removed from the
+ * waiter before the signal is emitted.
+ *
+ * The \a buffer shall have a valid fence, and its fence file descriptor shall
+ * not be closed before the fence is removed from the waiter.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int FenceWaiter::add(FrameBuffer *buffer)
+{
+	int ret;
+
+	if (!epollFd_.isValid()) {
+		epollFd_ = UniqueFD(epoll_create1(EPOLL_CLOEXEC));
+		if (!epollFd_.isValid()) {
+			ret = -errno;
+			LOG(Fence, Error)
+				<< "Failed to create epoll instance: "
+				<< strerror(-ret);
+			return ret;
+		}
+
+		notifier_ = std::make_unique<EventNotifier>(epollFd_.get(),
+							    EventNotifier::Read);
+		notifier_->activated.connect(this, &FenceWaiter::eventsReady);
+	}
+
+	const Fence *fence = buffer->_d()->fence();
+
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.ptr = buffer;
+
+	ret = epoll_ctl(epollFd_.get(), EPOLL_CTL_ADD, fence->fd().get(), &event);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(Fence, Error)
+			<< "Failed to wait for fence " << fence->fd().get()
+			<< ": " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Stop waiting for the fence of \a buffer
+ * \param[in] buffer The frame buffer
+ *
+ * Remove the fence of \a buffer from the waiter. This function shall be called
+ * for buffers whose fence has been added and hasn't been signalled, and before
+ * the fence file descriptor is closed.
+ */
+void FenceWaiter::remove(FrameBuffer *buffer)
+{
+	const Fence *fence = buffer->_d()->fence();
+	if (!fence || !epollFd_.isValid())
+		return;
+
+	epoll_ctl(epollFd_.get(), EPOLL_CTL_DEL, fence->fd().get(), nullptr);
+}
+
+void FenceWaiter::eventsReady()
+{
+	struct epoll_event events[kMaxEvents];
+
+	int count = epoll_wait(epollFd_.get(), events, kMaxEvents, 0);
+	if (count < 0) {
+		LOG(Fence, Error) << "Failed to wait for fences: "
+				  << strerror(errno);
+		return;
+	}
+
+	/*
+	 * Remove all the signalled fences first, as the slots may close them,
+	 * and then notify the signalled buffers in order.
+	 */
+	for (int i = 0; i < count; i++)
+		remove(static_cast<FrameBuffer *>(events[i].data.ptr));
+
+	for (int i = 0; i < count; i++)
+		signalled.emit(static_cast<FrameBuffer *>(events[i].data.ptr));
+}
+
+/**
+ * \var FenceWaiter::signalled
+ * \brief Signal emitted when the fence of a frame buffer has been signalled
+ */
+
+} /* namespace libcamera */
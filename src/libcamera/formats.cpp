@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <errno.h>
+#include <unordered_map>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
@@ -148,7 +149,19 @@ namespace {
 
 const PixelFormatInfo pixelFormatInfoInvalid{};
 
-const std::map<PixelFormat, PixelFormatInfo> pixelFormatInfo{
+/*
+ * PixelFormatInfo::info() is called on hot paths, such as stride and frame
+ * size computation in validate() or buffer mapping, use a hash table to look
+ * formats up in constant time.
+ */
+struct PixelFormatHash {
+	size_t operator()(const PixelFormat &format) const noexcept
+	{
+		return std::hash<uint64_t>{}(format.modifier() ^ format.fourcc());
+	}
+};
+
+const std::unordered_map<PixelFormat, PixelFormatInfo, PixelFormatHash> pixelFormatInfo{
 	/* RGB formats. */
 	{ formats::RGB565, {
 		.name = "RGB565",
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Frame rate adaptation to the application demand
+ */
+
+#include "libcamera/internal/frame_rate_governor.h"
+
+#include <algorithm>
+#include <array>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
+/**
+ * \file frame_rate_governor.h
+ * \brief Adaptation of the camera frame rate to the application demand
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(FrameRateGovernor)
+
+/**
+ * \class FrameRateGovernor
+ * \brief Lower the frame rate of a camera when the application can't keep up
+ *
+ * Applications that process frames slower than the camera produces them, and
+ * don't set the frame rate accordingly, cause the pipeline to run out of
+ * requests. The frames captured while no request is queued are dropped, after
+ * having been read out from the sensor, transferred and sometimes processed by
+ * the ISP for nothing.
+ *
+ * The FrameRateGovernor watches the frames dropped due to starvation, as
+ * reported in the FramesDropped and FrameDropCause metadata of completed
+ * requests. When more than a fifth of the frames produced over kWindow frames
+ * are dropped, it lowers the frame rate to the rate at which the application
+ * consumes frames, with some headroom. When no frame is dropped for
+ * kProbeWindows consecutive windows, it raises the frame rate by 10% to probe
+ * for an increase of the application demand, and goes back to the previous
+ * frame rate if the probe causes frame drops. The frame rate is restored
+ * completely once the minimum frame duration of the camera is reached.
+ *
+ * The frame rate is changed by setting the FrameDurationLimits control in
+ * the next request queued to the camera, and thus goes through the AE
+ * algorithm of the IPA as for application requests. The governor stops
+ * interfering as soon as the application sets FrameDurationLimits itself.
+ *
+ * The governor applies to the whole camera, and lowers the frame rate of all
+ * its streams alike.
+ */
+
+/**
+ * \var FrameRateGovernor::kWindow
+ * \brief The number of frames over which the frame drops are counted
+ */
+
+/**
+ * \var FrameRateGovernor::kProbeWindows
+ * \brief The number of windows without frame drops before the frame rate is
+ * raised
+ */
+
+/**
+ * \brief Construct a FrameRateGovernor
+ * \param[in] frameDurationLimits The FrameDurationLimits control information
+ * of the camera
+ */
+FrameRateGovernor::FrameRateGovernor(const ControlInfo &frameDurationLimits)
+	: minDuration_(frameDurationLimits.min().get<int64_t>()),
+	  maxDuration_(frameDurationLimits.max().get<int64_t>()),
+	  active_(false), target_(0), pending_(false), probeFrom_(0),
+	  frameDurationMeasured_(0), delivered_(0), starved_(0),
+	  cleanWindows_(0)
+{
+}
+
+/**
+ * \brief Reset the governor when the camera starts
+ * \param[in] controls The controls passed to Camera::start() (may be null)
+ *
+ * The governor is active for the capture session unless the application sets
+ * the frame duration limits in the start controls.
+ */
+void FrameRateGovernor::start(const ControlList *controls)
+{
+	MutexLocker locker(mutex_);
+
+	active_ = minDuration_ > 0 && maxDuration_ >= minDuration_ &&
+		  (!controls || !controls->contains(controls::FrameDurationLimits.id()));
+	target_ = 0;
+	pending_ = false;
+	probeFrom_ = 0;
+	frameDurationMeasured_ = 0;
+	delivered_ = 0;
+	starved_ = 0;
+	cleanWindows_ = 0;
+}
+
+/**
+ * \brief Apply the frame rate to a queued request
+ * \param[inout] controls The controls of the request
+ *
+ * If the frame rate has changed since the last request, set the
+ * FrameDurationLimits control in \a controls. If the application has set the
+ * control, deactivate the governor for the rest of the capture session.
+ */
+void FrameRateGovernor::requestQueued(ControlList &controls)
+{
+	MutexLocker locker(mutex_);
+
+	if (!active_)
+		return;
+
+	if (controls.contains(controls::FrameDurationLimits.id())) {
+		LOG(FrameRateGovernor, Debug)
+			<< "Frame duration limits set by the application";
+		active_ = false;
+		return;
+	}
+
+	if (!pending_)
+		return;
+
+	int64_t minDuration = target_ ? target_ : minDuration_;
+	std::array<int64_t, 2> limits = { minDuration,
+					  std::max(minDuration, maxDuration_) };
+	controls.set(controls::FrameDurationLimits, limits);
+	pending_ = false;
+}
+
+/**
+ * \brief Account for a completed request
+ * \param[in] metadata The metadata of the request
+ *
+ * Cancelled requests shall not be passed to this function.
+ */
+void FrameRateGovernor::requestCompleted(const ControlList &metadata)
+{
+	MutexLocker locker(mutex_);
+
+	if (!active_)
+		return;
+
+	delivered_++;
+
+	const auto &dropped = metadata.get(controls::FramesDropped);
+	const auto &cause = metadata.get(controls::FrameDropCause);
+	if (dropped && cause && *cause == controls::FrameDropStarvation)
+		starved_ += *dropped;
+
+	const auto &duration = metadata.get(controls::FrameDuration);
+	if (duration)
+		frameDurationMeasured_ = *duration;
+
+	if (delivered_ + starved_ >= kWindow)
+		update();
+}
+
+void FrameRateGovernor::update()
+{
+	unsigned int produced = delivered_ + starved_;
+	int64_t current = frameDurationMeasured_ ? frameDurationMeasured_
+						 : std::max(target_, minDuration_);
+	int64_t target = target_;
+
+	if (starved_ * 5 > produced) {
+		if (probeFrom_) {
+			/* The demand hasn't increased, revert the probe. */
+			target = probeFrom_;
+		} else {
+			/*
+			 * Match the rate at which the application consumes
+			 * frames, with a 10% headroom to absorb jitter.
+			 */
+			target = current * produced / delivered_ * 9 / 10;
+		}
+
+		probeFrom_ = 0;
+		cleanWindows_ = 0;
+	} else if (!starved_) {
+		probeFrom_ = 0;
+
+		if (target_ && ++cleanWindows_ >= kProbeWindows) {
+			/* Probe for a higher demand. */
+			probeFrom_ = target_;
+			target = target_ * 9 / 10;
+			cleanWindows_ = 0;
+		}
+	}
+
+	target = std::clamp(target, minDuration_, maxDuration_);
+	if (target == minDuration_)
+		target = 0;
+
+	if (target != target_) {
+		LOG(FrameRateGovernor, Debug)
+			<< starved_ << " of " << produced
+			<< " frames dropped by starvation, frame duration "
+			<< (target ? target : minDuration_) << "us";
+
+		target_ = target;
+		pending_ = true;
+	}
+
+	delivered_ = 0;
+	starved_ = 0;
+}
+
+/**
+ * \brief Check if the governor is active
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return True if the governor controls the frame rate, false if it has been
+ * deactivated by the application
+ */
+bool FrameRateGovernor::isActive() const
+{
+	MutexLocker locker(mutex_);
+	return active_;
+}
+
+/**
+ * \brief Retrieve the minimum frame duration imposed by the governor
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The minimum frame duration in microseconds, or 0 if the governor
+ * doesn't lower the frame rate
+ */
+int64_t FrameRateGovernor::frameDuration() const
+{
+	MutexLocker locker(mutex_);
+	return target_;
+}
+
+} /* namespace libcamera */
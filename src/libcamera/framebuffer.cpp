@@ -9,10 +9,14 @@
 #include "libcamera/internal/framebuffer.h"
 
 #include <sys/stat.h>
+#include <utility>
+#include <vector>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/shared_fd.h>
 
+#include "libcamera/internal/mapped_framebuffer.h"
+
 /**
  * \file libcamera/framebuffer.h
  * \brief Frame buffer handling
@@ -125,16 +129,19 @@ LOG_DEFINE_CATEGORY(Buffer)
  */
 FrameBuffer::Private::Private(const std::vector<Plane> &planes, uint64_t cookie)
 	: planes_(planes), cookie_(cookie), request_(nullptr),
-	  isContiguous_(true)
+	  isContiguous_(true), memoryType_(MemoryUsage::Type::Device)
 {
 	metadata_.planes_.resize(planes_.size());
 }
 
 /**
  * \brief FrameBuffer::Private destructor
+ *
+ * The cached CPU mappings of the frame buffer planes, if any, are released.
  */
 FrameBuffer::Private::~Private()
 {
+	MappedFrameBuffer::invalidate(planes_);
 }
 
 /**
@@ -210,6 +217,64 @@ FrameBuffer::Private::~Private()
  * \brief Retrieve the dynamic metadata
  * \return Dynamic metadata for the frame contained in the buffer
  */
+
+/**
+ * \fn FrameBuffer::Private::setRequestCompleteHandler()
+ * \brief Set a function to be called when the request of the buffer completes
+ * \param[in] handler The function
+ *
+ * The \a handler is called once, by requestComplete(), the next time a request
+ * containing the buffer completes. It is typically set by the device that has
+ * produced the buffer contents to track the buffer until it reaches the
+ * application. Setting a new handler replaces the previous one.
+ */
+
+/**
+ * \brief Notify the buffer that the request it belongs to has completed
+ *
+ * This function calls and clears the handler set with
+ * setRequestCompleteHandler(), if any.
+ */
+void FrameBuffer::Private::requestComplete()
+{
+	if (!requestCompleteHandler_)
+		return;
+
+	std::function<void()> handler = std::move(requestCompleteHandler_);
+	requestCompleteHandler_ = nullptr;
+	handler();
+}
+
+/**
+ * \fn FrameBuffer::Private::memoryType()
+ * \brief Retrieve the type of memory backing the buffer
+ *
+ * The memory type defaults to MemoryUsage::Type::Device, and is set by the
+ * allocators that create buffers backed by other types of memory.
+ *
+ * \return The memory type
+ */
+
+/**
+ * \fn FrameBuffer::Private::setMemoryType()
+ * \brief Set the type of memory backing the buffer
+ * \param[in] type The memory type
+ */
+
+/**
+ * \fn FrameBuffer::Private::memoryCharge()
+ * \brief Retrieve the memory charge of the buffer
+ * \return The memory charge, empty if the buffer isn't accounted for
+ */
+
+/**
+ * \fn FrameBuffer::Private::setMemoryCharge()
+ * \brief Charge the memory of the buffer for its lifetime
+ * \param[in] charge The memory charge
+ *
+ * Use MemoryAccount::charge(FrameBuffer *) instead of calling this function
+ * directly.
+ */
 #endif /* __DOXYGEN_PUBLIC__ */
 
 /**
@@ -251,13 +316,23 @@ FrameBuffer::Private::~Private()
  * memory referenced by the dmabuf file descriptor. Multiple planes may be
  * stored in the same dmabuf, in which case they will reference the same dmabuf
  * and different offsets. No two planes may overlap, as specified by their
- * offset and length.
+ * offset and length. Planes of a FrameBuffer that are stored in the same dmabuf
+ * share a single file descriptor, even when the FrameBuffer is constructed
+ * with different descriptors for the same dmabuf.
  *
  * To support DMA access, planes are associated with dmabuf objects represented
  * by SharedFD handles. The Plane class doesn't handle mapping of the memory to
  * the CPU, but applications and IPAs may use the dmabuf file descriptors to map
  * the plane memory with mmap() and access its contents.
  *
+ * Planes may alternatively be backed by user memory that can't be represented
+ * by a dmabuf, such as memory allocated by the application. Such planes have an
+ * invalid file descriptor, and their data is located at the \a address plus
+ * the \a offset. Only video devices that support the V4L2 USERPTR memory type
+ * can capture to or read from user memory planes, see
+ * V4L2VideoDevice::importBuffers(). All planes of a frame buffer shall be of
+ * the same kind.
+ *
  * \todo Specify how an application shall decide whether to use a single or
  * multiple dmabufs, based on the camera requirements.
  */
@@ -282,6 +357,13 @@ FrameBuffer::Private::~Private()
  * \brief The plane length in bytes
  */
 
+/**
+ * \var FrameBuffer::Plane::address
+ * \brief The address of the user memory backing the plane
+ *
+ * The address is null for planes backed by a dmabuf.
+ */
+
 namespace {
 
 ino_t fileDescriptorInode(const SharedFD &fd)
@@ -316,15 +398,65 @@ FrameBuffer::FrameBuffer(const std::vector<Plane> &planes, unsigned int cookie)
 /**
  * \brief Construct a FrameBuffer with an extensible private class
  * \param[in] d The extensible private class
+ *
+ * Planes whose file descriptors refer to the same dmabuf are modified to share
+ * a single file descriptor. The duplicate descriptors are closed once the
+ * caller releases its own references to them.
  */
 FrameBuffer::FrameBuffer(std::unique_ptr<Private> d)
 	: Extensible(std::move(d))
 {
+	std::vector<Plane> &planes = _d()->planes_;
+
+	/*
+	 * Two different dmabuf file descriptors may still refer to the same
+	 * dmabuf instance. Check this using inodes, and share a single file
+	 * descriptor between the planes of the same dmabuf to release the
+	 * duplicates.
+	 */
+	std::vector<std::pair<SharedFD, ino_t>> dmabufs;
+
+	for (Plane &plane : planes) {
+		if (plane.address || !plane.fd.isValid())
+			continue;
+
+		bool found = false;
+		for (const auto &dmabuf : dmabufs) {
+			if (dmabuf.first == plane.fd) {
+				found = true;
+				break;
+			}
+		}
+
+		if (found)
+			continue;
+
+		if (dmabufs.empty()) {
+			dmabufs.emplace_back(plane.fd, 0);
+			continue;
+		}
+
+		/* Inodes are only needed when there are multiple descriptors. */
+		ino_t inode = fileDescriptorInode(plane.fd);
+		for (auto &[fd, fdInode] : dmabufs) {
+			if (!fdInode)
+				fdInode = fileDescriptorInode(fd);
+
+			if (inode && fdInode == inode) {
+				plane.fd = fd;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			dmabufs.emplace_back(plane.fd, inode);
+	}
+
 	unsigned int offset = 0;
 	bool isContiguous = true;
-	ino_t inode = 0;
 
-	for (const auto &plane : _d()->planes_) {
+	for (const auto &plane : planes) {
 		ASSERT(plane.offset != Plane::kInvalidOffset);
 
 		if (plane.offset != offset) {
@@ -332,17 +464,20 @@ FrameBuffer::FrameBuffer(std::unique_ptr<Private> d)
 			break;
 		}
 
-		/*
-		 * Two different dmabuf file descriptors may still refer to the
-		 * same dmabuf instance. Check this using inodes.
-		 */
-		if (plane.fd != _d()->planes_[0].fd) {
-			if (!inode)
-				inode = fileDescriptorInode(_d()->planes_[0].fd);
-			if (fileDescriptorInode(plane.fd) != inode) {
+		/* User memory planes are contiguous if they share an address. */
+		if (plane.address || planes[0].address) {
+			if (plane.address != planes[0].address) {
 				isContiguous = false;
 				break;
 			}
+
+			offset += plane.length;
+			continue;
+		}
+
+		if (plane.fd != planes[0].fd) {
+			isContiguous = false;
+			break;
 		}
 
 		offset += plane.length;
@@ -7,14 +7,19 @@
 
 #include <libcamera/framebuffer_allocator.h>
 
+#include <algorithm>
 #include <errno.h>
+#include <string>
 
 #include <libcamera/base/log.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/framebuffer.h>
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
 #include <libcamera/stream.h>
 
+#include "libcamera/internal/camera.h"
 #include "libcamera/internal/pipeline_handler.h"
 
 /**
@@ -98,8 +103,13 @@ int FrameBufferAllocator::allocate(Stream *stream)
 			<< "Stream is not part of " << camera_->id()
 			<< " active configuration";
 
-	if (ret < 0)
+	if (ret < 0) {
 		buffers_.erase(it);
+		return ret;
+	}
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : it->second)
+		camera_->_d()->memory_->charge(buffer.get());
 
 	return ret;
 }
@@ -156,4 +166,185 @@ FrameBufferAllocator::buffers(Stream *stream) const
 	return iter->second;
 }
 
+/**
+ * \class FrameBufferPool
+ * \brief Pool of frame buffers shared between cameras
+ *
+ * The FrameBufferAllocator allocates a full set of buffers for each stream up
+ * front. Applications that handle multiple cameras, but only stream from some
+ * of them at a time, can instead share a FrameBufferPool between the cameras
+ * to bound the number of allocated buffers.
+ *
+ * Buffers are acquired from the pool with acquire() for a configured stream,
+ * typically before starting the camera, and returned to the pool with
+ * release() once the camera has been stopped. The pool hands out idle buffers
+ * that are compatible with the stream, and only allocates new buffers, from
+ * the camera the buffers are acquired for, when no idle compatible buffer is
+ * available. The total number of buffers in the pool is capped by the
+ * maximum set at construction time. Buffers are never freed before the pool is
+ * destroyed.
+ *
+ * Buffers are compatible with a stream when they have been allocated by the
+ * same pipeline handler for a stream with the same pixel format, size, stride
+ * and frame size. Applications shall only share a pool between cameras whose
+ * devices can import each other's buffers, which is typically the case for
+ * identical cameras handled by the same hardware.
+ *
+ * The FrameBufferPool is not thread-safe, and shall be used from a single
+ * thread.
+ */
+
+struct FrameBufferPool::Buffer {
+	std::string pipeline;
+	PixelFormat pixelFormat;
+	Size size;
+	unsigned int stride;
+	unsigned int frameSize;
+
+	std::unique_ptr<FrameBuffer> buffer;
+	bool inUse;
+};
+
+/**
+ * \brief Construct a FrameBufferPool
+ * \param[in] maxBuffers The maximum number of buffers in the pool
+ */
+FrameBufferPool::FrameBufferPool(unsigned int maxBuffers)
+	: maxBuffers_(maxBuffers)
+{
+}
+
+/**
+ * \brief Destroy the FrameBufferPool and free all its buffers
+ *
+ * All buffers shall have been released, and shall not be part of a queued
+ * request, when the pool is destroyed.
+ */
+FrameBufferPool::~FrameBufferPool() = default;
+
+/**
+ * \brief Acquire buffers for a configured stream
+ * \param[in] camera The camera
+ * \param[in] stream The stream to acquire buffers for
+ * \param[in] count The number of buffers, or 0 to use the stream buffer count
+ * \param[out] buffers The acquired buffers
+ *
+ * Acquire \a count idle buffers compatible with \a stream, and append them to
+ * \a buffers. If the pool doesn't contain enough idle compatible buffers, new
+ * buffers are allocated for \a stream, in the same way as with
+ * FrameBufferAllocator::allocate(). The constraints of that function on the
+ * camera state and the stream thus apply when the pool needs to grow.
+ *
+ * Buffers are allocated by batches whose size is picked by the pipeline handler.
+ * New buffers that don't fit in the pool are freed immediately, and buffers
+ * that have been allocated but not acquired stay idle in the pool.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOMEM The pool has reached its maximum number of buffers
+ * \retval -EACCES The pool needs to grow and the camera is not in a state
+ * where buffers can be allocated
+ * \retval -EINVAL The \a stream does not belong to the camera or the stream is
+ * not part of the active camera configuration
+ */
+int FrameBufferPool::acquire(Camera *camera, Stream *stream, unsigned int count,
+			     std::vector<FrameBuffer *> *buffers)
+{
+	const StreamConfiguration &cfg = stream->configuration();
+	const std::string &pipeline = camera->_d()->pipe()->name();
+
+	if (!count)
+		count = cfg.bufferCount;
+
+	auto isCompatible = [&](const Buffer &buffer) {
+		return buffer.pipeline == pipeline &&
+		       buffer.pixelFormat == cfg.pixelFormat &&
+		       buffer.size == cfg.size && buffer.stride == cfg.stride &&
+		       buffer.frameSize == cfg.frameSize;
+	};
+
+	auto idleBuffers = [&]() {
+		return std::count_if(buffers_.begin(), buffers_.end(),
+				     [&](const std::unique_ptr<Buffer> &buffer) {
+					     return !buffer->inUse &&
+						    isCompatible(*buffer);
+				     });
+	};
+
+	while (static_cast<unsigned int>(idleBuffers()) < count) {
+		if (buffers_.size() >= maxBuffers_) {
+			LOG(Allocator, Error)
+				<< "Buffer pool exhausted, " << buffers_.size()
+				<< " buffers allocated";
+			return -ENOMEM;
+		}
+
+		std::vector<std::unique_ptr<FrameBuffer>> allocated;
+		int ret = camera->exportFrameBuffers(stream, &allocated);
+		if (ret < 0)
+			return ret;
+		if (allocated.empty())
+			return -ENOMEM;
+
+		for (std::unique_ptr<FrameBuffer> &buffer : allocated) {
+			if (buffers_.size() >= maxBuffers_)
+				break;
+
+			buffers_.push_back(std::make_unique<Buffer>(Buffer{
+				pipeline, cfg.pixelFormat, cfg.size, cfg.stride,
+				cfg.frameSize, std::move(buffer), false }));
+		}
+
+		LOG(Allocator, Debug)
+			<< "Buffer pool grown to " << buffers_.size() << " buffers";
+	}
+
+	for (std::unique_ptr<Buffer> &buffer : buffers_) {
+		if (!count)
+			break;
+
+		if (buffer->inUse || !isCompatible(*buffer))
+			continue;
+
+		buffer->inUse = true;
+		buffers->push_back(buffer->buffer.get());
+		count--;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Return a buffer to the pool
+ * \param[in] buffer The buffer
+ *
+ * The \a buffer shall have been acquired from this pool with acquire(), and
+ * shall not be part of a queued request. It becomes available to be acquired
+ * again for any compatible stream.
+ */
+void FrameBufferPool::release(FrameBuffer *buffer)
+{
+	auto it = std::find_if(buffers_.begin(), buffers_.end(),
+			       [buffer](const std::unique_ptr<Buffer> &b) {
+				       return b->buffer.get() == buffer;
+			       });
+	if (it == buffers_.end() || !(*it)->inUse) {
+		LOG(Allocator, Warning) << "Releasing a buffer not acquired from the pool";
+		return;
+	}
+
+	(*it)->inUse = false;
+}
+
+/**
+ * \fn FrameBufferPool::size()
+ * \brief Retrieve the number of buffers allocated in the pool
+ * \return The number of allocated buffers, in use or idle
+ */
+
+/**
+ * \fn FrameBufferPool::maxBuffers()
+ * \brief Retrieve the maximum number of buffers in the pool
+ * \return The maximum number of buffers
+ */
+
 } /* namespace libcamera */
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Per-frame IPA processing time budget
+ */
+
+#include "libcamera/internal/ipa_budget.h"
+
+#include <string.h>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/metrics.h"
+#include "libcamera/internal/tracepoints.h"
+
+/**
+ * \file ipa_budget.h
+ * \brief Per-frame IPA processing time budget
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(IPABudget)
+
+/**
+ * \class IPABudget
+ * \brief Measure the IPA processing time against the frame period
+ *
+ * IPA modules process the statistics of a frame asynchronously, and pipeline
+ * handlers wait for the results before completing the corresponding request.
+ * When the processing of a frame takes longer than the frame period, the
+ * following frames queue up behind it, and occasional spikes in the
+ * processing time delay the completion of all the requests in flight.
+ *
+ * The IPABudget class gives the IPA processing of each frame a time budget
+ * equal to the frame period, estimated from the timestamps and sequence
+ * numbers of the statistics buffers. Pipeline handlers call skip() when the
+ * statistics of a frame are ready, begin() when passing them to the IPA, and
+ * end() when the IPA reports the metadata for the frame.
+ *
+ * Processing times that exceed the budget are counted as overruns, reported
+ * through the ipa_overrun tracepoint and the ipa_overruns metric, and handled
+ * according to the policy selected by the LIBCAMERA_IPA_OVERRUN_POLICY
+ * environment variable. With the default Policy::Report policy, overruns are
+ * only reported. With the Policy::Skip policy, skip() returns true for the
+ * frame following an overrun, and pipeline handlers then complete it without
+ * IPA processing, keeping the ISP parameters and sensor controls computed
+ * for the previous frames.
+ */
+
+/**
+ * \enum IPABudget::Policy
+ * \brief The action taken when the IPA processing overruns its budget
+ * \var IPABudget::Policy::Report
+ * \brief Report overruns only
+ * \var IPABudget::Policy::Skip
+ * \brief Skip the IPA processing of the frame following an overrun
+ */
+
+/**
+ * \brief Construct an IPABudget
+ * \param[in] pipe The pipeline handler name, reported in tracepoints
+ * \param[in] metrics The metrics registry to report overruns to
+ */
+IPABudget::IPABudget(const std::string &pipe, MetricsRegistry *metrics)
+	: pipe_(pipe), policy_(Policy::Report)
+{
+	const char *policy = utils::secure_getenv("LIBCAMERA_IPA_OVERRUN_POLICY");
+	if (policy && policy[0] != '\0') {
+		if (!strcmp(policy, "skip"))
+			policy_ = Policy::Skip;
+		else if (strcmp(policy, "report"))
+			LOG(IPABudget, Warning)
+				<< "Unknown IPA overrun policy '" << policy
+				<< "', reporting overruns only";
+	}
+
+	overrunsCounter_ = metrics->counter("ipa_overruns");
+	skippedCounter_ = metrics->counter("ipa_skipped_frames");
+	processingTime_ = metrics->histogram("ipa_processing_us",
+					     { 1000, 2000, 5000, 10000, 20000,
+					       33000, 50000, 100000, 200000 });
+
+	reset();
+}
+
+/**
+ * \fn IPABudget::policy()
+ * \brief Retrieve the overrun policy
+ * \return The overrun policy
+ */
+
+/**
+ * \fn IPABudget::budget()
+ * \brief Retrieve the current processing time budget
+ *
+ * The budget is zero until the frame period has been estimated from two
+ * statistics buffers.
+ *
+ * \return The processing time budget
+ */
+
+/**
+ * \fn IPABudget::overruns()
+ * \brief Retrieve the number of overruns since the last reset()
+ * \return The number of overruns
+ */
+
+/**
+ * \brief Reset the budget state
+ *
+ * Pipeline handlers shall call this function when starting the camera.
+ */
+void IPABudget::reset()
+{
+	budget_ = utils::Duration(0);
+	lastSequence_ = 0;
+	lastTimestamp_ = 0;
+
+	processing_.clear();
+	overruns_ = 0;
+	skipNext_ = false;
+}
+
+/**
+ * \brief Decide whether to skip the IPA processing of a frame
+ * \param[in] metadata The metadata of the statistics buffer of the frame
+ *
+ * This function updates the budget with the frame period, and applies the
+ * overrun policy. With the Policy::Skip policy, the IPA processing is skipped
+ * for the frame following an overrun, or when the processing of a previous
+ * frame is still in progress and has already exceeded its budget. Only one
+ * frame is skipped per overrun.
+ *
+ * \return True if the IPA processing of the frame shall be skipped, false
+ * otherwise
+ */
+bool IPABudget::skip(const FrameMetadata &metadata)
+{
+	updateBudget(metadata);
+
+	if (policy_ != Policy::Skip)
+		return false;
+
+	bool skip = skipNext_;
+	skipNext_ = false;
+
+	if (budget_) {
+		utils::time_point now = utils::clock::now();
+
+		for (auto &[frame, processing] : processing_) {
+			if (processing.handled || now - processing.start <= budget_)
+				continue;
+
+			processing.handled = true;
+			skip = true;
+		}
+	}
+
+	if (skip) {
+		LOG(IPABudget, Debug)
+			<< "Skipping IPA processing for frame " << metadata.sequence;
+		skippedCounter_->add();
+	}
+
+	return skip;
+}
+
+/**
+ * \brief Record the start of the IPA processing of a frame
+ * \param[in] frame The frame number
+ */
+void IPABudget::begin(unsigned int frame)
+{
+	processing_[frame] = { utils::clock::now(), false };
+}
+
+/**
+ * \brief Record the end of the IPA processing of a frame
+ * \param[in] frame The frame number
+ *
+ * The processing time is compared with the budget. Overruns are counted,
+ * logged and traced, and with the Policy::Skip policy, cause the IPA
+ * processing of the next frame to be skipped unless a frame has already been
+ * skipped for this overrun.
+ *
+ * \return The IPA processing time of the frame, or zero if begin() hasn't been
+ * called for the frame
+ */
+utils::Duration IPABudget::end(unsigned int frame)
+{
+	auto iter = processing_.find(frame);
+	if (iter == processing_.end())
+		return utils::Duration(0);
+
+	utils::Duration duration = utils::clock::now() - iter->second.start;
+	bool handled = iter->second.handled;
+	processing_.erase(iter);
+
+	uint64_t durationUs = static_cast<uint64_t>(duration.get<std::micro>());
+	processingTime_->record(durationUs);
+
+	if (!budget_ || duration <= budget_)
+		return duration;
+
+	overruns_++;
+	overrunsCounter_->add();
+
+	LIBCAMERA_TRACEPOINT(ipa_overrun, pipe_.c_str(), frame, durationUs,
+			     static_cast<uint64_t>(budget_.get<std::micro>()));
+
+	LOG(IPABudget, Debug)
+		<< "IPA processing for frame " << frame << " took " << duration
+		<< ", exceeding its budget of " << budget_;
+
+	if (policy_ == Policy::Skip && !handled)
+		skipNext_ = true;
+
+	return duration;
+}
+
+void IPABudget::updateBudget(const FrameMetadata &metadata)
+{
+	if (lastTimestamp_ && metadata.sequence > lastSequence_ &&
+	    metadata.timestamp > lastTimestamp_)
+		budget_ = std::chrono::nanoseconds((metadata.timestamp - lastTimestamp_) /
+						   (metadata.sequence - lastSequence_));
+
+	lastSequence_ = metadata.sequence;
+	lastTimestamp_ = metadata.timestamp;
+}
+
+} /* namespace libcamera */
@@ -129,6 +129,17 @@
  * As for the ControlList packet, empty spaces may be present between the end of
  * the entries array and the data section, and after the data section. They
  * shall be ignored when parsing the packet.
+ *
+ * ControlList packets may be delta-encoded. Consecutive lists serialized with
+ * the same non-zero ipa_controls_header::stream identifier form a stream, and
+ * each packet of the stream carries a sequence number incremented by one for
+ * every packet. A packet without the IPA_CONTROLS_FLAG_DELTA flag is a
+ * keyframe that contains the full list. A packet with the flag set contains
+ * only the controls whose value differs from the list carried by the previous
+ * packet of the stream, with controls removed from the list being stored as
+ * entries of type ControlTypeNone without any value. Delta packets can only be
+ * parsed when all the previous packets of the stream, up to the last keyframe,
+ * have been parsed in order.
  */
 
 namespace libcamera {
@@ -138,6 +149,12 @@ namespace libcamera {
  * \brief The current control serialization format version
  */
 
+/**
+ * \def IPA_CONTROLS_FLAG_DELTA
+ * \brief The ControlList packet only contains changes relative to the previous
+ * packet of the same stream
+ */
+
 /**
  * \var ipa_controls_id_map_type
  * \brief Enumerates the different control id map types
@@ -182,8 +199,16 @@ namespace libcamera {
  * Offset in bytes from the beginning of the packet of the data section start
  * \var ipa_controls_header::id_map_type
  * The id map type as defined by the ipa_controls_id_map_type enumeration
- * \var ipa_controls_header::reserved
- * Reserved for future extensions
+ * \var ipa_controls_header::flags
+ * Packet flags (IPA_CONTROLS_FLAG_*)
+ * \var ipa_controls_header::stream
+ * For delta-encoded ControlList streams, this field contains the non-zero
+ * identifier of the stream the packet belongs to. It is set to 0 for
+ * ControlInfoMap packets and for ControlList packets that are not part of a
+ * stream.
+ * \var ipa_controls_header::sequence
+ * The sequence number of the packet in its stream, or 0 if the packet isn't
+ * part of a stream
  */
 
 static_assert(sizeof(ipa_controls_header) == 32,
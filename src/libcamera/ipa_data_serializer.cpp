@@ -197,7 +197,7 @@ IPADataSerializer<type>::serialize(const type &data,			\
 	dataVec.reserve(sizeof(type));					\
 	appendPOD<type>(dataVec, data);					\
 									\
-	return { dataVec, {} };						\
+	return { std::move(dataVec), {} };				\
 }									\
 									\
 template<>								\
@@ -314,19 +314,32 @@ IPADataSerializer<ControlList>::serialize(const ControlList &data, ControlSerial
 		LOG(IPADataSerializer, Fatal)
 			<< "ControlSerializer not provided for serialization of ControlList";
 
-	size_t size;
-	std::vector<uint8_t> infoData;
+	const ControlInfoMap *infoMap = data.infoMap();
 	int ret;
 
 	/*
 	 * \todo Revisit this opportunistic serialization of the
 	 * ControlInfoMap, as it could be fragile
 	 */
-	if (data.infoMap() && !cs->isCached(*data.infoMap())) {
-		size = cs->binarySize(*data.infoMap());
-		infoData.resize(size);
-		ByteStreamBuffer buffer(infoData.data(), infoData.size());
-		ret = cs->serialize(*data.infoMap(), buffer);
+	if (infoMap && cs->isCached(*infoMap))
+		infoMap = nullptr;
+
+	/*
+	 * Serialize the ControlInfoMap and ControlList directly into the
+	 * output vector, after the sizes header.
+	 */
+	size_t infoDataSize = infoMap ? cs->binarySize(*infoMap) : 0;
+	size_t listDataSize = cs->binarySize(data);
+
+	std::vector<uint8_t> dataVec;
+	dataVec.reserve(8 + infoDataSize + listDataSize);
+	appendPOD<uint32_t>(dataVec, infoDataSize);
+	appendPOD<uint32_t>(dataVec, listDataSize);
+	dataVec.resize(8 + infoDataSize + listDataSize);
+
+	if (infoMap) {
+		ByteStreamBuffer buffer(dataVec.data() + 8, infoDataSize);
+		ret = cs->serialize(*infoMap, buffer);
 
 		if (ret < 0 || buffer.overflow()) {
 			LOG(IPADataSerializer, Error) << "Failed to serialize ControlList's ControlInfoMap";
@@ -334,9 +347,7 @@ IPADataSerializer<ControlList>::serialize(const ControlList &data, ControlSerial
 		}
 	}
 
-	size = cs->binarySize(data);
-	std::vector<uint8_t> listData(size);
-	ByteStreamBuffer buffer(listData.data(), listData.size());
+	ByteStreamBuffer buffer(dataVec.data() + 8 + infoDataSize, listDataSize);
 	ret = cs->serialize(data, buffer);
 
 	if (ret < 0 || buffer.overflow()) {
@@ -344,14 +355,7 @@ IPADataSerializer<ControlList>::serialize(const ControlList &data, ControlSerial
 		return { {}, {} };
 	}
 
-	std::vector<uint8_t> dataVec;
-	dataVec.reserve(8 + infoData.size() + listData.size());
-	appendPOD<uint32_t>(dataVec, infoData.size());
-	appendPOD<uint32_t>(dataVec, listData.size());
-	dataVec.insert(dataVec.end(), infoData.begin(), infoData.end());
-	dataVec.insert(dataVec.end(), listData.begin(), listData.end());
-
-	return { dataVec, {} };
+	return { std::move(dataVec), {} };
 }
 
 template<>
@@ -440,8 +444,12 @@ IPADataSerializer<ControlInfoMap>::serialize(const ControlInfoMap &map,
 			<< "ControlSerializer not provided for serialization of ControlInfoMap";
 
 	size_t size = cs->binarySize(map);
-	std::vector<uint8_t> infoData(size);
-	ByteStreamBuffer buffer(infoData.data(), infoData.size());
+	std::vector<uint8_t> dataVec;
+	dataVec.reserve(4 + size);
+	appendPOD<uint32_t>(dataVec, size);
+	dataVec.resize(4 + size);
+
+	ByteStreamBuffer buffer(dataVec.data() + 4, size);
 	int ret = cs->serialize(map, buffer);
 
 	if (ret < 0 || buffer.overflow()) {
@@ -449,11 +457,7 @@ IPADataSerializer<ControlInfoMap>::serialize(const ControlInfoMap &map,
 		return { {}, {} };
 	}
 
-	std::vector<uint8_t> dataVec;
-	appendPOD<uint32_t>(dataVec, infoData.size());
-	dataVec.insert(dataVec.end(), infoData.begin(), infoData.end());
-
-	return { dataVec, {} };
+	return { std::move(dataVec), {} };
 }
 
 template<>
@@ -538,7 +542,7 @@ IPADataSerializer<SharedFD>::serialize(const SharedFD &data,
 		fdVec.push_back(data);
 
 
-	return { dataVec, fdVec };
+	return { std::move(dataVec), std::move(fdVec) };
 }
 
 template<>
@@ -590,7 +594,7 @@ IPADataSerializer<FrameBuffer::Plane>::serialize(const FrameBuffer::Plane &data,
 	appendPOD<uint32_t>(dataVec, data.offset);
 	appendPOD<uint32_t>(dataVec, data.length);
 
-	return { dataVec, fdsVec };
+	return { std::move(dataVec), std::move(fdsVec) };
 }
 
 template<>
@@ -9,8 +9,16 @@
 
 #include <algorithm>
 #include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/log.h>
@@ -29,6 +37,12 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(IPAManager)
 
+namespace {
+
+constexpr const char *kSignatureCacheMagic = "libcamera-ipa-signature-cache 1";
+
+} /* namespace */
+
 /**
  * \class IPAManager
  * \brief Manager for IPA modules
@@ -93,6 +107,22 @@ LOG_DEFINE_CATEGORY(IPAManager)
  * serialized to Plain Old Data, either for the purpose of passing it to the IPA
  * context plain C API, or to transmit the data to the isolated process through
  * IPC.
+ *
+ * IPA modules are discovered lazily. The search directories are only scanned
+ * when a pipeline handler first requests an IPA, and the shared objects found
+ * there are only opened, in search order, until a module matching the request
+ * is found.
+ *
+ * Verifying the signature of a module requires reading and hashing the whole
+ * shared object. When the LIBCAMERA_IPA_SIGNATURE_CACHE environment variable
+ * is set, the manager stores the identity of the modules whose signature has
+ * been verified successfully in the cache file it points to, and skips the
+ * verification in later runs as long as neither the module nor the libcamera
+ * library, which embeds the public key, has changed. Files are identified by
+ * their device, inode, size, and modification and status change times. As the
+ * status change time can't be set from userspace, any modification to a file
+ * invalidates its cache entry. The cache file is ignored unless it is owned by
+ * the user running libcamera and isn't writable by anyone else.
  */
 
 IPAManager *IPAManager::self_ = nullptr;
@@ -104,6 +134,8 @@ IPAManager *IPAManager::self_ = nullptr;
  * CameraManager.
  */
 IPAManager::IPAManager()
+	: scanned_(false), nextModule_(0), signatureCacheLoaded_(false),
+	  libraryStamp_({})
 {
 	if (self_)
 		LOG(IPAManager, Fatal)
@@ -114,6 +146,28 @@ IPAManager::IPAManager()
 		LOG(IPAManager, Warning) << "Public key not valid";
 #endif
 
+	self_ = this;
+}
+
+IPAManager::~IPAManager()
+{
+	for (IPAModule *module : modules_)
+		delete module;
+
+	self_ = nullptr;
+}
+
+/**
+ * \brief Discover the IPA module candidates in all search directories
+ *
+ * The shared objects found in the search directories are recorded in search
+ * order, without being opened. This is performed once, the first time an IPA
+ * module is requested.
+ */
+void IPAManager::scan()
+{
+	scanned_ = true;
+
 	unsigned int ipaCount = 0;
 
 	/* User-specified paths take precedence. */
@@ -153,16 +207,6 @@ IPAManager::IPAManager()
 	if (!ipaCount)
 		LOG(IPAManager, Warning)
 			<< "No IPA found in '" IPA_MODULE_DIR "'";
-
-	self_ = this;
-}
-
-IPAManager::~IPAManager()
-{
-	for (IPAModule *module : modules_)
-		delete module;
-
-	self_ = nullptr;
 }
 
 /**
@@ -213,17 +257,17 @@ void IPAManager::parseDir(const char *libDir, unsigned int maxDepth,
 }
 
 /**
- * \brief Load IPA modules from a directory
+ * \brief Add the IPA module candidates from a directory
  * \param[in] libDir The directory to search for IPA modules
  * \param[in] maxDepth The maximum depth of sub-directories to search
  *
- * This function tries to create an IPAModule instance for every shared object
- * found in \a libDir, and skips invalid IPA modules.
+ * This function records every shared object found in \a libDir as an IPA
+ * module candidate. The candidates are opened on demand by module().
  *
  * Sub-directories are searched up to a depth of \a maxDepth. A \a maxDepth
  * value of 0 only searches the directory specified in \a libDir.
  *
- * \return Number of modules loaded by this call
+ * \return Number of module candidates found by this call
  */
 unsigned int IPAManager::addDir(const char *libDir, unsigned int maxDepth)
 {
@@ -234,21 +278,9 @@ unsigned int IPAManager::addDir(const char *libDir, unsigned int maxDepth)
 	/* Ensure a stable ordering of modules. */
 	std::sort(files.begin(), files.end());
 
-	unsigned int count = 0;
-	for (const std::string &file : files) {
-		IPAModule *ipaModule = new IPAModule(file);
-		if (!ipaModule->isValid()) {
-			delete ipaModule;
-			continue;
-		}
-
-		LOG(IPAManager, Debug) << "Loaded IPA module '" << file << "'";
+	moduleFiles_.insert(moduleFiles_.end(), files.begin(), files.end());
 
-		modules_.push_back(ipaModule);
-		count++;
-	}
-
-	return count;
+	return files.size();
 }
 
 /**
@@ -256,15 +288,42 @@ unsigned int IPAManager::addDir(const char *libDir, unsigned int maxDepth)
  * \param[in] pipe The pipeline handler
  * \param[in] minVersion Minimum acceptable version of IPA module
  * \param[in] maxVersion Maximum acceptable version of IPA module
+ *
+ * Modules that have already been opened are searched first. If none of them
+ * matches, the remaining candidates are opened in search order until a
+ * matching module is found, which preserves the priority of the search
+ * directories.
+ *
+ * \return The matching IPA module, or nullptr if no module matches
  */
 IPAModule *IPAManager::module(PipelineHandler *pipe, uint32_t minVersion,
 			      uint32_t maxVersion)
 {
+	if (!scanned_)
+		scan();
+
 	for (IPAModule *module : modules_) {
 		if (module->match(pipe, minVersion, maxVersion))
 			return module;
 	}
 
+	while (nextModule_ < moduleFiles_.size()) {
+		const std::string &file = moduleFiles_[nextModule_++];
+
+		IPAModule *ipaModule = new IPAModule(file);
+		if (!ipaModule->isValid()) {
+			delete ipaModule;
+			continue;
+		}
+
+		LOG(IPAManager, Debug) << "Loaded IPA module '" << file << "'";
+
+		modules_.push_back(ipaModule);
+
+		if (ipaModule->match(pipe, minVersion, maxVersion))
+			return ipaModule;
+	}
+
 	return nullptr;
 }
 
@@ -292,7 +351,7 @@ IPAModule *IPAManager::module(PipelineHandler *pipe, uint32_t minVersion,
  */
 #endif
 
-bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
+bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa)
 {
 #if HAVE_IPA_PUBKEY
 	char *force = utils::secure_getenv("LIBCAMERA_IPA_FORCE_ISOLATION");
@@ -303,6 +362,22 @@ bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 		return false;
 	}
 
+	if (!signatureCacheLoaded_)
+		loadSignatureCache();
+
+	FileStamp stamp;
+	bool cacheable = !signatureCachePath_.empty() &&
+			 fileStamp(ipa->path(), &stamp);
+	if (cacheable) {
+		auto iter = signatureCache_.find(ipa->path());
+		if (iter != signatureCache_.end() && iter->second == stamp) {
+			LOG(IPAManager, Debug)
+				<< "IPA module " << ipa->path()
+				<< " signature is valid (cached)";
+			return true;
+		}
+	}
+
 	File file{ ipa->path() };
 	if (!file.open(File::OpenModeFlag::ReadOnly))
 		return false;
@@ -317,10 +392,188 @@ bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 		<< "IPA module " << ipa->path() << " signature is "
 		<< (valid ? "valid" : "not valid");
 
+	/*
+	 * Only cache the result if the file hasn't been modified during
+	 * verification.
+	 */
+	FileStamp verifiedStamp;
+	if (valid && cacheable && fileStamp(ipa->path(), &verifiedStamp) &&
+	    verifiedStamp == stamp) {
+		signatureCache_[ipa->path()] = stamp;
+		saveSignatureCache();
+	}
+
 	return valid;
 #else
 	return false;
 #endif
 }
 
+bool IPAManager::FileStamp::operator==(const FileStamp &other) const
+{
+	return device == other.device && inode == other.inode &&
+	       size == other.size && mtime == other.mtime &&
+	       ctime == other.ctime;
+}
+
+bool IPAManager::fileStamp(const std::string &path, FileStamp *stamp)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st))
+		return false;
+
+	stamp->device = st.st_dev;
+	stamp->inode = st.st_ino;
+	stamp->size = st.st_size;
+	stamp->mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	stamp->ctime = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+
+	return true;
+}
+
+/*
+ * Load the signature cache file. The first lines hold a magic string and the
+ * stamp of the libcamera library, followed by one line per module with its
+ * stamp and path. Any error or mismatch in the header discards the whole file,
+ * which will be overwritten when the next signature is verified.
+ */
+void IPAManager::loadSignatureCache()
+{
+	signatureCacheLoaded_ = true;
+
+	const char *path = utils::secure_getenv("LIBCAMERA_IPA_SIGNATURE_CACHE");
+	if (!path || !*path)
+		return;
+
+	/* The public key is embedded in the library that contains this code. */
+	Dl_info info;
+	if (!dladdr(reinterpret_cast<void *>(&self_), &info) ||
+	    !fileStamp(info.dli_fname, &libraryStamp_)) {
+		LOG(IPAManager, Warning)
+			<< "Unable to identify libcamera, signature cache disabled";
+		return;
+	}
+
+	signatureCachePath_ = path;
+
+	struct stat st;
+	if (stat(path, &st))
+		return;
+
+	if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+		LOG(IPAManager, Warning)
+			<< "Ignoring untrusted signature cache '" << path << "'";
+		return;
+	}
+
+	std::ifstream file(path);
+	std::string line;
+
+	auto parseStamp = [](std::istringstream &ss, FileStamp *stamp) {
+		ss >> stamp->device >> stamp->inode >> stamp->size
+		   >> stamp->mtime >> stamp->ctime;
+		return !ss.fail();
+	};
+
+	if (!std::getline(file, line) || line != kSignatureCacheMagic)
+		return;
+
+	FileStamp stamp;
+	std::string key;
+
+	if (!std::getline(file, line))
+		return;
+
+	std::istringstream header(line);
+	header >> key;
+	if (key != "library" || !parseStamp(header, &stamp) ||
+	    stamp != libraryStamp_) {
+		LOG(IPAManager, Debug) << "Discarding stale signature cache";
+		return;
+	}
+
+	std::map<std::string, FileStamp> entries;
+
+	while (std::getline(file, line)) {
+		std::istringstream ss(line);
+		std::string modulePath;
+
+		ss >> key;
+		if (key != "module" || !parseStamp(ss, &stamp)) {
+			LOG(IPAManager, Debug) << "Discarding invalid signature cache";
+			return;
+		}
+
+		ss.get();
+		std::getline(ss, modulePath);
+		if (modulePath.empty()) {
+			LOG(IPAManager, Debug) << "Discarding invalid signature cache";
+			return;
+		}
+
+		entries[modulePath] = stamp;
+	}
+
+	signatureCache_ = std::move(entries);
+}
+
+/*
+ * Write the signature cache file. The file is written to a temporary file and
+ * renamed, to avoid exposing partially written files to concurrent readers.
+ */
+void IPAManager::saveSignatureCache() const
+{
+	std::string tmpPath = signatureCachePath_ + "." + std::to_string(getpid());
+
+	auto writeStamp = [](std::ostream &os, const FileStamp &stamp) {
+		os << stamp.device << " " << stamp.inode << " " << stamp.size
+		   << " " << stamp.mtime << " " << stamp.ctime;
+	};
+
+	/* Create the file without group and other write permissions. */
+	int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		      0644);
+	if (fd < 0) {
+		int ret = errno;
+		LOG(IPAManager, Warning)
+			<< "Unable to create signature cache '" << tmpPath
+			<< "': " << strerror(ret);
+		return;
+	}
+	close(fd);
+
+	{
+		std::ofstream file(tmpPath, std::ios::trunc);
+
+		file << kSignatureCacheMagic << "\n";
+
+		file << "library ";
+		writeStamp(file, libraryStamp_);
+		file << "\n";
+
+		for (const auto &[path, stamp] : signatureCache_) {
+			file << "module ";
+			writeStamp(file, stamp);
+			file << " " << path << "\n";
+		}
+
+		file.close();
+
+		if (!file) {
+			LOG(IPAManager, Warning)
+				<< "Unable to write signature cache '" << tmpPath << "'";
+			unlink(tmpPath.c_str());
+			return;
+		}
+	}
+
+	if (rename(tmpPath.c_str(), signatureCachePath_.c_str())) {
+		int ret = errno;
+		LOG(IPAManager, Warning)
+			<< "Unable to update signature cache '"
+			<< signatureCachePath_ << "': " << strerror(ret);
+		unlink(tmpPath.c_str());
+	}
+}
+
 } /* namespace libcamera */
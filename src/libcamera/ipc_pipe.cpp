@@ -22,7 +22,7 @@ LOG_DEFINE_CATEGORY(IPCPipe)
  * \struct IPCMessage::Header
  * \brief Container for an IPCMessage header
  *
- * Holds a cmd code for the IPC message, and a cookie.
+ * Holds a cmd code for the IPC message, a cookie, and a channel.
  */
 
 /**
@@ -40,6 +40,15 @@ LOG_DEFINE_CATEGORY(IPCPipe)
  * replies.
  */
 
+/**
+ * \var IPCMessage::Header::channel
+ * \brief Channel the message is sent on
+ *
+ * Populated and used by IPCPipe implementations to multiplex several pipes
+ * over a single connection. Replies and messages sent by the remote side carry
+ * the channel of the pipe they are destined to.
+ */
+
 /**
  * \class IPCMessage
  * \brief IPC message to be passed through IPC message pipe
@@ -49,7 +58,7 @@ LOG_DEFINE_CATEGORY(IPCPipe)
  * \brief Construct an empty IPCMessage instance
  */
 IPCMessage::IPCMessage()
-	: header_(Header{ 0, 0 })
+	: header_(Header{ 0, 0, 0 })
 {
 }
 
@@ -58,7 +67,7 @@ IPCMessage::IPCMessage()
  * \param[in] cmd The command code
  */
 IPCMessage::IPCMessage(uint32_t cmd)
-	: header_(Header{ cmd, 0 })
+	: header_(Header{ cmd, 0, 0 })
 {
 }
 
@@ -78,14 +87,15 @@ IPCMessage::IPCMessage(const Header &header)
  * This essentially converts an IPCUnixSocket payload into an IPCMessage.
  * The header is extracted from the payload into the IPCMessage's header field.
  *
- * If the IPCUnixSocket payload had any valid file descriptors, then they will
- * all be invalidated.
+ * The payload data buffer is moved to the IPCMessage to avoid a memory
+ * allocation, leaving the \a payload data empty. If the IPCUnixSocket payload
+ * had any valid file descriptors, then they will all be invalidated.
  */
 IPCMessage::IPCMessage(IPCUnixSocket::Payload &payload)
 {
 	memcpy(&header_, payload.data.data(), sizeof(header_));
-	data_ = std::vector<uint8_t>(payload.data.begin() + sizeof(header_),
-				     payload.data.end());
+	data_ = std::move(payload.data);
+	data_.erase(data_.begin(), data_.begin() + sizeof(header_));
 	for (int32_t &fd : payload.fds)
 		fds_.push_back(SharedFD(std::move(fd)));
 }
@@ -118,6 +128,52 @@ IPCUnixSocket::Payload IPCMessage::payload() const
 	return payload;
 }
 
+/**
+ * \brief Send the IPCMessage over an IPC unix socket
+ * \param[in] socket The socket to send the message on
+ *
+ * This function is equivalent to sending the payload() on \a socket, but
+ * transmits the header and data directly from the IPCMessage without copying
+ * them to an intermediate payload.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCMessage::send(IPCUnixSocket *socket) const
+{
+	std::vector<int32_t> fds;
+	fds.reserve(fds_.size());
+
+	for (const SharedFD &fd : fds_)
+		fds.push_back(fd.get());
+
+	const uint8_t *header = reinterpret_cast<const uint8_t *>(&header_);
+
+	return socket->send({ { header, sizeof(header_) }, data_ }, fds);
+}
+
+/**
+ * \brief Queue the IPCMessage for batched transmission over an IPC unix socket
+ * \param[in] socket The socket to send the message on
+ *
+ * This function is similar to send(), but queues the message with
+ * IPCUnixSocket::sendBatched() to transmit it along with the other messages
+ * queued in the same event loop iteration.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCMessage::sendBatched(IPCUnixSocket *socket) const
+{
+	std::vector<int32_t> fds;
+	fds.reserve(fds_.size());
+
+	for (const SharedFD &fd : fds_)
+		fds.push_back(fd.get());
+
+	const uint8_t *header = reinterpret_cast<const uint8_t *>(&header_);
+
+	return socket->sendBatched({ { header, sizeof(header_) }, data_ }, fds);
+}
+
 /**
  * \fn IPCMessage::header()
  * \brief Returns a reference to the header
@@ -148,13 +204,141 @@ IPCUnixSocket::Payload IPCMessage::payload() const
  * \brief Returns a const reference to the vector containing file descriptors
  */
 
+/**
+ * \class IPCPendingCall
+ * \brief Completion handle for a pipelined IPC call
+ *
+ * An IPCPendingCall tracks a call sent with IPCPipe::sendPipelined() whose
+ * response hasn't been consumed yet. The response is retrieved with wait(),
+ * which processes events until the response arrives, and completion can be
+ * polled without blocking with isComplete().
+ *
+ * Destroying a pending call without waiting for it discards its response when
+ * it arrives. The handle is movable but not copyable, and must not outlive the
+ * IPCPipe that created it.
+ */
+
+/**
+ * \brief Construct an invalid IPCPendingCall
+ */
+IPCPendingCall::IPCPendingCall()
+	: pipe_(nullptr), cookie_(0)
+{
+}
+
+/**
+ * \brief Construct an IPCPendingCall for a call sent over \a pipe
+ * \param[in] pipe The pipe the call has been sent over
+ * \param[in] cookie The cookie identifying the call
+ *
+ * This constructor is meant to be used by IPCPipe implementations only.
+ */
+IPCPendingCall::IPCPendingCall(IPCPipe *pipe, uint32_t cookie)
+	: pipe_(pipe), cookie_(cookie)
+{
+}
+
+/**
+ * \brief Move-construct an IPCPendingCall
+ * \param[in] other The other IPCPendingCall
+ *
+ * The \a other handle is invalidated.
+ */
+IPCPendingCall::IPCPendingCall(IPCPendingCall &&other)
+	: pipe_(other.pipe_), cookie_(other.cookie_)
+{
+	other.pipe_ = nullptr;
+}
+
+IPCPendingCall::~IPCPendingCall()
+{
+	release();
+}
+
+/**
+ * \brief Move-assign an IPCPendingCall
+ * \param[in] other The other IPCPendingCall
+ *
+ * The call currently tracked by this handle, if any, is discarded, and the
+ * \a other handle is invalidated.
+ *
+ * \return A reference to this IPCPendingCall
+ */
+IPCPendingCall &IPCPendingCall::operator=(IPCPendingCall &&other)
+{
+	if (this != &other) {
+		release();
+
+		pipe_ = other.pipe_;
+		cookie_ = other.cookie_;
+		other.pipe_ = nullptr;
+	}
+
+	return *this;
+}
+
+/**
+ * \fn IPCPendingCall::isValid()
+ * \brief Check if the handle tracks a call
+ *
+ * A handle is invalid when default-constructed, when sending the call failed,
+ * after it has been moved from, and after wait() returned.
+ *
+ * \return True if the handle tracks a call, false otherwise
+ */
+
+/**
+ * \brief Check if the response to the call has been received
+ *
+ * This function doesn't process events, the response is only received when
+ * the event loop of the calling thread runs.
+ *
+ * \return True if the response has been received, false otherwise
+ */
+bool IPCPendingCall::isComplete() const
+{
+	return pipe_ && pipe_->isCallComplete(cookie_);
+}
+
+/**
+ * \brief Wait for the response to the call
+ * \param[out] out IPCMessage instance in which to receive data, if applicable
+ *
+ * This function behaves as IPCPipe::sendSync() for a call that has already
+ * been sent. It will not return until the response is received or the call
+ * times out, and the handle is invalid after it returns.
+ *
+ * \return Zero on success, negative error code otherwise
+ * \retval -EINVAL The handle is invalid
+ */
+int IPCPendingCall::wait(IPCMessage *out)
+{
+	if (!pipe_)
+		return -EINVAL;
+
+	int ret = pipe_->waitCall(cookie_, out);
+	pipe_ = nullptr;
+
+	return ret;
+}
+
+void IPCPendingCall::release()
+{
+	if (!pipe_)
+		return;
+
+	pipe_->cancelCall(cookie_);
+	pipe_ = nullptr;
+}
+
 /**
  * \class IPCPipe
  * \brief IPC message pipe for IPA isolation
  *
  * Virtual class to model an IPC message pipe for use by IPA proxies for IPA
- * isolation. sendSync() and sendAsync() must be implemented, and the recvMessage
- * signal must be emitted whenever new data is available.
+ * isolation. sendSync(), sendAsync() and sendPipelined() must be implemented,
+ * along with the pending call tracking functions used by IPCPendingCall, and
+ * the recvMessage signal must be emitted whenever new data is available.
  */
 
 /**
@@ -200,10 +384,54 @@ IPCPipe::~IPCPipe()
  * \param[in] data Data to send
  *
  * This function will return immediately after sending the message.
+ * Implementations may defer the transmission to batch it with other messages,
+ * as long as the order of all messages sent over the pipe is preserved.
+ *
+ * \return Zero on success, negative error code otherwise
+ */
+
+/**
+ * \fn IPCPipe::sendPipelined()
+ * \brief Send a message over IPC without waiting for the response
+ * \param[in] in Data to send
+ *
+ * This function sends a message that expects a response, as sendSync() does,
+ * but returns immediately after sending it. The response is retrieved later
+ * through the returned handle, allowing the caller to overlap the remote
+ * processing with other work. Calls are processed by the remote side in the
+ * order they are sent, regardless of whether they are synchronous, pipelined
+ * or asynchronous.
+ *
+ * \return A handle to the pending call, invalid if the message couldn't be sent
+ */
+
+/**
+ * \fn IPCPipe::isCallComplete()
+ * \brief Check if the response to a pipelined call has been received
+ * \param[in] cookie The cookie identifying the call
+ * \return True if the response has been received, false otherwise
+ */
+
+/**
+ * \fn IPCPipe::waitCall()
+ * \brief Wait for the response to a pipelined call
+ * \param[in] cookie The cookie identifying the call
+ * \param[out] out IPCMessage instance in which to receive data, if applicable
+ *
+ * The call is forgotten when this function returns.
  *
  * \return Zero on success, negative error code otherwise
  */
 
+/**
+ * \fn IPCPipe::cancelCall()
+ * \brief Discard a pipelined call
+ * \param[in] cookie The cookie identifying the call
+ *
+ * The response to the call, if already received, is dropped. Otherwise it will
+ * be dropped upon reception.
+ */
+
 /**
  * \var IPCPipe::recv
  * \brief Signal to be emitted when a message is received over IPC
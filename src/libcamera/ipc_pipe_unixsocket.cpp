@@ -7,12 +7,18 @@
 
 #include "libcamera/internal/ipc_pipe_unixsocket.h"
 
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <tuple>
 #include <vector>
 
 #include <libcamera/base/event_dispatcher.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/thread.h>
 #include <libcamera/base/timer.h>
+#include <libcamera/base/utils.h>
 
 #include "libcamera/internal/ipc_pipe.h"
 #include "libcamera/internal/ipc_unixsocket.h"
@@ -24,26 +30,78 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(IPCPipe)
 
-IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
-				     const char *ipaProxyWorkerPath)
-	: IPCPipe()
+/*
+ * The proxy worker process and the socket connected to it. A worker hosts one
+ * IPA instance per channel, and routes the messages it receives to the pipe that
+ * owns their channel.
+ */
+class IPCPipeUnixSocket::Worker
+{
+public:
+	Worker(const char *ipaModulePath, const char *ipaProxyWorkerPath,
+	       bool shared);
+
+	static std::shared_ptr<Worker> get(const char *ipaModulePath,
+					   const char *ipaProxyWorkerPath);
+	static void releaseSpares();
+
+	bool isConnected() const { return connected_; }
+	IPCUnixSocket *socket() { return &socket_; }
+
+	uint32_t attach(IPCPipeUnixSocket *pipe);
+	void detach(uint32_t channel);
+
+private:
+	/* The socket is bound to the thread it is created in. */
+	using Key = std::tuple<Thread *, std::string, std::string>;
+
+	static std::shared_ptr<Worker> takeSpare(const Key &key)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+	static void spawnSpares(const Key &key, unsigned int count)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	void readyRead();
+
+	static Mutex mutex_;
+	static std::map<Key, std::weak_ptr<Worker>> shared_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	static std::multimap<Key, std::shared_ptr<Worker>> spares_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	bool connected_;
+	Process proc_;
+	IPCUnixSocket socket_;
+
+	std::map<uint32_t, IPCPipeUnixSocket *> pipes_;
+	uint32_t nextChannel_;
+};
+
+IPCPipeUnixSocket::Worker::Worker(const char *ipaModulePath,
+				  const char *ipaProxyWorkerPath, bool shared)
+	: connected_(false), nextChannel_(0)
 {
 	std::vector<int> fds;
 	std::vector<std::string> args;
 	args.push_back(ipaModulePath);
 
-	socket_ = std::make_unique<IPCUnixSocket>();
-	UniqueFD fd = socket_->create();
+	UniqueFD fd = socket_.create();
 	if (!fd.isValid()) {
 		LOG(IPCPipe, Error) << "Failed to create socket";
 		return;
 	}
-	socket_->readyRead.connect(this, &IPCPipeUnixSocket::readyRead);
+	socket_.readyRead.connect(this, &Worker::readyRead);
 	args.push_back(std::to_string(fd.get()));
 	fds.push_back(fd.get());
 
-	proc_ = std::make_unique<Process>();
-	int ret = proc_->start(ipaProxyWorkerPath, args, fds);
+	/*
+	 * A shared worker keeps running when all its IPA instances have
+	 * exited, as new instances can be created at any time. It is
+	 * terminated when the last pipe releases it.
+	 */
+	if (shared)
+		args.push_back("shared");
+
+	int ret = proc_.start(ipaProxyWorkerPath, args, fds);
 	if (ret) {
 		LOG(IPCPipe, Error)
 			<< "Failed to start proxy worker process";
@@ -53,95 +111,333 @@ IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
 	connected_ = true;
 }
 
-IPCPipeUnixSocket::~IPCPipeUnixSocket()
+Mutex IPCPipeUnixSocket::Worker::mutex_;
+std::map<IPCPipeUnixSocket::Worker::Key, std::weak_ptr<IPCPipeUnixSocket::Worker>>
+	IPCPipeUnixSocket::Worker::shared_;
+std::multimap<IPCPipeUnixSocket::Worker::Key, std::shared_ptr<IPCPipeUnixSocket::Worker>>
+	IPCPipeUnixSocket::Worker::spares_;
+
+/*
+ * Get a worker for the IPA module. Workers are not shared by default, when the
+ * LIBCAMERA_IPA_SHARED_WORKERS environment variable is set, all the pipes
+ * created in a thread for the same IPA module share a single worker process.
+ *
+ * Otherwise, when the LIBCAMERA_IPA_SPARE_WORKERS environment variable is set,
+ * the given number of spare workers is started in advance for each IPA module
+ * that has been used once, and handed out to the next pipes. The worker
+ * processes then load the IPA module while the pipeline handler runs, and the
+ * first call to the IPA doesn't wait for the process to start.
+ */
+std::shared_ptr<IPCPipeUnixSocket::Worker>
+IPCPipeUnixSocket::Worker::get(const char *ipaModulePath,
+			       const char *ipaProxyWorkerPath)
 {
+	Key key{ Thread::current(), ipaModulePath, ipaProxyWorkerPath };
+
+	MutexLocker locker(mutex_);
+
+	const char *shared = utils::secure_getenv("LIBCAMERA_IPA_SHARED_WORKERS");
+	if (!shared || shared[0] == '\0') {
+		std::shared_ptr<Worker> worker = takeSpare(key);
+		if (!worker)
+			worker = std::make_shared<Worker>(ipaModulePath,
+							  ipaProxyWorkerPath,
+							  false);
+
+		const char *spares = utils::secure_getenv("LIBCAMERA_IPA_SPARE_WORKERS");
+		if (spares && spares[0] != '\0')
+			spawnSpares(key, std::min(std::strtoul(spares, nullptr, 10), 8UL));
+
+		return worker;
+	}
+
+	for (auto it = shared_.begin(); it != shared_.end();) {
+		if (it->second.expired())
+			it = shared_.erase(it);
+		else
+			++it;
+	}
+
+	auto it = shared_.find(key);
+	if (it != shared_.end()) {
+		std::shared_ptr<Worker> worker = it->second.lock();
+		if (worker)
+			return worker;
+	}
+
+	auto worker = std::make_shared<Worker>(ipaModulePath,
+					       ipaProxyWorkerPath, true);
+	if (worker->isConnected())
+		shared_[key] = worker;
+
+	return worker;
 }
 
-int IPCPipeUnixSocket::sendSync(const IPCMessage &in, IPCMessage *out)
+void IPCPipeUnixSocket::Worker::releaseSpares()
 {
-	IPCUnixSocket::Payload response;
+	std::vector<std::shared_ptr<Worker>> workers;
 
-	int ret = call(in.payload(), &response, in.header().cookie);
-	if (ret) {
-		LOG(IPCPipe, Error) << "Failed to call sync";
-		return ret;
+	{
+		MutexLocker locker(mutex_);
+
+		for (auto it = spares_.begin(); it != spares_.end();) {
+			if (std::get<0>(it->first) != Thread::current()) {
+				++it;
+				continue;
+			}
+
+			workers.push_back(std::move(it->second));
+			it = spares_.erase(it);
+		}
 	}
 
-	if (out)
-		*out = IPCMessage(response);
+	/* Terminate the processes without holding the lock. */
+	workers.clear();
+}
 
-	return 0;
+std::shared_ptr<IPCPipeUnixSocket::Worker>
+IPCPipeUnixSocket::Worker::takeSpare(const Key &key)
+{
+	auto range = spares_.equal_range(key);
+
+	for (auto it = range.first; it != range.second;) {
+		std::shared_ptr<Worker> worker = std::move(it->second);
+		it = spares_.erase(it);
+
+		/* Skip workers that have died since they have been started. */
+		if (worker->proc_.exitStatus() == Process::NotExited) {
+			LOG(IPCPipe, Debug)
+				<< "Using spare worker for " << std::get<1>(key);
+			return worker;
+		}
+	}
+
+	return nullptr;
 }
 
-int IPCPipeUnixSocket::sendAsync(const IPCMessage &data)
+void IPCPipeUnixSocket::Worker::spawnSpares(const Key &key, unsigned int count)
 {
-	int ret = socket_->send(data.payload());
-	if (ret) {
-		LOG(IPCPipe, Error) << "Failed to call async";
-		return ret;
+	unsigned int available = spares_.count(key);
+
+	for (unsigned int i = available; i < count; i++) {
+		auto worker = std::make_shared<Worker>(std::get<1>(key).c_str(),
+						       std::get<2>(key).c_str(),
+						       false);
+		if (!worker->isConnected())
+			break;
+
+		spares_.emplace(key, std::move(worker));
 	}
+}
 
-	return 0;
+uint32_t IPCPipeUnixSocket::Worker::attach(IPCPipeUnixSocket *pipe)
+{
+	uint32_t channel = nextChannel_++;
+	pipes_[channel] = pipe;
+	return channel;
+}
+
+void IPCPipeUnixSocket::Worker::detach(uint32_t channel)
+{
+	pipes_.erase(channel);
 }
 
-void IPCPipeUnixSocket::readyRead()
+void IPCPipeUnixSocket::Worker::readyRead()
 {
 	IPCUnixSocket::Payload payload;
-	int ret = socket_->receive(&payload);
+	int ret = socket_.receive(&payload);
 	if (ret) {
 		LOG(IPCPipe, Error) << "Receive message failed" << ret;
 		return;
 	}
 
-	/* \todo Use span to avoid the double copy when callData is found. */
 	if (payload.data.size() < sizeof(IPCMessage::Header)) {
 		LOG(IPCPipe, Error) << "Not enough data received";
 		return;
 	}
 
-	IPCMessage ipcMessage(payload);
+	IPCMessage::Header header;
+	memcpy(&header, payload.data.data(), sizeof(header));
 
-	auto callData = callData_.find(ipcMessage.header().cookie);
-	if (callData != callData_.end()) {
-		*callData->second.response = std::move(payload);
-		callData->second.done = true;
+	auto pipe = pipes_.find(header.channel);
+	if (pipe == pipes_.end()) {
+		LOG(IPCPipe, Debug)
+			<< "Dropping message for closed channel " << header.channel;
 		return;
 	}
 
-	/* Received unexpected data, this means it's a call from the IPA. */
-	recv.emit(ipcMessage);
+	pipe->second->receive(header, payload);
 }
 
-int IPCPipeUnixSocket::call(const IPCUnixSocket::Payload &message,
-			    IPCUnixSocket::Payload *response, uint32_t cookie)
+IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
+				     const char *ipaProxyWorkerPath)
+	: IPCPipe(), channel_(0)
 {
-	Timer timeout;
-	int ret;
+	worker_ = Worker::get(ipaModulePath, ipaProxyWorkerPath);
+	if (!worker_->isConnected())
+		return;
+
+	channel_ = worker_->attach(this);
+	connected_ = true;
+}
+
+IPCPipeUnixSocket::~IPCPipeUnixSocket()
+{
+	if (connected_)
+		worker_->detach(channel_);
+}
 
-	const auto result = callData_.insert({ cookie, { response, false } });
-	const auto &iter = result.first;
+/*
+ * Release the spare proxy worker processes started from the calling thread,
+ * when requested through the LIBCAMERA_IPA_SPARE_WORKERS environment variable.
+ * This shall be called before the thread stops.
+ */
+void IPCPipeUnixSocket::releaseSpareWorkers()
+{
+	Worker::releaseSpares();
+}
 
-	ret = socket_->send(message);
+int IPCPipeUnixSocket::sendSync(const IPCMessage &in, IPCMessage *out)
+{
+	IPCPendingCall call = sendPipelined(in);
+	if (!call.isValid()) {
+		LOG(IPCPipe, Error) << "Failed to call sync";
+		return -EIO;
+	}
+
+	int ret = call.wait(out);
 	if (ret) {
-		callData_.erase(iter);
+		LOG(IPCPipe, Error) << "Failed to call sync";
 		return ret;
 	}
 
-	/* \todo Make this less dangerous, see IPCPipe::sendSync() */
+	return 0;
+}
+
+int IPCPipeUnixSocket::sendAsync(const IPCMessage &data)
+{
+	int ret = send(data, true);
+	if (ret) {
+		LOG(IPCPipe, Error) << "Failed to call async";
+		return ret;
+	}
+
+	return 0;
+}
+
+IPCPendingCall IPCPipeUnixSocket::sendPipelined(const IPCMessage &in)
+{
+	const auto result = callData_.insert({ in.header().cookie,
+					       { {}, false, false } });
+	if (!result.second) {
+		LOG(IPCPipe, Error)
+			<< "Call " << in.header().cookie << " already pending";
+		return {};
+	}
+
+	int ret = send(in, false);
+	if (ret) {
+		callData_.erase(result.first);
+		return {};
+	}
+
+	return IPCPendingCall(this, in.header().cookie);
+}
+
+bool IPCPipeUnixSocket::isCallComplete(uint32_t cookie) const
+{
+	auto iter = callData_.find(cookie);
+	return iter != callData_.end() && iter->second.done;
+}
+
+int IPCPipeUnixSocket::waitCall(uint32_t cookie, IPCMessage *out)
+{
+	auto iter = callData_.find(cookie);
+	if (iter == callData_.end())
+		return -ENOENT;
+
+	/*
+	 * The iterator stays valid while processing events, as other calls
+	 * only insert or erase their own entries.
+	 *
+	 * \todo Make this less dangerous, see IPCPipe::sendSync()
+	 */
+	Timer timeout;
 	timeout.start(2000ms);
 	while (!iter->second.done) {
 		if (!timeout.isRunning()) {
 			LOG(IPCPipe, Error) << "Call timeout!";
-			callData_.erase(iter);
+			/* Keep the entry to drop the response if it arrives. */
+			iter->second.cancelled = true;
 			return -ETIMEDOUT;
 		}
 
 		Thread::current()->eventDispatcher()->processEvents();
 	}
 
+	if (out)
+		*out = IPCMessage(iter->second.response);
+
 	callData_.erase(iter);
 
 	return 0;
 }
 
+void IPCPipeUnixSocket::cancelCall(uint32_t cookie)
+{
+	auto iter = callData_.find(cookie);
+	if (iter == callData_.end())
+		return;
+
+	if (iter->second.done)
+		callData_.erase(iter);
+	else
+		iter->second.cancelled = true;
+}
+
+/*
+ * Send a message on the channel of the pipe. The channel is set in the
+ * transmitted header only, the message is left untouched.
+ */
+int IPCPipeUnixSocket::send(const IPCMessage &in, bool batched)
+{
+	IPCMessage::Header header = in.header();
+	header.channel = channel_;
+
+	std::vector<int32_t> fds;
+	fds.reserve(in.fds().size());
+
+	for (const SharedFD &fd : in.fds())
+		fds.push_back(fd.get());
+
+	Span<const uint8_t> headerData{ reinterpret_cast<const uint8_t *>(&header),
+					sizeof(header) };
+	IPCUnixSocket *socket = worker_->socket();
+
+	if (batched)
+		return socket->sendBatched({ headerData, in.data() }, fds);
+
+	return socket->send({ headerData, in.data() }, fds);
+}
+
+void IPCPipeUnixSocket::receive(const IPCMessage::Header &header,
+				IPCUnixSocket::Payload &payload)
+{
+	auto callData = callData_.find(header.cookie);
+	if (callData != callData_.end()) {
+		if (callData->second.cancelled) {
+			callData_.erase(callData);
+			return;
+		}
+
+		callData->second.response = std::move(payload);
+		callData->second.done = true;
+		return;
+	}
+
+	/* Received unexpected data, this means it's a call from the IPA. */
+	IPCMessage ipcMessage(payload);
+	recv.emit(ipcMessage);
+}
+
 } /* namespace libcamera */
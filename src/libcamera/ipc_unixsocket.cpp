@@ -7,15 +7,22 @@
 
 #include "libcamera/internal/ipc_unixsocket.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <poll.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <vector>
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/timer.h>
+
+#include "libcamera/internal/tracepoints.h"
 
 /**
  * \file ipc_unixsocket.h
@@ -26,6 +33,37 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(IPCUnixSocket)
 
+namespace {
+
+/* The message payload is stored in the sender's transmit ring. */
+constexpr uint8_t kHeaderFlagRing = 1 << 0;
+/* The message carries the rings memfd and isn't delivered to the user. */
+constexpr uint8_t kHeaderFlagRingSetup = 1 << 1;
+/* The message payload is a sequence of batched messages. */
+constexpr uint8_t kHeaderFlagBatch = 1 << 2;
+
+constexpr uint32_t kRingSize = 256 * 1024;
+
+static_assert((kRingSize & (kRingSize - 1)) == 0,
+	      "Ring size must be a power of two");
+
+} /* namespace */
+
+/*
+ * A single producer single consumer ring buffer stored in shared memory. The
+ * head and tail are free-running byte counters, the producer only writes the
+ * head and the consumer only writes the tail. They are placed in separate
+ * cache lines to avoid false sharing between the two processes.
+ */
+struct IPCUnixSocket::Ring {
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+	alignas(64) uint8_t data[kRingSize];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+	      "Ring indices must be lock-free to be shared between processes");
+
 /**
  * \struct IPCUnixSocket::Payload
  * \brief Container for an IPC payload
@@ -66,11 +104,31 @@ LOG_DEFINE_CATEGORY(IPCUnixSocket)
  * it to the other side by passing the file descriptor to bind(). At that point
  * the channel is operation and communication is bidirectional and symmmetrical.
  *
+ * To avoid copying message payloads through the kernel, create() additionally
+ * allocates a shared memory region holding one single producer single consumer
+ * ring buffer per direction, and passes it to the remote side as the first
+ * message on the socket. Payloads are then written to the rings, and the
+ * socket only carries a small header that serves as a doorbell to wake up the
+ * receiver, along with the file descriptors of the message, if any. Messages
+ * that don't fit in the free space of the ring, as well as messages sent
+ * before the remote side has mapped the rings, fall back to transporting the
+ * payload through the socket. The fallback is transparent to the users.
+ *
+ * Messages that don't need to be delivered immediately can be sent with
+ * sendBatched(). They are accumulated and transmitted as a single message at
+ * the end of the current event loop iteration, or earlier when a message is
+ * sent with send() or when flush() is called. The receiver unpacks batches
+ * transparently and delivers their messages individually, in order, through
+ * the \ref readyRead signal. Message ordering is preserved across batched and
+ * non-batched messages.
+ *
  * \context This class is \threadbound.
  */
 
 IPCUnixSocket::IPCUnixSocket()
-	: headerReceived_(false), notifier_(nullptr)
+	: headerReceived_(false), notifier_(nullptr), ringMem_(nullptr),
+	  txRing_(nullptr), rxRing_(nullptr), batchCount_(0),
+	  batchTimer_(nullptr)
 {
 }
 
@@ -111,6 +169,25 @@ UniqueFD IPCUnixSocket::create()
 	if (bind(std::move(socketFds[0])) < 0)
 		return {};
 
+	/*
+	 * Create the shared memory rings and pass them to the remote side.
+	 * Failure isn't fatal, messages will then be transported through the
+	 * socket only.
+	 */
+	UniqueFD ringFd = MemFd::create("libcamera-ipc", sizeof(Ring) * 2,
+					MemFd::Seal::Shrink | MemFd::Seal::Grow);
+	if (ringFd.isValid() && !mapRings(ringFd, true)) {
+		Header hdr = {};
+		hdr.fds = 1;
+		hdr.flags = kHeaderFlagRingSetup;
+
+		const int32_t fd = ringFd.get();
+		Span<const uint8_t> header{ reinterpret_cast<const uint8_t *>(&hdr),
+					    sizeof(hdr) };
+		if (sendData({ header }, &fd, 1) < 0)
+			unmapRings();
+	}
+
 	return std::move(socketFds[1]);
 }
 
@@ -133,6 +210,9 @@ int IPCUnixSocket::bind(UniqueFD fd)
 	notifier_ = new EventNotifier(fd_.get(), EventNotifier::Read);
 	notifier_->activated.connect(this, &IPCUnixSocket::dataNotifier);
 
+	batchTimer_ = new Timer();
+	batchTimer_->timeout.connect(this, &IPCUnixSocket::flush);
+
 	return 0;
 }
 
@@ -146,11 +226,20 @@ void IPCUnixSocket::close()
 	if (!isBound())
 		return;
 
+	flush();
+
+	delete batchTimer_;
+	batchTimer_ = nullptr;
+
 	delete notifier_;
 	notifier_ = nullptr;
 
 	fd_.reset();
 	headerReceived_ = false;
+	headerFds_.clear();
+	pending_.clear();
+
+	unmapRings();
 }
 
 /**
@@ -174,18 +263,194 @@ bool IPCUnixSocket::isBound() const
  */
 int IPCUnixSocket::send(const Payload &payload)
 {
-	int ret;
+	return send({ payload.data }, payload.fds);
+}
+
+/**
+ * \brief Send a message assembled from multiple data buffers
+ * \param[in] data The data buffers to send
+ * \param[in] fds The file descriptors to send
+ *
+ * This function queues a message for transmission to the other end of the IPC
+ * channel, in the same way as send(const Payload &payload). The message data is
+ * the concatenation of all buffers in \a data. The buffers are gathered by the
+ * kernel when transmitting the message, allowing callers to send a header and
+ * a separately stored body without copying them to a single buffer first.
+ * Up to four data buffers are supported.
+ *
+ * Messages previously queued with sendBatched() are transmitted first.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCUnixSocket::send(std::initializer_list<Span<const uint8_t>> data,
+			Span<const int32_t> fds)
+{
+	if (!isBound())
+		return -ENOTCONN;
+
+	int ret = flush();
+	if (ret < 0)
+		return ret;
+
+	return sendMessage(data, fds, 0);
+}
 
+/**
+ * \brief Queue a message for batched transmission
+ * \param[in] data The data buffers to send
+ * \param[in] fds The file descriptors to send
+ *
+ * This function queues a message for transmission to the other end of the IPC
+ * channel, as send() does, but defers the transmission to the end of the
+ * current event loop iteration of the calling thread. All messages queued in
+ * the same iteration are transmitted together, which reduces the number of
+ * system calls. The batch is transmitted earlier if it grows too large, if a
+ * message is sent with send(), or if flush() is called.
+ *
+ * The remote side receives the messages individually, in order. Errors that
+ * occur when transmitting the batch are logged, but can't be reported to the
+ * caller.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCUnixSocket::sendBatched(std::initializer_list<Span<const uint8_t>> data,
+			       Span<const int32_t> fds)
+{
 	if (!isBound())
 		return -ENOTCONN;
 
+	if (data.size() > kMaxDataBuffers)
+		return -EINVAL;
+
+	size_t size = 0;
+	for (const Span<const uint8_t> &buffer : data)
+		size += buffer.size();
+
+	if (!size && fds.empty())
+		return -EINVAL;
+
+	size_t recordSize = sizeof(BatchRecord) + size;
+
+	if (batchCount_ && (batchData_.size() + recordSize > kMaxBatchSize ||
+			    batchFds_.size() + fds.size() > UINT8_MAX)) {
+		int ret = flush();
+		if (ret < 0)
+			return ret;
+	}
+
+	if (recordSize > kMaxBatchSize || fds.size() > UINT8_MAX)
+		return sendMessage(data, fds, 0);
+
+	BatchRecord record = {};
+	record.data = size;
+	record.fds = fds.size();
+
+	const uint8_t *recordData = reinterpret_cast<const uint8_t *>(&record);
+	batchData_.insert(batchData_.end(), recordData, recordData + sizeof(record));
+	for (const Span<const uint8_t> &buffer : data)
+		batchData_.insert(batchData_.end(), buffer.begin(), buffer.end());
+	/*
+	 * The caller may close the file descriptors as soon as this function
+	 * returns, duplicate them until the batch is transmitted.
+	 */
+	for (unsigned int i = 0; i < fds.size(); i++) {
+		UniqueFD fd(dup(fds[i]));
+		if (!fd.isValid()) {
+			int ret = -errno;
+			LOG(IPCUnixSocket, Error)
+				<< "Failed to duplicate fd: " << strerror(-ret);
+			batchData_.resize(batchData_.size() - recordSize);
+			batchFds_.resize(batchFds_.size() - i);
+			return ret;
+		}
+
+		batchFds_.push_back(std::move(fd));
+	}
+
+	batchCount_++;
+
+	if (!batchTimer_->isRunning())
+		batchTimer_->start(std::chrono::milliseconds(0));
+
+	return 0;
+}
+
+/**
+ * \brief Transmit the messages queued with sendBatched()
+ *
+ * This function is called automatically at the end of the event loop iteration
+ * in which messages have been queued. It only needs to be called explicitly to
+ * transmit the queued messages without delay.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCUnixSocket::flush()
+{
+	if (!batchCount_)
+		return 0;
+
+	batchTimer_->stop();
+
+	std::vector<int32_t> fds;
+	fds.reserve(batchFds_.size());
+	for (const UniqueFD &fd : batchFds_)
+		fds.push_back(fd.get());
+
+	int ret;
+
+	/* Don't wrap single messages, to avoid the unpacking overhead. */
+	if (batchCount_ == 1) {
+		Span<const uint8_t> data{ batchData_ };
+		ret = sendMessage({ data.subspan(sizeof(BatchRecord)) }, fds, 0);
+	} else {
+		ret = sendMessage({ batchData_ }, fds, kHeaderFlagBatch);
+	}
+
+	batchData_.clear();
+	batchFds_.clear();
+	batchCount_ = 0;
+
+	return ret;
+}
+
+int IPCUnixSocket::sendMessage(std::initializer_list<Span<const uint8_t>> data,
+			       Span<const int32_t> fds, uint8_t flags)
+{
+	int ret;
+
+	if (data.size() > kMaxDataBuffers)
+		return -EINVAL;
+
 	Header hdr = {};
-	hdr.data = payload.data.size();
-	hdr.fds = payload.fds.size();
+	for (const Span<const uint8_t> &buffer : data)
+		hdr.data += buffer.size();
+	hdr.fds = fds.size();
+	hdr.flags = flags;
 
 	if (!hdr.data && !hdr.fds)
 		return -EINVAL;
 
+	if (hdr.data && writeRing(data, hdr.data)) {
+		hdr.flags |= kHeaderFlagRing;
+
+		Span<const uint8_t> header{ reinterpret_cast<const uint8_t *>(&hdr),
+					    sizeof(hdr) };
+		ret = sendData({ header }, fds.data(), hdr.fds);
+		if (ret < 0) {
+			/*
+			 * The receiver only consumes data announced by a
+			 * header, roll the payload back to keep the ring in
+			 * sync.
+			 */
+			uint32_t head = txRing_->head.load(std::memory_order_relaxed);
+			txRing_->head.store(head - hdr.data, std::memory_order_release);
+			return ret;
+		}
+
+		LIBCAMERA_TRACEPOINT(ipc_send, fd_.get(), hdr.data, hdr.fds, hdr.flags);
+		return ret;
+	}
+
 	ret = ::send(fd_.get(), &hdr, sizeof(hdr), 0);
 	if (ret < 0) {
 		ret = -errno;
@@ -194,7 +459,12 @@ int IPCUnixSocket::send(const Payload &payload)
 		return ret;
 	}
 
-	return sendData(payload.data.data(), hdr.data, payload.fds.data(), hdr.fds);
+	ret = sendData(data, fds.data(), hdr.fds);
+	if (ret < 0)
+		return ret;
+
+	LIBCAMERA_TRACEPOINT(ipc_send, fd_.get(), hdr.data, hdr.fds, hdr.flags);
+	return ret;
 }
 
 /**
@@ -204,7 +474,8 @@ int IPCUnixSocket::send(const Payload &payload)
  * This function receives the message payload from the IPC channel and writes it
  * to the \a payload. If no message payload is available, it returns
  * immediately with -EAGAIN. The \ref readyRead signal shall be used to receive
- * notification of message availability.
+ * notification of message availability. As the signal is emitted once per
+ * message, receive() shall be called from the signal handler.
  *
  * \todo Add state machine to make sure we don't block forever and that
  * a header is always followed by a payload.
@@ -219,10 +490,59 @@ int IPCUnixSocket::receive(Payload *payload)
 	if (!isBound())
 		return -ENOTCONN;
 
+	/* Messages from a previously received batch come first. */
+	if (!pending_.empty()) {
+		*payload = std::move(pending_.front());
+		pending_.pop_front();
+		return 0;
+	}
+
 	if (!headerReceived_)
 		return -EAGAIN;
 
+	bool batch = header_.flags & kHeaderFlagBatch;
+
+	int ret = receiveMessage(payload);
+	if (ret < 0 || !batch)
+		return ret;
+
+	ret = unpackBatch(*payload);
+	if (ret < 0)
+		return ret;
+
+	*payload = std::move(pending_.front());
+	pending_.pop_front();
+
+	return 0;
+}
+
+/**
+ * \var IPCUnixSocket::readyRead
+ * \brief A Signal emitted when a message is ready to be read
+ */
+
+int IPCUnixSocket::receiveMessage(Payload *payload)
+{
 	payload->data.resize(header_.data);
+
+	if (header_.flags & kHeaderFlagRing) {
+		int ret = readRing(payload->data.data(), header_.data);
+		payload->fds = std::move(headerFds_);
+		headerFds_.clear();
+
+		LIBCAMERA_TRACEPOINT(ipc_receive, fd_.get(), header_.data,
+				     header_.fds, header_.flags);
+
+		/*
+		 * A corrupted ring can't be recovered from, drop the message
+		 * but keep receiving the next ones.
+		 */
+		headerReceived_ = false;
+		notifier_->setEnabled(true);
+
+		return ret;
+	}
+
 	payload->fds.resize(header_.fds);
 
 	int ret = recvData(payload->data.data(), header_.data,
@@ -230,23 +550,83 @@ int IPCUnixSocket::receive(Payload *payload)
 	if (ret < 0)
 		return ret;
 
+	LIBCAMERA_TRACEPOINT(ipc_receive, fd_.get(), header_.data, header_.fds,
+			     header_.flags);
+
 	headerReceived_ = false;
 	notifier_->setEnabled(true);
 
 	return 0;
 }
 
-/**
- * \var IPCUnixSocket::readyRead
- * \brief A Signal emitted when a message is ready to be read
- */
+int IPCUnixSocket::unpackBatch(const Payload &batch)
+{
+	size_t offset = 0;
+	size_t fdOffset = 0;
+
+	while (offset < batch.data.size()) {
+		BatchRecord record;
+
+		if (batch.data.size() - offset < sizeof(record))
+			break;
+
+		memcpy(&record, &batch.data[offset], sizeof(record));
+		offset += sizeof(record);
+
+		if (record.data > batch.data.size() - offset ||
+		    record.fds > batch.fds.size() - fdOffset)
+			break;
+
+		Payload &payload = pending_.emplace_back();
+		payload.data.assign(batch.data.begin() + offset,
+				    batch.data.begin() + offset + record.data);
+		payload.fds.assign(batch.fds.begin() + fdOffset,
+				   batch.fds.begin() + fdOffset + record.fds);
+
+		offset += record.data;
+		fdOffset += record.fds;
+	}
+
+	if (offset != batch.data.size() || fdOffset != batch.fds.size() ||
+	    pending_.empty()) {
+		LOG(IPCUnixSocket, Error) << "Malformed message batch";
+		pending_.clear();
+		return -EIO;
+	}
+
+	return 0;
+}
+
+void IPCUnixSocket::dispatchPending()
+{
+	/*
+	 * Deliver the remaining messages of a batch, stopping if the receiver
+	 * doesn't consume them.
+	 */
+	while (!pending_.empty()) {
+		size_t count = pending_.size();
 
-int IPCUnixSocket::sendData(const void *buffer, size_t length,
+		readyRead.emit();
+
+		if (pending_.size() == count)
+			break;
+	}
+}
+
+int IPCUnixSocket::sendData(std::initializer_list<Span<const uint8_t>> data,
 			    const int32_t *fds, unsigned int num)
 {
-	struct iovec iov[1];
-	iov[0].iov_base = const_cast<void *>(buffer);
-	iov[0].iov_len = length;
+	std::array<struct iovec, kMaxDataBuffers> iov;
+	unsigned int count = 0;
+
+	for (const Span<const uint8_t> &buffer : data) {
+		if (buffer.empty())
+			continue;
+
+		iov[count].iov_base = const_cast<uint8_t *>(buffer.data());
+		iov[count].iov_len = buffer.size();
+		count++;
+	}
 
 	std::vector<uint8_t> buf(CMSG_SPACE(num * sizeof(uint32_t)));
 
@@ -258,8 +638,8 @@ int IPCUnixSocket::sendData(const void *buffer, size_t length,
 	struct msghdr msg;
 	msg.msg_name = nullptr;
 	msg.msg_namelen = 0;
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
+	msg.msg_iov = iov.data();
+	msg.msg_iovlen = count;
 	msg.msg_control = cmsg;
 	msg.msg_controllen = cmsg->cmsg_len;
 	msg.msg_flags = 0;
@@ -313,23 +693,183 @@ int IPCUnixSocket::recvData(void *buffer, size_t length,
 	return 0;
 }
 
+int IPCUnixSocket::recvHeader()
+{
+	/* Reserve space for the maximum number of fds a header can announce. */
+	std::array<uint8_t, CMSG_SPACE(UINT8_MAX * sizeof(int32_t))> buf;
+
+	struct iovec iov[1];
+	iov[0].iov_base = &header_;
+	iov[0].iov_len = sizeof(header_);
+
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf.data();
+	msg.msg_controllen = buf.size();
+
+	if (recvmsg(fd_.get(), &msg, 0) < 0) {
+		int ret = -errno;
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to receive header: " << strerror(-ret);
+		return ret;
+	}
+
+	headerFds_.clear();
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+		size_t offset = headerFds_.size();
+		headerFds_.resize(offset + count);
+		memcpy(&headerFds_[offset], CMSG_DATA(cmsg),
+		       count * sizeof(int32_t));
+	}
+
+	return 0;
+}
+
+int IPCUnixSocket::mapRings(const UniqueFD &fd, bool creator)
+{
+	void *mem = mmap(nullptr, sizeof(Ring) * 2, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, fd.get(), 0);
+	if (mem == MAP_FAILED) {
+		int ret = -errno;
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to map rings: " << strerror(-ret);
+		return ret;
+	}
+
+	unmapRings();
+
+	ringMem_ = mem;
+
+	/* The creator transmits on the first ring and receives on the second. */
+	Ring *rings = static_cast<Ring *>(mem);
+	txRing_ = creator ? &rings[0] : &rings[1];
+	rxRing_ = creator ? &rings[1] : &rings[0];
+
+	return 0;
+}
+
+void IPCUnixSocket::unmapRings()
+{
+	if (!ringMem_)
+		return;
+
+	munmap(ringMem_, sizeof(Ring) * 2);
+	ringMem_ = nullptr;
+	txRing_ = nullptr;
+	rxRing_ = nullptr;
+}
+
+bool IPCUnixSocket::writeRing(std::initializer_list<Span<const uint8_t>> data,
+			      size_t size)
+{
+	if (!txRing_)
+		return false;
+
+	uint32_t head = txRing_->head.load(std::memory_order_relaxed);
+	uint32_t tail = txRing_->tail.load(std::memory_order_acquire);
+
+	if (size > kRingSize - (head - tail))
+		return false;
+
+	uint32_t pos = head;
+	for (const Span<const uint8_t> &buffer : data) {
+		uint32_t offset = pos & (kRingSize - 1);
+		size_t first = std::min<size_t>(buffer.size(), kRingSize - offset);
+
+		memcpy(&txRing_->data[offset], buffer.data(), first);
+		memcpy(&txRing_->data[0], buffer.data() + first,
+		       buffer.size() - first);
+
+		pos += buffer.size();
+	}
+
+	txRing_->head.store(pos, std::memory_order_release);
+
+	return true;
+}
+
+int IPCUnixSocket::readRing(uint8_t *data, size_t size)
+{
+	if (!rxRing_) {
+		LOG(IPCUnixSocket, Error) << "Ring message without rings";
+		return -EIO;
+	}
+
+	uint32_t tail = rxRing_->tail.load(std::memory_order_relaxed);
+	uint32_t head = rxRing_->head.load(std::memory_order_acquire);
+
+	if (head - tail < size) {
+		LOG(IPCUnixSocket, Error)
+			<< "Ring underflow, " << size << " bytes announced, "
+			<< head - tail << " available";
+		return -EIO;
+	}
+
+	uint32_t offset = tail & (kRingSize - 1);
+	size_t first = std::min<size_t>(size, kRingSize - offset);
+
+	memcpy(data, &rxRing_->data[offset], first);
+	memcpy(data + first, &rxRing_->data[0], size - first);
+
+	rxRing_->tail.store(tail + size, std::memory_order_release);
+
+	return 0;
+}
+
 void IPCUnixSocket::dataNotifier()
 {
 	int ret;
 
+	/*
+	 * Messages from a batch must be delivered before receiving any new
+	 * message. This happens when the receiver processes events from its
+	 * readyRead handler.
+	 */
+	dispatchPending();
+	if (!pending_.empty())
+		return;
+
 	if (!headerReceived_) {
-		/* Receive the header. */
-		ret = ::recv(fd_.get(), &header_, sizeof(header_), 0);
-		if (ret < 0) {
-			ret = -errno;
-			LOG(IPCUnixSocket, Error)
-				<< "Failed to receive header: " << strerror(-ret);
+		ret = recvHeader();
+		if (ret < 0)
+			return;
+
+		if (header_.flags & kHeaderFlagRingSetup) {
+			std::vector<UniqueFD> fds;
+			for (int32_t fd : headerFds_)
+				fds.emplace_back(fd);
+			headerFds_.clear();
+
+			if (fds.size() == 1)
+				mapRings(fds[0], false);
+			else
+				LOG(IPCUnixSocket, Error)
+					<< "Invalid ring setup message";
 			return;
 		}
 
 		headerReceived_ = true;
 	}
 
+	/*
+	 * The payload of ring messages is already available, there's no need to
+	 * wait for a data datagram.
+	 */
+	if (header_.flags & kHeaderFlagRing) {
+		notifier_->setEnabled(false);
+		readyRead.emit();
+		dispatchPending();
+		return;
+	}
+
 	/*
 	 * If the payload has arrived, disable the notifier and emit the
 	 * readyRead signal. The notifier will be reenabled by the receive()
@@ -345,6 +885,7 @@ void IPCUnixSocket::dataNotifier()
 
 	notifier_->setEnabled(false);
 	readyRead.emit();
+	dispatchPending();
 }
 
 } /* namespace libcamera */
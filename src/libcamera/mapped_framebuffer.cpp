@@ -9,11 +9,19 @@
 
 #include <algorithm>
 #include <errno.h>
+#include <fcntl.h>
+#include <linux/dma-buf.h>
 #include <map>
+#include <memory>
+#include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/unique_fd.h>
 
 /**
  * \file mapped_framebuffer.h
@@ -161,6 +169,22 @@ MappedBuffer::~MappedBuffer()
  * \brief Create a write-only mapping
  * \var MappedFrameBuffer::ReadWrite
  * \brief Create a mapping that can be both read and written
+ * \var MappedFrameBuffer::Populate
+ * \brief Pre-fault the pages of the buffer when it is mapped
+ *
+ * Populating the mapping avoids taking one page fault per page on the first
+ * CPU access to the buffer, at the cost of a longer mmap() call. It is only
+ * worth it for buffers that are accessed in full, such as the input and output
+ * buffers of a software ISP. The flag has no effect when an existing cached
+ * mapping is reused, as its pages have been faulted in already.
+ * \var MappedFrameBuffer::ExplicitAccess
+ * \brief Don't begin CPU access when the buffer is mapped
+ *
+ * By default, CPU access to the buffer begins when the MappedFrameBuffer is
+ * constructed and ends when it is destroyed. Mappings that are kept for a long
+ * time, across multiple frames, shall instead bracket each CPU access with
+ * beginAccess() and endAccess(). This flag creates the mapping without
+ * beginning CPU access.
  */
 
 /**
@@ -168,6 +192,195 @@ MappedBuffer::~MappedBuffer()
  * \brief A bitwise combination of MappedFrameBuffer::MapFlag values
  */
 
+/*
+ * A mapping of a dmabuf, shared by all MappedFrameBuffer instances that map the
+ * same dmabuf with the same protection flags. Mappings are kept in a
+ * process-wide cache when they are not used anymore, and are unmapped when
+ * the frame buffer is destroyed, or when the cache grows too large.
+ */
+struct MappedFrameBuffer::Mapping {
+	static Mapping *acquire(int fd, int prot, bool populate, int *error);
+	static void release(Mapping *mapping);
+	static void invalidate(int fd);
+
+	~Mapping();
+
+	dev_t device;
+	ino_t inode;
+	int prot;
+
+	UniqueFD fd;
+	uint8_t *address;
+	size_t length;
+
+	unsigned int refs;
+	uint64_t lastUse;
+	bool stale;
+
+private:
+	struct Cache {
+		Mutex lock;
+		std::vector<std::unique_ptr<Mapping>> mappings LIBCAMERA_TSA_GUARDED_BY(lock);
+		uint64_t useCount LIBCAMERA_TSA_GUARDED_BY(lock) = 0;
+	};
+
+	/* Maximum number of unused mappings kept in the cache. */
+	static constexpr unsigned int kMaxIdleMappings = 32;
+
+	static Cache &cache();
+	static void evict(Cache &cache) LIBCAMERA_TSA_REQUIRES(cache.lock);
+};
+
+MappedFrameBuffer::Mapping::~Mapping()
+{
+	munmap(address, length);
+}
+
+MappedFrameBuffer::Mapping::Cache &MappedFrameBuffer::Mapping::cache()
+{
+	static Cache cache;
+	return cache;
+}
+
+MappedFrameBuffer::Mapping *
+MappedFrameBuffer::Mapping::acquire(int fd, int prot, bool populate, int *error)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		*error = -errno;
+		return nullptr;
+	}
+
+	Cache &cache = Mapping::cache();
+	MutexLocker locker(cache.lock);
+
+	for (std::unique_ptr<Mapping> &mapping : cache.mappings) {
+		if (mapping->device != st.st_dev || mapping->inode != st.st_ino ||
+		    mapping->prot != prot || mapping->stale)
+			continue;
+
+		mapping->refs++;
+		mapping->lastUse = ++cache.useCount;
+		return mapping.get();
+	}
+
+	/* Map the whole dmabuf, to share the mapping between all planes. */
+	std::unique_ptr<Mapping> mapping{ new Mapping() };
+	mapping->fd = UniqueFD(fcntl(fd, F_DUPFD_CLOEXEC, 0));
+	if (!mapping->fd.isValid()) {
+		*error = -errno;
+		return nullptr;
+	}
+
+	off_t length = lseek(fd, 0, SEEK_END);
+	if (length < 0) {
+		*error = -errno;
+		return nullptr;
+	}
+
+	mapping->length = length;
+	int flags = MAP_SHARED | (populate ? MAP_POPULATE : 0);
+	void *address = mmap(nullptr, mapping->length, prot, flags, fd, 0);
+	if (address == MAP_FAILED) {
+		*error = -errno;
+		return nullptr;
+	}
+
+	mapping->device = st.st_dev;
+	mapping->inode = st.st_ino;
+	mapping->prot = prot;
+	mapping->address = static_cast<uint8_t *>(address);
+	mapping->refs = 1;
+	mapping->lastUse = ++cache.useCount;
+	mapping->stale = false;
+
+	cache.mappings.push_back(std::move(mapping));
+	evict(cache);
+
+	return cache.mappings.back().get();
+}
+
+void MappedFrameBuffer::Mapping::release(Mapping *mapping)
+{
+	Cache &cache = Mapping::cache();
+	MutexLocker locker(cache.lock);
+
+	ASSERT(mapping->refs);
+	if (--mapping->refs)
+		return;
+
+	if (mapping->stale) {
+		auto it = std::find_if(cache.mappings.begin(), cache.mappings.end(),
+				       [&](const std::unique_ptr<Mapping> &m) {
+					       return m.get() == mapping;
+				       });
+		cache.mappings.erase(it);
+		return;
+	}
+
+	evict(cache);
+}
+
+void MappedFrameBuffer::Mapping::invalidate(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return;
+
+	Cache &cache = Mapping::cache();
+	MutexLocker locker(cache.lock);
+
+	/*
+	 * Unmap the unused mappings of the dmabuf immediately, and mark the
+	 * used ones as stale to unmap them when they get released.
+	 */
+	auto it = cache.mappings.begin();
+	while (it != cache.mappings.end()) {
+		Mapping *mapping = it->get();
+
+		if (mapping->device != st.st_dev || mapping->inode != st.st_ino) {
+			++it;
+			continue;
+		}
+
+		if (mapping->refs) {
+			mapping->stale = true;
+			++it;
+			continue;
+		}
+
+		it = cache.mappings.erase(it);
+	}
+}
+
+/*
+ * Unmap the least recently used mappings when the cache holds too many unused
+ * mappings, to bound the address space and the dmabuf references it holds.
+ */
+void MappedFrameBuffer::Mapping::evict(Cache &cache)
+{
+	std::vector<std::unique_ptr<Mapping>> &mappings = cache.mappings;
+
+	while (true) {
+		auto oldest = mappings.end();
+		unsigned int idle = 0;
+
+		for (auto it = mappings.begin(); it != mappings.end(); ++it) {
+			if ((*it)->refs)
+				continue;
+
+			idle++;
+			if (oldest == mappings.end() || (*it)->lastUse < (*oldest)->lastUse)
+				oldest = it;
+		}
+
+		if (idle <= kMaxIdleMappings)
+			return;
+
+		mappings.erase(oldest);
+	}
+}
+
 /**
  * \brief Map all planes of a FrameBuffer
  * \param[in] buffer FrameBuffer to be mapped
@@ -175,9 +388,21 @@ MappedBuffer::~MappedBuffer()
  *
  * Construct an object to map a frame buffer for CPU access. The mapping can be
  * made as Read only, Write only or support Read and Write operations by setting
- * the MapFlag flags accordingly.
+ * the MapFlag flags accordingly. The MapFlag::Populate flag additionally
+ * pre-faults the pages of new mappings.
+ *
+ * The memory mappings are cached and shared between all MappedFrameBuffer
+ * instances that map the same dmabuf with the same flags, mapping the same
+ * frame buffer repeatedly thus doesn't mmap() and munmap() it every time.
+ * Cached mappings are released when the frame buffer is destroyed.
+ *
+ * CPU access to the buffer begins when the MappedFrameBuffer is constructed,
+ * in the directions specified by \a flags, and ends when it is destroyed,
+ * unless the MapFlag::ExplicitAccess flag is set. See beginAccess() for
+ * details.
  */
 MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
+	: flags_(flags), syncFlags_(0)
 {
 	ASSERT(!buffer->planes().empty());
 	planes_.reserve(buffer->planes().size());
@@ -190,53 +415,202 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 	if (flags & MapFlag::Write)
 		mmapFlags |= PROT_WRITE;
 
-	struct MappedBufferInfo {
-		uint8_t *address = nullptr;
-		size_t mapLength = 0;
-		size_t dmabufLength = 0;
-	};
-	std::map<int, MappedBufferInfo> mappedBuffers;
+	std::map<int, Mapping *> mappings;
 
 	for (const FrameBuffer::Plane &plane : buffer->planes()) {
-		const int fd = plane.fd.get();
-		if (mappedBuffers.find(fd) == mappedBuffers.end()) {
-			const size_t length = lseek(fd, 0, SEEK_END);
-			mappedBuffers[fd] = MappedBufferInfo{ nullptr, 0, length };
+		if (plane.address) {
+			planes_.emplace_back(static_cast<uint8_t *>(plane.address) + plane.offset,
+					     plane.length);
+			continue;
 		}
 
-		const size_t length = mappedBuffers[fd].dmabufLength;
+		const int fd = plane.fd.get();
+		Mapping *&mapping = mappings[fd];
+		if (!mapping) {
+			mapping = Mapping::acquire(fd, mmapFlags,
+						   !!(flags & MapFlag::Populate),
+						   &error_);
+			if (!mapping) {
+				LOG(Buffer, Error) << "Failed to mmap plane: "
+						   << strerror(-error_);
+				return;
+			}
+
+			mappings_.push_back(mapping);
+		}
 
-		if (plane.offset > length ||
-		    plane.offset + plane.length > length) {
+		if (plane.offset > mapping->length ||
+		    plane.offset + plane.length > mapping->length) {
 			LOG(Buffer, Fatal) << "plane is out of buffer: "
-					   << "buffer length=" << length
+					   << "buffer length=" << mapping->length
 					   << ", plane offset=" << plane.offset
 					   << ", plane length=" << plane.length;
 			return;
 		}
-		size_t &mapLength = mappedBuffers[fd].mapLength;
-		mapLength = std::max(mapLength,
-				     static_cast<size_t>(plane.offset + plane.length));
+
+		planes_.emplace_back(mapping->address + plane.offset, plane.length);
 	}
 
-	for (const FrameBuffer::Plane &plane : buffer->planes()) {
-		const int fd = plane.fd.get();
-		auto &info = mappedBuffers[fd];
-		if (!info.address) {
-			void *address = mmap(nullptr, info.mapLength, mmapFlags,
-					     MAP_SHARED, fd, 0);
-			if (address == MAP_FAILED) {
-				error_ = -errno;
-				LOG(Buffer, Error) << "Failed to mmap plane: "
-						   << strerror(-error_);
-				return;
-			}
+	if (!(flags & MapFlag::ExplicitAccess))
+		beginAccess(flags);
+}
+
+MappedFrameBuffer::~MappedFrameBuffer()
+{
+	release();
+}
+
+/**
+ * \brief Move constructor, construct the MappedFrameBuffer with the contents
+ * of \a other using move semantics
+ * \param[in] other The other MappedFrameBuffer
+ */
+MappedFrameBuffer::MappedFrameBuffer(MappedFrameBuffer &&other)
+	: MappedBuffer(std::move(other)),
+	  mappings_(std::move(other.mappings_)), flags_(other.flags_),
+	  syncFlags_(other.syncFlags_)
+{
+	other.mappings_.clear();
+	other.syncFlags_ = 0;
+}
+
+/**
+ * \brief Move assignment operator, replace the mappings with those of \a other
+ * \param[in] other The other MappedFrameBuffer
+ * \return A reference to this MappedFrameBuffer
+ */
+MappedFrameBuffer &MappedFrameBuffer::operator=(MappedFrameBuffer &&other)
+{
+	release();
+
+	MappedBuffer::operator=(std::move(other));
+	mappings_ = std::move(other.mappings_);
+	flags_ = other.flags_;
+	syncFlags_ = other.syncFlags_;
+	other.mappings_.clear();
+	other.syncFlags_ = 0;
+
+	return *this;
+}
+
+/**
+ * \brief Begin CPU access to the buffer
+ * \param[in] access The directions of the CPU access
+ *
+ * Buffers can be allocated from cached memory, in which case the CPU caches
+ * must be maintained around CPU accesses for the CPU and the devices to see
+ * the same data. This function prepares the buffer for CPU access in the
+ * directions specified by \a access, MapFlag::Read to read data written by a
+ * device, MapFlag::Write to write data that a device will read, or both. Other
+ * flags are ignored. The directions shall be allowed by the mapping flags.
+ *
+ * Every call to beginAccess() shall be balanced by a call to endAccess()
+ * before the buffer is accessed by a device again. Cache maintenance is
+ * performed with the DMA_BUF_IOCTL_SYNC ioctl on all the dmabufs of the frame
+ * buffer, the kernel doesn't support maintaining a range of a dmabuf. Planes
+ * that are not backed by a dmabuf are not affected. CPU access begins even if
+ * cache maintenance fails, and shall be ended with endAccess() in all cases.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY CPU access has already begun
+ * \retval -EINVAL The access directions are not allowed by the mapping
+ *
+ * The function is const, as it doesn't modify the mapping, to allow bracketing
+ * CPU access to buffers that are only reachable through const references.
+ */
+int MappedFrameBuffer::beginAccess(MapFlags access) const
+{
+	access &= MapFlag::ReadWrite;
+	if (!access || (access & ~flags_ & MapFlag::ReadWrite))
+		return -EINVAL;
+
+	if (syncFlags_)
+		return -EBUSY;
+
+	unsigned int flags = 0;
+	if (access & MapFlag::Read)
+		flags |= DMA_BUF_SYNC_READ;
+	if (access & MapFlag::Write)
+		flags |= DMA_BUF_SYNC_WRITE;
+
+	syncFlags_ = flags;
 
-			info.address = static_cast<uint8_t *>(address);
-			maps_.emplace_back(info.address, info.mapLength);
+	return sync(DMA_BUF_SYNC_START | flags);
+}
+
+/**
+ * \brief End CPU access to the buffer
+ *
+ * Complete the CPU access started by beginAccess(), in the same directions.
+ * The function does nothing if no CPU access is in progress.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::endAccess() const
+{
+	if (!syncFlags_)
+		return 0;
+
+	int ret = sync(DMA_BUF_SYNC_END | syncFlags_);
+	syncFlags_ = 0;
+	return ret;
+}
+
+/**
+ * \fn MappedFrameBuffer::accessing()
+ * \brief Check if CPU access to the buffer is in progress
+ * \return True if beginAccess() has been called without a matching
+ * endAccess(), false otherwise
+ */
+
+int MappedFrameBuffer::sync(uint64_t flags) const
+{
+	struct dma_buf_sync sync = { flags };
+	int ret = 0;
+
+	for (Mapping *mapping : mappings_) {
+		/* Not all mappable file descriptors are dmabufs, ignore ENOTTY. */
+		if (ioctl(mapping->fd.get(), DMA_BUF_IOCTL_SYNC, &sync) < 0 &&
+		    errno != ENOTTY) {
+			ret = -errno;
+			LOG(Buffer, Warning) << "Failed to sync dmabuf: "
+					     << strerror(-ret);
 		}
+	}
+
+	return ret;
+}
+
+void MappedFrameBuffer::release()
+{
+	endAccess();
+
+	for (Mapping *mapping : mappings_)
+		Mapping::release(mapping);
+
+	mappings_.clear();
+}
+
+/**
+ * \brief Release the cached mappings of frame buffer planes
+ * \param[in] planes The frame buffer planes
+ *
+ * This function unmaps the cached mappings of the dmabufs of all \a planes.
+ * Mappings still used by MappedFrameBuffer instances are unmapped when the last
+ * instance using them is destroyed. It is called when frame buffers are
+ * destroyed, and only needs to be called explicitly when the dmabufs are
+ * released through other means.
+ */
+void MappedFrameBuffer::invalidate(Span<const FrameBuffer::Plane> planes)
+{
+	int fd = -1;
+
+	for (const FrameBuffer::Plane &plane : planes) {
+		if (plane.address || !plane.fd.isValid() || plane.fd.get() == fd)
+			continue;
 
-		planes_.emplace_back(info.address + plane.offset, plane.length);
+		fd = plane.fd.get();
+		Mapping::invalidate(fd);
 	}
 }
 
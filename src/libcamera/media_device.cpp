@@ -9,16 +9,21 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <map>
 #include <stdint.h>
 #include <string>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include <linux/media.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+
+#include "libcamera/internal/media_request.h"
 
 /**
  * \file media_device.h
@@ -30,6 +35,27 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(MediaDevice)
 
+namespace {
+
+/*
+ * Number of objects of each type found in the topology of a media device the
+ * last time it was populated. The sizes are shared by all MediaDevice instances
+ * of the process, so that populating the same device again, for instance when
+ * a new CameraManager is started, retrieves its topology in a single
+ * MEDIA_IOC_G_TOPOLOGY call.
+ */
+struct TopologySizes {
+	unsigned int entities = 0;
+	unsigned int interfaces = 0;
+	unsigned int pads = 0;
+	unsigned int links = 0;
+};
+
+Mutex topologySizesMutex;
+std::map<std::string, TopologySizes> topologySizes;
+
+} /* namespace */
+
 /**
  * \class MediaDevice
  * \brief The MediaDevice represents a Media Controller device with its full
@@ -42,11 +68,11 @@ LOG_DEFINE_CATEGORY(MediaDevice)
  * The instance is created with an empty media graph. Before performing any
  * other operation, it must be populate by calling populate(). Instances of
  * MediaEntity, MediaPad and MediaLink are created to model the media graph,
- * and stored in a map indexed by object id.
+ * and indexed by object id in a hash table.
  *
  * The graph is valid once successfully populated, as reported by the isValid()
  * function. It can be queried to list all entities(), or entities can be
- * looked up by name with getEntityByName(). The graph can be traversed from
+ * looked up by name in constant time with getEntityByName(). The graph can be traversed from
  * entity to entity through pads and links as exposed by the corresponding
  * classes.
  *
@@ -193,11 +219,11 @@ void MediaDevice::unlock()
 int MediaDevice::populate()
 {
 	struct media_v2_topology topology = {};
-	struct media_v2_entity *ents = nullptr;
-	struct media_v2_interface *interfaces = nullptr;
-	struct media_v2_link *links = nullptr;
-	struct media_v2_pad *pads = nullptr;
-	__u64 version = -1;
+	std::vector<struct media_v2_entity> ents;
+	std::vector<struct media_v2_interface> interfaces;
+	std::vector<struct media_v2_link> links;
+	std::vector<struct media_v2_pad> pads;
+	TopologySizes sizes;
 	int ret;
 
 	clear();
@@ -217,21 +243,41 @@ int MediaDevice::populate()
 
 	driver_ = info.driver;
 	model_ = info.model;
+	serial_ = info.serial;
 	version_ = info.media_version;
 	hwRevision_ = info.hw_revision;
 
+	{
+		MutexLocker locker(topologySizesMutex);
+		auto it = topologySizes.find(deviceNode_);
+		if (it != topologySizes.end())
+			sizes = it->second;
+	}
+
 	/*
-	 * Keep calling G_TOPOLOGY until the version number stays stable.
+	 * The kernel fills the arrays atomically, and reports the number of
+	 * objects in the graph. Retrieve the topology with arrays sized from
+	 * the previous enumeration, and retry with larger arrays if they are
+	 * too small.
 	 */
 	while (true) {
-		topology.topology_version = 0;
-		topology.ptr_entities = reinterpret_cast<uintptr_t>(ents);
-		topology.ptr_interfaces = reinterpret_cast<uintptr_t>(interfaces);
-		topology.ptr_links = reinterpret_cast<uintptr_t>(links);
-		topology.ptr_pads = reinterpret_cast<uintptr_t>(pads);
+		ents.resize(sizes.entities);
+		interfaces.resize(sizes.interfaces);
+		links.resize(sizes.links);
+		pads.resize(sizes.pads);
+
+		topology = {};
+		topology.num_entities = ents.size();
+		topology.ptr_entities = reinterpret_cast<uintptr_t>(ents.data());
+		topology.num_interfaces = interfaces.size();
+		topology.ptr_interfaces = reinterpret_cast<uintptr_t>(interfaces.data());
+		topology.num_links = links.size();
+		topology.ptr_links = reinterpret_cast<uintptr_t>(links.data());
+		topology.num_pads = pads.size();
+		topology.ptr_pads = reinterpret_cast<uintptr_t>(pads.data());
 
 		ret = ioctl(fd_.get(), MEDIA_IOC_G_TOPOLOGY, &topology);
-		if (ret < 0) {
+		if (ret < 0 && errno != ENOSPC) {
 			ret = -errno;
 			LOG(MediaDevice, Error)
 				<< "Failed to enumerate topology: "
@@ -239,20 +285,25 @@ int MediaDevice::populate()
 			goto done;
 		}
 
-		if (version == topology.topology_version)
+		if (ret == 0 &&
+		    topology.num_entities <= ents.size() &&
+		    topology.num_interfaces <= interfaces.size() &&
+		    topology.num_links <= links.size() &&
+		    topology.num_pads <= pads.size())
 			break;
 
-		delete[] ents;
-		delete[] interfaces;
-		delete[] pads;
-		delete[] links;
-
-		ents = new struct media_v2_entity[topology.num_entities]();
-		interfaces = new struct media_v2_interface[topology.num_interfaces]();
-		links = new struct media_v2_link[topology.num_links]();
-		pads = new struct media_v2_pad[topology.num_pads]();
+		sizes.entities = topology.num_entities;
+		sizes.interfaces = topology.num_interfaces;
+		sizes.links = topology.num_links;
+		sizes.pads = topology.num_pads;
+	}
 
-		version = topology.topology_version;
+	{
+		MutexLocker locker(topologySizesMutex);
+		topologySizes[deviceNode_] = { topology.num_entities,
+					       topology.num_interfaces,
+					       topology.num_pads,
+					       topology.num_links };
 	}
 
 	/* Populate entities, pads and links. */
@@ -265,11 +316,6 @@ int MediaDevice::populate()
 done:
 	close();
 
-	delete[] ents;
-	delete[] interfaces;
-	delete[] pads;
-	delete[] links;
-
 	if (!valid_) {
 		clear();
 		return -EINVAL;
@@ -302,6 +348,16 @@ done:
  * \return The MediaDevice model name
  */
 
+/**
+ * \fn MediaDevice::serial()
+ * \brief Retrieve the media device serial number
+ *
+ * The serial number is reported by the driver, and is empty when the device
+ * has no serial number.
+ *
+ * \return The MediaDevice serial number
+ */
+
 /**
  * \fn MediaDevice::version()
  * \brief Retrieve the media device API version
@@ -333,11 +389,8 @@ done:
  */
 MediaEntity *MediaDevice::getEntityByName(const std::string &name) const
 {
-	for (MediaEntity *e : entities_)
-		if (e->name() == name)
-			return e;
-
-	return nullptr;
+	auto it = entitiesByName_.find(name);
+	return it != entitiesByName_.end() ? it->second : nullptr;
 }
 
 /**
@@ -453,6 +506,43 @@ int MediaDevice::disableLinks()
 	return 0;
 }
 
+/**
+ * \brief Allocate media requests
+ * \param[in] count Number of requests to allocate
+ * \param[out] requests Vector to store the allocated requests
+ *
+ * This function allocates \a count media requests and appends them to
+ * \a requests. The media device shall be acquired. Requests are only
+ * supported by drivers that implement the Media Request API, a failure with
+ * -ENOTTY or -ENOTSUP indicates that requests are not supported.
+ *
+ * \return The number of requests allocated on success or a negative error code
+ * otherwise
+ * \retval -EBADF The media device isn't acquired
+ * \sa MediaRequest
+ */
+int MediaDevice::allocateRequests(unsigned int count,
+				  std::vector<std::unique_ptr<MediaRequest>> *requests)
+{
+	if (!fd_.isValid())
+		return -EBADF;
+
+	for (unsigned int i = 0; i < count; i++) {
+		int fd;
+
+		if (ioctl(fd_.get(), MEDIA_IOC_REQUEST_ALLOC, &fd) < 0) {
+			int ret = -errno;
+			LOG(MediaDevice, Debug)
+				<< "Failed to allocate request: " << strerror(-ret);
+			return ret;
+		}
+
+		requests->push_back(std::make_unique<MediaRequest>(UniqueFD(fd)));
+	}
+
+	return count;
+}
+
 /**
  * \var MediaDevice::disconnected
  * \brief Signal emitted when the media device is disconnected from the system
@@ -509,8 +599,13 @@ void MediaDevice::close()
 
 /**
  * \var MediaDevice::objects_
- * \brief Global map of media objects (entities, pads, links) keyed by their
- * object id.
+ * \brief Global list of media objects (entities, pads, links) owned by the
+ * media device
+ */
+
+/**
+ * \var MediaDevice::objectsById_
+ * \brief Hash table of the media objects keyed by their object id
  */
 
 /**
@@ -519,8 +614,8 @@ void MediaDevice::close()
  */
 MediaObject *MediaDevice::object(unsigned int id)
 {
-	auto it = objects_.find(id);
-	return (it == objects_.end()) ? nullptr : it->second;
+	auto it = objectsById_.find(id);
+	return (it == objectsById_.end()) ? nullptr : it->second;
 }
 
 /**
@@ -535,15 +630,14 @@ MediaObject *MediaDevice::object(unsigned int id)
  */
 bool MediaDevice::addObject(MediaObject *object)
 {
-
-	if (objects_.find(object->id()) != objects_.end()) {
+	if (!objectsById_.emplace(object->id(), object).second) {
 		LOG(MediaDevice, Error)
 			<< "Element with id " << object->id()
 			<< " already enumerated.";
 		return false;
 	}
 
-	objects_[object->id()] = object;
+	objects_.push_back(object);
 
 	return true;
 }
@@ -561,11 +655,13 @@ bool MediaDevice::addObject(MediaObject *object)
  */
 void MediaDevice::clear()
 {
-	for (auto const &o : objects_)
-		delete o.second;
+	for (MediaObject *o : objects_)
+		delete o;
 
 	objects_.clear();
+	objectsById_.clear();
 	entities_.clear();
+	entitiesByName_.clear();
 	valid_ = false;
 }
 
@@ -575,52 +671,53 @@ void MediaDevice::clear()
  */
 
 /**
- * \brief Find the interface associated with an entity
- * \param[in] topology The media topology as returned by MEDIA_IOC_G_TOPOLOGY
- * \param[in] entityId The entity id
- * \return A pointer to the interface if found, or nullptr otherwise
+ * \var MediaDevice::entitiesByName_
+ * \brief Hash table of the media entities keyed by their name
+ *
+ * When multiple entities share the same name, the table references the first
+ * one in the entities_ list.
  */
-struct media_v2_interface *MediaDevice::findInterface(const struct media_v2_topology &topology,
-						      unsigned int entityId)
-{
-	struct media_v2_link *links = reinterpret_cast<struct media_v2_link *>
-						      (topology.ptr_links);
-	unsigned int ifaceId = 0;
-	unsigned int i;
-
-	for (i = 0; i < topology.num_links; ++i) {
-		/* Search for the interface to entity link. */
-		if (links[i].sink_id != entityId)
-			continue;
-
-		if ((links[i].flags & MEDIA_LNK_FL_LINK_TYPE) !=
-		    MEDIA_LNK_FL_INTERFACE_LINK)
-			continue;
-
-		ifaceId = links[i].source_id;
-		break;
-	}
-	if (i == topology.num_links)
-		return nullptr;
-
-	struct media_v2_interface *ifaces = reinterpret_cast<struct media_v2_interface *>
-					    (topology.ptr_interfaces);
-	for (i = 0; i < topology.num_interfaces; ++i) {
-		if (ifaces[i].id == ifaceId)
-			return &ifaces[i];
-	}
-
-	return nullptr;
-}
 
 /*
  * For each entity in the media graph create a MediaEntity and store a
- * reference in the media device objects map and entities list.
+ * reference in the media device objects table and entities list.
  */
 bool MediaDevice::populateEntities(const struct media_v2_topology &topology)
 {
 	struct media_v2_entity *mediaEntities = reinterpret_cast<struct media_v2_entity *>
 						(topology.ptr_entities);
+	struct media_v2_interface *mediaInterfaces = reinterpret_cast<struct media_v2_interface *>
+						     (topology.ptr_interfaces);
+	struct media_v2_link *mediaLinks = reinterpret_cast<struct media_v2_link *>
+					   (topology.ptr_links);
+
+	/*
+	 * Index the interfaces by the id of the entity they're linked to, to
+	 * avoid scanning all links for every entity.
+	 */
+	std::unordered_map<unsigned int, const struct media_v2_interface *> interfaceIds;
+	for (unsigned int i = 0; i < topology.num_interfaces; ++i) {
+		unsigned int id = mediaInterfaces[i].id;
+		interfaceIds.emplace(id, &mediaInterfaces[i]);
+	}
+
+	std::unordered_map<unsigned int, const struct media_v2_interface *> entityInterfaces;
+	for (unsigned int i = 0; i < topology.num_links; ++i) {
+		if ((mediaLinks[i].flags & MEDIA_LNK_FL_LINK_TYPE) !=
+		    MEDIA_LNK_FL_INTERFACE_LINK)
+			continue;
+
+		unsigned int entityId = mediaLinks[i].sink_id;
+		auto iface = interfaceIds.find(mediaLinks[i].source_id);
+		if (iface != interfaceIds.end())
+			entityInterfaces.emplace(entityId, iface->second);
+	}
+
+	objects_.reserve(topology.num_entities + topology.num_pads +
+			 topology.num_links);
+	objectsById_.reserve(objects_.capacity());
+	entities_.reserve(topology.num_entities);
+	entitiesByName_.reserve(topology.num_entities);
 
 	for (unsigned int i = 0; i < topology.num_entities; ++i) {
 		struct media_v2_entity *ent = &mediaEntities[i];
@@ -636,9 +733,10 @@ bool MediaDevice::populateEntities(const struct media_v2_topology &topology)
 		 * Find the interface linked to this entity to get the device
 		 * node major and minor numbers.
 		 */
-		struct media_v2_interface *iface =
-			findInterface(topology, ent->id);
-		MediaEntity *entity = new MediaEntity(this, ent, iface);
+		auto iface = entityInterfaces.find(ent->id);
+		MediaEntity *entity =
+			new MediaEntity(this, ent,
+					iface != entityInterfaces.end() ? iface->second : nullptr);
 
 		if (!addObject(entity)) {
 			delete entity;
@@ -646,6 +744,7 @@ bool MediaDevice::populateEntities(const struct media_v2_topology &topology)
 		}
 
 		entities_.push_back(entity);
+		entitiesByName_.emplace(entity->name(), entity);
 	}
 
 	return true;
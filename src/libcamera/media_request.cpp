@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Media Controller request
+ */
+
+#include "libcamera/internal/media_request.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <linux/media.h>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+
+/**
+ * \file media_request.h
+ * \brief Media Controller request
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(MediaDevice)
+
+/**
+ * \class MediaRequest
+ * \brief A Media Controller request bundling buffers and controls
+ *
+ * Media requests group V4L2 buffers and control values, possibly spanning
+ * multiple video devices and subdevices of a media device, that the kernel
+ * applies atomically to the same frame. They allow associating sensor and ISP
+ * parameters with a given frame without having to predict when controls set
+ * immediately will take effect.
+ *
+ * Requests are allocated from the media device with
+ * MediaDevice::allocateRequests(). In the Idle state, buffers are added to a
+ * request with V4L2VideoDevice::queueBuffer() and controls with
+ * V4L2Device::setControls(), passing the request as an argument. The request
+ * is then queued to the kernel with queue(). The completed signal is emitted
+ * once the kernel has processed all the objects contained in the request.
+ * Control values applied by the request can then be read back with
+ * V4L2Device::getControls(), and the request recycled with reinit().
+ *
+ * The buffers contained in the request are still completed individually
+ * through the V4L2VideoDevice::bufferReady signal.
+ */
+
+/**
+ * \enum MediaRequest::Status
+ * \brief The request status
+ * \var MediaRequest::Status::Idle
+ * \brief The request is being prepared and hasn't been queued
+ * \var MediaRequest::Status::Queued
+ * \brief The request has been queued to the kernel
+ * \var MediaRequest::Status::Complete
+ * \brief The request has been completed by the kernel
+ */
+
+/**
+ * \brief Construct a MediaRequest from a request file descriptor
+ * \param[in] fd The file descriptor returned by MEDIA_IOC_REQUEST_ALLOC
+ */
+MediaRequest::MediaRequest(UniqueFD fd)
+	: fd_(std::move(fd)), status_(Status::Idle), cookie_(0)
+{
+	/* The kernel signals request completion with POLLPRI. */
+	notifier_ = std::make_unique<EventNotifier>(fd_.get(),
+						    EventNotifier::Exception);
+	notifier_->activated.connect(this, &MediaRequest::requestComplete);
+	notifier_->setEnabled(false);
+}
+
+MediaRequest::~MediaRequest() = default;
+
+/**
+ * \fn MediaRequest::fd()
+ * \brief Retrieve the request file descriptor
+ * \return The request file descriptor
+ */
+
+/**
+ * \fn MediaRequest::status()
+ * \brief Retrieve the request status
+ * \return The request status
+ */
+
+/**
+ * \fn MediaRequest::cookie()
+ * \brief Retrieve the cookie set with setCookie()
+ * \return The request cookie
+ */
+
+/**
+ * \fn MediaRequest::setCookie()
+ * \brief Associate an opaque value with the request
+ * \param[in] cookie The cookie
+ *
+ * The cookie is not interpreted by the request. It is typically used by
+ * pipeline handlers to store the sequence number of the frame the request
+ * applies to. It is preserved by reinit().
+ */
+
+/**
+ * \brief Queue the request to the kernel
+ *
+ * The request shall be in the Idle state. Once queued, no buffer or control
+ * can be added to the request until it completes and is reinitialized.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The request isn't idle
+ * \retval -ENOENT The request doesn't contain any buffer
+ */
+int MediaRequest::queue()
+{
+	if (status_ != Status::Idle)
+		return -EBUSY;
+
+	if (::ioctl(fd_.get(), MEDIA_REQUEST_IOC_QUEUE) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to queue request: " << strerror(-ret);
+		return ret;
+	}
+
+	status_ = Status::Queued;
+	notifier_->setEnabled(true);
+
+	return 0;
+}
+
+/**
+ * \brief Reinitialize the request for reuse
+ *
+ * This function discards all the objects contained in the request and moves it
+ * back to the Idle state. It shall not be called while the request is queued.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaRequest::reinit()
+{
+	if (status_ == Status::Queued)
+		return -EBUSY;
+
+	if (::ioctl(fd_.get(), MEDIA_REQUEST_IOC_REINIT) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to reinitialize request: " << strerror(-ret);
+		return ret;
+	}
+
+	status_ = Status::Idle;
+
+	return 0;
+}
+
+/**
+ * \var MediaRequest::completed
+ * \brief Signal emitted when the request completes
+ */
+
+void MediaRequest::requestComplete()
+{
+	notifier_->setEnabled(false);
+	status_ = Status::Complete;
+
+	completed.emit(this);
+}
+
+} /* namespace libcamera */
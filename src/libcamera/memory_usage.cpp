@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Memory footprint of a camera
+ */
+
+#include "libcamera/internal/memory_usage.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/framebuffer.h"
+
+/**
+ * \file memory_usage.h
+ * \brief Memory footprint of a camera
+ *
+ * Cameras account for the memory allocated on their behalf by libcamera, such
+ * as the frame buffers exported to applications, the internal buffer pools of
+ * pipeline handlers and the buffers of the software ISP. The memory footprint
+ * is retrieved with Camera::memoryUsage(), broken down by type of memory, and
+ * helps sizing the memory of products that operate multiple cameras.
+ */
+
+/**
+ * \internal
+ * \file internal/memory_usage.h
+ * \brief Memory footprint accounting
+ */
+
+namespace libcamera {
+
+/**
+ * \struct MemoryUsage
+ * \brief A snapshot of the memory footprint of a camera
+ *
+ * The memory footprint is broken down by type of memory. For each type, and
+ * for the total, the structure stores the memory currently in use and the
+ * peak memory use over the lifetime of the camera, in bytes.
+ *
+ * Only the memory allocated by libcamera for the camera is accounted for.
+ * Buffers imported from applications, and memory allocated by the kernel or
+ * by IPA modules for their internal needs, are not included.
+ */
+
+/**
+ * \enum MemoryUsage::Type
+ * \brief The type of memory
+ * \var MemoryUsage::Type::Device
+ * \brief Buffers allocated by V4L2 devices, from a memory pool specific to
+ * the device driver
+ * \var MemoryUsage::Type::DmaHeapCma
+ * \brief Physically-contiguous dma-bufs allocated from the CMA dma-heap
+ * \var MemoryUsage::Type::DmaHeapSystem
+ * \brief Dma-bufs allocated from the system dma-heap
+ * \var MemoryUsage::Type::Anonymous
+ * \brief Anonymous memory, including shared memory, memfd-backed udmabufs
+ * and heap allocations
+ */
+
+/**
+ * \var MemoryUsage::kNumTypes
+ * \brief The number of memory types
+ */
+
+/**
+ * \struct MemoryUsage::Entry
+ * \brief The memory use of one type of memory
+ *
+ * \var MemoryUsage::Entry::current
+ * \brief The memory currently in use, in bytes
+ *
+ * \var MemoryUsage::Entry::peak
+ * \brief The maximum memory in use since the camera has been created, in bytes
+ */
+
+/**
+ * \fn MemoryUsage::operator[](Type type)
+ * \brief Retrieve the memory use of a type of memory
+ * \param[in] type The memory type
+ * \return The memory use for \a type
+ */
+
+/**
+ * \fn MemoryUsage::operator[](Type type) const
+ * \copydoc MemoryUsage::operator[](Type type)
+ */
+
+/**
+ * \var MemoryUsage::types
+ * \brief The memory use by type, indexed by MemoryUsage::Type
+ */
+
+/**
+ * \var MemoryUsage::total
+ * \brief The memory use of all types
+ *
+ * The peak of the total is the maximum of the sum of all types, which may be
+ * lower than the sum of the peaks of each type.
+ */
+
+/**
+ * \brief Assemble and return a string describing the memory footprint
+ * \return A string describing the memory footprint
+ */
+std::string MemoryUsage::toString() const
+{
+	static const char *const names[kNumTypes] = {
+		"device",
+		"dmaheap-cma",
+		"dmaheap-system",
+		"anonymous",
+	};
+
+	std::stringstream ss;
+
+	ss << "total " << total.current << " (peak " << total.peak << ")";
+	for (unsigned int i = 0; i < kNumTypes; i++)
+		ss << ", " << names[i] << " " << types[i].current
+		   << " (peak " << types[i].peak << ")";
+
+	return ss.str();
+}
+
+/**
+ * \class MemoryAccount
+ * \brief Account for the memory allocated on behalf of a camera
+ *
+ * The MemoryAccount class tracks the memory in use and its peak, by type of
+ * memory. Allocations are accounted for with charges, which remain active
+ * until they are destroyed or released. Frame buffers are charged for their
+ * whole lifetime with charge(FrameBuffer *).
+ *
+ * Memory accounts are shared by the charges they hand out, and shall thus
+ * always be managed by a std::shared_ptr.
+ *
+ * \context This class is \threadsafe.
+ */
+
+/**
+ * \class MemoryAccount::Charge
+ * \brief An active charge of memory on a MemoryAccount
+ *
+ * A charge holds a reference to the account it has been made on, and removes
+ * its bytes from the account when destroyed or released. Default-constructed
+ * charges are empty. Charges are movable but not copyable.
+ */
+
+MemoryAccount::Charge::Charge(std::shared_ptr<MemoryAccount> account,
+			      MemoryUsage::Type type, uint64_t bytes)
+	: account_(std::move(account)), type_(type), bytes_(bytes)
+{
+	account_->add(type_, bytes_);
+}
+
+/**
+ * \brief Move-construct a charge
+ * \param[in] other The other charge
+ *
+ * The \a other charge is left empty.
+ */
+MemoryAccount::Charge::Charge(Charge &&other)
+	: account_(std::move(other.account_)), type_(other.type_),
+	  bytes_(other.bytes_)
+{
+	other.bytes_ = 0;
+}
+
+MemoryAccount::Charge::~Charge()
+{
+	release();
+}
+
+/**
+ * \brief Move-assign a charge
+ * \param[in] other The other charge
+ *
+ * The charge previously held is released, and the \a other charge is left
+ * empty.
+ *
+ * \return A reference to this charge
+ */
+MemoryAccount::Charge &MemoryAccount::Charge::operator=(Charge &&other)
+{
+	if (this != &other) {
+		release();
+
+		account_ = std::move(other.account_);
+		type_ = other.type_;
+		bytes_ = other.bytes_;
+		other.bytes_ = 0;
+	}
+
+	return *this;
+}
+
+/**
+ * \fn MemoryAccount::Charge::bytes()
+ * \brief Retrieve the number of bytes charged
+ * \return The number of bytes charged, or 0 if the charge is empty
+ */
+
+/**
+ * \brief Remove the charge from its account
+ *
+ * The charge is empty after this call.
+ */
+void MemoryAccount::Charge::release()
+{
+	if (!account_)
+		return;
+
+	account_->remove(type_, bytes_);
+	account_.reset();
+	bytes_ = 0;
+}
+
+/**
+ * \fn MemoryAccount::MemoryAccount()
+ * \brief Construct an empty memory account
+ */
+
+/**
+ * \brief Charge memory on the account
+ * \param[in] type The memory type
+ * \param[in] bytes The number of bytes
+ * \return The charge, active until it is destroyed or released
+ */
+MemoryAccount::Charge MemoryAccount::charge(MemoryUsage::Type type, uint64_t bytes)
+{
+	return Charge(shared_from_this(), type, bytes);
+}
+
+/**
+ * \brief Charge the memory of a frame buffer on the account
+ * \param[in] buffer The frame buffer
+ *
+ * The size of the planes of \a buffer is charged with the memory type of the
+ * buffer, until the buffer is destroyed. Buffers that are already charged on
+ * an account are left untouched.
+ */
+void MemoryAccount::charge(FrameBuffer *buffer)
+{
+	FrameBuffer::Private *data = buffer->_d();
+	if (data->memoryCharge().bytes())
+		return;
+
+	uint64_t bytes = 0;
+	for (const FrameBuffer::Plane &plane : buffer->planes())
+		bytes += plane.length;
+
+	data->setMemoryCharge(charge(data->memoryType(), bytes));
+}
+
+/**
+ * \brief Retrieve the memory footprint accounted for
+ * \return A snapshot of the memory footprint
+ */
+MemoryUsage MemoryAccount::usage() const
+{
+	MutexLocker locker(mutex_);
+	return usage_;
+}
+
+void MemoryAccount::add(MemoryUsage::Type type, uint64_t bytes)
+{
+	MutexLocker locker(mutex_);
+
+	MemoryUsage::Entry &entry = usage_[type];
+	entry.current += bytes;
+	entry.peak = std::max(entry.peak, entry.current);
+
+	usage_.total.current += bytes;
+	usage_.total.peak = std::max(usage_.total.peak, usage_.total.current);
+}
+
+void MemoryAccount::remove(MemoryUsage::Type type, uint64_t bytes)
+{
+	MutexLocker locker(mutex_);
+
+	usage_[type].current -= bytes;
+	usage_.total.current -= bytes;
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,379 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Runtime metrics
+ */
+
+#include "libcamera/internal/metrics.h"
+
+#include <algorithm>
+#include <sstream>
+
+/**
+ * \file metrics.h
+ * \brief Runtime metrics
+ *
+ * libcamera collects a small set of metrics about the health of the cameras
+ * and devices it handles, such as the number of dropped frames or the latency
+ * of requests. The metrics are always enabled, and are cheap enough to be
+ * collected in production. They are retrieved with Camera::metrics() and
+ * CameraManager::metrics(), and can be written to a file when the camera
+ * manager stops with the LIBCAMERA_METRICS_FILE environment variable.
+ */
+
+/**
+ * \internal
+ * \file internal/metrics.h
+ * \brief Runtime metrics registry
+ */
+
+namespace libcamera {
+
+/**
+ * \struct Metric
+ * \brief A snapshot of the value of a metric
+ *
+ * Metrics are either counters, which count events, or histograms, which record
+ * the distribution of a value in fixed buckets. The Metric structure stores the
+ * value of a metric at the time it has been retrieved.
+ */
+
+/**
+ * \enum Metric::Type
+ * \brief The metric type
+ * \var Metric::Type::Counter
+ * \brief A monotonic counter of events
+ * \var Metric::Type::Histogram
+ * \brief A distribution of values in fixed buckets
+ */
+
+/**
+ * \var Metric::scope
+ * \brief The object the metric relates to, such as a camera ID or a device
+ * node
+ */
+
+/**
+ * \var Metric::name
+ * \brief The metric name, unique within its scope
+ */
+
+/**
+ * \var Metric::type
+ * \brief The metric type
+ */
+
+/**
+ * \var Metric::value
+ * \brief The counter value, or the number of values recorded in the histogram
+ */
+
+/**
+ * \var Metric::sum
+ * \brief The sum of the values recorded in the histogram
+ *
+ * This field is 0 for counters.
+ */
+
+/**
+ * \var Metric::bounds
+ * \brief The inclusive upper bounds of the histogram buckets, in increasing
+ * order
+ *
+ * This field is empty for counters.
+ */
+
+/**
+ * \var Metric::buckets
+ * \brief The number of values recorded in each histogram bucket
+ *
+ * The vector has one more element than the bounds vector. The last bucket
+ * counts the values larger than the last bound. This field is empty for
+ * counters.
+ */
+
+/**
+ * \brief Assemble and return a string describing the metric
+ * \return A string describing the metric
+ */
+std::string Metric::toString() const
+{
+	std::stringstream ss;
+
+	ss << scope << "/" << name << ": " << value;
+
+	if (type == Type::Counter)
+		return ss.str();
+
+	ss << " sum " << sum << " [";
+	for (unsigned int i = 0; i < buckets.size(); i++) {
+		if (i)
+			ss << ", ";
+		if (i < bounds.size())
+			ss << "<=" << bounds[i];
+		else
+			ss << ">" << (bounds.empty() ? 0 : bounds.back());
+		ss << ": " << buckets[i];
+	}
+	ss << "]";
+
+	return ss.str();
+}
+
+/**
+ * \class MetricCounter
+ * \brief A counter metric
+ *
+ * The counter is incremented atomically, and can be updated from any thread
+ * without locking.
+ */
+
+/**
+ * \fn MetricCounter::MetricCounter()
+ * \brief Construct a counter with a zero value
+ */
+
+/**
+ * \fn MetricCounter::add()
+ * \brief Increment the counter
+ * \param[in] count The increment
+ */
+
+/**
+ * \fn MetricCounter::value()
+ * \brief Retrieve the counter value
+ * \return The counter value
+ */
+
+/**
+ * \class MetricHistogram
+ * \brief A histogram metric with fixed buckets
+ *
+ * The histogram counts the recorded values in buckets defined by their upper
+ * bounds at construction time, and an additional bucket for values larger than
+ * the last bound. Values are recorded atomically, and can be recorded from any
+ * thread without locking.
+ */
+
+/**
+ * \brief Construct a histogram
+ * \param[in] bounds The inclusive upper bounds of the buckets
+ *
+ * The \a bounds are sorted in increasing order.
+ */
+MetricHistogram::MetricHistogram(std::vector<uint64_t> bounds)
+	: bounds_(std::move(bounds)), count_(0), sum_(0)
+{
+	std::sort(bounds_.begin(), bounds_.end());
+
+	buckets_ = std::make_unique<std::atomic<uint64_t>[]>(bounds_.size() + 1);
+	for (unsigned int i = 0; i <= bounds_.size(); i++)
+		buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Record a value in the histogram
+ * \param[in] value The value
+ */
+void MetricHistogram::record(uint64_t value)
+{
+	auto it = std::lower_bound(bounds_.begin(), bounds_.end(), value);
+	buckets_[it - bounds_.begin()].fetch_add(1, std::memory_order_relaxed);
+
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+/**
+ * \fn MetricHistogram::bounds()
+ * \brief Retrieve the upper bounds of the buckets
+ * \return The inclusive upper bounds of the buckets, in increasing order
+ */
+
+/**
+ * \fn MetricHistogram::count()
+ * \brief Retrieve the number of values recorded in the histogram
+ * \return The number of recorded values
+ */
+
+/**
+ * \fn MetricHistogram::sum()
+ * \brief Retrieve the sum of the values recorded in the histogram
+ * \return The sum of the recorded values
+ */
+
+/**
+ * \brief Retrieve the number of values recorded in each bucket
+ *
+ * The buckets are read individually, values recorded concurrently may thus
+ * be accounted for in count() and sum() but not in the buckets.
+ *
+ * \return The number of values in each bucket, followed by the number of
+ * values larger than the last bound
+ */
+std::vector<uint64_t> MetricHistogram::buckets() const
+{
+	std::vector<uint64_t> buckets(bounds_.size() + 1);
+
+	for (unsigned int i = 0; i < buckets.size(); i++)
+		buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+
+	return buckets;
+}
+
+/**
+ * \class MetricsRegistry
+ * \brief A set of metrics related to an object
+ *
+ * The registry owns the metrics of an object, such as a camera or a device,
+ * identified by the registry scope. Metrics are created on first use by name
+ * with counter() and histogram(), and the returned pointers stay valid for the
+ * lifetime of the registry. Users are expected to look metrics up once and
+ * update them through the pointers in hot paths.
+ *
+ * All registries are tracked in a process-wide list, to retrieve the metrics
+ * of all the live objects with allMetrics().
+ */
+
+struct MetricsRegistry::List {
+	Mutex mutex;
+	std::vector<MetricsRegistry *> registries LIBCAMERA_TSA_GUARDED_BY(mutex);
+};
+
+MetricsRegistry::List &MetricsRegistry::list()
+{
+	static List list;
+	return list;
+}
+
+/**
+ * \brief Construct a metrics registry
+ * \param[in] scope The name of the object the metrics relate to
+ */
+MetricsRegistry::MetricsRegistry(const std::string &scope)
+	: scope_(scope)
+{
+	List &list = MetricsRegistry::list();
+	MutexLocker locker(list.mutex);
+	list.registries.push_back(this);
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+	List &list = MetricsRegistry::list();
+	MutexLocker locker(list.mutex);
+	list.registries.erase(std::find(list.registries.begin(),
+					list.registries.end(), this));
+}
+
+/**
+ * \brief Retrieve the registry scope
+ * \return The name of the object the metrics relate to
+ */
+std::string MetricsRegistry::scope() const
+{
+	MutexLocker locker(mutex_);
+	return scope_;
+}
+
+/**
+ * \brief Set the registry scope
+ * \param[in] scope The name of the object the metrics relate to
+ *
+ * This function is meant for objects whose name isn't known when the registry
+ * is constructed.
+ */
+void MetricsRegistry::setScope(const std::string &scope)
+{
+	MutexLocker locker(mutex_);
+	scope_ = scope;
+}
+
+/**
+ * \brief Retrieve a counter, creating it if it doesn't exist
+ * \param[in] name The counter name
+ * \return The counter, valid for the lifetime of the registry
+ */
+MetricCounter *MetricsRegistry::counter(const std::string &name)
+{
+	MutexLocker locker(mutex_);
+
+	std::unique_ptr<MetricCounter> &counter = counters_[name];
+	if (!counter)
+		counter = std::make_unique<MetricCounter>();
+
+	return counter.get();
+}
+
+/**
+ * \brief Retrieve a histogram, creating it if it doesn't exist
+ * \param[in] name The histogram name
+ * \param[in] bounds The inclusive upper bounds of the buckets
+ *
+ * The \a bounds are only used when the histogram is created, and are ignored
+ * when an existing histogram is retrieved.
+ *
+ * \return The histogram, valid for the lifetime of the registry
+ */
+MetricHistogram *MetricsRegistry::histogram(const std::string &name,
+					    std::vector<uint64_t> bounds)
+{
+	MutexLocker locker(mutex_);
+
+	std::unique_ptr<MetricHistogram> &histogram = histograms_[name];
+	if (!histogram)
+		histogram = std::make_unique<MetricHistogram>(std::move(bounds));
+
+	return histogram.get();
+}
+
+/**
+ * \brief Retrieve a snapshot of the metrics of the registry
+ * \return The metrics of the registry, sorted by name
+ */
+std::vector<Metric> MetricsRegistry::metrics() const
+{
+	std::vector<Metric> metrics;
+
+	MutexLocker locker(mutex_);
+	collect(&metrics);
+
+	return metrics;
+}
+
+/**
+ * \brief Retrieve a snapshot of the metrics of all registries
+ * \return The metrics of all live registries
+ */
+std::vector<Metric> MetricsRegistry::allMetrics()
+{
+	std::vector<Metric> metrics;
+
+	List &list = MetricsRegistry::list();
+	MutexLocker listLocker(list.mutex);
+
+	for (const MetricsRegistry *registry : list.registries) {
+		MutexLocker locker(registry->mutex_);
+		registry->collect(&metrics);
+	}
+
+	return metrics;
+}
+
+void MetricsRegistry::collect(std::vector<Metric> *metrics) const
+{
+	for (const auto &[name, counter] : counters_)
+		metrics->push_back({ scope_, name, Metric::Type::Counter,
+				     counter->value(), 0, {}, {} });
+
+	for (const auto &[name, histogram] : histograms_)
+		metrics->push_back({ scope_, name, Metric::Type::Histogram,
+				     histogram->count(), histogram->sum(),
+				     histogram->bounds(), histogram->buckets() });
+
+	std::sort(metrics->end() - counters_.size() - histograms_.size(),
+		  metrics->end(), [](const Metric &a, const Metric &b) {
+			  return a.name < b.name;
+		  });
+}
+
+} /* namespace libcamera */
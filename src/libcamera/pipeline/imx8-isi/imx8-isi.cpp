@@ -54,11 +54,6 @@ public:
 
 	int init();
 
-	unsigned int pipeIndex(const Stream *stream)
-	{
-		return stream - &*streams_.begin();
-	}
-
 	unsigned int getRawMediaBusFormat(PixelFormat *pixelFormat) const;
 	unsigned int getYuvMediaBusFormat(const PixelFormat &pixelFormat) const;
 	unsigned int getMediaBusFormat(PixelFormat *pixelFormat) const;
@@ -70,6 +65,9 @@ public:
 
 	std::vector<Stream *> enabledStreams_;
 
+	/* Index of the ISI pipe assigned to each enabled stream. */
+	std::map<const Stream *, unsigned int> streamPipes_;
+
 	unsigned int xbarSink_;
 };
 
@@ -117,13 +115,25 @@ protected:
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
 
+	void releaseDevice(Camera *camera) override;
+
 private:
 	static constexpr Size kPreviewSize = { 1920, 1080 };
 	static constexpr Size kMinISISize = { 1, 1 };
 
+	/*
+	 * Width of the line buffer of each ISI channel. Wider images are
+	 * processed by chaining the line buffers of consecutive channels.
+	 */
+	static constexpr unsigned int kISILineBufferWidth = 2048;
+
 	struct Pipe {
 		std::unique_ptr<V4L2Subdevice> isi;
 		std::unique_ptr<V4L2VideoDevice> capture;
+
+		/* The camera the pipe is assigned to, and its input size. */
+		Camera *camera = nullptr;
+		Size inputSize = {};
 	};
 
 	ISICameraData *cameraData(Camera *camera)
@@ -133,6 +143,10 @@ private:
 
 	Pipe *pipeFromStream(Camera *camera, const Stream *stream);
 
+	int assignPipes(Camera *camera, const CameraConfiguration *config);
+	void releasePipes(Camera *camera);
+	void checkBandwidth() const;
+
 	StreamConfiguration generateYUVConfiguration(Camera *camera,
 						     const Size &size);
 	StreamConfiguration generateRawConfiguration(Camera *camera);
@@ -817,25 +831,49 @@ int PipelineHandlerISI::configure(Camera *camera, CameraConfiguration *c)
 	sensorSrc->links()[0]->setEnabled(true);
 
 	/*
-	 * Reset the crossbar switch routing and enable one route for each
-	 * requested stream configuration.
-	 *
-	 * \todo Handle concurrent usage of multiple cameras by adjusting the
-	 * routing table instead of resetting it.
+	 * Assign an ISI pipe to each requested stream, among the ones not used
+	 * by other cameras.
+	 */
+	int ret = assignPipes(camera, c);
+	if (ret)
+		return ret;
+
+	for (Pipe &pipe : pipes_) {
+		if (pipe.camera == camera)
+			pipe.inputSize = camConfig->sensorFormat_.size;
+	}
+
+	checkBandwidth();
+
+	/*
+	 * Program the crossbar switch routing with one route for each assigned
+	 * pipe, from the crossbar sink of the camera the pipe belongs to. The
+	 * routes of the other cameras are preserved.
 	 */
 	V4L2Subdevice::Routing routing = {};
 	unsigned int xbarFirstSource = crossbar_->entity()->pads().size() / 2 + 1;
 
-	for (const auto &[idx, config] : utils::enumerate(*c)) {
+	for (const auto &[idx, pipe] : utils::enumerate(pipes_)) {
+		if (!pipe.camera)
+			continue;
+
 		uint32_t sourcePad = xbarFirstSource + idx;
-		routing.emplace_back(V4L2Subdevice::Stream{ data->xbarSink_, 0 },
+		routing.emplace_back(V4L2Subdevice::Stream{ cameraData(pipe.camera)->xbarSink_, 0 },
 				     V4L2Subdevice::Stream{ sourcePad, 0 },
 				     V4L2_SUBDEV_ROUTE_FL_ACTIVE);
 	}
 
-	int ret = crossbar_->setRouting(&routing, V4L2Subdevice::ActiveFormat);
-	if (ret)
+	ret = crossbar_->setRouting(&routing, V4L2Subdevice::ActiveFormat);
+	if (ret) {
+		/*
+		 * The routing table can't be changed while the crossbar is
+		 * streaming. All the cameras must be configured before any of
+		 * them is started.
+		 */
+		LOG(ISI, Error) << "Failed to route the crossbar switch";
+		releasePipes(camera);
 		return ret;
+	}
 
 	/* Apply format to the sensor and CSIS receiver. */
 	V4L2SubdeviceFormat format = camConfig->sensorFormat_;
@@ -921,21 +959,34 @@ int PipelineHandlerISI::start(Camera *camera,
 			      [[maybe_unused]] const ControlList *controls)
 {
 	ISICameraData *data = cameraData(camera);
+	int ret;
 
+	/*
+	 * Prepare the buffers of all pipes before starting any of them, so
+	 * that the streams start as closely together as possible.
+	 */
 	for (const auto &stream : data->enabledStreams_) {
 		Pipe *pipe = pipeFromStream(camera, stream);
 		const StreamConfiguration &config = stream->configuration();
 
-		int ret = pipe->capture->importBuffers(config.bufferCount);
+		ret = pipe->capture->importBuffers(config.bufferCount);
 		if (ret)
-			return ret;
+			goto error;
+	}
+
+	for (const auto &stream : data->enabledStreams_) {
+		Pipe *pipe = pipeFromStream(camera, stream);
 
 		ret = pipe->capture->streamOn();
 		if (ret)
-			return ret;
+			goto error;
 	}
 
 	return 0;
+
+error:
+	stopDevice(camera);
+	return ret;
 }
 
 void PipelineHandlerISI::stopDevice(Camera *camera)
@@ -963,6 +1014,11 @@ int PipelineHandlerISI::queueRequestDevice(Camera *camera, Request *request)
 	return 0;
 }
 
+void PipelineHandlerISI::releaseDevice(Camera *camera)
+{
+	releasePipes(camera);
+}
+
 bool PipelineHandlerISI::match(DeviceEnumerator *enumerator)
 {
 	DeviceMatch dm("mxc-isi");
@@ -1088,11 +1144,82 @@ PipelineHandlerISI::Pipe *PipelineHandlerISI::pipeFromStream(Camera *camera,
 							     const Stream *stream)
 {
 	ISICameraData *data = cameraData(camera);
-	unsigned int pipeIndex = data->pipeIndex(stream);
+	const auto it = data->streamPipes_.find(stream);
+
+	ASSERT(it != data->streamPipes_.end());
+
+	return &pipes_[it->second];
+}
+
+/*
+ * Assign a free ISI pipe to each stream of the configuration, replacing the
+ * pipes previously assigned to the camera. Pipes assigned to other cameras
+ * are left untouched, which allows cameras connected to different crossbar
+ * sinks to stream concurrently.
+ */
+int PipelineHandlerISI::assignPipes(Camera *camera, const CameraConfiguration *config)
+{
+	ISICameraData *data = cameraData(camera);
+
+	releasePipes(camera);
+
+	for (const StreamConfiguration &cfg : *config) {
+		auto pipe = std::find_if(pipes_.begin(), pipes_.end(),
+					 [](const Pipe &p) { return !p.camera; });
+		if (pipe == pipes_.end()) {
+			LOG(ISI, Error)
+				<< "No ISI pipe available for stream " << cfg.toString();
+			releasePipes(camera);
+			return -EBUSY;
+		}
 
-	ASSERT(pipeIndex < pipes_.size());
+		pipe->camera = camera;
+		data->streamPipes_[cfg.stream()] = pipe - pipes_.begin();
+	}
+
+	return 0;
+}
+
+void PipelineHandlerISI::releasePipes(Camera *camera)
+{
+	for (Pipe &pipe : pipes_) {
+		if (pipe.camera != camera)
+			continue;
+
+		pipe.camera = nullptr;
+		pipe.inputSize = {};
+	}
+
+	cameraData(camera)->streamPipes_.clear();
+}
+
+/*
+ * Account for the line buffers used by all the assigned pipes. Input images
+ * wider than a line buffer are processed by chaining consecutive channels,
+ * which are then not usable by other pipes. Warn when the combined input
+ * widths exceed what the ISI can process.
+ */
+void PipelineHandlerISI::checkBandwidth() const
+{
+	unsigned int lineBuffers = 0;
+	unsigned int numPipes = 0;
+
+	for (const Pipe &pipe : pipes_) {
+		if (!pipe.camera)
+			continue;
+
+		lineBuffers += utils::alignUp(pipe.inputSize.width, kISILineBufferWidth)
+			     / kISILineBufferWidth;
+		numPipes++;
+	}
+
+	if (lineBuffers <= pipes_.size())
+		return;
 
-	return &pipes_[pipeIndex];
+	LOG(ISI, Warning)
+		<< "The input of the " << numPipes << " assigned pipes needs "
+		<< lineBuffers << " line buffers, only " << pipes_.size()
+		<< " are available";
 }
 
 void PipelineHandlerISI::bufferReady(FrameBuffer *buffer)
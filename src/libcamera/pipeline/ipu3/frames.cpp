@@ -7,6 +7,8 @@
 
 #include "frames.h"
 
+#include <algorithm>
+
 #include <libcamera/framebuffer.h>
 #include <libcamera/request.h>
 
@@ -19,25 +21,124 @@ namespace libcamera {
 LOG_DECLARE_CATEGORY(IPU3)
 
 IPU3Frames::IPU3Frames()
+	: paramBufferCount_(0), statBufferCount_(0), initialSize_(0),
+	  idleFrames_(0), peakInUse_(0), underruns_(0), grown_(0), shrunk_(0)
 {
 }
 
 void IPU3Frames::init(const std::vector<std::unique_ptr<FrameBuffer>> &paramBuffers,
 		      const std::vector<std::unique_ptr<FrameBuffer>> &statBuffers)
 {
-	for (const std::unique_ptr<FrameBuffer> &buffer : paramBuffers)
-		availableParamBuffers_.push(buffer.get());
+	paramBufferCount_ = 0;
+	statBufferCount_ = 0;
 
-	for (const std::unique_ptr<FrameBuffer> &buffer : statBuffers)
-		availableStatBuffers_.push(buffer.get());
+	addBuffers(paramBuffers, statBuffers);
+
+	initialSize_ = size();
+	idleFrames_ = 0;
+	peakInUse_ = 0;
+	underruns_ = 0;
+	grown_ = 0;
+	shrunk_ = 0;
 
 	frameInfo_.clear();
 }
 
 void IPU3Frames::clear()
 {
+	LOG(IPU3, Debug)
+		<< "Frame buffers pool: " << initialSize_ << " to " << size()
+		<< " buffers, " << peakInUse_ << " peak in use, "
+		<< underruns_ << " underruns, grown " << grown_
+		<< " times, shrunk " << shrunk_ << " times";
+
 	availableParamBuffers_ = {};
 	availableStatBuffers_ = {};
+	paramBufferCount_ = 0;
+	statBufferCount_ = 0;
+}
+
+/*
+ * Add parameters and statistics buffers to the pool. The buffers are
+ * immediately available.
+ */
+void IPU3Frames::addBuffers(Span<const std::unique_ptr<FrameBuffer>> paramBuffers,
+			    Span<const std::unique_ptr<FrameBuffer>> statBuffers)
+{
+	for (const std::unique_ptr<FrameBuffer> &buffer : paramBuffers)
+		availableParamBuffers_.push_back(buffer.get());
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : statBuffers)
+		availableStatBuffers_.push_back(buffer.get());
+
+	paramBufferCount_ += paramBuffers.size();
+	statBufferCount_ += statBuffers.size();
+
+	/* Don't shrink the pool right after growing it. */
+	if (initialSize_ && (!paramBuffers.empty() || !statBuffers.empty())) {
+		idleFrames_ = 0;
+		grown_++;
+	}
+}
+
+/*
+ * Remove parameters and statistics buffers from the pool. All the buffers
+ * must be available, otherwise the pool is left untouched and false is
+ * returned.
+ */
+bool IPU3Frames::removeBuffers(Span<const std::unique_ptr<FrameBuffer>> paramBuffers,
+			       Span<const std::unique_ptr<FrameBuffer>> statBuffers)
+{
+	auto available = [](const std::deque<FrameBuffer *> &pool,
+			    Span<const std::unique_ptr<FrameBuffer>> buffers) {
+		return std::all_of(buffers.begin(), buffers.end(),
+				   [&](const std::unique_ptr<FrameBuffer> &buffer) {
+					   return std::find(pool.begin(), pool.end(),
+							    buffer.get()) != pool.end();
+				   });
+	};
+
+	auto erase = [](std::deque<FrameBuffer *> &pool,
+			Span<const std::unique_ptr<FrameBuffer>> buffers) {
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers)
+			pool.erase(std::find(pool.begin(), pool.end(), buffer.get()));
+	};
+
+	if (!available(availableParamBuffers_, paramBuffers) ||
+	    !available(availableStatBuffers_, statBuffers))
+		return false;
+
+	erase(availableParamBuffers_, paramBuffers);
+	erase(availableStatBuffers_, statBuffers);
+
+	paramBufferCount_ -= paramBuffers.size();
+	statBufferCount_ -= statBuffers.size();
+
+	idleFrames_ = 0;
+	shrunk_++;
+
+	return true;
+}
+
+/* Retrieve the maximum number of frames that can be processed concurrently. */
+unsigned int IPU3Frames::size() const
+{
+	return std::min(paramBufferCount_, statBufferCount_);
+}
+
+/* Check if the pool can be grown on underrun. */
+bool IPU3Frames::canGrow() const
+{
+	return size() < kMaxBuffers;
+}
+
+/*
+ * Check if the pool has been grown and hasn't needed its extra buffers for
+ * kIdleFrames frames.
+ */
+bool IPU3Frames::idle() const
+{
+	return size() > initialSize_ && idleFrames_ >= kIdleFrames;
 }
 
 IPU3Frames::Info *IPU3Frames::create(Request *request)
@@ -46,11 +147,13 @@ IPU3Frames::Info *IPU3Frames::create(Request *request)
 
 	if (availableParamBuffers_.empty()) {
 		LOG(IPU3, Debug) << "Parameters buffer underrun";
+		underruns_++;
 		return nullptr;
 	}
 
 	if (availableStatBuffers_.empty()) {
 		LOG(IPU3, Debug) << "Statistics buffer underrun";
+		underruns_++;
 		return nullptr;
 	}
 
@@ -60,8 +163,8 @@ IPU3Frames::Info *IPU3Frames::create(Request *request)
 	paramBuffer->_d()->setRequest(request);
 	statBuffer->_d()->setRequest(request);
 
-	availableParamBuffers_.pop();
-	availableStatBuffers_.pop();
+	availableParamBuffers_.pop_front();
+	availableStatBuffers_.pop_front();
 
 	/* \todo Remove the dynamic allocation of Info */
 	std::unique_ptr<Info> info = std::make_unique<Info>();
@@ -76,14 +179,22 @@ IPU3Frames::Info *IPU3Frames::create(Request *request)
 
 	frameInfo_[id] = std::move(info);
 
+	/* The pool is busy when its extra buffers are needed. */
+	unsigned int inUse = frameInfo_.size();
+	peakInUse_ = std::max(peakInUse_, inUse);
+	if (inUse + kGrowCount > size())
+		idleFrames_ = 0;
+
 	return frameInfo_[id].get();
 }
 
 void IPU3Frames::remove(IPU3Frames::Info *info)
 {
 	/* Return params and stat buffer for reuse. */
-	availableParamBuffers_.push(info->paramBuffer);
-	availableStatBuffers_.push(info->statBuffer);
+	availableParamBuffers_.push_back(info->paramBuffer);
+	availableStatBuffers_.push_back(info->statBuffer);
+
+	idleFrames_++;
 
 	/* Delete the extended frame information. */
 	frameInfo_.erase(info->id);
@@ -7,12 +7,13 @@
 
 #pragma once
 
+#include <deque>
 #include <map>
 #include <memory>
-#include <queue>
 #include <vector>
 
 #include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
 
 #include <libcamera/controls.h>
 
@@ -28,6 +29,10 @@ struct IPABuffer;
 class IPU3Frames
 {
 public:
+	static constexpr unsigned int kMaxBuffers = 16;
+	static constexpr unsigned int kGrowCount = 2;
+	static constexpr unsigned int kIdleFrames = 120;
+
 	struct Info {
 		unsigned int id;
 		Request *request;
@@ -48,6 +53,15 @@ public:
 		  const std::vector<std::unique_ptr<FrameBuffer>> &statBuffers);
 	void clear();
 
+	void addBuffers(Span<const std::unique_ptr<FrameBuffer>> paramBuffers,
+			Span<const std::unique_ptr<FrameBuffer>> statBuffers);
+	bool removeBuffers(Span<const std::unique_ptr<FrameBuffer>> paramBuffers,
+			   Span<const std::unique_ptr<FrameBuffer>> statBuffers);
+
+	unsigned int size() const;
+	bool canGrow() const;
+	bool idle() const;
+
 	Info *create(Request *request);
 	void remove(Info *info);
 	bool tryComplete(Info *info);
@@ -58,8 +72,17 @@ public:
 	Signal<> bufferAvailable;
 
 private:
-	std::queue<FrameBuffer *> availableParamBuffers_;
-	std::queue<FrameBuffer *> availableStatBuffers_;
+	std::deque<FrameBuffer *> availableParamBuffers_;
+	std::deque<FrameBuffer *> availableStatBuffers_;
+	unsigned int paramBufferCount_;
+	unsigned int statBufferCount_;
+	unsigned int initialSize_;
+
+	unsigned int idleFrames_;
+	unsigned int peakInUse_;
+	unsigned int underruns_;
+	unsigned int grown_;
+	unsigned int shrunk_;
 
 	std::map<unsigned int, std::unique_ptr<Info>> frameInfo_;
 };
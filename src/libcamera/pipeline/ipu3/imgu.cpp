@@ -622,6 +622,52 @@ error:
 	return ret;
 }
 
+/**
+ * \brief Allocate additional parameters and statistics buffers
+ * \param[in] count The number of buffers to add to each of the nodes
+ *
+ * The new buffers are appended to paramBuffers_ and statBuffers_. As the
+ * parameters and statistics nodes are grown independently, the number of
+ * buffers added to each of them may differ if an error occurs.
+ *
+ * \return 0 if buffers have been added to any of the nodes, or a negative
+ * error code otherwise
+ */
+int ImgUDevice::addBuffers(unsigned int count)
+{
+	int params = param_->addBuffers(count, &paramBuffers_);
+	if (params < 0)
+		LOG(IPU3, Warning) << "Failed to add ImgU param buffers";
+
+	int stats = stat_->addBuffers(count, &statBuffers_);
+	if (stats < 0)
+		LOG(IPU3, Warning) << "Failed to add ImgU stat buffers";
+
+	if (params < 0 && stats < 0)
+		return params;
+
+	return 0;
+}
+
+/**
+ * \brief Free the last parameters and statistics buffers
+ * \param[in] params The number of parameters buffers to free
+ * \param[in] stats The number of statistics buffers to free
+ *
+ * The buffers are removed from the end of paramBuffers_ and statBuffers_, and
+ * shall not be queued.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int ImgUDevice::removeBuffers(unsigned int params, unsigned int stats)
+{
+	int ret = param_->removeBuffers(params, &paramBuffers_);
+	if (ret)
+		return ret;
+
+	return stat_->removeBuffers(stats, &statBuffers_);
+}
+
 /**
  * \brief Release buffers for all the ImgU video devices
  */
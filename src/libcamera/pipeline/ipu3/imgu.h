@@ -85,6 +85,8 @@ public:
 	}
 
 	int allocateBuffers(unsigned int bufferCount);
+	int addBuffers(unsigned int count);
+	int removeBuffers(unsigned int params, unsigned int stats);
 	void freeBuffers();
 
 	int start();
@@ -7,7 +7,9 @@
 
 #include <algorithm>
 #include <iomanip>
+#include <map>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <vector>
 
@@ -32,6 +34,7 @@
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
 
@@ -51,13 +54,19 @@ class IPU3CameraData : public Camera::Private
 {
 public:
 	IPU3CameraData(PipelineHandler *pipe)
-		: Camera::Private(pipe)
+		: Camera::Private(pipe), imgu_(nullptr), stillImgu_(nullptr),
+		  useStillImgu_(false), nextIpaBufferId_(1),
+		  canGrowBuffers_(false), canShrinkBuffers_(false)
 	{
 	}
 
 	int loadIPA();
+	void mapBuffers(Span<const std::unique_ptr<FrameBuffer>> buffers);
 
+	void imguInputBufferReady(FrameBuffer *buffer);
 	void imguOutputBufferReady(FrameBuffer *buffer);
+	void stillParamBufferReady(FrameBuffer *buffer);
+	void stillStatBufferReady(FrameBuffer *buffer);
 	void cio2BufferReady(FrameBuffer *buffer);
 	void paramBufferReady(FrameBuffer *buffer);
 	void statBufferReady(FrameBuffer *buffer);
@@ -67,10 +76,14 @@ public:
 
 	CIO2Device cio2_;
 	ImgUDevice *imgu_;
+	/* ImgU dedicated to the still stream, when available to the camera. */
+	ImgUDevice *stillImgu_;
+	bool useStillImgu_;
 
 	Stream outStream_;
 	Stream vfStream_;
 	Stream rawStream_;
+	Stream stillStream_;
 
 	Rectangle cropRegion_;
 
@@ -79,6 +92,12 @@ public:
 
 	std::unique_ptr<ipa::ipu3::IPAProxyIPU3> ipa_;
 
+	/* Parameters and statistics buffers mapped to the IPA. */
+	std::vector<IPABuffer> ipaBuffers_;
+	unsigned int nextIpaBufferId_;
+	bool canGrowBuffers_;
+	bool canShrinkBuffers_;
+
 	/* Requests for which no buffer has been queued to the CIO2 device yet. */
 	std::queue<Request *> pendingRequests_;
 	/* Requests queued to the CIO2 device but not yet processed by the ImgU. */
@@ -86,11 +105,26 @@ public:
 
 	ControlInfoMap ipaControls_;
 
+	/* Parameters and statistics buffers of the still ImgU. */
+	std::queue<FrameBuffer *> availableStillParamBuffers_;
+	std::queue<FrameBuffer *> availableStillStatBuffers_;
+	std::map<const FrameBuffer *, MappedFrameBuffer> paramMaps_;
+	/* Number of ImgU inputs a raw buffer is still queued to. */
+	std::map<FrameBuffer *, unsigned int> inputUsers_;
+	/* BDS output sizes the parameters of the video and still ImgUs target. */
+	Size bdsSize_;
+	Size stillBdsSize_;
+
 private:
 	void metadataReady(unsigned int id, const ControlList &metadata);
 	void paramsBufferReady(unsigned int id);
 	void setSensorControls(unsigned int id, const ControlList &sensorControls,
 			       const ControlList &lensControls);
+	void queueStillBuffer(IPU3Frames::Info *info, FrameBuffer *buffer);
+	void adjustStillParams(struct ipu3_uapi_params *params) const;
+
+	bool growBuffers();
+	void shrinkBuffers();
 };
 
 class IPU3CameraConfiguration : public CameraConfiguration
@@ -98,6 +132,7 @@ class IPU3CameraConfiguration : public CameraConfiguration
 public:
 	static constexpr unsigned int kBufferCount = 4;
 	static constexpr unsigned int kMaxStreams = 3;
+	static constexpr unsigned int kMaxStillStreams = 1;
 
 	IPU3CameraConfiguration(IPU3CameraData *data);
 
@@ -105,6 +140,7 @@ public:
 
 	const StreamConfiguration &cio2Format() const { return cio2Configuration_; }
 	const ImgUDevice::PipeConfig imguConfig() const { return pipeConfig_; }
+	const ImgUDevice::PipeConfig stillImguConfig() const { return stillPipeConfig_; }
 
 	/* Cache the combinedTransform_ that will be applied to the sensor */
 	Transform combinedTransform_;
@@ -119,6 +155,7 @@ private:
 
 	StreamConfiguration cio2Configuration_;
 	ImgUDevice::PipeConfig pipeConfig_;
+	ImgUDevice::PipeConfig stillPipeConfig_;
 };
 
 class PipelineHandlerIPU3 : public PipelineHandler
@@ -165,8 +202,6 @@ private:
 	ImgUDevice imgu1_;
 	MediaDevice *cio2MediaDev_;
 	MediaDevice *imguMediaDev_;
-
-	std::vector<IPABuffer> ipaBuffers_;
 };
 
 IPU3CameraConfiguration::IPU3CameraConfiguration(IPU3CameraData *data)
@@ -193,8 +228,12 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 		status = Adjusted;
 
 	/* Cap the number of entries to the available streams. */
-	if (config_.size() > kMaxStreams) {
-		config_.resize(kMaxStreams);
+	unsigned int maxStreams = kMaxStreams;
+	if (data_->stillImgu_)
+		maxStreams += kMaxStillStreams;
+
+	if (config_.size() > maxStreams) {
+		config_.resize(maxStreams);
 		status = Adjusted;
 	}
 
@@ -227,7 +266,8 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 		}
 	}
 
-	if (rawCount > 1 || yuvCount > 2) {
+	unsigned int maxYuvCount = data_->stillImgu_ ? 3 : 2;
+	if (rawCount > 1 || yuvCount > maxYuvCount) {
 		LOG(IPU3, Debug) << "Camera configuration not supported";
 		return Invalid;
 	} else if (rawCount && !yuvCount) {
@@ -246,6 +286,33 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 		return Invalid;
 	}
 
+	/*
+	 * If a third YUV stream is requested, assign the largest one to the
+	 * still ImgU, and dimension the main and viewfinder outputs of the
+	 * video ImgU for the other two. The CIO2 output is still sized from
+	 * all YUV streams, as it feeds both ImgUs.
+	 */
+	std::optional<unsigned int> stillIndex;
+	if (yuvCount > 2) {
+		Size stillSize = maxYuvSize;
+		maxYuvSize = {};
+
+		for (unsigned int i = 0; i < config_.size(); ++i) {
+			const StreamConfiguration &cfg = config_[i];
+			const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+
+			if (info.colourEncoding == PixelFormatInfo::ColourEncodingRAW)
+				continue;
+
+			if (!stillIndex && cfg.size == stillSize)
+				stillIndex = i;
+			else
+				maxYuvSize = std::max(maxYuvSize, cfg.size);
+		}
+
+		yuvCount--;
+	}
+
 	/*
 	 * Generate raw configuration from CIO2.
 	 *
@@ -273,6 +340,9 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 	ImgUDevice::Pipe pipe{};
 	pipe.input = cio2Configuration_.size;
 
+	ImgUDevice::Pipe stillPipe{};
+	stillPipe.input = cio2Configuration_.size;
+
 	/*
 	 * Adjust the configurations if needed and assign streams while
 	 * iterating them.
@@ -340,9 +410,18 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 			/*
 			 * Use the main output stream in case only one stream is
 			 * requested or if the current configuration is the one
-			 * with the maximum YUV output size.
+			 * with the maximum YUV output size, unless it has been
+			 * selected for the still ImgU.
 			 */
-			if (mainOutputAvailable &&
+			if (stillIndex && i == *stillIndex) {
+				cfg->setStream(const_cast<Stream *>(&data_->stillStream_));
+
+				stillPipe.main = cfg->size;
+				stillPipe.viewfinder = stillPipe.main;
+
+				LOG(IPU3, Debug) << "Assigned " << cfg->toString()
+						 << " to the still output";
+			} else if (mainOutputAvailable &&
 			    (originalCfg.size == maxYuvSize || yuvCount == 1)) {
 				cfg->setStream(const_cast<Stream *>(&data_->outStream_));
 				mainOutputAvailable = false;
@@ -381,6 +460,16 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 		}
 	}
 
+	stillPipeConfig_ = {};
+	if (stillIndex) {
+		stillPipeConfig_ = data_->stillImgu_->calculatePipeConfig(&stillPipe);
+		if (stillPipeConfig_.isNull()) {
+			LOG(IPU3, Error) << "Failed to calculate still pipe configuration: "
+					 << "unsupported resolutions.";
+			return Invalid;
+		}
+	}
+
 	return status;
 }
 
@@ -531,6 +620,13 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	if (ret)
 		return ret;
 
+	data->useStillImgu_ = !config->stillImguConfig().isNull();
+	if (data->useStillImgu_) {
+		ret = data->stillImgu_->enableLinks(true);
+		if (ret)
+			return ret;
+	}
+
 	/*
 	 * Pass the requested stream size to the CIO2 unit and get back the
 	 * adjusted format to be propagated to the ImgU output devices.
@@ -566,6 +662,7 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	/* Apply the format to the configured streams output devices. */
 	StreamConfiguration *mainCfg = nullptr;
 	StreamConfiguration *vfCfg = nullptr;
+	StreamConfiguration *stillCfg = nullptr;
 
 	for (unsigned int i = 0; i < config->size(); ++i) {
 		StreamConfiguration &cfg = (*config)[i];
@@ -581,6 +678,8 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 			ret = imgu->configureViewfinder(cfg, &outputFormat);
 			if (ret)
 				return ret;
+		} else if (stream == &data->stillStream_) {
+			stillCfg = &cfg;
 		}
 	}
 
@@ -612,6 +711,42 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 		return ret;
 	}
 
+	/*
+	 * Configure the still ImgU to process the same CIO2 frames at the
+	 * still stream resolution. Its viewfinder output isn't used, and is
+	 * configured with the still stream format as well. It runs in 'Video'
+	 * mode for the same reason as the video ImgU.
+	 */
+	data->bdsSize_ = imguConfig.bds;
+	data->stillBdsSize_ = {};
+
+	if (stillCfg) {
+		ImgUDevice *still = data->stillImgu_;
+
+		data->stillBdsSize_ = config->stillImguConfig().bds;
+
+		ret = still->configure(config->stillImguConfig(), &cio2Format);
+		if (ret)
+			return ret;
+
+		ret = still->configureOutput(*stillCfg, &outputFormat);
+		if (ret)
+			return ret;
+
+		ret = still->configureViewfinder(*stillCfg, &outputFormat);
+		if (ret)
+			return ret;
+
+		ControlList stillCtrls(still->imgu_->controls());
+		stillCtrls.set(V4L2_CID_IPU3_PIPE_MODE,
+			       static_cast<int32_t>(IPU3PipeModeVideo));
+		ret = still->imgu_->setControls(&stillCtrls);
+		if (ret) {
+			LOG(IPU3, Error) << "Unable to set still pipe_mode control";
+			return ret;
+		}
+	}
+
 	ipa::ipu3::IPAConfigInfo configInfo;
 	configInfo.sensorControls = data->cio2_.sensor()->controls();
 
@@ -645,6 +780,8 @@ int PipelineHandlerIPU3::exportFrameBuffers(Camera *camera, Stream *stream,
 		return data->imgu_->viewfinder_->exportBuffers(count, buffers);
 	else if (stream == &data->rawStream_)
 		return data->cio2_.exportBuffers(count, buffers);
+	else if (stream == &data->stillStream_ && data->stillImgu_)
+		return data->stillImgu_->output_->exportBuffers(count, buffers);
 
 	return -EINVAL;
 }
@@ -668,31 +805,66 @@ int PipelineHandlerIPU3::allocateBuffers(Camera *camera)
 		data->outStream_.configuration().bufferCount,
 		data->vfStream_.configuration().bufferCount,
 		data->rawStream_.configuration().bufferCount,
+		data->useStillImgu_ ? data->stillStream_.configuration().bufferCount : 0,
 	});
 
 	ret = imgu->allocateBuffers(bufferCount);
 	if (ret < 0)
 		return ret;
 
-	/* Map buffers to the IPA. */
-	unsigned int ipaBufferId = 1;
+	/*
+	 * The still ImgU parameters are copied from the ones computed by the
+	 * IPA for the video ImgU, map the parameters buffers of both ImgUs.
+	 * Its statistics are not used, but buffers must still be queued to
+	 * its stat node for the pipeline to operate.
+	 */
+	if (data->useStillImgu_) {
+		ImgUDevice *still = data->stillImgu_;
 
-	for (const std::unique_ptr<FrameBuffer> &buffer : imgu->paramBuffers_) {
-		buffer->setCookie(ipaBufferId++);
-		ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
-	}
+		ret = still->allocateBuffers(bufferCount);
+		if (ret < 0) {
+			imgu->freeBuffers();
+			return ret;
+		}
+
+		for (const auto *buffers : { &imgu->paramBuffers_, &still->paramBuffers_ }) {
+			for (const std::unique_ptr<FrameBuffer> &buffer : *buffers) {
+				auto it = data->paramMaps_.try_emplace(buffer.get(), buffer.get(),
+								       MappedFrameBuffer::MapFlag::ReadWrite);
+				if (!it.first->second.isValid()) {
+					LOG(IPU3, Error) << "Failed to map parameters buffer";
+					data->paramMaps_.clear();
+					still->freeBuffers();
+					imgu->freeBuffers();
+					return -ENOMEM;
+				}
+			}
+		}
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : still->paramBuffers_)
+			data->availableStillParamBuffers_.push(buffer.get());
 
-	for (const std::unique_ptr<FrameBuffer> &buffer : imgu->statBuffers_) {
-		buffer->setCookie(ipaBufferId++);
-		ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
+		for (const std::unique_ptr<FrameBuffer> &buffer : still->statBuffers_)
+			data->availableStillStatBuffers_.push(buffer.get());
 	}
 
-	data->ipa_->mapBuffers(ipaBuffers_);
+	/* Map buffers to the IPA. */
+	data->nextIpaBufferId_ = 1;
+	data->mapBuffers(imgu->paramBuffers_);
+	data->mapBuffers(imgu->statBuffers_);
 
 	data->frameInfos_.init(imgu->paramBuffers_, imgu->statBuffers_);
 	data->frameInfos_.bufferAvailable.connect(
 		data, &IPU3CameraData::queuePendingRequests);
 
+	/*
+	 * The parameters and statistics buffers pool is grown on underrun, and
+	 * shrunk back when the extra buffers are not needed anymore.
+	 */
+	data->canGrowBuffers_ = true;
+	data->canShrinkBuffers_ = imgu->param_->supportsRemoveBuffers() &&
+				  imgu->stat_->supportsRemoveBuffers();
+
 	return 0;
 }
 
@@ -703,14 +875,23 @@ int PipelineHandlerIPU3::freeBuffers(Camera *camera)
 	data->frameInfos_.clear();
 
 	std::vector<unsigned int> ids;
-	for (IPABuffer &ipabuf : ipaBuffers_)
+	for (IPABuffer &ipabuf : data->ipaBuffers_)
 		ids.push_back(ipabuf.id);
 
 	data->ipa_->unmapBuffers(ids);
-	ipaBuffers_.clear();
+	data->ipaBuffers_.clear();
 
 	data->imgu_->freeBuffers();
 
+	if (data->useStillImgu_) {
+		data->availableStillParamBuffers_ = {};
+		data->availableStillStatBuffers_ = {};
+		data->paramMaps_.clear();
+		data->stillImgu_->freeBuffers();
+	}
+
+	data->inputUsers_.clear();
+
 	return 0;
 }
 
@@ -750,9 +931,17 @@ int PipelineHandlerIPU3::start(Camera *camera, [[maybe_unused]] const ControlLis
 	if (ret)
 		goto error;
 
+	if (data->useStillImgu_) {
+		ret = data->stillImgu_->start();
+		if (ret)
+			goto error;
+	}
+
 	return 0;
 
 error:
+	if (data->useStillImgu_)
+		data->stillImgu_->stop();
 	imgu->stop();
 	cio2->stop();
 	data->ipa_->stop();
@@ -771,6 +960,8 @@ void PipelineHandlerIPU3::stopDevice(Camera *camera)
 
 	data->ipa_->stop();
 
+	if (data->useStillImgu_)
+		ret |= data->stillImgu_->stop();
 	ret |= data->imgu_->stop();
 	ret |= data->cio2_.stop();
 	if (ret)
@@ -797,12 +988,113 @@ void IPU3CameraData::cancelPendingRequests()
 	}
 }
 
+/*
+ * Map the parameters or statistics \a buffers to the IPA, and to the pipeline
+ * handler if the still ImgU copies them.
+ */
+void IPU3CameraData::mapBuffers(Span<const std::unique_ptr<FrameBuffer>> buffers)
+{
+	std::vector<IPABuffer> ipaBuffers;
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		buffer->setCookie(nextIpaBufferId_++);
+		ipaBuffers.emplace_back(buffer->cookie(), buffer->planes());
+	}
+
+	ipa_->mapBuffers(ipaBuffers);
+	ipaBuffers_.insert(ipaBuffers_.end(), ipaBuffers.begin(), ipaBuffers.end());
+}
+
+/*
+ * Grow the parameters and statistics buffers pool on underrun, up to
+ * IPU3Frames::kMaxBuffers. Return true if buffers have been added.
+ */
+bool IPU3CameraData::growBuffers()
+{
+	if (!canGrowBuffers_ || !frameInfos_.canGrow())
+		return false;
+
+	unsigned int params = imgu_->paramBuffers_.size();
+	unsigned int stats = imgu_->statBuffers_.size();
+
+	if (imgu_->addBuffers(IPU3Frames::kGrowCount) < 0) {
+		LOG(IPU3, Warning)
+			<< "Failed to grow buffers pool, keeping "
+			<< frameInfos_.size() << " buffers";
+		canGrowBuffers_ = false;
+		return false;
+	}
+
+	Span<const std::unique_ptr<FrameBuffer>> newParams =
+		Span<const std::unique_ptr<FrameBuffer>>(imgu_->paramBuffers_).subspan(params);
+	Span<const std::unique_ptr<FrameBuffer>> newStats =
+		Span<const std::unique_ptr<FrameBuffer>>(imgu_->statBuffers_).subspan(stats);
+
+	mapBuffers(newParams);
+	mapBuffers(newStats);
+
+	if (useStillImgu_) {
+		for (const std::unique_ptr<FrameBuffer> &buffer : newParams)
+			paramMaps_.try_emplace(buffer.get(), buffer.get(),
+					       MappedFrameBuffer::MapFlag::ReadWrite);
+	}
+
+	frameInfos_.addBuffers(newParams, newStats);
+
+	LOG(IPU3, Debug) << "Grew buffers pool to " << frameInfos_.size();
+
+	return newParams.size() && newStats.size();
+}
+
+/* Free one parameters and statistics buffer from a pool previously grown. */
+void IPU3CameraData::shrinkBuffers()
+{
+	if (!canShrinkBuffers_)
+		return;
+
+	Span<const std::unique_ptr<FrameBuffer>> params =
+		Span<const std::unique_ptr<FrameBuffer>>(imgu_->paramBuffers_).last(1);
+	Span<const std::unique_ptr<FrameBuffer>> stats =
+		Span<const std::unique_ptr<FrameBuffer>>(imgu_->statBuffers_).last(1);
+
+	/* Retry later if the buffers are in use. */
+	if (!frameInfos_.removeBuffers(params, stats))
+		return;
+
+	std::vector<unsigned int> ids = {
+		static_cast<unsigned int>(params[0]->cookie()),
+		static_cast<unsigned int>(stats[0]->cookie()),
+	};
+	paramMaps_.erase(params[0].get());
+
+	if (imgu_->removeBuffers(1, 1)) {
+		LOG(IPU3, Error) << "Failed to shrink buffers pool";
+		canShrinkBuffers_ = false;
+		return;
+	}
+
+	ipa_->unmapBuffers(ids);
+	ipaBuffers_.erase(std::remove_if(ipaBuffers_.begin(), ipaBuffers_.end(),
+					 [&](const IPABuffer &buffer) {
+						 return std::find(ids.begin(), ids.end(),
+								  buffer.id) != ids.end();
+					 }),
+			  ipaBuffers_.end());
+
+	LOG(IPU3, Debug) << "Shrunk buffers pool to " << frameInfos_.size();
+}
+
 void IPU3CameraData::queuePendingRequests()
 {
+	if (frameInfos_.idle())
+		shrinkBuffers();
+
 	while (!pendingRequests_.empty()) {
 		Request *request = pendingRequests_.front();
 
 		IPU3Frames::Info *info = frameInfos_.create(request);
+		if (!info && growBuffers())
+			info = frameInfos_.create(request);
 		if (!info)
 			break;
 
@@ -1051,15 +1343,10 @@ int PipelineHandlerIPU3::registerCameras()
 	 * image sensor is connected to it and the sensor can produce images
 	 * in a compatible format.
 	 */
-	unsigned int numCameras = 0;
-	for (unsigned int id = 0; id < 4 && numCameras < 2; ++id) {
+	std::vector<std::pair<unsigned int, std::unique_ptr<IPU3CameraData>>> cameras;
+	for (unsigned int id = 0; id < 4 && cameras.size() < 2; ++id) {
 		std::unique_ptr<IPU3CameraData> data =
 			std::make_unique<IPU3CameraData>(this);
-		std::set<Stream *> streams = {
-			&data->outStream_,
-			&data->vfStream_,
-			&data->rawStream_,
-		};
 		CIO2Device *cio2 = &data->cio2_;
 
 		ret = cio2->init(cio2MediaDev_, id);
@@ -1100,13 +1387,32 @@ int PipelineHandlerIPU3::registerCameras()
 					   << cio2->sensor()->id()
 					   << ". Assume rotation 0";
 
+		cameras.emplace_back(id, std::move(data));
+	}
+
+	unsigned int numCameras = 0;
+	for (auto &[id, data] : cameras) {
+		std::set<Stream *> streams = {
+			&data->outStream_,
+			&data->vfStream_,
+			&data->rawStream_,
+		};
+
 		/**
 		 * \todo Dynamically assign ImgU and output devices to each
 		 * stream and camera; as of now, limit support to two cameras
 		 * only, and assign imgu0 to the first one and imgu1 to the
 		 * second.
+		 *
+		 * When a single camera is present, imgu1 is otherwise unused.
+		 * Use it as a still ImgU, that processes the same CIO2 frames
+		 * as imgu0 for an additional full resolution still stream.
 		 */
 		data->imgu_ = numCameras ? &imgu1_ : &imgu0_;
+		if (cameras.size() == 1) {
+			data->stillImgu_ = &imgu1_;
+			streams.insert(&data->stillStream_);
+		}
 
 		/*
 		 * Connect video devices' 'bufferReady' signals to their
@@ -1120,8 +1426,8 @@ int PipelineHandlerIPU3::registerCameras()
 					&IPU3CameraData::cio2BufferReady);
 		data->cio2_.bufferAvailable.connect(
 			data.get(), &IPU3CameraData::queuePendingRequests);
-		data->imgu_->input_->bufferReady.connect(&data->cio2_,
-					&CIO2Device::tryReturnBuffer);
+		data->imgu_->input_->bufferReady.connect(data.get(),
+					&IPU3CameraData::imguInputBufferReady);
 		data->imgu_->output_->bufferReady.connect(data.get(),
 					&IPU3CameraData::imguOutputBufferReady);
 		data->imgu_->viewfinder_->bufferReady.connect(data.get(),
@@ -1131,8 +1437,19 @@ int PipelineHandlerIPU3::registerCameras()
 		data->imgu_->stat_->bufferReady.connect(data.get(),
 					&IPU3CameraData::statBufferReady);
 
+		if (data->stillImgu_) {
+			data->stillImgu_->input_->bufferReady.connect(data.get(),
+					&IPU3CameraData::imguInputBufferReady);
+			data->stillImgu_->output_->bufferReady.connect(data.get(),
+					&IPU3CameraData::imguOutputBufferReady);
+			data->stillImgu_->param_->bufferReady.connect(data.get(),
+					&IPU3CameraData::stillParamBufferReady);
+			data->stillImgu_->stat_->bufferReady.connect(data.get(),
+					&IPU3CameraData::stillStatBufferReady);
+		}
+
 		/* Create and register the Camera instance. */
-		const std::string &cameraId = cio2->sensor()->id();
+		const std::string cameraId = data->cio2_.sensor()->id();
 		std::shared_ptr<Camera> camera =
 			Camera::create(std::move(data), cameraId, streams);
 
@@ -1223,8 +1540,10 @@ void IPU3CameraData::paramsBufferReady(unsigned int id)
 	if (!info)
 		return;
 
+	Request *request = info->request;
+
 	/* Queue all buffers from the request aimed for the ImgU. */
-	for (auto it : info->request->buffers()) {
+	for (auto it : request->buffers()) {
 		const Stream *stream = it.first;
 		FrameBuffer *outbuffer = it.second;
 
@@ -1238,9 +1557,93 @@ void IPU3CameraData::paramsBufferReady(unsigned int id)
 		sizeof(struct ipu3_uapi_params);
 	imgu_->param_->queueBuffer(info->paramBuffer);
 	imgu_->stat_->queueBuffer(info->statBuffer);
+
+	FrameBuffer *stillBuffer = request->findBuffer(&stillStream_);
+	if (stillBuffer)
+		queueStillBuffer(info, stillBuffer);
+
 	imgu_->input_->queueBuffer(info->rawBuffer);
 }
 
+/*
+ * Process the raw frame of \a info through the still ImgU, in parallel with
+ * the video ImgU. The still ImgU uses a copy of the parameters computed by the
+ * IPA for the video ImgU, adjusted to its BDS output size.
+ */
+void IPU3CameraData::queueStillBuffer(IPU3Frames::Info *info, FrameBuffer *buffer)
+{
+	if (availableStillParamBuffers_.empty() ||
+	    availableStillStatBuffers_.empty()) {
+		LOG(IPU3, Warning) << "Still ImgU buffer underrun";
+		buffer->_d()->cancel();
+		pipe()->completeBuffer(info->request, buffer);
+		return;
+	}
+
+	FrameBuffer *paramBuffer = availableStillParamBuffers_.front();
+	FrameBuffer *statBuffer = availableStillStatBuffers_.front();
+	availableStillParamBuffers_.pop();
+	availableStillStatBuffers_.pop();
+
+	const MappedFrameBuffer &src = paramMaps_.at(info->paramBuffer);
+	const MappedFrameBuffer &dst = paramMaps_.at(paramBuffer);
+	memcpy(dst.planes()[0].data(), src.planes()[0].data(),
+	       sizeof(struct ipu3_uapi_params));
+	adjustStillParams(reinterpret_cast<struct ipu3_uapi_params *>(dst.planes()[0].data()));
+	paramBuffer->_d()->metadata().planes()[0].bytesused =
+		sizeof(struct ipu3_uapi_params);
+
+	stillImgu_->output_->queueBuffer(buffer);
+	stillImgu_->param_->queueBuffer(paramBuffer);
+	stillImgu_->stat_->queueBuffer(statBuffer);
+	stillImgu_->input_->queueBuffer(info->rawBuffer);
+
+	/* Return the raw buffer to the CIO2 once both ImgUs are done with it. */
+	inputUsers_[info->rawBuffer] = 2;
+}
+
+/*
+ * Adjust the parameters computed by the IPA for the video ImgU BDS output to
+ * the still ImgU BDS output.
+ */
+void IPU3CameraData::adjustStillParams(struct ipu3_uapi_params *params) const
+{
+	if (stillBdsSize_ == bdsSize_)
+		return;
+
+	/*
+	 * The statistics grids are positioned and sized in the video BDS
+	 * output, and may not fit in the still one. As the still ImgU
+	 * statistics are discarded, don't update its statistics configuration
+	 * and keep the driver defaults.
+	 */
+	params->use.acc_awb = 0;
+	params->use.acc_awb_fr = 0;
+	params->use.acc_ae = 0;
+	params->use.acc_af = 0;
+
+	if (!params->use.acc_bnr)
+		return;
+
+	/*
+	 * The BNR optical center is expressed relative to the BDS output.
+	 * Keep the same offset from the center of the still BDS output.
+	 */
+	struct ipu3_uapi_bnr_static_config &bnr = params->acc_param.bnr;
+	int32_t xReset = bnr.opt_center.x_reset
+		       + static_cast<int32_t>(bdsSize_.width / 2)
+		       - static_cast<int32_t>(stillBdsSize_.width / 2);
+	int32_t yReset = bnr.opt_center.y_reset
+		       + static_cast<int32_t>(bdsSize_.height / 2)
+		       - static_cast<int32_t>(stillBdsSize_.height / 2);
+
+	bnr.column_size = stillBdsSize_.width;
+	bnr.opt_center.x_reset = xReset;
+	bnr.opt_center.y_reset = yReset;
+	bnr.opt_center_sqr.x_sqr_reset = xReset * xReset;
+	bnr.opt_center_sqr.y_sqr_reset = yReset * yReset;
+}
+
 void IPU3CameraData::metadataReady(unsigned int id, const ControlList &metadata)
 {
 	IPU3Frames::Info *info = frameInfos_.find(id);
@@ -1259,6 +1662,26 @@ void IPU3CameraData::metadataReady(unsigned int id, const ControlList &metadata)
  * Buffer Ready slots
  */
 
+/**
+ * \brief Handle buffers completion at the ImgU inputs
+ * \param[in] buffer The completed buffer
+ *
+ * Raw buffers are returned to the CIO2 once all the ImgUs they have been
+ * queued to are done processing them.
+ */
+void IPU3CameraData::imguInputBufferReady(FrameBuffer *buffer)
+{
+	auto it = inputUsers_.find(buffer);
+	if (it != inputUsers_.end()) {
+		if (--it->second)
+			return;
+
+		inputUsers_.erase(it);
+	}
+
+	cio2_.tryReturnBuffer(buffer);
+}
+
 /**
  * \brief Handle buffers completion at the ImgU output
  * \param[in] buffer The completed buffer
@@ -1331,6 +1754,16 @@ void IPU3CameraData::cio2BufferReady(FrameBuffer *buffer)
 	ipa_->fillParamsBuffer(info->id, info->paramBuffer->cookie());
 }
 
+void IPU3CameraData::stillParamBufferReady(FrameBuffer *buffer)
+{
+	availableStillParamBuffers_.push(buffer);
+}
+
+void IPU3CameraData::stillStatBufferReady(FrameBuffer *buffer)
+{
+	availableStillStatBuffers_.push(buffer);
+}
+
 void IPU3CameraData::paramBufferReady(FrameBuffer *buffer)
 {
 	IPU3Frames::Info *info = frameInfos_.find(buffer);
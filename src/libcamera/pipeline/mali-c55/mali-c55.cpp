@@ -93,7 +93,7 @@ public:
 
 	int init();
 
-	/* Deflect these functionalities to either TPG or CameraSensor. */
+	/* Deflect these functionalities to the TPG, memory input or CameraSensor. */
 	const std::vector<unsigned int> mbusCodes() const;
 	const std::vector<Size> sizes(unsigned int mbusCode) const;
 	const Size resolution() const;
@@ -111,19 +111,48 @@ public:
 	Stream frStream_;
 	Stream dsStream_;
 
+	/* Memory input device and its stream, for memory-to-memory cameras. */
+	std::unique_ptr<V4L2VideoDevice> input_;
+	Stream inputStream_;
+
 private:
 	void initTPGData();
+	void initInputData();
 
 	std::string id_;
 	std::vector<unsigned int> tpgCodes_;
 	std::vector<Size> tpgSizes_;
 	Size tpgResolution_;
+
+	std::map<unsigned int, SizeRange> inputSizes_;
 };
 
 int MaliC55CameraData::init()
 {
 	int ret;
 
+	/*
+	 * A memory input device feeds the ISP with raw frames queued by the
+	 * application, there's no subdevice to operate.
+	 */
+	if (entity_->function() == MEDIA_ENT_F_IO_V4L) {
+		input_ = std::make_unique<V4L2VideoDevice>(entity_);
+		ret = input_->open();
+		if (ret) {
+			LOG(MaliC55, Error) << "Failed to open memory input device";
+			return ret;
+		}
+
+		initInputData();
+		if (inputSizes_.empty()) {
+			LOG(MaliC55, Error)
+				<< "Memory input supports no RAW format";
+			return -EINVAL;
+		}
+
+		return 0;
+	}
+
 	sd_ = std::make_unique<V4L2Subdevice>(entity_);
 	ret = sd_->open();
 	if (ret) {
@@ -177,11 +206,40 @@ void MaliC55CameraData::initTPGData()
 	tpgResolution_ = tpgSizes_.back();
 }
 
+/*
+ * Collect the RAW formats supported by the memory input device, and the range
+ * of frame sizes it accepts for each of them, bounded to the ISP limits.
+ */
+void MaliC55CameraData::initInputData()
+{
+	for (const auto &[v4l2Format, ranges] : input_->formats()) {
+		PixelFormat pixFmt = v4l2Format.toPixelFormat(false);
+		if (!pixFmt.isValid() || !isFormatRaw(pixFmt))
+			continue;
+
+		const auto it = maliC55FmtToCode.find(pixFmt);
+		if (it == maliC55FmtToCode.end() || ranges.empty())
+			continue;
+
+		SizeRange range = ranges.front();
+		range.min = range.min.expandedTo(kMaliC55MinSize);
+		range.max = range.max.boundedTo(kMaliC55MaxSize);
+		if (range.min.width > range.max.width ||
+		    range.min.height > range.max.height)
+			continue;
+
+		inputSizes_[it->second] = range;
+	}
+}
+
 const std::vector<unsigned int> MaliC55CameraData::mbusCodes() const
 {
 	if (sensor_)
 		return sensor_->mbusCodes();
 
+	if (input_)
+		return utils::map_keys(inputSizes_);
+
 	return tpgCodes_;
 }
 
@@ -190,6 +248,18 @@ const std::vector<Size> MaliC55CameraData::sizes(unsigned int mbusCode) const
 	if (sensor_)
 		return sensor_->sizes(mbusCode);
 
+	/*
+	 * The memory input accepts any size in its range, report the largest
+	 * one as the sensors and the TPG do for their discrete sizes.
+	 */
+	if (input_) {
+		const auto it = inputSizes_.find(mbusCode);
+		if (it == inputSizes_.end())
+			return {};
+
+		return { it->second.max };
+	}
+
 	V4L2Subdevice::Formats formats = sd_->formats(0);
 	if (formats.empty())
 		return {};
@@ -213,6 +283,14 @@ const Size MaliC55CameraData::resolution() const
 	if (sensor_)
 		return sensor_->resolution();
 
+	if (input_) {
+		Size resolution;
+		for (const auto &[code, range] : inputSizes_)
+			resolution = resolution.expandedTo(range.max);
+
+		return resolution;
+	}
+
 	return tpgResolution_;
 }
 
@@ -272,8 +350,19 @@ Size MaliC55CameraData::adjustRawSizes(const PixelFormat &rawFmt, const Size &ra
 	if (it == maliC55FmtToCode.end())
 		return {};
 
-	/* Check if the size is natively supported. */
 	unsigned int rawCode = it->second;
+
+	/* Frames fed from memory can have any size the input device accepts. */
+	if (input_) {
+		const auto range = inputSizes_.find(rawCode);
+		if (range == inputSizes_.end())
+			return {};
+
+		return rawSize.expandedTo(range->second.min)
+			      .boundedTo(range->second.max);
+	}
+
+	/* Check if the size is natively supported. */
 	const auto rawSizes = sizes(rawCode);
 	auto sizeIt = std::find(rawSizes.begin(), rawSizes.end(), rawSize);
 	if (sizeIt != rawSizes.end())
@@ -321,9 +410,13 @@ CameraConfiguration::Status MaliC55CameraConfiguration::validate()
 	if (config_.empty())
 		return Invalid;
 
-	/* Only 2 streams available. */
-	if (config_.size() > kMaxStreams) {
-		config_.resize(kMaxStreams);
+	/*
+	 * Only 2 streams available, plus the RAW input stream for memory
+	 * input cameras.
+	 */
+	unsigned int maxStreams = data_->input_ ? kMaxStreams + 1 : kMaxStreams;
+	if (config_.size() > maxStreams) {
+		config_.resize(maxStreams);
 		status = Adjusted;
 	}
 
@@ -342,6 +435,13 @@ CameraConfiguration::Status MaliC55CameraConfiguration::validate()
 		rawConfig = &config;
 	}
 
+	/* Memory input cameras need the RAW stream to describe their input. */
+	if (data_->input_ && !rawConfig) {
+		LOG(MaliC55, Error)
+			<< "Memory input requires a RAW input stream";
+		return Invalid;
+	}
+
 	Size maxSize = kMaliC55MaxSize;
 	if (rawConfig) {
 		/*
@@ -368,8 +468,16 @@ CameraConfiguration::Status MaliC55CameraConfiguration::validate()
 
 		maxSize = rawSize;
 
-		rawConfig->setStream(const_cast<Stream *>(&data_->frStream_));
-		frPipeAvailable = false;
+		/*
+		 * The RAW stream of a memory input camera is the input of the
+		 * ISP and leaves both pipes available for processed streams.
+		 */
+		if (data_->input_) {
+			rawConfig->setStream(const_cast<Stream *>(&data_->inputStream_));
+		} else {
+			rawConfig->setStream(const_cast<Stream *>(&data_->frStream_));
+			frPipeAvailable = false;
+		}
 	}
 
 	/* Adjust processed streams. */
@@ -508,6 +616,9 @@ private:
 			pipe.stream = nullptr;
 	}
 
+	int configureInput(MaliC55CameraData *data,
+			   const CameraConfiguration *config,
+			   V4L2SubdeviceFormat &subdevFormat);
 	int configureRawStream(MaliC55CameraData *data,
 			       const StreamConfiguration &config,
 			       V4L2SubdeviceFormat &subdevFormat);
@@ -519,6 +630,7 @@ private:
 				const std::string &name);
 	bool registerTPGCamera(MediaLink *link);
 	bool registerSensorCamera(MediaLink *link);
+	bool registerMemoryInputCamera(MediaLink *link);
 
 	MediaDevice *media_;
 	std::unique_ptr<V4L2Subdevice> isp_;
@@ -545,11 +657,19 @@ PipelineHandlerMaliC55::generateConfiguration(Camera *camera,
 	if (roles.empty())
 		return config;
 
-	/* Check if one stream is RAW to reserve the FR pipe for it. */
-	if (std::find(roles.begin(), roles.end(), StreamRole::Raw) != roles.end())
+	/*
+	 * Check if one stream is RAW to reserve the FR pipe for it. Memory
+	 * input cameras need a RAW stream to describe their input, add one
+	 * if it hasn't been requested. It doesn't use any of the pipes.
+	 */
+	std::vector<StreamRole> streamRoles(roles.begin(), roles.end());
+	bool hasRaw = std::find(roles.begin(), roles.end(), StreamRole::Raw) != roles.end();
+	if (hasRaw && !data->input_)
 		frPipeAvailable = false;
+	else if (!hasRaw && data->input_)
+		streamRoles.push_back(StreamRole::Raw);
 
-	for (const StreamRole &role : roles) {
+	for (const StreamRole &role : streamRoles) {
 		struct MaliC55Pipe *pipe;
 
 		/* Assign pipe for this role. */
@@ -644,6 +764,43 @@ PipelineHandlerMaliC55::generateConfiguration(Camera *camera,
 	return config;
 }
 
+/*
+ * Apply the RAW input stream configuration to the memory input device. The
+ * sensor format computed at validation time is propagated to the ISP sink
+ * pad.
+ */
+int PipelineHandlerMaliC55::configureInput(MaliC55CameraData *data,
+					   const CameraConfiguration *config,
+					   V4L2SubdeviceFormat &subdevFormat)
+{
+	for (const StreamConfiguration &streamConfig : *config) {
+		if (streamConfig.stream() != &data->inputStream_)
+			continue;
+
+		V4L2DeviceFormat inputFormat;
+		inputFormat.fourcc = data->input_->toV4L2PixelFormat(streamConfig.pixelFormat);
+		inputFormat.size = streamConfig.size;
+
+		int ret = data->input_->setFormat(&inputFormat);
+		if (ret)
+			return ret;
+
+		if (inputFormat.size != streamConfig.size ||
+		    inputFormat.fourcc != data->input_->toV4L2PixelFormat(streamConfig.pixelFormat)) {
+			LOG(MaliC55, Error)
+				<< "Memory input format not supported: "
+				<< inputFormat;
+			return -EINVAL;
+		}
+
+		subdevFormat.size = inputFormat.size;
+
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
 int PipelineHandlerMaliC55::configureRawStream(MaliC55CameraData *data,
 					       const StreamConfiguration &config,
 					       V4L2SubdeviceFormat &subdevFormat)
@@ -738,7 +895,10 @@ int PipelineHandlerMaliC55::configure(Camera *camera,
 	if (ret)
 		return ret;
 
-	/* Link the graph depending if we are operating the TPG or a sensor. */
+	/*
+	 * Link the graph depending if we are operating the TPG, a sensor or
+	 * the memory input.
+	 */
 	MaliC55CameraData *data = cameraData(camera);
 	if (data->csi_) {
 		const MediaEntity *csiEntity = data->csi_->entity();
@@ -752,9 +912,15 @@ int PipelineHandlerMaliC55::configure(Camera *camera,
 	MaliC55CameraConfiguration *maliConfig =
 		static_cast<MaliC55CameraConfiguration *>(config);
 	V4L2SubdeviceFormat subdevFormat = maliConfig->sensorFormat_;
-	ret = data->sd_->getFormat(0, &subdevFormat);
-	if (ret)
-		return ret;
+	if (data->input_) {
+		ret = configureInput(data, config, subdevFormat);
+		if (ret)
+			return ret;
+	} else {
+		ret = data->sd_->getFormat(0, &subdevFormat);
+		if (ret)
+			return ret;
+	}
 
 	if (data->csi_) {
 		ret = data->csi_->setFormat(0, &subdevFormat);
@@ -793,6 +959,9 @@ int PipelineHandlerMaliC55::configure(Camera *camera,
 	 */
 	for (const StreamConfiguration &streamConfig : *config) {
 		Stream *stream = streamConfig.stream();
+		if (stream == &data->inputStream_)
+			continue;
+
 		MaliC55Pipe *pipe = pipeFromStream(data, stream);
 
 		if (isFormatRaw(streamConfig.pixelFormat))
@@ -822,14 +991,21 @@ int PipelineHandlerMaliC55::configure(Camera *camera,
 int PipelineHandlerMaliC55::exportFrameBuffers(Camera *camera, Stream *stream,
 					       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
 {
-	MaliC55Pipe *pipe = pipeFromStream(cameraData(camera), stream);
+	MaliC55CameraData *data = cameraData(camera);
 	unsigned int count = stream->configuration().bufferCount;
 
+	if (stream == &data->inputStream_)
+		return data->input_->exportBuffers(count, buffers);
+
+	MaliC55Pipe *pipe = pipeFromStream(data, stream);
+
 	return pipe->cap->exportBuffers(count, buffers);
 }
 
-int PipelineHandlerMaliC55::start([[maybe_unused]] Camera *camera, [[maybe_unused]] const ControlList *controls)
+int PipelineHandlerMaliC55::start(Camera *camera, [[maybe_unused]] const ControlList *controls)
 {
+	MaliC55CameraData *data = cameraData(camera);
+
 	for (MaliC55Pipe &pipe : pipes_) {
 		if (!pipe.stream)
 			continue;
@@ -845,6 +1021,29 @@ int PipelineHandlerMaliC55::start([[maybe_unused]] Camera *camera, [[maybe_unuse
 		ret = pipe.cap->streamOn();
 		if (ret) {
 			LOG(MaliC55, Error) << "Failed to start stream";
+			stopDevice(camera);
+			return ret;
+		}
+	}
+
+	/*
+	 * Start the memory input last, the ISP processes the input frames as
+	 * soon as they're queued.
+	 */
+	if (data->input_) {
+		unsigned int count = data->inputStream_.configuration().bufferCount;
+
+		int ret = data->input_->importBuffers(count);
+		if (ret) {
+			LOG(MaliC55, Error) << "Failed to import input buffers";
+			stopDevice(camera);
+			return ret;
+		}
+
+		ret = data->input_->streamOn();
+		if (ret) {
+			LOG(MaliC55, Error) << "Failed to start memory input";
+			stopDevice(camera);
 			return ret;
 		}
 	}
@@ -852,8 +1051,15 @@ int PipelineHandlerMaliC55::start([[maybe_unused]] Camera *camera, [[maybe_unuse
 	return 0;
 }
 
-void PipelineHandlerMaliC55::stopDevice([[maybe_unused]] Camera *camera)
+void PipelineHandlerMaliC55::stopDevice(Camera *camera)
 {
+	MaliC55CameraData *data = cameraData(camera);
+
+	if (data->input_) {
+		data->input_->streamOff();
+		data->input_->releaseBuffers();
+	}
+
 	for (MaliC55Pipe &pipe : pipes_) {
 		if (!pipe.stream)
 			continue;
@@ -865,17 +1071,37 @@ void PipelineHandlerMaliC55::stopDevice([[maybe_unused]] Camera *camera)
 
 int PipelineHandlerMaliC55::queueRequestDevice(Camera *camera, Request *request)
 {
+	MaliC55CameraData *data = cameraData(camera);
+	FrameBuffer *input = nullptr;
 	int ret;
 
 	for (auto &[stream, buffer] : request->buffers()) {
-		MaliC55Pipe *pipe = pipeFromStream(cameraData(camera), stream);
+		if (stream == &data->inputStream_) {
+			input = buffer;
+			continue;
+		}
+
+		MaliC55Pipe *pipe = pipeFromStream(data, stream);
 
 		ret = pipe->cap->queueBuffer(buffer);
 		if (ret)
 			return ret;
 	}
 
-	return 0;
+	if (!data->input_)
+		return 0;
+
+	/*
+	 * The ISP only produces frames for the input frames it processes, a
+	 * request without an input buffer would never complete. Queue the
+	 * input last, once the capture buffers are ready to receive the output.
+	 */
+	if (!input) {
+		LOG(MaliC55, Error) << "Request has no RAW input buffer";
+		return -EINVAL;
+	}
+
+	return data->input_->queueBuffer(input);
 }
 
 void PipelineHandlerMaliC55::bufferReady(FrameBuffer *buffer)
@@ -896,6 +1122,8 @@ void PipelineHandlerMaliC55::registerMaliCamera(std::unique_ptr<MaliC55CameraDat
 	std::set<Stream *> streams{ &data->frStream_ };
 	if (dsFitted_)
 		streams.insert(&data->dsStream_);
+	if (data->input_)
+		streams.insert(&data->inputStream_);
 
 	std::shared_ptr<Camera> camera = Camera::create(std::move(data),
 							name, streams);
@@ -961,6 +1189,27 @@ bool PipelineHandlerMaliC55::registerSensorCamera(MediaLink *ispLink)
 	return true;
 }
 
+/*
+ * Register a Camera for the memory input device. Its RAW stream carries the
+ * frames fed to the ISP from memory, for instance to reprocess frames
+ * previously captured through the FR pipe bypass.
+ */
+bool PipelineHandlerMaliC55::registerMemoryInputCamera(MediaLink *link)
+{
+	MediaEntity *input = link->source()->entity();
+
+	std::unique_ptr<MaliC55CameraData> data =
+		std::make_unique<MaliC55CameraData>(this, input);
+	if (data->init())
+		return false;
+
+	data->input_->bufferReady.connect(this, &PipelineHandlerMaliC55::bufferReady);
+
+	registerMaliCamera(std::move(data), input->name());
+
+	return true;
+}
+
 bool PipelineHandlerMaliC55::match(DeviceEnumerator *enumerator)
 {
 	const MediaPad *ispSink;
@@ -1025,8 +1274,8 @@ bool PipelineHandlerMaliC55::match(DeviceEnumerator *enumerator)
 	 * MEDIA_ENT_F_VID_IF_BRIDGE - A CSI-2 receiver
 	 * MEDIA_ENT_F_IO_V4L - An input device
 	 *
-	 * The last one will be unsupported for now. The TPG is relatively easy,
-	 * we just register a Camera for it. If we have a CSI-2 receiver we need
+	 * The TPG and the input device are relatively easy, we just register a
+	 * Camera for each of them. If we have a CSI-2 receiver we need
 	 * to check its sink pad and register Cameras for anything connected to
 	 * it (probably...there are some complex situations in which that might
 	 * not be true but let's pretend they don't exist until we come across
@@ -1050,7 +1299,10 @@ bool PipelineHandlerMaliC55::match(DeviceEnumerator *enumerator)
 
 			break;
 		case MEDIA_ENT_F_IO_V4L:
-			LOG(MaliC55, Warning) << "Memory input not yet supported";
+			registered = registerMemoryInputCamera(link);
+			if (!registered)
+				return registered;
+
 			break;
 		default:
 			LOG(MaliC55, Error) << "Unsupported entity function";
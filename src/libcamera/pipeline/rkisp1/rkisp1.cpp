@@ -7,15 +7,16 @@
 
 #include <algorithm>
 #include <array>
+#include <deque>
 #include <iomanip>
 #include <memory>
 #include <numeric>
-#include <queue>
 
 #include <linux/media-bus-format.h>
 #include <linux/rkisp1-config.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread_pool.h>
 #include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
@@ -30,13 +31,19 @@
 #include <libcamera/ipa/core_ipa_interface.h>
 #include <libcamera/ipa/rkisp1_ipa_interface.h>
 #include <libcamera/ipa/rkisp1_ipa_proxy.h>
+#include <libcamera/ipa/rkisp1_ipa_serializer.h>
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/camera_sensor_properties.h"
+#include "libcamera/internal/capture_recorder.h"
+#include "libcamera/internal/control_serializer.h"
 #include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/ipa_budget.h"
 #include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/v4l2_subdevice.h"
@@ -54,6 +61,7 @@ class RkISP1CameraData;
 struct RkISP1FrameInfo {
 	unsigned int frame;
 	Request *request;
+	uint32_t queuedSequence;
 
 	FrameBuffer *paramBuffer;
 	FrameBuffer *statBuffer;
@@ -67,6 +75,10 @@ struct RkISP1FrameInfo {
 class RkISP1Frames
 {
 public:
+	static constexpr unsigned int kMaxBuffers = 16;
+	static constexpr unsigned int kGrowCount = 2;
+	static constexpr unsigned int kIdleFrames = 120;
+
 	RkISP1Frames(PipelineHandler *pipe);
 
 	RkISP1FrameInfo *create(const RkISP1CameraData *data, Request *request,
@@ -78,9 +90,16 @@ public:
 	RkISP1FrameInfo *find(FrameBuffer *buffer);
 	RkISP1FrameInfo *find(Request *request);
 
+	bool idle() const { return idleFrames_ >= kIdleFrames; }
+	void resetIdle() { idleFrames_ = 0; }
+	unsigned int peakInUse() const { return peakInUse_; }
+
 private:
 	PipelineHandlerRkISP1 *pipe_;
 	std::map<unsigned int, RkISP1FrameInfo *> frameInfo_;
+
+	unsigned int idleFrames_;
+	unsigned int peakInUse_;
 };
 
 class RkISP1CameraData : public Camera::Private
@@ -88,21 +107,34 @@ class RkISP1CameraData : public Camera::Private
 public:
 	RkISP1CameraData(PipelineHandler *pipe, RkISP1MainPath *mainPath,
 			 RkISP1SelfPath *selfPath)
-		: Camera::Private(pipe), frame_(0), frameInfo_(pipe),
-		  mainPath_(mainPath), selfPath_(selfPath)
+		: Camera::Private(pipe), frame_(0), sequence_(0),
+		  frameStarted_(false), frameInfo_(pipe),
+		  ipaBudget_("rkisp1", &metrics_), recorder_("rkisp1"),
+		  mainPath_(mainPath),
+		  selfPath_(selfPath)
 	{
 	}
 
 	PipelineHandlerRkISP1 *pipe();
 	int loadIPA(unsigned int hwRevision);
+	void processStats(RkISP1FrameInfo *info, const FrameMetadata &metadata,
+			  uint32_t bufferId);
+	void startRecording();
 
 	Stream mainPathStream_;
 	Stream selfPathStream_;
 	std::unique_ptr<CameraSensor> sensor_;
 	std::unique_ptr<DelayedControls> delayedCtrls_;
 	unsigned int frame_;
+	uint32_t sequence_;
+	bool frameStarted_;
 	std::vector<IPABuffer> ipaBuffers_;
 	RkISP1Frames frameInfo_;
+	IPABudget ipaBudget_;
+
+	CaptureRecorder recorder_;
+	std::vector<uint8_t> recordedInit_;
+	std::vector<uint8_t> recordedConfig_;
 
 	RkISP1MainPath *mainPath_;
 	RkISP1SelfPath *selfPath_;
@@ -154,6 +186,8 @@ public:
 	int exportFrameBuffers(Camera *camera, Stream *stream,
 			       std::vector<std::unique_ptr<FrameBuffer>> *buffers) override;
 
+	int setSyncMode(Camera *camera, SensorSyncMode mode) override;
+
 	int start(Camera *camera, const ControlList *controls) override;
 	void stopDevice(Camera *camera) override;
 
@@ -161,6 +195,8 @@ public:
 
 	bool match(DeviceEnumerator *enumerator) override;
 
+	void releaseDevice(Camera *camera) override;
+
 private:
 	static constexpr Size kRkISP1PreviewSize = { 1920, 1080 };
 
@@ -172,8 +208,12 @@ private:
 	friend RkISP1CameraData;
 	friend RkISP1Frames;
 
+	bool ispAvailable(Camera *camera) const;
 	int initLinks(Camera *camera, const CameraSensor *sensor,
 		      const RkISP1CameraConfiguration &config);
+	int configureDevices(RkISP1CameraData *data,
+			     const RkISP1CameraConfiguration &config,
+			     const V4L2SubdeviceFormat &format);
 	int createCamera(MediaEntity *sensor);
 	void tryCompleteRequest(RkISP1FrameInfo *info);
 	void bufferReady(FrameBuffer *buffer);
@@ -181,9 +221,19 @@ private:
 	void statReady(FrameBuffer *buffer);
 	void frameStart(uint32_t sequence);
 
+	/*
+	 * Minimum distance, in frames, between the frame being captured and
+	 * the frame targeted by a newly queued request.
+	 */
+	static constexpr unsigned int kParamsLookAhead = 1;
+
 	int allocateBuffers(Camera *camera);
 	int freeBuffers(Camera *camera);
 
+	unsigned int bufferPoolSize() const;
+	bool growBuffers(RkISP1CameraData *data);
+	void shrinkBuffers(RkISP1CameraData *data);
+
 	MediaDevice *media_;
 	std::unique_ptr<V4L2Subdevice> isp_;
 	std::unique_ptr<V4L2VideoDevice> param_;
@@ -192,14 +242,33 @@ private:
 
 	bool hasSelfPath_;
 	bool isRaw_;
+	bool metaFormatsConfigured_;
 
 	RkISP1MainPath mainPath_;
 	RkISP1SelfPath selfPath_;
 
 	std::vector<std::unique_ptr<FrameBuffer>> paramBuffers_;
 	std::vector<std::unique_ptr<FrameBuffer>> statBuffers_;
-	std::queue<FrameBuffer *> availableParamBuffers_;
-	std::queue<FrameBuffer *> availableStatBuffers_;
+	std::deque<FrameBuffer *> availableParamBuffers_;
+	std::deque<FrameBuffer *> availableStatBuffers_;
+
+	/*
+	 * The parameters and statistics buffers pool is grown on underrun, up
+	 * to RkISP1Frames::kMaxBuffers, and shrunk back when the extra buffers
+	 * haven't been needed for RkISP1Frames::kIdleFrames frames.
+	 */
+	unsigned int initialBufferCount_;
+	unsigned int nextIpaBufferId_;
+	unsigned int bufferUnderruns_;
+	bool canGrowBuffers_;
+	bool canShrinkBuffers_;
+
+	/*
+	 * The parameters and statistics buffers are kept across stop and start
+	 * until the camera they are mapped to is released, or another camera
+	 * is started.
+	 */
+	Camera *buffersCamera_;
 
 	Camera *activeCamera_;
 
@@ -207,7 +276,8 @@ private:
 };
 
 RkISP1Frames::RkISP1Frames(PipelineHandler *pipe)
-	: pipe_(static_cast<PipelineHandlerRkISP1 *>(pipe))
+	: pipe_(static_cast<PipelineHandlerRkISP1 *>(pipe)), idleFrames_(0),
+	  peakInUse_(0)
 {
 }
 
@@ -231,10 +301,10 @@ RkISP1FrameInfo *RkISP1Frames::create(const RkISP1CameraData *data, Request *req
 		}
 
 		paramBuffer = pipe_->availableParamBuffers_.front();
-		pipe_->availableParamBuffers_.pop();
+		pipe_->availableParamBuffers_.pop_front();
 
 		statBuffer = pipe_->availableStatBuffers_.front();
-		pipe_->availableStatBuffers_.pop();
+		pipe_->availableStatBuffers_.pop_front();
 	}
 
 	FrameBuffer *mainPathBuffer = request->findBuffer(&data->mainPathStream_);
@@ -244,6 +314,7 @@ RkISP1FrameInfo *RkISP1Frames::create(const RkISP1CameraData *data, Request *req
 
 	info->frame = frame;
 	info->request = request;
+	info->queuedSequence = data->sequence_;
 	info->paramBuffer = paramBuffer;
 	info->mainPathBuffer = mainPathBuffer;
 	info->selfPathBuffer = selfPathBuffer;
@@ -253,6 +324,12 @@ RkISP1FrameInfo *RkISP1Frames::create(const RkISP1CameraData *data, Request *req
 
 	frameInfo_[frame] = info;
 
+	/* The pool is busy when its extra buffers are needed. */
+	unsigned int inUse = frameInfo_.size();
+	peakInUse_ = std::max(peakInUse_, inUse);
+	if (inUse + kGrowCount > pipe_->bufferPoolSize())
+		idleFrames_ = 0;
+
 	return info;
 }
 
@@ -262,13 +339,15 @@ int RkISP1Frames::destroy(unsigned int frame)
 	if (!info)
 		return -ENOENT;
 
-	pipe_->availableParamBuffers_.push(info->paramBuffer);
-	pipe_->availableStatBuffers_.push(info->statBuffer);
+	pipe_->availableParamBuffers_.push_back(info->paramBuffer);
+	pipe_->availableStatBuffers_.push_back(info->statBuffer);
 
 	frameInfo_.erase(info->frame);
 
 	delete info;
 
+	idleFrames_++;
+
 	return 0;
 }
 
@@ -277,13 +356,16 @@ void RkISP1Frames::clear()
 	for (const auto &entry : frameInfo_) {
 		RkISP1FrameInfo *info = entry.second;
 
-		pipe_->availableParamBuffers_.push(info->paramBuffer);
-		pipe_->availableStatBuffers_.push(info->statBuffer);
+		pipe_->availableParamBuffers_.push_back(info->paramBuffer);
+		pipe_->availableStatBuffers_.push_back(info->statBuffer);
 
 		delete info;
 	}
 
 	frameInfo_.clear();
+
+	idleFrames_ = 0;
+	peakInUse_ = 0;
 }
 
 RkISP1FrameInfo *RkISP1Frames::find(unsigned int frame)
@@ -334,6 +416,28 @@ PipelineHandlerRkISP1 *RkISP1CameraData::pipe()
 	return static_cast<PipelineHandlerRkISP1 *>(Camera::Private::pipe());
 }
 
+namespace {
+
+/*
+ * The Init and Configure chunks of capture recordings store the arguments
+ * passed to the corresponding IPA functions, serialized with the IPA data
+ * serializers, each prefixed with its size.
+ */
+template<typename T>
+void recordArgument(std::vector<uint8_t> *data, const T &value,
+		    ControlSerializer *cs = nullptr)
+{
+	std::vector<uint8_t> arg;
+	std::tie(arg, std::ignore) = IPADataSerializer<T>::serialize(value, cs);
+
+	uint32_t size = arg.size();
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&size);
+	data->insert(data->end(), bytes, bytes + sizeof(size));
+	data->insert(data->end(), arg.begin(), arg.end());
+}
+
+} /* namespace */
+
 int RkISP1CameraData::loadIPA(unsigned int hwRevision)
 {
 	ipa_ = IPAManager::createIPA<ipa::rkisp1::IPAProxyRkISP1>(pipe(), 1, 1);
@@ -371,9 +475,80 @@ int RkISP1CameraData::loadIPA(unsigned int hwRevision)
 		return ret;
 	}
 
+	if (recorder_.isEnabled()) {
+		ControlSerializer serializer(ControlSerializer::Role::Proxy);
+		ipa::rkisp1::IPAConfigInfo initInfo{ sensorInfo, sensor_->controls() };
+
+		recordedInit_.clear();
+		recordArgument(&recordedInit_, static_cast<uint32_t>(hwRevision));
+		recordArgument(&recordedInit_, sensor_->model());
+		recordArgument(&recordedInit_, initInfo, &serializer);
+	}
+
 	return 0;
 }
 
+/*
+ * Pass the statistics of a frame to the IPA, unless the IPA overrun policy
+ * skips the processing of the frame. Skipped frames are completed with the
+ * ISP parameters and sensor controls computed for the previous frames.
+ */
+void RkISP1CameraData::processStats(RkISP1FrameInfo *info,
+				    const FrameMetadata &metadata,
+				    uint32_t bufferId)
+{
+	ControlList sensorControls = delayedCtrls_->get(metadata.sequence);
+
+	/*
+	 * Record the IPA inputs before applying the overrun policy, to replay
+	 * all frames regardless of the timings of the recorded session.
+	 */
+	if (recorder_.isOpen()) {
+		if (info->statBuffer) {
+			MappedFrameBuffer stats(info->statBuffer,
+						MappedFrameBuffer::MapFlag::Read);
+			if (stats.isValid()) {
+				Span<uint8_t> data = stats.planes()[0];
+				unsigned int bytesused = metadata.planes()[0].bytesused;
+				if (bytesused && bytesused < data.size())
+					data = data.first(bytesused);
+
+				recorder_.write(CaptureChunk::Type::Statistics,
+						info->frame, metadata.timestamp, data);
+			}
+		}
+
+		recorder_.write(CaptureChunk::Type::SensorControls, info->frame,
+				metadata.timestamp,
+				CaptureChunk::encodeControls(sensorControls));
+	}
+
+	if (ipaBudget_.skip(metadata)) {
+		ControlList overrunMetadata(controls::controls);
+		overrunMetadata.set(controls::ProcessingOverruns,
+				    static_cast<int32_t>(ipaBudget_.overruns()));
+		pipe()->metadataAvailable(info->request, overrunMetadata);
+		info->metadataProcessed = true;
+		return;
+	}
+
+	ipaBudget_.begin(info->frame);
+	ipa_->processStatsBuffer(info->frame, bufferId, sensorControls);
+}
+
+/*
+ * Start recording the capture session if enabled, with the IPA initialization
+ * and configuration parameters.
+ */
+void RkISP1CameraData::startRecording()
+{
+	if (recorder_.open() || !recorder_.isOpen())
+		return;
+
+	recorder_.write(CaptureChunk::Type::Init, 0, 0, recordedInit_);
+	recorder_.write(CaptureChunk::Type::Configure, 0, 0, recordedConfig_);
+}
+
 void RkISP1CameraData::paramFilled(unsigned int frame)
 {
 	PipelineHandlerRkISP1 *pipe = RkISP1CameraData::pipe();
@@ -381,6 +556,17 @@ void RkISP1CameraData::paramFilled(unsigned int frame)
 	if (!info)
 		return;
 
+	/*
+	 * The ISP applies the parameters at the start of the frame following
+	 * their queueing. If the frame they have been computed for has already
+	 * started, they will apply to a later frame, which paramReady() detects
+	 * and compensates for.
+	 */
+	if (frameStarted_ && info->frame <= sequence_)
+		LOG(RkISP1, Debug)
+			<< "Parameters for frame " << info->frame
+			<< " filled after frame " << sequence_ << " started";
+
 	info->paramBuffer->_d()->metadata().planes()[0].bytesused =
 		sizeof(struct rkisp1_params_cfg);
 	pipe->param_->queueBuffer(info->paramBuffer);
@@ -405,7 +591,14 @@ void RkISP1CameraData::metadataReady(unsigned int frame, const ControlList &meta
 	if (!info)
 		return;
 
-	info->request->metadata().merge(metadata);
+	ipaBudget_.end(frame);
+
+	ControlList overrunMetadata(controls::controls);
+	overrunMetadata.set(controls::ProcessingOverruns,
+			    static_cast<int32_t>(ipaBudget_.overruns()));
+
+	pipe()->metadataAvailable(info->request, metadata);
+	pipe()->metadataAvailable(info->request, overrunMetadata);
 	info->metadataProcessed = true;
 
 	pipe()->tryCompleteRequest(info);
@@ -598,7 +791,10 @@ CameraConfiguration::Status RkISP1CameraConfiguration::validate()
  */
 
 PipelineHandlerRkISP1::PipelineHandlerRkISP1(CameraManager *manager)
-	: PipelineHandler(manager), hasSelfPath_(true)
+	: PipelineHandler(manager), hasSelfPath_(true),
+	  metaFormatsConfigured_(false), initialBufferCount_(0),
+	  nextIpaBufferId_(1), bufferUnderruns_(0), canGrowBuffers_(false),
+	  canShrinkBuffers_(false), buffersCamera_(nullptr)
 {
 }
 
@@ -714,6 +910,10 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 	CameraSensor *sensor = data->sensor_.get();
 	int ret;
 
+	/* Reconfiguring the links would stop the camera using the ISP. */
+	if (!ispAvailable(camera))
+		return -EBUSY;
+
 	ret = initLinks(camera, sensor, *config);
 	if (ret)
 		return ret;
@@ -754,6 +954,16 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 	const PixelFormatInfo &info = PixelFormatInfo::info(streamFormat);
 	isRaw_ = info.colourEncoding == PixelFormatInfo::ColourEncodingRAW;
 
+	/*
+	 * When the ISP processes frames, the parameters and statistics buffers
+	 * carry every request through the pipeline, and requests without
+	 * image buffers complete with the IPA metadata. This allows keeping
+	 * the algorithms converged with statistics only, and resuming capture
+	 * on any configured stream from the next request. Raw capture produces
+	 * metadata from the image buffers and needs them in every request.
+	 */
+	data->metadataOnlyRequests_ = !isRaw_;
+
 	/* YUYV8_2X8 is required on the ISP source path pad for YUV output. */
 	if (!isRaw_)
 		format.code = MEDIA_BUS_FMT_YUYV8_2X8;
@@ -778,22 +988,75 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 	std::map<unsigned int, IPAStream> streamConfig;
 
 	for (const StreamConfiguration &cfg : *config) {
-		if (cfg.stream() == &data->mainPathStream_) {
-			ret = mainPath_.configure(cfg, format);
-			streamConfig[0] = IPAStream(cfg.pixelFormat,
-						    cfg.size);
-		} else if (hasSelfPath_) {
-			ret = selfPath_.configure(cfg, format);
-			streamConfig[1] = IPAStream(cfg.pixelFormat,
-						    cfg.size);
-		} else {
+		if (cfg.stream() == &data->mainPathStream_)
+			streamConfig[0] = IPAStream(cfg.pixelFormat, cfg.size);
+		else if (hasSelfPath_)
+			streamConfig[1] = IPAStream(cfg.pixelFormat, cfg.size);
+		else
 			return -ENODEV;
+	}
+
+	/*
+	 * The IPA configuration doesn't depend on the paths and the parameters
+	 * and statistics video nodes. Configure them in a thread pool task while
+	 * the IPA is configured, and wait for both before returning.
+	 */
+	int devicesRet = 0;
+	TaskGroup devices(1);
+	devices.run([&]() {
+		devicesRet = configureDevices(data, *config, format);
+	});
+
+	/* Inform IPA of stream configuration and sensor controls. */
+	ipa::rkisp1::IPAConfigInfo ipaConfig{};
+
+	ret = data->sensor_->sensorInfo(&ipaConfig.sensorInfo);
+	if (!ret) {
+		ipaConfig.sensorControls = data->sensor_->controls();
+
+		ret = data->ipa_->configure(ipaConfig, streamConfig,
+					    &data->controlInfo_);
+		if (ret)
+			LOG(RkISP1, Error) << "failed configuring IPA (" << ret << ")";
+
+		if (data->recorder_.isEnabled()) {
+			ControlSerializer serializer(ControlSerializer::Role::Proxy);
+
+			data->recordedConfig_.clear();
+			recordArgument(&data->recordedConfig_, ipaConfig, &serializer);
+			recordArgument(&data->recordedConfig_, streamConfig);
+			recordArgument(&data->recordedConfig_, isRaw_);
 		}
+	}
+
+	devices.wait();
+
+	return ret ? ret : devicesRet;
+}
+
+int PipelineHandlerRkISP1::configureDevices(RkISP1CameraData *data,
+					    const RkISP1CameraConfiguration &config,
+					    const V4L2SubdeviceFormat &format)
+{
+	int ret;
+
+	for (const StreamConfiguration &cfg : config) {
+		if (cfg.stream() == &data->mainPathStream_)
+			ret = mainPath_.configure(cfg, format);
+		else
+			ret = selfPath_.configure(cfg, format);
 
 		if (ret)
 			return ret;
 	}
 
+	/*
+	 * The formats of the parameters and statistics video nodes are fixed,
+	 * they only need to be set once.
+	 */
+	if (metaFormatsConfigured_)
+		return 0;
+
 	V4L2DeviceFormat paramFormat;
 	paramFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_PARAMS);
 	ret = param_->setFormat(&paramFormat);
@@ -806,20 +1069,8 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 	if (ret)
 		return ret;
 
-	/* Inform IPA of stream configuration and sensor controls. */
-	ipa::rkisp1::IPAConfigInfo ipaConfig{};
+	metaFormatsConfigured_ = true;
 
-	ret = data->sensor_->sensorInfo(&ipaConfig.sensorInfo);
-	if (ret)
-		return ret;
-
-	ipaConfig.sensorControls = data->sensor_->controls();
-
-	ret = data->ipa_->configure(ipaConfig, streamConfig, &data->controlInfo_);
-	if (ret) {
-		LOG(RkISP1, Error) << "failed configuring IPA (" << ret << ")";
-		return ret;
-	}
 	return 0;
 }
 
@@ -848,6 +1099,35 @@ int PipelineHandlerRkISP1::allocateBuffers(Camera *camera)
 		data->selfPathStream_.configuration().bufferCount,
 	});
 
+	/*
+	 * The formats of the parameters and statistics buffers don't depend on
+	 * the configuration, reuse the buffers of the previous capture session
+	 * if there are enough of them.
+	 */
+	if (buffersCamera_ == camera && (isRaw_ || bufferPoolSize() >= maxCount)) {
+		availableParamBuffers_.clear();
+		availableStatBuffers_.clear();
+
+		for (std::unique_ptr<FrameBuffer> &buffer : paramBuffers_)
+			availableParamBuffers_.push_back(buffer.get());
+		for (std::unique_ptr<FrameBuffer> &buffer : statBuffers_)
+			availableStatBuffers_.push_back(buffer.get());
+
+		LOG(RkISP1, Debug)
+			<< "Reusing " << bufferPoolSize() << " buffers";
+
+		initialBufferCount_ = bufferPoolSize();
+		bufferUnderruns_ = 0;
+		canGrowBuffers_ = !isRaw_;
+		canShrinkBuffers_ = !isRaw_ && param_->supportsRemoveBuffers() &&
+				    stat_->supportsRemoveBuffers();
+
+		return 0;
+	}
+
+	if (buffersCamera_)
+		freeBuffers(buffersCamera_);
+
 	if (!isRaw_) {
 		ret = param_->allocateBuffers(maxCount, &paramBuffers_);
 		if (ret < 0)
@@ -860,20 +1140,30 @@ int PipelineHandlerRkISP1::allocateBuffers(Camera *camera)
 
 	for (std::unique_ptr<FrameBuffer> &buffer : paramBuffers_) {
 		buffer->setCookie(ipaBufferId++);
+		data->memory_->charge(buffer.get());
 		data->ipaBuffers_.emplace_back(buffer->cookie(),
 					       buffer->planes());
-		availableParamBuffers_.push(buffer.get());
+		availableParamBuffers_.push_back(buffer.get());
 	}
 
 	for (std::unique_ptr<FrameBuffer> &buffer : statBuffers_) {
 		buffer->setCookie(ipaBufferId++);
+		data->memory_->charge(buffer.get());
 		data->ipaBuffers_.emplace_back(buffer->cookie(),
 					       buffer->planes());
-		availableStatBuffers_.push(buffer.get());
+		availableStatBuffers_.push_back(buffer.get());
 	}
 
 	data->ipa_->mapBuffers(data->ipaBuffers_);
 
+	initialBufferCount_ = bufferPoolSize();
+	nextIpaBufferId_ = ipaBufferId;
+	bufferUnderruns_ = 0;
+	canGrowBuffers_ = !isRaw_;
+	canShrinkBuffers_ = !isRaw_ && param_->supportsRemoveBuffers() &&
+			    stat_->supportsRemoveBuffers();
+	buffersCamera_ = camera;
+
 	return 0;
 
 error:
@@ -887,11 +1177,8 @@ int PipelineHandlerRkISP1::freeBuffers(Camera *camera)
 {
 	RkISP1CameraData *data = cameraData(camera);
 
-	while (!availableStatBuffers_.empty())
-		availableStatBuffers_.pop();
-
-	while (!availableParamBuffers_.empty())
-		availableParamBuffers_.pop();
+	availableStatBuffers_.clear();
+	availableParamBuffers_.clear();
 
 	paramBuffers_.clear();
 	statBuffers_.clear();
@@ -909,14 +1196,134 @@ int PipelineHandlerRkISP1::freeBuffers(Camera *camera)
 	if (stat_->releaseBuffers())
 		LOG(RkISP1, Error) << "Failed to release stat buffers";
 
+	buffersCamera_ = nullptr;
+
 	return 0;
 }
 
+unsigned int PipelineHandlerRkISP1::bufferPoolSize() const
+{
+	return std::min(paramBuffers_.size(), statBuffers_.size());
+}
+
+/*
+ * Grow the parameters and statistics buffers pool on underrun. The new buffers
+ * are mapped to the IPA and immediately available. Return true if buffers have
+ * been added.
+ */
+bool PipelineHandlerRkISP1::growBuffers(RkISP1CameraData *data)
+{
+	if (!canGrowBuffers_ || bufferPoolSize() >= RkISP1Frames::kMaxBuffers)
+		return false;
+
+	unsigned int params = paramBuffers_.size();
+	unsigned int stats = statBuffers_.size();
+
+	int paramsRet = param_->addBuffers(RkISP1Frames::kGrowCount, &paramBuffers_);
+	int statsRet = stat_->addBuffers(RkISP1Frames::kGrowCount, &statBuffers_);
+	if (paramsRet < 0 || statsRet < 0) {
+		LOG(RkISP1, Warning)
+			<< "Failed to grow buffers pool, keeping "
+			<< bufferPoolSize() << " buffers";
+		canGrowBuffers_ = false;
+	}
+
+	std::vector<IPABuffer> ipaBuffers;
+
+	for (unsigned int i = params; i < paramBuffers_.size(); i++) {
+		FrameBuffer *buffer = paramBuffers_[i].get();
+		buffer->setCookie(nextIpaBufferId_++);
+		data->memory_->charge(buffer);
+		ipaBuffers.emplace_back(buffer->cookie(), buffer->planes());
+		availableParamBuffers_.push_back(buffer);
+	}
+
+	for (unsigned int i = stats; i < statBuffers_.size(); i++) {
+		FrameBuffer *buffer = statBuffers_[i].get();
+		buffer->setCookie(nextIpaBufferId_++);
+		data->memory_->charge(buffer);
+		ipaBuffers.emplace_back(buffer->cookie(), buffer->planes());
+		availableStatBuffers_.push_back(buffer);
+	}
+
+	if (ipaBuffers.empty())
+		return false;
+
+	data->ipa_->mapBuffers(ipaBuffers);
+	data->ipaBuffers_.insert(data->ipaBuffers_.end(), ipaBuffers.begin(),
+				 ipaBuffers.end());
+
+	/* Don't shrink the pool right after growing it. */
+	data->frameInfo_.resetIdle();
+
+	LOG(RkISP1, Debug) << "Grew buffers pool to " << bufferPoolSize();
+
+	return !availableParamBuffers_.empty() && !availableStatBuffers_.empty();
+}
+
+/* Free one parameters and statistics buffer from a pool previously grown. */
+void PipelineHandlerRkISP1::shrinkBuffers(RkISP1CameraData *data)
+{
+	if (!canShrinkBuffers_)
+		return;
+
+	FrameBuffer *param = paramBuffers_.back().get();
+	FrameBuffer *stat = statBuffers_.back().get();
+
+	auto paramIt = std::find(availableParamBuffers_.begin(),
+				 availableParamBuffers_.end(), param);
+	auto statIt = std::find(availableStatBuffers_.begin(),
+				availableStatBuffers_.end(), stat);
+
+	/* Retry later if the buffers are in use. */
+	if (paramIt == availableParamBuffers_.end() ||
+	    statIt == availableStatBuffers_.end())
+		return;
+
+	availableParamBuffers_.erase(paramIt);
+	availableStatBuffers_.erase(statIt);
+
+	std::vector<unsigned int> ids = {
+		static_cast<unsigned int>(param->cookie()),
+		static_cast<unsigned int>(stat->cookie()),
+	};
+
+	if (param_->removeBuffers(1, &paramBuffers_) ||
+	    stat_->removeBuffers(1, &statBuffers_)) {
+		LOG(RkISP1, Error) << "Failed to shrink buffers pool";
+		canShrinkBuffers_ = false;
+		return;
+	}
+
+	data->ipa_->unmapBuffers(ids);
+	data->ipaBuffers_.erase(std::remove_if(data->ipaBuffers_.begin(),
+					       data->ipaBuffers_.end(),
+					       [&](const IPABuffer &buffer) {
+						       return std::find(ids.begin(), ids.end(),
+									buffer.id) != ids.end();
+					       }),
+				data->ipaBuffers_.end());
+
+	data->frameInfo_.resetIdle();
+
+	LOG(RkISP1, Debug) << "Shrunk buffers pool to " << bufferPoolSize();
+}
+
+int PipelineHandlerRkISP1::setSyncMode(Camera *camera, SensorSyncMode mode)
+{
+	RkISP1CameraData *data = cameraData(camera);
+
+	return data->sensor_->setSyncMode(mode);
+}
+
 int PipelineHandlerRkISP1::start(Camera *camera, [[maybe_unused]] const ControlList *controls)
 {
 	RkISP1CameraData *data = cameraData(camera);
 	int ret;
 
+	if (!ispAvailable(camera))
+		return -EBUSY;
+
 	/* Allocate buffers for internal pipeline usage. */
 	ret = allocateBuffers(camera);
 	if (ret)
@@ -931,6 +1338,9 @@ int PipelineHandlerRkISP1::start(Camera *camera, [[maybe_unused]] const ControlL
 	}
 
 	data->frame_ = 0;
+	data->sequence_ = 0;
+	data->frameStarted_ = false;
+	data->ipaBudget_.reset();
 
 	if (!isRaw_) {
 		ret = param_->streamOn();
@@ -978,6 +1388,8 @@ int PipelineHandlerRkISP1::start(Camera *camera, [[maybe_unused]] const ControlL
 
 	isp_->setFrameStartEnabled(true);
 
+	data->startRecording();
+
 	activeCamera_ = camera;
 	return ret;
 }
@@ -990,6 +1402,7 @@ void PipelineHandlerRkISP1::stopDevice(Camera *camera)
 	isp_->setFrameStartEnabled(false);
 
 	data->ipa_->stop();
+	data->recorder_.close();
 
 	if (hasSelfPath_)
 		selfPath_.stop();
@@ -1008,9 +1421,15 @@ void PipelineHandlerRkISP1::stopDevice(Camera *camera)
 	}
 
 	ASSERT(data->queuedRequests_.empty());
-	data->frameInfo_.clear();
 
-	freeBuffers(camera);
+	if (!isRaw_)
+		LOG(RkISP1, Debug)
+			<< "Frame buffers pool: " << initialBufferCount_ << " to "
+			<< bufferPoolSize() << " buffers, "
+			<< data->frameInfo_.peakInUse() << " peak in use, "
+			<< bufferUnderruns_ << " underruns";
+
+	data->frameInfo_.clear();
 
 	activeCamera_ = nullptr;
 }
@@ -1019,9 +1438,36 @@ int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera, Request *request)
 {
 	RkISP1CameraData *data = cameraData(camera);
 
+	if (!isRaw_) {
+		if (availableParamBuffers_.empty() || availableStatBuffers_.empty()) {
+			bufferUnderruns_++;
+			data->metrics_.counter("param_buffer_underruns")->add();
+			growBuffers(data);
+		} else if (data->frameInfo_.idle() &&
+			   bufferPoolSize() > initialBufferCount_) {
+			shrinkBuffers(data);
+		}
+	}
+
+	/*
+	 * Target a frame that hasn't started yet. If the application fell
+	 * behind the sensor, the frame counter would otherwise point to a
+	 * frame in the past, and the IPA would compute the parameters and
+	 * sensor controls for the wrong frame.
+	 */
+	if (data->frameStarted_)
+		data->frame_ = std::max(data->frame_,
+					data->sequence_ + kParamsLookAhead);
+
 	RkISP1FrameInfo *info = data->frameInfo_.create(data, request, isRaw_);
-	if (!info)
+	if (!info) {
+		frameDropped(camera, data->frame_,
+			     controls::FrameDropParamsUnderrun);
 		return -ENOENT;
+	}
+
+	data->recorder_.write(CaptureChunk::Type::Request, data->frame_, 0,
+			      CaptureChunk::encodeControls(request->controls()));
 
 	data->ipa_->queueRequest(data->frame_, request->controls());
 	if (isRaw_) {
@@ -1040,10 +1486,33 @@ int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera, Request *request)
 	return 0;
 }
 
+void PipelineHandlerRkISP1::releaseDevice(Camera *camera)
+{
+	if (buffersCamera_ == camera)
+		freeBuffers(camera);
+}
+
 /* -----------------------------------------------------------------------------
  * Match and Setup
  */
 
+/*
+ * The ISP processes the frames of a single sensor, as the driver has no memory
+ * input that would allow time-multiplexing it between sensors. Only one camera
+ * can use it at a time.
+ */
+bool PipelineHandlerRkISP1::ispAvailable(Camera *camera) const
+{
+	if (!activeCamera_ || activeCamera_ == camera)
+		return true;
+
+	LOG(RkISP1, Info)
+		<< "ISP in use by camera " << activeCamera_->id()
+		<< ", can't use it for " << camera->id();
+
+	return false;
+}
+
 int PipelineHandlerRkISP1::initLinks(Camera *camera,
 				     const CameraSensor *sensor,
 				     const RkISP1CameraConfiguration &config)
@@ -1209,6 +1678,7 @@ bool PipelineHandlerRkISP1::match(DeviceEnumerator *enumerator)
 		selfPath_.bufferReady().connect(this, &PipelineHandlerRkISP1::bufferReady);
 	stat_->bufferReady.connect(this, &PipelineHandlerRkISP1::statReady);
 	param_->bufferReady.connect(this, &PipelineHandlerRkISP1::paramReady);
+	isp_->frameStart.connect(this, &PipelineHandlerRkISP1::frameStart);
 
 	/*
 	 * Enumerate all sensors connected to the ISP and create one
@@ -1260,19 +1730,17 @@ void PipelineHandlerRkISP1::bufferReady(FrameBuffer *buffer)
 
 	if (metadata.status != FrameMetadata::FrameCancelled) {
 		/*
-		 * Record the sensor's timestamp in the request metadata.
+		 * Report the sensor's timestamp in the request metadata.
 		 *
 		 * \todo The sensor timestamp should be better estimated by connecting
 		 * to the V4L2Device::frameStart signal.
 		 */
-		request->metadata().set(controls::SensorTimestamp,
-					metadata.timestamp);
+		ControlList sensorMetadata(controls::controls);
+		sensorMetadata.set(controls::SensorTimestamp, metadata.timestamp);
+		metadataAvailable(request, sensorMetadata);
 
-		if (isRaw_) {
-			const ControlList &ctrls =
-				data->delayedCtrls_->get(metadata.sequence);
-			data->ipa_->processStatsBuffer(info->frame, 0, ctrls);
-		}
+		if (isRaw_)
+			data->processStats(info, metadata, 0);
 	} else {
 		if (isRaw_)
 			info->metadataProcessed = true;
@@ -1292,6 +1760,31 @@ void PipelineHandlerRkISP1::paramReady(FrameBuffer *buffer)
 		return;
 
 	info->paramDequeued = true;
+
+	/*
+	 * The parameters buffer sequence number is the frame the parameters
+	 * have been applied to. Report the achieved latency, and if the
+	 * parameters landed later than targeted, move the following requests
+	 * to frames the IPA can still target.
+	 */
+	const FrameMetadata &metadata = buffer->metadata();
+	if (metadata.status == FrameMetadata::FrameSuccess) {
+		int32_t latency = metadata.sequence - info->queuedSequence;
+
+		ControlList paramsMetadata(controls::controls);
+		paramsMetadata.set(controls::ParametersLatency, std::max(latency, 0));
+		metadataAvailable(info->request, paramsMetadata);
+
+		if (metadata.sequence > info->frame) {
+			LOG(RkISP1, Debug)
+				<< "Parameters for frame " << info->frame
+				<< " applied to frame " << metadata.sequence;
+
+			if (data->frame_ <= metadata.sequence)
+				data->frame_ = metadata.sequence + 1;
+		}
+	}
+
 	tryCompleteRequest(info);
 }
 
@@ -1313,8 +1806,19 @@ void PipelineHandlerRkISP1::statReady(FrameBuffer *buffer)
 	if (data->frame_ <= buffer->metadata().sequence)
 		data->frame_ = buffer->metadata().sequence + 1;
 
-	data->ipa_->processStatsBuffer(info->frame, info->statBuffer->cookie(),
-				       data->delayedCtrls_->get(buffer->metadata().sequence));
+	data->processStats(info, buffer->metadata(), info->statBuffer->cookie());
+	tryCompleteRequest(info);
+}
+
+void PipelineHandlerRkISP1::frameStart(uint32_t sequence)
+{
+	if (!activeCamera_)
+		return;
+
+	RkISP1CameraData *data = cameraData(activeCamera_);
+
+	data->sequence_ = sequence;
+	data->frameStarted_ = true;
 }
 
 REGISTER_PIPELINE_HANDLER(PipelineHandlerRkISP1, "rkisp1")
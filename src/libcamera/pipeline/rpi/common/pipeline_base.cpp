@@ -7,6 +7,7 @@
 
 #include "pipeline_base.h"
 
+#include <algorithm>
 #include <chrono>
 
 #include <linux/media-bus-format.h>
@@ -401,8 +402,7 @@ PipelineHandlerBase::generateConfiguration(Camera *camera, Span<const StreamRole
 		case StreamRole::Raw:
 			size = sensorSize;
 			sensorFormat = data->findBestFormat(size, defaultRawBitDepth);
-			pixelFormat = mbusCodeToPixelFormat(sensorFormat.code,
-							    BayerFormat::Packing::CSI2);
+			pixelFormat = data->platformRawFormats(sensorFormat.code).front();
 			ASSERT(pixelFormat.isValid());
 			colorSpace = ColorSpace::Raw;
 			bufferCount = 2;
@@ -458,13 +458,22 @@ PipelineHandlerBase::generateConfiguration(Camera *camera, Span<const StreamRole
 
 		std::map<PixelFormat, std::vector<SizeRange>> deviceFormats;
 		if (role == StreamRole::Raw) {
-			/* Translate the MBUS codes to a PixelFormat. */
+			/*
+			 * Translate the MBUS codes to the PixelFormats the
+			 * platform can output them in. Different MBUS codes may
+			 * translate to the same pixel format, merge their sizes.
+			 */
 			for (const auto &format : data->sensorFormats_) {
-				PixelFormat pf = mbusCodeToPixelFormat(format.first,
-								       BayerFormat::Packing::CSI2);
-				if (pf.isValid())
-					deviceFormats.emplace(std::piecewise_construct, std::forward_as_tuple(pf),
-							      std::forward_as_tuple(format.second.begin(), format.second.end()));
+				for (const PixelFormat &pf : data->platformRawFormats(format.first)) {
+					if (!pf.isValid())
+						continue;
+
+					std::vector<SizeRange> &sizes = deviceFormats[pf];
+					for (const Size &sz : format.second) {
+						if (std::find(sizes.begin(), sizes.end(), SizeRange(sz)) == sizes.end())
+							sizes.emplace_back(sz);
+					}
+				}
 			}
 		} else {
 			/*
@@ -529,6 +538,14 @@ int PipelineHandlerBase::configure(Camera *camera, CameraConfiguration *config)
 	if (ret)
 		return ret;
 
+	/*
+	 * Streams missing from a request are captured to internal buffers, so
+	 * requests without any buffer complete once the IPA has processed the
+	 * statistics of their frame. Platforms that don't allocate internal
+	 * buffers for some configurations reset the flag.
+	 */
+	data->metadataOnlyRequests_ = true;
+
 	/*
 	 * Platform specific internal stream configuration. This also assigns
 	 * external streams which get configured below.
@@ -817,15 +834,18 @@ int PipelineHandlerBase::registerCamera(std::unique_ptr<RPi::CameraData> &camera
 	 * Setup our delayed control writer with the sensor default
 	 * gain and exposure delays. Mark VBLANK for priority write.
 	 */
-	std::unordered_map<uint32_t, RPi::DelayedControls::ControlParams> params = {
+	std::unordered_map<uint32_t, DelayedControls::ControlParams> params = {
 		{ V4L2_CID_ANALOGUE_GAIN, { result.sensorConfig.gainDelay, false } },
 		{ V4L2_CID_EXPOSURE, { result.sensorConfig.exposureDelay, false } },
 		{ V4L2_CID_HBLANK, { result.sensorConfig.hblankDelay, false } },
 		{ V4L2_CID_VBLANK, { result.sensorConfig.vblankDelay, true } }
 	};
-	data->delayedCtrls_ = std::make_unique<RPi::DelayedControls>(data->sensor_->device(), params);
+	data->delayedCtrls_ = std::make_unique<DelayedControls>(data->sensor_->device(), params);
 	data->sensorMetadata_ = result.sensorConfig.sensorMetadata;
 
+	/* Sensor crop changes take effect at the same time as VBLANK changes. */
+	data->sensorCropDelay_ = result.sensorConfig.vblankDelay;
+
 	/* Register initial controls that the Raspberry Pi IPA can handle. */
 	data->controlInfo_ = std::move(result.controlInfo);
 
@@ -978,6 +998,12 @@ V4L2SubdeviceFormat CameraData::findBestFormat(const Size &req, unsigned int bit
 	return bestFormat;
 }
 
+std::vector<PixelFormat> CameraData::platformRawFormats(unsigned int mbusCode) const
+{
+	/* By default, raw streams are output CSI2 packed when possible. */
+	return { mbusCodeToPixelFormat(mbusCode, BayerFormat::Packing::CSI2) };
+}
+
 void CameraData::freeBuffers()
 {
 	if (ipa_) {
@@ -1097,6 +1123,7 @@ int CameraData::loadPipelineConfiguration()
 	config_ = {
 		.disableStartupFrameDrops = false,
 		.cameraTimeoutValue = 0,
+		.dynamicSensorCrop = false,
 	};
 
 	/* Initial configuration of the platform, in case no config file is present */
@@ -1144,6 +1171,9 @@ int CameraData::loadPipelineConfiguration()
 		frontendDevice()->setDequeueTimeout(config_.cameraTimeoutValue * 1ms);
 	}
 
+	config_.dynamicSensorCrop =
+		phConfig["dynamic_sensor_crop"].get<bool>(config_.dynamicSensorCrop);
+
 	return platformPipelineConfigure(root);
 }
 
@@ -1330,6 +1360,26 @@ void CameraData::applyScalerCrop(const ControlList &controls)
 			scalerCrops.push_back(*scalerCropCore);
 	}
 
+	/*
+	 * Move the sensor readout window if needed to cover all the requested
+	 * crops, before computing the ISP crops relative to it.
+	 */
+	if (config_.dynamicSensorCrop && !scalerCrops.empty()) {
+		int x0 = scalerCrops[0].x;
+		int y0 = scalerCrops[0].y;
+		int x1 = x0 + scalerCrops[0].width;
+		int y1 = y0 + scalerCrops[0].height;
+
+		for (const Rectangle &scalerCrop : scalerCrops) {
+			x0 = std::min(x0, scalerCrop.x);
+			y0 = std::min(y0, scalerCrop.y);
+			x1 = std::max<int>(x1, scalerCrop.x + scalerCrop.width);
+			y1 = std::max<int>(y1, scalerCrop.y + scalerCrop.height);
+		}
+
+		updateSensorCrop(Rectangle(x0, y0, x1 - x0, y1 - y0));
+	}
+
 	for (auto const &[i, scalerCrop] : utils::enumerate(scalerCrops)) {
 		Rectangle nativeCrop = scalerCrop;
 
@@ -1358,6 +1408,51 @@ void CameraData::applyScalerCrop(const ControlList &controls)
 	}
 }
 
+void CameraData::updateSensorCrop(const Rectangle &crop)
+{
+	const Rectangle analogCrop = sensorInfo_.analogCrop;
+
+	if (crop.isNull() || crop.boundedTo(analogCrop) == crop)
+		return;
+
+	/*
+	 * Move the sensor readout window, without resizing it, to centre it on
+	 * the requested crop. Applications wanting a smaller window, to lower
+	 * the bandwidth and increase the frame rate, select a cropped sensor
+	 * mode when configuring the camera.
+	 */
+	Rectangle activeArea(sensorInfo_.activeAreaSize);
+	Rectangle window = analogCrop.size().centeredTo(crop.center())
+					    .enclosedIn(activeArea);
+	if (window == analogCrop)
+		return;
+
+	int ret = sensor_->setCrop(&window);
+	if (ret || window.size() != analogCrop.size()) {
+		LOG(RPI, Warning)
+			<< "Sensor can't move its readout window while streaming, "
+			<< "disabling dynamic sensor crop";
+
+		if (!ret) {
+			Rectangle rect = analogCrop;
+			sensor_->setCrop(&rect);
+		}
+
+		config_.dynamicSensorCrop = false;
+		return;
+	}
+
+	LOG(RPI, Debug) << "Sensor readout window moved to " << window;
+
+	sensorInfo_.analogCrop = window;
+
+	/*
+	 * Drop the frames captured before the new window takes effect, as the
+	 * ISP crop is now computed relative to it.
+	 */
+	dropFrameCount_ = std::max(dropFrameCount_, sensorCropDelay_);
+}
+
 void CameraData::cameraTimeout()
 {
 	LOG(RPI, Error) << "Camera frontend has timed out!";
@@ -20,6 +20,7 @@
 #include "libcamera/internal/bayer_format.h"
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
@@ -30,7 +31,6 @@
 #include <libcamera/ipa/raspberrypi_ipa_interface.h>
 #include <libcamera/ipa/raspberrypi_ipa_proxy.h>
 
-#include "delayed_controls.h"
 #include "rpi_stream.h"
 
 using namespace std::chrono_literals;
@@ -48,7 +48,7 @@ class CameraData : public Camera::Private
 public:
 	CameraData(PipelineHandler *pipe)
 		: Camera::Private(pipe), state_(State::Stopped),
-		  dropFrameCount_(0), buffersAllocated_(false),
+		  dropFrameCount_(0), sensorCropDelay_(0), buffersAllocated_(false),
 		  ispOutputCount_(0), ispOutputTotal_(0)
 	{
 	}
@@ -83,6 +83,7 @@ public:
 
 	Rectangle scaleIspCrop(const Rectangle &ispCrop) const;
 	void applyScalerCrop(const ControlList &controls);
+	void updateSensorCrop(const Rectangle &crop);
 	virtual void platformSetIspCrop(unsigned int index, const Rectangle &ispCrop) = 0;
 
 	void cameraTimeout();
@@ -94,6 +95,7 @@ public:
 
 	virtual V4L2VideoDevice::Formats ispFormats() const = 0;
 	virtual V4L2VideoDevice::Formats rawFormats() const = 0;
+	virtual std::vector<PixelFormat> platformRawFormats(unsigned int mbusCode) const;
 	virtual V4L2VideoDevice *frontendDevice() = 0;
 
 	virtual int platformPipelineConfigure(const std::unique_ptr<YamlObject> &root) = 0;
@@ -157,6 +159,9 @@ public:
 
 	unsigned int dropFrameCount_;
 
+	/* Number of frames for a sensor crop change to take effect. */
+	unsigned int sensorCropDelay_;
+
 	/*
 	 * If set, this stores the value that represets a gain of one for
 	 * the V4L2_CID_NOTIFY_GAINS control.
@@ -177,6 +182,11 @@ public:
 		 * on frame durations.
 		 */
 		unsigned int cameraTimeoutValue;
+		/*
+		 * Move the sensor readout window while streaming when the
+		 * requested ScalerCrop falls outside of it.
+		 */
+		bool dynamicSensorCrop;
 	};
 
 	Config config_;
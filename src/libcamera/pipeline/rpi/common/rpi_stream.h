@@ -36,9 +36,14 @@ struct BufferObject {
 	BufferObject(FrameBuffer *b, bool requiresMmap)
 		: buffer(b), mapped(std::nullopt)
 	{
+		/*
+		 * The buffers are mapped for the lifetime of the stream, users
+		 * bracket CPU accesses with beginAccess() and endAccess().
+		 */
 		if (requiresMmap)
 			mapped = std::make_optional<MappedFrameBuffer>
-					(b, MappedFrameBuffer::MapFlag::ReadWrite);
+					(b, MappedFrameBuffer::MapFlag::ReadWrite |
+					    MappedFrameBuffer::MapFlag::ExplicitAccess);
 	}
 
 	FrameBuffer *buffer;
@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <fstream>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <numeric>
@@ -14,15 +15,14 @@
 #include <set>
 #include <sstream>
 #include <string>
-#include <sys/ioctl.h>
 #include <unordered_map>
 #include <vector>
 
-#include <linux/dma-buf.h>
 #include <linux/v4l2-controls.h>
 #include <linux/videodev2.h>
 
 #include <libcamera/base/shared_fd.h>
+#include <libcamera/base/thread_pool.h>
 #include <libcamera/formats.h>
 
 #include "libcamera/internal/device_enumerator.h"
@@ -293,31 +293,6 @@ void setupOutputClipping(const V4L2DeviceFormat &v4l2Format,
 	}
 }
 
-int dmabufSyncStart(const SharedFD &fd)
-{
-	struct dma_buf_sync dma_sync {};
-	dma_sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW;
-
-	int ret = ::ioctl(fd.get(), DMA_BUF_IOCTL_SYNC, &dma_sync);
-	if (ret)
-		LOG(RPI, Error) << "failed to lock-sync-write dma buf";
-
-	return ret;
-}
-
-int dmabufSyncEnd(const SharedFD &fd)
-{
-	struct dma_buf_sync dma_sync {};
-	dma_sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW;
-
-	int ret = ::ioctl(fd.get(), DMA_BUF_IOCTL_SYNC, &dma_sync);
-
-	if (ret)
-		LOG(RPI, Error) << "failed to unlock-sync-write dma buf";
-
-	return ret;
-}
-
 void do32BitConversion(void *mem, unsigned int width, unsigned int height,
 		       unsigned int stride)
 {
@@ -392,176 +367,116 @@ void do16BitEndianSwap([[maybe_unused]] void *mem, [[maybe_unused]] unsigned int
 #endif
 }
 
-void downscaleInterleaved3(void *mem, unsigned int height, unsigned int src_width,
-			   unsigned int stride)
-{
-	std::vector<uint8_t> incache(3 * src_width);
-	unsigned int dst_width = src_width / 2;
-	std::vector<uint8_t> outcache(3 * dst_width);
-
-	memcpy(incache.data(), mem, 3 * src_width);
-	for (unsigned int j = 0; j < height; j++) {
-		uint8_t *ptr = (uint8_t *)mem + j * stride;
-
-		uint8_t *src = incache.data(), *dst = outcache.data();
-		for (unsigned int i = 0; i < dst_width; i++, src += 6, dst += 3) {
-			dst[0] = ((int)src[0] + (int)src[3] + 1) >> 1;
-			dst[1] = ((int)src[1] + (int)src[4] + 1) >> 1;
-			dst[2] = ((int)src[2] + (int)src[5] + 1) >> 1;
-		}
+/*
+ * Row kernels for the software downscale-by-2. They are written without
+ * aliasing between the source and destination rows so that the compiler can
+ * vectorize them, which on arm64 maps to de-interleaving loads and rounding
+ * halving adds.
+ */
+using DownscaleRowFn = void (*)(const uint8_t *__restrict src,
+				uint8_t *__restrict dst, unsigned int dst_width);
 
-		if (j < height - 1)
-			memcpy(incache.data(), ptr + stride, 3 * src_width);
-		memcpy(ptr, outcache.data(), 3 * dst_width);
-	}
+inline uint8_t average(uint8_t a, uint8_t b)
+{
+	return (static_cast<unsigned int>(a) + b + 1) >> 1;
 }
 
-void downscaleInterleaved4(void *mem, unsigned int height, unsigned int src_width,
-			   unsigned int stride)
+void downscaleRow1(const uint8_t *__restrict src, uint8_t *__restrict dst,
+		   unsigned int dst_width)
 {
-	std::vector<uint8_t> incache(4 * src_width);
-	unsigned int dst_width = src_width / 2;
-	std::vector<uint8_t> outcache(4 * dst_width);
-
-	memcpy(incache.data(), mem, 4 * src_width);
-	for (unsigned int j = 0; j < height; j++) {
-		uint8_t *ptr = (uint8_t *)mem + j * stride;
-
-		uint8_t *src = incache.data(), *dst = outcache.data();
-		for (unsigned int i = 0; i < dst_width; i++, src += 8, dst += 4) {
-			dst[0] = ((int)src[0] + (int)src[4] + 1) >> 1;
-			dst[1] = ((int)src[1] + (int)src[5] + 1) >> 1;
-			dst[2] = ((int)src[2] + (int)src[6] + 1) >> 1;
-			dst[3] = ((int)src[3] + (int)src[7] + 1) >> 1;
-		}
-
-		if (j < height - 1)
-			memcpy(incache.data(), ptr + stride, 4 * src_width);
-		memcpy(ptr, outcache.data(), 4 * dst_width);
-	}
+	for (unsigned int i = 0; i < dst_width; i++)
+		dst[i] = average(src[2 * i], src[2 * i + 1]);
 }
 
-void downscalePlaneInternal(void *mem, unsigned int height, unsigned int src_width,
-			    unsigned int stride, std::vector<uint8_t> &incache,
-			    std::vector<uint8_t> &outcache)
+void downscaleRow2(const uint8_t *__restrict src, uint8_t *__restrict dst,
+		   unsigned int dst_width)
 {
-	unsigned int dst_width = src_width / 2;
-	memcpy(incache.data(), mem, src_width);
-	for (unsigned int j = 0; j < height; j++) {
-		uint8_t *ptr = (uint8_t *)mem + j * stride;
-
-		uint8_t *src = incache.data(), *dst = outcache.data();
-		for (unsigned int i = 0; i < dst_width; i++, src += 2, dst++)
-			*dst = ((int)src[0] + (int)src[1] + 1) >> 1;
-
-		if (j < height - 1)
-			memcpy(incache.data(), ptr + stride, src_width);
-		memcpy(ptr, outcache.data(), dst_width);
+	for (unsigned int i = 0; i < dst_width; i++) {
+		dst[2 * i + 0] = average(src[4 * i + 0], src[4 * i + 2]);
+		dst[2 * i + 1] = average(src[4 * i + 1], src[4 * i + 3]);
 	}
 }
 
-void downscalePlanar420(void *memY, void *memU, void *memV, unsigned int height,
-			unsigned int src_width, unsigned int stride)
+void downscaleRow3(const uint8_t *__restrict src, uint8_t *__restrict dst,
+		   unsigned int dst_width)
 {
-	std::vector<uint8_t> incache(src_width);
-	std::vector<uint8_t> outcache(src_width / 2);
-
-	downscalePlaneInternal(memY, height, src_width, stride, incache, outcache);
-	downscalePlaneInternal(memU, height / 2, src_width / 2, stride / 2, incache, outcache);
-	downscalePlaneInternal(memV, height / 2, src_width / 2, stride / 2, incache, outcache);
+	for (unsigned int i = 0; i < dst_width; i++) {
+		dst[3 * i + 0] = average(src[6 * i + 0], src[6 * i + 3]);
+		dst[3 * i + 1] = average(src[6 * i + 1], src[6 * i + 4]);
+		dst[3 * i + 2] = average(src[6 * i + 2], src[6 * i + 5]);
+	}
 }
 
-void downscalePlanar422(void *memY, void *memU, void *memV,
-			unsigned int height, unsigned int src_width, unsigned int stride)
+void downscaleRow4(const uint8_t *__restrict src, uint8_t *__restrict dst,
+		   unsigned int dst_width)
 {
-	std::vector<uint8_t> incache(src_width);
-	std::vector<uint8_t> outcache(src_width / 2);
-
-	downscalePlaneInternal(memY, height, src_width, stride, incache, outcache);
-	downscalePlaneInternal(memU, height, src_width / 2, stride / 2, incache, outcache);
-	downscalePlaneInternal(memV, height, src_width / 2, stride / 2, incache, outcache);
+	for (unsigned int i = 0; i < dst_width; i++) {
+		dst[4 * i + 0] = average(src[8 * i + 0], src[8 * i + 4]);
+		dst[4 * i + 1] = average(src[8 * i + 1], src[8 * i + 5]);
+		dst[4 * i + 2] = average(src[8 * i + 2], src[8 * i + 6]);
+		dst[4 * i + 3] = average(src[8 * i + 3], src[8 * i + 7]);
+	}
 }
 
-void downscaleInterleavedYuyv(void *mem, unsigned int height, unsigned int src_width,
-			      unsigned int stride)
+/* Downscale a row of packed YUYV (or YVYU) pixels, two pixels at a time. */
+void downscaleRowYuyv(const uint8_t *__restrict src, uint8_t *__restrict dst,
+		      unsigned int dst_width)
 {
-	std::vector<uint8_t> incache(2 * src_width);
-	unsigned int dst_width = src_width / 2;
-	std::vector<uint8_t> outcache(2 * dst_width);
-
-	memcpy(incache.data(), mem, 2 * src_width);
-	for (unsigned int j = 0; j < height; j++) {
-		uint8_t *ptr = (uint8_t *)mem + j * stride;
-
-		uint8_t *src = incache.data(), *dst = outcache.data();
-		for (unsigned int i = 0; i < dst_width; i++, src += 8, dst += 4) {
-			dst[0] = ((int)src[0] + (int)src[2] + 1) >> 1;
-			dst[1] = ((int)src[1] + (int)src[5] + 1) >> 1;
-			dst[2] = ((int)src[4] + (int)src[6] + 1) >> 1;
-			dst[3] = ((int)src[3] + (int)src[7] + 1) >> 1;
-		}
-
-		if (j < height - 1)
-			memcpy(incache.data(), ptr + stride, 4 * src_width);
-		memcpy(ptr, outcache.data(), 2 * dst_width);
+	for (unsigned int i = 0; i < dst_width / 2; i++) {
+		dst[4 * i + 0] = average(src[8 * i + 0], src[8 * i + 2]);
+		dst[4 * i + 1] = average(src[8 * i + 1], src[8 * i + 5]);
+		dst[4 * i + 2] = average(src[8 * i + 4], src[8 * i + 6]);
+		dst[4 * i + 3] = average(src[8 * i + 3], src[8 * i + 7]);
 	}
 }
 
-void downscaleInterleavedUyvy(void *mem, unsigned int height, unsigned int src_width,
-			      unsigned int stride)
+/* Downscale a row of packed UYVY (or VYUY) pixels, two pixels at a time. */
+void downscaleRowUyvy(const uint8_t *__restrict src, uint8_t *__restrict dst,
+		      unsigned int dst_width)
 {
-	std::vector<uint8_t> incache(2 * src_width);
-	unsigned int dst_width = src_width / 2;
-	std::vector<uint8_t> outcache(2 * dst_width);
-
-	memcpy(incache.data(), mem, 2 * src_width);
-	for (unsigned int j = 0; j < height; j++) {
-		uint8_t *ptr = (uint8_t *)mem + j * stride;
-
-		uint8_t *src = incache.data(), *dst = outcache.data();
-		for (unsigned int i = 0; i < dst_width; i++, src += 8, dst += 4) {
-			dst[0] = ((int)src[0] + (int)src[4] + 1) >> 1;
-			dst[1] = ((int)src[1] + (int)src[3] + 1) >> 1;
-			dst[2] = ((int)src[2] + (int)src[6] + 1) >> 1;
-			dst[3] = ((int)src[5] + (int)src[7] + 1) >> 1;
-		}
-
-		if (j < height - 1)
-			memcpy(incache.data(), ptr + stride, 4 * src_width);
-		memcpy(ptr, outcache.data(), 2 * dst_width);
+	for (unsigned int i = 0; i < dst_width / 2; i++) {
+		dst[4 * i + 0] = average(src[8 * i + 0], src[8 * i + 4]);
+		dst[4 * i + 1] = average(src[8 * i + 1], src[8 * i + 3]);
+		dst[4 * i + 2] = average(src[8 * i + 2], src[8 * i + 6]);
+		dst[4 * i + 3] = average(src[8 * i + 5], src[8 * i + 7]);
 	}
 }
 
-void downscaleInterleaved2Internal(void *mem, unsigned int height, unsigned int src_width,
-				   unsigned int stride, std::vector<uint8_t> &incache,
-				   std::vector<uint8_t> &outcache)
+/* Minimum number of rows processed by a downscale task. */
+constexpr unsigned int kDownscaleMinRows = 32;
+
+/*
+ * Downscale by 2 in place, horizontally, all rows of a plane. The rows are
+ * independent and are split in bands processed concurrently by the tasks of
+ * the \a group. Each row is copied to a cached buffer before being processed,
+ * as the output buffers may not be cached.
+ */
+void downscalePlane(TaskGroup &group, void *mem, unsigned int height,
+		    unsigned int src_width, unsigned int stride,
+		    unsigned int bytesPerPixel, DownscaleRowFn downscaleRow)
 {
-	unsigned int dst_width = src_width / 2;
-	memcpy(incache.data(), mem, 2 * src_width);
-	for (unsigned int j = 0; j < height; j++) {
-		uint8_t *ptr = (uint8_t *)mem + j * stride;
+	const unsigned int dst_width = src_width / 2;
+	const unsigned int bands =
+		std::clamp(height / kDownscaleMinRows, 1U,
+			   ThreadPool::instance()->size() + 1);
 
-		uint8_t *src = incache.data(), *dst = outcache.data();
-		for (unsigned int i = 0; i < dst_width; i++, src += 4, dst += 2) {
-			dst[0] = ((int)src[0] + (int)src[2] + 1) >> 1;
-			dst[1] = ((int)src[1] + (int)src[3] + 1) >> 1;
-		}
+	for (unsigned int band = 0; band < bands; band++) {
+		unsigned int first = height * band / bands;
+		unsigned int last = height * (band + 1) / bands;
 
-		if (j < height - 1)
-			memcpy(incache.data(), ptr + stride, 2 * src_width);
-		memcpy(ptr, outcache.data(), 2 * dst_width);
-	}
-}
+		group.run([=]() {
+			std::vector<uint8_t> incache(bytesPerPixel * src_width);
+			std::vector<uint8_t> outcache(bytesPerPixel * dst_width);
 
-void downscaleSemiPlanar420(void *memY, void *memUV, unsigned int height,
-			    unsigned int src_width, unsigned int stride)
-{
-	std::vector<uint8_t> incache(src_width);
-	std::vector<uint8_t> outcache(src_width / 2);
+			for (unsigned int j = first; j < last; j++) {
+				uint8_t *ptr = static_cast<uint8_t *>(mem) + j * stride;
 
-	downscalePlaneInternal(memY, height, src_width, stride, incache, outcache);
-	downscaleInterleaved2Internal(memUV, height / 2, src_width / 2, stride,
-				      incache, outcache);
+				memcpy(incache.data(), ptr, incache.size());
+				downscaleRow(incache.data(), outcache.data(), dst_width);
+				memcpy(ptr, outcache.data(), outcache.size());
+			}
+		});
+	}
 }
 
 void downscaleStreamBuffer(RPi::Stream *stream, int index)
@@ -581,29 +496,24 @@ void downscaleStreamBuffer(RPi::Stream *stream, int index)
 	/* Do repeated downscale-by-2 in place until we're done. */
 	for (; downscale > 1; downscale >>= 1) {
 		unsigned int src_width = downscale * dst_width;
+		TaskGroup group;
 
 		if (pixFormat == formats::RGB888 || pixFormat == formats::BGR888) {
-			downscaleInterleaved3(mem, height, src_width, stride);
+			downscalePlane(group, mem, height, src_width, stride, 3,
+				       downscaleRow3);
 		} else if (pixFormat == formats::XRGB8888 || pixFormat == formats::XBGR8888) {
 			/* On some devices these may actually be 24bpp at this point. */
 			if (stream->getFlags() & StreamFlag::Needs32bitConv)
-				downscaleInterleaved3(mem, height, src_width, stride);
+				downscalePlane(group, mem, height, src_width, stride, 3,
+					       downscaleRow3);
 			else
-				downscaleInterleaved4(mem, height, src_width, stride);
-		} else if (pixFormat == formats::YUV420 || pixFormat == formats::YVU420) {
-			/* These may look like either single or multi-planar buffers. */
-			void *mem1;
-			void *mem2;
-			if (b.mapped->planes().size() == 3) {
-				mem1 = b.mapped->planes()[1].data();
-				mem2 = b.mapped->planes()[2].data();
-			} else {
-				unsigned int ySize = height * stride;
-				mem1 = static_cast<uint8_t *>(mem) + ySize;
-				mem2 = static_cast<uint8_t *>(mem1) + ySize / 4;
-			}
-			downscalePlanar420(mem, mem1, mem2, height, src_width, stride);
-		} else if (pixFormat == formats::YUV422 || pixFormat == formats::YVU422) {
+				downscalePlane(group, mem, height, src_width, stride, 4,
+					       downscaleRow4);
+		} else if (pixFormat == formats::YUV420 || pixFormat == formats::YVU420 ||
+			   pixFormat == formats::YUV422 || pixFormat == formats::YVU422) {
+			bool is420 = pixFormat == formats::YUV420 || pixFormat == formats::YVU420;
+			unsigned int chromaHeight = is420 ? height / 2 : height;
+
 			/* These may look like either single or multi-planar buffers. */
 			void *mem1;
 			void *mem2;
@@ -613,13 +523,21 @@ void downscaleStreamBuffer(RPi::Stream *stream, int index)
 			} else {
 				unsigned int ySize = height * stride;
 				mem1 = static_cast<uint8_t *>(mem) + ySize;
-				mem2 = static_cast<uint8_t *>(mem1) + ySize / 2;
+				mem2 = static_cast<uint8_t *>(mem1) + chromaHeight * stride / 2;
 			}
-			downscalePlanar422(mem, mem1, mem2, height, src_width, stride);
+
+			downscalePlane(group, mem, height, src_width, stride, 1,
+				       downscaleRow1);
+			downscalePlane(group, mem1, chromaHeight, src_width / 2,
+				       stride / 2, 1, downscaleRow1);
+			downscalePlane(group, mem2, chromaHeight, src_width / 2,
+				       stride / 2, 1, downscaleRow1);
 		} else if (pixFormat == formats::YUYV || pixFormat == formats::YVYU) {
-			downscaleInterleavedYuyv(mem, height, src_width, stride);
+			downscalePlane(group, mem, height, src_width, stride, 2,
+				       downscaleRowYuyv);
 		} else if (pixFormat == formats::UYVY || pixFormat == formats::VYUY) {
-			downscaleInterleavedUyvy(mem, height, src_width, stride);
+			downscalePlane(group, mem, height, src_width, stride, 2,
+				       downscaleRowUyvy);
 		} else if (pixFormat == formats::NV12 || pixFormat == formats::NV21) {
 			/* These may look like either single or multi-planar buffers. */
 			void *mem1;
@@ -627,11 +545,18 @@ void downscaleStreamBuffer(RPi::Stream *stream, int index)
 				mem1 = b.mapped->planes()[1].data();
 			else
 				mem1 = static_cast<uint8_t *>(mem) + height * stride;
-			downscaleSemiPlanar420(mem, mem1, height, src_width, stride);
+
+			downscalePlane(group, mem, height, src_width, stride, 1,
+				       downscaleRow1);
+			downscalePlane(group, mem1, height / 2, src_width / 2, stride,
+				       2, downscaleRow2);
 		} else {
 			LOG(RPI, Error) << "Sw downscale unsupported for " << pixFormat;
 			ASSERT(0);
 		}
+
+		/* The next downscale step reads the output of this one. */
+		group.wait();
 	}
 }
 
@@ -684,11 +609,111 @@ unsigned int calculateSwDownscale(const V4L2DeviceFormat &format, unsigned int l
 using ::libpisp::BackEnd;
 using ::libpisp::FrontEnd;
 
+class PiSPCameraData;
+
+/*
+ * The Back End hardware is shared by all the cameras of the pipeline handler,
+ * and the kernel processes jobs in the order they are queued. The
+ * BackEndScheduler arbitrates the Back End between cameras: it limits the
+ * number of jobs queued to the kernel, and when the Back End is busy, picks the
+ * next job by camera priority and then by earliest deadline. Deadlines are the
+ * time at which the next frame of the camera is expected, cameras running at a
+ * higher frame rate thus get their jobs processed first.
+ *
+ * Each camera has at most one Back End job in flight. All functions are called
+ * from the pipeline handler thread.
+ */
+class BackEndScheduler
+{
+public:
+	BackEndScheduler()
+		: sequence_(0)
+	{
+	}
+
+	void submit(PiSPCameraData *camera, int priority, uint64_t deadline,
+		    std::function<void()> run);
+	void complete(PiSPCameraData *camera);
+	void cancel(PiSPCameraData *camera);
+
+private:
+	/*
+	 * Maximum number of jobs queued to the kernel. A single job keeps the
+	 * arbitration in userspace, at the cost of a short idle time of the Back
+	 * End between jobs of different cameras.
+	 */
+	static constexpr unsigned int kQueueDepth = 1;
+
+	struct Job {
+		PiSPCameraData *camera;
+		int priority;
+		uint64_t deadline;
+		uint64_t sequence;
+		std::function<void()> run;
+	};
+
+	void dispatch();
+
+	std::vector<Job> pending_;
+	std::vector<PiSPCameraData *> running_;
+	uint64_t sequence_;
+};
+
+void BackEndScheduler::submit(PiSPCameraData *camera, int priority,
+			      uint64_t deadline, std::function<void()> run)
+{
+	pending_.push_back({ camera, priority, deadline, sequence_++, std::move(run) });
+	dispatch();
+}
+
+void BackEndScheduler::complete(PiSPCameraData *camera)
+{
+	auto it = std::find(running_.begin(), running_.end(), camera);
+	if (it == running_.end())
+		return;
+
+	running_.erase(it);
+	dispatch();
+}
+
+void BackEndScheduler::cancel(PiSPCameraData *camera)
+{
+	pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+				      [camera](const Job &job) { return job.camera == camera; }),
+		       pending_.end());
+	complete(camera);
+}
+
+void BackEndScheduler::dispatch()
+{
+	while (!pending_.empty() && running_.size() < kQueueDepth) {
+		auto next = std::min_element(pending_.begin(), pending_.end(),
+					     [](const Job &a, const Job &b) {
+						     if (a.priority != b.priority)
+							     return a.priority > b.priority;
+						     if (a.deadline != b.deadline)
+							     return a.deadline < b.deadline;
+						     return a.sequence < b.sequence;
+					     });
+
+		Job job = std::move(*next);
+		pending_.erase(next);
+
+		running_.push_back(job.camera);
+		job.run();
+	}
+
+	if (!pending_.empty())
+		LOG(RPI, Debug) << pending_.size() << " Back End job(s) waiting";
+}
+
 class PiSPCameraData final : public RPi::CameraData
 {
 public:
 	PiSPCameraData(PipelineHandler *pipe, const libpisp::PiSPVariant &variant)
-		: RPi::CameraData(pipe), pispVariant_(variant)
+		: RPi::CameraData(pipe), pispVariant_(variant),
+		  beScheduler_(nullptr), lastFrameTimestamp_(0), frameInterval_(0),
+		  rawCompressionMode_(0)
 	{
 		/* Initialise internal libpisp logging. */
 		::libpisp::logging_init();
@@ -715,6 +740,27 @@ public:
 		return cfe_[Cfe::Output0].dev();
 	}
 
+	std::vector<PixelFormat> platformRawFormats(unsigned int mbusCode) const override
+	{
+		/*
+		 * The frontend outputs 16-bit samples only, either compressed
+		 * or unpacked. Prefer the compressed format, which halves the
+		 * memory bandwidth.
+		 */
+		BayerFormat bayer = BayerFormat::fromMbusCode(mbusCode);
+		bayer.bitDepth = 16;
+
+		bayer.packing = BayerFormat::Packing::PISP1;
+		PixelFormat compressed = bayer.toPixelFormat();
+		bayer.packing = BayerFormat::Packing::None;
+		PixelFormat unpacked = bayer.toPixelFormat();
+
+		if (!compressed.isValid())
+			return { unpacked };
+
+		return { compressed, unpacked };
+	}
+
 	CameraConfiguration::Status
 	platformValidate(RPi::RPiCameraConfiguration *rpiConfig) const override;
 
@@ -738,6 +784,13 @@ public:
 
 	const libpisp::PiSPVariant &pispVariant_;
 
+	BackEndScheduler *beScheduler_;
+	/* Timestamp of the last CFE frame, and interval between CFE frames. */
+	uint64_t lastFrameTimestamp_;
+	uint64_t frameInterval_;
+	/* Compression mode of the raw stream returned to the application. */
+	int32_t rawCompressionMode_;
+
 	/* Frontend/Backend objects shared with the IPA. */
 	SharedMemObject<FrontEnd> fe_;
 	SharedMemObject<BackEnd> be_;
@@ -767,6 +820,11 @@ public:
 		bool disableTdn;
 		/* Don't use BE HDR and free some memory resources. */
 		bool disableHdr;
+		/*
+		 * Priority of the camera when multiple cameras share the BE.
+		 * Jobs of cameras with a higher priority are run first.
+		 */
+		int bePriority;
 	};
 
 	Config config_;
@@ -842,6 +900,8 @@ private:
 	int prepareBuffers(Camera *camera) override;
 	int platformRegister(std::unique_ptr<RPi::CameraData> &cameraData,
 			     MediaDevice *cfe, MediaDevice *isp) override;
+
+	BackEndScheduler beScheduler_;
 };
 
 bool PipelineHandlerPiSP::match(DeviceEnumerator *enumerator)
@@ -906,6 +966,8 @@ bool PipelineHandlerPiSP::match(DeviceEnumerator *enumerator)
 			PiSPCameraData *pisp =
 				static_cast<PiSPCameraData *>(cameraData.get());
 
+			pisp->beScheduler_ = &beScheduler_;
+
 			pisp->fe_ = SharedMemObject<FrontEnd>
 					("pisp_frontend", true, pisp->pispVariant_);
 			pisp->be_ = SharedMemObject<BackEnd>
@@ -1313,6 +1375,7 @@ int PiSPCameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject>
 		.numCfeConfigQueue = 2,
 		.disableTdn = false,
 		.disableHdr = false,
+		.bePriority = 0,
 	};
 
 	if (!root)
@@ -1338,6 +1401,7 @@ int PiSPCameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject>
 		phConfig["num_cfe_config_queue"].get<unsigned int>(config_.numCfeConfigQueue);
 	config_.disableTdn = phConfig["disable_tdn"].get<bool>(config_.disableTdn);
 	config_.disableHdr = phConfig["disable_hdr"].get<bool>(config_.disableHdr);
+	config_.bePriority = phConfig["be_priority"].get<int>(config_.bePriority);
 
 	if (config_.disableTdn) {
 		LOG(RPI, Info) << "TDN disabled by user config";
@@ -1631,6 +1695,8 @@ void PiSPCameraData::platformStart()
 	stitchInputIndex_ = 0;
 
 	cfeJobQueue_ = {};
+	lastFrameTimestamp_ = 0;
+	frameInterval_ = 0;
 
 	for (unsigned int i = 0; i < config_.numCfeConfigQueue; i++)
 		prepareCfe();
@@ -1642,6 +1708,7 @@ void PiSPCameraData::platformStart()
 void PiSPCameraData::platformStop()
 {
 	cfeJobQueue_ = {};
+	beScheduler_->cancel(this);
 }
 
 void PiSPCameraData::platformFreeBuffers()
@@ -1682,6 +1749,12 @@ void PiSPCameraData::cfeBufferDequeue(FrameBuffer *buffer)
 	job.buffers[stream] = buffer;
 
 	if (stream == &cfe_[Cfe::Output0]) {
+		/* Track the frame interval to compute the BE job deadlines. */
+		uint64_t timestamp = buffer->metadata().timestamp;
+		if (lastFrameTimestamp_ && timestamp > lastFrameTimestamp_)
+			frameInterval_ = timestamp - lastFrameTimestamp_;
+		lastFrameTimestamp_ = timestamp;
+
 		/* Do an endian swap if needed. */
 		if (stream->getFlags() & StreamFlag::Needs16bitEndianSwap) {
 			const unsigned int stride = stream->configuration().stride;
@@ -1692,16 +1765,18 @@ void PiSPCameraData::cfeBufferDequeue(FrameBuffer *buffer)
 			ASSERT(b.mapped);
 			void *mem = b.mapped->planes()[0].data();
 
-			dmabufSyncStart(buffer->planes()[0].fd);
+			b.mapped->beginAccess(MappedFrameBuffer::MapFlag::ReadWrite);
 			do16BitEndianSwap(mem, width, height, stride);
-			dmabufSyncEnd(buffer->planes()[0].fd);
+			b.mapped->endAccess();
 		}
 
 		/*
 		 * Lookup the sensor controls used for this frame sequence from
 		 * DelayedControl and queue them along with the frame buffer.
 		 */
-		auto [ctrl, delayContext] = delayedCtrls_->get(buffer->metadata().sequence);
+		unsigned int delayContext;
+		ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence,
+						      &delayContext);
 		/*
 		 * Add the frame timestamp to the ControlList for the IPA to use
 		 * as it does not receive the FrameBuffer object.
@@ -1757,9 +1832,12 @@ void PiSPCameraData::beOutputDequeue(FrameBuffer *buffer)
 
 	bool downscale = stream->swDownscale() > 1;
 	bool needs32bitConv = !!(stream->getFlags() & StreamFlag::Needs32bitConv);
+	const RPi::BufferObject &b = stream->getBuffer(index);
 
-	if (downscale || needs32bitConv)
-		dmabufSyncStart(buffer->planes()[0].fd);
+	if (downscale || needs32bitConv) {
+		ASSERT(b.mapped);
+		b.mapped->beginAccess(MappedFrameBuffer::MapFlag::ReadWrite);
+	}
 
 	if (downscale) {
 		/* Further software downscaling must be applied. */
@@ -1772,15 +1850,12 @@ void PiSPCameraData::beOutputDequeue(FrameBuffer *buffer)
 		unsigned int width = stream->configuration().size.width;
 		unsigned int height = stream->configuration().size.height;
 
-		const RPi::BufferObject &b = stream->getBuffer(index);
-
-		ASSERT(b.mapped);
 		void *mem = b.mapped->planes()[0].data();
 		do32BitConversion(mem, width, height, stride);
 	}
 
 	if (downscale || needs32bitConv)
-		dmabufSyncEnd(buffer->planes()[0].fd);
+		b.mapped->endAccess();
 
 	handleStreamBuffer(buffer, stream);
 
@@ -1789,6 +1864,11 @@ void PiSPCameraData::beOutputDequeue(FrameBuffer *buffer)
 	 * This is needed to track dropped frames.
 	 */
 	ispOutputCount_++;
+
+	/* Let the next BE job run once all outputs of this one are done. */
+	if (ispOutputCount_ == ispOutputTotal_)
+		beScheduler_->complete(this);
+
 	handleState();
 }
 
@@ -1837,8 +1917,22 @@ void PiSPCameraData::prepareIspComplete(const ipa::RPi::BufferIds &buffers, bool
 		ispOutputCount_ = ispOutputTotal_;
 		buffer = cfe_[Cfe::Output0].getBuffers().at(bayerId).buffer;
 		handleStreamBuffer(buffer, &cfe_[Cfe::Output0]);
-	} else
-		prepareBe(bayerId, stitchSwapBuffers);
+	} else {
+		/*
+		 * The BE job may be deferred by the scheduler, reset the output
+		 * count now so that the outputs of the previous job are not
+		 * taken into account.
+		 */
+		ispOutputCount_ = 0;
+
+		buffer = cfe_[Cfe::Output0].getBuffers().at(bayerId).buffer;
+		uint64_t deadline = buffer->metadata().timestamp + frameInterval_;
+
+		beScheduler_->submit(this, config_.bePriority, deadline,
+				     [this, bayerId, stitchSwapBuffers]() {
+					     prepareBe(bayerId, stitchSwapBuffers);
+				     });
+	}
 
 	state_ = State::IpaComplete;
 	handleState();
@@ -1854,6 +1948,7 @@ int PiSPCameraData::configureCfe()
 	pisp_fe_global_config global;
 	fe_->GetGlobal(global);
 	global.enables &= ~PISP_FE_ENABLE_COMPRESS0;
+	rawCompressionMode_ = 0;
 
 	global.enables |= PISP_FE_ENABLE_OUTPUT0;
 	global.bayer_order = toPiSPBayerOrder(cfeFormat.fourcc);
@@ -1872,6 +1967,9 @@ int PiSPCameraData::configureCfe()
 					PISP_IMAGE_FORMAT_COMPRESSION_MODE_1;
 		global.enables |= PISP_FE_ENABLE_COMPRESS0;
 		fe_->SetCompress(0, compress);
+
+		if (cfe_[Cfe::Output0].getFlags() & StreamFlag::External)
+			rawCompressionMode_ = compress.mode;
 	}
 
 	if (input.format.width > pispVariant_.FrontEndDownscalerMaxWidth(0, 0))
@@ -2179,7 +2277,9 @@ void PiSPCameraData::prepareCfe()
 	{
 		std::scoped_lock<FrontEnd> l(*fe_);
 		Span<uint8_t> configBuffer = config.mapped->planes()[0];
+		config.mapped->beginAccess(MappedFrameBuffer::MapFlag::Write);
 		fe_->Prepare(reinterpret_cast<pisp_fe_config *>(configBuffer.data()));
+		config.mapped->endAccess();
 	}
 
 	config.buffer->_d()->metadata().planes()[0].bytesused = sizeof(pisp_fe_config);
@@ -2188,8 +2288,6 @@ void PiSPCameraData::prepareCfe()
 
 void PiSPCameraData::prepareBe(uint32_t bufferId, bool stitchSwapBuffers)
 {
-	ispOutputCount_ = 0;
-
 	FrameBuffer *buffer = cfe_[Cfe::Output0].getBuffers().at(bufferId).buffer;
 
 	LOG(RPI, Debug) << "Input re-queue to ISP, buffer id " << bufferId
@@ -2217,6 +2315,16 @@ void PiSPCameraData::prepareBe(uint32_t bufferId, bool stitchSwapBuffers)
 
 	Span<uint8_t> configBufferSpan = config.mapped->planes()[0];
 	pisp_be_tiles_config *configBuffer = reinterpret_cast<pisp_be_tiles_config *>(configBufferSpan.data());
+
+	/*
+	 * The tiling is cached by libpisp and only recomputed when the BE
+	 * geometry changes, which happens in configureBe() and, through
+	 * SetCrop(), in platformSetIspCrop(). The latter is only called by
+	 * applyScalerCrop() when the ISP crop changes. Prepare() thus only
+	 * copies the cached tiles to the config buffer, which is required as
+	 * config buffers are recycled and each job needs a complete config.
+	 */
+	config.mapped->beginAccess(MappedFrameBuffer::MapFlag::ReadWrite);
 	be_->Prepare(configBuffer);
 
 	/*
@@ -2238,6 +2346,8 @@ void PiSPCameraData::prepareBe(uint32_t bufferId, bool stitchSwapBuffers)
 		}
 	}
 
+	config.mapped->endAccess();
+
 	isp_[Isp::Config].queueBuffer(config.buffer);
 }
 
@@ -2263,6 +2373,17 @@ void PiSPCameraData::tryRunPipeline()
 	request->metadata().clear();
 	fillRequestMetadata(job.sensorControls, request);
 
+	/*
+	 * Report how the raw stream is compressed, for applications to
+	 * decompress it.
+	 */
+	if (rawCompressionMode_) {
+		request->metadata().set(controls::rpi::PispRawCompressionMode,
+					rawCompressionMode_);
+		request->metadata().set(controls::rpi::PispRawCompressionOffset,
+					DefaultCompressionOffset);
+	}
+
 	/* Set our state to say the pipeline is active. */
 	state_ = State::Busy;
 
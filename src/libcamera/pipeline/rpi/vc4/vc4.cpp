@@ -5,10 +5,15 @@
  * Pipeline handler for VC4-based Raspberry Pi devices
  */
 
+#include <chrono>
+#include <map>
+
 #include <linux/bcm2835-isp.h>
 #include <linux/v4l2-controls.h>
 #include <linux/videodev2.h>
 
+#include <libcamera/base/timer.h>
+
 #include <libcamera/formats.h>
 
 #include "libcamera/internal/device_enumerator.h"
@@ -37,8 +42,10 @@ class Vc4CameraData final : public RPi::CameraData
 {
 public:
 	Vc4CameraData(PipelineHandler *pipe)
-		: RPi::CameraData(pipe)
+		: RPi::CameraData(pipe), lastBayerTimestamp_(0),
+		  embeddedTimedOut_(nullptr)
 	{
+		embeddedTimer_.timeout.connect(this, &Vc4CameraData::embeddedDataTimeout);
 	}
 
 	~Vc4CameraData()
@@ -114,6 +121,13 @@ public:
 		 * Output 0 stream, if it has been configured.
 		 */
 		bool output0MandatoryStream;
+		/*
+		 * The time (in ms) to wait for the embedded data buffer matching
+		 * a Bayer frame before running the ISP without it. The IPA then
+		 * falls back to the sensor controls used for the frame. A value
+		 * of 0 waits for the embedded data buffer indefinitely.
+		 */
+		unsigned int embeddedDataTimeoutMs;
 	};
 
 	Config config_;
@@ -141,9 +155,18 @@ private:
 
 	void tryRunPipeline() override;
 	bool findMatchingBuffers(BayerFrame &bayerFrame, FrameBuffer *&embeddedBuffer);
+	void returnEmbeddedBuffers(uint64_t timestamp);
+	void embeddedDataTimeout();
 
 	std::queue<BayerFrame> bayerQueue_;
-	std::queue<FrameBuffer *> embeddedQueue_;
+	/* Embedded data buffers waiting for a Bayer frame, by timestamp. */
+	std::map<uint64_t, FrameBuffer *> embeddedBuffers_;
+	/* Timestamp of the last Bayer frame passed to the IPA. */
+	uint64_t lastBayerTimestamp_;
+
+	Timer embeddedTimer_;
+	/* Bayer frame for which the wait for embedded data has timed out. */
+	FrameBuffer *embeddedTimedOut_;
 };
 
 class PipelineHandlerVc4 : public RPi::PipelineHandlerBase
@@ -546,6 +569,7 @@ int Vc4CameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject> &
 		.minTotalUnicamBuffers = 4,
 		.rawMandatoryStream = false,
 		.output0MandatoryStream = false,
+		.embeddedDataTimeoutMs = 0,
 	};
 
 	if (!root)
@@ -573,6 +597,8 @@ int Vc4CameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject> &
 		phConfig["raw_mandatory_stream"].get<bool>(config_.rawMandatoryStream);
 	config_.output0MandatoryStream =
 		phConfig["output0_mandatory_stream"].get<bool>(config_.output0MandatoryStream);
+	config_.embeddedDataTimeoutMs =
+		phConfig["embedded_data_timeout_ms"].get<unsigned int>(config_.embeddedDataTimeoutMs);
 
 	if (config_.minTotalUnicamBuffers < config_.minUnicamBuffers) {
 		LOG(RPI, Error) << "Invalid configuration: min_total_unicam_buffers must be >= min_unicam_buffers";
@@ -596,6 +622,13 @@ int Vc4CameraData::platformConfigure(const RPi::RPiCameraConfiguration *rpiConfi
 	V4L2VideoDevice *unicam = unicam_[Unicam::Image].dev();
 	V4L2DeviceFormat unicamFormat;
 
+	/*
+	 * Mandatory streams may be left without internal buffers, requests
+	 * then need to provide buffers for them.
+	 */
+	if (config_.rawMandatoryStream || config_.output0MandatoryStream)
+		metadataOnlyRequests_ = false;
+
 	/*
 	 * See which streams are requested, and route the user
 	 * StreamConfiguration appropriately.
@@ -795,12 +828,15 @@ int Vc4CameraData::platformConfigureIpa(ipa::RPi::ConfigParams &params)
 
 void Vc4CameraData::platformStart()
 {
+	lastBayerTimestamp_ = 0;
+	embeddedTimedOut_ = nullptr;
 }
 
 void Vc4CameraData::platformStop()
 {
+	embeddedTimer_.stop();
 	bayerQueue_ = {};
-	embeddedQueue_ = {};
+	embeddedBuffers_.clear();
 }
 
 void Vc4CameraData::unicamBufferDequeue(FrameBuffer *buffer)
@@ -831,15 +867,25 @@ void Vc4CameraData::unicamBufferDequeue(FrameBuffer *buffer)
 		 * Lookup the sensor controls used for this frame sequence from
 		 * DelayedControl and queue them along with the frame buffer.
 		 */
-		auto [ctrl, delayContext] = delayedCtrls_->get(buffer->metadata().sequence);
+		unsigned int delayContext;
+		ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence,
+						      &delayContext);
 		/*
 		 * Add the frame timestamp to the ControlList for the IPA to use
 		 * as it does not receive the FrameBuffer object.
 		 */
 		ctrl.set(controls::SensorTimestamp, buffer->metadata().timestamp);
 		bayerQueue_.push({ buffer, std::move(ctrl), delayContext });
+	} else if (buffer->metadata().timestamp <= lastBayerTimestamp_) {
+		/*
+		 * The Bayer frame has already been passed to the IPA without
+		 * embedded data, the buffer will never be matched.
+		 */
+		stream->returnBuffer(buffer);
+		LOG(RPI, Debug) << "Dropping late buffer in stream "
+				<< stream->name();
 	} else {
-		embeddedQueue_.push(buffer);
+		embeddedBuffers_.emplace(buffer->metadata().timestamp, buffer);
 	}
 
 	handleState();
@@ -980,8 +1026,7 @@ void Vc4CameraData::tryRunPipeline()
 	BayerFrame bayerFrame;
 
 	/* If any of our request or buffer queues are empty, we cannot proceed. */
-	if (state_ != State::Idle || requestQueue_.empty() ||
-	    bayerQueue_.empty() || (embeddedQueue_.empty() && sensorMetadata_))
+	if (state_ != State::Idle || requestQueue_.empty() || bayerQueue_.empty())
 		return;
 
 	if (!findMatchingBuffers(bayerFrame, embeddedBuffer))
@@ -1038,32 +1083,28 @@ bool Vc4CameraData::findMatchingBuffers(BayerFrame &bayerFrame, FrameBuffer *&em
 	 * the IPA. Any embedded buffers with a timestamp lower than the
 	 * current bayer buffer will be removed and re-queued to the driver.
 	 */
-	uint64_t ts = bayerQueue_.front().buffer->metadata().timestamp;
+	FrameBuffer *bayer = bayerQueue_.front().buffer;
+	uint64_t ts = bayer->metadata().timestamp;
+	returnEmbeddedBuffers(ts);
+
 	embeddedBuffer = nullptr;
-	while (!embeddedQueue_.empty()) {
-		FrameBuffer *b = embeddedQueue_.front();
-		if (b->metadata().timestamp < ts) {
-			embeddedQueue_.pop();
-			unicam_[Unicam::Embedded].returnBuffer(b);
-			LOG(RPI, Debug) << "Dropping unmatched input frame in stream "
-					<< unicam_[Unicam::Embedded].name();
-		} else if (b->metadata().timestamp == ts) {
-			/* Found a match! */
-			embeddedBuffer = b;
-			embeddedQueue_.pop();
-			break;
-		} else {
-			break; /* Only higher timestamps from here. */
-		}
+	auto it = embeddedBuffers_.find(ts);
+	if (it != embeddedBuffers_.end()) {
+		/* Found a match! */
+		embeddedBuffer = it->second;
+		embeddedBuffers_.erase(it);
 	}
 
 	if (!embeddedBuffer && sensorMetadata_) {
-		if (embeddedQueue_.empty()) {
+		if (embeddedBuffers_.empty() && embeddedTimedOut_ != bayer) {
 			/*
 			 * If the embedded buffer queue is empty, wait for the next
 			 * buffer to arrive - dequeue ordering may send the image
-			 * buffer first.
+			 * buffer first. Bound the wait if a timeout is configured.
 			 */
+			if (config_.embeddedDataTimeoutMs && !embeddedTimer_.isRunning())
+				embeddedTimer_.start(std::chrono::milliseconds(config_.embeddedDataTimeoutMs));
+
 			LOG(RPI, Debug) << "Waiting for next embedded buffer.";
 			return false;
 		}
@@ -1072,12 +1113,39 @@ bool Vc4CameraData::findMatchingBuffers(BayerFrame &bayerFrame, FrameBuffer *&em
 		LOG(RPI, Debug) << "Returning bayer frame without a matching embedded buffer.";
 	}
 
+	embeddedTimer_.stop();
+	embeddedTimedOut_ = nullptr;
+	lastBayerTimestamp_ = ts;
+
 	bayerFrame = std::move(bayerQueue_.front());
 	bayerQueue_.pop();
 
 	return true;
 }
 
+void Vc4CameraData::returnEmbeddedBuffers(uint64_t timestamp)
+{
+	auto end = embeddedBuffers_.lower_bound(timestamp);
+	for (auto it = embeddedBuffers_.begin(); it != end; ++it) {
+		unicam_[Unicam::Embedded].returnBuffer(it->second);
+		LOG(RPI, Debug) << "Dropping unmatched input frame in stream "
+				<< unicam_[Unicam::Embedded].name();
+	}
+
+	embeddedBuffers_.erase(embeddedBuffers_.begin(), end);
+}
+
+void Vc4CameraData::embeddedDataTimeout()
+{
+	if (bayerQueue_.empty())
+		return;
+
+	LOG(RPI, Debug) << "Timeout waiting for embedded buffer";
+
+	embeddedTimedOut_ = bayerQueue_.front().buffer;
+	handleState();
+}
+
 REGISTER_PIPELINE_HANDLER(PipelineHandlerVc4, "rpi/vc4")
 
 } /* namespace libcamera */
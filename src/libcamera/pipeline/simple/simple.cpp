@@ -22,6 +22,7 @@
 #include <linux/media-bus-format.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
@@ -30,8 +31,10 @@
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/camera_sensor_properties.h"
 #include "libcamera/internal/converter.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/software_isp/software_isp.h"
@@ -153,6 +156,24 @@ LOG_DEFINE_CATEGORY(SimplePipeline)
  * the capture video node, and stores the information in the outputFormats and
  * outputSizes of the SimpleCameraData::Configuration structure.
  *
+ * On platforms without a memory-to-memory converter, conversion and scaling can
+ * instead be performed on the CPU by the software converter, by setting the
+ * LIBCAMERA_SIMPLE_SOFTWARE_CONVERTER environment variable. The software
+ * converter is only used when the Software ISP isn't, and handles packed YUV
+ * and RGB capture formats. Other capture formats are output unconverted.
+ *
+ * When converting, frames are captured to internal buffers and go through
+ * three stages: requests wait for a captured frame, captured frames wait for a
+ * conversion slot, and conversions run in the converter or Software ISP. Up to
+ * a conversion depth of frames are converted concurrently, set by the
+ * LIBCAMERA_SIMPLE_CONVERSION_DEPTH environment variable and defaulting to 2.
+ * Enough internal buffers are allocated to keep buffers queued for capture
+ * while the conversions are running. When a frame is captured while all
+ * conversion slots are busy and another frame is already waiting, the older
+ * frame is dropped and its buffer requeued for capture. Requests still complete
+ * in the order they have been queued. The maximum depth reached by each stage
+ * is logged when the camera is stopped.
+ *
  * Concurrent Access to Cameras
  * ----------------------------
  *
@@ -277,8 +298,26 @@ public:
 	std::vector<Configuration> configs_;
 	std::map<PixelFormat, std::vector<const Configuration *>> formats_;
 
+	/* Frames captured while all conversion slots are busy */
+	static constexpr unsigned int kMaxPendingCaptures = 1;
+
+	/* Streams produced by the software converter */
+	static constexpr unsigned int kSoftwareConverterStreams = 3;
+
+	struct ConversionStats {
+		unsigned int maxQueuedRequests;
+		unsigned int maxPendingCaptures;
+		unsigned int maxConversions;
+		unsigned int droppedFrames;
+	};
+
+	void resetConversions();
+
 	std::vector<std::unique_ptr<FrameBuffer>> conversionBuffers_;
-	std::queue<std::map<const Stream *, FrameBuffer *>> conversionQueue_;
+	std::queue<Request::BufferMap> conversionQueue_;
+	std::queue<FrameBuffer *> pendingCaptures_;
+	unsigned int conversionsInFlight_;
+	ConversionStats conversionStats_;
 	bool useConversion_;
 
 	std::unique_ptr<Converter> converter_;
@@ -288,10 +327,12 @@ private:
 	void tryPipeline(unsigned int code, const Size &size);
 	static std::vector<const MediaPad *> routedSourcePads(MediaPad *sink);
 
+	void queueConversions();
+	void cancelConversion(const Request::BufferMap &outputs);
 	void conversionInputDone(FrameBuffer *buffer);
 	void conversionOutputDone(FrameBuffer *buffer);
 
-	void ispStatsReady();
+	void ispStatsReady(uint32_t statsBufferId);
 	void setSensorControls(const ControlList &sensorControls);
 };
 
@@ -336,6 +377,8 @@ public:
 	int exportFrameBuffers(Camera *camera, Stream *stream,
 			       std::vector<std::unique_ptr<FrameBuffer>> *buffers) override;
 
+	int setSyncMode(Camera *camera, SensorSyncMode mode) override;
+
 	int start(Camera *camera, const ControlList *controls) override;
 	void stopDevice(Camera *camera) override;
 
@@ -345,12 +388,20 @@ public:
 	V4L2Subdevice *subdev(const MediaEntity *entity);
 	MediaDevice *converter() { return converter_; }
 	bool swIspEnabled() const { return swIspEnabled_; }
+	bool softwareConverterEnabled() const { return softwareConverterEnabled_; }
+	unsigned int conversionDepth() const { return conversionDepth_; }
 
 protected:
 	int queueRequestDevice(Camera *camera, Request *request) override;
 
 private:
-	static constexpr unsigned int kNumInternalBuffers = 3;
+	static constexpr unsigned int kDefaultConversionDepth = 2;
+
+	unsigned int numInternalBuffers() const
+	{
+		/* Keep at least one buffer queued for capture at all times. */
+		return conversionDepth_ + SimpleCameraData::kMaxPendingCaptures + 1;
+	}
 
 	struct EntityData {
 		std::unique_ptr<V4L2VideoDevice> video;
@@ -374,6 +425,8 @@ private:
 
 	MediaDevice *converter_;
 	bool swIspEnabled_;
+	bool softwareConverterEnabled_;
+	unsigned int conversionDepth_;
 };
 
 /* -----------------------------------------------------------------------------
@@ -383,7 +436,8 @@ private:
 SimpleCameraData::SimpleCameraData(SimplePipelineHandler *pipe,
 				   unsigned int numStreams,
 				   MediaEntity *sensor)
-	: Camera::Private(pipe), streams_(numStreams)
+	: Camera::Private(pipe), streams_(numStreams), conversionsInFlight_(0),
+	  conversionStats_({})
 {
 	int ret;
 
@@ -533,6 +587,8 @@ int SimpleCameraData::init()
 				<< "Failed to create software ISP, disabling software debayering";
 			swIsp_.reset();
 		} else {
+			swIsp_->setMemoryAccount(memory_);
+
 			/*
 			 * The inputBufferReady signal is emitted from the soft ISP thread,
 			 * and needs to be handled in the pipeline handler thread. Signals
@@ -551,6 +607,28 @@ int SimpleCameraData::init()
 			swIsp_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
 			swIsp_->ispStatsReady.connect(this, &SimpleCameraData::ispStatsReady);
 			swIsp_->setSensorControls.connect(this, &SimpleCameraData::setSensorControls);
+
+			/* The software ISP produces all its streams in one pass. */
+			streams_.resize(swIsp_->maxStreams());
+		}
+	}
+
+	/*
+	 * Fall back to converting on the CPU when neither a hardware converter
+	 * nor the Software ISP is used, if enabled. The software converter is
+	 * bound to the pipeline handler thread and emits its signals there.
+	 */
+	if (!converter_ && !swIsp_ && pipe->softwareConverterEnabled()) {
+		converter_ = ConverterFactoryBase::create("software");
+		if (!converter_) {
+			LOG(SimplePipeline, Warning)
+				<< "Failed to create software converter, disabling format conversion";
+		} else {
+			converter_->inputBufferReady.connect(this, &SimpleCameraData::conversionInputDone);
+			converter_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
+
+			/* The software converter produces all its streams in one pass. */
+			streams_.resize(kSoftwareConverterStreams);
 		}
 	}
 
@@ -647,6 +725,11 @@ void SimpleCameraData::tryPipeline(unsigned int code, const Size &size)
 		if (converter_) {
 			config.outputFormats = converter_->formats(pixelFormat);
 			config.outputSizes = converter_->sizes(format.size);
+			if (config.outputFormats.empty()) {
+				/* Capture unconverted formats directly. */
+				config.outputFormats = { pixelFormat };
+				config.outputSizes = config.captureSize;
+			}
 		} else if (swIsp_) {
 			config.outputFormats = swIsp_->formats(pixelFormat);
 			config.outputSizes = swIsp_->sizes(pixelFormat, format.size);
@@ -827,58 +910,138 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 	}
 
 	/*
-	 * Record the sensor's timestamp in the request metadata. The request
-	 * needs to be obtained from the user-facing buffer, as internal
-	 * buffers are free-wheeling and have no request associated with them.
+	 * Hand the captured buffer to the converter or Software ISP if format
+	 * conversion is needed. If there's no queued request, just requeue the
+	 * captured buffer for capture. Otherwise the buffer waits for a
+	 * conversion slot, replacing an older frame still waiting to keep
+	 * buffers queued for capture.
+	 */
+	if (useConversion_) {
+		if (conversionQueue_.empty()) {
+			video_->queueBuffer(buffer);
+			return;
+		}
+
+		pendingCaptures_.push(buffer);
+
+		while (pendingCaptures_.size() > kMaxPendingCaptures) {
+			FrameBuffer *dropped = pendingCaptures_.front();
+			frameDropped(dropped->metadata().sequence,
+				     controls::FrameDropOverrun);
+			video_->queueBuffer(dropped);
+			pendingCaptures_.pop();
+			conversionStats_.droppedFrames++;
+		}
+
+		queueConversions();
+
+		conversionStats_.maxPendingCaptures =
+			std::max<unsigned int>(conversionStats_.maxPendingCaptures,
+					       pendingCaptures_.size());
+		return;
+	}
+
+	/*
+	 * Record the sensor's timestamp in the request metadata.
 	 *
 	 * \todo The sensor timestamp should be better estimated by connecting
 	 * to the V4L2Device::frameStart signal if the platform provides it.
 	 */
 	Request *request = buffer->request();
+	request->metadata().set(controls::SensorTimestamp,
+				buffer->metadata().timestamp);
 
-	if (useConversion_ && !conversionQueue_.empty()) {
-		const std::map<const Stream *, FrameBuffer *> &outputs =
-			conversionQueue_.front();
-		if (!outputs.empty()) {
-			FrameBuffer *outputBuffer = outputs.begin()->second;
-			if (outputBuffer)
-				request = outputBuffer->request();
-		}
-	}
+	/* Otherwise simply complete the request. */
+	pipe->completeBuffer(request, buffer);
+	pipe->completeRequest(request);
+}
 
-	if (request)
+/*
+ * Start converting the captured frames waiting for a conversion slot, for the
+ * oldest queued requests.
+ */
+void SimpleCameraData::queueConversions()
+{
+	unsigned int depth = pipe()->conversionDepth();
+
+	while (!pendingCaptures_.empty() && !conversionQueue_.empty() &&
+	       conversionsInFlight_ < depth) {
+		FrameBuffer *buffer = pendingCaptures_.front();
+		pendingCaptures_.pop();
+
+		Request::BufferMap outputs = std::move(conversionQueue_.front());
+		conversionQueue_.pop();
+
+		/*
+		 * Record the sensor's timestamp in the request metadata. The
+		 * request needs to be obtained from the user-facing buffer, as
+		 * internal buffers are free-wheeling and have no request
+		 * associated with them.
+		 */
+		Request *request = outputs.begin()->second->request();
 		request->metadata().set(controls::SensorTimestamp,
 					buffer->metadata().timestamp);
 
-	/*
-	 * Queue the captured and the request buffer to the converter or Software
-	 * ISP if format conversion is needed. If there's no queued request, just
-	 * requeue the captured buffer for capture.
-	 */
-	if (useConversion_) {
-		if (conversionQueue_.empty()) {
+		conversionsInFlight_++;
+		conversionStats_.maxConversions =
+			std::max(conversionStats_.maxConversions, conversionsInFlight_);
+
+		int ret = converter_ ? converter_->queueBuffers(buffer, outputs)
+				     : swIsp_->queueBuffers(buffer, outputs);
+		if (ret < 0) {
+			LOG(SimplePipeline, Error)
+				<< "Failed to queue conversion: " << strerror(-ret);
+
+			conversionsInFlight_--;
 			video_->queueBuffer(buffer);
-			return;
+			cancelConversion(outputs);
 		}
+	}
+}
 
-		if (converter_)
-			converter_->queueBuffers(buffer, conversionQueue_.front());
-		else
-			swIsp_->queueBuffers(buffer, conversionQueue_.front());
+/* Complete the request of the output buffers without converting a frame. */
+void SimpleCameraData::cancelConversion(const Request::BufferMap &outputs)
+{
+	SimplePipelineHandler *pipe = SimpleCameraData::pipe();
+	Request *request = nullptr;
+
+	for (const auto &[stream, buffer] : outputs) {
+		buffer->_d()->cancel();
+		request = buffer->request();
+		pipe->completeBuffer(request, buffer);
+	}
+
+	if (request)
+		pipe->completeRequest(request);
+}
 
+/*
+ * Drop the frames waiting for a conversion slot, and cancel the requests
+ * waiting for a frame.
+ */
+void SimpleCameraData::resetConversions()
+{
+	pendingCaptures_ = {};
+
+	while (!conversionQueue_.empty()) {
+		cancelConversion(conversionQueue_.front());
 		conversionQueue_.pop();
-		return;
 	}
 
-	/* Otherwise simply complete the request. */
-	pipe->completeBuffer(request, buffer);
-	pipe->completeRequest(request);
+	conversionsInFlight_ = 0;
+	conversionStats_ = {};
 }
 
 void SimpleCameraData::conversionInputDone(FrameBuffer *buffer)
 {
 	/* Queue the input buffer back for capture. */
 	video_->queueBuffer(buffer);
+
+	/* The conversion slot is free, start the next conversion. */
+	if (conversionsInFlight_)
+		conversionsInFlight_--;
+
+	queueConversions();
 }
 
 void SimpleCameraData::conversionOutputDone(FrameBuffer *buffer)
@@ -891,10 +1054,11 @@ void SimpleCameraData::conversionOutputDone(FrameBuffer *buffer)
 		pipe->completeRequest(request);
 }
 
-void SimpleCameraData::ispStatsReady()
+void SimpleCameraData::ispStatsReady(uint32_t statsBufferId)
 {
 	/* \todo Use the DelayedControls class */
-	swIsp_->processStats(sensor_->getControls({ V4L2_CID_ANALOGUE_GAIN,
+	swIsp_->processStats(statsBufferId,
+			     sensor_->getControls({ V4L2_CID_ANALOGUE_GAIN,
 						    V4L2_CID_EXPOSURE }));
 }
 
@@ -1150,8 +1314,17 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
  */
 
 SimplePipelineHandler::SimplePipelineHandler(CameraManager *manager)
-	: PipelineHandler(manager), converter_(nullptr)
+	: PipelineHandler(manager), converter_(nullptr),
+	  softwareConverterEnabled_(false),
+	  conversionDepth_(kDefaultConversionDepth)
 {
+	const char *env = utils::secure_getenv("LIBCAMERA_SIMPLE_CONVERSION_DEPTH");
+	if (env)
+		conversionDepth_ = std::max(std::strtoul(env, nullptr, 10), 1UL);
+
+	env = utils::secure_getenv("LIBCAMERA_SIMPLE_SOFTWARE_CONVERTER");
+	if (env && env[0] != '\0' && strcmp(env, "0"))
+		softwareConverterEnabled_ = true;
 }
 
 std::unique_ptr<CameraConfiguration>
@@ -1284,7 +1457,7 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 	inputCfg.pixelFormat = pipeConfig->captureFormat;
 	inputCfg.size = pipeConfig->captureSize;
 	inputCfg.stride = captureFormat.planes[0].bpl;
-	inputCfg.bufferCount = kNumInternalBuffers;
+	inputCfg.bufferCount = numInternalBuffers();
 
 	return data->converter_
 		       ? data->converter_->configure(inputCfg, outputCfgs)
@@ -1310,6 +1483,13 @@ int SimplePipelineHandler::exportFrameBuffers(Camera *camera, Stream *stream,
 		return data->video_->exportBuffers(count, buffers);
 }
 
+int SimplePipelineHandler::setSyncMode(Camera *camera, SensorSyncMode mode)
+{
+	SimpleCameraData *data = cameraData(camera);
+
+	return data->sensor_->setSyncMode(mode);
+}
+
 int SimplePipelineHandler::start(Camera *camera, [[maybe_unused]] const ControlList *controls)
 {
 	SimpleCameraData *data = cameraData(camera);
@@ -1329,8 +1509,11 @@ int SimplePipelineHandler::start(Camera *camera, [[maybe_unused]] const ControlL
 		 * When using the converter allocate a fixed number of internal
 		 * buffers.
 		 */
-		ret = video->allocateBuffers(kNumInternalBuffers,
+		ret = video->allocateBuffers(numInternalBuffers(),
 					     &data->conversionBuffers_);
+		for (std::unique_ptr<FrameBuffer> &buffer : data->conversionBuffers_)
+			data->memory_->charge(buffer.get());
+		data->resetConversions();
 	} else {
 		/* Otherwise, prepare for using buffers from the only stream. */
 		Stream *stream = &data->streams_[0];
@@ -1376,6 +1559,18 @@ void SimplePipelineHandler::stopDevice(Camera *camera)
 	V4L2VideoDevice *video = data->video_;
 
 	if (data->useConversion_) {
+		const SimpleCameraData::ConversionStats &stats = data->conversionStats_;
+
+		LOG(SimplePipeline, Debug)
+			<< "Conversion stages peaked at "
+			<< stats.maxQueuedRequests << " queued requests, "
+			<< stats.maxPendingCaptures << " pending captures and "
+			<< stats.maxConversions << " conversions, "
+			<< stats.droppedFrames << " frames dropped";
+
+		/* Don't start new conversions while stopping. */
+		data->resetConversions();
+
 		if (data->converter_)
 			data->converter_->stop();
 		else if (data->swIsp_)
@@ -1397,7 +1592,7 @@ int SimplePipelineHandler::queueRequestDevice(Camera *camera, Request *request)
 	SimpleCameraData *data = cameraData(camera);
 	int ret;
 
-	std::map<const Stream *, FrameBuffer *> buffers;
+	Request::BufferMap buffers;
 
 	for (auto &[stream, buffer] : request->buffers()) {
 		/*
@@ -1414,9 +1609,14 @@ int SimplePipelineHandler::queueRequestDevice(Camera *camera, Request *request)
 		}
 	}
 
-	if (data->useConversion_)
+	if (data->useConversion_) {
 		data->conversionQueue_.push(std::move(buffers));
 
+		SimpleCameraData::ConversionStats &stats = data->conversionStats_;
+		stats.maxQueuedRequests = std::max<unsigned int>(stats.maxQueuedRequests,
+								 data->conversionQueue_.size());
+	}
+
 	return 0;
 }
 
@@ -0,0 +1,385 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * MJPEG decoder for the uvcvideo pipeline handler
+ */
+
+#include "mjpeg_decoder.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#include <jpeglib.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(UVC)
+
+namespace {
+
+/*
+ * Frames are decoded in parallel, one per worker thread. More threads than
+ * frames in flight would be idle, and a handful is enough for the frame rates
+ * of UVC cameras.
+ */
+constexpr unsigned int kMaxWorkers = 4;
+
+struct JpegErrorManager : public jpeg_error_mgr {
+	JpegErrorManager()
+	{
+		jpeg_std_error(this);
+		error_exit = errorExit;
+		output_message = outputMessage;
+	}
+
+	static void errorExit(j_common_ptr cinfo)
+	{
+		JpegErrorManager *self =
+			static_cast<JpegErrorManager *>(cinfo->err);
+		longjmp(self->escape_, 1);
+	}
+
+	static void outputMessage(j_common_ptr cinfo)
+	{
+		char message[JMSG_LENGTH_MAX];
+
+		cinfo->err->format_message(cinfo, message);
+		LOG(UVC, Debug) << "JPEG decoder: " << message;
+	}
+
+	jmp_buf escape_;
+};
+
+} /* namespace */
+
+#ifndef __DOXYGEN__
+
+class MjpegDecoder::Worker : public Object
+{
+public:
+	Worker(MjpegDecoder *decoder)
+		: decoder_(decoder)
+	{
+	}
+
+	void decode(FrameBuffer *input, FrameBuffer *output);
+	void flush() {}
+
+private:
+	int decompress(const MappedFrameBuffer &in, unsigned int size,
+		       MappedFrameBuffer &out);
+	void storeLine(const uint8_t *src, unsigned int y,
+		       MappedFrameBuffer &out);
+
+	MjpegDecoder *decoder_;
+	std::vector<uint8_t> line_;
+};
+
+void MjpegDecoder::Worker::decode(FrameBuffer *input, FrameBuffer *output)
+{
+	FrameMetadata &metadata = output->_d()->metadata();
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+	metadata.status = FrameMetadata::FrameError;
+
+	MappedFrameBuffer in(input, MappedFrameBuffer::MapFlag::Read);
+	MappedFrameBuffer out(output, MappedFrameBuffer::MapFlag::Write);
+
+	if (!in.isValid() || !out.isValid()) {
+		LOG(UVC, Error) << "Failed to map buffers for MJPEG decoding";
+	} else if (!decompress(in, input->metadata().planes()[0].bytesused, out)) {
+		metadata.status = FrameMetadata::FrameSuccess;
+
+		Span<FrameMetadata::Plane> planes = metadata.planes();
+		for (auto [i, plane] : utils::enumerate(planes))
+			plane.bytesused = out.planes()[i].size();
+	}
+
+	decoder_->complete(input, output);
+}
+
+int MjpegDecoder::Worker::decompress(const MappedFrameBuffer &in,
+				     unsigned int size, MappedFrameBuffer &out)
+{
+	struct jpeg_decompress_struct cinfo;
+	const Size &frameSize = decoder_->size_;
+
+	size = std::min<size_t>(size, in.planes()[0].size());
+
+	JpegErrorManager errorManager;
+	if (setjmp(errorManager.escape_)) {
+		jpeg_destroy_decompress(&cinfo);
+		LOG(UVC, Debug) << "Failed to decode MJPEG frame";
+		return -EINVAL;
+	}
+
+	cinfo.err = &errorManager;
+	jpeg_create_decompress(&cinfo);
+
+	jpeg_mem_src(&cinfo, in.planes()[0].data(), size);
+	jpeg_read_header(&cinfo, TRUE);
+
+	/*
+	 * Decode to interleaved YCbCr 4:4:4, one line at a time, and subsample
+	 * the chroma to the output format when storing the line. This avoids
+	 * the colour space conversion performed by the decoder by default.
+	 */
+	cinfo.out_color_space = JCS_YCbCr;
+	cinfo.dct_method = JDCT_IFAST;
+
+	jpeg_start_decompress(&cinfo);
+
+	if (cinfo.output_width != frameSize.width ||
+	    cinfo.output_height != frameSize.height ||
+	    cinfo.output_components != 3) {
+		LOG(UVC, Debug)
+			<< "Unexpected MJPEG frame size "
+			<< Size(cinfo.output_width, cinfo.output_height);
+		jpeg_destroy_decompress(&cinfo);
+		return -EINVAL;
+	}
+
+	line_.resize(frameSize.width * 3);
+
+	while (cinfo.output_scanline < cinfo.output_height) {
+		unsigned int y = cinfo.output_scanline;
+		JSAMPROW row = line_.data();
+
+		jpeg_read_scanlines(&cinfo, &row, 1);
+		storeLine(line_.data(), y, out);
+	}
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+
+	return 0;
+}
+
+void MjpegDecoder::Worker::storeLine(const uint8_t *src, unsigned int y,
+				     MappedFrameBuffer &out)
+{
+	const unsigned int width = decoder_->size_.width;
+	const unsigned int stride = decoder_->stride_;
+
+	if (decoder_->pixelFormat_ == formats::YUYV) {
+		uint8_t *dst = out.planes()[0].data() + y * stride;
+
+		for (unsigned int x = 0; x < width; x += 2, src += 6, dst += 4) {
+			dst[0] = src[0];
+			dst[1] = (src[1] + src[4] + 1) / 2;
+			dst[2] = src[3];
+			dst[3] = (src[2] + src[5] + 1) / 2;
+		}
+
+		return;
+	}
+
+	/* NV12, sample the chroma from the even lines. */
+	uint8_t *luma = out.planes()[0].data() + y * stride;
+	for (unsigned int x = 0; x < width; x++)
+		luma[x] = src[x * 3];
+
+	if (y % 2)
+		return;
+
+	uint8_t *chroma = out.planes()[1].data() + y / 2 * stride;
+	for (unsigned int x = 0; x < width; x += 2, src += 6, chroma += 2) {
+		chroma[0] = (src[1] + src[4] + 1) / 2;
+		chroma[1] = (src[2] + src[5] + 1) / 2;
+	}
+}
+
+#endif /* __DOXYGEN__ */
+
+/**
+ * \class MjpegDecoder
+ * \brief Software decoder for MJPEG frames captured by UVC cameras
+ *
+ * The MjpegDecoder decodes MJPEG frames to YUV formats with libjpeg. Frames are
+ * decoded in worker threads, one frame per thread, which lets the decoder keep
+ * up with the frame rate of high resolution cameras without stalling the
+ * pipeline handler thread. Decoded frames are reported through the bufferReady
+ * signal, emitted in the thread the decoder belongs to, possibly out of order.
+ */
+
+MjpegDecoder::MjpegDecoder()
+	: nextWorker_(0), stride_(0)
+{
+	unsigned int count = std::clamp(std::thread::hardware_concurrency(),
+					1U, kMaxWorkers);
+
+	for (unsigned int i = 0; i < count; i++) {
+		threads_.push_back(std::make_unique<Thread>("MjpegDecoder"));
+		workers_.push_back(std::make_unique<Worker>(this));
+		workers_.back()->moveToThread(threads_.back().get());
+	}
+}
+
+MjpegDecoder::~MjpegDecoder()
+{
+	stop();
+}
+
+/**
+ * \brief Retrieve the pixel formats the decoder can produce
+ * \return The list of supported output pixel formats
+ */
+const std::vector<PixelFormat> &MjpegDecoder::formats()
+{
+	static const std::vector<PixelFormat> formats = {
+		formats::NV12,
+		formats::YUYV,
+	};
+
+	return formats;
+}
+
+/**
+ * \brief Compute the stride and frame size of a decoded frame
+ * \param[in] pixelFormat The output pixel format
+ * \param[in] size The output size
+ * \return A tuple of the stride and frame size, or a tuple of zeros if the
+ * pixel format isn't supported
+ */
+std::tuple<unsigned int, unsigned int>
+MjpegDecoder::strideAndFrameSize(const PixelFormat &pixelFormat, const Size &size)
+{
+	const auto &supported = formats();
+	if (std::find(supported.begin(), supported.end(), pixelFormat) == supported.end())
+		return { 0, 0 };
+
+	const PixelFormatInfo &info = PixelFormatInfo::info(pixelFormat);
+	unsigned int stride = info.stride(size.width, 0, 1);
+
+	return { stride, info.frameSize(size, 1) };
+}
+
+/**
+ * \brief Configure the decoder output
+ * \param[in] pixelFormat The output pixel format
+ * \param[in] size The frame size, identical for the input and output
+ * \return 0 on success or a negative error code otherwise
+ */
+int MjpegDecoder::configure(const PixelFormat &pixelFormat, const Size &size)
+{
+	/* The chroma is subsampled horizontally, and vertically for NV12. */
+	if (size.width % 2 || size.height % 2)
+		return -EINVAL;
+
+	unsigned int stride = std::get<0>(strideAndFrameSize(pixelFormat, size));
+	if (!stride)
+		return -EINVAL;
+
+	pixelFormat_ = pixelFormat;
+	size_ = size;
+	stride_ = stride;
+
+	LOG(UVC, Debug)
+		<< "Decoding MJPEG to " << pixelFormat << " " << size
+		<< " with " << workers_.size() << " threads";
+
+	return 0;
+}
+
+/**
+ * \brief Start the decoder worker threads
+ * \return 0 on success or a negative error code otherwise
+ */
+int MjpegDecoder::start()
+{
+	for (std::unique_ptr<Thread> &thread : threads_)
+		thread->start();
+
+	return 0;
+}
+
+/**
+ * \brief Stop the decoder
+ *
+ * Wait for all the queued frames to be decoded, and report them through the
+ * bufferReady signal before returning.
+ */
+void MjpegDecoder::stop()
+{
+	for (auto [i, thread] : utils::enumerate(threads_)) {
+		if (!thread->isRunning())
+			continue;
+
+		workers_[i]->invokeMethod(&Worker::flush, ConnectionTypeBlocking);
+
+		thread->exit();
+		thread->wait();
+	}
+
+	processCompleted();
+
+	nextWorker_ = 0;
+}
+
+/**
+ * \brief Queue an MJPEG frame for decoding
+ * \param[in] input The MJPEG frame buffer
+ * \param[in] output The frame buffer to store the decoded frame
+ *
+ * The \a input and \a output buffers are reported through the bufferReady
+ * signal once decoded. The \a output buffer status is set to
+ * FrameMetadata::FrameError if the frame can't be decoded.
+ */
+void MjpegDecoder::queueBuffers(FrameBuffer *input, FrameBuffer *output)
+{
+	Worker *worker = workers_[nextWorker_].get();
+	nextWorker_ = (nextWorker_ + 1) % workers_.size();
+
+	worker->invokeMethod(&Worker::decode, ConnectionTypeQueued,
+			     input, output);
+}
+
+/*
+ * Called from the worker threads. Completed frames are accumulated and
+ * reported from the decoder thread, which stop() also uses to report the
+ * frames synchronously.
+ */
+void MjpegDecoder::complete(FrameBuffer *input, FrameBuffer *output)
+{
+	{
+		MutexLocker locker(mutex_);
+		completed_.emplace_back(input, output);
+	}
+
+	invokeMethod(&MjpegDecoder::processCompleted, ConnectionTypeQueued);
+}
+
+void MjpegDecoder::processCompleted()
+{
+	std::vector<std::pair<FrameBuffer *, FrameBuffer *>> completed;
+
+	{
+		MutexLocker locker(mutex_);
+		completed.swap(completed_);
+	}
+
+	for (const auto &[input, output] : completed)
+		bufferReady.emit(input, output);
+}
+
+/**
+ * \var MjpegDecoder::bufferReady
+ * \brief Signal emitted when a frame has been decoded
+ *
+ * The signal carries the input MJPEG buffer and the output buffer.
+ */
+
+} /* namespace libcamera */
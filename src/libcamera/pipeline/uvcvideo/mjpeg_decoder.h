@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * MJPEG decoder for the uvcvideo pipeline handler
+ */
+
+#pragma once
+
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/signal.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+
+namespace libcamera {
+
+class FrameBuffer;
+class Thread;
+
+class MjpegDecoder : public Object
+{
+public:
+	MjpegDecoder();
+	~MjpegDecoder();
+
+	static const std::vector<PixelFormat> &formats();
+	static std::tuple<unsigned int, unsigned int>
+	strideAndFrameSize(const PixelFormat &pixelFormat, const Size &size);
+
+	int configure(const PixelFormat &pixelFormat, const Size &size);
+
+	int start();
+	void stop();
+
+	void queueBuffers(FrameBuffer *input, FrameBuffer *output);
+
+	Signal<FrameBuffer *, FrameBuffer *> bufferReady;
+
+private:
+	class Worker;
+
+	void complete(FrameBuffer *input, FrameBuffer *output);
+	void processCompleted();
+
+	std::vector<std::unique_ptr<Thread>> threads_;
+	std::vector<std::unique_ptr<Worker>> workers_;
+	unsigned int nextWorker_;
+
+	PixelFormat pixelFormat_;
+	Size size_;
+	unsigned int stride_;
+
+	Mutex mutex_;
+	std::vector<std::pair<FrameBuffer *, FrameBuffer *>> completed_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
@@ -6,10 +6,14 @@
  */
 
 #include <algorithm>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <math.h>
 #include <memory>
+#include <optional>
+#include <queue>
+#include <string.h>
 #include <tuple>
 
 #include <libcamera/base/log.h>
@@ -18,26 +22,138 @@
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
+#include <libcamera/formats.h>
 #include <libcamera/property_ids.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/sysfs.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
+#if HAVE_LIBJPEG
+#include "mjpeg_decoder.h"
+#endif
+
 namespace libcamera {
 
 LOG_DEFINE_CATEGORY(UVC)
 
+/*
+ * Recover the device clock from the UVC payload headers, to convert the frames
+ * presentation time stamps to the system clock.
+ *
+ * The Source Clock Reference (SCR) of the payload headers samples the device
+ * clock (STC) at a USB start of frame (SOF). The host time of that SOF is
+ * estimated from the time the header has been received by the host, corrected
+ * by the number of USB frames between the SCR sampling and the reception. A
+ * linear fit over the most recent samples then maps the device clock to the
+ * system clock, which removes the USB transfer jitter from the timestamps.
+ */
+class UVCClock
+{
+public:
+	UVCClock()
+		: stc_(0), lastStc_(0)
+	{
+	}
+
+	void reset();
+	void addSample(uint32_t stc, uint16_t deviceSof, uint64_t ns,
+		       uint16_t hostSof);
+	std::optional<uint64_t> convert(uint32_t pts) const;
+
+private:
+	static constexpr unsigned int kMaxSamples = 32;
+	static constexpr unsigned int kMinSamples = 8;
+
+	struct Sample {
+		uint64_t stc;
+		uint64_t ns;
+	};
+
+	std::deque<Sample> samples_;
+	uint64_t stc_;
+	uint32_t lastStc_;
+};
+
+void UVCClock::reset()
+{
+	samples_.clear();
+	stc_ = 0;
+	lastStc_ = 0;
+}
+
+void UVCClock::addSample(uint32_t stc, uint16_t deviceSof, uint64_t ns,
+			 uint16_t hostSof)
+{
+	/* Extend the 32-bit device clock to 64 bits. */
+	if (samples_.empty())
+		stc_ = stc;
+	else
+		stc_ += static_cast<uint32_t>(stc - lastStc_);
+	lastStc_ = stc;
+
+	/* The SOF counter has 11 bits and increments every millisecond. */
+	unsigned int frames = (hostSof - deviceSof) & 0x7ff;
+	uint64_t sampleNs = ns - frames * 1000000ULL;
+
+	samples_.push_back({ stc_, sampleNs });
+	if (samples_.size() > kMaxSamples)
+		samples_.pop_front();
+}
+
+std::optional<uint64_t> UVCClock::convert(uint32_t pts) const
+{
+	if (samples_.size() < kMinSamples)
+		return std::nullopt;
+
+	/*
+	 * Least squares fit of the system clock against the device clock,
+	 * relative to the first sample to preserve the precision.
+	 */
+	const Sample &origin = samples_.front();
+	double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+
+	for (const Sample &sample : samples_) {
+		double x = static_cast<double>(sample.stc - origin.stc);
+		double y = static_cast<double>(static_cast<int64_t>(sample.ns - origin.ns));
+
+		sumX += x;
+		sumY += y;
+		sumXX += x * x;
+		sumXY += x * y;
+	}
+
+	double n = samples_.size();
+	double det = n * sumXX - sumX * sumX;
+	if (det <= 0)
+		return std::nullopt;
+
+	double slope = (n * sumXY - sumX * sumY) / det;
+	double offset = (sumY - slope * sumX) / n;
+	if (slope <= 0)
+		return std::nullopt;
+
+	/* The PTS is close to the latest SCR, extend it to 64 bits. */
+	int64_t stc = stc_ + static_cast<int32_t>(pts - lastStc_);
+	double x = static_cast<double>(stc - static_cast<int64_t>(origin.stc));
+
+	return origin.ns + static_cast<int64_t>(llround(offset + slope * x));
+}
+
 class UVCCameraData : public Camera::Private
 {
 public:
 	UVCCameraData(PipelineHandler *pipe)
-		: Camera::Private(pipe)
+		: Camera::Private(pipe), useDecoder_(false)
 	{
 	}
 
@@ -46,14 +162,62 @@ public:
 			ControlInfoMap::Map *ctrls);
 	void bufferReady(FrameBuffer *buffer);
 
+	bool needsDecoding(const PixelFormat &pixelFormat, const Size &size) const;
+	V4L2PixelFormat captureFormat(const PixelFormat &pixelFormat,
+				      const Size &size) const;
+
 	const std::string &id() const { return id_; }
 
+	int startMetadata();
+	void stopMetadata();
+
 	std::unique_ptr<V4L2VideoDevice> video_;
 	Stream stream_;
 	std::map<PixelFormat, std::vector<SizeRange>> formats_;
 
+	/*
+	 * The optional metadata video node, capturing the UVC payload headers
+	 * used to timestamp the frames.
+	 */
+	static constexpr unsigned int kMetadataBufferCount = 8;
+
+	std::unique_ptr<V4L2VideoDevice> metadata_;
+	std::vector<std::unique_ptr<FrameBuffer>> metadataBuffers_;
+	std::vector<MappedFrameBuffer> metadataMaps_;
+	UVCClock clock_;
+	std::map<uint32_t, std::optional<uint64_t>> timestamps_;
+	std::queue<FrameBuffer *> pendingBuffers_;
+
+	/*
+	 * Formats and sizes only available by decoding MJPEG, and whether the
+	 * current configuration decodes MJPEG.
+	 */
+	std::map<PixelFormat, std::vector<SizeRange>> decodedFormats_;
+	bool useDecoder_;
+
+#if HAVE_LIBJPEG
+	static constexpr unsigned int kMjpegBufferCount = 4;
+
+	void cancelPendingRequests();
+
+	std::unique_ptr<MjpegDecoder> decoder_;
+	std::vector<std::unique_ptr<FrameBuffer>> mjpegBuffers_;
+	std::queue<Request *> pendingRequests_;
+	bool streaming_ = false;
+#endif
+
 private:
 	bool generateId();
+	void initMetadata(MediaDevice *media);
+	void metadataBufferReady(FrameBuffer *buffer);
+	std::optional<uint64_t> parseMetadata(Span<const uint8_t> data);
+	void completePendingBuffers(bool flush = false);
+	void frameReady(FrameBuffer *buffer, uint64_t timestamp);
+#if HAVE_LIBJPEG
+	void addDecodedFormats();
+	void mjpegBufferReady(FrameBuffer *buffer, uint64_t timestamp);
+	void decoderBufferReady(FrameBuffer *input, FrameBuffer *output);
+#endif
 
 	std::string id_;
 };
@@ -97,6 +261,14 @@ private:
 	{
 		return static_cast<UVCCameraData *>(camera->_d());
 	}
+
+#if HAVE_LIBJPEG
+	int exportDecodedBuffers(Stream *stream, unsigned int count,
+				 std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+	int startDecoding(UVCCameraData *data);
+
+	DmaBufAllocator dmaHeap_;
+#endif
 };
 
 UVCCameraConfiguration::UVCCameraConfiguration(UVCCameraData *data)
@@ -155,7 +327,7 @@ CameraConfiguration::Status UVCCameraConfiguration::validate()
 	cfg.bufferCount = 4;
 
 	V4L2DeviceFormat format;
-	format.fourcc = data_->video_->toV4L2PixelFormat(cfg.pixelFormat);
+	format.fourcc = data_->captureFormat(cfg.pixelFormat, cfg.size);
 	format.size = cfg.size;
 
 	int ret = data_->video_->tryFormat(&format);
@@ -165,6 +337,12 @@ CameraConfiguration::Status UVCCameraConfiguration::validate()
 	cfg.stride = format.planes[0].bpl;
 	cfg.frameSize = format.planes[0].size;
 
+#if HAVE_LIBJPEG
+	if (data_->needsDecoding(cfg.pixelFormat, cfg.size))
+		std::tie(cfg.stride, cfg.frameSize) =
+			MjpegDecoder::strideAndFrameSize(cfg.pixelFormat, cfg.size);
+#endif
+
 	if (cfg.colorSpace != format.colorSpace) {
 		cfg.colorSpace = format.colorSpace;
 		status = Adjusted;
@@ -175,6 +353,11 @@ CameraConfiguration::Status UVCCameraConfiguration::validate()
 
 PipelineHandlerUVC::PipelineHandlerUVC(CameraManager *manager)
 	: PipelineHandler(manager)
+#if HAVE_LIBJPEG
+	  , dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+		     DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+		     DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf)
+#endif
 {
 }
 
@@ -192,8 +375,21 @@ PipelineHandlerUVC::generateConfiguration(Camera *camera,
 	StreamFormats formats(data->formats_);
 	StreamConfiguration cfg(formats);
 
-	cfg.pixelFormat = formats.pixelformats().front();
-	cfg.size = formats.sizes(cfg.pixelFormat).back();
+	/*
+	 * Default to the largest size of the first format the camera produces
+	 * natively, decoding MJPEG is only used when explicitly requested.
+	 */
+	for (const PixelFormat &pixelFormat : formats.pixelformats()) {
+		for (const Size &size : formats.sizes(pixelFormat)) {
+			if (!data->needsDecoding(pixelFormat, size))
+				cfg.size = size;
+		}
+
+		if (!cfg.size.isNull()) {
+			cfg.pixelFormat = pixelFormat;
+			break;
+		}
+	}
 	cfg.bufferCount = 4;
 
 	config->addConfiguration(cfg);
@@ -210,7 +406,7 @@ int PipelineHandlerUVC::configure(Camera *camera, CameraConfiguration *config)
 	int ret;
 
 	V4L2DeviceFormat format;
-	format.fourcc = data->video_->toV4L2PixelFormat(cfg.pixelFormat);
+	format.fourcc = data->captureFormat(cfg.pixelFormat, cfg.size);
 	format.size = cfg.size;
 
 	ret = data->video_->setFormat(&format);
@@ -218,9 +414,19 @@ int PipelineHandlerUVC::configure(Camera *camera, CameraConfiguration *config)
 		return ret;
 
 	if (format.size != cfg.size ||
-	    format.fourcc != data->video_->toV4L2PixelFormat(cfg.pixelFormat))
+	    format.fourcc != data->captureFormat(cfg.pixelFormat, cfg.size))
 		return -EINVAL;
 
+	data->useDecoder_ = data->needsDecoding(cfg.pixelFormat, cfg.size);
+
+#if HAVE_LIBJPEG
+	if (data->useDecoder_) {
+		ret = data->decoder_->configure(cfg.pixelFormat, cfg.size);
+		if (ret)
+			return ret;
+	}
+#endif
+
 	cfg.setStream(&data->stream_);
 
 	return 0;
@@ -232,21 +438,131 @@ int PipelineHandlerUVC::exportFrameBuffers(Camera *camera, Stream *stream,
 	UVCCameraData *data = cameraData(camera);
 	unsigned int count = stream->configuration().bufferCount;
 
+#if HAVE_LIBJPEG
+	if (data->useDecoder_)
+		return exportDecodedBuffers(stream, count, buffers);
+#endif
+
 	return data->video_->exportBuffers(count, buffers);
 }
 
+#if HAVE_LIBJPEG
+/*
+ * Decoded frames are written by the CPU, allocate the buffers from a dma-buf
+ * heap instead of the video device. The planes of multi-planar formats are
+ * stored contiguously in a single dma-buf.
+ */
+int PipelineHandlerUVC::exportDecodedBuffers(Stream *stream, unsigned int count,
+					     std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (!dmaHeap_.isValid())
+		return -ENOMEM;
+
+	const StreamConfiguration &cfg = stream->configuration();
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+
+	for (unsigned int i = 0; i < count; i++) {
+		const std::string name = "uvc-frame-" + std::to_string(i);
+
+		std::vector<FrameBuffer::Plane> planes(info.numPlanes());
+		unsigned int offset = 0;
+
+		for (auto [j, plane] : utils::enumerate(planes)) {
+			unsigned int stride = cfg.stride
+					    * info.planes[j].bytesPerGroup
+					    / info.planes[0].bytesPerGroup;
+
+			plane.offset = offset;
+			plane.length = info.planeSize(cfg.size.height, j, stride);
+			offset += plane.length;
+		}
+
+		std::unique_ptr<FrameBuffer> buffer =
+			dmaHeap_.exportFrameBuffer(name.c_str(), cfg.frameSize,
+						   std::move(planes));
+		if (!buffer) {
+			LOG(UVC, Error) << "Failed to allocate a dma_buf";
+			return -ENOMEM;
+		}
+
+		buffers->push_back(std::move(buffer));
+	}
+
+	return count;
+}
+
+/*
+ * When decoding, capture to internal MJPEG buffers, all queued to the device.
+ * Captured frames are decoded to the buffer of the oldest pending request, or
+ * dropped if no request is pending.
+ */
+int PipelineHandlerUVC::startDecoding(UVCCameraData *data)
+{
+	int ret = data->video_->allocateBuffers(UVCCameraData::kMjpegBufferCount,
+						&data->mjpegBuffers_);
+	if (ret < 0)
+		return ret;
+
+	for (std::unique_ptr<FrameBuffer> &buffer : data->mjpegBuffers_) {
+		ret = data->video_->queueBuffer(buffer.get());
+		if (ret < 0)
+			goto error;
+	}
+
+	ret = data->decoder_->start();
+	if (ret < 0)
+		goto error;
+
+	data->streaming_ = true;
+
+	ret = data->video_->streamOn();
+	if (ret < 0) {
+		data->streaming_ = false;
+		data->decoder_->stop();
+		goto error;
+	}
+
+	return 0;
+
+error:
+	data->video_->releaseBuffers();
+	data->mjpegBuffers_.clear();
+	return ret;
+}
+#endif
+
 int PipelineHandlerUVC::start(Camera *camera, [[maybe_unused]] const ControlList *controls)
 {
 	UVCCameraData *data = cameraData(camera);
 	unsigned int count = data->stream_.configuration().bufferCount;
+	int ret;
 
-	int ret = data->video_->importBuffers(count);
-	if (ret < 0)
+	/* Timestamp the frames from the metadata if available. */
+	if (data->metadata_ && data->startMetadata() < 0) {
+		LOG(UVC, Warning)
+			<< "Failed to start metadata capture, using buffer timestamps";
+		data->stopMetadata();
+	}
+
+#if HAVE_LIBJPEG
+	if (data->useDecoder_) {
+		ret = startDecoding(data);
+		if (ret < 0)
+			data->stopMetadata();
+		return ret;
+	}
+#endif
+
+	ret = data->video_->importBuffers(count);
+	if (ret < 0) {
+		data->stopMetadata();
 		return ret;
+	}
 
 	ret = data->video_->streamOn();
 	if (ret < 0) {
 		data->video_->releaseBuffers();
+		data->stopMetadata();
 		return ret;
 	}
 
@@ -256,8 +572,27 @@ int PipelineHandlerUVC::start(Camera *camera, [[maybe_unused]] const ControlList
 void PipelineHandlerUVC::stopDevice(Camera *camera)
 {
 	UVCCameraData *data = cameraData(camera);
+
+#if HAVE_LIBJPEG
+	data->streaming_ = false;
+#endif
+
 	data->video_->streamOff();
+	data->stopMetadata();
+
+#if HAVE_LIBJPEG
+	if (data->useDecoder_) {
+		/* Complete the frames being decoded, and cancel the others. */
+		data->decoder_->stop();
+		data->cancelPendingRequests();
+	}
+#endif
+
 	data->video_->releaseBuffers();
+
+#if HAVE_LIBJPEG
+	data->mjpegBuffers_.clear();
+#endif
 }
 
 int PipelineHandlerUVC::processControl(ControlList *controls, unsigned int id,
@@ -377,6 +712,13 @@ int PipelineHandlerUVC::queueRequestDevice(Camera *camera, Request *request)
 	if (ret < 0)
 		return ret;
 
+#if HAVE_LIBJPEG
+	if (data->useDecoder_) {
+		data->pendingRequests_.push(request);
+		return 0;
+	}
+#endif
+
 	ret = data->video_->queueBuffer(buffer);
 	if (ret < 0)
 		return ret;
@@ -434,6 +776,8 @@ int UVCCameraData::init(MediaDevice *media)
 
 	video_->bufferReady.connect(this, &UVCCameraData::bufferReady);
 
+	initMetadata(media);
+
 	/* Generate the camera ID. */
 	if (!generateId()) {
 		LOG(UVC, Error) << "Failed to generate camera ID";
@@ -459,6 +803,10 @@ int UVCCameraData::init(MediaDevice *media)
 		}
 	}
 
+#if HAVE_LIBJPEG
+	addDecodedFormats();
+#endif
+
 	if (formats_.empty()) {
 		LOG(UVC, Error)
 			<< "Camera " << id_ << " (" << media->model()
@@ -512,6 +860,8 @@ int UVCCameraData::init(MediaDevice *media)
 
 	controlInfo_ = ControlInfoMap(std::move(ctrls), controls::controls);
 
+	metadataIds_ = { &controls::SensorTimestamp };
+
 	return 0;
 }
 
@@ -697,18 +1047,360 @@ void UVCCameraData::addControl(uint32_t cid, const ControlInfo &v4l2Info,
 	ctrls->emplace(id, info);
 }
 
+#if HAVE_LIBJPEG
+/*
+ * Expose the sizes the camera only produces in MJPEG in the formats of the
+ * decoder, to let applications use them without decoding MJPEG themselves.
+ * Only discrete sizes are handled, which is what UVC cameras report.
+ */
+void UVCCameraData::addDecodedFormats()
+{
+	auto mjpeg = formats_.find(formats::MJPEG);
+	if (mjpeg == formats_.end())
+		return;
+
+	auto isDiscrete = [](const SizeRange &range) {
+		return range.min == range.max;
+	};
+
+	const std::vector<SizeRange> &mjpegRanges = mjpeg->second;
+	if (!std::all_of(mjpegRanges.begin(), mjpegRanges.end(), isDiscrete))
+		return;
+
+	for (const PixelFormat &pixelFormat : MjpegDecoder::formats()) {
+		std::vector<SizeRange> &ranges = formats_[pixelFormat];
+		if (!std::all_of(ranges.begin(), ranges.end(), isDiscrete))
+			continue;
+
+		std::vector<SizeRange> decoded;
+
+		for (const SizeRange &range : mjpegRanges) {
+			const Size &size = range.min;
+
+			if (size.width % 2 || size.height % 2)
+				continue;
+
+			if (std::find(ranges.begin(), ranges.end(), range) != ranges.end())
+				continue;
+
+			decoded.push_back(range);
+		}
+
+		if (decoded.empty()) {
+			if (ranges.empty())
+				formats_.erase(pixelFormat);
+			continue;
+		}
+
+		ranges.insert(ranges.end(), decoded.begin(), decoded.end());
+		decodedFormats_[pixelFormat] = std::move(decoded);
+	}
+
+	if (decodedFormats_.empty())
+		return;
+
+	decoder_ = std::make_unique<MjpegDecoder>();
+	decoder_->bufferReady.connect(this, &UVCCameraData::decoderBufferReady);
+}
+
+void UVCCameraData::mjpegBufferReady(FrameBuffer *buffer, uint64_t timestamp)
+{
+	if (!streaming_ || buffer->metadata().status == FrameMetadata::FrameCancelled)
+		return;
+
+	/* Drop the frame if no request is waiting for it. */
+	if (pendingRequests_.empty()) {
+		video_->queueBuffer(buffer);
+		return;
+	}
+
+	Request *request = pendingRequests_.front();
+	pendingRequests_.pop();
+
+	request->metadata().set(controls::SensorTimestamp, timestamp);
+
+	FrameBuffer *output = request->findBuffer(&stream_);
+
+	if (buffer->metadata().status != FrameMetadata::FrameSuccess) {
+		output->_d()->metadata().status = buffer->metadata().status;
+		pipe()->completeBuffer(request, output);
+		pipe()->completeRequest(request);
+		video_->queueBuffer(buffer);
+		return;
+	}
+
+	decoder_->queueBuffers(buffer, output);
+}
+
+void UVCCameraData::decoderBufferReady(FrameBuffer *input, FrameBuffer *output)
+{
+	Request *request = output->request();
+
+	pipe()->completeBuffer(request, output);
+	pipe()->completeRequest(request);
+
+	if (streaming_)
+		video_->queueBuffer(input);
+}
+
+void UVCCameraData::cancelPendingRequests()
+{
+	while (!pendingRequests_.empty()) {
+		Request *request = pendingRequests_.front();
+		pendingRequests_.pop();
+
+		FrameBuffer *output = request->findBuffer(&stream_);
+		output->_d()->cancel();
+
+		pipe()->completeBuffer(request, output);
+		pipe()->completeRequest(request);
+	}
+}
+#endif
+
+bool UVCCameraData::needsDecoding(const PixelFormat &pixelFormat,
+				  const Size &size) const
+{
+	auto it = decodedFormats_.find(pixelFormat);
+	if (it == decodedFormats_.end())
+		return false;
+
+	return std::any_of(it->second.begin(), it->second.end(),
+			   [&](const SizeRange &range) { return range.contains(size); });
+}
+
+/* Retrieve the V4L2 format to capture for the given output format and size. */
+V4L2PixelFormat UVCCameraData::captureFormat(const PixelFormat &pixelFormat,
+					     const Size &size) const
+{
+	if (needsDecoding(pixelFormat, size))
+		return video_->toV4L2PixelFormat(formats::MJPEG);
+
+	return video_->toV4L2PixelFormat(pixelFormat);
+}
+
 void UVCCameraData::bufferReady(FrameBuffer *buffer)
 {
+	/*
+	 * Wait for the metadata of the frame if the metadata node is used.
+	 * The driver completes the metadata buffer before the video buffer,
+	 * but their events may be processed in any order.
+	 */
+	if (!metadataBuffers_.empty() &&
+	    buffer->metadata().status != FrameMetadata::FrameCancelled) {
+		pendingBuffers_.push(buffer);
+		completePendingBuffers();
+		return;
+	}
+
+	frameReady(buffer, buffer->metadata().timestamp);
+}
+
+void UVCCameraData::frameReady(FrameBuffer *buffer, uint64_t timestamp)
+{
+#if HAVE_LIBJPEG
+	if (useDecoder_) {
+		mjpegBufferReady(buffer, timestamp);
+		return;
+	}
+#endif
+
 	Request *request = buffer->request();
 
-	/* \todo Use the UVC metadata to calculate a more precise timestamp */
-	request->metadata().set(controls::SensorTimestamp,
-				buffer->metadata().timestamp);
+	request->metadata().set(controls::SensorTimestamp, timestamp);
 
 	pipe()->completeBuffer(request, buffer);
 	pipe()->completeRequest(request);
 }
 
+/*
+ * Locate the metadata video node of the camera. It is optional, older kernels
+ * don't expose it, and the camera is then timestamped with the video buffers
+ * timestamps.
+ */
+void UVCCameraData::initMetadata(MediaDevice *media)
+{
+	for (MediaEntity *entity : media->entities()) {
+		if (entity->flags() & MEDIA_ENT_FL_DEFAULT ||
+		    entity->function() != MEDIA_ENT_F_IO_V4L)
+			continue;
+
+		auto metadata = std::make_unique<V4L2VideoDevice>(entity);
+		if (metadata->open() < 0 || !metadata->caps().isMetaCapture())
+			continue;
+
+		V4L2DeviceFormat format;
+		format.fourcc = V4L2PixelFormat(V4L2_META_FMT_UVC);
+		if (metadata->setFormat(&format) < 0 ||
+		    format.fourcc != V4L2PixelFormat(V4L2_META_FMT_UVC))
+			continue;
+
+		metadata->bufferReady.connect(this, &UVCCameraData::metadataBufferReady);
+		metadata_ = std::move(metadata);
+
+		LOG(UVC, Debug)
+			<< "Using metadata node " << metadata_->deviceNode();
+		return;
+	}
+}
+
+int UVCCameraData::startMetadata()
+{
+	int ret = metadata_->allocateBuffers(kMetadataBufferCount,
+					     &metadataBuffers_);
+	if (ret < 0)
+		return ret;
+
+	for (auto [i, buffer] : utils::enumerate(metadataBuffers_)) {
+		buffer->setCookie(i);
+		metadataMaps_.emplace_back(buffer.get(),
+					   MappedFrameBuffer::MapFlag::Read);
+		if (!metadataMaps_.back().isValid())
+			return -ENOMEM;
+
+		ret = metadata_->queueBuffer(buffer.get());
+		if (ret < 0)
+			return ret;
+	}
+
+	clock_.reset();
+
+	return metadata_->streamOn();
+}
+
+void UVCCameraData::stopMetadata()
+{
+	if (!metadata_)
+		return;
+
+	metadata_->streamOff();
+
+	/* Complete the frames still waiting for their metadata. */
+	completePendingBuffers(true);
+	timestamps_.clear();
+
+	metadataMaps_.clear();
+	metadata_->releaseBuffers();
+	metadataBuffers_.clear();
+}
+
+/*
+ * The metadata buffer contains one uvc_meta_buf block per payload header:
+ *
+ *	struct uvc_meta_buf {
+ *		__u64 ns;	(system time when the header was received)
+ *		__u16 sof;	(USB frame number when the header was received)
+ *		__u8 length;	(header length, including length and flags)
+ *		__u8 flags;
+ *		__u8 buf[];
+ *	} __packed;
+ *
+ * The header contains the PTS and SCR fields when flagged in the flags.
+ * Return the PTS of the frame converted to the system clock, if available.
+ */
+std::optional<uint64_t> UVCCameraData::parseMetadata(Span<const uint8_t> data)
+{
+	static constexpr unsigned int kBlockHeaderSize = 10;
+	static constexpr uint8_t kHeaderPts = 1 << 2;
+	static constexpr uint8_t kHeaderScr = 1 << 3;
+
+	std::optional<uint32_t> pts;
+	bool hasScr = false;
+
+	while (data.size() >= kBlockHeaderSize + 2) {
+		uint64_t ns;
+		uint16_t hostSof;
+		memcpy(&ns, data.data(), sizeof(ns));
+		memcpy(&hostSof, data.data() + 8, sizeof(hostSof));
+
+		unsigned int length = data[kBlockHeaderSize];
+		uint8_t flags = data[kBlockHeaderSize + 1];
+		if (length < 2 || data.size() < kBlockHeaderSize + length)
+			break;
+
+		const uint8_t *header = data.data() + kBlockHeaderSize + 2;
+		unsigned int fieldsSize = length - 2;
+
+		unsigned int ptsSize = flags & kHeaderPts ? 4 : 0;
+		if (ptsSize && fieldsSize >= ptsSize && !pts) {
+			uint32_t value;
+			memcpy(&value, header, sizeof(value));
+			pts = value;
+		}
+
+		/* Use one clock sample per frame, from the first SCR. */
+		if (flags & kHeaderScr && fieldsSize >= ptsSize + 6 && !hasScr) {
+			uint32_t stc;
+			uint16_t deviceSof;
+			memcpy(&stc, header + ptsSize, sizeof(stc));
+			memcpy(&deviceSof, header + ptsSize + 4, sizeof(deviceSof));
+
+			clock_.addSample(stc, deviceSof & 0x7ff, ns, hostSof & 0x7ff);
+			hasScr = true;
+		}
+
+		data = data.subspan(kBlockHeaderSize + length);
+	}
+
+	if (!pts)
+		return std::nullopt;
+
+	return clock_.convert(*pts);
+}
+
+void UVCCameraData::metadataBufferReady(FrameBuffer *buffer)
+{
+	const FrameMetadata &metadata = buffer->metadata();
+	if (metadata.status == FrameMetadata::FrameCancelled)
+		return;
+
+	std::optional<uint64_t> timestamp;
+
+	if (metadata.status == FrameMetadata::FrameSuccess) {
+		Span<const uint8_t> data = metadataMaps_[buffer->cookie()].planes()[0];
+		timestamp = parseMetadata(data.first(std::min<size_t>(metadata.planes()[0].bytesused,
+								      data.size())));
+	}
+
+	timestamps_[metadata.sequence] = timestamp;
+
+	/* Don't accumulate metadata for frames not captured by the video node. */
+	while (timestamps_.size() > kMetadataBufferCount)
+		timestamps_.erase(timestamps_.begin());
+
+	metadata_->queueBuffer(buffer);
+
+	completePendingBuffers();
+}
+
+/*
+ * Complete the video buffers whose metadata is available, using the buffer
+ * timestamp when the metadata has no usable timestamp. Buffers whose metadata
+ * has been skipped, or all buffers if \a flush is set, are completed with
+ * their buffer timestamp.
+ */
+void UVCCameraData::completePendingBuffers(bool flush)
+{
+	while (!pendingBuffers_.empty()) {
+		FrameBuffer *buffer = pendingBuffers_.front();
+		uint32_t sequence = buffer->metadata().sequence;
+		uint64_t timestamp = buffer->metadata().timestamp;
+
+		auto it = timestamps_.find(sequence);
+		if (it != timestamps_.end()) {
+			if (it->second)
+				timestamp = *it->second;
+			timestamps_.erase(timestamps_.begin(), std::next(it));
+		} else if (!flush && (timestamps_.empty() ||
+				      timestamps_.rbegin()->first < sequence)) {
+			break;
+		}
+
+		pendingBuffers_.pop();
+		frameReady(buffer, timestamp);
+	}
+}
+
 REGISTER_PIPELINE_HANDLER(PipelineHandlerUVC, "uvcvideo")
 
 } /* namespace libcamera */
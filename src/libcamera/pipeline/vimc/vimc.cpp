@@ -591,6 +591,8 @@ int VimcCameraData::init()
 	/* Initialize the camera properties. */
 	properties_ = sensor_->properties();
 
+	metadataIds_ = { &controls::SensorTimestamp };
+
 	return 0;
 }
 
@@ -612,9 +614,10 @@ void VimcCameraData::bufferReady(FrameBuffer *buffer)
 		return;
 	}
 
-	/* Record the sensor's timestamp in the request metadata. */
-	request->metadata().set(controls::SensorTimestamp,
-				buffer->metadata().timestamp);
+	/* Report the sensor's timestamp in the request metadata. */
+	ControlList metadata(controls::controls);
+	metadata.set(controls::SensorTimestamp, buffer->metadata().timestamp);
+	pipe->metadataAvailable(request, metadata);
 
 	pipe->completeBuffer(request, buffer);
 	pipe->completeRequest(request);
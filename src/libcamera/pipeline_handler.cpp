@@ -7,7 +7,9 @@
 
 #include "libcamera/internal/pipeline_handler.h"
 
+#include <algorithm>
 #include <chrono>
+#include <errno.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 
@@ -21,6 +23,7 @@
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_manager.h"
+#include "libcamera/internal/camera_sensor_properties.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
@@ -58,6 +61,25 @@ LOG_DEFINE_CATEGORY(Pipeline)
  * They implement std::enable_shared_from_this<> in order to create new
  * std::shared_ptr<> in code paths originating from member functions of the
  * PipelineHandler class where only the 'this' pointer is available.
+ *
+ * \section pipeline-handler-thread Pipeline Handler Thread
+ *
+ * Each pipeline handler instance is bound to a single thread, called the
+ * pipeline handler thread, in which it is created and matched, and from which
+ * all its functions are called. All the objects it creates, including its
+ * cameras, their Camera::Private data and their devices, are bound to the same
+ * thread, and their signals, event notifiers and timers are delivered there.
+ * This is the CameraManager thread by default. When the
+ * LIBCAMERA_PIPELINE_THREADS environment variable is set, the pipeline handler
+ * instances are distributed over a pool of dedicated threads, in which case
+ * the pipeline handlers of different cameras run concurrently.
+ *
+ * Pipeline handlers shall therefore not share state across instances without
+ * locking, and shall not access objects owned by other pipeline handler
+ * instances. The DeviceEnumerator and the IPAManager are only accessed from
+ * match(), which the camera manager calls for one pipeline handler at a time
+ * while the CameraManager thread waits. Media devices are acquired by a single
+ * pipeline handler instance, and are only accessed from its thread.
  */
 
 /**
@@ -69,7 +91,7 @@ LOG_DEFINE_CATEGORY(Pipeline)
  * through the PipelineHandlerFactoryBase::create() function.
  */
 PipelineHandler::PipelineHandler(CameraManager *manager)
-	: manager_(manager), useCount_(0)
+	: manager_(manager), queueingBatch_(false), useCount_(0)
 {
 }
 
@@ -106,7 +128,7 @@ PipelineHandler::~PipelineHandler()
  * If this function returns true, a new instance of the pipeline handler will
  * be created and its match() function called.
  *
- * \context This function is called from the CameraManager thread.
+ * \context This function is called from the pipeline handler thread.
  *
  * \return true if media devices have been acquired and camera instances
  * created, or false otherwise
@@ -124,7 +146,7 @@ PipelineHandler::~PipelineHandler()
  * device explicitly, it will be automatically released when the pipeline
  * handler is destroyed.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the pipeline handler thread.
  *
  * \return A pointer to the matching MediaDevice, or nullptr if no match is found
  */
@@ -272,7 +294,7 @@ void PipelineHandler::unlockMediaDevices()
  * instance to each StreamConfiguration entry in the CameraConfiguration using
  * the StreamConfiguration::setStream() function.
  *
- * \context This function is called from the CameraManager thread.
+ * \context This function is called from the pipeline handler thread.
  *
  * \return 0 on success or a negative error code otherwise
  */
@@ -295,12 +317,37 @@ void PipelineHandler::unlockMediaDevices()
  *
  * The only intended caller is Camera::exportFrameBuffers().
  *
- * \context This function is called from the CameraManager thread.
+ * \context This function is called from the pipeline handler thread.
  *
  * \return The number of allocated buffers on success or a negative error code
  * otherwise
  */
 
+/**
+ * \brief Set the hardware synchronisation mode of a camera
+ * \param[in] camera The camera
+ * \param[in] mode The synchronisation mode
+ *
+ * Set the camera sensor of \a camera to generate the frame synchronisation
+ * signal of a group of cameras, to start its frames on that signal, or to run
+ * freely. The intended caller of this function is the CameraGroup class, which
+ * calls it on configured cameras before starting them, and on stopped cameras
+ * to return them to free running mode.
+ *
+ * Pipeline handlers that support hardware synchronisation shall override this
+ * function. The default implementation only accepts SensorSyncMode::Off.
+ *
+ * \context This function is called from the pipeline handler thread.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOTSUP The camera doesn't support the synchronisation \a mode
+ */
+int PipelineHandler::setSyncMode([[maybe_unused]] Camera *camera,
+				 SensorSyncMode mode)
+{
+	return mode == SensorSyncMode::Off ? 0 : -ENOTSUP;
+}
+
 /**
  * \fn PipelineHandler::start()
  * \brief Start capturing from a group of streams
@@ -312,7 +359,7 @@ void PipelineHandler::unlockMediaDevices()
  * which will in turn be called from the application to indicate that it has
  * configured the streams and is ready to capture.
  *
- * \context This function is called from the CameraManager thread.
+ * \context This function is called from the pipeline handler thread.
  *
  * \return 0 on success or a negative error code otherwise
  */
@@ -324,17 +371,22 @@ void PipelineHandler::unlockMediaDevices()
  * This function stops capturing and processing requests immediately. All
  * pending requests are cancelled and complete immediately in an error state.
  *
- * \context This function is called from the CameraManager thread.
+ * \context This function is called from the pipeline handler thread.
  */
 void PipelineHandler::stop(Camera *camera)
 {
 	/* Stop the pipeline handler and let the queued requests complete. */
 	stopDevice(camera);
 
-	/* Cancel and signal as complete all waiting requests. */
-	while (!waitingRequests_.empty()) {
-		Request *request = waitingRequests_.front();
-		waitingRequests_.pop();
+	/* Cancel and signal as complete all waiting requests of the camera. */
+	for (auto it = waitingRequests_.begin(); it != waitingRequests_.end();) {
+		Request *request = *it;
+		if (request->_d()->camera() != camera) {
+			++it;
+			continue;
+		}
+
+		it = eraseRequest(waitingRequests_, it);
 
 		request->_d()->cancel();
 		completeRequest(request);
@@ -345,6 +397,8 @@ void PipelineHandler::stop(Camera *camera)
 	ASSERT(data->queuedRequests_.empty());
 
 	data->requestSequence_ = 0;
+	data->resetFrameDrops();
+	data->resetBufferResidency();
 }
 
 /**
@@ -399,7 +453,9 @@ void PipelineHandler::registerRequest(Request *request)
  *
  * The queue of waiting requests is iterated and all prepared requests are
  * passed to the pipeline handler in the same order they have been queued by
- * calling this function.
+ * calling this function. A request that isn't prepared yet only holds back the
+ * requests of the same camera, except for the requests with a higher
+ * Request::priority(), which bypass it.
  *
  * If a Request fails during the preparation phase or if the pipeline handler
  * fails in queuing the request to the hardware the request is cancelled.
@@ -408,17 +464,91 @@ void PipelineHandler::registerRequest(Request *request)
  * when the pipeline handler is stopped with stop(). Request completion shall be
  * signalled by the pipeline handler using the completeRequest() function.
  *
- * \context This function is called from the CameraManager thread.
+ * \context This function is called from the pipeline handler thread.
  */
 void PipelineHandler::queueRequest(Request *request)
 {
 	LIBCAMERA_TRACEPOINT(request_queue, request);
 
-	waitingRequests_.push(request);
+	pushRequest(waitingRequests_, request);
 
 	request->_d()->prepare(300ms);
 }
 
+/**
+ * \brief Queue multiple requests
+ * \param[in] requests The requests to queue
+ *
+ * This function queues all the \a requests to the pipeline handler, as if by
+ * calling queueRequest() for each of them in order. Requests are all prepared
+ * before any of them is queued to the device, so that the requests that are
+ * ready are passed to queueRequestDevice() back-to-back. This allows device
+ * operations issued by the pipeline handler within the same event loop
+ * iteration to be batched, such as IPA messages.
+ *
+ * \context This function is called from the pipeline handler thread.
+ */
+void PipelineHandler::queueRequests(const std::vector<Request *> &requests)
+{
+	queueingBatch_ = true;
+
+	for (Request *request : requests)
+		queueRequest(request);
+
+	queueingBatch_ = false;
+
+	doQueueRequests();
+}
+
+/**
+ * \brief Append a request to a list of requests
+ * \param[in] list The request list
+ * \param[in] request The request to append
+ *
+ * Requests continuously move through the waiting and queued lists. To avoid
+ * allocating and freeing a list node for every request, nodes are recycled
+ * through a list of free nodes with std::list::splice().
+ */
+void PipelineHandler::pushRequest(std::list<Request *> &list, Request *request)
+{
+	if (freeRequestNodes_.empty()) {
+		list.push_back(request);
+		return;
+	}
+
+	list.splice(list.end(), freeRequestNodes_, freeRequestNodes_.begin());
+	list.back() = request;
+}
+
+/**
+ * \brief Remove the first request from a list of requests
+ * \param[in] list The request list
+ *
+ * The list node is kept for reuse by pushRequest().
+ */
+void PipelineHandler::popRequest(std::list<Request *> &list)
+{
+	freeRequestNodes_.splice(freeRequestNodes_.end(), list, list.begin());
+}
+
+/**
+ * \brief Remove a request from a list of requests
+ * \param[in] list The request list
+ * \param[in] pos The position of the request in the list
+ *
+ * The list node is kept for reuse by pushRequest().
+ *
+ * \return The position of the request that followed the removed request
+ */
+std::list<Request *>::iterator
+PipelineHandler::eraseRequest(std::list<Request *> &list,
+			      std::list<Request *>::iterator pos)
+{
+	auto next = std::next(pos);
+	freeRequestNodes_.splice(freeRequestNodes_.end(), list, pos);
+	return next;
+}
+
 /**
  * \brief Queue one requests to the device
  */
@@ -426,9 +556,19 @@ void PipelineHandler::doQueueRequest(Request *request)
 {
 	LIBCAMERA_TRACEPOINT(request_device_queue, request);
 
+	request->_d()->recordStage(Request::Private::StageDeviceQueued);
+
 	Camera *camera = request->_d()->camera();
 	Camera::Private *data = camera->_d();
-	data->queuedRequests_.push_back(request);
+
+	/*
+	 * The pipeline ran out of requests if none is in flight when a request
+	 * other than the first one is queued, frames may have been dropped.
+	 */
+	if (data->queuedRequests_.empty() && data->requestSequence_)
+		data->starved_ = true;
+
+	pushRequest(data->queuedRequests_, request);
 
 	request->_d()->sequence_ = data->requestSequence_++;
 
@@ -437,6 +577,8 @@ void PipelineHandler::doQueueRequest(Request *request)
 		return;
 	}
 
+	data->recordBuffersQueued(request);
+
 	int ret = queueRequestDevice(camera, request);
 	if (ret) {
 		request->_d()->cancel();
@@ -447,19 +589,44 @@ void PipelineHandler::doQueueRequest(Request *request)
 /**
  * \brief Queue prepared requests to the device
  *
- * Iterate the list of waiting requests and queue them to the device one
- * by one if they have been prepared.
+ * Iterate the list of waiting requests and queue them to the device one by one
+ * if they have been prepared. A request that isn't prepared holds back the
+ * following requests of the same camera, unless they have a higher priority.
+ * Requests held back in turn hold back the requests that follow them, such
+ * that requests never bypass requests of a higher or equal priority.
  */
 void PipelineHandler::doQueueRequests()
 {
-	while (!waitingRequests_.empty()) {
-		Request *request = waitingRequests_.front();
-		if (!request->_d()->prepared_)
-			break;
+	/* Requests are queued at the end of queueRequests(). */
+	if (queueingBatch_)
+		return;
 
+	for (auto it = waitingRequests_.begin(); it != waitingRequests_.end();) {
+		Request *request = *it;
+		const Camera *camera = request->_d()->camera();
+		int priority = request->_d()->priority_;
+
+		auto blocked = std::find_if(blockedCameras_.begin(), blockedCameras_.end(),
+					    [camera](const auto &entry) {
+						    return entry.first == camera;
+					    });
+		bool held = blocked != blockedCameras_.end() && priority <= blocked->second;
+
+		if (!request->_d()->prepared_ || held) {
+			if (blocked == blockedCameras_.end())
+				blockedCameras_.emplace_back(camera, priority);
+			else
+				blocked->second = std::max(blocked->second, priority);
+
+			++it;
+			continue;
+		}
+
+		it = eraseRequest(waitingRequests_, it);
 		doQueueRequest(request);
-		waitingRequests_.pop();
 	}
+
+	blockedCameras_.clear();
 }
 
 /**
@@ -474,7 +641,7 @@ void PipelineHandler::doQueueRequests()
  * parameters will be applied to the frames captured in the buffers provided in
  * the request.
  *
- * \context This function is called from the CameraManager thread.
+ * \context This function is called from the pipeline handler thread.
  *
  * \return 0 on success or a negative error code otherwise
  */
@@ -491,7 +658,7 @@ void PipelineHandler::doQueueRequests()
  * pipeline handlers a chance to perform any operation that may still be
  * needed. They shall complete requests explicitly with completeRequest().
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the pipeline handler thread.
  *
  * \return True if all buffers contained in the request have completed, false
  * otherwise
@@ -499,10 +666,37 @@ void PipelineHandler::doQueueRequests()
 bool PipelineHandler::completeBuffer(Request *request, FrameBuffer *buffer)
 {
 	Camera *camera = request->_d()->camera();
-	camera->bufferCompleted.emit(request, buffer);
+	camera->_d()->recordBufferCompleted(request, buffer);
+	camera->_d()->bufferComplete(request, buffer);
 	return request->_d()->completeBuffer(buffer);
 }
 
+/**
+ * \brief Report metadata for a request before it completes
+ * \param[in] request The request the metadata belongs to
+ * \param[in] metadata The metadata
+ *
+ * This function shall be called by pipeline handlers to report \a metadata for
+ * the \a request as soon as it becomes available, instead of only storing it
+ * in the request metadata. It merges \a metadata in the request metadata, and
+ * notifies applications with the Camera::metadataAvailable signal. Pipeline
+ * handlers shall not call this function once the request has been completed.
+ *
+ * \context This function shall be called from the pipeline handler thread.
+ */
+void PipelineHandler::metadataAvailable(Request *request, const ControlList &metadata)
+{
+	ASSERT(request->status() == Request::RequestPending);
+
+	request->metadata().merge(metadata);
+	request->_d()->recordStage(Request::Private::StageMetadata);
+
+	LIBCAMERA_TRACEPOINT(request_metadata_available, request);
+
+	Camera *camera = request->_d()->camera();
+	camera->_d()->metadataAvailable(request, metadata);
+}
+
 /**
  * \brief Signal request completion
  * \param[in] request The request that has completed
@@ -515,7 +709,7 @@ bool PipelineHandler::completeBuffer(Request *request, FrameBuffer *buffer)
  * submission order, the pipeline handler may call it on any complete request
  * without any ordering constraint.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the pipeline handler thread.
  */
 void PipelineHandler::completeRequest(Request *request)
 {
@@ -524,6 +718,11 @@ void PipelineHandler::completeRequest(Request *request)
 	request->_d()->complete();
 
 	Camera::Private *data = camera->_d();
+	data->detectFrameDrops(request);
+	data->recordRequestMetrics(request);
+
+	if (data->governor_ && request->status() == Request::RequestComplete)
+		data->governor_->requestCompleted(request->metadata());
 
 	while (!data->queuedRequests_.empty()) {
 		Request *req = data->queuedRequests_.front();
@@ -531,11 +730,35 @@ void PipelineHandler::completeRequest(Request *request)
 			break;
 
 		ASSERT(!req->hasPendingBuffers());
-		data->queuedRequests_.pop_front();
+		popRequest(data->queuedRequests_);
 		camera->requestComplete(req);
 	}
 }
 
+/**
+ * \brief Report a frame dropped by the pipeline handler
+ * \param[in] camera The camera that dropped the frame
+ * \param[in] sequence The sequence number of the dropped frame
+ * \param[in] cause The cause of the drop
+ *
+ * The pipeline handler core detects gaps in the sequence numbers of the buffers
+ * of completed requests, and reports them to applications in the FramesDropped
+ * and FrameDropCause metadata of the request that follows the gap. Drops are
+ * attributed to application starvation when the pipeline ran out of requests,
+ * and to the kernel otherwise.
+ *
+ * Pipeline handlers shall call this function when they drop a frame
+ * themselves, for instance when the ISP or IPA can't keep up with the sensor,
+ * to attribute the drop to the right \a cause.
+ *
+ * \context This function shall be called from the pipeline handler thread.
+ */
+void PipelineHandler::frameDropped(Camera *camera, uint32_t sequence,
+				   controls::FrameDropCauseEnum cause)
+{
+	camera->_d()->frameDropped(sequence, cause);
+}
+
 /**
  * \brief Retrieve the absolute path to a platform configuration file
  * \param[in] subdir The pipeline handler specific subdirectory name
@@ -599,7 +822,7 @@ std::string PipelineHandler::configurationFile(const std::string &subdir,
  * This function is called by pipeline handlers to register the cameras they
  * handle with the camera manager.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the pipeline handler thread.
  */
 void PipelineHandler::registerCamera(std::shared_ptr<Camera> camera)
 {
@@ -7,10 +7,15 @@
 
 #include "libcamera/internal/request.h"
 
+#include <algorithm>
 #include <map>
 #include <sstream>
+#include <string.h>
+#include <time.h>
 
+#include <libcamera/base/allocation_tracker.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
@@ -38,6 +43,16 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(Request)
 
+static bool timelineMetadataEnabled()
+{
+	static const bool enabled = [] {
+		const char *env = utils::secure_getenv("LIBCAMERA_REQUEST_TIMELINE");
+		return env && strcmp(env, "0");
+	}();
+
+	return enabled;
+}
+
 #ifndef __DOXYGEN_PUBLIC__
 /**
  * \class Request::Private
@@ -99,8 +114,13 @@ bool Request::Private::completeBuffer(FrameBuffer *buffer)
 {
 	LIBCAMERA_TRACEPOINT(request_complete_buffer, this, buffer);
 
-	int ret = pending_.erase(buffer);
-	ASSERT(ret == 1);
+	if (!timeline_[StageFirstBuffer])
+		recordStage(StageFirstBuffer);
+	recordStage(StageLastBuffer);
+
+	auto it = std::find(pending_.begin(), pending_.end(), buffer);
+	ASSERT(it != pending_.end());
+	pending_.erase(it);
 
 	buffer->_d()->setRequest(nullptr);
 
@@ -115,7 +135,8 @@ bool Request::Private::completeBuffer(FrameBuffer *buffer)
  *
  * Mark the request as complete by updating its status to RequestComplete,
  * unless buffers have been cancelled in which case the status is set to
- * RequestCancelled.
+ * RequestCancelled. The buffers of the request are notified of the completion
+ * through FrameBuffer::Private::requestComplete().
  */
 void Request::Private::complete()
 {
@@ -126,23 +147,44 @@ void Request::Private::complete()
 
 	request->status_ = cancelled_ ? RequestCancelled : RequestComplete;
 
+	for (const auto &[stream, buffer] : request->buffers())
+		buffer->_d()->requestComplete();
+
+	const auto sensorTimestamp = request->metadata().get(controls::SensorTimestamp);
+	if (sensorTimestamp)
+		timeline_[StageSensor] = *sensorTimestamp;
+	recordStage(StageCompleted);
+
+	if (timelineMetadataEnabled())
+		request->metadata().set(controls::RequestTimeline, timeline_);
+
+	if (AllocationTracker::enabled()) {
+		AllocationCounters allocations = AllocationTracker::process() - allocations_;
+		request->metadata().set(controls::HeapAllocations,
+					{ static_cast<int64_t>(allocations.allocations),
+					  static_cast<int64_t>(allocations.bytes) });
+	}
+
 	LOG(Request, Debug) << request->toString();
 
 	LIBCAMERA_TRACEPOINT(request_complete, this);
+	LIBCAMERA_TRACEPOINT(request_timeline, this);
 }
 
 void Request::Private::doCancelRequest()
 {
 	Request *request = _o<Request>();
 
+	/* Remove the fences before buffer completion lets them be closed. */
+	cancelFences();
+
 	for (FrameBuffer *buffer : pending_) {
 		buffer->_d()->cancel();
-		camera_->bufferCompleted.emit(request, buffer);
+		camera_->_d()->bufferComplete(request, buffer);
 	}
 
 	cancelled_ = true;
 	pending_.clear();
-	notifiers_.clear();
 	timer_.reset();
 }
 
@@ -176,10 +218,71 @@ void Request::Private::reset()
 	cancelled_ = false;
 	prepared_ = false;
 	pending_.clear();
-	notifiers_.clear();
+	pendingFences_ = 0;
 	timer_.reset();
+	timeline_ = {};
+	allocations_ = {};
 }
 
+/**
+ * \enum Request::Private::TimelineStage
+ * \brief Processing stages of a request recorded in its timeline
+ * \var Request::Private::StageQueued
+ * \brief The request has been queued to the camera by the application
+ * \var Request::Private::StageDeviceQueued
+ * \brief The request has been queued to the device by the pipeline handler
+ * \var Request::Private::StageSensor
+ * \brief The sensor has started exposing the frame, as reported by the
+ * SensorTimestamp metadata
+ * \var Request::Private::StageFirstBuffer
+ * \brief The first buffer of the request has completed
+ * \var Request::Private::StageLastBuffer
+ * \brief The last buffer of the request has completed
+ * \var Request::Private::StageMetadata
+ * \brief Metadata has last been reported before completion, typically when the
+ * IPA has processed the frame statistics
+ * \var Request::Private::StageCompleted
+ * \brief The request has been completed by the pipeline handler
+ * \var Request::Private::StageCount
+ * \brief The number of stages
+ */
+
+/**
+ * \brief Record the time at which the request reaches a processing stage
+ * \param[in] stage The processing stage
+ *
+ * The timeline stores, for each stage, the time at which the request has last
+ * reached it, in nanoseconds on the CLOCK_BOOTTIME clock used by the
+ * SensorTimestamp control. Stages that haven't been reached are set to 0. The
+ * timeline is reported with the request_timeline tracepoint when the request
+ * completes, and in the RequestTimeline metadata if enabled with the
+ * LIBCAMERA_REQUEST_TIMELINE environment variable.
+ *
+ * Recording the StageQueued stage also snapshots the heap allocation counters
+ * of the process, to report the allocations performed until completion in the
+ * HeapAllocations metadata when allocation tracking is enabled.
+ */
+void Request::Private::recordStage(TimelineStage stage)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+
+	timeline_[stage] = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
+	if (stage == StageQueued)
+		allocations_ = AllocationTracker::process();
+}
+
+/**
+ * \fn Request::Private::timeline()
+ * \brief Retrieve the processing timeline of the request
+ *
+ * \sa recordStage()
+ *
+ * \return The time at which the request reached each processing stage,
+ * indexed by TimelineStage
+ */
+
 /*
  * Helper function to save some lines of code and make sure prepared_ is set
  * to true before emitting the signal.
@@ -222,24 +325,23 @@ void Request::Private::emitPrepareCompleted()
  */
 void Request::Private::prepare(std::chrono::milliseconds timeout)
 {
-	/* Create and connect one notifier for each synchronization fence. */
+	/* Wait for all synchronization fences through the camera's waiter. */
+	FenceWaiter &waiter = camera_->_d()->fenceWaiter_;
+
 	for (FrameBuffer *buffer : pending_) {
-		const Fence *fence = buffer->_d()->fence();
-		if (!fence)
+		if (!buffer->_d()->fence())
 			continue;
 
-		std::unique_ptr<EventNotifier> notifier =
-			std::make_unique<EventNotifier>(fence->fd().get(),
-							EventNotifier::Read);
-
-		notifier->activated.connect(this, [this, buffer] {
-							notifierActivated(buffer);
-					    });
+		if (waiter.add(buffer) < 0) {
+			cancel();
+			emitPrepareCompleted();
+			return;
+		}
 
-		notifiers_[buffer] = std::move(notifier);
+		pendingFences_++;
 	}
 
-	if (notifiers_.empty()) {
+	if (!pendingFences_) {
 		emitPrepareCompleted();
 		return;
 	}
@@ -270,23 +372,30 @@ void Request::Private::prepare(std::chrono::milliseconds timeout)
  * if they have failed preparing.
  */
 
-void Request::Private::notifierActivated(FrameBuffer *buffer)
+/**
+ * \brief Handle the signalling of a buffer fence
+ * \param[in] buffer The buffer whose fence has been signalled
+ *
+ * This function is called by the camera's FenceWaiter when the fence of a
+ * \a buffer of the request has been signalled. Once all fences have been
+ * signalled, the prepared signal is emitted.
+ */
+void Request::Private::fenceSignalled(FrameBuffer *buffer)
 {
 	/* Close the fence if successfully signalled. */
 	ASSERT(buffer);
 	buffer->releaseFence();
 
-	/* Remove the entry from the map and check if other fences are pending. */
-	auto it = notifiers_.find(buffer);
-	ASSERT(it != notifiers_.end());
-	notifiers_.erase(it);
+	/* Check if other fences are pending. */
+	ASSERT(pendingFences_);
+	pendingFences_--;
 
 	Request *request = _o<Request>();
 	LOG(Request, Debug)
 		<< "Request " << request->cookie() << " buffer " << buffer
 		<< " fence signalled";
 
-	if (!notifiers_.empty())
+	if (pendingFences_)
 		return;
 
 	/* All fences completed, delete the timer and emit the prepared signal. */
@@ -294,11 +403,27 @@ void Request::Private::notifierActivated(FrameBuffer *buffer)
 	emitPrepareCompleted();
 }
 
+/*
+ * Stop waiting for the fences that haven't been signalled yet. Their buffers
+ * still hold the fence, which applications retrieve with
+ * FrameBuffer::releaseFence().
+ */
+void Request::Private::cancelFences()
+{
+	if (!pendingFences_)
+		return;
+
+	FenceWaiter &waiter = camera_->_d()->fenceWaiter_;
+	for (FrameBuffer *buffer : pending_)
+		waiter.remove(buffer);
+
+	pendingFences_ = 0;
+}
+
 void Request::Private::timeout()
 {
 	/* A timeout can only happen if there are fences not yet signalled. */
-	ASSERT(!notifiers_.empty());
-	notifiers_.clear();
+	ASSERT(pendingFences_);
 
 	Request *request = _o<Request>();
 	LOG(Request, Debug) << "Request prepare timeout: " << request->cookie();
@@ -356,13 +481,21 @@ Request::Request(Camera *camera, uint64_t cookie)
 	: Extensible(std::make_unique<Private>(camera)),
 	  cookie_(cookie), status_(RequestPending)
 {
-	controls_ = new ControlList(controls::controls,
-				    camera->_d()->validator());
+	Camera::Private *data = camera->_d();
+
+	/*
+	 * Reserve storage for all the controls the camera supports and all
+	 * the metadata it reports, to avoid reallocating the lists when the
+	 * request is recycled.
+	 */
+	controls_ = new ControlList(controls::controls, data->validator());
+	controls_->reserve(data->controlInfo_.size());
 
 	/**
 	 * \todo Add a validator for metadata controls.
 	 */
 	metadata_ = new ControlList(controls::controls);
+	metadata_->reserve(data->metadataIds_.size());
 
 	LIBCAMERA_TRACEPOINT(request_construct, this);
 
@@ -397,7 +530,7 @@ void Request::reuse(ReuseFlag flags)
 		for (auto pair : bufferMap_) {
 			FrameBuffer *buffer = pair.second;
 			buffer->_d()->setRequest(this);
-			_d()->pending_.insert(buffer);
+			_d()->pending_.push_back(buffer);
 		}
 	} else {
 		bufferMap_.clear();
@@ -482,7 +615,7 @@ int Request::addBuffer(const Stream *stream, FrameBuffer *buffer,
 	}
 
 	buffer->_d()->setRequest(this);
-	_d()->pending_.insert(buffer);
+	_d()->pending_.push_back(buffer);
 	bufferMap_[stream] = buffer;
 
 	/*
@@ -571,6 +704,37 @@ uint32_t Request::sequence() const
  * \return The request completion status
  */
 
+/**
+ * \brief Set the scheduling priority of the request
+ * \param[in] priority The request priority
+ *
+ * Requests are passed to the device in the order they have been queued to the
+ * camera, once their buffer fences have been signalled. By default, a request
+ * that waits for its fences holds back the requests queued after it to the same
+ * camera. A request with a higher priority than all the requests that hold it
+ * back bypasses them instead, and is passed to the device as soon as it is
+ * ready. Its completion is then signalled before the completion of the requests
+ * it has bypassed.
+ *
+ * The default priority is 0, and is kept when the request is reused. The
+ * priority shall not be changed while the request is queued. Applications that set priorities shall expect requests to complete out of
+ * order, and can use the request sequence() to track the order in which the
+ * requests have been passed to the device.
+ */
+void Request::setPriority(int priority)
+{
+	_d()->priority_ = priority;
+}
+
+/**
+ * \brief Retrieve the scheduling priority of the request
+ * \return The request priority
+ */
+int Request::priority() const
+{
+	return _d()->priority_;
+}
+
 /**
  * \brief Check if a request has buffers yet to be completed
  *
@@ -57,7 +57,7 @@ LOG_DEFINE_CATEGORY(CameraSensor)
  */
 CameraSensor::CameraSensor(const MediaEntity *entity)
 	: entity_(entity), pad_(UINT_MAX), staticProps_(nullptr),
-	  bayerFormat_(nullptr), supportFlips_(false),
+	  syncMode_(SensorSyncMode::Off), bayerFormat_(nullptr), supportFlips_(false),
 	  flipsAlterBayerOrder_(false), properties_(properties::properties)
 {
 }
@@ -143,6 +143,23 @@ int CameraSensor::init()
 	auto last = std::unique(sizes_.begin(), sizes_.end());
 	sizes_.erase(last, sizes_.end());
 
+	/*
+	 * Build the table of modes used by getFormat(), sorted by media bus
+	 * code. The sizes of each code are kept in the order reported by the
+	 * driver, which getFormat() uses to break ties.
+	 */
+	for (const auto &[code, ranges] : formats_) {
+		for (const SizeRange &range : ranges) {
+			const Size &size = range.max;
+			if (!size.height)
+				continue;
+
+			modes_.push_back({ code, size,
+					   static_cast<float>(size.width) / size.height,
+					   size.width * size.height });
+		}
+	}
+
 	/*
 	 * VIMC is a bit special, as it does not yet support all the mandatory
 	 * requirements regular sensors have to respect.
@@ -391,6 +408,7 @@ void CameraSensor::initStaticProperties()
 	properties_.set(properties::UnitCellSize, staticProps_->unitCellSize);
 
 	initTestPatternModes();
+	initSyncModes();
 }
 
 void CameraSensor::initTestPatternModes()
@@ -437,6 +455,51 @@ void CameraSensor::initTestPatternModes()
 	}
 }
 
+void CameraSensor::initSyncModes()
+{
+	const auto &syncModes = staticProps_->syncModes;
+	if (syncModes.empty())
+		return;
+
+	const auto &v4l2SyncMode = controls().find(staticProps_->syncModeControl);
+	if (v4l2SyncMode == controls().end()) {
+		LOG(CameraSensor, Debug)
+			<< "Synchronisation control "
+			<< utils::hex(staticProps_->syncModeControl)
+			<< " is not supported";
+		return;
+	}
+
+	/*
+	 * Only retain the modes whose values the driver accepts. Menu controls
+	 * list their valid values, integer controls only report a range.
+	 */
+	const ControlInfo &info = v4l2SyncMode->second;
+	for (const auto &[mode, value] : syncModes) {
+		bool supported;
+
+		if (!info.values().empty())
+			supported = std::any_of(info.values().begin(), info.values().end(),
+						[value = value](const ControlValue &v) {
+							return v.get<int32_t>() == value;
+						});
+		else
+			supported = value >= info.min().get<int32_t>() &&
+				    value <= info.max().get<int32_t>();
+
+		if (supported)
+			syncModes_.push_back(mode);
+	}
+
+	/* The sensor can't be synchronised if it can't be reset to free run. */
+	if (std::find(syncModes_.begin(), syncModes_.end(), SensorSyncMode::Off) ==
+	    syncModes_.end()) {
+		LOG(CameraSensor, Warning)
+			<< "Synchronisation modes ignored, free running mode not supported";
+		syncModes_.clear();
+	}
+}
+
 int CameraSensor::initProperties()
 {
 	model_ = subdev_->model();
@@ -701,29 +764,54 @@ Size CameraSensor::resolution() const
  */
 V4L2SubdeviceFormat CameraSensor::getFormat(const std::vector<unsigned int> &mbusCodes,
 					    const Size &size) const
+{
+	/*
+	 * Pipeline handlers call this function from validate(), which
+	 * applications may call repeatedly with the same configuration. Cache
+	 * the results, the sensor formats don't change after init().
+	 */
+	static constexpr unsigned int kMaxCachedFormats = 32;
+
+	FormatKey key{ mbusCodes, size };
+
+	MutexLocker locker(formatCacheMutex_);
+
+	auto iter = formatCache_.find(key);
+	if (iter != formatCache_.end())
+		return iter->second;
+
+	V4L2SubdeviceFormat format = findFormat(mbusCodes, size);
+
+	if (formatCache_.size() >= kMaxCachedFormats)
+		formatCache_.clear();
+	formatCache_.emplace(std::move(key), format);
+
+	return format;
+}
+
+V4L2SubdeviceFormat CameraSensor::findFormat(const std::vector<unsigned int> &mbusCodes,
+					     const Size &size) const
 {
 	unsigned int desiredArea = size.width * size.height;
 	unsigned int bestArea = UINT_MAX;
 	float desiredRatio = static_cast<float>(size.width) / size.height;
 	float bestRatio = FLT_MAX;
-	const Size *bestSize = nullptr;
-	uint32_t bestCode = 0;
+	const Mode *bestMode = nullptr;
 
 	for (unsigned int code : mbusCodes) {
-		const auto formats = formats_.find(code);
-		if (formats == formats_.end())
-			continue;
+		auto mode = std::lower_bound(modes_.begin(), modes_.end(), code,
+					     [](const Mode &m, unsigned int c) {
+						     return m.code < c;
+					     });
 
-		for (const SizeRange &range : formats->second) {
-			const Size &sz = range.max;
+		for (; mode != modes_.end() && mode->code == code; ++mode) {
+			const Size &sz = mode->size;
 
 			if (sz.width < size.width || sz.height < size.height)
 				continue;
 
-			float ratio = static_cast<float>(sz.width) / sz.height;
-			float ratioDiff = fabsf(ratio - desiredRatio);
-			unsigned int area = sz.width * sz.height;
-			unsigned int areaDiff = area - desiredArea;
+			float ratioDiff = fabsf(mode->ratio - desiredRatio);
+			unsigned int areaDiff = mode->area - desiredArea;
 
 			if (ratioDiff > bestRatio)
 				continue;
@@ -731,20 +819,19 @@ V4L2SubdeviceFormat CameraSensor::getFormat(const std::vector<unsigned int> &mbu
 			if (ratioDiff < bestRatio || areaDiff < bestArea) {
 				bestRatio = ratioDiff;
 				bestArea = areaDiff;
-				bestSize = &sz;
-				bestCode = code;
+				bestMode = &*mode;
 			}
 		}
 	}
 
-	if (!bestSize) {
+	if (!bestMode) {
 		LOG(CameraSensor, Debug) << "No supported format or size found";
 		return {};
 	}
 
 	V4L2SubdeviceFormat format{
-		.code = bestCode,
-		.size = *bestSize,
+		.code = bestMode->code,
+		.size = bestMode->size,
 		.colorSpace = ColorSpace::Raw,
 	};
 
@@ -808,6 +895,35 @@ int CameraSensor::tryFormat(V4L2SubdeviceFormat *format) const
 				  V4L2Subdevice::Whence::TryFormat);
 }
 
+/**
+ * \brief Set the analogue crop rectangle of the camera sensor
+ * \param[inout] crop The crop rectangle
+ *
+ * This function changes the portion of the pixel array read out by the sensor.
+ * The \a crop rectangle is expressed relative to the active pixel area, as
+ * IPACameraSensorInfo::analogCrop, and is updated with the rectangle applied by
+ * the driver.
+ *
+ * Changing the crop rectangle while the sensor is streaming is only possible
+ * with drivers that can move the readout window without changing the output
+ * format. Other drivers return an error, or adjust the crop rectangle to keep
+ * its size unchanged.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraSensor::setCrop(Rectangle *crop)
+{
+	Rectangle rect = crop->translatedBy(activeArea_.topLeft());
+
+	int ret = subdev_->setSelection(pad_, V4L2_SEL_TGT_CROP, &rect);
+	if (ret)
+		return ret;
+
+	*crop = rect.translatedBy(-activeArea_.topLeft());
+
+	return 0;
+}
+
 /**
  * \brief Apply a sensor configuration to the camera sensor
  * \param[in] config The sensor configuration
@@ -1091,6 +1207,7 @@ const ControlInfoMap &CameraSensor::controls() const
 /**
  * \brief Read V4L2 controls from the sensor
  * \param[in] ids The list of controls to read, specified by their ID
+ * \param[in] request The media request to read the controls from
  *
  * This function reads the value of all controls contained in \a ids, and
  * returns their values as a ControlList. The control identifiers are defined by
@@ -1106,14 +1223,16 @@ const ControlInfoMap &CameraSensor::controls() const
  * \return The control values in a ControlList on success, or an empty list on
  * error
  */
-ControlList CameraSensor::getControls(const std::vector<uint32_t> &ids)
+ControlList CameraSensor::getControls(const std::vector<uint32_t> &ids,
+					 const MediaRequest *request)
 {
-	return subdev_->getControls(ids);
+	return subdev_->getControls(ids, request);
 }
 
 /**
  * \brief Write V4L2 controls to the sensor
  * \param[in] ctrls The list of controls to write
+ * \param[in] request The media request to store the controls in
  *
  * This function writes the value of all controls contained in \a ctrls, and
  * stores the values actually applied to the device in the corresponding \a
@@ -1136,9 +1255,9 @@ ControlList CameraSensor::getControls(const std::vector<uint32_t> &ids)
  * \retval -EINVAL One of the control is not supported or not accessible
  * \retval i The index of the control that failed
  */
-int CameraSensor::setControls(ControlList *ctrls)
+int CameraSensor::setControls(ControlList *ctrls, const MediaRequest *request)
 {
-	return subdev_->setControls(ctrls);
+	return subdev_->setControls(ctrls, request);
 }
 
 /**
@@ -1199,6 +1318,52 @@ int CameraSensor::applyTestPatternMode(controls::draft::TestPatternModeEnum mode
 	return 0;
 }
 
+/**
+ * \fn CameraSensor::syncModes()
+ * \brief Retrieve the hardware synchronisation modes supported by the sensor
+ *
+ * The list is empty if the sensor doesn't support hardware synchronisation.
+ * Otherwise it always contains SensorSyncMode::Off.
+ *
+ * \return The list of supported synchronisation modes
+ */
+
+/**
+ * \brief Set the hardware synchronisation mode of the camera sensor
+ * \param[in] mode The synchronisation mode
+ *
+ * The synchronisation mode selects whether the sensor generates the frame
+ * synchronisation signal of a group of sensors, starts its frames on that
+ * signal, or runs freely. It shall be set while the sensor isn't streaming, as
+ * drivers usually only apply it when streaming starts.
+ *
+ * Setting the SensorSyncMode::Off mode always succeeds on sensors that don't
+ * support hardware synchronisation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOTSUP The sensor doesn't support the synchronisation \a mode
+ */
+int CameraSensor::setSyncMode(SensorSyncMode mode)
+{
+	if (syncMode_ == mode)
+		return 0;
+
+	auto it = std::find(syncModes_.begin(), syncModes_.end(), mode);
+	if (it == syncModes_.end())
+		return -ENOTSUP;
+
+	ControlList ctrls{ controls() };
+	ctrls.set(staticProps_->syncModeControl, staticProps_->syncModes.at(mode));
+
+	int ret = setControls(&ctrls);
+	if (ret)
+		return ret;
+
+	syncMode_ = mode;
+
+	return 0;
+}
+
 std::string CameraSensor::logPrefix() const
 {
 	return "'" + entity_->name() + "'";
@@ -30,6 +30,23 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(CameraSensorProperties)
 
+/**
+ * \enum SensorSyncMode
+ * \brief Hardware frame synchronisation mode of a camera sensor
+ *
+ * Sensors that support hardware synchronisation can either generate a frame
+ * synchronisation signal for other sensors, or start the exposure of their
+ * frames on an external signal. The two roles are also known as master and
+ * slave modes.
+ *
+ * \var SensorSyncMode::Off
+ * \brief The sensor runs freely and ignores any external signal
+ * \var SensorSyncMode::Leader
+ * \brief The sensor outputs a frame synchronisation signal
+ * \var SensorSyncMode::Follower
+ * \brief The sensor starts frames on an external synchronisation signal
+ */
+
 /**
  * \struct CameraSensorProperties
  * \brief Database of camera sensor properties
@@ -41,6 +58,14 @@ LOG_DEFINE_CATEGORY(CameraSensorProperties)
  * \brief Map that associates the TestPattern control value with the indexes of
  * the corresponding sensor test pattern modes as returned by
  * V4L2_CID_TEST_PATTERN.
+ *
+ * \var CameraSensorProperties::syncModeControl
+ * \brief The V4L2 control that selects the hardware synchronisation mode of
+ * the sensor, or 0 if the sensor doesn't support hardware synchronisation
+ *
+ * \var CameraSensorProperties::syncModes
+ * \brief Map that associates the hardware synchronisation modes with the
+ * values of the corresponding syncModeControl
  */
 
 /**
@@ -43,11 +43,29 @@ namespace libcamera {
  * \brief Lookup table for blue color, mapping input values to output values
  */
 
+/**
+ * \var kDebayerParamsBufferCount
+ * \brief Number of debayer parameters buffers shared between the Software ISP
+ * and IPA
+ *
+ * The parameters buffers are used in turn for consecutive frames. The count
+ * must be larger than the maximum number of frames in flight in the Software
+ * ISP, to ensure that the IPA never fills a buffer still in use.
+ */
+
+/**
+ * \typedef DebayerParamsBuffers
+ * \brief Type of the debayer parameters buffers pool shared with the IPA
+ */
+
 /**
  * \class Debayer
  * \brief Base debayering class
  *
  * Base class that provides functions for setting up the debayering process.
+ *
+ * Debayer objects are meant to be moved to a dedicated thread, in which
+ * process() is invoked for each frame.
  */
 
 LOG_DEFINE_CATEGORY(Debayer)
@@ -94,14 +112,18 @@ Debayer::~Debayer()
  */
 
 /**
- * \fn void Debayer::process(FrameBuffer *input, FrameBuffer *output, DebayerParams params)
- * \brief Process the bayer data into the requested format.
+ * \fn void Debayer::process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs, const DebayerParams *params)
+ * \brief Process the bayer data into the requested formats.
  * \param[in] input The input buffer.
- * \param[in] output The output buffer.
+ * \param[in] outputs The output buffers.
  * \param[in] params The parameters to be used in debayering.
  *
- * \note DebayerParams is passed by value deliberately so that a copy is passed
- * when this is run in another thread by invokeMethod().
+ * The \a outputs are ordered as the output configurations passed to
+ * configure(). Entries may be null for outputs not needed for this frame, at
+ * least one entry shall not be null.
+ *
+ * The \a params point to a per-frame parameters buffer that must not be
+ * modified until the output buffers are ready.
  */
 
 /**
@@ -113,6 +135,49 @@ Debayer::~Debayer()
  * \return The valid size ranges or an empty range if there are none.
  */
 
+/**
+ * \fn const SharedFD &Debayer::getStatsFD()
+ * \brief Get the file descriptor of the statistics shared memory
+ *
+ * \return The file descriptor of the statistics buffers
+ */
+
+/**
+ * \fn void Debayer::releaseStats(uint32_t index)
+ * \brief Release a statistics buffer
+ * \param[in] index The index of the statistics buffer
+ *
+ * Return the ownership of a statistics buffer to the statistics gatherer once
+ * the statistics it holds have been consumed. This function may be called from
+ * any thread.
+ */
+
+/**
+ * \fn unsigned int Debayer::frameSize()
+ * \brief Get the size of the frame buffers of the first output
+ *
+ * This may only be called after a successful configure() call.
+ *
+ * \return The output frame size in bytes
+ */
+
+/**
+ * \fn unsigned int Debayer::maxOutputs()
+ * \brief Get the maximum number of outputs produced from one input frame
+ * \return The maximum number of output configurations supported by configure()
+ */
+
+/**
+ * \fn std::size_t Debayer::memoryUsage() const
+ * \brief Get the size of the internal buffers allocated by the debayer
+ *
+ * The internal buffers, such as line buffers, are allocated by configure().
+ * The statistics shared memory isn't included. The default implementation
+ * returns 0, for implementations that don't allocate memory from the heap.
+ *
+ * \return The size of the internal buffers in bytes
+ */
+
 /**
  * \var Signal<FrameBuffer *> Debayer::inputBufferReady
  * \brief Signals when the input buffer is ready.
@@ -12,8 +12,11 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/signal.h>
 
 #include <libcamera/geometry.h>
@@ -27,7 +30,7 @@ class FrameBuffer;
 
 LOG_DECLARE_CATEGORY(Debayer)
 
-class Debayer
+class Debayer : public Object
 {
 public:
 	virtual ~Debayer() = 0;
@@ -40,10 +43,21 @@ public:
 	virtual std::tuple<unsigned int, unsigned int>
 	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size) = 0;
 
-	virtual void process(FrameBuffer *input, FrameBuffer *output, DebayerParams params) = 0;
+	virtual void process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs,
+			     const DebayerParams *params) = 0;
 
 	virtual SizeRange sizes(PixelFormat inputFormat, const Size &inputSize) = 0;
 
+	virtual const SharedFD &getStatsFD() = 0;
+
+	virtual void releaseStats(uint32_t index) = 0;
+
+	virtual unsigned int frameSize() = 0;
+
+	virtual unsigned int maxOutputs() = 0;
+
+	virtual std::size_t memoryUsage() const { return 0; }
+
 	Signal<FrameBuffer *> inputBufferReady;
 	Signal<FrameBuffer *> outputBufferReady;
 
@@ -11,14 +11,22 @@
 
 #include "debayer_cpu.h"
 
+#include <algorithm>
+#include <optional>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <time.h>
 
+#include <libcamera/base/utils.h>
+
 #include <libcamera/formats.h>
 
 #include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/formats.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/tracepoints.h"
 
 namespace libcamera {
 
@@ -27,6 +35,24 @@ namespace libcamera {
  * \brief Class for debayering on the CPU
  *
  * Implementation for CPU based debayering
+ *
+ * Frames can be split in horizontal stripes that are debayered concurrently.
+ * Each stripe uses its own line buffers and partial statistics, the stripes
+ * are processed on the libcamera thread pool with the first stripe processed by
+ * the thread calling process(). The number of stripes is set by the
+ * LIBCAMERA_SOFTISP_THREADS environment variable and defaults to 1, which
+ * processes the whole frame in the calling thread.
+ *
+ * Besides RGB formats, NV12 and YUV420 outputs are supported. Lines are then
+ * debayered to BGR888 line buffers and converted to BT.601 limited range YUV
+ * 4:2:0 by pairs of lines in the same pass.
+ *
+ * Up to kMaxOutputs outputs of different sizes and formats can be produced
+ * from a single pass over the input. The window is processed at the size of
+ * the largest output, and lines are debayered to BGR888 line buffers from which
+ * all outputs are written. Smaller outputs are downscaled with nearest neighbour
+ * sampling of the same lines, and thus share the field of view of the largest
+ * output. A single RGB output is debayered to directly.
  */
 
 /**
@@ -36,15 +62,50 @@ namespace libcamera {
 DebayerCpu::DebayerCpu(std::unique_ptr<SwStatsCpu> stats)
 	: stats_(std::move(stats))
 {
+	unsigned int threads = 1;
+
+	const char *env = utils::secure_getenv("LIBCAMERA_SOFTISP_THREADS");
+	if (env) {
+		threads = std::strtoul(env, nullptr, 10);
+		threads = std::clamp(threads, 1U, kMaxStripes);
+	}
+
+	stripes_.resize(threads);
+
+	if (threads > 1) {
+		stripeTasks_ = std::make_unique<TaskGroup>(threads - 1);
+		LOG(Debayer, Debug) << "Using " << threads << " debayer stripes";
+	}
+
 	/*
-	 * Reading from uncached buffers may be very slow.
-	 * In such a case, it's better to copy input buffer data to normal memory.
-	 * But in case of cached buffers, copying the data is unnecessary overhead.
-	 * enable_input_memcpy_ makes this behavior configurable.  At the moment, we
-	 * always set it to true as the safer choice but this should be changed in
-	 * future.
+	 * Reading from uncached buffers may be very slow. In such a case, it's
+	 * better to copy input buffer data to normal memory. But in case of
+	 * cached buffers, copying the data is unnecessary overhead. Unless
+	 * forced from the environment, the buffer reads are timed on the first
+	 * frame after configuration to decide whether to copy the input lines,
+	 * see detectInputMemcpy(). Copying is the safer choice until then.
 	 */
-	enableInputMemcpy_ = true;
+	inputMemcpyMode_ = InputMemcpyMode::Auto;
+
+	env = utils::secure_getenv("LIBCAMERA_SOFTISP_INPUT_MEMCPY");
+	if (env) {
+		if (!strcmp(env, "0"))
+			inputMemcpyMode_ = InputMemcpyMode::Disabled;
+		else if (!strcmp(env, "1"))
+			inputMemcpyMode_ = InputMemcpyMode::Enabled;
+		else
+			LOG(Debayer, Warning)
+				<< "Invalid LIBCAMERA_SOFTISP_INPUT_MEMCPY value '"
+				<< env << "'";
+	}
+
+	enableInputMemcpy_ = inputMemcpyMode_ != InputMemcpyMode::Disabled;
+	detectInputMemcpy_ = false;
+	binning_ = false;
+
+	/* The vectorized debayering can be disabled for testing purposes. */
+	env = utils::secure_getenv("LIBCAMERA_SOFTISP_SIMD");
+	enableSimd_ = !env || strcmp(env, "0");
 
 	/* Initialize color lookup tables */
 	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
@@ -269,6 +330,465 @@ void DebayerCpu::debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+/*
+ * 2x2 binning implementation
+ *
+ * Each Bayer quad of the src[1] and src[2] lines produces a single output
+ * pixel, using the blue and red values as is and averaging the two greens.
+ * This halves the output resolution at a fraction of the cost of a full
+ * debayering, as no neighbouring lines are needed for interpolation.
+ */
+#define BIN_BGR888(x, div)                              \
+	*dst++ = blue_[b[x] / (div)];                   \
+	*dst++ = green_[(g0[x] + g1[x]) / (2 * (div))]; \
+	*dst++ = red_[r[x] / (div)];                    \
+	if constexpr (addAlphaByte)                     \
+		*dst++ = 255;
+
+#define DECLARE_BIN_POINTERS(pixel_t)                                 \
+	const pixel_t *blueLine = (const pixel_t *)src[1 + blueRow_]; \
+	const pixel_t *redLine = (const pixel_t *)src[2 - blueRow_];  \
+	const pixel_t *b = blueLine + blueColumn_;                    \
+	const pixel_t *g0 = blueLine + (blueColumn_ ^ 1);             \
+	const pixel_t *g1 = redLine + blueColumn_;                    \
+	const pixel_t *r = redLine + (blueColumn_ ^ 1);
+
+template<typename pixel_t, unsigned int div, bool addAlphaByte>
+void DebayerCpu::bin_BGR888(uint8_t *dst, const uint8_t *src[])
+{
+	DECLARE_BIN_POINTERS(pixel_t)
+
+	for (unsigned int x = 0; x < window_.width; x += 2) {
+		BIN_BGR888(x, div)
+	}
+}
+
+template<bool addAlphaByte>
+void DebayerCpu::bin10P_BGR888(uint8_t *dst, const uint8_t *src[])
+{
+	const unsigned int widthInBytes = window_.width * 5 / 4;
+
+	DECLARE_BIN_POINTERS(uint8_t)
+
+	/* The 2 quads of each 5 bytes group, skipping the least-significant bits */
+	for (unsigned int x = 0; x < widthInBytes; x += 5) {
+		BIN_BGR888(x, 1)
+		BIN_BGR888(x + 2, 1)
+	}
+}
+
+/*
+ * SIMD implementation of the debayering functions
+ *
+ * The vectorized functions split the work in two stages. The interpolation of
+ * the missing colour components is performed with SIMD instructions on blocks
+ * of pixels, producing the colour lookup table indices of each component. The
+ * lookups and the interleaved output writes are then performed by a scalar
+ * loop, as neither NEON nor AVX2 can efficiently look up 256 entries tables.
+ *
+ * The interpolation computes the exact same values as the BGGR_BGR888,
+ * GRBG_BGR888, GBRG_BGR888 and RGGB_BGR888 macros, which makes the vectorized
+ * functions bit-exact with the scalar ones.
+ */
+#if __x86_64__ && (__GNUC__ || __clang__)
+#define DEBAYER_SIMD_AVX2 1
+#include <immintrin.h>
+#define DEBAYER_SIMD_TARGET __attribute__((target("avx2")))
+#elif __aarch64__
+#define DEBAYER_SIMD_NEON 1
+#include <arm_neon.h>
+#define DEBAYER_SIMD_TARGET
+#endif
+
+#ifdef DEBAYER_SIMD_TARGET
+
+namespace {
+
+/* Number of pixels processed by each vectorized lookup table indices pass */
+constexpr unsigned int kSimdChunkSize = 64;
+
+/*
+ * Compute the lookup table indices for a single pixel. This is used for the
+ * pixels at the end of a line that don't fill a whole vector.
+ */
+template<typename pixel_t, unsigned int shift, bool bgRow, bool firstIsG>
+inline void interpolatePixel(const pixel_t *prev, const pixel_t *curr,
+			     const pixel_t *next, int x,
+			     uint8_t *b, uint8_t *g, uint8_t *r)
+{
+	const unsigned int c = curr[x] >> shift;
+	const unsigned int cross = (prev[x] + curr[x - 1] + curr[x + 1] + next[x]) >> (2 + shift);
+	const unsigned int diag = (prev[x - 1] + prev[x + 1] + next[x - 1] + next[x + 1]) >> (2 + shift);
+	const unsigned int h2 = (curr[x - 1] + curr[x + 1]) >> (1 + shift);
+	const unsigned int v2 = (prev[x] + next[x]) >> (1 + shift);
+	const bool isG = (x & 1) != firstIsG;
+
+	if (bgRow) {
+		b[x] = isG ? h2 : c;
+		g[x] = isG ? c : cross;
+		r[x] = isG ? v2 : diag;
+	} else {
+		b[x] = isG ? v2 : diag;
+		g[x] = isG ? c : cross;
+		r[x] = isG ? h2 : c;
+	}
+}
+
+#if DEBAYER_SIMD_AVX2
+
+constexpr unsigned int kSimdWidth = 16;
+
+DEBAYER_SIMD_TARGET
+inline __m256i loadPixels(const uint8_t *src)
+{
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+}
+
+DEBAYER_SIMD_TARGET
+inline __m256i loadPixels(const uint16_t *src)
+{
+	return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+}
+
+DEBAYER_SIMD_TARGET
+inline void storeIndices(uint8_t *dst, __m256i value)
+{
+	__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(value, value), 0x08);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(packed));
+}
+
+/* Select the green pixels lanes from green and the other lanes from other */
+template<bool firstIsG>
+DEBAYER_SIMD_TARGET
+inline __m256i selectGreen(__m256i green, __m256i other)
+{
+	/* Bits set in the immediate mask select words from the second operand */
+	return _mm256_blend_epi16(other, green, firstIsG ? 0x55 : 0xaa);
+}
+
+template<typename pixel_t, unsigned int shift, bool bgRow, bool firstIsG>
+DEBAYER_SIMD_TARGET
+inline void interpolateVector(const pixel_t *prev, const pixel_t *curr,
+			      const pixel_t *next, uint8_t *b, uint8_t *g,
+			      uint8_t *r)
+{
+	const __m256i p = loadPixels(prev);
+	const __m256i pl = loadPixels(prev - 1);
+	const __m256i pr = loadPixels(prev + 1);
+	const __m256i c = loadPixels(curr);
+	const __m256i cl = loadPixels(curr - 1);
+	const __m256i cr = loadPixels(curr + 1);
+	const __m256i n = loadPixels(next);
+	const __m256i nl = loadPixels(next - 1);
+	const __m256i nr = loadPixels(next + 1);
+
+	const __m256i centre = _mm256_srli_epi16(c, shift);
+	const __m256i cross = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(p, n),
+								 _mm256_add_epi16(cl, cr)),
+						2 + shift);
+	const __m256i diag = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(pl, pr),
+								_mm256_add_epi16(nl, nr)),
+					       2 + shift);
+	const __m256i h2 = _mm256_srli_epi16(_mm256_add_epi16(cl, cr), 1 + shift);
+	const __m256i v2 = _mm256_srli_epi16(_mm256_add_epi16(p, n), 1 + shift);
+
+	if (bgRow) {
+		storeIndices(b, selectGreen<firstIsG>(h2, centre));
+		storeIndices(r, selectGreen<firstIsG>(v2, diag));
+	} else {
+		storeIndices(b, selectGreen<firstIsG>(v2, diag));
+		storeIndices(r, selectGreen<firstIsG>(h2, centre));
+	}
+	storeIndices(g, selectGreen<firstIsG>(centre, cross));
+}
+
+#elif DEBAYER_SIMD_NEON
+
+constexpr unsigned int kSimdWidth = 8;
+
+inline uint16x8_t loadPixels(const uint8_t *src)
+{
+	return vmovl_u8(vld1_u8(src));
+}
+
+inline uint16x8_t loadPixels(const uint16_t *src)
+{
+	return vld1q_u16(src);
+}
+
+inline void storeIndices(uint8_t *dst, uint16x8_t value)
+{
+	vst1_u8(dst, vmovn_u16(value));
+}
+
+/* Select the green pixels lanes from green and the other lanes from other */
+template<bool firstIsG>
+inline uint16x8_t selectGreen(uint16x8_t green, uint16x8_t other)
+{
+	static const uint16_t evenMask[8] = { 0xffff, 0, 0xffff, 0, 0xffff, 0, 0xffff, 0 };
+	static const uint16_t oddMask[8] = { 0, 0xffff, 0, 0xffff, 0, 0xffff, 0, 0xffff };
+
+	return vbslq_u16(vld1q_u16(firstIsG ? evenMask : oddMask), green, other);
+}
+
+template<typename pixel_t, unsigned int shift, bool bgRow, bool firstIsG>
+inline void interpolateVector(const pixel_t *prev, const pixel_t *curr,
+			      const pixel_t *next, uint8_t *b, uint8_t *g,
+			      uint8_t *r)
+{
+	const uint16x8_t p = loadPixels(prev);
+	const uint16x8_t pl = loadPixels(prev - 1);
+	const uint16x8_t pr = loadPixels(prev + 1);
+	const uint16x8_t c = loadPixels(curr);
+	const uint16x8_t cl = loadPixels(curr - 1);
+	const uint16x8_t cr = loadPixels(curr + 1);
+	const uint16x8_t n = loadPixels(next);
+	const uint16x8_t nl = loadPixels(next - 1);
+	const uint16x8_t nr = loadPixels(next + 1);
+
+	const uint16x8_t centre = vshlq_u16(c, vdupq_n_s16(-static_cast<int>(shift)));
+	const uint16x8_t cross = vshrq_n_u16(vaddq_u16(vaddq_u16(p, n), vaddq_u16(cl, cr)),
+					     2 + shift);
+	const uint16x8_t diag = vshrq_n_u16(vaddq_u16(vaddq_u16(pl, pr), vaddq_u16(nl, nr)),
+					    2 + shift);
+	const uint16x8_t h2 = vshrq_n_u16(vaddq_u16(cl, cr), 1 + shift);
+	const uint16x8_t v2 = vshrq_n_u16(vaddq_u16(p, n), 1 + shift);
+
+	if (bgRow) {
+		storeIndices(b, selectGreen<firstIsG>(h2, centre));
+		storeIndices(r, selectGreen<firstIsG>(v2, diag));
+	} else {
+		storeIndices(b, selectGreen<firstIsG>(v2, diag));
+		storeIndices(r, selectGreen<firstIsG>(h2, centre));
+	}
+	storeIndices(g, selectGreen<firstIsG>(centre, cross));
+}
+
+#endif
+
+/*
+ * Compute the lookup table indices for count pixels. The caller guarantees
+ * that the pixels before the first one and after the last one can be read.
+ */
+template<typename pixel_t, unsigned int shift, bool bgRow, bool firstIsG>
+DEBAYER_SIMD_TARGET
+void interpolateLine(const pixel_t *prev, const pixel_t *curr,
+		     const pixel_t *next, unsigned int count,
+		     uint8_t *b, uint8_t *g, uint8_t *r)
+{
+	unsigned int x = 0;
+
+	for (; x + kSimdWidth <= count; x += kSimdWidth)
+		interpolateVector<pixel_t, shift, bgRow, firstIsG>(prev + x, curr + x, next + x,
+								   b + x, g + x, r + x);
+
+	for (; x < count; x++)
+		interpolatePixel<pixel_t, shift, bgRow, firstIsG>(prev, curr, next, x,
+								  b, g, r);
+}
+
+/*
+ * Copy the 8 most significant bits of count CSI-2 packed 10-bit pixels, plus
+ * one extra pixel on each side, to the unpacked dst array. The src pointer
+ * points to the first byte of a 5 bytes group and count is a multiple of 4.
+ */
+inline void unpack10P(const uint8_t *src, unsigned int count, uint8_t *dst)
+{
+	/* The pixel on the left is before the least-significant bits byte */
+	*dst++ = src[-2];
+
+	for (unsigned int x = 0; x < count; x += 4, src += 5) {
+		*dst++ = src[0];
+		*dst++ = src[1];
+		*dst++ = src[2];
+		*dst++ = src[3];
+	}
+
+	*dst = src[0];
+}
+
+bool hasSimdSupport()
+{
+#if DEBAYER_SIMD_AVX2
+	return __builtin_cpu_supports("avx2");
+#else
+	return true;
+#endif
+}
+
+} /* namespace */
+
+template<bool addAlphaByte>
+uint8_t *DebayerCpu::applyLookup(uint8_t *dst, const uint8_t *b, const uint8_t *g,
+				 const uint8_t *r, unsigned int count)
+{
+	for (unsigned int x = 0; x < count; x++) {
+		*dst++ = blue_[b[x]];
+		*dst++ = green_[g[x]];
+		*dst++ = red_[r[x]];
+		if constexpr (addAlphaByte)
+			*dst++ = 255;
+	}
+
+	return dst;
+}
+
+template<typename pixel_t, unsigned int shift, bool bgRow, bool firstIsG, bool addAlphaByte>
+void DebayerCpu::debayerSimd_BGR888(uint8_t *dst, const uint8_t *src[])
+{
+	DECLARE_SRC_POINTERS(pixel_t)
+
+	uint8_t b[kSimdChunkSize], g[kSimdChunkSize], r[kSimdChunkSize];
+
+	for (unsigned int x = 0; x < window_.width; x += kSimdChunkSize) {
+		unsigned int count = std::min(kSimdChunkSize, window_.width - x);
+
+		interpolateLine<pixel_t, shift, bgRow, firstIsG>(prev + x, curr + x,
+								 next + x, count,
+								 b, g, r);
+		dst = applyLookup<addAlphaByte>(dst, b, g, r, count);
+	}
+}
+
+template<bool bgRow, bool firstIsG, bool addAlphaByte>
+void DebayerCpu::debayer10PSimd_BGR888(uint8_t *dst, const uint8_t *src[])
+{
+	/* Unpacked lines, with one extra pixel on each side */
+	uint8_t prev[kSimdChunkSize + 2], curr[kSimdChunkSize + 2], next[kSimdChunkSize + 2];
+	uint8_t b[kSimdChunkSize], g[kSimdChunkSize], r[kSimdChunkSize];
+
+	for (unsigned int x = 0; x < window_.width; x += kSimdChunkSize) {
+		unsigned int count = std::min(kSimdChunkSize, window_.width - x);
+		unsigned int offset = x * 5 / 4;
+
+		unpack10P(src[0] + offset, count, prev);
+		unpack10P(src[1] + offset, count, curr);
+		unpack10P(src[2] + offset, count, next);
+
+		interpolateLine<uint8_t, 0, bgRow, firstIsG>(prev + 1, curr + 1,
+							     next + 1, count,
+							     b, g, r);
+		dst = applyLookup<addAlphaByte>(dst, b, g, r, count);
+	}
+}
+
+#endif /* DEBAYER_SIMD_TARGET */
+
+/*
+ * BT.601 limited range RGB to YUV conversion, using 8-bit fixed point
+ * coefficients. The chroma values are computed from the sum of the 4 pixels of
+ * a 2x2 block, the offsets include the rounding and are chosen to keep all
+ * intermediate values positive.
+ */
+static inline uint8_t rgbToY(unsigned int r, unsigned int g, unsigned int b)
+{
+	return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t rgbSumToU(int r, int g, int b)
+{
+	return (-38 * r - 74 * g + 112 * b + 4 * (128 * 256 + 128)) >> 10;
+}
+
+static inline uint8_t rgbSumToV(int r, int g, int b)
+{
+	return (112 * r - 94 * g - 18 * b + 4 * (128 * 256 + 128)) >> 10;
+}
+
+/*
+ * Scaled outputs pick the nearest pixel of the processed window through the
+ * xOffsets table, the other outputs use the BGR888 lines as-is.
+ */
+template<bool swapRedBlue, bool addAlphaByte, bool scaled>
+void DebayerCpu::writeRGB(const DebayerOutput &output, const uint8_t *bgr[],
+			  unsigned int line)
+{
+	for (unsigned int i = 0; i < 2; i++) {
+		uint8_t *dst = output.planes[0] + (line + i) * output.config.stride;
+
+		if constexpr (!swapRedBlue && !addAlphaByte && !scaled) {
+			memcpy(dst, bgr[i], output.size.width * 3);
+			continue;
+		}
+
+		for (unsigned int x = 0; x < output.size.width; x++) {
+			const uint8_t *pixel = scaled ? bgr[i] + output.xOffsets[x]
+						      : bgr[i] + x * 3;
+
+			*dst++ = pixel[swapRedBlue ? 2 : 0];
+			*dst++ = pixel[1];
+			*dst++ = pixel[swapRedBlue ? 0 : 2];
+			if constexpr (addAlphaByte)
+				*dst++ = 255;
+		}
+	}
+}
+
+template<bool semiPlanar, bool scaled>
+void DebayerCpu::writeYUV420(const DebayerOutput &output, const uint8_t *bgr[],
+			     unsigned int line)
+{
+	constexpr unsigned int chromaStep = semiPlanar ? 2 : 1;
+	uint8_t *y0 = output.planes[0] + line * output.config.stride;
+	uint8_t *y1 = y0 + output.config.stride;
+
+	const unsigned int chromaOffset = line / 2 * output.config.chromaStride;
+	uint8_t *u = output.planes[1] + chromaOffset;
+	uint8_t *v = semiPlanar ? u + 1 : output.planes[2] + chromaOffset;
+
+	for (unsigned int x = 0; x < output.size.width; x += 2) {
+		const unsigned int offset0 = scaled ? output.xOffsets[x] : x * 3;
+		const unsigned int offset1 = scaled ? output.xOffsets[x + 1] : x * 3 + 3;
+		const uint8_t *p00 = bgr[0] + offset0;
+		const uint8_t *p01 = bgr[0] + offset1;
+		const uint8_t *p10 = bgr[1] + offset0;
+		const uint8_t *p11 = bgr[1] + offset1;
+
+		y0[x] = rgbToY(p00[2], p00[1], p00[0]);
+		y0[x + 1] = rgbToY(p01[2], p01[1], p01[0]);
+		y1[x] = rgbToY(p10[2], p10[1], p10[0]);
+		y1[x + 1] = rgbToY(p11[2], p11[1], p11[0]);
+
+		int b = p00[0] + p01[0] + p10[0] + p11[0];
+		int g = p00[1] + p01[1] + p10[1] + p11[1];
+		int r = p00[2] + p01[2] + p10[2] + p11[2];
+
+		*u = rgbSumToU(r, g, b);
+		*v = rgbSumToV(r, g, b);
+
+		u += chromaStep;
+		v += chromaStep;
+	}
+}
+
+DebayerCpu::outputFn DebayerCpu::outputFunction(PixelFormat outputFormat, bool scaled)
+{
+	switch (outputFormat) {
+	case formats::RGB888:
+		return scaled ? &DebayerCpu::writeRGB<false, false, true>
+			      : &DebayerCpu::writeRGB<false, false, false>;
+	case formats::XRGB8888:
+	case formats::ARGB8888:
+		return scaled ? &DebayerCpu::writeRGB<false, true, true>
+			      : &DebayerCpu::writeRGB<false, true, false>;
+	case formats::BGR888:
+		return scaled ? &DebayerCpu::writeRGB<true, false, true>
+			      : &DebayerCpu::writeRGB<true, false, false>;
+	case formats::XBGR8888:
+	case formats::ABGR8888:
+		return scaled ? &DebayerCpu::writeRGB<true, true, true>
+			      : &DebayerCpu::writeRGB<true, true, false>;
+	case formats::NV12:
+		return scaled ? &DebayerCpu::writeYUV420<true, true>
+			      : &DebayerCpu::writeYUV420<true, false>;
+	case formats::YUV420:
+		return scaled ? &DebayerCpu::writeYUV420<false, true>
+			      : &DebayerCpu::writeYUV420<false, false>;
+	default:
+		return nullptr;
+	}
+}
+
 static bool isStandardBayerOrder(BayerFormat::Order order)
 {
 	return order == BayerFormat::BGGR || order == BayerFormat::GBRG ||
@@ -296,7 +816,9 @@ int DebayerCpu::getInputConfig(PixelFormat inputFormat, DebayerInputConfig &conf
 								  formats::ARGB8888,
 								  formats::BGR888,
 								  formats::XBGR8888,
-								  formats::ABGR8888 });
+								  formats::ABGR8888,
+								  formats::NV12,
+								  formats::YUV420 });
 		return 0;
 	}
 
@@ -311,7 +833,9 @@ int DebayerCpu::getInputConfig(PixelFormat inputFormat, DebayerInputConfig &conf
 								  formats::ARGB8888,
 								  formats::BGR888,
 								  formats::XBGR8888,
-								  formats::ABGR8888 });
+								  formats::ABGR8888,
+								  formats::NV12,
+								  formats::YUV420 });
 		return 0;
 	}
 
@@ -333,6 +857,11 @@ int DebayerCpu::getOutputConfig(PixelFormat outputFormat, DebayerOutputConfig &c
 		return 0;
 	}
 
+	if (outputFormat == formats::NV12 || outputFormat == formats::YUV420) {
+		config.bpp = 8;
+		return 0;
+	}
+
 	LOG(Debayer, Info)
 		<< "Unsupported output format " << outputFormat.toString();
 	return -EINVAL;
@@ -414,6 +943,14 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 		return invalidFmt();
 	}
 
+	if (binning_) {
+		if (!isStandardBayerOrder(bayerFormat.order))
+			return invalidFmt();
+
+		setBinningFunctions(bayerFormat, addAlphaByte);
+		return 0;
+	}
+
 	if ((bayerFormat.bitDepth == 8 || bayerFormat.bitDepth == 10 || bayerFormat.bitDepth == 12) &&
 	    bayerFormat.packing == BayerFormat::Packing::None &&
 	    isStandardBayerOrder(bayerFormat.order)) {
@@ -431,6 +968,7 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer12_GRGR_BGR888<true> : &DebayerCpu::debayer12_GRGR_BGR888<false>;
 			break;
 		}
+		setSimdDebayerFunctions(bayerFormat, addAlphaByte);
 		setupStandardBayerOrder(bayerFormat.order);
 		return 0;
 	}
@@ -441,34 +979,135 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 		case BayerFormat::BGGR:
 			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10P_BGBG_BGR888<true> : &DebayerCpu::debayer10P_BGBG_BGR888<false>;
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10P_GRGR_BGR888<true> : &DebayerCpu::debayer10P_GRGR_BGR888<false>;
-			return 0;
+			break;
 		case BayerFormat::GBRG:
 			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10P_GBGB_BGR888<true> : &DebayerCpu::debayer10P_GBGB_BGR888<false>;
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10P_RGRG_BGR888<true> : &DebayerCpu::debayer10P_RGRG_BGR888<false>;
-			return 0;
+			break;
 		case BayerFormat::GRBG:
 			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10P_GRGR_BGR888<true> : &DebayerCpu::debayer10P_GRGR_BGR888<false>;
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10P_BGBG_BGR888<true> : &DebayerCpu::debayer10P_BGBG_BGR888<false>;
-			return 0;
+			break;
 		case BayerFormat::RGGB:
 			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10P_RGRG_BGR888<true> : &DebayerCpu::debayer10P_RGRG_BGR888<false>;
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10P_GBGB_BGR888<true> : &DebayerCpu::debayer10P_GBGB_BGR888<false>;
-			return 0;
-		default:
 			break;
+		default:
+			return invalidFmt();
 		}
+
+		setSimdDebayerFunctions(bayerFormat, addAlphaByte);
+		return 0;
 	}
 
 	return invalidFmt();
 }
 
+/*
+ * Replace the scalar debayer functions set by setDebayerFunctions() with their
+ * vectorized equivalents when supported by the CPU.
+ */
+void DebayerCpu::setSimdDebayerFunctions([[maybe_unused]] const BayerFormat &bayerFormat,
+					 [[maybe_unused]] bool addAlphaByte)
+{
+#ifdef DEBAYER_SIMD_TARGET
+	if (!enableSimd_ || !hasSimdSupport())
+		return;
+
+	if (bayerFormat.packing == BayerFormat::Packing::CSI2) {
+		switch (bayerFormat.order) {
+		case BayerFormat::BGGR:
+			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<true, false, true> : &DebayerCpu::debayer10PSimd_BGR888<true, false, false>;
+			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<false, true, true> : &DebayerCpu::debayer10PSimd_BGR888<false, true, false>;
+			break;
+		case BayerFormat::GBRG:
+			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<true, true, true> : &DebayerCpu::debayer10PSimd_BGR888<true, true, false>;
+			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<false, false, true> : &DebayerCpu::debayer10PSimd_BGR888<false, false, false>;
+			break;
+		case BayerFormat::GRBG:
+			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<false, true, true> : &DebayerCpu::debayer10PSimd_BGR888<false, true, false>;
+			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<true, false, true> : &DebayerCpu::debayer10PSimd_BGR888<true, false, false>;
+			break;
+		case BayerFormat::RGGB:
+			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<false, false, true> : &DebayerCpu::debayer10PSimd_BGR888<false, false, false>;
+			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10PSimd_BGR888<true, true, true> : &DebayerCpu::debayer10PSimd_BGR888<true, true, false>;
+			break;
+		default:
+			return;
+		}
+
+		LOG(Debayer, Debug) << "Using vectorized debayering";
+		return;
+	}
+
+	/* The standard Bayer orders are handled by setupStandardBayerOrder() */
+	switch (bayerFormat.bitDepth) {
+	case 8:
+		debayer0_ = addAlphaByte ? &DebayerCpu::debayerSimd_BGR888<uint8_t, 0, true, false, true> : &DebayerCpu::debayerSimd_BGR888<uint8_t, 0, true, false, false>;
+		debayer1_ = addAlphaByte ? &DebayerCpu::debayerSimd_BGR888<uint8_t, 0, false, true, true> : &DebayerCpu::debayerSimd_BGR888<uint8_t, 0, false, true, false>;
+		break;
+	case 10:
+		debayer0_ = addAlphaByte ? &DebayerCpu::debayerSimd_BGR888<uint16_t, 2, true, false, true> : &DebayerCpu::debayerSimd_BGR888<uint16_t, 2, true, false, false>;
+		debayer1_ = addAlphaByte ? &DebayerCpu::debayerSimd_BGR888<uint16_t, 2, false, true, true> : &DebayerCpu::debayerSimd_BGR888<uint16_t, 2, false, true, false>;
+		break;
+	case 12:
+		debayer0_ = addAlphaByte ? &DebayerCpu::debayerSimd_BGR888<uint16_t, 4, true, false, true> : &DebayerCpu::debayerSimd_BGR888<uint16_t, 4, true, false, false>;
+		debayer1_ = addAlphaByte ? &DebayerCpu::debayerSimd_BGR888<uint16_t, 4, false, true, true> : &DebayerCpu::debayerSimd_BGR888<uint16_t, 4, false, true, false>;
+		break;
+	default:
+		return;
+	}
+
+	LOG(Debayer, Debug) << "Using vectorized debayering";
+#endif /* DEBAYER_SIMD_TARGET */
+}
+
+/*
+ * Select the 2x2 binning functions. The Bayer order is handled through the
+ * position of the blue pixel in the quads, which is the one written first.
+ */
+void DebayerCpu::setBinningFunctions(const BayerFormat &bayerFormat, bool addAlphaByte)
+{
+	blueRow_ = bayerFormat.order == BayerFormat::GRBG ||
+		   bayerFormat.order == BayerFormat::RGGB;
+	blueColumn_ = bayerFormat.order == BayerFormat::GBRG ||
+		      bayerFormat.order == BayerFormat::RGGB;
+
+	if (bayerFormat.packing == BayerFormat::Packing::CSI2) {
+		debayer0_ = addAlphaByte ? &DebayerCpu::bin10P_BGR888<true> : &DebayerCpu::bin10P_BGR888<false>;
+		return;
+	}
+
+	switch (bayerFormat.bitDepth) {
+	case 8:
+		debayer0_ = addAlphaByte ? &DebayerCpu::bin_BGR888<uint8_t, 1, true> : &DebayerCpu::bin_BGR888<uint8_t, 1, false>;
+		break;
+	case 10:
+		debayer0_ = addAlphaByte ? &DebayerCpu::bin_BGR888<uint16_t, 4, true> : &DebayerCpu::bin_BGR888<uint16_t, 4, false>;
+		break;
+	case 12:
+		debayer0_ = addAlphaByte ? &DebayerCpu::bin_BGR888<uint16_t, 16, true> : &DebayerCpu::bin_BGR888<uint16_t, 16, false>;
+		break;
+	}
+}
+
+/*
+ * Output size at which the frame is 2x2 binned instead of cropped, rounded
+ * down to the pattern size.
+ */
+static Size binnedSize(const Size &inputSize, const Size &patternSize)
+{
+	return Size((inputSize.width / 2) & ~(patternSize.width - 1),
+		    (inputSize.height / 2) & ~(patternSize.height - 1));
+}
+
 int DebayerCpu::configure(const StreamConfiguration &inputCfg,
 			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
 {
 	if (getInputConfig(inputCfg.pixelFormat, inputConfig_) != 0)
 		return -EINVAL;
 
-	if (stats_->configure(inputCfg) != 0)
+	if (stats_->configure(inputCfg, stripes_.size()) != 0)
 		return -EINVAL;
 
 	const Size &statsPatternSize = stats_->patternSize();
@@ -482,35 +1121,103 @@ int DebayerCpu::configure(const StreamConfiguration &inputCfg,
 
 	inputConfig_.stride = inputCfg.stride;
 
-	if (outputCfgs.size() != 1) {
+	if (outputCfgs.empty() || outputCfgs.size() > kMaxOutputs) {
 		LOG(Debayer, Error)
 			<< "Unsupported number of output streams: "
 			<< outputCfgs.size();
 		return -EINVAL;
 	}
 
-	const StreamConfiguration &outputCfg = outputCfgs[0];
 	SizeRange outSizeRange = sizes(inputCfg.pixelFormat, inputCfg.size);
-	std::tie(outputConfig_.stride, outputConfig_.frameSize) =
-		strideAndFrameSize(outputCfg.pixelFormat, outputCfg.size);
+	outputs_.resize(outputCfgs.size());
+	outputSize_ = {};
+
+	for (unsigned int i = 0; i < outputCfgs.size(); i++) {
+		const StreamConfiguration &outputCfg = outputCfgs[i];
+		DebayerOutputConfig &config = outputs_[i].config;
+
+		std::tie(config.stride, config.frameSize) =
+			strideAndFrameSize(outputCfg.pixelFormat, outputCfg.size);
+
+		/* The chroma planes are subsampled by 2 horizontally for YUV420 */
+		const PixelFormatInfo &outputInfo = PixelFormatInfo::info(outputCfg.pixelFormat);
+		config.chromaStride = outputInfo.numPlanes() > 1
+				    ? config.stride
+				      * outputInfo.planes[1].bytesPerGroup
+				      / outputInfo.planes[0].bytesPerGroup
+				    : 0;
+
+		if (!outSizeRange.contains(outputCfg.size) || config.stride != outputCfg.stride) {
+			LOG(Debayer, Error)
+				<< "Invalid output size/stride: "
+				<< "\n  " << outputCfg.size << " (" << outSizeRange << ")"
+				<< "\n  " << outputCfg.stride << " (" << config.stride << ")";
+			return -EINVAL;
+		}
 
-	if (!outSizeRange.contains(outputCfg.size) || outputConfig_.stride != outputCfg.stride) {
-		LOG(Debayer, Error)
-			<< "Invalid output size/stride: "
-			<< "\n  " << outputCfg.size << " (" << outSizeRange << ")"
-			<< "\n  " << outputCfg.stride << " (" << outputConfig_.stride << ")";
-		return -EINVAL;
+		outputs_[i].size = outputCfg.size;
+		outputSize_.expandTo(outputCfg.size);
 	}
 
-	if (setDebayerFunctions(inputCfg.pixelFormat, outputCfg.pixelFormat) != 0)
+	/*
+	 * The window is processed once at the size of the largest output, the
+	 * other outputs are downscaled from the same lines.
+	 */
+	const PixelFormat &outputFormat = outputCfgs[0].get().pixelFormat;
+	directOutput_ = outputs_.size() == 1 &&
+			PixelFormatInfo::info(outputFormat).colourEncoding ==
+				PixelFormatInfo::ColourEncodingRGB;
+
+	for (unsigned int i = 0; i < outputs_.size(); i++) {
+		DebayerOutput &output = outputs_[i];
+		const bool scaled = output.size != outputSize_;
+
+		output.write = outputFunction(outputCfgs[i].get().pixelFormat, scaled);
+		if (!output.write) {
+			LOG(Debayer, Error)
+				<< "Unsupported output format "
+				<< outputCfgs[i].get().pixelFormat;
+			return -EINVAL;
+		}
+
+		output.xOffsets.clear();
+		if (scaled) {
+			for (unsigned int x = 0; x < output.size.width; x++)
+				output.xOffsets.push_back(x * outputSize_.width /
+							  output.size.width * 3);
+		}
+
+		output.planes = {};
+	}
+
+	/*
+	 * Half the input size is produced by binning the full frame instead of
+	 * cropping its center, for cheap full field of view preview streams.
+	 */
+	binning_ = inputConfig_.patternSize.height == 2 &&
+		   outputSize_ == binnedSize(inputCfg.size, inputConfig_.patternSize);
+
+	if (setDebayerFunctions(inputCfg.pixelFormat,
+				directOutput_ ? outputFormat : formats::RGB888) != 0)
 		return -EINVAL;
 
-	window_.x = ((inputCfg.size.width - outputCfg.size.width) / 2) &
+	/* The window is the area of the input frame being processed */
+	const Size windowSize = binning_
+			       ? Size(outputSize_.width * 2, outputSize_.height * 2)
+			       : outputSize_;
+	window_.x = ((inputCfg.size.width - windowSize.width) / 2) &
 		    ~(inputConfig_.patternSize.width - 1);
-	window_.y = ((inputCfg.size.height - outputCfg.size.height) / 2) &
+	window_.y = ((inputCfg.size.height - windowSize.height) / 2) &
 		    ~(inputConfig_.patternSize.height - 1);
-	window_.width = outputCfg.size.width;
-	window_.height = outputCfg.size.height;
+	window_.width = windowSize.width;
+	window_.height = windowSize.height;
+
+	if (binning_)
+		LOG(Debayer, Debug) << "Binning " << window_ << " to " << outputSize_;
+
+	/* The input buffers may have changed, detect their caching again */
+	enableInputMemcpy_ = inputMemcpyMode_ != InputMemcpyMode::Disabled;
+	detectInputMemcpy_ = inputMemcpyMode_ == InputMemcpyMode::Auto;
 
 	/* Don't pass x,y since process() already adjusts src before passing it */
 	stats_->setWindow(Rectangle(window_.size()));
@@ -520,10 +1227,7 @@ int DebayerCpu::configure(const StreamConfiguration &inputCfg,
 	lineBufferLength_ = window_.width * inputConfig_.bpp / 8 +
 			    2 * lineBufferPadding_;
 
-	if (enableInputMemcpy_) {
-		for (unsigned int i = 0; i <= inputConfig_.patternSize.height; i++)
-			lineBuffers_[i].resize(lineBufferLength_);
-	}
+	setupStripes();
 
 	measuredFrames_ = 0;
 	frameProcessTime_ = 0;
@@ -565,11 +1269,71 @@ DebayerCpu::strideAndFrameSize(const PixelFormat &outputFormat, const Size &size
 
 	/* round up to multiple of 8 for 64 bits alignment */
 	unsigned int stride = (size.width * config.bpp / 8 + 7) & ~7;
+	unsigned int frameSize = 0;
 
-	return std::make_tuple(stride, stride * size.height);
+	/* Planes are stored contiguously, with strides relative to the first */
+	const PixelFormatInfo &info = PixelFormatInfo::info(outputFormat);
+	for (unsigned int i = 0; i < info.numPlanes(); i++)
+		frameSize += info.planeSize(size.height, i,
+					    stride * info.planes[i].bytesPerGroup /
+						    info.planes[0].bytesPerGroup);
+
+	return std::make_tuple(stride, frameSize);
 }
 
-void DebayerCpu::setupInputMemcpy(const uint8_t *linePointers[])
+/*
+ * Split the window in horizontal stripes of roughly equal height, aligned to
+ * the statistics line skipping pattern of 4 lines, and allocate the line
+ * buffers of each stripe.
+ */
+void DebayerCpu::setupStripes()
+{
+	const unsigned int yEnd = window_.y + window_.height;
+	unsigned int stripeHeight = window_.height / stripes_.size();
+	unsigned int y = window_.y;
+
+	stripeHeight = std::max((stripeHeight + 3) & ~3U, 4U);
+
+	for (unsigned int i = 0; i < stripes_.size(); i++) {
+		DebayerStripe &stripe = stripes_[i];
+
+		stripe.index = i;
+		stripe.yStart = std::min(y, yEnd);
+		stripe.yEnd = i == stripes_.size() - 1
+			    ? yEnd : std::min(y + stripeHeight, yEnd);
+		y = stripe.yEnd;
+
+		for (unsigned int j = 0; j < kMaxLineBuffers; j++) {
+			if (enableInputMemcpy_ && j <= inputConfig_.patternSize.height)
+				stripe.lineBuffers[j].resize(lineBufferLength_);
+			else
+				stripe.lineBuffers[j].clear();
+		}
+
+		for (std::vector<uint8_t> &line : stripe.bgrLines) {
+			if (!directOutput_)
+				line.resize(outputSize_.width * 3);
+			else
+				line.clear();
+		}
+	}
+}
+
+std::size_t DebayerCpu::memoryUsage() const
+{
+	std::size_t size = 0;
+
+	for (const DebayerStripe &stripe : stripes_) {
+		for (const std::vector<uint8_t> &line : stripe.lineBuffers)
+			size += line.capacity();
+		for (const std::vector<uint8_t> &line : stripe.bgrLines)
+			size += line.capacity();
+	}
+
+	return size;
+}
+
+void DebayerCpu::setupInputMemcpy(DebayerStripe &stripe, const uint8_t *linePointers[])
 {
 	const unsigned int patternHeight = inputConfig_.patternSize.height;
 
@@ -577,14 +1341,14 @@ void DebayerCpu::setupInputMemcpy(const uint8_t *linePointers[])
 		return;
 
 	for (unsigned int i = 0; i < patternHeight; i++) {
-		memcpy(lineBuffers_[i].data(),
+		memcpy(stripe.lineBuffers[i].data(),
 		       linePointers[i + 1] - lineBufferPadding_,
 		       lineBufferLength_);
-		linePointers[i + 1] = lineBuffers_[i].data() + lineBufferPadding_;
+		linePointers[i + 1] = stripe.lineBuffers[i].data() + lineBufferPadding_;
 	}
 
-	/* Point lineBufferIndex_ to first unused lineBuffer */
-	lineBufferIndex_ = patternHeight;
+	/* Point lineBufferIndex to first unused lineBuffer */
+	stripe.lineBufferIndex = patternHeight;
 }
 
 void DebayerCpu::shiftLinePointers(const uint8_t *linePointers[], const uint8_t *src)
@@ -598,88 +1362,139 @@ void DebayerCpu::shiftLinePointers(const uint8_t *linePointers[], const uint8_t
 				      (patternHeight / 2) * (int)inputConfig_.stride;
 }
 
-void DebayerCpu::memcpyNextLine(const uint8_t *linePointers[])
+void DebayerCpu::memcpyNextLine(DebayerStripe &stripe, const uint8_t *linePointers[])
 {
 	const unsigned int patternHeight = inputConfig_.patternSize.height;
 
 	if (!enableInputMemcpy_)
 		return;
 
-	memcpy(lineBuffers_[lineBufferIndex_].data(),
+	memcpy(stripe.lineBuffers[stripe.lineBufferIndex].data(),
 	       linePointers[patternHeight] - lineBufferPadding_,
 	       lineBufferLength_);
-	linePointers[patternHeight] = lineBuffers_[lineBufferIndex_].data()
+	linePointers[patternHeight] = stripe.lineBuffers[stripe.lineBufferIndex].data()
 				    + lineBufferPadding_;
 
-	lineBufferIndex_ = (lineBufferIndex_ + 1) % (patternHeight + 1);
+	stripe.lineBufferIndex = (stripe.lineBufferIndex + 1) % (patternHeight + 1);
 }
 
-void DebayerCpu::process2(const uint8_t *src, uint8_t *dst)
+/*
+ * Debayer the next line of the stripe. Unless debayering straight to a single
+ * RGB output, the line is debayered to BGR888 in the stripe line buffers, and
+ * pairs of lines are written to all outputs while still hot in the cache.
+ */
+void DebayerCpu::debayerLine(debayerFn debayer, DebayerStripe &stripe,
+			     const uint8_t *linePointers[])
 {
-	unsigned int yEnd = window_.y + window_.height;
+	const unsigned int line = stripe.outputLine++;
+
+	if (directOutput_) {
+		const DebayerOutput &output = outputs_[0];
+		(this->*debayer)(output.planes[0] + line * output.config.stride,
+				 linePointers);
+		return;
+	}
+
+	/* Stripes start on even lines, pairs of lines never span stripes */
+	(this->*debayer)(stripe.bgrLines[line & 1].data(), linePointers);
+	if (line & 1)
+		writeOutputs(stripe, line - 1);
+}
+
+/*
+ * Write a pair of lines of the processed window, starting at \a line, to the
+ * outputs. Outputs smaller than the window sample pairs of lines, so that 4:2:0
+ * chroma is computed from lines debayered together.
+ */
+void DebayerCpu::writeOutputs(const DebayerStripe &stripe, unsigned int line)
+{
+	const uint8_t *bgr[2] = { stripe.bgrLines[0].data(), stripe.bgrLines[1].data() };
+	const unsigned int pairs = outputSize_.height / 2;
+	const unsigned int pair = line / 2;
+
+	for (const DebayerOutput &output : outputs_) {
+		if (!output.planes[0])
+			continue;
+
+		/* Find the pair of output lines sampled from this pair, if any */
+		const unsigned int outputPairs = output.size.height / 2;
+		const unsigned int outputPair = (pair * outputPairs + pairs - 1) / pairs;
+		if (outputPair >= outputPairs || outputPair * pairs / outputPairs != pair)
+			continue;
+
+		(this->*output.write)(output, bgr, outputPair * 2);
+	}
+}
+
+void DebayerCpu::process2(DebayerStripe &stripe, const uint8_t *src)
+{
+	unsigned int yEnd = stripe.yEnd;
 	/* Holds [0] previous- [1] current- [2] next-line */
 	const uint8_t *linePointers[3];
 
-	/* Adjust src to top left corner of the window */
-	src += window_.y * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	/* Adjust src to top left corner of the stripe */
+	src += stripe.yStart * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
 
 	/* [x] becomes [x - 1] after initial shiftLinePointers() call */
-	if (window_.y) {
+	if (stripe.yStart) {
 		linePointers[1] = src - inputConfig_.stride; /* previous-line */
 		linePointers[2] = src;
 	} else {
-		/* window_.y == 0, use the next line as prev line */
+		/* stripe.yStart == 0, use the next line as prev line */
 		linePointers[1] = src + inputConfig_.stride;
 		linePointers[2] = src;
-		/* Last 2 lines also need special handling */
-		yEnd -= 2;
 	}
 
-	setupInputMemcpy(linePointers);
+	/*
+	 * When the window starts at the top of the frame, the last 2 lines of
+	 * the window also need special handling as there may be no next line.
+	 */
+	const bool lastLines = window_.y == 0 &&
+			       stripe.yEnd == window_.y + window_.height;
+	if (lastLines)
+		yEnd -= 2;
+
+	setupInputMemcpy(stripe, linePointers);
 
-	for (unsigned int y = window_.y; y < yEnd; y += 2) {
+	for (unsigned int y = stripe.yStart; y < yEnd; y += 2) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(y, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine0(y, linePointers, stripe.index);
+		debayerLine(debayer0_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer1_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		debayerLine(debayer1_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 	}
 
-	if (window_.y == 0) {
+	if (lastLines) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(yEnd, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine0(yEnd, linePointers, stripe.index);
+		debayerLine(debayer0_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
 		/* next line may point outside of src, use prev. */
 		linePointers[2] = linePointers[0];
-		(this->*debayer1_)(dst, linePointers);
+		debayerLine(debayer1_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 	}
 }
 
-void DebayerCpu::process4(const uint8_t *src, uint8_t *dst)
+void DebayerCpu::process4(DebayerStripe &stripe, const uint8_t *src)
 {
-	const unsigned int yEnd = window_.y + window_.height;
+	const unsigned int yEnd = stripe.yEnd;
 	/*
 	 * This holds pointers to [0] 2-lines-up [1] 1-line-up [2] current-line
 	 * [3] 1-line-down [4] 2-lines-down.
 	 */
 	const uint8_t *linePointers[5];
 
-	/* Adjust src to top left corner of the window */
-	src += window_.y * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	/* Adjust src to top left corner of the stripe */
+	src += stripe.yStart * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
 
 	/* [x] becomes [x - 1] after initial shiftLinePointers() call */
 	linePointers[1] = src - 2 * inputConfig_.stride;
@@ -687,78 +1502,227 @@ void DebayerCpu::process4(const uint8_t *src, uint8_t *dst)
 	linePointers[3] = src;
 	linePointers[4] = src + inputConfig_.stride;
 
-	setupInputMemcpy(linePointers);
+	setupInputMemcpy(stripe, linePointers);
 
-	for (unsigned int y = window_.y; y < yEnd; y += 4) {
+	for (unsigned int y = stripe.yStart; y < yEnd; y += 4) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(y, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine0(y, linePointers, stripe.index);
+		debayerLine(debayer0_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer1_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		debayerLine(debayer1_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine2(y, linePointers);
-		(this->*debayer2_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine2(y, linePointers, stripe.index);
+		debayerLine(debayer2_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer3_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		debayerLine(debayer3_, stripe, linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 	}
 }
 
+void DebayerCpu::processBinning(DebayerStripe &stripe, const uint8_t *src)
+{
+	/* Holds [1] the first and [2] the second line of each row of quads */
+	const uint8_t *linePointers[3];
+
+	/* Adjust src to top left corner of the stripe */
+	src += stripe.yStart * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+
+	for (unsigned int y = stripe.yStart; y < stripe.yEnd; y += 2) {
+		linePointers[1] = src;
+		linePointers[2] = src + inputConfig_.stride;
+
+		if (enableInputMemcpy_) {
+			for (unsigned int i = 0; i < 2; i++) {
+				memcpy(stripe.lineBuffers[i].data(),
+				       linePointers[i + 1] - lineBufferPadding_,
+				       lineBufferLength_);
+				linePointers[i + 1] = stripe.lineBuffers[i].data()
+						    + lineBufferPadding_;
+			}
+		}
+
+		stats_->processLine0(y, linePointers, stripe.index);
+		debayerLine(debayer0_, stripe, linePointers);
+		src += 2 * inputConfig_.stride;
+	}
+}
+
+void DebayerCpu::processStripe(DebayerStripe &stripe, const uint8_t *src)
+{
+	if (stripe.yStart == stripe.yEnd)
+		return;
+
+	stripe.outputLine = binning_ ? (stripe.yStart - window_.y) / 2
+				     : stripe.yStart - window_.y;
+
+	if (binning_)
+		processBinning(stripe, src);
+	else if (inputConfig_.patternSize.height == 2)
+		process2(stripe, src);
+	else
+		process4(stripe, src);
+}
+
 static inline int64_t timeDiff(timespec &after, timespec &before)
 {
 	return (after.tv_sec - before.tv_sec) * 1000000000LL +
 	       (int64_t)after.tv_nsec - (int64_t)before.tv_nsec;
 }
 
-void DebayerCpu::process(FrameBuffer *input, FrameBuffer *output, DebayerParams params)
+/*
+ * Decide whether to copy the input lines before debayering them, by reading a
+ * few lines of the frame twice. Reads from cached memory are much faster the
+ * second time, while reads from uncached memory are equally slow.
+ */
+void DebayerCpu::detectInputMemcpy(const uint8_t *src)
 {
+	const unsigned int lines = std::min(kInputMemcpyProbeLines, window_.height);
+	const unsigned int length = std::min(lineBufferLength_, inputConfig_.stride);
+	std::vector<uint8_t> buffer(length);
+	int64_t duration[2];
+
+	src += window_.y * inputConfig_.stride;
+
+	for (int64_t &d : duration) {
+		timespec start = {};
+		timespec end = {};
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		for (unsigned int i = 0; i < lines; i++)
+			memcpy(buffer.data(), src + i * inputConfig_.stride, length);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+		d = timeDiff(end, start);
+	}
+
+	enableInputMemcpy_ = duration[1] * 2 > duration[0];
+
+	LOG(Debayer, Debug)
+		<< "Input reads took " << duration[0] << "ns then "
+		<< duration[1] << "ns, buffers look "
+		<< (enableInputMemcpy_ ? "uncached" : "cached")
+		<< ", input memcpy " << (enableInputMemcpy_ ? "enabled" : "disabled");
+
+	/* Allocate or free the line buffers */
+	setupStripes();
+}
+
+void DebayerCpu::process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs,
+			 const DebayerParams *params)
+{
+	std::array<std::optional<MappedFrameBuffer>, kMaxOutputs> out;
 	timespec frameStartTime;
 
+	ASSERT(outputs.size() == outputs_.size());
+
+	LIBCAMERA_TRACEPOINT(debayer_process_begin, input->metadata().sequence,
+			     outputs.size());
+
 	if (measuredFrames_ < DebayerCpu::kLastFrameToMeasure) {
 		frameStartTime = {};
 		clock_gettime(CLOCK_MONOTONIC_RAW, &frameStartTime);
 	}
 
-	green_ = params.green;
-	red_ = swapRedBlueGains_ ? params.blue : params.red;
-	blue_ = swapRedBlueGains_ ? params.red : params.blue;
+	green_ = params->green;
+	red_ = swapRedBlueGains_ ? params->blue : params->red;
+	blue_ = swapRedBlueGains_ ? params->red : params->blue;
 
-	/* Copy metadata from the input buffer */
-	FrameMetadata &metadata = output->_d()->metadata();
-	metadata.status = input->metadata().status;
-	metadata.sequence = input->metadata().sequence;
-	metadata.timestamp = input->metadata().timestamp;
+	/*
+	 * The whole input and output buffers are accessed, pre-fault them when
+	 * they are first mapped instead of taking one page fault per page.
+	 */
+	MappedFrameBuffer in(input, MappedFrameBuffer::MapFlag::Read |
+				    MappedFrameBuffer::MapFlag::Populate);
+	bool mapped = in.isValid();
+
+	for (unsigned int i = 0; i < outputs.size(); i++) {
+		FrameBuffer *output = outputs[i];
+		outputs_[i].planes = {};
+
+		if (!output)
+			continue;
+
+		/* Copy metadata from the input buffer */
+		FrameMetadata &metadata = output->_d()->metadata();
+		metadata.status = input->metadata().status;
+		metadata.sequence = input->metadata().sequence;
+		metadata.timestamp = input->metadata().timestamp;
+
+		out[i].emplace(output, MappedFrameBuffer::MapFlag::Write |
+				       MappedFrameBuffer::MapFlag::Populate);
+		mapped &= out[i]->isValid();
+	}
 
-	MappedFrameBuffer in(input, MappedFrameBuffer::MapFlag::Read);
-	MappedFrameBuffer out(output, MappedFrameBuffer::MapFlag::Write);
-	if (!in.isValid() || !out.isValid()) {
+	if (!mapped) {
 		LOG(Debayer, Error) << "mmap-ing buffer(s) failed";
-		metadata.status = FrameMetadata::FrameError;
+		for (FrameBuffer *output : outputs) {
+			if (output)
+				output->_d()->metadata().status = FrameMetadata::FrameError;
+		}
+		LIBCAMERA_TRACEPOINT(debayer_process_end, input->metadata().sequence);
 		return;
 	}
 
 	stats_->startFrame();
 
-	if (inputConfig_.patternSize.height == 2)
-		process2(in.planes()[0].data(), out.planes()[0].data());
-	else
-		process4(in.planes()[0].data(), out.planes()[0].data());
+	const uint8_t *src = in.planes()[0].data();
+
+	if (detectInputMemcpy_) {
+		detectInputMemcpy(src);
+		detectInputMemcpy_ = false;
+	}
+
+	for (unsigned int i = 0; i < outputs.size(); i++) {
+		if (!out[i])
+			continue;
+
+		DebayerOutput &output = outputs_[i];
+		const std::vector<Span<uint8_t>> &planes = out[i]->planes();
+		for (unsigned int j = 0; j < std::min<size_t>(planes.size(), 3); j++)
+			output.planes[j] = planes[j].data();
+
+		/* Locate the chroma planes of single plane YUV buffers */
+		if (output.config.chromaStride) {
+			if (!output.planes[1])
+				output.planes[1] = output.planes[0] +
+						   output.config.stride * output.size.height;
+			if (!output.planes[2])
+				output.planes[2] = output.planes[1] +
+						   output.config.chromaStride * output.size.height / 2;
+		}
+	}
+
+	/* Hand all but the first stripe to the thread pool */
+	for (unsigned int i = 1; i < stripes_.size(); i++) {
+		DebayerStripe *stripe = &stripes_[i];
+		stripeTasks_->run([this, stripe, src]() {
+			processStripe(*stripe, src);
+		});
+	}
+
+	processStripe(stripes_[0], src);
+
+	if (stripeTasks_)
+		stripeTasks_->wait();
 
-	metadata.planes()[0].bytesused = out.planes()[0].size();
+	for (unsigned int i = 0; i < outputs.size(); i++) {
+		if (!out[i])
+			continue;
+
+		Span<FrameMetadata::Plane> planes = outputs[i]->_d()->metadata().planes();
+		for (unsigned int j = 0; j < planes.size(); j++)
+			planes[j].bytesused = out[i]->planes()[j].size();
+	}
 
 	/* Measure before emitting signals */
 	if (measuredFrames_ < DebayerCpu::kLastFrameToMeasure &&
@@ -778,7 +1742,13 @@ void DebayerCpu::process(FrameBuffer *input, FrameBuffer *output, DebayerParams
 	}
 
 	stats_->finishFrame();
-	outputBufferReady.emit(output);
+
+	LIBCAMERA_TRACEPOINT(debayer_process_end, input->metadata().sequence);
+
+	for (FrameBuffer *output : outputs) {
+		if (output)
+			outputBufferReady.emit(output);
+	}
 	inputBufferReady.emit(input);
 }
 
@@ -11,11 +11,13 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 #include <stdint.h>
 #include <vector>
 
 #include <libcamera/base/object.h>
+#include <libcamera/base/thread_pool.h>
 
 #include "libcamera/internal/bayer_format.h"
 
@@ -24,7 +26,7 @@
 
 namespace libcamera {
 
-class DebayerCpu : public Debayer, public Object
+class DebayerCpu : public Debayer
 {
 public:
 	DebayerCpu(std::unique_ptr<SwStatsCpu> stats);
@@ -36,22 +38,15 @@ public:
 	std::vector<PixelFormat> formats(PixelFormat input);
 	std::tuple<unsigned int, unsigned int>
 	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size);
-	void process(FrameBuffer *input, FrameBuffer *output, DebayerParams params);
+	void process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs,
+		     const DebayerParams *params);
 	SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
 
-	/**
-	 * \brief Get the file descriptor for the statistics
-	 *
-	 * \return the file descriptor pointing to the statistics
-	 */
 	const SharedFD &getStatsFD() { return stats_->getStatsFD(); }
-
-	/**
-	 * \brief Get the output frame size
-	 *
-	 * \return The output frame size
-	 */
-	unsigned int frameSize() { return outputConfig_.frameSize; }
+	void releaseStats(uint32_t index) { stats_->releaseBuffer(index); }
+	unsigned int frameSize() { return outputs_.empty() ? 0 : outputs_[0].config.frameSize; }
+	unsigned int maxOutputs() { return kMaxOutputs; }
+	std::size_t memoryUsage() const;
 
 private:
 	/**
@@ -109,6 +104,42 @@ private:
 	template<bool addAlphaByte>
 	void debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[]);
 
+	/*
+	 * Vectorized variants of the above functions, bit-exact with the
+	 * scalar implementations. The bgRow parameter selects between a BGBG
+	 * and a GRGR line, firstIsG tells if the line starts with a green
+	 * pixel.
+	 */
+	template<typename pixel_t, unsigned int shift, bool bgRow, bool firstIsG,
+		 bool addAlphaByte>
+	void debayerSimd_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool bgRow, bool firstIsG, bool addAlphaByte>
+	void debayer10PSimd_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool addAlphaByte>
+	uint8_t *applyLookup(uint8_t *dst, const uint8_t *b, const uint8_t *g,
+			     const uint8_t *r, unsigned int count);
+
+	/*
+	 * 2x2 binning variants, producing one output pixel per Bayer quad of
+	 * the src[1] and src[2] lines, without interpolation.
+	 */
+	template<typename pixel_t, unsigned int div, bool addAlphaByte>
+	void bin_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool addAlphaByte>
+	void bin10P_BGR888(uint8_t *dst, const uint8_t *src[]);
+
+	/* Max. supported Bayer pattern height is 4, debayering this requires 5 lines */
+	static constexpr unsigned int kMaxLineBuffers = 5;
+
+	/* Max. number of stripes (and threads) a frame is split in */
+	static constexpr unsigned int kMaxStripes = 8;
+
+	/* Number of lines read to detect whether the input buffers are cached */
+	static constexpr unsigned int kInputMemcpyProbeLines = 8;
+
+	/* Max. number of outputs produced in a single pass */
+	static constexpr unsigned int kMaxOutputs = 3;
+
 	struct DebayerInputConfig {
 		Size patternSize;
 		unsigned int bpp; /* Memory used per pixel, not precision */
@@ -117,23 +148,77 @@ private:
 	};
 
 	struct DebayerOutputConfig {
-		unsigned int bpp; /* Memory used per pixel, not precision */
+		unsigned int bpp; /* Memory used per pixel (of the first plane), not precision */
 		unsigned int stride;
+		unsigned int chromaStride; /* Only for YUV output */
 		unsigned int frameSize;
 	};
 
+	struct DebayerStripe {
+		unsigned int index;
+		unsigned int yStart;
+		unsigned int yEnd;
+		std::vector<uint8_t> lineBuffers[kMaxLineBuffers];
+		unsigned int lineBufferIndex;
+		/* Next line of the processed window to be output */
+		unsigned int outputLine;
+		/* BGR888 lines pending conversion, unless directOutput_ is set */
+		std::vector<uint8_t> bgrLines[2];
+	};
+
+	struct DebayerOutput;
+
+	/**
+	 * \brief Called to write 2 lines of BGR888 data to an output
+	 * \param[in] output The output to write to
+	 * \param[in] bgr The BGR888 lines, of the size of the processed window
+	 * \param[in] line The index of the first output line to write
+	 */
+	using outputFn = void (DebayerCpu::*)(const DebayerOutput &output,
+					      const uint8_t *bgr[], unsigned int line);
+
+	struct DebayerOutput {
+		Size size;
+		DebayerOutputConfig config;
+		outputFn write;
+		/* Offset in the BGR888 lines of the pixels, for scaled outputs only */
+		std::vector<unsigned int> xOffsets;
+		/* Planes of the current output buffer, null if not requested */
+		std::array<uint8_t *, 3> planes;
+	};
+
+	enum class InputMemcpyMode {
+		Auto,
+		Enabled,
+		Disabled,
+	};
+
+	/* RGB and BGR outputs, with or without alpha byte */
+	template<bool swapRedBlue, bool addAlphaByte, bool scaled>
+	void writeRGB(const DebayerOutput &output, const uint8_t *bgr[], unsigned int line);
+	/* Semi-planar (NV12) or planar (YUV420) 4:2:0 outputs */
+	template<bool semiPlanar, bool scaled>
+	void writeYUV420(const DebayerOutput &output, const uint8_t *bgr[], unsigned int line);
+	static outputFn outputFunction(PixelFormat outputFormat, bool scaled);
+
 	int getInputConfig(PixelFormat inputFormat, DebayerInputConfig &config);
 	int getOutputConfig(PixelFormat outputFormat, DebayerOutputConfig &config);
 	int setupStandardBayerOrder(BayerFormat::Order order);
 	int setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputFormat);
-	void setupInputMemcpy(const uint8_t *linePointers[]);
+	void setSimdDebayerFunctions(const BayerFormat &bayerFormat, bool addAlphaByte);
+	void setBinningFunctions(const BayerFormat &bayerFormat, bool addAlphaByte);
+	void setupStripes();
+	void setupInputMemcpy(DebayerStripe &stripe, const uint8_t *linePointers[]);
 	void shiftLinePointers(const uint8_t *linePointers[], const uint8_t *src);
-	void memcpyNextLine(const uint8_t *linePointers[]);
-	void process2(const uint8_t *src, uint8_t *dst);
-	void process4(const uint8_t *src, uint8_t *dst);
-
-	/* Max. supported Bayer pattern height is 4, debayering this requires 5 lines */
-	static constexpr unsigned int kMaxLineBuffers = 5;
+	void memcpyNextLine(DebayerStripe &stripe, const uint8_t *linePointers[]);
+	void debayerLine(debayerFn debayer, DebayerStripe &stripe,
+			 const uint8_t *linePointers[]);
+	void writeOutputs(const DebayerStripe &stripe, unsigned int line);
+	void process2(DebayerStripe &stripe, const uint8_t *src);
+	void process4(DebayerStripe &stripe, const uint8_t *src);
+	void processBinning(DebayerStripe &stripe, const uint8_t *src);
+	void processStripe(DebayerStripe &stripe, const uint8_t *src);
+	void detectInputMemcpy(const uint8_t *src);
 
 	DebayerParams::ColorLookupTable red_;
 	DebayerParams::ColorLookupTable green_;
@@ -143,15 +228,25 @@ private:
 	debayerFn debayer2_;
 	debayerFn debayer3_;
 	Rectangle window_;
+	Size outputSize_; /* Size of the processed window after binning */
 	DebayerInputConfig inputConfig_;
-	DebayerOutputConfig outputConfig_;
+	std::vector<DebayerOutput> outputs_;
+	/* Debayer straight to the single RGB output, without BGR888 lines */
+	bool directOutput_;
 	std::unique_ptr<SwStatsCpu> stats_;
-	std::vector<uint8_t> lineBuffers_[kMaxLineBuffers];
+	std::vector<DebayerStripe> stripes_;
+	std::unique_ptr<TaskGroup> stripeTasks_;
 	unsigned int lineBufferLength_;
 	unsigned int lineBufferPadding_;
-	unsigned int lineBufferIndex_;
 	unsigned int xShift_; /* Offset of 0/1 applied to window_.x */
+	bool binning_;
+	/* Position of the blue pixel in the Bayer quads, for binning only */
+	unsigned int blueRow_;
+	unsigned int blueColumn_;
+	InputMemcpyMode inputMemcpyMode_;
 	bool enableInputMemcpy_;
+	bool detectInputMemcpy_;
+	bool enableSimd_;
 	bool swapRedBlueGains_;
 	unsigned int measuredFrames_;
 	int64_t frameProcessTime_;
@@ -0,0 +1,742 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * GPU based debayering class
+ */
+
+#include "debayer_egl.h"
+
+#include <algorithm>
+#include <array>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libcamera/base/utils.h>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+namespace libcamera {
+
+/**
+ * \class DebayerEGL
+ * \brief Class for debayering on the GPU
+ *
+ * Implementation of the Debayer interface using OpenGL ES 3.0 through EGL.
+ * The input and output buffers are imported as EGL images from their dmabufs,
+ * and the demosaicing and the colour lookup are performed in a fragment shader
+ * rendering directly to the output buffer. The shader implements the same
+ * bilinear interpolation as DebayerCpu.
+ *
+ * Only 32-bit RGB output formats are supported, as 24-bit formats are commonly
+ * not renderable by GPUs.
+ *
+ * The statistics are gathered on the CPU with SwStatsCpu, with the subsampling
+ * and region of interest configured for it, while the GPU renders the frame.
+ *
+ * The EGL context is only made current in the thread calling process() for the
+ * duration of the call, so that the object can be moved to a worker thread
+ * after construction.
+ */
+
+namespace {
+
+const char *kVertexShader = R"(#version 300 es
+in vec2 position;
+
+void main()
+{
+	gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+
+/*
+ * The raw input is imported as an R8 image for 8-bit and CSI-2 packed 10-bit
+ * formats, and as an R16 image for unpacked formats stored on 16 bits. Pixels
+ * are addressed with integer coordinates to avoid any filtering or precision
+ * issue.
+ */
+const char *kFragmentShader = R"(#version 300 es
+precision highp float;
+precision highp int;
+
+uniform highp sampler2D inputTexture;
+uniform highp sampler2D lutTexture;
+
+/* Top left corner of the window and size of the input, in pixels */
+uniform ivec2 window;
+uniform ivec2 inputSize;
+/* Position of the red pixel in the 2x2 Bayer pattern */
+uniform ivec2 firstRed;
+/* 0: 8-bit, 1: unpacked 16-bit, 2: CSI-2 packed 10-bit */
+uniform int inputFormat;
+/* Scaling of the raw values to 8 bits */
+uniform float divisor;
+
+out vec4 fragColor;
+
+float fetch(int x, int y)
+{
+	if (inputFormat == 2) {
+		/* Only use the 8 most significant bits, as DebayerCpu does */
+		vec4 t = texelFetch(inputTexture, ivec2((x >> 2) * 5 + (x & 3), y), 0);
+		return floor(t.r * 255.0 + 0.5);
+	}
+
+	vec4 t = texelFetch(inputTexture, ivec2(x, y), 0);
+	if (inputFormat == 1)
+		return floor(t.r * 65535.0 + 0.5);
+
+	return floor(t.r * 255.0 + 0.5);
+}
+
+float scale(float sum, float count)
+{
+	return min(floor(sum / (count * divisor)), 255.0);
+}
+
+void main()
+{
+	ivec2 pos = ivec2(gl_FragCoord.xy) + window;
+	int x = pos.x;
+	int y = pos.y;
+
+	/* Mirror the lines above and below the frame */
+	int yp = y == 0 ? 1 : y - 1;
+	int yn = y == inputSize.y - 1 ? y - 1 : y + 1;
+
+	float c = fetch(x, y);
+	float cross = fetch(x - 1, y) + fetch(x + 1, y) +
+		      fetch(x, yp) + fetch(x, yn);
+	float diag = fetch(x - 1, yp) + fetch(x + 1, yp) +
+		     fetch(x - 1, yn) + fetch(x + 1, yn);
+	float horiz = fetch(x - 1, y) + fetch(x + 1, y);
+	float vert = fetch(x, yp) + fetch(x, yn);
+
+	bvec2 red = equal(pos & 1, firstRed);
+	vec3 rgb;
+
+	if (red.x && red.y)
+		rgb = vec3(scale(c, 1.0), scale(cross, 4.0), scale(diag, 4.0));
+	else if (!red.x && !red.y)
+		rgb = vec3(scale(diag, 4.0), scale(cross, 4.0), scale(c, 1.0));
+	else if (red.y)
+		rgb = vec3(scale(horiz, 2.0), scale(c, 1.0), scale(vert, 2.0));
+	else
+		rgb = vec3(scale(vert, 2.0), scale(c, 1.0), scale(horiz, 2.0));
+
+	ivec3 idx = ivec3(rgb);
+	fragColor = vec4(texelFetch(lutTexture, ivec2(idx.r, 0), 0).r,
+			 texelFetch(lutTexture, ivec2(idx.g, 0), 0).g,
+			 texelFetch(lutTexture, ivec2(idx.b, 0), 0).b,
+			 1.0);
+}
+)";
+
+enum InputFormat {
+	Input8 = 0,
+	Input16 = 1,
+	Input10P = 2,
+};
+
+bool isSupportedInput(const BayerFormat &bayerFormat)
+{
+	if (bayerFormat.order != BayerFormat::BGGR &&
+	    bayerFormat.order != BayerFormat::GBRG &&
+	    bayerFormat.order != BayerFormat::GRBG &&
+	    bayerFormat.order != BayerFormat::RGGB)
+		return false;
+
+	if (bayerFormat.packing == BayerFormat::Packing::None)
+		return bayerFormat.bitDepth == 8 || bayerFormat.bitDepth == 10 ||
+		       bayerFormat.bitDepth == 12;
+
+	return bayerFormat.packing == BayerFormat::Packing::CSI2 &&
+	       bayerFormat.bitDepth == 10;
+}
+
+bool hasExtension(const char *extensions, const char *name)
+{
+	if (!extensions)
+		return false;
+
+	size_t len = strlen(name);
+
+	for (const char *p = extensions; (p = strstr(p, name)); p += len) {
+		if ((p == extensions || p[-1] == ' ') &&
+		    (p[len] == ' ' || p[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+GLuint compileShader(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	if (!shader)
+		return 0;
+
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+
+	GLint status;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		char log[512] = {};
+		glGetShaderInfoLog(shader, sizeof(log) - 1, nullptr, log);
+		LOG(Debayer, Error) << "Failed to compile shader: " << log;
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+} /* namespace */
+
+/**
+ * \brief Constructs a DebayerEGL object
+ * \param[in] stats Pointer to the stats object to use
+ *
+ * The EGL display and context are created and the shaders compiled at
+ * construction time. Use isValid() to check whether the GPU can be used.
+ */
+DebayerEGL::DebayerEGL(std::unique_ptr<SwStatsCpu> stats)
+	: display_(EGL_NO_DISPLAY), context_(EGL_NO_CONTEXT), program_(0),
+	  lutTexture_(0), stats_(std::move(stats))
+{
+	if (initEGL() < 0)
+		return;
+
+	if (initProgram() < 0) {
+		releaseCurrent();
+		return;
+	}
+
+	releaseCurrent();
+
+	LOG(Debayer, Info) << "Using GPU debayering with "
+			   << eglQueryString(display_, EGL_VENDOR);
+}
+
+DebayerEGL::~DebayerEGL()
+{
+	if (display_ == EGL_NO_DISPLAY)
+		return;
+
+	if (context_ != EGL_NO_CONTEXT) {
+		makeCurrent();
+
+		clearImages();
+		if (lutTexture_)
+			glDeleteTextures(1, &lutTexture_);
+		if (program_)
+			glDeleteProgram(program_);
+
+		releaseCurrent();
+		eglDestroyContext(display_, context_);
+	}
+
+	eglTerminate(display_);
+}
+
+/**
+ * \fn bool DebayerEGL::isValid() const
+ * \brief Check if the GPU debayering has been initialized successfully
+ * \return True if the object can be used, false otherwise
+ */
+
+int DebayerEGL::initEGL()
+{
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+	/* Prefer a surfaceless display, no window system is needed */
+	if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+			eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (getPlatformDisplay)
+			display_ = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+						      EGL_DEFAULT_DISPLAY, nullptr);
+	}
+
+	if (display_ == EGL_NO_DISPLAY)
+		display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, nullptr, nullptr)) {
+		LOG(Debayer, Error) << "Failed to initialize EGL display";
+		display_ = EGL_NO_DISPLAY;
+		return -ENODEV;
+	}
+
+	const char *extensions = eglQueryString(display_, EGL_EXTENSIONS);
+	if (!hasExtension(extensions, "EGL_EXT_image_dma_buf_import") ||
+	    !hasExtension(extensions, "EGL_KHR_surfaceless_context")) {
+		LOG(Debayer, Error) << "EGL dmabuf import is not supported";
+		return -ENOTSUP;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_ES_API)) {
+		LOG(Debayer, Error) << "Failed to bind OpenGL ES API";
+		return -ENOTSUP;
+	}
+
+	static const EGLint configAttribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+		EGL_SURFACE_TYPE, 0,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs;
+
+	if (!eglChooseConfig(display_, configAttribs, &config, 1, &numConfigs) ||
+	    numConfigs < 1) {
+		LOG(Debayer, Error) << "No OpenGL ES 3.0 EGL configuration";
+		return -ENOTSUP;
+	}
+
+	static const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_NONE
+	};
+
+	context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context_ == EGL_NO_CONTEXT) {
+		LOG(Debayer, Error) << "Failed to create EGL context";
+		return -ENOTSUP;
+	}
+
+	makeCurrent();
+
+	const char *glExtensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+	if (!hasExtension(glExtensions, "GL_OES_EGL_image")) {
+		LOG(Debayer, Error) << "GL_OES_EGL_image is not supported";
+		releaseCurrent();
+		return -ENOTSUP;
+	}
+
+	eglCreateImageKHR_ = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+		eglGetProcAddress("eglCreateImageKHR"));
+	eglDestroyImageKHR_ = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+		eglGetProcAddress("eglDestroyImageKHR"));
+	glEGLImageTargetTexture2DOES_ = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(
+		eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+	if (!eglCreateImageKHR_ || !eglDestroyImageKHR_ ||
+	    !glEGLImageTargetTexture2DOES_) {
+		LOG(Debayer, Error) << "Failed to get EGL image functions";
+		releaseCurrent();
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+int DebayerEGL::initProgram()
+{
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, kVertexShader);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, kFragmentShader);
+
+	if (!vertexShader || !fragmentShader) {
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return -EINVAL;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glBindAttribLocation(program, 0, "position");
+	glLinkProgram(program);
+
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		char log[512] = {};
+		glGetProgramInfoLog(program, sizeof(log) - 1, nullptr, log);
+		LOG(Debayer, Error) << "Failed to link program: " << log;
+		glDeleteProgram(program);
+		return -EINVAL;
+	}
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "inputTexture"), 0);
+	glUniform1i(glGetUniformLocation(program, "lutTexture"), 1);
+	windowUniform_ = glGetUniformLocation(program, "window");
+	inputSizeUniform_ = glGetUniformLocation(program, "inputSize");
+	firstRedUniform_ = glGetUniformLocation(program, "firstRed");
+	formatUniform_ = glGetUniformLocation(program, "inputFormat");
+	divisorUniform_ = glGetUniformLocation(program, "divisor");
+
+	/* The lookup tables are stored in a 256x1 texture, one per channel */
+	glGenTextures(1, &lutTexture_);
+	glBindTexture(GL_TEXTURE_2D, lutTexture_);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, DebayerParams::kRGBLookupSize, 1,
+		     0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+
+	program_ = program;
+
+	return 0;
+}
+
+void DebayerEGL::makeCurrent()
+{
+	if (!eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_))
+		LOG(Debayer, Error) << "Failed to make EGL context current";
+}
+
+void DebayerEGL::releaseCurrent()
+{
+	eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+/*
+ * Import the first plane of a buffer as an EGL image and bind it to a texture,
+ * and to a framebuffer for output buffers. Imported buffers are cached, indexed
+ * by the inode of the dmabuf and the plane offset. The inode is unique as long
+ * as the image holds a reference to the dmabuf.
+ */
+DebayerEGL::Image *DebayerEGL::importBuffer(const FrameBuffer *buffer, bool output)
+{
+	const FrameBuffer::Plane &plane = buffer->planes()[0];
+	auto &images = output ? outputImages_ : inputImages_;
+
+	struct stat st;
+	if (fstat(plane.fd.get(), &st) < 0)
+		return nullptr;
+
+	const std::pair<ino_t, unsigned int> key(st.st_ino, plane.offset);
+	auto it = images.find(key);
+	if (it != images.end())
+		return &it->second;
+
+	EGLint width;
+	EGLint height;
+	EGLint fourcc;
+	EGLint pitch;
+
+	if (output) {
+		width = window_.width;
+		height = window_.height;
+		fourcc = outputFourcc_;
+		pitch = outputStride_;
+	} else {
+		bool wide = inputFormat_.packing == BayerFormat::Packing::None &&
+			    inputFormat_.bitDepth > 8;
+
+		width = wide ? inputStride_ / 2 : inputStride_;
+		height = inputSize_.height;
+		fourcc = wide ? formats::R16.fourcc() : formats::R8.fourcc();
+		pitch = inputStride_;
+	}
+
+	const EGLint attribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_LINUX_DRM_FOURCC_EXT, fourcc,
+		EGL_DMA_BUF_PLANE0_FD_EXT, plane.fd.get(),
+		EGL_DMA_BUF_PLANE0_OFFSET_EXT, static_cast<EGLint>(plane.offset),
+		EGL_DMA_BUF_PLANE0_PITCH_EXT, pitch,
+		EGL_NONE
+	};
+
+	EGLImageKHR image = eglCreateImageKHR_(display_, EGL_NO_CONTEXT,
+					       EGL_LINUX_DMA_BUF_EXT, nullptr,
+					       attribs);
+	if (image == EGL_NO_IMAGE_KHR) {
+		LOG(Debayer, Error)
+			<< "Failed to import " << (output ? "output" : "input")
+			<< " buffer: 0x" << utils::hex(eglGetError());
+		return nullptr;
+	}
+
+	Image img = { image, 0, 0 };
+
+	glGenTextures(1, &img.texture);
+	glBindTexture(GL_TEXTURE_2D, img.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glEGLImageTargetTexture2DOES_(GL_TEXTURE_2D, image);
+
+	if (output) {
+		glGenFramebuffers(1, &img.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, img.framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				       GL_TEXTURE_2D, img.texture, 0);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			LOG(Debayer, Error) << "Output buffer is not renderable";
+			glDeleteFramebuffers(1, &img.framebuffer);
+			glDeleteTextures(1, &img.texture);
+			eglDestroyImageKHR_(display_, image);
+			return nullptr;
+		}
+	}
+
+	return &images.emplace(key, img).first->second;
+}
+
+/* Must be called with the context current */
+void DebayerEGL::clearImages()
+{
+	for (auto *images : { &inputImages_, &outputImages_ }) {
+		for (auto &[key, img] : *images) {
+			if (img.framebuffer)
+				glDeleteFramebuffers(1, &img.framebuffer);
+			glDeleteTextures(1, &img.texture);
+			eglDestroyImageKHR_(display_, img.image);
+		}
+
+		images->clear();
+	}
+}
+
+int DebayerEGL::configure(const StreamConfiguration &inputCfg,
+			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
+{
+	inputFormat_ = BayerFormat::fromPixelFormat(inputCfg.pixelFormat);
+	if (!isSupportedInput(inputFormat_)) {
+		LOG(Debayer, Error)
+			<< "Unsupported input format " << inputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	if (stats_->configure(inputCfg) != 0)
+		return -EINVAL;
+
+	if (outputCfgs.size() != 1) {
+		LOG(Debayer, Error)
+			<< "Unsupported number of output streams: "
+			<< outputCfgs.size();
+		return -EINVAL;
+	}
+
+	const StreamConfiguration &outputCfg = outputCfgs[0];
+	const std::vector<PixelFormat> outputFormats = formats(inputCfg.pixelFormat);
+	if (std::find(outputFormats.begin(), outputFormats.end(),
+		      outputCfg.pixelFormat) == outputFormats.end()) {
+		LOG(Debayer, Error)
+			<< "Unsupported output format " << outputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	SizeRange outSizeRange = sizes(inputCfg.pixelFormat, inputCfg.size);
+	std::tie(outputStride_, outputFrameSize_) =
+		strideAndFrameSize(outputCfg.pixelFormat, outputCfg.size);
+
+	if (!outSizeRange.contains(outputCfg.size) || outputStride_ != outputCfg.stride) {
+		LOG(Debayer, Error)
+			<< "Invalid output size/stride: "
+			<< "\n  " << outputCfg.size << " (" << outSizeRange << ")"
+			<< "\n  " << outputCfg.stride << " (" << outputStride_ << ")";
+		return -EINVAL;
+	}
+
+	const Size pattern = patternSize(inputCfg.pixelFormat);
+
+	inputSize_ = inputCfg.size;
+	inputStride_ = inputCfg.stride;
+	outputFourcc_ = outputCfg.pixelFormat.fourcc();
+
+	window_.x = ((inputCfg.size.width - outputCfg.size.width) / 2) &
+		    ~(pattern.width - 1);
+	window_.y = ((inputCfg.size.height - outputCfg.size.height) / 2) &
+		    ~(pattern.height - 1);
+	window_.width = outputCfg.size.width;
+	window_.height = outputCfg.size.height;
+
+	/* The stats are computed on lines offset to the window, as DebayerCpu does */
+	stats_->setWindow(Rectangle(window_.size()));
+
+	/* Drop the buffers imported with the previous configuration */
+	makeCurrent();
+	clearImages();
+
+	static const std::array<std::array<GLint, 2>, 4> firstRed = { {
+		{ 1, 1 }, /* BGGR */
+		{ 0, 1 }, /* GBRG */
+		{ 1, 0 }, /* GRBG */
+		{ 0, 0 }, /* RGGB */
+	} };
+	const std::array<GLint, 2> &red = firstRed[inputFormat_.order];
+
+	InputFormat format;
+	float divisor = 1.0f;
+
+	if (inputFormat_.packing == BayerFormat::Packing::CSI2) {
+		format = Input10P;
+	} else if (inputFormat_.bitDepth == 8) {
+		format = Input8;
+	} else {
+		format = Input16;
+		divisor = 1 << (inputFormat_.bitDepth - 8);
+	}
+
+	glUseProgram(program_);
+	glUniform2i(windowUniform_, window_.x, window_.y);
+	glUniform2i(inputSizeUniform_, inputSize_.width, inputSize_.height);
+	glUniform2i(firstRedUniform_, red[0], red[1]);
+	glUniform1i(formatUniform_, format);
+	glUniform1f(divisorUniform_, divisor);
+
+	releaseCurrent();
+
+	return 0;
+}
+
+Size DebayerEGL::patternSize(PixelFormat inputFormat)
+{
+	BayerFormat bayerFormat = BayerFormat::fromPixelFormat(inputFormat);
+
+	if (!isSupportedInput(bayerFormat))
+		return {};
+
+	/* 5 bytes per 4 pixels for CSI-2 packed formats */
+	if (bayerFormat.packing == BayerFormat::Packing::CSI2)
+		return Size(4, 2);
+
+	return Size(2, 2);
+}
+
+std::vector<PixelFormat> DebayerEGL::formats(PixelFormat inputFormat)
+{
+	if (patternSize(inputFormat).isNull())
+		return {};
+
+	return { formats::XRGB8888, formats::ARGB8888,
+		 formats::XBGR8888, formats::ABGR8888 };
+}
+
+std::tuple<unsigned int, unsigned int>
+DebayerEGL::strideAndFrameSize(const PixelFormat &outputFormat, const Size &size)
+{
+	if (outputFormat != formats::XRGB8888 && outputFormat != formats::ARGB8888 &&
+	    outputFormat != formats::XBGR8888 && outputFormat != formats::ABGR8888)
+		return std::make_tuple(0, 0);
+
+	/* Align lines to 256 bytes, as commonly required by GPUs */
+	unsigned int stride = (size.width * 4 + 255) & ~255;
+
+	return std::make_tuple(stride, stride * size.height);
+}
+
+SizeRange DebayerEGL::sizes(PixelFormat inputFormat, const Size &inputSize)
+{
+	Size pattern = patternSize(inputFormat);
+
+	if (pattern.isNull())
+		return {};
+
+	/*
+	 * Keep a border on the left and right side for the interpolation, the
+	 * lines above and below the frame are mirrored.
+	 */
+	if (inputSize.width < 3 * pattern.width || inputSize.height < pattern.height) {
+		LOG(Debayer, Warning)
+			<< "Input format size too small: " << inputSize.toString();
+		return {};
+	}
+
+	return SizeRange(Size(pattern.width, pattern.height),
+			 Size((inputSize.width - 2 * pattern.width) & ~(pattern.width - 1),
+			      inputSize.height & ~(pattern.height - 1)),
+			 pattern.width, pattern.height);
+}
+
+void DebayerEGL::processStats(const uint8_t *src)
+{
+	const unsigned int bpp = inputFormat_.packing == BayerFormat::Packing::CSI2
+			       ? 10 : (inputFormat_.bitDepth + 7) & ~7;
+	const uint8_t *linePointers[3];
+
+	src += window_.x * bpp / 8;
+
+	stats_->startFrame();
+
+	for (unsigned int y = window_.y; y < window_.y + window_.height; y += 2) {
+		linePointers[0] = src + (y ? y - 1 : y + 1) * inputStride_;
+		linePointers[1] = src + y * inputStride_;
+		linePointers[2] = src + (y + 1) * inputStride_;
+
+		stats_->processLine0(y, linePointers);
+	}
+
+	stats_->finishFrame();
+}
+
+void DebayerEGL::process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs,
+			 const DebayerParams *params)
+{
+	FrameBuffer *output = outputs[0];
+
+	/* Copy metadata from the input buffer */
+	FrameMetadata &metadata = output->_d()->metadata();
+	metadata.status = input->metadata().status;
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+
+	makeCurrent();
+
+	Image *in = importBuffer(input, false);
+	Image *out = importBuffer(output, true);
+	if (!in || !out) {
+		releaseCurrent();
+		metadata.status = FrameMetadata::FrameError;
+		outputBufferReady.emit(output);
+		inputBufferReady.emit(input);
+		return;
+	}
+
+	std::array<uint8_t, DebayerParams::kRGBLookupSize * 3> lut;
+	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+		lut[i * 3] = params->red[i];
+		lut[i * 3 + 1] = params->green[i];
+		lut[i * 3 + 2] = params->blue[i];
+	}
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, lutTexture_);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DebayerParams::kRGBLookupSize, 1,
+			GL_RGB, GL_UNSIGNED_BYTE, lut.data());
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, in->texture);
+
+	static const GLfloat vertices[] = {
+		-1.0f, -1.0f,
+		1.0f, -1.0f,
+		-1.0f, 1.0f,
+		1.0f, 1.0f,
+	};
+
+	glUseProgram(program_);
+	glBindFramebuffer(GL_FRAMEBUFFER, out->framebuffer);
+	glViewport(0, 0, window_.width, window_.height);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, vertices);
+	glEnableVertexAttribArray(0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glFlush();
+
+	/* Gather the statistics on the CPU while the GPU renders */
+	MappedFrameBuffer mappedInput(input, MappedFrameBuffer::MapFlag::Read);
+	if (mappedInput.isValid())
+		processStats(mappedInput.planes()[0].data());
+	else
+		LOG(Debayer, Error) << "mmap-ing input buffer failed";
+
+	glFinish();
+	releaseCurrent();
+
+	metadata.planes()[0].bytesused = outputFrameSize_;
+
+	outputBufferReady.emit(output);
+	inputBufferReady.emit(input);
+}
+
+} /* namespace libcamera */
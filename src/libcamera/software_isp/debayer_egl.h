@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * GPU based debayering header
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "libcamera/internal/bayer_format.h"
+
+#include "debayer.h"
+#include "swstats_cpu.h"
+
+namespace libcamera {
+
+class DebayerEGL : public Debayer
+{
+public:
+	DebayerEGL(std::unique_ptr<SwStatsCpu> stats);
+	~DebayerEGL();
+
+	bool isValid() const { return program_ != 0; }
+
+	int configure(const StreamConfiguration &inputCfg,
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs);
+	Size patternSize(PixelFormat inputFormat);
+	std::vector<PixelFormat> formats(PixelFormat input);
+	std::tuple<unsigned int, unsigned int>
+	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size);
+	void process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs,
+		     const DebayerParams *params);
+	SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
+
+	const SharedFD &getStatsFD() { return stats_->getStatsFD(); }
+	void releaseStats(uint32_t index) { stats_->releaseBuffer(index); }
+	unsigned int frameSize() { return outputFrameSize_; }
+	unsigned int maxOutputs() { return 1; }
+
+private:
+	struct Image {
+		EGLImageKHR image;
+		GLuint texture;
+		GLuint framebuffer;
+	};
+
+	int initEGL();
+	int initProgram();
+	void makeCurrent();
+	void releaseCurrent();
+	Image *importBuffer(const FrameBuffer *buffer, bool output);
+	void clearImages();
+	void processStats(const uint8_t *src);
+
+	EGLDisplay display_;
+	EGLContext context_;
+
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_;
+	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES_;
+
+	GLuint program_;
+	GLuint lutTexture_;
+	GLint windowUniform_;
+	GLint inputSizeUniform_;
+	GLint firstRedUniform_;
+	GLint formatUniform_;
+	GLint divisorUniform_;
+
+	/* Imported buffers, indexed by dmabuf inode and offset */
+	std::map<std::pair<ino_t, unsigned int>, Image> inputImages_;
+	std::map<std::pair<ino_t, unsigned int>, Image> outputImages_;
+
+	std::unique_ptr<SwStatsCpu> stats_;
+	BayerFormat inputFormat_;
+	Size inputSize_;
+	unsigned int inputStride_;
+	uint32_t outputFourcc_;
+	unsigned int outputStride_;
+	unsigned int outputFrameSize_;
+	Rectangle window_;
+};
+
+} /* namespace libcamera */
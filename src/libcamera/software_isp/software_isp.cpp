@@ -7,22 +7,30 @@
 
 #include "libcamera/internal/software_isp/software_isp.h"
 
-#include <cmath>
+#include <algorithm>
 #include <stdint.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <libcamera/base/utils.h>
+
 #include <libcamera/formats.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/formats.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/software_isp/debayer_params.h"
+#include "libcamera/internal/software_isp/swisp_stats.h"
 
 #include "debayer_cpu.h"
+#if HAVE_DEBAYER_EGL
+#include "debayer_egl.h"
+#endif
 
 /**
  * \file software_isp.cpp
@@ -33,6 +41,9 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(SoftwareIsp)
 
+/* Maximum total size of the freed output buffers kept for reuse, in bytes. */
+static constexpr std::size_t kDmaBufPoolLimit = 64 << 20;
+
 /**
  * \class SoftwareIsp
  * \brief Class for the Software ISP
@@ -51,6 +62,9 @@ LOG_DEFINE_CATEGORY(SoftwareIsp)
 /**
  * \var SoftwareIsp::ispStatsReady
  * \brief A signal emitted when the statistics for IPA are ready
+ *
+ * The signal carries the index of the statistics buffer to be passed to
+ * processStats().
  */
 
 /**
@@ -66,33 +80,30 @@ LOG_DEFINE_CATEGORY(SoftwareIsp)
  * handler
  */
 SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor)
-	: dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+	: ispWorkerThread_("SoftwareIsp"),
+	  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
 		   DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
-		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf)
+		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf),
+	  paramsBufferIndex_(0), pendingFrames_{}
 {
-	/*
-	 * debayerParams_ must be initialized because the initial value is used for
-	 * the first two frames, i.e. until stats processing starts providing its
-	 * own parameters.
-	 *
-	 * \todo This should be handled in the same place as the related
-	 * operations, in the IPA module.
-	 */
-	std::array<uint8_t, 256> gammaTable;
-	for (unsigned int i = 0; i < 256; i++)
-		gammaTable[i] = UINT8_MAX * std::pow(i / 256.0, 0.5);
-	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
-		debayerParams_.red[i] = gammaTable[i];
-		debayerParams_.green[i] = gammaTable[i];
-		debayerParams_.blue[i] = gammaTable[i];
-	}
-
 	if (!dmaHeap_.isValid()) {
 		LOG(SoftwareIsp, Error) << "Failed to create DmaBufAllocator object";
 		return;
 	}
 
-	sharedParams_ = SharedMemObject<DebayerParams>("softIsp_params");
+	/*
+	 * Keep the output buffers freed by applications when reconfiguring the
+	 * camera, to reuse them when switching back to the same configuration.
+	 */
+	dmaHeap_.setPoolLimit(kDmaBufPoolLimit);
+
+	/*
+	 * The output buffers are written in full by the CPU, back them with
+	 * huge pages when available to reduce TLB misses.
+	 */
+	dmaHeap_.setHugePages(true);
+
+	sharedParams_ = SharedMemObject<DebayerParamsBuffers>("softIsp_params");
 	if (!sharedParams_) {
 		LOG(SoftwareIsp, Error) << "Failed to create shared memory for parameters";
 		return;
@@ -105,7 +116,32 @@ SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor)
 	}
 	stats->statsReady.connect(this, &SoftwareIsp::statsReady);
 
-	debayer_ = std::make_unique<DebayerCpu>(std::move(stats));
+	const char *mode = utils::secure_getenv("LIBCAMERA_SOFTISP_MODE");
+	if (mode && !strcmp(mode, "gpu")) {
+#if HAVE_DEBAYER_EGL
+		auto debayer = std::make_unique<DebayerEGL>(std::move(stats));
+		if (debayer->isValid()) {
+			debayer_ = std::move(debayer);
+		} else {
+			LOG(SoftwareIsp, Warning)
+				<< "GPU debayering unavailable, using the CPU";
+			stats = std::make_unique<SwStatsCpu>();
+			if (!stats->isValid()) {
+				LOG(SoftwareIsp, Error) << "Failed to create SwStatsCpu object";
+				return;
+			}
+			stats->statsReady.connect(this, &SoftwareIsp::statsReady);
+		}
+#else
+		LOG(SoftwareIsp, Warning)
+			<< "GPU debayering not supported, using the CPU";
+#endif
+	} else if (mode && strcmp(mode, "cpu")) {
+		LOG(SoftwareIsp, Warning) << "Unknown mode '" << mode << "'";
+	}
+
+	if (!debayer_)
+		debayer_ = std::make_unique<DebayerCpu>(std::move(stats));
 	debayer_->inputBufferReady.connect(this, &SoftwareIsp::inputReady);
 	debayer_->outputBufferReady.connect(this, &SoftwareIsp::outputReady);
 
@@ -136,13 +172,14 @@ SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor)
 
 	ipa_->setIspParams.connect(this, &SoftwareIsp::saveIspParams);
 	ipa_->setSensorControls.connect(this, &SoftwareIsp::setSensorCtrls);
+	ipa_->releaseStatsBuffer.connect(this, &SoftwareIsp::releaseStatsBuffer);
 
 	debayer_->moveToThread(&ispWorkerThread_);
 }
 
 SoftwareIsp::~SoftwareIsp()
 {
-	/* make sure to destroy the DebayerCpu before the ispWorkerThread_ is gone */
+	/* make sure to destroy the Debayer before the ispWorkerThread_ is gone */
 	debayer_.reset();
 }
 
@@ -158,15 +195,17 @@ SoftwareIsp::~SoftwareIsp()
 
 /**
  * \brief Process the statistics gathered
+ * \param[in] statsBufferId The index of the statistics buffer, as reported by
+ * the ispStatsReady signal
  * \param[in] sensorControls The sensor controls
  *
  * Requests the IPA to calculate new parameters for ISP and new control
  * values for the sensor.
  */
-void SoftwareIsp::processStats(const ControlList &sensorControls)
+void SoftwareIsp::processStats(uint32_t statsBufferId, const ControlList &sensorControls)
 {
 	ASSERT(ipa_);
-	ipa_->processStats(sensorControls);
+	ipa_->processStats(statsBufferId, sensorControls);
 }
 
 /**
@@ -178,6 +217,36 @@ bool SoftwareIsp::isValid() const
 	return !!debayer_;
 }
 
+/**
+ * \brief Set the account to charge the memory of the Software ISP on
+ * \param[in] account The memory account of the camera
+ *
+ * The parameters and statistics shared memory is charged immediately, and the
+ * internal buffers of the debayer when configuring the Software ISP. The
+ * output buffers are charged by the frame buffer allocator when exported to
+ * applications.
+ */
+void SoftwareIsp::setMemoryAccount(std::shared_ptr<MemoryAccount> account)
+{
+	memoryAccount_ = std::move(account);
+
+	sharedMemoryCharge_ = memoryAccount_->charge(MemoryUsage::Type::Anonymous,
+						     SharedMemObject<DebayerParamsBuffers>::kSize +
+						     sizeof(SwIspStatsBuffers));
+	debayerCharge_.release();
+}
+
+/**
+ * \brief Get the maximum number of streams produced from one input frame
+ * \return The maximum number of output configurations supported by configure()
+ */
+unsigned int SoftwareIsp::maxStreams() const
+{
+	ASSERT(debayer_);
+
+	return debayer_->maxOutputs();
+}
+
 /**
   * \brief Get the output formats supported for the given input format
   * \param[in] inputFormat The input format
@@ -194,6 +263,12 @@ std::vector<PixelFormat> SoftwareIsp::formats(PixelFormat inputFormat)
  * \brief Get the supported output sizes for the given input format and size
  * \param[in] inputFormat The input format
  * \param[in] inputSize The input frame size
+ *
+ * Output sizes smaller than the input size are normally produced by cropping
+ * the center of the input frame. With the CPU debayering backend, an output
+ * size of half the input size, rounded down to the Bayer pattern size, is
+ * instead produced by 2x2 binning of the full frame.
+ *
  * \return The valid size range or an empty range if there are none
  */
 SizeRange SoftwareIsp::sizes(PixelFormat inputFormat, const Size &inputSize)
@@ -223,6 +298,11 @@ SoftwareIsp::strideAndFrameSize(const PixelFormat &outputFormat, const Size &siz
  * \param[in] inputCfg The input configuration
  * \param[in] outputCfgs The output configurations
  * \param[in] sensorControls ControlInfoMap of the controls supported by the sensor
+ *
+ * Up to maxStreams() output configurations are supported, all produced from a
+ * single pass over the input frame. The output configurations shall have their
+ * stream set.
+ *
  * \return 0 on success, a negative errno on failure
  */
 int SoftwareIsp::configure(const StreamConfiguration &inputCfg,
@@ -235,7 +315,19 @@ int SoftwareIsp::configure(const StreamConfiguration &inputCfg,
 	if (ret < 0)
 		return ret;
 
-	return debayer_->configure(inputCfg, outputCfgs);
+	ret = debayer_->configure(inputCfg, outputCfgs);
+	if (ret < 0)
+		return ret;
+
+	if (memoryAccount_)
+		debayerCharge_ = memoryAccount_->charge(MemoryUsage::Type::Anonymous,
+							debayer_->memoryUsage());
+
+	streams_.clear();
+	for (const StreamConfiguration &cfg : outputCfgs)
+		streams_.push_back(cfg.stream());
+
+	return 0;
 }
 
 /**
@@ -251,26 +343,45 @@ int SoftwareIsp::exportBuffers(const Stream *stream, unsigned int count,
 {
 	ASSERT(debayer_ != nullptr);
 
-	/* single output for now */
 	if (stream == nullptr)
 		return -EINVAL;
 
+	const StreamConfiguration &cfg = stream->configuration();
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+	const size_t frameSize =
+		std::get<1>(debayer_->strideAndFrameSize(cfg.pixelFormat, cfg.size));
+
 	for (unsigned int i = 0; i < count; i++) {
 		const std::string name = "frame-" + std::to_string(i);
-		const size_t frameSize = debayer_->frameSize();
 
-		FrameBuffer::Plane outPlane;
-		outPlane.fd = SharedFD(dmaHeap_.alloc(name.c_str(), frameSize));
-		if (!outPlane.fd.isValid()) {
+		/*
+		 * Multi-planar formats are stored contiguously in a single
+		 * dma_buf, with the stride of the other planes computed from
+		 * the stride of the first plane.
+		 */
+		std::vector<FrameBuffer::Plane> planes(info.numPlanes());
+		unsigned int offset = 0;
+
+		for (auto [j, plane] : utils::enumerate(planes)) {
+			unsigned int stride = cfg.stride
+					    * info.planes[j].bytesPerGroup
+					    / info.planes[0].bytesPerGroup;
+
+			plane.offset = offset;
+			plane.length = info.planeSize(cfg.size.height, j, stride);
+			offset += plane.length;
+		}
+
+		std::unique_ptr<FrameBuffer> buffer =
+			dmaHeap_.exportFrameBuffer(name.c_str(), frameSize,
+						   std::move(planes));
+		if (!buffer) {
 			LOG(SoftwareIsp, Error)
 				<< "failed to allocate a dma_buf";
 			return -ENOMEM;
 		}
-		outPlane.offset = 0;
-		outPlane.length = frameSize;
 
-		std::vector<FrameBuffer::Plane> planes{ outPlane };
-		buffers->emplace_back(std::make_unique<FrameBuffer>(std::move(planes)));
+		buffers->push_back(std::move(buffer));
 	}
 
 	return count;
@@ -284,7 +395,7 @@ int SoftwareIsp::exportBuffers(const Stream *stream, unsigned int count,
  * \return 0 on success, a negative errno on failure
  */
 int SoftwareIsp::queueBuffers(FrameBuffer *input,
-			      const std::map<const Stream *, FrameBuffer *> &outputs)
+			      const Request::BufferMap &outputs)
 {
 	/*
 	 * Validate the outputs as a sanity check: at least one output is
@@ -293,15 +404,18 @@ int SoftwareIsp::queueBuffers(FrameBuffer *input,
 	if (outputs.empty())
 		return -EINVAL;
 
+	/* All the streams of the request are produced in a single pass */
+	std::vector<FrameBuffer *> buffers(streams_.size());
+
 	for (auto [stream, buffer] : outputs) {
-		if (!buffer)
-			return -EINVAL;
-		if (outputs.size() != 1) /* only single stream atm */
+		auto it = std::find(streams_.begin(), streams_.end(), stream);
+		if (!buffer || it == streams_.end())
 			return -EINVAL;
+
+		buffers[it - streams_.begin()] = buffer;
 	}
 
-	for (auto iter = outputs.begin(); iter != outputs.end(); iter++)
-		process(input, iter->second);
+	process(input, buffers);
 
 	return 0;
 }
@@ -329,22 +443,83 @@ void SoftwareIsp::stop()
 	ispWorkerThread_.wait();
 
 	ipa_->stop();
+
+	/* The IPA won't release the statistics it hasn't processed */
+	for (unsigned int i = 0; i < kSwIspStatsBufferCount; i++)
+		debayer_->releaseStats(i);
+
+	MutexLocker locker(pendingFramesMutex_);
+	pendingFrames_.fill({});
+	paramsBufferIndex_ = 0;
 }
 
 /**
  * \brief Passes the input framebuffer to the ISP worker to process
  * \param[in] input The input framebuffer
- * \param[out] output The framebuffer to write the processed frame to
+ * \param[out] outputs The framebuffers to write the processed frame to, one
+ * per configured stream in configuration order, null for the streams not
+ * requested
+ *
+ * The IPA is first requested to fill the next debayer parameters buffer for
+ * the frame. The frame is passed to the ISP worker, along with its parameters
+ * buffer, when the IPA signals that the parameters are ready.
  */
-void SoftwareIsp::process(FrameBuffer *input, FrameBuffer *output)
+void SoftwareIsp::process(FrameBuffer *input, const std::vector<FrameBuffer *> &outputs)
 {
-	debayer_->invokeMethod(&DebayerCpu::process,
-			       ConnectionTypeQueued, input, output, debayerParams_);
+	const uint32_t paramsBufferId = paramsBufferIndex_;
+
+	{
+		MutexLocker locker(pendingFramesMutex_);
+		PendingFrame &frame = pendingFrames_[paramsBufferId];
+
+		if (frame.input) {
+			locker.unlock();
+			LOG(SoftwareIsp, Error)
+				<< "Parameters buffer " << paramsBufferId
+				<< " still in use";
+			for (FrameBuffer *output : outputs) {
+				if (!output)
+					continue;
+
+				output->_d()->cancel();
+				outputBufferReady.emit(output);
+			}
+			inputBufferReady.emit(input);
+			return;
+		}
+
+		frame.input = input;
+		frame.outputs = outputs;
+	}
+
+	paramsBufferIndex_ = (paramsBufferIndex_ + 1) % kDebayerParamsBufferCount;
+
+	ipa_->fillParamsBuffer(input->metadata().sequence, paramsBufferId);
 }
 
-void SoftwareIsp::saveIspParams()
+void SoftwareIsp::saveIspParams(uint32_t paramsBufferId)
 {
-	debayerParams_ = *sharedParams_;
+	if (paramsBufferId >= kDebayerParamsBufferCount)
+		return;
+
+	FrameBuffer *input;
+	std::vector<FrameBuffer *> outputs;
+
+	{
+		MutexLocker locker(pendingFramesMutex_);
+		const PendingFrame &frame = pendingFrames_[paramsBufferId];
+
+		input = frame.input;
+		outputs = frame.outputs;
+	}
+
+	if (!input)
+		return;
+
+	const DebayerParams *params = &(*sharedParams_)[paramsBufferId];
+
+	debayer_->invokeMethod(&Debayer::process,
+			       ConnectionTypeQueued, input, outputs, params);
 }
 
 void SoftwareIsp::setSensorCtrls(const ControlList &sensorControls)
@@ -352,13 +527,30 @@ void SoftwareIsp::setSensorCtrls(const ControlList &sensorControls)
 	setSensorControls.emit(sensorControls);
 }
 
-void SoftwareIsp::statsReady()
+void SoftwareIsp::statsReady(uint32_t statsBufferId)
 {
-	ispStatsReady.emit();
+	ispStatsReady.emit(statsBufferId);
+}
+
+void SoftwareIsp::releaseStatsBuffer(uint32_t statsBufferId)
+{
+	debayer_->releaseStats(statsBufferId);
 }
 
 void SoftwareIsp::inputReady(FrameBuffer *input)
 {
+	/* Release the parameters buffer of the frame */
+	{
+		MutexLocker locker(pendingFramesMutex_);
+
+		for (PendingFrame &frame : pendingFrames_) {
+			if (frame.input == input) {
+				frame = {};
+				break;
+			}
+		}
+	}
+
 	inputBufferReady.emit(input);
 }
 
@@ -11,11 +11,16 @@
 
 #include "swstats_cpu.h"
 
+#include <algorithm>
+#include <stdlib.h>
+
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/tracepoints.h"
 
 namespace libcamera {
 
@@ -32,6 +37,25 @@ namespace libcamera {
  *
  * It is also possible to specify a window over which to gather statistics
  * instead of processing the whole frame.
+ *
+ * The statistics are stored in a ring of kSwIspStatsBufferCount buffers in
+ * shared memory, filled in turn. The index of the buffer holding the
+ * statistics of a frame is passed to the statsReady signal, and the buffer is
+ * then owned by the receiver until it calls releaseBuffer(). Buffers that are
+ * owned are skipped, and when none of the buffers is free, the statistics of
+ * the frame are gathered but dropped without emitting statsReady.
+ *
+ * To support processing a frame in multiple horizontal stripes concurrently,
+ * the statistics are accumulated in one set of partial statistics per stripe.
+ * Each stripe must only be processed by a single thread at a time. The partial
+ * statistics are merged into the statistics buffer when the frame is finished.
+ *
+ * As the statistics are only used for 3A, they don't need to be gathered on
+ * every pixel. By default one out of every two bayer pattern blocks is sampled
+ * in each direction. The subsampling factors can be increased, and the
+ * statistics restricted to a central region of the window, through the
+ * LIBCAMERA_SOFTISP_STATS_SUBSAMPLING and LIBCAMERA_SOFTISP_STATS_ROI
+ * environment variables.
  */
 
 /**
@@ -62,10 +86,12 @@ namespace libcamera {
  */
 
 /**
- * \fn void SwStatsCpu::processLine0(unsigned int y, const uint8_t *src[])
+ * \fn void SwStatsCpu::processLine0(unsigned int y, const uint8_t *src[],
+ * unsigned int stripe)
  * \brief Process line 0
  * \param[in] y The y coordinate.
  * \param[in] src The input data.
+ * \param[in] stripe The index of the stripe the line belongs to
  *
  * This function processes line 0 for input formats with
  * patternSize height == 1.
@@ -74,10 +100,12 @@ namespace libcamera {
  */
 
 /**
- * \fn void SwStatsCpu::processLine2(unsigned int y, const uint8_t *src[])
+ * \fn void SwStatsCpu::processLine2(unsigned int y, const uint8_t *src[],
+ * unsigned int stripe)
  * \brief Process line 2 and 3
  * \param[in] y The y coordinate.
  * \param[in] src The input data.
+ * \param[in] stripe The index of the stripe the line belongs to
  *
  * This function processes line 2 and 3 for input formats with
  * patternSize height == 4.
@@ -85,14 +113,18 @@ namespace libcamera {
  */
 
 /**
- * \var Signal<> SwStatsCpu::statsReady
+ * \var Signal<uint32_t> SwStatsCpu::statsReady
  * \brief Signals that the statistics are ready
+ *
+ * The signal carries the index of the statistics buffer in the shared memory
+ * ring.
  */
 
 /**
  * \typedef SwStatsCpu::statsProcessFn
  * \brief Called when there is data to get statistics from
  * \param[in] src The input data
+ * \param[out] stats The partial statistics to accumulate into
  *
  * These functions take an array of (patternSize_.height + 1) src
  * pointers each pointing to a line in the source image. The middle
@@ -103,11 +135,32 @@ namespace libcamera {
  * See the documentation of DebayerCpu::debayerFn for more details.
  */
 
+/**
+ * \var unsigned int SwStatsCpu::xSubsampling_
+ * \brief Sample one out of every xSubsampling_ bayer blocks horizontally
+ */
+
+/**
+ * \var unsigned int SwStatsCpu::ySubsampling_
+ * \brief Sample one out of every ySubsampling_ bayer blocks vertically
+ */
+
+/**
+ * \var unsigned int SwStatsCpu::roiPercentage_
+ * \brief Size of the central statistics region, in percents of the window
+ */
+
 /**
  * \var unsigned int SwStatsCpu::ySkipMask_
  * \brief Skip lines where this bitmask is set in y
  */
 
+/**
+ * \var unsigned int SwStatsCpu::xStep_
+ * \brief Step between sampled blocks in a line, in pixels or bytes for packed
+ * formats
+ */
+
 /**
  * \var Rectangle SwStatsCpu::window_
  * \brief Statistics window, set by setWindow(), used every line
@@ -129,12 +182,51 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(SwStatsCpu)
 
+static_assert(kSwIspStatsBufferCount <= 32,
+	      "The statistics buffers ownership is tracked in a 32-bit mask");
+
+static constexpr unsigned int kMaxSubsampling = 16;
+
+/*
+ * Round the subsampling factor down to a power of two in the supported range,
+ * for the line skipping to be implemented with a mask.
+ */
+static unsigned int subsamplingFactor(unsigned long value)
+{
+	unsigned int factor = 1;
+
+	while (factor * 2 <= value && factor * 2 <= kMaxSubsampling)
+		factor *= 2;
+
+	return factor;
+}
+
 SwStatsCpu::SwStatsCpu()
-	: sharedStats_("softIsp_stats")
+	: xSubsampling_(2), ySubsampling_(2), roiPercentage_(100),
+	  sharedStats_("softIsp_stats"), bufferIndex_(0),
+	  frameBuffer_(kSwIspStatsBufferCount), busyBuffers_(0)
 {
 	if (!sharedStats_)
 		LOG(SwStatsCpu, Error)
 			<< "Failed to create shared memory for statistics";
+
+	const char *env = utils::secure_getenv("LIBCAMERA_SOFTISP_STATS_SUBSAMPLING");
+	if (env) {
+		char *end;
+
+		xSubsampling_ = subsamplingFactor(strtoul(env, &end, 10));
+		ySubsampling_ = *end == 'x'
+			      ? subsamplingFactor(strtoul(end + 1, nullptr, 10))
+			      : xSubsampling_;
+	}
+
+	env = utils::secure_getenv("LIBCAMERA_SOFTISP_STATS_ROI");
+	if (env)
+		roiPercentage_ = std::clamp(strtoul(env, nullptr, 10), 1UL, 100UL);
+
+	LOG(SwStatsCpu, Debug)
+		<< "Statistics subsampling " << xSubsampling_ << "x"
+		<< ySubsampling_ << ", ROI " << roiPercentage_ << "%";
 }
 
 static constexpr unsigned int kRedYMul = 77; /* 0.299 * 256 */
@@ -157,14 +249,14 @@ static constexpr unsigned int kBlueYMul = 29; /* 0.114 * 256 */
 	yVal = r * kRedYMul;               \
 	yVal += g * kGreenYMul;            \
 	yVal += b * kBlueYMul;             \
-	stats_.yHistogram[yVal * SwIspStats::kYHistogramSize / (256 * 256 * (div))]++;
+	stats.yHistogram[yVal * SwIspStats::kYHistogramSize / (256 * 256 * (div))]++;
 
 #define SWSTATS_FINISH_LINE_STATS() \
-	stats_.sumR_ += sumR;       \
-	stats_.sumG_ += sumG;       \
-	stats_.sumB_ += sumB;
+	stats.sumR_ += sumR;        \
+	stats.sumG_ += sumG;        \
+	stats.sumB_ += sumB;
 
-void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[], SwIspStats &stats)
 {
 	const uint8_t *src0 = src[1] + window_.x;
 	const uint8_t *src1 = src[2] + window_.x;
@@ -174,8 +266,8 @@ void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
+	/* x += xStep_ sample every xSubsampling_ 2x2 block */
+	for (int x = 0; x < (int)window_.width; x += xStep_) {
 		b = src0[x];
 		g = src0[x + 1];
 		g2 = src1[x];
@@ -189,7 +281,7 @@ void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[], SwIspStats &stats)
 {
 	const uint16_t *src0 = (const uint16_t *)src[1] + window_.x;
 	const uint16_t *src1 = (const uint16_t *)src[2] + window_.x;
@@ -199,8 +291,8 @@ void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
+	/* x += xStep_ sample every xSubsampling_ 2x2 block */
+	for (int x = 0; x < (int)window_.width; x += xStep_) {
 		b = src0[x];
 		g = src0[x + 1];
 		g2 = src1[x];
@@ -215,7 +307,7 @@ void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[], SwIspStats &stats)
 {
 	const uint16_t *src0 = (const uint16_t *)src[1] + window_.x;
 	const uint16_t *src1 = (const uint16_t *)src[2] + window_.x;
@@ -225,8 +317,8 @@ void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
+	/* x += xStep_ sample every xSubsampling_ 2x2 block */
+	for (int x = 0; x < (int)window_.width; x += xStep_) {
 		b = src0[x];
 		g = src0[x + 1];
 		g2 = src1[x];
@@ -241,7 +333,7 @@ void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[], SwIspStats &stats)
 {
 	const uint8_t *src0 = src[1] + window_.x * 5 / 4;
 	const uint8_t *src1 = src[2] + window_.x * 5 / 4;
@@ -252,8 +344,8 @@ void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[])
 
 	SWSTATS_START_LINE_STATS(uint8_t)
 
-	/* x += 5 sample every other 2x2 block */
-	for (int x = 0; x < widthInBytes; x += 5) {
+	/* x += xStep_ sample every xSubsampling_ 2x2 block */
+	for (int x = 0; x < widthInBytes; x += xStep_) {
 		/* BGGR */
 		b = src0[x];
 		g = src0[x + 1];
@@ -267,7 +359,7 @@ void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsGBRG10PLine0(const uint8_t *src[])
+void SwStatsCpu::statsGBRG10PLine0(const uint8_t *src[], SwIspStats &stats)
 {
 	const uint8_t *src0 = src[1] + window_.x * 5 / 4;
 	const uint8_t *src1 = src[2] + window_.x * 5 / 4;
@@ -278,8 +370,8 @@ void SwStatsCpu::statsGBRG10PLine0(const uint8_t *src[])
 
 	SWSTATS_START_LINE_STATS(uint8_t)
 
-	/* x += 5 sample every other 2x2 block */
-	for (int x = 0; x < widthInBytes; x += 5) {
+	/* x += xStep_ sample every xSubsampling_ 2x2 block */
+	for (int x = 0; x < widthInBytes; x += xStep_) {
 		/* GBRG */
 		g = src0[x];
 		b = src0[x + 1];
@@ -303,21 +395,89 @@ void SwStatsCpu::startFrame(void)
 	if (window_.width == 0)
 		LOG(SwStatsCpu, Error) << "Calling startFrame() without setWindow()";
 
-	stats_.sumR_ = 0;
-	stats_.sumB_ = 0;
-	stats_.sumG_ = 0;
-	stats_.yHistogram.fill(0);
+	/* Pick the next buffer of the ring that isn't owned by the receiver */
+	const uint32_t busy = busyBuffers_.load(std::memory_order_acquire);
+
+	frameBuffer_ = kSwIspStatsBufferCount;
+	for (unsigned int i = 0; i < kSwIspStatsBufferCount; i++) {
+		uint32_t index = (bufferIndex_ + i) % kSwIspStatsBufferCount;
+		if (!(busy & (1U << index))) {
+			frameBuffer_ = index;
+			break;
+		}
+	}
+
+	/*
+	 * The first stripe accumulates directly in the shared buffer, or in a
+	 * private buffer when the statistics of the frame will be dropped.
+	 */
+	stripeStats_[0] = frameBuffer_ < kSwIspStatsBufferCount
+			? &(*sharedStats_)[frameBuffer_] : &droppedStats_;
+
+	for (SwIspStats *stats : stripeStats_) {
+		stats->sumR_ = 0;
+		stats->sumB_ = 0;
+		stats->sumG_ = 0;
+		stats->yHistogram.fill(0);
+	}
 }
 
 /**
  * \brief Finish statistics calculation for the current frame
  *
+ * Merge the partial statistics of all stripes in the current statistics
+ * buffer, signal its index and move to the next buffer of the ring. If no
+ * statistics buffer was free when the frame started, the statistics are
+ * dropped and statsReady isn't emitted. All stripes must have been fully
+ * processed before calling this function.
+ *
  * This may only be called after a successful setWindow() call.
  */
 void SwStatsCpu::finishFrame(void)
 {
-	*sharedStats_ = stats_;
-	statsReady.emit();
+	SwIspStats &stats = *stripeStats_[0];
+
+	for (const SwIspStats &partial : partialStats_) {
+		stats.sumR_ += partial.sumR_;
+		stats.sumG_ += partial.sumG_;
+		stats.sumB_ += partial.sumB_;
+
+		for (unsigned int i = 0; i < SwIspStats::kYHistogramSize; i++)
+			stats.yHistogram[i] += partial.yHistogram[i];
+	}
+
+	if (frameBuffer_ >= kSwIspStatsBufferCount) {
+		LOG(SwStatsCpu, Warning)
+			<< "No free statistics buffer, dropping the frame statistics";
+		return;
+	}
+
+	uint32_t index = frameBuffer_;
+	busyBuffers_.fetch_or(1U << index, std::memory_order_relaxed);
+	bufferIndex_ = (index + 1) % kSwIspStatsBufferCount;
+
+	LIBCAMERA_TRACEPOINT(swstats_frame_finish, index);
+
+	statsReady.emit(index);
+}
+
+/**
+ * \brief Release a statistics buffer
+ * \param[in] index The index of the buffer, as passed to the statsReady signal
+ *
+ * Return the ownership of the statistics buffer \a index, to let its content be
+ * overwritten by the statistics of a later frame. The receiver of the
+ * statsReady signal shall release each buffer once it has finished reading the
+ * statistics.
+ *
+ * This function may be called from any thread.
+ */
+void SwStatsCpu::releaseBuffer(uint32_t index)
+{
+	if (index >= kSwIspStatsBufferCount)
+		return;
+
+	busyBuffers_.fetch_and(~(1U << index), std::memory_order_release);
 }
 
 /**
@@ -352,21 +512,55 @@ int SwStatsCpu::setupStandardBayerOrder(BayerFormat::Order order)
 
 	patternSize_.height = 2;
 	patternSize_.width = 2;
-	ySkipMask_ = 0x02; /* Skip every 3th and 4th line */
+	setupSubsampling(false);
 	return 0;
 }
 
+/**
+ * \brief Setup the line skip mask and the block step for the subsampling
+ * \param[in] packed Whether the input format is CSI-2 10-bit packed
+ *
+ * With the default subsampling factors of 2, this skips every 3th and 4th
+ * line and samples every other 2x2 block. Packed formats store two 2x2 blocks
+ * per 5 bytes group and only the first block of a group is sampled, the
+ * horizontal subsampling factor is thus at least 2 in that case.
+ */
+void SwStatsCpu::setupSubsampling(bool packed)
+{
+	ySkipMask_ = (patternSize_.height * ySubsampling_ - 1) &
+		     ~(patternSize_.height - 1);
+
+	if (packed)
+		xStep_ = 5 * std::max(xSubsampling_, 2U) / 2;
+	else
+		xStep_ = 2 * xSubsampling_;
+}
+
 /**
  * \brief Configure the statistics object for the passed in input format
  * \param[in] inputCfg The input format
+ * \param[in] stripeCount The number of stripes the frames will be split in
+ *
+ * The \a stripeCount sets the number of partial statistics accumulators. Lines
+ * passed to processLine0() and processLine2() with different stripe indices
+ * may be processed concurrently.
  *
  * \return 0 on success, a negative errno value on failure
  */
-int SwStatsCpu::configure(const StreamConfiguration &inputCfg)
+int SwStatsCpu::configure(const StreamConfiguration &inputCfg,
+			  unsigned int stripeCount)
 {
 	BayerFormat bayerFormat =
 		BayerFormat::fromPixelFormat(inputCfg.pixelFormat);
 
+	if (!stripeCount)
+		return -EINVAL;
+
+	partialStats_.resize(stripeCount - 1);
+	stripeStats_.resize(stripeCount);
+	for (unsigned int i = 1; i < stripeCount; i++)
+		stripeStats_[i] = &partialStats_[i - 1];
+
 	if (bayerFormat.packing == BayerFormat::Packing::None &&
 	    setupStandardBayerOrder(bayerFormat.order) == 0) {
 		switch (bayerFormat.bitDepth) {
@@ -386,9 +580,8 @@ int SwStatsCpu::configure(const StreamConfiguration &inputCfg)
 	    bayerFormat.packing == BayerFormat::Packing::CSI2) {
 		patternSize_.height = 2;
 		patternSize_.width = 4; /* 5 bytes per *4* pixels */
-		/* Skip every 3th and 4th line, sample every other 2x2 block */
-		ySkipMask_ = 0x02;
 		xShift_ = 0;
+		setupSubsampling(true);
 
 		switch (bayerFormat.order) {
 		case BayerFormat::BGGR:
@@ -414,10 +607,17 @@ int SwStatsCpu::configure(const StreamConfiguration &inputCfg)
 /**
  * \brief Specify window coordinates over which to gather statistics
  * \param[in] window The window object.
+ *
+ * When a statistics ROI is configured, the statistics are only gathered over
+ * the central part of the \a window.
  */
 void SwStatsCpu::setWindow(const Rectangle &window)
 {
-	window_ = window;
+	if (roiPercentage_ < 100)
+		window_ = (window.size() * (roiPercentage_ / 100.0f))
+				  .centeredTo(window.center());
+	else
+		window_ = window;
 
 	window_.x &= ~(patternSize_.width - 1);
 	window_.x += xShift_;
@@ -11,7 +11,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <stdint.h>
+#include <vector>
 
 #include <libcamera/base/signal.h>
 
@@ -38,44 +40,56 @@ public:
 
 	const Size &patternSize() { return patternSize_; }
 
-	int configure(const StreamConfiguration &inputCfg);
+	int configure(const StreamConfiguration &inputCfg,
+		      unsigned int stripeCount = 1);
 	void setWindow(const Rectangle &window);
 	void startFrame();
 	void finishFrame();
+	void releaseBuffer(uint32_t index);
 
-	void processLine0(unsigned int y, const uint8_t *src[])
+	void processLine0(unsigned int y, const uint8_t *src[],
+			  unsigned int stripe = 0)
 	{
 		if ((y & ySkipMask_) || y < static_cast<unsigned int>(window_.y) ||
 		    y >= (window_.y + window_.height))
 			return;
 
-		(this->*stats0_)(src);
+		(this->*stats0_)(src, *stripeStats_[stripe]);
 	}
 
-	void processLine2(unsigned int y, const uint8_t *src[])
+	void processLine2(unsigned int y, const uint8_t *src[],
+			  unsigned int stripe = 0)
 	{
 		if ((y & ySkipMask_) || y < static_cast<unsigned int>(window_.y) ||
 		    y >= (window_.y + window_.height))
 			return;
 
-		(this->*stats2_)(src);
+		(this->*stats2_)(src, *stripeStats_[stripe]);
 	}
 
-	Signal<> statsReady;
+	Signal<uint32_t> statsReady;
 
 private:
-	using statsProcessFn = void (SwStatsCpu::*)(const uint8_t *src[]);
+	using statsProcessFn = void (SwStatsCpu::*)(const uint8_t *src[],
+						    SwIspStats &stats);
 
 	int setupStandardBayerOrder(BayerFormat::Order order);
 	/* Bayer 8 bpp unpacked */
-	void statsBGGR8Line0(const uint8_t *src[]);
+	void statsBGGR8Line0(const uint8_t *src[], SwIspStats &stats);
 	/* Bayer 10 bpp unpacked */
-	void statsBGGR10Line0(const uint8_t *src[]);
+	void statsBGGR10Line0(const uint8_t *src[], SwIspStats &stats);
 	/* Bayer 12 bpp unpacked */
-	void statsBGGR12Line0(const uint8_t *src[]);
+	void statsBGGR12Line0(const uint8_t *src[], SwIspStats &stats);
 	/* Bayer 10 bpp packed */
-	void statsBGGR10PLine0(const uint8_t *src[]);
-	void statsGBRG10PLine0(const uint8_t *src[]);
+	void statsBGGR10PLine0(const uint8_t *src[], SwIspStats &stats);
+	void statsGBRG10PLine0(const uint8_t *src[], SwIspStats &stats);
+
+	void setupSubsampling(bool packed);
+
+	/* Subsampling and ROI settings, set at construction time */
+	unsigned int xSubsampling_;
+	unsigned int ySubsampling_;
+	unsigned int roiPercentage_;
 
 	/* Variables set by configure(), used every line */
 	statsProcessFn stats0_;
@@ -83,6 +97,7 @@ private:
 	bool swapLines_;
 
 	unsigned int ySkipMask_;
+	unsigned int xStep_;
 
 	Rectangle window_;
 
@@ -90,8 +105,13 @@ private:
 
 	unsigned int xShift_;
 
-	SharedMemObject<SwIspStats> sharedStats_;
-	SwIspStats stats_;
+	SharedMemObject<SwIspStatsBuffers> sharedStats_;
+	uint32_t bufferIndex_;
+	uint32_t frameBuffer_;
+	std::atomic<uint32_t> busyBuffers_;
+	SwIspStats droppedStats_;
+	std::vector<SwIspStats *> stripeStats_;
+	std::vector<SwIspStats> partialStats_;
 };
 
 } /* namespace libcamera */
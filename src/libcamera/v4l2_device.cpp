@@ -11,6 +11,7 @@
 #include <iomanip>
 #include <limits.h>
 #include <map>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -25,13 +26,17 @@
 #include <libcamera/base/utils.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/media_request.h"
 #include "libcamera/internal/sysfs.h"
+#include "libcamera/internal/tracepoints.h"
 
 /**
  * \file v4l2_device.h
  * \brief Common base for V4L2 devices and subdevices
  */
 
+using namespace std::chrono_literals;
+
 namespace libcamera {
 
 LOG_DEFINE_CATEGORY(V4L2)
@@ -59,8 +64,9 @@ LOG_DEFINE_CATEGORY(V4L2)
  */
 V4L2Device::V4L2Device(const std::string &deviceNode)
 	: deviceNode_(deviceNode), fdEventNotifier_(nullptr),
-	  frameStartEnabled_(false)
+	  frameStartEnabled_(false), controlCacheEnabled_(false)
 {
+	flushTimer_.timeout.connect(this, &V4L2Device::flushControls);
 }
 
 /**
@@ -129,6 +135,8 @@ int V4L2Device::setFd(UniqueFD fd)
 	fdEventNotifier_->setEnabled(false);
 
 	listControls();
+	pendingControls_ = ControlList(controls_);
+	enableControlCache();
 
 	return 0;
 }
@@ -143,6 +151,9 @@ void V4L2Device::close()
 	if (!isOpen())
 		return;
 
+	flushControls();
+	disableControlCache();
+
 	delete fdEventNotifier_;
 
 	fd_.reset();
@@ -163,10 +174,15 @@ void V4L2Device::close()
 /**
  * \brief Read controls from the device
  * \param[in] ids The list of controls to read, specified by their ID
+ * \param[in] request The media request to read the controls from
  *
  * This function reads the value of all controls contained in \a ids, and
  * returns their values as a ControlList.
  *
+ * If \a request is not null, the values are read from the request instead of
+ * the device. Once the request has completed, they are the values that have
+ * been applied by the request.
+ *
  * If any control in \a ids is not supported by the device, is disabled (i.e.
  * has the V4L2_CTRL_FLAG_DISABLED flag set), or if any other error occurs
  * during validation of the requested controls, no control is read and this
@@ -175,11 +191,15 @@ void V4L2Device::close()
  * \return The control values in a ControlList on success, or an empty list on
  * error
  */
-ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
+ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids,
+				       const MediaRequest *request)
 {
 	if (ids.empty())
 		return {};
 
+	if (!request)
+		flushControls();
+
 	ControlList ctrls{ controls_ };
 
 	for (uint32_t id : ids) {
@@ -229,10 +249,16 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
 	}
 
 	struct v4l2_ext_controls v4l2ExtCtrls = {};
-	v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
 	v4l2ExtCtrls.controls = v4l2Ctrls.data();
 	v4l2ExtCtrls.count = v4l2Ctrls.size();
 
+	if (request) {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		v4l2ExtCtrls.request_fd = request->fd();
+	} else {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+	}
+
 	int ret = ioctl(VIDIOC_G_EXT_CTRLS, &v4l2ExtCtrls);
 	if (ret) {
 		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
@@ -254,17 +280,34 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
 
 	updateControls(&ctrls, v4l2Ctrls);
 
+	if (!request) {
+		for (const v4l2_ext_control &v4l2Ctrl : v4l2Ctrls)
+			updateControlCache(v4l2Ctrl.id, ctrls.get(v4l2Ctrl.id));
+	}
+
 	return ctrls;
 }
 
 /**
  * \brief Write controls to the device
  * \param[in] ctrls The list of controls to write
+ * \param[in] request The media request to store the controls in
  *
  * This function writes the value of all controls contained in \a ctrls, and
  * stores the values actually applied to the device in the corresponding
  * \a ctrls entry.
  *
+ * If \a request is not null, the controls are stored in the request instead of
+ * being applied immediately, and will be applied atomically with the other
+ * objects of the request when it is processed by the kernel. The request shall
+ * be in the MediaRequest::Status::Idle state.
+ *
+ * The V4L2Device caches the last value written to or read from each control,
+ * and skips writing controls whose value wouldn't change. Volatile, read-only,
+ * write-only and execute-on-write controls are never cached. The cache relies
+ * on control change events to detect changes made by the driver, and is
+ * disabled for devices that don't support them.
+ *
  * If any control in \a ctrls is not supported by the device, is disabled (i.e.
  * has the V4L2_CTRL_FLAG_DISABLED flag set), is read-only, if any other error
  * occurs during validation of the requested controls, no control is written and
@@ -279,13 +322,27 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
  * \retval -EINVAL One of the control is not supported or not accessible
  * \retval i The index of the control that failed
  */
-int V4L2Device::setControls(ControlList *ctrls)
+int V4L2Device::setControls(ControlList *ctrls, const MediaRequest *request)
 {
 	if (ctrls->empty())
 		return 0;
 
-	std::vector<v4l2_ext_control> v4l2Ctrls(ctrls->size());
-	memset(v4l2Ctrls.data(), 0, sizeof(v4l2_ext_control) * ctrls->size());
+	/* Apply the deferred writes first to preserve the writes order. */
+	if (!request)
+		flushControls();
+
+	/*
+	 * Skip the controls whose value matches the cache, unless the driver
+	 * may have changed the value behind our back. The indices of the
+	 * written controls in \a ctrls are stored to report errors.
+	 */
+	bool useCache = !request && !controlCache_.empty() &&
+			!controlEventsPending();
+
+	std::vector<v4l2_ext_control> v4l2Ctrls;
+	std::vector<unsigned int> indices;
+	v4l2Ctrls.reserve(ctrls->size());
+	indices.reserve(ctrls->size());
 
 	for (auto [ctrl, i] = std::pair(ctrls->begin(), 0u); i < ctrls->size(); ctrl++, i++) {
 		const unsigned int id = ctrl->first;
@@ -295,8 +352,17 @@ int V4L2Device::setControls(ControlList *ctrls)
 				<< "Control " << utils::hex(id) << " not found";
 			return -EINVAL;
 		}
-		v4l2_ext_control &v4l2Ctrl = v4l2Ctrls[i];
+
+		if (useCache) {
+			const auto cached = controlCache_.find(id);
+			if (cached != controlCache_.end() &&
+			    cached->second == ctrl->second)
+				continue;
+		}
+
+		v4l2_ext_control &v4l2Ctrl = v4l2Ctrls.emplace_back();
 		v4l2Ctrl.id = id;
+		indices.push_back(i);
 
 		/* Set the v4l2_ext_control value for the write operation. */
 		ControlValue &value = ctrl->second;
@@ -339,12 +405,24 @@ int V4L2Device::setControls(ControlList *ctrls)
 		}
 	}
 
+	if (v4l2Ctrls.empty())
+		return 0;
+
 	struct v4l2_ext_controls v4l2ExtCtrls = {};
-	v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
 	v4l2ExtCtrls.controls = v4l2Ctrls.data();
 	v4l2ExtCtrls.count = v4l2Ctrls.size();
 
+	if (request) {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		v4l2ExtCtrls.request_fd = request->fd();
+	} else {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+	}
+
+	LIBCAMERA_TRACEPOINT(v4l2_set_controls_begin, deviceNode_.c_str(),
+			     v4l2ExtCtrls.count);
 	int ret = ioctl(VIDIOC_S_EXT_CTRLS, &v4l2ExtCtrls);
+	LIBCAMERA_TRACEPOINT(v4l2_set_controls_end, deviceNode_.c_str(), ret);
 	if (ret) {
 		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
 
@@ -360,15 +438,70 @@ int V4L2Device::setControls(ControlList *ctrls)
 		LOG(V4L2, Error) << "Unable to set control " << utils::hex(id)
 				 << ": " << strerror(-ret);
 
+		controlCache_.erase(id);
+
 		v4l2Ctrls.resize(errorIdx);
-		ret = errorIdx;
+		ret = indices[errorIdx];
 	}
 
 	updateControls(ctrls, v4l2Ctrls);
 
+	/*
+	 * Controls stored in a request are applied later, their cached value
+	 * becomes unknown.
+	 */
+	for (const v4l2_ext_control &v4l2Ctrl : v4l2Ctrls) {
+		if (request)
+			controlCache_.erase(v4l2Ctrl.id);
+		else
+			updateControlCache(v4l2Ctrl.id, ctrls->get(v4l2Ctrl.id));
+	}
+
 	return ret;
 }
 
+/**
+ * \brief Write controls to the device at the end of the event loop iteration
+ * \param[in] ctrls The list of controls to write
+ *
+ * This function stores the controls in \a ctrls to be written to the device
+ * later, coalescing all the writes issued during the same iteration of the
+ * event loop of the calling thread into a single ioctl call. When the same
+ * control is written multiple times, the last value wins.
+ *
+ * The deferred writes are applied before any call to getControls() or
+ * setControls(), and can be applied explicitly with flushControls(). As the
+ * values actually applied to the device aren't reported to the caller, errors
+ * are only logged.
+ */
+void V4L2Device::setControlsDeferred(const ControlList &ctrls)
+{
+	if (ctrls.empty())
+		return;
+
+	pendingControls_.merge(ctrls, ControlList::MergePolicy::OverwriteExisting);
+
+	if (!flushTimer_.isRunning())
+		flushTimer_.start(0ms);
+}
+
+/**
+ * \brief Write the controls deferred by setControlsDeferred() to the device
+ * \return 0 on success or an error code otherwise, as for setControls()
+ */
+int V4L2Device::flushControls()
+{
+	flushTimer_.stop();
+
+	if (pendingControls_.empty())
+		return 0;
+
+	ControlList ctrls = std::move(pendingControls_);
+	pendingControls_ = ControlList(controls_);
+
+	return setControls(&ctrls);
+}
+
 /**
  * \brief Retrieve the v4l2_query_ext_ctrl information for the given control
  * \param[in] id The V4L2 control id
@@ -435,7 +568,7 @@ int V4L2Device::setFrameStartEnabled(bool enable)
 	if (enable && ret)
 		return ret;
 
-	fdEventNotifier_->setEnabled(enable);
+	fdEventNotifier_->setEnabled(enable || controlCacheEnabled_);
 	frameStartEnabled_ = enable;
 
 	return ret;
@@ -691,6 +824,9 @@ void V4L2Device::updateControlInfo()
 
 		info = *v4l2ControlInfo(ctrl);
 	}
+
+	/* Values may have been clamped to the new ranges. */
+	controlCache_.clear();
 }
 
 /*
@@ -738,6 +874,60 @@ void V4L2Device::updateControls(ControlList *ctrls,
 	}
 }
 
+/*
+ * \brief Check if the value of a control can be cached
+ *
+ * Values of volatile controls can change at any time, and writing controls that
+ * trigger an action must not be skipped even when the value doesn't change.
+ */
+bool V4L2Device::controlCacheable(const v4l2_query_ext_ctrl &ctrl)
+{
+	return !(ctrl.flags & (V4L2_CTRL_FLAG_VOLATILE |
+			       V4L2_CTRL_FLAG_EXECUTE_ON_WRITE |
+			       V4L2_CTRL_FLAG_WRITE_ONLY |
+			       V4L2_CTRL_FLAG_READ_ONLY));
+}
+
+/*
+ * \brief Store the value of a control written to or read from the device
+ *
+ * Writing a control flagged with V4L2_CTRL_FLAG_UPDATE may change the value of
+ * other controls in the same cluster without generating any control event for
+ * the V4L2Device, invalidate the whole cache in that case.
+ */
+void V4L2Device::updateControlCache(unsigned int id, const ControlValue &value)
+{
+	if (!controlCacheEnabled_)
+		return;
+
+	const struct v4l2_query_ext_ctrl &info = controlInfo_[id];
+
+	if (info.flags & V4L2_CTRL_FLAG_UPDATE)
+		controlCache_.clear();
+
+	if (controlCacheable(info))
+		controlCache_[id] = value;
+}
+
+/*
+ * \brief Check if events are waiting to be dequeued
+ *
+ * Control change events are only processed when the event loop runs. Check
+ * for pending events before relying on the cache, and invalidate the whole
+ * cache if any is found, as it can't be dequeued without also dispatching
+ * frame start events synchronously.
+ */
+bool V4L2Device::controlEventsPending()
+{
+	struct pollfd pfd = { fd_.get(), POLLPRI, 0 };
+
+	if (::poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLPRI))
+		return false;
+
+	controlCache_.clear();
+	return true;
+}
+
 /**
  * \brief Slot to handle V4L2 events from the V4L2 device
  *
@@ -752,6 +942,13 @@ void V4L2Device::eventAvailable()
 		LOG(V4L2, Error)
 			<< "Failed to dequeue event, disabling event notifier";
 		fdEventNotifier_->setEnabled(false);
+		disableControlCache();
+		return;
+	}
+
+	if (event.type == V4L2_EVENT_CTRL) {
+		/* The driver changed the control, its cached value is stale. */
+		controlCache_.erase(event.id);
 		return;
 	}
 
@@ -760,12 +957,61 @@ void V4L2Device::eventAvailable()
 			<< "Spurious event (" << event.type
 			<< "), disabling event notifier";
 		fdEventNotifier_->setEnabled(false);
+		disableControlCache();
 		return;
 	}
 
 	frameStart.emit(event.u.frame_sync.frame_sequence);
 }
 
+/*
+ * \brief Enable the control cache
+ *
+ * Values of controls written or read by the V4L2Device are cached to skip
+ * writes that wouldn't change the value of the control. The driver may however
+ * change the value of controls on its own, for instance when the range of a
+ * control depends on the value of another control. Subscribe to control change
+ * events for all the cacheable controls to invalidate their cached value in
+ * that case. The cache is disabled if the device doesn't support control
+ * events.
+ */
+void V4L2Device::enableControlCache()
+{
+	for (const auto &[id, info] : controlInfo_) {
+		if (!controlCacheable(info))
+			continue;
+
+		struct v4l2_event_subscription event{};
+		event.type = V4L2_EVENT_CTRL;
+		event.id = id;
+
+		int ret = ioctl(VIDIOC_SUBSCRIBE_EVENT, &event);
+		if (ret) {
+			LOG(V4L2, Debug)
+				<< "Control events not supported, control cache disabled";
+			disableControlCache();
+			return;
+		}
+	}
+
+	controlCacheEnabled_ = true;
+	fdEventNotifier_->setEnabled(true);
+}
+
+/**
+ * \brief Disable the control cache
+ *
+ * The control cache is enabled automatically when the device is opened, if the
+ * device supports control events. Derived classes shall disable it when the
+ * file handle is shared with other V4L2Device instances, as control events are
+ * not reported for control changes made through the same file handle.
+ */
+void V4L2Device::disableControlCache()
+{
+	controlCacheEnabled_ = false;
+	controlCache_.clear();
+}
+
 static const std::map<uint32_t, ColorSpace> v4l2ToColorSpace = {
 	{ V4L2_COLORSPACE_RAW, ColorSpace::Raw },
 	{ V4L2_COLORSPACE_SRGB, {
@@ -926,6 +1172,12 @@ template std::optional<ColorSpace> V4L2Device::toColorSpace(const struct v4l2_mb
 template<typename T>
 int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v4l2Format)
 {
+	/*
+	 * Use the non-member _log() in the LOG() macro, as the Loggable member
+	 * function can't be called from a static function.
+	 */
+	using libcamera::_log;
+
 	v4l2Format.colorspace = V4L2_COLORSPACE_DEFAULT;
 	v4l2Format.xfer_func = V4L2_XFER_FUNC_DEFAULT;
 	v4l2Format.ycbcr_enc = V4L2_YCBCR_ENC_DEFAULT;
@@ -954,7 +1206,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itPrimaries != primariesToV4l2.end()) {
 		v4l2Format.colorspace = itPrimaries->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised primaries in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -964,7 +1216,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itTransfer != transferFunctionToV4l2.end()) {
 		v4l2Format.xfer_func = itTransfer->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised transfer function in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -974,7 +1226,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itYcbcrEncoding != ycbcrEncodingToV4l2.end()) {
 		v4l2Format.ycbcr_enc = itYcbcrEncoding->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised YCbCr encoding in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -984,7 +1236,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itRange != rangeToV4l2.end()) {
 		v4l2Format.quantization = itRange->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised quantization in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -0,0 +1,359 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Persistent cache of enumerated V4L2 formats
+ */
+
+#include "libcamera/internal/v4l2_format_cache.h"
+
+#include <errno.h>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+#include "libcamera/internal/sysfs.h"
+
+/**
+ * \file v4l2_format_cache.h
+ * \brief Persistent cache of enumerated V4L2 formats
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(V4L2Cache)
+
+namespace {
+
+constexpr const char *kMagic = "libcamera-v4l2-format-cache 1";
+
+/* 64-bit FNV-1a hash, stable across runs to name the cache files. */
+uint64_t hash(const std::string &str)
+{
+	uint64_t value = 0xcbf29ce484222325ULL;
+
+	for (unsigned char c : str) {
+		value ^= c;
+		value *= 0x100000001b3ULL;
+	}
+
+	return value;
+}
+
+} /* namespace */
+
+/**
+ * \class V4L2FormatCache
+ * \brief Persistent cache of the formats enumerated on V4L2 devices
+ *
+ * Enumerating the formats and frame sizes supported by V4L2 video devices and
+ * subdevices requires one ioctl per format and per size, which adds up to a
+ * significant portion of the camera enumeration time on platforms with many
+ * devices. As the results only depend on the kernel and the hardware, they can
+ * be stored on disk and reused across runs.
+ *
+ * The cache stores, for each device, the formats returned by a set of queries.
+ * Devices are identified by a string built by the caller from all the
+ * information that identifies the hardware and the driver, which should
+ * include the deviceId() of the device node. Queries are identified by a
+ * string that describes the enumeration parameters.
+ *
+ * Each device is stored in a separate file in the cache directory, along with
+ * the full device identifier and the release and version of the running kernel.
+ * Entries are considered stale and discarded when any of them doesn't match,
+ * which makes validation cheap as it doesn't require accessing the device.
+ *
+ * The cache is only valid for enumerations whose results don't depend on the
+ * device configuration. It is the responsibility of the caller to only use it
+ * for such devices.
+ *
+ * A process-wide cache is available through instance(), when enabled with the
+ * LIBCAMERA_V4L2_FORMAT_CACHE environment variable. All functions of this
+ * class are thread-safe.
+ */
+
+/**
+ * \typedef V4L2FormatCache::Formats
+ * \brief A map of format codes to the frame sizes supported for each of them
+ */
+
+/**
+ * \brief Construct a cache stored in \a directory
+ * \param[in] directory The directory holding the cache files
+ *
+ * The directory is created if it doesn't exist. Its parent must exist.
+ */
+V4L2FormatCache::V4L2FormatCache(const std::string &directory)
+	: directory_(directory)
+{
+	if (mkdir(directory_.c_str(), 0755) && errno != EEXIST) {
+		int ret = errno;
+		LOG(V4L2Cache, Warning)
+			<< "Unable to create cache directory '" << directory_
+			<< "': " << strerror(ret);
+	}
+
+	struct utsname name;
+	if (uname(&name)) {
+		int ret = errno;
+		LOG(V4L2Cache, Warning)
+			<< "Unable to identify the kernel, cache disabled: "
+			<< strerror(ret);
+		return;
+	}
+
+	kernel_ = std::string(name.release) + " " + name.version;
+}
+
+/**
+ * \brief Retrieve the process-wide format cache
+ *
+ * The cache is disabled by default, and is enabled by setting the
+ * LIBCAMERA_V4L2_FORMAT_CACHE environment variable to the path of the cache
+ * directory.
+ *
+ * \return The process-wide format cache, or nullptr if the cache is disabled
+ */
+V4L2FormatCache *V4L2FormatCache::instance()
+{
+	static std::unique_ptr<V4L2FormatCache> cache = []() {
+		const char *directory = utils::secure_getenv("LIBCAMERA_V4L2_FORMAT_CACHE");
+		if (!directory || !*directory)
+			return std::unique_ptr<V4L2FormatCache>();
+
+		return std::make_unique<V4L2FormatCache>(directory);
+	}();
+
+	return cache.get();
+}
+
+/**
+ * \brief Identify the hardware device behind a device node
+ * \param[in] deviceNode The path to the device node
+ *
+ * The identifier is built from the name of the device node as reported by the
+ * kernel, and the sysfs path of the device it belongs to. It is stable across
+ * reboots as long as the hardware topology doesn't change, but doesn't identify
+ * the driver. Callers shall combine it with driver information to identify
+ * devices in the cache.
+ *
+ * \return The device identifier, or an empty string if the device can't be
+ * identified
+ */
+std::string V4L2FormatCache::deviceId(const std::string &deviceNode)
+{
+	std::string sysfsPath = sysfs::charDevPath(deviceNode);
+	if (sysfsPath.empty())
+		return {};
+
+	std::string name;
+	std::ifstream file(sysfsPath + "/name");
+	if (!std::getline(file, name))
+		return {};
+
+	char *realPath = realpath((sysfsPath + "/device").c_str(), nullptr);
+	if (!realPath)
+		return {};
+
+	std::string path{ realPath };
+	free(realPath);
+
+	return name + "@" + path;
+}
+
+/**
+ * \brief Look up the result of a format enumeration in the cache
+ * \param[in] device The device identifier
+ * \param[in] query The query identifier
+ * \return The cached formats, or std::nullopt if the query isn't cached for
+ * \a device
+ */
+std::optional<V4L2FormatCache::Formats>
+V4L2FormatCache::lookup(const std::string &device, const std::string &query)
+{
+	if (kernel_.empty() || device.empty())
+		return std::nullopt;
+
+	MutexLocker locker(mutex_);
+
+	const Queries &entries = queries(device);
+	auto iter = entries.find(query);
+	if (iter == entries.end())
+		return std::nullopt;
+
+	LOG(V4L2Cache, Debug) << "Cache hit for '" << device << "' " << query;
+
+	return iter->second;
+}
+
+/**
+ * \brief Store the result of a format enumeration in the cache
+ * \param[in] device The device identifier
+ * \param[in] query The query identifier
+ * \param[in] formats The enumerated formats
+ *
+ * The cache file of the \a device is updated immediately.
+ */
+void V4L2FormatCache::store(const std::string &device, const std::string &query,
+			    const Formats &formats)
+{
+	if (kernel_.empty() || device.empty())
+		return;
+
+	MutexLocker locker(mutex_);
+
+	Queries &entries = queries(device);
+	entries[query] = formats;
+
+	save(device, entries);
+}
+
+std::string V4L2FormatCache::path(const std::string &device) const
+{
+	std::ostringstream path;
+	path << directory_ << "/" << std::hex << std::setfill('0')
+	     << std::setw(16) << hash(device) << ".cache";
+
+	return path.str();
+}
+
+V4L2FormatCache::Queries &V4L2FormatCache::queries(const std::string &device)
+{
+	auto iter = devices_.find(device);
+	if (iter != devices_.end())
+		return iter->second;
+
+	return devices_.emplace(device, load(device)).first->second;
+}
+
+/*
+ * Load the cache file of a device. The file is line-based, each line starting
+ * with a keyword followed by a single space and the value. Any error or
+ * mismatch in the header discards the whole file, which will be overwritten by
+ * the next store() call.
+ */
+V4L2FormatCache::Queries V4L2FormatCache::load(const std::string &device) const
+{
+	std::ifstream file(path(device));
+	if (!file)
+		return {};
+
+	Queries queries;
+	Formats *formats = nullptr;
+	std::vector<SizeRange> *sizes = nullptr;
+	unsigned int lineNumber = 0;
+	std::string line;
+
+	while (std::getline(file, line)) {
+		lineNumber++;
+
+		size_t pos = line.find(' ');
+		std::string key = line.substr(0, pos);
+		std::string value = pos != std::string::npos ? line.substr(pos + 1) : "";
+
+		bool valid;
+
+		switch (lineNumber) {
+		case 1:
+			valid = line == kMagic;
+			break;
+		case 2:
+			valid = key == "kernel" && value == kernel_;
+			break;
+		case 3:
+			valid = key == "device" && value == device;
+			break;
+		default:
+			if (key == "query") {
+				formats = &queries[value];
+				sizes = nullptr;
+				valid = true;
+			} else if (key == "format" && formats) {
+				char *end;
+				unsigned long code = strtoul(value.c_str(), &end, 16);
+				valid = !value.empty() && *end == '\0';
+				sizes = &(*formats)[code];
+			} else if (key == "size" && sizes) {
+				std::istringstream ss(value);
+				SizeRange range;
+				ss >> range.min.width >> range.min.height
+				   >> range.max.width >> range.max.height
+				   >> range.hStep >> range.vStep;
+				valid = !ss.fail() && ss.eof();
+				sizes->push_back(range);
+			} else {
+				valid = false;
+			}
+			break;
+		}
+
+		if (!valid) {
+			LOG(V4L2Cache, Debug)
+				<< "Discarding stale or invalid cache entry for '"
+				<< device << "' (line " << lineNumber << ")";
+			return {};
+		}
+	}
+
+	return queries;
+}
+
+/*
+ * Write the cache file of a device. The file is written to a temporary file
+ * and renamed, to avoid exposing partially written files to concurrent
+ * readers.
+ */
+void V4L2FormatCache::save(const std::string &device, const Queries &queries) const
+{
+	std::string filePath = path(device);
+	std::string tmpPath = filePath + "." + std::to_string(getpid());
+
+	{
+		std::ofstream file(tmpPath, std::ios::trunc);
+
+		file << kMagic << "\n"
+		     << "kernel " << kernel_ << "\n"
+		     << "device " << device << "\n";
+
+		for (const auto &[query, formats] : queries) {
+			file << "query " << query << "\n";
+
+			for (const auto &[code, sizes] : formats) {
+				file << "format " << utils::hex(code, 8) << "\n";
+
+				for (const SizeRange &range : sizes)
+					file << "size "
+					     << range.min.width << " " << range.min.height << " "
+					     << range.max.width << " " << range.max.height << " "
+					     << range.hStep << " " << range.vStep << "\n";
+			}
+		}
+
+		file.close();
+
+		if (!file) {
+			LOG(V4L2Cache, Warning)
+				<< "Unable to write cache file '" << tmpPath << "'";
+			unlink(tmpPath.c_str());
+			return;
+		}
+	}
+
+	if (rename(tmpPath.c_str(), filePath.c_str())) {
+		int ret = errno;
+		LOG(V4L2Cache, Warning)
+			<< "Unable to update cache file '" << filePath << "': "
+			<< strerror(ret);
+		unlink(tmpPath.c_str());
+	}
+}
+
+} /* namespace libcamera */
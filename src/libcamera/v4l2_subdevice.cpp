@@ -26,6 +26,7 @@
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/v4l2_format_cache.h"
 
 /**
  * \file v4l2_subdevice.h
@@ -1170,6 +1171,9 @@ int V4L2Subdevice::setSelection(const Stream &stream, unsigned int target,
  * Enumerate all media bus codes and frame sizes supported by the subdevice on
  * a \a stream.
  *
+ * When the V4L2FormatCache is enabled, the formats of camera sensors are
+ * retrieved from the cache if available, and stored in the cache otherwise.
+ *
  * \return A list of the supported device formats
  */
 V4L2Subdevice::Formats V4L2Subdevice::formats(const Stream &stream)
@@ -1181,6 +1185,37 @@ V4L2Subdevice::Formats V4L2Subdevice::formats(const Stream &stream)
 		return {};
 	}
 
+	/*
+	 * The formats supported on the source pads of most subdevices depend
+	 * on the configuration of their sink pads, only cache the formats of
+	 * camera sensors.
+	 */
+	V4L2FormatCache *cache = entity_->function() == MEDIA_ENT_F_CAM_SENSOR
+			       ? V4L2FormatCache::instance() : nullptr;
+	std::string device;
+	std::string query;
+
+	if (cache) {
+		std::string id = V4L2FormatCache::deviceId(deviceNode());
+		if (!id.empty()) {
+			const MediaDevice *media = entity_->device();
+			std::ostringstream ss;
+			ss << media->driver() << " " << media->model() << " "
+			   << media->serial() << " " << utils::hex(media->hwRevision())
+			   << " " << utils::hex(caps_.version) << " "
+			   << entity_->name() << " " << id;
+			device = ss.str();
+		}
+
+		std::ostringstream ss;
+		ss << "mbus " << stream.pad << " " << stream.stream;
+		query = ss.str();
+
+		std::optional<Formats> cached = cache->lookup(device, query);
+		if (cached)
+			return std::move(*cached);
+	}
+
 	for (unsigned int code : enumPadCodes(stream)) {
 		std::vector<SizeRange> sizes = enumPadSizes(stream, code);
 		if (sizes.empty())
@@ -1195,6 +1230,9 @@ V4L2Subdevice::Formats V4L2Subdevice::formats(const Stream &stream)
 		}
 	}
 
+	if (cache && !formats.empty())
+		cache->store(device, query, formats);
+
 	return formats;
 }
 
@@ -23,6 +23,7 @@
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/shared_fd.h>
 #include <libcamera/base/unique_fd.h>
 #include <libcamera/base/utils.h>
@@ -31,6 +32,9 @@
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/media_request.h"
+#include "libcamera/internal/tracepoints.h"
+#include "libcamera/internal/v4l2_format_cache.h"
 
 /**
  * \file v4l2_videodevice.h
@@ -162,6 +166,11 @@ LOG_DECLARE_CATEGORY(V4L2)
  * index associations to help selecting V4L2 buffers. It tracks, for every
  * entry, if the V4L2 buffer is in use, and offers lookup of the best free V4L2
  * buffer for a set of dmabufs.
+ *
+ * Entries are indexed by a hash of the file descriptors, offsets and lengths
+ * of their planes, making cache hits a constant time operation regardless of
+ * the number of entries. Cache misses fall back to a linear search for the
+ * least recently used free entry.
  */
 
 /**
@@ -173,7 +182,7 @@ LOG_DECLARE_CATEGORY(V4L2)
  * buffer import, with buffers added to the cache as they are queued.
  */
 V4L2BufferCache::V4L2BufferCache(unsigned int numEntries)
-	: lastUsedCounter_(1), missCounter_(0)
+	: lastUsedCounter_(1), hits_(0), misses_(0)
 {
 	cache_.resize(numEntries);
 }
@@ -187,18 +196,22 @@ V4L2BufferCache::V4L2BufferCache(unsigned int numEntries)
  * allocated.
  */
 V4L2BufferCache::V4L2BufferCache(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
-	: lastUsedCounter_(1), missCounter_(0)
+	: lastUsedCounter_(1), hits_(0), misses_(0)
 {
-	for (const std::unique_ptr<FrameBuffer> &buffer : buffers)
-		cache_.emplace_back(true,
-				    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
-				    *buffer.get());
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		const Entry &entry =
+			cache_.emplace_back(true,
+					    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
+					    *buffer.get());
+		index_.emplace(entry.key_, cache_.size() - 1);
+	}
 }
 
 V4L2BufferCache::~V4L2BufferCache()
 {
-	if (missCounter_ > cache_.size())
-		LOG(V4L2, Debug) << "Cache misses: " << missCounter_;
+	if (misses_ > cache_.size())
+		LOG(V4L2, Debug)
+			<< "Cache hits: " << hits_ << ", misses: " << misses_;
 }
 
 /**
@@ -221,46 +234,53 @@ bool V4L2BufferCache::isEmpty() const
  * Find the best V4L2 buffer index to be used for the FrameBuffer \a buffer
  * based on previous mappings of frame buffers to V4L2 buffers. If a free V4L2
  * buffer previously used with the same dmabufs as \a buffer is found in the
- * cache, return its index. Otherwise return the index of the first free V4L2
- * buffer and record its association with the dmabufs of \a buffer.
+ * cache, return its index. Otherwise return the index of the least recently
+ * used free V4L2 buffer and record its association with the dmabufs of
+ * \a buffer.
  *
  * \return The index of the best V4L2 buffer, or -ENOENT if no free V4L2 buffer
  * is available
  */
 int V4L2BufferCache::get(const FrameBuffer &buffer)
 {
-	bool hit = false;
+	uint64_t lastUsed = lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel);
+
+	/* Try to find a cache hit through the index. */
+	auto [first, last] = index_.equal_range(key(buffer));
+	for (auto it = first; it != last; ++it) {
+		Entry &entry = cache_[it->second];
+
+		if (!entry.free_ || !(entry == buffer))
+			continue;
+
+		entry.free_ = false;
+		entry.lastUsed_ = lastUsed;
+		hits_++;
+
+		return it->second;
+	}
+
+	misses_++;
+
 	int use = -1;
 	uint64_t oldest = UINT64_MAX;
 
 	for (unsigned int index = 0; index < cache_.size(); index++) {
 		const Entry &entry = cache_[index];
 
-		if (!entry.free_)
-			continue;
-
-		/* Try to find a cache hit by comparing the planes. */
-		if (entry == buffer) {
-			hit = true;
-			use = index;
-			break;
-		}
-
-		if (entry.lastUsed_ < oldest) {
+		if (entry.free_ && entry.lastUsed_ < oldest) {
 			use = index;
 			oldest = entry.lastUsed_;
 		}
 	}
 
-	if (!hit)
-		missCounter_++;
-
 	if (use < 0)
 		return -ENOENT;
 
-	cache_[use] = Entry(false,
-			    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
-			    buffer);
+	unindex(use);
+
+	cache_[use] = Entry(false, lastUsed, buffer);
+	index_.emplace(cache_[use].key_, use);
 
 	return use;
 }
@@ -275,13 +295,109 @@ void V4L2BufferCache::put(unsigned int index)
 	cache_[index].free_ = true;
 }
 
+/**
+ * \brief Add a free entry for \a buffer at the end of the cache
+ * \param[in] buffer The buffer to pre-populate the entry with
+ *
+ * This is used to extend a cache created from an array of buffers, when new
+ * V4L2 buffers are allocated. The entry index is the number of entries in the
+ * cache before the call.
+ */
+void V4L2BufferCache::add(const FrameBuffer &buffer)
+{
+	const Entry &entry =
+		cache_.emplace_back(true,
+				    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
+				    buffer);
+	index_.emplace(entry.key_, cache_.size() - 1);
+}
+
+/**
+ * \brief Remove the last \a count entries from the cache
+ * \param[in] count The number of entries to remove
+ *
+ * The removed entries shall be free.
+ */
+void V4L2BufferCache::remove(unsigned int count)
+{
+	ASSERT(count <= cache_.size());
+
+	for (unsigned int i = 0; i < count; i++) {
+		ASSERT(cache_.back().free_);
+
+		unindex(cache_.size() - 1);
+		cache_.pop_back();
+	}
+}
+
+/**
+ * \fn V4L2BufferCache::size()
+ * \brief Retrieve the number of entries in the cache
+ * \return The number of entries in the cache
+ */
+
+/**
+ * \fn V4L2BufferCache::hits()
+ * \brief Retrieve the number of cache hits
+ *
+ * A cache hit occurs when get() finds a free V4L2 buffer previously used with
+ * the same dmabufs.
+ *
+ * \return The number of cache hits since the cache was created
+ */
+
+/**
+ * \fn V4L2BufferCache::misses()
+ * \brief Retrieve the number of cache misses
+ *
+ * A cache miss occurs when get() has to associate a V4L2 buffer with new
+ * dmabufs, or when no free V4L2 buffer is available.
+ *
+ * \return The number of cache misses since the cache was created
+ */
+
+/*
+ * Compute the index key of the dmabufs of a frame buffer, from the file
+ * descriptor, offset and length of all planes. The address is used in place of
+ * the file descriptor for user memory planes.
+ */
+std::size_t V4L2BufferCache::key(const FrameBuffer &buffer)
+{
+	std::size_t hash = 0;
+
+	for (const FrameBuffer::Plane &plane : buffer.planes()) {
+		uint64_t id = plane.address
+			    ? reinterpret_cast<uintptr_t>(plane.address)
+			    : static_cast<uint64_t>(plane.fd.get()) << 32;
+		uint64_t value = id ^ (static_cast<uint64_t>(plane.offset) << 16)
+			       ^ plane.length;
+
+		hash ^= std::hash<uint64_t>{}(value) + 0x9e3779b97f4a7c15ULL
+		      + (hash << 6) + (hash >> 2);
+	}
+
+	return hash;
+}
+
+/* Remove the index entry of the cache entry \a index, if any. */
+void V4L2BufferCache::unindex(unsigned int index)
+{
+	auto [first, last] = index_.equal_range(cache_[index].key_);
+	for (auto it = first; it != last; ++it) {
+		if (it->second == index) {
+			index_.erase(it);
+			return;
+		}
+	}
+}
+
 V4L2BufferCache::Entry::Entry()
-	: free_(true), lastUsed_(0)
+	: free_(true), lastUsed_(0), key_(0)
 {
 }
 
 V4L2BufferCache::Entry::Entry(bool free, uint64_t lastUsed, const FrameBuffer &buffer)
-	: free_(free), lastUsed_(lastUsed)
+	: free_(free), lastUsed_(lastUsed), key_(V4L2BufferCache::key(buffer))
 {
 	for (const FrameBuffer::Plane &plane : buffer.planes())
 		planes_.emplace_back(plane);
@@ -296,7 +412,9 @@ bool V4L2BufferCache::Entry::operator==(const FrameBuffer &buffer) const
 
 	for (unsigned int i = 0; i < planes.size(); i++)
 		if (planes_[i].fd != planes[i].fd.get() ||
-		    planes_[i].length != planes[i].length)
+		    planes_[i].offset != planes[i].offset ||
+		    planes_[i].length != planes[i].length ||
+		    planes_[i].address != planes[i].address)
 			return false;
 	return true;
 }
@@ -451,6 +569,117 @@ std::ostream &operator<<(std::ostream &out, const V4L2DeviceFormat &f)
 	return out;
 }
 
+/**
+ * \struct V4L2LatencyStatistics
+ * \brief Buffer latency statistics of a V4L2VideoDevice
+ *
+ * The statistics track buffers through three stages, each of them starting
+ * when the buffer is dequeued with VIDIOC_DQBUF:
+ *
+ * - The kernel stage measures the time between the buffer timestamp set by
+ *   the kernel and the dequeue. It is only recorded for devices that timestamp
+ *   buffers with the monotonic clock, and shows how long completed buffers
+ *   wait for userspace.
+ * - The dispatch stage measures the time between the dequeue and the return
+ *   of the bufferReady signal emission, and shows how long the pipeline
+ *   handler takes to process the buffer.
+ * - The completion stage measures the time between the dequeue and the
+ *   completion of the request the buffer belongs to. It is only recorded for
+ *   buffers successfully captured and returned to the application as part of
+ *   a request.
+ *
+ * \sa V4L2VideoDevice::setLatencyStatisticsEnabled()
+ */
+
+/**
+ * \var V4L2LatencyStatistics::kLatencyBuckets
+ * \brief The number of buckets of the latency histograms
+ */
+
+/**
+ * \struct V4L2LatencyStatistics::Stage
+ * \brief Latency statistics of a buffer processing stage
+ *
+ * \var V4L2LatencyStatistics::Stage::buffers
+ * \brief The number of buffers that went through the stage
+ *
+ * \var V4L2LatencyStatistics::Stage::latency
+ * \brief Histogram of the stage latency
+ *
+ * Bucket i counts the buffers with a latency between 2^i and 2^(i+1) µs.
+ * Bucket 0 also counts the buffers with a latency lower than 1µs, and the last
+ * bucket all the buffers with a latency higher than its lower bound.
+ *
+ * \var V4L2LatencyStatistics::Stage::totalTime
+ * \brief The sum of the latencies of all buffers
+ *
+ * \var V4L2LatencyStatistics::Stage::maxTime
+ * \brief The highest latency of a single buffer
+ */
+
+/**
+ * \var V4L2LatencyStatistics::kernel
+ * \brief Latency from the kernel buffer timestamp to the buffer dequeue
+ *
+ * \var V4L2LatencyStatistics::dispatch
+ * \brief Latency from the buffer dequeue to the return of the bufferReady
+ * signal handlers
+ *
+ * \var V4L2LatencyStatistics::completion
+ * \brief Latency from the buffer dequeue to the completion of its request
+ */
+
+/*
+ * Collect the latency statistics of a V4L2VideoDevice. The tracker is shared
+ * with the request completion handlers of the dequeued buffers, which may
+ * outlive the statistics being disabled, and may run in a different thread.
+ */
+class V4L2VideoDevice::LatencyTracker
+{
+public:
+	LatencyTracker(const std::string &deviceNode)
+		: deviceNode_(deviceNode)
+	{
+	}
+
+	const std::string &deviceNode() const { return deviceNode_; }
+
+	void record(V4L2LatencyStatistics::Stage V4L2LatencyStatistics::*stage,
+		    utils::duration latency) LIBCAMERA_TSA_EXCLUDES(mutex_)
+	{
+		latency = std::max(latency, utils::duration::zero());
+
+		uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+		unsigned int bucket = us < 2 ? 0 : 63 - __builtin_clzll(us);
+
+		MutexLocker locker(mutex_);
+
+		V4L2LatencyStatistics::Stage &stats = stats_.*stage;
+		stats.buffers++;
+		stats.latency[std::min(bucket, V4L2LatencyStatistics::kLatencyBuckets - 1)]++;
+		stats.totalTime += latency;
+		stats.maxTime = std::max(stats.maxTime, latency);
+	}
+
+	V4L2LatencyStatistics statistics() const LIBCAMERA_TSA_EXCLUDES(mutex_)
+	{
+		MutexLocker locker(mutex_);
+		return stats_;
+	}
+
+	void reset() LIBCAMERA_TSA_EXCLUDES(mutex_)
+	{
+		MutexLocker locker(mutex_);
+		stats_ = {};
+	}
+
+private:
+	const std::string deviceNode_;
+
+	mutable Mutex mutex_;
+	V4L2LatencyStatistics stats_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
 /**
  * \class V4L2VideoDevice
  * \brief V4L2VideoDevice object and API
@@ -508,6 +737,10 @@ std::ostream &operator<<(std::ostream &out, const V4L2DeviceFormat &f)
  *   of the two video device that participate in buffer sharing inside
  *   pipelines, the other video device typically using allocateBuffers().
  *
+ * - The addBuffers() and removeBuffers() functions grow and shrink the set of
+ *   buffers allocated by allocateBuffers(), including while streaming. They
+ *   are meant for internal buffer pools whose size is adjusted to the load.
+ *
  * - The releaseBuffers() function resets the driver's internal buffer
  *   management that was initialized by a previous call to allocateBuffers() or
  *   importBuffers(). Any memory allocated by allocateBuffers() is freed.
@@ -535,7 +768,9 @@ std::ostream &operator<<(std::ostream &out, const V4L2DeviceFormat &f)
 V4L2VideoDevice::V4L2VideoDevice(const std::string &deviceNode)
 	: V4L2Device(deviceNode), formatInfo_(nullptr), cache_(nullptr),
 	  fdBufferNotifier_(nullptr), state_(State::Stopped),
-	  watchdogDuration_(0.0)
+	  watchdogDuration_(0.0), batchedDequeue_(false),
+	  supportsRequests_(false), supportsRemoveBuffers_(false),
+	  metrics_(deviceNode)
 {
 	/*
 	 * We default to an MMAP based CAPTURE video device, however this will
@@ -543,6 +778,12 @@ V4L2VideoDevice::V4L2VideoDevice(const std::string &deviceNode)
 	 */
 	bufferType_ = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 	memoryType_ = V4L2_MEMORY_MMAP;
+
+	cacheHits_ = metrics_.counter("buffer_cache_hits");
+	cacheMisses_ = metrics_.counter("buffer_cache_misses");
+	buffersDequeued_ = metrics_.counter("buffers_dequeued");
+	bufferErrors_ = metrics_.counter("buffer_errors");
+	dequeueTimeouts_ = metrics_.counter("dequeue_timeouts");
 }
 
 /**
@@ -676,6 +917,12 @@ int V4L2VideoDevice::open(SharedFD handle, enum v4l2_buf_type type)
 		return ret;
 	}
 
+	/*
+	 * The file handle is shared with other instances, which may write
+	 * controls without generating control events for this instance.
+	 */
+	disableControlCache();
+
 	ret = ioctl(VIDIOC_QUERYCAP, &caps_);
 	if (ret < 0) {
 		LOG(V4L2, Error)
@@ -1099,12 +1346,49 @@ int V4L2VideoDevice::trySetFormatSingleplane(V4L2DeviceFormat *format, bool set)
  * If the \a code argument is not zero, only formats compatible with that media
  * bus code will be enumerated.
  *
+ * When the V4L2FormatCache is enabled, the formats of devices other than
+ * memory-to-memory devices are retrieved from the cache if available, and
+ * stored in the cache otherwise.
+ *
  * \return A list of the supported video device formats
  */
 V4L2VideoDevice::Formats V4L2VideoDevice::formats(uint32_t code)
 {
+	/*
+	 * The formats supported by memory-to-memory devices may depend on the
+	 * format configured on the other queue, don't cache them.
+	 */
+	V4L2FormatCache *cache = caps_.isM2M() ? nullptr : V4L2FormatCache::instance();
+	std::string device;
+	std::string query;
+
+	if (cache) {
+		std::string id = V4L2FormatCache::deviceId(deviceNode());
+		if (!id.empty()) {
+			std::ostringstream ss;
+			ss << caps_.driver() << " " << caps_.card() << " "
+			   << caps_.bus_info() << " " << utils::hex(caps_.version)
+			   << " " << id;
+			device = ss.str();
+		}
+
+		std::ostringstream ss;
+		ss << "fmt " << bufferType_ << " " << utils::hex(code);
+		query = ss.str();
+	}
+
 	Formats formats;
 
+	if (cache) {
+		std::optional<V4L2FormatCache::Formats> cached =
+			cache->lookup(device, query);
+		if (cached) {
+			for (auto &[fourcc, sizes] : *cached)
+				formats.emplace(V4L2PixelFormat(fourcc), std::move(sizes));
+			return formats;
+		}
+	}
+
 	for (V4L2PixelFormat pixelFormat : enumPixelformats(code)) {
 		std::vector<SizeRange> sizes = enumSizes(pixelFormat);
 		if (sizes.empty())
@@ -1120,6 +1404,13 @@ V4L2VideoDevice::Formats V4L2VideoDevice::formats(uint32_t code)
 		formats.emplace(pixelFormat, sizes);
 	}
 
+	if (cache && !formats.empty()) {
+		V4L2FormatCache::Formats entry;
+		for (const auto &[pixelFormat, sizes] : formats)
+			entry.emplace(pixelFormat.fourcc(), sizes);
+		cache->store(device, query, entry);
+	}
+
 	return formats;
 }
 
@@ -1277,6 +1568,9 @@ int V4L2VideoDevice::requestBuffers(unsigned int count,
 		return -ENOMEM;
 	}
 
+	supportsRequests_ = rb.capabilities & V4L2_BUF_CAP_SUPPORTS_REQUESTS;
+	supportsRemoveBuffers_ = rb.capabilities & V4L2_BUF_CAP_SUPPORTS_REMOVE_BUFS;
+
 	LOG(V4L2, Debug) << rb.count << " buffers requested.";
 
 	return 0;
@@ -1371,6 +1665,151 @@ int V4L2VideoDevice::exportBuffers(unsigned int count,
 	return ret;
 }
 
+/**
+ * \brief Allocate additional buffers from the video device
+ * \param[in] count Number of buffers to add
+ * \param[inout] buffers Vector of buffers allocated by allocateBuffers()
+ *
+ * This function allocates \a count additional buffers with the V4L2 MMAP
+ * memory type, using the currently active format, and appends them to
+ * \a buffers. It can be called while the device is streaming, and the new
+ * buffers can be passed to queueBuffer() as soon as the function returns.
+ *
+ * The video device shall have been initialized with allocateBuffers(), and
+ * \a buffers shall contain all the buffers allocated by allocateBuffers() and
+ * previous calls to this function, in order.
+ *
+ * \return The number of added buffers on success or a negative error code
+ * otherwise
+ * \retval -EINVAL buffers haven't been allocated with allocateBuffers()
+ * \retval -ENOMEM the driver failed to allocate the buffers
+ */
+int V4L2VideoDevice::addBuffers(unsigned int count,
+				std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (!cache_ || memoryType_ != V4L2_MEMORY_MMAP ||
+	    buffers->size() != cache_->size()) {
+		LOG(V4L2, Error) << "Buffers not allocated by allocateBuffers()";
+		return -EINVAL;
+	}
+
+	struct v4l2_create_buffers create = {};
+	create.count = count;
+	create.memory = V4L2_MEMORY_MMAP;
+	create.format.type = bufferType_;
+
+	int ret = ioctl(VIDIOC_G_FMT, &create.format);
+	if (ret < 0) {
+		LOG(V4L2, Error) << "Unable to get format: " << strerror(-ret);
+		return ret;
+	}
+
+	ret = ioctl(VIDIOC_CREATE_BUFS, &create);
+	if (ret < 0) {
+		LOG(V4L2, Error)
+			<< "Unable to create " << count << " buffers: "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	if (!create.count)
+		return -ENOMEM;
+
+	/*
+	 * The new buffers must follow the existing ones, as the buffer cache
+	 * entries are indexed by V4L2 buffer index.
+	 */
+	if (create.index != cache_->size()) {
+		LOG(V4L2, Error)
+			<< "Unexpected buffer index " << create.index;
+		return -EINVAL;
+	}
+
+	std::vector<std::unique_ptr<FrameBuffer>> created;
+	for (unsigned int i = 0; i < create.count; ++i) {
+		std::unique_ptr<FrameBuffer> buffer = createBuffer(create.index + i);
+		if (!buffer) {
+			LOG(V4L2, Error) << "Unable to create buffer";
+
+			if (supportsRemoveBuffers_) {
+				struct v4l2_remove_buffers remove = {};
+				remove.index = create.index;
+				remove.count = create.count;
+				remove.type = bufferType_;
+				ioctl(VIDIOC_REMOVE_BUFS, &remove);
+			}
+
+			return -EINVAL;
+		}
+
+		created.push_back(std::move(buffer));
+	}
+
+	for (std::unique_ptr<FrameBuffer> &buffer : created) {
+		cache_->add(*buffer);
+		buffers->push_back(std::move(buffer));
+	}
+
+	LOG(V4L2, Debug) << create.count << " buffers added.";
+
+	return create.count;
+}
+
+/**
+ * \brief Free the last buffers allocated from the video device
+ * \param[in] count Number of buffers to remove
+ * \param[inout] buffers Vector of buffers allocated by allocateBuffers()
+ *
+ * This function frees the last \a count buffers of \a buffers, and removes
+ * them from the vector. It reverts a previous addBuffers() call, and can be
+ * called while the device is streaming. The buffers to remove shall not be
+ * queued.
+ *
+ * The \a buffers vector shall fulfil the same requirements as for
+ * addBuffers().
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOTSUP the driver doesn't support removing buffers
+ * \retval -EBUSY one of the buffers to remove is queued
+ * \retval -EINVAL buffers haven't been allocated with allocateBuffers()
+ */
+int V4L2VideoDevice::removeBuffers(unsigned int count,
+				   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (!cache_ || memoryType_ != V4L2_MEMORY_MMAP ||
+	    buffers->size() != cache_->size() || count > buffers->size()) {
+		LOG(V4L2, Error) << "Buffers not allocated by allocateBuffers()";
+		return -EINVAL;
+	}
+
+	if (!supportsRemoveBuffers_)
+		return -ENOTSUP;
+
+	unsigned int first = buffers->size() - count;
+	if (!queuedBuffers_.empty() && queuedBuffers_.rbegin()->first >= first)
+		return -EBUSY;
+
+	struct v4l2_remove_buffers remove = {};
+	remove.index = first;
+	remove.count = count;
+	remove.type = bufferType_;
+
+	int ret = ioctl(VIDIOC_REMOVE_BUFS, &remove);
+	if (ret < 0) {
+		LOG(V4L2, Error)
+			<< "Unable to remove " << count << " buffers: "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	cache_->remove(count);
+	buffers->resize(first);
+
+	LOG(V4L2, Debug) << count << " buffers removed.";
+
+	return 0;
+}
+
 int V4L2VideoDevice::createBuffers(unsigned int count,
 				   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
 {
@@ -1426,6 +1865,11 @@ std::unique_ptr<FrameBuffer> V4L2VideoDevice::createBuffer(unsigned int index)
 		return nullptr;
 	}
 
+	/*
+	 * Export one dmabuf per V4L2 plane. If the driver stores multiple
+	 * planes in the same dmabuf, the FrameBuffer constructor makes them
+	 * share a single file descriptor and closes the duplicates.
+	 */
 	std::vector<FrameBuffer::Plane> planes;
 	for (unsigned int nplane = 0; nplane < numPlanes; nplane++) {
 		UniqueFD fd = exportDmabufFd(buf.index, nplane);
@@ -1512,10 +1956,17 @@ UniqueFD V4L2VideoDevice::exportDmabufFd(unsigned int index,
 /**
  * \brief Prepare the device to import \a count buffers
  * \param[in] count Number of buffers to prepare to import
+ * \param[in] memoryType The memory type of the buffers to import
  *
  * This function initializes the driver's buffer management to import buffers
- * in DMABUF mode. It requests buffers from the driver, but doesn't allocate
- * memory.
+ * in DMABUF or USERPTR mode, as selected by \a memoryType. It requests buffers
+ * from the driver, but doesn't allocate memory.
+ *
+ * In DMABUF mode, the buffers passed to queueBuffer() shall have planes backed
+ * by dmabufs. In USERPTR mode, they shall have planes backed by user memory,
+ * as described by FrameBuffer::Plane::address. User memory must stay valid
+ * until the buffers are released with releaseBuffers(), as the driver may keep
+ * it pinned for the whole streaming session.
  *
  * Upon successful return, the video device is ready to accept queueBuffer()
  * calls. The buffers to be imported are provided to queueBuffer(), and may be
@@ -1528,17 +1979,25 @@ UniqueFD V4L2VideoDevice::exportDmabufFd(unsigned int index,
  *
  * \return 0 on success or a negative error code otherwise
  * \retval -EBUSY buffers have already been allocated or imported
+ * \retval -EINVAL the memory type is not supported
  */
-int V4L2VideoDevice::importBuffers(unsigned int count)
+int V4L2VideoDevice::importBuffers(unsigned int count,
+				   enum v4l2_memory memoryType)
 {
 	if (cache_) {
 		LOG(V4L2, Error) << "Buffers already allocated";
 		return -EINVAL;
 	}
 
-	memoryType_ = V4L2_MEMORY_DMABUF;
+	if (memoryType != V4L2_MEMORY_DMABUF &&
+	    memoryType != V4L2_MEMORY_USERPTR) {
+		LOG(V4L2, Error) << "Invalid memory type " << memoryType;
+		return -EINVAL;
+	}
+
+	memoryType_ = memoryType;
 
-	int ret = requestBuffers(count, V4L2_MEMORY_DMABUF);
+	int ret = requestBuffers(count, memoryType);
 	if (ret)
 		return ret;
 
@@ -1570,9 +2029,31 @@ int V4L2VideoDevice::releaseBuffers()
 	return requestBuffers(0, memoryType_);
 }
 
+/**
+ * \fn V4L2VideoDevice::supportsRequests()
+ * \brief Check if the device supports media requests
+ *
+ * Support for media requests is reported by the driver when allocating or
+ * importing buffers. This function shall thus only be called after a
+ * successful call to allocateBuffers(), exportBuffers() or importBuffers().
+ *
+ * \return True if buffers can be queued to media requests, false otherwise
+ */
+
+/**
+ * \fn V4L2VideoDevice::supportsRemoveBuffers()
+ * \brief Check if the driver supports removing buffers with removeBuffers()
+ *
+ * The support is reported by the driver when buffers are allocated. This
+ * function shall be called after allocateBuffers().
+ *
+ * \return True if the driver supports removing buffers, false otherwise
+ */
+
 /**
  * \brief Queue a buffer to the video device if possible
  * \param[in] buffer The buffer to be queued
+ * \param[in] request The media request to add the buffer to
  *
  * For capture video devices the \a buffer will be filled with data by the
  * device. For output video devices the \a buffer shall contain valid data and
@@ -1589,15 +2070,33 @@ int V4L2VideoDevice::releaseBuffers()
  * we reach this limit, store the framebuffers in a pending queue, and try to
  * enqueue once a buffer has been dequeued.
  *
+ * If \a request is not null, the buffer is added to the media request, and is
+ * only processed by the device once the request is queued. The device shall
+ * support requests, as reported by supportsRequests(), and \a request shall be
+ * in the MediaRequest::Status::Idle state. As the buffer must be part of the
+ * request when it gets queued, buffers added to requests are never deferred
+ * to the pending queue, and this function fails with -EBUSY if VIDEO_MAX_FRAME
+ * buffers are already queued.
+ *
  * \return 0 on success or a negative error code otherwise
  */
-int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
+int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer, const MediaRequest *request)
 {
 	if (state_ == State::Stopping) {
 		LOG(V4L2, Error) << "Device is in a stopping state.";
 		return -ESHUTDOWN;
 	}
 
+	if (request) {
+		if (queuedBuffers_.size() == VIDEO_MAX_FRAME) {
+			LOG(V4L2, Error)
+				<< "V4L2 queue full, can't add buffer to request";
+			return -EBUSY;
+		}
+
+		return queueToDevice(buffer, request);
+	}
+
 	if (queuedBuffers_.size() == VIDEO_MAX_FRAME) {
 		LOG(V4L2, Debug) << "V4L2 queue has " << VIDEO_MAX_FRAME
 				 << " already queued, differing queueing.";
@@ -1616,26 +2115,50 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 		pendingBuffersToQueue_.pop();
 	}
 
-	return queueToDevice(buffer);
+	return queueToDevice(buffer, nullptr);
 }
 
 /**
  * \brief Slot to handle completed buffer events from the V4L2 video device
  *
  * When this slot is called, a Buffer has become available from the device, and
- * will be emitted through the bufferReady Signal.
+ * will be emitted through the bufferReady Signal. When batched dequeue is
+ * enabled, all the buffers available from the device are dequeued and emitted
+ * in turn, followed by the bufferBatchComplete signal.
  *
  * For Capture video devices the FrameBuffer will contain valid data.
  * For Output video devices the FrameBuffer can be considered empty.
  */
 void V4L2VideoDevice::bufferAvailable()
 {
-	FrameBuffer *buffer = dequeueBuffer();
-	if (!buffer)
-		return;
+	unsigned int count = 0;
+
+	while (FrameBuffer *buffer = dequeueBuffer()) {
+		utils::time_point dequeued = dequeueTime_;
+		uint32_t sequence = buffer->metadata().sequence;
 
-	/* Notify anyone listening to the device. */
-	bufferReady.emit(buffer);
+		/* Notify anyone listening to the device. */
+		bufferReady.emit(buffer);
+		count++;
+
+		utils::duration dispatch = utils::clock::now() - dequeued;
+		if (latency_)
+			latency_->record(&V4L2LatencyStatistics::dispatch, dispatch);
+
+		LIBCAMERA_TRACEPOINT(v4l2_buffer_ready, deviceNode().c_str(), sequence,
+				     std::chrono::duration_cast<std::chrono::nanoseconds>(dispatch).count());
+
+		/*
+		 * Stop when the device has no more buffers queued, or when the
+		 * bufferReady handler has stopped the stream.
+		 */
+		if (!batchedDequeue_ || queuedBuffers_.empty() ||
+		    state_ != State::Streaming)
+			break;
+	}
+
+	if (batchedDequeue_ && count)
+		bufferBatchComplete.emit();
 }
 
 /**
@@ -1669,11 +2192,15 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 
 	ret = ioctl(VIDIOC_DQBUF, &buf);
 	if (ret < 0) {
-		LOG(V4L2, Error)
-			<< "Failed to dequeue buffer: " << strerror(-ret);
+		/* The device is opened in non-blocking mode. */
+		if (ret != -EAGAIN)
+			LOG(V4L2, Error)
+				<< "Failed to dequeue buffer: " << strerror(-ret);
 		return nullptr;
 	}
 
+	dequeueTime_ = utils::clock::now();
+
 	LOG(V4L2, Debug) << "Dequeuing buffer " << buf.index;
 
 	/*
@@ -1709,7 +2236,7 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 		 * If the pending buffer enqueue fails, we must continue this
 		 * function to completion for the dequeue operation.
 		 */
-		if (queueToDevice(pending))
+		if (queueToDevice(pending, nullptr))
 			LOG(V4L2, Error)
 				<< "Failed to re-queue pending buffer "
 				<< pending;
@@ -1731,10 +2258,55 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 	metadata.status = buf.flags & V4L2_BUF_FLAG_ERROR
 			? FrameMetadata::FrameError
 			: FrameMetadata::FrameSuccess;
+
+	buffersDequeued_->add();
+	if (metadata.status == FrameMetadata::FrameError)
+		bufferErrors_->add();
 	metadata.sequence = buf.sequence;
 	metadata.timestamp = buf.timestamp.tv_sec * 1000000000ULL
 			   + buf.timestamp.tv_usec * 1000ULL;
 
+	/*
+	 * The time spent by the buffer in the kernel after completion can only
+	 * be measured when the kernel timestamps buffers with the monotonic
+	 * clock, which is the clock used by utils::clock.
+	 */
+	int64_t kernelLatency = -1;
+	if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC &&
+	    metadata.timestamp) {
+		utils::duration latency = dequeueTime_.time_since_epoch() -
+					  std::chrono::nanoseconds(metadata.timestamp);
+		kernelLatency = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+
+		if (latency_)
+			latency_->record(&V4L2LatencyStatistics::kernel, latency);
+	}
+
+	LIBCAMERA_TRACEPOINT(v4l2_buffer_dequeue, deviceNode().c_str(), buf.index,
+			     buf.sequence, metadata.timestamp, kernelLatency);
+
+	if (latency_) {
+		std::weak_ptr<LatencyTracker> weakTracker = latency_;
+		utils::time_point dequeued = dequeueTime_;
+
+		buffer->_d()->setRequestCompleteHandler([weakTracker, dequeued, buffer]() {
+			std::shared_ptr<LatencyTracker> tracker = weakTracker.lock();
+			if (!tracker)
+				return;
+
+			const FrameMetadata &md = buffer->metadata();
+			if (md.status != FrameMetadata::FrameSuccess)
+				return;
+
+			utils::duration latency = utils::clock::now() - dequeued;
+			tracker->record(&V4L2LatencyStatistics::completion, latency);
+
+			LIBCAMERA_TRACEPOINT(v4l2_buffer_request_complete,
+					     tracker->deviceNode().c_str(), md.sequence,
+					     std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+		});
+	}
+
 	if (V4L2_TYPE_IS_OUTPUT(buf.type))
 		return buffer;
 
@@ -1828,9 +2400,12 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
  * Note that queueToDevice() will fail if the device is in the process of being
  * stopped from a streaming state through streamOff().
  *
+ * When \a request is not null, the buffer is added to the request.
+ *
  * \return 0 on success or a negative error code otherwise
  */
-int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
+int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer,
+				   const MediaRequest *request)
 {
 	struct v4l2_plane v4l2Planes[VIDEO_MAX_PLANES] = {};
 	struct v4l2_buffer buf = {};
@@ -1846,10 +2421,16 @@ int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
 		return -ENOENT;
 	}
 
+	uint64_t misses = cache_->misses();
 	ret = cache_->get(*buffer);
 	if (ret < 0)
 		return ret;
 
+	if (cache_->misses() != misses)
+		cacheMisses_->add();
+	else
+		cacheHits_->add();
+
 	buf.index = ret;
 	buf.type = bufferType_;
 	buf.memory = memoryType_;
@@ -1880,6 +2461,38 @@ int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
 		} else {
 			buf.m.fd = planes[0].fd.get();
 		}
+	} else if (buf.memory == V4L2_MEMORY_USERPTR) {
+		if (!planes[0].address) {
+			LOG(V4L2, Error) << "Frame buffer has no user memory";
+			return -EINVAL;
+		}
+
+		/*
+		 * Unlike dmabufs, the driver can't retrieve the size of user
+		 * memory, set the length for capture buffers too. Multiple
+		 * planes with a single-planar format are guaranteed to be
+		 * contiguous at this point, and are coalesced.
+		 */
+		auto userptr = [](const FrameBuffer::Plane &plane) {
+			return reinterpret_cast<unsigned long>(plane.address) + plane.offset;
+		};
+
+		unsigned int length = 0;
+		for (const FrameBuffer::Plane &plane : planes)
+			length += plane.length;
+
+		if (multiPlanar && numV4l2Planes == planes.size()) {
+			for (unsigned int p = 0; p < numV4l2Planes; ++p) {
+				v4l2Planes[p].m.userptr = userptr(planes[p]);
+				v4l2Planes[p].length = planes[p].length;
+			}
+		} else if (multiPlanar) {
+			v4l2Planes[0].m.userptr = userptr(planes[0]);
+			v4l2Planes[0].length = length;
+		} else {
+			buf.m.userptr = userptr(planes[0]);
+			buf.length = length;
+		}
 	}
 
 	if (multiPlanar) {
@@ -1954,6 +2567,11 @@ int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
 		buf.timestamp.tv_usec = (metadata.timestamp / 1000) % 1000000;
 	}
 
+	if (request) {
+		buf.flags |= V4L2_BUF_FLAG_REQUEST_FD;
+		buf.request_fd = request->fd();
+	}
+
 	LOG(V4L2, Debug) << "Queueing buffer " << buf.index;
 
 	ret = ioctl(VIDIOC_QBUF, &buf);
@@ -1972,6 +2590,9 @@ int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
 
 	queuedBuffers_[buf.index] = buffer;
 
+	LIBCAMERA_TRACEPOINT(v4l2_buffer_queue, deviceNode().c_str(), buf.index,
+			     queuedBuffers_.size());
+
 	return 0;
 }
 
@@ -2055,6 +2676,60 @@ int V4L2VideoDevice::streamOff()
 	return 0;
 }
 
+/**
+ * \brief Enable or disable the buffer latency statistics
+ * \param[in] enable Whether to collect the statistics
+ *
+ * When enabled, the device records the latency of the buffers it dequeues at
+ * each stage described in V4L2LatencyStatistics, to identify whether missed
+ * deadlines are caused by the kernel, the event loop or the pipeline handler.
+ * Collecting the statistics takes a lock for every stage of every buffer, they
+ * are thus disabled by default. Disabling the statistics discards the recorded
+ * values.
+ *
+ * The v4l2_buffer_dequeue and v4l2_buffer_ready tracepoints are emitted for
+ * every buffer regardless of this setting. The v4l2_buffer_request_complete
+ * tracepoint is only emitted while the statistics are enabled.
+ */
+void V4L2VideoDevice::setLatencyStatisticsEnabled(bool enable)
+{
+	if (enable == latencyStatisticsEnabled())
+		return;
+
+	if (enable)
+		latency_ = std::make_shared<LatencyTracker>(deviceNode());
+	else
+		latency_.reset();
+}
+
+/**
+ * \fn V4L2VideoDevice::latencyStatisticsEnabled()
+ * \brief Retrieve whether the buffer latency statistics are enabled
+ * \return True if the statistics are enabled, false otherwise
+ */
+
+/**
+ * \brief Retrieve the buffer latency statistics
+ * \return A snapshot of the statistics recorded since they were enabled or last
+ * reset, or empty statistics if they are disabled
+ */
+V4L2LatencyStatistics V4L2VideoDevice::latencyStatistics() const
+{
+	if (!latency_)
+		return {};
+
+	return latency_->statistics();
+}
+
+/**
+ * \brief Reset the buffer latency statistics
+ */
+void V4L2VideoDevice::resetLatencyStatistics()
+{
+	if (latency_)
+		latency_->reset();
+}
+
 /**
  * \brief Set the dequeue timeout value
  * \param[in] timeout The timeout value to be used
@@ -2085,6 +2760,29 @@ void V4L2VideoDevice::setDequeueTimeout(utils::Duration timeout)
  * \brief A Signal emitted when the dequeue watchdog timer expires
  */
 
+/**
+ * \fn V4L2VideoDevice::setBatchedDequeue()
+ * \brief Enable or disable batched buffer dequeue
+ * \param[in] enable Whether to dequeue buffers in batches
+ *
+ * By default, a single buffer is dequeued every time the device signals that
+ * buffers are available, and the event loop runs between each buffer. When
+ * batched dequeue is enabled, all the available buffers are dequeued at once,
+ * reducing the overhead of the event loop when the device runs at high frame
+ * rates or when the buffers completion is delayed. The bufferReady signal is
+ * emitted for each buffer, and the bufferBatchComplete signal is then emitted
+ * after the last buffer of the batch.
+ */
+
+/**
+ * \var V4L2VideoDevice::bufferBatchComplete
+ * \brief A Signal emitted after a batch of buffers has been dequeued
+ *
+ * This signal is only emitted when batched dequeue is enabled, after the
+ * bufferReady signal has been emitted for all the buffers of the batch. It
+ * allows processing the completed buffers together.
+ */
+
 /**
  * \brief Slot to handle an expired dequeue timer
  *
@@ -2096,6 +2794,8 @@ void V4L2VideoDevice::watchdogExpired()
 	LOG(V4L2, Warning)
 		<< "Dequeue timer of " << watchdogDuration_ << " has expired!";
 
+	dequeueTimeouts_->add();
+
 	dequeueTimeout.emit();
 }
 
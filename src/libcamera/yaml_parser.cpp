@@ -7,13 +7,21 @@
 
 #include "libcamera/internal/yaml_parser.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <errno.h>
 #include <functional>
+#include <iomanip>
 #include <limits>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <unordered_set>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <yaml.h>
 
@@ -31,8 +39,57 @@ namespace {
 /* Empty static YamlObject as a safe result for invalid operations */
 static const YamlObject empty;
 
+/* Key of list elements */
+static const std::string emptyKey;
+
 } /* namespace */
 
+#ifndef __DOXYGEN__
+
+/*
+ * Storage for the nodes and dictionary keys of a YAML document, owned by the
+ * root YamlObject. Nodes are allocated in chunks of growing size, and keys are
+ * interned, as tuning files repeat the same keys many times. This avoids one
+ * memory allocation per node and per key.
+ */
+class YamlObject::Storage
+{
+public:
+	Storage()
+		: chunkSize_(0), used_(0)
+	{
+	}
+
+	YamlObject *create()
+	{
+		if (used_ == chunkSize_) {
+			chunkSize_ = std::clamp(chunkSize_ * 2, kMinChunkSize,
+						kMaxChunkSize);
+			chunks_.push_back(std::make_unique<YamlObject[]>(chunkSize_));
+			used_ = 0;
+		}
+
+		return &chunks_.back()[used_++];
+	}
+
+	const std::string *intern(std::string &&key)
+	{
+		return &*keys_.insert(std::move(key)).first;
+	}
+
+private:
+	static constexpr unsigned int kMinChunkSize = 16;
+	static constexpr unsigned int kMaxChunkSize = 1024;
+
+	std::vector<std::unique_ptr<YamlObject[]>> chunks_;
+	unsigned int chunkSize_;
+	unsigned int used_;
+
+	std::unordered_set<std::string> keys_;
+};
+
+#endif /* __DOXYGEN__ */
+
 /**
  * \class YamlObject
  * \brief A class representing the tree structure of the YAML content
@@ -468,10 +525,12 @@ const YamlObject &YamlObject::operator[](std::size_t index) const
  */
 bool YamlObject::contains(const std::string &key) const
 {
-	if (dictionary_.find(std::ref(key)) == dictionary_.end())
-		return false;
+	auto iter = std::lower_bound(dictionary_.begin(), dictionary_.end(), key,
+				     [this](uint32_t index, const std::string &k) {
+					     return *list_[index].key < k;
+				     });
 
-	return true;
+	return iter != dictionary_.end() && *list_[*iter].key == key;
 }
 
 /**
@@ -490,11 +549,30 @@ const YamlObject &YamlObject::operator[](const std::string &key) const
 	if (type_ != Type::Dictionary)
 		return empty;
 
-	auto iter = dictionary_.find(key);
-	if (iter == dictionary_.end())
+	auto iter = std::lower_bound(dictionary_.begin(), dictionary_.end(), key,
+				     [this](uint32_t index, const std::string &k) {
+					     return *list_[index].key < k;
+				     });
+	if (iter == dictionary_.end() || *list_[*iter].key != key)
 		return empty;
 
-	return *iter->second;
+	return *list_[*iter].value;
+}
+
+/*
+ * Index the elements of a dictionary by key. The index is sorted with a stable
+ * sort, so that the first of duplicated keys is found by lookups.
+ */
+void YamlObject::indexDictionary()
+{
+	dictionary_.resize(list_.size());
+	for (uint32_t i = 0; i < list_.size(); i++)
+		dictionary_[i] = i;
+
+	std::stable_sort(dictionary_.begin(), dictionary_.end(),
+			 [this](uint32_t a, uint32_t b) {
+				 return *list_[a].key < *list_[b].key;
+			 });
 }
 
 #ifndef __DOXYGEN__
@@ -530,6 +608,7 @@ private:
 
 	bool parserValid_;
 	yaml_parser_t parser_;
+	YamlObject::Storage *storage_;
 };
 
 /**
@@ -540,7 +619,7 @@ private:
  * helper functions to do event-based parsing for YAML files.
  */
 YamlParserContext::YamlParserContext()
-	: parserValid_(false)
+	: parserValid_(false), storage_(nullptr)
 {
 }
 
@@ -628,6 +707,9 @@ YamlParserContext::EventPtr YamlParserContext::nextEvent()
  */
 int YamlParserContext::parseContent(YamlObject &yamlObject)
 {
+	yamlObject.storage_ = std::make_unique<YamlObject::Storage>();
+	storage_ = yamlObject.storage_.get();
+
 	/* Check start of the YAML file. */
 	EventPtr event = nextEvent();
 	if (!event || event->type != YAML_STREAM_START_EVENT)
@@ -743,7 +825,7 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
 		yamlObject.type_ = YamlObject::Type::List;
 		auto &list = yamlObject.list_;
 		auto handler = [this, &list](EventPtr evt) {
-			list.emplace_back(std::string{}, std::make_unique<YamlObject>());
+			list.emplace_back(&emptyKey, storage_->create());
 			return parseNextYamlObject(*list.back().value, std::move(evt));
 		};
 		return parseDictionaryOrList(YamlObject::Type::List, handler);
@@ -770,17 +852,15 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
 			if (!evtValue)
 				return -EINVAL;
 
-			auto &elem = list.emplace_back(std::move(key),
-						       std::make_unique<YamlObject>());
+			auto &elem = list.emplace_back(storage_->intern(std::move(key)),
+						       storage_->create());
 			return parseNextYamlObject(*elem.value, std::move(evtValue));
 		};
 		int ret = parseDictionaryOrList(YamlObject::Type::Dictionary, handler);
 		if (ret)
 			return ret;
 
-		auto &dictionary = yamlObject.dictionary_;
-		for (const auto &elem : list)
-			dictionary.emplace(elem.key, elem.value.get());
+		yamlObject.indexDictionary();
 
 		return 0;
 	}
@@ -793,6 +873,295 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
 
 #endif /* __DOXYGEN__ */
 
+#ifndef __DOXYGEN__
+/*
+ * Binary cache of parsed YAML documents
+ *
+ * Parsing large YAML or JSON documents, such as IPA tuning files, with libyaml
+ * is slow. When the LIBCAMERA_YAML_CACHE environment variable is set, the
+ * YamlObject tree of each parsed file is stored in a binary form in the cache
+ * directory, and loaded from there the next time the same file is parsed.
+ *
+ * Cache files are named after a hash of the source file name, and store a
+ * hash and the size of the source file contents. A cache file is only used
+ * when both match the source file, editing the source file thus invalidates
+ * its cache entry. The cache file is memory-mapped and decoded directly into
+ * a YamlObject tree.
+ *
+ * The file format is a header followed by the root node, using the native byte
+ * order:
+ *
+ * - header: the kMagic string, the content hash (u64) and size (u64)
+ * - node: the node type (u8) followed by its contents
+ * - value: the value string
+ * - list: the number of items (u32) followed by the items nodes
+ * - dictionary: the number of items (u32) followed, for each item, by the key
+ *   string and the item node
+ * - string: the string length (u32) followed by the characters
+ */
+class YamlParserCache
+{
+public:
+	YamlParserCache(File &file);
+
+	std::unique_ptr<YamlObject> load();
+	void store(const YamlObject &root);
+
+private:
+	struct Header {
+		char magic[8];
+		uint64_t hash;
+		uint64_t size;
+	};
+
+	static constexpr char kMagic[8] = { 'L', 'C', 'Y', 'A', 'M', 'L', '0', '1' };
+
+	static uint64_t hash(Span<const uint8_t> data);
+
+	static void encode(std::string &out, const YamlObject &obj);
+	static void encodeString(std::string &out, const std::string &str);
+	static void encodeU32(std::string &out, uint32_t value);
+
+	class Decoder;
+
+	std::string path_;
+	Header header_;
+};
+
+YamlParserCache::YamlParserCache(File &file)
+	: header_{}
+{
+	const char *directory = utils::secure_getenv("LIBCAMERA_YAML_CACHE");
+	if (!directory || !*directory)
+		return;
+
+	Span<uint8_t> data = file.map();
+	if (data.empty())
+		return;
+
+	memcpy(header_.magic, kMagic, sizeof(kMagic));
+	header_.hash = hash(data);
+	header_.size = data.size();
+	file.unmap(data.data());
+
+	const std::string &name = file.fileName();
+	std::ostringstream path;
+	path << directory << "/" << std::hex << std::setfill('0')
+	     << std::setw(16)
+	     << hash({ reinterpret_cast<const uint8_t *>(name.data()), name.size() })
+	     << ".yaml.cache";
+	path_ = path.str();
+}
+
+/* 64-bit FNV-1a hash, stable across runs. */
+uint64_t YamlParserCache::hash(Span<const uint8_t> data)
+{
+	uint64_t value = 0xcbf29ce484222325ULL;
+
+	for (uint8_t c : data) {
+		value ^= c;
+		value *= 0x100000001b3ULL;
+	}
+
+	return value;
+}
+
+class YamlParserCache::Decoder
+{
+public:
+	Decoder(Span<const uint8_t> data, YamlObject::Storage *storage)
+		: data_(data), pos_(0), storage_(storage)
+	{
+	}
+
+	bool read(void *dst, size_t size)
+	{
+		if (data_.size() - pos_ < size)
+			return false;
+
+		memcpy(dst, data_.data() + pos_, size);
+		pos_ += size;
+		return true;
+	}
+
+	bool readString(std::string &str)
+	{
+		uint32_t length;
+		if (!read(&length, sizeof(length)) || data_.size() - pos_ < length)
+			return false;
+
+		str.assign(reinterpret_cast<const char *>(data_.data() + pos_), length);
+		pos_ += length;
+		return true;
+	}
+
+	bool decode(YamlObject &obj, unsigned int depth)
+	{
+		uint8_t type;
+		uint32_t count;
+
+		/* Guard against corrupted files causing a stack overflow. */
+		if (depth > kMaxDepth || !read(&type, sizeof(type)))
+			return false;
+
+		switch (static_cast<YamlObject::Type>(type)) {
+		case YamlObject::Type::Value:
+			obj.type_ = YamlObject::Type::Value;
+			return readString(obj.value_);
+
+		case YamlObject::Type::List:
+			obj.type_ = YamlObject::Type::List;
+			if (!read(&count, sizeof(count)))
+				return false;
+
+			for (uint32_t i = 0; i < count; i++) {
+				auto &elem = obj.list_.emplace_back(&emptyKey,
+								    storage_->create());
+				if (!decode(*elem.value, depth + 1))
+					return false;
+			}
+			return true;
+
+		case YamlObject::Type::Dictionary:
+			obj.type_ = YamlObject::Type::Dictionary;
+			if (!read(&count, sizeof(count)))
+				return false;
+
+			for (uint32_t i = 0; i < count; i++) {
+				std::string key;
+				if (!readString(key))
+					return false;
+
+				auto &elem = obj.list_.emplace_back(storage_->intern(std::move(key)),
+								    storage_->create());
+				if (!decode(*elem.value, depth + 1))
+					return false;
+			}
+
+			obj.indexDictionary();
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	bool atEnd() const { return pos_ == data_.size(); }
+
+private:
+	static constexpr unsigned int kMaxDepth = 256;
+
+	Span<const uint8_t> data_;
+	size_t pos_;
+	YamlObject::Storage *storage_;
+};
+
+std::unique_ptr<YamlObject> YamlParserCache::load()
+{
+	if (path_.empty())
+		return nullptr;
+
+	File file(path_);
+	if (!file.open(File::OpenModeFlag::ReadOnly))
+		return nullptr;
+
+	Span<const uint8_t> data = file.map();
+	if (data.empty())
+		return nullptr;
+
+	std::unique_ptr<YamlObject> root = std::make_unique<YamlObject>();
+	root->storage_ = std::make_unique<YamlObject::Storage>();
+
+	Decoder decoder(data, root->storage_.get());
+	Header header;
+
+	if (!decoder.read(&header, sizeof(header)) ||
+	    memcmp(&header, &header_, sizeof(header))) {
+		LOG(YamlParser, Debug) << "Discarding stale cache file " << path_;
+		return nullptr;
+	}
+
+	if (!decoder.decode(*root, 0) || !decoder.atEnd()) {
+		LOG(YamlParser, Warning) << "Invalid cache file " << path_;
+		return nullptr;
+	}
+
+	LOG(YamlParser, Debug) << "Loaded YAML document from cache file " << path_;
+
+	return root;
+}
+
+void YamlParserCache::store(const YamlObject &root)
+{
+	if (path_.empty())
+		return;
+
+	std::string data(reinterpret_cast<const char *>(&header_), sizeof(header_));
+	encode(data, root);
+
+	/*
+	 * Write to a temporary file and rename it, to avoid exposing partially
+	 * written files to concurrent readers.
+	 */
+	std::string tmpPath = path_ + "." + std::to_string(getpid());
+	unlink(tmpPath.c_str());
+
+	File file(tmpPath);
+	if (!file.open(File::OpenModeFlag::WriteOnly)) {
+		LOG(YamlParser, Debug)
+			<< "Unable to create cache file " << tmpPath << ": "
+			<< strerror(-file.error());
+		return;
+	}
+
+	ssize_t ret = file.write({ reinterpret_cast<const uint8_t *>(data.data()),
+				   data.size() });
+	file.close();
+
+	if (ret != static_cast<ssize_t>(data.size()) ||
+	    rename(tmpPath.c_str(), path_.c_str())) {
+		LOG(YamlParser, Warning) << "Unable to write cache file " << path_;
+		unlink(tmpPath.c_str());
+	}
+}
+
+void YamlParserCache::encode(std::string &out, const YamlObject &obj)
+{
+	out.push_back(static_cast<char>(obj.type_));
+
+	switch (obj.type_) {
+	case YamlObject::Type::Value:
+		encodeString(out, obj.value_);
+		break;
+
+	case YamlObject::Type::List:
+		encodeU32(out, obj.list_.size());
+		for (const auto &elem : obj.list_)
+			encode(out, *elem.value);
+		break;
+
+	case YamlObject::Type::Dictionary:
+		encodeU32(out, obj.list_.size());
+		for (const auto &elem : obj.list_) {
+			encodeString(out, *elem.key);
+			encode(out, *elem.value);
+		}
+		break;
+	}
+}
+
+void YamlParserCache::encodeString(std::string &out, const std::string &str)
+{
+	encodeU32(out, str.size());
+	out.append(str);
+}
+
+void YamlParserCache::encodeU32(std::string &out, uint32_t value)
+{
+	out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+#endif /* __DOXYGEN__ */
+
 /**
  * \class YamlParser
  * \brief A helper class for parsing a YAML file
@@ -851,16 +1220,27 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
  * returns a pointer to a YamlObject corresponding to the root node of the YAML
  * document.
  *
+ * When the LIBCAMERA_YAML_CACHE environment variable is set, the parsed
+ * document is stored in a binary cache, and later calls for the same file load
+ * it from the cache instead of parsing it, as long as the file contents are
+ * unchanged.
+ *
  * \return Pointer to result YamlObject on success or nullptr otherwise
  */
 std::unique_ptr<YamlObject> YamlParser::parse(File &file)
 {
+	YamlParserCache cache(file);
+
+	std::unique_ptr<YamlObject> root = cache.load();
+	if (root)
+		return root;
+
 	YamlParserContext context;
 
 	if (context.init(file))
 		return nullptr;
 
-	std::unique_ptr<YamlObject> root(new YamlObject());
+	root = std::make_unique<YamlObject>();
 
 	if (context.parseContent(*root)) {
 		LOG(YamlParser, Error)
@@ -869,6 +1249,8 @@ std::unique_ptr<YamlObject> YamlParser::parse(File &file)
 		return nullptr;
 	}
 
+	cache.store(*root);
+
 	return root;
 }
 
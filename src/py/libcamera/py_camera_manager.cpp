@@ -5,13 +5,21 @@
 
 #include "py_camera_manager.h"
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <errno.h>
+#include <map>
 #include <memory>
+#include <poll.h>
 #include <sys/eventfd.h>
 #include <system_error>
 #include <unistd.h>
 #include <vector>
 
+#include <pybind11/stl.h>
+
+#include "py_helpers.h"
 #include "py_main.h"
 
 namespace py = pybind11;
@@ -82,6 +90,56 @@ std::vector<py::object> PyCameraManager::getReadyRequests()
 	return py_reqs;
 }
 
+/*
+ * Wait for requests to complete, with the GIL released, so that other Python
+ * threads can run while waiting. A timeout of None waits forever, and an empty
+ * list is returned if the timeout expires.
+ */
+std::vector<py::object> PyCameraManager::waitReadyRequests(std::optional<double> timeout)
+{
+	if (!waitFd(timeout))
+		return std::vector<py::object>();
+
+	return getReadyRequests();
+}
+
+/*
+ * Retrieve the completed requests along with their buffers and the requested
+ * metadata, as a list of (request, buffers, metadata) tuples. This avoids
+ * going back and forth between Python and C++ for each request. Unless the
+ * timeout is 0, wait for requests to complete as waitReadyRequests() does.
+ */
+py::list PyCameraManager::getReadyRequestBatch(const std::vector<const ControlId *> &metadata,
+					       std::optional<double> timeout)
+{
+	py::list batch;
+
+	if ((!timeout || *timeout > 0) && !waitFd(timeout))
+		return batch;
+
+	for (py::object &o : getReadyRequests()) {
+		Request *request = o.cast<Request *>();
+
+		const Request::BufferMap &buffers = request->buffers();
+		py::object pyBuffers = py::cast(std::map<const Stream *, FrameBuffer *>(buffers.begin(),
+											 buffers.end()),
+						py::return_value_policy::reference);
+
+		py::dict pyMetadata;
+		for (const ControlId *id : metadata) {
+			if (!request->metadata().contains(id->id()))
+				continue;
+
+			py::object key = py::cast(id, py::return_value_policy::reference);
+			pyMetadata[key] = controlValueToPy(request->metadata().get(id->id()));
+		}
+
+		batch.append(py::make_tuple(o, pyBuffers, pyMetadata));
+	}
+
+	return batch;
+}
+
 /* Note: Called from another thread */
 void PyCameraManager::handleRequestCompleted(Request *req)
 {
@@ -116,6 +174,46 @@ int PyCameraManager::readFd()
 		return -EIO;
 }
 
+/*
+ * Wait for the eventfd to become readable, with the GIL released. Return true
+ * if the eventfd is readable, or false if the timeout expired or the wait got
+ * interrupted by a signal that doesn't raise an exception.
+ */
+bool PyCameraManager::waitFd(std::optional<double> timeout)
+{
+	struct pollfd pfd = { eventFd_.get(), POLLIN, 0 };
+	int timeoutMs = -1;
+	int ret;
+	int err;
+
+	/* Clamp the timeout to the poll() range, negative values don't wait. */
+	if (timeout) {
+		double ms = std::ceil(*timeout * 1000);
+		timeoutMs = ms > 0 ? static_cast<int>(std::min<double>(ms, INT_MAX)) : 0;
+	}
+
+	{
+		py::gil_scoped_release release;
+
+		ret = poll(&pfd, 1, timeoutMs);
+		err = errno;
+	}
+
+	if (ret < 0) {
+		if (err != EINTR)
+			throw std::system_error(err, std::generic_category(),
+						"Failed to wait for requests");
+
+		/* Let Python handle the signal, KeyboardInterrupt for instance. */
+		if (PyErr_CheckSignals())
+			throw py::error_already_set();
+
+		return false;
+	}
+
+	return ret > 0;
+}
+
 void PyCameraManager::pushRequest(Request *req)
 {
 	MutexLocker guard(completedRequestsMutex_);
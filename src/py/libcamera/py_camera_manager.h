@@ -5,6 +5,9 @@
 
 #pragma once
 
+#include <optional>
+#include <vector>
+
 #include <libcamera/base/mutex.h>
 
 #include <libcamera/libcamera.h>
@@ -27,6 +30,9 @@ public:
 	int eventFd() const { return eventFd_.get(); }
 
 	std::vector<pybind11::object> getReadyRequests();
+	std::vector<pybind11::object> waitReadyRequests(std::optional<double> timeout);
+	pybind11::list getReadyRequestBatch(const std::vector<const ControlId *> &metadata,
+					    std::optional<double> timeout);
 
 	void handleRequestCompleted(Request *req);
 
@@ -40,6 +46,7 @@ private:
 
 	void writeFd();
 	int readFd();
+	bool waitFd(std::optional<double> timeout);
 	void pushRequest(Request *req);
 	std::vector<Request *> getCompletedRequests();
 };
@@ -7,7 +7,9 @@
 
 #include "py_main.h"
 
+#include <map>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -79,6 +81,43 @@ private:
 
 PYBIND11_DECLARE_HOLDER_TYPE(T, PyCameraSmartPtr<T>)
 
+/*
+ * A read-only mapping view of the request metadata. Metadata values are
+ * converted to Python objects only when accessed, instead of converting the
+ * whole ControlList for every completed request. The view reflects the current
+ * metadata of the request, and is thus invalidated when the request is reused.
+ */
+class PyRequestMetadata
+{
+public:
+	PyRequestMetadata(Request *request)
+		: request_(request)
+	{
+	}
+
+	const ControlList &metadata() const { return request_->metadata(); }
+
+	template<typename T>
+	std::optional<T> get(const Control<T> &ctrl) const
+	{
+		return metadata().get(ctrl);
+	}
+
+	std::vector<const ControlId *> keys() const
+	{
+		std::vector<const ControlId *> ids;
+		ids.reserve(metadata().size());
+
+		for (const auto &[id, value] : metadata())
+			ids.push_back(controls::controls.at(id));
+
+		return ids;
+	}
+
+private:
+	Request *request_;
+};
+
 /*
  * Note: global C++ destructors can be ran on this before the py module is
  * destructed.
@@ -118,12 +157,14 @@ PYBIND11_MODULE(_libcamera, m)
 	auto pyRequest = py::class_<Request>(m, "Request");
 	auto pyRequestStatus = py::enum_<Request::Status>(pyRequest, "Status");
 	auto pyRequestReuse = py::enum_<Request::ReuseFlag>(pyRequest, "Reuse");
+	auto pyRequestMetadata = py::class_<PyRequestMetadata>(pyRequest, "Metadata");
 	auto pyFrameMetadata = py::class_<FrameMetadata>(m, "FrameMetadata");
 	auto pyFrameMetadataStatus = py::enum_<FrameMetadata::Status>(pyFrameMetadata, "Status");
 	auto pyFrameMetadataPlane = py::class_<FrameMetadata::Plane>(pyFrameMetadata, "Plane");
 	auto pyPixelFormat = py::class_<PixelFormat>(m, "PixelFormat");
 
 	init_py_formats_generated(m);
+	init_py_mapped_frame_buffer(m);
 
 	/* Global functions */
 	m.def("log_set_level", &logSetLevel);
@@ -146,7 +187,12 @@ PYBIND11_MODULE(_libcamera, m)
 		.def_property_readonly("cameras", &PyCameraManager::cameras)
 
 		.def_property_readonly("event_fd", &PyCameraManager::eventFd)
-		.def("get_ready_requests", &PyCameraManager::getReadyRequests);
+		.def("get_ready_requests", &PyCameraManager::getReadyRequests)
+		.def("wait_ready_requests", &PyCameraManager::waitReadyRequests,
+		     py::arg("timeout") = py::none())
+		.def("get_ready_request_batch", &PyCameraManager::getReadyRequestBatch,
+		     py::arg("metadata") = py::list(),
+		     py::arg("timeout") = 0.0);
 
 	pyCamera
 		.def_property_readonly("id", &Camera::id)
@@ -437,26 +483,28 @@ PYBIND11_MODULE(_libcamera, m)
 							"Failed to add buffer");
 		}, py::keep_alive<1, 3>()) /* Request keeps Framebuffer alive */
 		.def_property_readonly("status", &Request::status)
-		.def_property_readonly("buffers", &Request::buffers)
+		.def_property_readonly("buffers", [](Request &self) {
+			/* Convert BufferMap to std container */
+
+			const Request::BufferMap &buffers = self.buffers();
+			return std::map<const Stream *, FrameBuffer *>(buffers.begin(),
+								       buffers.end());
+		})
 		.def_property_readonly("cookie", &Request::cookie)
 		.def_property_readonly("sequence", &Request::sequence)
+		.def_property("priority", &Request::priority, &Request::setPriority)
 		.def_property_readonly("has_pending_buffers", &Request::hasPendingBuffers)
 		.def("set_control", [](Request &self, const ControlId &id, py::object value) {
 			self.controls().set(id.id(), pyToControlValue(value, id.type()));
 		})
-		.def_property_readonly("metadata", [](Request &self) {
-			/* Convert ControlList to std container */
-
-			std::unordered_map<const ControlId *, py::object> ret;
-
-			for (const auto &[key, cv] : self.metadata()) {
-				const ControlId *id = controls::controls.at(key);
-				py::object ob = controlValueToPy(cv);
-				ret[id] = ob;
-			}
-
-			return ret;
-		})
+		/*
+		 * Call policies passed to def_property_readonly() are ignored,
+		 * wrap the getter in a cpp_function to keep the request alive
+		 * for as long as the view is referenced.
+		 */
+		.def_property_readonly("metadata", py::cpp_function([](Request &self) {
+			return PyRequestMetadata(&self);
+		}, py::keep_alive<0, 1>()))
 		/*
 		 * \todo As we add a keep_alive to the fb in addBuffers(), we
 		 * can only allow reuse with ReuseBuffers.
@@ -464,6 +512,70 @@ PYBIND11_MODULE(_libcamera, m)
 		.def("reuse", [](Request &self) { self.reuse(Request::ReuseFlag::ReuseBuffers); })
 		.def("__str__", &Request::toString);
 
+	pyRequestMetadata
+		.def("__getitem__", [](const PyRequestMetadata &self, const ControlId &id) {
+			if (!self.metadata().contains(id.id()))
+				throw py::key_error(id.name());
+			return controlValueToPy(self.metadata().get(id.id()));
+		})
+		.def("get", [](const PyRequestMetadata &self, const ControlId &id,
+			       py::object def) {
+			if (!self.metadata().contains(id.id()))
+				return def;
+			return controlValueToPy(self.metadata().get(id.id()));
+		}, py::arg("id"), py::arg("default") = py::none())
+		.def("__contains__", [](const PyRequestMetadata &self, const ControlId &id) {
+			return self.metadata().contains(id.id());
+		})
+		.def("__len__", [](const PyRequestMetadata &self) {
+			return self.metadata().size();
+		})
+		.def("__iter__", [](const PyRequestMetadata &self) {
+			return py::iter(py::cast(self.keys(), py::return_value_policy::reference));
+		})
+		.def("keys", [](const PyRequestMetadata &self) {
+			return py::cast(self.keys(), py::return_value_policy::reference);
+		})
+		.def("values", [](const PyRequestMetadata &self) {
+			py::list values;
+			for (const auto &[id, value] : self.metadata())
+				values.append(controlValueToPy(value));
+			return values;
+		})
+		.def("items", [](const PyRequestMetadata &self) {
+			py::list items;
+			for (const auto &[id, value] : self.metadata())
+				items.append(py::make_tuple(py::cast(controls::controls.at(id),
+								     py::return_value_policy::reference),
+							    controlValueToPy(value)));
+			return items;
+		})
+		/* Typed accessors for the most common per-frame metadata */
+		.def_property_readonly("sensor_timestamp", [](const PyRequestMetadata &self) {
+			return self.get(controls::SensorTimestamp);
+		})
+		.def_property_readonly("exposure_time", [](const PyRequestMetadata &self) {
+			return self.get(controls::ExposureTime);
+		})
+		.def_property_readonly("analogue_gain", [](const PyRequestMetadata &self) {
+			return self.get(controls::AnalogueGain);
+		})
+		.def_property_readonly("digital_gain", [](const PyRequestMetadata &self) {
+			return self.get(controls::DigitalGain);
+		})
+		.def_property_readonly("frame_duration", [](const PyRequestMetadata &self) {
+			return self.get(controls::FrameDuration);
+		})
+		.def_property_readonly("colour_temperature", [](const PyRequestMetadata &self) {
+			return self.get(controls::ColourTemperature);
+		})
+		.def_property_readonly("lux", [](const PyRequestMetadata &self) {
+			return self.get(controls::Lux);
+		});
+
+	/* Let the view be recognized as a mapping by isinstance() */
+	py::module::import("collections.abc").attr("Mapping").attr("register")(pyRequestMetadata);
+
 	pyRequestStatus
 		.value("Pending", Request::RequestPending)
 		.value("Complete", Request::RequestComplete)
@@ -20,5 +20,6 @@ void init_py_controls_generated(pybind11::module &m);
 void init_py_enums(pybind11::module &m);
 void init_py_formats_generated(pybind11::module &m);
 void init_py_geometry(pybind11::module &m);
+void init_py_mapped_frame_buffer(pybind11::module &m);
 void init_py_properties_generated(pybind11::module &m);
 void init_py_transform(pybind11::module &m);
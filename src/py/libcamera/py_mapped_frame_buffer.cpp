@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Python bindings - Mapped frame buffers
+ */
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <system_error>
+#include <vector>
+
+#include <libcamera/libcamera.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "py_main.h"
+
+namespace py = pybind11;
+
+using namespace libcamera;
+
+namespace {
+
+/*
+ * The mapping of a frame buffer, shared by all the Python objects that expose
+ * its planes. The planes are copied to keep their file descriptors open for as
+ * long as the mapping exists, which guarantees that the cache below can't
+ * match a different buffer that would reuse the same file descriptors.
+ */
+struct Mapping {
+	Mapping(const FrameBuffer *buffer)
+		: map(buffer, MappedFrameBuffer::MapFlag::ReadWrite),
+		  planes(buffer->planes())
+	{
+	}
+
+	bool matches(const FrameBuffer *buffer) const
+	{
+		const std::vector<FrameBuffer::Plane> &bufferPlanes = buffer->planes();
+
+		if (bufferPlanes.size() != planes.size())
+			return false;
+
+		for (unsigned int i = 0; i < planes.size(); i++) {
+			if (bufferPlanes[i].fd.get() != planes[i].fd.get() ||
+			    bufferPlanes[i].offset != planes[i].offset ||
+			    bufferPlanes[i].length != planes[i].length)
+				return false;
+		}
+
+		return true;
+	}
+
+	MappedFrameBuffer map;
+	std::vector<FrameBuffer::Plane> planes;
+};
+
+/*
+ * Map a frame buffer, or reuse its existing mapping. Mappings are cached for
+ * as long as a Python object references them, so that repeatedly mapping the
+ * buffers of a capture loop doesn't mmap() and munmap() them for every frame.
+ */
+std::shared_ptr<Mapping> mapFrameBuffer(const FrameBuffer *buffer)
+{
+	static std::map<const FrameBuffer *, std::weak_ptr<Mapping>> cache;
+
+	for (auto it = cache.begin(); it != cache.end();) {
+		if (it->second.expired())
+			it = cache.erase(it);
+		else
+			++it;
+	}
+
+	auto it = cache.find(buffer);
+	if (it != cache.end()) {
+		std::shared_ptr<Mapping> mapping = it->second.lock();
+		if (mapping->matches(buffer))
+			return mapping;
+	}
+
+	auto mapping = std::make_shared<Mapping>(buffer);
+	if (!mapping->map.isValid())
+		throw std::system_error(mapping->map.error(), std::generic_category(),
+					"Failed to map buffer");
+
+	cache[buffer] = mapping;
+
+	return mapping;
+}
+
+/*
+ * A plane of a mapped frame buffer, exposed through the Python buffer protocol
+ * and the numpy array interface. The plane keeps the mapping alive for as long
+ * as it is referenced, including by the arrays created from it.
+ */
+struct MappedPlane {
+	std::shared_ptr<Mapping> mapping;
+	uint8_t *data;
+	std::vector<py::ssize_t> shape;
+	std::vector<py::ssize_t> strides;
+};
+
+/*
+ * Compute the shape of the planes from the stream configuration. Planes are
+ * exposed as arrays of lines, without the padding at the end of the lines.
+ * Formats that store one pixel per group of bytes add a dimension for the bytes
+ * of each pixel, (height, width, 3) for RGB888 for instance. Compressed formats
+ * and unknown formats are exposed as one-dimensional arrays of bytes.
+ */
+bool planeShape(const StreamConfiguration &config, unsigned int index,
+		size_t size, MappedPlane *plane)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(config.pixelFormat);
+	if (!info.isValid() || !config.stride || index >= info.numPlanes())
+		return false;
+
+	const PixelFormatPlaneInfo &planeInfo = info.planes[index];
+	unsigned int stride = config.stride * planeInfo.bytesPerGroup /
+			      info.planes[0].bytesPerGroup;
+	unsigned int lineSize = info.stride(config.size.width, index);
+	unsigned int lines = (config.size.height + planeInfo.verticalSubSampling - 1) /
+			     planeInfo.verticalSubSampling;
+
+	if (!lines || !lineSize || lineSize > stride ||
+	    static_cast<uint64_t>(stride) * (lines - 1) + lineSize > size)
+		return false;
+
+	if (info.pixelsPerGroup == 1 && planeInfo.bytesPerGroup > 1) {
+		plane->shape = {
+			static_cast<py::ssize_t>(lines),
+			static_cast<py::ssize_t>(config.size.width),
+			static_cast<py::ssize_t>(planeInfo.bytesPerGroup),
+		};
+		plane->strides = {
+			static_cast<py::ssize_t>(stride),
+			static_cast<py::ssize_t>(planeInfo.bytesPerGroup),
+			1,
+		};
+	} else {
+		plane->shape = {
+			static_cast<py::ssize_t>(lines),
+			static_cast<py::ssize_t>(lineSize),
+		};
+		plane->strides = { static_cast<py::ssize_t>(stride), 1 };
+	}
+
+	return true;
+}
+
+/*
+ * A frame buffer mapped in memory. Creating the object is cheap when the
+ * buffer is already mapped, the planes are then created from the cached
+ * mapping.
+ */
+class PyMappedFrameBuffer
+{
+public:
+	PyMappedFrameBuffer(const FrameBuffer *buffer,
+			    const StreamConfiguration *config)
+	{
+		std::shared_ptr<Mapping> mapping = mapFrameBuffer(buffer);
+		const std::vector<MappedBuffer::Plane> &planes = mapping->map.planes();
+
+		for (unsigned int i = 0; i < planes.size(); i++) {
+			MappedPlane plane{ mapping, planes[i].data(), {}, {} };
+
+			if (!config || !planeShape(*config, i, planes[i].size(), &plane)) {
+				plane.shape = { static_cast<py::ssize_t>(planes[i].size()) };
+				plane.strides = { 1 };
+			}
+
+			planes_.push_back(std::move(plane));
+		}
+	}
+
+	const std::vector<MappedPlane> &planes() const { return planes_; }
+
+private:
+	std::vector<MappedPlane> planes_;
+};
+
+} /* namespace */
+
+/*
+ * The mapping holds references to the buffer file descriptors, the planes thus
+ * remain valid when the FrameBuffer is deleted.
+ */
+void init_py_mapped_frame_buffer(py::module &m)
+{
+	auto pyMappedFrameBuffer = py::class_<PyMappedFrameBuffer>(m, "MappedFrameBuffer");
+	auto pyMappedPlane = py::class_<MappedPlane>(pyMappedFrameBuffer, "Plane",
+						      py::buffer_protocol());
+
+	pyMappedFrameBuffer
+		.def(py::init<const FrameBuffer *, const StreamConfiguration *>(),
+		     py::arg("buffer"), py::arg("config") = py::none())
+		.def_property_readonly("planes", [](const PyMappedFrameBuffer &self) {
+			py::tuple planes(self.planes().size());
+			for (unsigned int i = 0; i < self.planes().size(); i++)
+				planes[i] = py::cast(self.planes()[i]);
+			return planes;
+		})
+		/* Context manager support, for compatibility with utils.MappedFrameBuffer */
+		.def("__enter__", [](py::object self) { return self; })
+		.def("__exit__", []([[maybe_unused]] const PyMappedFrameBuffer &self,
+				     [[maybe_unused]] py::object excType,
+				     [[maybe_unused]] py::object excValue,
+				     [[maybe_unused]] py::object traceback) {});
+
+	pyMappedPlane
+		.def_buffer([](MappedPlane &self) {
+			return py::buffer_info(self.data, sizeof(uint8_t),
+					       py::format_descriptor<uint8_t>::format(),
+					       self.shape.size(), self.shape,
+					       self.strides);
+		})
+		.def_property_readonly("shape", [](const MappedPlane &self) {
+			return py::tuple(py::cast(self.shape));
+		})
+		.def_property_readonly("strides", [](const MappedPlane &self) {
+			return py::tuple(py::cast(self.strides));
+		})
+		.def_property_readonly("__array_interface__", [](const MappedPlane &self) {
+			py::dict arrayInterface;
+			arrayInterface["version"] = 3;
+			arrayInterface["shape"] = py::tuple(py::cast(self.shape));
+			arrayInterface["strides"] = py::tuple(py::cast(self.strides));
+			arrayInterface["typestr"] = "|u1";
+			arrayInterface["data"] = py::make_tuple(reinterpret_cast<uintptr_t>(self.data),
+								false);
+			return arrayInterface;
+		});
+}
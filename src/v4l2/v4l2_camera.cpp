@@ -8,17 +8,40 @@
 #include "v4l2_camera.h"
 
 #include <errno.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <libcamera/base/log.h>
 
+#include "libcamera/internal/formats.h"
+
 using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(V4L2Compat)
 
+namespace {
+
+/*
+ * Compute the size of a plane from the stream configuration. The stride is
+ * reported for the first plane only, the stride of the other planes is
+ * computed from the horizontal subsampling factor, as done by the V4L2 video
+ * device for single-planar buffers.
+ */
+unsigned int planeSize(const StreamConfiguration &streamConfig,
+		       const PixelFormatInfo &info, unsigned int plane)
+{
+	unsigned int stride = streamConfig.stride
+			    * info.planes[plane].bytesPerGroup
+			    / info.planes[0].bytesPerGroup;
+
+	return info.planeSize(streamConfig.size.height, plane, stride);
+}
+
+} /* namespace */
+
 V4L2Camera::V4L2Camera(std::shared_ptr<Camera> camera)
 	: camera_(camera), isRunning_(false), bufferAllocator_(nullptr),
-	  efd_(-1), bufferAvailableCount_(0)
+	  bufferAvailableCount_(0), efd_(-1)
 {
 	camera_->requestCompleted.connect(this, &V4L2Camera::requestComplete);
 }
@@ -50,6 +73,7 @@ int V4L2Camera::open(StreamConfiguration *streamConfig)
 void V4L2Camera::close()
 {
 	requestPool_.clear();
+	importedBuffers_.clear();
 
 	delete bufferAllocator_;
 	bufferAllocator_ = nullptr;
@@ -59,24 +83,24 @@ void V4L2Camera::close()
 
 void V4L2Camera::bind(int efd)
 {
+	MutexLocker locker(bufferMutex_);
 	efd_ = efd;
 }
 
 void V4L2Camera::unbind()
 {
+	MutexLocker locker(bufferMutex_);
 	efd_ = -1;
 }
 
-std::vector<V4L2Camera::Buffer> V4L2Camera::completedBuffers()
+/*
+ * Retrieve the buffers completed since the last call. The vectors are swapped
+ * to reuse their storage, the caller is expected to pass an empty vector.
+ */
+void V4L2Camera::completedBuffers(std::vector<Buffer> *buffers)
 {
-	std::vector<Buffer> v;
-
-	MutexLocker lock(bufferLock_);
-	for (std::unique_ptr<Buffer> &metadata : completedBuffers_)
-		v.push_back(*metadata.get());
-	completedBuffers_.clear();
-
-	return v;
+	MutexLocker locker(bufferMutex_);
+	std::swap(*buffers, completedBuffers_);
 }
 
 void V4L2Camera::requestComplete(Request *request)
@@ -85,26 +109,47 @@ void V4L2Camera::requestComplete(Request *request)
 		return;
 
 	/* We only have one stream at the moment. */
-	bufferLock_.lock();
 	FrameBuffer *buffer = request->buffers().begin()->second;
-	std::unique_ptr<Buffer> metadata =
-		std::make_unique<Buffer>(request->cookie(), buffer->metadata());
-	completedBuffers_.push_back(std::move(metadata));
-	bufferLock_.unlock();
+	Buffer completed(request->cookie(), buffer->metadata());
 
-	uint64_t data = 1;
-	int ret = ::write(efd_, &data, sizeof(data));
-	if (ret != sizeof(data))
-		LOG(V4L2Compat, Error) << "Failed to signal eventfd POLLIN";
+	/*
+	 * Let the shared stream readers copy the frame before the buffer can
+	 * be dequeued and requeued by the application.
+	 */
+	bufferCompleted.emit(buffer);
 
+	/* Reuse the request before the application can dequeue the buffer. */
 	request->reuse();
+
 	{
 		MutexLocker locker(bufferMutex_);
-		bufferAvailableCount_++;
+		completedBuffers_.push_back(std::move(completed));
+		if (bufferAvailableCount_++ == 0)
+			signalEventfd(true);
 	}
 	bufferCV_.notify_all();
 }
 
+void V4L2Camera::consumeBuffer()
+{
+	if (--bufferAvailableCount_ == 0)
+		signalEventfd(false);
+}
+
+void V4L2Camera::signalEventfd(bool ready)
+{
+	if (efd_ < 0)
+		return;
+
+	uint64_t data = 1;
+	int ret = ready ? ::write(efd_, &data, sizeof(data))
+			: ::read(efd_, &data, sizeof(data));
+	if (ret != sizeof(data))
+		LOG(V4L2Compat, Error)
+			<< "Failed to " << (ready ? "signal" : "clear")
+			<< " eventfd POLLIN";
+}
+
 int V4L2Camera::configure(StreamConfiguration *streamConfigOut,
 			  const Size &size, const PixelFormat &pixelformat,
 			  unsigned int bufferCount)
@@ -164,6 +209,34 @@ int V4L2Camera::allocBuffers(unsigned int count)
 	if (ret < 0)
 		return ret;
 
+	ret = createRequests(count);
+	if (ret < 0) {
+		bufferAllocator_->free(stream);
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Prepare for capture in DMABUF mode. The buffers are provided by the
+ * application when queuing them, only the requests are created here.
+ */
+int V4L2Camera::importBuffers(unsigned int count)
+{
+	importedBuffers_.resize(count);
+
+	int ret = createRequests(count);
+	if (ret < 0) {
+		importedBuffers_.clear();
+		return ret;
+	}
+
+	return 0;
+}
+
+int V4L2Camera::createRequests(unsigned int count)
+{
 	for (unsigned int i = 0; i < count; i++) {
 		std::unique_ptr<Request> request = camera_->createRequest(i);
 		if (!request) {
@@ -173,7 +246,7 @@ int V4L2Camera::allocBuffers(unsigned int count)
 		requestPool_.push_back(std::move(request));
 	}
 
-	return ret;
+	return 0;
 }
 
 void V4L2Camera::freeBuffers()
@@ -181,20 +254,30 @@ void V4L2Camera::freeBuffers()
 	pendingRequests_.clear();
 	requestPool_.clear();
 
+	if (!importedBuffers_.empty()) {
+		importedBuffers_.clear();
+		return;
+	}
+
 	Stream *stream = config_->at(0).stream();
 	bufferAllocator_->free(stream);
 }
 
-int V4L2Camera::getBufferFd(unsigned int index)
+const FrameBuffer::Plane *V4L2Camera::getBufferPlane(unsigned int index,
+						     unsigned int plane)
 {
 	Stream *stream = config_->at(0).stream();
 	const std::vector<std::unique_ptr<FrameBuffer>> &buffers =
 		bufferAllocator_->buffers(stream);
 
 	if (buffers.size() <= index)
-		return -1;
+		return nullptr;
 
-	return buffers[index]->planes()[0].fd.get();
+	const std::vector<FrameBuffer::Plane> &planes = buffers[index]->planes();
+	if (planes.size() <= plane)
+		return nullptr;
+
+	return &planes[plane];
 }
 
 int V4L2Camera::streamOn()
@@ -238,6 +321,13 @@ int V4L2Camera::streamOff()
 	{
 		MutexLocker locker(bufferMutex_);
 		isRunning_ = false;
+
+		/* Buffers can't be dequeued once the stream is stopped. */
+		completedBuffers_.clear();
+		if (bufferAvailableCount_) {
+			bufferAvailableCount_ = 0;
+			signalEventfd(false);
+		}
 	}
 	bufferCV_.notify_all();
 
@@ -250,10 +340,131 @@ int V4L2Camera::qbuf(unsigned int index)
 		LOG(V4L2Compat, Error) << "Invalid index";
 		return -EINVAL;
 	}
-	Request *request = requestPool_[index].get();
 
 	Stream *stream = config_->at(0).stream();
 	FrameBuffer *buffer = bufferAllocator_->buffers(stream)[index].get();
+
+	return queueBuffer(index, buffer);
+}
+
+int V4L2Camera::qbuf(unsigned int index, const std::vector<DmabufPlane> &dmabufs)
+{
+	if (index >= requestPool_.size() || index >= importedBuffers_.size()) {
+		LOG(V4L2Compat, Error) << "Invalid index";
+		return -EINVAL;
+	}
+
+	FrameBuffer *buffer = importBuffer(index, dmabufs);
+	if (!buffer)
+		return -EINVAL;
+
+	return queueBuffer(index, buffer);
+}
+
+/*
+ * Wrap the dmabufs queued by the application in a FrameBuffer. Applications
+ * usually queue the same dmabufs at the same index for the whole capture
+ * session, the FrameBuffer is thus cached and only recreated when different
+ * dmabufs are queued. The dmabufs are identified by their inode, as the file
+ * descriptor numbers may be reused after the application closes them.
+ *
+ * A single dmabuf stores all planes contiguously, as for single-planar V4L2
+ * buffers. Otherwise, each plane is stored in its own dmabuf.
+ */
+FrameBuffer *V4L2Camera::importBuffer(unsigned int index,
+				      const std::vector<DmabufPlane> &dmabufs)
+{
+	ImportedBuffer &imported = importedBuffers_[index];
+	std::vector<ino_t> inodes;
+
+	for (const DmabufPlane &dmabuf : dmabufs) {
+		struct stat st;
+		if (fstat(dmabuf.fd, &st) < 0) {
+			LOG(V4L2Compat, Error)
+				<< "Invalid dmabuf file descriptor " << dmabuf.fd;
+			return nullptr;
+		}
+
+		inodes.push_back(st.st_ino);
+	}
+
+	if (imported.buffer && imported.inodes == inodes)
+		return imported.buffer.get();
+
+	const StreamConfiguration &streamConfig = config_->at(0);
+	const PixelFormatInfo &info = PixelFormatInfo::info(streamConfig.pixelFormat);
+	std::vector<FrameBuffer::Plane> planes;
+
+	if (dmabufs.size() == 1) {
+		SharedFD fd(dmabufs[0].fd);
+
+		if (!info.isValid() || info.numPlanes() <= 1) {
+			FrameBuffer::Plane plane;
+			plane.fd = fd;
+			plane.offset = 0;
+			plane.length = streamConfig.frameSize;
+			planes.push_back(std::move(plane));
+		} else {
+			unsigned int offset = 0;
+
+			for (unsigned int i = 0; i < info.numPlanes(); i++) {
+				FrameBuffer::Plane plane;
+				plane.fd = fd;
+				plane.offset = offset;
+				plane.length = planeSize(streamConfig, info, i);
+				offset += plane.length;
+
+				planes.push_back(std::move(plane));
+			}
+		}
+	} else if (dmabufs.size() > 1 && dmabufs.size() == info.numPlanes()) {
+		for (unsigned int i = 0; i < info.numPlanes(); i++) {
+			FrameBuffer::Plane plane;
+			plane.fd = SharedFD(dmabufs[i].fd);
+			plane.offset = 0;
+			plane.length = planeSize(streamConfig, info, i);
+
+			planes.push_back(std::move(plane));
+		}
+	} else {
+		LOG(V4L2Compat, Error)
+			<< "Invalid number of dmabufs " << dmabufs.size()
+			<< " for format " << streamConfig.pixelFormat;
+		return nullptr;
+	}
+
+	/* Check that the planes fit in their dmabuf. */
+	for (unsigned int i = 0; i < dmabufs.size(); i++) {
+		const DmabufPlane &dmabuf = dmabufs[i];
+		const FrameBuffer::Plane &last = dmabufs.size() == 1 ? planes.back()
+								     : planes[i];
+
+		off_t size = lseek(dmabuf.fd, 0, SEEK_END);
+		if (size < 0)
+			size = dmabuf.length;
+
+		if (static_cast<uint64_t>(size) < last.offset + last.length) {
+			LOG(V4L2Compat, Error)
+				<< "dmabuf " << i << " too small (" << size
+				<< " < " << last.offset + last.length << ")";
+			return nullptr;
+		}
+	}
+
+	if (!planes[0].fd.isValid())
+		return nullptr;
+
+	imported.inodes = std::move(inodes);
+	imported.buffer = std::make_unique<FrameBuffer>(planes);
+
+	return imported.buffer.get();
+}
+
+int V4L2Camera::queueBuffer(unsigned int index, FrameBuffer *buffer)
+{
+	Request *request = requestPool_[index].get();
+	Stream *stream = config_->at(0).stream();
+
 	int ret = request->addBuffer(stream, buffer);
 	if (ret < 0) {
 		LOG(V4L2Compat, Error) << "Can't set buffer for request";
@@ -281,7 +492,7 @@ void V4L2Camera::waitForBufferAvailable()
 			       return bufferAvailableCount_ >= 1 || !isRunning_;
 		       });
 	if (isRunning_)
-		bufferAvailableCount_--;
+		consumeBuffer();
 }
 
 bool V4L2Camera::isBufferAvailable()
@@ -290,7 +501,7 @@ bool V4L2Camera::isBufferAvailable()
 	if (bufferAvailableCount_ < 1)
 		return false;
 
-	bufferAvailableCount_--;
+	consumeBuffer();
 	return true;
 }
 
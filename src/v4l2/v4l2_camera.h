@@ -8,11 +8,15 @@
 #pragma once
 
 #include <deque>
+#include <memory>
+#include <sys/types.h>
 #include <utility>
+#include <vector>
 
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/semaphore.h>
 #include <libcamera/base/shared_fd.h>
+#include <libcamera/base/signal.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/framebuffer.h>
@@ -31,15 +35,21 @@ public:
 		libcamera::FrameMetadata data_;
 	};
 
+	struct DmabufPlane {
+		int fd;
+		unsigned int length;
+	};
+
 	V4L2Camera(std::shared_ptr<libcamera::Camera> camera);
 	~V4L2Camera();
 
 	int open(libcamera::StreamConfiguration *streamConfig);
 	void close();
-	void bind(int efd);
-	void unbind();
+	void bind(int efd) LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
+	void unbind() LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
 
-	std::vector<Buffer> completedBuffers() LIBCAMERA_TSA_EXCLUDES(bufferLock_);
+	void completedBuffers(std::vector<Buffer> *buffers)
+		LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
 
 	int configure(libcamera::StreamConfiguration *streamConfigOut,
 		      const libcamera::Size &size,
@@ -50,40 +60,62 @@ public:
 				  libcamera::StreamConfiguration *streamConfigOut);
 
 	int allocBuffers(unsigned int count);
+	int importBuffers(unsigned int count);
 	void freeBuffers();
-	int getBufferFd(unsigned int index);
+	const libcamera::FrameBuffer::Plane *getBufferPlane(unsigned int index,
+							    unsigned int plane);
 
 	int streamOn();
-	int streamOff();
+	int streamOff() LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
 
 	int qbuf(unsigned int index);
+	int qbuf(unsigned int index, const std::vector<DmabufPlane> &dmabufs);
 
 	void waitForBufferAvailable() LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
 	bool isBufferAvailable() LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
 
 	bool isRunning();
 
+	libcamera::Signal<libcamera::FrameBuffer *> bufferCompleted;
+
 private:
+	struct ImportedBuffer {
+		std::vector<ino_t> inodes;
+		std::unique_ptr<libcamera::FrameBuffer> buffer;
+	};
+
 	void requestComplete(libcamera::Request *request)
-		LIBCAMERA_TSA_EXCLUDES(bufferLock_);
+		LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
+	void consumeBuffer() LIBCAMERA_TSA_REQUIRES(bufferMutex_);
+	void signalEventfd(bool ready) LIBCAMERA_TSA_REQUIRES(bufferMutex_);
+
+	int createRequests(unsigned int count);
+	libcamera::FrameBuffer *importBuffer(unsigned int index,
+					     const std::vector<DmabufPlane> &dmabufs);
+	int queueBuffer(unsigned int index, libcamera::FrameBuffer *buffer);
 
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
 
 	bool isRunning_;
 
-	libcamera::Mutex bufferLock_;
 	libcamera::FrameBufferAllocator *bufferAllocator_;
 
 	std::vector<std::unique_ptr<libcamera::Request>> requestPool_;
+	std::vector<ImportedBuffer> importedBuffers_;
 
 	std::deque<libcamera::Request *> pendingRequests_;
-	std::deque<std::unique_ptr<Buffer>> completedBuffers_
-		LIBCAMERA_TSA_GUARDED_BY(bufferLock_);
-
-	int efd_;
 
+	/*
+	 * Completed buffers are queued by the camera thread and drained by the
+	 * proxy, under a single lock. The eventfd is signalled when the first
+	 * buffer becomes available for dequeuing and cleared when the last one
+	 * is dequeued, to report POLLIN precisely with one write and one read
+	 * at most per batch of buffers.
+	 */
 	libcamera::Mutex bufferMutex_;
 	libcamera::ConditionVariable bufferCV_;
+	std::vector<Buffer> completedBuffers_ LIBCAMERA_TSA_GUARDED_BY(bufferMutex_);
 	unsigned int bufferAvailableCount_ LIBCAMERA_TSA_GUARDED_BY(bufferMutex_);
+	int efd_ LIBCAMERA_TSA_GUARDED_BY(bufferMutex_);
 };
@@ -29,6 +29,7 @@
 
 #include "v4l2_camera.h"
 #include "v4l2_camera_file.h"
+#include "v4l2_camera_reader.h"
 #include "v4l2_compat_manager.h"
 
 #define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
@@ -39,10 +40,18 @@ LOG_DECLARE_CATEGORY(V4L2Compat)
 
 V4L2CameraProxy::V4L2CameraProxy(unsigned int index,
 				 std::shared_ptr<Camera> camera)
-	: refcount_(0), index_(index), bufferCount_(0), currentBuf_(0),
-	  vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr)
+	: refcount_(0), index_(index), bufferCount_(0),
+	  memory_(V4L2_MEMORY_MMAP), bufferType_(V4L2_BUF_TYPE_VIDEO_CAPTURE),
+	  numPlanes_(1),
+	  vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr),
+	  cacheMappings_(true)
 {
 	querycap(camera);
+
+	const char *shared = utils::secure_getenv("LIBCAMERA_V4L2_COMPAT_SHARED_STREAM");
+	sharedStream_ = shared && shared[0] != '\0';
+
+	vcam_->bufferCompleted.connect(this, &V4L2CameraProxy::bufferCompleted);
 }
 
 int V4L2CameraProxy::open(V4L2CameraFile *file)
@@ -73,6 +82,7 @@ int V4L2CameraProxy::open(V4L2CameraFile *file)
 		return ret;
 	}
 
+	numPlanes_ = defaultMemoryPlanes(streamConfig_.pixelFormat);
 	setFmtFromConfig(streamConfig_);
 
 	files_.insert(file);
@@ -89,6 +99,15 @@ void V4L2CameraProxy::close(V4L2CameraFile *file)
 
 	files_.erase(file);
 
+	/* Wake up threads blocked in dqbuf on the reader before freeing it. */
+	auto reader = readers_.find(file);
+	if (reader != readers_.end()) {
+		reader->second->streamOff();
+
+		MutexLocker readersLocker(readersMutex_);
+		readers_.erase(reader);
+	}
+
 	release(file);
 
 	if (--refcount_ > 0)
@@ -119,28 +138,62 @@ void *V4L2CameraProxy::mmap(V4L2CameraFile *file, void *addr, size_t length,
 		return MAP_FAILED;
 	}
 
-	unsigned int index = offset / sizeimage_;
-	if (static_cast<off_t>(index * sizeimage_) != offset ||
-	    length != sizeimage_) {
+	auto reader = readers_.find(file);
+	if (reader != readers_.end())
+		return reader->second->mmap(addr, length, prot, flags, offset);
+
+	if (memory_ != V4L2_MEMORY_MMAP) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	unsigned int index;
+	unsigned int plane;
+	if (!findPlane(offset, length, &index, &plane)) {
 		errno = EINVAL;
 		return MAP_FAILED;
 	}
 
-	int fd = vcam_->getBufferFd(index);
-	if (fd < 0) {
+	/*
+	 * Memory planes map to the FrameBuffer planes when the format has
+	 * multiple memory planes, otherwise all planes are stored contiguously
+	 * starting at the first one.
+	 */
+	const FrameBuffer::Plane *bufferPlane =
+		vcam_->getBufferPlane(index, numPlanes_ > 1 ? plane : 0);
+	if (!bufferPlane || !bufferPlane->fd.isValid()) {
 		errno = EINVAL;
 		return MAP_FAILED;
 	}
 
-	void *map = V4L2CompatManager::instance()->fops().mmap(addr, length, prot,
-							       flags, fd, 0);
+	/*
+	 * The planes of a FrameBuffer may start at any offset in their dmabuf,
+	 * while mmap() requires page-aligned offsets. Map from the start of
+	 * the page and return a pointer to the beginning of the plane. This
+	 * can't be done for fixed mappings.
+	 */
+	static const long pageSize = sysconf(_SC_PAGESIZE);
+	off_t mapOffset = bufferPlane->offset & ~(pageSize - 1);
+	size_t delta = bufferPlane->offset - mapOffset;
+
+	if (delta && (flags & MAP_FIXED)) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	void *map = V4L2CompatManager::instance()->fops().mmap(addr, length + delta,
+							       prot, flags,
+							       bufferPlane->fd.get(),
+							       mapOffset);
 	if (map == MAP_FAILED)
 		return map;
 
+	void *data = static_cast<uint8_t *>(map) + delta;
+
 	buffers_[index].flags |= V4L2_BUF_FLAG_MAPPED;
-	mmaps_[map] = index;
+	mmaps_[data] = { index, map, length + delta, length };
 
-	return map;
+	return data;
 }
 
 int V4L2CameraProxy::munmap(V4L2CameraFile *file, void *addr, size_t length)
@@ -150,17 +203,23 @@ int V4L2CameraProxy::munmap(V4L2CameraFile *file, void *addr, size_t length)
 
 	MutexLocker locker(proxyMutex_);
 
+	auto reader = readers_.find(file);
+	if (reader != readers_.end())
+		return reader->second->munmap(addr, length);
+
 	auto iter = mmaps_.find(addr);
-	if (iter == mmaps_.end() || length != sizeimage_) {
+	if (iter == mmaps_.end() || length != iter->second.length) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (V4L2CompatManager::instance()->fops().munmap(addr, length))
+	const Mapping &mapping = iter->second;
+
+	if (V4L2CompatManager::instance()->fops().munmap(mapping.base, mapping.size))
 		LOG(V4L2Compat, Error) << "Failed to unmap " << addr
 				       << " with length " << length;
 
-	buffers_[iter->second].flags &= ~V4L2_BUF_FLAG_MAPPED;
+	buffers_[mapping.index].flags &= ~V4L2_BUF_FLAG_MAPPED;
 	mmaps_.erase(iter);
 
 	return 0;
@@ -168,12 +227,93 @@ int V4L2CameraProxy::munmap(V4L2CameraFile *file, void *addr, size_t length)
 
 bool V4L2CameraProxy::validateBufferType(uint32_t type)
 {
-	return type == V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	return type == V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	       type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 }
 
 bool V4L2CameraProxy::validateMemoryType(uint32_t memory)
 {
-	return memory == V4L2_MEMORY_MMAP;
+	return memory == V4L2_MEMORY_MMAP || memory == V4L2_MEMORY_DMABUF;
+}
+
+/*
+ * The multi-planar API passes the planes in an array provided by the
+ * application, which must be large enough to hold all memory planes.
+ */
+bool V4L2CameraProxy::validatePlanes(const struct v4l2_buffer *arg)
+{
+	if (bufferType_ != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		return true;
+
+	return arg->m.planes && arg->length >= numPlanes_;
+}
+
+/*
+ * Return the number of memory planes of a V4L2 format. libcamera pixel formats
+ * map to a contiguous V4L2 format (e.g. NV12) and optionally to a
+ * non-contiguous one with one memory plane per colour plane (e.g. NV12M).
+ */
+unsigned int V4L2CameraProxy::memoryPlanes(const PixelFormat &pixelFormat,
+					   uint32_t fourcc)
+{
+	const std::vector<V4L2PixelFormat> &v4l2Formats =
+		V4L2PixelFormat::fromPixelFormat(pixelFormat);
+
+	if (v4l2Formats.size() > 1 && V4L2PixelFormat(fourcc) == v4l2Formats[0])
+		return 1;
+
+	return std::max(PixelFormatInfo::info(pixelFormat).numPlanes(), 1U);
+}
+
+/*
+ * Formats default to their non-contiguous variant with the multi-planar API,
+ * to map the FrameBuffer planes directly to memory planes.
+ */
+unsigned int V4L2CameraProxy::defaultMemoryPlanes(const PixelFormat &pixelFormat)
+{
+	return memoryPlanes(pixelFormat,
+			    V4L2PixelFormat::fromPixelFormat(pixelFormat).back());
+}
+
+void V4L2CameraProxy::fillMplaneFormat(const StreamConfiguration &streamConfig,
+				       unsigned int numPlanes,
+				       struct v4l2_pix_format_mplane *fmt)
+{
+	const std::vector<V4L2PixelFormat> &v4l2Formats =
+		V4L2PixelFormat::fromPixelFormat(streamConfig.pixelFormat);
+	const PixelFormatInfo &info = PixelFormatInfo::info(streamConfig.pixelFormat);
+
+	memset(fmt, 0, sizeof(*fmt));
+
+	fmt->width        = streamConfig.size.width;
+	fmt->height       = streamConfig.size.height;
+	fmt->pixelformat  = numPlanes > 1 ? v4l2Formats.back() : v4l2Formats[0];
+	fmt->field        = V4L2_FIELD_NONE;
+	fmt->colorspace   = V4L2_COLORSPACE_SRGB;
+	fmt->num_planes   = numPlanes;
+	fmt->ycbcr_enc    = V4L2_YCBCR_ENC_DEFAULT;
+	fmt->quantization = V4L2_QUANTIZATION_DEFAULT;
+	fmt->xfer_func    = V4L2_XFER_FUNC_DEFAULT;
+
+	if (numPlanes == 1) {
+		fmt->plane_fmt[0].bytesperline = streamConfig.stride;
+		fmt->plane_fmt[0].sizeimage = streamConfig.frameSize;
+		return;
+	}
+
+	/*
+	 * The stride is reported for the first plane only, compute the stride
+	 * of the other planes from the horizontal subsampling factor.
+	 */
+	for (unsigned int i = 0; i < numPlanes; i++) {
+		unsigned int stride = streamConfig.stride
+				    * info.planes[i].bytesPerGroup
+				    / info.planes[0].bytesPerGroup;
+
+		fmt->plane_fmt[i].bytesperline = stride;
+		fmt->plane_fmt[i].sizeimage =
+			info.planeSize(streamConfig.size.height, i, stride);
+	}
 }
 
 void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
@@ -193,6 +333,8 @@ void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
 	v4l2PixFormat_.xfer_func    = V4L2_XFER_FUNC_DEFAULT;
 
 	sizeimage_ = streamConfig.frameSize;
+
+	fillMplaneFormat(streamConfig, numPlanes_, &v4l2PixFormatMplane_);
 }
 
 void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
@@ -209,6 +351,7 @@ void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
 	/* \todo Put this in a header/config somewhere. */
 	capabilities_.version = KERNEL_VERSION(5, 2, 0);
 	capabilities_.device_caps = V4L2_CAP_VIDEO_CAPTURE
+				  | V4L2_CAP_VIDEO_CAPTURE_MPLANE
 				  | V4L2_CAP_STREAMING
 				  | V4L2_CAP_EXT_PIX_FORMAT;
 	capabilities_.capabilities = capabilities_.device_caps
@@ -218,11 +361,15 @@ void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
 
 void V4L2CameraProxy::updateBuffers()
 {
-	std::vector<V4L2Camera::Buffer> completedBuffers = vcam_->completedBuffers();
-	for (const V4L2Camera::Buffer &buffer : completedBuffers) {
+	completedBuffers_.clear();
+	vcam_->completedBuffers(&completedBuffers_);
+
+	for (const V4L2Camera::Buffer &buffer : completedBuffers_) {
 		const FrameMetadata &fmd = buffer.data_;
 		struct v4l2_buffer &buf = buffers_[buffer.index_];
 
+		doneBuffers_.push_back(buffer.index_);
+
 		switch (fmd.status) {
 		case FrameMetadata::FrameSuccess:
 			buf.bytesused = std::accumulate(fmd.planes().begin(),
@@ -236,6 +383,20 @@ void V4L2CameraProxy::updateBuffers()
 			buf.sequence = fmd.sequence;
 
 			buf.flags |= V4L2_BUF_FLAG_DONE;
+
+			if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+				std::vector<struct v4l2_plane> &planes = planes_[buffer.index_];
+
+				if (numPlanes_ == 1) {
+					planes[0].bytesused = buf.bytesused;
+					break;
+				}
+
+				unsigned int count = std::min<unsigned int>(numPlanes_,
+									    fmd.planes().size());
+				for (unsigned int i = 0; i < count; i++)
+					planes[i].bytesused = fmd.planes()[i].bytesused;
+			}
 			break;
 		case FrameMetadata::FrameError:
 			buf.flags |= V4L2_BUF_FLAG_ERROR;
@@ -290,7 +451,11 @@ int V4L2CameraProxy::vidioc_enum_fmt(V4L2CameraFile *file, struct v4l2_fmtdesc *
 		return -EINVAL;
 
 	PixelFormat format = streamConfig_.formats().pixelformats()[arg->index];
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat::fromPixelFormat(format)[0];
+	const std::vector<V4L2PixelFormat> &v4l2Formats =
+		V4L2PixelFormat::fromPixelFormat(format);
+	bool multiPlanar = arg->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE &&
+			   defaultMemoryPlanes(format) > 1;
+	V4L2PixelFormat v4l2Format = multiPlanar ? v4l2Formats.back() : v4l2Formats[0];
 
 	arg->flags = format == formats::MJPEG ? V4L2_FMT_FLAG_COMPRESSED : 0;
 	utils::strlcpy(reinterpret_cast<char *>(arg->description),
@@ -311,16 +476,24 @@ int V4L2CameraProxy::vidioc_g_fmt(V4L2CameraFile *file, struct v4l2_format *arg)
 		return -EINVAL;
 
 	memset(&arg->fmt, 0, sizeof(arg->fmt));
-	arg->fmt.pix = v4l2PixFormat_;
+	if (arg->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		arg->fmt.pix_mp = v4l2PixFormatMplane_;
+	else
+		arg->fmt.pix = v4l2PixFormat_;
 
 	return 0;
 }
 
 int V4L2CameraProxy::tryFormat(struct v4l2_format *arg)
 {
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat(arg->fmt.pix.pixelformat);
+	bool multiPlanar = arg->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	V4L2PixelFormat v4l2Format = V4L2PixelFormat(multiPlanar
+						     ? arg->fmt.pix_mp.pixelformat
+						     : arg->fmt.pix.pixelformat);
 	PixelFormat format = v4l2Format.toPixelFormat();
-	Size size(arg->fmt.pix.width, arg->fmt.pix.height);
+	Size size = multiPlanar
+		  ? Size(arg->fmt.pix_mp.width, arg->fmt.pix_mp.height)
+		  : Size(arg->fmt.pix.width, arg->fmt.pix.height);
 
 	StreamConfiguration config;
 	int ret = vcam_->validateConfiguration(format, size, &config);
@@ -331,6 +504,12 @@ int V4L2CameraProxy::tryFormat(struct v4l2_format *arg)
 		return -EINVAL;
 	}
 
+	if (multiPlanar) {
+		fillMplaneFormat(config, memoryPlanes(config.pixelFormat, v4l2Format),
+				 &arg->fmt.pix_mp);
+		return 0;
+	}
+
 	arg->fmt.pix.width        = config.size.width;
 	arg->fmt.pix.height       = config.size.height;
 	arg->fmt.pix.pixelformat  = V4L2PixelFormat::fromPixelFormat(config.pixelFormat)[0];
@@ -365,13 +544,22 @@ int V4L2CameraProxy::vidioc_s_fmt(V4L2CameraFile *file, struct v4l2_format *arg)
 	if (ret < 0)
 		return ret;
 
-	Size size(arg->fmt.pix.width, arg->fmt.pix.height);
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat(arg->fmt.pix.pixelformat);
+	bool multiPlanar = arg->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	V4L2PixelFormat v4l2Format = V4L2PixelFormat(multiPlanar
+						     ? arg->fmt.pix_mp.pixelformat
+						     : arg->fmt.pix.pixelformat);
+	Size size = multiPlanar
+		  ? Size(arg->fmt.pix_mp.width, arg->fmt.pix_mp.height)
+		  : Size(arg->fmt.pix.width, arg->fmt.pix.height);
 	ret = vcam_->configure(&streamConfig_, size, v4l2Format.toPixelFormat(),
 			       bufferCount_);
 	if (ret < 0)
 		return -EINVAL;
 
+	bufferType_ = static_cast<enum v4l2_buf_type>(arg->type);
+	numPlanes_ = multiPlanar
+		   ? memoryPlanes(streamConfig_.pixelFormat, v4l2Format)
+		   : defaultMemoryPlanes(streamConfig_.pixelFormat);
 	setFmtFromConfig(streamConfig_);
 
 	return 0;
@@ -468,11 +656,65 @@ int V4L2CameraProxy::vidioc_s_input(V4L2CameraFile *file, int *arg)
 
 void V4L2CameraProxy::freeBuffers()
 {
+	{
+		MutexLocker readersLocker(readersMutex_);
+		mappedBuffers_.clear();
+	}
+
 	vcam_->freeBuffers();
 	buffers_.clear();
+	planes_.clear();
+	doneBuffers_.clear();
 	bufferCount_ = 0;
 }
 
+/*
+ * Copy the state of a buffer to the application. With the multi-planar API,
+ * the planes are copied to the array provided by the application, which has
+ * been validated with validatePlanes().
+ */
+void V4L2CameraProxy::copyBuffer(unsigned int index, struct v4l2_buffer *arg)
+{
+	if (bufferType_ != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		*arg = buffers_[index];
+		return;
+	}
+
+	struct v4l2_plane *planes = arg->m.planes;
+
+	*arg = buffers_[index];
+	arg->m.planes = planes;
+	std::copy(planes_[index].begin(), planes_[index].end(), planes);
+}
+
+bool V4L2CameraProxy::findPlane(off64_t offset, size_t length,
+				unsigned int *index, unsigned int *plane)
+{
+	for (unsigned int i = 0; i < bufferCount_; i++) {
+		if (bufferType_ != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+			if (static_cast<off64_t>(buffers_[i].m.offset) != offset ||
+			    buffers_[i].length != length)
+				continue;
+
+			*index = i;
+			*plane = 0;
+			return true;
+		}
+
+		for (unsigned int j = 0; j < numPlanes_; j++) {
+			if (static_cast<off64_t>(planes_[i][j].m.mem_offset) != offset ||
+			    planes_[i][j].length != length)
+				continue;
+
+			*index = i;
+			*plane = j;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuffers *arg)
 {
 	LOG(V4L2Compat, Debug)
@@ -490,7 +732,8 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	if (!hasOwnership(file) && owner_)
 		return -EBUSY;
 
-	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP
+			  | V4L2_BUF_CAP_SUPPORTS_DMABUF;
 	arg->flags = 0;
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
@@ -523,25 +766,97 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	arg->count = streamConfig_.bufferCount;
 	bufferCount_ = arg->count;
 
-	ret = vcam_->allocBuffers(arg->count);
+	memory_ = static_cast<enum v4l2_memory>(arg->memory);
+
+	{
+		/*
+		 * Imported FrameBuffer instances are recreated when the
+		 * application queues a different dmabuf, their mappings can't
+		 * be cached by address.
+		 */
+		MutexLocker readersLocker(readersMutex_);
+		cacheMappings_ = memory_ == V4L2_MEMORY_MMAP;
+	}
+
+	if (memory_ == V4L2_MEMORY_DMABUF)
+		ret = vcam_->importBuffers(arg->count);
+	else
+		ret = vcam_->allocBuffers(arg->count);
 	if (ret < 0) {
 		arg->count = 0;
+		bufferCount_ = 0;
 		return ret;
 	}
 
+	bufferType_ = static_cast<enum v4l2_buf_type>(arg->type);
+
+	/*
+	 * Memory planes are mapped to the FrameBuffer planes, which requires
+	 * the allocated buffers to have one plane per colour plane.
+	 */
+	if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE &&
+	    memory_ == V4L2_MEMORY_MMAP && numPlanes_ > 1) {
+		for (unsigned int i = 0; i < arg->count; i++) {
+			if (vcam_->getBufferPlane(i, numPlanes_ - 1))
+				continue;
+
+			LOG(V4L2Compat, Error)
+				<< "Buffers don't support " << numPlanes_
+				<< " memory planes";
+			freeBuffers();
+			arg->count = 0;
+			return -EINVAL;
+		}
+	}
+
 	buffers_.resize(arg->count);
 	for (unsigned int i = 0; i < arg->count; i++) {
 		struct v4l2_buffer buf = {};
-		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.length = v4l2PixFormat_.sizeimage;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.m.offset = i * v4l2PixFormat_.sizeimage;
+		buf.type = bufferType_;
+		buf.memory = memory_;
 		buf.index = i;
 		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
 
+		if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+			buf.length = v4l2PixFormat_.sizeimage;
+			if (memory_ == V4L2_MEMORY_DMABUF)
+				buf.m.fd = -1;
+			else
+				buf.m.offset = i * v4l2PixFormat_.sizeimage;
+		} else {
+			buf.length = numPlanes_;
+		}
+
 		buffers_[i] = buf;
 	}
 
+	/*
+	 * Assign page-aligned offsets to the memory planes of all buffers, to
+	 * identify them in mmap() calls.
+	 */
+	if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		static const long pageSize = sysconf(_SC_PAGESIZE);
+		uint32_t offset = 0;
+
+		planes_.resize(arg->count);
+		for (std::vector<struct v4l2_plane> &planes : planes_) {
+			planes.resize(numPlanes_);
+
+			for (unsigned int i = 0; i < numPlanes_; i++) {
+				struct v4l2_plane &plane = planes[i];
+
+				plane = {};
+				plane.length = v4l2PixFormatMplane_.plane_fmt[i].sizeimage;
+				if (memory_ == V4L2_MEMORY_DMABUF) {
+					plane.m.fd = -1;
+				} else {
+					plane.m.mem_offset = offset;
+					offset += utils::alignUp(plane.length, pageSize);
+				}
+			}
+		}
+	}
+
 	LOG(V4L2Compat, Debug) << "Allocated " << arg->count << " buffers";
 
 	acquire(file);
@@ -557,13 +872,12 @@ int V4L2CameraProxy::vidioc_querybuf(V4L2CameraFile *file, struct v4l2_buffer *a
 	if (arg->index >= bufferCount_)
 		return -EINVAL;
 
-	if (!validateBufferType(arg->type) ||
-	    arg->index >= bufferCount_)
+	if (arg->type != bufferType_ || !validatePlanes(arg))
 		return -EINVAL;
 
 	updateBuffers();
 
-	*arg = buffers_[arg->index];
+	copyBuffer(arg->index, arg);
 
 	return 0;
 }
@@ -583,8 +897,7 @@ int V4L2CameraProxy::vidioc_prepare_buf(V4L2CameraFile *file, struct v4l2_buffer
 	if (arg->flags & V4L2_BUF_FLAG_REQUEST_FD)
 		return -EINVAL;
 
-	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	if (arg->type != bufferType_ || arg->memory != memory_)
 		return -EINVAL;
 
 	struct v4l2_buffer &buffer = buffers_[arg->index];
@@ -615,18 +928,43 @@ int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 	if (!hasOwnership(file))
 		return -EBUSY;
 
-	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory) ||
-	    arg->index >= bufferCount_)
+	if (arg->type != bufferType_ || arg->memory != memory_ ||
+	    !validatePlanes(arg))
 		return -EINVAL;
 
-	int ret = vcam_->qbuf(arg->index);
-	if (ret < 0)
-		return ret;
+	struct v4l2_buffer &buffer = buffers_[arg->index];
+	int ret;
+
+	if (memory_ == V4L2_MEMORY_DMABUF) {
+		std::vector<V4L2Camera::DmabufPlane> dmabufs;
+
+		if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+			for (unsigned int i = 0; i < numPlanes_; i++)
+				dmabufs.push_back({ arg->m.planes[i].m.fd,
+						    arg->m.planes[i].length });
+		} else {
+			dmabufs.push_back({ arg->m.fd, arg->length });
+		}
 
-	buffers_[arg->index].flags |= V4L2_BUF_FLAG_QUEUED;
+		ret = vcam_->qbuf(arg->index, dmabufs);
+		if (ret < 0)
+			return ret;
 
-	arg->flags = buffers_[arg->index].flags;
+		if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+			for (unsigned int i = 0; i < numPlanes_; i++)
+				planes_[arg->index][i].m.fd = arg->m.planes[i].m.fd;
+		} else {
+			buffer.m.fd = arg->m.fd;
+		}
+	} else {
+		ret = vcam_->qbuf(arg->index);
+		if (ret < 0)
+			return ret;
+	}
+
+	buffer.flags |= V4L2_BUF_FLAG_QUEUED;
+
+	arg->flags = buffer.flags;
 
 	return ret;
 }
@@ -646,8 +984,8 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 	if (!vcam_->isRunning())
 		return -EINVAL;
 
-	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	if (arg->type != bufferType_ || arg->memory != memory_ ||
+	    !validatePlanes(arg))
 		return -EINVAL;
 
 	if (!file->nonBlocking()) {
@@ -666,18 +1004,22 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 
 	updateBuffers();
 
-	struct v4l2_buffer &buf = buffers_[currentBuf_];
+	/*
+	 * Buffers are dequeued in completion order, which may differ from the
+	 * queuing order when the application requeues buffers out of order.
+	 */
+	if (doneBuffers_.empty())
+		return -EINVAL;
 
-	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_PREPARED);
-	buf.length = sizeimage_;
-	*arg = buf;
+	unsigned int index = doneBuffers_.front();
+	doneBuffers_.pop_front();
 
-	currentBuf_ = (currentBuf_ + 1) % bufferCount_;
+	struct v4l2_buffer &buf = buffers_[index];
 
-	uint64_t data;
-	int ret = ::read(file->efd(), &data, sizeof(data));
-	if (ret != sizeof(data))
-		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_PREPARED);
+	if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		buf.length = sizeimage_;
+	copyBuffer(index, arg);
 
 	return 0;
 }
@@ -690,21 +1032,59 @@ int V4L2CameraProxy::vidioc_expbuf(V4L2CameraFile *file, struct v4l2_exportbuffe
 	if (!hasOwnership(file))
 		return -EBUSY;
 
-	/* \todo Verify that the memory type is MMAP when adding DMABUF support */
-	if (!validateBufferType(arg->type))
+	if (arg->type != bufferType_ || memory_ != V4L2_MEMORY_MMAP)
 		return -EINVAL;
 
 	if (arg->index >= bufferCount_)
 		return -EINVAL;
 
+	unsigned int plane = 0;
+	if (bufferType_ == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		if (arg->plane >= numPlanes_)
+			return -EINVAL;
+		if (numPlanes_ > 1)
+			plane = arg->plane;
+	}
+
 	if (arg->flags & ~(O_CLOEXEC | O_ACCMODE))
 		return -EINVAL;
 
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
-	/* \todo honor the O_ACCMODE flags passed to this function */
-	arg->fd = fcntl(vcam_->getBufferFd(arg->index),
-			arg->flags & O_CLOEXEC ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+	const FrameBuffer::Plane *bufferPlane = vcam_->getBufferPlane(arg->index, plane);
+	if (!bufferPlane || !bufferPlane->fd.isValid())
+		return -EINVAL;
+
+	int fd = bufferPlane->fd.get();
+
+	/*
+	 * The access mode of a dmabuf is fixed when the buffer is exported by
+	 * the kernel, and is shared by all duplicates of its file descriptor.
+	 * Reject requests for an access mode that the buffer doesn't grant,
+	 * as mapping the exported file descriptor would otherwise fail later
+	 * in a way that is much harder to diagnose.
+	 *
+	 * \todo Export buffers with the requested access mode instead of
+	 * duplicating the file descriptor when they are more permissive
+	 */
+	int bufferMode = fcntl(fd, F_GETFL);
+	if (bufferMode < 0)
+		return -errno;
+
+	int accessMode = arg->flags & O_ACCMODE;
+	bufferMode &= O_ACCMODE;
+	if (accessMode != bufferMode && bufferMode != O_RDWR) {
+		LOG(V4L2Compat, Debug)
+			<< "Buffer " << arg->index
+			<< " doesn't allow access mode " << accessMode;
+		return -EACCES;
+	}
+
+	int ret = fcntl(fd, arg->flags & O_CLOEXEC ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+	if (ret < 0)
+		return -errno;
+
+	arg->fd = ret;
 
 	return 0;
 }
@@ -717,7 +1097,7 @@ int V4L2CameraProxy::vidioc_streamon(V4L2CameraFile *file, int *arg)
 	if (bufferCount_ == 0)
 		return -EINVAL;
 
-	if (!validateBufferType(*arg))
+	if (static_cast<uint32_t>(*arg) != bufferType_)
 		return -EINVAL;
 
 	if (file->priority() < maxPriority())
@@ -729,8 +1109,6 @@ int V4L2CameraProxy::vidioc_streamon(V4L2CameraFile *file, int *arg)
 	if (vcam_->isRunning())
 		return 0;
 
-	currentBuf_ = 0;
-
 	return vcam_->streamOn();
 }
 
@@ -739,7 +1117,8 @@ int V4L2CameraProxy::vidioc_streamoff(V4L2CameraFile *file, int *arg)
 	LOG(V4L2Compat, Debug)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
-	if (!validateBufferType(*arg))
+	if (!validateBufferType(*arg) ||
+	    (bufferCount_ && static_cast<uint32_t>(*arg) != bufferType_))
 		return -EINVAL;
 
 	if (file->priority() < maxPriority())
@@ -750,6 +1129,8 @@ int V4L2CameraProxy::vidioc_streamoff(V4L2CameraFile *file, int *arg)
 
 	int ret = vcam_->streamOff();
 
+	doneBuffers_.clear();
+
 	for (struct v4l2_buffer &buf : buffers_)
 		buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
 
@@ -808,6 +1189,17 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long longRequest, void
 	}
 
 	int ret;
+
+	if (isReader(file, request)) {
+		ret = readerIoctl(file, request, arg, &proxyMutex_);
+		if (ret < 0) {
+			errno = -ret;
+			return -1;
+		}
+
+		return ret;
+	}
+
 	switch (request) {
 	case VIDIOC_QUERYCAP:
 		ret = vidioc_querycap(file, static_cast<struct v4l2_capability *>(arg));
@@ -916,3 +1308,171 @@ void V4L2CameraProxy::release(V4L2CameraFile *file)
 
 	owner_ = nullptr;
 }
+
+/*
+ * Buffer ioctls are handled by the reader of the file once it has been
+ * created. Readers are created by reqbufs calls from files that don't own the
+ * camera while another file does, when the shared stream mode is enabled.
+ */
+bool V4L2CameraProxy::isReader(V4L2CameraFile *file, unsigned int request)
+{
+	switch (request) {
+	case VIDIOC_REQBUFS:
+	case VIDIOC_QUERYBUF:
+	case VIDIOC_PREPARE_BUF:
+	case VIDIOC_QBUF:
+	case VIDIOC_DQBUF:
+	case VIDIOC_EXPBUF:
+	case VIDIOC_STREAMON:
+	case VIDIOC_STREAMOFF:
+		break;
+	default:
+		return false;
+	}
+
+	if (readers_.find(file) != readers_.end())
+		return true;
+
+	return sharedStream_ && request == VIDIOC_REQBUFS &&
+	       owner_ && owner_ != file;
+}
+
+int V4L2CameraProxy::readerIoctl(V4L2CameraFile *file, unsigned int request,
+				 void *arg, Mutex *lock)
+{
+	LOG(V4L2Compat, Debug)
+		<< "[" << file->description() << "] " << __func__
+		<< "(request=" << utils::hex(request) << ")";
+
+	auto iter = readers_.find(file);
+	std::shared_ptr<V4L2CameraReader> reader =
+		iter != readers_.end() ? iter->second : nullptr;
+
+	switch (request) {
+	case VIDIOC_REQBUFS: {
+		struct v4l2_requestbuffers *reqbufs =
+			static_cast<struct v4l2_requestbuffers *>(arg);
+
+		/* Readers receive frames in the single-planar MMAP format. */
+		if (reqbufs->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+		    reqbufs->memory != V4L2_MEMORY_MMAP)
+			return -EINVAL;
+
+		reqbufs->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+		reqbufs->flags = 0;
+		memset(reqbufs->reserved, 0, sizeof(reqbufs->reserved));
+
+		if (reqbufs->count == 0) {
+			if (!reader)
+				return 0;
+			if (reader->isMapped())
+				return -EBUSY;
+
+			MutexLocker readersLocker(readersMutex_);
+			readers_.erase(file);
+
+			return 0;
+		}
+
+		bool created = !reader;
+		if (created)
+			reader = std::make_shared<V4L2CameraReader>(file);
+
+		int ret = reader->allocate(reqbufs->count, sizeimage_);
+		if (ret <= 0) {
+			reqbufs->count = 0;
+			return ret < 0 ? ret : -ENOMEM;
+		}
+
+		reqbufs->count = ret;
+
+		if (created) {
+			MutexLocker readersLocker(readersMutex_);
+			readers_[file] = reader;
+		}
+
+		LOG(V4L2Compat, Debug)
+			<< "[" << file->description() << "] Sharing stream with "
+			<< reqbufs->count << " buffers";
+
+		return 0;
+	}
+
+	case VIDIOC_QUERYBUF:
+		return reader->querybuf(static_cast<struct v4l2_buffer *>(arg));
+
+	case VIDIOC_QBUF:
+		return reader->qbuf(static_cast<struct v4l2_buffer *>(arg));
+
+	case VIDIOC_DQBUF:
+		/*
+		 * The reader is kept alive by the local reference if the file
+		 * is closed by another thread while waiting.
+		 */
+		if (!file->nonBlocking()) {
+			lock->unlock();
+			reader->waitForBuffer();
+			lock->lock();
+		}
+
+		return reader->dqbuf(static_cast<struct v4l2_buffer *>(arg));
+
+	case VIDIOC_STREAMON:
+		if (*static_cast<int *>(arg) != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+			return -EINVAL;
+
+		return reader->streamOn();
+
+	case VIDIOC_STREAMOFF:
+		if (*static_cast<int *>(arg) != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+			return -EINVAL;
+
+		return reader->streamOff();
+
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Fan out the frames captured by the owner to the readers. This is called
+ * from the camera thread before the buffer can be dequeued by the owner.
+ */
+void V4L2CameraProxy::bufferCompleted(FrameBuffer *buffer)
+{
+	MutexLocker locker(readersMutex_);
+
+	if (readers_.empty() ||
+	    buffer->metadata().status != FrameMetadata::FrameSuccess)
+		return;
+
+	std::unique_ptr<MappedFrameBuffer> mapping;
+	MappedFrameBuffer *mapped;
+
+	if (cacheMappings_) {
+		std::unique_ptr<MappedFrameBuffer> &cached = mappedBuffers_[buffer];
+		if (!cached)
+			cached = std::make_unique<MappedFrameBuffer>(buffer,
+								     MappedFrameBuffer::MapFlag::Read |
+								     MappedFrameBuffer::MapFlag::ExplicitAccess);
+		mapped = cached.get();
+	} else {
+		mapping = std::make_unique<MappedFrameBuffer>(buffer,
+							      MappedFrameBuffer::MapFlag::Read);
+		mapped = mapping.get();
+	}
+
+	if (!mapped->isValid()) {
+		LOG(V4L2Compat, Error) << "Failed to map buffer for readers";
+		return;
+	}
+
+	/* Cached mappings outlive the frame, bracket the CPU access explicitly. */
+	if (!mapped->accessing())
+		mapped->beginAccess(MappedFrameBuffer::MapFlag::Read);
+
+	for (const auto &[file, reader] : readers_)
+		reader->deliver(mapped->planes(), buffer->metadata());
+
+	mapped->endAccess();
+}
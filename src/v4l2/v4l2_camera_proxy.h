@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <deque>
 #include <linux/videodev2.h>
 #include <map>
 #include <memory>
@@ -17,10 +18,14 @@
 #include <libcamera/base/mutex.h>
 
 #include <libcamera/camera.h>
+#include <libcamera/pixel_format.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
 
 #include "v4l2_camera.h"
 
 class V4L2CameraFile;
+class V4L2CameraReader;
 
 class V4L2CameraProxy
 {
@@ -38,14 +43,31 @@ public:
 		LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
 
 private:
+	struct Mapping {
+		unsigned int index;
+		void *base;
+		size_t size;
+		size_t length;
+	};
+
 	bool validateBufferType(uint32_t type);
 	bool validateMemoryType(uint32_t memory);
+	bool validatePlanes(const struct v4l2_buffer *arg);
+	static unsigned int memoryPlanes(const libcamera::PixelFormat &pixelFormat,
+					 uint32_t fourcc);
+	static unsigned int defaultMemoryPlanes(const libcamera::PixelFormat &pixelFormat);
+	static void fillMplaneFormat(const libcamera::StreamConfiguration &streamConfig,
+				     unsigned int numPlanes,
+				     struct v4l2_pix_format_mplane *fmt);
 	void setFmtFromConfig(const libcamera::StreamConfiguration &streamConfig);
 	void querycap(std::shared_ptr<libcamera::Camera> camera);
 	int tryFormat(struct v4l2_format *arg);
 	enum v4l2_priority maxPriority();
 	void updateBuffers();
 	void freeBuffers();
+	void copyBuffer(unsigned int index, struct v4l2_buffer *arg);
+	bool findPlane(off64_t offset, size_t length, unsigned int *index,
+		       unsigned int *plane);
 
 	int vidioc_querycap(V4L2CameraFile *file, struct v4l2_capability *arg);
 	int vidioc_enum_framesizes(V4L2CameraFile *file, struct v4l2_frmsizeenum *arg);
@@ -72,6 +94,12 @@ private:
 	int acquire(V4L2CameraFile *file);
 	void release(V4L2CameraFile *file);
 
+	bool isReader(V4L2CameraFile *file, unsigned int request);
+	int readerIoctl(V4L2CameraFile *file, unsigned int request, void *arg,
+			libcamera::Mutex *lock) LIBCAMERA_TSA_REQUIRES(*lock);
+	void bufferCompleted(libcamera::FrameBuffer *buffer)
+		LIBCAMERA_TSA_EXCLUDES(readersMutex_);
+
 	static const std::set<unsigned long> supportedIoctls_;
 
 	unsigned int refcount_;
@@ -79,14 +107,27 @@ private:
 
 	libcamera::StreamConfiguration streamConfig_;
 	unsigned int bufferCount_;
-	unsigned int currentBuf_;
+	enum v4l2_memory memory_;
 	unsigned int sizeimage_;
 
+	/*
+	 * The buffer type selected by the last call to s_fmt or reqbufs, and
+	 * the number of memory planes of the format for the multi-planar API.
+	 */
+	enum v4l2_buf_type bufferType_;
+	unsigned int numPlanes_;
+
 	struct v4l2_capability capabilities_;
 	struct v4l2_pix_format v4l2PixFormat_;
+	struct v4l2_pix_format_mplane v4l2PixFormatMplane_;
 
 	std::vector<struct v4l2_buffer> buffers_;
-	std::map<void *, unsigned int> mmaps_;
+	std::vector<std::vector<struct v4l2_plane>> planes_;
+	std::map<void *, Mapping> mmaps_;
+
+	/* Indices of the completed buffers, in completion order. */
+	std::deque<unsigned int> doneBuffers_;
+	std::vector<V4L2Camera::Buffer> completedBuffers_;
 
 	std::set<V4L2CameraFile *> files_;
 
@@ -105,4 +146,20 @@ private:
 
 	/* This mutex is to serialize access to the proxy. */
 	libcamera::Mutex proxyMutex_;
+
+	/*
+	 * In shared stream mode, files that call reqbufs while another file
+	 * owns the camera become readers, and receive a copy of the frames
+	 * captured by the owner. The readers are added and removed with both
+	 * the proxy mutex and the readers mutex held, they can thus be looked
+	 * up with either of them held. The camera thread holds the readers
+	 * mutex only, as the proxy mutex is held while stopping the camera.
+	 */
+	bool sharedStream_;
+	libcamera::Mutex readersMutex_;
+	std::map<V4L2CameraFile *, std::shared_ptr<V4L2CameraReader>> readers_;
+	std::map<const libcamera::FrameBuffer *,
+		 std::unique_ptr<libcamera::MappedFrameBuffer>> mappedBuffers_
+		LIBCAMERA_TSA_GUARDED_BY(readersMutex_);
+	bool cacheMappings_ LIBCAMERA_TSA_GUARDED_BY(readersMutex_);
 };
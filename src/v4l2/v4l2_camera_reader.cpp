@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * V4L2 compatibility shared stream reader
+ */
+
+#include "v4l2_camera_reader.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/memfd.h>
+
+#include "v4l2_camera_file.h"
+#include "v4l2_compat_manager.h"
+
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(V4L2Compat)
+
+/*
+ * A reader receives a copy of the frames captured by the file that owns the
+ * camera, without controlling the capture. The buffers are allocated from a
+ * memfd and exposed through the V4L2 MMAP memory type, with the format of the
+ * owner.
+ */
+V4L2CameraReader::V4L2CameraReader(V4L2CameraFile *file)
+	: file_(file), data_(nullptr), size_(0), sizeimage_(0),
+	  streaming_(false), dropped_(0)
+{
+}
+
+V4L2CameraReader::~V4L2CameraReader()
+{
+	MutexLocker locker(mutex_);
+	free();
+}
+
+int V4L2CameraReader::allocate(unsigned int count, unsigned int sizeimage)
+{
+	MutexLocker locker(mutex_);
+
+	if (streaming_)
+		return -EBUSY;
+
+	free();
+
+	if (!count || !sizeimage)
+		return 0;
+
+	count = std::min<unsigned int>(count, VIDEO_MAX_FRAME);
+
+	size_t size = static_cast<size_t>(count) * sizeimage;
+	UniqueFD fd = MemFd::create("libcamera-v4l2-reader", size,
+				    MemFd::Seal::Shrink | MemFd::Seal::Grow);
+	if (!fd.isValid())
+		return -ENOMEM;
+
+	void *data = V4L2CompatManager::instance()->fops().mmap(nullptr, size,
+								PROT_READ | PROT_WRITE,
+								MAP_SHARED, fd.get(), 0);
+	if (data == MAP_FAILED)
+		return -errno;
+
+	fd_ = std::move(fd);
+	data_ = static_cast<uint8_t *>(data);
+	size_ = size;
+	sizeimage_ = sizeimage;
+
+	buffers_.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		struct v4l2_buffer buf = {};
+		buf.index = i;
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.length = sizeimage;
+		buf.m.offset = i * sizeimage;
+		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+		buffers_[i] = buf;
+	}
+
+	return count;
+}
+
+void V4L2CameraReader::free()
+{
+	if (!done_.empty())
+		signalEventfd(false);
+
+	buffers_.clear();
+	queued_.clear();
+	done_.clear();
+
+	if (data_)
+		V4L2CompatManager::instance()->fops().munmap(data_, size_);
+
+	data_ = nullptr;
+	size_ = 0;
+	fd_.reset();
+}
+
+int V4L2CameraReader::querybuf(struct v4l2_buffer *arg)
+{
+	MutexLocker locker(mutex_);
+
+	if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	    arg->index >= buffers_.size())
+		return -EINVAL;
+
+	*arg = buffers_[arg->index];
+
+	return 0;
+}
+
+int V4L2CameraReader::qbuf(struct v4l2_buffer *arg)
+{
+	MutexLocker locker(mutex_);
+
+	if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	    arg->memory != V4L2_MEMORY_MMAP ||
+	    arg->index >= buffers_.size())
+		return -EINVAL;
+
+	struct v4l2_buffer &buf = buffers_[arg->index];
+	if (buf.flags & (V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE))
+		return -EINVAL;
+
+	buf.flags |= V4L2_BUF_FLAG_QUEUED;
+	queued_.push_back(arg->index);
+
+	arg->flags = buf.flags;
+
+	return 0;
+}
+
+int V4L2CameraReader::dqbuf(struct v4l2_buffer *arg)
+{
+	MutexLocker locker(mutex_);
+
+	if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	    arg->memory != V4L2_MEMORY_MMAP || !streaming_)
+		return -EINVAL;
+
+	if (done_.empty())
+		return -EAGAIN;
+
+	unsigned int index = done_.front();
+	done_.pop_front();
+
+	if (done_.empty())
+		signalEventfd(false);
+
+	struct v4l2_buffer &buf = buffers_[index];
+	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
+	*arg = buf;
+
+	return 0;
+}
+
+void V4L2CameraReader::waitForBuffer()
+{
+	MutexLocker locker(mutex_);
+	cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			 return !done_.empty() || !streaming_;
+		 });
+}
+
+int V4L2CameraReader::streamOn()
+{
+	MutexLocker locker(mutex_);
+
+	if (buffers_.empty())
+		return -EINVAL;
+
+	streaming_ = true;
+	dropped_ = 0;
+
+	return 0;
+}
+
+int V4L2CameraReader::streamOff()
+{
+	{
+		MutexLocker locker(mutex_);
+
+		if (streaming_ && dropped_)
+			LOG(V4L2Compat, Debug)
+				<< "[" << file_->description() << "] "
+				<< dropped_ << " frames dropped";
+
+		streaming_ = false;
+
+		if (!done_.empty())
+			signalEventfd(false);
+
+		queued_.clear();
+		done_.clear();
+
+		for (struct v4l2_buffer &buf : buffers_)
+			buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
+	}
+
+	cv_.notify_all();
+
+	return 0;
+}
+
+void *V4L2CameraReader::mmap(void *addr, size_t length, int prot, int flags,
+			     off64_t offset)
+{
+	MutexLocker locker(mutex_);
+
+	unsigned int index = sizeimage_ ? offset / sizeimage_ : 0;
+	if (index >= buffers_.size() ||
+	    static_cast<off64_t>(index) * sizeimage_ != offset ||
+	    length != sizeimage_) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	void *map = V4L2CompatManager::instance()->fops().mmap(addr, length, prot,
+							       flags, fd_.get(),
+							       offset);
+	if (map == MAP_FAILED)
+		return map;
+
+	buffers_[index].flags |= V4L2_BUF_FLAG_MAPPED;
+	mmaps_[map] = index;
+
+	return map;
+}
+
+int V4L2CameraReader::munmap(void *addr, size_t length)
+{
+	MutexLocker locker(mutex_);
+
+	auto iter = mmaps_.find(addr);
+	if (iter == mmaps_.end() || length != sizeimage_) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (V4L2CompatManager::instance()->fops().munmap(addr, length))
+		LOG(V4L2Compat, Error) << "Failed to unmap " << addr
+				       << " with length " << length;
+
+	if (iter->second < buffers_.size())
+		buffers_[iter->second].flags &= ~V4L2_BUF_FLAG_MAPPED;
+	mmaps_.erase(iter);
+
+	return 0;
+}
+
+/*
+ * Copy a frame to the next queued buffer. When no buffer is queued, the oldest
+ * buffer waiting to be dequeued is overwritten, so that the application always
+ * dequeues the most recent frames. This is called from the camera thread, and
+ * delays the completion of the frame for the owner by the time of the copy.
+ */
+void V4L2CameraReader::deliver(const std::vector<Span<uint8_t>> &planes,
+			       const FrameMetadata &metadata)
+{
+	{
+		MutexLocker locker(mutex_);
+
+		if (!streaming_)
+			return;
+
+		unsigned int index;
+		if (!queued_.empty()) {
+			index = queued_.front();
+			queued_.pop_front();
+		} else if (!done_.empty()) {
+			index = done_.front();
+			done_.pop_front();
+			dropped_++;
+		} else {
+			dropped_++;
+			return;
+		}
+
+		uint8_t *dst = data_ + static_cast<size_t>(index) * sizeimage_;
+		size_t bytesused = 0;
+
+		for (unsigned int i = 0; i < planes.size(); i++) {
+			size_t length = planes[i].size();
+			if (i < metadata.planes().size() && metadata.planes()[i].bytesused)
+				length = std::min<size_t>(length, metadata.planes()[i].bytesused);
+			length = std::min<size_t>(length, sizeimage_ - bytesused);
+
+			memcpy(dst + bytesused, planes[i].data(), length);
+			bytesused += length;
+		}
+
+		struct v4l2_buffer &buf = buffers_[index];
+		buf.bytesused = bytesused;
+		buf.field = V4L2_FIELD_NONE;
+		buf.timestamp.tv_sec = metadata.timestamp / 1000000000;
+		buf.timestamp.tv_usec = (metadata.timestamp / 1000) % 1000000;
+		buf.sequence = metadata.sequence;
+		buf.flags &= ~V4L2_BUF_FLAG_QUEUED;
+		buf.flags |= V4L2_BUF_FLAG_DONE;
+
+		if (done_.empty())
+			signalEventfd(true);
+		done_.push_back(index);
+	}
+
+	cv_.notify_all();
+}
+
+/*
+ * The eventfd is signalled when the first buffer becomes available and cleared
+ * when the last one is dequeued, to report POLLIN precisely.
+ */
+void V4L2CameraReader::signalEventfd(bool ready)
+{
+	uint64_t data = 1;
+	int ret = ready ? ::write(file_->efd(), &data, sizeof(data))
+			: ::read(file_->efd(), &data, sizeof(data));
+	if (ret != sizeof(data))
+		LOG(V4L2Compat, Error)
+			<< "Failed to " << (ready ? "signal" : "clear")
+			<< " eventfd POLLIN";
+}
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * V4L2 compatibility shared stream reader
+ */
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/span.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/framebuffer.h>
+
+class V4L2CameraFile;
+
+class V4L2CameraReader
+{
+public:
+	V4L2CameraReader(V4L2CameraFile *file);
+	~V4L2CameraReader();
+
+	int allocate(unsigned int count, unsigned int sizeimage)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+	bool isMapped() const { return !mmaps_.empty(); }
+
+	int querybuf(struct v4l2_buffer *arg) LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int qbuf(struct v4l2_buffer *arg) LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int dqbuf(struct v4l2_buffer *arg) LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void waitForBuffer() LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int streamOn() LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int streamOff() LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	void *mmap(void *addr, size_t length, int prot, int flags,
+		   off64_t offset) LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int munmap(void *addr, size_t length) LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	void deliver(const std::vector<libcamera::Span<uint8_t>> &planes,
+		     const libcamera::FrameMetadata &metadata)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+private:
+	void free() LIBCAMERA_TSA_REQUIRES(mutex_);
+	void signalEventfd(bool ready) LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	V4L2CameraFile *file_;
+
+	libcamera::UniqueFD fd_;
+	uint8_t *data_;
+	size_t size_;
+	unsigned int sizeimage_;
+
+	/* Accessed from the application threads, under the proxy lock. */
+	std::map<void *, unsigned int> mmaps_;
+
+	/*
+	 * The buffers are filled by the camera thread and dequeued by the
+	 * application. Queued buffers are filled in order, and the oldest
+	 * filled buffer is recycled when the application doesn't requeue
+	 * buffers fast enough.
+	 */
+	libcamera::Mutex mutex_;
+	libcamera::ConditionVariable cv_;
+	std::vector<struct v4l2_buffer> buffers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::deque<unsigned int> queued_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::deque<unsigned int> done_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool streaming_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int dropped_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
@@ -58,6 +58,8 @@ V4L2CompatManager::~V4L2CompatManager()
 
 	if (cm_) {
 		proxies_.clear();
+		devices_.clear();
+		cameras_.clear();
 		cm_->stop();
 		delete cm_;
 		cm_ = nullptr;
@@ -80,18 +82,49 @@ int V4L2CompatManager::start()
 	LOG(V4L2Compat, Debug) << "Started camera manager";
 
 	/*
-	 * For each Camera registered in the system, a V4L2CameraProxy gets
-	 * created here to wrap a camera device.
+	 * Record the device numbers of the nodes of each Camera registered in
+	 * the system. The V4L2CameraProxy that wraps a camera is only created
+	 * when one of its nodes is opened, applications that open a single
+	 * device don't pay for the other cameras.
+	 *
+	 * While there may be multiple cameras that could reference the same
+	 * device node, we take a first match as a best effort for now.
+	 *
+	 * \todo Each camera can be accessed through any of the video device
+	 * nodes that it uses. This may confuse applications. Consider reworking
+	 * the V4L2 adaptation layer to instead expose each Camera instance
+	 * through a single video device node (with a consistent and stable
+	 * mapping). The other device nodes could possibly be hidden from the
+	 * application by intercepting additional calls to the C library.
 	 */
-	auto cameras = cm_->cameras();
-	for (auto [index, camera] : utils::enumerate(cameras)) {
-		V4L2CameraProxy *proxy = new V4L2CameraProxy(index, camera);
-		proxies_.emplace_back(proxy);
+	cameras_ = cm_->cameras();
+	proxies_.resize(cameras_.size());
+
+	for (auto [index, camera] : utils::enumerate(cameras_)) {
+		Span<const int64_t> devices = camera->properties()
+						      .get(properties::SystemDevices)
+						      .value_or(Span<int64_t>{});
+
+		for (const int64_t dev : devices)
+			devices_.emplace(static_cast<dev_t>(dev), index);
 	}
 
 	return 0;
 }
 
+V4L2CameraProxy *V4L2CompatManager::proxy(unsigned int index)
+{
+	std::unique_ptr<V4L2CameraProxy> &proxy = proxies_[index];
+	if (!proxy) {
+		proxy = std::make_unique<V4L2CameraProxy>(index, cameras_[index]);
+
+		LOG(V4L2Compat, Debug)
+			<< "Created proxy for camera " << cameras_[index]->id();
+	}
+
+	return proxy.get();
+}
+
 V4L2CompatManager *V4L2CompatManager::instance()
 {
 	static V4L2CompatManager instance;
@@ -114,38 +147,11 @@ int V4L2CompatManager::getCameraIndex(int fd)
 	if (ret < 0)
 		return -1;
 
-	const dev_t devnum = statbuf.st_rdev;
-
-	/*
-	 * Iterate each known camera and identify if it reports this nodes
-	 * device number in its list of SystemDevices.
-	 */
-	auto cameras = cm_->cameras();
-	for (auto [index, camera] : utils::enumerate(cameras)) {
-		Span<const int64_t> devices = camera->properties()
-						      .get(properties::SystemDevices)
-						      .value_or(Span<int64_t>{});
-
-		/*
-		 * While there may be multiple cameras that could reference the
-		 * same device node, we take a first match as a best effort for
-		 * now.
-		 *
-		 * \todo Each camera can be accessed through any of the video
-		 * device nodes that it uses. This may confuse applications.
-		 * Consider reworking the V4L2 adaptation layer to instead
-		 * expose each Camera instance through a single video device
-		 * node (with a consistent and stable mapping). The other
-		 * device nodes could possibly be hidden from the application
-		 * by intercepting additional calls to the C library.
-		 */
-		for (const int64_t dev : devices) {
-			if (dev == static_cast<int64_t>(devnum))
-				return index;
-		}
-	}
+	auto iter = devices_.find(statbuf.st_rdev);
+	if (iter == devices_.end())
+		return -1;
 
-	return -1;
+	return iter->second;
 }
 
 int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mode)
@@ -177,10 +183,9 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 	if (efd < 0)
 		return efd;
 
-	V4L2CameraProxy *proxy = proxies_[ret].get();
 	files_.emplace(efd, std::make_shared<V4L2CameraFile>(dirfd, path, efd,
 							     oflag & O_NONBLOCK,
-							     proxy));
+							     proxy(ret)));
 
 	LOG(V4L2Compat, Debug) << "Opened " << path << " -> fd " << efd;
 	return efd;
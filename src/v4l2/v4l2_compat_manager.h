@@ -57,12 +57,19 @@ private:
 
 	int start();
 	int getCameraIndex(int fd);
+	V4L2CameraProxy *proxy(unsigned int index);
 	std::shared_ptr<V4L2CameraFile> cameraFile(int fd);
 
 	FileOperations fops_;
 
 	libcamera::CameraManager *cm_;
 
+	/*
+	 * Cameras are resolved from the device numbers of their nodes, and the
+	 * proxies are created when one of their nodes is first opened.
+	 */
+	std::vector<std::shared_ptr<libcamera::Camera>> cameras_;
+	std::map<dev_t, unsigned int> devices_;
 	std::vector<std::unique_ptr<V4L2CameraProxy>> proxies_;
 	std::map<int, std::shared_ptr<V4L2CameraFile>> files_;
 	std::map<void *, std::shared_ptr<V4L2CameraFile>> mmaps_;
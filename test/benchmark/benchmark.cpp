@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Base class for microbenchmarks
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+Benchmark::Benchmark(const std::string &suite)
+	: suite_(suite)
+{
+}
+
+/*
+ * Print the results as one JSON object per line, to be easily collected and
+ * compared across releases. Values are rounded to one decimal.
+ */
+void Benchmark::report(const std::string &name,
+		       const std::vector<std::pair<std::string, double>> &values)
+{
+	std::cout << std::setprecision(15)
+		  << "{ \"benchmark\": \"" << suite_ << "." << name << "\"";
+
+	for (const auto &[key, value] : values)
+		std::cout << ", \"" << key << "\": " << std::round(value * 10) / 10;
+
+	std::cout << " }" << std::endl;
+}
+
+/*
+ * The minimum is the most stable measurement, the median gives an indication
+ * of the noise.
+ */
+void Benchmark::reportSamples(const std::string &name, unsigned int count,
+			      std::vector<double> &samples)
+{
+	std::sort(samples.begin(), samples.end());
+
+	report(name, {
+		{ "iterations", static_cast<double>(count) },
+		{ "runs", static_cast<double>(samples.size()) },
+		{ "min_ns", samples.front() },
+		{ "median_ns", samples[samples.size() / 2] },
+		{ "max_ns", samples.back() },
+	});
+}
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Base class for microbenchmarks
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "test.h"
+
+class Benchmark : public Test
+{
+public:
+	Benchmark(const std::string &suite);
+
+protected:
+	/*
+	 * Run \a func, which performs the benchmarked operation \a count times,
+	 * once to warm up and then kRuns times, and report the time per
+	 * operation.
+	 */
+	template<typename Func>
+	void measure(const std::string &name, unsigned int count, Func &&func)
+	{
+		std::vector<double> samples;
+
+		func(count / 10 + 1);
+
+		for (unsigned int run = 0; run < kRuns; run++) {
+			auto start = std::chrono::steady_clock::now();
+			func(count);
+			auto end = std::chrono::steady_clock::now();
+
+			std::chrono::duration<double, std::nano> duration = end - start;
+			samples.push_back(duration.count() / count);
+		}
+
+		reportSamples(name, count, samples);
+	}
+
+	void report(const std::string &name,
+		    const std::vector<std::pair<std::string, double>> &values);
+
+	/* Prevent the compiler from optimizing away the computation of value. */
+	template<typename T>
+	static void doNotOptimize(const T &value)
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+private:
+	static constexpr unsigned int kRuns = 5;
+
+	void reportSamples(const std::string &name, unsigned int count,
+			   std::vector<double> &samples);
+
+	std::string suite_;
+};
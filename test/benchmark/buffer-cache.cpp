@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark the V4L2 buffer cache
+ */
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/shared_fd.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/v4l2_videodevice.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class BufferCacheBenchmark : public Benchmark
+{
+public:
+	BufferCacheBenchmark()
+		: Benchmark("buffer-cache")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		for (unsigned int i = 0; i < kNumBuffers; i++) {
+			SharedFD fd(MemFd::create("benchmark", 4096));
+			if (!fd.isValid()) {
+				std::cerr << "Failed to allocate buffer" << std::endl;
+				return TestFail;
+			}
+
+			FrameBuffer::Plane plane;
+			plane.fd = fd;
+			plane.offset = 0;
+			plane.length = 4096;
+
+			buffers_.push_back(std::make_unique<FrameBuffer>(
+				std::vector<FrameBuffer::Plane>{ plane }));
+		}
+
+		return TestPass;
+	}
+
+	/* Cycle through the buffers in order, as a capture loop does. */
+	void cycle(const std::string &name, V4L2BufferCache &cache)
+	{
+		measure(name, 1000000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				int index = cache.get(*buffers_[i % buffers_.size()]);
+				doNotOptimize(index);
+				cache.put(index);
+			}
+		});
+	}
+
+	int run() override
+	{
+		V4L2BufferCache hot(buffers_);
+		cycle("get-hit", hot);
+
+		V4L2BufferCache cold(kNumBuffers / 2);
+		cycle("get-miss", cold);
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kNumBuffers = 8;
+
+	std::vector<std::unique_ptr<FrameBuffer>> buffers_;
+};
+
+TEST_REGISTER(BufferCacheBenchmark)
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark the control lists and their serialization
+ */
+
+#include <array>
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
+#include "libcamera/internal/byte_stream_buffer.h"
+#include "libcamera/internal/control_serializer.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class ControlsBenchmark : public Benchmark
+{
+public:
+	ControlsBenchmark()
+		: Benchmark("controls")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		ControlInfoMap::Map map = {
+			{ &controls::ExposureTime, ControlInfo(100, 1000000) },
+			{ &controls::AnalogueGain, ControlInfo(1.0f, 16.0f) },
+			{ &controls::ColourGains, ControlInfo(0.0f, 32.0f) },
+			{ &controls::ColourTemperature, ControlInfo(2000, 10000) },
+			{ &controls::Lux, ControlInfo(0.0f, 100000.0f) },
+			{ &controls::FrameDuration, ControlInfo(INT64_C(1000), INT64_C(1000000)) },
+			{ &controls::SensorTimestamp, ControlInfo(INT64_C(0), INT64_MAX) },
+			{ &controls::ColourCorrectionMatrix, ControlInfo(-16.0f, 16.0f) },
+		};
+
+		infoMap_ = ControlInfoMap(std::move(map), controls::controls);
+
+		return TestPass;
+	}
+
+	/* Fill a list with typical per-frame metadata. */
+	void fill(ControlList &list, unsigned int frame)
+	{
+		static const std::array<float, 9> ccm = {
+			1.6f, -0.4f, -0.2f, -0.3f, 1.5f, -0.2f, -0.1f, -0.5f, 1.6f,
+		};
+
+		list.set(controls::ExposureTime, 10000 + frame % 100);
+		list.set(controls::AnalogueGain, 2.0f);
+		list.set(controls::ColourGains, { 1.5f, 2.0f });
+		list.set(controls::ColourTemperature, 5000);
+		list.set(controls::Lux, 400.0f);
+		list.set(controls::FrameDuration, INT64_C(33333));
+		list.set(controls::SensorTimestamp, INT64_C(33333000) * frame);
+		list.set(controls::ColourCorrectionMatrix, ccm);
+	}
+
+	int run() override
+	{
+		measure("list-build", 100000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				ControlList list(infoMap_);
+				fill(list, i);
+				doNotOptimize(list);
+			}
+		});
+
+		ControlList metadata(infoMap_);
+		fill(metadata, 0);
+
+		measure("list-merge", 100000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				ControlList list(controls::controls);
+				list.set(controls::AfState, controls::AfStateIdle);
+				list.merge(metadata);
+				doNotOptimize(list);
+			}
+		});
+
+		measure("list-lookup", 1000000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				doNotOptimize(metadata.get(controls::ExposureTime));
+				doNotOptimize(metadata.get(controls::SensorTimestamp));
+				doNotOptimize(metadata.contains(controls::AF_STATE));
+			}
+		});
+
+		return serializerRoundTrip(metadata);
+	}
+
+	int serializerRoundTrip(const ControlList &metadata)
+	{
+		ControlSerializer serializer(ControlSerializer::Role::Proxy);
+		ControlSerializer deserializer(ControlSerializer::Role::Worker);
+
+		std::vector<uint8_t> infoData(serializer.binarySize(infoMap_));
+		ByteStreamBuffer infoBuffer(infoData.data(), infoData.size());
+		if (serializer.serialize(infoMap_, infoBuffer) < 0) {
+			std::cerr << "Failed to serialize ControlInfoMap" << std::endl;
+			return TestFail;
+		}
+
+		ByteStreamBuffer infoInput(const_cast<const uint8_t *>(infoData.data()),
+					   infoData.size());
+		deserializer.deserialize<ControlInfoMap>(infoInput);
+
+		std::vector<uint8_t> data;
+		bool failed = false;
+
+		measure("serializer-round-trip", 100000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				data.resize(serializer.binarySize(metadata));
+				ByteStreamBuffer output(data.data(), data.size());
+				if (serializer.serialize(metadata, output))
+					failed = true;
+
+				ByteStreamBuffer input(const_cast<const uint8_t *>(data.data()),
+						       data.size());
+				ControlList list = deserializer.deserialize<ControlList>(input);
+				if (list.size() != metadata.size())
+					failed = true;
+			}
+		});
+
+		if (failed) {
+			std::cerr << "Control list round-trip failed" << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	ControlInfoMap infoMap_;
+};
+
+TEST_REGISTER(ControlsBenchmark)
@@ -0,0 +1,506 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark the rkisp1 IPA module by replaying a capture recording
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <linux/rkisp1-config.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/shared_fd.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/ipa/rkisp1_ipa_interface.h>
+#include <libcamera/ipa/rkisp1_ipa_proxy.h>
+
+#include "libcamera/internal/capture_recorder.h"
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+#include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/process.h"
+
+#include <libcamera/ipa/rkisp1_ipa_serializer.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+namespace {
+
+/*
+ * Read the arguments of the Init and Configure chunks, serialized by the
+ * pipeline handler, each prefixed with its size.
+ */
+class ArgumentReader
+{
+public:
+	ArgumentReader(const std::vector<uint8_t> &data)
+		: pos_(data.cbegin()), end_(data.cend()), valid_(true)
+	{
+	}
+
+	bool valid() const { return valid_; }
+
+	template<typename T>
+	T read(ControlSerializer *cs = nullptr)
+	{
+		size_t available = end_ - pos_;
+		uint32_t size = 0;
+		if (available >= sizeof(size))
+			memcpy(&size, &*pos_, sizeof(size));
+
+		if (available < sizeof(size) + size) {
+			valid_ = false;
+			return {};
+		}
+
+		pos_ += sizeof(size);
+		T value = IPADataSerializer<T>::deserialize(pos_, pos_ + size, cs);
+		pos_ += size;
+
+		return value;
+	}
+
+private:
+	std::vector<uint8_t>::const_iterator pos_;
+	std::vector<uint8_t>::const_iterator end_;
+	bool valid_;
+};
+
+/* FNV-1a, to compare the IPA outputs across replays. */
+class Digest
+{
+public:
+	void update(Span<const uint8_t> data)
+	{
+		for (uint8_t byte : data) {
+			hash_ ^= byte;
+			hash_ *= 16777619;
+		}
+	}
+
+	/* Control lists are unordered, hash the controls sorted by id. */
+	void update(const ControlList &controls)
+	{
+		std::map<unsigned int, const ControlValue *> sorted;
+		for (const auto &[id, value] : controls)
+			sorted[id] = &value;
+
+		for (const auto &[id, value] : sorted) {
+			update({ reinterpret_cast<const uint8_t *>(&id), sizeof(id) });
+			update(value->data());
+		}
+	}
+
+	uint32_t value() const { return hash_; }
+
+private:
+	uint32_t hash_ = 2166136261;
+};
+
+double median(std::vector<double> samples)
+{
+	if (samples.empty())
+		return 0;
+
+	std::sort(samples.begin(), samples.end());
+	return samples[samples.size() / 2];
+}
+
+double maximum(const std::vector<double> &samples)
+{
+	if (samples.empty())
+		return 0;
+
+	return *std::max_element(samples.begin(), samples.end());
+}
+
+} /* namespace */
+
+/*
+ * Replay a capture session recorded with the LIBCAMERA_RECORD environment
+ * variable (or 'cam --record') to the rkisp1 IPA module, without a camera
+ * sensor or an ISP. The recorded request controls, statistics buffers and
+ * sensor controls are passed to the IPA in the recorded order, one call at a
+ * time, waiting for the IPA to complete each call before issuing the next.
+ * The replay is thus deterministic, and reports the IPA processing times, the
+ * frame at which the AGC converged, and digests of the ISP parameters, sensor
+ * controls and metadata computed by the IPA to detect changes in the results.
+ */
+class RkISP1ReplayBenchmark : public Benchmark, public Object
+{
+public:
+	RkISP1ReplayBenchmark()
+		: Benchmark("ipa-replay-rkisp1")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		const char *path = getenv("LIBCAMERA_REPLAY_FILE");
+		if (!path || path[0] == '\0') {
+			std::cout << "LIBCAMERA_REPLAY_FILE not set, skipping" << std::endl;
+			return TestSkip;
+		}
+
+		recording_ = std::make_unique<CaptureRecording>(path);
+		if (recording_->open()) {
+			std::cerr << "Failed to open recording " << path << std::endl;
+			return TestFail;
+		}
+
+		if (recording_->pipe() != "rkisp1") {
+			std::cerr << "Recording made by the " << recording_->pipe()
+				  << " pipeline handler" << std::endl;
+			return TestFail;
+		}
+
+		ipaManager_ = std::make_unique<IPAManager>();
+
+		for (const PipelineHandlerFactoryBase *factory :
+		     PipelineHandlerFactoryBase::factories()) {
+			if (factory->name() == "rkisp1") {
+				pipe_ = factory->create(nullptr);
+				break;
+			}
+		}
+
+		if (!pipe_) {
+			std::cout << "rkisp1 pipeline handler not found" << std::endl;
+			return TestSkip;
+		}
+
+		ipa_ = IPAManager::createIPA<ipa::rkisp1::IPAProxyRkISP1>(pipe_.get(), 1, 1);
+		if (!ipa_) {
+			std::cerr << "Failed to create the rkisp1 IPA" << std::endl;
+			return TestFail;
+		}
+
+		ipa_->paramsBufferReady.connect(this, &RkISP1ReplayBenchmark::paramsBufferReady);
+		ipa_->setSensorControls.connect(this, &RkISP1ReplayBenchmark::setSensorControls);
+		ipa_->metadataReady.connect(this, &RkISP1ReplayBenchmark::metadataReady);
+
+		if (createBuffer(kParamsBufferId, sizeof(rkisp1_params_cfg)) ||
+		    createBuffer(kStatsBufferId, sizeof(rkisp1_stat_buffer))) {
+			std::cerr << "Failed to create the IPA buffers" << std::endl;
+			return TestFail;
+		}
+
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		CaptureChunk chunk;
+		int ret;
+
+		auto start = std::chrono::steady_clock::now();
+
+		while (!(ret = recording_->next(&chunk))) {
+			ret = replay(chunk);
+			if (ret)
+				break;
+		}
+
+		auto end = std::chrono::steady_clock::now();
+
+		if (started_)
+			ipa_->stop();
+
+		if (ret != -ENODATA) {
+			std::cerr << "Failed to replay the recording: "
+				  << strerror(-ret) << std::endl;
+			return TestFail;
+		}
+
+		std::chrono::duration<double> duration = end - start;
+
+		report("replay", {
+			{ "frames", static_cast<double>(statsTimes_.size()) },
+			{ "fps", statsTimes_.size() / duration.count() },
+			{ "stats_median_us", median(statsTimes_) },
+			{ "stats_max_us", maximum(statsTimes_) },
+			{ "params_median_us", median(paramsTimes_) },
+			{ "params_max_us", maximum(paramsTimes_) },
+			{ "ae_converged_frame", static_cast<double>(aeConvergence()) },
+			{ "params_digest", static_cast<double>(paramsDigest_.value()) },
+			{ "sensor_controls_digest", static_cast<double>(sensorDigest_.value()) },
+			{ "metadata_digest", static_cast<double>(metadataDigest_.value()) },
+		});
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kParamsBufferId = 1;
+	static constexpr unsigned int kStatsBufferId = 2;
+	static constexpr float kConvergenceTolerance = 0.02;
+
+	int createBuffer(unsigned int id, size_t size)
+	{
+		UniqueFD fd = MemFd::create("ipa-replay", size);
+		if (!fd.isValid())
+			return -ENOMEM;
+
+		FrameBuffer::Plane plane;
+		plane.fd = SharedFD(std::move(fd));
+		plane.offset = 0;
+		plane.length = size;
+
+		buffers_.emplace_back(id, std::vector<FrameBuffer::Plane>{ plane });
+		frameBuffers_[id] = std::make_unique<FrameBuffer>(buffers_.back().planes);
+
+		MappedFrameBuffer mapped(frameBuffers_[id].get(),
+					 MappedFrameBuffer::MapFlag::ReadWrite);
+		if (!mapped.isValid())
+			return -ENOMEM;
+
+		mappedBuffers_.emplace(id, std::move(mapped));
+
+		return 0;
+	}
+
+	Span<uint8_t> bufferData(unsigned int id)
+	{
+		return mappedBuffers_.at(id).planes()[0];
+	}
+
+	int replay(const CaptureChunk &chunk)
+	{
+		switch (chunk.type) {
+		case CaptureChunk::Type::Init:
+			return replayInit(chunk);
+		case CaptureChunk::Type::Configure:
+			return replayConfigure(chunk);
+		case CaptureChunk::Type::Request:
+			return replayRequest(chunk);
+		case CaptureChunk::Type::Statistics:
+			return replayStatistics(chunk);
+		case CaptureChunk::Type::SensorControls:
+			return replaySensorControls(chunk);
+		}
+
+		/* Skip chunks added by later versions of the recorder. */
+		return 0;
+	}
+
+	int replayInit(const CaptureChunk &chunk)
+	{
+		ControlSerializer serializer(ControlSerializer::Role::Worker);
+		ArgumentReader reader(chunk.data);
+
+		uint32_t hwRevision = reader.read<uint32_t>();
+		std::string model = reader.read<std::string>();
+		ipa::rkisp1::IPAConfigInfo info =
+			reader.read<ipa::rkisp1::IPAConfigInfo>(&serializer);
+		if (!reader.valid())
+			return -EINVAL;
+
+		std::string tuningFile;
+		const char *tuningFromEnv = getenv("LIBCAMERA_RKISP1_TUNING_FILE");
+		if (tuningFromEnv && tuningFromEnv[0] != '\0')
+			tuningFile = tuningFromEnv;
+		else
+			tuningFile = ipa_->configurationFile(model + ".yaml",
+							     "uncalibrated.yaml");
+
+		ControlInfoMap ipaControls;
+		return ipa_->init({ tuningFile, model }, hwRevision, info.sensorInfo,
+				  info.sensorControls, &ipaControls);
+	}
+
+	int replayConfigure(const CaptureChunk &chunk)
+	{
+		ControlSerializer serializer(ControlSerializer::Role::Worker);
+		ArgumentReader reader(chunk.data);
+
+		ipa::rkisp1::IPAConfigInfo config =
+			reader.read<ipa::rkisp1::IPAConfigInfo>(&serializer);
+		std::map<uint32_t, IPAStream> streams =
+			reader.read<std::map<uint32_t, IPAStream>>();
+		raw_ = reader.read<bool>();
+		if (!reader.valid())
+			return -EINVAL;
+
+		sensorControls_ = config.sensorControls;
+
+		ControlInfoMap ipaControls;
+		int ret = ipa_->configure(config, streams, &ipaControls);
+		if (ret)
+			return ret;
+
+		ipa_->mapBuffers(buffers_);
+
+		ret = ipa_->start();
+		if (ret)
+			return ret;
+
+		started_ = true;
+
+		return 0;
+	}
+
+	int replayRequest(const CaptureChunk &chunk)
+	{
+		ControlList controls(controls::controls);
+		int ret = CaptureChunk::decodeControls(chunk.data, &controls);
+		if (ret)
+			return ret;
+
+		ipa_->queueRequest(chunk.frame, controls);
+
+		if (raw_)
+			return 0;
+
+		auto start = std::chrono::steady_clock::now();
+
+		paramsReady_ = false;
+		ipa_->fillParamsBuffer(chunk.frame, kParamsBufferId);
+		if (!wait(paramsReady_))
+			return -ETIMEDOUT;
+
+		std::chrono::duration<double, std::micro> duration =
+			std::chrono::steady_clock::now() - start;
+		paramsTimes_.push_back(duration.count());
+
+		paramsDigest_.update(bufferData(kParamsBufferId));
+
+		return 0;
+	}
+
+	int replayStatistics(const CaptureChunk &chunk)
+	{
+		Span<uint8_t> stats = bufferData(kStatsBufferId);
+		size_t size = std::min(stats.size(), chunk.data.size());
+
+		memcpy(stats.data(), chunk.data.data(), size);
+		memset(stats.data() + size, 0, stats.size() - size);
+
+		return 0;
+	}
+
+	int replaySensorControls(const CaptureChunk &chunk)
+	{
+		ControlList controls(sensorControls_);
+		int ret = CaptureChunk::decodeControls(chunk.data, &controls);
+		if (ret)
+			return ret;
+
+		auto start = std::chrono::steady_clock::now();
+
+		metadataReady_ = false;
+		ipa_->processStatsBuffer(chunk.frame, kStatsBufferId, controls);
+		if (!wait(metadataReady_))
+			return -ETIMEDOUT;
+
+		std::chrono::duration<double, std::micro> duration =
+			std::chrono::steady_clock::now() - start;
+		statsTimes_.push_back(duration.count());
+
+		return 0;
+	}
+
+	bool wait(const bool &done)
+	{
+		Timer timer;
+		timer.start(1000ms);
+		while (timer.isRunning() && !done)
+			dispatcher_->processEvents();
+
+		return done;
+	}
+
+	void paramsBufferReady([[maybe_unused]] unsigned int frame)
+	{
+		paramsReady_ = true;
+	}
+
+	void setSensorControls([[maybe_unused]] unsigned int frame,
+			       const ControlList &controls)
+	{
+		sensorDigest_.update(controls);
+	}
+
+	void metadataReady([[maybe_unused]] unsigned int frame,
+			   const ControlList &metadata)
+	{
+		metadataDigest_.update(metadata);
+
+		auto exposureTime = metadata.get(controls::ExposureTime);
+		auto gain = metadata.get(controls::AnalogueGain);
+		if (exposureTime && gain)
+			exposures_.push_back(*exposureTime * *gain);
+
+		metadataReady_ = true;
+	}
+
+	/*
+	 * The AGC is considered converged from the first frame after which the
+	 * total exposure stays within kConvergenceTolerance of its final value.
+	 */
+	unsigned int aeConvergence() const
+	{
+		if (exposures_.empty())
+			return 0;
+
+		float target = exposures_.back();
+		unsigned int frame = exposures_.size();
+
+		while (frame > 0 &&
+		       std::abs(exposures_[frame - 1] - target) <= target * kConvergenceTolerance)
+			frame--;
+
+		return frame;
+	}
+
+	ProcessManager processManager_;
+
+	std::unique_ptr<CaptureRecording> recording_;
+	std::unique_ptr<IPAManager> ipaManager_;
+	std::shared_ptr<PipelineHandler> pipe_;
+	std::unique_ptr<ipa::rkisp1::IPAProxyRkISP1> ipa_;
+	EventDispatcher *dispatcher_;
+
+	std::vector<IPABuffer> buffers_;
+	std::map<unsigned int, std::unique_ptr<FrameBuffer>> frameBuffers_;
+	std::map<unsigned int, MappedFrameBuffer> mappedBuffers_;
+
+	ControlInfoMap sensorControls_;
+	bool raw_ = false;
+	bool started_ = false;
+
+	bool paramsReady_;
+	bool metadataReady_;
+
+	std::vector<double> paramsTimes_;
+	std::vector<double> statsTimes_;
+	std::vector<float> exposures_;
+
+	Digest paramsDigest_;
+	Digest sensorDigest_;
+	Digest metadataDigest_;
+};
+
+TEST_REGISTER(RkISP1ReplayBenchmark)
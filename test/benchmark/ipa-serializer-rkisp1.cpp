@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark the serialization of the rkisp1 IPA interface structures
+ */
+
+#include <iostream>
+#include <stdint.h>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/base/shared_fd.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/ipa/rkisp1_ipa_interface.h>
+
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+
+#include <libcamera/ipa/rkisp1_ipa_serializer.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class RkISP1SerializerBenchmark : public Benchmark
+{
+public:
+	RkISP1SerializerBenchmark()
+		: Benchmark("ipa-serializer-rkisp1")
+	{
+	}
+
+protected:
+	int run() override
+	{
+		ControlInfoMap::Map map = {
+			{ &controls::ExposureTime, ControlInfo(100, 1000000) },
+			{ &controls::AnalogueGain, ControlInfo(1.0f, 16.0f) },
+			{ &controls::FrameDurationLimits, ControlInfo(INT64_C(1000), INT64_C(1000000)) },
+		};
+		ControlInfoMap sensorControls(std::move(map), controls::controls);
+
+		ipa::rkisp1::IPAConfigInfo config;
+		config.sensorInfo.model = "imx219";
+		config.sensorInfo.bitsPerPixel = 10;
+		config.sensorInfo.activeAreaSize = { 3280, 2464 };
+		config.sensorInfo.analogCrop = { 0, 0, 3280, 2464 };
+		config.sensorInfo.outputSize = { 1640, 1232 };
+		config.sensorInfo.pixelRate = 182400000;
+		config.sensorInfo.minLineLength = 3448;
+		config.sensorInfo.maxLineLength = 32767;
+		config.sensorInfo.minFrameLength = 1248;
+		config.sensorInfo.maxFrameLength = 65535;
+		config.sensorControls = sensorControls;
+
+		ControlSerializer serializer(ControlSerializer::Role::Proxy);
+		ControlSerializer deserializer(ControlSerializer::Role::Worker);
+		bool failed = false;
+
+		/*
+		 * The configuration is sent once per capture session, with a
+		 * new ControlInfoMap, reset the serializers to serialize the
+		 * map in every iteration.
+		 */
+		measure("config-info-round-trip", 10000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				serializer.reset();
+				deserializer.reset();
+
+				std::vector<uint8_t> data;
+				std::vector<SharedFD> fds;
+				std::tie(data, fds) =
+					IPADataSerializer<ipa::rkisp1::IPAConfigInfo>::serialize(config, &serializer);
+
+				ipa::rkisp1::IPAConfigInfo result =
+					IPADataSerializer<ipa::rkisp1::IPAConfigInfo>::deserialize(data.cbegin(), data.cend(),
+												   &deserializer);
+				if (result.sensorControls.size() != sensorControls.size())
+					failed = true;
+			}
+		});
+
+		if (failed) {
+			std::cerr << "IPAConfigInfo round-trip failed" << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(RkISP1SerializerBenchmark)
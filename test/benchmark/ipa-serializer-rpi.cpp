@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark the serialization of the Raspberry Pi IPA interface structures
+ */
+
+#include <iostream>
+#include <stdint.h>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/base/shared_fd.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/geometry.h>
+#include <libcamera/ipa/raspberrypi_ipa_interface.h>
+
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+
+#include <libcamera/ipa/raspberrypi_ipa_serializer.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class RPiSerializerBenchmark : public Benchmark
+{
+public:
+	RPiSerializerBenchmark()
+		: Benchmark("ipa-serializer-rpi")
+	{
+	}
+
+protected:
+	/* PrepareParams is sent to the IPA for every frame. */
+	int run() override
+	{
+		ipa::RPi::PrepareParams params;
+		params.buffers = { 1, 2, 3 };
+		params.ipaContext = 4;
+		params.delayContext = 4;
+
+		params.sensorControls = ControlList(controls::controls);
+		params.sensorControls.set(controls::ExposureTime, 10000);
+		params.sensorControls.set(controls::AnalogueGain, 2.0f);
+
+		params.requestControls = ControlList(controls::controls);
+		params.requestControls.set(controls::AeEnable, true);
+		params.requestControls.set(controls::Brightness, 0.1f);
+		params.requestControls.set(controls::ScalerCrop, Rectangle(0, 0, 1640, 1232));
+
+		ControlSerializer serializer(ControlSerializer::Role::Proxy);
+		ControlSerializer deserializer(ControlSerializer::Role::Worker);
+		bool failed = false;
+
+		measure("prepare-params-round-trip", 100000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				std::vector<uint8_t> data;
+				std::vector<SharedFD> fds;
+				std::tie(data, fds) =
+					IPADataSerializer<ipa::RPi::PrepareParams>::serialize(params, &serializer);
+
+				ipa::RPi::PrepareParams result =
+					IPADataSerializer<ipa::RPi::PrepareParams>::deserialize(data.cbegin(), data.cend(),
+												&deserializer);
+				if (result.requestControls.size() != params.requestControls.size())
+					failed = true;
+			}
+		});
+
+		if (failed) {
+			std::cerr << "PrepareParams round-trip failed" << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(RPiSerializerBenchmark)
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark cross-thread method invocation and message posting
+ */
+
+#include <memory>
+
+#include <libcamera/base/message.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class MessageReceiver : public Object
+{
+public:
+	MessageReceiver(Message::Type type)
+		: type_(type), received_(0)
+	{
+	}
+
+	unsigned int ping(unsigned int value)
+	{
+		return value + 1;
+	}
+
+	/* Wait until \a count messages have been received since the last wait. */
+	void wait(unsigned int count)
+	{
+		MutexLocker locker(mutex_);
+		cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return received_ >= count;
+		});
+		received_ -= count;
+	}
+
+protected:
+	void message(Message *msg) override
+	{
+		if (msg->type() != type_) {
+			Object::message(msg);
+			return;
+		}
+
+		{
+			MutexLocker locker(mutex_);
+			received_++;
+		}
+
+		cv_.notify_one();
+	}
+
+private:
+	Message::Type type_;
+
+	Mutex mutex_;
+	ConditionVariable cv_;
+	unsigned int received_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+class MessageBenchmark : public Benchmark
+{
+public:
+	MessageBenchmark()
+		: Benchmark("message")
+	{
+	}
+
+protected:
+	int run() override
+	{
+		Message::Type type = Message::registerMessageType();
+
+		Thread thread;
+		MessageReceiver receiver(type);
+		receiver.moveToThread(&thread);
+		thread.start();
+
+		measure("invoke-blocking", 10000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++)
+				doNotOptimize(receiver.invokeMethod(&MessageReceiver::ping,
+								    ConnectionTypeBlocking, i));
+		});
+
+		measure("post-message", 100000, [&](unsigned int count) {
+			for (unsigned int i = 0; i < count; i++)
+				receiver.postMessage(std::make_unique<Message>(type));
+
+			receiver.wait(count);
+		});
+
+		thread.exit();
+		thread.wait();
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(MessageBenchmark)
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark signal emission
+ */
+
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/object.h>
+#include <libcamera/base/signal.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class SignalReceiver : public Object
+{
+public:
+	SignalReceiver()
+		: count_(0)
+	{
+	}
+
+	void slot(int value)
+	{
+		count_ += value;
+	}
+
+	unsigned int count() const { return count_; }
+
+private:
+	unsigned int count_;
+};
+
+class SignalBenchmark : public Benchmark
+{
+public:
+	SignalBenchmark()
+		: Benchmark("signal")
+	{
+	}
+
+protected:
+	void emit(unsigned int slots)
+	{
+		Signal<int> signal;
+		std::vector<std::unique_ptr<SignalReceiver>> receivers;
+
+		for (unsigned int i = 0; i < slots; i++) {
+			receivers.push_back(std::make_unique<SignalReceiver>());
+			signal.connect(receivers.back().get(), &SignalReceiver::slot);
+		}
+
+		measure("emit-" + std::to_string(slots), 1000000 / slots,
+			[&](unsigned int count) {
+				for (unsigned int i = 0; i < count; i++)
+					signal.emit(1);
+			});
+
+		doNotOptimize(receivers.front()->count());
+	}
+
+	int run() override
+	{
+		for (unsigned int slots : { 1, 4, 16, 64 })
+			emit(slots);
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(SignalBenchmark)
@@ -0,0 +1,294 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Benchmark the library overhead of sustained captures on vimc
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include <libcamera/framebuffer_allocator.h>
+
+#include "benchmark.h"
+#include "camera_test.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+namespace {
+
+/*
+ * Read the CPU time consumed by the threads of the process, by thread name,
+ * in microseconds. Isolated IPA modules run in child processes, their CPU time
+ * is accounted as a single "ipa-proxy" entry.
+ */
+class CpuTimes
+{
+public:
+	void sample()
+	{
+		times_.clear();
+
+		DIR *dir = opendir("/proc/self/task");
+		if (dir) {
+			while (struct dirent *entry = readdir(dir)) {
+				if (entry->d_name[0] == '.')
+					continue;
+
+				std::string name;
+				pid_t ppid;
+				uint64_t time;
+				if (readStat("/proc/self/task/" + std::string(entry->d_name) + "/stat",
+					     &name, &ppid, &time))
+					times_[name] += time;
+			}
+
+			closedir(dir);
+		}
+
+		dir = opendir("/proc");
+		if (!dir)
+			return;
+
+		while (struct dirent *entry = readdir(dir)) {
+			if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+				continue;
+
+			std::string name;
+			pid_t ppid;
+			uint64_t time;
+			if (readStat("/proc/" + std::string(entry->d_name) + "/stat",
+				     &name, &ppid, &time) &&
+			    ppid == getpid())
+				times_["ipa-proxy"] += time;
+		}
+
+		closedir(dir);
+	}
+
+	const std::map<std::string, uint64_t> &times() const { return times_; }
+
+private:
+	/* The name is enclosed in parentheses and may contain spaces. */
+	static bool readStat(const std::string &path, std::string *name,
+			     pid_t *ppid, uint64_t *time)
+	{
+		std::ifstream file(path);
+		std::string stat;
+		if (!std::getline(file, stat))
+			return false;
+
+		size_t open = stat.find('(');
+		size_t close = stat.rfind(')');
+		if (open == std::string::npos || close == std::string::npos ||
+		    close < open)
+			return false;
+
+		/* Fields 3 (state) to 13 precede utime and stime. */
+		std::istringstream fields(stat.substr(close + 1));
+		std::string state;
+		fields >> state >> *ppid;
+
+		std::string field;
+		for (unsigned int i = 0; i < 9; i++)
+			fields >> field;
+
+		uint64_t user, system;
+		if (!(fields >> user >> system))
+			return false;
+
+		*name = stat.substr(open + 1, close - open - 1);
+		*time = (user + system) * 1000000 / sysconf(_SC_CLK_TCK);
+
+		return true;
+	}
+
+	std::map<std::string, uint64_t> times_;
+};
+
+bool isolated()
+{
+	const char *isolate = getenv("LIBCAMERA_IPA_FORCE_ISOLATION");
+	return isolate && isolate[0] != '\0';
+}
+
+} /* namespace */
+
+class VimcCaptureBenchmark : public CameraTest, public Benchmark
+{
+public:
+	VimcCaptureBenchmark()
+		: CameraTest("platform/vimc.0 Sensor B"),
+		  Benchmark(isolated() ? "vimc-capture-isolated" : "vimc-capture")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		if (camera_->acquire()) {
+			std::cerr << "Failed to acquire the camera" << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void requestComplete(Request *request)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		completed_++;
+
+		request->reuse(Request::ReuseBuffers);
+		camera_->queueRequest(request);
+
+		dispatcher_->interrupt();
+	}
+
+	int capture(unsigned int bufferCount)
+	{
+		std::unique_ptr<CameraConfiguration> config =
+			camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config) {
+			std::cerr << "Failed to generate configuration" << std::endl;
+			return TestFail;
+		}
+
+		StreamConfiguration &cfg = config->at(0);
+		cfg.bufferCount = bufferCount;
+
+		if (config->validate() == CameraConfiguration::Invalid ||
+		    camera_->configure(config.get())) {
+			std::cerr << "Failed to configure the camera" << std::endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+		FrameBufferAllocator allocator(camera_);
+		if (allocator.allocate(stream) < 0) {
+			std::cerr << "Failed to allocate buffers" << std::endl;
+			return TestFail;
+		}
+
+		std::vector<std::unique_ptr<Request>> requests;
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator.buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				std::cerr << "Failed to create request" << std::endl;
+				return TestFail;
+			}
+
+			requests.push_back(std::move(request));
+		}
+
+		camera_->requestCompleted.connect(this, &VimcCaptureBenchmark::requestComplete);
+
+		if (camera_->start()) {
+			std::cerr << "Failed to start the camera" << std::endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests)
+			camera_->queueRequest(request.get());
+
+		/* Warm up, and then measure a sustained capture. */
+		bool success = waitFrames(kWarmupFrames);
+
+		CpuTimes start;
+		start.sample();
+		auto startTime = std::chrono::steady_clock::now();
+		unsigned int startCompleted = completed_;
+
+		success = success && waitFrames(kCaptureFrames);
+
+		CpuTimes end;
+		end.sample();
+		auto endTime = std::chrono::steady_clock::now();
+		unsigned int frames = completed_ - startCompleted;
+
+		camera_->stop();
+		camera_->requestCompleted.disconnect(this);
+
+		if (!success) {
+			std::cerr << "Failed to capture " << kCaptureFrames
+				  << " frames" << std::endl;
+			return TestFail;
+		}
+
+		std::chrono::duration<double> duration = endTime - startTime;
+		std::vector<std::pair<std::string, double>> values = {
+			{ "buffers", static_cast<double>(bufferCount) },
+			{ "frames", static_cast<double>(frames) },
+			{ "fps", frames / duration.count() },
+		};
+
+		uint64_t total = 0;
+		for (const auto &[name, time] : end.times()) {
+			auto iter = start.times().find(name);
+			uint64_t delta = time - (iter != start.times().end()
+						 ? std::min(iter->second, time) : 0);
+			total += delta;
+
+			values.push_back({ "cpu_us_per_frame." + name,
+					   static_cast<double>(delta) / frames });
+		}
+
+		values.push_back({ "cpu_us_per_frame", static_cast<double>(total) / frames });
+
+		report("buffers-" + std::to_string(bufferCount), values);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		for (unsigned int bufferCount : { 2, 4, 8 }) {
+			int ret = capture(bufferCount);
+			if (ret)
+				return ret;
+		}
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kWarmupFrames = 10;
+	static constexpr unsigned int kCaptureFrames = 120;
+
+	bool waitFrames(unsigned int count)
+	{
+		unsigned int target = completed_ + count;
+
+		Timer timer;
+		timer.start(100ms * count);
+		while (timer.isRunning() && completed_ < target)
+			dispatcher_->processEvents();
+
+		return completed_ >= target;
+	}
+
+	EventDispatcher *dispatcher_;
+	unsigned int completed_ = 0;
+};
+
+TEST_REGISTER(VimcCaptureBenchmark)
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Buffer residency tracking test
+ */
+
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/buffer_residency.h"
+#include "libcamera/internal/framebuffer.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class BufferResidencyTest : public Test
+{
+protected:
+	static constexpr int64_t kMs = 1000000;
+
+	/*
+	 * Simulate a stream capturing a frame every \a interval with \a count
+	 * buffers. Each frame completes \a latency after its start, and the
+	 * application queues the buffer again after \a hold.
+	 */
+	unsigned int simulate(unsigned int count, int64_t interval,
+			      int64_t latency, int64_t hold,
+			      unsigned int frames)
+	{
+		BufferResidency residency;
+		vector<unique_ptr<FrameBuffer>> buffers;
+		deque<pair<int64_t, FrameBuffer *>> held;
+
+		for (unsigned int i = 0; i < count; i++) {
+			buffers.push_back(make_unique<FrameBuffer>(vector<FrameBuffer::Plane>{}));
+			residency.bufferQueued(buffers.back().get(), 0);
+		}
+
+		for (unsigned int frame = 1; frame <= frames; frame++) {
+			int64_t completed = frame * interval + latency;
+
+			while (!held.empty() && held.front().first <= completed) {
+				residency.bufferQueued(held.front().second,
+						       held.front().first);
+				held.pop_front();
+			}
+
+			FrameBuffer *buffer = buffers[frame % count].get();
+			FrameMetadata &metadata = buffer->_d()->metadata();
+			metadata.status = FrameMetadata::FrameSuccess;
+			metadata.timestamp = frame * interval;
+
+			residency.bufferCompleted(buffer, completed);
+			held.emplace_back(completed + hold, buffer);
+		}
+
+		return residency.recommendedCount();
+	}
+
+	int run()
+	{
+		/* Test that no estimate is reported before enough frames. */
+		unsigned int count = simulate(4, 30 * kMs, 20 * kMs, 5 * kMs,
+					      BufferResidency::kMinSamples / 2);
+		if (count) {
+			cerr << "Estimate reported too early: " << count << endl;
+			return TestFail;
+		}
+
+		/* Test that a fast application needs fewer buffers than queued. */
+		count = simulate(6, 30 * kMs, 20 * kMs, 5 * kMs, 100);
+		if (count != 1) {
+			cerr << "Invalid estimate for a fast application: "
+			     << count << endl;
+			return TestFail;
+		}
+
+		/* Test that the time buffers are held is accounted for. */
+		count = simulate(6, 30 * kMs, 20 * kMs, 75 * kMs, 100);
+		if (count != 4) {
+			cerr << "Invalid estimate for a slow application: "
+			     << count << endl;
+			return TestFail;
+		}
+
+		/* Test that buffers failing to complete are ignored. */
+		BufferResidency residency;
+		FrameBuffer buffer(vector<FrameBuffer::Plane>{});
+		buffer._d()->metadata().status = FrameMetadata::FrameCancelled;
+
+		for (unsigned int i = 0; i < BufferResidency::kWindow; i++) {
+			residency.bufferQueued(&buffer, i * 30 * kMs);
+			residency.bufferCompleted(&buffer, i * 30 * kMs + 20 * kMs);
+		}
+
+		if (residency.recommendedCount()) {
+			cerr << "Cancelled buffers accounted for" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(BufferResidencyTest)
@@ -171,6 +171,45 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Bulk operations.
+		 */
+		std::array<uint8_t, 12> bulk = {};
+		wbuf = ByteStreamBuffer(bulk.data(), bulk.size());
+
+		/* Test vectored write. */
+		const std::array<uint8_t, 3> first{ 1, 2, 3 };
+		const std::array<uint8_t, 2> second{ 4, 5 };
+		ret = wbuf.write({ first, second });
+		if (ret || wbuf.offset() != 5 || bulk[2] != 3 || bulk[3] != 4) {
+			cerr << "Vectored write failed" << endl;
+			return TestFail;
+		}
+
+		/* Test in-place writes. */
+		uint8_t *reserved = wbuf.reserve<uint8_t>(3);
+		if (reserved != bulk.data() + 5 || wbuf.offset() != 8) {
+			cerr << "Reserve failed" << endl;
+			return TestFail;
+		}
+
+		/* Test vectored write overflow, no data shall be written. */
+		ret = wbuf.write({ first, second });
+		if (!ret || !wbuf.overflow() || bulk[8] != 0) {
+			cerr << "Vectored write failed to overflow" << endl;
+			return TestFail;
+		}
+
+		if (wbuf.reserve<uint8_t>()) {
+			cerr << "Reserve should fail on overflown buffer" << endl;
+			return TestFail;
+		}
+
+		if (rbuf.reserve<uint8_t>()) {
+			cerr << "Reserve should fail on read buffer" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
@@ -108,6 +108,17 @@ protected:
 			return TestFail;
 		}
 
+		/* Repeated lookups must return the same format. */
+		V4L2SubdeviceFormat cached = sensor_->getFormat({ 0xdeadbeef,
+								  MEDIA_BUS_FMT_SBGGR10_1X10,
+								  MEDIA_BUS_FMT_BGR888_1X24 },
+								Size(1024, 768));
+		if (cached.code != format.code || cached.size != format.size) {
+			cerr << "Cached format " << cached
+			     << " differs from " << format << endl;
+			return TestFail;
+		}
+
 		if (lens_ && lens_->setFocusPosition(10)) {
 			cerr << "Failed to set lens focus position" << endl;
 			return TestFail;
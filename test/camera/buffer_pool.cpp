@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * FrameBufferPool test
+ */
+
+#include <iostream>
+#include <vector>
+
+#include <libcamera/framebuffer_allocator.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+class BufferPoolTest : public CameraTest, public Test
+{
+public:
+	BufferPoolTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		Stream *stream = config_->at(0).stream();
+		unsigned int count = config_->at(0).bufferCount;
+		std::vector<FrameBuffer *> buffers;
+
+		FrameBufferPool pool(count * 3 / 2);
+
+		/* The pool grows on the first acquisition. */
+		if (pool.acquire(camera_.get(), stream, 0, &buffers) < 0 ||
+		    buffers.size() != count || pool.size() != count) {
+			cout << "Failed to acquire buffers" << endl;
+			return TestFail;
+		}
+
+		/* Growing past the maximum number of buffers fails. */
+		std::vector<FrameBuffer *> more;
+		if (pool.acquire(camera_.get(), stream, count, &more) != -ENOMEM ||
+		    pool.size() > pool.maxBuffers()) {
+			cout << "Buffer pool grown past its maximum" << endl;
+			return TestFail;
+		}
+
+		/* Released buffers are reused without allocating new ones. */
+		for (FrameBuffer *buffer : buffers)
+			pool.release(buffer);
+
+		unsigned int size = pool.size();
+		std::vector<FrameBuffer *> again;
+		if (pool.acquire(camera_.get(), stream, count, &again) < 0 ||
+		    again.size() != count || pool.size() != size) {
+			cout << "Failed to reuse released buffers" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		camera_->release();
+	}
+
+private:
+	std::unique_ptr<CameraConfiguration> config_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(BufferPoolTest)
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * libcamera CameraGroup API tests
+ */
+
+#include <iostream>
+
+#include <libcamera/camera_group.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class CameraGroupTest : public CameraTest, public Test
+{
+public:
+	CameraGroupTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	unsigned int completeGroupsCount_;
+	uint64_t nextCookie_;
+	bool outOfOrder_;
+
+	void requestsComplete(const std::vector<Request *> &requests)
+	{
+		Request *request = requests[0];
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		/* Groups must complete in the order they have been queued. */
+		if (request->cookie() != nextCookie_)
+			outOfOrder_ = true;
+		nextCookie_ = (nextCookie_ + 1) % requests_.size();
+
+		completeGroupsCount_++;
+
+		const Stream *stream = request->buffers().begin()->first;
+		FrameBuffer *buffer = request->buffers().begin()->second;
+
+		request->reuse();
+		request->addBuffer(stream, buffer);
+		group_->queueRequests(requests);
+
+		dispatcher_->interrupt();
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		group_ = std::make_unique<CameraGroup>(std::vector<std::shared_ptr<Camera>>{ camera_ });
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		group_.reset();
+		allocator_.reset();
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (group_->start() != -EACCES) {
+			cout << "Unconfigured group started" << endl;
+			return TestFail;
+		}
+
+		if (group_->configure({}) != -EINVAL) {
+			cout << "Configuration count mismatch not rejected" << endl;
+			return TestFail;
+		}
+
+		if (group_->configure({ config_.get() })) {
+			cout << "Failed to configure the group" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		uint64_t cookie = 0;
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest(cookie++);
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		completeGroupsCount_ = 0;
+		nextCookie_ = 0;
+		outOfOrder_ = false;
+
+		group_->requestsCompleted.connect(this, &CameraGroupTest::requestsComplete);
+
+		if (group_->start()) {
+			cout << "Failed to start the group" << endl;
+			return TestFail;
+		}
+
+		/* A single camera can't be hardware synchronised. */
+		if (group_->hardwareSynchronised()) {
+			cout << "Single camera group reported as synchronised" << endl;
+			return TestFail;
+		}
+
+		if (group_->queueRequests({}) != -EINVAL) {
+			cout << "Request count mismatch not rejected" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			if (group_->queueRequests({ request.get() })) {
+				cout << "Failed to queue requests" << endl;
+				return TestFail;
+			}
+		}
+
+		unsigned int nFrames = requests_.size() * 2;
+
+		Timer timer;
+		timer.start(500ms * nFrames);
+		while (timer.isRunning()) {
+			dispatcher_->processEvents();
+			if (completeGroupsCount_ > nFrames)
+				break;
+		}
+
+		if (completeGroupsCount_ < nFrames) {
+			cout << "Failed to capture enough frames (got "
+			     << completeGroupsCount_ << " expected at least "
+			     << nFrames << ")" << endl;
+			return TestFail;
+		}
+
+		if (outOfOrder_) {
+			cout << "Groups completed out of order" << endl;
+			return TestFail;
+		}
+
+		if (group_->stop()) {
+			cout << "Failed to stop the group" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+	std::unique_ptr<CameraGroup> group_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CameraGroupTest)
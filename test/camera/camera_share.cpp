@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Test camera sharing between a server and a client
+ */
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "libcamera/internal/camera_share.h"
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class CameraShareTest : public CameraTest, public Test
+{
+public:
+	CameraShareTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::Viewfinder });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		path_ = "/tmp/libcamera-share-test-" + std::to_string(getpid());
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire() || camera_->configure(config_.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		CameraShareServer server(camera_);
+		if (server.start(path_, config_.get())) {
+			cout << "Failed to start the server" << endl;
+			return TestFail;
+		}
+
+		CameraShareClient client;
+		bool ready = false;
+		unsigned int frames = 0;
+		bool hungup = false;
+
+		client.streamsReady.connect(this, [&]() { ready = true; });
+		client.frameReady.connect(this, [&](unsigned int stream, FrameBuffer *buffer,
+						    const ControlList &) {
+			frames++;
+			client.release(stream, buffer);
+		});
+		client.disconnected.connect(this, [&]() { hungup = true; });
+
+		if (client.connect(path_)) {
+			cout << "Failed to connect to the server" << endl;
+			return TestFail;
+		}
+
+		Timer timer;
+		timer.start(1s);
+		while (timer.isRunning() && !ready)
+			dispatcher_->processEvents();
+
+		if (!ready || client.streams().size() != 1) {
+			cout << "Streams not received" << endl;
+			return TestFail;
+		}
+
+		const StreamConfiguration &cfg = client.streams()[0].configuration;
+		if (cfg.pixelFormat != config_->at(0).pixelFormat ||
+		    cfg.size != config_->at(0).size) {
+			cout << "Stream configuration mismatch" << endl;
+			return TestFail;
+		}
+
+		if (client.subscribe({ 0 })) {
+			cout << "Failed to subscribe" << endl;
+			return TestFail;
+		}
+
+		/* Frames must keep flowing as long as the client releases them. */
+		const unsigned int expected = client.streams()[0].buffers.size() * 2;
+
+		timer.start(2s);
+		while (timer.isRunning() && frames < expected)
+			dispatcher_->processEvents();
+
+		if (frames < expected) {
+			cout << "Only " << frames << " frames received" << endl;
+			return TestFail;
+		}
+
+		/* Stopping the server disconnects the client. */
+		server.stop();
+
+		timer.start(1s);
+		while (timer.isRunning() && !hungup)
+			dispatcher_->processEvents();
+
+		if (!hungup || client.isConnected()) {
+			cout << "Client not disconnected" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	EventDispatcher *dispatcher_;
+	std::string path_;
+	std::unique_ptr<CameraConfiguration> config_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CameraShareTest)
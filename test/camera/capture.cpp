@@ -7,6 +7,7 @@
 
 #include <iostream>
 
+#include <libcamera/control_ids.h>
 #include <libcamera/framebuffer_allocator.h>
 
 #include <libcamera/base/event_dispatcher.h>
@@ -33,6 +34,7 @@ public:
 protected:
 	unsigned int completeBuffersCount_;
 	unsigned int completeRequestsCount_;
+	unsigned int partialMetadataCount_;
 
 	void bufferComplete([[maybe_unused]] Request *request,
 			    FrameBuffer *buffer)
@@ -43,6 +45,13 @@ protected:
 		completeBuffersCount_++;
 	}
 
+	void metadataAvailable([[maybe_unused]] Request *request,
+			       const ControlList &metadata)
+	{
+		if (metadata.contains(controls::SensorTimestamp.id()))
+			partialMetadataCount_++;
+	}
+
 	void requestComplete(Request *request)
 	{
 		if (request->status() != Request::RequestComplete)
@@ -122,8 +131,10 @@ protected:
 
 		completeRequestsCount_ = 0;
 		completeBuffersCount_ = 0;
+		partialMetadataCount_ = 0;
 
 		camera_->bufferCompleted.connect(this, &Capture::bufferComplete);
+		camera_->metadataAvailable.connect(this, &Capture::metadataAvailable);
 		camera_->requestCompleted.connect(this, &Capture::requestComplete);
 
 		if (camera_->start()) {
@@ -131,11 +142,42 @@ protected:
 			return TestFail;
 		}
 
-		for (std::unique_ptr<Request> &request : requests_) {
-			if (camera_->queueRequest(request.get())) {
-				cout << "Failed to queue request" << endl;
-				return TestFail;
-			}
+		/*
+		 * The vimc pipeline handler doesn't support metadata-only
+		 * requests, requests without buffers must be rejected.
+		 */
+		std::unique_ptr<Request> empty = camera_->createRequest();
+		if (camera_->queueRequest(empty.get()) != -EINVAL) {
+			cout << "Request without buffers not rejected" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Queue all requests but the last one in a batch, the same
+		 * request can't be queued twice.
+		 */
+		std::vector<Request *> requests;
+		for (std::unique_ptr<Request> &request : requests_)
+			requests.push_back(request.get());
+
+		Request *last = requests.back();
+		requests.back() = requests.front();
+
+		if (camera_->queueRequests(requests) != -EINVAL) {
+			cout << "Batch with duplicated request not rejected" << endl;
+			return TestFail;
+		}
+
+		requests.pop_back();
+
+		if (camera_->queueRequests(requests)) {
+			cout << "Failed to queue requests" << endl;
+			return TestFail;
+		}
+
+		if (camera_->queueRequest(last)) {
+			cout << "Failed to queue request" << endl;
+			return TestFail;
 		}
 
 		unsigned int nFrames = allocator_->buffers(stream).size() * 2;
@@ -160,6 +202,11 @@ protected:
 			return TestFail;
 		}
 
+		if (partialMetadataCount_ < completeRequestsCount_) {
+			cout << "Sensor timestamp not reported before completion" << endl;
+			return TestFail;
+		}
+
 		if (camera_->stop()) {
 			cout << "Failed to stop camera" << endl;
 			return TestFail;
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Test request scheduling priorities
+ */
+
+#include <iostream>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <libcamera/fence.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/unique_fd.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class RequestPriorityTest : public CameraTest, public Test
+{
+public:
+	RequestPriorityTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	void requestComplete(Request *request)
+	{
+		completed_.push_back(request->cookie());
+		dispatcher_->interrupt();
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		eventFd_ = UniqueFD(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+		if (!eventFd_.isValid()) {
+			cout << "Unable to create eventfd" << endl;
+			return TestFail;
+		}
+
+		config_ = camera_->generateConfiguration({ StreamRole::Viewfinder });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire() || camera_->configure(config_.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+		if (allocator_->allocate(stream) < 3) {
+			cout << "Not enough buffers available" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Request 0 waits on a fence. Request 1 has a higher priority and
+		 * is expected to bypass it, while request 2 has the default
+		 * priority and is expected to stay behind it.
+		 */
+		int efd = eventFd_.get();
+
+		for (unsigned int i = 0; i < 3; ++i) {
+			std::unique_ptr<Request> request = camera_->createRequest(i);
+			FrameBuffer *buffer = allocator_->buffers(stream)[i].get();
+
+			std::unique_ptr<Fence> fence;
+			if (i == 0)
+				fence = std::make_unique<Fence>(std::move(eventFd_));
+			if (i == 1)
+				request->setPriority(1);
+
+			if (request->addBuffer(stream, buffer, std::move(fence))) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		camera_->requestCompleted.connect(this, &RequestPriorityTest::requestComplete);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			if (camera_->queueRequest(request.get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		Timer timer;
+		timer.start(2s);
+		while (timer.isRunning() && completed_.size() < 3) {
+			/* Signal the fence once the bypassing request completes. */
+			if (completed_.size() == 1 && efd >= 0) {
+				uint64_t value = 1;
+				if (write(efd, &value, sizeof(value)) != sizeof(value)) {
+					cout << "Failed to signal fence" << endl;
+					return TestFail;
+				}
+				efd = -1;
+			}
+
+			dispatcher_->processEvents();
+		}
+
+		camera_->requestCompleted.disconnect();
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completed_ != std::vector<uint64_t>{ 1, 0, 2 }) {
+			cout << "Requests completed in unexpected order:";
+			for (uint64_t cookie : completed_)
+				cout << " " << cookie;
+			cout << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	EventDispatcher *dispatcher_;
+	UniqueFD eventFd_;
+
+	std::vector<std::unique_ptr<Request>> requests_;
+	std::vector<uint64_t> completed_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(RequestPriorityTest)
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Request recycling allocation test
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include "libcamera/internal/request.h"
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+std::atomic<bool> countAllocations{ false };
+std::atomic<unsigned int> allocations{ 0 };
+
+} /* namespace */
+
+void *operator new(std::size_t size)
+{
+	if (countAllocations.load(std::memory_order_relaxed))
+		allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void *ptr = std::malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, [[maybe_unused]] std::size_t size) noexcept
+{
+	std::free(ptr);
+}
+
+namespace {
+
+class RequestRecycling : public CameraTest, public Test
+{
+public:
+	RequestRecycling()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		allocator_.reset();
+	}
+
+	/*
+	 * Run one frame worth of request processing: recycle the request,
+	 * fill it with a buffer and controls, and complete it the same way a
+	 * pipeline handler would.
+	 */
+	int cycle(Request *request, const Stream *stream, FrameBuffer *buffer,
+		  unsigned int frame)
+	{
+		request->reuse(frame % 2 ? Request::ReuseBuffers : Request::Default);
+
+		if (!(frame % 2) && request->addBuffer(stream, buffer))
+			return TestFail;
+
+		request->controls().set(controls::Brightness, 0.5f);
+		request->metadata().set(controls::SensorTimestamp,
+					static_cast<int64_t>(frame));
+
+		if (!request->_d()->completeBuffer(buffer))
+			return TestFail;
+
+		request->_d()->complete();
+
+		if (request->status() != Request::RequestComplete)
+			return TestFail;
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+		if (allocator_->allocate(stream) < 0) {
+			cout << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		FrameBuffer *buffer = allocator_->buffers(stream)[0].get();
+
+		std::unique_ptr<Request> request = camera_->createRequest();
+		if (!request) {
+			cout << "Failed to create request" << endl;
+			return TestFail;
+		}
+
+		/* Warm up to let all containers reach their steady-state size. */
+		const unsigned int warmupFrames = 4;
+		const unsigned int nFrames = 1000;
+
+		for (unsigned int frame = 0; frame < warmupFrames + nFrames; frame++) {
+			if (frame == warmupFrames)
+				countAllocations = true;
+
+			int ret = cycle(request.get(), stream, buffer, frame);
+			if (ret != TestPass) {
+				countAllocations = false;
+				cout << "Failed to process frame " << frame << endl;
+				return ret;
+			}
+		}
+
+		countAllocations = false;
+
+		if (allocations) {
+			cout << allocations << " allocations in " << nFrames
+			     << " recycled requests" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(RequestRecycling)
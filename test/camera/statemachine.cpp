@@ -42,6 +42,9 @@ protected:
 		if (camera_->queueRequest(&request) != -EACCES)
 			return TestFail;
 
+		if (camera_->setCompletionExecutor(nullptr) != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		if (camera_->release())
 			return TestFail;
@@ -76,6 +79,9 @@ protected:
 		if (camera_->stop())
 			return TestFail;
 
+		if (camera_->setCompletionExecutor(nullptr))
+			return TestFail;
+
 		/* Test valid state transitions, end in Configured state. */
 		if (camera_->release())
 			return TestFail;
@@ -144,6 +150,9 @@ protected:
 		if (camera_->start() != -EACCES)
 			return TestFail;
 
+		if (camera_->setCompletionExecutor(nullptr) != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		std::unique_ptr<Request> request = camera_->createRequest();
 		if (!request)
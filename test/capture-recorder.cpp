@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Capture session recording test
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
+#include "libcamera/internal/capture_recorder.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class CaptureRecorderTest : public Test
+{
+protected:
+	int init()
+	{
+		char directory[] = "/tmp/libcamera.test.XXXXXX";
+		if (!mkdtemp(directory)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		directory_ = directory;
+		setenv("LIBCAMERA_RECORD", directory_.c_str(), 1);
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/* Test that controls survive an encoding round trip. */
+		ControlList controls(controls::controls);
+		controls.set(controls::ExposureTime, 10000);
+		controls.set(controls::AnalogueGain, 2.5f);
+		controls.set(controls::ColourGains, { 1.5f, 1.8f });
+
+		std::vector<uint8_t> encoded = CaptureChunk::encodeControls(controls);
+
+		ControlList decoded(controls::controls);
+		if (CaptureChunk::decodeControls(encoded, &decoded)) {
+			cerr << "Failed to decode controls" << endl;
+			return TestFail;
+		}
+
+		auto gains = decoded.get(controls::ColourGains);
+		if (decoded.size() != 3 ||
+		    decoded.get(controls::ExposureTime) != 10000 ||
+		    decoded.get(controls::AnalogueGain) != 2.5f ||
+		    !gains || (*gains)[1] != 1.8f) {
+			cerr << "Decoded controls don't match" << endl;
+			return TestFail;
+		}
+
+		/* Test that truncated data is rejected. */
+		encoded.pop_back();
+		ControlList truncated(controls::controls);
+		if (CaptureChunk::decodeControls(encoded, &truncated) != -EINVAL) {
+			cerr << "Truncated controls not rejected" << endl;
+			return TestFail;
+		}
+
+		/* Test that chunks are read back in order. */
+		CaptureRecorder recorder("test");
+		if (!recorder.isEnabled() || recorder.open() || !recorder.isOpen()) {
+			cerr << "Failed to start recording" << endl;
+			return TestFail;
+		}
+
+		std::vector<uint8_t> stats(1000, 0x5a);
+		recorder.write(CaptureChunk::Type::Request, 3, 0,
+			       CaptureChunk::encodeControls(controls));
+		recorder.write(CaptureChunk::Type::Statistics, 3, 123456789, stats);
+		recorder.close();
+
+		std::string path = recordingPath();
+		if (path.empty()) {
+			cerr << "Recording not found" << endl;
+			return TestFail;
+		}
+
+		CaptureRecording recording(path);
+		if (recording.open() || recording.pipe() != "test") {
+			cerr << "Failed to open recording" << endl;
+			return TestFail;
+		}
+
+		CaptureChunk chunk;
+		if (recording.next(&chunk) ||
+		    chunk.type != CaptureChunk::Type::Request || chunk.frame != 3) {
+			cerr << "Invalid request chunk" << endl;
+			return TestFail;
+		}
+
+		if (recording.next(&chunk) ||
+		    chunk.type != CaptureChunk::Type::Statistics ||
+		    chunk.timestamp != 123456789 || chunk.data != stats) {
+			cerr << "Invalid statistics chunk" << endl;
+			return TestFail;
+		}
+
+		if (recording.next(&chunk) != -ENODATA) {
+			cerr << "Recording not terminated" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		std::string path;
+		while (!(path = recordingPath()).empty())
+			unlink(path.c_str());
+
+		rmdir(directory_.c_str());
+	}
+
+private:
+	std::string recordingPath()
+	{
+		DIR *dir = opendir(directory_.c_str());
+		if (!dir)
+			return {};
+
+		std::string path;
+		while (struct dirent *entry = readdir(dir)) {
+			if (entry->d_name[0] != '.') {
+				path = directory_ + "/" + entry->d_name;
+				break;
+			}
+		}
+
+		closedir(dir);
+		return path;
+	}
+
+	std::string directory_;
+};
+
+TEST_REGISTER(CaptureRecorderTest)
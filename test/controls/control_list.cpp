@@ -39,6 +39,30 @@ protected:
 		CameraControlValidator validator(camera_.get());
 		ControlList list(controls::controls, &validator);
 
+		/*
+		 * Test that the validator reports the information of all the
+		 * camera controls, and only those.
+		 */
+		const ControlInfoMap &infoMap = camera_->controls();
+		for (const auto &[id, info] : infoMap) {
+			if (validator.info(id->id()) != &info) {
+				cout << "Invalid information for control "
+				     << id->name() << endl;
+				return TestFail;
+			}
+		}
+
+		unsigned int supported = 0;
+		for (const auto &[id, ctrl] : controls::controls) {
+			if (validator.validate(id))
+				supported++;
+		}
+
+		if (supported != infoMap.size() || validator.info(0)) {
+			cout << "Validator reports unsupported controls" << endl;
+			return TestFail;
+		}
+
 		/* Test that the list is initially empty. */
 		if (!list.empty()) {
 			cout << "List should to be empty" << endl;
@@ -246,6 +270,17 @@ protected:
 			return TestFail;
 		}
 
+		/* Iteration must visit controls in ascending numerical ID order. */
+		unsigned int previousId = 0;
+		for (const auto &ctrl : mergeList) {
+			if (ctrl.first <= previousId) {
+				cout << "Controls not sorted by ID" << endl;
+				return TestFail;
+			}
+
+			previousId = ctrl.first;
+		}
+
 		return TestPass;
 	}
 };
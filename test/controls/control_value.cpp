@@ -257,6 +257,38 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Values too large to be stored inline, and transitions between
+		 * inline and out-of-line storage in copies and moves.
+		 */
+		std::array<float, 16> matrix{};
+		for (unsigned int i = 0; i < matrix.size(); i++)
+			matrix[i] = i;
+
+		value.set(Span<float>(matrix));
+		ControlValue copy = value;
+		ControlValue moved = std::move(value);
+
+		Span<const float> copyResult = copy.get<Span<const float>>();
+		Span<const float> movedResult = moved.get<Span<const float>>();
+		if (!std::equal(matrix.begin(), matrix.end(), copyResult.begin()) ||
+		    !std::equal(matrix.begin(), matrix.end(), movedResult.begin())) {
+			cerr << "Control value mismatch after copying large array" << endl;
+			return TestFail;
+		}
+
+		if (!value.isNone()) {
+			cerr << "Control value not empty after move" << endl;
+			return TestFail;
+		}
+
+		copy.set(Rectangle{ 1, 2, 3, 4 });
+		moved = copy;
+		if (moved.get<Rectangle>() != Rectangle{ 1, 2, 3, 4 }) {
+			cerr << "Control value mismatch after shrinking storage" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Software converter test
+ */
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/converter/converter_software.h"
+
+#include "memfd_buffer.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+namespace {
+
+class SoftwareConverterTest : public Test
+{
+protected:
+	int init() override
+	{
+		inputCfg_.pixelFormat = formats::YUYV;
+		inputCfg_.size = Size(kWidth, kHeight);
+		inputCfg_.stride = kWidth * 2;
+
+		input_ = MemFdBuffer::create("input", inputCfg_.stride * kHeight);
+		if (!input_)
+			return TestFail;
+
+		/* Grey pixels with random luma, in the limited range. */
+		srand(42);
+		for (unsigned int i = 0; i < inputCfg_.stride * kHeight; i += 2) {
+			input_->data()[i] = 16 + rand() % 220;
+			input_->data()[i + 1] = 128;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		SoftwareConverter converter(nullptr);
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+
+		/* One unscaled copy and two converted outputs, one downscaled. */
+		std::vector<Stream> streams(3);
+		std::vector<StreamConfiguration> cfgs(3);
+		cfgs[0].pixelFormat = formats::YUYV;
+		cfgs[0].size = Size(kWidth, kHeight);
+		cfgs[1].pixelFormat = formats::XRGB8888;
+		cfgs[1].size = Size(kWidth / 2, kHeight / 2);
+		cfgs[2].pixelFormat = formats::BGR888;
+		cfgs[2].size = Size(kWidth, kHeight);
+
+		std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs;
+		std::vector<std::unique_ptr<MemFdBuffer>> buffers;
+		Request::BufferMap outputs;
+
+		for (unsigned int i = 0; i < cfgs.size(); i++) {
+			StreamConfiguration &cfg = cfgs[i];
+			std::tie(cfg.stride, cfg.frameSize) =
+				converter.strideAndFrameSize(cfg.pixelFormat, cfg.size);
+			cfg.setStream(&streams[i]);
+			outputCfgs.push_back(cfg);
+
+			buffers.push_back(MemFdBuffer::create("output", cfg.frameSize));
+			if (!buffers.back())
+				return TestFail;
+
+			outputs[&streams[i]] = buffers.back()->buffer();
+		}
+
+		if (converter.configure(inputCfg_, outputCfgs)) {
+			cerr << "Failed to configure the converter" << endl;
+			return TestFail;
+		}
+
+		if (converter.queueBuffers(input_->buffer(), outputs) != -EINVAL) {
+			cerr << "Buffers queued while stopped" << endl;
+			return TestFail;
+		}
+
+		unsigned int outputsCompleted = 0;
+		bool inputCompleted = false;
+
+		converter.outputBufferReady.connect(this, [&](FrameBuffer *) {
+			outputsCompleted++;
+		});
+		converter.inputBufferReady.connect(this, [&](FrameBuffer *buffer) {
+			inputCompleted = buffer == input_->buffer() &&
+					 outputsCompleted == outputs.size();
+		});
+
+		converter.start();
+
+		if (converter.queueBuffers(input_->buffer(), outputs)) {
+			cerr << "Failed to queue buffers" << endl;
+			return TestFail;
+		}
+
+		Timer timer;
+		timer.start(1s);
+		while (timer.isRunning() && !inputCompleted)
+			dispatcher->processEvents();
+
+		converter.stop();
+
+		if (!inputCompleted) {
+			cerr << "Conversion didn't complete" << endl;
+			return TestFail;
+		}
+
+		/* The unscaled YUYV output is a copy of the input. */
+		for (unsigned int y = 0; y < kHeight; y++) {
+			if (memcmp(buffers[0]->data() + y * cfgs[0].stride,
+				   input_->data() + y * inputCfg_.stride,
+				   kWidth * 2)) {
+				cerr << "YUYV output differs at line " << y << endl;
+				return TestFail;
+			}
+		}
+
+		/*
+		 * The RGB outputs are grey, and the downscaled output samples
+		 * odd lines and columns.
+		 */
+		for (unsigned int i = 1; i < cfgs.size(); i++) {
+			const StreamConfiguration &cfg = cfgs[i];
+			const unsigned int scale = kWidth / cfg.size.width;
+			const unsigned int bpp = cfg.pixelFormat == formats::XRGB8888 ? 4 : 3;
+
+			for (unsigned int y = 0; y < cfg.size.height; y++) {
+				const uint8_t *dst = buffers[i]->data() + y * cfg.stride;
+
+				for (unsigned int x = 0; x < cfg.size.width; x++, dst += bpp) {
+					unsigned int sx = x * scale + scale / 2;
+					unsigned int sy = y * scale + scale / 2;
+					int luma = input_->data()[sy * inputCfg_.stride + sx * 2];
+					int expected = std::lround((luma - 16) * 255.0 / 219.0);
+
+					for (unsigned int c = 0; c < 3; c++) {
+						if (abs(dst[c] - expected) > 1) {
+							cerr << cfg.pixelFormat << " output differs at "
+							     << x << "," << y << ": " << int(dst[c])
+							     << " instead of " << expected << endl;
+							return TestFail;
+						}
+					}
+
+					if (bpp == 4 && dst[3] != 255) {
+						cerr << "Invalid alpha value at " << x << "," << y << endl;
+						return TestFail;
+					}
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kWidth = 64;
+	static constexpr unsigned int kHeight = 48;
+
+	StreamConfiguration inputCfg_;
+	std::unique_ptr<MemFdBuffer> input_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(SoftwareConverterTest)
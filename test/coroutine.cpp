@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Coroutine completion queue test
+ */
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <iostream>
+#include <thread>
+
+#include <libcamera/coroutine.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+namespace {
+
+struct Task {
+	struct promise_type {
+		Task get_return_object() { return {}; }
+		suspend_never initial_suspend() { return {}; }
+		suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { terminate(); }
+	};
+};
+
+Task consume(CompletionQueue<unsigned int> &queue, unsigned int count,
+	     atomic<unsigned int> &received, atomic<bool> &ordered)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int value = co_await queue.next();
+		if (value != i)
+			ordered = false;
+
+		received++;
+	}
+}
+
+} /* namespace */
+
+class CoroutineTest : public Test
+{
+protected:
+	int run() override
+	{
+		atomic<unsigned int> received = 0;
+		atomic<bool> ordered = true;
+		unsigned int resumed = 0;
+
+		/* Available completions shall not suspend the consumer. */
+		CompletionQueue<unsigned int> queue(4, [&](coroutine_handle<> handle) {
+			resumed++;
+			handle.resume();
+		});
+
+		queue.push(0);
+		queue.push(1);
+
+		consume(queue, 4, received, ordered);
+		if (received != 2 || resumed != 0) {
+			cerr << "Consumer suspended with completions available" << endl;
+			return TestFail;
+		}
+
+		/* Pushing resumes the suspended consumer. */
+		queue.push(2);
+		queue.push(3);
+		if (received != 4 || resumed != 2 || !ordered) {
+			cerr << "Consumer not resumed by completions" << endl;
+			return TestFail;
+		}
+
+		/* The queue can't hold more completions than its capacity. */
+		for (unsigned int i = 0; i < queue.capacity(); i++)
+			queue.push(i);
+
+		if (queue.push(0)) {
+			cerr << "Completion pushed to a full queue" << endl;
+			return TestFail;
+		}
+
+		while (!queue.empty())
+			queue.pop();
+
+		/* Deliver completions from another thread. */
+		constexpr unsigned int kCount = 100000;
+		CompletionQueue<unsigned int> threaded(8);
+
+		received = 0;
+		consume(threaded, kCount, received, ordered);
+
+		thread producer([&]() {
+			for (unsigned int i = 0; i < kCount; i++) {
+				while (!threaded.push(i))
+					this_thread::yield();
+			}
+		});
+
+		producer.join();
+
+		if (received != kCount || !ordered) {
+			cerr << "Received " << received << " of " << kCount
+			     << " completions" << (ordered ? "" : " out of order")
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(CoroutineTest)
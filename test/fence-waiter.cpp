@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * FenceWaiter test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/fence.h>
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/fence_waiter.h"
+#include "libcamera/internal/framebuffer.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+class FenceWaiterTest : public Test
+{
+protected:
+	void fenceSignalled(FrameBuffer *buffer)
+	{
+		signalled_.push_back(buffer);
+	}
+
+	UniqueFD addFence(FrameBuffer *buffer)
+	{
+		UniqueFD fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+		if (!fd.isValid())
+			return {};
+
+		UniqueFD fence(dup(fd.get()));
+		buffer->_d()->setFence(std::make_unique<Fence>(std::move(fence)));
+
+		return fd;
+	}
+
+	int run()
+	{
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		FenceWaiter waiter;
+		Timer timeout;
+
+		waiter.signalled.connect(this, &FenceWaiterTest::fenceSignalled);
+
+		std::vector<std::unique_ptr<FrameBuffer>> buffers;
+		std::vector<UniqueFD> fds;
+
+		for (unsigned int i = 0; i < 3; i++) {
+			buffers.push_back(std::make_unique<FrameBuffer>(
+				std::vector<FrameBuffer::Plane>{}));
+
+			UniqueFD fd = addFence(buffers.back().get());
+			if (!fd.isValid()) {
+				cerr << "Failed to create fence" << endl;
+				return TestFail;
+			}
+
+			fds.push_back(std::move(fd));
+
+			if (waiter.add(buffers.back().get()) < 0) {
+				cerr << "Failed to wait for fence" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Nothing is signalled before the fences are. */
+		timeout.start(50ms);
+		while (timeout.isRunning())
+			dispatcher->processEvents();
+
+		if (!signalled_.empty()) {
+			cerr << "Fence reported before being signalled" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Stop waiting for the second fence, and signal all of them.
+		 * Only the first and third buffers must be reported, once.
+		 */
+		waiter.remove(buffers[1].get());
+
+		for (UniqueFD &fd : fds) {
+			uint64_t value = 1;
+			if (write(fd.get(), &value, sizeof(value)) != sizeof(value)) {
+				cerr << "Failed to signal fence" << endl;
+				return TestFail;
+			}
+		}
+
+		timeout.start(100ms);
+		while (timeout.isRunning())
+			dispatcher->processEvents();
+
+		if (signalled_.size() != 2 ||
+		    std::find(signalled_.begin(), signalled_.end(), buffers[0].get()) == signalled_.end() ||
+		    std::find(signalled_.begin(), signalled_.end(), buffers[2].get()) == signalled_.end()) {
+			cerr << "Unexpected signalled fences" << endl;
+			return TestFail;
+		}
+
+		/* The signalled fences can be closed and waited for again. */
+		signalled_.clear();
+		buffers[0]->releaseFence();
+
+		UniqueFD fd = addFence(buffers[0].get());
+		if (!fd.isValid() || waiter.add(buffers[0].get()) < 0) {
+			cerr << "Failed to wait for fence again" << endl;
+			return TestFail;
+		}
+
+		uint64_t value = 1;
+		if (write(fd.get(), &value, sizeof(value)) != sizeof(value)) {
+			cerr << "Failed to signal fence" << endl;
+			return TestFail;
+		}
+
+		timeout.start(100ms);
+		while (timeout.isRunning() && signalled_.empty())
+			dispatcher->processEvents();
+
+		if (signalled_.size() != 1 || signalled_[0] != buffers[0].get()) {
+			cerr << "Fence not signalled after reuse" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	std::vector<FrameBuffer *> signalled_;
+};
+
+TEST_REGISTER(FenceWaiterTest)
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * FlatMap tests
+ */
+
+/*
+ * Include first to ensure the header is self-contained, as flat_map.cpp only
+ * contains documentation.
+ */
+#include <libcamera/base/flat_map.h>
+
+#include <iostream>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class FlatMapTest : public Test
+{
+protected:
+	template<std::size_t N>
+	int checkSorted(const FlatMap<int, int, N> &map)
+	{
+		for (auto it = map.begin(); it != map.end(); ++it) {
+			if (it != map.begin() && (it - 1)->first >= it->first) {
+				cerr << "Entries not sorted by key" << endl;
+				return TestFail;
+			}
+
+			if (it->second != it->first * 10) {
+				cerr << "Entry " << it->first << " has wrong value "
+				     << it->second << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		FlatMap<int, int, 4> map;
+
+		if (!map.empty() || map.size() != 0 || map.begin() != map.end()) {
+			cerr << "Default-constructed map is not empty" << endl;
+			return TestFail;
+		}
+
+		/* Insert entries out of order, within the inline storage. */
+		map[3] = 30;
+		map.emplace(1, 10);
+		map.insert({ 2, 20 });
+
+		if (map.size() != 3 || checkSorted(map) != TestPass) {
+			cerr << "Failed to insert inline entries" << endl;
+			return TestFail;
+		}
+
+		if (map.emplace(2, 0).second || map.at(2) != 20) {
+			cerr << "Duplicate key inserted" << endl;
+			return TestFail;
+		}
+
+		if (!map.contains(1) || map.count(4) || map.find(4) != map.end()) {
+			cerr << "Lookup failed" << endl;
+			return TestFail;
+		}
+
+		/* Grow past the inline storage. */
+		for (int key : { 8, 0, 5, 7, 4, 6 })
+			map[key] = key * 10;
+
+		if (map.size() != 9 || checkSorted(map) != TestPass) {
+			cerr << "Failed to insert entries past inline capacity" << endl;
+			return TestFail;
+		}
+
+		for (int key = 0; key < 9; key++) {
+			if (map.at(key) != key * 10) {
+				cerr << "Lookup of " << key << " failed" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Copy and compare. */
+		FlatMap<int, int, 4> copy = map;
+		if (copy != map) {
+			cerr << "Copied map differs" << endl;
+			return TestFail;
+		}
+
+		/* Erase entries. */
+		if (map.erase(4) != 1 || map.erase(4) != 0 || map.contains(4)) {
+			cerr << "Failed to erase entry by key" << endl;
+			return TestFail;
+		}
+
+		auto it = map.erase(map.begin());
+		if (it != map.begin() || it->first != 1 || map.size() != 7 ||
+		    checkSorted(map) != TestPass) {
+			cerr << "Failed to erase entry by iterator" << endl;
+			return TestFail;
+		}
+
+		if (copy == map) {
+			cerr << "Modified map equals its copy" << endl;
+			return TestFail;
+		}
+
+		map.clear();
+		if (!map.empty() || map.begin() != map.end()) {
+			cerr << "Map not empty after clear" << endl;
+			return TestFail;
+		}
+
+		/* Initializer list construction with inline erasure. */
+		FlatMap<int, int, 4> small{ { 2, 20 }, { 0, 0 }, { 1, 10 } };
+		small.erase(0);
+		if (small.size() != 2 || small.begin()->first != 1 ||
+		    checkSorted(small) != TestPass) {
+			cerr << "Failed to erase inline entry" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(FlatMapTest)
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Frame rate governor test
+ */
+
+#include <array>
+#include <iostream>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
+#include "libcamera/internal/frame_rate_governor.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class FrameRateGovernorTest : public Test
+{
+protected:
+	static constexpr int64_t kMinDuration = 33333;
+	static constexpr int64_t kMaxDuration = 1000000;
+
+	/*
+	 * Simulate an application that holds a single request for \a hold
+	 * microseconds before queuing it again, for \a requests requests.
+	 * Return the frame duration the camera runs at in the end.
+	 */
+	int64_t simulate(FrameRateGovernor &governor, int64_t hold,
+			 unsigned int requests, int64_t duration)
+	{
+		for (unsigned int i = 0; i < requests; i++) {
+			ControlList controls(controls::controls);
+			governor.requestQueued(controls);
+
+			const auto &limits = controls.get(controls::FrameDurationLimits);
+			if (limits)
+				duration = (*limits)[0];
+
+			/*
+			 * The frames captured while the application holds the
+			 * request are dropped.
+			 */
+			int32_t dropped = (hold + duration - 1) / duration - 1;
+
+			ControlList metadata(controls::controls);
+			metadata.set(controls::FrameDuration, duration);
+			if (dropped > 0) {
+				metadata.set(controls::FramesDropped, dropped);
+				metadata.set(controls::FrameDropCause,
+					     controls::FrameDropStarvation);
+			}
+
+			governor.requestCompleted(metadata);
+		}
+
+		return duration;
+	}
+
+	int run() override
+	{
+		ControlInfo info(kMinDuration, kMaxDuration);
+
+		/* A 5 fps consumer should lower the frame rate. */
+		FrameRateGovernor governor(info);
+		governor.start(nullptr);
+
+		int64_t duration = simulate(governor, 200000, 200, kMinDuration);
+		if (duration < 100000 || duration > 250000) {
+			cerr << "Frame duration " << duration
+			     << "us doesn't match the demand" << endl;
+			return TestFail;
+		}
+
+		/* The frame rate should go back up when the demand increases. */
+		duration = simulate(governor, 10000, 2000, duration);
+		if (duration != kMinDuration || governor.frameDuration()) {
+			cerr << "Frame duration " << duration
+			     << "us not restored" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Setting the frame duration limits in the application should
+		 * deactivate the governor.
+		 */
+		ControlList controls(controls::controls);
+		controls.set(controls::FrameDurationLimits,
+			     array<int64_t, 2>{ kMinDuration, kMinDuration });
+		governor.requestQueued(controls);
+
+		duration = simulate(governor, 200000, 200, kMinDuration);
+		if (governor.isActive() || duration != kMinDuration) {
+			cerr << "Governor still active" << endl;
+			return TestFail;
+		}
+
+		/* Neither should it be active when started with the limits. */
+		governor.start(&controls);
+		if (governor.isActive()) {
+			cerr << "Governor active with start limits" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(FrameRateGovernorTest)
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Histogram tests
+ */
+
+#include <cmath>
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#include "libipa/histogram.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace ipa;
+
+class HistogramTest : public Test
+{
+protected:
+	int check(const Histogram &hist, size_t bins, uint64_t total)
+	{
+		if (hist.bins() != bins || hist.total() != total) {
+			cerr << "Histogram has " << hist.bins() << " bins and "
+			     << hist.total() << " values, expected " << bins
+			     << " and " << total << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		Histogram hist;
+
+		if (check(hist, 0, 0) != TestPass)
+			return TestFail;
+
+		std::vector<uint32_t> data = { 1, 2, 3, 4 };
+		hist.assign(data);
+		if (check(hist, 4, 10) != TestPass)
+			return TestFail;
+
+		if (hist.cumulativeFrequency(3) != 6) {
+			cerr << "Invalid cumulative frequency "
+			     << hist.cumulativeFrequency(3) << endl;
+			return TestFail;
+		}
+
+		if (hist.quantile(0.3) != 2.0) {
+			cerr << "Invalid quantile " << hist.quantile(0.3) << endl;
+			return TestFail;
+		}
+
+		/* Rebuild the histogram in place with fewer bins. */
+		data = { 5, 5 };
+		hist.assign(data, [](uint32_t x) { return x * 2; });
+		if (check(hist, 2, 20) != TestPass)
+			return TestFail;
+
+		if (hist.quantile(0.5) != 1.0) {
+			cerr << "Invalid quantile after rebuild "
+			     << hist.quantile(0.5) << endl;
+			return TestFail;
+		}
+
+		/* And with more bins, it must match a new histogram. */
+		data = { 10, 10, 10, 10 };
+		hist.assign(data);
+		Histogram ref(data);
+		if (check(hist, ref.bins(), ref.total()) != TestPass)
+			return TestFail;
+
+		double mean = hist.interQuantileMean(0, 1);
+		if (mean != ref.interQuantileMean(0, 1) || std::abs(mean - 2.0) > 1e-9) {
+			cerr << "Invalid inter-quantile mean " << mean << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(HistogramTest)
@@ -258,6 +258,33 @@ protected:
 		return 0;
 	}
 
+	int testLargeReverse()
+	{
+		IPCUnixSocket::Payload message, response;
+		int ret;
+
+		/*
+		 * Send enough data to wrap around the shared memory rings
+		 * multiple times.
+		 */
+		message.data.resize(64 * 1024);
+		for (unsigned int i = 0; i < 16; i++) {
+			for (unsigned int j = 1; j < message.data.size(); j++)
+				message.data[j] = i + j;
+			message.data[0] = CMD_REVERSE;
+
+			ret = call(message, &response);
+			if (ret)
+				return ret;
+
+			std::reverse(response.data.begin() + 1, response.data.end());
+			if (message.data != response.data)
+				return TestFail;
+		}
+
+		return 0;
+	}
+
 	int testEmptyFail()
 	{
 		IPCUnixSocket::Payload message;
@@ -306,6 +333,37 @@ protected:
 		return 0;
 	}
 
+	int testBatched()
+	{
+		/*
+		 * Queue fire and forget messages with different numbers of FDs,
+		 * closing the FDs right away, and make sure they are delivered
+		 * before the next call.
+		 */
+		for (unsigned int num : { 2, 3 }) {
+			IPCUnixSocket::Payload message;
+			int size;
+
+			size = prepareFDs(&message, num);
+			if (size < 0)
+				return size;
+
+			message.data.resize(1 + sizeof(size));
+			message.data[0] = CMD_LEN_CMP;
+			memcpy(message.data.data() + 1, &size, sizeof(size));
+
+			int ret = ipc_.sendBatched({ message.data }, message.fds);
+
+			for (int fd : message.fds)
+				close(fd);
+
+			if (ret)
+				return TestFail;
+		}
+
+		return testReverse();
+	}
+
 	int testFdOrder()
 	{
 		IPCUnixSocket::Payload message, response;
@@ -382,6 +440,12 @@ protected:
 			return TestFail;
 		}
 
+		/* Test large messages. */
+		if (testLargeReverse()) {
+			cerr << "Large reverse array test failed" << endl;
+			return TestFail;
+		}
+
 		/* Test that an empty message fails. */
 		if (testEmptyFail()) {
 			cerr << "Empty message test failed" << endl;
@@ -400,6 +464,12 @@ protected:
 			return TestFail;
 		}
 
+		/* Test batched messages. */
+		if (testBatched()) {
+			cerr << "Batched messages test failed" << endl;
+			return TestFail;
+		}
+
 		/* Test order of file descriptors. */
 		if (testFdOrder()) {
 			cerr << "fd order test failed" << endl;
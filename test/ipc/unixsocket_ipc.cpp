@@ -9,6 +9,7 @@
 #include <fcntl.h>
 #include <iostream>
 #include <limits.h>
+#include <map>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -34,6 +35,7 @@ enum {
 	CmdExit = 0,
 	CmdGetSync = 1,
 	CmdSetAsync = 2,
+	CmdGetPid = 3,
 };
 
 const int32_t kInitialValue = 1337;
@@ -43,7 +45,7 @@ class UnixSocketTestIPCSlave
 {
 public:
 	UnixSocketTestIPCSlave()
-		: value_(kInitialValue), exitCode_(EXIT_FAILURE), exit_(false)
+		: exitCode_(EXIT_FAILURE), exit_(false)
 	{
 		dispatcher_ = Thread::current()->eventDispatcher();
 		ipc_.readyRead.connect(this, &UnixSocketTestIPCSlave::readyRead);
@@ -78,22 +80,32 @@ private:
 
 		IPCMessage ipcMessage(message);
 		uint32_t cmd = ipcMessage.header().cmd;
+		uint32_t channel = ipcMessage.header().channel;
+
+		/* Each channel of a shared slave has its own value. */
+		auto value = values_.try_emplace(channel, kInitialValue).first;
 
 		switch (cmd) {
 		case CmdExit: {
-			exit_ = true;
+			values_.erase(value);
+			exit_ = values_.empty();
 			break;
 		}
 
-		case CmdGetSync: {
-			IPCMessage::Header header = { cmd, ipcMessage.header().cookie };
+		case CmdGetSync:
+		case CmdGetPid: {
+			IPCMessage::Header header = {
+				cmd, ipcMessage.header().cookie,
+				ipcMessage.header().channel
+			};
 			IPCMessage response(header);
 
+			int32_t data = cmd == CmdGetPid ? getpid() : value->second;
 			vector<uint8_t> buf;
-			tie(buf, ignore) = IPADataSerializer<int32_t>::serialize(value_);
+			tie(buf, ignore) = IPADataSerializer<int32_t>::serialize(data);
 			response.data().insert(response.data().end(), buf.begin(), buf.end());
 
-			ret = ipc_.send(response.payload());
+			ret = response.send(&ipc_);
 			if (ret < 0) {
 				cerr << "Reply failed" << endl;
 				stop(ret);
@@ -102,7 +114,7 @@ private:
 		}
 
 		case CmdSetAsync: {
-			value_ = IPADataSerializer<int32_t>::deserialize(ipcMessage.data());
+			value->second = IPADataSerializer<int32_t>::deserialize(ipcMessage.data());
 			break;
 		}
 		}
@@ -114,7 +126,7 @@ private:
 		exit_ = true;
 	}
 
-	int32_t value_;
+	std::map<uint32_t, int32_t> values_;
 
 	IPCUnixSocket ipc_;
 	EventDispatcher *dispatcher_;
@@ -131,11 +143,16 @@ protected:
 	}
 
 	int setValue(int32_t val)
+	{
+		return setValue(ipc_.get(), val);
+	}
+
+	int setValue(IPCPipe *ipc, int32_t val)
 	{
 		IPCMessage msg(CmdSetAsync);
 		tie(msg.data(), ignore) = IPADataSerializer<int32_t>::serialize(val);
 
-		int ret = ipc_->sendAsync(msg);
+		int ret = ipc->sendAsync(msg);
 		if (ret < 0) {
 			cerr << "Failed to call set value" << endl;
 			return ret;
@@ -146,10 +163,15 @@ protected:
 
 	int getValue()
 	{
-		IPCMessage msg(CmdGetSync);
+		return getValue(ipc_.get(), CmdGetSync);
+	}
+
+	int getValue(IPCPipe *ipc, uint32_t cmd)
+	{
+		IPCMessage msg(cmd);
 		IPCMessage buf;
 
-		int ret = ipc_->sendSync(msg, &buf);
+		int ret = ipc->sendSync(msg, &buf);
 		if (ret < 0) {
 			cerr << "Failed to call get value" << endl;
 			return ret;
@@ -158,11 +180,127 @@ protected:
 		return IPADataSerializer<int32_t>::deserialize(buf.data());
 	}
 
+	int testPipelined()
+	{
+		/*
+		 * Pipeline two calls around a value change and collect their
+		 * responses in reverse order.
+		 */
+		IPCMessage first(IPCMessage::Header{ CmdGetSync, 1, 0 });
+		IPCMessage second(IPCMessage::Header{ CmdGetSync, 2, 0 });
+		IPCMessage firstResponse;
+		IPCMessage secondResponse;
+
+		IPCPendingCall firstCall = ipc_->sendPipelined(first);
+		if (setValue(kInitialValue) < 0)
+			return TestFail;
+		IPCPendingCall secondCall = ipc_->sendPipelined(second);
+
+		if (!firstCall.isValid() || !secondCall.isValid()) {
+			cerr << "Failed to send pipelined calls" << endl;
+			return TestFail;
+		}
+
+		if (secondCall.wait(&secondResponse) < 0 ||
+		    !firstCall.isComplete() ||
+		    firstCall.wait(&firstResponse) < 0) {
+			cerr << "Failed to wait for pipelined calls" << endl;
+			return TestFail;
+		}
+
+		if (IPADataSerializer<int32_t>::deserialize(firstResponse.data()) != kChangedValue ||
+		    IPADataSerializer<int32_t>::deserialize(secondResponse.data()) != kInitialValue) {
+			cerr << "Wrong pipelined call responses" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testShared()
+	{
+		/*
+		 * Pipes created for the same worker share its process when
+		 * requested, and each of them is routed to its own state.
+		 */
+		setenv("LIBCAMERA_IPA_SHARED_WORKERS", "1", 1);
+		auto first = std::make_unique<IPCPipeUnixSocket>("", self().c_str());
+		auto second = std::make_unique<IPCPipeUnixSocket>("", self().c_str());
+		unsetenv("LIBCAMERA_IPA_SHARED_WORKERS");
+
+		if (!first->isConnected() || !second->isConnected()) {
+			cerr << "Failed to create shared IPCPipes" << endl;
+			return TestFail;
+		}
+
+		int firstPid = getValue(first.get(), CmdGetPid);
+		int secondPid = getValue(second.get(), CmdGetPid);
+		if (firstPid <= 0 || firstPid != secondPid) {
+			cerr << "Pipes don't share the worker process" << endl;
+			return TestFail;
+		}
+
+		if (setValue(second.get(), kChangedValue) < 0)
+			return TestFail;
+
+		if (getValue(first.get(), CmdGetSync) != kInitialValue ||
+		    getValue(second.get(), CmdGetSync) != kChangedValue) {
+			cerr << "Wrong values on shared channels" << endl;
+			return TestFail;
+		}
+
+		if (exit(first.get()) < 0 || exit(second.get()) < 0)
+			return TestFail;
+
+		return TestPass;
+	}
+
+	int testSpare()
+	{
+		/*
+		 * The second pipe is handed a spare worker started when the
+		 * first one was created.
+		 */
+		setenv("LIBCAMERA_IPA_SPARE_WORKERS", "1", 1);
+		auto first = std::make_unique<IPCPipeUnixSocket>("", self().c_str());
+		auto second = std::make_unique<IPCPipeUnixSocket>("", self().c_str());
+		unsetenv("LIBCAMERA_IPA_SPARE_WORKERS");
+
+		if (!first->isConnected() || !second->isConnected()) {
+			cerr << "Failed to create IPCPipes with spare workers" << endl;
+			return TestFail;
+		}
+
+		int firstPid = getValue(first.get(), CmdGetPid);
+		int secondPid = getValue(second.get(), CmdGetPid);
+		if (firstPid <= 0 || secondPid <= 0 || firstPid == secondPid) {
+			cerr << "Pipes don't use separate workers" << endl;
+			return TestFail;
+		}
+
+		if (getValue(second.get(), CmdGetSync) != kInitialValue) {
+			cerr << "Wrong value on spare worker" << endl;
+			return TestFail;
+		}
+
+		if (exit(first.get()) < 0 || exit(second.get()) < 0)
+			return TestFail;
+
+		IPCPipeUnixSocket::releaseSpareWorkers();
+
+		return TestPass;
+	}
+
 	int exit()
+	{
+		return exit(ipc_.get());
+	}
+
+	int exit(IPCPipe *ipc)
 	{
 		IPCMessage msg(CmdExit);
 
-		int ret = ipc_->sendAsync(msg);
+		int ret = ipc->sendAsync(msg);
 		if (ret < 0) {
 			cerr << "Failed to call exit" << endl;
 			return ret;
@@ -199,13 +337,21 @@ protected:
 			return TestFail;
 		}
 
+		ret = testPipelined();
+		if (ret != TestPass)
+			return ret;
+
 		ret = exit();
 		if (ret < 0) {
 			cerr << "Failed to exit: " << strerror(-ret) << endl;
 			return TestFail;
 		}
 
-		return TestPass;
+		ret = testShared();
+		if (ret != TestPass)
+			return ret;
+
+		return testSpare();
 	}
 
 private:
@@ -220,8 +366,11 @@ private:
  */
 int main(int argc, char **argv)
 {
-	/* IPCPipeUnixSocket passes IPA module path in argv[1] */
-	if (argc == 3) {
+	/*
+	 * IPCPipeUnixSocket passes IPA module path in argv[1], and the socket
+	 * fd in argv[2], followed by "shared" for shared workers.
+	 */
+	if (argc == 3 || argc == 4) {
 		UniqueFD ipcfd = UniqueFD(std::stoi(argv[2]));
 		UnixSocketTestIPCSlave slave;
 		return slave.run(std::move(ipcfd));
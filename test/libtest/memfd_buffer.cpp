@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Memfd-backed frame buffer for tests
+ */
+
+#include "memfd_buffer.h"
+
+#include <iostream>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/shared_fd.h>
+#include <libcamera/base/unique_fd.h>
+
+using namespace libcamera;
+
+MemFdBuffer::MemFdBuffer(size_t size)
+	: size_(size), data_(nullptr)
+{
+}
+
+MemFdBuffer::~MemFdBuffer()
+{
+	if (data_)
+		munmap(data_, size_);
+}
+
+/*
+ * Allocate a single-plane frame buffer of size bytes, mapped in the test
+ * process. An error mentioning the buffer name is printed on failure.
+ */
+std::unique_ptr<MemFdBuffer> MemFdBuffer::create(const char *name, size_t size)
+{
+	std::unique_ptr<MemFdBuffer> buffer(new MemFdBuffer(size));
+
+	UniqueFD fd = MemFd::create(name, size);
+	void *map = MAP_FAILED;
+	if (fd.isValid())
+		map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   fd.get(), 0);
+
+	if (map == MAP_FAILED) {
+		std::cerr << "Failed to allocate " << name << " buffer" << std::endl;
+		return nullptr;
+	}
+
+	buffer->data_ = static_cast<uint8_t *>(map);
+
+	FrameBuffer::Plane plane;
+	plane.fd = SharedFD(std::move(fd));
+	plane.offset = 0;
+	plane.length = size;
+	buffer->buffer_ = std::make_unique<FrameBuffer>(std::vector<FrameBuffer::Plane>{ plane });
+
+	return buffer;
+}
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Memfd-backed frame buffer for tests
+ */
+
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libcamera/framebuffer.h>
+
+class MemFdBuffer
+{
+public:
+	static std::unique_ptr<MemFdBuffer> create(const char *name, size_t size);
+
+	~MemFdBuffer();
+
+	uint8_t *data() const { return data_; }
+	size_t size() const { return size_; }
+	libcamera::FrameBuffer *buffer() const { return buffer_.get(); }
+
+private:
+	MemFdBuffer(size_t size);
+
+	size_t size_;
+	uint8_t *data_;
+	std::unique_ptr<libcamera::FrameBuffer> buffer_;
+};
@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Asynchronous logging test
+ */
+
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/logging.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+LOG_DEFINE_CATEGORY(LogAsyncTest)
+
+class LogAsyncTest : public Test
+{
+protected:
+	static constexpr unsigned int kThreads = 4;
+	static constexpr unsigned int kMessages = 100;
+
+	int init() override
+	{
+		/* Enable asynchronous logging before the logger is created. */
+		setenv("LIBCAMERA_LOG_ASYNC", "1", 1);
+
+		fd_ = open("/tmp", O_TMPFILE | O_RDWR, S_IRUSR | S_IWUSR);
+		if (fd_ < 0) {
+			cerr << "Failed to open tmp log file" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	string readLog()
+	{
+		string log;
+		char buf[4096];
+		off_t offset = 0;
+
+		while (true) {
+			ssize_t ret = pread(fd_, buf, sizeof(buf), offset);
+			if (ret <= 0)
+				break;
+
+			log.append(buf, ret);
+			offset += ret;
+		}
+
+		return log;
+	}
+
+	int verifyOutput(const string &log)
+	{
+		vector<unsigned int> sequences(kThreads, 0);
+		istringstream iss(log);
+		string line;
+
+		while (getline(iss, line)) {
+			size_t pos = line.find("thread ");
+			if (pos == string::npos) {
+				cout << "Unexpected log line: " << line << endl;
+				return TestFail;
+			}
+
+			unsigned int thread;
+			unsigned int message;
+			if (sscanf(line.c_str() + pos, "thread %u message %u",
+				   &thread, &message) != 2 || thread >= kThreads) {
+				cout << "Invalid log line: " << line << endl;
+				return TestFail;
+			}
+
+			/* Messages from each thread must be written in order. */
+			if (message != sequences[thread]++) {
+				cout << "Out of order log line: " << line << endl;
+				return TestFail;
+			}
+		}
+
+		for (unsigned int i = 0; i < kThreads; i++) {
+			if (sequences[i] != kMessages) {
+				cout << "Missing log messages from thread " << i
+				     << ": " << sequences[i] << "/" << kMessages
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		char path[32];
+		snprintf(path, sizeof(path), "/proc/self/fd/%u", fd_);
+
+		if (logSetFile(path) < 0) {
+			cerr << "Failed to set log file" << endl;
+			return TestFail;
+		}
+
+		vector<thread> threads;
+		for (unsigned int i = 0; i < kThreads; i++) {
+			threads.emplace_back([i]() {
+				for (unsigned int j = 0; j < kMessages; j++)
+					LOG(LogAsyncTest, Info)
+						<< "thread " << i << " message " << j;
+			});
+		}
+
+		for (thread &t : threads)
+			t.join();
+
+		/* Wait for the messages to be written. */
+		const size_t expected = kThreads * kMessages;
+		string log;
+
+		for (unsigned int i = 0; i < 100; i++) {
+			log = readLog();
+
+			size_t lines = 0;
+			for (char c : log)
+				lines += c == '\n';
+
+			if (lines >= expected)
+				break;
+
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+
+		return verifyOutput(log);
+	}
+
+	void cleanup() override
+	{
+		if (fd_ >= 0)
+			close(fd_);
+	}
+
+private:
+	int fd_ = -1;
+};
+
+TEST_REGISTER(LogAsyncTest)
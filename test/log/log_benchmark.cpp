@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Logging overhead benchmark
+ */
+
+#include <iostream>
+#include <string>
+#include <time.h>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/logging.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+LOG_DEFINE_CATEGORY(LogBenchmark)
+
+namespace {
+
+/*
+ * Mimic the logging performed by V4L2VideoDevice::dequeueBuffer(), with a
+ * prefix identifying the device.
+ */
+class Device : public Loggable
+{
+public:
+	Device()
+		: sequence_(0)
+	{
+	}
+
+	void dequeueBuffer(unsigned int index)
+	{
+		LOG(LogBenchmark, Debug) << "Dequeuing buffer " << index;
+
+		sequence_++;
+	}
+
+	unsigned int sequence() const { return sequence_; }
+
+protected:
+	std::string logPrefix() const override
+	{
+		return "'video0'[cap]";
+	}
+
+private:
+	unsigned int sequence_;
+};
+
+} /* namespace */
+
+class LogBenchmarkTest : public Test
+{
+protected:
+	int init() override
+	{
+		/* Don't output anything, to only measure the logging overhead. */
+		logSetTarget(LoggingTargetNone);
+
+		cout << "case,ns_per_call" << endl;
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		logSetLevel("LogBenchmark", "INFO");
+		benchmark("dequeue-debug-disabled");
+
+		/*
+		 * Measure the cost of constructing the messages, which disabled
+		 * messages used to incur as well. The messages are compiled out
+		 * when log_min_severity is above debug, and enabling them has
+		 * no effect.
+		 */
+		logSetLevel("LogBenchmark", "DEBUG");
+		benchmark("dequeue-debug-enabled");
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kIterations = 1000000;
+
+	void benchmark(const char *name)
+	{
+		Device device;
+		timespec start = {};
+		timespec end = {};
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		for (unsigned int i = 0; i < kIterations; i++)
+			device.dequeueBuffer(i % 4);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+		int64_t duration = (end.tv_sec - start.tv_sec) * 1000000000LL +
+				   (int64_t)end.tv_nsec - (int64_t)start.tv_nsec;
+
+		cout << name << "," << static_cast<double>(duration) / device.sequence()
+		     << endl;
+	}
+};
+
+TEST_REGISTER(LogBenchmarkTest)
@@ -7,6 +7,10 @@
 
 #include <iostream>
 
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/shared_fd.h>
+
+#include <libcamera/framebuffer.h>
 #include <libcamera/framebuffer_allocator.h>
 
 #include "libcamera/internal/mapped_framebuffer.h"
@@ -70,7 +74,7 @@ protected:
 	int run() override
 	{
 		const std::unique_ptr<FrameBuffer> &buffer = allocator_->buffers(stream_).front();
-		std::vector<MappedBuffer> maps;
+		std::vector<MappedFrameBuffer> maps;
 
 		MappedFrameBuffer map(buffer.get(), MappedFrameBuffer::MapFlag::Read);
 		if (!map.isValid()) {
@@ -103,6 +107,45 @@ protected:
 			return TestFail;
 		}
 
+		/* Mappings with identical flags are shared. */
+		MappedFrameBuffer read_map(buffer.get(), MappedFrameBuffer::MapFlag::Read);
+		if (!read_map.isValid() ||
+		    read_map.planes()[0].data() != maps[0].planes()[0].data()) {
+			cout << "Read mappings of the same buffer are not shared" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Planes stored in the same dmabuf share a file descriptor and a
+		 * mapping, even when created with duplicated descriptors.
+		 */
+		SharedFD fd(MemFd::create("mapped-buffer", 8192));
+		if (!fd.isValid()) {
+			cout << "Failed to create memfd" << endl;
+			return TestFail;
+		}
+
+		std::vector<FrameBuffer::Plane> planes(2);
+		planes[0].fd = fd;
+		planes[0].offset = 0;
+		planes[0].length = 4096;
+		planes[1].fd = SharedFD(fd.get());
+		planes[1].offset = 4096;
+		planes[1].length = 4096;
+
+		FrameBuffer shared(planes);
+		if (shared.planes()[0].fd != shared.planes()[1].fd) {
+			cout << "Planes of the same dmabuf don't share a descriptor" << endl;
+			return TestFail;
+		}
+
+		MappedFrameBuffer shared_map(&shared, MappedFrameBuffer::MapFlag::Read);
+		if (!shared_map.isValid() ||
+		    shared_map.planes()[1].data() != shared_map.planes()[0].data() + 4096) {
+			cout << "Planes of the same dmabuf are not mapped once" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
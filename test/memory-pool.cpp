@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Memory pool test
+ */
+
+#include <iostream>
+#include <thread>
+
+#include <libcamera/base/memory_pool.h>
+#include <libcamera/base/message.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class CountingObject : public Object
+{
+public:
+	CountingObject()
+		: count_(0)
+	{
+	}
+
+	void method(int value)
+	{
+		count_ += value;
+	}
+
+	unsigned int count() const { return count_; }
+
+private:
+	unsigned int count_;
+};
+
+class MemoryPoolTest : public Test
+{
+protected:
+	int run()
+	{
+		/* Test that freed blocks are reused by the allocating thread. */
+		void *block = MemoryPool::allocate(48);
+		MemoryPool::deallocate(block, 48);
+
+		uint64_t allocations = MemoryPool::heapAllocations();
+
+		void *other = MemoryPool::allocate(48);
+		MemoryPool::deallocate(other, 48);
+
+		if (other != block ||
+		    MemoryPool::heapAllocations() != allocations) {
+			cout << "Freed block not reused" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Test that blocks freed by another thread are returned to the
+		 * allocating thread.
+		 */
+		block = MemoryPool::allocate(48);
+		std::thread([block]() { MemoryPool::deallocate(block, 48); }).join();
+
+		other = MemoryPool::allocate(48);
+		MemoryPool::deallocate(other, 48);
+
+		if (other != block ||
+		    MemoryPool::heapAllocations() != allocations) {
+			cout << "Remotely freed block not reused" << endl;
+			return TestFail;
+		}
+
+		/* Test freeing blocks after the allocating thread has exited. */
+		std::thread([&block]() { block = MemoryPool::allocate(200); }).join();
+		MemoryPool::deallocate(block, 200);
+
+		/*
+		 * Test that queued method invocations don't allocate memory
+		 * from the heap once the pool is warm.
+		 */
+		static constexpr unsigned int kBatchSize = 16;
+		static constexpr unsigned int kIterations = 100;
+
+		CountingObject object;
+
+		for (unsigned int i = 0; i < kIterations; i++) {
+			if (i == 1)
+				allocations = MemoryPool::heapAllocations();
+
+			for (unsigned int j = 0; j < kBatchSize; j++)
+				object.invokeMethod(&CountingObject::method,
+						    ConnectionTypeQueued, 1);
+
+			Thread::current()->dispatchMessages(Message::Type::InvokeMessage);
+		}
+
+		if (object.count() != kBatchSize * kIterations) {
+			cout << "Invalid number of invocations " << object.count()
+			     << endl;
+			return TestFail;
+		}
+
+		allocations = MemoryPool::heapAllocations() - allocations;
+		if (allocations) {
+			cout << "Queued invocations caused " << allocations
+			     << " heap allocations" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(MemoryPoolTest)
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Memory footprint accounting test
+ */
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+#include <libcamera/memory_usage.h>
+
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/memory_usage.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class MemoryUsageTest : public Test
+{
+protected:
+	int run()
+	{
+		auto account = make_shared<MemoryAccount>();
+
+		/* Test that charges are accounted for by type, with peaks. */
+		MemoryAccount::Charge cma = account->charge(MemoryUsage::Type::DmaHeapCma, 4096);
+		MemoryAccount::Charge anon = account->charge(MemoryUsage::Type::Anonymous, 1024);
+
+		MemoryUsage usage = account->usage();
+		if (usage[MemoryUsage::Type::DmaHeapCma].current != 4096 ||
+		    usage[MemoryUsage::Type::Anonymous].current != 1024 ||
+		    usage.total.current != 5120 || usage.total.peak != 5120) {
+			cerr << "Invalid usage after charging: "
+			     << usage.toString() << endl;
+			return TestFail;
+		}
+
+		/* Test that released and moved charges are removed once. */
+		cma.release();
+
+		MemoryAccount::Charge moved = std::move(anon);
+		anon = account->charge(MemoryUsage::Type::Anonymous, 512);
+
+		usage = account->usage();
+		if (usage[MemoryUsage::Type::DmaHeapCma].current != 0 ||
+		    usage[MemoryUsage::Type::DmaHeapCma].peak != 4096 ||
+		    usage[MemoryUsage::Type::Anonymous].current != 1536 ||
+		    usage.total.current != 1536 || usage.total.peak != 5120) {
+			cerr << "Invalid usage after releasing: "
+			     << usage.toString() << endl;
+			return TestFail;
+		}
+
+		moved = MemoryAccount::Charge();
+		anon.release();
+
+		/* Test that frame buffers are charged for their lifetime. */
+		FrameBuffer::Plane plane;
+		plane.offset = 0;
+		plane.length = 8192;
+
+		auto buffer = make_unique<FrameBuffer>(vector<FrameBuffer::Plane>{ plane, plane });
+		account->charge(buffer.get());
+		account->charge(buffer.get());
+
+		usage = account->usage();
+		if (usage[MemoryUsage::Type::Device].current != 16384 ||
+		    usage.total.current != 16384) {
+			cerr << "Invalid frame buffer usage: "
+			     << usage.toString() << endl;
+			return TestFail;
+		}
+
+		buffer.reset();
+
+		usage = account->usage();
+		if (usage.total.current != 0 || usage.total.peak != 16384) {
+			cerr << "Frame buffer charge not released: "
+			     << usage.toString() << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(MemoryUsageTest)
@@ -5,10 +5,12 @@
  * Messages test
  */
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <libcamera/base/message.h>
 #include <libcamera/base/object.h>
@@ -93,6 +95,51 @@ private:
 	bool success_;
 };
 
+class SequenceMessage : public Message
+{
+public:
+	SequenceMessage(unsigned int producer, unsigned int sequence)
+		: Message(Message::None), producer_(producer), sequence_(sequence)
+	{
+	}
+
+	unsigned int producer_;
+	unsigned int sequence_;
+};
+
+class SequenceMessageReceiver : public Object
+{
+public:
+	SequenceMessageReceiver(unsigned int producers)
+		: sequences_(producers, 0), received_(0), success_(true)
+	{
+	}
+
+	unsigned int received() const { return received_; }
+	bool success() const { return success_; }
+
+protected:
+	void message(Message *msg)
+	{
+		if (msg->type() != Message::None) {
+			Object::message(msg);
+			return;
+		}
+
+		/* Messages from each producer must be received in order. */
+		SequenceMessage *seq = static_cast<SequenceMessage *>(msg);
+		if (seq->sequence_ != sequences_[seq->producer_]++)
+			success_ = false;
+
+		received_++;
+	}
+
+private:
+	std::vector<unsigned int> sequences_;
+	std::atomic<unsigned int> received_;
+	std::atomic<bool> success_;
+};
+
 class MessageTest : public Test
 {
 protected:
@@ -154,6 +201,50 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Test concurrent message posting from multiple threads. All
+		 * messages should be delivered, in order for each thread.
+		 */
+		constexpr unsigned int kProducers = 4;
+		constexpr unsigned int kMessages = 10000;
+
+		SequenceMessageReceiver *sequenceReceiver =
+			new SequenceMessageReceiver(kProducers);
+		sequenceReceiver->moveToThread(&thread_);
+
+		std::vector<std::thread> producers;
+		for (unsigned int i = 0; i < kProducers; i++) {
+			producers.emplace_back([sequenceReceiver, i]() {
+				for (unsigned int j = 0; j < kMessages; j++)
+					sequenceReceiver->postMessage(
+						std::make_unique<SequenceMessage>(i, j));
+			});
+		}
+
+		for (std::thread &producer : producers)
+			producer.join();
+
+		for (unsigned int i = 0; i < 100; i++) {
+			if (sequenceReceiver->received() == kProducers * kMessages)
+				break;
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+
+		unsigned int received = sequenceReceiver->received();
+		success = sequenceReceiver->success();
+		sequenceReceiver->deleteLater();
+
+		if (received != kProducers * kMessages) {
+			cout << "Concurrent message delivery lost messages: "
+			     << received << "/" << kProducers * kMessages << endl;
+			return TestFail;
+		}
+
+		if (!success) {
+			cout << "Concurrent message delivery out of order" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -3,6 +3,7 @@
 # SPDX-License-Identifier: GPL-2.0-or-later
 # Copyright (C) 2022, Tomi Valkeinen <tomi.valkeinen@ideasonboard.com>
 
+import collections.abc
 from collections import defaultdict
 import gc
 import libcamera as libcam
@@ -162,6 +163,62 @@ class AllocatorTestMethods(CameraTesterBase):
         self.assertIsDead(wr_streamconfig)
 
 
+    def test_mapped_frame_buffer(self):
+        cam = self.cam
+
+        camconfig = cam.generate_configuration([libcam.StreamRole.StillCapture])
+        self.assertTrue(camconfig.size == 1)
+
+        streamconfig = camconfig.at(0)
+        cam.configure(camconfig)
+
+        stream = streamconfig.stream
+
+        allocator = libcam.FrameBufferAllocator(cam)
+        num_bufs = allocator.allocate(stream)
+        self.assertTrue(num_bufs > 0)
+
+        buffer = allocator.buffers(stream)[0]
+
+        # Planes are exposed as arrays of lines, without the line padding.
+        mfb = libcam.MappedFrameBuffer(buffer, streamconfig)
+        self.assertEqual(len(mfb.planes), len(buffer.planes))
+
+        plane = mfb.planes[0]
+        view = memoryview(plane)
+        self.assertEqual(view.shape, plane.shape)
+        self.assertEqual(view.strides, plane.strides)
+        self.assertEqual(plane.shape[0], streamconfig.size.height)
+        self.assertEqual(plane.strides[0], streamconfig.stride)
+        self.assertFalse(view.readonly)
+
+        view[0, 0, 0] = 0x5a
+        self.assertEqual(view[0, 0, 0], 0x5a)
+
+        # Mapping the buffer again reuses the mapping.
+        with libcam.MappedFrameBuffer(buffer) as mfb2:
+            plane2 = mfb2.planes[0]
+            self.assertEqual(len(plane2.shape), 1)
+            self.assertEqual(plane2.__array_interface__['data'],
+                             plane.__array_interface__['data'])
+            self.assertEqual(memoryview(plane2)[0], 0x5a)
+
+        # The planes remain valid when the buffer and allocator are gone.
+        del mfb2
+        del plane2
+        del mfb
+        del buffer
+        del allocator
+        gc.collect()
+
+        self.assertEqual(view[0, 0, 0], 0x5a)
+
+        view.release()
+        del view
+        del plane
+        gc.collect()
+
+
 class SimpleCaptureMethods(CameraTesterBase):
     def test_blocking(self):
         cm = self.cm
@@ -298,6 +355,94 @@ class SimpleCaptureMethods(CameraTesterBase):
 
         cam.stop()
 
+    def test_wait(self):
+        cm = self.cm
+        cam = self.cam
+
+        camconfig = cam.generate_configuration([libcam.StreamRole.StillCapture])
+        self.assertTrue(camconfig.size == 1)
+
+        streamconfig = camconfig.at(0)
+        cam.configure(camconfig)
+
+        stream = streamconfig.stream
+
+        allocator = libcam.FrameBufferAllocator(cam)
+        num_bufs = allocator.allocate(stream)
+        self.assertTrue(num_bufs > 0)
+
+        num_bufs = len(allocator.buffers(stream))
+
+        reqs = []
+        for i in range(num_bufs):
+            req = cam.create_request(i)
+            self.assertIsNotNone(req)
+
+            buffer = allocator.buffers(stream)[i]
+            req.add_buffer(stream, buffer)
+
+            reqs.append(req)
+
+        buffer = None
+
+        # Nothing has completed yet, the wait shall time out.
+        self.assertEqual(cm.wait_ready_requests(0.01), [])
+        self.assertEqual(cm.get_ready_request_batch(), [])
+
+        cam.start()
+
+        for req in reqs:
+            cam.queue_request(req)
+
+        reqs = None
+        gc.collect()
+
+        # Retrieve the first requests, then the others as a batch.
+        reqs = []
+        while not reqs:
+            reqs += cm.wait_ready_requests(5)
+
+        batch = []
+        while len(reqs) + len(batch) < num_bufs:
+            batch += cm.get_ready_request_batch([libcam.controls.SensorTimestamp], 5)
+
+        self.assertTrue(len(reqs) + len(batch) == num_bufs)
+
+        for req, buffers, metadata in batch:
+            self.assertTrue(stream in buffers)
+            self.assertEqual([id.name for id in metadata], ['SensorTimestamp'])
+            reqs.append(req)
+
+        for i, req in enumerate(reqs):
+            self.assertTrue(i == req.cookie)
+
+        # The metadata view converts the values when accessed.
+        metadata = reqs[0].metadata
+        self.assertTrue(isinstance(metadata, collections.abc.Mapping))
+        self.assertTrue(libcam.controls.SensorTimestamp in metadata)
+        self.assertEqual(len(metadata), len(dict(metadata)))
+        self.assertEqual(metadata.sensor_timestamp,
+                         metadata[libcam.controls.SensorTimestamp])
+        self.assertIsNone(metadata.get(libcam.controls.Lux))
+        self.assertIsNone(metadata.lux)
+
+        with self.assertRaises(KeyError):
+            metadata[libcam.controls.Lux]
+
+        # The view keeps the request alive.
+        wr_req = weakref.ref(reqs[0])
+        batch = None
+        reqs = None
+        req = None
+        gc.collect()
+        self.assertIsAlive(wr_req)
+
+        metadata = None
+        gc.collect()
+        self.assertIsDead(wr_req)
+
+        cam.stop()
+
 
 # Recursively expand slist's objects into olist, using seen to track already
 # processed objects.
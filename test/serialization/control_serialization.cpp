@@ -169,6 +169,56 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Enable delta encoding and serialize a sequence of lists with
+		 * changed, added and removed controls.
+		 */
+		serializer.setDeltaEncoding(3);
+
+		const size_t fullSize = serializer.binarySize(list);
+
+		ControlList changedList(infoMap);
+		changedList.set(controls::Brightness, 0.6f);
+		changedList.set(controls::Contrast, 1.2f);
+
+		std::vector<const ControlList *> lists = {
+			&list, &list, &changedList, &list
+		};
+
+		for (unsigned int i = 0; i < lists.size(); i++) {
+			const ControlList &current = *lists[i];
+
+			size = serializer.binarySize(current);
+			if (i == 1 && size >= fullSize) {
+				cerr << "Unchanged list not delta-encoded" << endl;
+				return TestFail;
+			}
+
+			if (i == 3 && size != fullSize) {
+				cerr << "Keyframe not serialized" << endl;
+				return TestFail;
+			}
+
+			listData.resize(size);
+			buffer = ByteStreamBuffer(listData.data(), listData.size());
+
+			ret = serializer.serialize(current, buffer);
+			if (ret || buffer.overflow()) {
+				cerr << "Failed to serialize delta ControlList" << endl;
+				return TestFail;
+			}
+
+			buffer = ByteStreamBuffer(const_cast<const uint8_t *>(listData.data()),
+						  listData.size());
+
+			newList = deserializer.deserialize<ControlList>(buffer);
+			if (!equals(current, newList)) {
+				cerr << "Deserialized delta list " << i
+				     << " doesn't match original" << endl;
+				return TestFail;
+			}
+		}
+
 		return TestPass;
 	}
 };
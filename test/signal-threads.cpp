@@ -5,9 +5,11 @@
  * Cross-thread signal delivery test
  */
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include <libcamera/base/message.h>
 #include <libcamera/base/object.h>
@@ -56,6 +58,17 @@ private:
 	int value_;
 };
 
+static std::atomic<unsigned int> emissions;
+
+static void countEmission()
+{
+	emissions.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void noopSlot()
+{
+}
+
 class SignalThreadsTest : public Test
 {
 protected:
@@ -114,6 +127,45 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Emit a signal from multiple threads while slots are connected
+		 * and disconnected, and verify that no emission is lost.
+		 */
+		static constexpr unsigned int kThreads = 4;
+		static constexpr unsigned int kEmissions = 10000;
+
+		Signal<> counterSignal;
+		counterSignal.connect(&countEmission);
+
+		std::atomic<bool> done = false;
+		vector<thread> emitters;
+
+		for (unsigned int i = 0; i < kThreads; i++) {
+			emitters.emplace_back([&counterSignal]() {
+				for (unsigned int j = 0; j < kEmissions; j++)
+					counterSignal.emit();
+			});
+		}
+
+		thread updater([&counterSignal, &done]() {
+			while (!done.load()) {
+				counterSignal.connect(&noopSlot);
+				counterSignal.disconnect(&noopSlot);
+			}
+		});
+
+		for (thread &emitter : emitters)
+			emitter.join();
+
+		done.store(true);
+		updater.join();
+
+		if (emissions != kThreads * kEmissions) {
+			cout << "Lost emissions with concurrent connections: "
+			     << emissions << "/" << kThreads * kEmissions << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
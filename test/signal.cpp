@@ -74,6 +74,24 @@ protected:
 		signalVoid_.disconnect(this, &SignalTest::slotDisconnect);
 	}
 
+	void slotDisconnectOther(int value)
+	{
+		values_[0] = value;
+		signalInt_.disconnect(this, &SignalTest::slotInteger2);
+	}
+
+	void slotConnectOther(int value)
+	{
+		values_[0] = value;
+		signalInt_.connect(this, &SignalTest::slotInteger2);
+	}
+
+	void slotDeleteSignal()
+	{
+		called_ = true;
+		delete dynamicSignal_;
+	}
+
 	void slotInteger1(int value)
 	{
 		values_[0] = value;
@@ -184,6 +202,56 @@ protected:
 			return TestFail;
 		}
 
+		/* Test disconnection of another slot from a slot. */
+		memset(values_, 0, sizeof(values_));
+		signalInt_.connect(this, &SignalTest::slotDisconnectOther);
+		signalInt_.connect(this, &SignalTest::slotInteger2);
+		signalInt_.emit(42);
+
+		if (values_[0] != 42 || values_[1] != 0) {
+			cout << "Signal disconnection of other slot test failed" << endl;
+			return TestFail;
+		}
+
+		signalInt_.disconnect();
+
+		/*
+		 * Test connection from a slot. The new slot shall only be
+		 * called by the next emission.
+		 */
+		memset(values_, 0, sizeof(values_));
+		signalInt_.connect(this, &SignalTest::slotConnectOther);
+		signalInt_.emit(42);
+
+		if (values_[0] != 42 || values_[1] != 0) {
+			cout << "Signal connection from slot test failed" << endl;
+			return TestFail;
+		}
+
+		signalInt_.emit(43);
+
+		if (values_[0] != 43 || values_[1] != 43) {
+			cout << "Signal connection from slot test failed" << endl;
+			return TestFail;
+		}
+
+		signalInt_.disconnect();
+
+		/*
+		 * Test deletion of the signal from a slot. This shall not
+		 * generate any valgrind warning.
+		 */
+		called_ = false;
+		dynamicSignal_ = new Signal<>();
+		dynamicSignal_->connect(this, &SignalTest::slotDeleteSignal);
+		dynamicSignal_->connect(this, &SignalTest::slotVoid);
+		dynamicSignal_->emit();
+
+		if (!called_) {
+			cout << "Signal deletion from slot test failed" << endl;
+			return TestFail;
+		}
+
 		/*
 		 * Test connecting to slots that return a value. This targets
 		 * compilation, there's no need to check runtime results.
@@ -352,6 +420,7 @@ private:
 	Signal<> signalVoid2_;
 	Signal<int> signalInt_;
 	Signal<int, const std::string &> signalMultiArgs_;
+	Signal<> *dynamicSignal_;
 
 	bool called_;
 	int values_[3];
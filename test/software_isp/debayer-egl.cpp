@@ -0,0 +1,282 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Software ISP GPU debayering test
+ */
+
+#include <iostream>
+
+#if HAVE_DEBAYER_EGL
+
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "debayer_cpu.h"
+#include "debayer_egl.h"
+#include "swstats_cpu.h"
+
+#include "memfd_buffer.h"
+
+#endif /* HAVE_DEBAYER_EGL */
+
+#include "test.h"
+
+using namespace std;
+
+#if HAVE_DEBAYER_EGL
+
+using namespace libcamera;
+
+namespace {
+
+class DebayerEglTest : public Test
+{
+protected:
+	int init() override
+	{
+		/* Release the statistics buffers as soon as they're ready. */
+		std::unique_ptr<SwStatsCpu> stats = std::make_unique<SwStatsCpu>();
+		stats->statsReady.connect(stats.get(), &SwStatsCpu::releaseBuffer);
+
+		debayer_ = std::make_unique<DebayerEGL>(std::move(stats));
+		if (!debayer_->isValid()) {
+			cout << "No GPU available for debayering" << endl;
+			return TestSkip;
+		}
+
+		using DmaBufAllocatorFlag = DmaBufAllocator::DmaBufAllocatorFlag;
+		allocator_ = std::make_unique<DmaBufAllocator>(std::initializer_list<DmaBufAllocatorFlag>{
+			DmaBufAllocatorFlag::UDmaBuf,
+			DmaBufAllocatorFlag::SystemHeap,
+			DmaBufAllocatorFlag::CmaHeap,
+		});
+		if (!allocator_->isValid()) {
+			cout << "No dma-buf provider available" << endl;
+			return TestSkip;
+		}
+
+		/*
+		 * Use distinct monotonic lookup tables to catch swapped
+		 * components, while tolerating rounding differences of one
+		 * between the GPU and the CPU.
+		 */
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+			params_.red[i] = i;
+			params_.green[i] = 255 - i;
+			params_.blue[i] = i / 2;
+		}
+
+		return TestPass;
+	}
+
+	std::unique_ptr<FrameBuffer> allocate(const char *name, size_t size)
+	{
+		FrameBuffer::Plane plane;
+		plane.offset = 0;
+		plane.length = size;
+
+		return allocator_->exportFrameBuffer(name, size, { plane });
+	}
+
+	int fill(FrameBuffer *buffer, const BayerFormat &bayerFormat)
+	{
+		MappedFrameBuffer mapped(buffer, MappedFrameBuffer::MapFlag::Write);
+		if (!mapped.isValid()) {
+			cerr << "Failed to map input buffer" << endl;
+			return TestFail;
+		}
+
+		buffer->_d()->metadata().status = FrameMetadata::FrameSuccess;
+
+		Span<uint8_t> data = mapped.planes()[0];
+
+		if (bayerFormat.bitDepth > 8 &&
+		    bayerFormat.packing == BayerFormat::Packing::None) {
+			uint16_t *pixels = reinterpret_cast<uint16_t *>(data.data());
+			for (unsigned int i = 0; i < data.size() / 2; i++)
+				pixels[i] = rand() & ((1 << bayerFormat.bitDepth) - 1);
+		} else {
+			for (unsigned int i = 0; i < data.size(); i++)
+				data[i] = rand();
+		}
+
+		return TestPass;
+	}
+
+	int compare(const StreamConfiguration &inputCfg, FrameBuffer *input,
+		    const StreamConfiguration &outputCfg, FrameBuffer *output)
+	{
+		/* Debayer on the CPU to the same window as a reference. */
+		DebayerCpu reference(std::make_unique<SwStatsCpu>());
+
+		StreamConfiguration cfg = outputCfg;
+		std::tie(cfg.stride, cfg.frameSize) =
+			reference.strideAndFrameSize(cfg.pixelFormat, cfg.size);
+
+		std::vector<std::reference_wrapper<StreamConfiguration>> cfgs{ cfg };
+		if (reference.configure(inputCfg, cfgs)) {
+			cerr << "Failed to configure the CPU debayering" << endl;
+			return TestFail;
+		}
+
+		std::unique_ptr<MemFdBuffer> expected =
+			MemFdBuffer::create("reference", cfg.frameSize);
+		if (!expected)
+			return TestFail;
+
+		reference.process(input, { expected->buffer() }, &params_);
+
+		MappedFrameBuffer gpu(output, MappedFrameBuffer::MapFlag::Read);
+		if (!gpu.isValid()) {
+			cerr << "Failed to map output buffer" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int y = 0; y < cfg.size.height; y++) {
+			const uint8_t *g = gpu.planes()[0].data() + y * outputCfg.stride;
+			const uint8_t *c = expected->data() + y * cfg.stride;
+
+			/* Skip the X component, only the colours matter. */
+			for (unsigned int x = 0; x < cfg.size.width * 4; x++) {
+				if (x % 4 == 3 || abs(g[x] - c[x]) <= 1)
+					continue;
+
+				cerr << "GPU " << inputCfg.pixelFormat
+				     << " debayering differs from CPU at ("
+				     << x / 4 << ", " << y << "): "
+				     << static_cast<unsigned int>(g[x]) << " != "
+				     << static_cast<unsigned int>(c[x]) << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		static const PixelFormat inputFormats[] = {
+			formats::SBGGR8, formats::SRGGB8,
+			formats::SGRBG10, formats::SGBRG12,
+			formats::SBGGR10_CSI2P,
+		};
+
+		srand(42);
+
+		for (const PixelFormat &inputFormat : inputFormats) {
+			BayerFormat bayerFormat = BayerFormat::fromPixelFormat(inputFormat);
+
+			/* Leave a border of one pattern around the output. */
+			StreamConfiguration inputCfg;
+			inputCfg.pixelFormat = inputFormat;
+			inputCfg.size = Size(kWidth + 8, kHeight + 4);
+			if (bayerFormat.packing == BayerFormat::Packing::CSI2)
+				inputCfg.stride = inputCfg.size.width * 5 / 4;
+			else
+				inputCfg.stride = inputCfg.size.width *
+						  (bayerFormat.bitDepth > 8 ? 2 : 1);
+			inputCfg.frameSize = inputCfg.stride * inputCfg.size.height;
+
+			StreamConfiguration outputCfg;
+			outputCfg.pixelFormat = formats::XRGB8888;
+			outputCfg.size = Size(kWidth, kHeight);
+			std::tie(outputCfg.stride, outputCfg.frameSize) =
+				debayer_->strideAndFrameSize(outputCfg.pixelFormat,
+							     outputCfg.size);
+
+			std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs{ outputCfg };
+			if (debayer_->configure(inputCfg, outputCfgs)) {
+				cerr << "Failed to configure " << inputCfg.toString()
+				     << " to " << outputCfg.toString() << endl;
+				return TestFail;
+			}
+
+			std::unique_ptr<FrameBuffer> input =
+				allocate("debayer-egl-input", inputCfg.frameSize);
+			std::unique_ptr<FrameBuffer> output =
+				allocate("debayer-egl-output", outputCfg.frameSize);
+			if (!input || !output) {
+				cerr << "Failed to allocate dma-bufs" << endl;
+				return TestFail;
+			}
+
+			/*
+			 * Process two frames with the same buffers, to test
+			 * both the import and the reuse of the imported
+			 * buffers.
+			 */
+			for (unsigned int frame = 0; frame < 2; frame++) {
+				if (fill(input.get(), bayerFormat) != TestPass)
+					return TestFail;
+
+				debayer_->process(input.get(), { output.get() }, &params_);
+
+				if (output->metadata().status != FrameMetadata::FrameSuccess) {
+					cerr << "Failed to debayer " << inputFormat
+					     << " on the GPU" << endl;
+					return TestFail;
+				}
+
+				int ret = compare(inputCfg, input.get(), outputCfg,
+						  output.get());
+				if (ret != TestPass)
+					return ret;
+			}
+
+			/* Buffers that aren't dma-bufs shall be rejected. */
+			std::unique_ptr<MemFdBuffer> memfd =
+				MemFdBuffer::create("memfd", inputCfg.frameSize);
+			if (!memfd)
+				return TestFail;
+
+			memfd->buffer()->_d()->metadata().status = FrameMetadata::FrameSuccess;
+
+			debayer_->process(memfd->buffer(), { output.get() }, &params_);
+
+			if (output->metadata().status != FrameMetadata::FrameError) {
+				cerr << "Non dma-buf input buffer accepted" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kWidth = 64;
+	static constexpr unsigned int kHeight = 8;
+
+	std::unique_ptr<DebayerEGL> debayer_;
+	std::unique_ptr<DmaBufAllocator> allocator_;
+	DebayerParams params_;
+};
+
+} /* namespace */
+
+#else
+
+class DebayerEglTest : public Test
+{
+protected:
+	int run() override
+	{
+		cout << "GPU debayering not compiled in" << endl;
+		return TestSkip;
+	}
+};
+
+#endif /* HAVE_DEBAYER_EGL */
+
+TEST_REGISTER(DebayerEglTest)
@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Software ISP multiple outputs test
+ */
+
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "debayer_cpu.h"
+#include "swstats_cpu.h"
+
+#include "memfd_buffer.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+namespace {
+
+class DebayerOutputsTest : public Test
+{
+protected:
+	int init() override
+	{
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
+			params_.red[i] = params_.green[i] = params_.blue[i] = i;
+
+		inputCfg_.pixelFormat = formats::SBGGR8;
+		inputCfg_.size = Size(kWidth + 4, kHeight);
+		inputCfg_.stride = inputCfg_.size.width;
+
+		input_ = MemFdBuffer::create("input", inputCfg_.stride * kHeight);
+		if (!input_)
+			return TestFail;
+
+		srand(42);
+		for (unsigned int i = 0; i < inputCfg_.stride * kHeight; i++)
+			input_->data()[i] = rand();
+
+		return TestPass;
+	}
+
+	/*
+	 * Process the input frame with one output per entry of cfgs. Outputs
+	 * whose buffer is set to null in skip are not requested.
+	 */
+	int process(std::vector<StreamConfiguration> &cfgs,
+		    std::vector<std::unique_ptr<MemFdBuffer>> &buffers,
+		    const std::vector<bool> &skip = {})
+	{
+		DebayerCpu debayer(std::make_unique<SwStatsCpu>());
+		std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs;
+		std::vector<FrameBuffer *> outputs;
+		unsigned int completed = 0;
+
+		for (unsigned int i = 0; i < cfgs.size(); i++) {
+			StreamConfiguration &cfg = cfgs[i];
+			std::tie(cfg.stride, cfg.frameSize) =
+				debayer.strideAndFrameSize(cfg.pixelFormat, cfg.size);
+			outputCfgs.push_back(cfg);
+
+			buffers.push_back(MemFdBuffer::create("output", cfg.frameSize));
+			if (!buffers.back())
+				return TestFail;
+
+			memset(buffers.back()->data(), 0, cfg.frameSize);
+
+			bool requested = i >= skip.size() || !skip[i];
+			outputs.push_back(requested ? buffers.back()->buffer() : nullptr);
+		}
+
+		if (debayer.configure(inputCfg_, outputCfgs)) {
+			cerr << "Failed to configure " << cfgs.size() << " outputs" << endl;
+			return TestFail;
+		}
+
+		debayer.outputBufferReady.connect(this, [&](FrameBuffer *) { completed++; });
+		debayer.process(input_->buffer(), outputs, &params_);
+
+		unsigned int requested = 0;
+		for (FrameBuffer *output : outputs)
+			requested += output != nullptr;
+
+		if (completed != requested) {
+			cerr << "Completed " << completed << " outputs, expected "
+			     << requested << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		/* Reference outputs, produced one at a time. */
+		std::vector<StreamConfiguration> rgbCfg(1);
+		rgbCfg[0].pixelFormat = formats::RGB888;
+		rgbCfg[0].size = Size(kWidth, kHeight);
+
+		std::vector<std::unique_ptr<MemFdBuffer>> rgb;
+		if (process(rgbCfg, rgb) != TestPass)
+			return TestFail;
+
+		std::vector<StreamConfiguration> nv12Cfg(1);
+		nv12Cfg[0].pixelFormat = formats::NV12;
+		nv12Cfg[0].size = Size(kWidth, kHeight);
+
+		std::vector<std::unique_ptr<MemFdBuffer>> nv12;
+		if (process(nv12Cfg, nv12) != TestPass)
+			return TestFail;
+
+		/* All outputs in a single pass, the smallest one first. */
+		std::vector<StreamConfiguration> cfgs(3);
+		cfgs[0].pixelFormat = formats::RGB888;
+		cfgs[0].size = Size(kWidth / 2, kHeight / 2);
+		cfgs[1].pixelFormat = formats::XBGR8888;
+		cfgs[1].size = Size(kWidth, kHeight);
+		cfgs[2].pixelFormat = formats::NV12;
+		cfgs[2].size = Size(kWidth, kHeight);
+
+		std::vector<std::unique_ptr<MemFdBuffer>> outputs;
+		if (process(cfgs, outputs) != TestPass)
+			return TestFail;
+
+		const uint8_t *ref = rgb[0]->data();
+		const unsigned int refStride = rgbCfg[0].stride;
+
+		/* The unscaled RGB output has its components swapped. */
+		for (unsigned int y = 0; y < kHeight; y++) {
+			const uint8_t *src = ref + y * refStride;
+			const uint8_t *dst = outputs[1]->data() + y * cfgs[1].stride;
+
+			for (unsigned int x = 0; x < kWidth; x++) {
+				if (dst[x * 4] != src[x * 3 + 2] ||
+				    dst[x * 4 + 1] != src[x * 3 + 1] ||
+				    dst[x * 4 + 2] != src[x * 3] ||
+				    dst[x * 4 + 3] != 255) {
+					cerr << "XBGR8888 output differs at "
+					     << x << "," << y << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/* The unscaled YUV output matches the single output. */
+		if (memcmp(outputs[2]->data(), nv12[0]->data(), nv12Cfg[0].frameSize)) {
+			cerr << "NV12 output differs" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The downscaled output samples every other column, and every
+		 * other pair of lines.
+		 */
+		for (unsigned int y = 0; y < kHeight / 2; y++) {
+			const uint8_t *src = ref + (y / 2 * 4 + y % 2) * refStride;
+			const uint8_t *dst = outputs[0]->data() + y * cfgs[0].stride;
+
+			for (unsigned int x = 0; x < kWidth / 2; x++) {
+				if (memcmp(dst + x * 3, src + x * 6, 3)) {
+					cerr << "Downscaled output differs at "
+					     << x << "," << y << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/* Outputs not requested are left untouched. */
+		std::vector<std::unique_ptr<MemFdBuffer>> partial;
+		if (process(cfgs, partial, { false, true, false }) != TestPass)
+			return TestFail;
+
+		for (unsigned int i = 0; i < cfgs[1].frameSize; i++) {
+			if (partial[1]->data()[i]) {
+				cerr << "Output written while not requested" << endl;
+				return TestFail;
+			}
+		}
+
+		if (memcmp(partial[0]->data(), outputs[0]->data(), cfgs[0].frameSize)) {
+			cerr << "Downscaled output differs without the largest output"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kWidth = 64;
+	static constexpr unsigned int kHeight = 48;
+
+	StreamConfiguration inputCfg_;
+	std::unique_ptr<MemFdBuffer> input_;
+	DebayerParams params_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(DebayerOutputsTest)
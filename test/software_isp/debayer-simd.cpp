@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Software ISP vectorized debayering test
+ */
+
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "debayer_cpu.h"
+#include "swstats_cpu.h"
+
+#include "memfd_buffer.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+namespace {
+
+class DebayerSimdTest : public Test
+{
+protected:
+	int init() override
+	{
+#if defined(__x86_64__)
+		if (!__builtin_cpu_supports("avx2")) {
+			cout << "The CPU doesn't support AVX2" << endl;
+			return TestSkip;
+		}
+#elif !defined(__aarch64__)
+		cout << "No vectorized debayering on this architecture" << endl;
+		return TestSkip;
+#endif
+
+		/* Use distinct lookup tables to catch swapped components. */
+		srand(42);
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+			params_.red[i] = rand();
+			params_.green[i] = rand();
+			params_.blue[i] = rand();
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Debayer the input to an output of the given format, with the
+	 * vectorized functions enabled or disabled.
+	 */
+	std::unique_ptr<MemFdBuffer> process(const StreamConfiguration &inputCfg,
+					     const MemFdBuffer &input, PixelFormat format,
+					     bool simd)
+	{
+		if (simd)
+			unsetenv("LIBCAMERA_SOFTISP_SIMD");
+		else
+			setenv("LIBCAMERA_SOFTISP_SIMD", "0", 1);
+
+		DebayerCpu debayer(std::make_unique<SwStatsCpu>());
+
+		StreamConfiguration cfg;
+		cfg.pixelFormat = format;
+		cfg.size = Size(kWidth, kHeight);
+		std::tie(cfg.stride, cfg.frameSize) =
+			debayer.strideAndFrameSize(cfg.pixelFormat, cfg.size);
+
+		std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs{ cfg };
+		if (debayer.configure(inputCfg, outputCfgs)) {
+			cerr << "Failed to configure " << inputCfg.toString()
+			     << " to " << cfg.toString() << endl;
+			return nullptr;
+		}
+
+		auto output = MemFdBuffer::create("output", cfg.frameSize);
+		if (!output)
+			return nullptr;
+
+		memset(output->data(), 0, cfg.frameSize);
+
+		debayer.process(input.buffer(), { output->buffer() }, &params_);
+
+		return output;
+	}
+
+	int run() override
+	{
+		static const PixelFormat inputFormats[] = {
+			formats::SBGGR8, formats::SGBRG8,
+			formats::SGRBG8, formats::SRGGB8,
+			formats::SBGGR10, formats::SGRBG10,
+			formats::SGBRG12, formats::SRGGB12,
+			formats::SBGGR10_CSI2P, formats::SGBRG10_CSI2P,
+			formats::SGRBG10_CSI2P, formats::SRGGB10_CSI2P,
+		};
+
+		static const PixelFormat outputFormats[] = {
+			formats::RGB888, formats::XRGB8888,
+		};
+
+		for (const PixelFormat &inputFormat : inputFormats) {
+			BayerFormat bayerFormat = BayerFormat::fromPixelFormat(inputFormat);
+
+			/*
+			 * Leave a border of one pattern around the output. The
+			 * width isn't a multiple of the vector sizes, to test
+			 * the end of the lines.
+			 */
+			StreamConfiguration inputCfg;
+			inputCfg.pixelFormat = inputFormat;
+			inputCfg.size = Size(kWidth + 8, kHeight + 4);
+			if (bayerFormat.packing == BayerFormat::Packing::CSI2)
+				inputCfg.stride = inputCfg.size.width * 5 / 4;
+			else
+				inputCfg.stride = inputCfg.size.width *
+						  (bayerFormat.bitDepth > 8 ? 2 : 1);
+
+			std::unique_ptr<MemFdBuffer> input =
+				MemFdBuffer::create("input", inputCfg.stride * inputCfg.size.height);
+			if (!input)
+				return TestFail;
+
+			/* Fill the input with random pixels of the format bit depth. */
+			if (bayerFormat.bitDepth > 8 &&
+			    bayerFormat.packing == BayerFormat::Packing::None) {
+				uint16_t *data = reinterpret_cast<uint16_t *>(input->data());
+				for (unsigned int i = 0; i < input->size() / 2; i++)
+					data[i] = rand() & ((1 << bayerFormat.bitDepth) - 1);
+			} else {
+				for (unsigned int i = 0; i < input->size(); i++)
+					input->data()[i] = rand();
+			}
+
+			for (const PixelFormat &outputFormat : outputFormats) {
+				std::unique_ptr<MemFdBuffer> scalar =
+					process(inputCfg, *input, outputFormat, false);
+				std::unique_ptr<MemFdBuffer> simd =
+					process(inputCfg, *input, outputFormat, true);
+				if (!scalar || !simd)
+					return TestFail;
+
+				if (memcmp(scalar->data(), simd->data(), scalar->size())) {
+					cerr << "Vectorized " << inputFormat << " to "
+					     << outputFormat
+					     << " debayering differs from scalar"
+					     << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		unsetenv("LIBCAMERA_SOFTISP_SIMD");
+	}
+
+private:
+	static constexpr unsigned int kWidth = 200;
+	static constexpr unsigned int kHeight = 8;
+
+	DebayerParams params_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(DebayerSimdTest)
@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Software ISP debayering and statistics benchmark
+ */
+
+#include <iomanip>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "debayer_cpu.h"
+#include "swstats_cpu.h"
+
+#include "memfd_buffer.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+namespace {
+
+/*
+ * Count the CPU cycles spent in user space by the calling thread and by the
+ * threads it creates while the counter is open. The cycles of the created
+ * threads are accounted when they exit.
+ */
+class CycleCounter
+{
+public:
+	CycleCounter()
+	{
+		struct perf_event_attr attr = {};
+
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CPU_CYCLES;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		fd_ = UniqueFD(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+
+	bool isValid() const { return fd_.isValid(); }
+
+	uint64_t read() const
+	{
+		uint64_t count;
+
+		if (!isValid() || ::read(fd_.get(), &count, sizeof(count)) != sizeof(count))
+			return 0;
+
+		return count;
+	}
+
+private:
+	UniqueFD fd_;
+};
+
+class SoftIspBenchmark : public Test
+{
+protected:
+	int init() override
+	{
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
+			params_.red[i] = params_.green[i] = params_.blue[i] = i;
+
+		/* Machine readable output, one line per kernel and format */
+		cout << "kernel,format,width,height,ns_per_pixel,mpix_per_s,cycles_per_line"
+		     << endl;
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		static const BayerFormat::Order orders[] = {
+			BayerFormat::BGGR, BayerFormat::GBRG,
+			BayerFormat::GRBG, BayerFormat::RGGB,
+		};
+		static const struct {
+			uint8_t bitDepth;
+			BayerFormat::Packing packing;
+		} depths[] = {
+			{ 8, BayerFormat::Packing::None },
+			{ 10, BayerFormat::Packing::None },
+			{ 12, BayerFormat::Packing::None },
+			{ 10, BayerFormat::Packing::CSI2 },
+		};
+
+		for (const auto &depth : depths) {
+			for (BayerFormat::Order order : orders) {
+				BayerFormat bayerFormat{ order, depth.bitDepth, depth.packing };
+				int ret = benchmark(bayerFormat);
+				if (ret != TestPass)
+					return ret;
+			}
+		}
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kWidth = 1920;
+	static constexpr unsigned int kHeight = 1080;
+	static constexpr unsigned int kWarmupFrames = 5;
+	static constexpr unsigned int kFrames = 30;
+
+	static int64_t timeDiff(const timespec &after, const timespec &before)
+	{
+		return (after.tv_sec - before.tv_sec) * 1000000000LL +
+		       (int64_t)after.tv_nsec - (int64_t)before.tv_nsec;
+	}
+
+	static void report(const char *kernel, const PixelFormat &format,
+			   const Size &size, int64_t duration, unsigned int frames,
+			   uint64_t cycles)
+	{
+		const double pixels = static_cast<double>(size.width) *
+				      size.height * frames;
+
+		cout << kernel << "," << format << ","
+		     << size.width << "," << size.height << ","
+		     << fixed << setprecision(3)
+		     << duration / pixels << ","
+		     << pixels * 1000 / duration << ",";
+		if (cycles)
+			cout << setprecision(0)
+			     << static_cast<double>(cycles) / (size.height * frames);
+		cout << defaultfloat << endl;
+	}
+
+	void fillFrame(const BayerFormat &bayerFormat, uint8_t *data, size_t size)
+	{
+		/* Random data, clamped to the bit depth for unpacked formats */
+		srand(42);
+		for (size_t i = 0; i < size; i++)
+			data[i] = rand();
+
+		if (bayerFormat.bitDepth > 8 &&
+		    bayerFormat.packing == BayerFormat::Packing::None) {
+			uint16_t *pixels = reinterpret_cast<uint16_t *>(data);
+			for (size_t i = 0; i < size / 2; i++)
+				pixels[i] &= (1 << bayerFormat.bitDepth) - 1;
+		}
+	}
+
+	int benchmark(const BayerFormat &bayerFormat)
+	{
+		StreamConfiguration inputCfg;
+		inputCfg.pixelFormat = bayerFormat.toPixelFormat();
+		inputCfg.size = Size(kWidth, kHeight);
+		inputCfg.stride = bayerFormat.packing == BayerFormat::Packing::CSI2
+				? kWidth * 5 / 4
+				: kWidth * ((bayerFormat.bitDepth + 7) / 8);
+
+		std::unique_ptr<MemFdBuffer> input =
+			MemFdBuffer::create("input", inputCfg.stride * kHeight);
+		if (!input)
+			return TestFail;
+
+		fillFrame(bayerFormat, input->data(), input->size());
+
+		int ret = benchmarkDebayer(inputCfg, *input);
+		if (ret != TestPass)
+			return ret;
+
+		return benchmarkStats(inputCfg, *input);
+	}
+
+	int benchmarkDebayer(const StreamConfiguration &inputCfg, const MemFdBuffer &input)
+	{
+		/* Open the counter first to account for the debayer workers */
+		CycleCounter counter;
+		uint64_t cycles = counter.read();
+
+		/* Release the statistics buffers as soon as they're ready */
+		std::unique_ptr<SwStatsCpu> stats = std::make_unique<SwStatsCpu>();
+		stats->statsReady.connect(stats.get(), &SwStatsCpu::releaseBuffer);
+
+		std::unique_ptr<DebayerCpu> debayer =
+			std::make_unique<DebayerCpu>(std::move(stats));
+
+		StreamConfiguration outputCfg;
+		outputCfg.pixelFormat = formats::RGB888;
+		outputCfg.size = debayer->sizes(inputCfg.pixelFormat, inputCfg.size).max;
+		outputCfg.stride = std::get<0>(debayer->strideAndFrameSize(outputCfg.pixelFormat,
+									  outputCfg.size));
+
+		std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs{ outputCfg };
+		if (debayer->configure(inputCfg, outputCfgs)) {
+			cerr << "Failed to configure debayer for "
+			     << inputCfg.pixelFormat << endl;
+			return TestFail;
+		}
+
+		std::unique_ptr<MemFdBuffer> output =
+			MemFdBuffer::create("output", debayer->frameSize());
+		if (!output)
+			return TestFail;
+
+		const std::vector<FrameBuffer *> outputs{ output->buffer() };
+
+		for (unsigned int i = 0; i < kWarmupFrames; i++)
+			debayer->process(input.buffer(), outputs, &params_);
+
+		timespec start = {};
+		timespec end = {};
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		for (unsigned int i = 0; i < kFrames; i++)
+			debayer->process(input.buffer(), outputs, &params_);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+		/* Stop the workers to collect their cycles, averaged on all frames */
+		debayer.reset();
+		cycles = counter.isValid() ? counter.read() - cycles : 0;
+
+		report("debayer", inputCfg.pixelFormat, outputCfg.size,
+		       timeDiff(end, start), kFrames,
+		       cycles / (kWarmupFrames + kFrames) * kFrames);
+
+		return TestPass;
+	}
+
+	int benchmarkStats(const StreamConfiguration &inputCfg, const MemFdBuffer &input)
+	{
+		SwStatsCpu stats;
+		if (!stats.isValid() || stats.configure(inputCfg)) {
+			cerr << "Failed to configure statistics for "
+			     << inputCfg.pixelFormat << endl;
+			return TestFail;
+		}
+
+		const Rectangle window(inputCfg.size);
+		const uint8_t *src = input.data();
+
+		stats.setWindow(window);
+		stats.statsReady.connect(&stats, &SwStatsCpu::releaseBuffer);
+
+		CycleCounter counter;
+		timespec start = {};
+		timespec end = {};
+		uint64_t cycles = 0;
+
+		for (unsigned int i = 0; i < kWarmupFrames + kFrames; i++) {
+			if (i == kWarmupFrames) {
+				cycles = counter.read();
+				clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+			}
+
+			stats.startFrame();
+			for (unsigned int y = 0; y < window.height; y += 2) {
+				const uint8_t *linePointers[3] = {
+					nullptr,
+					src + y * inputCfg.stride,
+					src + (y + 1) * inputCfg.stride,
+				};
+
+				stats.processLine0(y, linePointers);
+			}
+			stats.finishFrame();
+		}
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+		cycles = counter.isValid() ? counter.read() - cycles : 0;
+
+		report("stats", inputCfg.pixelFormat, window.size(),
+		       timeDiff(end, start), kFrames, cycles);
+
+		return TestPass;
+	}
+
+	DebayerParams params_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(SoftIspBenchmark)
@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Software ISP statistics buffers ownership test
+ */
+
+#include <iostream>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include <libcamera/formats.h>
+#include <libcamera/geometry.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/software_isp/swisp_stats.h"
+
+#include "swstats_cpu.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class SwStatsRingTest : public Test
+{
+protected:
+	int init() override
+	{
+		if (!stats_.isValid()) {
+			cerr << "Failed to create statistics" << endl;
+			return TestFail;
+		}
+
+		StreamConfiguration cfg;
+		cfg.pixelFormat = formats::SBGGR8;
+		cfg.size = Size(kWidth, kHeight);
+		cfg.stride = kWidth;
+
+		if (stats_.configure(cfg)) {
+			cerr << "Failed to configure statistics" << endl;
+			return TestFail;
+		}
+
+		stats_.setWindow(Rectangle(cfg.size));
+		stats_.statsReady.connect(this, &SwStatsRingTest::statsReady);
+
+		void *mem = mmap(nullptr, sizeof(SwIspStatsBuffers), PROT_READ,
+				 MAP_SHARED, stats_.getStatsFD().get(), 0);
+		if (mem == MAP_FAILED) {
+			cerr << "Failed to map statistics" << endl;
+			return TestFail;
+		}
+
+		buffers_ = static_cast<const SwIspStatsBuffers *>(mem);
+
+		return TestPass;
+	}
+
+	/* Gather the statistics of a frame with all pixels set to value. */
+	int processFrame(uint8_t value)
+	{
+		std::vector<uint8_t> line(kWidth, value);
+		const uint8_t *lines[3] = { line.data(), line.data(), line.data() };
+
+		ready_ = -1;
+
+		stats_.startFrame();
+		for (unsigned int y = 0; y < kHeight; y += 2)
+			stats_.processLine0(y, lines);
+		stats_.finishFrame();
+
+		return ready_;
+	}
+
+	int checkOwned()
+	{
+		for (unsigned int i = 0; i < kSwIspStatsBufferCount; i++) {
+			if (!owned_[i])
+				continue;
+
+			if ((*buffers_)[i].sumG_ != sums_[i]) {
+				cerr << "Owned statistics buffer " << i
+				     << " overwritten" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		/* Fill all the buffers without releasing them. */
+		for (unsigned int i = 0; i < kSwIspStatsBufferCount; i++) {
+			int index = processFrame(i + 1);
+			if (index < 0 || owned_[index]) {
+				cerr << "Frame " << i << " got no free buffer" << endl;
+				return TestFail;
+			}
+
+			owned_[index] = true;
+			sums_[index] = (*buffers_)[index].sumG_;
+			if (!sums_[index]) {
+				cerr << "No statistics gathered" << endl;
+				return TestFail;
+			}
+		}
+
+		/* With no free buffer, the statistics shall be dropped. */
+		if (processFrame(0xff) >= 0) {
+			cerr << "Statistics emitted with all buffers owned" << endl;
+			return TestFail;
+		}
+
+		if (checkOwned() != TestPass)
+			return TestFail;
+
+		/* A released buffer shall be reused, and only that one. */
+		const unsigned int released = 1;
+		stats_.releaseBuffer(released);
+		owned_[released] = false;
+
+		int index = processFrame(0xff);
+		if (index != static_cast<int>(released)) {
+			cerr << "Released buffer not reused, got " << index << endl;
+			return TestFail;
+		}
+
+		if (checkOwned() != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		if (buffers_)
+			munmap(const_cast<SwIspStatsBuffers *>(buffers_),
+			       sizeof(SwIspStatsBuffers));
+	}
+
+private:
+	void statsReady(uint32_t index)
+	{
+		ready_ = index;
+	}
+
+	static constexpr unsigned int kWidth = 64;
+	static constexpr unsigned int kHeight = 8;
+
+	SwStatsCpu stats_;
+	const SwIspStatsBuffers *buffers_ = nullptr;
+
+	int ready_ = -1;
+	bool owned_[kSwIspStatsBufferCount] = {};
+	uint64_t sums_[kSwIspStatsBufferCount] = {};
+};
+
+TEST_REGISTER(SwStatsRingTest)
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Thread pool test
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <libcamera/base/semaphore.h>
+#include <libcamera/base/thread_pool.h>
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+class ThreadPoolTest : public Test
+{
+protected:
+	int testSubmit()
+	{
+		ThreadPool pool(4);
+		vector<future<unsigned int>> results;
+
+		for (unsigned int i = 0; i < 100; i++)
+			results.push_back(pool.submit([i]() { return i * i; }));
+
+		for (unsigned int i = 0; i < results.size(); i++) {
+			if (results[i].get() != i * i) {
+				cout << "Invalid task result" << endl;
+				return TestFail;
+			}
+		}
+
+		future<void> failure = pool.submit([]() {
+			throw runtime_error("failure");
+		});
+
+		try {
+			failure.get();
+			cout << "Task exception not propagated" << endl;
+			return TestFail;
+		} catch (const runtime_error &) {
+		}
+
+		return TestPass;
+	}
+
+	int testConcurrency()
+	{
+		static constexpr unsigned int kMaxConcurrency = 2;
+
+		ThreadPool pool(4);
+		TaskGroup group(kMaxConcurrency, &pool);
+		Semaphore done;
+		atomic<unsigned int> running = 0;
+		atomic<unsigned int> maxRunning = 0;
+		atomic<unsigned int> count = 0;
+
+		group.finished.connect(&done, [&]() { done.release(); });
+
+		for (unsigned int i = 0; i < 20; i++) {
+			group.run([&]() {
+				unsigned int value = ++running;
+				unsigned int max = maxRunning;
+				while (value > max &&
+				       !maxRunning.compare_exchange_weak(max, value))
+					;
+
+				this_thread::sleep_for(1ms);
+
+				--running;
+				++count;
+			});
+		}
+
+		/*
+		 * Wait through the signal to only run tasks on the pool. The
+		 * group may become idle before all tasks are added.
+		 */
+		while (count < 20)
+			done.acquire();
+
+		group.wait();
+
+		if (count != 20) {
+			cout << "Only " << count << " tasks run" << endl;
+			return TestFail;
+		}
+
+		if (maxRunning > kMaxConcurrency) {
+			cout << "Concurrency bound exceeded: " << maxRunning
+			     << " tasks run concurrently" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testNested()
+	{
+		/*
+		 * Wait for task groups from tasks running on a pool with less
+		 * workers than groups. This would deadlock if wait() didn't run
+		 * the pending tasks in the calling thread.
+		 */
+		ThreadPool pool(2);
+		atomic<unsigned int> count = 0;
+
+		{
+			TaskGroup outer(0, &pool);
+
+			for (unsigned int i = 0; i < 8; i++) {
+				outer.run([&]() {
+					TaskGroup inner(0, &pool);
+
+					for (unsigned int j = 0; j < 8; j++)
+						inner.run([&]() { ++count; });
+
+					inner.wait();
+				});
+			}
+
+			outer.wait();
+		}
+
+		if (count != 64) {
+			cout << "Only " << count << " nested tasks run" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		if (testSubmit() != TestPass)
+			return TestFail;
+
+		if (testConcurrency() != TestPass)
+			return TestFail;
+
+		if (testNested() != TestPass)
+			return TestFail;
+
+		/* The process-wide pool must be usable. */
+		if (ThreadPool::instance()->submit([]() { return 42; }).get() != 42) {
+			cout << "Process-wide pool failed" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ThreadPoolTest)
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Thread slot profiling test
+ */
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace libcamera;
+
+class SlowObject : public Object
+{
+public:
+	void method()
+	{
+		this_thread::sleep_for(2ms);
+	}
+};
+
+class ThreadProfileTest : public Test
+{
+protected:
+	static constexpr unsigned int kMessages = 10;
+	static constexpr unsigned int kInterval = 2;
+
+	int run()
+	{
+		Thread thread;
+		SlowObject object;
+
+		object.moveToThread(&thread);
+
+		if (thread.profilingInterval()) {
+			cout << "Profiling enabled by default" << endl;
+			return TestFail;
+		}
+
+		thread.setProfilingInterval(kInterval);
+		thread.start();
+
+		for (unsigned int i = 0; i < kMessages; i++)
+			object.invokeMethod(&SlowObject::method,
+					    ConnectionTypeQueued);
+
+		/* Synchronize with the thread with a blocking call. */
+		object.invokeMethod(&SlowObject::method,
+				    ConnectionTypeBlocking);
+
+		ThreadProfile profile = thread.profile();
+
+		thread.exit(0);
+		thread.wait();
+
+		if (profile.interval != kInterval ||
+		    profile.dispatches < kMessages + 1) {
+			cout << "Invalid dispatch count " << profile.dispatches
+			     << endl;
+			return TestFail;
+		}
+
+		const ThreadProfile::Slot *slot = nullptr;
+		for (const ThreadProfile::Slot &s : profile.slots) {
+			if (s.receiver == "SlowObject" &&
+			    s.slot.find("BoundMethodMember<SlowObject") != string::npos)
+				slot = &s;
+		}
+
+		if (!slot || slot->samples < (kMessages + 1) / kInterval ||
+		    slot->samples > kMessages + 1 ||
+		    slot->totalTime < slot->samples * 2ms ||
+		    slot->maxTime < 2ms) {
+			cout << "Invalid slot profile" << endl
+			     << profile.toString() << endl;
+			return TestFail;
+		}
+
+		thread.resetProfile();
+		if (thread.profile().dispatches || !thread.profile().slots.empty()) {
+			cout << "Profile not reset" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ThreadProfileTest)
@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Thread event loop statistics test
+ */
+
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace libcamera;
+
+class SlowObject : public Object
+{
+public:
+	void method()
+	{
+		this_thread::sleep_for(2ms);
+	}
+};
+
+class ThreadStatisticsTest : public Test
+{
+protected:
+	static constexpr unsigned int kMessages = 10;
+
+	int run()
+	{
+		Thread thread;
+		SlowObject object;
+
+		object.moveToThread(&thread);
+
+		if (thread.statisticsEnabled()) {
+			cout << "Statistics enabled by default" << endl;
+			return TestFail;
+		}
+
+		thread.setStatisticsEnabled(true);
+		thread.start();
+
+		/* Let the thread sleep in the event dispatcher. */
+		this_thread::sleep_for(10ms);
+
+		for (unsigned int i = 0; i < kMessages; i++)
+			object.invokeMethod(&SlowObject::method,
+					    ConnectionTypeQueued);
+
+		/* Synchronize with the thread with a blocking call. */
+		object.invokeMethod(&SlowObject::method,
+				    ConnectionTypeBlocking);
+
+		ThreadStatistics stats = thread.statistics();
+
+		thread.exit(0);
+		thread.wait();
+
+		/* The thread move message may or may not be accounted. */
+		if (stats.messages < kMessages + 1) {
+			cout << "Invalid message count " << stats.messages << endl;
+			return TestFail;
+		}
+
+		uint64_t latencies = accumulate(stats.latency.begin(),
+						stats.latency.end(), uint64_t(0));
+		if (latencies != stats.messages) {
+			cout << "Invalid latency histogram" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The messages queued while the first message is dispatched
+		 * are fetched at once.
+		 */
+		if (stats.maxQueueDepth < 2) {
+			cout << "Invalid queue depth " << stats.maxQueueDepth << endl;
+			return TestFail;
+		}
+
+		const ThreadStatistics::Receiver *receiver = nullptr;
+		for (const ThreadStatistics::Receiver &r : stats.receivers) {
+			if (r.name == "SlowObject")
+				receiver = &r;
+		}
+
+		if (!receiver || receiver->messages < kMessages + 1 ||
+		    receiver->totalTime < (kMessages + 1) * 2ms ||
+		    receiver->maxTime < 2ms) {
+			cout << "Invalid receiver statistics" << endl;
+			return TestFail;
+		}
+
+		if (stats.waitTime < 5ms || stats.busyTime < receiver->totalTime) {
+			cout << "Invalid wait or busy time" << endl;
+			return TestFail;
+		}
+
+		thread.resetStatistics();
+		if (thread.statistics().messages || !thread.statistics().receivers.empty()) {
+			cout << "Statistics not reset" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ThreadStatisticsTest)
@@ -9,6 +9,8 @@
 #include <iostream>
 #include <memory>
 #include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <thread>
 #include <time.h>
 
@@ -66,6 +68,25 @@ private:
 	bool &cancelled_;
 };
 
+class AttributesThread : public Thread
+{
+public:
+	AttributesThread()
+		: Thread("attributes-test-thread")
+	{
+	}
+
+	cpu_set_t cpus_;
+	char name_[16];
+
+protected:
+	void run()
+	{
+		sched_getaffinity(0, sizeof(cpus_), &cpus_);
+		pthread_getname_np(pthread_self(), name_, sizeof(name_));
+	}
+};
+
 class ThreadTest : public Test
 {
 protected:
@@ -149,6 +170,47 @@ protected:
 			return TestFail;
 		}
 
+		/* Test the thread name and CPU affinity. */
+		cpu_set_t cpus;
+		sched_getaffinity(0, sizeof(cpus), &cpus);
+
+		unsigned int cpu = 0;
+		while (!CPU_ISSET(cpu, &cpus))
+			cpu++;
+
+		std::unique_ptr<AttributesThread> attrThread =
+			std::make_unique<AttributesThread>();
+
+		const unsigned int invalidCpus[] = { CPU_SETSIZE };
+		const unsigned int validCpus[] = { cpu };
+
+		if (attrThread->setAffinity(invalidCpus) != -EINVAL ||
+		    attrThread->setPriority(Thread::SchedulingPolicy::Other, 1) != -EINVAL) {
+			cout << "Invalid thread attributes not rejected" << endl;
+			return TestFail;
+		}
+
+		if (attrThread->setAffinity(validCpus) < 0 ||
+		    attrThread->setPriority(Thread::SchedulingPolicy::Other) < 0) {
+			cout << "Failed to set thread attributes" << endl;
+			return TestFail;
+		}
+
+		attrThread->start();
+		attrThread->wait();
+
+		if (CPU_COUNT(&attrThread->cpus_) != 1 ||
+		    !CPU_ISSET(cpu, &attrThread->cpus_)) {
+			cout << "Thread affinity not applied" << endl;
+			return TestFail;
+		}
+
+		if (strcmp(attrThread->name_, "attributes-test")) {
+			cout << "Thread name not applied: " << attrThread->name_
+			     << endl;
+			return TestFail;
+		}
+
 		/* Test thread cleanup upon abnormal termination. */
 		bool cancelled = false;
 		bool finished = false;
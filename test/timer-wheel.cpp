@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Timer wheel test
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <libcamera/base/timer.h>
+#include <libcamera/base/timer_wheel.h>
+#include <libcamera/base/utils.h>
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+class TimerWheelTest : public Test
+{
+protected:
+	int run()
+	{
+		static constexpr unsigned int kTimers = 1000;
+
+		TimerWheel wheel;
+		vector<unique_ptr<Timer>> timers;
+		vector<Timer *> running;
+		mt19937 gen(42);
+
+		utils::time_point now = utils::clock::now();
+
+		/*
+		 * Spread the deadlines from the past to several hours in the
+		 * future to exercise all the levels of the wheel.
+		 */
+		uniform_int_distribution<int64_t> exponent(0, 44);
+		uniform_int_distribution<int64_t> mantissa(0, 1 << 10);
+
+		for (unsigned int i = 0; i < kTimers; i++) {
+			auto timer = make_unique<Timer>();
+			int64_t offset = (mantissa(gen) << exponent(gen)) >> 10;
+
+			/*
+			 * Set the deadline without starting the timer, as the
+			 * wheel is operated manually.
+			 */
+			timer->start(now + chrono::nanoseconds(offset) - 1ms);
+			timer->stop();
+
+			wheel.add(timer.get());
+			running.push_back(timer.get());
+			timers.push_back(move(timer));
+		}
+
+		/* Remove a quarter of the timers. */
+		for (unsigned int i = 0; i < kTimers / 4; i++) {
+			uniform_int_distribution<size_t> index(0, running.size() - 1);
+			auto iter = running.begin() + index(gen);
+
+			wheel.remove(*iter);
+			running.erase(iter);
+		}
+
+		sort(running.begin(), running.end(), [](Timer *a, Timer *b) {
+			return a->deadline() < b->deadline();
+		});
+
+		/*
+		 * Jump to the next deadline, as an event dispatcher would, and
+		 * verify that timers expire exactly on time and in order.
+		 */
+		auto expected = running.begin();
+
+		while (!wheel.empty()) {
+			utils::time_point deadline = wheel.nextDeadline();
+			if (expected == running.end() ||
+			    deadline != (*expected)->deadline()) {
+				cout << "Invalid next deadline" << endl;
+				return TestFail;
+			}
+
+			now = max(now, deadline);
+
+			while (Timer *timer = wheel.pop(now)) {
+				/* Timers with equal deadlines may expire in any order. */
+				if (expected == running.end() ||
+				    timer->deadline() != (*expected)->deadline()) {
+					cout << "Timer expired out of order" << endl;
+					return TestFail;
+				}
+
+				++expected;
+			}
+
+			if (expected != running.end() &&
+			    (*expected)->deadline() <= now) {
+				cout << "Expired timer not reported" << endl;
+				return TestFail;
+			}
+		}
+
+		if (expected != running.end()) {
+			cout << "Timers missing from the wheel" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(TimerWheelTest)
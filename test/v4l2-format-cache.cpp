@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * V4L2 format cache test
+ */
+
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "libcamera/internal/v4l2_format_cache.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+class V4L2FormatCacheTest : public Test
+{
+protected:
+	int init()
+	{
+		char dir[] = "/tmp/libcamera.test.XXXXXX";
+		if (!mkdtemp(dir)) {
+			cout << "Unable to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		dir_ = dir;
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		const string device = "driver card bus 0x00060800 name@/sys/devices/test";
+		V4L2FormatCache::Formats formats = {
+			{ 0x56595559, { SizeRange({ 640, 480 }),
+					SizeRange({ 1280, 720 }) } },
+			{ 0x3231564e, { SizeRange({ 16, 16 }, { 4096, 4096 }, 2, 2) } },
+		};
+
+		{
+			V4L2FormatCache cache(dir_);
+
+			if (cache.lookup(device, "fmt 1 0x0")) {
+				cout << "Unexpected entry in empty cache" << endl;
+				return TestFail;
+			}
+
+			cache.store(device, "fmt 1 0x0", formats);
+			cache.store(device, "fmt 1 0x2006", { formats.begin(), ++formats.begin() });
+		}
+
+		/* Reload the cache from disk. */
+		V4L2FormatCache cache(dir_);
+
+		auto cached = cache.lookup(device, "fmt 1 0x0");
+		if (!cached || *cached != formats) {
+			cout << "Cached formats don't match" << endl;
+			return TestFail;
+		}
+
+		cached = cache.lookup(device, "fmt 1 0x2006");
+		if (!cached || cached->size() != 1) {
+			cout << "Second query not cached" << endl;
+			return TestFail;
+		}
+
+		if (cache.lookup(device, "fmt 2 0x0") ||
+		    cache.lookup(device + "-other", "fmt 1 0x0")) {
+			cout << "Unexpected cache hit" << endl;
+			return TestFail;
+		}
+
+		/* Corrupt the cache file, the entries must be discarded. */
+		for (const auto &path : files()) {
+			ofstream file(path, ios::app);
+			file << "size garbage" << endl;
+		}
+
+		V4L2FormatCache corrupted(dir_);
+		if (corrupted.lookup(device, "fmt 1 0x0")) {
+			cout << "Corrupted cache entry not discarded" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		for (const auto &path : files())
+			unlink(path.c_str());
+		rmdir(dir_.c_str());
+	}
+
+private:
+	vector<string> files()
+	{
+		vector<string> paths;
+
+		DIR *dir = opendir(dir_.c_str());
+		if (!dir)
+			return paths;
+
+		while (struct dirent *ent = readdir(dir)) {
+			if (ent->d_name[0] != '.')
+				paths.push_back(dir_ + "/" + ent->d_name);
+		}
+
+		closedir(dir);
+
+		return paths;
+	}
+
+	string dir_;
+};
+
+TEST_REGISTER(V4L2FormatCacheTest)
@@ -126,6 +126,35 @@ public:
 		return TestPass;
 	}
 
+	/*
+	 * Test that the hit and miss counters reflect the cache usage. Buffers
+	 * queued sequentially must all hit the cache, except for the first
+	 * use of each buffer when the cache isn't pre-populated.
+	 */
+	int testStatistics(V4L2BufferCache *cache,
+			   const std::vector<std::unique_ptr<FrameBuffer>> &buffers,
+			   uint64_t expectedMisses)
+	{
+		uint64_t hits = cache->hits();
+		uint64_t misses = cache->misses();
+
+		if (testSequential(cache, buffers) != TestPass)
+			return TestFail;
+
+		uint64_t lookups = buffers.size() * 100;
+
+		if (cache->misses() - misses != expectedMisses ||
+		    cache->hits() - hits != lookups - expectedMisses) {
+			std::cout << "Invalid cache statistics, "
+				  << cache->hits() - hits << " hits and "
+				  << cache->misses() - misses << " misses"
+				  << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
 	int testIsEmpty(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
 	{
 		V4L2BufferCache cache(buffers.size());
@@ -197,7 +226,7 @@ public:
 		 */
 		V4L2BufferCache cacheFromBuffers(buffers);
 
-		if (testSequential(&cacheFromBuffers, buffers) != TestPass)
+		if (testStatistics(&cacheFromBuffers, buffers, 0) != TestPass)
 			return TestFail;
 
 		if (testRandom(&cacheFromBuffers, buffers) != TestPass)
@@ -212,7 +241,7 @@ public:
 		 */
 		V4L2BufferCache cacheFromNumbers(numBuffers);
 
-		if (testSequential(&cacheFromNumbers, buffers) != TestPass)
+		if (testStatistics(&cacheFromNumbers, buffers, numBuffers) != TestPass)
 			return TestFail;
 
 		if (testRandom(&cacheFromNumbers, buffers) != TestPass)
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * libcamera V4L2 batched buffer dequeue test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include <libcamera/framebuffer.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "v4l2_videodevice_test.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+class CaptureBatchedTest : public V4L2VideoDeviceTest
+{
+public:
+	CaptureBatchedTest()
+		: V4L2VideoDeviceTest("vimc", "Raw Capture 0"), frames_(0),
+		  batchFrames_(0), batches_(0), maxBatch_(0)
+	{
+	}
+
+	void receiveBuffer(FrameBuffer *buffer)
+	{
+		frames_++;
+		batchFrames_++;
+
+		/* Requeue the buffer for further use. */
+		capture_->queueBuffer(buffer);
+	}
+
+	void batchComplete()
+	{
+		batches_++;
+		maxBatch_ = std::max(maxBatch_, batchFrames_);
+		batchFrames_ = 0;
+	}
+
+protected:
+	int run()
+	{
+		const unsigned int bufferCount = 8;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		Timer timeout;
+		int ret;
+
+		ret = capture_->allocateBuffers(bufferCount, &buffers_);
+		if (ret < 0) {
+			std::cout << "Failed to allocate buffers" << std::endl;
+			return TestFail;
+		}
+
+		capture_->setBatchedDequeue(true);
+		capture_->bufferReady.connect(this, &CaptureBatchedTest::receiveBuffer);
+		capture_->bufferBatchComplete.connect(this, &CaptureBatchedTest::batchComplete);
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+			if (capture_->queueBuffer(buffer.get())) {
+				std::cout << "Failed to queue buffer" << std::endl;
+				return TestFail;
+			}
+		}
+
+		ret = capture_->streamOn();
+		if (ret)
+			return TestFail;
+
+		/*
+		 * Block the event loop to let several buffers complete, they
+		 * must then be dequeued in a single batch.
+		 */
+		std::this_thread::sleep_for(500ms);
+
+		const unsigned int nFrames = 30;
+
+		timeout.start(500ms * nFrames);
+		while (timeout.isRunning()) {
+			dispatcher->processEvents();
+			if (frames_ > nFrames)
+				break;
+		}
+
+		/* Buffers cancelled by streamOff() are not part of a batch. */
+		unsigned int pendingFrames = batchFrames_;
+
+		ret = capture_->streamOff();
+		if (ret)
+			return TestFail;
+
+		if (frames_ < nFrames) {
+			std::cout << "Failed to capture " << nFrames
+				  << " frames within timeout." << std::endl;
+			return TestFail;
+		}
+
+		if (!batches_ || pendingFrames) {
+			std::cout << "Batch completion not signalled" << std::endl;
+			return TestFail;
+		}
+
+		if (maxBatch_ < 2) {
+			std::cout << "Buffers not dequeued in batches" << std::endl;
+			return TestFail;
+		}
+
+		std::cout << "Processed " << frames_ << " frames in " << batches_
+			  << " batches" << std::endl;
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+	unsigned int batchFrames_;
+	unsigned int batches_;
+	unsigned int maxBatch_;
+};
+
+TEST_REGISTER(CaptureBatchedTest)
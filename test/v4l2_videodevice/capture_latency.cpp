@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * libcamera V4L2 buffer latency statistics test
+ */
+
+#include <iostream>
+#include <numeric>
+
+#include <libcamera/framebuffer.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "v4l2_videodevice_test.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+class CaptureLatencyTest : public V4L2VideoDeviceTest
+{
+public:
+	CaptureLatencyTest()
+		: V4L2VideoDeviceTest("vimc", "Raw Capture 0"), frames_(0)
+	{
+	}
+
+	void receiveBuffer(FrameBuffer *buffer)
+	{
+		if (buffer->metadata().status == FrameMetadata::FrameCancelled)
+			return;
+
+		frames_++;
+
+		capture_->queueBuffer(buffer);
+	}
+
+protected:
+	int run()
+	{
+		const unsigned int bufferCount = 4;
+		const unsigned int nFrames = 10;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		Timer timeout;
+		int ret;
+
+		ret = capture_->allocateBuffers(bufferCount, &buffers_);
+		if (ret < 0) {
+			std::cout << "Failed to allocate buffers" << std::endl;
+			return TestFail;
+		}
+
+		if (capture_->latencyStatisticsEnabled()) {
+			std::cout << "Statistics enabled by default" << std::endl;
+			return TestFail;
+		}
+
+		capture_->setLatencyStatisticsEnabled(true);
+		capture_->bufferReady.connect(this, &CaptureLatencyTest::receiveBuffer);
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+			if (capture_->queueBuffer(buffer.get())) {
+				std::cout << "Failed to queue buffer" << std::endl;
+				return TestFail;
+			}
+		}
+
+		ret = capture_->streamOn();
+		if (ret)
+			return TestFail;
+
+		timeout.start(500ms * nFrames);
+		while (timeout.isRunning()) {
+			dispatcher->processEvents();
+			if (frames_ >= nFrames)
+				break;
+		}
+
+		ret = capture_->streamOff();
+		if (ret)
+			return TestFail;
+
+		if (frames_ < nFrames) {
+			std::cout << "Failed to capture " << nFrames
+				  << " frames within timeout." << std::endl;
+			return TestFail;
+		}
+
+		/* Cancelled buffers aren't dequeued and must not be recorded. */
+		V4L2LatencyStatistics stats = capture_->latencyStatistics();
+		const V4L2LatencyStatistics::Stage &dispatch = stats.dispatch;
+
+		if (dispatch.buffers != frames_ ||
+		    std::accumulate(dispatch.latency.begin(), dispatch.latency.end(),
+				    uint64_t(0)) != frames_) {
+			std::cout << "Dispatch statistics recorded " << dispatch.buffers
+				  << " buffers, expected " << frames_ << std::endl;
+			return TestFail;
+		}
+
+		/* vimc timestamps buffers with the monotonic clock. */
+		if (stats.kernel.buffers != frames_ ||
+		    stats.kernel.maxTime < stats.kernel.totalTime / frames_) {
+			std::cout << "Invalid kernel statistics" << std::endl;
+			return TestFail;
+		}
+
+		/* No request has been completed. */
+		if (stats.completion.buffers) {
+			std::cout << "Unexpected completion statistics" << std::endl;
+			return TestFail;
+		}
+
+		capture_->resetLatencyStatistics();
+		if (capture_->latencyStatistics().dispatch.buffers) {
+			std::cout << "Failed to reset statistics" << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+};
+
+TEST_REGISTER(CaptureLatencyTest)
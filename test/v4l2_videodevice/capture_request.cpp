@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * libcamera V4L2 media request capture test
+ */
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+#include <libcamera/framebuffer.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "libcamera/internal/media_request.h"
+
+#include "v4l2_videodevice_test.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+class CaptureRequestTest : public V4L2VideoDeviceTest
+{
+public:
+	CaptureRequestTest()
+		: V4L2VideoDeviceTest("vivid", "vivid-000-vid-cap"), frames_(0),
+		  completed_(0), mismatches_(0)
+	{
+	}
+
+	void receiveBuffer([[maybe_unused]] FrameBuffer *buffer)
+	{
+		frames_++;
+	}
+
+	void requestComplete(MediaRequest *request)
+	{
+		completed_++;
+
+		/* The request must have applied the brightness it carried. */
+		ControlList ctrls = capture_->getControls({ V4L2_CID_BRIGHTNESS },
+							  request);
+		if (ctrls.empty() ||
+		    ctrls.get(V4L2_CID_BRIGHTNESS).get<int32_t>() !=
+			    static_cast<int32_t>(request->cookie()))
+			mismatches_++;
+	}
+
+protected:
+	int run()
+	{
+		const unsigned int bufferCount = 4;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		std::vector<std::unique_ptr<MediaRequest>> requests;
+		Timer timeout;
+		int ret;
+
+		ret = capture_->allocateBuffers(bufferCount, &buffers_);
+		if (ret < 0) {
+			std::cout << "Failed to allocate buffers" << std::endl;
+			return TestFail;
+		}
+
+		if (!capture_->supportsRequests()) {
+			std::cout << "Media requests not supported" << std::endl;
+			return TestSkip;
+		}
+
+		if (!media_->acquire())
+			return TestFail;
+
+		ret = media_->allocateRequests(bufferCount, &requests);
+		if (ret < 0) {
+			std::cout << "Failed to allocate requests" << std::endl;
+			media_->release();
+			return TestFail;
+		}
+
+		capture_->bufferReady.connect(this, &CaptureRequestTest::receiveBuffer);
+
+		for (unsigned int i = 0; i < bufferCount; i++) {
+			MediaRequest *request = requests[i].get();
+			int32_t brightness = 64 + i * 32;
+
+			request->setCookie(brightness);
+			request->completed.connect(this, &CaptureRequestTest::requestComplete);
+
+			ControlList ctrls(capture_->controls());
+			ctrls.set(V4L2_CID_BRIGHTNESS, brightness);
+
+			if (capture_->setControls(&ctrls, request) ||
+			    capture_->queueBuffer(buffers_[i].get(), request)) {
+				std::cout << "Failed to prepare request" << std::endl;
+				media_->release();
+				return TestFail;
+			}
+
+			if (request->queue()) {
+				std::cout << "Failed to queue request" << std::endl;
+				media_->release();
+				return TestFail;
+			}
+		}
+
+		ret = capture_->streamOn();
+		if (ret) {
+			media_->release();
+			return TestFail;
+		}
+
+		timeout.start(500ms * bufferCount);
+		while (timeout.isRunning()) {
+			dispatcher->processEvents();
+			if (completed_ == bufferCount && frames_ == bufferCount)
+				break;
+		}
+
+		ret = capture_->streamOff();
+		media_->release();
+		if (ret)
+			return TestFail;
+
+		if (completed_ != bufferCount || frames_ != bufferCount) {
+			std::cout << "Only " << completed_ << " requests and "
+				  << frames_ << " frames completed" << std::endl;
+			return TestFail;
+		}
+
+		if (mismatches_) {
+			std::cout << mismatches_ << " requests applied wrong controls"
+				  << std::endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<MediaRequest> &request : requests) {
+			if (request->status() != MediaRequest::Status::Complete ||
+			    request->reinit()) {
+				std::cout << "Failed to recycle request" << std::endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+	unsigned int completed_;
+	unsigned int mismatches_;
+};
+
+TEST_REGISTER(CaptureRequestTest)
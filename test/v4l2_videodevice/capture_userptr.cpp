@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * libcamera V4L2 user memory capture test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "v4l2_videodevice_test.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+class CaptureUserptrTest : public V4L2VideoDeviceTest
+{
+public:
+	CaptureUserptrTest()
+		: V4L2VideoDeviceTest("vivid", "vivid-000-vid-cap"), frames_(0)
+	{
+	}
+
+	void receiveBuffer(FrameBuffer *buffer)
+	{
+		if (buffer->metadata().status != FrameMetadata::FrameSuccess)
+			return;
+
+		frames_++;
+
+		capture_->queueBuffer(buffer);
+	}
+
+protected:
+	int run()
+	{
+		const unsigned int bufferCount = 4;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		std::vector<std::unique_ptr<uint8_t, decltype(&free)>> memory;
+		V4L2DeviceFormat format;
+		Timer timeout;
+		int ret;
+
+		if (capture_->getFormat(&format))
+			return TestFail;
+
+		ret = capture_->importBuffers(bufferCount, V4L2_MEMORY_USERPTR);
+		if (ret) {
+			std::cout << "USERPTR memory not supported" << std::endl;
+			return TestSkip;
+		}
+
+		/* Allocate page-aligned memory, as required by most drivers. */
+		const long pageSize = sysconf(_SC_PAGESIZE);
+
+		for (unsigned int i = 0; i < bufferCount; i++) {
+			std::vector<FrameBuffer::Plane> planes;
+
+			for (unsigned int p = 0; p < format.planesCount; p++) {
+				size_t length = format.planes[p].size;
+				void *mem = aligned_alloc(pageSize,
+							  (length + pageSize - 1) / pageSize * pageSize);
+				if (!mem)
+					return TestFail;
+
+				memset(mem, 0, length);
+				memory.emplace_back(static_cast<uint8_t *>(mem), &free);
+
+				FrameBuffer::Plane plane;
+				plane.offset = 0;
+				plane.length = length;
+				plane.address = mem;
+				planes.push_back(plane);
+			}
+
+			buffers_.push_back(std::make_unique<FrameBuffer>(planes));
+		}
+
+		capture_->bufferReady.connect(this, &CaptureUserptrTest::receiveBuffer);
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+			if (capture_->queueBuffer(buffer.get())) {
+				std::cout << "Failed to queue buffer" << std::endl;
+				return TestFail;
+			}
+		}
+
+		ret = capture_->streamOn();
+		if (ret)
+			return TestFail;
+
+		const unsigned int nFrames = 10;
+
+		timeout.start(500ms * nFrames);
+		while (timeout.isRunning()) {
+			dispatcher->processEvents();
+			if (frames_ > nFrames)
+				break;
+		}
+
+		ret = capture_->streamOff();
+		if (ret)
+			return TestFail;
+
+		if (frames_ < nFrames) {
+			std::cout << "Failed to capture " << nFrames
+				  << " frames within timeout." << std::endl;
+			return TestFail;
+		}
+
+		/* The vivid test pattern must have been written to user memory. */
+		const uint8_t *data = memory[0].get();
+		if (std::all_of(data, data + format.planes[0].size,
+				[](uint8_t v) { return v == 0; })) {
+			std::cout << "No data captured to user memory" << std::endl;
+			return TestFail;
+		}
+
+		/*
+		 * Release the buffers before freeing the memory they point to,
+		 * cleanup() would otherwise run too late.
+		 */
+		capture_->releaseBuffers();
+		buffers_.clear();
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+};
+
+TEST_REGISTER(CaptureUserptrTest)
@@ -10,6 +10,9 @@
 #include <iostream>
 #include <limits.h>
 
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+
 #include "libcamera/internal/v4l2_videodevice.h"
 
 #include "v4l2_videodevice_test.h"
@@ -134,6 +137,49 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Test deferred writes, through a second instance that has its
+		 * own file handle and doesn't see the pending writes.
+		 */
+		V4L2VideoDevice reader(capture_->deviceNode());
+		if (reader.open()) {
+			cerr << "Failed to open second instance" << endl;
+			return TestFail;
+		}
+
+		const int32_t value = brightness.min().get<int32_t>() + 1;
+		ControlList deferred(infoMap);
+
+		deferred.set(V4L2_CID_BRIGHTNESS, brightness.max());
+		capture_->setControlsDeferred(deferred);
+		deferred.set(V4L2_CID_BRIGHTNESS, value);
+		capture_->setControlsDeferred(deferred);
+
+		Thread::current()->eventDispatcher()->processEvents();
+
+		ctrls = reader.getControls({ V4L2_CID_BRIGHTNESS });
+		if (ctrls.empty() || ctrls.get(V4L2_CID_BRIGHTNESS).get<int32_t>() != value) {
+			cerr << "Deferred controls not written" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Change the control through the second instance, the cached
+		 * value must not prevent writing it back.
+		 */
+		ctrls.set(V4L2_CID_BRIGHTNESS, brightness.max());
+		if (reader.setControls(&ctrls) ||
+		    capture_->setControls(&deferred)) {
+			cerr << "Failed to set controls" << endl;
+			return TestFail;
+		}
+
+		ctrls = reader.getControls({ V4L2_CID_BRIGHTNESS });
+		if (ctrls.empty() || ctrls.get(V4L2_CID_BRIGHTNESS).get<int32_t>() != value) {
+			cerr << "Control write skipped with stale cache" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
@@ -5,6 +5,8 @@
  * libcamera V4L2 API tests
  */
 
+#include <iostream>
+
 #include "v4l2_videodevice_test.h"
 
 class RequestBuffersTest : public V4L2VideoDeviceTest
@@ -22,6 +24,24 @@ protected:
 		if (ret != bufferCount)
 			return TestFail;
 
+		/* Grow the set of buffers and shrink it back. */
+		const unsigned int addCount = 2;
+
+		ret = capture_->addBuffers(addCount, &buffers_);
+		if (ret != addCount || buffers_.size() != bufferCount + addCount) {
+			std::cerr << "Failed to add buffers" << std::endl;
+			return TestFail;
+		}
+
+		ret = capture_->removeBuffers(addCount, &buffers_);
+		if (ret == -ENOTSUP)
+			return TestPass;
+
+		if (ret || buffers_.size() != bufferCount) {
+			std::cerr << "Failed to remove buffers" << std::endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
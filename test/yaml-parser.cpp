@@ -6,6 +6,8 @@
  */
 
 #include <array>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <string>
@@ -279,6 +281,101 @@ protected:
 		return TestPass;
 	}
 
+	bool compareObjects(const YamlObject &a, const YamlObject &b)
+	{
+		if (a.isValue() != b.isValue() || a.isList() != b.isList() ||
+		    a.isDictionary() != b.isDictionary())
+			return false;
+
+		if (a.isValue())
+			return a.get<string>() == b.get<string>();
+
+		if (a.size() != b.size())
+			return false;
+
+		if (a.isList()) {
+			for (size_t i = 0; i < a.size(); i++) {
+				if (!compareObjects(a[i], b[i]))
+					return false;
+			}
+
+			return true;
+		}
+
+		auto itB = b.asDict().begin();
+		for (const auto &[key, value] : a.asDict()) {
+			const auto &[keyB, valueB] = *itB;
+			if (key != keyB || !compareObjects(value, valueB))
+				return false;
+			++itB;
+		}
+
+		return true;
+	}
+
+	std::unique_ptr<YamlObject> parseFile(const string &filename)
+	{
+		File file{ filename };
+		if (!file.open(File::OpenModeFlag::ReadOnly))
+			return nullptr;
+
+		return YamlParser::parse(file);
+	}
+
+	int testCache(const YamlObject &reference)
+	{
+		string cacheDir = "/tmp/libcamera.test.XXXXXX";
+		if (!mkdtemp(&cacheDir.front())) {
+			cerr << "Failed to create cache directory" << std::endl;
+			return TestFail;
+		}
+
+		setenv("LIBCAMERA_YAML_CACHE", cacheDir.c_str(), 1);
+
+		int ret = TestFail;
+
+		/* The first parse fills the cache, the second one uses it. */
+		for (unsigned int i = 0; i < 2; i++) {
+			std::unique_ptr<YamlObject> root = parseFile(testYamlFile_);
+			if (!root || !compareObjects(reference, *root)) {
+				cerr << "Cached YAML document differs (pass " << i
+				     << ")" << std::endl;
+				goto done;
+			}
+		}
+
+		/* Modifying the file must invalidate the cache. */
+		{
+			ofstream file(testYamlFile_, ios::trunc);
+			file << "modified: true\n";
+			file.close();
+			if (!file) {
+				cerr << "Failed to modify test YAML file" << std::endl;
+				goto done;
+			}
+		}
+
+		{
+			std::unique_ptr<YamlObject> root = parseFile(testYamlFile_);
+			if (!root || !root->contains("modified") ||
+			    root->contains("string")) {
+				cerr << "Stale cache entry used" << std::endl;
+				goto done;
+			}
+		}
+
+		ret = TestPass;
+
+	done:
+		unsetenv("LIBCAMERA_YAML_CACHE");
+
+		for (const auto &entry : std::filesystem::directory_iterator(cacheDir))
+			unlink(entry.path().c_str());
+		rmdir(cacheDir.c_str());
+
+		return ret;
+	}
+
 	int run()
 	{
 		/* Test invalid YAML file */
@@ -557,7 +654,8 @@ protected:
 			return TestFail;
 		}
 
-		return TestPass;
+		/* Test the binary cache of parsed documents */
+		return testCache(*root);
 	}
 
 	void cleanup()
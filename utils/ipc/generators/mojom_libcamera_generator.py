@@ -258,6 +258,14 @@ def IsPod(element):
 def IsStr(element):
     return element.kind.spec == 's'
 
+# Structs made of PODs and enums only can be serialized with a memory copy when
+# their layout has no padding, which is checked at compile time
+def IsTriviallySerializable(element):
+    if not mojom.IsStructKind(element) or not element.fields:
+        return False
+    return all(IsPod(field) or (IsEnum(field) and not IsFlags(field))
+               for field in element.fields)
+
 def BitWidth(element):
     if element.kind in _bit_widths:
         return _bit_widths[element.kind]
@@ -443,6 +451,7 @@ class Generator(generator.Generator):
             'is_pod': IsPod,
             'is_scoped': IsScoped,
             'is_str': IsStr,
+            'is_trivially_serializable': IsTriviallySerializable,
             'method_input_has_fd': MethodInputHasFd,
             'method_output_has_fd': MethodOutputHasFd,
             'method_param_names': MethodParamNames,